@@ -178,7 +178,7 @@ function follow_accurate ()
    local goal = ai.follow_accurate(target, mem.radius, 
          mem.angle, mem.Kp, mem.Kd)
 
-   local mod = vec2.mod(goal - p:pos())
+   local mod = goal:dist(p:pos())
 
    --  Always face the goal
    local dir   = ai.face(goal)
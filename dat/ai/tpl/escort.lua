@@ -15,5 +15,5 @@ end
 
 -- Just tries to guard mem.escort
 function idle ()
-   ai.pushtask("follow_fleet")
+   ai.pushtask("native_follow_fleet")
 end
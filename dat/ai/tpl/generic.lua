@@ -181,7 +181,7 @@ function control ()
          taunt(enemy, true)
          ai.pushtask("attack", enemy)
       elseif ai.pilot():leader() and ai.pilot():leader():exists() then
-         ai.pushtask("follow_fleet")
+         ai.pushtask("native_follow_fleet")
       else
          idle()
       end
@@ -90,6 +90,9 @@ function create()
    -- Bottom bar
    --gui.viewport( 0, 20, screen_w, screen_h-20 )
 
+   -- Elements drawn without going through render()
+   create_elements()
+
    -- Update stuff
    update_cargo()
    update_nav()
@@ -103,6 +106,33 @@ function relativize( x, y )
 end
 
 
+--[[
+-- @brief Creates the parts of the GUI that only change through bound values or update functions.
+--]]
+function create_elements ()
+   gui.elemTex( frame, frame_x, frame_y )
+   gui.elemRadar( radar_x, radar_y )
+
+   -- Health
+   gui.elemBar( shield_x, shield_y, shield_w, shield_h, shield_col, "shield" )
+   gui.elemBar( armour_x, armour_y, armour_w, armour_h, armour_col, "armour" )
+   gui.elemBar( energy_x, energy_y, energy_w, energy_h, energy_col, "energy", energy )
+   gui.elemBar( fuel_x, fuel_y, fuel_w, fuel_h, fuel_col, "fuel", fuel )
+
+   -- Misc
+   local h = 5 + smallfont_h
+   local y = misc_y - h
+   gui.elemText( true, "Creds:", misc_x, y, col_console, misc_w )
+   gui.elemText( true, "", misc_x, y, col_white, misc_w-3, "right", "credits" )
+   y = y - h
+   gui.elemText( true, "Cargo Free:", misc_x, y, col_console, misc_w )
+   gui.elemText( true, "", misc_x, y, col_white, misc_w-3, "right", "cargo_free" )
+   y = y - 5
+   h = misc_h - 2*h - 8
+   misc_cargo_elem = gui.elemTextBlock( true, "", misc_x+13., y-h, misc_w-15., h, col_white )
+end
+
+
 --[[
 -- @brief This function is run whenever the player changes nav target (be in hyperspace or planet target).
 --]]
@@ -157,6 +187,7 @@ function update_cargo ()
       end
       misc_cargo = misc_cargo .. "\n"
    end
+   gui.elemSetText( misc_cargo_elem, misc_cargo )
 end
 
 
@@ -175,14 +206,10 @@ end
       @param dt Current deltatick in seconds since last render.
 --]]
 function render( dt )
-   gfx.renderTex( frame, frame_x, frame_y )
-   gui.radarRender( radar_x, radar_y )
    render_border()
    render_nav()
-   render_health()
    render_weapon()
    render_target()
-   render_misc()
    render_warnings()
 end
 
@@ -235,18 +262,6 @@ function update_faction()
 end
 
 
--- Renders the health bars
-function render_health ()
-   local arm, shi = pp:health()
-   gfx.renderRect( shield_x, shield_y, shi/100.*shield_w, shield_h, shield_col )
-   gfx.renderRect( armour_x, armour_y, arm/100.*armour_w, armour_h, armour_col )
-   local ene = pp:energy() / 100
-   gfx.renderTexRaw( energy, energy_x, energy_y, ene*energy_w, energy_h, 1, 1, 0, 0, ene, 1, energy_col )
-   local fue = player.fuel() / fuel_max
-   gfx.renderTexRaw( fuel, fuel_x, fuel_y, fue*fuel_w, fuel_h, 1, 1, 0, 0, fue, 1, fuel_col )
-end
-
-
 -- Renders the weapon systems
 function render_weapon ()
    col = col_console
@@ -355,25 +370,6 @@ function render_targetnone ()
 end
 
 
--- Renders the miscellaneous stuff
-function render_misc ()
-   _, creds = player.credits(2)
-   h = 5 + smallfont_h
-   y = misc_y - h
-   gfx.print( true, "Creds:", misc_x, y, col_console, misc_w, false )
-   w = gfx.printDim( true, creds )
-   gfx.print( true, creds, misc_x+misc_w-w-3, y, col_white, misc_w, false )
-   y = y - h
-   gfx.print( true, "Cargo Free:", misc_x, y, col_console, misc_w, false )
-   local free = string.format("%d" .. "t", pp:cargoFree())
-   w = gfx.printDim( true, free )
-   gfx.print( true, free, misc_x+misc_w-w-3, y, col_white, misc_w, false )
-   y = y - 5
-   h = misc_h - 2*h - 8
-   gfx.printText( true, misc_cargo, misc_x+13., y-h, misc_w-15., h, col_white )
-end
-
-
 -- Renders the warnings like system volatility
 function render_warnings ()
    -- Render warnings
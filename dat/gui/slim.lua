@@ -968,7 +968,7 @@ function render( dt, dt_mod )
       end
 
       x1, y1 = vec2.get(planet.pos)
-      x2, y2 = vec2.get(player.pilot():pos())
+      x2, y2 = player.pilot():posxy()
       ta_pnt_dir = math.atan2(y2 - y1, x2 - x1) + math.pi
 
       -- Render dir sprite.
@@ -31,6 +31,11 @@
  *     - if Task is NULL, AI will run "control" task
  *     - Task is continued every frame
  *     - Tasks can have subtasks which will be closed when parent task is dead.
+ *     - Tasks named in ai_natives (native_attack, native_follow,
+ *       native_follow_fleet, native_goto, native_hyperspace...) run in C
+ *       without entering Lua
+ *     - With conf.ai_parallel the steering of most native tasks is left to
+ *       the worker threads, see ai_frameEnd()
  *     -  "control" task is a special task that MUST exist in any given  Pilot AI
  *        (missiles and such will use "seek")
  *     - "control" task is not permanent, but transitory
@@ -64,6 +69,8 @@
 
 #include "naev.h"
 
+#include "SDL.h"
+
 #include <stdlib.h>
 #include <stdio.h> /* malloc realloc */
 #include <math.h>
@@ -90,9 +97,12 @@
 #include "nlua_pilot.h"
 #include "nlua_planet.h"
 #include "nlua_faction.h"
+#include "nlua_jump.h"
 #include "board.h"
 #include "hook.h"
 #include "array.h"
+#include "conf.h"
+#include "threadpool.h"
 
 
 /*
@@ -114,6 +124,83 @@
  */
 #define AI_SUFFIX       ".lua" /**< AI file suffix. */
 #define AI_MEM_DEF      "def" /**< Default pilot memory. */
+#define AI_MEM_POOL     128 /**< Maximum number of pilot memory tables kept for reuse. */
+
+
+/*
+ * level of detail
+ *
+ * Pilots far from the player only run their task every so often, holding
+ *  their last outputs in between.
+ */
+#define AI_LOD_NEAR     2.    /**< Sensor range multiplier within which the AI runs every frame. */
+#define AI_LOD_MID      4.    /**< Sensor range multiplier within which the AI runs at AI_LOD_MID_RATE. */
+#define AI_LOD_MID_RATE 0.1   /**< Seconds between AI ticks of mid range pilots. */
+#define AI_LOD_FAR_RATE 0.25  /**< Seconds between AI ticks of far pilots. */
+#define AI_LOD_BUDGET   0.004 /**< Lua AI seconds per frame after which LOD pilots are deferred. */
+
+
+/*
+ * equipment cache
+ *
+ * Each pilot rolls one of AI_EQUIP_POOL buckets for its faction and ship. The
+ *  first pilot to roll a bucket runs the equipper and its loadout becomes the
+ *  bucket's template, the next ones copy the template instead of running Lua.
+ *  A few pilots still get equipped live so loadouts keep some variety.
+ */
+#define AI_EQUIP_POOL   8 /**< Loadout buckets per faction and ship. */
+#define AI_EQUIP_LIVE   0.1 /**< Chance of equipping live even if the bucket is built. */
+
+
+/*
+ * parallel steering
+ */
+#define AI_STEER_GRAIN  16 /**< Minimum pilots steered per job. */
+
+
+/**
+ * @brief Outfits an equipper put on a ship.
+ */
+typedef struct AI_Loadout_ {
+   Outfit **outfits; /**< Outfit of each slot, NULL if the bucket isn't built. */
+   Outfit **ammo; /**< Ammo of each slot, NULL if none. */
+   int *nammo; /**< Amount of ammo of each slot. */
+} AI_Loadout;
+
+
+/**
+ * @brief Loadouts built for a faction and ship.
+ */
+typedef struct AI_EquipCache_ {
+   int faction; /**< Faction of the equipper, -1 is the generic one. */
+   const Ship *ship; /**< Ship equipped. */
+   int nslots; /**< Number of outfit slots of the ship. */
+   AI_Loadout loadouts[AI_EQUIP_POOL]; /**< Loadout template of each bucket. */
+} AI_EquipCache;
+
+
+/**
+ * @brief Command buffer of a pilot steered by a native task.
+ *
+ * Targets are resolved into it beforehand on the main thread, so steering
+ *  only reads the pilot being steered and the buffer, and only writes to
+ *  them. What the steering commands is applied afterwards on the main thread.
+ */
+typedef struct AI_Steer_ {
+   Pilot *p; /**< Pilot being steered. */
+   Task *t; /**< Native task steering. */
+   const struct AI_NativeTask_ *nat; /**< Native task definition. */
+   Vector2d pos; /**< Position of the target. */
+   Vector2d vel; /**< Velocity of the target. */
+   double acc; /**< Acceleration commanded. */
+   double turn; /**< Turn commanded. */
+   int flags; /**< AI flags commanded. */
+   int done; /**< Whether the task is done. */
+   const char *push; /**< Native task to push once done steering, NULL for none. */
+   int push_sub; /**< Whether to push it as a subtask. */
+} AI_Steer;
+typedef int (*AI_SteerResolve)( AI_Steer *s ); /**< Resolves the target, returns 0 if it can steer. */
+typedef void (*AI_SteerFunc)( AI_Steer *s ); /**< Steers, safe to run off the main thread. */
 
 
 /*
@@ -121,6 +208,11 @@
  */
 static AI_Profile* profiles = NULL; /**< Array of AI_Profiles loaded. */
 static nlua_env equip_env = LUA_NOREF; /**< Equipment enviornment. */
+static AI_EquipCache *equip_cache = NULL; /**< Loadouts built by the equippers. */
+static double ai_frameTime = 0.; /**< Lua AI time spent in the current frame. */
+static int ai_memPool = LUA_NOREF; /**< Registry reference to cleared pilot memory tables. */
+static int ai_memPoolN = 0; /**< Number of tables in the memory pool. */
+static AI_Steer *ai_steers = NULL; /**< Pilots steered at the end of the frame. */
 
 
 /*
@@ -134,16 +226,75 @@ extern int pilot_nstack;
  * prototypes
  */
 /* Internal C routines */
-static void ai_run( nlua_env env, const char *funcname );
+static void ai_run( nlua_env env, int ref, const char *funcname );
 static int ai_loadProfile( const char* filename );
+static void ai_profileResolve( AI_Profile *prof );
+static void ai_profileFree( AI_Profile *prof );
+static int ai_funcRef( const AI_Profile *prof, const char *name );
+static AI_EquipCache* ai_equipCache( int faction, const Ship *ship );
+static void ai_equipSave( AI_Loadout *l, int nslots, const Pilot *p );
+static void ai_equipApply( const AI_Loadout *l, Pilot *p );
+static void ai_equipFree (void);
 static void ai_setMemory (void);
 static void ai_create( Pilot* pilot );
+static void ai_memPush (void);
+static void ai_memRecycle (void);
 static int ai_loadEquip (void);
+static double ai_costNearest( const Pilot *t, double d2, void *data );
+static double ai_clock (void);
+static double ai_lodRate( const Pilot *p );
+static void ai_lodHold( Pilot *p );
+/* Steering shared between bindings and native tasks. */
+static double ai_face( const Vector2d *tv, int invert, int vel );
+static double ai_faceFrom( const Pilot *self, const Vector2d *tv,
+      int invert, int vel, double *turn );
+static double ai_aim( const Pilot *p );
+static double ai_aimAt( Pilot *self, const Vector2d *pos,
+      const Vector2d *vel, double *turn );
+static double ai_minbrakedist( const Pilot *p );
+static double ai_minbrakedistFrom( const Pilot *self, const Pilot *p );
+static int ai_brake (void);
+static int ai_brakeFrom( Pilot *self, double *acc, double *turn );
+static JumpPoint* ai_nearJump (void);
+static JumpPoint* ai_rndJump (void);
+static void ai_setJump( const JumpPoint *jp, Vector2d *vec );
 /* Task management. */
 static void ai_taskGC( Pilot* pilot );
 static Task* ai_curTask( Pilot* pilot );
 static Task* ai_createTask( lua_State *L, int subtask );
 static int ai_tasktarget( lua_State *L, Task *t );
+static void ai_popsubtask( Task *t );
+static void ai_runTask( nlua_env env, Task *t );
+static void ai_thinkApply (void);
+/* Native tasks. */
+static Task* ai_newtaskVector( const char *func, int subtask, const Vector2d *v );
+static Pilot* ai_taskPilot( Task *t );
+static int ai_taskVector( Task *t, Vector2d *v );
+static void ai_nativeDone( Task *t );
+static void ai_nativeSteer( Task *t, AI_SteerResolve resolve, AI_SteerFunc steer );
+static void ai_steerInit( AI_Steer *s, Pilot *p, Task *t );
+static void ai_steerFinish( AI_Steer *s );
+static int ai_steerQueue( Task *t );
+static void ai_steerRange( int start, int end, void *data );
+static int ai_resolvePilot( AI_Steer *s );
+static int ai_resolveAttack( AI_Steer *s );
+static int ai_resolveFleet( AI_Steer *s );
+static int ai_resolveVector( AI_Steer *s );
+static void ai_steerAttack( AI_Steer *s );
+static void ai_steerFollow( AI_Steer *s );
+static void ai_steerGoto( AI_Steer *s );
+static void ai_steerBrake( AI_Steer *s );
+static void ai_steerHypApproach( AI_Steer *s );
+static void ai_steerHypBrake( AI_Steer *s );
+static void ai_nativeAttack( Task *t );
+static void ai_nativeFollow( Task *t );
+static void ai_nativeFollowFleet( Task *t );
+static void ai_nativeGoto( Task *t );
+static void ai_nativeBrake( Task *t );
+static void ai_nativeHyperspace( Task *t );
+static void ai_nativeHypApproach( Task *t );
+static void ai_nativeHypBrake( Task *t );
+static void ai_nativeHypJump( Task *t );
 
 
 
@@ -195,6 +346,8 @@ static int aiL_land( lua_State *L ); /* bool land() */
 static int aiL_stop( lua_State *L ); /* stop() */
 static int aiL_relvel( lua_State *L ); /* relvel( number ) */
 static int aiL_follow_accurate( lua_State *L ); /* follow_accurate() */
+static void ai_followAccurate( const Pilot *target, double radius, double angle,
+      double Kp, double Kd, const char *method, Vector2d *goal );
 
 /* Hyperspace. */
 static int aiL_sethyptarget( lua_State *L );
@@ -242,6 +395,29 @@ static int aiL_refuel( lua_State *L ); /* boolean, boolean refuel() */
 static int aiL_messages( lua_State *L );
 
 
+/**
+ * @brief Task implemented in C, pushed from Lua by name like any other task.
+ */
+typedef struct AI_NativeTask_ {
+   const char *name; /**< Name Lua pushes the task with. */
+   AI_TaskFunc func; /**< Function running the task. */
+   AI_SteerResolve resolve; /**< Resolves what the task steers to, NULL if nothing. */
+   AI_SteerFunc steer; /**< Steering that can run off the main thread, NULL if none. */
+} AI_NativeTask;
+static const AI_NativeTask ai_natives[] = {
+   { "native_attack", ai_nativeAttack, ai_resolveAttack, ai_steerAttack },
+   { "native_follow", ai_nativeFollow, ai_resolvePilot, ai_steerFollow },
+   { "native_follow_fleet", ai_nativeFollowFleet, ai_resolveFleet, ai_steerFollow },
+   { "native_goto", ai_nativeGoto, ai_resolveVector, ai_steerGoto },
+   { "native_brake", ai_nativeBrake, NULL, ai_steerBrake },
+   { "native_hyperspace", ai_nativeHyperspace, NULL, NULL },
+   { "native_hyp_approach", ai_nativeHypApproach, ai_resolveVector, ai_steerHypApproach },
+   { "native_hyp_brake", ai_nativeHypBrake, NULL, ai_steerHypBrake },
+   { "native_hyp_jump", ai_nativeHypJump, NULL, NULL },
+   { NULL, NULL, NULL, NULL }
+}; /**< Tasks that run without entering Lua. */
+
+
 static const luaL_reg aiL_methods[] = {
    /* tasks */
    { "pushtask", aiL_pushtask },
@@ -420,26 +596,81 @@ void ai_setPilot( Pilot *p )
 /**
  * @brief Attempts to run a function.
  *
- *    @param[in] L Lua state to run function on.
- *    @param[in] funcname Function to run.
+ *    @param[in] env Environment of the function.
+ *    @param[in] ref Registry reference of the function, see ai_funcRef().
+ *    @param[in] funcname Name of the function, for messages.
  */
-static void ai_run( nlua_env env, const char *funcname )
+static void ai_run( nlua_env env, int ref, const char *funcname )
 {
-   nlua_getenv(env, funcname);
+   double t0;
 
-#ifdef DEBUGGING
-   if (lua_isnil(naevL, -1)) {
+   if (ref == LUA_NOREF) {
       WARN("Pilot '%s' ai -> '%s': attempting to run non-existant function",
             cur_pilot->name, funcname );
-      lua_pop(naevL,1);
       return;
    }
-#endif /* DEBUGGING */
+
+   t0 = nlua_profStart();
+   lua_rawgeti(naevL, LUA_REGISTRYINDEX, ref);
 
    if (nlua_pcall(env, 0, 0)) { /* error has occurred */
       WARN("Pilot '%s' ai -> '%s': %s", cur_pilot->name, funcname, lua_tostring(naevL,-1));
       lua_pop(naevL,1);
    }
+
+   nlua_profStop( t0, "ai:%s:%s", cur_pilot->ai->name, funcname );
+}
+
+
+/**
+ * @brief Pushes an empty pilot memory table, reusing a pooled one if possible.
+ */
+static void ai_memPush (void)
+{
+   if (ai_memPoolN <= 0) {
+      lua_newtable(naevL);
+      return;
+   }
+
+   lua_rawgeti(naevL, LUA_REGISTRYINDEX, ai_memPool); /* pool */
+   lua_rawgeti(naevL, -1, ai_memPoolN);   /* pool, m */
+   lua_pushnil(naevL);                    /* pool, m, nil */
+   lua_rawseti(naevL, -3, ai_memPoolN);   /* pool, m */
+   lua_remove(naevL, -2);                 /* m */
+   ai_memPoolN--;
+}
+
+
+/**
+ * @brief Pops a pilot memory table off the stack, clearing it into the pool.
+ *
+ * Clearing keeps the table's storage around so the next pilot does not have
+ *  to grow it again. Memory tables must not be used once their pilot is gone.
+ */
+static void ai_memRecycle (void)
+{
+   if (!lua_istable(naevL, -1) || (ai_memPoolN >= AI_MEM_POOL)) {
+      lua_pop(naevL, 1);
+      return;
+   }
+
+   /* Clear the table, setting existing fields to nil while traversing is allowed. */
+   lua_pushnil(naevL);                    /* m, nil */
+   while (lua_next(naevL, -2) != 0) {     /* m, k, v */
+      lua_pop(naevL, 1);                  /* m, k */
+      lua_pushvalue(naevL, -1);           /* m, k, k */
+      lua_pushnil(naevL);                 /* m, k, k, nil */
+      lua_rawset(naevL, -4);              /* m, k */
+   }                                      /* m */
+
+   if (ai_memPool == LUA_NOREF) {
+      lua_newtable(naevL);
+      ai_memPool = luaL_ref(naevL, LUA_REGISTRYINDEX);
+   }
+   lua_rawgeti(naevL, LUA_REGISTRYINDEX, ai_memPool); /* m, pool */
+   lua_insert(naevL, -2);                 /* pool, m */
+   lua_rawseti(naevL, -2, ++ai_memPoolN); /* pool */
+   lua_pop(naevL, 1);                     /* */
 }
 
 
@@ -453,11 +684,33 @@ static void ai_run( nlua_env env, const char *funcname )
  *    @return 0 on success.
  */
 int ai_pinit( Pilot *p, const char *ai )
+{
+   return ai_pinitBatch( &p, 1, ai );
+}
+
+
+/**
+ * @brief Initializes a group of pilots in the same ai.
+ *
+ * The profile and its default memory are only looked up once, the pilots
+ *  are then created in order.
+ *
+ *    @param p Pilots to initialize in AI.
+ *    @param n Number of pilots.
+ *    @param ai AI to initialize pilots.
+ *    @return 0 on success.
+ */
+int ai_pinitBatch( Pilot **p, int n, const char *ai )
 {
    AI_Profile *prof;
    char buf[PATH_MAX];
+   int i;
+
+   if (n <= 0)
+      return 0;
 
    strncpy(buf, ai, sizeof(buf));
+   buf[sizeof(buf)-1] = '\0';
 
    /* Set up the profile. */
    prof = ai_getProfile(buf);
@@ -466,39 +719,47 @@ int ai_pinit( Pilot *p, const char *ai )
       nsnprintf(buf, sizeof(buf), "dummy" );
       prof = ai_getProfile(buf);
    }
-   p->ai = prof;
 
-   /* Adds a new pilot memory in the memory table. */
-   nlua_getenv(p->ai->env, AI_MEM);  /* pm */
-   lua_newtable(naevL);              /* pm, nt */
-   lua_pushvalue(naevL, -1);         /* pm, nt, nt */
-   lua_rawseti(naevL, -3, p->id);    /* pm, nt */
-
-   /* Copy defaults over. */
-   lua_pushstring(naevL, AI_MEM_DEF);/* pm, nt, s */
-   lua_gettable(naevL, -3);          /* pm, nt, dt */
+   /* Get the memory table and defaults. */
+   nlua_getenv(prof->env, AI_MEM);   /* pm */
+   lua_pushstring(naevL, AI_MEM_DEF);/* pm, s */
+   lua_gettable(naevL, -2);          /* pm, dt */
 #if DEBUGGING
    if (lua_isnil(naevL,-1))
       WARN( "AI profile '%s' has no default memory for pilot '%s'.",
-            buf, p->name );
+            buf, p[0]->name );
 #endif
-   lua_pushnil(naevL);               /* pm, nt, dt, nil */
-   while (lua_next(naevL,-2) != 0) { /* pm, nt, dt, k, v */
-      lua_pushvalue(naevL,-2);       /* pm, nt, dt, k, v, k */
-      lua_pushvalue(naevL,-2);       /* pm, nt, dt, k, v, k, v */
-      lua_remove(naevL, -3);         /* pm, nt, dt, k, k, v */
-      lua_settable(naevL,-5);        /* pm, nt, dt, k */
-   }                             /* pm, nt, dt */
-   lua_pop(naevL,3);                 /* */
 
-   /* Create the pilot. */
-   ai_create( p );
-   pilot_setFlag(p, PILOT_CREATED_AI);
+   /* Adds a new pilot memory in the memory table for each. */
+   for (i=0; i<n; i++) {
+      p[i]->ai = prof;
+      ai_memPush();                     /* pm, dt, nt */
+      lua_pushvalue(naevL, -1);         /* pm, dt, nt, nt */
+      lua_rawseti(naevL, -4, p[i]->id); /* pm, dt, nt */
+
+      /* Copy defaults over. */
+      if (lua_istable(naevL,-2)) {
+         lua_pushnil(naevL);               /* pm, dt, nt, nil */
+         while (lua_next(naevL,-3) != 0) { /* pm, dt, nt, k, v */
+            lua_pushvalue(naevL,-2);       /* pm, dt, nt, k, v, k */
+            lua_insert(naevL,-2);          /* pm, dt, nt, k, k, v */
+            lua_settable(naevL,-4);        /* pm, dt, nt, k */
+         }                                 /* pm, dt, nt */
+      }
+      lua_pop(naevL,1);                 /* pm, dt */
+   }
+   lua_pop(naevL,2);                    /* */
+
+   for (i=0; i<n; i++) {
+      /* Create the pilot. */
+      ai_create( p[i] );
+      pilot_setFlag(p[i], PILOT_CREATED_AI);
 
-   /* Set fuel.  Hack until we do it through AI itself. */
-   if (!pilot_isPlayer(p)) {
-      p->fuel  = (RNG_2SIGMA()/4. + 0.5) * (p->fuel_max - p->fuel_consumption);
-      p->fuel += p->fuel_consumption;
+      /* Set fuel.  Hack until we do it through AI itself. */
+      if (!pilot_isPlayer(p[i])) {
+         p[i]->fuel  = (RNG_2SIGMA()/4. + 0.5) * (p[i]->fuel_max - p[i]->fuel_consumption);
+         p[i]->fuel += p[i]->fuel_consumption;
+      }
    }
 
    return 0;
@@ -532,6 +793,8 @@ void ai_destroy( Pilot* p )
    /* Get rid of pilot's memory. */
    if (!pilot_isPlayer(p)) { /* Player is an exception as more than one ship shares pilot id. */
       nlua_getenv(env, AI_MEM);  /* t */
+      lua_rawgeti(naevL, -1, p->id); /* t, m */
+      ai_memRecycle();           /* t */
       lua_pushnil(naevL);        /* t, nil */
       lua_rawseti(naevL,-2, p->id);/* t */
       lua_pop(naevL, 1);         /* */
@@ -597,6 +860,7 @@ static int ai_loadEquip (void)
    /* Make sure doesn't already exist. */
    if (equip_env != LUA_NOREF)
       nlua_freeEnv(equip_env);
+   ai_equipFree();
 
    /* Create new state. */
    equip_env = nlua_newEnv(1);
@@ -679,10 +943,89 @@ static int ai_loadProfile( const char* filename )
    }
    free(buf);
 
+   /* Entry points and tasks are looked up once. */
+   ai_profileResolve( prof );
+
    return 0;
 }
 
 
+/**
+ * @brief Keeps references to the functions and settings of a profile, so
+ *  running them doesn't look them up in the environment.
+ *
+ * Functions defined by the profile after loading aren't picked up.
+ *
+ *    @param prof Profile that was just loaded.
+ */
+static void ai_profileResolve( AI_Profile *prof )
+{
+   char *name;
+
+   nhash_init( &prof->funcs );
+   prof->funcnames = array_create( char* );
+
+   nlua_pushenv( prof->env );            /* env */
+   lua_pushnil( naevL );                 /* env, nil */
+   while (lua_next( naevL, -2 ) != 0) {  /* env, k, v */
+      if ((lua_type( naevL, -2 ) != LUA_TSTRING) || !lua_isfunction( naevL, -1 )) {
+         lua_pop( naevL, 1 );            /* env, k */
+         continue;
+      }
+      name = strdup( lua_tostring( naevL, -2 ) );
+      array_push_back( &prof->funcnames, name );
+      nhash_set( &prof->funcs, name, luaL_ref( naevL, LUA_REGISTRYINDEX ) ); /* env, k */
+   }
+   lua_pop( naevL, 1 );                  /* */
+
+   prof->ref_control        = ai_funcRef( prof, "control" );
+   prof->ref_control_manual = ai_funcRef( prof, "control_manual" );
+   prof->ref_attacked       = ai_funcRef( prof, "attacked" );
+   prof->ref_create         = ai_funcRef( prof, "create" );
+   prof->ref_distress       = ai_funcRef( prof, "distress" );
+
+   nlua_getenv( prof->env, "control_rate" );
+   prof->control_rate = lua_tonumber( naevL, -1 );
+   lua_pop( naevL, 1 );
+}
+
+
+/**
+ * @brief Frees what ai_profileResolve() kept.
+ */
+static void ai_profileFree( AI_Profile *prof )
+{
+   int i;
+
+   for (i=0; i<array_size(prof->funcnames); i++) {
+      luaL_unref( naevL, LUA_REGISTRYINDEX,
+            nhash_get( &prof->funcs, prof->funcnames[i] ) );
+      free( prof->funcnames[i] );
+   }
+   array_free( prof->funcnames );
+   prof->funcnames = NULL;
+   nhash_free( &prof->funcs );
+}
+
+
+/**
+ * @brief Gets the registry reference of a function of a profile.
+ *
+ *    @param prof Profile to look in.
+ *    @param name Name of the function.
+ *    @return The reference or LUA_NOREF if the profile doesn't define it.
+ */
+static int ai_funcRef( const AI_Profile *prof, const char *name )
+{
+   int ref;
+
+   if (prof == NULL)
+      return LUA_NOREF;
+   ref = nhash_get( &prof->funcs, name );
+   return (ref < 0) ? LUA_NOREF : ref;
+}
+
+
 /**
  * @brief Gets the AI_Profile by name.
  *
@@ -715,6 +1058,7 @@ void ai_exit (void)
    /* Free AI profiles. */
    for (i=0; i<array_size(profiles); i++) {
       free(profiles[i].name);
+      ai_profileFree( &profiles[i] );
       nlua_freeEnv(profiles[i].env);
    }
    array_free( profiles );
@@ -723,6 +1067,128 @@ void ai_exit (void)
    if (equip_env != LUA_NOREF)
       nlua_freeEnv(equip_env);
    equip_env = LUA_NOREF;
+   ai_equipFree();
+
+   /* Free the memory pool. */
+   if (ai_memPool != LUA_NOREF)
+      luaL_unref(naevL, LUA_REGISTRYINDEX, ai_memPool);
+   ai_memPool  = LUA_NOREF;
+   ai_memPoolN = 0;
+
+   array_free( ai_steers );
+   ai_steers = NULL;
+}
+
+
+/**
+ * @brief Gets a high resolution clock in seconds.
+ *
+ *    @return Current time in seconds.
+ */
+static double ai_clock (void)
+{
+#if SDL_VERSION_ATLEAST(2,0,0)
+   return (double)SDL_GetPerformanceCounter() /
+         (double)SDL_GetPerformanceFrequency();
+#else /* SDL_VERSION_ATLEAST(2,0,0) */
+   return (double)SDL_GetTicks() / 1000.;
+#endif /* SDL_VERSION_ATLEAST(2,0,0) */
+}
+
+
+/**
+ * @brief Gets the time between AI ticks for a pilot.
+ *
+ *    @param p Pilot to get the AI tick rate of.
+ *    @return Seconds between ticks or 0. if it must think every frame.
+ */
+static double ai_lodRate( const Pilot *p )
+{
+   double d, r;
+
+   /* Pilots the player can affect directly always think. */
+   if ((player.p == NULL) || (p == player.p) ||
+         pilot_isFlag(p, PILOT_PLAYER) ||
+         pilot_isFlag(p, PILOT_MANUAL_CONTROL) ||
+         (p->parent == PLAYER_ID) ||
+         (p->target == PLAYER_ID))
+      return 0.;
+
+   /* Sensor range is squared. */
+   d = vect_dist2( &p->solid->pos, &player.p->solid->pos );
+   r = pilot_sensorRange();
+   if (d < pow2(AI_LOD_NEAR) * r)
+      return 0.;
+   if (d < pow2(AI_LOD_MID) * r)
+      return AI_LOD_MID_RATE;
+   return AI_LOD_FAR_RATE;
+}
+
+
+/**
+ * @brief Keeps a pilot doing what it did on its last AI tick.
+ *
+ * Turn and thrust are held by the solid, only firing has to be redone.
+ *
+ *    @param p Pilot to hold outputs of.
+ */
+static void ai_lodHold( Pilot *p )
+{
+   if (p->lod_flags & AI_PRIMARY)
+      pilot_shoot( p, 0 );
+   if (p->lod_flags & AI_SECONDARY)
+      pilot_shoot( p, 1 );
+}
+
+
+/**
+ * @brief Starts a new frame of AI, resetting the Lua AI time budget.
+ */
+void ai_frameStart (void)
+{
+   ai_frameTime = 0.;
+}
+
+
+/**
+ * @brief Steers the pilots queued while thinking and applies their commands.
+ *
+ * Must be called once all the pilots thought and before they are updated.
+ */
+void ai_frameEnd (void)
+{
+   int i, n;
+   AI_Steer *s;
+   Task *cur;
+
+   n = array_size( ai_steers );
+   if (n == 0)
+      return;
+
+   threadpool_parallelFor( n, AI_STEER_GRAIN, ai_steerRange, NULL );
+
+   for (i=0; i<n; i++) {
+      s = &ai_steers[i];
+
+      /* Lua that ran since may have changed the tasks. */
+      cur = ai_curTask( s->p );
+      if ((cur == NULL) || ((cur != s->t) && (cur->subtask != s->t)))
+         continue;
+
+      ai_setPilot( s->p );
+      pilot_acc   = s->acc;
+      pilot_turn  = s->turn;
+      pilot_flags = s->flags;
+      ai_steerFinish( s );
+
+      /* Manual control must check if IDLE hook has to be run. */
+      if (pilot_isFlag(cur_pilot, PILOT_MANUAL_CONTROL) &&
+            (ai_curTask( cur_pilot ) == NULL))
+         pilot_runHook( cur_pilot, PILOT_HOOK_IDLE );
+
+      ai_thinkApply();
+   }
+   array_resize( &ai_steers, 0 );
 }
 
 
@@ -734,14 +1200,28 @@ void ai_exit (void)
 void ai_think( Pilot* pilot, const double dt )
 {
    nlua_env env;
-   (void) dt;
+   double rate, t0;
 
-   Task *t;
+   Task *t, *run;
 
    /* Must have AI. */
-   if (cur_pilot->ai == NULL)
+   if (pilot->ai == NULL)
       return;
 
+   /* Distant pilots only tick every so often or when there is time left. */
+   rate = ai_lodRate( pilot );
+   if (rate > 0.) {
+      pilot->tlod -= dt;
+      if ((pilot->tlod > 0.) || (ai_frameTime > AI_LOD_BUDGET)) {
+         ai_lodHold( pilot );
+         return;
+      }
+      pilot->tlod = rate;
+   }
+   else
+      pilot->tlod = 0.;
+   t0 = ai_clock();
+
    ai_setPilot(pilot);
    env = cur_pilot->ai->env; /* set the AI profile to the current pilot's */
 
@@ -759,33 +1239,35 @@ void ai_think( Pilot* pilot, const double dt )
    if ((cur_pilot->tcontrol < 0.) || (t == NULL)) {
       if (pilot_isFlag(pilot,PILOT_PLAYER) ||
           pilot_isFlag(cur_pilot, PILOT_MANUAL_CONTROL)) {
-         nlua_getenv(env, "control_manual");
-         if (!lua_isnil(naevL, -1))
-            ai_run(env, "control_manual");
-         lua_pop(naevL, 1);
+         if (cur_pilot->ai->ref_control_manual != LUA_NOREF)
+            ai_run(env, cur_pilot->ai->ref_control_manual, "control_manual");
       } else {
-         ai_run(env, "control"); /* run control */
+         ai_run(env, cur_pilot->ai->ref_control, "control"); /* run control */
       }
 
-      nlua_getenv(env, "control_rate");
-      cur_pilot->tcontrol = lua_tonumber(naevL,-1);
-      lua_pop(naevL,1);
+      cur_pilot->tcontrol = cur_pilot->ai->control_rate;
 
       /* Task may have changed due to control tick. */
       t = ai_curTask( cur_pilot );
    }
 
    if (pilot_isFlag(pilot,PILOT_PLAYER) &&
-       !pilot_isFlag(cur_pilot, PILOT_MANUAL_CONTROL))
+       !pilot_isFlag(cur_pilot, PILOT_MANUAL_CONTROL)) {
+      ai_frameTime += ai_clock() - t0;
       return;
+   }
 
    /* pilot has a currently running task */
    if (t != NULL) {
       /* Run subtask if available, otherwise run main task. */
-      if (t->subtask != NULL)
-         ai_run(env, t->subtask->name);
-      else
-         ai_run(env, t->name);
+      run = (t->subtask != NULL) ? t->subtask : t;
+
+      /* Steering is left for the end of the frame. */
+      if (conf.ai_parallel && (ai_steerQueue( run ) == 0)) {
+         ai_frameTime += ai_clock() - t0;
+         return;
+      }
+      ai_runTask(env, run);
 
       /* Manual control must check if IDLE hook has to be run. */
       if (pilot_isFlag(cur_pilot, PILOT_MANUAL_CONTROL)) {
@@ -795,6 +1277,16 @@ void ai_think( Pilot* pilot, const double dt )
       }
    }
 
+   ai_thinkApply();
+   ai_frameTime += ai_clock() - t0;
+}
+
+
+/**
+ * @brief Applies what the current pilot's AI commanded.
+ */
+static void ai_thinkApply (void)
+{
    /* make sure pilot_acc and pilot_turn are legal */
    pilot_acc   = CLAMP( -1., 1., pilot_acc );
    pilot_turn  = CLAMP( -1., 1., pilot_turn );
@@ -808,6 +1300,7 @@ void ai_think( Pilot* pilot, const double dt )
       pilot_shoot(cur_pilot, 0); /* primary */
    if (ai_isFlag(AI_SECONDARY))
       pilot_shoot(cur_pilot, 1 ); /* secondary */
+   cur_pilot->lod_flags = pilot_flags & (AI_PRIMARY | AI_SECONDARY);
 
    /* other behaviours. */
    if (ai_isFlag(AI_DISTRESS))
@@ -846,7 +1339,9 @@ void ai_attacked( Pilot* attacked, const unsigned int attacker, double dmg )
 
    ai_setPilot( attacked ); /* Sets cur_pilot. */
 
-   nlua_getenv(cur_pilot->ai->env, "attacked");
+   if (cur_pilot->ai->ref_attacked == LUA_NOREF)
+      return;
+   lua_rawgeti(naevL, LUA_REGISTRYINDEX, cur_pilot->ai->ref_attacked);
 
    lua_pushpilot(naevL, attacker);
    if (nlua_pcall(cur_pilot->ai->env, 1, 0)) {
@@ -869,6 +1364,7 @@ void ai_refuel( Pilot* refueler, unsigned int target )
    /* Create the task. */
    t           = calloc( 1, sizeof(Task) );
    t->name     = strdup("refuel");
+   t->func     = ai_funcRef( refueler->ai, "refuel" );
    lua_pushpilot(naevL, target);
    t->dat      = luaL_ref(naevL, LUA_REGISTRYINDEX);
 
@@ -900,11 +1396,9 @@ void ai_getDistress( Pilot *p, const Pilot *distressed, const Pilot *attacker )
    ai_setPilot(p);
 
    /* See if function exists. */
-   nlua_getenv(cur_pilot->ai->env, "distress");
-   if (lua_isnil(naevL,-1)) {
-      lua_pop(naevL,1);
+   if (cur_pilot->ai->ref_distress == LUA_NOREF)
       return;
-   }
+   lua_rawgeti(naevL, LUA_REGISTRYINDEX, cur_pilot->ai->ref_distress);
 
    /* Run the function. */
    lua_pushpilot(naevL, distressed->id);
@@ -920,6 +1414,108 @@ void ai_getDistress( Pilot *p, const Pilot *distressed, const Pilot *attacker )
 }
 
 
+/**
+ * @brief Gets the loadouts built for a faction and ship.
+ *
+ *    @param faction Faction of the equipper, -1 for the generic one.
+ *    @param ship Ship being equipped.
+ *    @return The loadouts, created if needed.
+ */
+static AI_EquipCache* ai_equipCache( int faction, const Ship *ship )
+{
+   int i;
+   AI_EquipCache *c;
+
+   if (equip_cache == NULL)
+      equip_cache = array_create( AI_EquipCache );
+
+   for (i=0; i<array_size(equip_cache); i++)
+      if ((equip_cache[i].faction == faction) && (equip_cache[i].ship == ship))
+         return &equip_cache[i];
+
+   c = &array_grow( &equip_cache );
+   memset( c, 0, sizeof(AI_EquipCache) );
+   c->faction = faction;
+   c->ship    = ship;
+   c->nslots  = ship->outfit_nstructure + ship->outfit_nutility + ship->outfit_nweapon;
+   return c;
+}
+
+
+/**
+ * @brief Makes the loadout an equipper just built a bucket's template.
+ */
+static void ai_equipSave( AI_Loadout *l, int nslots, const Pilot *p )
+{
+   int i;
+   PilotOutfitSlot *slot;
+
+   if ((l->outfits != NULL) || (p->noutfits != nslots))
+      return;
+
+   l->outfits = calloc( nslots, sizeof(Outfit*) );
+   l->ammo    = calloc( nslots, sizeof(Outfit*) );
+   l->nammo   = calloc( nslots, sizeof(int) );
+   for (i=0; i<nslots; i++) {
+      slot = p->outfits[i];
+      l->outfits[i] = slot->outfit;
+      if ((slot->outfit != NULL) && outfit_ammo(slot->outfit) != NULL) {
+         l->ammo[i]  = slot->u.ammo.outfit;
+         l->nammo[i] = slot->u.ammo.quantity;
+      }
+   }
+}
+
+
+/**
+ * @brief Copies a loadout template onto a pilot.
+ *
+ * Stats and weapon sets point to the pilot's own slots so they get computed
+ *  once here, instead of after every outfit like the equipper does.
+ */
+static void ai_equipApply( const AI_Loadout *l, Pilot *p )
+{
+   int i;
+   PilotOutfitSlot *slot;
+
+   for (i=0; i<p->noutfits; i++) {
+      slot = p->outfits[i];
+      if (slot->outfit != NULL)
+         pilot_rmOutfitRaw( p, slot );
+      if (l->outfits[i] == NULL)
+         continue;
+      pilot_addOutfitRaw( p, l->outfits[i], slot );
+      if (l->ammo[i] != NULL)
+         pilot_addAmmo( p, slot, l->ammo[i], l->nammo[i] );
+   }
+   pilot_calcStats( p );
+   if (p->autoweap)
+      pilot_weaponAuto( p );
+}
+
+
+/**
+ * @brief Frees the kept loadouts.
+ */
+static void ai_equipFree (void)
+{
+   int i, j;
+
+   if (equip_cache == NULL)
+      return;
+
+   for (i=0; i<array_size(equip_cache); i++) {
+      for (j=0; j<AI_EQUIP_POOL; j++) {
+         free( equip_cache[i].loadouts[j].outfits );
+         free( equip_cache[i].loadouts[j].ammo );
+         free( equip_cache[i].loadouts[j].nammo );
+      }
+   }
+   array_free( equip_cache );
+   equip_cache = NULL;
+}
+
+
 /**
  * @brief Runs the create() function in the pilot.
  *
@@ -931,6 +1527,8 @@ static void ai_create( Pilot* pilot )
 {
    nlua_env env;
    char *func;
+   int faction, bucket, live;
+   AI_EquipCache *cache;
 
    env = equip_env;
    func = "equip_generic";
@@ -942,17 +1540,34 @@ static void ai_create( Pilot* pilot )
    /* Create equipment first - only if creating for the first time. */
    if (!pilot_isFlag(pilot,PILOT_PLAYER) && (aiL_status==AI_STATUS_CREATE) &&
             !pilot_isFlag(pilot, PILOT_EMPTY)) {
+      faction = -1;
       if  (faction_getEquipper( pilot->faction ) != LUA_NOREF) {
          env = faction_getEquipper( pilot->faction );
          func = "equip";
+         faction = pilot->faction;
       }
-      nlua_getenv(env, func);
-      nlua_pushenv(env);
-      lua_setfenv(naevL, -2);
-      lua_pushpilot(naevL, pilot->id);
-      if (nlua_pcall(env, 1, 0)) { /* Error has occurred. */
-         WARN("Pilot '%s' equip -> '%s': %s", pilot->name, func, lua_tostring(naevL, -1));
-         lua_pop(naevL, 1);
+
+      /* Copy the bucket's template if it's built. */
+      cache  = ai_equipCache( faction, pilot->ship );
+      bucket = RNG( 0, AI_EQUIP_POOL-1 );
+      live   = (cache->loadouts[bucket].outfits == NULL);
+      if (!live && (RNGF() < AI_EQUIP_LIVE))
+         live = -1; /* Live variant, not kept. */
+      if (!live)
+         ai_equipApply( &cache->loadouts[bucket], pilot );
+      else {
+         nlua_getenv(env, func);
+         nlua_pushenv(env);
+         lua_setfenv(naevL, -2);
+         lua_pushpilot(naevL, pilot->id);
+         if (nlua_pcall(env, 1, 0)) { /* Error has occurred. */
+            WARN("Pilot '%s' equip -> '%s': %s", pilot->name, func, lua_tostring(naevL, -1));
+            lua_pop(naevL, 1);
+         }
+         else if (live > 0) {
+            cache = ai_equipCache( faction, pilot->ship ); /* Lua may have grown it. */
+            ai_equipSave( &cache->loadouts[bucket], cache->nslots, pilot );
+         }
       }
    }
 
@@ -966,14 +1581,8 @@ static void ai_create( Pilot* pilot )
    /* Prepare AI (this sets cur_pilot among others). */
    ai_setPilot( pilot );
 
-   /* Prepare stack. */
-   nlua_getenv(cur_pilot->ai->env, "create");
-
    /* Run function. */
-   if (nlua_pcall(cur_pilot->ai->env, 0, 0)) { /* error has occurred */
-      WARN("Pilot '%s' ai -> '%s': %s", cur_pilot->name, "create", lua_tostring(naevL,-1));
-      lua_pop(naevL,1);
-   }
+   ai_run( cur_pilot->ai->env, cur_pilot->ai->ref_create, "create" );
 
    /* Recover normal mode. */
    if (!pilot_isFlag(pilot, PILOT_CREATED_AI))
@@ -987,13 +1596,23 @@ static void ai_create( Pilot* pilot )
 Task *ai_newtask( Pilot *p, const char *func, int subtask, int pos )
 {
    Task *t, *curtask, *pointer;
+   int i;
 
    /* Create the new task. */
    t           = calloc( 1, sizeof(Task) );
    t->name     = strdup(func);
+   t->func     = ai_funcRef( p->ai, func );
    lua_pushnil(naevL);
    t->dat      = luaL_ref(naevL, LUA_REGISTRYINDEX);
 
+   /* See if it can run natively. */
+   for (i=0; ai_natives[i].name != NULL; i++) {
+      if (strcmp( func, ai_natives[i].name ) == 0) {
+         t->native = ai_natives[i].func;
+         break;
+      }
+   }
+
    /* Handle subtask and general task. */
    if (!subtask) {
       if ((pos == 1) && (p->task != NULL)) { /* put at the end */
@@ -1050,42 +1669,665 @@ void ai_freetask( Task* t )
       t->next = NULL;
    }
 
-   if (t->name)
-      free(t->name);
-   free(t);
+   if (t->name)
+      free(t->name);
+   free(t);
+}
+
+
+/**
+ * @brief Creates a new task based on stack information.
+ */
+static Task* ai_createTask( lua_State *L, int subtask )
+{
+   const char *func;
+   Task *t;
+
+   /* Parse basic parameters. */
+   func  = luaL_checkstring(L,1);
+
+   /* Creates a new AI task. */
+   t     = ai_newtask( cur_pilot, func, subtask, 0 );
+
+   /* Set the data. */
+   if (lua_gettop(L) > 1) {
+      t->dat = luaL_ref(L, LUA_REGISTRYINDEX);
+   }
+
+   return t;
+}
+
+
+/**
+ * @brief Pushes a task target.
+ */
+static int ai_tasktarget( lua_State *L, Task *t )
+{
+   lua_rawgeti(L, LUA_REGISTRYINDEX, t->dat);
+   return 1;
+}
+
+
+/**
+ * @brief Pops the first subtask of a task.
+ *
+ *    @param t Task to pop subtask of, must have one.
+ */
+static void ai_popsubtask( Task *t )
+{
+   Task *st;
+
+   /* Exterminate, annihilate destroy. */
+   st          = t->subtask;
+   t->subtask  = st->next;
+   st->next    = NULL;
+   ai_freetask(st);
+}
+
+
+/**
+ * @brief Runs a task for the current pilot, natively if possible.
+ *
+ *    @param env Environment of the pilot's AI.
+ *    @param t Task to run.
+ */
+static void ai_runTask( nlua_env env, Task *t )
+{
+   if (t->native != NULL)
+      t->native( t );
+   else
+      ai_run( env, t->func, t->name );
+}
+
+
+/**
+ * @brief Creates a new task for the current pilot with a vector as data.
+ *
+ *    @param func Name of the task.
+ *    @param subtask Whether it is a subtask of the current task.
+ *    @param v Vector to set as data.
+ *    @return The new task or NULL on error.
+ */
+static Task* ai_newtaskVector( const char *func, int subtask, const Vector2d *v )
+{
+   Task *t;
+
+   t = ai_newtask( cur_pilot, func, subtask, 0 );
+   if (t == NULL)
+      return NULL;
+
+   luaL_unref(naevL, LUA_REGISTRYINDEX, t->dat);
+   lua_pushvector(naevL, *v);
+   t->dat = luaL_ref(naevL, LUA_REGISTRYINDEX);
+   return t;
+}
+
+
+/**
+ * @brief Gets the pilot a task targets.
+ *
+ *    @param t Task to get target of.
+ *    @return The target pilot or NULL if it is not a pilot or is gone.
+ */
+static Pilot* ai_taskPilot( Task *t )
+{
+   Pilot *p;
+
+   p = NULL;
+   lua_rawgeti(naevL, LUA_REGISTRYINDEX, t->dat);
+   if (lua_ispilot(naevL, -1))
+      p = pilot_get( lua_topilot(naevL, -1) );
+   lua_pop(naevL, 1);
+
+   if ((p == NULL) || pilot_isFlag(p, PILOT_DEAD))
+      return NULL;
+   return p;
+}
+
+
+/**
+ * @brief Gets the position a task targets.
+ *
+ *    @param t Task to get target of.
+ *    @param[out] v Position targeted.
+ *    @return 0 on success.
+ */
+static int ai_taskVector( Task *t, Vector2d *v )
+{
+   Pilot *p;
+   int ret;
+
+   ret = 0;
+   lua_rawgeti(naevL, LUA_REGISTRYINDEX, t->dat);
+   if (lua_isvector(naevL, -1))
+      *v = *lua_tovector(naevL, -1);
+   else if (lua_ispilot(naevL, -1)) {
+      p = pilot_get( lua_topilot(naevL, -1) );
+      if (p != NULL)
+         *v = p->solid->pos;
+      else
+         ret = -1;
+   }
+   else
+      ret = -1;
+   lua_pop(naevL, 1);
+   return ret;
+}
+
+
+/**
+ * @brief Finishes a native task, be it a task or a subtask.
+ *
+ * The task may be freed so it must not be used afterwards.
+ *
+ *    @param t Task that is done.
+ */
+static void ai_nativeDone( Task *t )
+{
+   Task *cur;
+
+   cur = ai_curTask( cur_pilot );
+   if ((cur != NULL) && (cur->subtask == t))
+      ai_popsubtask( cur );
+   else
+      t->done = 1;
+}
+
+
+/**
+ * @brief Runs a native task that steers right away on the current pilot.
+ *
+ *    @param t Task being run.
+ *    @param resolve Resolves the target of the task, NULL if it has none.
+ *    @param steer Steers the pilot.
+ */
+static void ai_nativeSteer( Task *t, AI_SteerResolve resolve, AI_SteerFunc steer )
+{
+   AI_Steer s;
+
+   ai_steerInit( &s, cur_pilot, t );
+   if ((resolve == NULL) || (resolve( &s ) == 0))
+      steer( &s );
+   else
+      s.done = 1;
+
+   pilot_acc   = s.acc;
+   pilot_turn  = s.turn;
+   pilot_flags = s.flags;
+   ai_steerFinish( &s );
+}
+
+
+/**
+ * @brief Sets up a command buffer with what the current pilot commanded so far.
+ *
+ *    @param s Command buffer to set up.
+ *    @param p Pilot to steer, must be the current pilot.
+ *    @param t Task steering.
+ */
+static void ai_steerInit( AI_Steer *s, Pilot *p, Task *t )
+{
+   memset( s, 0, sizeof(AI_Steer) );
+   s->p     = p;
+   s->t     = t;
+   s->acc   = pilot_acc;
+   s->turn  = pilot_turn;
+   s->flags = pilot_flags;
+}
+
+
+/**
+ * @brief Finishes the task and pushes the next one as the steering asked.
+ *
+ * The current pilot must be the pilot steered.
+ *
+ *    @param s Command buffer that was steered.
+ */
+static void ai_steerFinish( AI_Steer *s )
+{
+   Task *cur;
+
+   cur = ai_curTask( s->p );
+   if (s->done)
+      ai_nativeDone( s->t );
+
+   /* Subtasks only go to a task still running. */
+   if ((s->push != NULL) &&
+         (!s->push_sub || ((cur != NULL) && !cur->done)))
+      ai_newtask( s->p, s->push, s->push_sub, 0 );
+}
+
+
+/**
+ * @brief Queues the current pilot to be steered at the end of the frame.
+ *
+ * Distress calls are sent now, as the distress message is shared by all
+ *  pilots.
+ *
+ *    @param t Task being run.
+ *    @return 0 if queued, -1 if the task has to run now.
+ */
+static int ai_steerQueue( Task *t )
+{
+   const AI_NativeTask *nat;
+   AI_Steer *s;
+
+   if (t->native == NULL)
+      return -1;
+   for (nat=ai_natives; nat->name != NULL; nat++)
+      if (nat->func == t->native)
+         break;
+   if (nat->steer == NULL)
+      return -1;
+
+   if (ai_isFlag(AI_DISTRESS)) {
+      pilot_distress(cur_pilot, NULL, aiL_distressmsg, 0);
+      pilot_flags &= ~AI_DISTRESS;
+   }
+
+   if (ai_steers == NULL)
+      ai_steers = array_create( AI_Steer );
+   s = &array_grow( &ai_steers );
+   ai_steerInit( s, cur_pilot, t );
+   s->nat = nat;
+   if ((nat->resolve != NULL) && nat->resolve( s ))
+      s->done = 1;
+   return 0;
+}
+
+
+/**
+ * @brief Steers a range of the queued pilots.
+ */
+static void ai_steerRange( int start, int end, void *data )
+{
+   int i;
+   (void) data;
+
+   for (i=start; i<end; i++)
+      if (!ai_steers[i].done)
+         ai_steers[i].nat->steer( &ai_steers[i] );
+}
+
+
+/**
+ * @brief Resolves the pilot a task targets.
+ *
+ *    @param s Command buffer to resolve into.
+ *    @return 0 on success.
+ */
+static int ai_resolvePilot( AI_Steer *s )
+{
+   Pilot *p;
+
+   p = ai_taskPilot( s->t );
+   if (p == NULL)
+      return -1;
+   s->pos = p->solid->pos;
+   s->vel = p->solid->vel;
+   return 0;
+}
+
+
+/**
+ * @brief Resolves the pilot to attack, targeting it.
+ *
+ *    @param s Command buffer to resolve into.
+ *    @return 0 on success.
+ */
+static int ai_resolveAttack( AI_Steer *s )
+{
+   Pilot *p;
+
+   p = ai_taskPilot( s->t );
+   if ((p == NULL) || pilot_isDisabled(p))
+      return -1;
+
+   if (s->p->target != p->id)
+      pilot_setTarget( s->p, p->id );
+   s->pos = p->solid->pos;
+   s->vel = p->solid->vel;
+   return 0;
+}
+
+
+/**
+ * @brief Resolves the formation position of the fleet leader.
+ *
+ * Same as the follow_fleet Lua task, the formation position sent by the
+ *  leader is read from mem.form_pos.
+ *
+ *    @param s Command buffer to resolve into.
+ *    @return 0 on success.
+ */
+static int ai_resolveFleet( AI_Steer *s )
+{
+   Pilot *l;
+   double angle, radius, Kp, Kd;
+   const char *method;
+
+   l = pilot_get( s->p->parent );
+   if ((l == NULL) || pilot_isFlag(l, PILOT_DEAD))
+      return -1;
+
+   /* Formation position, truncated like follow_accurate() does. */
+   s->pos = l->solid->pos;
+   s->vel = l->solid->vel;
+   nlua_getenv( s->p->ai->env, "mem" );         /* mem */
+   lua_getfield( naevL, -1, "form_pos" );       /* mem, fp */
+   if (lua_istable( naevL, -1 )) {
+      lua_rawgeti( naevL, -1, 1 );              /* mem, fp, a */
+      lua_rawgeti( naevL, -2, 2 );              /* mem, fp, a, r */
+      lua_rawgeti( naevL, -3, 3 );              /* mem, fp, a, r, m */
+      lua_getfield( naevL, -5, "Kp" );          /* mem, fp, a, r, m, Kp */
+      lua_getfield( naevL, -6, "Kd" );          /* mem, fp, a, r, m, Kp, Kd */
+      angle  = (long)lua_tonumber( naevL, -5 );
+      radius = (long)lua_tonumber( naevL, -4 );
+      method = lua_isstring( naevL, -3 ) ? lua_tostring( naevL, -3 ) : "velocity";
+      Kp     = (long)lua_tonumber( naevL, -2 );
+      Kd     = (long)lua_tonumber( naevL, -1 );
+      ai_followAccurate( l, radius, angle, Kp, Kd, method, &s->pos );
+      lua_pop( naevL, 5 );                      /* mem, fp */
+   }
+   lua_pop( naevL, 2 );                         /* */
+   return 0;
+}
+
+
+/**
+ * @brief Resolves the position a task targets.
+ *
+ *    @param s Command buffer to resolve into.
+ *    @return 0 on success.
+ */
+static int ai_resolveVector( AI_Steer *s )
+{
+   return ai_taskVector( s->t, &s->pos );
+}
+
+
+/**
+ * @brief Native task to attack the target pilot.
+ *
+ * Closes in until in range of the active weapon set, then aims and fires the
+ *  primary weapons.
+ *
+ *    @param t Task being run.
+ */
+static void ai_nativeAttack( Task *t )
+{
+   ai_nativeSteer( t, ai_resolveAttack, ai_steerAttack );
+}
+
+
+/**
+ * @brief Steers to attack the resolved pilot.
+ *
+ *    @param s Command buffer to steer.
+ */
+static void ai_steerAttack( AI_Steer *s )
+{
+   double dist, range, dir;
+
+   dist  = vect_dist( &s->p->solid->pos, &s->pos );
+   range = pilot_weapSetRange( s->p, s->p->active_set, -1 );
+
+   /* Must approach. */
+   if (dist > range) {
+      dir = ai_faceFrom( s->p, &s->pos, 0, 0, &s->turn );
+      if (dir < 10.)
+         s->acc = 1.;
+      return;
+   }
+
+   /* In range, aim and shoot. */
+   dir = ai_aimAt( s->p, &s->pos, &s->vel, &s->turn );
+   if (dir < 10.) {
+      if (dist > 0.5*range)
+         s->acc = 1.;
+      if (!pilot_isFlag(s->p, PILOT_COOLDOWN))
+         s->flags |= AI_PRIMARY;
+   }
+}
+
+
+/**
+ * @brief Native task to follow the target pilot.
+ *
+ *    @param t Task being run.
+ */
+static void ai_nativeFollow( Task *t )
+{
+   /* Will just float without a target to escort. */
+   ai_nativeSteer( t, ai_resolvePilot, ai_steerFollow );
+}
+
+
+/**
+ * @brief Native task to follow the fleet leader, keeping formation.
+ *
+ *    @param t Task being run.
+ */
+static void ai_nativeFollowFleet( Task *t )
+{
+   ai_nativeSteer( t, ai_resolveFleet, ai_steerFollow );
+}
+
+
+/**
+ * @brief Steers to follow the resolved position.
+ *
+ *    @param s Command buffer to steer.
+ */
+static void ai_steerFollow( AI_Steer *s )
+{
+   double dir, dist;
+
+   dir   = ai_faceFrom( s->p, &s->pos, 0, 0, &s->turn );
+   dist  = vect_dist( &s->p->solid->pos, &s->pos );
+
+   /* Must approach. */
+   if ((dir < 10.) && (dist > 300.))
+      s->acc = 1.;
+}
+
+
+/**
+ * @brief Native task to go to the target position and brake there.
+ *
+ *    @param t Task being run.
+ */
+static void ai_nativeGoto( Task *t )
+{
+   ai_nativeSteer( t, ai_resolveVector, ai_steerGoto );
+}
+
+
+/**
+ * @brief Steers to the resolved position, braking once there.
+ *
+ *    @param s Command buffer to steer.
+ */
+static void ai_steerGoto( AI_Steer *s )
+{
+   double dir, dist, bdist;
+
+   dir   = ai_faceFrom( s->p, &s->pos, 0, 1, &s->turn );
+   dist  = vect_dist( &s->p->solid->pos, &s->pos );
+   bdist = ai_minbrakedistFrom( s->p, NULL );
+
+   /* Need to get closer. */
+   if ((dir < 10.) && (dist > bdist))
+      s->acc = 1.;
+
+   /* Need to start braking. */
+   else if (dist < bdist) {
+      s->done     = 1;
+      s->push     = "native_brake";
+      s->push_sub = 0;
+   }
+}
+
+
+/**
+ * @brief Native task to brake until stopped.
+ *
+ *    @param t Task being run.
+ */
+static void ai_nativeBrake( Task *t )
+{
+   ai_nativeSteer( t, NULL, ai_steerBrake );
+}
+
+
+/**
+ * @brief Steers to brake until stopped.
+ *
+ *    @param s Command buffer to steer.
+ */
+static void ai_steerBrake( AI_Steer *s )
+{
+   ai_brakeFrom( s->p, &s->acc, &s->turn );
+   if (VMOD(s->p->solid->vel) < MIN_VEL_ERR) {
+      vect_pset( &s->p->solid->vel, 0., 0. );
+      s->done = 1;
+   }
+}
+
+
+/**
+ * @brief Native task to hyperspace through the target or a random jump.
+ *
+ *    @param t Task being run.
+ */
+static void ai_nativeHyperspace( Task *t )
+{
+   JumpPoint *jp;
+   LuaJump *lj;
+   Vector2d v;
+
+   /* Get the jump point. */
+   jp = NULL;
+   lua_rawgeti(naevL, LUA_REGISTRYINDEX, t->dat);
+   if (lua_isjump(naevL, -1)) {
+      lj = lua_tojump(naevL, -1);
+      if (lj->srcid == cur_system->id)
+         jp = jump_getTarget( system_getIndex( lj->destid ), cur_system );
+   }
+   lua_pop(naevL, 1);
+   if (jp == NULL)
+      jp = ai_rndJump();
+   if (jp == NULL)
+      return;
+
+   ai_setJump( jp, &v );
+   ai_newtaskVector( "native_hyp_approach", 1, &v );
+}
+
+
+/**
+ * @brief Native subtask to approach the jump point.
+ *
+ *    @param t Task being run.
+ */
+static void ai_nativeHypApproach( Task *t )
+{
+   ai_nativeSteer( t, ai_resolveVector, ai_steerHypApproach );
+}
+
+
+/**
+ * @brief Steers to the resolved jump point, braking once there.
+ *
+ *    @param s Command buffer to steer.
+ */
+static void ai_steerHypApproach( AI_Steer *s )
+{
+   double dir, dist, bdist;
+
+   dist  = vect_dist( &s->p->solid->pos, &s->pos );
+   bdist = ai_minbrakedistFrom( s->p, NULL );
+   dir   = ai_faceFrom( s->p, &s->pos, 0, 0, &s->turn );
+
+   /* Need to get closer. */
+   if ((dir < 10.) && (dist > bdist))
+      s->acc = 1.;
+
+   /* Need to start braking. */
+   else if (dist < bdist) {
+      s->push     = "native_hyp_brake";
+      s->push_sub = 1;
+   }
 }
 
 
 /**
- * @brief Creates a new task based on stack information.
+ * @brief Native subtask to brake before jumping.
+ *
+ *    @param t Task being run.
  */
-static Task* ai_createTask( lua_State *L, int subtask )
+static void ai_nativeHypBrake( Task *t )
 {
-   const char *func;
-   Task *t;
-
-   /* Parse basic parameters. */
-   func  = luaL_checkstring(L,1);
+   ai_nativeSteer( t, NULL, ai_steerHypBrake );
+}
 
-   /* Creates a new AI task. */
-   t     = ai_newtask( cur_pilot, func, subtask, 0 );
 
-   /* Set the data. */
-   if (lua_gettop(L) > 1) {
-      t->dat = luaL_ref(L, LUA_REGISTRYINDEX);
+/**
+ * @brief Steers to brake, jumping once stopped.
+ *
+ *    @param s Command buffer to steer.
+ */
+static void ai_steerHypBrake( AI_Steer *s )
+{
+   ai_steerBrake( s );
+   if (s->done) {
+      s->push     = "native_hyp_jump";
+      s->push_sub = 1;
    }
-
-   return t;
 }
 
 
 /**
- * @brief Pushes a task target.
+ * @brief Native subtask to jump, telling followers where it went.
+ *
+ *    @param t Task being run.
  */
-static int ai_tasktarget( lua_State *L, Task *t )
+static void ai_nativeHypJump( Task *t )
 {
-   lua_rawgeti(L, LUA_REGISTRYINDEX, t->dat);
-   return 1;
+   JumpPoint *jp;
+   LuaJump lj;
+   Pilot *e;
+   int i, idx;
+
+   /* Too far away, go back to approaching. */
+   if (space_hyperspace( cur_pilot ) != 0) {
+      ai_nativeDone( t );
+      return;
+   }
+   pilot_shootStop( cur_pilot, 0 );
+   pilot_shootStop( cur_pilot, 1 );
+
+   /* Tell followers. */
+   jp = ai_nearJump();
+   if (jp != NULL) {
+      lj.destid = jp->targetid;
+      lj.srcid  = cur_system->id;
+      lua_pushjump( naevL, lj );
+   }
+   else
+      lua_pushnil( naevL );
+   idx = lua_gettop( naevL );
+   for (i=0; i<cur_pilot->nescorts; i++) {
+      e = pilot_get( cur_pilot->escorts[i].id );
+      if (e != NULL)
+         pilot_msg( cur_pilot, e, "hyperspace", idx );
+   }
+   lua_pop( naevL, 1 );
+
+   /* Whole task is done. */
+   t = ai_curTask( cur_pilot );
+   if (t != NULL)
+      t->done = 1;
 }
 
 
@@ -1195,7 +2437,7 @@ static int aiL_pushsubtask( lua_State *L )
  */
 static int aiL_popsubtask( lua_State *L )
 {
-   Task *t, *st;
+   Task *t;
    t = ai_curTask( cur_pilot );
 
    /* Tasks must exist. */
@@ -1208,11 +2450,7 @@ static int aiL_popsubtask( lua_State *L )
       return 0;
    }
 
-   /* Exterminate, annihilate destroy. */
-   st          = t->subtask;
-   t->subtask  = st->next;
-   st->next    = NULL;
-   ai_freetask(st);
+   ai_popsubtask( t );
    return 0;
 }
 
@@ -1300,33 +2538,32 @@ static int aiL_getrndpilot( lua_State *L )
  */
 static int aiL_getnearestpilot( lua_State *L )
 {
+   Pilot *p;
 
-   /*dist will be initialized to a number*/
-   /*this will only seek out pilots closer than dist*/
-   int dist=1000;
-   int i;
-   int candidate_id = -1;
-
-   /*cycle through all the pilots and find the closest one that is not the pilot */
-
-   for(i = 0; i<pilot_nstack; i++)
-   {
-       if(pilot_stack[i]->id != cur_pilot->id && vect_dist(&pilot_stack[i]->solid->pos, &cur_pilot->solid->pos) < dist)
-       {
-            dist = vect_dist(&pilot_stack[i]->solid->pos, &cur_pilot->solid->pos);
-            candidate_id = i;
-       }
-   }
+   /* Only seek out pilots closer than 1000. */
+   p = pilot_gridNearest( cur_pilot->solid->pos.x, cur_pilot->solid->pos.y,
+         1., ai_costNearest, cur_pilot, NULL );
 
    /* Last check. */
-   if (candidate_id == -1)
+   if (p == NULL)
       return 0;
 
    /* Actually found a pilot. */
-   lua_pushpilot(L, pilot_stack[candidate_id]->id);
+   lua_pushpilot(L, p->id);
    return 1;
 }
 
+
+/**
+ * @brief Cost of a pilot for aiL_getnearestpilot.
+ */
+static double ai_costNearest( const Pilot *t, double d2, void *data )
+{
+   if ((t == (const Pilot*) data) || (d2 >= 1000.*1000.))
+      return -1.;
+   return d2;
+}
+
 /**
  * @brief Gets the distance from the pointer.
  *
@@ -1412,24 +2649,53 @@ static int aiL_getflybydistance( lua_State *L )
  */
 static int aiL_minbrakedist( lua_State *L )
 {
-   double time, dist, vel;
-   Vector2d vv;
    Pilot *p;
 
-   /* More complicated calculation based on relative velocity. */
-   if (lua_gettop(L) > 0) {
+   p = NULL;
+   if (lua_gettop(L) > 0)
       p = luaL_validpilot(L,1);
 
+   lua_pushnumber(L, ai_minbrakedist( p )); /* return */
+   return 1; /* returns one thing */
+}
+
+
+/**
+ * @brief Gets the minimum braking distance of the current pilot.
+ *
+ *    @param p Pilot to brake relative to or NULL to come to a full stop.
+ *    @return Minimum braking distance.
+ */
+static double ai_minbrakedist( const Pilot *p )
+{
+   return ai_minbrakedistFrom( cur_pilot, p );
+}
+
+
+/**
+ * @brief Gets the minimum braking distance of a pilot.
+ *
+ *    @param self Pilot braking.
+ *    @param p Pilot to brake relative to or NULL to come to a full stop.
+ *    @return Minimum braking distance.
+ */
+static double ai_minbrakedistFrom( const Pilot *self, const Pilot *p )
+{
+   double time, dist, vel;
+   Vector2d vv;
+
+   /* More complicated calculation based on relative velocity. */
+   if (p != NULL) {
       /* Set up the vectors. */
-      vect_cset( &vv, p->solid->vel.x - cur_pilot->solid->vel.x,
-            p->solid->vel.y - cur_pilot->solid->vel.y );
+      vect_cset( &vv, p->solid->vel.x - self->solid->vel.x,
+            p->solid->vel.y - self->solid->vel.y );
 
       /* Run the same calculations. */
       time = VMOD(vv) /
-            (cur_pilot->thrust / cur_pilot->solid->mass);
+            (self->thrust / self->solid->mass);
 
       /* Get relative velocity. */
-      vel = MIN(cur_pilot->speed - VMOD(p->solid->vel), VMOD(vv));
+      vel = MIN(self->speed - VMOD(p->solid->vel), VMOD(vv));
       if (vel < 0.)
          vel = 0.;
    }
@@ -1437,18 +2703,17 @@ static int aiL_minbrakedist( lua_State *L )
    /* Simple calculation based on distance. */
    else {
       /* Get current time to reach target. */
-      time = VMOD(cur_pilot->solid->vel) /
-            (cur_pilot->thrust / cur_pilot->solid->mass);
+      time = VMOD(self->solid->vel) /
+            (self->thrust / self->solid->mass);
 
       /* Get velocity. */
-      vel = MIN(cur_pilot->speed,VMOD(cur_pilot->solid->vel));
+      vel = MIN(self->speed,VMOD(self->solid->vel));
    }
    /* Get distance to brake. */
-   dist = vel*(time+1.1*M_PI/cur_pilot->turn) -
-         0.5*(cur_pilot->thrust/cur_pilot->solid->mass)*time*time;
+   dist = vel*(time+1.1*M_PI/self->turn) -
+         0.5*(self->thrust/self->solid->mass)*time*time;
 
-   lua_pushnumber(L, dist); /* return */
-   return 1; /* returns one thing */
+   return dist;
 }
 
 
@@ -1644,8 +2909,7 @@ static int aiL_face( lua_State *L )
 {
    Vector2d *tv; /* get the position to face */
    Pilot* p;
-   double k_diff, k_vel, d, diff, vx, vy, dx, dy;
-   int vel;
+   double d;
 
    /* Get first parameter, aka what to face. */
    if (lua_ispilot(L,1)) {
@@ -1665,17 +2929,49 @@ static int aiL_face( lua_State *L )
    else
       NLUA_INVALID_PARAMETER(L);
 
+   /* Return angle in degrees away from target. */
+   lua_pushnumber(L, ai_face( tv, lua_toboolean(L,2), lua_toboolean(L,3) ));
+   return 1;
+}
+
+
+/**
+ * @brief Makes the current pilot turn to face a position.
+ *
+ *    @param tv Position to face.
+ *    @param invert Whether to face away from the position instead.
+ *    @param vel Whether to compensate for tangential velocity.
+ *    @return Angle offset in degrees.
+ */
+static double ai_face( const Vector2d *tv, int invert, int vel )
+{
+   return ai_faceFrom( cur_pilot, tv, invert, vel, &pilot_turn );
+}
+
+
+/**
+ * @brief Gets the turn for a pilot to face a position.
+ *
+ *    @param self Pilot turning.
+ *    @param tv Position to face.
+ *    @param invert Whether to face away from the position instead.
+ *    @param vel Whether to compensate for tangential velocity.
+ *    @param[out] turn Turn to face the position.
+ *    @return Angle offset in degrees.
+ */
+static double ai_faceFrom( const Pilot *self, const Vector2d *tv,
+      int invert, int vel, double *turn )
+{
+   double k_diff, k_vel, d, diff, vx, vy, dx, dy;
+
    /* Default gain. */
    k_diff = 10.;
    k_vel  = 100.; /* overkill gain! */
 
    /* Check if must invert. */
-   if (lua_toboolean(L,2))
+   if (invert)
       k_diff *= -1;
 
-   /* Third parameter. */
-   vel = lua_toboolean(L, 3);
-
    /* Tangential component of velocity vector
     *
     * v: velocity vector
@@ -1686,11 +2982,11 @@ static int aiL_face( lua_State *L )
     *                 |d|     |d|             |d|^2
     */
    /* Velocity vector. */
-   vx = cur_pilot->solid->vel.x;
-   vy = cur_pilot->solid->vel.y;
+   vx = self->solid->vel.x;
+   vy = self->solid->vel.y;
    /* Direction vector. */
-   dx = tv->x - cur_pilot->solid->pos.x;
-   dy = tv->y - cur_pilot->solid->pos.y;
+   dx = tv->x - self->solid->pos.x;
+   dy = tv->y - self->solid->pos.y;
    if (vel) {
       /* Calculate dot product. */
       d = (vx * dx + vy * dy) / (dx*dx + dy*dy);
@@ -1704,14 +3000,13 @@ static int aiL_face( lua_State *L )
    }
 
    /* Compensate error and rotate. */
-   diff = angle_diff( cur_pilot->solid->dir, atan2( dy, dx ) );
+   diff = angle_diff( self->solid->dir, atan2( dy, dx ) );
 
    /* Make pilot turn. */
-   pilot_turn = k_diff * diff;
+   *turn = k_diff * diff;
 
    /* Return angle in degrees away from target. */
-   lua_pushnumber(L, ABS(diff*180./M_PI));
-   return 1;
+   return ABS(diff*180./M_PI);
 }
 
 
@@ -1820,10 +3115,44 @@ static int aiL_careful_face( lua_State *L )
  * @luafunc aim( target )
  */
 static int aiL_aim( lua_State *L )
+{
+   Pilot *p;
+
+   /* Only acceptable parameter is pilot */
+   p = luaL_validpilot(L,1);
+
+   /* Return distance to target (in grad) */
+   lua_pushnumber(L, ai_aim( p ));
+   return 1;
+}
+
+
+/**
+ * @brief Makes the current pilot turn to aim at a pilot.
+ *
+ *    @param p Pilot to aim at.
+ *    @return Angle offset in degrees.
+ */
+static double ai_aim( const Pilot *p )
+{
+   return ai_aimAt( cur_pilot, &p->solid->pos, &p->solid->vel, &pilot_turn );
+}
+
+
+/**
+ * @brief Gets the turn for a pilot to aim at a moving target.
+ *
+ *    @param self Pilot aiming.
+ *    @param pos Position of the target.
+ *    @param vel Velocity of the target.
+ *    @param[out] turn Turn to aim at the target.
+ *    @return Angle offset in degrees.
+ */
+static double ai_aimAt( Pilot *self, const Vector2d *pos,
+      const Vector2d *vel, double *turn )
 {
    double x,y;
    double t;
-   Pilot *p;
    Vector2d tv, approach_vector, relative_location, orthoradial_vector;
    double dist, diff;
    double mod;
@@ -1831,14 +3160,11 @@ static int aiL_aim( lua_State *L )
    double radial_speed;
    double orthoradial_speed;
 
-   /* Only acceptable parameter is pilot */
-   p = luaL_validpilot(L,1);
-
    /* Get the distance */
-   dist = vect_dist( &cur_pilot->solid->pos, &p->solid->pos );
+   dist = vect_dist( &self->solid->pos, pos );
 
    /* Check if should recalculate weapon speed with secondary weapon. */
-   speed = pilot_weapSetSpeed( cur_pilot, cur_pilot->active_set, -1 );
+   speed = pilot_weapSetSpeed( self, self->active_set, -1 );
 
    /* determine the radial, or approach speed */
    /*
@@ -1852,9 +3178,9 @@ static int aiL_aim( lua_State *L )
     *
     *Position prediction logic is the same as the previous function
     */
-   vect_cset(&approach_vector, VX(cur_pilot->solid->vel) - VX(p->solid->vel), VY(cur_pilot->solid->vel) - VY(p->solid->vel) );
-   vect_cset(&relative_location, VX(p->solid->pos) -  VX(cur_pilot->solid->pos),  VY(p->solid->pos) - VY(cur_pilot->solid->pos) );
-   vect_cset(&orthoradial_vector, VY(cur_pilot->solid->pos) - VY(p->solid->pos), VX(p->solid->pos) -  VX(cur_pilot->solid->pos) );
+   vect_cset(&approach_vector, VX(self->solid->vel) - vel->x, VY(self->solid->vel) - vel->y );
+   vect_cset(&relative_location, pos->x -  VX(self->solid->pos),  pos->y - VY(self->solid->pos) );
+   vect_cset(&orthoradial_vector, VY(self->solid->pos) - pos->y, pos->x -  VX(self->solid->pos) );
 
    radial_speed = vect_dot(&approach_vector, &relative_location);
    radial_speed = radial_speed / VMOD(relative_location);
@@ -1881,20 +3207,18 @@ static int aiL_aim( lua_State *L )
       t = 0;
 
    /* Position is calculated on where it should be */
-   x = p->solid->pos.x + p->solid->vel.x*t
-      - (cur_pilot->solid->pos.x + cur_pilot->solid->vel.x*t);
-   y = p->solid->pos.y + p->solid->vel.y*t
-      - (cur_pilot->solid->pos.y + cur_pilot->solid->vel.y*t);
+   x = pos->x + vel->x*t
+      - (self->solid->pos.x + self->solid->vel.x*t);
+   y = pos->y + vel->y*t
+      - (self->solid->pos.y + self->solid->vel.y*t);
    vect_cset( &tv, x, y );
 
    /* Calculate what we need to turn */
    mod = 10.;
-   diff = angle_diff(cur_pilot->solid->dir, VANGLE(tv));
-   pilot_turn = mod * diff;
+   diff = angle_diff(self->solid->dir, VANGLE(tv));
+   *turn = mod * diff;
 
-   /* Return distance to target (in grad) */
-   lua_pushnumber(L, ABS(diff*180./M_PI));
-   return 1;
+   return ABS(diff*180./M_PI);
 }
 
 
@@ -2122,16 +3446,41 @@ static int aiL_drift_facing( lua_State *L )
  */
 
 static int aiL_brake( lua_State *L )
+{
+   lua_pushboolean(L, ai_brake());
+   return 1;
+}
+
+
+/**
+ * @brief Makes the current pilot brake.
+ *
+ *    @return Whether braking is finished.
+ */
+static int ai_brake (void)
+{
+   return ai_brakeFrom( cur_pilot, &pilot_acc, &pilot_turn );
+}
+
+
+/**
+ * @brief Makes a pilot brake.
+ *
+ *    @param self Pilot braking.
+ *    @param[out] acc Acceleration to brake.
+ *    @param[out] turn Turn to brake.
+ *    @return Whether braking is finished.
+ */
+static int ai_brakeFrom( Pilot *self, double *acc, double *turn )
 {
    int ret;
 
-   ret = pilot_brake( cur_pilot );
+   ret = pilot_brake( self );
 
-   pilot_acc = cur_pilot->solid->thrust / cur_pilot->thrust;
-   pilot_turn = cur_pilot->solid->dir_vel / cur_pilot->turn;
+   *acc  = self->solid->thrust / self->thrust;
+   *turn = self->solid->dir_vel / self->turn;
 
-   lua_pushboolean(L, ret);
-   return 1;
+   return ret;
 }
 
 
@@ -2146,14 +3495,17 @@ static int aiL_getnearestplanet( lua_State *L )
    double dist, d;
    int i, j;
    LuaPlanet planet;
+   const SystemView *v;
 
    if (cur_system->nplanets == 0) return 0; /* no planets */
 
    /* cycle through planets */
-   for (dist=0., j=-1, i=0; i<cur_system->nplanets; i++) {
-      d = vect_dist( &cur_system->planets[i]->pos, &cur_pilot->solid->pos );
-      if ((!areEnemies(cur_pilot->faction,cur_system->planets[i]->faction)) &&
-            (d < dist)) { /* closer friendly planet */
+   v = space_getView();
+   for (dist=INFINITY, j=-1, i=0; i<v->nplanets; i++) {
+      d = pow2( v->px[i] - cur_pilot->solid->pos.x ) +
+            pow2( v->py[i] - cur_pilot->solid->pos.y );
+      if ((d < dist) &&
+            (!areEnemies(cur_pilot->faction,v->pfaction[i]))) { /* closer friendly planet */
          j = i;
          dist = d;
       }
@@ -2206,6 +3558,7 @@ static int aiL_getlandplanet( lua_State *L )
    LuaPlanet planet;
    Planet *p;
    int only_friend;
+   const SystemView *v;
 
    /* Must have planets. */
    if (cur_system->nplanets == 0)
@@ -2218,14 +3571,15 @@ static int aiL_getlandplanet( lua_State *L )
    ind = malloc( sizeof(int) * cur_system->nplanets );
 
    /* Copy friendly planet.s */
-   for (nplanets=0, i=0; i<cur_system->nplanets; i++) {
-      if (!planet_hasService(cur_system->planets[i],PLANET_SERVICE_INHABITED))
+   v = space_getView();
+   for (nplanets=0, i=0; i<v->nplanets; i++) {
+      if (!(v->pservices[i] & PLANET_SERVICE_INHABITED))
          continue;
 
       /* Check conditions. */
-      if (only_friend && !areAllies( cur_pilot->faction, cur_system->planets[i]->faction ))
+      if (only_friend && !areAllies( cur_pilot->faction, v->pfaction[i] ))
          continue;
-      else if (!only_friend && areEnemies(cur_pilot->faction,cur_system->planets[i]->faction))
+      else if (!only_friend && areEnemies( cur_pilot->faction, v->pfaction[i] ))
          continue;
 
       /* Add it. */
@@ -2338,7 +3692,6 @@ static int aiL_sethyptarget( lua_State *L )
    JumpPoint *jp;
    LuaJump *lj;
    Vector2d vec;
-   double a, rad;
 
    lj = luaL_checkjump( L, 1 );
    jp = luaL_validjump( L, 1 );
@@ -2346,21 +3699,35 @@ static int aiL_sethyptarget( lua_State *L )
    if ( lj->srcid != cur_system->id )
       NLUA_ERROR(L, "Jump point must be in current system.");
 
+   ai_setJump( jp, &vec );
+
+   /* Return vector. */
+   lua_pushvector( L, vec );
+
+   return 1;
+}
+
+
+/**
+ * @brief Sets the hyperspace target of the current pilot.
+ *
+ *    @param jp Jump point to target, must be in the current system.
+ *    @param[out] vec Where to go to jump.
+ */
+static void ai_setJump( const JumpPoint *jp, Vector2d *vec )
+{
+   double a, rad;
+
    /* Copy vector. */
-   vec = jp->pos;
+   *vec = jp->pos;
 
    /* Introduce some error. */
    a     = RNGF() * M_PI * 2.;
    rad   = RNGF() * 0.5 * jp->radius;
-   vect_cadd( &vec, rad*cos(a), rad*sin(a) );
+   vect_cadd( vec, rad*cos(a), rad*sin(a) );
 
    /* Set up target. */
    cur_pilot->nav_hyperspace = jp - cur_system->jumps;
-
-   /* Return vector. */
-   lua_pushvector( L, vec );
-
-   return 1;
 }
 
 
@@ -2372,15 +3739,34 @@ static int aiL_sethyptarget( lua_State *L )
  */
 static int aiL_nearhyptarget( lua_State *L )
 {
-   JumpPoint *jp, *jiter;
-   double mindist, dist;
-   int i;
+   JumpPoint *jp;
    LuaJump lj;
 
-   /* No jumps. */
-   if (cur_system->njumps == 0)
+   /* None available. */
+   jp = ai_nearJump();
+   if (jp == NULL)
       return 0;
 
+   lj.destid = jp->targetid;
+   lj.srcid = cur_system->id;
+
+   /* Return Jump. */
+   lua_pushjump( L, lj );
+   return 1;
+}
+
+
+/**
+ * @brief Gets the nearest usable jump point to the current pilot.
+ *
+ *    @return The nearest jump point or NULL if there are none.
+ */
+static JumpPoint* ai_nearJump (void)
+{
+   JumpPoint *jp, *jiter;
+   double mindist, dist;
+   int i;
+
    /* Find nearest jump .*/
    mindist = INFINITY;
    jp      = NULL;
@@ -2396,7 +3782,23 @@ static int aiL_nearhyptarget( lua_State *L )
          mindist  = dist;
       }
    }
-   /* None available. */
+   return jp;
+}
+
+
+/**
+ * @brief Gets a random hyperspace target.
+ *
+ *    @luatreturn JumpPoint|nil
+ *    @luafunc rndhyptarget()
+ */
+static int aiL_rndhyptarget( lua_State *L )
+{
+   JumpPoint *jp;
+   LuaJump lj;
+
+   /* No jumps in the system. */
+   jp = ai_rndJump();
    if (jp == NULL)
       return 0;
 
@@ -2410,48 +3812,37 @@ static int aiL_nearhyptarget( lua_State *L )
 
 
 /**
- * @brief Gets a random hyperspace target.
+ * @brief Gets a random usable jump point in the current system.
  *
- *    @luatreturn JumpPoint|nil
- *    @luafunc rndhyptarget()
+ *    @return A random jump point or NULL if there are none.
  */
-static int aiL_rndhyptarget( lua_State *L )
+static JumpPoint* ai_rndJump (void)
 {
-   JumpPoint **jumps, *jiter;
+   JumpPoint *jiter;
    int i, j, r;
-   int *id;
-   LuaJump lj;
-
-   /* No jumps in the system. */
-   if (cur_system->njumps == 0)
-      return 0;
 
-   /* Find usable jump points. */
-   jumps = malloc( sizeof(JumpPoint*) * cur_system->njumps );
-   id    = malloc( sizeof(int) * cur_system->njumps );
+   /* Count usable jump points. */
    j = 0;
    for (i=0; i < cur_system->njumps; i++) {
       jiter = &cur_system->jumps[i];
       /* We want only standard jump points to be used. */
       if (jp_isFlag(jiter, JP_HIDDEN) || jp_isFlag(jiter, JP_EXITONLY))
          continue;
-      id[j]      = i;
-      jumps[j++] = jiter;
+      j++;
    }
+   if (j == 0)
+      return NULL;
 
    /* Choose random jump point. */
    r = RNG(0, j-1);
-
-   lj.destid = jumps[r]->targetid;
-   lj.srcid = cur_system->id;
-
-   /* Clean up. */
-   free(jumps);
-   free(id);
-
-   /* Return Jump. */
-   lua_pushjump( L, lj );
-   return 1;
+   for (i=0; i < cur_system->njumps; i++) {
+      jiter = &cur_system->jumps[i];
+      if (jp_isFlag(jiter, JP_HIDDEN) || jp_isFlag(jiter, JP_EXITONLY))
+         continue;
+      if (r-- == 0)
+         return jiter;
+   }
+   return NULL;
 }
 
 /**
@@ -2505,12 +3896,11 @@ static int aiL_relvel( lua_State *L )
  */
 static int aiL_follow_accurate( lua_State *L )
 {
-   Vector2d point, cons, goal, pv;
-   double radius, angle, Kp, Kd, angle2;
-   Pilot *p, *target;
+   Vector2d goal;
+   double radius, angle, Kp, Kd;
+   Pilot *target;
    const char *method;
 
-   p = cur_pilot;
    target = luaL_validpilot(L,1);
    radius = luaL_checklong(L,2);
    angle = luaL_checklong(L,3);
@@ -2522,6 +3912,37 @@ static int aiL_follow_accurate( lua_State *L )
    else
       method = luaL_checkstring(L,6);
 
+   ai_followAccurate( target, radius, angle, Kp, Kd, method, &goal );
+
+   /* Push info */
+   lua_pushvector( L, goal );
+
+   return 1;
+
+}
+
+
+/**
+ * @brief Computes the point to go to in order to follow a target at a position.
+ *
+ * Shared by follow_accurate() and the native fleet following task.
+ *
+ *    @param target Pilot to follow.
+ *    @param radius Distance to keep from the target.
+ *    @param angle Angle to keep from the target, in degrees.
+ *    @param Kp First control coefficient.
+ *    @param Kd Second control coefficient.
+ *    @param method "absolute", "keepangle" or "velocity".
+ *    @param[out] goal Point to go to.
+ */
+static void ai_followAccurate( const Pilot *target, double radius, double angle,
+      double Kp, double Kd, const char *method, Vector2d *goal )
+{
+   Vector2d point, cons, pv;
+   double angle2;
+   Pilot *p;
+
+   p = cur_pilot;
    if (strcmp( method, "absolute" ) == 0)
       angle2 = angle * M_PI/180;
    else if (strcmp( method, "keepangle" ) == 0){
@@ -2541,13 +3962,7 @@ static int aiL_follow_accurate( lua_State *L )
          (point.y - p->solid->pos.y) * Kp +
          (target->solid->vel.y - p->solid->vel.y) *Kd );
 
-   vect_cset( &goal, cons.x + p->solid->pos.x, cons.y + p->solid->pos.y);
-
-   /* Push info */
-   lua_pushvector( L, goal );
-
-   return 1;
-
+   vect_cset( goal, cons.x + p->solid->pos.x, cons.y + p->solid->pos.y);
 }
 
 /**
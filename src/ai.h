@@ -13,6 +13,7 @@
 
 #include "physics.h"
 #include "nlua.h"
+#include "nhash.h"
 
 /* Forward declaration to avoid cyclical import. */
 struct Pilot_;
@@ -31,6 +32,10 @@ typedef struct Pilot_ Pilot;
 #define MAX_AI_TIMERS   2 /**< Max amount of AI timers. */
 
 
+struct Task_;
+typedef void (*AI_TaskFunc)( struct Task_ *t ); /**< Native task function. */
+
+
 /**
  * @struct Task
  *
@@ -39,7 +44,9 @@ typedef struct Pilot_ Pilot;
 typedef struct Task_ {
    struct Task_* next; /**< Next task */
    char *name; /**< Task name. */
+   int func; /**< Registry reference of the task's Lua function, LUA_NOREF if none. */
    int done; /**< Task is done and ready for deletion. */
+   AI_TaskFunc native; /**< Runs the task in C instead of Lua, NULL for Lua tasks. */
 
    struct Task_* subtask; /**< Subtasks of the current task. */
 
@@ -55,6 +62,16 @@ typedef struct Task_ {
 typedef struct AI_Profile_ {
    char* name; /**< Name of the profile. */
    nlua_env env; /**< Assosciated Lua Environment. */
+
+   /* Resolved when loading, see ai_loadProfile(). */
+   NameHash funcs; /**< Function name to registry reference. */
+   char **funcnames; /**< Keys of funcs. */
+   int ref_control; /**< control(), LUA_NOREF if not defined. */
+   int ref_control_manual; /**< control_manual(), LUA_NOREF if not defined. */
+   int ref_attacked; /**< attacked(), LUA_NOREF if not defined. */
+   int ref_create; /**< create(), LUA_NOREF if not defined. */
+   int ref_distress; /**< distress(), LUA_NOREF if not defined. */
+   double control_rate; /**< Seconds between control() calls. */
 } AI_Profile;
 
 
@@ -75,6 +92,7 @@ void ai_exit (void);
  * Init, destruction.
  */
 int ai_pinit( Pilot *p, const char *ai );
+int ai_pinitBatch( Pilot **p, int n, const char *ai );
 void ai_destroy( Pilot* p );
 
 /*
@@ -90,6 +108,8 @@ void ai_cleartasks( Pilot* p );
 void ai_attacked( Pilot* attacked, const unsigned int attacker, double dmg );
 void ai_refuel( Pilot* refueler, unsigned int target );
 void ai_getDistress( Pilot *p, const Pilot *distressed, const Pilot *attacker );
+void ai_frameStart (void);
+void ai_frameEnd (void);
 void ai_think( Pilot* pilot, const double dt );
 void ai_setPilot( Pilot *p );
 
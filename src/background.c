@@ -12,6 +12,8 @@
 
 #include "naev.h"
 
+#include <stdlib.h>
+
 #include "nxml.h"
 
 #include "opengl.h"
@@ -28,6 +30,7 @@
 #include "nlua_col.h"
 #include "nlua_bkg.h"
 #include "camera.h"
+#include "gui.h"
 #include "nebula.h"
 #include "nstring.h"
 
@@ -48,6 +51,31 @@ static background_image_t *bkg_image_arr_bk = NULL; /**< Background image array
 static background_image_t *bkg_image_arr_ft = NULL; /**< Background image array to display (in front of stars). */
 
 
+/**
+ * @brief Run of baked background quads sharing movement and texture.
+ */
+typedef struct background_run_s {
+   double move; /**< Movement of the images in the run. */
+   GLuint texture; /**< Texture of the images in the run. */
+   int first; /**< First quad of the run. */
+   int n; /**< Number of quads in the run. */
+} background_run_t;
+/**
+ * @brief Background images baked into a static VBO, sorted by movement.
+ *
+ * Quads are in layer coordinates, the camera and parallax are applied through
+ *  the matrix of each movement so nothing is uploaded per frame.
+ */
+typedef struct background_bake_s {
+   gl_vbo *vbo; /**< Vertex, texture coordinates and colour of the quads. */
+   background_run_t *runs; /**< Runs to draw in order. */
+   int nquads; /**< Number of quads in the VBO. */
+   int dirty; /**< Whether the images changed since baking. */
+} background_bake_t;
+static background_bake_t bkg_bake_bk; /**< Baked images behind the stars. */
+static background_bake_t bkg_bake_ft; /**< Baked images in front of the stars. */
+
+
 static unsigned int bkg_idgen = 0; /**< ID generator for backgrounds. */
 
 
@@ -71,17 +99,51 @@ static unsigned int mstars = 0; /**< Memory stars are taking. */
 static GLfloat star_x = 0.; /**< Star X movement. */
 static GLfloat star_y = 0.; /**< Star Y movement. */
 
+/*
+ * Shader starfield, stars stay put in the VBO and are moved by the program.
+ */
+#define STAR_REBASE  65536. /**< Offset at which it's folded into the VBO to keep precision. */
+static gl_vbo *star_texVBO = NULL; /**< Brightness and tail flag of the vertices. */
+static GLfloat *star_tex = NULL; /**< Brightness and tail flag of the vertices. */
+static GLuint star_program = 0; /**< Starfield program, 0 if unavailable. */
+static int star_programTried = 0; /**< Whether building star_program was tried. */
+static GLint star_uOffset = -1; /**< Location of the offset uniform. */
+static GLint star_uDim = -1; /**< Location of the wrap dimensions uniform. */
+static GLint star_uStreak = -1; /**< Location of the motion blur uniform. */
+static double star_ox = 0.; /**< Movement not yet folded into the VBO. */
+static double star_oy = 0.; /**< Movement not yet folded into the VBO. */
+static const char star_vertSrc[] =
+   "uniform vec2 offset;\n"
+   "uniform vec2 dim;\n"
+   "uniform vec2 streak;\n"
+   "void main(void) {\n"
+   "   float b = gl_MultiTexCoord0.x;\n"
+   "   vec2 p  = gl_Vertex.xy + offset / (9. - 10.*b);\n"
+   "   p  = mod( p + 0.5*dim, dim ) - 0.5*dim;\n"
+   "   p += streak * b * gl_MultiTexCoord0.y;\n"
+   "   gl_Position   = gl_ModelViewProjectionMatrix * vec4( p, 0., 1. );\n"
+   "   gl_FrontColor = gl_Color;\n"
+   "}\n"; /**< Parallax, wrap-around and motion blur of the stars. */
+
 
 /*
  * Prototypes.
  */
-static void background_renderImages( background_image_t *bkg_arr );
+static void background_renderImages( background_image_t *bkg_arr,
+      background_bake_t *bake );
+static void background_bakeImages( background_image_t *bkg_arr,
+      background_bake_t *bake );
+static void background_freeBake( background_bake_t *bake );
 static nlua_env background_create( const char *path );
 static void background_clearCurrent (void);
 static void background_clearImgArr( background_image_t **arr );
 /* Sorting. */
 static int bkg_compare( const void *p1, const void *p2 );
 static void bkg_sort( background_image_t *arr );
+/* Stars. */
+static void background_starDim( GLfloat *w, GLfloat *h );
+static void background_shiftStars( double x, double y, GLfloat w, GLfloat h );
+static void background_initStarProgram (void);
 
 
 /**
@@ -100,10 +162,7 @@ void background_initStars( int n )
    size /= pow2(conf.zoom_far);
 
    /* Calculate star buffer. */
-   w  = (SCREEN_W + 2.*STAR_BUF);
-   w += conf.zoom_stars * (w / conf.zoom_far - 1.);
-   h  = (SCREEN_H + 2.*STAR_BUF);
-   h += conf.zoom_stars * (h / conf.zoom_far - 1.);
+   background_starDim( &w, &h );
    hw = w / 2.;
    hh = h / 2.;
 
@@ -115,14 +174,15 @@ void background_initStars( int n )
       /* Create data. */
       star_vertex = realloc( star_vertex, nstars * sizeof(GLfloat) * 4 );
       star_colour = realloc( star_colour, nstars * sizeof(GLfloat) * 8 );
+      star_tex    = realloc( star_tex, nstars * sizeof(GLfloat) * 4 );
       mstars = nstars;
    }
    for (i=0; i < nstars; i++) {
       /* Set the position. */
       star_vertex[4*i+0] = RNGF()*w - hw;
       star_vertex[4*i+1] = RNGF()*h - hh;
-      star_vertex[4*i+2] = 0.;
-      star_vertex[4*i+3] = 0.;
+      star_vertex[4*i+2] = star_vertex[4*i+0];
+      star_vertex[4*i+3] = star_vertex[4*i+1];
       /* Set the colour. */
       star_colour[8*i+0] = 1.;
       star_colour[8*i+1] = 1.;
@@ -133,6 +193,15 @@ void background_initStars( int n )
       star_colour[8*i+6] = 1.;
       star_colour[8*i+7] = 0.;
    }
+   /* Both vertices get the brightness of the star, the tail is flagged. */
+   for (i=0; i < nstars; i++) {
+      star_tex[4*i+0] = star_colour[8*i+3];
+      star_tex[4*i+1] = 0.;
+      star_tex[4*i+2] = star_colour[8*i+3];
+      star_tex[4*i+3] = 1.;
+   }
+   star_ox = 0.;
+   star_oy = 0.;
 
    /* Destroy old VBO. */
    if (star_vertexVBO != NULL) {
@@ -143,12 +212,84 @@ void background_initStars( int n )
       gl_vboDestroy( star_colourVBO );
       star_colourVBO = NULL;
    }
+   if (star_texVBO != NULL) {
+      gl_vboDestroy( star_texVBO );
+      star_texVBO = NULL;
+   }
 
    /* Create now VBO. */
    star_vertexVBO = gl_vboCreateStream(
          nstars * sizeof(GLfloat) * 4, star_vertex );
    star_colourVBO = gl_vboCreateStatic(
          nstars * sizeof(GLfloat) * 8, star_colour );
+
+   /* The shader only needs the vertices uploaded when rebasing. */
+   background_initStarProgram();
+   if (star_program != 0)
+      star_texVBO = gl_vboCreateStatic(
+            nstars * sizeof(GLfloat) * 4, star_tex );
+}
+
+
+/**
+ * @brief Builds the starfield program the first time it's needed.
+ */
+static void background_initStarProgram (void)
+{
+   if (star_programTried)
+      return;
+   star_programTried = 1;
+
+   star_program = gl_programCreate( "stars", star_vertSrc, NULL );
+   if (star_program == 0)
+      return;
+   star_uOffset = nglGetUniformLocation( star_program, "offset" );
+   star_uDim    = nglGetUniformLocation( star_program, "dim" );
+   star_uStreak = nglGetUniformLocation( star_program, "streak" );
+}
+
+
+/**
+ * @brief Gets the dimensions of the area the stars wrap around in.
+ */
+static void background_starDim( GLfloat *w, GLfloat *h )
+{
+   *w  = (SCREEN_W + 2.*STAR_BUF);
+   *w += conf.zoom_stars * (*w / conf.zoom_far - 1.);
+   *h  = (SCREEN_H + 2.*STAR_BUF);
+   *h += conf.zoom_stars * (*h / conf.zoom_far - 1.);
+}
+
+
+/**
+ * @brief Moves the stars in star_vertex with parallax and wraps them around.
+ *
+ * Handles any displacement in a single pass.
+ */
+static void background_shiftStars( double x, double y, GLfloat w, GLfloat h )
+{
+   unsigned int i;
+   GLfloat hw, hh, b;
+
+   hw = w/2.;
+   hh = h/2.;
+   for (i=0; i < nstars; i++) {
+
+      /* Calculate new position */
+      b = 1./(9. - 10.*star_colour[8*i+3]);
+      star_vertex[4*i+0] = star_vertex[4*i+0] + x*b;
+      star_vertex[4*i+1] = star_vertex[4*i+1] + y*b;
+
+      /* check boundaries */
+      if ((star_vertex[4*i+0] > hw) || (star_vertex[4*i+0] < -hw)) {
+         star_vertex[4*i+0] = fmod( star_vertex[4*i+0] + hw, w );
+         star_vertex[4*i+0] += (star_vertex[4*i+0] < 0.) ? hw : -hw;
+      }
+      if ((star_vertex[4*i+1] > hh) || (star_vertex[4*i+1] < -hh)) {
+         star_vertex[4*i+1] = fmod( star_vertex[4*i+1] + hh, h );
+         star_vertex[4*i+1] += (star_vertex[4*i+1] < 0.) ? hh : -hh;
+      }
+   }
 }
 
 
@@ -168,9 +309,10 @@ void background_moveStars( double x, double y )
 /**
  * @brief Renders the starry background.
  *
- * This could really benefit from OpenCL directly. It would probably give a great
- *  speed up, although we'll consider it when we get a runtime linking OpenCL
- *  framework someday.
+ * With shaders the stars stay put in the VBO and the program applies the
+ *  parallax, wrap-around and motion blur, so the CPU cost doesn't depend on
+ *  the number of stars or on how fast the player is going. Otherwise the
+ *  stars are moved here and re-uploaded every frame.
  *
  *    @param dt Current delta tick.
  */
@@ -178,13 +320,11 @@ void background_renderStars( const double dt )
 {
    (void) dt;
    unsigned int i;
-   GLfloat hh, hw, h, w;
-   GLfloat x, y, m, b;
+   GLfloat h, w;
+   GLfloat x, y, m;
    GLfloat brightness;
    double z;
-   double sx, sy;
    int shade_mode;
-   int j, n;
 
 
    /*
@@ -198,55 +338,39 @@ void background_renderStars( const double dt )
       gl_matrixTranslate( SCREEN_W/2., SCREEN_H/2. );
       gl_matrixScale( z, z );
 
+   /* Calculate some dimensions. */
+   background_starDim( &w, &h );
+
    if (!paused && (player.p != NULL) && !player_isFlag(PLAYER_DESTROYED) &&
          !player_isFlag(PLAYER_CREATING)) { /* update position */
 
-      /* Calculate some dimensions. */
-      w  = (SCREEN_W + 2.*STAR_BUF);
-      w += conf.zoom_stars * (w / conf.zoom_far - 1.);
-      h  = (SCREEN_H + 2.*STAR_BUF);
-      h += conf.zoom_stars * (h / conf.zoom_far - 1.);
-      hw = w/2.;
-      hh = h/2.;
-
-      /* Calculate multiple updates in the case the ship is moving really ridiculously fast. */
-      if ((star_x > SCREEN_W) || (star_y > SCREEN_H)) {
-         sx = ceil( star_x / SCREEN_W );
-         sy = ceil( star_y / SCREEN_H );
-         n  = MAX( sx, sy );
-         star_x /= (double)n;
-         star_y /= (double)n;
-      }
-      else
-         n = 1;
-
-      /* Calculate new star positions. */
-      for (j=0; j < n; j++) {
-         for (i=0; i < nstars; i++) {
-
-            /* Calculate new position */
-            b = 1./(9. - 10.*star_colour[8*i+3]);
-            star_vertex[4*i+0] = star_vertex[4*i+0] + star_x*b;
-            star_vertex[4*i+1] = star_vertex[4*i+1] + star_y*b;
-
-            /* check boundaries */
-            if (star_vertex[4*i+0] > hw)
-               star_vertex[4*i+0] -= w;
-            else if (star_vertex[4*i+0] < -hw)
-               star_vertex[4*i+0] += w;
-            if (star_vertex[4*i+1] > hh)
-               star_vertex[4*i+1] -= h;
-            else if (star_vertex[4*i+1] < -hh)
-               star_vertex[4*i+1] += h;
+      if (star_program != 0) {
+         star_ox += star_x;
+         star_oy += star_y;
+
+         /* Fold the offset in once in a while so floats don't lose precision. */
+         if ((fabs(star_ox) > STAR_REBASE) || (fabs(star_oy) > STAR_REBASE)) {
+            background_shiftStars( star_ox, star_oy, w, h );
+            for (i=0; i < nstars; i++) {
+               star_vertex[4*i+2] = star_vertex[4*i+0];
+               star_vertex[4*i+3] = star_vertex[4*i+1];
+            }
+            gl_vboSubData( star_vertexVBO, 0, nstars * 4 * sizeof(GLfloat), star_vertex );
+            star_ox = 0.;
+            star_oy = 0.;
          }
       }
+      else {
+         background_shiftStars( star_x, star_y, w, h );
 
-      /* Upload the data. */
-      gl_vboSubData( star_vertexVBO, 0, nstars * 4 * sizeof(GLfloat), star_vertex );
+         /* Upload the data. */
+         gl_vboSubData( star_vertexVBO, 0, nstars * 4 * sizeof(GLfloat), star_vertex );
+      }
    }
 
    /* Decide on shade mode. */
    shade_mode = 0;
+   x = y = 0.;
    if ((player.p != NULL) && !player_isFlag(PLAYER_DESTROYED) &&
          !player_isFlag(PLAYER_CREATING)) {
 
@@ -276,7 +400,7 @@ void background_renderStars( const double dt )
          y = m*sin(VANGLE(player.p->solid->vel));
       }
 
-      if (shade_mode) {
+      if (shade_mode && (star_program == 0)) {
          /* Generate lines. */
          for (i=0; i < nstars; i++) {
             brightness = star_colour[8*i+3];
@@ -292,13 +416,24 @@ void background_renderStars( const double dt )
    /* Render. */
    gl_vboActivate( star_vertexVBO, GL_VERTEX_ARRAY, 2, GL_FLOAT, 2 * sizeof(GLfloat) );
    gl_vboActivate( star_colourVBO, GL_COLOR_ARRAY,  4, GL_FLOAT, 4 * sizeof(GLfloat) );
+   if (star_program != 0) {
+      gl_vboActivate( star_texVBO, GL_TEXTURE_COORD_ARRAY, 2, GL_FLOAT, 2 * sizeof(GLfloat) );
+      nglUseProgram( star_program );
+      nglUniform2f( star_uOffset, star_ox, star_oy );
+      nglUniform2f( star_uDim, w, h );
+      nglUniform2f( star_uStreak, x, y );
+   }
    if (shade_mode) {
       glDrawArrays( GL_LINES, 0, nstars );
+      if (star_program != 0)
+         nglUniform2f( star_uStreak, 0., 0. );
       glDrawArrays( GL_POINTS, 0, nstars ); /* This second pass is when the lines are very short that they "lose" intensity. */
       glShadeModel(GL_FLAT);
    }
    else
       glDrawArrays( GL_POINTS, 0, nstars );
+   if (star_program != 0)
+      nglUseProgram( 0 );
 
    /* Clear star movement. */
    star_x = 0.;
@@ -320,9 +455,9 @@ void background_renderStars( const double dt )
  */
 void background_render( double dt )
 {
-   background_renderImages( bkg_image_arr_bk );
+   background_renderImages( bkg_image_arr_bk, &bkg_bake_bk );
    background_renderStars(dt);
-   background_renderImages( bkg_image_arr_ft );
+   background_renderImages( bkg_image_arr_ft, &bkg_bake_ft );
 }
 
 
@@ -340,6 +475,12 @@ static int bkg_compare( const void *p1, const void *p2 )
       return -1;
    else if (bkg1->move > bkg2->move)
       return +1;
+
+   /* Keep the order they were added in. */
+   if (bkg1->id < bkg2->id)
+      return -1;
+   else if (bkg1->id > bkg2->id)
+      return +1;
    return  0;
 }
 
@@ -361,10 +502,14 @@ unsigned int background_addImage( glTexture *image, double x, double y,
 {
    background_image_t *bkg, **arr;
 
-   if (foreground)
+   if (foreground) {
       arr = &bkg_image_arr_ft;
-   else
+      bkg_bake_ft.dirty = 1;
+   }
+   else {
       arr = &bkg_image_arr_bk;
+      bkg_bake_bk.dirty = 1;
+   }
 
    /* See if must create. */
    if (*arr == NULL)
@@ -380,39 +525,173 @@ unsigned int background_addImage( glTexture *image, double x, double y,
    bkg->scale  = scale;
    bkg->col    = (col!=NULL) ? *col : cWhite;
 
-   /* Sort if necessary. */
-   bkg_sort( *arr );
-
+   /* Sorted when baked. */
    return bkg_idgen;
 }
 
 
 /**
- * @brief Renders the background images.
+ * @brief Sorts the background images and bakes them into a static VBO.
+ *
+ *    @param bkg_arr Images to bake.
+ *    @param bake Where to bake them.
  */
-static void background_renderImages( background_image_t *bkg_arr )
+static void background_bakeImages( background_image_t *bkg_arr,
+      background_bake_t *bake )
 {
-   int i;
+   int i, j, n;
    background_image_t *bkg;
-   double px,py, x,y, xs,ys, z;
+   background_run_t *run;
+   GLfloat *data, *vtx, *tex, *col;
+   GLfloat x, y, w, h;
+
+   bake->dirty = 0;
+   bake->nquads = 0;
+   if (bake->runs == NULL)
+      bake->runs = array_create( background_run_t );
+   else
+      array_erase( &bake->runs, array_begin(bake->runs), array_end(bake->runs) );
+
+   n = (bkg_arr != NULL) ? array_size(bkg_arr) : 0;
+   if (n == 0)
+      return;
+   bkg_sort( bkg_arr );
+
+   /* Vertices, then texture coordinates, then colours. */
+   data = malloc( n*4*(2+2+4) * sizeof(GLfloat) );
+   run  = NULL;
+   for (i=0; i<n; i++) {
+      bkg = &bkg_arr[i];
+
+      /* Quad around the moved centre, before camera and zoom. */
+      w = bkg->scale * bkg->image->sw;
+      h = bkg->scale * bkg->image->sh;
+      x = bkg->x * bkg->move - w/2.;
+      y = bkg->y * bkg->move - h/2.;
+      vtx = &data[ i*4*2 ];
+      vtx[0] = x;
+      vtx[1] = y;
+      vtx[2] = x + w;
+      vtx[3] = y;
+      vtx[4] = x + w;
+      vtx[5] = y + h;
+      vtx[6] = x;
+      vtx[7] = y + h;
+
+      tex = &data[ n*4*2 + i*4*2 ];
+      tex[0] = bkg->image->ox;
+      tex[1] = bkg->image->oy;
+      tex[2] = bkg->image->ox + bkg->image->srw;
+      tex[3] = tex[1];
+      tex[4] = tex[2];
+      tex[5] = bkg->image->oy + bkg->image->srh;
+      tex[6] = tex[0];
+      tex[7] = tex[5];
+
+      col = &data[ n*4*(2+2) + i*4*4 ];
+      for (j=0; j<4; j++) {
+         col[4*j+0] = bkg->col.r;
+         col[4*j+1] = bkg->col.g;
+         col[4*j+2] = bkg->col.b;
+         col[4*j+3] = bkg->col.a;
+      }
+
+      /* Extend the run if nothing changes. */
+      if ((run == NULL) || (run->move != bkg->move) ||
+            (run->texture != bkg->image->texture)) {
+         run          = &array_grow( &bake->runs );
+         run->move    = bkg->move;
+         run->texture = bkg->image->texture;
+         run->first   = i;
+         run->n       = 0;
+      }
+      run->n++;
+   }
+
+   if (bake->vbo != NULL)
+      gl_vboDestroy( bake->vbo );
+   bake->vbo    = gl_vboCreateStatic( n*4*(2+2+4) * sizeof(GLfloat), data );
+   bake->nquads = n;
+   free( data );
+}
+
+
+/**
+ * @brief Frees baked background images.
+ *
+ *    @param bake Baked images to free.
+ */
+static void background_freeBake( background_bake_t *bake )
+{
+   if (bake->vbo != NULL)
+      gl_vboDestroy( bake->vbo );
+   bake->vbo = NULL;
+   if (bake->runs != NULL)
+      array_free( bake->runs );
+   bake->runs   = NULL;
+   bake->nquads = 0;
+   bake->dirty  = 0;
+}
+
+
+/**
+ * @brief Renders the background images.
+ *
+ *    @param bkg_arr Images to render.
+ *    @param bake Baked images, rebaked if they changed.
+ */
+static void background_renderImages( background_image_t *bkg_arr,
+      background_bake_t *bake )
+{
+   int i, shader;
+   background_run_t *run;
+   double px,py, gx,gy, z;
 
    /* Must have an image array created. */
    if (bkg_arr == NULL)
       return;
+   if (bake->dirty)
+      background_bakeImages( bkg_arr, bake );
+   if (bake->nquads == 0)
+      return;
 
-   /* Render images in order. */
-   for (i=0; i<array_size(bkg_arr); i++) {
-      bkg = &bkg_arr[i];
+   cam_getPos( &px, &py );
+   gui_getOffset( &gx, &gy );
+   z = cam_getZoom();
 
-      cam_getPos( &px, &py );
-      x  = px + (bkg->x - px) * bkg->move - bkg->scale*bkg->image->sw/2.;
-      y  = py + (bkg->y - py) * bkg->move - bkg->scale*bkg->image->sh/2.;
-      gl_gameToScreenCoords( &xs, &ys, x, y );
-      z = cam_getZoom();
-      z *= bkg->scale;
-      gl_blitScale( bkg->image, xs, ys,
-            z*bkg->image->sw, z*bkg->image->sh, &bkg->col );
+   gl_vboActivateOffset( bake->vbo, GL_VERTEX_ARRAY, 0, 2, GL_FLOAT, 0 );
+   gl_vboActivateOffset( bake->vbo, GL_TEXTURE_COORD_ARRAY,
+         bake->nquads*4*2 * sizeof(GLfloat), 2, GL_FLOAT, 0 );
+   gl_vboActivateOffset( bake->vbo, GL_COLOR_ARRAY,
+         bake->nquads*4*(2+2) * sizeof(GLfloat), 4, GL_FLOAT, 0 );
+
+   /* Render runs in order, parallax comes from the matrix. */
+   shader = 0;
+   for (i=0; i<array_size(bake->runs); i++) {
+      run = &bake->runs[i];
+
+      gl_matrixPush();
+         gl_matrixTranslate( SCREEN_W/2. + gx - z*run->move*px,
+               SCREEN_H/2. + gy - z*run->move*py );
+         gl_matrixScale( z, z );
+
+      shader = (gl_programUse( GL_PROG_TEXTURE, NULL ) == 0);
+      if (!shader)
+         glEnable(GL_TEXTURE_2D);
+      glBindTexture( GL_TEXTURE_2D, run->texture );
+      glDrawArrays( GL_QUADS, run->first*4, run->n*4 );
+
+      gl_matrixPop();
    }
+
+   /* Clear state. */
+   gl_vboDeactivate();
+   if (shader)
+      gl_programUnuse();
+   else
+      glDisable(GL_TEXTURE_2D);
+
+   gl_checkErr();
 }
 
 
@@ -504,6 +783,10 @@ int background_load( const char *name )
             (err) ? err : "unknown error");
       lua_pop(naevL, 1);
    }
+
+   /* Sort and bake everything the script added at once. */
+   background_bakeImages( bkg_image_arr_bk, &bkg_bake_bk );
+   background_bakeImages( bkg_image_arr_ft, &bkg_bake_ft );
    return ret;
 }
 
@@ -532,6 +815,8 @@ void background_clear (void)
    /* Clear the backgrounds. */
    background_clearImgArr( &bkg_image_arr_bk );
    background_clearImgArr( &bkg_image_arr_ft );
+   background_freeBake( &bkg_bake_bk );
+   background_freeBake( &bkg_bake_ft );
 }
 
 
@@ -594,6 +879,13 @@ void background_free (void)
       gl_vboDestroy( star_colourVBO );
       star_colourVBO = NULL;
    }
+   if (star_texVBO != NULL) {
+      gl_vboDestroy( star_texVBO );
+      star_texVBO = NULL;
+   }
+   gl_programFree( star_program );
+   star_program      = 0;
+   star_programTried = 0;
 
    /* Free the stars. */
    if (star_vertex != NULL) {
@@ -604,6 +896,10 @@ void background_free (void)
       free(star_colour);
       star_colour = NULL;
    }
+   if (star_tex != NULL) {
+      free(star_tex);
+      star_tex = NULL;
+   }
    nstars = 0;
    mstars = 0;
 }
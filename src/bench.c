@@ -0,0 +1,645 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file bench.c
+ *
+ * @brief Runs deterministic simulation benchmarks.
+ *
+ * A scenario sets up a fleet battle in a system with no player, which is
+ *  then stepped with a fixed delta tick from a seeded random number
+ *  generator so that runs can be compared. Nothing is rendered and sound is
+ *  disabled, only the time spent in each update phase is measured.
+ *
+ * Scenarios are loaded from BENCH_DATA_PATH and look like:
+ * @code
+ * <bench>
+ *  <system>Gamma Polaris</system>
+ *  <seed>1</seed>
+ *  <frames>3600</frames>
+ *  <dt>0.0166667</dt>
+ *  <fleet x="-3000" y="0" count="4">Empire Lancelot</fleet>
+ *  <fleet x="3000" y="0" count="6">Pirate Vendetta</fleet>
+ * </bench>
+ * @endcode
+ *
+ * The BENCH_KERNELS name instead times engine kernels one at a time on the
+ *  loaded data. Each kernel prints a single line for scripts to pick up:
+ * @code
+ * bench,<kernel>,<iterations>,<total ms>,<ns per iteration>,<checksum>
+ * @endcode
+ */
+
+
+#include "bench.h"
+
+#include "naev.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "log.h"
+#include "nxml.h"
+#include "ndata.h"
+#include "nstring.h"
+#include "array.h"
+#include "rng.h"
+#include "perf.h"
+#include "space.h"
+#include "fleet.h"
+#include "pilot.h"
+#include "ship.h"
+#include "outfit.h"
+#include "collision.h"
+#include "perlin.h"
+#include "economy.h"
+#include "map.h"
+#include "cond.h"
+
+
+#define XML_BENCH_ID    "bench" /**< XML document tag of a scenario. */
+
+#define BENCH_FRAMES    3600 /**< Default number of frames simulated. */
+#define BENCH_DT        (1./60.) /**< Default delta tick. */
+#define BENCH_SPREAD    150. /**< Maximum displacement of fleet members. */
+
+#define BENCH_REPEAT    4 /**< Times each kernel is timed, the fastest is kept. */
+
+
+/**
+ * @brief Fleet spawned by a scenario.
+ */
+typedef struct BenchFleet_ {
+   Fleet *flt; /**< Fleet to spawn. */
+   Vector2d pos; /**< Where to spawn it. */
+   int count; /**< Number of times to spawn it. */
+} BenchFleet;
+
+
+/**
+ * @brief Benchmark scenario.
+ */
+typedef struct BenchScenario_ {
+   char *system; /**< System to fight in. */
+   uint32_t seed; /**< Random seed. */
+   int frames; /**< Frames to simulate. */
+   double dt; /**< Delta tick of each frame. */
+   BenchFleet *fleets; /**< Fleets to spawn. */
+} BenchScenario;
+
+
+/*
+ * Prototypes.
+ */
+static int bench_load( BenchScenario *s, const char *name );
+static void bench_free( BenchScenario *s );
+static int bench_spawn( const BenchScenario *s );
+static double bench_checksum (void);
+static double bench_clock (void);
+static void bench_kernel( const char *name, double (*func)( int n, void *data ),
+      int n, void *data );
+static double bench_kCollide( int n, void *data );
+static double bench_kCollideLine( int n, void *data );
+static double bench_kNoise( int n, void *data );
+static double bench_kEconomy( int n, void *data );
+static double bench_kJumpPath( int n, void *data );
+static double bench_kCond( int n, void *data );
+static double bench_kCondRef( int n, void *data );
+static double bench_kOutfitGet( int n, void *data );
+static double bench_kSystemGet( int n, void *data );
+static void bench_xmlDoc( xmlDocPtr doc, int i, void *data );
+static double bench_kXML( int n, void *data );
+static int bench_kernels (void);
+
+
+/**
+ * @brief Loads a scenario.
+ *
+ *    @param[out] s Scenario to load.
+ *    @param name Name of the scenario.
+ *    @return 0 on success.
+ */
+static int bench_load( BenchScenario *s, const char *name )
+{
+   char file[PATH_MAX], *buf;
+   uint32_t bufsize;
+   xmlDocPtr doc;
+   xmlNodePtr node;
+   BenchFleet *bf;
+   Fleet *flt;
+
+   memset( s, 0, sizeof(BenchScenario) );
+   s->frames = BENCH_FRAMES;
+   s->dt     = BENCH_DT;
+   s->seed   = 1;
+   s->fleets = array_create( BenchFleet );
+
+   nsnprintf( file, sizeof(file), BENCH_DATA_PATH"%s.xml", name );
+   buf = ndata_read( file, &bufsize );
+   if (buf == NULL) {
+      WARN("Benchmark scenario '%s' not found.", file);
+      return -1;
+   }
+
+   doc = xmlParseMemory( buf, bufsize );
+   free( buf );
+   if (doc == NULL) {
+      WARN("Unable to parse benchmark scenario '%s'.", file);
+      return -1;
+   }
+
+   node = doc->xmlChildrenNode;
+   if (!xml_isNode(node,XML_BENCH_ID)) {
+      WARN("Malformed '%s' file: missing root element '"XML_BENCH_ID"'", file);
+      xmlFreeDoc( doc );
+      return -1;
+   }
+
+   node = node->xmlChildrenNode;
+   do {
+      xml_onlyNodes(node);
+
+      xmlr_strd( node, "system", s->system );
+      xmlr_uint( node, "seed", s->seed );
+      xmlr_int( node, "frames", s->frames );
+      xmlr_float( node, "dt", s->dt );
+
+      if (xml_isNode(node,"fleet")) {
+         flt = (xml_get(node) != NULL) ? fleet_get( xml_raw(node) ) : NULL;
+         if (flt == NULL) {
+            WARN("'%s' has unknown fleet '%s'.", file, xml_get(node));
+            continue;
+         }
+
+         bf        = &array_grow( &s->fleets );
+         bf->flt   = flt;
+         bf->count = 1;
+         vectnull( &bf->pos );
+         xmlr_attr( node, "x", buf );
+         if (buf != NULL) {
+            bf->pos.x = atof( buf );
+            free( buf );
+         }
+         xmlr_attr( node, "y", buf );
+         if (buf != NULL) {
+            bf->pos.y = atof( buf );
+            free( buf );
+         }
+         xmlr_attr( node, "count", buf );
+         if (buf != NULL) {
+            bf->count = MAX( 1, atoi( buf ) );
+            free( buf );
+         }
+         continue;
+      }
+
+      WARN("'%s' has unknown node '%s'.", file, node->name);
+   } while (xml_nextNode(node));
+
+   xmlFreeDoc( doc );
+
+   if (s->system == NULL) {
+      WARN("Benchmark scenario '%s' has no system.", file);
+      return -1;
+   }
+   if ((s->frames <= 0) || (s->dt <= 0.)) {
+      WARN("Benchmark scenario '%s' has no frames to run.", file);
+      return -1;
+   }
+   return 0;
+}
+
+
+/**
+ * @brief Frees a scenario.
+ */
+static void bench_free( BenchScenario *s )
+{
+   free( s->system );
+   array_free( s->fleets );
+}
+
+
+/**
+ * @brief Spawns the fleets of a scenario, facing the system centre.
+ *
+ *    @return Number of pilots spawned.
+ */
+static int bench_spawn( const BenchScenario *s )
+{
+   int i, j, k, n;
+   double dir;
+   Vector2d vp, vv;
+   PilotFlags flags;
+   const BenchFleet *bf;
+
+   pilot_clearFlagsRaw( flags );
+   vectnull( &vv );
+
+   n = 0;
+   for (i=0; i<array_size(s->fleets); i++) {
+      bf  = &s->fleets[i];
+      dir = ANGLE( -bf->pos.x, -bf->pos.y );
+      for (j=0; j<bf->count; j++) {
+         for (k=0; k<bf->flt->npilots; k++) {
+            vect_cset( &vp, bf->pos.x + BENCH_SPREAD * (2.*RNGF()-1.),
+                  bf->pos.y + BENCH_SPREAD * (2.*RNGF()-1.) );
+            fleet_createPilot( bf->flt, &bf->flt->pilots[k], dir,
+                  &vp, &vv, NULL, flags );
+            n++;
+         }
+      }
+   }
+   return n;
+}
+
+
+/**
+ * @brief Sums up the state of the pilots so runs can be compared.
+ */
+static double bench_checksum (void)
+{
+   int i, n;
+   double sum;
+   Pilot **pilots;
+
+   pilots = pilot_getAll( &n );
+   sum    = 0.;
+   for (i=0; i<n; i++)
+      sum += pilots[i]->solid->pos.x + pilots[i]->solid->pos.y +
+            pilots[i]->armour + pilots[i]->shield;
+   return sum;
+}
+
+
+/**
+ * @brief Gets the time in milliseconds.
+ */
+static double bench_clock (void)
+{
+#if SDL_VERSION_ATLEAST(2,0,0)
+   return (double)SDL_GetPerformanceCounter() * 1e3 /
+         (double)SDL_GetPerformanceFrequency();
+#else /* SDL_VERSION_ATLEAST(2,0,0) */
+   return (double)SDL_GetTicks();
+#endif /* SDL_VERSION_ATLEAST(2,0,0) */
+}
+
+
+/**
+ * @brief Times a kernel and prints its result line.
+ *
+ * The kernel is run BENCH_REPEAT times and the fastest run is kept so the
+ *  numbers are as repeatable as the machine allows.
+ *
+ *    @param name Name of the kernel.
+ *    @param func Kernel to run, returns a checksum of what it computed.
+ *    @param n Iterations of each run.
+ *    @param data Data to pass to the kernel.
+ */
+static void bench_kernel( const char *name, double (*func)( int n, void *data ),
+      int n, void *data )
+{
+   int i;
+   double t0, t, best, sum;
+
+   best = -1.;
+   sum  = 0.;
+   for (i=0; i<BENCH_REPEAT; i++) {
+      t0  = bench_clock();
+      sum = func( n, data );
+      t   = bench_clock() - t0;
+      if ((best < 0.) || (t < best))
+         best = t;
+   }
+   LOG("bench,%s,%d,%.3f,%.1f,%.6g", name, n, best, best * 1e6 / n, sum);
+}
+
+
+/**
+ * @brief Sprite to sprite collisions of a ship against itself.
+ */
+static double bench_kCollide( int n, void *data )
+{
+   int i, hits, sx, sy;
+   const glTexture *gfx;
+   Vector2d ap, bp, crash;
+
+   gfx  = data;
+   hits = 0;
+   vectnull( &ap );
+   for (i=0; i<n; i++) {
+      sx = i % (int)gfx->sx;
+      sy = (i / (int)gfx->sx) % (int)gfx->sy;
+      vect_cset( &bp, ((i%17)-8) * gfx->sw / 8., ((i%13)-6) * gfx->sh / 6. );
+      hits += CollideSprite( gfx, sx, sy, &ap, gfx, sy % (int)gfx->sx,
+            sx % (int)gfx->sy, &bp, &crash );
+   }
+   return hits;
+}
+
+
+/**
+ * @brief Beam collisions through a ship at varying offsets and angles.
+ */
+static double bench_kCollideLine( int n, void *data )
+{
+   int i, hits;
+   const glTexture *gfx;
+   Vector2d ap, bp, crash[2];
+
+   gfx  = data;
+   hits = 0;
+   vectnull( &bp );
+   for (i=0; i<n; i++) {
+      vect_cset( &ap, -2. * gfx->sw, ((i%21)-10) * gfx->sh / 10. );
+      hits += CollideLineSprite( &ap, ((i%7)-3) * 0.05, 4. * gfx->sw,
+            gfx, i % (int)gfx->sx, (i / (int)gfx->sx) % (int)gfx->sy,
+            &bp, crash );
+   }
+   return hits;
+}
+
+
+/**
+ * @brief Turbulence like the nebula generation uses.
+ */
+static double bench_kNoise( int n, void *data )
+{
+   int i;
+   float f[3];
+   double sum;
+
+   sum = 0.;
+   for (i=0; i<n; i++) {
+      f[0] = (float)(i % 64) * 0.1;
+      f[1] = (float)((i / 64) % 64) * 0.1;
+      f[2] = (float)(i / 4096) * 0.1;
+      sum += noise_turbulence3( data, f, NOISE_MAX_OCTAVES );
+   }
+   return sum;
+}
+
+
+/**
+ * @brief QR solves of the economy matrix.
+ */
+static double bench_kEconomy( int n, void *data )
+{
+   (void) data;
+   return economy_benchSolve( n );
+}
+
+
+/**
+ * @brief Jump paths between systems spread over the universe.
+ */
+static double bench_kJumpPath( int n, void *data )
+{
+   int i, nsys, njumps, sum;
+   StarSystem *sys, **path;
+
+   (void) data;
+   sys = system_getAll( &nsys );
+   sum = 0;
+   for (i=0; i<n; i++) {
+      njumps = 0;
+      path   = map_getJumpPath( &njumps, sys[ (i*7) % nsys ].name,
+            sys[ (i*13+nsys/2) % nsys ].name, 1, 0, NULL );
+      sum   += njumps;
+      free( path );
+   }
+   return sum;
+}
+
+
+/**
+ * @brief Conditions checked from source like missions and events do.
+ */
+static double bench_kCond( int n, void *data )
+{
+   int i, sum;
+
+   sum = 0;
+   for (i=0; i<n; i++)
+      sum += cond_check( data );
+   return sum;
+}
+
+
+/**
+ * @brief Compiled conditions.
+ */
+static double bench_kCondRef( int n, void *data )
+{
+   int i, ref, sum;
+
+   ref = cond_compile( data );
+   sum = 0;
+   for (i=0; i<n; i++)
+      sum += cond_checkRef( ref );
+   cond_free( ref );
+   return sum;
+}
+
+
+/**
+ * @brief Looks up every outfit by name.
+ */
+static double bench_kOutfitGet( int n, void *data )
+{
+   int i, j, nout, sum;
+   Outfit *o;
+
+   (void) data;
+   o   = outfit_getAll( &nout );
+   sum = 0;
+   for (i=0; i<n; i++)
+      for (j=0; j<nout; j++)
+         sum += (outfit_get( o[j].name ) == &o[j]);
+   return sum;
+}
+
+
+/**
+ * @brief Looks up every system by name.
+ */
+static double bench_kSystemGet( int n, void *data )
+{
+   int i, j, nsys, sum;
+   StarSystem *sys;
+
+   (void) data;
+   sys = system_getAll( &nsys );
+   sum = 0;
+   for (i=0; i<n; i++)
+      for (j=0; j<nsys; j++)
+         sum += (system_get( sys[j].name ) == &sys[j]);
+   return sum;
+}
+
+
+/**
+ * @brief Counts the elements at the root of a parsed file.
+ */
+static void bench_xmlDoc( xmlDocPtr doc, int i, void *data )
+{
+   xmlNodePtr node;
+   int *count;
+
+   (void) i;
+   if (doc == NULL)
+      return;
+   count = data;
+   for (node=doc->xmlChildrenNode; node!=NULL; node=node->next)
+      (*count)++;
+   xmlFreeDoc( doc );
+}
+
+
+/**
+ * @brief Reads and parses every XML file in the data.
+ */
+static double bench_kXML( int n, void *data )
+{
+   int i, count;
+   char **files;
+
+   files = data;
+   count = 0;
+   for (i=0; i<n; i++)
+      xml_forEachFile( NULL, files, array_size(files), bench_xmlDoc, &count );
+   return count;
+}
+
+
+/**
+ * @brief Runs the kernel benchmarks on the loaded data.
+ *
+ *    @return 0 on success.
+ */
+static int bench_kernels (void)
+{
+   const char *cond = "math.floor( 7 / 2 ) == 3 and string.len( \"naev\" ) == 4";
+   Ship *ships, *s;
+   perlin_data_t *noise;
+   char **all, **xml;
+   uint32_t nall;
+   size_t len;
+   int i, nships;
+
+   LOG("bench,kernel,iterations,total ms,ns per iteration,checksum");
+
+   /* Collisions against the first ship with graphics. */
+   ships = ship_getAll( &nships );
+   s     = NULL;
+   for (i=0; i<nships; i++) {
+      ship_gfxUse( &ships[i] );
+      if (ships[i].gfx_space != NULL) {
+         s = &ships[i];
+         break;
+      }
+      ship_gfxRelease( &ships[i] );
+   }
+   if (s != NULL) {
+      bench_kernel( "collide_sprite", bench_kCollide, 100000, s->gfx_space );
+      bench_kernel( "collide_line_sprite", bench_kCollideLine, 100000, s->gfx_space );
+      ship_gfxRelease( s );
+   }
+   else
+      WARN("No ship graphics to benchmark collisions with.");
+
+   noise = noise_new( 3, NOISE_DEFAULT_HURST, NOISE_DEFAULT_LACUNARITY );
+   bench_kernel( "noise_turbulence3", bench_kNoise, 100000, noise );
+   noise_delete( noise );
+
+   bench_kernel( "cs_qrsol", bench_kEconomy, 100, NULL );
+   bench_kernel( "map_getJumpPath", bench_kJumpPath, 1000, NULL );
+   bench_kernel( "cond_check", bench_kCond, 10000, (void*)cond );
+   bench_kernel( "cond_checkRef", bench_kCondRef, 10000, (void*)cond );
+   bench_kernel( "outfit_get", bench_kOutfitGet, 100, NULL );
+   bench_kernel( "system_get", bench_kSystemGet, 100, NULL );
+
+   /* XML of all the data. */
+   all = ndata_listRecursive( "dat/", &nall );
+   xml = array_create( char* );
+   for (i=0; i<(int)nall; i++) {
+      len = strlen( all[i] );
+      if ((len > 4) && (strcmp( &all[i][len-4], ".xml" ) == 0))
+         array_push_back( &xml, all[i] );
+      else
+         free( all[i] );
+   }
+   free( all );
+   bench_kernel( "xml_load", bench_kXML, 1, xml );
+   for (i=0; i<array_size(xml); i++)
+      free( xml[i] );
+   array_free( xml );
+
+   return 0;
+}
+
+
+/**
+ * @brief Runs a benchmark scenario and logs the time spent per phase.
+ *
+ *    @param name Name of the scenario in BENCH_DATA_PATH, without extension,
+ *           or BENCH_KERNELS for the kernel benchmarks.
+ *    @return 0 on success.
+ */
+int bench_run( const char *name )
+{
+   BenchScenario s;
+   double total[PERF_PHASES], max[PERF_PHASES], t, sum;
+   int i, j, n;
+
+   if (strcmp( name, BENCH_KERNELS ) == 0)
+      return bench_kernels();
+
+   if (bench_load( &s, name )) {
+      bench_free( &s );
+      return -1;
+   }
+
+   /* Same seed, same battle. */
+   rng_seed( s.seed );
+   space_init( s.system );
+   space_spawn = 0;
+   n = bench_spawn( &s );
+
+   LOG("Benchmark '%s': %d pilots in %s, %d frames of %.4f s, seed %u",
+         name, n, s.system, s.frames, s.dt, s.seed);
+
+   for (j=0; j<PERF_PHASES; j++) {
+      total[j] = 0.;
+      max[j]   = 0.;
+   }
+   for (i=0; i<s.frames; i++) {
+      perf_frameStart( 1 );
+      update_routine( s.dt, 0 );
+      for (j=0; j<PERF_PHASES; j++) {
+         t         = perf_get( j );
+         total[j] += t;
+         max[j]    = MAX( max[j], t );
+      }
+   }
+
+   /* Report. */
+   sum = 0.;
+   LOG("   %-16s %10s %10s %10s", "phase", "total ms", "mean ms", "max ms");
+   for (j=0; j<PERF_PHASES; j++) {
+      if (total[j] <= 0.)
+         continue;
+      LOG("   %-16s %10.2f %10.4f %10.4f", perf_name(j),
+            total[j], total[j] / s.frames, max[j]);
+      sum += total[j];
+   }
+   LOG("   %-16s %10.2f %10.4f", "total", sum, sum / s.frames);
+   pilot_getAll( &n );
+   LOG("Benchmark '%s' finished with %d pilots, checksum %.6f",
+         name, n, bench_checksum());
+
+   bench_free( &s );
+   return 0;
+}
@@ -0,0 +1,16 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef BENCH_H
+#  define BENCH_H
+
+
+#define BENCH_KERNELS    "kernels" /**< Name that runs the kernel benchmarks. */
+
+
+int bench_run( const char *name );
+
+
+#endif /* BENCH_H */
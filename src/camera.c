@@ -24,6 +24,7 @@
 
 
 #define CAMERA_DIR      (M_PI/2.)
+#define CAMERA_LERP_MAX 1000. /**< Moves longer than this in a tick are cuts. */
 
 
 static unsigned int camera_followpilot = 0; /**< Pilot to follow. */
@@ -34,6 +35,11 @@ static double camera_Y     = 0.; /**< Y position of camera. */
 /* Old is used to compensate pilot movement. */
 static double old_X        = 0.; /**< Old X positiion. */
 static double old_Y        = 0.; /**< Old Y position. */
+/* Interpolation between ticks when rendering. */
+static double prev_X       = 0.; /**< X position at the start of the tick. */
+static double prev_Y       = 0.; /**< Y position at the start of the tick. */
+static double sim_X        = 0.; /**< Simulated X position while interpolating. */
+static double sim_Y        = 0.; /**< Simulated Y position while interpolating. */
 /* Target is used why flying over with a target set. */
 static double target_Z     = 0.; /**< Target zoom. */
 static double target_X     = 0.; /**< Target X position. */
@@ -189,6 +195,45 @@ int cam_getTarget( void )
 }
 
 
+/**
+ * @brief Remembers where the camera is at the start of a tick.
+ */
+void cam_snapshot (void)
+{
+   prev_X = camera_X;
+   prev_Y = camera_Y;
+}
+
+
+/**
+ * @brief Moves the camera between its last two ticks for rendering.
+ *
+ * Must be followed by cam_interpolateEnd() before the next update.
+ *
+ *    @param alpha How far into the current tick to render, from 0 to 1.
+ */
+void cam_interpolate( double alpha )
+{
+   sim_X = camera_X;
+   sim_Y = camera_Y;
+   if (pow2(camera_X-prev_X) + pow2(camera_Y-prev_Y) > pow2(CAMERA_LERP_MAX))
+      return;
+   alpha    = CLAMP( 0., 1., alpha );
+   camera_X = prev_X + alpha * (camera_X - prev_X);
+   camera_Y = prev_Y + alpha * (camera_Y - prev_Y);
+}
+
+
+/**
+ * @brief Puts the camera back where the simulation has it.
+ */
+void cam_interpolateEnd (void)
+{
+   camera_X = sim_X;
+   camera_Y = sim_Y;
+}
+
+
 /**
  * @brief Updates the camera.
  *
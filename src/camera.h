@@ -32,6 +32,9 @@ void cam_setTargetPos( double x, double y, int soft_over );
  * Update.
  */
 void cam_update( double dt );
+void cam_snapshot (void);
+void cam_interpolate( double alpha );
+void cam_interpolateEnd (void);
 
 
 #endif /* CAMERA_H */
@@ -12,6 +12,8 @@
 
 #include "naev.h"
 
+#include <string.h>
+
 #include "log.h"
 #include "space.h"
 #include "array.h"
@@ -24,9 +26,20 @@
  */
 struct SysClaim_s {
    int *ids; /**< System ids. */
+   unsigned int active; /**< Generation it was activated in, 0 if inactive. */
 };
 
 
+static int *claim_refs = NULL; /**< Number of active claims on each system. */
+static unsigned int claim_gen = 1; /**< Current claim generation, bumped on clear. */
+
+
+/*
+ * Prototypes.
+ */
+static void claim_release( SysClaim_t *claim );
+
+
 /**
  * @brief Creates a system claim.
  *
@@ -38,6 +51,7 @@ SysClaim_t *claim_create (void)
 
    claim = malloc( sizeof(SysClaim_t) );
    claim->ids = NULL;
+   claim->active = 0;
 
    return claim;
 }
@@ -125,6 +139,7 @@ int claim_testSys( SysClaim_t *claim, int sys )
  */
 void claim_destroy( SysClaim_t *claim )
 {
+   claim_release( claim );
    if (claim->ids != NULL)
       array_free( claim->ids );
    free(claim);
@@ -133,6 +148,8 @@ void claim_destroy( SysClaim_t *claim )
 
 /**
  * @brief Clears the claims on all systems.
+ *
+ * Claims activated before this are considered inactive afterwards.
  */
 void claim_clear (void)
 {
@@ -144,11 +161,23 @@ void claim_clear (void)
    sys = system_getAll( &nsys );
    for (i=0; i<nsys; i++)
       sys_rmFlag( &sys[i], SYSTEM_CLAIMED );
+
+   /* Forget about the counts. */
+   if (claim_refs != NULL) {
+      array_free( claim_refs );
+      claim_refs = NULL;
+   }
+   claim_gen++;
+   if (claim_gen == 0)
+      claim_gen = 1;
 }
 
 
 /**
- * @brief Activates all the claims.
+ * @brief Rebuilds all the claims from the active missions and events.
+ *
+ * Claims are kept up to date as they are activated and destroyed, so this is
+ *  only needed to recover from a claim_clear().
  */
 void claim_activateAll (void)
 {
@@ -165,15 +194,62 @@ void claim_activateAll (void)
  */
 void claim_activate( SysClaim_t *claim )
 {
-   int i;
+   int i, n, nsys;
+
+   /* Already counted. */
+   if (claim->active == claim_gen)
+      return;
+   claim->active = claim_gen;
 
    /* Make sure something to activate. */
    if (claim->ids == NULL)
       return;
 
+   /* Make room for all the systems. */
+   system_getAll( &nsys );
+   if (claim_refs == NULL)
+      claim_refs = array_create( int );
+   n = array_size( claim_refs );
+   if (n < nsys) {
+      array_resize( &claim_refs, nsys );
+      memset( &claim_refs[n], 0, sizeof(int) * (nsys-n) );
+   }
+
    /* Add flags. */
-   for (i=0; i<array_size(claim->ids); i++)
+   for (i=0; i<array_size(claim->ids); i++) {
+      claim_refs[ claim->ids[i] ]++;
       sys_setFlag( system_getIndex(claim->ids[i]), SYSTEM_CLAIMED );
+   }
+}
+
+
+/**
+ * @brief Releases the systems held by an active claim.
+ *
+ *    @param claim Claim to release.
+ */
+static void claim_release( SysClaim_t *claim )
+{
+   int i, id;
+
+   /* Only claims active in this generation are counted. */
+   if (claim->active != claim_gen) {
+      claim->active = 0;
+      return;
+   }
+   claim->active = 0;
+
+   if ((claim->ids == NULL) || (claim_refs == NULL))
+      return;
+
+   for (i=0; i<array_size(claim->ids); i++) {
+      id = claim->ids[i];
+      if (claim_refs[id] <= 0)
+         continue;
+      claim_refs[id]--;
+      if (claim_refs[id] == 0)
+         sys_rmFlag( system_getIndex(id), SYSTEM_CLAIMED );
+   }
 }
 
 
@@ -16,12 +16,48 @@
 #include "log.h"
 
 
+/*
+ * Prototypes.
+ */
+static uint64_t collide_maskBits( const uint64_t *row, int stride, int off );
+static int collide_clipPolygon( double ox, double oy, double dx, double dy,
+      const GLfloat *pts, int n, double t[2] );
+
+
+/**
+ * @brief Gets 64 bits of a mask row starting at a pixel.
+ *
+ *    @param row Row of the mask.
+ *    @param stride Words in the row.
+ *    @param off First pixel to get.
+ *    @return The bits with off as the lowest, zero past the end of the row.
+ */
+static uint64_t collide_maskBits( const uint64_t *row, int stride, int off )
+{
+   int w, b;
+   uint64_t v;
+
+   w = off / 64;
+   b = off % 64;
+   if (w >= stride)
+      return 0;
+
+   v = row[w] >> b;
+   if ((b > 0) && (w+1 < stride))
+      v |= row[w+1] << (64-b);
+   return v;
+}
+
+
 /**
  * @brief Checks whether or not two sprites collide.
  *
  * This function does pixel perfect checks.  If the collision actually occurs,
  *  crash is set to store the real position of the collision.
  *
+ * The bounding boxes of the opaque pixels are checked first, then the rows
+ *  of the sprite masks are compared 64 pixels at a time.
+ *
  *    @param[in] at Texture a.
  *    @param[in] asx Position of x of sprite a.
  *    @param[in] asy Position of y of sprite a.
@@ -37,20 +73,24 @@ int CollideSprite( const glTexture* at, const int asx, const int asy, const Vect
       const glTexture* bt, const int bsx, const int bsy, const Vector2d* bp,
       Vector2d* crash )
 {
-   int x,y;
+   int x,y,i,n;
    int ax1,ax2, ay1,ay2;
    int bx1,bx2, by1,by2;
    int inter_x0, inter_x1, inter_y0, inter_y1;
-   int rasy, rbsy;
-   int abx,aby, bbx, bby;
+   const uint64_t *am, *bm, *ar, *br;
+   const int *ah, *bh;
+   uint64_t v;
 
+   /* Get the masks. */
+   am = gl_getMask( at, asx, asy, &ah );
+   bm = gl_getMask( bt, bsx, bsy, &bh );
 #if DEBUGGING
    /* Make sure the surfaces have transparency maps. */
-   if (at->trans == NULL) {
+   if (am == NULL) {
       WARN("Texture '%s' has no transparency map.", at->name);
       return 0;
    }
-   if (bt->trans == NULL) {
+   if (bm == NULL) {
       WARN("Texture '%s' has no transparency map.", bt->name);
       return 0;
    }
@@ -72,33 +112,33 @@ int CollideSprite( const glTexture* at, const int asx, const int asy, const Vect
    if((bx2 < ax1) || (ax2 < bx1)) return 0;
    if((by2 < ay1) || (ay2 < by1)) return 0;
 
-   /* define the remaining binding box */
-   inter_x0 = MAX( ax1, bx1 );
-   inter_x1 = MIN( ax2, bx2 );
-   inter_y0 = MAX( ay1, by1 );
-   inter_y1 = MIN( ay2, by2 );
-
-   /* real vertical sprite value (flipped) */
-   rasy = at->sy - asy - 1;
-   rbsy = bt->sy - bsy - 1;
+   /* define the remaining binding box from the opaque parts */
+   inter_x0 = MAX( ax1 + ah[0], bx1 + bh[0] );
+   inter_x1 = MIN( ax1 + ah[2], bx1 + bh[2] );
+   inter_y0 = MAX( ay1 + ah[1], by1 + bh[1] );
+   inter_y1 = MIN( ay1 + ah[3], by1 + bh[3] );
+   if ((inter_x1 < inter_x0) || (inter_y1 < inter_y0))
+      return 0;
 
-   /* set up the base points */
-   abx =  asx*(int)(at->sw) - ax1;
-   aby = rasy*(int)(at->sh) - ay1;
-   bbx =  bsx*(int)(bt->sw) - bx1;
-   bby = rbsy*(int)(bt->sh) - by1;
-
-   for (y=inter_y0; y<=inter_y1; y++)
-      for (x=inter_x0; x<=inter_x1; x++)
-         /* compute offsets for surface before pass to TransparentPixel test */
-         if ((!gl_isTrans(at, abx + x, aby + y)) &&
-               (!gl_isTrans(bt, bbx + x, bby + y))) {
-
-            /* Set the crash position. */
-            crash->x = x;
-            crash->y = y;
-            return 1;
-         }
+   for (y=inter_y0; y<=inter_y1; y++) {
+      ar = &am[ (y-ay1) * at->mask_stride ];
+      br = &bm[ (y-by1) * bt->mask_stride ];
+      for (x=inter_x0; x<=inter_x1; x+=64) {
+         v  = collide_maskBits( ar, at->mask_stride, x-ax1 );
+         v &= collide_maskBits( br, bt->mask_stride, x-bx1 );
+         n  = inter_x1 - x + 1;
+         if (n < 64)
+            v &= ((uint64_t)1 << n) - 1;
+         if (v == 0)
+            continue;
+
+         /* Set the crash position at the first overlapping pixel. */
+         for (i=0; !(v & ((uint64_t)1 << i)); i++);
+         crash->x = x + i;
+         crash->y = y;
+         return 1;
+      }
+   }
 
    return 0;
 }
@@ -154,12 +194,57 @@ int CollideLineLine( double s1x, double s1y, double e1x, double e1y,
 }
 
 
+/**
+ * @brief Clips a line to a convex polygon.
+ *
+ *    @param ox X origin of the line.
+ *    @param oy Y origin of the line.
+ *    @param dx X displacement of the line.
+ *    @param dy Y displacement of the line.
+ *    @param pts Counter-clockwise polygon as x, y pairs.
+ *    @param n Number of points of the polygon.
+ *    @param[in,out] t Parameters along the line of the part to clip, set to
+ *                     the part inside the polygon.
+ *    @return 1 if part of the line is inside the polygon, 0 else.
+ */
+static int collide_clipPolygon( double ox, double oy, double dx, double dy,
+      const GLfloat *pts, int n, double t[2] )
+{
+   int i, j;
+   double nx, ny, num, den, u;
+
+   for (i=0; i<n; i++) {
+      j  = (i+1) % n;
+      /* Outward normal of the edge. */
+      nx = pts[2*j+1] - pts[2*i+1];
+      ny = pts[2*i]   - pts[2*j];
+      num = nx * (ox - pts[2*i]) + ny * (oy - pts[2*i+1]);
+      den = nx * dx + ny * dy;
+      if (den == 0.) {
+         /* Parallel and outside. */
+         if (num > 0.)
+            return 0;
+         continue;
+      }
+      u = -num / den;
+      if (den < 0.)
+         t[0] = MAX( t[0], u ); /* Entering. */
+      else
+         t[1] = MIN( t[1], u ); /* Leaving. */
+      if (t[0] > t[1])
+         return 0;
+   }
+   return 1;
+}
+
+
 /**
  * @brief Checks to see if a line collides with a sprite.
  *
- * First collisions are detected on all the walls of the sprite's rectangle.
- *  Then the collisions are tested by pixel perfectness until collisions are
- *  actually found with the ship itself.
+ * The line is first clipped to the convex hull of the sprite's opaque
+ *  pixels, or its rectangle if it has no outline. Then the collisions are
+ *  tested by pixel perfectness from both ends of the clipped line until
+ *  collisions are actually found with the ship itself.
  *
  *    @param[in] ap Origin of the line.
  *    @param[in] ad Direction of the line.
@@ -177,10 +262,12 @@ int CollideLineSprite( const Vector2d* ap, double ad, double al,
       const glTexture* bt, const int bsx, const int bsy, const Vector2d* bp,
       Vector2d crash[2] )
 {
-   int x,y, rbsy, bbx,bby;
-   double ep[2], bl[2], tr[2], v[2], mod;
-   int hits, real_hits;
-   Vector2d tmp_crash, border[2];
+   int rbsy, bbx,bby, n;
+   int real_hits;
+   double x,y, ep[2], bl[2], v[2], t[2], mod;
+   const GLfloat *pts;
+   GLfloat rect[8];
+   Vector2d border[2];
 
    /* Make sure texture has transparency map. */
    if (bt->trans == NULL) {
@@ -192,56 +279,36 @@ int CollideLineSprite( const Vector2d* ap, double ad, double al,
    ep[0] = ap->x + al*cos(ad);
    ep[1] = ap->y + al*sin(ad);
 
-   /* Set up top right corner of the rectangle. */
-   tr[0] = bp->x + bt->sw/2.;
-   tr[1] = bp->y + bt->sh/2.;
    /* Set up bottom left corner of the rectangle. */
    bl[0] = bp->x - bt->sw/2.;
    bl[1] = bp->y - bt->sh/2.;
 
-   /*
-    * Start check for rectangular collisions.
-    */
-   hits = 0;
-   /* Left border. */
-   if (CollideLineLine(ap->x, ap->y, ep[0], ep[1],
-         bl[0], bl[1], bl[0], tr[1], &tmp_crash) == 1) {
-      border[hits].x = tmp_crash.x;
-      border[hits].y = tmp_crash.y;
-      hits++;
-   }
-   /* Top border. */
-   if (CollideLineLine(ap->x, ap->y, ep[0], ep[1],
-         bl[0], tr[1], tr[0], tr[1], &tmp_crash) == 1) {
-      border[hits].x = tmp_crash.x;
-      border[hits].y = tmp_crash.y;
-      hits++;
-   }
-   /* Now we have to make sure hits isn't 2. */
-   /* Right border. */
-   if ((hits < 2) && CollideLineLine(ap->x, ap->y, ep[0], ep[1],
-         tr[0], tr[1], tr[0], bl[1], &tmp_crash) == 1) {
-      border[hits].x = tmp_crash.x;
-      border[hits].y = tmp_crash.y;
-      hits++;
+   /* Outline of the sprite. */
+   n = gl_getOutline( bt, bsx, bsy, &pts );
+   if (n < 0) {
+      rect[0] = 0.;     rect[1] = 0.;
+      rect[2] = bt->sw; rect[3] = 0.;
+      rect[4] = bt->sw; rect[5] = bt->sh;
+      rect[6] = 0.;     rect[7] = bt->sh;
+      pts = rect;
+      n   = 4;
    }
-   /* Bottom border. */
-   if ((hits < 2) && CollideLineLine(ap->x, ap->y, ep[0], ep[1],
-         tr[0], bl[1], bl[0], bl[1], &tmp_crash) == 1) {
-      border[hits].x = tmp_crash.x;
-      border[hits].y = tmp_crash.y;
-      hits++;
-   }
-
-   /* No hits - missed. */
-   if (hits == 0)
+   /* Sprite is fully transparent. */
+   if (n < 3)
       return 0;
 
-   /* Beam must die in the rectangle. */
-   if (hits == 1) {
-      border[1].x = ep[0];
-      border[1].y = ep[1];
-   }
+   /*
+    * Clip the line to the outline, relative to the bottom left corner.
+    */
+   t[0] = 0.;
+   t[1] = 1.;
+   if (!collide_clipPolygon( ap->x - bl[0], ap->y - bl[1],
+         ep[0] - ap->x, ep[1] - ap->y, pts, n, t ))
+      return 0;
+   border[0].x = ap->x + t[0] * (ep[0] - ap->x);
+   border[0].y = ap->y + t[0] * (ep[1] - ap->y);
+   border[1].x = ap->x + t[1] * (ep[0] - ap->x);
+   border[1].y = ap->y + t[1] * (ep[1] - ap->y);
 
    /*
     * Now we do a pixel perfect approach.
@@ -251,7 +318,9 @@ int CollideLineSprite( const Vector2d* ap, double ad, double al,
    v[0] = border[1].x - border[0].x;
    v[1] = border[1].y - border[0].y;
    /* Normalize. */
-   mod = MOD(v[0],v[1])/2.; /* Multiply by two to reduce check amount. */
+   mod = MOD(v[0],v[1])*2.; /* Half pixel steps. */
+   if (mod <= 0.)
+      return 0;
    v[0] /= mod;
    v[1] /= mod;
 
@@ -264,7 +333,7 @@ int CollideLineSprite( const Vector2d* ap, double ad, double al,
    /* We start checking first border until we find collision. */
    x = border[0].x - bl[0] + v[0];
    y = border[0].y - bl[1] + v[1];
-   while ((x > 0.) && (x < bt->sw) && (y > 0.) && (y < bt->sh)) {
+   while ((x >= 0.) && (x < bt->sw) && (y >= 0.) && (y < bt->sh)) {
       /* Is non-transparent. */
       if (!gl_isTrans(bt, bbx+(int)x, bby+(int)y)) {
          crash[real_hits].x = x + bl[0];
@@ -279,7 +348,7 @@ int CollideLineSprite( const Vector2d* ap, double ad, double al,
    /* Now we check the second border. */
    x = border[1].x - bl[0] - v[0];
    y = border[1].y - bl[1] - v[1];
-   while ((x > 0.) && (x < bt->sw) && (y > 0.) && (y < bt->sh)) {
+   while ((real_hits > 0) && (x >= 0.) && (x < bt->sw) && (y >= 0.) && (y < bt->sh)) {
       /* Is non-transparent. */
       if (!gl_isTrans(bt, bbx+(int)x, bby+(int)y)) {
          crash[real_hits].x = x + bl[0];
@@ -305,5 +374,3 @@ int CollideLineSprite( const Vector2d* ap, double ad, double al,
    /* We hit. */
    return 1;
 }
-
-
@@ -248,7 +248,8 @@ int comm_openPlanet( Planet *planet )
    comm_planet = planet;
 
    /* Create the generic comm window. */
-   wid = comm_open( gl_dupTexture( comm_planet->gfx_space ),
+   wid = comm_open( gl_newImage( comm_planet->gfx_spaceName,
+            OPENGL_TEX_MIPMAPS | OPENGL_TEX_CACHE ),
          comm_planet->faction, 0, 0, comm_planet->name );
 
    /* Add special buttons. */
@@ -107,3 +107,79 @@ cond_err:
    lua_settop(naevL, 0);
    return -1;
 }
+
+
+/**
+ * @brief Compiles a condition so it can be checked repeatedly.
+ *
+ *    @param cond Condition to compile.
+ *    @return Reference to the compiled condition or LUA_NOREF on error.
+ */
+int cond_compile( const char* cond )
+{
+   int ref;
+
+   /* Load the string. */
+   lua_pushstring(naevL, "return ");
+   lua_pushstring(naevL, cond);
+   lua_concat(naevL, 2);
+   if (nlua_loadbuffer(naevL, lua_tostring(naevL,-1),
+            lua_strlen(naevL,-1), "Lua Conditional") != 0) {
+      WARN("Lua conditional syntax error: %s", lua_tostring(naevL, -1));
+      lua_pop(naevL, 2);
+      return LUA_NOREF;
+   }
+
+   /* Run in the conditional env. */
+   nlua_pushenv(cond_env);
+   lua_setfenv(naevL, -2);
+   ref = luaL_ref(naevL, LUA_REGISTRYINDEX);
+   lua_pop(naevL, 1);
+
+   return ref;
+}
+
+
+/**
+ * @brief Checks to see if a compiled condition is true.
+ *
+ *    @param ref Condition compiled with cond_compile().
+ *    @return 0 if is false, 1 if is true, -1 on error.
+ */
+int cond_checkRef( int ref )
+{
+   int b;
+
+   if (ref == LUA_NOREF)
+      return -1;
+
+   lua_rawgeti(naevL, LUA_REGISTRYINDEX, ref);
+   if (nlua_pcall(cond_env, 0, 1) != 0) {
+      WARN("Lua Conditional had a runtime error: %s", lua_tostring(naevL, -1));
+      lua_pop(naevL, 1);
+      return -1;
+   }
+
+   /* Check the result. */
+   if (!lua_isboolean(naevL, -1)) {
+      WARN("Lua Conditional didn't return a boolean");
+      lua_pop(naevL, 1);
+      return -1;
+   }
+   b = lua_toboolean(naevL, -1);
+   lua_pop(naevL, 1);
+   return (b) ? 1 : 0;
+}
+
+
+/**
+ * @brief Frees a compiled condition.
+ *
+ *    @param ref Condition compiled with cond_compile().
+ */
+void cond_free( int ref )
+{
+   if (ref == LUA_NOREF)
+      return;
+   luaL_unref(naevL, LUA_REGISTRYINDEX, ref);
+}
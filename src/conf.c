@@ -24,6 +24,7 @@
 #include "ndata.h"
 #include "nfile.h"
 #include "nstring.h"
+#include "savebin.h"
 
 
 #define  conf_loadInt(n,i)    \
@@ -88,6 +89,7 @@ static void print_usage( char **argv )
    LOG("   -f, --fullscreen      activate fullscreen");
    LOG("   -F n, --fps n         limit frames per second to n");
    LOG("   -V, --vsync           enable vsync");
+   LOG("   --low-latency         paces frames to cut input latency");
    LOG("   -W n                  set width to n");
    LOG("   -H n                  set height to n");
    LOG("   -j n, --joystick n    use joystick n");
@@ -99,6 +101,17 @@ static void print_usage( char **argv )
    LOG("   -G, --generate        regenerates the nebula (slow)");
    LOG("   -N, --nondata         do not use ndata and try to use laid out files");
    LOG("   -d, --datapath        specifies a custom path for all user data (saves, screenshots, etc.)");
+   LOG("   --bench s             runs the benchmark scenario s without sound and exits");
+   LOG("                         'kernels' times the engine kernels instead");
+   LOG("   --econsim n           runs n economy steps, writes econsim.csv and exits");
+   LOG("   --metrics t           exports metrics to the file t or to udp://host:port");
+   LOG("   --metrics-interval s  exports metrics every s seconds");
+   LOG("   --startup-profile     logs how long each phase of the startup takes");
+   LOG("   --record f            records the session to the file f");
+   LOG("   --replay f            replays the session recorded in f and exits");
+   LOG("   --replay-fast         replays as fast as possible instead of at the recorded pace");
+   LOG("   --save-to-binary f    converts the savegame f to the binary format and exits");
+   LOG("   --save-to-xml f       converts the savegame f to XML and exits");
 #ifdef DEBUGGING
    LOG("   --devmode             enables dev mode perks like the editors");
    LOG("   --devcsv              generates csv output from the ndata for development purposes");
@@ -152,6 +165,7 @@ void conf_setDefaults (void)
    conf.devmode      = 0;
    conf.devautosave  = 0;
    conf.devcsv       = 0;
+   conf.ai_parallel  = 0;
 
    /* Gameplay. */
    conf_setGameplayDefaults();
@@ -167,6 +181,11 @@ void conf_setDefaults (void)
 
    /* Debugging. */
    conf.fpu_except   = 0; /* Causes many issues. */
+   conf.lua_profile  = 0;
+   conf.startup_profile = 0;
+   conf.perf_show    = 0;
+   conf.econsim      = 0;
+   conf.metrics_interval = 10.;
 
    /* Editor. */
    if (conf.dev_save_sys != NULL)
@@ -190,6 +209,8 @@ void conf_setGameplayDefaults (void)
    conf.compression_velocity  = TIME_COMPRESSION_DEFAULT_MAX;
    conf.compression_mult      = TIME_COMPRESSION_DEFAULT_MULT;
    conf.save_compress         = SAVE_COMPRESSION_DEFAULT;
+   conf.save_snapshot         = SAVE_SNAPSHOT_DEFAULT;
+   conf.save_binary           = SAVE_BINARY_DEFAULT;
    conf.mouse_thrust          = MOUSE_THRUST_DEFAULT;
    conf.mouse_doubleclick     = MOUSE_DOUBLECLICK_TIME;
    conf.autonav_reset_speed   = AUTONAV_RESET_SPEED_DEFAULT;
@@ -253,6 +274,9 @@ void conf_setVideoDefaults (void)
    conf.compress     = TEXTURE_COMPRESSION_DEFAULT;
    conf.interpolate  = INTERPOLATION_DEFAULT;
    conf.npot         = NPOT_TEXTURES_DEFAULT;
+   conf.shaders      = SHADERS_DEFAULT;
+   conf.fbo          = FBO_DEFAULT;
+   conf.nebu_scale   = NEBU_SCALE_DEFAULT;
 
    /* Window. */
    conf.fullscreen   = f;
@@ -265,12 +289,15 @@ void conf_setVideoDefaults (void)
    /* FPS. */
    conf.fps_show     = SHOW_FPS_DEFAULT;
    conf.fps_max      = FPS_MAX_DEFAULT;
+   conf.low_latency  = LOW_LATENCY_DEFAULT;
 
    /* Pause. */
    conf.pause_show   = SHOW_PAUSE_DEFAULT;
 
    /* Memory. */
    conf.engineglow   = ENGINE_GLOWS_DEFAULT;
+   conf.tex_cache    = TEXTURE_CACHE_DEFAULT;
+   conf.misn_mem     = MISSION_MEMORY_DEFAULT;
 }
 
 
@@ -281,10 +308,20 @@ void conf_cleanup (void)
 {
    if (conf.ndata != NULL)
       free(conf.ndata);
+   if (conf.overlays != NULL)
+      free(conf.overlays);
    if (conf.sound_backend != NULL)
       free(conf.sound_backend);
    if (conf.joystick_nam != NULL)
       free(conf.joystick_nam);
+   if (conf.bench != NULL)
+      free(conf.bench);
+   if (conf.record != NULL)
+      free(conf.record);
+   if (conf.replay != NULL)
+      free(conf.replay);
+   if (conf.metrics != NULL)
+      free(conf.metrics);
 
    if (conf.dev_save_sys != NULL)
       free(conf.dev_save_sys);
@@ -338,6 +375,7 @@ int conf_loadConfig ( const char* file )
 
       /* ndata. */
       conf_loadString("data",conf.ndata);
+      conf_loadString("overlays",conf.overlays);
 
       /* OpenGL. */
       conf_loadInt("fsaa",conf.fsaa);
@@ -347,9 +385,14 @@ int conf_loadConfig ( const char* file )
       conf_loadBool("compress",conf.compress);
       conf_loadBool("interpolate",conf.interpolate);
       conf_loadBool("npot",conf.npot);
+      conf_loadBool("shaders",conf.shaders);
+      conf_loadBool("fbo",conf.fbo);
+      conf_loadInt("nebu_scale",conf.nebu_scale);
 
       /* Memory. */
       conf_loadBool("engineglow",conf.engineglow);
+      conf_loadInt("texture_cache",conf.tex_cache);
+      conf_loadInt("mission_memory",conf.misn_mem);
 
       /* Window. */
       w = h = 0;
@@ -371,6 +414,7 @@ int conf_loadConfig ( const char* file )
       /* FPS */
       conf_loadBool("showfps",conf.fps_show);
       conf_loadInt("maxfps",conf.fps_max);
+      conf_loadBool("lowlatency",conf.low_latency);
 
       /*  Pause */
       conf_loadBool("showpause",conf.pause_show);
@@ -421,6 +465,8 @@ int conf_loadConfig ( const char* file )
       conf_loadFloat("compression_mult",conf.compression_mult);
       conf_loadBool("redirect_file",conf.redirect_file);
       conf_loadBool("save_compress",conf.save_compress);
+      conf_loadBool("save_snapshot",conf.save_snapshot);
+      conf_loadBool("save_binary",conf.save_binary);
       conf_loadInt("afterburn_sensitivity",conf.afterburn_sens);
       conf_loadInt("mouse_thrust",conf.mouse_thrust);
       conf_loadFloat("mouse_doubleclick",conf.mouse_doubleclick);
@@ -428,9 +474,14 @@ int conf_loadConfig ( const char* file )
       conf_loadBool("devmode",conf.devmode);
       conf_loadBool("devautosave",conf.devautosave);
       conf_loadBool("conf_nosave",conf.nosave);
+      conf_loadBool("ai_parallel",conf.ai_parallel);
 
       /* Debugging. */
       conf_loadBool("fpu_except",conf.fpu_except);
+      conf_loadBool("lua_profile",conf.lua_profile);
+      conf_loadBool("showperf",conf.perf_show);
+      conf_loadString("metrics",conf.metrics);
+      conf_loadFloat("metrics_interval",conf.metrics_interval);
 
       /* Editor. */
       conf_loadString("dev_save_sys",conf.dev_save_sys);
@@ -593,6 +644,7 @@ void conf_parseCLI( int argc, char** argv )
       { "fullscreen", no_argument, 0, 'f' },
       { "fps", required_argument, 0, 'F' },
       { "vsync", no_argument, 0, 'V' },
+      { "low-latency", no_argument, 0, 'A' },
       { "joystick", required_argument, 0, 'j' },
       { "Joystick", required_argument, 0, 'J' },
       { "width", required_argument, 0, 'W' },
@@ -603,6 +655,16 @@ void conf_parseCLI( int argc, char** argv )
       { "svol", required_argument, 0, 's' },
       { "generate", no_argument, 0, 'G' },
       { "nondata", no_argument, 0, 'N' },
+      { "bench", required_argument, 0, 'B' },
+      { "econsim", required_argument, 0, 'E' },
+      { "metrics", required_argument, 0, 'T' },
+      { "metrics-interval", required_argument, 0, 'I' },
+      { "startup-profile", no_argument, 0, 'L' },
+      { "record", required_argument, 0, 'R' },
+      { "replay", required_argument, 0, 'P' },
+      { "replay-fast", no_argument, 0, 'Q' },
+      { "save-to-binary", required_argument, 0, 'Y' },
+      { "save-to-xml", required_argument, 0, 'X' },
 #ifdef DEBUGGING
       { "devmode", no_argument, 0, 'D' },
       { "devcsv", no_argument, 0, 'C' },
@@ -634,6 +696,9 @@ void conf_parseCLI( int argc, char** argv )
          case 'V':
             conf.vsync = 1;
             break;
+         case 'A':
+            conf.low_latency = 1;
+            break;
          case 'j':
             conf.joystick_ind = atoi(optarg);
             break;
@@ -668,6 +733,46 @@ void conf_parseCLI( int argc, char** argv )
                free(conf.ndata);
             conf.ndata = NULL;
             break;
+         case 'B':
+            if (conf.bench != NULL)
+               free(conf.bench);
+            conf.bench   = strdup(optarg);
+            conf.nosound = 1;
+            conf.nosave  = 1; /* Don't keep the forced settings. */
+            break;
+         case 'E':
+            conf.econsim = MAX( atoi(optarg), 1 );
+            conf.nosound = 1;
+            conf.nosave  = 1;
+            break;
+         case 'T':
+            if (conf.metrics != NULL)
+               free(conf.metrics);
+            conf.metrics = strdup(optarg);
+            break;
+         case 'I':
+            conf.metrics_interval = atof(optarg);
+            break;
+         case 'L':
+            conf.startup_profile = 1;
+            break;
+         case 'R':
+            if (conf.record != NULL)
+               free(conf.record);
+            conf.record  = strdup(optarg);
+            break;
+         case 'P':
+            if (conf.replay != NULL)
+               free(conf.replay);
+            conf.replay  = strdup(optarg);
+            conf.nosave  = 1;
+            break;
+         case 'Q':
+            conf.replay_fast = 1;
+            break;
+         case 'Y':
+         case 'X':
+            exit( savebin_convert( optarg, (c == 'Y') ) ? EXIT_FAILURE : EXIT_SUCCESS );
 #ifdef DEBUGGING
          case 'D':
             conf.devmode = 1;
@@ -890,6 +995,11 @@ int conf_saveConfig ( const char* file )
    conf_saveString("data",conf.ndata);
    conf_saveEmptyLine();
 
+   conf_saveComment("Directories with files to use instead of the data pack's, separated by ';'");
+   conf_saveComment("The first directory listed takes precedence");
+   conf_saveString("overlays",conf.overlays);
+   conf_saveEmptyLine();
+
    /* OpenGL. */
    conf_saveComment("The factor to use in Full-Scene Anti-Aliasing");
    conf_saveComment("Anything lower than 2 will simply disable FSAA");
@@ -921,11 +1031,34 @@ int conf_saveConfig ( const char* file )
    conf_saveBool("npot",conf.npot);
    conf_saveEmptyLine();
 
+   conf_saveComment("Use OpenGL shaders if available, for things like the starfield");
+   conf_saveBool("shaders",conf.shaders);
+   conf_saveEmptyLine();
+
+   conf_saveComment("Use OpenGL framebuffer objects if available, to cache the menus");
+   conf_saveBool("fbo",conf.fbo);
+   conf_saveEmptyLine();
+
+   conf_saveComment("Renders the nebula overlay and puffs at half (2) or quarter (4) resolution");
+   conf_saveComment("Helps a lot on fill-rate limited graphics cards, needs framebuffer objects");
+   conf_saveInt("nebu_scale",conf.nebu_scale);
+   conf_saveEmptyLine();
+
    /* Memory. */
    conf_saveComment("If true enables engine glow");
    conf_saveBool("engineglow",conf.engineglow);
    conf_saveEmptyLine();
 
+   conf_saveComment("Megabytes of video memory to keep textures no longer used in, so they");
+   conf_saveComment("don't have to be loaded again, 0 frees them immediately");
+   conf_saveInt("texture_cache",conf.tex_cache);
+   conf_saveEmptyLine();
+
+   conf_saveComment("Megabytes of Lua memory a mission can have before its scripts fail,");
+   conf_saveComment("0 for no limit");
+   conf_saveInt("mission_memory",conf.misn_mem);
+   conf_saveEmptyLine();
+
    /* Window. */
    conf_saveComment("The window size or screen resolution");
    conf_saveComment("Set both of these to 0 to make "APPNAME" try the desktop resolution");
@@ -964,6 +1097,11 @@ int conf_saveConfig ( const char* file )
    conf_saveInt("maxfps",conf.fps_max);
    conf_saveEmptyLine();
 
+   conf_saveComment("Sleep before polling input instead of after the frame, predicting how long");
+   conf_saveComment("the frame takes and not letting the driver queue frames");
+   conf_saveBool("lowlatency",conf.low_latency);
+   conf_saveEmptyLine();
+
    /* Pause */
    conf_saveComment("Show 'PAUSED' on screen while paused");
    conf_saveBool("showpause",conf.pause_show);
@@ -1072,6 +1210,14 @@ int conf_saveConfig ( const char* file )
    conf_saveBool("save_compress",conf.save_compress);
    conf_saveEmptyLine();
 
+   conf_saveComment("Keeps the last savegame in memory so reloading doesn't read it again");
+   conf_saveBool("save_snapshot",conf.save_snapshot);
+   conf_saveEmptyLine();
+
+   conf_saveComment("Writes savegames in a compact binary format instead of XML, both are always read");
+   conf_saveBool("save_binary",conf.save_binary);
+   conf_saveEmptyLine();
+
    conf_saveComment("Afterburner sensitivity");
    conf_saveInt("afterburn_sensitivity",conf.afterburn_sens);
    conf_saveEmptyLine();
@@ -1100,11 +1246,30 @@ int conf_saveConfig ( const char* file )
    conf_saveInt("conf_nosave",conf.nosave);
    conf_saveEmptyLine();
 
+   conf_saveComment("Steers pilots running native AI tasks on the worker threads");
+   conf_saveBool("ai_parallel",conf.ai_parallel);
+   conf_saveEmptyLine();
+
    /* Debugging. */
    conf_saveComment("Enables FPU exceptions - only works on DEBUG builds");
    conf_saveBool("fpu_except",conf.fpu_except);
    conf_saveEmptyLine();
 
+   conf_saveComment("Profiles Lua calls, dumping the results to "NLUA_PROF_CSV" on exit");
+   conf_saveBool("lua_profile",conf.lua_profile);
+   conf_saveEmptyLine();
+
+   conf_saveComment("Shows how long each phase of the frame takes");
+   conf_saveBool("showperf",conf.perf_show);
+   conf_saveEmptyLine();
+
+   conf_saveComment("Exports engine metrics as JSON lines to a file, relative to the data directory");
+   conf_saveComment("or in statsd format to \"udp://host:port\", nil disables them");
+   conf_saveString("metrics",conf.metrics);
+   conf_saveComment("Seconds between metrics exports");
+   conf_saveFloat("metrics_interval",conf.metrics_interval);
+   conf_saveEmptyLine();
+
    /* Editor. */
    conf_saveComment("Paths for saving different files from the editor");
    conf_saveString("dev_save_sys",conf.dev_save_sys);
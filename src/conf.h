@@ -16,6 +16,8 @@
 #define TIME_COMPRESSION_DEFAULT_MULT        200   /**< Default level of time compression multiplier. */
 #define REDIRECT_FILE_DEFAULT                1     /**< Whether output should be redirected to a file. */
 #define SAVE_COMPRESSION_DEFAULT             1     /**< Whether or not saved games should be compressed. */
+#define SAVE_SNAPSHOT_DEFAULT                1     /**< Whether or not to keep the last savegame in memory. */
+#define SAVE_BINARY_DEFAULT                  0     /**< Whether or not to write savegames in the binary format. */
 #define MOUSE_THRUST_DEFAULT                 1     /**< Whether or not to use mouse thrust controls. */
 #define MOUSE_DOUBLECLICK_TIME               0.5   /**< How long to consider double-clicks for. */
 #define AUTONAV_RESET_SPEED_DEFAULT          1.    /**< Shield level (0-1) to reset autonav speed at. 1 means at enemy presence, 0 means at armour damage. */
@@ -32,12 +34,18 @@
 #define MIPMAP_DEFAULT                       0     /**< Whether to use Mip Mapping. */
 #define TEXTURE_COMPRESSION_DEFAULT          0     /**< Whether to use texture compression. */
 #define INTERPOLATION_DEFAULT                1     /**< Whether to use interpolation. */
-#define NPOT_TEXTURES_DEFAULT                0     /**< Whether to allow non-power-of-two textures. */
+#define NPOT_TEXTURES_DEFAULT                1     /**< Whether to allow non-power-of-two textures when the context supports them. */
+#define SHADERS_DEFAULT                      1     /**< Whether to use shaders if available. */
+#define FBO_DEFAULT                          1     /**< Whether to use framebuffer objects if available. */
+#define NEBU_SCALE_DEFAULT                   1     /**< Screen pixels per texel of the nebula overlay. */
 #define SCALE_FACTOR_DEFAULT                 1.    /**< Default scale factor. */
 #define SHOW_FPS_DEFAULT                     0     /**< Whether to display FPS on screen. */
 #define FPS_MAX_DEFAULT                      60    /**< Maximum FPS. */
+#define LOW_LATENCY_DEFAULT                  0     /**< Whether to pace frames for low input latency. */
 #define SHOW_PAUSE_DEFAULT                   1     /**< Whether to display pause status. */
 #define ENGINE_GLOWS_DEFAULT                 1     /**< Whether to display engine glows. */
+#define TEXTURE_CACHE_DEFAULT                64    /**< Megabytes of unused textures kept loaded. */
+#define MISSION_MEMORY_DEFAULT               64    /**< Megabytes of Lua memory a mission can have. */
 #define MINIMIZE_DEFAULT                     1     /**< Whether to minimize on focus loss. */
 /* Audio options */
 #define VOICES_DEFAULT                       128   /**< Amount of voices to use. */
@@ -67,6 +75,7 @@ typedef struct PlayerConf_s {
 
    /* ndata. */
    char *ndata; /**< Ndata path to use. */
+   char *overlays; /**< Directories searched before the ndata, separated by ';'. */
    char *datapath; /**< Path for user data (saves, screenshots, etc.). */
 
    /* OpenGL properties. */
@@ -77,9 +86,14 @@ typedef struct PlayerConf_s {
    int compress; /**< Use texture compression. */
    int interpolate; /**< Use texture interpolation. */
    int npot; /**< Use NPOT textures if available. */
+   int shaders; /**< Use shaders if available. */
+   int fbo; /**< Use framebuffer objects if available. */
+   int nebu_scale; /**< Render the nebula overlay at 1/nebu_scale resolution. */
 
    /* Memory usage. */
    int engineglow; /**< Sets engine glow. */
+   int tex_cache; /**< Megabytes of unused textures kept loaded. */
+   int misn_mem; /**< Megabytes of Lua memory a mission can have, 0 for no limit. */
 
    /* Window dimensions. */
    int width; /**< Width of the window to use. */
@@ -103,6 +117,7 @@ typedef struct PlayerConf_s {
    /* FPS. */
    int fps_show; /**< Whether or not FPS should be shown */
    int fps_max; /**< Maximum FPS to limit to. */
+   int low_latency; /**< Sleep before polling input instead of after the frame. */
 
    /* Pause. */
    int pause_show; /**< Whether pause status should be shown. */
@@ -136,6 +151,8 @@ typedef struct PlayerConf_s {
    double compression_mult; /**< Maximum time multiplier. */
    int redirect_file; /**< Redirect output to files. */
    int save_compress; /**< Compress savegame. */
+   int save_snapshot; /**< Keep the last savegame in memory for reloading. */
+   int save_binary; /**< Write savegames in the binary format. */
    unsigned int afterburn_sens; /**< Afterburn sensibility. */
    int mouse_thrust; /**< Whether mouse flying controls thrust. */
    double mouse_doubleclick; /**< How long to consider double-clicks for. */
@@ -144,9 +161,20 @@ typedef struct PlayerConf_s {
    int devmode; /**< Developer mode. */
    int devautosave; /**< Developer mode autosave. */
    int devcsv; /**< Output CSV data. */
+   int ai_parallel; /**< Steer pilots running native AI tasks on the worker threads. */
 
    /* Debugging. */
    int fpu_except; /**< Enable FPU exceptions? */
+   int lua_profile; /**< Profile Lua calls from startup. */
+   int startup_profile; /**< Log how long each phase of the startup takes, only set from the CLI. */
+   int perf_show; /**< Show the frame phase timing overlay. */
+   char *metrics; /**< File or "udp://host:port" to export metrics to, NULL to disable. */
+   double metrics_interval; /**< Seconds between metrics exports. */
+   char *bench; /**< Benchmark scenario to run instead of the game. */
+   int econsim; /**< Economy steps to simulate instead of the game. */
+   char *record; /**< File to record the session to. */
+   char *replay; /**< File to replay a session from. */
+   int replay_fast; /**< Replay as fast as possible instead of at the recorded pace. */
 
    /* Editor. */
    char *dev_save_sys; /**< Path to save systems to. */
@@ -24,6 +24,7 @@
 #include "log.h"
 #include "naev.h"
 #include "nlua.h"
+#include "nluadef.h"
 #include "nlua_cli.h"
 #include "nlua_tk.h"
 #include "nlua_tex.h"
@@ -37,6 +38,8 @@
 #include "menu.h"
 #include "conf.h"
 #include "array.h"
+#include "perf.h"
+#include "memstats.h"
 
 
 #define BUTTON_WIDTH    50 /**< Button width. */
@@ -59,6 +62,7 @@ static glFont *cli_font     = NULL; /**< CLI font to use. */
 #define CLI_CONSOLE_HEIGHT  (CLI_HEIGHT-80-BUTTON_HEIGHT)
 /** Number of lines displayed at once */
 #define CLI_MAX_LINES (CLI_CONSOLE_HEIGHT/(cli_font->h+5))
+#define CLI_PROFILE_LINES  20 /**< Profiled functions printed by profile(). */
 static char **cli_buffer; /**< CLI buffer. */
 static int cli_history     = 0; /**< Position in history. */
 static int cli_scroll_pos  = -1; /**< Pistion in scrolling through output */
@@ -76,10 +80,20 @@ static int cli_firstline   = 1; /**< Is this the first line? */
  */
 static int cli_script( lua_State *L );
 static int cli_printOnly( lua_State *L );
+static int cli_profile( lua_State *L );
+static int cli_trace( lua_State *L );
+static int cli_textures( lua_State *L );
+static int cli_memory( lua_State *L );
+static int cli_logs( lua_State *L );
 static const luaL_Reg cli_methods[] = {
    { "print", cli_printOnly },
    { "script", cli_script },
    { "warn", cli_warn },
+   { "profile", cli_profile },
+   { "trace", cli_trace },
+   { "textures", cli_textures },
+   { "memory", cli_memory },
+   { "logs", cli_logs },
    {NULL, NULL}
 }; /**< Console only functions. */
 
@@ -180,6 +194,170 @@ static int cli_printOnly( lua_State *L )
 }
 
 
+/**
+ * @brief Controls the Lua profiler.
+ *
+ * @usage profile(true) -- Starts recording
+ * @usage profile(false) -- Stops recording
+ * @usage profile() -- Prints the functions taking the most time
+ * @usage profile("clear") -- Forgets what was recorded
+ *
+ * @luafunc profile( arg )
+ */
+static int cli_profile( lua_State *L )
+{
+   const NLuaProfEntry *e;
+   char buf[CLI_MAX_INPUT];
+   int i, n;
+
+   if (lua_isboolean(L,1)) {
+      nlua_profEnable( lua_toboolean(L,1) );
+      return 0;
+   }
+   else if (lua_isstring(L,1)) {
+      if (strcmp( lua_tostring(L,1), "clear" ) == 0)
+         nlua_profClear();
+      else
+         NLUA_INVALID_PARAMETER(L);
+      return 0;
+   }
+
+   n = nlua_profGet( &e );
+   nsnprintf( buf, sizeof(buf), "Lua profile (%s), %d functions:",
+         nlua_profEnabled() ? "recording" : "stopped", n );
+   cli_addMessage( buf );
+   for (i=0; i<MIN(n,CLI_PROFILE_LINES); i++) {
+      nsnprintf( buf, sizeof(buf), "%9.1f ms %8lu calls  %s",
+            e[i].time*1000., e[i].calls, e[i].name );
+      cli_addMessage( buf );
+   }
+   return 0;
+}
+
+
+/**
+ * @brief Records a trace of the frame phases.
+ *
+ * The trace is written as Chrome trace-event JSON when stopped or on exit.
+ *
+ * @usage trace(true) -- Starts recording
+ * @usage trace(false) -- Stops recording and writes the trace
+ *
+ *    @luatparam boolean enable Whether to record.
+ * @luafunc trace( enable )
+ */
+static int cli_trace( lua_State *L )
+{
+   if (lua_toboolean(L,1)) {
+      if (perf_traceStart())
+         cli_addMessage( "Trace already being recorded." );
+   }
+   else if (perf_traceStop())
+      cli_addMessage( "No trace being recorded." );
+   return 0;
+}
+
+
+/**
+ * @brief Prints the video memory used by textures.
+ *
+ * @usage textures() -- Prints usage
+ * @usage textures(32) -- Keeps at most 32 MiB of unused textures loaded
+ *
+ *    @luatparam[opt] number budget Megabytes of unused textures to keep.
+ * @luafunc textures( budget )
+ */
+static int cli_textures( lua_State *L )
+{
+   char buf[CLI_MAX_INPUT];
+   int nused, ncached;
+   size_t used, cached;
+
+   if (lua_isnumber(L,1)) {
+      conf.tex_cache = MAX( 0, lua_tointeger(L,1) );
+      gl_texEvict();
+   }
+
+   gl_texUsage( &nused, &used, &ncached, &cached );
+   nsnprintf( buf, sizeof(buf), "%d textures in use: %.1f MiB",
+         nused, (double)used / (1024.*1024.) );
+   cli_addMessage( buf );
+   nsnprintf( buf, sizeof(buf), "%d textures cached: %.1f of %d MiB",
+         ncached, (double)cached / (1024.*1024.), conf.tex_cache );
+   cli_addMessage( buf );
+   return 0;
+}
+
+
+/**
+ * @brief Prints the memory used by each subsystem.
+ *
+ * @usage memory() -- Prints usage
+ * @usage memory(60) -- Also logs usage every minute
+ * @usage memory(0) -- Stops logging usage
+ *
+ *    @luatparam[opt] number interval Seconds between logs, 0 to stop.
+ * @luafunc memory( interval )
+ */
+static int cli_memory( lua_State *L )
+{
+   char buf[CLI_MAX_INPUT];
+   MemStat stats[MEMSTATS_MAX];
+   int i, n;
+   size_t total;
+
+   if (lua_isnumber(L,1))
+      memstats_setInterval( lua_tonumber(L,1) );
+
+   n     = memstats_get( stats );
+   total = 0;
+   for (i=0; i<n; i++) {
+      nsnprintf( buf, sizeof(buf), "%s: %d, %.1f KiB", stats[i].name,
+            stats[i].n, (double)stats[i].bytes / 1024. );
+      cli_addMessage( buf );
+      total += stats[i].bytes;
+   }
+   nsnprintf( buf, sizeof(buf), "Total: %.1f MiB", (double)total / (1024.*1024.) );
+   cli_addMessage( buf );
+   if (memstats_getInterval() > 0.) {
+      nsnprintf( buf, sizeof(buf), "Logging every %.0f seconds",
+            memstats_getInterval() );
+      cli_addMessage( buf );
+   }
+   return 0;
+}
+
+
+/**
+ * @brief Prints the messages that were logged the most.
+ *
+ * @usage logs() -- Prints the 10 most logged messages
+ * @usage logs(30) -- Prints the 30 most logged messages
+ *
+ *    @luatparam[opt=10] number n Number of messages to print.
+ * @luafunc logs( n )
+ */
+static int cli_logs( lua_State *L )
+{
+   char buf[CLI_MAX_INPUT];
+   LogCount counts[64];
+   int i, n;
+
+   n = MIN( luaL_optinteger(L,1,10), 64 );
+   n = log_getCounts( counts, MAX(n,0) );
+   for (i=0; i<n; i++) {
+      if (counts[i].suppressed > 0)
+         nsnprintf( buf, sizeof(buf), "%u (%u not shown): %s", counts[i].count,
+               counts[i].suppressed, counts[i].sample );
+      else
+         nsnprintf( buf, sizeof(buf), "%u: %s", counts[i].count,
+               counts[i].sample );
+      cli_addMessage( buf );
+   }
+   return 0;
+}
+
+
 /**
  * @brief Would be like "dofile" from the base Lua lib.
  */
@@ -23,6 +23,7 @@
 #include "ndata.h"
 #include "nxml.h"
 #include "shipstats.h"
+#include "nhash.h"
 
 
 #define DTYPE_XML_ID     "dtypes"   /**< XML Document tag. */
@@ -46,6 +47,7 @@ typedef struct DTYPE_ {
 
 static DTYPE* dtype_types  = NULL;  /**< Total damage types. */
 static int dtype_ntypes    = 0;     /**< Total number of damage types. */
+static NameHash dtype_hash;         /**< Damage type name to index. */
 
 
 /*
@@ -141,9 +143,10 @@ static void DTYPE_free( DTYPE *damtype )
 int dtype_get( char* name )
 {
    int i;
-   for (i=0; i<dtype_ntypes; i++)
-      if (strcmp(dtype_types[i].name, name)==0)
-         return i;
+
+   i = nhash_get( &dtype_hash, name );
+   if (i >= 0)
+      return i;
    WARN("Damage type '%s' not found in stack.", name);
    return -1;
 }
@@ -181,7 +184,7 @@ char* dtype_damageTypeToStr( int type )
  */
 int dtype_load (void)
 {
-   int mem;
+   int i, mem;
    uint32_t bufsize;
    char *buf;
    xmlNodePtr node;
@@ -226,9 +229,21 @@ int dtype_load (void)
       DTYPE_parse( &dtype_types[dtype_ntypes-1], node );
 
    } while (xml_nextNode(node));
+   /* Pilots only keep multipliers for so many. */
+   if (dtype_ntypes > DTYPE_MAX) {
+      WARN("'"DTYPE_DATA_PATH"' has %d damage types, only the first %d are used.",
+            dtype_ntypes, DTYPE_MAX);
+      while (dtype_ntypes > DTYPE_MAX)
+         DTYPE_free( &dtype_types[ --dtype_ntypes ] );
+   }
    /* Shrink back to minimum - shouldn't change ever. */
    dtype_types = realloc(dtype_types, sizeof(DTYPE) * dtype_ntypes);
 
+   /* Index by name. */
+   nhash_init( &dtype_hash );
+   for (i=0; i<dtype_ntypes; i++)
+      nhash_set( &dtype_hash, dtype_types[i].name, i );
+
    /* Clean up. */
    xmlFreeDoc(doc);
    free(buf);
@@ -250,6 +265,7 @@ void dtype_free (void)
    free( dtype_types );
    dtype_types    = NULL;
    dtype_ntypes   = 0;
+   nhash_free( &dtype_hash );
 }
 
 
@@ -304,3 +320,60 @@ void dtype_calcDamage( double *dshield, double *darmour, double absorb, double *
 }
 
 
+/**
+ * @brief Computes the multipliers of every damage type against a ship.
+ *
+ * Done whenever the stats change so hits don't have to look them up.
+ *
+ *    @param[out] mods Multipliers of each damage type.
+ *    @param s Stats of the ship, NULL if it has none.
+ */
+void dtype_calcMods( DTypeMod mods[DTYPE_MAX], const ShipStats *s )
+{
+   int i;
+   const DTYPE *dtype;
+   const char *ptr;
+
+   ptr = (const char*) s;
+   for (i=0; i<dtype_ntypes; i++) {
+      dtype = &dtype_types[i];
+      mods[i].shield = dtype->sdam;
+      mods[i].armour = dtype->adam;
+      mods[i].knock  = dtype->knock;
+      /* Same as dtype_calcDamage(), undo ss_statsInit's initialization. */
+      if ((dtype->soffset > 0) && (s != NULL))
+         mods[i].shield *= 2. - *(const double*) &ptr[ dtype->soffset ];
+      if ((dtype->aoffset > 0) && (s != NULL))
+         mods[i].armour *= 2. - *(const double*) &ptr[ dtype->aoffset ];
+   }
+}
+
+
+/**
+ * @brief Gives the real shield damage, armour damage and knockback modifier
+ *  from multipliers computed by dtype_calcMods().
+ *
+ *    @param[out] dshield Real shield damage.
+ *    @param[out] darmour Real armour damage.
+ *    @param[in] absorb Absorption value.
+ *    @param[out] knockback Knockback modifier.
+ *    @param[in] dmg Damage information.
+ *    @param[in] mods Multipliers of the ship being hit.
+ */
+void dtype_calcDamageMod( double *dshield, double *darmour, double absorb,
+      double *knockback, const Damage *dmg, const DTypeMod mods[DTYPE_MAX] )
+{
+   const DTypeMod *mod;
+
+   /* Must be valid. */
+   if (dtype_validType( dmg->type ) == NULL)
+      return;
+   mod = &mods[ dmg->type ];
+
+   if (dshield != NULL)
+      *dshield  = mod->shield * dmg->damage * absorb;
+   if (darmour != NULL)
+      *darmour  = mod->armour * dmg->damage * absorb;
+   if (knockback != NULL)
+      *knockback = mod->knock;
+}
@@ -9,6 +9,20 @@
 
 #include "outfit.h"
 
+
+#define DTYPE_MAX    16 /**< Maximum number of damage types. */
+
+
+/**
+ * @brief Multipliers of a damage type against a ship.
+ */
+typedef struct DTypeMod_ {
+   double shield; /**< Shield damage multiplier. */
+   double armour; /**< Armour damage multiplier. */
+   double knock; /**< Knockback. */
+} DTypeMod;
+
+
 /*
  * stack manipulation
  */
@@ -26,6 +40,9 @@ void dtype_free (void);
  */
 void dtype_calcDamage( double *dshield, double *darmour, double absorb,
       double *knockback, const Damage *dmg, ShipStats *s );
+void dtype_calcMods( DTypeMod mods[DTYPE_MAX], const ShipStats *s );
+void dtype_calcDamageMod( double *dshield, double *darmour, double absorb,
+      double *knockback, const Damage *dmg, const DTypeMod mods[DTYPE_MAX] );
 
 
 #endif /* _DTYPE_H */
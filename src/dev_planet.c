@@ -137,7 +137,7 @@ int dpl_savePlanet( const Planet *p )
    /* Write data. */
    cleanName = uniedit_nameFilter( p->name );
    nsnprintf( file, sizeof(file), "%s/%s.xml", conf.dev_save_asset, cleanName );
-   xmlSaveFileEnc( file, doc, "UTF-8" );
+   xmlw_saveIfChanged( doc, file );
 
    /* Clean up. */
    xmlFreeDoc(doc);
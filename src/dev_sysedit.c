@@ -130,6 +130,7 @@ static void sysedit_planetDescClose( unsigned int wid, char *unused );
 static void sysedit_genServicesList( unsigned int wid );
 static void sysedit_btnTechEdit( unsigned int wid, char *unused );
 static void sysedit_genTechList( unsigned int wid );
+static void sysedit_techMove( unsigned int wid, const char *from, const char *to );
 static void sysedit_btnAddTech( unsigned int wid, char *unused );
 static void sysedit_btnRmTech( unsigned int wid, char *unused );
 static void sysedit_btnAddService( unsigned int wid, char *unused );
@@ -281,6 +282,9 @@ static void sysedit_close( unsigned int wid, char *wgt )
    /* Reconstruct universe presences. */
    space_reconstructPresences();
 
+   /* Economy changes were deferred while editing. */
+   economy_execQueued();
+
    /* Close the window. */
    window_close( wid, wgt );
 
@@ -304,7 +308,7 @@ static void sysedit_editPntClose( unsigned int wid, char *unused )
    p = sysedit_sys->planets[ sysedit_select[0].u.planet ];
 
    /* Remove the old presence. */
-   system_addPresence(sysedit_sys, p->faction, -p->presenceAmount, p->presenceRange);
+   planet_rmPresence( p );
 
    p->population = (uint64_t)strtoull( window_getInput( sysedit_widEdit, "inpPop" ), 0, 10);
 
@@ -331,7 +335,7 @@ static void sysedit_editPntClose( unsigned int wid, char *unused )
    p->hide           = pow2( atof(window_getInput( sysedit_widEdit, "inpHide" )) );
 
    /* Add the new presence. */
-   system_addPresence(sysedit_sys, p->faction, p->presenceAmount, p->presenceRange);
+   planet_addPresence( p, sysedit_sys );
 
    if (conf.devautosave)
       dpl_savePlanet( p );
@@ -380,12 +384,9 @@ static void sysedit_btnNew( unsigned int wid_unused, char *unused )
    p->hide              = pow2(HIDE_DEFAULT_PLANET);
    p->radius            = b->radius;
 
-   /* Add new planet. */
+   /* Add new planet, the economy gets updated when closing the editor. */
    system_addPlanet( sysedit_sys, name );
 
-   /* Update economy due to galaxy modification. */
-   economy_execQueued();
-
    if (conf.devautosave)
       dpl_savePlanet( p );
 
@@ -439,6 +440,7 @@ static void sysedit_btnRename( unsigned int wid_unused, char *unused )
          free(p->name);
 
          p->name = name;
+         space_namesChanged();
          window_modifyText( sysedit_widEdit, "txtName", p->name );
          dpl_savePlanet( p );
       }
@@ -472,9 +474,6 @@ static void sysedit_btnRemove( unsigned int wid_unused, char *unused )
             system_rmPlanet( sysedit_sys, sysedit_sys->planets[ sel->u.planet ]->name );
          }
       }
-
-      /* Update economy due to galaxy modification. */
-      economy_execQueued();
    }
 }
 
@@ -491,11 +490,11 @@ static void sysedit_btnReset( unsigned int wid_unused, char *unused )
    for (i=0; i<sysedit_nselect; i++) {
       sel = &sysedit_select[i];
       if (sel->type == SELECT_JUMPPOINT)
-         sysedit_sys[i].jumps[ sel->u.jump ].flags |= JP_AUTOPOS;
+         sysedit_sys->jumps[ sel->u.jump ].flags |= JP_AUTOPOS;
    }
 
-   /* Must reconstruct jumps. */
-   systems_reconstructJumps();
+   /* Only this system's jumps moved, connections are unchanged. */
+   system_reconstructJumps( sysedit_sys );
 }
 
 
@@ -558,8 +557,8 @@ void sysedit_sysScale( StarSystem *sys, double factor )
       vect_cset( &jp->pos, jp->pos.x*factor, jp->pos.y*factor );
    }
 
-   /* Must reconstruct jumps. */
-   systems_reconstructJumps();
+   /* Only this system's jumps moved, connections are unchanged. */
+   system_reconstructJumps( sys );
 }
 
 /**
@@ -1762,8 +1761,8 @@ static void sysedit_btnAddTech( unsigned int wid, char *unused )
       p->tech = tech_groupCreate();
    tech_addItemTech( p->tech, selected );
 
-   /* Regenerate the list. */
-   sysedit_genTechList( wid );
+   /* Move it over instead of regenerating the lists. */
+   sysedit_techMove( wid, "lstTechsLacked", "lstTechsHave" );
 }
 
 
@@ -1789,8 +1788,39 @@ static void sysedit_btnRmTech( unsigned int wid, char *unused )
    if (!n)
       p->tech = NULL;
 
-   /* Regenerate the list. */
-   sysedit_genTechList( wid );
+   /* Move it over instead of regenerating the lists. */
+   sysedit_techMove( wid, "lstTechsHave", "lstTechsLacked" );
+}
+
+
+/**
+ * @brief Moves the selected tech from a list to the other.
+ *
+ * Lists with the "None" placeholder are used as is, as lists are never left
+ *  empty.
+ *
+ *    @param wid Window the lists are in.
+ *    @param from List the tech is selected in.
+ *    @param to List to move the tech to.
+ */
+static void sysedit_techMove( unsigned int wid, const char *from, const char *to )
+{
+   char *item;
+
+   item = toolkit_listRemove( wid, from, toolkit_getListPos( wid, from ) );
+   if (item == NULL)
+      return;
+
+   /* Replace the placeholder, no tech is called that. */
+   if (toolkit_setList( wid, to, "None" ) != NULL)
+      free( toolkit_listRemove( wid, to, toolkit_getListPos( wid, to ) ) );
+   toolkit_setListPos( wid, to, toolkit_listInsert( wid, to, -1, item ) );
+
+   /* Removing the last option leaves nothing selected. */
+   if (toolkit_getListPos( wid, from ) < 0) {
+      toolkit_listInsert( wid, from, 0, strdup("None") );
+      toolkit_setListPos( wid, from, 0 );
+   }
 }
 
 
@@ -1989,7 +2019,7 @@ static void sysedit_btnGFXApply( unsigned int wid, char *wgt )
    }
    else { /* Free old texture, load new. */
       free( p->gfx_spacePath );
-      gl_freeTexture( p->gfx_space );
+      planet_gfxFree( p );
       p->gfx_space     = gl_newImage( buf, OPENGL_TEX_MIPMAPS );
       p->gfx_spacePath = strdup( str );
       planet_setRadiusFromGFX(p);
@@ -196,7 +196,7 @@ int dsys_saveSystem( StarSystem *sys )
    /* Write data. */
    cleanName = uniedit_nameFilter( sys->name );
    nsnprintf( file, sizeof(file), "%s/%s.xml", conf.dev_save_sys, cleanName );
-   xmlSaveFileEnc( file, doc, "UTF-8" );
+   xmlw_saveIfChanged( doc, file );
 
    /* Clean up. */
    xmlFreeDoc(doc);
@@ -209,6 +209,8 @@ int dsys_saveSystem( StarSystem *sys )
 /**
  * @brief Saves all the star systems.
  *
+ * Only the files of systems that changed get rewritten.
+ *
  *    @return 0 on success.
  */
 int dsys_saveAll (void)
@@ -79,6 +79,10 @@ static int uniedit_nsys       = 0;  /**< Number of selected systems. */
 static int uniedit_msys       = 0;  /**< Memory allocated for selected systems. */
 static double uniedit_mx      = 0.; /**< X mouse position. */
 static double uniedit_my      = 0.; /**< Y mouse position. */
+static int *uniedit_undoSys   = NULL; /**< Systems moved by the last drag. */
+static Vector2d *uniedit_undoPos = NULL; /**< Positions before the last drag. */
+static int uniedit_nundo      = 0;  /**< Number of systems moved by the last drag. */
+static int uniedit_dragMoving = 0;  /**< Selected systems moved during this drag. */
 
 
 static map_find_t *found_cur  = NULL;  /**< Pointer to found stuff. */
@@ -92,6 +96,10 @@ static int found_ncur         = 0;     /**< Number of found stuff. */
 static void uniedit_deselect (void);
 static void uniedit_selectAdd( StarSystem *sys );
 static void uniedit_selectRm( StarSystem *sys );
+/* Undo. */
+static void uniedit_undoSave (void);
+static void uniedit_undoMove (void);
+static void uniedit_undoFree (void);
 /* System and asset search. */
 static void uniedit_findSys (void);
 static void uniedit_findSysClose( unsigned int wid, char *name );
@@ -250,7 +258,6 @@ void uniedit_open( unsigned int wid_unused, char *unused )
 static int uniedit_keys( unsigned int wid, SDLKey key, SDLMod mod )
 {
    (void) wid;
-   (void) mod;
 
    switch (key) {
       /* Mode changes. */
@@ -258,6 +265,13 @@ static int uniedit_keys( unsigned int wid, SDLKey key, SDLMod mod )
          uniedit_mode = UNIEDIT_DEFAULT;
          return 1;
 
+      /* Undo the last move. */
+      case SDLK_z:
+         if (!(mod & (KMOD_LCTRL | KMOD_RCTRL)))
+            return 0;
+         uniedit_undoMove();
+         return 1;
+
       default:
          return 0;
    }
@@ -271,10 +285,14 @@ static void uniedit_close( unsigned int wid, char *wgt )
 {
    /* Frees some memory. */
    uniedit_deselect();
+   uniedit_undoFree();
 
    /* Reconstruct jumps. */
    systems_reconstructJumps();
 
+   /* Economy changes were deferred while editing. */
+   economy_execQueued();
+
    /* Unpause. */
    unpause_game();
 
@@ -557,6 +575,7 @@ static int uniedit_mouse( unsigned int wid, SDL_Event* event, double mx, double
                            uniedit_tadd      = -1;
                         uniedit_dragTime  = SDL_GetTicks();
                         uniedit_moved     = 0;
+                        uniedit_dragMoving = 0;
                      }
                      return 1;
                   }
@@ -575,6 +594,7 @@ static int uniedit_mouse( unsigned int wid, SDL_Event* event, double mx, double
                      uniedit_dragSys   = 1;
                      uniedit_dragTime  = SDL_GetTicks();
                      uniedit_moved     = 0;
+                     uniedit_dragMoving = 0;
                   }
                   else if (uniedit_mode == UNIEDIT_JUMP) {
                      uniedit_toggleJump( sys );
@@ -616,7 +636,7 @@ static int uniedit_mouse( unsigned int wid, SDL_Event* event, double mx, double
                }
             }
             uniedit_dragSys   = 0;
-            if (conf.devautosave)
+            if (conf.devautosave && uniedit_dragMoving)
                for (i=0; i<uniedit_nsys; i++)
                   dsys_saveSystem(uniedit_sys[i]);
          }
@@ -638,6 +658,11 @@ static int uniedit_mouse( unsigned int wid, SDL_Event* event, double mx, double
          }
          else if (uniedit_dragSys && (uniedit_nsys > 0)) {
             if ((uniedit_moved > UNIEDIT_MOVE_THRESHOLD) || (SDL_GetTicks() - uniedit_dragTime > UNIEDIT_DRAG_THRESHOLD)) {
+               /* The whole drag is undone at once. */
+               if (!uniedit_dragMoving) {
+                  uniedit_undoSave();
+                  uniedit_dragMoving = 1;
+               }
                for (i=0; i<uniedit_nsys; i++) {
                   uniedit_sys[i]->pos.x += ((double)event->motion.xrel) / uniedit_zoom;
                   uniedit_sys[i]->pos.y -= ((double)event->motion.yrel) / uniedit_zoom;
@@ -739,6 +764,7 @@ static void uniedit_renameSys (void)
       free(sys->name);
 
       sys->name = name;
+      space_namesChanged();
       dsys_saveSystem(sys);
 
       /* Re-save adjacent systems. */
@@ -957,6 +983,60 @@ static void uniedit_selectRm( StarSystem *sys )
 }
 
 
+/**
+ * @brief Remembers where the selected systems are before moving them.
+ *
+ * Systems are stored by index, since adding a system can move the stack.
+ */
+static void uniedit_undoSave (void)
+{
+   int i;
+
+   uniedit_undoFree();
+   if (uniedit_nsys <= 0)
+      return;
+
+   uniedit_undoSys = malloc( sizeof(int) * uniedit_nsys );
+   uniedit_undoPos = malloc( sizeof(Vector2d) * uniedit_nsys );
+   for (i=0; i<uniedit_nsys; i++) {
+      uniedit_undoSys[i] = uniedit_sys[i]->id;
+      uniedit_undoPos[i] = uniedit_sys[i]->pos;
+   }
+   uniedit_nundo = uniedit_nsys;
+}
+
+
+/**
+ * @brief Moves the systems of the last drag back to where they were.
+ */
+static void uniedit_undoMove (void)
+{
+   int i;
+   StarSystem *sys;
+
+   for (i=0; i<uniedit_nundo; i++) {
+      sys      = system_getIndex( uniedit_undoSys[i] );
+      sys->pos = uniedit_undoPos[i];
+      if (conf.devautosave)
+         dsys_saveSystem( sys );
+   }
+   uniedit_undoFree();
+}
+
+
+/**
+ * @brief Forgets the last move.
+ */
+static void uniedit_undoFree (void)
+{
+   free( uniedit_undoSys );
+   free( uniedit_undoPos );
+   uniedit_undoSys = NULL;
+   uniedit_undoPos = NULL;
+   uniedit_nundo   = 0;
+}
+
+
 /**
  * @brief Sets the selected system text.
  */
@@ -1471,9 +1551,6 @@ static void uniedit_btnEditRmAsset( unsigned int wid, char *unused )
       return;
    }
 
-   /* Update economy due to galaxy modification. */
-   economy_execQueued();
-
    uniedit_editGenList( wid );
 }
 
@@ -1546,9 +1623,6 @@ static void uniedit_btnEditAddAssetAdd( unsigned int wid, char *unused )
       return;
    }
 
-   /* Update economy due to galaxy modification. */
-   economy_execQueued();
-
    /* Regenerate the list. */
    uniedit_editGenList( uniedit_widEdit );
 
@@ -36,6 +36,7 @@
 #include "menu.h"
 #include "nstring.h"
 #include "ndata.h"
+#include "replay.h"
 
 
 static int dialogue_open; /**< Number of dialogues open. */
@@ -849,7 +850,7 @@ static int toolkit_loop( int *loop_done )
       /* Loop first so exit condition is checked before next iteration. */
       main_loop( 0 );
 
-      while (SDL_PollEvent(&event)) { /* event loop */
+      while (replay_pollEvent(&event)) { /* event loop */
          if (event.type == SDL_QUIT) { /* pass quit event to main engine */
             if (menu_askQuit()) {
                naev_quit();
@@ -10,6 +10,10 @@
  * Economy is handled with Nodal Analysis.  Systems are modelled as nodes,
  *  jump routes are resistances and production is modelled as node intensity.
  *  This is then solved with linear algebra after each time increment.
+ *
+ * The solve runs in the threadpool, from a copy of the intensities, and the
+ *  new prices are only put into the systems from the main loop once it is
+ *  done, so they keep their old values until then.
  */
 
 
@@ -20,6 +24,10 @@
 #include <stdio.h>
 #include "nstring.h"
 #include <stdint.h>
+#include <math.h>
+
+#include "SDL.h"
+#include "SDL_thread.h"
 
 #ifdef HAVE_SUITESPARSE_CS_H
 #include <suitesparse/cs.h>
@@ -35,6 +43,8 @@
 #include "rng.h"
 #include "space.h"
 #include "ntime.h"
+#include "threadpool.h"
+#include "nhash.h"
 
 
 #define XML_COMMODITY_ID      "Commodities" /**< XML document identifier */
@@ -49,11 +59,14 @@
 #define ECON_FACTION_MOD   0.1 /**< Modifier on Base for faction standings. */
 #define ECON_PROD_MODIFIER 500000. /**< Production modifier, divide production by this amount. */
 #define ECON_PROD_VAR      0.01 /**< Defines the variability of production. */
+#define ECON_SIM_DT        NT_STP_STU /**< Time each simulated step covers. */
+#define ECON_SIM_TOL       1e-9 /**< Largest price change for the simulation to be converged. */
 
 
 /* commodity stack */
 static Commodity* commodity_stack = NULL; /**< Contains all the commodities. */
 static int commodity_nstack       = 0; /**< Number of commodities in the stack. */
+static NameHash commodity_hash; /**< Commodity name to stack index. */
 
 
 /* systems stack. */
@@ -68,7 +81,35 @@ static int econ_initialized   = 0; /**< Is economy system initialized? */
 static int econ_queued        = 0; /**< Whether there are any queued updates. */
 static int *econ_comm         = NULL; /**< Commodities to calculate. */
 static int econ_nprices       = 0; /**< Number of prices to calculate. */
-static cs *econ_G             = NULL; /**< Admittance matrix. */
+static cs *econ_G             = NULL; /**< Admittance matrix, only used by the solver. */
+static css *econ_S            = NULL; /**< Symbolic analysis of econ_G's Cholesky factorization. */
+static csn *econ_N            = NULL; /**< Cholesky factorization of econ_G. */
+static cs *econ_Gnext         = NULL; /**< New admittance matrix waiting for the solver. */
+
+
+/**
+ * @brief Price solve running in the threadpool.
+ *
+ * The solver owns econ_G and its factorization while it runs, the main
+ *  thread only touches the prices once it is done.
+ */
+typedef struct EconSolve_ {
+   cs *G; /**< New admittance matrix to factor first, NULL to keep econ_G. */
+   double *X; /**< Intensities, overwritten by the solution, nprices blocks of n. */
+   int n; /**< Number of systems. */
+   int nprices; /**< Number of price sets. */
+   double *B; /**< Copy of the intensities to check the solution against, or NULL. */
+   double residual; /**< Largest |G*X - B| of the solution, if B is set. */
+   double ms; /**< Milliseconds spent solving. */
+} EconSolve;
+static EconSolve econ_job; /**< Current solve. */
+static SDL_sem *econ_done     = NULL; /**< Posted when the running solve finished. */
+static int econ_busy          = 0; /**< Whether a solve is running. */
+static int econ_again         = 0; /**< Whether another solve was asked for while busy. */
+static unsigned int econ_againDt = 0; /**< Time to solve for once the current solve is done. */
+static int econ_check         = 0; /**< Whether solves check their solution, when simulating. */
+static double econ_residual   = 0.; /**< Residual of the last solve put in, if checked. */
+static double econ_solveMs    = 0.; /**< Milliseconds the last solve put in took. */
 
 
 /*
@@ -80,6 +121,15 @@ static int commodity_parse( Commodity *temp, xmlNodePtr parent );
 /* Economy. */
 static double econ_calcJumpR( StarSystem *A, StarSystem *B );
 static int econ_createGMatrix (void);
+static void econ_factorGMatrix (void);
+static void econ_freeGMatrix (void);
+static int econ_solve( double *X, double *work );
+static int econ_solveJob( void *data );
+static int econ_start( unsigned int dt );
+static void econ_wait (void);
+static void econ_finish (void);
+static void econ_cachePrices( StarSystem *sys );
+static double econ_clock (void);
 credits_t economy_getPrice( const Commodity *com,
       const StarSystem *sys, const Planet *p ); /* externed in land.c */
 
@@ -132,6 +182,19 @@ void price2str(char *str, credits_t price, credits_t credits, int decimals )
    free(buf);
 }
 
+/**
+ * @brief Gets all the commodities.
+ *
+ *    @param[out] n Number of commodities.
+ *    @return The commodity stack.
+ */
+Commodity* commodity_getAll( int *n )
+{
+   *n = commodity_nstack;
+   return commodity_stack;
+}
+
+
 /**
  * @brief Gets a commodity by name.
  *
@@ -141,9 +204,10 @@ void price2str(char *str, credits_t price, credits_t credits, int decimals )
 Commodity* commodity_get( const char* name )
 {
    int i;
-   for (i=0; i<commodity_nstack; i++)
-      if (strcmp(commodity_stack[i].name,name)==0)
-         return &commodity_stack[i];
+
+   i = nhash_get( &commodity_hash, name );
+   if (i >= 0)
+      return &commodity_stack[i];
 
    WARN("Commodity '%s' not found in stack", name);
    return NULL;
@@ -159,9 +223,10 @@ Commodity* commodity_get( const char* name )
 Commodity* commodity_getW( const char* name )
 {
    int i;
-   for (i=0; i<commodity_nstack; i++)
-      if (strcmp(commodity_stack[i].name,name)==0)
-         return &commodity_stack[i];
+
+   i = nhash_get( &commodity_hash, name );
+   if (i >= 0)
+      return &commodity_stack[i];
    return NULL;
 }
 
@@ -238,17 +303,17 @@ static int commodity_parse( Commodity *temp, xmlNodePtr parent )
       xmlr_int(node, "price", temp->price);
       if (xml_isNode(node,"gfx_store")) {
          temp->gfx_store = xml_parseTexture( node,
-               COMMODITY_GFX_PATH"%s.png", 1, 1, OPENGL_TEX_MIPMAPS );
+               COMMODITY_GFX_PATH"%s.png", 1, 1, OPENGL_TEX_MIPMAPS | OPENGL_TEX_ATLAS );
          if (temp->gfx_store != NULL) {
          } else {
-            temp->gfx_store = gl_newImage( COMMODITY_GFX_PATH"_default.png", 0 );
+            temp->gfx_store = gl_newImage( COMMODITY_GFX_PATH"_default.png", OPENGL_TEX_ATLAS );
          }
          continue;
       }
    } while (xml_nextNode(node));
    if ((temp->gfx_store == NULL) && (temp->price>0)) {
       WARN("No <gfx_store> node found, using default texture for commodity \"%s\"", temp->name);
-      temp->gfx_store = gl_newImage( COMMODITY_GFX_PATH"_default.png", 0 );
+      temp->gfx_store = gl_newImage( COMMODITY_GFX_PATH"_default.png", OPENGL_TEX_ATLAS );
    }
 
 #if 0 /* shouldn't be needed atm */
@@ -308,6 +373,7 @@ void commodity_Jettison( int pilot, Commodity* com, int quantity )
  */
 int commodity_load (void)
 {
+   int i;
    uint32_t bufsize;
    char *buf;
    xmlNodePtr node;
@@ -362,6 +428,11 @@ int commodity_load (void)
    xmlFreeDoc(doc);
    free(buf);
 
+   /* Index by name. */
+   nhash_init( &commodity_hash );
+   for (i=0; i<commodity_nstack; i++)
+      nhash_set( &commodity_hash, commodity_stack[i].name, i );
+
    DEBUG("Loaded %d Commodit%s", commodity_nstack, (commodity_nstack==1) ? "y" : "ies" );
 
    return 0;
@@ -381,6 +452,7 @@ void commodity_free (void)
    free( commodity_stack );
    commodity_stack = NULL;
    commodity_nstack = 0;
+   nhash_free( &commodity_hash );
 
    /* More clean up. */
    free( econ_comm );
@@ -399,27 +471,38 @@ credits_t economy_getPrice( const Commodity *com,
       const StarSystem *sys, const Planet *p )
 {
    (void) p;
-   int i, k;
-   double price;
-
-   /* Get position in stack. */
-   k = com - commodity_stack;
 
-   /* Find what commodity that is. */
-   for (i=0; i<econ_nprices; i++)
-      if (econ_comm[i] == k)
-         break;
-
-   /* Check if found. */
-   if (i >= econ_nprices) {
+   /* Only commodities with a base price are in the economy. */
+   if (com->price <= 0.) {
       WARN("Price for commodity '%s' not known.", com->name);
       return 0;
    }
 
-   /* Calculate price. */
-   price  = (double) com->price;
-   price *= sys->prices[i];
-   return (credits_t) price;
+   /* Systems created since the last solve have no prices yet. */
+   if (sys->comm_prices == NULL)
+      return 0;
+
+   return sys->comm_prices[ com - commodity_stack ];
+}
+
+
+/**
+ * @brief Computes the price of every commodity in a system.
+ *
+ * Done once per solve so looking up prices is only reading an array.
+ *
+ *    @param sys System to compute prices in.
+ */
+static void econ_cachePrices( StarSystem *sys )
+{
+   int i, k;
+
+   if (sys->comm_prices == NULL)
+      sys->comm_prices = calloc( commodity_nstack, sizeof(credits_t) );
+   for (i=0; i<econ_nprices; i++) {
+      k = econ_comm[i];
+      sys->comm_prices[k] = (credits_t)(commodity_stack[k].price * sys->prices[i]);
+   }
 }
 
 
@@ -550,12 +633,13 @@ static int econ_createGMatrix (void)
       cs_entry( M, i, i, Rsum );
    }
 
-   /* Compress M matrix and put into G. */
-   if (econ_G != NULL)
-      cs_spfree( econ_G );
-   econ_G = cs_compress( M );
-   if (econ_G == NULL)
+   /* Compress M matrix and hand it to the next solve. */
+   if (econ_Gnext != NULL)
+      cs_spfree( econ_Gnext );
+   econ_Gnext = cs_compress( M );
+   if (econ_Gnext == NULL)
       ERR("Unable to create economy G Matrix.");
+   cs_dupl( econ_Gnext ); /* Jumps both ways enter the same cell twice. */
 
    /* Clean up. */
    cs_spfree(M);
@@ -564,6 +648,196 @@ static int econ_createGMatrix (void)
 }
 
 
+/**
+ * @brief Factors the admittance matrix.
+ *
+ * The matrix is symmetric and strictly diagonally dominant with a positive
+ *  diagonal thanks to the self resistance, so it is positive definite and
+ *  the Cholesky factorization can be used.
+ */
+static void econ_factorGMatrix (void)
+{
+   econ_S = cs_schol( 1, econ_G );
+   econ_N = (econ_S != NULL) ? cs_chol( econ_G, econ_S ) : NULL;
+   if (econ_N == NULL) {
+      WARN("Unable to factor the economy G Matrix, falling back to QR.");
+      econ_S = cs_sfree( econ_S );
+   }
+}
+
+
+/**
+ * @brief Frees the admittance matrix and its factorization.
+ */
+static void econ_freeGMatrix (void)
+{
+   econ_N = cs_nfree( econ_N );
+   econ_S = cs_sfree( econ_S );
+   if (econ_G != NULL) {
+      cs_spfree( econ_G );
+      econ_G = NULL;
+   }
+}
+
+
+/**
+ * @brief Solves the economy system for a price set.
+ *
+ *    @param[in,out] X Intensities of the systems, overwritten by the solution.
+ *    @param work Workspace of systems_nstack elements.
+ *    @return 1 on success.
+ */
+static int econ_solve( double *X, double *work )
+{
+   int n;
+
+   /* No factorization, do it the slow way. */
+   if (econ_N == NULL)
+      return cs_qrsol( 3, econ_G, X );
+
+   n = econ_G->n;
+   cs_ipvec( econ_S->pinv, X, work, n ); /* work = P*X */
+   cs_lsolve( econ_N->L, work ); /* work = L\work */
+   cs_ltsolve( econ_N->L, work ); /* work = L'\work */
+   cs_pvec( econ_S->pinv, work, X, n ); /* X = P'*work */
+   return 1;
+}
+
+
+/**
+ * @brief Solves all the price sets, run in the threadpool.
+ *
+ * The matrix is factored once whenever it changes, all the updates until
+ *  the next change reuse the factorization.
+ *
+ *    @param data The EconSolve to run.
+ *    @return 0 on success.
+ */
+static int econ_solveJob( void *data )
+{
+   int i, j;
+   double *work, t0;
+   EconSolve *job;
+
+   job = (EconSolve*) data;
+   t0  = econ_clock();
+
+   /* Factor the new matrix. */
+   if (job->G != NULL) {
+      econ_freeGMatrix();
+      econ_G = job->G;
+      job->G = NULL;
+      econ_factorGMatrix();
+   }
+
+   work = malloc( sizeof(double) * MAX(job->n,1) );
+   if (work == NULL)
+      WARN("Out of Memory!");
+   else {
+      for (j=0; j<job->nprices; j++)
+         if (econ_solve( &job->X[ j*job->n ], work ) != 1)
+            WARN("Failed to solve the Economy System.");
+
+      /* Check the solution against the intensities, work = G*X - B. */
+      job->residual = 0.;
+      for (j=0; (job->B != NULL) && (j<job->nprices); j++) {
+         for (i=0; i<job->n; i++)
+            work[i] = -job->B[ j*job->n + i ];
+         cs_gaxpy( econ_G, &job->X[ j*job->n ], work );
+         for (i=0; i<job->n; i++)
+            job->residual = MAX( job->residual, fabs(work[i]) );
+      }
+      free( work );
+   }
+   job->ms = econ_clock() - t0;
+
+   SDL_SemPost( econ_done );
+   return 0;
+}
+
+
+/**
+ * @brief Starts solving the prices in the background.
+ *
+ * If a solve is already running another one is done once it finishes.
+ *
+ *    @param dt Deltatick in NTIME.
+ *    @return 0 on success.
+ */
+static int econ_start( unsigned int dt )
+{
+   int i, j;
+   double *x;
+
+   if (econ_busy) {
+      econ_again    = 1;
+      econ_againDt += dt;
+      return 0;
+   }
+
+   /* Nothing to solve yet. */
+   if ((econ_G == NULL) && (econ_Gnext == NULL))
+      return 0;
+
+   /* Load the vectors with intensities, all price sets at once. */
+   econ_job.n       = systems_nstack;
+   econ_job.nprices = econ_nprices;
+   econ_job.X       = malloc( sizeof(double) * MAX(systems_nstack*econ_nprices,1) );
+   if (econ_job.X == NULL) {
+      WARN("Out of Memory!");
+      return -1;
+   }
+   for (j=0; j<econ_nprices; j++) {
+      x = &econ_job.X[ j*systems_nstack ];
+      for (i=0; i<systems_nstack; i++)
+         x[i] = econ_calcSysI( dt, &systems_stack[i], j );
+   }
+
+   econ_job.B = NULL;
+   if (econ_check) {
+      econ_job.B = malloc( sizeof(double) * MAX(systems_nstack*econ_nprices,1) );
+      if (econ_job.B != NULL)
+         memcpy( econ_job.B, econ_job.X, sizeof(double) * systems_nstack*econ_nprices );
+   }
+
+   econ_job.G = econ_Gnext;
+   econ_Gnext = NULL;
+   econ_busy  = 1;
+   if (threadpool_newJob( econ_solveJob, &econ_job ))
+      econ_solveJob( &econ_job ); /* No threadpool, solve right away. */
+
+   return 0;
+}
+
+
+/**
+ * @brief Blocks until the running solve is done and its prices are in.
+ */
+static void econ_wait (void)
+{
+   /* Another solve is only asked for while busy, and started by econ_finish(). */
+   while (econ_busy) {
+      while (SDL_SemWait( econ_done ) == -1)
+         WARN("SDL_SemWait failed! Error: %s", SDL_GetError());
+      econ_finish();
+   }
+}
+
+
+/**
+ * @brief Gets the time in milliseconds, for timing solves.
+ */
+static double econ_clock (void)
+{
+#if SDL_VERSION_ATLEAST(2,0,0)
+   return (double)SDL_GetPerformanceCounter() * 1e3 /
+         (double)SDL_GetPerformanceFrequency();
+#else /* SDL_VERSION_ATLEAST(2,0,0) */
+   return (double)SDL_GetTicks();
+#endif /* SDL_VERSION_ATLEAST(2,0,0) */
+}
+
+
 /**
  * @brief Initializes the economy.
  *
@@ -586,9 +860,11 @@ int economy_init (void)
 
    /* Mark economy as initialized. */
    econ_initialized = 1;
+   econ_done        = SDL_CreateSemaphore( 0 );
 
-   /* Refresh economy. */
+   /* Refresh economy, prices must be there from the start. */
    economy_refresh();
+   econ_wait();
 
    return 0;
 }
@@ -641,78 +917,227 @@ int economy_refresh (void)
 /**
  * @brief Updates the economy.
  *
+ * The prices are solved in the background, they are only changed once
+ *  economy_sync() finds the solve done.
+ *
  *    @param dt Deltatick in NTIME.
  */
 int economy_update( unsigned int dt )
 {
-   int ret;
+   /* Economy must be initialized. */
+   if (econ_initialized == 0)
+      return 0;
+
+   econ_queued = 0;
+   return econ_start( dt );
+}
+
+
+/**
+ * @brief Puts in the prices of a finished background solve.
+ *
+ * Called from the main loop, so the prices never change while being read.
+ */
+void economy_sync (void)
+{
+   if (!econ_busy)
+      return;
+   if (SDL_SemTryWait( econ_done ) != 0)
+      return;
+   econ_finish();
+}
+
+
+/**
+ * @brief Puts in the prices of the solve that just finished.
+ */
+static void econ_finish (void)
+{
    int i, j;
-   double *X;
+   double *x;
    double scale, offset;
    /*double min, max;*/
 
-   /* Economy must be initialized. */
-   if (econ_initialized == 0)
-      return 0;
+   econ_busy = 0;
+
+   /* The universe changed size while solving, the refresh that follows
+    * will have the right prices. */
+   if (econ_job.n == systems_nstack) {
+      for (j=0; j<econ_job.nprices; j++) {
+         x = &econ_job.X[ j*econ_job.n ];
+
+         /*
+          * Get the minimum and maximum to scale.
+          */
+         /*
+         min = +HUGE_VALF;
+         max = -HUGE_VALF;
+         for (i=0; i<systems_nstack; i++) {
+            if (x[i] < min)
+               min = x[i];
+            if (x[i] > max)
+               max = x[i];
+         }
+         scale = 1. / (max - min);
+         offset = 0.5 - min * scale;
+         */
 
-   /* Create the vector to solve the system. */
-   X = malloc(sizeof(double)*systems_nstack);
+         /*
+          * I'm not sure I like the filtering of the results, but it would take
+          * much more work to get a sane system working without the need of post
+          * filtering.
+          */
+         scale    = 1.;
+         offset   = 1.;
+         for (i=0; i<systems_nstack; i++)
+            systems_stack[i].prices[j] = x[i] * scale + offset;
+      }
+      for (i=0; i<systems_nstack; i++)
+         econ_cachePrices( &systems_stack[i] );
+   }
+   free( econ_job.X );
+   econ_job.X = NULL;
+   free( econ_job.B );
+   econ_job.B = NULL;
+   econ_residual = econ_job.residual;
+   econ_solveMs  = econ_job.ms;
+
+   /* Run the solve that was asked for meanwhile. */
+   if (econ_again) {
+      econ_again = 0;
+      econ_start( econ_againDt );
+      econ_againDt = 0;
+   }
+}
+
+
+/**
+ * @brief Solves the economy system repeatedly to benchmark the solver.
+ *
+ * Uses the sparse QR solver on the real admittance matrix with fixed
+ *  intensities, the prices are left untouched.
+ *
+ *    @param n Number of times to solve.
+ *    @return 0 on success.
+ */
+int economy_benchSolve( int n )
+{
+   int i, j, ret;
+   double *X;
+
+   economy_init();
+   econ_wait(); /* The solver must not be holding the matrix. */
+   if (econ_G == NULL)
+      return -1;
+
+   X = malloc( sizeof(double) * MAX(econ_G->n,1) );
    if (X == NULL) {
       WARN("Out of Memory!");
       return -1;
    }
+   ret = 0;
+   for (i=0; i<n; i++) {
+      for (j=0; j<econ_G->n; j++)
+         X[j] = (j%2) ? 1. : -1.;
+      if (cs_qrsol( 3, econ_G, X ) != 1)
+         ret = -1;
+   }
+   free( X );
+   return ret;
+}
 
-   /* Calculate the results for each price set. */
-   for (j=0; j<econ_nprices; j++) {
 
-      /* First we must load the vector with intensities. */
-      for (i=0; i<systems_nstack; i++)
-         X[i] = econ_calcSysI( dt, &systems_stack[i], j );
-
-      /* Solve the system. */
-      /** @TODO This should be improved to try to use better factorizations (LU/Cholesky)
-       * if possible or just outright try to use some other library that does fancy stuff
-       * like UMFPACK. Would be also interesting to see if it could be optimized so we
-       * store the factorization or update that instead of handling it individually. Another
-       * point of interest would be to split loops out to make the solving faster, however,
-       * this may be trickier to do (although it would surely let us use cholesky always if we
-       * enforce that condition). */
-      ret = cs_qrsol( 3, econ_G, X );
-      if (ret != 1)
-         WARN("Failed to solve the Economy System.");
-
-      /*
-       * Get the minimum and maximum to scale.
-       */
-      /*
-      min = +HUGE_VALF;
-      max = -HUGE_VALF;
-      for (i=0; i<systems_nstack; i++) {
-         if (X[i] < min)
-            min = X[i];
-         if (X[i] > max)
-            max = X[i];
-      }
-      scale = 1. / (max - min);
-      offset = 0.5 - min * scale;
-      */
-
-      /*
-       * I'm not sure I like the filtering of the results, but it would take
-       * much more work to get a sane system working without the need of post
-       * filtering.
-       */
-      scale    = 1.;
-      offset   = 1.;
-      for (i=0; i<systems_nstack; i++)
-         systems_stack[i].prices[j] = X[i] * scale + offset;
+/**
+ * @brief Runs the economy without the game to tune it.
+ *
+ * Every step is a full economy_update() with the real matrix and solver,
+ *  one row per step and price set is written to the CSV file with the time
+ *  taken, the residual of the solution, how much the prices moved since the
+ *  last step and their spread over the universe.
+ *
+ *    @param steps Number of steps to run.
+ *    @param file CSV file to write.
+ *    @return 0 on success.
+ */
+int economy_sim( int steps, const char *file )
+{
+   int i, j, s, converged, ret;
+   double *prev, t0, t, total, delta, maxdelta, p, min, max, sum, sum2, mean;
+   FILE *f;
+
+   economy_init();
+   econ_wait();
+   if ((econ_G == NULL) || (econ_nprices == 0)) {
+      WARN("Economy has nothing to simulate.");
+      return -1;
    }
 
-   /* Clean up. */
-   free(X);
-
-   econ_queued = 0;
-   return 0;
+   f = fopen( file, "w" );
+   if (f == NULL) {
+      WARN("Unable to open '%s' for writing.", file);
+      return -1;
+   }
+   prev = malloc( sizeof(double) * systems_nstack * econ_nprices );
+   if (prev == NULL) {
+      WARN("Out of Memory!");
+      fclose( f );
+      return -1;
+   }
+   for (i=0; i<systems_nstack; i++)
+      for (j=0; j<econ_nprices; j++)
+         prev[ j*systems_nstack + i ] = systems_stack[i].prices[j];
+
+   fprintf( f, "step,commodity,step_ms,solve_ms,residual,delta,min,max,mean,stddev\n" );
+   econ_check = 1;
+   converged  = -1;
+   total      = 0.;
+   ret        = 0;
+   for (s=1; s<=steps; s++) {
+      t0 = econ_clock();
+      if (economy_update( ECON_SIM_DT ))
+         ret = -1;
+      econ_wait();
+      t      = econ_clock() - t0;
+      total += t;
+
+      maxdelta = 0.;
+      for (j=0; j<econ_nprices; j++) {
+         delta = 0.;
+         min   = +HUGE_VAL;
+         max   = -HUGE_VAL;
+         sum   = 0.;
+         sum2  = 0.;
+         for (i=0; i<systems_nstack; i++) {
+            p      = systems_stack[i].prices[j];
+            delta  = MAX( delta, fabs( p - prev[ j*systems_nstack + i ] ) );
+            prev[ j*systems_nstack + i ] = p;
+            p     *= commodity_stack[ econ_comm[j] ].price;
+            min    = MIN( min, p );
+            max    = MAX( max, p );
+            sum   += p;
+            sum2  += p*p;
+         }
+         mean     = sum / systems_nstack;
+         maxdelta = MAX( maxdelta, delta );
+         fprintf( f, "%d,%s,%f,%f,%g,%g,%f,%f,%f,%f\n", s,
+               commodity_stack[ econ_comm[j] ].name, t, econ_solveMs,
+               econ_residual, delta, min, max, mean,
+               sqrt( MAX( sum2 / systems_nstack - mean*mean, 0. ) ) );
+      }
+      if ((converged < 0) && (s > 1) && (maxdelta < ECON_SIM_TOL))
+         converged = s;
+   }
+   econ_check = 0;
+   free( prev );
+   fclose( f );
+
+   LOG("Economy: %d steps of %d systems and %d commodities in %.2f ms (%.4f ms per step)",
+         steps, systems_nstack, econ_nprices, total, total / MAX(steps,1));
+   if (converged > 0)
+      LOG("Economy: converged after %d steps, written to '%s'.", converged, file);
+   else
+      LOG("Economy: did not converge, written to '%s'.", file);
+   return ret;
 }
 
 
@@ -727,19 +1152,27 @@ void economy_destroy (void)
    if (!econ_initialized)
       return;
 
+   /* Let the solver finish. */
+   econ_wait();
+
    /* Clean up the prices in the systems stack. */
    for (i=0; i<systems_nstack; i++) {
       if (systems_stack[i].prices != NULL) {
          free(systems_stack[i].prices);
          systems_stack[i].prices = NULL;
       }
+      free(systems_stack[i].comm_prices);
+      systems_stack[i].comm_prices = NULL;
    }
 
    /* Destroy the economy matrix. */
-   if (econ_G != NULL) {
-      cs_spfree( econ_G );
-      econ_G = NULL;
+   econ_freeGMatrix();
+   if (econ_Gnext != NULL) {
+      cs_spfree( econ_Gnext );
+      econ_Gnext = NULL;
    }
+   SDL_DestroySemaphore( econ_done );
+   econ_done = NULL;
 
    /* Economy is now deinitialized. */
    econ_initialized = 0;
@@ -39,6 +39,7 @@ typedef struct Commodity_ {
 /*
  * Commodity stuff.
  */
+Commodity* commodity_getAll( int *n );
 Commodity* commodity_get( const char* name );
 Commodity* commodity_getW( const char* name );
 int commodity_load (void);
@@ -53,7 +54,10 @@ void economy_addQueuedUpdate (void);
 int economy_execQueued (void);
 int economy_update( unsigned int dt );
 int economy_refresh (void);
+void economy_sync (void);
 void economy_destroy (void);
+int economy_benchSolve( int n );
+int economy_sim( int steps, const char *file );
 
 
 /*
@@ -77,6 +77,8 @@ static void equipment_getDim( unsigned int wid, int *w, int *h,
       int *ew, int *eh,
       int *cw, int *ch, int *bw, int *bh );
 static void equipment_genShipList( unsigned int wid );
+static char* equipment_shipAlt( const Pilot *s );
+static void equipment_updateShipAlt( unsigned int wid );
 static void equipment_genOutfitList( unsigned int wid );
 /* Widget. */
 static void equipment_genLists( unsigned int wid );
@@ -422,7 +424,7 @@ static void equipment_renderColumn( double x, double y, double w, double h,
 
       if (lst[i].outfit != NULL) {
          /* Draw bugger. */
-         gl_blitScale( lst[i].outfit->gfx_store,
+         gl_blitScale( gl_deferGet( outfit_gfxStoreDefer( lst[i].outfit ) ),
                x, y, w, h, NULL );
       }
       else if ((o != NULL) &&
@@ -1143,7 +1145,7 @@ static int equipment_swapSlot( unsigned int wid, Pilot *p, PilotOutfitSlot *slot
          pilot_addOutfitRaw( eq_wgt.selected, o, slot );
 
          /* Recalculate stats. */
-         pilot_calcStats( eq_wgt.selected );
+         pilot_calcStatsOutfit( eq_wgt.selected, slot, o, 1 );
       }
 
       equipment_addAmmo();
@@ -1156,8 +1158,8 @@ static int equipment_swapSlot( unsigned int wid, Pilot *p, PilotOutfitSlot *slot
    pilot_calcStats( p );
    pilot_healLanded( p );
 
-   /* Redo the outfits thingy. */
-   equipment_regenLists( wid, 1, 1 );
+   /* Only the selected ship changed, the outfit lists get regenerated below. */
+   equipment_updateShipAlt( wid );
 
    /* Update outfits. */
    outfits_updateEquipmentOutfits();
@@ -1390,14 +1392,13 @@ static void equipment_genLists( unsigned int wid )
  */
 static void equipment_genShipList( unsigned int wid )
 {
-   int i, l;
+   int i;
    char **sships;
    glTexture **tships;
    int nships;
    int w, h;
    int sw, sh;
    char **alt;
-   Pilot *s;
 
    /* Get dimensions. */
    equipment_getDim( wid, &w, &h, &sw, &sh, NULL, NULL,
@@ -1423,21 +1424,52 @@ static void equipment_genShipList( unsigned int wid )
 
       /* Ship stats in alt text. */
       alt   = malloc( sizeof(char*) * nships );
-      for (i=0; i<nships; i++) {
-         s        = player_getShip( sships[i] );
-         alt[i]   = malloc( SHIP_ALT_MAX );
-         l        = nsnprintf( &alt[i][0], SHIP_ALT_MAX, "Ship Stats\n" );
-         l        = equipment_shipStats( &alt[i][l], SHIP_ALT_MAX-l, s, 1 );
-         if (l == 0) {
-            free( alt[i] );
-            alt[i] = NULL;
-         }
-      }
+      for (i=0; i<nships; i++)
+         alt[i] = equipment_shipAlt( player_getShip( sships[i] ) );
       toolkit_setImageArrayAlt( wid, EQUIPMENT_SHIPS, alt );
    }
 }
 
 
+/**
+ * @brief Creates the alt text of a ship in the ship list.
+ *
+ *    @param s Ship to describe.
+ *    @return The alt text or NULL if it has no stats to show.
+ */
+static char* equipment_shipAlt( const Pilot *s )
+{
+   int l;
+   char *alt;
+
+   alt = malloc( SHIP_ALT_MAX );
+   l   = nsnprintf( &alt[0], SHIP_ALT_MAX, "Ship Stats\n" );
+   l   = equipment_shipStats( &alt[l], SHIP_ALT_MAX-l, s, 1 );
+   if (l == 0) {
+      free( alt );
+      alt = NULL;
+   }
+   return alt;
+}
+
+
+/**
+ * @brief Updates the alt text of the selected ship after its outfits change.
+ *
+ * The ships don't change, so the rest of the ship list is kept as is.
+ *
+ *    @param wid Window of the equipment screen.
+ */
+static void equipment_updateShipAlt( unsigned int wid )
+{
+   if (eq_wgt.selected == NULL)
+      return;
+   toolkit_setImageArrayAltElem( wid, EQUIPMENT_SHIPS,
+         toolkit_getImageArrayPos( wid, EQUIPMENT_SHIPS ),
+         equipment_shipAlt( eq_wgt.selected ) );
+}
+
+
 static int equipment_outfitFilterWeapon( const Outfit *o )
 { return ((o->slot.type == OUTFIT_SLOT_WEAPON) && !sp_required( o->slot.spid )); }
 
@@ -1474,6 +1506,7 @@ static void equipment_genOutfitList( unsigned int wid )
    int active, i, l, p, noutfits;
    char **soutfits, **alt, **quantity, **slottype;
    glTexture **toutfits;
+   glTexDefer **defers;
    Outfit *o, **outfits;
    const glColour *c;
    glColour *bg, blend;
@@ -1562,11 +1595,15 @@ static void equipment_genOutfitList( unsigned int wid )
    quantity = malloc( sizeof(char*) * noutfits );
    slottype = malloc( sizeof(char*) * noutfits );
    bg       = malloc( sizeof(glColour) * noutfits );
+   defers   = malloc( sizeof(glTexDefer*) * noutfits );
 
    /* Process all the outfits. */
    for (i=0; i<noutfits; i++) {
       o = outfits[i];
 
+      /* Image to fill in once decoded. */
+      defers[i] = outfit_gfxStoreDefer( o );
+
       /* Background colour. */
       c = outfit_slotSizeColour( &o->slot );
       if (c == NULL)
@@ -1618,6 +1655,7 @@ static void equipment_genOutfitList( unsigned int wid )
    toolkit_setImageArrayQuantity( wid,    EQUIPMENT_OUTFITS, quantity );
    toolkit_setImageArraySlotType( wid,    EQUIPMENT_OUTFITS, slottype );
    toolkit_setImageArrayBackground( wid,  EQUIPMENT_OUTFITS, bg );
+   toolkit_setImageArrayDefer( wid,       EQUIPMENT_OUTFITS, defers );
 }
 
 
@@ -2004,8 +2042,8 @@ static void equipment_unequipShip( unsigned int wid, char* str )
    pilot_calcStats( ship );
    pilot_healLanded( ship );
 
-   /* Regenerate list. */
-   equipment_regenLists( wid, 1, 1 );
+   /* Only the selected ship changed, the outfit lists get regenerated below. */
+   equipment_updateShipAlt( wid );
 
    /* Regenerate outfits. */
    outfits_updateEquipmentOutfits();
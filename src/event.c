@@ -40,6 +40,8 @@
 #include "hook.h"
 #include "player.h"
 #include "npc.h"
+#include "nhash.h"
+#include "array.h"
 
 
 #define XML_EVENT_ID          "Events" /**< XML document identifier */
@@ -61,15 +63,21 @@ typedef struct EventData_s {
 
    EventTrigger_t trigger; /**< What triggers the event. */
    char *cond; /**< Conditional Lua code to execute. */
+   int cond_ref; /**< Compiled conditional, see cond_compile(). */
    double chance; /**< Chance of appearing. */
 } EventData_t;
 
 
+#define EVENT_NTRIGGERS  (EVENT_TRIGGER_LOAD+1) /**< Number of event triggers. */
+
+
 /*
  * Event data.
  */
 static EventData_t *event_data   = NULL; /**< Allocated event data. */
 static int event_ndata           = 0; /**< Number of actual event data. */
+static NameHash event_hash; /**< Event data name to index. */
+static int *event_triggers[EVENT_NTRIGGERS]; /**< Event data ids by trigger. */
 
 
 /*
@@ -87,6 +95,8 @@ static int event_mactive         = 0; /**< Allocated space for active events. */
 static unsigned int event_genID (void);
 static int event_parse( EventData_t *temp, const xmlNodePtr parent );
 static void event_freeData( EventData_t *event );
+static void event_triggersBuild (void);
+static void event_triggersFree (void);
 static int event_create( int dataid, unsigned int *id );
 int events_saveActive( xmlTextWriterPtr writer );
 int events_loadActive( xmlNodePtr parent );;
@@ -397,31 +407,33 @@ int event_alreadyRunning( int data )
  */
 void events_trigger( EventTrigger_t trigger )
 {
-   int i, c;
-   int created;
+   int i, j, c, *list;
 
    /* Events can't be triggered by tutorial. */
    if (player_isTut())
       return;
 
-   created = 0;
-   for (i=0; i<event_ndata; i++) {
-      /* Make sure trigger matches. */
-      if (event_data[i].trigger != trigger)
-         continue;
+   if ((trigger < 0) || (trigger >= EVENT_NTRIGGERS))
+      return;
+   list = event_triggers[trigger];
+   if (list == NULL)
+      return;
 
-      /* Make sure chance is succeeded. */
-      if (RNGF() > event_data[i].chance)
-         continue;
+   for (j=0; j<array_size(list); j++) {
+      i = list[j];
 
-      /* Test uniqueness. */
+      /* Test uniqueness, done events are skipped before rolling. */
       if ((event_data[i].flags & EVENT_FLAG_UNIQUE) &&
             (player_eventAlreadyDone( i ) || event_alreadyRunning(i)))
          continue;
 
+      /* Make sure chance is succeeded. */
+      if (RNGF() > event_data[i].chance)
+         continue;
+
       /* Test conditional. */
       if (event_data[i].cond != NULL) {
-         c = cond_check(event_data[i].cond);
+         c = cond_checkRef(event_data[i].cond_ref);
          if (c<0) {
             WARN("Conditional for event '%s' failed to run.", event_data[i].name);
             continue;
@@ -432,12 +444,7 @@ void events_trigger( EventTrigger_t trigger )
 
       /* Create the event. */
       event_create( i, NULL );
-      created++;
    }
-
-   /* Run claims if necessary. */
-   if (created)
-      claim_activateAll();
 }
 
 
@@ -539,6 +546,8 @@ static int event_parse( EventData_t *temp, const xmlNodePtr parent )
 
    /* Process. */
    temp->chance /= 100.;
+   if (temp->cond != NULL)
+      temp->cond_ref = cond_compile( temp->cond );
 
 #define MELEMENT(o,s) \
    if (o) WARN("Mission '%s' missing/invalid '"s"' element", temp->name)
@@ -558,7 +567,7 @@ static int event_parse( EventData_t *temp, const xmlNodePtr parent )
  */
 int events_load (void)
 {
-   int m;
+   int i, m;
    uint32_t bufsize;
    char *buf;
    xmlNodePtr node;
@@ -611,6 +620,14 @@ int events_load (void)
    /* Shrink to minimum. */
    event_data = realloc(event_data, sizeof(EventData_t)*event_ndata);
 
+   /* Index by name. */
+   nhash_init( &event_hash );
+   for (i=0; i<event_ndata; i++)
+      nhash_set( &event_hash, event_data[i].name, i );
+
+   /* Bucket them by trigger. */
+   event_triggersBuild();
+
    /* Clean up. */
    xmlFreeDoc(doc);
    free(buf);
@@ -630,6 +647,8 @@ static void event_freeData( EventData_t *event )
 {
    free( event->name );
    free( event->lua );
+   if (event->cond != NULL)
+      cond_free( event->cond_ref );
    free( event->cond );
 #if DEBUGGING
    memset( event, 0, sizeof(EventData_t) );
@@ -673,6 +692,43 @@ void events_exit (void)
    }
    event_data  = NULL;
    event_ndata = 0;
+   nhash_free( &event_hash );
+   event_triggersFree();
+}
+
+
+/**
+ * @brief Buckets the event data by trigger, so triggering only looks at
+ *  the events that can run.
+ */
+static void event_triggersBuild (void)
+{
+   int i, t;
+
+   event_triggersFree();
+   for (i=0; i<event_ndata; i++) {
+      t = event_data[i].trigger;
+      if ((t < 0) || (t >= EVENT_NTRIGGERS))
+         continue;
+      if (event_triggers[t] == NULL)
+         event_triggers[t] = array_create( int );
+      array_push_back( &event_triggers[t], i );
+   }
+}
+
+
+/**
+ * @brief Frees the event data buckets.
+ */
+static void event_triggersFree (void)
+{
+   int i;
+
+   for (i=0; i<EVENT_NTRIGGERS; i++) {
+      if (event_triggers[i] != NULL)
+         array_free( event_triggers[i] );
+      event_triggers[i] = NULL;
+   }
 }
 
 
@@ -686,9 +742,9 @@ int event_dataID( const char *evdata )
 {
    int i;
 
-   for (i=0; i<event_ndata; i++)
-      if (strcmp(event_data[i].name, evdata)==0)
-         return i;
+   i = nhash_get( &event_hash, evdata );
+   if (i >= 0)
+      return i;
    WARN("No event data found matching name '%s'.", evdata);
    return -1;
 }
@@ -6,6 +6,17 @@
  * @file explosion.c
  *
  * @brief Handles gigantic explosions.
+ *
+ * Explosion damage is queued and applied all at once by expl_update(), ships
+ *  are looked up in the pilot grid and weapons are handled in a single pass
+ *  per layer for all the queued explosions.
+ *
+ * The graphics are queued too and merged before being spawned. Explosions
+ *  that overlap in the same step, or overlap one spawned during the last
+ *  EXPL_MERGE_TIME seconds, become a single explosion covering all of them.
+ *  Only the area it grew by gets new effects, so a chain of explosions in the
+ *  same spot only adds a few. The effects alive at once are capped by
+ *  EXPL_FX_BUDGET. Damage is never merged.
  */
 
 
@@ -18,12 +29,48 @@
 #include "weapon.h"
 #include "spfx.h"
 #include "rng.h"
+#include "array.h"
+
+
+#define EXPL_FX_AREA       100. /**< Area covered by each small effect. */
+#define EXPL_FX_MAX        64 /**< Most small effects spawned per explosion. */
+#define EXPL_FX_BUDGET     768 /**< Most explosion effects alive at once. */
+#define EXPL_MERGE_TIME    0.25 /**< Seconds a spawned explosion absorbs others for. */
+#define EXPL_MERGE_GROW    2. /**< Most an explosion grows by when absorbing another. */
+
+
+/**
+ * @brief Explosion graphics, pending or recently spawned.
+ */
+typedef struct ExplosionFx_ {
+   double x; /**< X position of the center. */
+   double y; /**< Y position of the center. */
+   double vx; /**< X velocity. */
+   double vy; /**< Y velocity. */
+   double radius; /**< Radius covered. */
+   double timer; /**< Seconds since it was spawned. */
+} ExplosionFx;
 
 
 static int exp_s = -1; /**< Small explosion spfx. */
 static int exp_m = -1; /**< Medium explosion spfx. */
 static int exp_l = -1; /**< Large explosion spfx. */
 
+static ExplosionDamage *expl_queue = NULL; /**< Explosion damage to apply. */
+static unsigned int *expl_hit      = NULL; /**< Pilots an explosion may hit. */
+static ExplosionFx *expl_fx        = NULL; /**< Explosion graphics queued this step. */
+static ExplosionFx *expl_recent    = NULL; /**< Explosion graphics spawned lately. */
+
+
+/*
+ * Prototypes.
+ */
+static void expl_damagePilots( const ExplosionDamage *e );
+static int expl_merge( ExplosionFx *a, const ExplosionFx *b );
+static int expl_fxCount( double radius );
+static void expl_fxSpawn( const ExplosionFx *e, int n );
+static void expl_fxUpdate( double dt );
+
 
 /**
  * @brief Does explosion in a radius (damage and graphics).
@@ -42,69 +89,298 @@ void expl_explode( double x, double y, double vx, double vy,
       double radius, const Damage *dmg,
       const Pilot *parent, int mode )
 {
-   int i, n;
-   double a, d;
-   double area;
-   double ex, ey;
-   int layer;
-   int efx;
+   int i;
+   ExplosionFx e, *f;
 
-   /* Standard stuff - lazy allocation. */
-   if (exp_s == -1) {
-      exp_s = spfx_get("ExpS");
-      exp_m = spfx_get("ExpM");
-      exp_l = spfx_get("ExpL");
+   /* Queue the graphics, merging with those of this step. */
+   e.x      = x;
+   e.y      = y;
+   e.vx     = vx;
+   e.vy     = vy;
+   e.radius = radius;
+   e.timer  = 0.;
+   if (expl_fx == NULL)
+      expl_fx = array_create( ExplosionFx );
+   for (i=0; i<array_size(expl_fx); i++)
+      if (expl_merge( &expl_fx[i], &e ))
+         break;
+   if (i >= array_size(expl_fx)) {
+      f  = &array_grow( &expl_fx );
+      *f = e;
    }
+
+   /* Run the damage. */
+   if (dmg != NULL)
+      expl_explodeDamage( x, y, radius, dmg, parent, mode );
+}
+
+
+/**
+ * @brief Merges an explosion into another if they overlap.
+ *
+ * The result is the smallest circle covering both, it moves with their
+ *  velocities weighted by area.
+ *
+ *    @param a Explosion to merge into.
+ *    @param b Explosion to merge.
+ *    @return 1 if merged, 0 if they are too far apart.
+ */
+static int expl_merge( ExplosionFx *a, const ExplosionFx *b )
+{
+   double dx, dy, d, r, wa, wb;
+
+   dx = b->x - a->x;
+   dy = b->y - a->y;
+   d  = sqrt( pow2(dx) + pow2(dy) );
+   if (d >= a->radius + b->radius)
+      return 0;
+
+   /* Smallest circle covering both. */
+   if (d + b->radius <= a->radius)
+      r = a->radius;
+   else if (d + a->radius <= b->radius)
+      r = b->radius;
+   else
+      r = (d + a->radius + b->radius) / 2.;
+
+   /* Don't let chains merge into a single huge explosion. */
+   if (r > EXPL_MERGE_GROW * MAX( a->radius, b->radius ))
+      return 0;
+
+   wa = pow2( a->radius );
+   wb = pow2( b->radius );
+   a->vx = (a->vx*wa + b->vx*wb) / (wa + wb);
+   a->vy = (a->vy*wa + b->vy*wb) / (wa + wb);
+   if (r == b->radius) {
+      a->x = b->x;
+      a->y = b->y;
+   }
+   else if (r != a->radius) {
+      a->x += dx * (r - a->radius) / d;
+      a->y += dy * (r - a->radius) / d;
+   }
+   a->radius = r;
+   return 1;
+}
+
+
+/**
+ * @brief Gets the small effects an explosion of a radius is made of.
+ */
+static int expl_fxCount( double radius )
+{
+   return (int)(M_PI * pow2(radius) / EXPL_FX_AREA);
+}
+
+
+/**
+ * @brief Spawns the effects of an explosion.
+ *
+ *    @param e Explosion to spawn.
+ *    @param n Small effects to scatter over it, the budget may lower it.
+ */
+static void expl_fxSpawn( const ExplosionFx *e, int n )
+{
+   int i, left, layer, efx;
+   double a, d;
+
    layer = SPFX_LAYER_FRONT;
 
-   /* Number of explosions. */
-   area = M_PI * pow2(radius);
-   n = (int)(area / 100.);
+   /* Keep within the budget. */
+   left = EXPL_FX_BUDGET - spfx_count( exp_s, layer ) -
+         spfx_count( exp_m, layer ) - spfx_count( exp_l, layer );
+   n    = MIN( n, MIN( left, EXPL_FX_MAX ) );
 
    /* Create explosions. */
    for (i=0; i<n; i++) {
       /* Get position. */
       a = RNGF()*360.;
-      d = RNGF()*(radius-5.) + 5.;
-      ex = d*cos(a);
-      ey = d*sin(a);
+      d = RNGF()*(e->radius-5.) + 5.;
 
       /* Create explosion. */
       efx = (RNG(0,2)==0) ? exp_m : exp_s;
-      spfx_add( efx, x+ex, y+ey, vx, vy, layer );
+      spfx_add( efx, e->x + d*cos(a), e->y + d*sin(a), e->vx, e->vy, layer );
    }
+}
 
-   /* Final explosion. */
-   spfx_add( exp_l, x, y, vx, vy, layer );
 
-   /* Run the damage. */
-   if (dmg != NULL)
-      expl_explodeDamage( x, y, radius, dmg, parent, mode );
+/**
+ * @brief Spawns the explosion graphics queued this step.
+ *
+ *    @param dt Duration of the step.
+ */
+static void expl_fxUpdate( double dt )
+{
+   int i, j, n;
+   double r;
+   ExplosionFx *e, *f;
+
+   /* Age the explosions spawned lately, they move with their debris. */
+   if (expl_recent == NULL)
+      expl_recent = array_create( ExplosionFx );
+   for (i=array_size(expl_recent)-1; i>=0; i--) {
+      f = &expl_recent[i];
+      f->timer += dt;
+      if (f->timer > EXPL_MERGE_TIME) {
+         array_erase( &expl_recent, f, f+1 );
+         continue;
+      }
+      f->x += f->vx * dt;
+      f->y += f->vy * dt;
+   }
+
+   if ((expl_fx == NULL) || (array_size(expl_fx) == 0))
+      return;
+
+   /* Standard stuff - lazy allocation. */
+   if (exp_s == -1) {
+      exp_s = spfx_get("ExpS");
+      exp_m = spfx_get("ExpM");
+      exp_l = spfx_get("ExpL");
+   }
+
+   for (i=0; i<array_size(expl_fx); i++) {
+      e = &expl_fx[i];
+
+      /* Absorbed by an explosion on screen, only fill the area it grew by. */
+      for (j=0; j<array_size(expl_recent); j++) {
+         f = &expl_recent[j];
+         r = f->radius;
+         if (expl_merge( f, e ))
+            break;
+      }
+      if (j < array_size(expl_recent)) {
+         n = expl_fxCount( f->radius ) - expl_fxCount( r );
+         spfx_add( exp_m, e->x, e->y, e->vx, e->vy, SPFX_LAYER_FRONT );
+         expl_fxSpawn( f, n );
+         continue;
+      }
+
+      /* A new explosion, the final one is always there. */
+      expl_fxSpawn( e, expl_fxCount( e->radius ) );
+      spfx_add( exp_l, e->x, e->y, e->vx, e->vy, SPFX_LAYER_FRONT );
+      f  = &array_grow( &expl_recent );
+      *f = *e;
+   }
+   array_erase( &expl_fx, array_begin(expl_fx), array_end(expl_fx) );
 }
 
 
 
 /**
- * @brief Does explosion damage in a radius.
+ * @brief Queues explosion damage in a radius.
+ *
+ * The damage is applied on the next expl_update().
  *
  *    @param x X position of explosion center.
  *    @param y Y position of explosion center.
  *    @param radius Radius of the explosion.
- *    @param dtype Damage type.
- *    @param damage Damage amount.
- *    @param penetration Damage penetration [0:1].
- *    @param parent Parent of the explosion, 0 is none.
+ *    @param dmg Damage of the explosion.
+ *    @param parent Parent of the explosion, NULL is none.
  *    @param mode Defines the explosion behaviour.
  */
 void expl_explodeDamage( double x, double y, double radius,
       const Damage *dmg, const Pilot *parent, int mode )
 {
-   /* Explosion affects ships. */
-   if (mode & EXPL_MODE_SHIP)
-      pilot_explode( x, y, radius, dmg, parent );
+   ExplosionDamage *e;
 
-   /* Explosion affects missiles and bolts. */
-   if ((mode & EXPL_MODE_MISSILE) || (mode & EXPL_MODE_BOLT))
-      weapon_explode( x, y, radius, dmg->type, dmg->damage, parent, mode );
+   if (expl_queue == NULL)
+      expl_queue = array_create( ExplosionDamage );
+
+   e         = &array_grow( &expl_queue );
+   e->x      = x;
+   e->y      = y;
+   e->radius = radius;
+   e->dmg    = *dmg;
+   e->parent = (parent != NULL) ? parent->id : 0;
+   e->mode   = mode;
 }
 
+
+/**
+ * @brief Applies an explosion to the pilots near it.
+ */
+static void expl_damagePilots( const ExplosionDamage *e )
+{
+   int i, n;
+   double r;
+   Pilot **list, *p;
+
+   /* Ship size is added to the radius, so widen by the widest ship. */
+   r = e->radius + pilot_gridMaxWidth();
+   n = pilot_gridQueryRect( e->x - r, e->y - r, e->x + r, e->y + r, &list );
+   if (n <= 0)
+      return;
+
+   /* Hits can run Lua which may query the grid again. */
+   if (expl_hit == NULL)
+      expl_hit = array_create( unsigned int );
+   array_resize( &expl_hit, n );
+   for (i=0; i<n; i++)
+      expl_hit[i] = list[i]->id;
+
+   for (i=0; i<n; i++) {
+      p = pilot_get( expl_hit[i] );
+      if (p == NULL)
+         continue;
+      pilot_explodeHit( p, e->x, e->y, e->radius, &e->dmg, e->parent );
+   }
+}
+
+
+/**
+ * @brief Applies all the queued explosion damage.
+ *
+ * Should be called once per update step after the pilots are updated, the
+ *  queued graphics are spawned too.
+ *
+ *    @param dt Duration of the step.
+ */
+void expl_update( double dt )
+{
+   int i, n;
+   ExplosionDamage e;
+
+   expl_fxUpdate( dt );
+
+   if ((expl_queue == NULL) || (array_size(expl_queue) == 0))
+      return;
+
+   /* Explosions affect ships, hits may queue more so work on a copy. */
+   for (i=0; i<array_size(expl_queue); i++) {
+      e = expl_queue[i];
+      if (e.mode & EXPL_MODE_SHIP)
+         expl_damagePilots( &e );
+   }
+
+   /* Explosions affect missiles and bolts. */
+   n = array_size(expl_queue);
+   for (i=0; i<n; i++) {
+      if (expl_queue[i].mode & (EXPL_MODE_MISSILE | EXPL_MODE_BOLT)) {
+         weapon_explode( expl_queue, n );
+         break;
+      }
+   }
+
+   array_erase( &expl_queue, array_begin(expl_queue), array_end(expl_queue) );
+}
+
+
+/**
+ * @brief Frees the explosion queue.
+ */
+void expl_free (void)
+{
+   if (expl_queue != NULL)
+      array_free( expl_queue );
+   expl_queue = NULL;
+   if (expl_hit != NULL)
+      array_free( expl_hit );
+   expl_hit = NULL;
+   if (expl_fx != NULL)
+      array_free( expl_fx );
+   expl_fx = NULL;
+   if (expl_recent != NULL)
+      array_free( expl_recent );
+   expl_recent = NULL;
+}
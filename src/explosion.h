@@ -17,11 +17,26 @@
 #define EXPL_MODE_BOLT     (1<<2) /**< Affects bolts. */
 
 
+/**
+ * @brief Explosion damage waiting to be applied by expl_update().
+ */
+typedef struct ExplosionDamage_ {
+   double x; /**< X position of the explosion center. */
+   double y; /**< Y position of the explosion center. */
+   double radius; /**< Radius of the explosion. */
+   Damage dmg; /**< Damage of the explosion. */
+   unsigned int parent; /**< Parent of the explosion, 0 is none. */
+   int mode; /**< Defines the explosion behaviour. */
+} ExplosionDamage;
+
+
 void expl_explode( double x, double y, double vx, double vy,
       double radius, const Damage *dmg,
       const Pilot *parent, int mode );
 void expl_explodeDamage( double x, double y, double radius,
       const Damage *dmg, const Pilot *parent, int mode );
+void expl_update( double dt );
+void expl_free (void);
 
 
 #endif /* EXPLOSION_H */
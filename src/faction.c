@@ -27,6 +27,8 @@
 #include "colour.h"
 #include "hook.h"
 #include "space.h"
+#include "nhash.h"
+#include "array.h"
 
 
 #define XML_FACTION_ID     "Factions"   /**< XML section identifier */
@@ -44,6 +46,10 @@
 #define faction_isFlag(fa,f)  ((fa)->flags & (f))
 #define faction_isKnown_(fa)   ((fa)->flags & (FACTION_KNOWN))
 
+#define FACTION_REL_ENEMY     (1<<0) /**< Factions are enemies. */
+#define FACTION_REL_ALLY      (1<<1) /**< Factions are allies. */
+#define faction_rel(a,b)      (faction_grid[ (a)*faction_nstack + (b) ]) /**< Relationship of two factions. */
+
 /**
  * @struct Faction
  *
@@ -86,6 +92,20 @@ typedef struct Faction_ {
 
 static Faction* faction_stack = NULL; /**< Faction stack. */
 int faction_nstack = 0; /**< Number of factions in the faction stack. */
+static NameHash faction_hash; /**< Faction name to stack index. */
+static unsigned char *faction_grid = NULL; /**< Dense relationship matrix, see faction_rel. */
+
+
+/**
+ * @brief Standing change waiting to be applied.
+ */
+typedef struct FactionDelta_ {
+   int f; /**< Faction to modify. */
+   int secondary; /**< Whether it comes from an ally or enemy. */
+   const char *source; /**< Source of the change. */
+   double mod; /**< Accumulated amount. */
+} FactionDelta;
+static FactionDelta *faction_pending = NULL; /**< Pending standing changes. */
 
 
 /*
@@ -93,9 +113,13 @@ int faction_nstack = 0; /**< Number of factions in the faction stack. */
  */
 /* static */
 static void faction_sanitizePlayer( Faction* faction );
-static void faction_modPlayerLua( int f, double mod, const char *source, int secondary );
+static int faction_modPlayerLua( int f, double mod, const char *source, int secondary );
+static void faction_queuePlayer( int f, double mod, const char *source, int secondary );
 static int faction_parse( Faction* temp, xmlNodePtr parent );
 static void faction_parseSocial( xmlNodePtr parent );
+static void faction_updateRel( int a, int b );
+static void faction_updatePlayerRel( int f );
+static void faction_buildRel (void);
 /* externed */
 int pfaction_save( xmlTextWriterPtr writer );
 int pfaction_load( xmlNodePtr parent );
@@ -115,14 +139,9 @@ int faction_get( const char* name )
    if (strcmp(name, "Escort") == 0)
       return FACTION_PLAYER;
 
-   if (name != NULL) {
-      for (i=0; i<faction_nstack; i++)
-         if (strcmp(faction_stack[i].name, name)==0)
-            break;
-
-      if (i != faction_nstack)
-         return i;
-   }
+   i = nhash_get( &faction_hash, name );
+   if (i >= 0)
+      return i;
 
    WARN("Faction '%s' not found in stack.", name);
    return -1;
@@ -361,18 +380,16 @@ int* faction_getEnemies( int f, int *n )
       return NULL;
    }
 
-   /* Player's faction ratings can change, so regenerate each call. */
+   /* Player's faction ratings can change, so regenerate each call. The
+    * list is rebuilt in place, realloc keeps it when it's already big enough. */
    if (f == FACTION_PLAYER) {
       nenemies = 0;
-      enemies = malloc(sizeof(int)*faction_nstack);
+      enemies = realloc(faction_stack[f].enemies, sizeof(int)*faction_nstack);
 
       for (i=0; i<faction_nstack; i++)
          if (faction_isPlayerEnemy(i))
             enemies[nenemies++] = i;
 
-      enemies = realloc(enemies, sizeof(int)*nenemies);
-
-      free(faction_stack[f].enemies);
       faction_stack[f].enemies = enemies;
       faction_stack[f].nenemies = nenemies;
    }
@@ -399,18 +416,16 @@ int* faction_getAllies( int f, int *n )
       return NULL;
    }
 
-   /* Player's faction ratings can change, so regenerate each call. */
+   /* Player's faction ratings can change, so regenerate each call. The
+    * list is rebuilt in place, realloc keeps it when it's already big enough. */
    if (f == FACTION_PLAYER) {
       nallies = 0;
-      allies = malloc(sizeof(int)*faction_nstack);
+      allies = realloc(faction_stack[f].allies, sizeof(int)*faction_nstack);
 
       for (i=0; i<faction_nstack; i++)
          if (faction_isPlayerFriend(i))
             allies[nallies++] = i;
 
-      allies = realloc(allies, sizeof(int)*nallies);
-
-      free(faction_stack[f].allies);
       faction_stack[f].allies = allies;
       faction_stack[f].nallies = nallies;
    }
@@ -463,6 +478,8 @@ void faction_addEnemy( int f, int o)
    ff->nenemies++;
    ff->enemies = realloc(ff->enemies, sizeof(int)*ff->nenemies);
    ff->enemies[ff->nenemies-1] = o;
+
+   faction_updateRel( f, o );
 }
 
 
@@ -491,6 +508,7 @@ void faction_rmEnemy( int f, int o)
          ff->enemies[i] = ff->enemies[ff->nenemies-1];
          ff->nenemies--;
          ff->enemies = realloc(ff->enemies, sizeof(int)*ff->nenemies);
+         faction_updateRel( f, o );
          return;
       }
    }
@@ -540,6 +558,8 @@ void faction_addAlly( int f, int o)
    ff->nallies++;
    ff->allies = realloc(ff->allies, sizeof(int)*ff->nallies);
    ff->allies[ff->nallies-1] = o;
+
+   faction_updateRel( f, o );
 }
 
 
@@ -568,6 +588,7 @@ void faction_rmAlly( int f, int o)
          ff->allies[i] = ff->allies[ff->nallies-1];
          ff->nallies--;
          ff->allies = realloc(ff->allies, sizeof(int)*ff->nallies);
+         faction_updateRel( f, o );
          return;
       }
    }
@@ -618,8 +639,10 @@ static void faction_sanitizePlayer( Faction* faction )
 
 /**
  * @brief Mods player using the power of Lua.
+ *
+ *    @return 1 if the standing changed.
  */
-static void faction_modPlayerLua( int f, double mod, const char *source, int secondary )
+static int faction_modPlayerLua( int f, double mod, const char *source, int secondary )
 {
    Faction *faction;
    double old, delta;
@@ -629,7 +652,7 @@ static void faction_modPlayerLua( int f, double mod, const char *source, int sec
 
    /* Make sure it's not static. */
    if (faction_isFlag(faction, FACTION_STATIC))
-      return;
+      return 0;
 
    old   = faction->player;
 
@@ -649,7 +672,7 @@ static void faction_modPlayerLua( int f, double mod, const char *source, int sec
       if (nlua_pcall( faction->env, 4, 1 )) { /* An error occurred. */
          WARN("Faction '%s': %s", faction->name, lua_tostring(naevL,-1));
          lua_pop( naevL, 1 );
-         return;
+         return 0;
       }
 
       /* Parse return. */
@@ -662,20 +685,49 @@ static void faction_modPlayerLua( int f, double mod, const char *source, int sec
 
    /* Sanitize just in case. */
    faction_sanitizePlayer( faction );
+   faction_updatePlayerRel( f );
 
    /* Run hook if necessary. */
    delta = faction->player - old;
-   if (fabs(delta) > 1e-10) {
-      hparam[0].type    = HOOK_PARAM_FACTION;
-      hparam[0].u.lf    = f;
-      hparam[1].type    = HOOK_PARAM_NUMBER;
-      hparam[1].u.num   = delta;
-      hparam[2].type    = HOOK_PARAM_SENTINEL;
-      hooks_runParam( "standing", hparam );
-
-      /* Tell space the faction changed. */
-      space_factionChange();
+   if (fabs(delta) <= 1e-10)
+      return 0;
+
+   hparam[0].type    = HOOK_PARAM_FACTION;
+   hparam[0].u.lf    = f;
+   hparam[1].type    = HOOK_PARAM_NUMBER;
+   hparam[1].u.num   = delta;
+   hparam[2].type    = HOOK_PARAM_SENTINEL;
+   hooks_runParam( "standing", hparam );
+   return 1;
+}
+
+
+/**
+ * @brief Adds a standing change to the pending ones.
+ *
+ * Changes to the same faction from the same source are merged.
+ */
+static void faction_queuePlayer( int f, double mod, const char *source, int secondary )
+{
+   int i;
+   FactionDelta *d;
+
+   if (faction_pending == NULL)
+      faction_pending = array_create( FactionDelta );
+
+   for (i=0; i<array_size(faction_pending); i++) {
+      d = &faction_pending[i];
+      if ((d->f == f) && (d->secondary == secondary) && (strcmp(d->source, source) == 0)) {
+         d->mod += mod;
+         return;
+      }
    }
+
+   d = &array_grow( &faction_pending );
+   d->f         = f;
+   d->secondary = secondary;
+   d->source    = source;
+   d->mod       = mod;
 }
 
 
@@ -689,7 +741,7 @@ static void faction_modPlayerLua( int f, double mod, const char *source, int sec
  */
 void faction_modPlayer( int f, double mod, const char *source )
 {
-   int i;
+   int i, changed;
    Faction *faction;
 
    if (!faction_isFaction(f)) {
@@ -697,19 +749,85 @@ void faction_modPlayer( int f, double mod, const char *source )
       return;
    }
    faction = &faction_stack[f];
+   changed = 0;
 
    /* Modify faction standing with parent faction. */
-   faction_modPlayerLua( f, mod, source, 0 );
+   if (faction_modPlayerLua( f, mod, source, 0 ))
+      changed = 1;
 
    /* Now mod allies to a lesser degree */
    for (i=0; i<faction->nallies; i++)
       /* Modify faction standing */
-      faction_modPlayerLua( faction->allies[i], mod, source, 1 );
+      if (faction_modPlayerLua( faction->allies[i], mod, source, 1 ))
+         changed = 1;
 
    /* Now mod enemies */
    for (i=0; i<faction->nenemies; i++)
       /* Modify faction standing. */
-      faction_modPlayerLua( faction->enemies[i], -mod, source, 1 );
+      if (faction_modPlayerLua( faction->enemies[i], -mod, source, 1 ))
+         changed = 1;
+
+   /* Tell space the faction changed. */
+   if (changed)
+      space_factionChange();
+}
+
+
+/**
+ * @brief Modifies the player's standing with a faction at the end of the frame.
+ *
+ * Works like faction_modPlayer(), but changes are accumulated and applied by
+ *  faction_updatePlayer() with a single run of the faction script for each
+ *  faction and source. Meant for combat where many hits can pile up in a
+ *  single frame.
+ *
+ *    @param f Faction to modify player's standing.
+ *    @param mod Modifier to modify by.
+ *    @param source Source of the change, must not be freed before the update.
+ */
+void faction_modPlayerQueue( int f, double mod, const char *source )
+{
+   int i;
+   Faction *faction;
+
+   if (!faction_isFaction(f)) {
+      WARN("%d is an invalid faction", f);
+      return;
+   }
+   faction = &faction_stack[f];
+
+   faction_queuePlayer( f, mod, source, 0 );
+   for (i=0; i<faction->nallies; i++)
+      faction_queuePlayer( faction->allies[i], mod, source, 1 );
+   for (i=0; i<faction->nenemies; i++)
+      faction_queuePlayer( faction->enemies[i], -mod, source, 1 );
+}
+
+
+/**
+ * @brief Applies the standing changes queued by faction_modPlayerQueue().
+ */
+void faction_updatePlayer (void)
+{
+   int i, n, changed;
+   FactionDelta *d;
+
+   if ((faction_pending == NULL) || (array_size(faction_pending) == 0))
+      return;
+
+   /* Hooks may queue more, only apply what is here now. */
+   n        = array_size(faction_pending);
+   changed  = 0;
+   for (i=0; i<n; i++) {
+      d = &faction_pending[i];
+      if (faction_modPlayerLua( d->f, d->mod, d->source, d->secondary ))
+         changed = 1;
+   }
+   array_erase( &faction_pending, faction_pending, &faction_pending[n] );
+
+   /* Tell space the faction changed. */
+   if (changed)
+      space_factionChange();
 }
 
 /**
@@ -729,7 +847,8 @@ void faction_modPlayerSingle( int f, double mod, const char *source )
       return;
    }
 
-   faction_modPlayerLua( f, mod, source, 0 );
+   if (faction_modPlayerLua( f, mod, source, 0 ))
+      space_factionChange();
 }
 
 
@@ -755,6 +874,8 @@ void faction_modPlayerRaw( int f, double mod )
 
    faction = &faction_stack[f];
    faction->player += mod;
+   faction_sanitizePlayer( faction );
+   faction_updatePlayerRel( f );
    /* Run hook if necessary. */
    hparam[0].type    = HOOK_PARAM_FACTION;
    hparam[0].u.lf    = f;
@@ -763,9 +884,6 @@ void faction_modPlayerRaw( int f, double mod )
    hparam[2].type    = HOOK_PARAM_SENTINEL;
    hooks_runParam( "standing", hparam );
 
-   /* Sanitize just in case. */
-   faction_sanitizePlayer( faction );
-
    /* Tell space the faction changed. */
    space_factionChange();
 }
@@ -791,6 +909,8 @@ void faction_setPlayer( int f, double value )
    faction = &faction_stack[f];
    mod = value - faction->player;
    faction->player = value;
+   faction_sanitizePlayer( faction );
+   faction_updatePlayerRel( f );
    /* Run hook if necessary. */
    hparam[0].type    = HOOK_PARAM_FACTION;
    hparam[0].u.lf    = f;
@@ -799,9 +919,6 @@ void faction_setPlayer( int f, double value )
    hparam[2].type    = HOOK_PARAM_SENTINEL;
    hooks_runParam( "standing", hparam );
 
-   /* Sanitize just in case. */
-   faction_sanitizePlayer( faction );
-
    /* Tell space the faction changed. */
    space_factionChange();
 }
@@ -1076,43 +1193,18 @@ const char *faction_getStandingBroad( int f, int bribed, int override )
  */
 int areEnemies( int a, int b)
 {
-   Faction *fa, *fb;
-   int i;
-
-   if (a==b) return 0; /* luckily our factions aren't masochistic */
-
-   /* handle a */
-   if (faction_isFaction(a))
-      fa = &faction_stack[a];
-   else { /* a is invalid */
+   /* Single unsigned compare catches negative factions too. */
+   if ((unsigned int)a >= (unsigned int)faction_nstack) {
       WARN("areEnemies: %d is an invalid faction", a);
       return 0;
    }
-
-   /* handle b */
-   if (faction_isFaction(b))
-      fb = &faction_stack[b];
-   else { /* b is invalid */
+   if ((unsigned int)b >= (unsigned int)faction_nstack) {
       WARN("areEnemies: %d is an invalid faction", b);
       return 0;
    }
 
-   /* player handled separately */
-   if (a==FACTION_PLAYER) {
-      return faction_isPlayerEnemy(b);
-   }
-   else if (b==FACTION_PLAYER) {
-      return faction_isPlayerEnemy(a);
-   }
-
-   for (i=0;i<fa->nenemies;i++)
-      if (fa->enemies[i] == b)
-         return 1;
-   for (i=0;i<fb->nenemies;i++)
-      if(fb->enemies[i] == a)
-         return 1;
-
-   return 0;
+   /* The diagonal is never set, our factions aren't masochistic. */
+   return (faction_rel(a,b) & FACTION_REL_ENEMY) != 0;
 }
 
 
@@ -1125,44 +1217,112 @@ int areEnemies( int a, int b)
  */
 int areAllies( int a, int b )
 {
-   Faction *fa, *fb;
-   int i;
-
-   /* If they are the same they must be allies. */
-   if (a==b) return 1;
-
-   /* handle a */
-   if (faction_isFaction(a))
-      fa = &faction_stack[a];
-   else { /* a is invalid */
+   if ((unsigned int)a >= (unsigned int)faction_nstack) {
       WARN("%d is an invalid faction", a);
       return 0;
    }
-
-   /* handle b */
-   if (faction_isFaction(b))
-      fb = &faction_stack[b];
-   else { /* b is invalid */
+   if ((unsigned int)b >= (unsigned int)faction_nstack) {
       WARN("%d is an invalid faction", b);
       return 0;
    }
 
-   /* we assume player becomes allies with high rating */
-   if (a==FACTION_PLAYER) {
-      return faction_isPlayerFriend(b);
+   /* The diagonal is always set, factions are their own allies. */
+   return (faction_rel(a,b) & FACTION_REL_ALLY) != 0;
+}
+
+
+/**
+ * @brief Recalculates the relationship between two factions from their lists.
+ *
+ * The matrix is kept symmetric, so either faction listing the other is
+ *  enough.  The player is handled by faction_updatePlayerRel.
+ *
+ *    @param a Faction A.
+ *    @param b Faction B.
+ */
+static void faction_updateRel( int a, int b )
+{
+   Faction *fa, *fb;
+   unsigned char r;
+   int i;
+
+   if ((a == FACTION_PLAYER) || (b == FACTION_PLAYER)) {
+      faction_updatePlayerRel( (a == FACTION_PLAYER) ? b : a );
+      return;
+   }
+
+   fa = &faction_stack[a];
+   fb = &faction_stack[b];
+   r  = 0;
+   if (a == b)
+      r |= FACTION_REL_ALLY;
+   else {
+      for (i=0; i<fa->nenemies; i++)
+         if (fa->enemies[i] == b)
+            r |= FACTION_REL_ENEMY;
+      for (i=0; i<fb->nenemies; i++)
+         if (fb->enemies[i] == a)
+            r |= FACTION_REL_ENEMY;
+      for (i=0; i<fa->nallies; i++)
+         if (fa->allies[i] == b)
+            r |= FACTION_REL_ALLY;
+      for (i=0; i<fb->nallies; i++)
+         if (fb->allies[i] == a)
+            r |= FACTION_REL_ALLY;
    }
-   else if (b==FACTION_PLAYER) {
-      return faction_isPlayerFriend(a);
+
+   faction_rel(a,b) = r;
+   faction_rel(b,a) = r;
+}
+
+
+/**
+ * @brief Recalculates the relationship between the player and a faction.
+ *
+ * Runs the faction's standing scripts, so should be called only when the
+ *  player's standing with the faction changes.
+ *
+ *    @param f Faction to update.
+ */
+static void faction_updatePlayerRel( int f )
+{
+   unsigned char r;
+
+   if (faction_grid == NULL)
+      return;
+
+   if (f == FACTION_PLAYER)
+      r = FACTION_REL_ALLY;
+   else {
+      r = 0;
+      if (faction_isPlayerEnemy(f))
+         r |= FACTION_REL_ENEMY;
+      if (faction_isPlayerFriend(f))
+         r |= FACTION_REL_ALLY;
    }
 
-   for (i=0;i<fa->nallies;i++)
-      if (fa->allies[i] == b)
-         return 1;
-   for (i=0;i<fb->nallies;i++)
-      if(fb->allies[i] == a)
-         return 1;
+   faction_rel(FACTION_PLAYER,f) = r;
+   faction_rel(f,FACTION_PLAYER) = r;
+}
+
 
-   return 0;
+/**
+ * @brief Builds the full relationship matrix.
+ */
+static void faction_buildRel (void)
+{
+   int i, j;
+
+   free( faction_grid );
+   faction_grid = calloc( faction_nstack * faction_nstack, sizeof(unsigned char) );
+
+   for (i=0; i<faction_nstack; i++)
+      for (j=i; j<faction_nstack; j++)
+         if ((i != FACTION_PLAYER) && (j != FACTION_PLAYER))
+            faction_updateRel( i, j );
+
+   for (i=0; i<faction_nstack; i++)
+      faction_updatePlayerRel( i );
 }
 
 
@@ -1320,9 +1480,9 @@ static int faction_parse( Faction* temp, xmlNodePtr parent )
          if (temp->logo_small != NULL)
             WARN("Faction '%s' has duplicate 'logo' tag.", temp->name);
          nsnprintf( buf, PATH_MAX, FACTION_LOGO_PATH"%s_small.png", xml_get(node));
-         temp->logo_small = gl_newImage(buf, 0);
+         temp->logo_small = gl_newImage(buf, OPENGL_TEX_ATLAS);
          nsnprintf( buf, PATH_MAX, FACTION_LOGO_PATH"%s_tiny.png", xml_get(node));
-         temp->logo_tiny = gl_newImage(buf, 0);
+         temp->logo_tiny = gl_newImage(buf, OPENGL_TEX_ATLAS);
          continue;
       }
 
@@ -1421,8 +1581,14 @@ static void faction_parseSocial( xmlNodePtr parent )
 void factions_reset (void)
 {
    int i;
-   for (i=0; i<faction_nstack; i++)
+   for (i=0; i<faction_nstack; i++) {
       faction_stack[i].player = faction_stack[i].player_def;
+      faction_updatePlayerRel( i );
+   }
+
+   /* Pending changes belong to the previous game. */
+   if (faction_pending != NULL)
+      array_erase( &faction_pending, faction_pending, &faction_pending[ array_size(faction_pending) ] );
 }
 
 
@@ -1433,7 +1599,7 @@ void factions_reset (void)
  */
 int factions_load (void)
 {
-   int mem;
+   int i, mem;
    uint32_t bufsize;
    char *buf = ndata_read( FACTION_DATA_PATH, &bufsize);
 
@@ -1481,6 +1647,11 @@ int factions_load (void)
    /* Shrink to minimum size. */
    faction_stack = realloc(faction_stack, sizeof(Faction)*faction_nstack);
 
+   /* Index by name. */
+   nhash_init( &faction_hash );
+   for (i=0; i<faction_nstack; i++)
+      nhash_set( &faction_hash, faction_stack[i].name, i );
+
    /* Second pass - sets allies and enemies */
    node = factions;
    do {
@@ -1488,8 +1659,11 @@ int factions_load (void)
          faction_parseSocial(node);
    } while (xml_nextNode(node));
 
+   /* Cache the relationships. */
+   faction_buildRel();
+
 #ifdef DEBUGGING
-   int i, j, k, r;
+   int j, k, r;
    Faction *f, *sf;
 
    /* Third pass, makes sure allies/enemies are sane. */
@@ -1553,10 +1727,8 @@ void factions_free (void)
          gl_freeTexture(faction_stack[i].logo_small);
       if (faction_stack[i].logo_tiny != NULL)
          gl_freeTexture(faction_stack[i].logo_tiny);
-      if (faction_stack[i].nallies > 0)
-         free(faction_stack[i].allies);
-      if (faction_stack[i].nenemies > 0)
-         free(faction_stack[i].enemies);
+      free(faction_stack[i].allies);
+      free(faction_stack[i].enemies);
       if (faction_stack[i].sched_env != LUA_NOREF)
          nlua_freeEnv( faction_stack[i].sched_env );
       if (faction_stack[i].env != LUA_NOREF)
@@ -1566,7 +1738,14 @@ void factions_free (void)
    }
    free(faction_stack);
    faction_stack = NULL;
+
+   if (faction_pending != NULL)
+      array_free( faction_pending );
+   faction_pending = NULL;
    faction_nstack = 0;
+   nhash_free( &faction_hash );
+   free(faction_grid);
+   faction_grid = NULL;
 }
 
 
@@ -1633,8 +1812,10 @@ int pfaction_load( xmlNodePtr parent )
                      if (xml_isNode(sub,"standing")) {
 
                         /* Must not be static. */
-                        if (!faction_isFlag( &faction_stack[faction], FACTION_STATIC ))
+                        if (!faction_isFlag( &faction_stack[faction], FACTION_STATIC )) {
                            faction_stack[faction].player = xml_getFloat(sub);
+                           faction_updatePlayerRel( faction );
+                        }
                         continue;
                      }
                      if (xml_isNode(sub,"known")) {
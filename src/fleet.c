@@ -92,6 +92,76 @@ unsigned int fleet_createPilot( Fleet *flt, FleetPilot *plt, double dir,
 }
 
 
+/**
+ * @brief Gets the AI a fleet pilot uses.
+ */
+static const char* fleet_pilotAI( const Fleet *flt, const FleetPilot *plt,
+      const char *ai )
+{
+   if (ai != NULL)
+      return ai;
+   return (plt->ai != NULL) ? plt->ai : flt->ai;
+}
+
+
+/**
+ * @brief Creates all the pilots of a fleet.
+ *
+ * Consecutive pilots with the same ship, name and AI are created together
+ *  with pilot_createBatch().
+ *
+ *    @param flt Fleet to create.
+ *    @param dir Direction to face.
+ *    @param pos Position of each pilot of the fleet.
+ *    @param vel Initial velocity.
+ *    @param ai AI to use (NULL is default).
+ *    @param flags Flags to create with.
+ *    @param[out] ids Ids of the pilots created, one per fleet pilot.
+ *
+ * @sa fleet_createPilot
+ */
+void fleet_createPilots( Fleet *flt, double dir, const Vector2d *pos,
+      const Vector2d *vel, const char* ai, PilotFlags flags, unsigned int *ids )
+{
+   int i, j, k;
+   FleetPilot *plt;
+   const char *pai;
+   double *dirs;
+   Vector2d *vels;
+
+   dirs = malloc( MAX(flt->npilots,1) * sizeof(double) );
+   vels = malloc( MAX(flt->npilots,1) * sizeof(Vector2d) );
+   for (i=0; i<flt->npilots; i++) {
+      dirs[i] = dir;
+      vels[i] = *vel;
+   }
+
+   for (i=0; i<flt->npilots; i=j) {
+      plt = &flt->pilots[i];
+      pai = fleet_pilotAI( flt, plt, ai );
+
+      /* Extend the run while the template stays the same. */
+      for (j=i+1; j<flt->npilots; j++) {
+         if ((flt->pilots[j].ship != plt->ship) ||
+               (fleet_pilotAI( flt, &flt->pilots[j], ai ) != pai))
+            break;
+         if ((flt->pilots[j].name != plt->name) && ((plt->name == NULL) ||
+               (flt->pilots[j].name == NULL) ||
+               (strcmp( flt->pilots[j].name, plt->name ) != 0)))
+            break;
+      }
+
+      k = pilot_createBatch( plt->ship, plt->name, flt->faction, pai,
+            j-i, &dirs[i], &pos[i], &vels[i], flags, &ids[i] );
+      if (k < j-i)
+         WARN("Only created %d of %d pilots of fleet '%s'.", k, j-i, flt->name);
+   }
+
+   free( dirs );
+   free( vels );
+}
+
+
 
 /**
  * @brief Parses the fleet node.
@@ -66,6 +66,8 @@ void fleet_free (void);
  */
 unsigned int fleet_createPilot( Fleet *flt, FleetPilot *plt, double dir,
       Vector2d *pos, Vector2d *vel, const char* ai, PilotFlags flags );
+void fleet_createPilots( Fleet *flt, double dir, const Vector2d *pos,
+      const Vector2d *vel, const char* ai, PilotFlags flags, unsigned int *ids );
 
 
 #endif /* FLEET_H */
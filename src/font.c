@@ -15,6 +15,19 @@
  * There are hard-coded size limits.  256 characters for all routines
  * except gl_printText which has a 1024 limit.
  *
+ * Text printed over and over again, which is most of the GUI, gets laid out
+ *  once the second time it's seen into a VBO with a colour per vertex, so it
+ *  renders with a single draw call.  Layouts are keyed by font, string and
+ *  dimensions, and only their colours get updated when printed with another
+ *  colour.
+ *
+ * Text is UTF-8, bytes that aren't part of a valid sequence are taken as
+ *  Latin-1.  The ASCII characters are rendered into an atlas when the font is
+ *  loaded, anything else is rendered the first time it's printed into one of
+ *  a few pages that are recycled least recently used first.  All the quads of
+ *  a string are then drawn from a single buffer update, with a draw call per
+ *  page used.
+ *
  * @todo check if length is too long
  */
 
@@ -29,6 +42,15 @@
 
 #include "log.h"
 #include "ndata.h"
+#include "array.h"
+
+
+#define FONT_LAYOUT_BUCKETS   1024 /**< Hash buckets of the layout cache, power of two. */
+#define FONT_LAYOUT_CACHE     512 /**< Maximum layouts cached. */
+#define FONT_ASCII            128 /**< Characters in the atlas made at load time. */
+#define FONT_PAGES            4 /**< Pages of glyphs rendered on demand per font. */
+#define FONT_PAGE_SIZE        512 /**< Width and height of a page. */
+#define FONT_GLYPH_BUCKETS    256 /**< Hash buckets of glyphs rendered on demand, power of two. */
 
 
 /**
@@ -49,6 +71,101 @@ typedef struct font_char_s {
 } font_char_t;
 
 
+/**
+ * @brief A glyph ready to be drawn.
+ */
+typedef struct FontGlyph_ {
+   struct FontGlyph_ *next; /**< Next in the hash bucket. */
+   uint32_t ch; /**< Character. */
+   int page; /**< Texture with the glyph, 0 is the atlas and -1 nothing to draw. */
+   int adv_x; /**< X advancement. */
+   int adv_y; /**< Y advancement. */
+   GLfloat tex[8]; /**< Texture coordinates of the quad. */
+   GLshort vert[8]; /**< Vertex coordinates of the quad. */
+} FontGlyph;
+
+
+/**
+ * @brief Texture glyphs get rendered into on demand.
+ */
+typedef struct FontPage_ {
+   GLuint texture; /**< Texture, 0 if not created yet. */
+   int x; /**< Horizontal position in the current shelf. */
+   int y; /**< Bottom of the current shelf. */
+   int shelf_h; /**< Height of the current shelf. */
+   unsigned int stamp; /**< Last time a glyph of it was laid out. */
+   unsigned int gen; /**< Incremented every time it's recycled. */
+} FontPage;
+
+
+/**
+ * @brief Glyphs of a font.
+ */
+typedef struct glFontCache_ {
+   FT_Library library; /**< Library of the face. */
+   FT_Face face; /**< Face to render glyphs with. */
+   FT_Byte *buf; /**< Font file the face uses. */
+   FontGlyph ascii[FONT_ASCII]; /**< Glyphs in the atlas. */
+   FontGlyph *hash[FONT_GLYPH_BUCKETS]; /**< Glyphs rendered on demand. */
+   FontPage pages[FONT_PAGES+1]; /**< Pages, 0 is the atlas. */
+} glFontCache;
+
+
+/**
+ * @brief Quads of a layout drawn from the same texture.
+ */
+typedef struct FontRange_ {
+   int page; /**< Page of the quads. */
+   unsigned int gen; /**< Generation of the page when laid out. */
+   int first; /**< First quad. */
+   int n; /**< Number of quads. */
+} FontRange;
+
+
+/**
+ * @brief How a layout was printed.
+ */
+typedef enum FontLayoutMode_ {
+   FONT_LAYOUT_RAW,  /**< gl_printRaw() */
+   FONT_LAYOUT_MAX,  /**< gl_printMaxRaw() */
+   FONT_LAYOUT_MID,  /**< gl_printMidRaw() */
+   FONT_LAYOUT_TEXT  /**< gl_printTextRaw() */
+} FontLayoutMode;
+
+
+/**
+ * @brief A laid out piece of text.
+ *
+ * Made when the text is first seen, the quads are only kept the second
+ *  time so text that changes every frame doesn't fill up VBOs.  Until then
+ *  they are built into the shared stream VBO every time.
+ */
+typedef struct FontLayout_ {
+   struct FontLayout_ *next; /**< Next in the hash bucket. */
+   uint32_t hash; /**< Hash of the key. */
+   const glFont *font; /**< Font it was laid out with. */
+   GLuint texture; /**< Atlas of the font, in case the font gets moved. */
+   FontLayoutMode mode; /**< How it was printed. */
+   int width; /**< Width or maximum it was printed to. */
+   int height; /**< Height it was printed to. */
+   char *text; /**< Text laid out. */
+   unsigned int stamp; /**< Last time it was used. */
+   int ret; /**< Return value of the print function. */
+   double ox; /**< X offset before rounding, for centering. */
+   int built; /**< Whether it has been laid out. */
+   gl_vbo *vbo; /**< Vertex, texture and colour data, NULL if nothing to draw. */
+   int stream; /**< Whether vbo is the shared stream one. */
+   GLuint base; /**< Offset of the data in vbo. */
+   int nquads; /**< Number of characters drawn. */
+   FontRange *ranges; /**< Quads to draw per page. */
+   const glColour **cols; /**< Colour of each quad, see font_layoutColour(). */
+   int has_esc; /**< Whether the text has any colour escape. */
+   const glColour *lastcol; /**< Last escape colour. */
+   glColour col; /**< Colour the VBO colours were built with. */
+   const glColour *init; /**< Initial colour the VBO colours were built with. */
+} FontLayout;
+
+
 /* default font */
 glFont gl_defFont; /**< Default font. */
 glFont gl_smallFont; /**< Small font. */
@@ -60,16 +177,47 @@ static const glColour *font_lastCol    = NULL; /**< Stores last colour used (act
 static int font_restoreLast      = 0; /**< Restore last colour. */
 
 
+/* Layout cache. */
+static const glColour font_colInit = { 1., 1., 1., 1. }; /**< Marks quads using the initial colour. */
+static FontLayout *font_layoutHash[FONT_LAYOUT_BUCKETS]; /**< Layouts by hash. */
+static FontLayout **font_layouts = NULL; /**< All the layouts. */
+static unsigned int font_layoutStamp = 0; /**< Incremented every time a layout is used. */
+static GLfloat *font_layoutScratch = NULL; /**< Colours being uploaded. */
+static int font_layoutMScratch     = 0; /**< Quads the scratch can hold. */
+static unsigned int font_pageStamp = 0; /**< Incremented every time a layout is built or drawn. */
+
+
 /*
  * prototypes
  */
 static int font_limitSize( const glFont *ft_font, int *width,
       const char *text, const int max );
 static const glColour* gl_fontGetColour( int ch );
-/* Render. */
-static void gl_fontRenderStart( const glFont* font, double x, double y, const glColour *c );
-static int gl_fontRenderCharacter( const glFont* font, int ch, const glColour *c, int state );
+/* Glyphs. */
+static uint32_t font_nextChar( const char *text, int *i );
+static const FontGlyph* font_getGlyph( const glFont *ft_font, uint32_t ch );
+static int font_makeChar( font_char_t *c, FT_Face face, uint32_t ch );
+static void font_glyphQuad( FontGlyph *g, const font_char_t *c, int w, int h );
+static int font_pageFit( glFontCache *cache, int w, int h, int *x, int *y );
+static int font_pageRecycle( glFontCache *cache );
 static void gl_fontRenderEnd (void);
+/* Layouts. */
+static uint32_t font_layoutHashKey( const glFont *ft_font, FontLayoutMode mode,
+      int width, int height, const char *text );
+static int font_layoutPrint( const glFont *ft_font, FontLayoutMode mode,
+      int width, int height, double x, double y,
+      const glColour *c, const char *text );
+static void font_layoutBuild( FontLayout *l, int stream );
+static void font_layoutLine( FontLayout *l, GLfloat **data, int *pages,
+      const char *text, int n, int y, const glColour **col, int *state );
+static int font_layoutValid( const FontLayout *l );
+static void font_layoutRender( FontLayout *l, double x, double y,
+      const glColour *c );
+static void font_layoutColour( FontLayout *l, const glColour *c,
+      const glColour *init );
+static void font_layoutClear( FontLayout *l );
+static void font_layoutFree( FontLayout *l );
+static void font_layoutPurge( const glFont *ft_font );
 
 
 /**
@@ -165,7 +313,7 @@ void gl_printStore( glFontRestore *restore, const char *text )
 static int font_limitSize( const glFont *ft_font, int *width,
       const char *text, const int max )
 {
-   int n, i;
+   int n, i, p, adv;
 
    /* Avoid segfaults. */
    if (text == NULL)
@@ -173,18 +321,23 @@ static int font_limitSize( const glFont *ft_font, int *width,
 
    /* limit size */
    n = 0;
-   for (i=0; text[i] != '\0'; i++) {
+   i = 0;
+   while (text[i] != '\0') {
       /* Ignore escape sequence. */
       if (text[i] == '\e') {
          if (text[i+1] != '\0')
             i += 1;
+         i++;
          continue;
       }
 
       /* Count length. */
-      n += ft_font->chars[ (int)text[i] ].adv_x;
+      p   = i;
+      adv = font_getGlyph( ft_font, font_nextChar( text, &i ) )->adv_x;
+      n  += adv;
       if (n > max) {
-         n -= ft_font->chars[ (int)text[i] ].adv_x; /* actual size */
+         n -= adv; /* actual size */
+         i  = p;
          break;
       }
    }
@@ -206,7 +359,7 @@ static int font_limitSize( const glFont *ft_font, int *width,
 int gl_printWidthForText( const glFont *ft_font, const char *text,
       const int width )
 {
-   int i, n, lastspace;
+   int i, n, lastspace, prev, p;
 
    if (ft_font == NULL)
       ft_font = &gl_defFont;
@@ -215,6 +368,7 @@ int gl_printWidthForText( const glFont *ft_font, const char *text,
    lastspace = 0; /* last ' ' or '\n' in the text */
    n = 0; /* current width */
    i = 0; /* current position */
+   prev = -1; /* start of the previous character */
    while ((text[i] != '\n') && (text[i] != '\0')) {
 
       /* Characters we should ignore. */
@@ -232,29 +386,510 @@ int gl_printWidthForText( const glFont *ft_font, const char *text,
          continue;
       }
 
-      /* Increase size. */
-      n += ft_font->chars[ (int)text[i] ].adv_x;
-
       /* Save last space. */
       if (text[i] == ' ')
          lastspace = i;
 
+      /* Increase size. */
+      p  = i;
+      n += font_getGlyph( ft_font, font_nextChar( text, &i ) )->adv_x;
+
       /* Check if out of bounds. */
       if (n > width) {
          if (lastspace > 0)
             return lastspace;
          else
-            return i-1;
+            return prev;
       }
 
       /* Check next character. */
-      i++;
+      prev = p;
    }
 
    return i;
 }
 
 
+/**
+ * @brief Hashes the key of a layout.
+ */
+static uint32_t font_layoutHashKey( const glFont *ft_font, FontLayoutMode mode,
+      int width, int height, const char *text )
+{
+   uint32_t hash;
+   int i;
+
+   /* FNV-1a. */
+   hash = 2166136261u;
+   for (i=0; text[i] != '\0'; i++)
+      hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+   hash ^= (uint32_t)(size_t)ft_font;
+   hash  = (hash ^ (uint32_t)mode) * 16777619u;
+   hash  = (hash ^ (uint32_t)width) * 16777619u;
+   hash  = (hash ^ (uint32_t)height) * 16777619u;
+   return hash;
+}
+
+
+/**
+ * @brief Prints text through the layout cache.
+ *
+ * Parameters are the same as the print function of the mode, with width
+ *  being the maximum for FONT_LAYOUT_MAX.
+ *
+ *    @return Return value of the print function.
+ */
+static int font_layoutPrint( const glFont *ft_font, FontLayoutMode mode,
+      int width, int height, double x, double y,
+      const glColour *c, const char *text )
+{
+   uint32_t hash;
+   FontLayout *l, **pl, tmp;
+   int i, oldest;
+
+   hash = font_layoutHashKey( ft_font, mode, width, height, text );
+   for (l = font_layoutHash[ hash & (FONT_LAYOUT_BUCKETS-1) ]; l != NULL; l = l->next)
+      if ((l->hash == hash) && (l->font == ft_font) &&
+            (l->texture == ft_font->texture) && (l->mode == mode) &&
+            (l->width == width) && (l->height == height) &&
+            (strcmp( l->text, text ) == 0))
+         break;
+
+   /* First time seen, remember it and draw it from the stream VBO. */
+   if (l == NULL) {
+      if (font_layouts == NULL)
+         font_layouts = array_create( FontLayout* );
+
+      /* Make room by dropping the least recently used. */
+      if (array_size(font_layouts) >= FONT_LAYOUT_CACHE) {
+         oldest = 0;
+         for (i=1; i<array_size(font_layouts); i++)
+            if (font_layouts[i]->stamp < font_layouts[oldest]->stamp)
+               oldest = i;
+         font_layoutFree( font_layouts[oldest] );
+         array_erase( &font_layouts, &font_layouts[oldest], &font_layouts[oldest+1] );
+      }
+
+      l           = calloc( 1, sizeof(FontLayout) );
+      l->hash     = hash;
+      l->font     = ft_font;
+      l->texture  = ft_font->texture;
+      l->mode     = mode;
+      l->width    = width;
+      l->height   = height;
+      l->text     = strdup( text );
+      l->stamp    = font_layoutStamp++;
+      pl          = &font_layoutHash[ hash & (FONT_LAYOUT_BUCKETS-1) ];
+      l->next     = *pl;
+      *pl         = l;
+      array_push_back( &font_layouts, l );
+
+      memset( &tmp, 0, sizeof(FontLayout) );
+      tmp.font    = ft_font;
+      tmp.texture = ft_font->texture;
+      tmp.mode    = mode;
+      tmp.width   = width;
+      tmp.height  = height;
+      tmp.text    = l->text;
+      font_layoutBuild( &tmp, 1 );
+      font_layoutRender( &tmp, x, y, c );
+      font_layoutClear( &tmp );
+      return tmp.ret;
+   }
+   l->stamp = font_layoutStamp++;
+
+   /* Glyphs got recycled, lay it out again. */
+   if (l->built && !font_layoutValid( l ))
+      font_layoutClear( l );
+
+   /* Seen before, lay it out. */
+   if (!l->built)
+      font_layoutBuild( l, 0 );
+   font_layoutRender( l, x, y, c );
+   return l->ret;
+}
+
+
+/**
+ * @brief Lays out text the same way its print function renders it.
+ *
+ *    @param l Layout to build.
+ *    @param stream Whether to use the shared stream VBO instead of its own.
+ */
+static void font_layoutBuild( FontLayout *l, int stream )
+{
+   const glFont *ft_font;
+   const char *text;
+   GLfloat *data, *p, *vbo;
+   const glColour *col, **cols;
+   int *pages, count[FONT_PAGES+1];
+   FontRange *r;
+   int i, j, n, k, ret, state, len;
+   double y;
+
+   ft_font = l->font;
+   text    = l->text;
+   len     = strlen(text);
+
+   /* Pages laid out now can't be recycled until the next layout. */
+   font_pageStamp++;
+
+   /* At most a quad per character. */
+   data    = malloc( MAX(1,len) * 4*(2+2) * sizeof(GLfloat) );
+   pages   = malloc( MAX(1,len) * sizeof(int) );
+   cols    = malloc( MAX(1,len) * sizeof(const glColour*) );
+   l->cols = cols;
+   p       = data;
+   col     = (l->mode == FONT_LAYOUT_TEXT) ? NULL : &font_colInit;
+   state   = 0;
+
+   switch (l->mode) {
+      case FONT_LAYOUT_RAW:
+         font_layoutLine( l, &p, pages, text, len, 0, &col, &state );
+         break;
+
+      case FONT_LAYOUT_MAX:
+         l->ret = font_limitSize( ft_font, NULL, text, l->width );
+         font_layoutLine( l, &p, pages, text, l->ret, 0, &col, &state );
+         break;
+
+      case FONT_LAYOUT_MID:
+         l->ret = font_limitSize( ft_font, &n, text, l->width );
+         l->ox  = (double)(l->width - n)/2.;
+         font_layoutLine( l, &p, pages, text, l->ret, 0, &col, &state );
+         break;
+
+      case FONT_LAYOUT_TEXT:
+         /* Lines are placed relative to the first one. */
+         i = 0;
+         k = 0;
+         y = (double)(l->height - ft_font->h);
+         while (y - 1.5*(double)ft_font->h*k > -1e-5) {
+            ret = gl_printWidthForText( ft_font, &text[i], l->width );
+            font_layoutLine( l, &p, pages, &text[i], ret,
+                  -(int)round(1.5*(double)ft_font->h*k), &col, &state );
+            if (text[i+ret] == '\0')
+               break;
+            i += ret;
+            if ((text[i] == '\n') || (text[i] == ' '))
+               i++; /* Skip "empty char". */
+            k++;
+         }
+         l->ret = 0;
+         l->ox  = 0.;
+         break;
+   }
+
+   /* Vertex, texture coordinates and colours, set when rendering. Quads are
+    * grouped by page so each one is a single draw. */
+   l->ranges = array_create( FontRange );
+   if (l->nquads > 0) {
+      n = l->nquads*4;
+      for (j=0; j<FONT_PAGES+1; j++)
+         count[j] = 0;
+      for (i=0; i<l->nquads; i++)
+         count[ pages[i] ]++;
+      for (j=0, k=0; j<FONT_PAGES+1; j++) {
+         if (count[j] == 0)
+            continue;
+         r        = &array_grow( &l->ranges );
+         r->page  = j;
+         r->gen   = ft_font->cache->pages[j].gen;
+         r->first = k;
+         r->n     = 0;
+         k       += count[j];
+      }
+
+      vbo     = calloc( n*(2+2+4), sizeof(GLfloat) );
+      l->cols = malloc( l->nquads * sizeof(const glColour*) );
+      for (i=0; i<l->nquads; i++) {
+         for (j=0; j<array_size(l->ranges); j++)
+            if (l->ranges[j].page == pages[i])
+               break;
+         r = &l->ranges[j];
+         k = r->first + r->n++;
+         memcpy( &vbo[ k*4*2 ], &data[ i*4*2 ], 4*2 * sizeof(GLfloat) );
+         memcpy( &vbo[ n*2 + k*4*2 ], &data[ len*4*2 + i*4*2 ], 4*2 * sizeof(GLfloat) );
+         l->cols[k] = cols[i];
+      }
+
+      if (stream) {
+         l->vbo  = gl_vboStreamReserve( n*(2+2+4) * sizeof(GLfloat) );
+         l->base = gl_vboStreamPush( vbo, n*(2+2+4) * sizeof(GLfloat) );
+      }
+      else {
+         l->vbo  = gl_vboCreateStatic( n*(2+2+4) * sizeof(GLfloat), vbo );
+         l->base = 0;
+      }
+      l->stream = stream;
+      free( vbo );
+      free( cols );
+   }
+   free( pages );
+   free( data );
+   l->built = 1;
+
+   /* Force the colours to be set. */
+   l->init  = &font_colInit;
+}
+
+
+/**
+ * @brief Lays out a line.
+ *
+ *    @param l Layout being built.
+ *    @param[in,out] data Where to write the vertex of the next quad, texture
+ *           coordinates are written at the string length in quads after.
+ *    @param[out] pages Page of each quad.
+ *    @param text Text of the line.
+ *    @param n Bytes to lay out.
+ *    @param y Vertical position of the line.
+ *    @param[in,out] col Current colour.
+ *    @param[in,out] state Escape sequence state.
+ */
+static void font_layoutLine( FontLayout *l, GLfloat **data, int *pages,
+      const char *text, int n, int y, const glColour **col, int *state )
+{
+   int i, j, x, len;
+   uint32_t ch;
+   GLfloat *v, *t;
+   const FontGlyph *g;
+
+   len     = strlen(l->text);
+   x       = 0;
+   i       = 0;
+   while (i<n) {
+      /* Handle escape sequences. */
+      if (text[i] == '\e') {
+         *state = 1;
+         i++;
+         continue;
+      }
+      if (*state == 1) {
+         *col       = gl_fontGetColour( text[i] );
+         l->lastcol = *col;
+         l->has_esc = 1;
+         *state     = 0;
+         i++;
+         continue;
+      }
+
+      ch = font_nextChar( text, &i );
+      g  = font_getGlyph( l->font, ch );
+      if (g->page >= 0) {
+         v = *data;
+         t = &v[ len*4*2 ];
+         for (j=0; j<4; j++) {
+            v[2*j+0] = x + g->vert[ 2*j+0 ];
+            v[2*j+1] = y + g->vert[ 2*j+1 ];
+            t[2*j+0] = g->tex[ 2*j+0 ];
+            t[2*j+1] = g->tex[ 2*j+1 ];
+         }
+         l->font->cache->pages[ g->page ].stamp = font_pageStamp;
+         pages[ l->nquads ]     = g->page;
+         l->cols[ l->nquads++ ] = *col;
+         *data += 4*2;
+      }
+
+      x += g->adv_x;
+   }
+}
+
+
+/**
+ * @brief Checks to see if the pages a layout uses still have its glyphs.
+ */
+static int font_layoutValid( const FontLayout *l )
+{
+   int i;
+   const FontPage *pg;
+
+   for (i=0; i<array_size(l->ranges); i++) {
+      pg = &l->font->cache->pages[ l->ranges[i].page ];
+      if (pg->gen != l->ranges[i].gen)
+         return 0;
+   }
+   return 1;
+}
+
+
+/**
+ * @brief Renders a built layout.
+ *
+ *    @param l Layout to render.
+ *    @param x X position.
+ *    @param y Y position.
+ *    @param c Base colour (NULL is white).
+ */
+static void font_layoutRender( FontLayout *l, double x, double y,
+      const glColour *c )
+{
+   const glColour *init;
+   glFontCache *cache;
+   FontRange *r;
+   int i;
+
+   /* Colour the text starts with. */
+   if (l->mode == FONT_LAYOUT_TEXT)
+      gl_printRestoreClear();
+   init = (font_restoreLast && (font_lastCol != NULL)) ? font_lastCol : NULL;
+   font_restoreLast = 0;
+   font_layoutColour( l, c, init );
+   if (l->has_esc)
+      font_lastCol = l->lastcol;
+
+   if (l->nquads == 0)
+      return;
+
+   /* Render it, a draw per page. */
+   cache = l->font->cache;
+   font_pageStamp++;
+   glEnable(GL_TEXTURE_2D);
+   gl_matrixMode(GL_MODELVIEW);
+   gl_matrixPush();
+      gl_matrixTranslate( round(x + l->ox), round(y) );
+   gl_vboActivateOffset( l->vbo, GL_VERTEX_ARRAY, l->base, 2, GL_FLOAT, 0 );
+   gl_vboActivateOffset( l->vbo, GL_TEXTURE_COORD_ARRAY,
+         l->base + l->nquads*4*2 * sizeof(GLfloat), 2, GL_FLOAT, 0 );
+   gl_vboActivateOffset( l->vbo, GL_COLOR_ARRAY,
+         l->base + l->nquads*4*(2+2) * sizeof(GLfloat), 4, GL_FLOAT, 0 );
+   for (i=0; i<array_size(l->ranges); i++) {
+      r = &l->ranges[i];
+      cache->pages[ r->page ].stamp = font_pageStamp;
+      glBindTexture( GL_TEXTURE_2D, cache->pages[ r->page ].texture );
+      glDrawArrays( GL_QUADS, r->first*4, r->n*4 );
+   }
+   gl_fontRenderEnd();
+}
+
+
+/**
+ * @brief Updates the colours of a layout if needed.
+ *
+ *    @param l Layout to colour.
+ *    @param c Base colour (NULL is white).
+ *    @param init Colour restored at the start (NULL is the base colour).
+ */
+static void font_layoutColour( FontLayout *l, const glColour *c,
+      const glColour *init )
+{
+   int i, j;
+   glColour base;
+   const glColour *col;
+   GLfloat *p;
+
+   if (c == NULL)
+      c = &cWhite;
+   if ((l->init == init) && (memcmp( &l->col, c, sizeof(glColour) ) == 0))
+      return;
+   l->col  = *c;
+   l->init = init;
+   if (l->nquads == 0)
+      return;
+
+   /* Grow scratch memory if needed. */
+   if (l->nquads > font_layoutMScratch) {
+      font_layoutMScratch = l->nquads;
+      font_layoutScratch  = realloc( font_layoutScratch,
+            font_layoutMScratch * 4*4 * sizeof(GLfloat) );
+   }
+
+   /* Escape colours keep the alpha of the base. */
+   for (i=0; i<l->nquads; i++) {
+      col = l->cols[i];
+      if (col == &font_colInit)
+         col = init;
+      if (col == NULL)
+         base = *c;
+      else {
+         base   = *col;
+         base.a = c->a;
+      }
+      p = &font_layoutScratch[ i*4*4 ];
+      for (j=0; j<4; j++) {
+         p[4*j+0] = base.r;
+         p[4*j+1] = base.g;
+         p[4*j+2] = base.b;
+         p[4*j+3] = base.a;
+      }
+   }
+   gl_vboSubData( l->vbo, l->base + l->nquads*4*(2+2) * sizeof(GLfloat),
+         l->nquads*4*4 * sizeof(GLfloat), font_layoutScratch );
+}
+
+
+/**
+ * @brief Frees what was laid out of a layout.
+ */
+static void font_layoutClear( FontLayout *l )
+{
+   if ((l->vbo != NULL) && !l->stream)
+      gl_vboDestroy( l->vbo );
+   l->vbo    = NULL;
+   l->stream = 0;
+   l->base   = 0;
+   free( l->cols );
+   l->cols   = NULL;
+   if (l->ranges != NULL)
+      array_free( l->ranges );
+   l->ranges  = NULL;
+   l->nquads  = 0;
+   l->has_esc = 0;
+   l->built   = 0;
+}
+
+
+/**
+ * @brief Frees a layout, unlinking it from its bucket.
+ */
+static void font_layoutFree( FontLayout *l )
+{
+   FontLayout **pl;
+
+   for (pl = &font_layoutHash[ l->hash & (FONT_LAYOUT_BUCKETS-1) ]; *pl != NULL; pl = &(*pl)->next) {
+      if (*pl == l) {
+         *pl = l->next;
+         break;
+      }
+   }
+
+   font_layoutClear( l );
+   free( l->text );
+   free( l );
+}
+
+
+/**
+ * @brief Frees the layouts of a font.
+ *
+ *    @param ft_font Font being freed.
+ */
+static void font_layoutPurge( const glFont *ft_font )
+{
+   int i;
+
+   if (font_layouts == NULL)
+      return;
+
+   for (i=array_size(font_layouts)-1; i>=0; i--) {
+      if ((font_layouts[i]->font != ft_font) &&
+            (font_layouts[i]->texture != ft_font->texture))
+         continue;
+      font_layoutFree( font_layouts[i] );
+      array_erase( &font_layouts, &font_layouts[i], &font_layouts[i+1] );
+   }
+
+   /* Last font gone. */
+   if (array_size(font_layouts) == 0) {
+      array_free( font_layouts );
+      font_layouts = NULL;
+      free( font_layoutScratch );
+      font_layoutScratch  = NULL;
+      font_layoutMScratch = 0;
+   }
+}
+
+
 /**
  * @brief Prints text on screen.
  *
@@ -270,17 +905,10 @@ void gl_printRaw( const glFont *ft_font,
       const double x, const double y,
       const glColour* c, const char *text )
 {
-   int i, s;
-
    if (ft_font == NULL)
       ft_font = &gl_defFont;
 
-   /* Render it. */
-   s = 0;
-   gl_fontRenderStart(ft_font, x, y, c);
-   for (i=0; text[i] != '\0'; i++)
-      s = gl_fontRenderCharacter( ft_font, text[i], c, s );
-   gl_fontRenderEnd();
+   font_layoutPrint( ft_font, FONT_LAYOUT_RAW, 0, 0, x, y, c, text );
 }
 
 
@@ -329,22 +957,10 @@ int gl_printMaxRaw( const glFont *ft_font, const int max,
       const double x, const double y,
       const glColour* c, const char *text )
 {
-   int ret, i, s;
-
    if (ft_font == NULL)
       ft_font = &gl_defFont;
 
-   /* Limit size. */
-   ret = font_limitSize( ft_font, NULL, text, max );
-
-   /* Render it. */
-   s = 0;
-   gl_fontRenderStart(ft_font, x, y, c);
-   for (i=0; i < ret; i++)
-      s = gl_fontRenderCharacter( ft_font, text[i], c, s );
-   gl_fontRenderEnd();
-
-   return ret;
+   return font_layoutPrint( ft_font, FONT_LAYOUT_MAX, max, 0, x, y, c, text );
 }
 /**
  * @brief Behaves like gl_print but stops displaying text after reaching a certain length.
@@ -393,24 +1009,10 @@ int gl_printMidRaw( const glFont *ft_font, const int width,
       double x, const double y,
       const glColour* c, const char *text )
 {
-   /*float h = ft_font->h / .63;*/ /* slightly increase fontsize */
-   int n, ret, i, s;
-
    if (ft_font == NULL)
       ft_font = &gl_defFont;
 
-   /* limit size */
-   ret = font_limitSize( ft_font, &n, text, width );
-   x += (double)(width - n)/2.;
-
-   /* Render it. */
-   s = 0;
-   gl_fontRenderStart(ft_font, x, y, c);
-   for (i=0; i < ret; i++)
-      s = gl_fontRenderCharacter( ft_font, text[i], c, s );
-   gl_fontRenderEnd();
-
-   return ret;
+   return font_layoutPrint( ft_font, FONT_LAYOUT_MID, width, 0, x, y, c, text );
 }
 /**
  * @brief Displays text centered in position and width.
@@ -464,7 +1066,6 @@ int gl_printTextRaw( const glFont *ft_font,
       double bx, double by,
       const glColour* c, const char *text )
 {
-   int ret, i, p, s;
    double x,y;
 
    if (ft_font == NULL)
@@ -473,32 +1074,8 @@ int gl_printTextRaw( const glFont *ft_font,
    x = bx;
    y = by + height - (double)ft_font->h; /* y is top left corner */
 
-   /* Clears restoration. */
-   gl_printRestoreClear();
-
-   s = 0;
-   p = 0; /* where we last drew up to */
-   while (y - by > -1e-5) {
-      ret = gl_printWidthForText( ft_font, &text[p], width );
-
-      /* Must restore stuff. */
-      gl_printRestoreLast();
-
-      /* Render it. */
-      gl_fontRenderStart(ft_font, x, y, c);
-      for (i=0; i < ret; i++)
-         s = gl_fontRenderCharacter( ft_font, text[p+i], c, s );
-      gl_fontRenderEnd();
-
-      if (text[p+i] == '\0')
-         break;
-      p += i;
-      if ((text[p] == '\n') || (text[p] == ' '))
-         p++; /* Skip "empty char". */
-      y -= 1.5*(double)ft_font->h; /* move position down */
-   }
-
-
+   /* Lines are laid out from the top one. */
+   font_layoutPrint( ft_font, FONT_LAYOUT_TEXT, width, height, x, y, c, text );
    return 0;
 }
 
@@ -554,17 +1131,19 @@ int gl_printWidthRaw( const glFont *ft_font, const char *text )
    if (ft_font == NULL)
       ft_font = &gl_defFont;
 
-   for (n=0,i=0; i<(int)strlen(text); i++) {
+   n = 0;
+   i = 0;
+   while (text[i] != '\0') {
       /* Ignore escape sequence. */
       if (text[i] == '\e') {
          if (text[i+1] != '\0')
             i++;
-
+         i++;
          continue;
       }
 
       /* Increment width. */
-      n += ft_font->chars[ (int)text[i] ].adv_x;
+      n += font_getGlyph( ft_font, font_nextChar( text, &i ) )->adv_x;
    }
 
    return n;
@@ -664,7 +1243,7 @@ int gl_printHeight( const glFont *ft_font,
  */
 /**
  */
-static int font_makeChar( font_char_t *c, FT_Face face, char ch )
+static int font_makeChar( font_char_t *c, FT_Face face, uint32_t ch )
 {
    FT_Bitmap bitmap;
    FT_GlyphSlot slot;
@@ -697,28 +1276,313 @@ static int font_makeChar( font_char_t *c, FT_Face face, char ch )
 }
 
 
+/**
+ * @brief Sets the quad of a glyph from where it was put in its texture.
+ *
+ *    @param g Glyph to set.
+ *    @param c Rendered character with its texture position.
+ *    @param w Width of the texture.
+ *    @param h Height of the texture.
+ */
+static void font_glyphQuad( FontGlyph *g, const font_char_t *c, int w, int h )
+{
+   GLfloat tx, ty, txw, tyh;
+   GLshort vx, vy, vw, vh;
+
+   /* We do something like the following for vertex coordinates.
+    *
+    *
+    *  +----------------- top reference   \  <------- font->h
+    *  |                                  |
+    *  |                                  | --- off_y
+    *  +----------------- glyph top       /
+    *  |
+    *  |
+    *  +----------------- glyph bottom
+    *  |
+    *  v   y
+    *
+    *
+    *  +----+------------->  x
+    *  |    |
+    *  |    glyph start
+    *  |
+    *  side reference
+    *
+    *  \----/
+    *   off_x
+    */
+   tx  = (GLfloat)c->tx / (GLfloat)w;
+   ty  = (GLfloat)c->ty / (GLfloat)h;
+   txw = (GLfloat)(c->tx + c->tw) / (GLfloat)w;
+   tyh = (GLfloat)(c->ty + c->th) / (GLfloat)h;
+   vx  = c->off_x;
+   vy  = c->off_y - c->h;
+   vw  = c->w;
+   vh  = c->h;
+   /* Texture coords. */
+   g->tex[0]  = tx;  /* Top left. */
+   g->tex[1]  = ty;
+   g->tex[2]  = txw; /* Top right. */
+   g->tex[3]  = ty;
+   g->tex[4]  = txw; /* Bottom right. */
+   g->tex[5]  = tyh;
+   g->tex[6]  = tx;  /* Bottom left. */
+   g->tex[7]  = tyh;
+   /* Vertex coords. */
+   g->vert[0] = vx;    /* Top left. */
+   g->vert[1] = vy+vh;
+   g->vert[2] = vx+vw; /* Top right. */
+   g->vert[3] = vy+vh;
+   g->vert[4] = vx+vw; /* Bottom right. */
+   g->vert[5] = vy;
+   g->vert[6] = vx;    /* Bottom left. */
+   g->vert[7] = vy;
+}
+
+
+/**
+ * @brief Decodes the next character of UTF-8 text.
+ *
+ * Bytes that don't start a valid sequence are returned as is, which reads
+ *  Latin-1 text right.
+ *
+ *    @param text Text to decode.
+ *    @param[in,out] i Position in text, moved past the character.
+ *    @return The character.
+ */
+static uint32_t font_nextChar( const char *text, int *i )
+{
+   const unsigned char *t;
+   uint32_t ch;
+   int n, j;
+
+   t = (const unsigned char*) &text[*i];
+   if (t[0] < 0x80) {
+      (*i)++;
+      return t[0];
+   }
+
+   if ((t[0] & 0xE0) == 0xC0) {
+      n  = 1;
+      ch = t[0] & 0x1F;
+   }
+   else if ((t[0] & 0xF0) == 0xE0) {
+      n  = 2;
+      ch = t[0] & 0x0F;
+   }
+   else if ((t[0] & 0xF8) == 0xF0) {
+      n  = 3;
+      ch = t[0] & 0x07;
+   }
+   else {
+      (*i)++;
+      return t[0];
+   }
+
+   for (j=1; j<=n; j++) {
+      if ((t[j] & 0xC0) != 0x80) {
+         (*i)++;
+         return t[0];
+      }
+      ch = (ch << 6) | (t[j] & 0x3F);
+   }
+   (*i) += n+1;
+   return ch;
+}
+
+
+/**
+ * @brief Finds room for a glyph on the shelves of the current page.
+ *
+ *    @return Page it fits in or -1.
+ */
+static int font_pageFit( glFontCache *cache, int w, int h, int *x, int *y )
+{
+   int i;
+   FontPage *pg;
+
+   for (i=1; i<FONT_PAGES+1; i++) {
+      pg = &cache->pages[i];
+      if (pg->texture == 0)
+         continue;
+
+      /* Next shelf. */
+      if (pg->x + w > FONT_PAGE_SIZE) {
+         pg->y      += pg->shelf_h;
+         pg->x       = 0;
+         pg->shelf_h = 0;
+      }
+      if (pg->y + h > FONT_PAGE_SIZE)
+         continue;
+
+      *x           = pg->x;
+      *y           = pg->y;
+      pg->x       += w;
+      pg->shelf_h  = MAX( pg->shelf_h, h );
+      return i;
+   }
+   return -1;
+}
+
+
+/**
+ * @brief Gets an empty page, recycling the least recently used if needed.
+ *
+ * Pages used by the layout being built are kept.
+ *
+ *    @return Page or -1 if they are all in use.
+ */
+static int font_pageRecycle( glFontCache *cache )
+{
+   int i, oldest;
+   FontPage *pg;
+   FontGlyph **pg_glyph, *g;
+   GLubyte *data;
+
+   /* Create a page first. */
+   oldest = -1;
+   for (i=1; i<FONT_PAGES+1; i++) {
+      pg = &cache->pages[i];
+      if (pg->texture == 0) {
+         data = calloc( FONT_PAGE_SIZE*FONT_PAGE_SIZE*2, 1 );
+         glGenTextures( 1, &pg->texture );
+         glBindTexture( GL_TEXTURE_2D, pg->texture );
+         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+         glTexImage2D( GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA,
+               FONT_PAGE_SIZE, FONT_PAGE_SIZE, 0,
+               GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, data );
+         free( data );
+         gl_checkErr();
+         return i;
+      }
+      if (pg->stamp == font_pageStamp)
+         continue;
+      if ((oldest < 0) || (pg->stamp < cache->pages[oldest].stamp))
+         oldest = i;
+   }
+   if (oldest < 0)
+      return -1;
+
+   /* Drop its glyphs, layouts using it see the new generation. */
+   for (i=0; i<FONT_GLYPH_BUCKETS; i++) {
+      pg_glyph = &cache->hash[i];
+      while (*pg_glyph != NULL) {
+         g = *pg_glyph;
+         if (g->page == oldest) {
+            *pg_glyph = g->next;
+            free( g );
+         }
+         else
+            pg_glyph = &g->next;
+      }
+   }
+   pg          = &cache->pages[oldest];
+   pg->x       = 0;
+   pg->y       = 0;
+   pg->shelf_h = 0;
+   pg->gen++;
+   return oldest;
+}
+
+
+/**
+ * @brief Gets a glyph, rendering it if it's not in the atlas or a page.
+ *
+ *    @param ft_font Font to get the glyph of.
+ *    @param ch Character to get.
+ *    @return The glyph, never NULL.
+ */
+static const FontGlyph* font_getGlyph( const glFont *ft_font, uint32_t ch )
+{
+   glFontCache *cache;
+   FontGlyph *g;
+   font_char_t c;
+   GLubyte *data;
+   int i, p, x, y;
+
+   cache = ft_font->cache;
+   if (ch < FONT_ASCII)
+      return &cache->ascii[ch];
+
+   for (g = cache->hash[ ch & (FONT_GLYPH_BUCKETS-1) ]; g != NULL; g = g->next)
+      if (g->ch == ch)
+         return g;
+
+   /* Render it. */
+   g     = calloc( 1, sizeof(FontGlyph) );
+   g->ch = ch;
+   if (font_makeChar( &c, cache->face, ch )) {
+      g->page = -1;
+      g->adv_x = cache->ascii['?'].adv_x;
+   }
+   else {
+      g->adv_x = c.adv_x;
+      g->adv_y = c.adv_y;
+      g->page  = -1;
+      if ((c.w > 0) && (c.h > 0) &&
+            (c.w <= FONT_PAGE_SIZE) && (c.h <= FONT_PAGE_SIZE)) {
+         p = font_pageFit( cache, c.w, c.h, &x, &y );
+         if (p < 0) {
+            p = font_pageRecycle( cache );
+            if (p >= 0)
+               p = font_pageFit( cache, c.w, c.h, &x, &y );
+         }
+         if (p >= 0) {
+            /* Same layout as the atlas. */
+            data = malloc( c.w*c.h*2 );
+            for (i=0; i<c.w*c.h; i++) {
+               data[2*i]   = 0xcf; /* Constant luminance. */
+               data[2*i+1] = c.data[i];
+            }
+            glBindTexture( GL_TEXTURE_2D, cache->pages[p].texture );
+            glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+            glTexSubImage2D( GL_TEXTURE_2D, 0, x, y, c.w, c.h,
+                  GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, data );
+            glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+            free( data );
+            gl_checkErr();
+
+            c.tx    = x;
+            c.ty    = y;
+            c.tw    = c.w;
+            c.th    = c.h;
+            g->page = p;
+            font_glyphQuad( g, &c, FONT_PAGE_SIZE, FONT_PAGE_SIZE );
+         }
+         else
+            WARN("No room left for glyph U+%04X, too many different characters at once.", ch);
+      }
+      free( c.data );
+   }
+
+   g->next = cache->hash[ ch & (FONT_GLYPH_BUCKETS-1) ];
+   cache->hash[ ch & (FONT_GLYPH_BUCKETS-1) ] = g;
+   return g;
+}
+
+
 /**
  * @brief Generates the font's texture atlas.
  */
 static int font_genTextureAtlas( glFont* font, FT_Face face )
 {
-   font_char_t chars[128];
+   font_char_t chars[FONT_ASCII];
    int i, n;
    int x, y, x_off, y_off;
    int total_w;
    int w, h, max_h;
    int offset;
    GLubyte *data;
-   GLfloat *vbo_tex;
-   GLshort *vbo_vert;
-   GLfloat tx, ty, txw, tyh;
-   GLfloat fw, fh;
-   GLshort vx, vy, vw, vh;
+   FontGlyph *g;
 
    /* Render characters into software. */
    total_w  = 0;
    max_h    = 0;
-   for (i=0; i<128; i++) {
+   for (i=0; i<FONT_ASCII; i++) {
       font_makeChar( &chars[i], face, i );
       total_w += chars[i].w;
       if (chars[i].h > max_h)
@@ -743,7 +1607,7 @@ static int font_genTextureAtlas( glFont* font, FT_Face face )
    /* Test fit - formula isn't perfect. */
    x_off = 0;
    y_off = 0;
-   for (i=0; i<128; i++) {
+   for (i=0; i<FONT_ASCII; i++) {
       if (x_off + chars[i].w >= w) {
          x_off  = 0;
          y_off += max_h;
@@ -766,7 +1630,7 @@ static int font_genTextureAtlas( glFont* font, FT_Face face )
    data  = calloc( w*h*2, 1 );
    x_off = 0;
    y_off = 0;
-   for (i=0; i<128; i++) {
+   for (i=0; i<FONT_ASCII; i++) {
       /* Check if need to skip to newline. */
       if (x_off + chars[i].w >= w) {
          x_off  = 0;
@@ -786,10 +1650,6 @@ static int font_genTextureAtlas( glFont* font, FT_Face face )
          }
       }
 
-      /* Store character information. */
-      font->chars[i].adv_x = chars[i].adv_x;
-      font->chars[i].adv_y = chars[i].adv_y;
-
       /* Store temporary information. */
       chars[i].tx = x_off;
       chars[i].ty = y_off;
@@ -822,111 +1682,24 @@ static int font_genTextureAtlas( glFont* font, FT_Face face )
    /* Check for errors. */
    gl_checkErr();
 
-   /* Create the VBOs. */
-   n           = 8 * 128;
-   vbo_tex     = malloc(sizeof(GLfloat) * n);
-   vbo_vert    = malloc(sizeof(GLshort) * n);
-   for (i=0; i<128; i++) {
-      /* We do something like the following for vertex coordinates.
-       *
-       *
-       *  +----------------- top reference   \  <------- font->h
-       *  |                                  |
-       *  |                                  | --- off_y
-       *  +----------------- glyph top       /
-       *  |
-       *  |
-       *  +----------------- glyph bottom
-       *  |
-       *  v   y
-       *
-       *
-       *  +----+------------->  x
-       *  |    |
-       *  |    glyph start
-       *  |
-       *  side reference
-       *
-       *  \----/
-       *   off_x
-       */
-      /* Temporary variables. */
-      fw  = (GLfloat) w;
-      fh  = (GLfloat) h;
-      tx  = (GLfloat)chars[i].tx / fw;
-      ty  = (GLfloat)chars[i].ty / fh;
-      txw = (GLfloat)(chars[i].tx + chars[i].tw) / fw;
-      tyh = (GLfloat)(chars[i].ty + chars[i].th) / fh;
-      vx  = chars[i].off_x;
-      vy  = chars[i].off_y - chars[i].h;
-      vw  = chars[i].w;
-      vh  = chars[i].h;
-      /* Texture coords. */
-      vbo_tex[  8*i + 0 ] = tx;  /* Top left. */
-      vbo_tex[  8*i + 1 ] = ty;
-      vbo_tex[  8*i + 2 ] = txw; /* Top right. */
-      vbo_tex[  8*i + 3 ] = ty;
-      vbo_tex[  8*i + 4 ] = txw; /* Bottom right. */
-      vbo_tex[  8*i + 5 ] = tyh;
-      vbo_tex[  8*i + 6 ] = tx;  /* Bottom left. */
-      vbo_tex[  8*i + 7 ] = tyh;
-      /* Vertex coords. */
-      vbo_vert[ 8*i + 0 ] = vx;    /* Top left. */
-      vbo_vert[ 8*i + 1 ] = vy+vh;
-      vbo_vert[ 8*i + 2 ] = vx+vw; /* Top right. */
-      vbo_vert[ 8*i + 3 ] = vy+vh;
-      vbo_vert[ 8*i + 4 ] = vx+vw; /* Bottom right. */
-      vbo_vert[ 8*i + 5 ] = vy;
-      vbo_vert[ 8*i + 6 ] = vx;    /* Bottom left. */
-      vbo_vert[ 8*i + 7 ] = vy;
+   /* Keep the quads for the layouts. */
+   for (i=0; i<FONT_ASCII; i++) {
+      g        = &font->cache->ascii[i];
+      g->ch    = i;
+      g->page  = isspace(i) ? -1 : 0;
+      g->adv_x = chars[i].adv_x;
+      g->adv_y = chars[i].adv_y;
+      font_glyphQuad( g, &chars[i], w, h );
    }
-   font->vbo_tex  = gl_vboCreateStatic( sizeof(GLfloat)*n, vbo_tex );
-   font->vbo_vert = gl_vboCreateStatic( sizeof(GLshort)*n, vbo_vert );
+   font->cache->pages[0].texture = font->texture;
 
    /* Free the data. */
    free(data);
-   free(vbo_tex);
-   free(vbo_vert);
 
    return 0;
 }
 
 
-/**
- * @brief Starts the rendering engine.
- */
-static void gl_fontRenderStart( const glFont* font, double x, double y, const glColour *c )
-{
-   double a;
-
-   /* Enable textures. */
-   glEnable(GL_TEXTURE_2D);
-   glBindTexture( GL_TEXTURE_2D, font->texture);
-
-   /* Set up matrix. */
-   gl_matrixMode(GL_MODELVIEW);
-   gl_matrixPush();
-      gl_matrixTranslate( round(x), round(y) );
-
-   /* Handle colour. */
-   if (font_restoreLast) {
-      a   = (c==NULL) ? 1. : c->a;
-      ACOLOUR(*font_lastCol,a);
-   }
-   else {
-      if (c==NULL)
-         glColor4d( 1., 1., 1., 1. );
-      else
-         COLOUR(*c);
-   }
-   font_restoreLast = 0;
-
-   /* Activate the appropriate VBOs. */
-   gl_vboActivateOffset( font->vbo_tex,  GL_TEXTURE_COORD_ARRAY, 0, 2, GL_FLOAT, 0 );
-   gl_vboActivateOffset( font->vbo_vert, GL_VERTEX_ARRAY, 0, 2, GL_SHORT, 0 );
-}
-
-
 /**
  * @brief Gets the colour from a character.
  */
@@ -966,59 +1739,6 @@ static const glColour* gl_fontGetColour( int ch )
 }
 
 
-/**
- * @brief Renders a character.
- */
-static int gl_fontRenderCharacter( const glFont* font, int ch, const glColour *c, int state )
-{
-   GLushort ind[6];
-   double a;
-   const glColour *col;
-
-   /* Handle escape sequences. */
-   if (ch == '\e') /* Start sequence. */
-      return 1;
-   if (state == 1) {
-      col = gl_fontGetColour( ch );
-      a   = (c==NULL) ? 1. : c->a;
-      if (col == NULL) {
-         if (c==NULL)
-            glColor4d( 1., 1., 1., 1. );
-         else
-            COLOUR(*c);
-      }
-      else
-         ACOLOUR(*col,a);
-      font_lastCol = col;
-      return 0;
-   }
-
-   if (!isspace(ch)) {
-      /*
-       * Global  Local
-       * 0--1      0--1 4
-       * | /|  =>  | / /|
-       * |/ |      |/ / |
-       * 3--2      2 3--5
-       */
-      ind[0] = 4*ch + 0;
-      ind[1] = 4*ch + 1;
-      ind[2] = 4*ch + 3;
-      ind[3] = 4*ch + 1;
-      ind[4] = 4*ch + 3;
-      ind[5] = 4*ch + 2;
-
-      /* Draw the element. */
-      glDrawElements( GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, ind );
-   }
-
-   /* Translate matrix. */
-   gl_matrixTranslate( font->chars[ch].adv_x, font->chars[ch].adv_y );
-
-   return 0;
-}
-
-
 /**
  * @brief Ends the rendering engine.
  */
@@ -1060,9 +1780,9 @@ void gl_fontInit( glFont* font, const char *fname, const unsigned int h )
    }
 
    /* Allocage. */
-   font->chars = malloc(sizeof(glFontChar)*128);
+   font->cache = calloc( 1, sizeof(glFontCache) );
    font->h = (int)floor((double)h * gl_screen.scale);
-   if (font->chars==NULL) {
+   if (font->cache==NULL) {
       WARN("Out of memory!");
       return;
    }
@@ -1100,10 +1820,10 @@ void gl_fontInit( glFont* font, const char *fname, const unsigned int h )
    /* Generate the font atlas. */
    font_genTextureAtlas( font, face );
 
-   /* we can now free the face and library */
-   FT_Done_Face(face);
-   FT_Done_FreeType(library);
-   free(buf);
+   /* Keep the face around for the other glyphs. */
+   font->cache->library = library;
+   font->cache->face    = face;
+   font->cache->buf     = buf;
 }
 
 /**
@@ -1113,16 +1833,33 @@ void gl_fontInit( glFont* font, const char *fname, const unsigned int h )
  */
 void gl_freeFont( glFont* font )
 {
+   glFontCache *cache;
+   FontGlyph *g;
+   int i;
+
    if (font == NULL)
       font = &gl_defFont;
+   font_layoutPurge( font );
    glDeleteTextures(1,&font->texture);
-   if (font->chars != NULL)
-      free(font->chars);
-   font->chars = NULL;
-   if (font->vbo_tex != NULL)
-      gl_vboDestroy(font->vbo_tex);
-   font->vbo_tex = NULL;
-   if (font->vbo_vert != NULL)
-      gl_vboDestroy(font->vbo_vert);
-   font->vbo_vert = NULL;
+
+   cache = font->cache;
+   if (cache == NULL)
+      return;
+   for (i=0; i<FONT_GLYPH_BUCKETS; i++) {
+      while (cache->hash[i] != NULL) {
+         g = cache->hash[i];
+         cache->hash[i] = g->next;
+         free( g );
+      }
+   }
+   for (i=1; i<FONT_PAGES+1; i++)
+      if (cache->pages[i].texture != 0)
+         glDeleteTextures( 1, &cache->pages[i].texture );
+   if (cache->face != NULL)
+      FT_Done_Face( cache->face );
+   if (cache->library != NULL)
+      FT_Done_FreeType( cache->library );
+   free( cache->buf );
+   free( cache );
+   font->cache = NULL;
 }
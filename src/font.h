@@ -11,13 +11,7 @@
 #include "opengl.h"
 
 
-/**
- * @brief Represents a character in the font.
- */
-typedef struct glFontChar_s {
-   double adv_x; /**< X advancement. */
-   double adv_y; /**< Y advancement. */
-} glFontChar;
+struct glFontCache_;
 
 
 /**
@@ -25,10 +19,8 @@ typedef struct glFontChar_s {
  */
 typedef struct glFont_s {
    int h; /**< Font height. */
-   GLuint texture; /**< Font atlas. */
-   gl_vbo *vbo_tex; /**< VBO associated to texture coordinates. */
-   gl_vbo *vbo_vert; /**< VBO associated to vertex coordinates. */
-   glFontChar *chars; /**< Characters in the font. */
+   GLuint texture; /**< Atlas of the ASCII characters. */
+   struct glFontCache_ *cache; /**< Glyphs, including the ones rendered on demand. */
 } glFont;
 extern glFont gl_defFont; /**< Default font. */
 extern glFont gl_smallFont; /**< Small font. */
@@ -18,8 +18,10 @@
 #include "player.h"
 #include "nxml.h"
 #include "pilot.h"
+#include "pilot_grid.h"
 #include "log.h"
 #include "opengl.h"
+#include "opengl_shader.h"
 #include "font.h"
 #include "ndata.h"
 #include "space.h"
@@ -56,6 +58,7 @@
 #include "nlua_gui.h"
 #include "nlua_tex.h"
 #include "gui_omsg.h"
+#include "gui_elem.h"
 #include "nstring.h"
 
 
@@ -73,6 +76,7 @@
 static int interference_layer = 0; /**< Layer of the current interference. */
 double interference_alpha     = 0.; /**< Alpha of the current interference layer. */
 static double interference_t  = 0.; /**< Interference timer to control transitions. */
+static double interference_time = 0.; /**< Time interference has been shown, animates the program. */
 
 /* some blinking stuff. */
 static double blink_pilot     = 0.; /**< Timer on target blinking on radar. */
@@ -82,6 +86,17 @@ static double blink_planet    = 0.; /**< Timer on planet blinking on radar. */
 static gl_vbo *gui_vbo = NULL; /**< GUI VBO. */
 static GLsizei gui_vboColourOffset = 0; /**< Offset of colour pixels. */
 
+/* Radar batch. */
+#define RADAR_BATCH_CHUNK     256 /**< Quads to grow the radar batch by. */
+#define RADAR_ASTEROID_RANGE  4000. /**< Distance asteroids are shown at. */
+#define RADAR_ASTEROID_MARGIN 500. /**< Asteroids drifting outside their field. */
+static gl_vbo *gui_radarVBO   = NULL; /**< Radar batch VBO. */
+static GLfloat *gui_radarVertex = NULL; /**< Radar batch vertices, 4 per quad. */
+static GLfloat *gui_radarColour = NULL; /**< Radar batch colours, 4 per quad. */
+static int gui_radarNquads    = 0; /**< Quads in the radar batch. */
+static int gui_radarMquads    = 0; /**< Quads allocated for the radar batch. */
+static int gui_radarBatching  = 0; /**< Whether radar quads are being batched. */
+
 static int gui_getMessage     = 1; /**< Whether or not the player should receive messages. */
 
 /*
@@ -98,6 +113,8 @@ extern int land_wid; /**< From land.c */
  * GUI Lua stuff.
  */
 static nlua_env gui_env = LUA_NOREF; /**< Current GUI Lua environment. */
+static int gui_hasRender   = 0; /**< Whether the GUI has a render function. */
+static int gui_hasCooldown = 0; /**< Whether the GUI has a render_cooldown function. */
 static int gui_L_mclick = 0; /**< Use mouse click callback. */
 static int gui_L_mmove = 0; /**< Use mouse movement callback. */
 
@@ -138,6 +155,7 @@ static double gui_yoff = 0.; /**< Y offset that GUI introduces. */
 
 /* messages */
 #define MESG_SIZE_MAX        256 /**< Maxmimu message length. */
+#define MESG_FADE_STEPS      32. /**< Alpha steps messages fade out in. */
 static int mesg_max        = 128; /**< Maximum messages onscreen */
 static int mesg_pointer    = 0; /**< Current pointer message is at (for when scrolling. */
 static int mesg_viewpoint  = -1; /**< Position of viewing. */
@@ -194,6 +212,10 @@ static void gui_renderRadarOutOfRange( RadarShape sh, int w, int h, int cx, int
 static void gui_planetBlink( int w, int h, int rc, int cx, int cy, GLfloat vr, RadarShape shape );
 static const glColour* gui_getPilotColour( const Pilot* p );
 static void gui_renderInterference (void);
+static int gui_renderInterferenceProgram( const glColour *c );
+static void gui_radarQuad( double x, double y, double w, double h, const glColour *c );
+static int gui_asteroidFieldInRange( const AsteroidAnchor *ast,
+      double x1, double y1, double x2, double y2 );
 static void gui_calcBorders (void);
 /* Lua GUI. */
 static int gui_doFunc( const char* func );
@@ -878,8 +900,10 @@ void gui_render( double dt )
    blink_planet   -= dt / dt_mod;
    if (blink_planet < 0.)
       blink_planet += RADAR_BLINK_PLANET;
-   if (interference_alpha > 0.)
-      interference_t += dt;
+   if (interference_alpha > 0.) {
+      interference_t    += dt;
+      interference_time += dt;
+   }
 
    /* Render the border ships and targets. */
    gui_renderBorder(dt);
@@ -887,13 +911,16 @@ void gui_render( double dt )
    /* Set viewport. */
    gl_viewport( 0., 0., gl_screen.rw, gl_screen.rh );
 
-   /* Run Lua. */
+   /* Retained elements, then Lua only if the GUI still draws by itself. */
+   guie_render();
    if (gui_env != LUA_NOREF) {
-      gui_prepFunc( "render" );
-      lua_pushnumber( naevL, dt );
-      lua_pushnumber( naevL, dt_mod );
-      gui_runFunc( "render", 2, 0 );
-      if (pilot_isFlag(player.p, PILOT_COOLDOWN)) {
+      if (gui_hasRender) {
+         gui_prepFunc( "render" );
+         lua_pushnumber( naevL, dt );
+         lua_pushnumber( naevL, dt_mod );
+         gui_runFunc( "render", 2, 0 );
+      }
+      if (gui_hasCooldown && pilot_isFlag(player.p, PILOT_COOLDOWN)) {
          gui_prepFunc( "render_cooldown" );
          lua_pushnumber( naevL, player.p->ctimer / player.p->cdelay  );
          lua_pushnumber( naevL, player.p->ctimer );
@@ -962,9 +989,12 @@ int gui_radarInit( int circle, int w, int h )
  */
 void gui_radarRender( double x, double y )
 {
-   int i, j;
+   int i, j, n;
+   double px, py, rw, rh;
    Radar *radar;
    AsteroidAnchor *ast;
+   Pilot **pilots, *target;
+   const SystemView *v;
 
    /* The global radar. */
    radar = &gui_radar;
@@ -982,8 +1012,9 @@ void gui_radarRender( double x, double y )
    /*
     * planets
     */
-   for (i=0; i<cur_system->nplanets; i++)
-      if ((cur_system->planets[ i ]->real == ASSET_REAL) && (i != player.p->nav_planet))
+   v = space_getView();
+   for (i=0; i<v->nplanets; i++)
+      if ((v->pflags[i] & SYSVIEW_REAL) && (i != player.p->nav_planet))
          gui_renderPlanet( i, radar->shape, radar->w, radar->h, radar->res, 0 );
    if (player.p->nav_planet > -1)
       gui_renderPlanet( player.p->nav_planet, radar->shape, radar->w, radar->h, radar->res, 0 );
@@ -1004,25 +1035,43 @@ void gui_radarRender( double x, double y )
          radar->shape, 1.-interference_alpha );
 
 
-   /* render the pilot_nstack */
-   j = 0;
-   for (i=1; i<pilot_nstack; i++) { /* skip the player */
-      if (pilot_stack[i]->id == player.p->target)
-         j = i;
-      else
-         gui_renderPilot( pilot_stack[i], radar->shape, radar->w, radar->h, radar->res, 0 );
+   /* Pilots and asteroids are drawn together. */
+   gui_radarBatchBegin();
+
+   /* Range of the radar in the system. */
+   if (radar->shape == RADAR_CIRCLE) {
+      rw = radar->w * radar->res;
+      rh = rw;
+   }
+   else {
+      rw = radar->w/2. * radar->res;
+      rh = radar->h/2. * radar->res;
    }
-   /* render the targeted pilot */
-   if (j!=0)
-      gui_renderPilot( pilot_stack[j], radar->shape, radar->w, radar->h, radar->res, 0 );
+   px = player.p->solid->pos.x;
+   py = player.p->solid->pos.y;
+
+   /* render the pilots in range, targeted pilot last */
+   n = pilot_gridQueryRect( px-rw, py-rh, px+rw, py+rh, &pilots );
+   for (i=0; i<n; i++)
+      if ((pilots[i] != player.p) && (pilots[i]->id != player.p->target))
+         gui_renderPilot( pilots[i], radar->shape, radar->w, radar->h, radar->res, 0 );
+   target = pilot_get( player.p->target );
+   if ((target != NULL) && (target != player.p))
+      gui_renderPilot( target, radar->shape, radar->w, radar->h, radar->res, 0 );
 
    /* render the asteroids */
+   rw = MIN( rw, RADAR_ASTEROID_RANGE );
+   rh = MIN( rh, RADAR_ASTEROID_RANGE );
    for (i=0; i<cur_system->nasteroids; i++) {
       ast = &cur_system->asteroids[i];
+      if (!gui_asteroidFieldInRange( ast, px-rw, py-rh, px+rw, py+rh ))
+         continue;
       for (j=0; j<ast->nb; j++)
          gui_renderAsteroid( &ast->asteroids[j], radar->w, radar->h, radar->res, 0 );
    }
 
+   gui_radarBatchEnd();
+
    /* Interference. */
    gui_renderInterference();
 
@@ -1136,9 +1185,11 @@ static void gui_renderMessages( double dt )
          if (mesg_viewpoint == -1) {
             mesg_stack[m].t -= dt / dt_mod;
 
-            /* Handle fading out. */
+            /* Handle fading out, in steps so the cached text isn't
+             * recoloured every frame. */
             if (mesg_stack[m].t - mesg_fade < 0.)
-               c.a = mesg_stack[m].t / mesg_fade;
+               c.a = ceil( mesg_stack[m].t / mesg_fade * MESG_FADE_STEPS ) /
+                     MESG_FADE_STEPS;
             else
                c.a = 1.;
          }
@@ -1186,6 +1237,11 @@ static void gui_renderInterference (void)
    if (interference_alpha <= 0.)
       return;
 
+   c.r = c.g = c.b = 1.;
+   c.a = interference_alpha;
+   if (gui_renderInterferenceProgram( &c ) == 0)
+      return;
+
    /* Calculate frame to draw. */
    if (interference_t > INTERFERENCE_CHANGE_DT) { /* Time to change */
       t = RNG(0, INTERFERENCE_LAYERS-1);
@@ -1198,8 +1254,6 @@ static void gui_renderInterference (void)
    }
 
    /* Render the interference. */
-   c.r = c.g = c.b = 1.;
-   c.a = interference_alpha;
    tex = gui_radar.interference[interference_layer];
    if (gui_radar.shape == RADAR_CIRCLE)
       gl_blitStatic( tex, -gui_radar.w, -gui_radar.w, &c );
@@ -1208,6 +1262,66 @@ static void gui_renderInterference (void)
 }
 
 
+/**
+ * @brief Renders interference generated by a program, at any radar size.
+ *
+ *    @param c Colour to modulate the interference with.
+ *    @return 0 on success, nonzero if the textures must be used instead.
+ */
+static int gui_renderInterferenceProgram( const glColour *c )
+{
+   GLfloat vertex[8], tex[8], col[16], param[4];
+   GLuint voff, toff, coff;
+   gl_vbo *vbo;
+   double w, h, vol;
+   int i;
+
+   if (!gl_programAvailable( GL_PROG_INTERFERENCE ))
+      return -1;
+
+   w = gui_radar.w;
+   h = (gui_radar.shape == RADAR_CIRCLE) ? gui_radar.w : gui_radar.h;
+
+   /* Quad over the radar, texture coordinates in pixels. */
+   vertex[0] = vertex[4] = -w;
+   vertex[2] = vertex[6] = w;
+   vertex[1] = vertex[3] = -h;
+   vertex[5] = vertex[7] = h;
+   for (i=0; i<8; i+=2) {
+      tex[i]   = vertex[i]   + w;
+      tex[i+1] = vertex[i+1] + h;
+   }
+   for (i=0; i<4; i++) {
+      col[4*i+0] = c->r;
+      col[4*i+1] = c->g;
+      col[4*i+2] = c->b;
+      col[4*i+3] = c->a;
+   }
+   vbo  = gl_vboStreamReserve( sizeof(vertex) + sizeof(tex) + sizeof(col) );
+   voff = gl_vboStreamPush( vertex, sizeof(vertex) );
+   toff = gl_vboStreamPush( tex, sizeof(tex) );
+   coff = gl_vboStreamPush( col, sizeof(col) );
+   gl_vboActivateOffset( vbo, GL_VERTEX_ARRAY, voff, 2, GL_FLOAT, 0 );
+   gl_vboActivateOffset( vbo, GL_TEXTURE0, toff, 2, GL_FLOAT, 0 );
+   gl_vboActivateOffset( vbo, GL_COLOR_ARRAY, coff, 4, GL_FLOAT, 0 );
+
+   /* Volatile nebulae make the interference roll. */
+   vol      = (cur_system != NULL) ? cur_system->nebu_volatility : 0.;
+   param[0] = interference_time / INTERFERENCE_CHANGE_DT;
+   param[1] = vol / (vol + 100.);
+   param[2] = (gui_radar.shape == RADAR_CIRCLE) ? w : 0.;
+   param[3] = 0.;
+   if (gl_programUse( GL_PROG_INTERFERENCE, param ) == 0) {
+      glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
+      gl_programUnuse();
+   }
+   gl_vboDeactivate();
+
+   gl_checkErr();
+   return 0;
+}
+
+
 /**
  * @brief Gets a pilot's colour, with a special colour for targets.
  *
@@ -1229,6 +1343,111 @@ static const glColour* gui_getPilotColour( const Pilot* p )
 }
 
 
+/**
+ * @brief Starts batching the pilots and asteroids drawn on the radar.
+ *
+ * Quads are kept until gui_radarBatchEnd() so they are drawn at once.
+ */
+void gui_radarBatchBegin (void)
+{
+   gui_radarBatching = 1;
+   gui_radarNquads   = 0;
+}
+
+
+/**
+ * @brief Draws the radar quads batched since gui_radarBatchBegin().
+ */
+void gui_radarBatchEnd (void)
+{
+   GLsizei size;
+
+   gui_radarBatching = 0;
+   if (gui_radarNquads == 0)
+      return;
+
+   if (gui_radarVBO == NULL)
+      gui_radarVBO = gl_vboCreateStream( 0, NULL );
+
+   /* Vertices then colours. */
+   size = sizeof(GLfloat) * 4*2 * gui_radarNquads;
+   gl_vboData( gui_radarVBO, size * 3, NULL );
+   gl_vboSubData( gui_radarVBO, 0, size, gui_radarVertex );
+   gl_vboSubData( gui_radarVBO, size, size * 2, gui_radarColour );
+
+   gl_vboActivateOffset( gui_radarVBO, GL_VERTEX_ARRAY, 0, 2, GL_FLOAT, 0 );
+   gl_vboActivateOffset( gui_radarVBO, GL_COLOR_ARRAY, size, 4, GL_FLOAT, 0 );
+   glDrawArrays( GL_QUADS, 0, 4 * gui_radarNquads );
+   gl_vboDeactivate();
+
+   gui_radarNquads = 0;
+   gl_checkErr();
+}
+
+
+/**
+ * @brief Draws a flat quad on the radar, batched if possible.
+ */
+static void gui_radarQuad( double x, double y, double w, double h, const glColour *c )
+{
+   int i;
+   GLfloat *v, *col;
+
+   if (!gui_radarBatching) {
+      gl_renderRect( x, y, w, h, c );
+      return;
+   }
+
+   /* Grow. */
+   if (gui_radarNquads >= gui_radarMquads) {
+      gui_radarMquads += RADAR_BATCH_CHUNK;
+      gui_radarVertex  = realloc( gui_radarVertex,
+            sizeof(GLfloat) * 4*2 * gui_radarMquads );
+      gui_radarColour  = realloc( gui_radarColour,
+            sizeof(GLfloat) * 4*4 * gui_radarMquads );
+   }
+
+   v    = &gui_radarVertex[ 4*2 * gui_radarNquads ];
+   v[0] = x;
+   v[1] = y;
+   v[2] = x + w;
+   v[3] = y;
+   v[4] = x + w;
+   v[5] = y + h;
+   v[6] = x;
+   v[7] = y + h;
+
+   col  = &gui_radarColour[ 4*4 * gui_radarNquads ];
+   for (i=0; i<4; i++) {
+      col[4*i+0] = c->r;
+      col[4*i+1] = c->g;
+      col[4*i+2] = c->b;
+      col[4*i+3] = c->a;
+   }
+
+   gui_radarNquads++;
+}
+
+
+/**
+ * @brief Checks to see if an asteroid field may have asteroids in a rectangle.
+ *
+ *    @return 1 if the bounding box of the field touches the rectangle.
+ */
+static int gui_asteroidFieldInRange( const AsteroidAnchor *ast,
+      double x1, double y1, double x2, double y2 )
+{
+   /* No corners, can't tell. */
+   if (ast->ncorners <= 0)
+      return 1;
+
+   return !((ast->bmax.x + RADAR_ASTEROID_MARGIN < x1) ||
+         (ast->bmin.x - RADAR_ASTEROID_MARGIN > x2) ||
+         (ast->bmax.y + RADAR_ASTEROID_MARGIN < y1) ||
+         (ast->bmin.y - RADAR_ASTEROID_MARGIN > y2));
+}
+
+
 /**
  * @brief Renders a pilot in the GUI radar.
  *
@@ -1362,7 +1581,7 @@ void gui_renderPilot( const Pilot* p, RadarShape shape, double w, double h, doub
    ccol.g = col->g;
    ccol.b = col->b;
    ccol.a = 1.-interference_alpha;
-   gl_renderRect( px, py, MIN( 2*sx, w-px ), MIN( 2*sy, h-py ), &ccol );
+   gui_radarQuad( px, py, MIN( 2*sx, w-px ), MIN( 2*sy, h-py ), &ccol );
 
    /* Draw name. */
    if (overlay && pilot_isFlag(p, PILOT_HILIGHT))
@@ -1384,7 +1603,7 @@ void gui_renderAsteroid( const Asteroid* a, double w, double h, double res, int
 
    /* Make sure is in range. TODO: real detection system for asteroids */
    if ( MOD( a->pos.x - player.p->solid->pos.x,
-             a->pos.y - player.p->solid->pos.y ) > 4000. )
+             a->pos.y - player.p->solid->pos.y ) > RADAR_ASTEROID_RANGE )
       return;
 
    /* Get position. */
@@ -1420,7 +1639,7 @@ void gui_renderAsteroid( const Asteroid* a, double w, double h, double res, int
    ccol.g = col->g;
    ccol.b = col->b;
    ccol.a = 1.-interference_alpha;
-   gl_renderRect( px, py, MIN( 2*sx, w-px ), MIN( 2*sy, h-py ), &ccol );
+   gui_radarQuad( px, py, MIN( 2*sx, w-px ), MIN( 2*sy, h-py ), &ccol );
 }
 
 
@@ -1995,9 +2214,12 @@ static int gui_runFunc( const char* func, int nargs, int nret )
 {
    int ret;
    const char* err;
+   double t0;
 
    /* Run the function. */
+   t0  = nlua_profStart();
    ret = nlua_pcall( gui_env, nargs, nret );
+   nlua_profStop( t0, "gui:%s", func );
    if (ret != 0) { /* error has occurred */
       err = (lua_isstring(naevL,-1)) ? lua_tostring(naevL,-1) : NULL;
       WARN("GUI Lua -> '%s': %s",
@@ -2167,6 +2389,14 @@ int gui_load( const char* name )
       nlua_freeEnv( gui_env );
       gui_env = LUA_NOREF;
    }
+   else {
+      /* GUIs made only of elements don't render from Lua. */
+      nlua_getenv( gui_env, "render" );
+      gui_hasRender = lua_isfunction( naevL, -1 );
+      nlua_getenv( gui_env, "render_cooldown" );
+      gui_hasCooldown = lua_isfunction( naevL, -1 );
+      lua_pop( naevL, 2 );
+   }
 
    /* Recreate land window if landed. */
    if (landed) {
@@ -2192,6 +2422,16 @@ static void gui_createInterference( Radar *radar )
    float c;
    int r;
 
+   /* Generated by a program when rendering instead. */
+   if (gl_programAvailable( GL_PROG_INTERFERENCE )) {
+      for (k=0; k<INTERFERENCE_LAYERS; k++) {
+         if (radar->interference[k] != NULL)
+            gl_freeTexture( radar->interference[k] );
+         radar->interference[k] = NULL;
+      }
+      return;
+   }
+
    /* Dimension shortcuts. */
    if (radar->shape == RADAR_CIRCLE) {
       w = radar->w*2.;
@@ -2289,6 +2529,7 @@ void gui_cleanup (void)
    interference_alpha = 0.;
    interference_layer = 0;
    interference_t     = 0.;
+   interference_time  = 0.;
 
    /* Destroy offset. */
    gui_xoff = 0.;
@@ -2299,6 +2540,11 @@ void gui_cleanup (void)
       nlua_freeEnv( gui_env );
       gui_env = LUA_NOREF;
    }
+   gui_hasRender   = 0;
+   gui_hasCooldown = 0;
+
+   /* Retained elements. */
+   guie_cleanup();
 
    /* OMSG */
    omsg_position( SCREEN_W/2., SCREEN_H*2./3., SCREEN_W*2./3. );
@@ -2324,6 +2570,15 @@ void gui_free (void)
       gl_vboDestroy( gui_vbo );
       gui_vbo = NULL;
    }
+   if (gui_radarVBO != NULL) {
+      gl_vboDestroy( gui_radarVBO );
+      gui_radarVBO = NULL;
+   }
+   free( gui_radarVertex );
+   free( gui_radarColour );
+   gui_radarVertex = NULL;
+   gui_radarColour = NULL;
+   gui_radarMquads = 0;
 
    /* Clean up the osd. */
    osd_exit();
@@ -0,0 +1,543 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file gui_elem.c
+ *
+ * @brief Retained GUI elements.
+ *
+ * The GUI script declares its bars, text and graphics once and they are
+ *  drawn every frame from C, following the player values they are bound to.
+ *  Lua only has to change them from its update functions, so a GUI made of
+ *  elements alone doesn't need a render function at all.
+ */
+
+
+#include "gui_elem.h"
+
+#include "naev.h"
+
+#include <stdlib.h>
+#include "nstring.h"
+
+#include "log.h"
+#include "opengl.h"
+#include "font.h"
+#include "array.h"
+#include "gui.h"
+#include "player.h"
+#include "pilot.h"
+
+
+#define GUIE_TEXT_MAX   64 /**< Maximum length of a bound value. */
+
+
+/**
+ * @brief Types of elements.
+ */
+typedef enum GuiElemType_ {
+   GUIE_BAR,         /**< Rectangle or texture filled by a value. */
+   GUIE_TEXT,        /**< Line of text. */
+   GUIE_TEXTBLOCK,   /**< Block of wrapped text. */
+   GUIE_TEX,         /**< Texture. */
+   GUIE_RADAR        /**< The radar. */
+} GuiElemType;
+
+
+/**
+ * @brief Element of the GUI.
+ */
+typedef struct GuiElem_ {
+   unsigned int id;  /**< Unique ID. */
+   GuiElemType type; /**< Type of element. */
+   GuiBind bind;     /**< Value followed. */
+   int visible;      /**< Whether it gets rendered. */
+   double x;         /**< X position. */
+   double y;         /**< Y position. */
+   double w;         /**< Width or maximum width. */
+   double h;         /**< Height. */
+   glColour col;     /**< Colour. */
+   int colset;       /**< Whether col is used, textures are drawn as is otherwise. */
+   glTexture *tex;   /**< Texture, may be NULL. */
+   const glFont *font; /**< Font of text. */
+   GuiAlign align;   /**< Alignment of text. */
+   char *str;        /**< Text, or what goes in front of the bound value. */
+   double value;     /**< Value of bars not bound, last value of bound text. */
+   char *cache;      /**< Text with the bound value, rebuilt when it changes. */
+   int tw;           /**< Width of the text. */
+} GuiElem;
+static GuiElem *guie_array       = NULL; /**< Elements in render order. */
+static unsigned int guie_idgen   = 0; /**< Unique ID generator. */
+
+
+/*
+ * Prototypes.
+ */
+static GuiElem* guie_new( GuiElemType type, double x, double y, const glColour *col );
+static GuiElem* guie_get( unsigned int id );
+static double guie_fraction( GuiBind bind );
+static void guie_updateText( GuiElem *e );
+static void guie_renderText( GuiElem *e );
+
+
+/**
+ * @brief Adds a new element.
+ */
+static GuiElem* guie_new( GuiElemType type, double x, double y, const glColour *col )
+{
+   GuiElem *e;
+
+   if (guie_array == NULL)
+      guie_array = array_create( GuiElem );
+   e = &array_grow( &guie_array );
+   memset( e, 0, sizeof(GuiElem) );
+   e->id       = ++guie_idgen;
+   e->type     = type;
+   e->visible  = 1;
+   e->x        = x;
+   e->y        = y;
+   e->font     = &gl_defFont;
+   if (col != NULL) {
+      e->col    = *col;
+      e->colset = 1;
+   }
+   return e;
+}
+
+
+/**
+ * @brief Gets an element from id.
+ */
+static GuiElem* guie_get( unsigned int id )
+{
+   int i;
+   if (guie_array == NULL)
+      return NULL;
+   for (i=0; i<array_size(guie_array); i++)
+      if (guie_array[i].id == id)
+         return &guie_array[i];
+   return NULL;
+}
+
+
+/**
+ * @brief Adds a bar.
+ *
+ *    @param x X position.
+ *    @param y Y position.
+ *    @param w Width when full, that of the texture if 0.
+ *    @param h Height, that of the texture if 0.
+ *    @param col Colour.
+ *    @param tex Texture cut to the value, rectangle if NULL.
+ *    @param bind Value to follow.
+ *    @return ID of the element.
+ */
+unsigned int guie_addBar( double x, double y, double w, double h,
+      const glColour *col, glTexture *tex, GuiBind bind )
+{
+   GuiElem *e;
+
+   e        = guie_new( GUIE_BAR, x, y, col );
+   e->bind  = bind;
+   e->value = 1.;
+   if (tex != NULL) {
+      e->tex = gl_dupTexture( tex );
+      w      = (w > 0.) ? w : tex->sw;
+      h      = (h > 0.) ? h : tex->sh;
+   }
+   e->w     = w;
+   e->h     = h;
+   return e->id;
+}
+
+
+/**
+ * @brief Adds a line of text.
+ *
+ *    @param small Whether or not to use the small font.
+ *    @param str Text, shown in front of the value if bound.
+ *    @param x X position.
+ *    @param y Y position.
+ *    @param col Colour.
+ *    @param max Maximum width, 0 for none.
+ *    @param align Alignment in the maximum width.
+ *    @param bind Value to follow.
+ *    @return ID of the element.
+ */
+unsigned int guie_addText( int small, const char *str, double x, double y,
+      const glColour *col, int max, GuiAlign align, GuiBind bind )
+{
+   GuiElem *e;
+
+   e        = guie_new( GUIE_TEXT, x, y, col );
+   e->font  = small ? &gl_smallFont : &gl_defFont;
+   e->w     = max;
+   e->align = align;
+   e->bind  = bind;
+   e->value = -HUGE_VAL;
+   e->str   = strdup( (str != NULL) ? str : "" );
+   guie_updateText( e );
+   return e->id;
+}
+
+
+/**
+ * @brief Adds a block of wrapped text.
+ *
+ *    @param small Whether or not to use the small font.
+ *    @param str Text.
+ *    @param x X position.
+ *    @param y Y position.
+ *    @param w Width of the block.
+ *    @param h Height of the block.
+ *    @param col Colour.
+ *    @return ID of the element.
+ */
+unsigned int guie_addTextBlock( int small, const char *str, double x, double y,
+      int w, int h, const glColour *col )
+{
+   GuiElem *e;
+
+   e        = guie_new( GUIE_TEXTBLOCK, x, y, col );
+   e->font  = small ? &gl_smallFont : &gl_defFont;
+   e->w     = w;
+   e->h     = h;
+   e->str   = strdup( (str != NULL) ? str : "" );
+   return e->id;
+}
+
+
+/**
+ * @brief Adds a texture.
+ *
+ *    @param tex Texture.
+ *    @param x X position.
+ *    @param y Y position.
+ *    @param col Colour to tint it with, NULL for none.
+ *    @return ID of the element.
+ */
+unsigned int guie_addTex( glTexture *tex, double x, double y, const glColour *col )
+{
+   GuiElem *e;
+
+   e        = guie_new( GUIE_TEX, x, y, col );
+   e->tex   = gl_dupTexture( tex );
+   return e->id;
+}
+
+
+/**
+ * @brief Adds the radar.
+ *
+ *    @param x X position.
+ *    @param y Y position.
+ *    @return ID of the element.
+ */
+unsigned int guie_addRadar( double x, double y )
+{
+   return guie_new( GUIE_RADAR, x, y, NULL )->id;
+}
+
+
+/**
+ * @brief Changes the text of an element.
+ *
+ *    @param id ID of the element.
+ *    @param str New text, shown in front of the value if bound.
+ *    @return 0 on success.
+ */
+int guie_setText( unsigned int id, const char *str )
+{
+   GuiElem *e;
+
+   e = guie_get( id );
+   if ((e == NULL) || ((e->type != GUIE_TEXT) && (e->type != GUIE_TEXTBLOCK)))
+      return -1;
+
+   free( e->str );
+   e->str   = strdup( (str != NULL) ? str : "" );
+   e->value = -HUGE_VAL;
+   guie_updateText( e );
+   return 0;
+}
+
+
+/**
+ * @brief Changes the value of a bar that isn't bound.
+ *
+ *    @param id ID of the element.
+ *    @param value Fraction filled, from 0 to 1.
+ *    @return 0 on success.
+ */
+int guie_setValue( unsigned int id, double value )
+{
+   GuiElem *e;
+
+   e = guie_get( id );
+   if ((e == NULL) || (e->type != GUIE_BAR))
+      return -1;
+   e->value = CLAMP( 0., 1., value );
+   return 0;
+}
+
+
+/**
+ * @brief Changes the colour of an element.
+ *
+ *    @param id ID of the element.
+ *    @param col New colour, NULL to draw textures as is.
+ *    @return 0 on success.
+ */
+int guie_setColour( unsigned int id, const glColour *col )
+{
+   GuiElem *e;
+
+   e = guie_get( id );
+   if (e == NULL)
+      return -1;
+   e->colset = (col != NULL);
+   if (col != NULL)
+      e->col = *col;
+   return 0;
+}
+
+
+/**
+ * @brief Shows or hides an element.
+ *
+ *    @param id ID of the element.
+ *    @param visible Whether it should be rendered.
+ *    @return 0 on success.
+ */
+int guie_setVisible( unsigned int id, int visible )
+{
+   GuiElem *e;
+
+   e = guie_get( id );
+   if (e == NULL)
+      return -1;
+   e->visible = visible;
+   return 0;
+}
+
+
+/**
+ * @brief Gets a binding from its name.
+ *
+ *    @param name Name of the binding, NULL for none.
+ *    @return The binding or -1 if unknown.
+ */
+int guie_bind( const char *name )
+{
+   if (name == NULL)
+      return GUI_BIND_NONE;
+   else if (strcmp(name,"shield")==0)
+      return GUI_BIND_SHIELD;
+   else if (strcmp(name,"armour")==0)
+      return GUI_BIND_ARMOUR;
+   else if (strcmp(name,"energy")==0)
+      return GUI_BIND_ENERGY;
+   else if (strcmp(name,"fuel")==0)
+      return GUI_BIND_FUEL;
+   else if (strcmp(name,"credits")==0)
+      return GUI_BIND_CREDITS;
+   else if (strcmp(name,"cargo_free")==0)
+      return GUI_BIND_CARGOFREE;
+   return -1;
+}
+
+
+/**
+ * @brief Gets an alignment from its name.
+ *
+ *    @param name Name of the alignment, NULL for left.
+ *    @return The alignment or -1 if unknown.
+ */
+int guie_align( const char *name )
+{
+   if ((name == NULL) || (strcmp(name,"left")==0))
+      return GUI_ALIGN_LEFT;
+   else if (strcmp(name,"center")==0)
+      return GUI_ALIGN_CENTER;
+   else if (strcmp(name,"right")==0)
+      return GUI_ALIGN_RIGHT;
+   return -1;
+}
+
+
+/**
+ * @brief Gets the fraction of a bound value.
+ */
+static double guie_fraction( GuiBind bind )
+{
+   Pilot *p;
+
+   p = player.p;
+   switch (bind) {
+      case GUI_BIND_SHIELD:
+         return (p->shield_max > 0.) ? p->shield / p->shield_max : 0.;
+      case GUI_BIND_ARMOUR:
+         return (p->armour_max > 0.) ? p->armour / p->armour_max : 0.;
+      case GUI_BIND_ENERGY:
+         return (p->energy_max > 0.) ? p->energy / p->energy_max : 0.;
+      case GUI_BIND_FUEL:
+         return (p->fuel_max > 0.) ? p->fuel / p->fuel_max : 0.;
+
+      default:
+         return 0.;
+   }
+}
+
+
+/**
+ * @brief Rebuilds the text of an element if its bound value changed.
+ */
+static void guie_updateText( GuiElem *e )
+{
+   char buf[GUIE_TEXT_MAX];
+   double v;
+
+   /* Get the value. */
+   switch (e->bind) {
+      case GUI_BIND_NONE:
+         v = 0.;
+         break;
+      case GUI_BIND_CREDITS:
+         v = (player.p != NULL) ? (double)player.p->credits : 0.;
+         break;
+      case GUI_BIND_CARGOFREE:
+         v = (player.p != NULL) ? pilot_cargoFree( player.p ) : 0.;
+         break;
+      default:
+         v = (player.p != NULL) ? round( 100. * guie_fraction( e->bind ) ) : 0.;
+         break;
+   }
+   if ((e->cache != NULL) && (v == e->value))
+      return;
+   e->value = v;
+
+   /* Format it. */
+   switch (e->bind) {
+      case GUI_BIND_NONE:
+         buf[0] = '\0';
+         break;
+      case GUI_BIND_CREDITS:
+         credits2str( buf, (credits_t)v, 2 );
+         break;
+      case GUI_BIND_CARGOFREE:
+         nsnprintf( buf, sizeof(buf), "%.0ft", v );
+         break;
+      default:
+         nsnprintf( buf, sizeof(buf), "%.0f%%", v );
+         break;
+   }
+   free( e->cache );
+   e->cache = malloc( strlen(e->str) + strlen(buf) + 1 );
+   strcpy( e->cache, e->str );
+   strcat( e->cache, buf );
+   e->tw = gl_printWidthRaw( e->font, e->cache );
+}
+
+
+/**
+ * @brief Renders a line of text.
+ */
+static void guie_renderText( GuiElem *e )
+{
+   double x;
+
+   if (e->bind != GUI_BIND_NONE)
+      guie_updateText( e );
+
+   switch (e->align) {
+      case GUI_ALIGN_CENTER:
+         gl_printMidRaw( e->font, e->w, e->x, e->y, &e->col, e->cache );
+         break;
+      case GUI_ALIGN_RIGHT:
+         x = e->x + MAX( 0., e->w - e->tw );
+         gl_printMaxRaw( e->font, e->w, x, e->y, &e->col, e->cache );
+         break;
+
+      default:
+         if (e->w > 0)
+            gl_printMaxRaw( e->font, e->w, e->x, e->y, &e->col, e->cache );
+         else
+            gl_printRaw( e->font, e->x, e->y, &e->col, e->cache );
+         break;
+   }
+}
+
+
+/**
+ * @brief Renders all the elements.
+ */
+void guie_render (void)
+{
+   int i;
+   GuiElem *e;
+   double f;
+   const glTexture *t;
+
+   if ((guie_array == NULL) || (player.p == NULL))
+      return;
+
+   for (i=0; i<array_size(guie_array); i++) {
+      e = &guie_array[i];
+      if (!e->visible)
+         continue;
+
+      switch (e->type) {
+         case GUIE_BAR:
+            f = (e->bind == GUI_BIND_NONE) ? e->value : guie_fraction( e->bind );
+            f = CLAMP( 0., 1., f );
+            t = e->tex;
+            if (t == NULL)
+               gl_renderRect( e->x, e->y, f * e->w, e->h, &e->col );
+            else
+               gl_blitTexture( t, e->x, e->y, f * e->w, e->h,
+                     0., t->sh * (t->sy - 1.) / t->rh, f * t->srw, t->srh,
+                     e->colset ? &e->col : NULL );
+            break;
+
+         case GUIE_TEXT:
+            guie_renderText( e );
+            break;
+
+         case GUIE_TEXTBLOCK:
+            gl_printTextRaw( e->font, e->w, e->h, e->x, e->y, &e->col, e->str );
+            break;
+
+         case GUIE_TEX:
+            gl_blitStatic( e->tex, e->x, e->y, e->colset ? &e->col : NULL );
+            break;
+
+         case GUIE_RADAR:
+            gui_radarRender( e->x, e->y );
+            break;
+      }
+   }
+}
+
+
+/**
+ * @brief Removes all the elements.
+ */
+void guie_cleanup (void)
+{
+   int i;
+   GuiElem *e;
+
+   if (guie_array == NULL)
+      return;
+
+   for (i=0; i<array_size(guie_array); i++) {
+      e = &guie_array[i];
+      if (e->tex != NULL)
+         gl_freeTexture( e->tex );
+      free( e->str );
+      free( e->cache );
+   }
+   array_free( guie_array );
+   guie_array = NULL;
+}
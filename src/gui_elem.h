@@ -0,0 +1,62 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+
+#ifndef GUI_ELEM_H
+#  define GUI_ELEM_H
+
+
+#include "opengl.h"
+
+
+/**
+ * @brief Player values an element can follow.
+ */
+typedef enum GuiBind_ {
+   GUI_BIND_NONE,       /**< Only changed from Lua. */
+   GUI_BIND_SHIELD,     /**< Shield over maximum shield. */
+   GUI_BIND_ARMOUR,     /**< Armour over maximum armour. */
+   GUI_BIND_ENERGY,     /**< Energy over maximum energy. */
+   GUI_BIND_FUEL,       /**< Fuel over maximum fuel. */
+   GUI_BIND_CREDITS,    /**< Credits, text only. */
+   GUI_BIND_CARGOFREE   /**< Free cargo space, text only. */
+} GuiBind;
+
+/**
+ * @brief Alignment of text elements.
+ */
+typedef enum GuiAlign_ {
+   GUI_ALIGN_LEFT,      /**< Starts at the position. */
+   GUI_ALIGN_CENTER,    /**< Centered in the maximum width. */
+   GUI_ALIGN_RIGHT      /**< Ends at the maximum width. */
+} GuiAlign;
+
+
+/*
+ * Creation and management.
+ */
+unsigned int guie_addBar( double x, double y, double w, double h,
+      const glColour *col, glTexture *tex, GuiBind bind );
+unsigned int guie_addText( int small, const char *str, double x, double y,
+      const glColour *col, int max, GuiAlign align, GuiBind bind );
+unsigned int guie_addTextBlock( int small, const char *str, double x, double y,
+      int w, int h, const glColour *col );
+unsigned int guie_addTex( glTexture *tex, double x, double y, const glColour *col );
+unsigned int guie_addRadar( double x, double y );
+int guie_setText( unsigned int id, const char *str );
+int guie_setValue( unsigned int id, double value );
+int guie_setColour( unsigned int id, const glColour *col );
+int guie_setVisible( unsigned int id, int visible );
+int guie_bind( const char *name );
+int guie_align( const char *name );
+
+/*
+ * Global stuff.
+ */
+void guie_render (void);
+void guie_cleanup (void);
+
+
+#endif /* GUI_ELEM_H */
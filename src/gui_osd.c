@@ -38,6 +38,7 @@ typedef struct OSD_s {
    int nitems; /**< Number of items on the list. */
 
    int active; /**< Active item. */
+   int wrap_w; /**< Width the items are wrapped to. */
 } OSD_t;
 
 
@@ -66,6 +67,8 @@ static int osd_hyphenLen = 0;
  */
 static OSD_t *osd_get( unsigned int osd );
 static int osd_free( OSD_t *osd );
+static void osd_wordwrap( OSD_t* osd );
+static void osd_freeChunks( OSD_t *osd );
 static void osd_calcDimensions (void);
 /* Sort. */
 static int osd_sortCompare( const void * arg1, const void * arg2 );
@@ -133,7 +136,7 @@ static void osd_sort (void)
  */
 unsigned int osd_create( const char *title, int nitems, const char **items, int priority )
 {
-   int i, j, n, m, l, s, w, t, id;
+   int i, id;
    OSD_t *osd;
 
    /* Create. */
@@ -150,9 +153,35 @@ unsigned int osd_create( const char *title, int nitems, const char **items, int
    osd->msg    = malloc( sizeof(char*) * nitems );
    osd->items  = malloc( sizeof(OSDmsg_s) * nitems );
    osd->nitems = nitems;
-   for (i=0; i<osd->nitems; i++) {
+   for (i=0; i<osd->nitems; i++)
       osd->msg[i] = strdup( items[i] );
+   osd_wordwrap( osd );
 
+   /* Sort them buggers. */
+   id = osd->id; /* WE MUST SAVE THE ID BEFORE WE SORT. Or we get stuck with an invalid osd pointer. */
+   osd_sort();
+
+   /* Recalculate dimensions. */
+   osd_calcDimensions();
+
+   return id;
+}
+
+
+/**
+ * @brief Wraps the items of an OSD to the current width.
+ *
+ * Done once when created and again only when the width changes, rendering
+ *  just prints the chunks.
+ *
+ *    @param osd OSD to wrap.
+ */
+static void osd_wordwrap( OSD_t* osd )
+{
+   int i, j, n, m, l, s, w, t;
+
+   osd->wrap_w = osd_w;
+   for (i=0; i<osd->nitems; i++) {
       l = strlen(osd->msg[i]); /* Message length. */
       n = 0; /* Text position. */
       j = 0; /* Lines. */
@@ -164,7 +193,7 @@ unsigned int osd_create( const char *title, int nitems, const char **items, int
 
          /* Test if tabbed. */
          if (j==0) {
-            if (items[i][n] == '\t') {
+            if (osd->msg[i][n] == '\t') {
                t  = 1;
                w = osd_w - osd_tabLen;
             }
@@ -175,7 +204,7 @@ unsigned int osd_create( const char *title, int nitems, const char **items, int
          }
 
          /* Get text size. */
-         s = gl_printWidthForText( &gl_smallFont, &items[i][n], w );
+         s = gl_printWidthForText( &gl_smallFont, &osd->msg[i][n], w );
 
          if ((j==0) && (t==1))
             w -= osd_hyphenLen;
@@ -192,20 +221,20 @@ unsigned int osd_create( const char *title, int nitems, const char **items, int
          if (j==0) {
             if (t==1) {
                osd->items[i].chunks[j] = malloc(s+4);
-               nsnprintf( osd->items[i].chunks[j], s+4, "   %s", &items[i][n+1] );
+               nsnprintf( osd->items[i].chunks[j], s+4, "   %s", &osd->msg[i][n+1] );
             }
             else {
                osd->items[i].chunks[j] = malloc(s+3);
-               nsnprintf( osd->items[i].chunks[j], s+3, "- %s", &items[i][n] );
+               nsnprintf( osd->items[i].chunks[j], s+3, "- %s", &osd->msg[i][n] );
             }
          }
          else if (t==1) {
             osd->items[i].chunks[j] = malloc(s+4);
-            nsnprintf( osd->items[i].chunks[j], s+4, "   %s", &items[i][n] );
+            nsnprintf( osd->items[i].chunks[j], s+4, "   %s", &osd->msg[i][n] );
          }
          else {
             osd->items[i].chunks[j] = malloc(s+1);
-            nsnprintf( osd->items[i].chunks[j], s+1, "%s", &items[i][n] );
+            nsnprintf( osd->items[i].chunks[j], s+1, "%s", &osd->msg[i][n] );
          }
 
          /* Go to next line. */
@@ -214,15 +243,23 @@ unsigned int osd_create( const char *title, int nitems, const char **items, int
       }
       osd->items[i].nchunks = j;
    }
+}
 
-   /* Sort them buggers. */
-   id = osd->id; /* WE MUST SAVE THE ID BEFORE WE SORT. Or we get stuck with an invalid osd pointer. */
-   osd_sort();
 
-   /* Recalculate dimensions. */
-   osd_calcDimensions();
+/**
+ * @brief Frees the wrapped items of an OSD.
+ */
+static void osd_freeChunks( OSD_t *osd )
+{
+   int i, j;
 
-   return id;
+   for (i=0; i<osd->nitems; i++) {
+      for (j=0; j<osd->items[i].nchunks; j++)
+         free(osd->items[i].chunks[j]);
+      free(osd->items[i].chunks);
+      osd->items[i].chunks  = NULL;
+      osd->items[i].nchunks = 0;
+   }
 }
 
 
@@ -252,17 +289,14 @@ static OSD_t *osd_get( unsigned int osd )
  */
 static int osd_free( OSD_t *osd )
 {
-   int i, j;
+   int i;
 
    if (osd->title != NULL)
       free(osd->title);
 
-   for(i=0; i<osd->nitems; i++) {
+   osd_freeChunks( osd );
+   for(i=0; i<osd->nitems; i++)
       free( osd->msg[i] );
-      for (j=0; j<osd->items[i].nchunks; j++)
-         free(osd->items[i].chunks[j]);
-      free(osd->items[i].chunks);
-   }
    free(osd->msg);
    free(osd->items);
 
@@ -360,6 +394,8 @@ int osd_getActive( unsigned int osd )
  */
 int osd_setup( int x, int y, int w, int h )
 {
+   int i;
+
    /* Set offsets. */
    osd_x = x;
    osd_y = y;
@@ -371,6 +407,17 @@ int osd_setup( int x, int y, int w, int h )
    osd_tabLen = gl_printWidthRaw( &gl_smallFont, "   " );
    osd_hyphenLen = gl_printWidthRaw( &gl_smallFont, "- " );
 
+   /* Wrap again what was wrapped to another width. */
+   if (osd_list == NULL)
+      return 0;
+   for (i=0; i<array_size(osd_list); i++) {
+      if (osd_list[i].wrap_w == osd_w)
+         continue;
+      osd_freeChunks( &osd_list[i] );
+      osd_wordwrap( &osd_list[i] );
+   }
+   osd_calcDimensions();
+
    return 0;
 }
 
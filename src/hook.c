@@ -39,9 +39,12 @@
 #include "mission.h"
 #include "space.h"
 #include "menu.h"
+#include "nhash.h"
+#include "array.h"
 
 
 #define HOOK_CHUNK   32 /**< Size to grow by when out of space */
+#define HOOK_ID_BUCKETS 256 /**< Buckets of the id table, must be power of two. */
 
 
 /**
@@ -54,6 +57,7 @@ typedef struct HookQueue_s {
    HookParam hparam[ HOOK_MAX_PARAM ]; /**< Parameters. */
 } HookQueue_t;
 static HookQueue_t *hook_queue   = NULL; /**< The hook queue. */
+static HookQueue_t *hook_queueTail = NULL; /**< Last element of the hook queue. */
 static int hook_atomic           = 0; /**< Whether or not hooks should be queued. */
 static ntime_t hook_time_accum   = 0; /**< Time accumulator. */
 
@@ -76,22 +80,29 @@ typedef enum HookType_e {
  */
 typedef struct Hook_ {
    struct Hook_ *next; /**< Linked list. */
+   struct Hook_ *next_id; /**< Next hook in the same id bucket. */
+   struct Hook_ *next_stack; /**< Next hook in the same stack. */
+   struct Hook_ *prev_stack; /**< Previous hook in the same stack. */
+   int stackid; /**< Index of the stack in hook_stacks. */
 
    unsigned int id; /**< unique id */
    char *stack; /**< stack it's a part of */
    int created; /**< Hook has just been created. */
+   unsigned int serial; /**< Creation order, tells apart hooks made while updating. */
    int delete; /**< indicates it should be deleted when possible */
    int ran_once; /**< Indicates if the hook already ran, useful when iterating. */
    int once; /**< Only run the hook once. */
 
    /* Timer information. */
    int is_timer; /**< Whether or not is actually a timer. */
-   double ms; /**< Milliseconds left. */
 
    /* Date information. */
    int is_date; /**< Whether or not it is a date hook. */
    ntime_t res; /**< Resolution to display. */
-   ntime_t acc; /**< Accumulated resolution. */
+
+   /* Scheduling of timer and date hooks. */
+   double key; /**< Clock value of its heap at which it is due. */
+   int heap; /**< Position in its heap, -1 if not in one. */
 
    HookType_t type; /**< Type of hook. */
    union {
@@ -112,7 +123,40 @@ typedef struct Hook_ {
  */
 static unsigned int hook_id   = 0; /**< Unique hook id generator. */
 static Hook* hook_list        = NULL; /**< Stack of hooks. */
+static Hook* hook_ids[ HOOK_ID_BUCKETS ]; /**< Hooks by id, chained through next_id. */
+
+
+/**
+ * @brief Hooks sharing a stack name, newest first like hook_list.
+ */
+typedef struct HookStack_ {
+   char *name; /**< Name of the stack. */
+   Hook *first; /**< First hook of the stack. */
+} HookStack;
+static HookStack *hook_stacks = NULL; /**< Known stacks. */
+static int hook_nstacks       = 0; /**< Number of known stacks. */
+static int hook_mstacks       = 0; /**< Memory allocated for known stacks. */
+static NameHash hook_stackNames; /**< Stack name to hook_stacks index. */
 static int hook_runningstack  = 0; /**< Check if stack is running. */
+static int hook_dirty         = 0; /**< Hooks are pending deletion. */
+static unsigned int hook_serial = 0; /**< Creation counter. */
+
+
+/**
+ * @brief Min-heap of hooks ordered by when they are due.
+ *
+ * Timer and date hooks are kept in one each so updates only touch the hooks
+ *  that are due instead of the whole stack.
+ */
+typedef struct HookHeap_ {
+   Hook **h; /**< Hooks, h[0] is due first. */
+   int n; /**< Number of hooks. */
+   int m; /**< Memory allocated. */
+} HookHeap;
+static HookHeap hook_timers   = { NULL, 0, 0 }; /**< Timer hooks keyed by hook_timerClock. */
+static HookHeap hook_dates    = { NULL, 0, 0 }; /**< Date hooks keyed by hook_dateClock. */
+static double hook_timerClock = 0.; /**< Time elapsed for timer hooks. */
+static ntime_t hook_dateClock = 0; /**< Game time elapsed for date hooks. */
 static int hook_loadingstack  = 0; /**< Check if the hooks are being loaded. */
 
 
@@ -122,10 +166,25 @@ static int hook_loadingstack  = 0; /**< Check if the hooks are being loaded. */
 /* Execution. */
 static int hooks_executeParam( const char* stack, HookParam *param );
 static void hooks_updateDateExecute( ntime_t change );
+static void hooks_updateTimers( int claims, unsigned int serial );
+static void hooks_updateDates( int claims, unsigned int serial );
+/* Scheduling. */
+static void hh_swap( HookHeap *hp, int i, int j );
+static void hh_up( HookHeap *hp, int i );
+static void hh_down( HookHeap *hp, int i );
+static void hh_push( HookHeap *hp, Hook *h );
+static Hook* hh_pop( HookHeap *hp );
+static void hh_remove( HookHeap *hp, Hook *h );
+static void hook_timerStart( Hook *h, double ms );
+static void hook_dateStart( Hook *h, ntime_t resolution );
 /* intern */
 static void hook_rmRaw( Hook *h );
+static void hook_markDelete( Hook *h );
 static void hooks_purgeList (void);
 static Hook* hook_get( unsigned int id );
+static void hook_setID( Hook *h, unsigned int id );
+static void hook_unlink( Hook *h );
+static int hook_stackGet( const char *stack, int create );
 static unsigned int hook_genID (void);
 static Hook* hook_new( HookType_t type, const char *stack );
 static int hook_parseParam( lua_State *L, HookParam *param );
@@ -151,13 +210,15 @@ static int hq_add( HookQueue_t *hq )
 
    /* Set as head. */
    if (hook_queue == NULL) {
-      hook_queue = hq;
+      hook_queue     = hq;
+      hook_queueTail = hq;
       return 0;
    }
 
-   /* Find tail. */
-   for (c=hook_queue; c->next != NULL; c=c->next);
-   c->next = hq;
+   /* Append to tail. */
+   c              = hook_queueTail;
+   c->next        = hq;
+   hook_queueTail = hq;
    return 0;
 }
 
@@ -184,6 +245,7 @@ static void hq_clear (void)
       hook_queue = hq->next;
       hq_free( hq );
    }
+   hook_queueTail = NULL;
 }
 
 
@@ -210,6 +272,8 @@ void hook_exclusionEnd( double dt )
       /* Move hook down. */
       hq = hook_queue;
       hook_queue = hq->next;
+      if (hook_queue == NULL)
+         hook_queueTail = NULL;
 
       /* Execute. */
       hooks_executeParam( hq->stack, hq->hparam );
@@ -301,7 +365,8 @@ static int hook_runMisn( Hook *hook, HookParam *param, int claims )
 {
    unsigned int id;
    Mission* misn;
-   int n;
+   int n, ret;
+   double t0;
 
    /* Simplicity. */
    id = hook->id;
@@ -309,7 +374,7 @@ static int hook_runMisn( Hook *hook, HookParam *param, int claims )
    /* Make sure it's valid. */
    if (hook->u.misn.parent == 0) {
       WARN("Trying to run hook with inexistant parent: deleting");
-      hook->delete = 1; /* so we delete it */
+      hook_markDelete( hook ); /* so we delete it */
       return -1;
    }
 
@@ -317,7 +382,7 @@ static int hook_runMisn( Hook *hook, HookParam *param, int claims )
    misn = hook_getMission( hook );
    if (misn == NULL) {
       WARN("Trying to run hook with parent not in player mission stack: deleting");
-      hook->delete = 1; /* so we delete it */
+      hook_markDelete( hook ); /* so we delete it */
       return -1;
    }
 
@@ -339,7 +404,10 @@ static int hook_runMisn( Hook *hook, HookParam *param, int claims )
 
    /* Run mission code. */
    hook->ran_once = 1;
-   if (misn_runFunc( misn, hook->u.misn.func, n ) < 0) { /* error has occurred */
+   t0  = nlua_profStart();
+   ret = misn_runFunc( misn, hook->u.misn.func, n );
+   nlua_profStop( t0, "misn:%s:%s", misn->data->name, hook->u.misn.func );
+   if (ret < 0) { /* error has occurred */
       WARN("Hook [%s] '%d' -> '%s' failed", hook->stack,
             hook->id, hook->u.misn.func);
       return -1;
@@ -358,6 +426,8 @@ static int hook_runEvent( Hook *hook, HookParam *param, int claims )
 {
    int ret;
    int n;
+   double t0;
+   const char *name;
 
    /* Must match claims. */
    if ((claims > 0) && (event_testClaims( hook->u.event.parent, cur_system->id ) != claims))
@@ -371,7 +441,7 @@ static int hook_runEvent( Hook *hook, HookParam *param, int claims )
    if (event_get(hook->u.event.parent) == NULL) {
       WARN("Hook [%s] '%d' -> '%s' failed, event does not exist. Deleting hook.", hook->stack,
             hook->id, hook->u.event.func);
-      hook->delete = 1; /* Set for deletion. */
+      hook_markDelete( hook ); /* Set for deletion. */
       return -1;
    }
 
@@ -384,7 +454,10 @@ static int hook_runEvent( Hook *hook, HookParam *param, int claims )
    n++;
 
    /* Run the hook. */
-   ret = event_runFunc( hook->u.event.parent, hook->u.event.func, n );
+   name = event_getData( hook->u.event.parent ); /* Event may end while running. */
+   t0   = nlua_profStart();
+   ret  = event_runFunc( hook->u.event.parent, hook->u.event.func, n );
+   nlua_profStop( t0, "event:%s:%s", name, hook->u.event.func );
    hook->ran_once = 1;
    if (ret < 0) {
       hook_rmRaw( hook );
@@ -425,7 +498,7 @@ static int hook_run( Hook *hook, HookParam *param, int claims )
 
       default:
          WARN("Invalid hook type '%d', deleting.", hook->type);
-         hook->delete = 1;
+         hook_markDelete( hook );
          return -1;
    }
 
@@ -441,7 +514,6 @@ static int hook_run( Hook *hook, HookParam *param, int claims )
 static unsigned int hook_genID (void)
 {
    unsigned int id;
-   Hook *h;
    id = ++hook_id; /* default id, not safe if loading */
 
    /* If not loading we can just return. */
@@ -449,9 +521,8 @@ static unsigned int hook_genID (void)
       return id;
 
    /* Must check ids for collisions. */
-   for (h=hook_list; h!=NULL; h=h->next)
-      if (id == h->id) /* Check for collision. */
-         return hook_genID(); /* recursively try again */
+   if (hook_get( id ) != NULL)
+      return hook_genID(); /* recursively try again */
 
    return id;
 }
@@ -479,9 +550,18 @@ static Hook* hook_new( HookType_t type, const char *stack )
 
    /* Fill out generic details. */
    new_hook->type    = type;
-   new_hook->id      = hook_genID();
    new_hook->stack   = strdup(stack);
    new_hook->created = 1;
+   new_hook->serial  = ++hook_serial;
+   new_hook->heap    = -1;
+   hook_setID( new_hook, hook_genID() );
+
+   /* Put at the front of its stack too. */
+   new_hook->stackid    = hook_stackGet( stack, 1 );
+   new_hook->next_stack = hook_stacks[ new_hook->stackid ].first;
+   if (new_hook->next_stack != NULL)
+      new_hook->next_stack->prev_stack = new_hook;
+   hook_stacks[ new_hook->stackid ].first = new_hook;
 
    /** @TODO fix this hack. */
    if (strcmp(stack,"safe")==0)
@@ -557,8 +637,7 @@ unsigned int hook_addTimerMisn( unsigned int parent, const char *func, double ms
    new_hook->u.misn.func   = strdup(func);
 
    /* Timer information. */
-   new_hook->is_timer      = 1;
-   new_hook->ms            = ms;
+   hook_timerStart( new_hook, ms );
 
    return new_hook->id;
 }
@@ -584,8 +663,7 @@ unsigned int hook_addTimerEvt( unsigned int parent, const char *func, double ms
    new_hook->u.event.func   = strdup(func);
 
    /* Timer information. */
-   new_hook->is_timer      = 1;
-   new_hook->ms            = ms;
+   hook_timerStart( new_hook, ms );
 
    return new_hook->id;
 }
@@ -599,8 +677,9 @@ static void hooks_purgeList (void)
    Hook *h, *hl;
 
    /* Do not run while stack is being run. */
-   if (hook_runningstack)
+   if (hook_runningstack || !hook_dirty)
       return;
+   hook_dirty = 0;
 
    /* Second pass to delete. */
    hl = NULL;
@@ -616,6 +695,7 @@ static void hooks_purgeList (void)
 
          /* Free. */
          h->next = NULL;
+         hook_unlink( h );
          hook_free( h );
 
          /* Last. */
@@ -646,47 +726,73 @@ void hooks_updateDate( ntime_t change )
  */
 static void hooks_updateDateExecute( ntime_t change )
 {
-   int j;
-   Hook *h;
+   unsigned int serial;
 
    /* Don't update without player. */
    if ((player.p == NULL) || player_isFlag(PLAYER_CREATING))
       return;
 
-   /* Clear creation flags. */
-   for (h=hook_list; h!=NULL; h=h->next)
-      h->created = 0;
+   /* Hooks created from here on don't get updated. */
+   serial = hook_serial;
 
-   /* On j=0 we increment all timers and try to run, then on j=1 we update the timers. */
+   /* First the claimed hooks that were left due, then the ones due now. */
    hook_runningstack++; /* running hooks */
-   for (j=1; j>=0; j--) {
-      for (h=hook_list; h!=NULL; h=h->next) {
-         /* Find valid date hooks. */
-         if (h->is_date == 0)
-            continue;
-         /* Don't update newly created hooks. */
-         if (h->created != 0)
-            continue;
+   hooks_updateDates( 1, serial );
+   hook_dateClock += change;
+   hooks_updateDates( 0, serial );
+   hook_runningstack--; /* not running hooks anymore */
 
-         /* Decrement timer and check to see if should run. */
-         if (j==0)
-            h->acc += change;
-         if (h->acc < h->res)
-            continue;
+   /* Second pass to delete. */
+   hooks_purgeList();
+}
 
-         /* Run the timer hook. */
-         hook_run( h, NULL, j );
-         /* Date hooks are not deleted. */
 
-         /* Time is modified at the end. */
-         if (j==1)
-            h->acc %= h->res; /* We'll skip all buggers. */
+/**
+ * @brief Runs the date hooks that are due.
+ *
+ * Hooks run in the unclaimed pass stay due, the claimed pass of the next
+ *  update runs them again and moves them to their next resolution.
+ *
+ *    @param claims Claims to run with.
+ *    @param serial Hooks created after it are left alone.
+ */
+static void hooks_updateDates( int claims, unsigned int serial )
+{
+   int i;
+   Hook *h, **keep;
+   ntime_t acc;
+
+   keep = NULL;
+   while ((hook_dates.n > 0) && (hook_dates.h[0]->key <= (double)hook_dateClock)) {
+      h = hh_pop( &hook_dates );
+      /* Gone for good. */
+      if (h->delete)
+         continue;
+      if (keep == NULL)
+         keep = array_create( Hook* );
+      array_push_back( &keep, h );
+      /* Don't update newly created hooks. */
+      if (h->serial > serial)
+         continue;
+
+      /* Run the date hook. */
+      hook_run( h, NULL, claims );
+
+      /* Time is modified at the end. */
+      if (claims) {
+         acc    = h->res + hook_dateClock - (ntime_t)h->key;
+         acc   %= h->res; /* We'll skip all buggers. */
+         h->key = (double)(hook_dateClock + h->res - acc);
       }
    }
-   hook_runningstack--; /* not running hooks anymore */
 
-   /* Second pass to delete. */
-   hooks_purgeList();
+   /* Put them back. */
+   if (keep != NULL) {
+      for (i=0; i<array_size(keep); i++)
+         if (!keep[i]->delete)
+            hh_push( &hook_dates, keep[i] );
+      array_free( keep );
+   }
 }
 
 
@@ -702,9 +808,7 @@ unsigned int hook_addDateMisn( unsigned int parent, const char *func, ntime_t re
    new_hook->u.misn.func   = strdup(func);
 
    /* Timer information. */
-   new_hook->is_date       = 1;
-   new_hook->res           = resolution;
-   new_hook->acc           = 0;
+   hook_dateStart( new_hook, resolution );
 
    return new_hook->id;
 }
@@ -722,9 +826,7 @@ unsigned int hook_addDateEvt( unsigned int parent, const char *func, ntime_t res
    new_hook->u.event.func   = strdup(func);
 
    /* Timer information. */
-   new_hook->is_date       = 1;
-   new_hook->res           = resolution;
-   new_hook->acc           = 0;
+   hook_dateStart( new_hook, resolution );
 
    return new_hook->id;
 }
@@ -735,45 +837,187 @@ unsigned int hook_addDateEvt( unsigned int parent, const char *func, ntime_t res
  */
 void hooks_update( double dt )
 {
-   int j;
-   Hook *h;
+   unsigned int serial;
 
    /* Don't update without player. */
    if ((player.p == NULL) || player_isFlag(PLAYER_CREATING))
       return;
 
-   /* Clear creation flags. */
-   for (h=hook_list; h!=NULL; h=h->next)
-      h->created = 0;
+   /* Hooks created from here on don't get updated. */
+   serial = hook_serial;
 
+   /* First the claimed hooks that were already due, then the ones due now. */
    hook_runningstack++; /* running hooks */
-   for (j=1; j>=0; j--) {
-      for (h=hook_list; h!=NULL; h=h->next) {
-         /* Not be deleting. */
-         if (h->delete)
-            continue;
-         /* Find valid timer hooks. */
-         if (h->is_timer == 0)
-            continue;
-         /* Don't update newly created hooks. */
-         if (h->created != 0)
-            continue;
+   hooks_updateTimers( 1, serial );
+   hook_timerClock += dt;
+   hooks_updateTimers( 0, serial );
+   hook_runningstack--; /* not running hooks anymore */
+
+   /* Second pass to delete. */
+   hooks_purgeList();
+}
 
-         /* Decrement timer and check to see if should run. */
-         if (j==0)
-            h->ms -= dt;
-         if (h->ms > 0.)
-            continue;
 
-         /* Run the timer hook. */
-         hook_run( h, NULL, j );
-         hook_rmRaw( h );
+/**
+ * @brief Runs and removes the timer hooks that are due.
+ *
+ *    @param claims Claims to run with.
+ *    @param serial Hooks created after it are left alone.
+ */
+static void hooks_updateTimers( int claims, unsigned int serial )
+{
+   int i;
+   Hook *h, **keep;
+
+   keep = NULL;
+   while ((hook_timers.n > 0) && (hook_timers.h[0]->key <= hook_timerClock)) {
+      h = hh_pop( &hook_timers );
+      /* Not be deleting. */
+      if (h->delete)
+         continue;
+      /* Don't update newly created hooks. */
+      if (h->serial > serial) {
+         if (keep == NULL)
+            keep = array_create( Hook* );
+         array_push_back( &keep, h );
+         continue;
       }
+
+      /* Run the timer hook. */
+      hook_run( h, NULL, claims );
+      hook_rmRaw( h );
    }
-   hook_runningstack--; /* not running hooks anymore */
 
-   /* Second pass to delete. */
-   hooks_purgeList();
+   /* Put them back. */
+   if (keep != NULL) {
+      for (i=0; i<array_size(keep); i++)
+         if (!keep[i]->delete)
+            hh_push( &hook_timers, keep[i] );
+      array_free( keep );
+   }
+}
+
+
+/**
+ * @brief Schedules a timer hook.
+ *
+ *    @param h Hook to schedule.
+ *    @param ms Time until it runs.
+ */
+static void hook_timerStart( Hook *h, double ms )
+{
+   h->is_timer = 1;
+   h->key      = hook_timerClock + ms;
+   hh_push( &hook_timers, h );
+}
+
+
+/**
+ * @brief Schedules a date hook.
+ *
+ *    @param h Hook to schedule.
+ *    @param resolution Game time between runs.
+ */
+static void hook_dateStart( Hook *h, ntime_t resolution )
+{
+   h->is_date = 1;
+   h->res     = resolution;
+   if (resolution <= 0) {
+      WARN("Date hook '%d' has invalid resolution %"PRId64", it will never run.",
+            h->id, resolution);
+      return;
+   }
+   h->key     = (double)(hook_dateClock + resolution);
+   hh_push( &hook_dates, h );
+}
+
+
+/**
+ * @brief Swaps two hooks of a heap.
+ */
+static void hh_swap( HookHeap *hp, int i, int j )
+{
+   Hook *t;
+   t        = hp->h[i];
+   hp->h[i] = hp->h[j];
+   hp->h[j] = t;
+   hp->h[i]->heap = i;
+   hp->h[j]->heap = j;
+}
+
+
+/**
+ * @brief Moves a hook up the heap until its parent is due before it.
+ */
+static void hh_up( HookHeap *hp, int i )
+{
+   while ((i > 0) && (hp->h[(i-1)/2]->key > hp->h[i]->key)) {
+      hh_swap( hp, i, (i-1)/2 );
+      i = (i-1)/2;
+   }
+}
+
+
+/**
+ * @brief Moves a hook down the heap until its children are due after it.
+ */
+static void hh_down( HookHeap *hp, int i )
+{
+   int c;
+   for (c=2*i+1; c<hp->n; c=2*i+1) {
+      if ((c+1 < hp->n) && (hp->h[c+1]->key < hp->h[c]->key))
+         c++;
+      if (hp->h[i]->key <= hp->h[c]->key)
+         break;
+      hh_swap( hp, i, c );
+      i = c;
+   }
+}
+
+
+/**
+ * @brief Adds a hook to a heap.
+ */
+static void hh_push( HookHeap *hp, Hook *h )
+{
+   if (hp->n >= hp->m) {
+      hp->m = MAX( 2*hp->m, HOOK_CHUNK );
+      hp->h = realloc( hp->h, hp->m * sizeof(Hook*) );
+   }
+   h->heap = hp->n;
+   hp->h[ hp->n++ ] = h;
+   hh_up( hp, h->heap );
+}
+
+
+/**
+ * @brief Removes the hook that is due first from a heap.
+ */
+static Hook* hh_pop( HookHeap *hp )
+{
+   Hook *h;
+   h = hp->h[0];
+   hh_remove( hp, h );
+   return h;
+}
+
+
+/**
+ * @brief Removes a hook from a heap.
+ */
+static void hh_remove( HookHeap *hp, Hook *h )
+{
+   int i;
+
+   i = h->heap;
+   h->heap = -1;
+   hp->n--;
+   if (i == hp->n)
+      return;
+   hp->h[i] = hp->h[ hp->n ];
+   hp->h[i]->heap = i;
+   hh_up( hp, i );
+   hh_down( hp, hp->h[i]->heap );
 }
 
 
@@ -813,11 +1057,21 @@ void hook_rm( unsigned int id )
  */
 static void hook_rmRaw( Hook *h )
 {
-   h->delete = 1;
+   hook_markDelete( h );
    hookL_unsetarg( h->id );
 }
 
 
+/**
+ * @brief Marks a hook for deletion by hooks_purgeList().
+ */
+static void hook_markDelete( Hook *h )
+{
+   h->delete  = 1;
+   hook_dirty = 1;
+}
+
+
 /**
  * @brief Removes all hooks belonging to parent mission.
  *
@@ -829,7 +1083,7 @@ void hook_rmMisnParent( unsigned int parent )
 
    for (h=hook_list; h!=NULL; h=h->next)
       if ((h->type==HOOK_TYPE_MISN) && (parent == h->u.misn.parent))
-         h->delete = 1;
+         hook_markDelete( h );
 }
 
 
@@ -844,7 +1098,7 @@ void hook_rmEventParent( unsigned int parent )
 
    for (h=hook_list; h!=NULL; h=h->next)
       if ((h->type==HOOK_TYPE_EVENT) && (parent == h->u.event.parent))
-         h->delete = 1;
+         hook_markDelete( h );
 }
 
 
@@ -891,7 +1145,7 @@ int hook_hasEventParent( unsigned int parent )
 
 static int hooks_executeParam( const char* stack, HookParam *param )
 {
-   int j;
+   int j, s;
    int run;
    Hook *h;
 
@@ -899,17 +1153,22 @@ static int hooks_executeParam( const char* stack, HookParam *param )
    if ((player.p == NULL) || player_isFlag(PLAYER_DESTROYED))
       return 0;
 
+   /* Stack nobody ever hooked. */
+   s = hook_stackGet( stack, 0 );
+   if (s < 0)
+      return 0;
+
    /* Reset the current stack's ran and creation flags. */
-   for (h=hook_list; h!=NULL; h=h->next)
-      if (strcmp(stack, h->stack)==0) {
-         h->ran_once = 0;
-         h->created = 0;
-      }
+   for (h=hook_stacks[s].first; h!=NULL; h=h->next_stack) {
+      h->ran_once = 0;
+      h->created = 0;
+   }
 
    run = 0;
    hook_runningstack++; /* running hooks */
    for (j=1; j>=0; j--) {
-      for (h=hook_list; h!=NULL; h=h->next) {
+      /* Only purgeList unlinks hooks and it doesn't run while we do. */
+      for (h=hook_stacks[s].first; h!=NULL; h=h->next_stack) {
          /* Should be deleted. */
          if (h->delete)
             continue;
@@ -919,9 +1178,6 @@ static int hooks_executeParam( const char* stack, HookParam *param )
          /* Don't update newly created hooks. */
          if (h->created != 0)
             continue;
-         /* Doesn't match stack. */
-         if (strcmp(stack, h->stack) != 0)
-            continue;
 
          /* Run hook. */
          hook_run( h, param, j );
@@ -930,10 +1186,6 @@ static int hooks_executeParam( const char* stack, HookParam *param )
    }
    hook_runningstack--; /* not running hooks anymore */
 
-   /* Check claims. */
-   if (run)
-      claim_activateAll();
-
    return run;
 }
 
@@ -991,7 +1243,7 @@ int hooks_run( const char* stack )
 static Hook* hook_get( unsigned int id )
 {
    Hook *h;
-   for (h=hook_list; h!=NULL; h=h->next)
+   for (h=hook_ids[ id & (HOOK_ID_BUCKETS-1) ]; h!=NULL; h=h->next_id)
       if (h->id == id)
          return h;
 
@@ -999,6 +1251,89 @@ static Hook* hook_get( unsigned int id )
 }
 
 
+/**
+ * @brief Changes the id of a hook, keeping the id table current.
+ *
+ *    @param h Hook to change, may not be in the table yet if its id is 0.
+ *    @param id New id of the hook.
+ */
+static void hook_setID( Hook *h, unsigned int id )
+{
+   Hook **p;
+
+   /* Leave the old bucket. */
+   if (h->id != 0) {
+      for (p=&hook_ids[ h->id & (HOOK_ID_BUCKETS-1) ]; *p!=NULL; p=&(*p)->next_id) {
+         if (*p == h) {
+            *p = h->next_id;
+            break;
+         }
+      }
+   }
+
+   /* Join the new one. */
+   h->id      = id;
+   p          = &hook_ids[ id & (HOOK_ID_BUCKETS-1) ];
+   h->next_id = *p;
+   *p         = h;
+}
+
+
+/**
+ * @brief Removes a hook from the id table and its stack, but not from hook_list.
+ *
+ *    @param h Hook to unlink.
+ */
+static void hook_unlink( Hook *h )
+{
+   Hook **p;
+
+   for (p=&hook_ids[ h->id & (HOOK_ID_BUCKETS-1) ]; *p!=NULL; p=&(*p)->next_id) {
+      if (*p == h) {
+         *p = h->next_id;
+         break;
+      }
+   }
+
+   if (h->prev_stack != NULL)
+      h->prev_stack->next_stack = h->next_stack;
+   else
+      hook_stacks[ h->stackid ].first = h->next_stack;
+   if (h->next_stack != NULL)
+      h->next_stack->prev_stack = h->prev_stack;
+   h->next_stack = NULL;
+   h->prev_stack = NULL;
+}
+
+
+/**
+ * @brief Gets the index of a stack by name.
+ *
+ *    @param stack Name of the stack.
+ *    @param create Whether to create the stack if it doesn't exist.
+ *    @return Index of the stack in hook_stacks or -1 if not found.
+ */
+static int hook_stackGet( const char *stack, int create )
+{
+   int s;
+
+   s = nhash_get( &hook_stackNames, stack );
+   if ((s >= 0) || !create)
+      return s;
+
+   /* New stack. */
+   if (hook_nstacks >= hook_mstacks) {
+      hook_mstacks += HOOK_CHUNK;
+      hook_stacks   = realloc( hook_stacks, sizeof(HookStack) * hook_mstacks );
+   }
+   s = hook_nstacks++;
+   hook_stacks[s].name  = strdup( stack );
+   hook_stacks[s].first = NULL;
+   nhash_set( &hook_stackNames, hook_stacks[s].name, s );
+   return s;
+}
+
+
 /**
  * @brief Gets the lua env for a hook.
  */
@@ -1078,6 +1413,10 @@ static void hook_free( Hook *h )
    /* Remove from all the pilots. */
    pilots_rmHook( h->id );
 
+   /* No longer scheduled. */
+   if (h->heap >= 0)
+      hh_remove( h->is_timer ? &hook_timers : &hook_dates, h );
+
    /* Generic freeing. */
    if (h->stack != NULL)
       free(h->stack);
@@ -1108,6 +1447,7 @@ static void hook_free( Hook *h )
 void hook_cleanup (void)
 {
    Hook *h, *hn;
+   int i;
 
    if (hook_runningstack)
       WARN("Running hook_cleanup while hook stack is being run!");
@@ -1123,6 +1463,25 @@ void hook_cleanup (void)
    }
    /* sane defaults just in case */
    hook_list  = NULL;
+   memset( hook_ids, 0, sizeof(hook_ids) );
+
+   /* Stacks are always empty now. */
+   for (i=0; i<hook_nstacks; i++)
+      free( hook_stacks[i].name );
+   free( hook_stacks );
+   hook_stacks  = NULL;
+   hook_nstacks = 0;
+   hook_mstacks = 0;
+   nhash_free( &hook_stackNames );
+
+   /* Nothing left to schedule. */
+   free( hook_timers.h );
+   free( hook_dates.h );
+   memset( &hook_timers, 0, sizeof(HookHeap) );
+   memset( &hook_dates, 0, sizeof(HookHeap) );
+   hook_timerClock = 0.;
+   hook_dateClock  = 0;
+   hook_dirty      = 0;
 }
 
 
@@ -1334,16 +1693,13 @@ static int hook_parse( xmlNodePtr base )
             new_id = hook_addEvent( parent, func, stack );
 
          /* Set the id. */
-         if (id != 0) {
-            h = hook_get( new_id );
-            h->id = id;
-         }
+         h = hook_get( new_id );
+         if (id != 0)
+            hook_setID( h, id );
 
          /* Additional info. */
-         if (is_date) {
-            h->is_date = 1;
-            h->res = res;
-         }
+         if (is_date)
+            hook_dateStart( h, res );
       }
    } while (xml_nextNode(node));
 
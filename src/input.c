@@ -114,6 +114,7 @@ const char *keybind_info[][3] = {
    { "mapzoomin", "Radar Zoom In", "Zooms in on the radar." },
    { "mapzoomout", "Radar Zoom Out", "Zooms out on the radar." },
    { "screenshot", "Screenshot", "Takes a screenshot." },
+   { "screenshotburst", "Screenshot Burst", "Starts or stops capturing a screenshot of every frame." },
    { "togglefullscreen", "Toggle Fullscreen", "Toggles between windowed and fullscreen mode." },
    { "pause", "Pause", "Pauses the game." },
    { "speed", "Toggle 2x Speed", "Toggles 2x speed modifier." },
@@ -276,6 +277,7 @@ void input_setDefault ( int wasd )
    input_setKeybind( "mapzoomin", KEYBIND_KEYBOARD, SDLK_KP_PLUS, NMOD_ALL );
    input_setKeybind( "mapzoomout", KEYBIND_KEYBOARD, SDLK_KP_MINUS, NMOD_ALL );
    input_setKeybind( "screenshot", KEYBIND_KEYBOARD, SDLK_KP_MULTIPLY, NMOD_ALL );
+   input_setKeybind( "screenshotburst", KEYBIND_NULL, SDLK_UNKNOWN, NMOD_NONE );
    input_setKeybind( "togglefullscreen", KEYBIND_KEYBOARD, SDLK_F11, NMOD_ALL );
    input_setKeybind( "pause", KEYBIND_KEYBOARD, SDLK_PAUSE, NMOD_ALL );
 
@@ -993,6 +995,8 @@ static void input_key( int keynum, double value, double kabs, int repeat )
    /* take a screenshot */
    } else if (KEY("screenshot")) {
       if (value==KEY_PRESS) player_screenshot();
+   } else if (KEY("screenshotburst")) {
+      if (value==KEY_PRESS) player_screenshotBurst();
 #if SDL_VERSION_ATLEAST(2,0,0)
    /* toggle fullscreen */
    } else if (KEY("togglefullscreen") && !repeat) {
@@ -1512,6 +1516,10 @@ void input_handle( SDL_Event* event )
          return; /* Toolkit absorbs everything mousy. */
    }
 
+   /* The game may react even while paused. */
+   if (event->type != SDL_MOUSEMOTION)
+      naev_sceneDirty();
+
    if (ovr_isOpen())
       if (ovr_input(event))
          return; /* Don't process if the map overlay wants it. */
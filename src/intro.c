@@ -27,6 +27,7 @@
 #include "nstd.h"
 #include "toolkit.h"
 #include "conf.h"
+#include "replay.h"
 
 
 #define INTRO_SPEED        30. /**< Speed of text in characters / second. */
@@ -265,7 +266,7 @@ static void intro_event_handler( int *stop, double *offset, double *vel )
 {
    SDL_Event event;           /* user key-press, mouse-push, etc. */
 
-   while (SDL_PollEvent(&event)) {
+   while (replay_pollEvent(&event)) {
 #if SDL_VERSION_ATLEAST(2,0,0)
       if (event.type == SDL_WINDOWEVENT &&
             event.window.event == SDL_WINDOWEVENT_RESIZED) {
@@ -92,13 +92,14 @@ static const char *land_windowNames[LAND_NUMWINDOWS] = {
 static int land_windowsMap[LAND_NUMWINDOWS]; /**< Mapping of windows. */
 static unsigned int *land_windows = NULL; /**< Landed window ids. */
 Planet* land_planet = NULL; /**< Planet player landed at. */
-static glTexture *gfx_exterior = NULL; /**< Exterior graphic of the landed planet. */
+static glTexDefer *gfx_exterior = NULL; /**< Exterior graphic of the landed planet. */
 
 /*
  * mission computer stack
  */
 static Mission* mission_computer = NULL; /**< Missions at the computer. */
 static int mission_ncomputer = 0; /**< Number of missions at the computer. */
+static int mission_computerGen = 0; /**< Whether the computer missions were generated this landing. */
 
 /*
  * Bar stuff.
@@ -133,6 +134,7 @@ static void land_stranded (void);
 static void land_createMainTab( unsigned int wid );
 static void land_cleanupWindow( unsigned int wid, char *name );
 static void land_changeTab( unsigned int wid, char *wgt, int old, int tab );
+static void land_tabOpen( int window );
 /* spaceport bar */
 static void bar_getDim( int wid,
       int *w, int *h, int *iw, int *ih, int *bw, int *bh );
@@ -405,7 +407,7 @@ static int bar_genList( unsigned int wid )
  */
 void bar_regen (void)
 {
-   if (!landed)
+   if (!landed || !land_tabGenerated(LAND_WINDOW_BAR))
       return;
    bar_genList( land_getWid(LAND_WINDOW_BAR) );
 }
@@ -870,7 +872,7 @@ static void land_cleanupWindow( unsigned int wid, char *name )
 
    /* Clean up possible stray graphic. */
    if (gfx_exterior != NULL) {
-      gl_freeTexture( gfx_exterior );
+      gl_freeDefer( gfx_exterior );
       gfx_exterior = NULL;
    }
 }
@@ -879,17 +881,68 @@ static void land_cleanupWindow( unsigned int wid, char *name )
 /**
  * @brief Gets the WID of a window by type.
  *
+ * Tabs other than the main one are only built when first visited, until
+ *  then they have no contents to update.
+ *
  *    @param window Type of window to get wid (LAND_WINDOW_MAIN, ...).
- *    @return 0 on error, otherwise the wid of the window.
+ *    @return 0 on error or if not built yet, otherwise the wid of the window.
  */
 unsigned int land_getWid( int window )
 {
    if (land_windowsMap[window] == -1)
       return 0;
+   if ((window != LAND_WINDOW_MAIN) && !land_tabGenerated(window))
+      return 0;
    return land_windows[ land_windowsMap[window] ];
 }
 
 
+/**
+ * @brief Builds a land tab if it wasn't already.
+ *
+ *    @param window Type of window to build (LAND_WINDOW_BAR, ...).
+ */
+static void land_tabOpen( int window )
+{
+   unsigned int w;
+
+   if ((land_windowsMap[window] == -1) || land_tabGenerated(window))
+      return;
+   w = land_windows[ land_windowsMap[window] ];
+
+   switch (window) {
+      case LAND_WINDOW_BAR:
+         bar_open( w );
+         break;
+      case LAND_WINDOW_MISSION:
+         /* Generated the first time the computer is used on each landing. */
+         if (!mission_computerGen) {
+            mission_computer = missions_genList( &mission_ncomputer,
+                  land_planet->faction, land_planet->name, cur_system->name,
+                  MIS_AVAIL_COMPUTER );
+            mission_computerGen = 1;
+         }
+         misn_open( w );
+         break;
+      case LAND_WINDOW_OUTFITS:
+         outfits_open( w );
+         break;
+      case LAND_WINDOW_SHIPYARD:
+         shipyard_open( w );
+         break;
+      case LAND_WINDOW_EQUIPMENT:
+         equipment_open( w );
+         break;
+      case LAND_WINDOW_COMMODITY:
+         commodity_exchange_open( w );
+         break;
+
+      default:
+         break;
+   }
+}
+
+
 /**
  * @brief Recreates the land windows.
  *
@@ -979,8 +1032,9 @@ void land_genWindows( int load, int changetab )
     *
     *  1) Create main tab - must have decent background.
     *  2) Set landed, play music and run land hooks - so hooks run well.
-    *  3) Generate missions - so that campaigns are fluid.
-    *  4) Create other tabs - lists depend on NPC and missions.
+    *  3) Generate bar missions - so that campaigns are fluid.
+    *  4) Other tabs and the mission computer are created when first
+    *     visited - lists depend on NPC and missions.
     */
 
    /* 1) Create main tab. */
@@ -998,44 +1052,14 @@ void land_genWindows( int load, int changetab )
       }
       events_trigger( EVENT_TRIGGER_LAND );
 
-      /* 3) Generate computer and bar missions. */
-      if (planet_hasService(land_planet, PLANET_SERVICE_MISSIONS))
-         mission_computer = missions_genList( &mission_ncomputer,
-               land_planet->faction, land_planet->name, cur_system->name,
-               MIS_AVAIL_COMPUTER );
+      /* 3) Generate bar missions. */
       if (planet_hasService(land_planet, PLANET_SERVICE_BAR))
          npc_generate(); /* Generate bar npc. */
    }
 
-   /* 4) Create other tabs. */
-#define should_open(s, w) \
-   (planet_hasService(land_planet, s) && (!land_tabGenerated(w)))
-
-   /* Things get a bit hairy here. Hooks may have triggered a GUI reload via
-    * e.g. player.swapShip, so the land tabs may have been generated already
-    * and we need to check that before regenerating them.
-    */
-
-   /* Basic - bar + missions */
-   if (should_open( PLANET_SERVICE_BAR, LAND_WINDOW_BAR ))
-      bar_open( land_getWid(LAND_WINDOW_BAR) );
-   if (should_open( PLANET_SERVICE_MISSIONS, LAND_WINDOW_MISSION ))
-      misn_open( land_getWid(LAND_WINDOW_MISSION) );
-   /* Outfits. */
-   if (should_open( PLANET_SERVICE_OUTFITS, LAND_WINDOW_OUTFITS ))
-      outfits_open( land_getWid(LAND_WINDOW_OUTFITS) );
-   /* Shipyard. */
-   if (should_open( PLANET_SERVICE_SHIPYARD, LAND_WINDOW_SHIPYARD ))
-      shipyard_open( land_getWid(LAND_WINDOW_SHIPYARD) );
-   /* Equipment. */
-   if ((planet_hasService(land_planet, PLANET_SERVICE_OUTFITS) ||
-         planet_hasService(land_planet, PLANET_SERVICE_SHIPYARD)) &&
-         !land_tabGenerated( LAND_WINDOW_EQUIPMENT ))
-      equipment_open( land_getWid(LAND_WINDOW_EQUIPMENT) );
-   /* Commodity. */
-   if (should_open( PLANET_SERVICE_COMMODITY, LAND_WINDOW_COMMODITY ))
-      commodity_exchange_open( land_getWid(LAND_WINDOW_COMMODITY) );
-#undef should_open
+   /* 4) Other tabs get built by land_changeTab(). Hooks may have triggered a
+    * GUI reload via e.g. player.swapShip, in which case they are built again
+    * on their next visit. */
 
    if (!regen) {
       /* Reset markers if needed. */
@@ -1104,7 +1128,7 @@ void land( Planet* p, int load )
 
    /* Load stuff */
    land_planet = p;
-   gfx_exterior = gl_newImage( p->gfx_exterior, 0 );
+   gfx_exterior = gl_newImageDefer( p->gfx_exterior, 0 );
 
    /* Generate the news. */
    if (planet_hasService(land_planet, PLANET_SERVICE_BAR))
@@ -1156,7 +1180,8 @@ static void land_createMainTab( unsigned int wid )
    /*
     * Pretty display.
     */
-   window_addImage( wid, 20, -40, 0, 0, "imgPlanet", gfx_exterior, 1 );
+   /* Exterior graphics are 400x400, reserve the space while decoding. */
+   window_addImageDefer( wid, 20, -40, 400, 400, "imgPlanet", gfx_exterior, 1 );
    window_addText( wid, 440, -20-offset,
          w-460, h-20-offset-60-LAND_BUTTON_HEIGHT*2, 0,
          "txtPlanetDesc", &gl_smallFont, &cBlack, land_planet->description);
@@ -1205,6 +1230,7 @@ static void land_changeTab( unsigned int wid, char *wgt, int old, int tab )
    for (i=0; i<LAND_NUMWINDOWS; i++) {
       if (land_windowsMap[i] == tab) {
          last_window = i;
+         land_tabOpen( i );
          w = land_getWid( i );
 
          /* Must regenerate outfits. */
@@ -1262,7 +1288,7 @@ static void land_changeTab( unsigned int wid, char *wgt, int old, int tab )
       /* Run hooks, run after music in case hook wants to change music. */
       if (torun_hook != NULL)
          if (hooks_run( torun_hook ) > 0)
-            bar_genList( land_getWid(LAND_WINDOW_BAR) );
+            bar_regen();
 
       visited(to_visit);
 
@@ -1426,8 +1452,7 @@ void land_cleanup (void)
    land_wid       = 0;
 
    /* Clean up possible stray graphic. */
-   if (gfx_exterior != NULL)
-      gl_freeTexture( gfx_exterior );
+   gl_freeDefer( gfx_exterior );
    gfx_exterior   = NULL;
 
    /* Clean up mission computer. */
@@ -1437,6 +1462,7 @@ void land_cleanup (void)
       free(mission_computer);
    mission_computer  = NULL;
    mission_ncomputer = 0;
+   mission_computerGen = 0;
 
    /* Clean up bar missions. */
    npc_freeAll();
@@ -57,6 +57,8 @@ static void outfits_find( unsigned int wid, char* str );
 static credits_t outfit_getPrice( Outfit *outfit );
 static void outfits_genList( unsigned int wid );
 static void outfits_changeTab( unsigned int wid, char *wgt, int old, int tab );
+static void outfits_updateQuantity( unsigned int wid, Outfit *outfit );
+static void outfits_updateEquipment( void );
 
 
 /**
@@ -241,6 +243,7 @@ static void outfits_genList( unsigned int wid )
    Outfit **outfits;
    char **soutfits, **slottype, **quantity;
    glTexture **toutfits;
+   glTexDefer **defers;
    int noutfits, moutfits;
    int w, h, iw, ih;
    glColour *bg, blend;
@@ -283,6 +286,7 @@ static void outfits_genList( unsigned int wid )
       if (strlen(filtertext) == 0)
          filtertext = NULL;
    }
+   defers = NULL;
 
    /* set up the outfits to buy/sell */
    outfits = tech_getOutfit( land_planet->tech, &noutfits );
@@ -304,8 +308,10 @@ static void outfits_genList( unsigned int wid )
       quantity = malloc(sizeof(char*)*noutfits);
       bg       = malloc(sizeof(glColour)*noutfits);
       slottype = malloc(sizeof(char*)*noutfits);
+      defers   = malloc(sizeof(glTexDefer*)*noutfits);
       for (i=0; i<noutfits; i++) {
          soutfits[i] = strdup( outfits[i]->name );
+         defers[i]   = outfit_gfxStoreDefer( outfits[i] );
 
          /* Background colour. */
          c = outfit_slotSizeColour( &outfits[i]->slot );
@@ -351,6 +357,7 @@ static void outfits_genList( unsigned int wid )
       toolkit_setImageArrayQuantity( wid, OUTFITS_IAR, quantity );
       toolkit_setImageArraySlotType( wid, OUTFITS_IAR, slottype );
       toolkit_setImageArrayBackground( wid, OUTFITS_IAR, bg );
+      toolkit_setImageArrayDefer( wid, OUTFITS_IAR, defers );
    }
 }
 
@@ -404,7 +411,7 @@ void outfits_update( unsigned int wid, char* str )
    outfit = outfit_get( outfitname );
 
    /* new image */
-   window_modifyImage( wid, "imgOutfit", outfit->gfx_store, 0, 0 );
+   window_modifyImageDefer( wid, "imgOutfit", outfit_gfxStoreDefer(outfit), 0, 0 );
 
    if (outfit_canBuy(outfitname, land_planet) > 0)
       window_enableButton( wid, "btnBuyOutfit" );
@@ -462,19 +469,63 @@ void outfits_update( unsigned int wid, char* str )
  */
 void outfits_updateEquipmentOutfits( void )
 {
-   int ew, ow;
+   int ow;
 
    if (landed && land_doneLoading()) {
       if (planet_hasService(land_planet, PLANET_SERVICE_OUTFITS)) {
          ow = land_getWid( LAND_WINDOW_OUTFITS );
-         outfits_regenList( ow, NULL );
+         if (ow > 0)
+            outfits_regenList( ow, NULL );
       }
-      else if (!planet_hasService(land_planet, PLANET_SERVICE_SHIPYARD))
-         return;
-      ew = land_getWid( LAND_WINDOW_EQUIPMENT );
-      equipment_addAmmo();
+      outfits_updateEquipment();
+   }
+}
+
+
+/**
+ * @brief Updates the equipment outfit image arrays.
+ */
+static void outfits_updateEquipment( void )
+{
+   int ew;
+
+   if (!landed || !land_doneLoading())
+      return;
+   if (!planet_hasService(land_planet, PLANET_SERVICE_OUTFITS) &&
+         !planet_hasService(land_planet, PLANET_SERVICE_SHIPYARD))
+      return;
+
+   ew = land_getWid( LAND_WINDOW_EQUIPMENT );
+   equipment_addAmmo();
+   if (ew > 0)
       equipment_regenLists( ew, 1, 0 );
+}
+
+
+/**
+ * @brief Updates the owned quantity of the selected outfit.
+ *
+ * The outfits on sale don't change when buying or selling, so only the
+ *  selected element needs updating instead of regenerating the list.
+ *
+ *    @param wid Window of the outfitter.
+ *    @param outfit Outfit selected.
+ */
+static void outfits_updateQuantity( unsigned int wid, Outfit *outfit )
+{
+   int owned, len;
+   char *quantity;
+
+   owned    = player_outfitOwned( outfit );
+   quantity = NULL;
+   if (owned >= 1) {
+      len      = owned / 10 + 4;
+      quantity = malloc( len );
+      nsnprintf( quantity, len, "%d", owned );
    }
+   toolkit_setImageArrayQuantityElem( wid, OUTFITS_IAR,
+         toolkit_getImageArrayPos( wid, OUTFITS_IAR ), quantity );
+   outfits_update( wid, NULL );
 }
 
 
@@ -541,7 +592,7 @@ int outfits_filter( Outfit **outfits, glTexture **toutfits, int n,
       /* Shift matches downward. */
       outfits[j] = outfits[i];
       if (toutfits != NULL)
-         toutfits[j] = outfits[i]->gfx_store;
+         toutfits[j] = gl_deferGet( outfit_gfxStoreDefer( outfits[i] ) );
 
       j++;
    }
@@ -662,7 +713,8 @@ static void outfits_buy( unsigned int wid, char* str )
 
    /* Actually buy the outfit. */
    player_modCredits( -outfit->price * player_addOutfit( outfit, q ) );
-   outfits_updateEquipmentOutfits();
+   outfits_updateQuantity( wid, outfit );
+   outfits_updateEquipment();
 }
 /**
  * @brief Checks to see if the player can sell the selected outfit.
@@ -727,7 +779,8 @@ static void outfits_sell( unsigned int wid, char* str )
       return;
 
    player_modCredits( outfit->price * player_rmOutfit( outfit, q ) );
-   outfits_updateEquipmentOutfits();
+   outfits_updateQuantity( wid, outfit );
+   outfits_updateEquipment();
 }
 /**
  * @brief Gets the current modifier status.
@@ -156,6 +156,7 @@ void shipyard_open( unsigned int wid )
       tships = malloc(sizeof(glTexture*)*nships);
       for (i=0; i<nships; i++) {
          sships[i] = strdup(ships[i]->name);
+         ship_gfxLoad( ships[i] );
          tships[i] = ships[i]->gfx_store;
       }
       free(ships);
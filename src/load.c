@@ -13,6 +13,8 @@
 
 #include "naev.h"
 
+#include <sys/stat.h>
+
 #include "nxml.h"
 #include "log.h"
 #include "player.h"
@@ -33,6 +35,8 @@
 #include "hook.h"
 #include "nstring.h"
 #include "outfit.h"
+#include "save.h"
+#include "savebin.h"
 
 
 #define LOAD_WIDTH      600 /**< Load window width. */
@@ -41,8 +45,24 @@
 #define BUTTON_WIDTH    80 /**< Button width. */
 #define BUTTON_HEIGHT   30 /**< Button height. */
 
+#define LOAD_INDEX      "index.xml" /**< Save metadata index in the save directory. */
+
+
+/**
+ * @brief Cached metadata of a save file.
+ */
+typedef struct LoadIndex_ {
+   char *file; /**< Name of the save file. */
+   long mtime; /**< Modification time the metadata belongs to. */
+   long size; /**< File size the metadata belongs to. */
+   int seen; /**< Whether the file was found on the last refresh. */
+   nsave_t save; /**< Metadata of the save, without path. */
+} LoadIndex;
+
 
 static nsave_t *load_saves = NULL; /**< Array of save.s */
+static LoadIndex *load_index = NULL; /**< Save metadata index. */
+static int load_indexDirty = 0; /**< Whether the index needs to be written. */
 
 
 extern int save_loaded; /**< From save.c */
@@ -76,6 +96,13 @@ static void load_menu_close( unsigned int wdw, char *str );
 static void load_menu_load( unsigned int wdw, char *str );
 static void load_menu_delete( unsigned int wdw, char *str );
 static int load_load( nsave_t *save, const char *path );
+static void load_saveCopy( nsave_t *dest, const nsave_t *src );
+static void load_saveFree( nsave_t *ns );
+static int load_stat( const char *path, long *mtime, long *size );
+static LoadIndex* load_indexGet( const char *file, int create );
+static void load_indexRead (void);
+static int load_indexWrite (void);
+static int load_loadIndexed( nsave_t *save, const char *file, const char *path );
 
 
 /**
@@ -91,7 +118,7 @@ static int load_load( nsave_t *save, const char *path )
    memset( save, 0, sizeof(nsave_t) );
 
    /* Load the XML. */
-   doc   = xmlParseFile(path);
+   doc   = savebin_parseFile(path);
    if (doc == NULL) {
       WARN("Unable to parse save path '%s'.", path);
       return -1;
@@ -170,6 +197,281 @@ static int load_load( nsave_t *save, const char *path )
 }
 
 
+/**
+ * @brief Duplicates the metadata of a save.
+ */
+static void load_saveCopy( nsave_t *dest, const nsave_t *src )
+{
+   *dest = *src;
+   dest->name      = (src->name != NULL) ? strdup(src->name) : NULL;
+   dest->path      = (src->path != NULL) ? strdup(src->path) : NULL;
+   dest->data      = (src->data != NULL) ? strdup(src->data) : NULL;
+   dest->planet    = (src->planet != NULL) ? strdup(src->planet) : NULL;
+   dest->shipname  = (src->shipname != NULL) ? strdup(src->shipname) : NULL;
+   dest->shipmodel = (src->shipmodel != NULL) ? strdup(src->shipmodel) : NULL;
+}
+
+
+/**
+ * @brief Frees the metadata of a save.
+ */
+static void load_saveFree( nsave_t *ns )
+{
+   free(ns->path);
+   free(ns->name);
+   free(ns->data);
+   free(ns->planet);
+   free(ns->shipname);
+   free(ns->shipmodel);
+   memset( ns, 0, sizeof(nsave_t) );
+}
+
+
+/**
+ * @brief Gets what the index uses to tell whether a file changed.
+ *
+ *    @return 0 on success.
+ */
+static int load_stat( const char *path, long *mtime, long *size )
+{
+   struct stat sb;
+
+   if (stat( path, &sb ) != 0)
+      return -1;
+   *mtime = (long) sb.st_mtime;
+   *size  = (long) sb.st_size;
+   return 0;
+}
+
+
+/**
+ * @brief Gets the index entry of a save file.
+ *
+ *    @param file Name of the save file.
+ *    @param create Whether to create the entry if missing.
+ *    @return The entry or NULL if not found.
+ */
+static LoadIndex* load_indexGet( const char *file, int create )
+{
+   int i;
+   LoadIndex *e;
+
+   if (load_index == NULL)
+      load_indexRead();
+
+   for (i=0; i<array_size(load_index); i++)
+      if (strcmp( load_index[i].file, file ) == 0)
+         return &load_index[i];
+
+   if (!create)
+      return NULL;
+
+   e = &array_grow( &load_index );
+   memset( e, 0, sizeof(LoadIndex) );
+   e->file = strdup( file );
+   e->mtime = -1;
+   return e;
+}
+
+
+/**
+ * @brief Reads the save metadata index.
+ */
+static void load_indexRead (void)
+{
+   char path[PATH_MAX], *buf, *version;
+   xmlDocPtr doc;
+   xmlNodePtr node, cur;
+   LoadIndex *e;
+
+   load_index = array_create( LoadIndex );
+
+   nsnprintf( path, sizeof(path), "%ssaves/"LOAD_INDEX, nfile_dataPath() );
+   if (!nfile_fileExists( path ))
+      return;
+   doc = xmlParseFile( path );
+   if (doc == NULL) {
+      load_indexDirty = 1;
+      return;
+   }
+
+   node = doc->xmlChildrenNode;
+   if (!xml_isNode(node,"saves")) {
+      load_indexDirty = 1;
+      xmlFreeDoc(doc);
+      return;
+   }
+
+   node = node->xmlChildrenNode;
+   do {
+      xml_onlyNodes(node);
+      if (!xml_isNode(node,"save"))
+         continue;
+
+      xmlr_attr(node,"file",buf);
+      if (buf == NULL)
+         continue;
+      e = &array_grow( &load_index );
+      memset( e, 0, sizeof(LoadIndex) );
+      e->file = buf;
+      xmlr_attr(node,"mtime",buf);
+      e->mtime = (buf != NULL) ? atol(buf) : -1;
+      free(buf);
+      xmlr_attr(node,"size",buf);
+      e->size = (buf != NULL) ? atol(buf) : -1;
+      free(buf);
+
+      version = NULL;
+      cur = node->xmlChildrenNode;
+      do {
+         xml_onlyNodes(cur);
+         xmlr_strd(cur,"name",e->save.name);
+         xmlr_strd(cur,"version",version);
+         xmlr_strd(cur,"data",e->save.data);
+         xmlr_strd(cur,"planet",e->save.planet);
+         xmlr_long(cur,"date",e->save.date);
+         xmlr_ulong(cur,"credits",e->save.credits);
+         xmlr_strd(cur,"shipname",e->save.shipname);
+         xmlr_strd(cur,"shipmodel",e->save.shipmodel);
+      } while (xml_nextNode(cur));
+
+      if (version != NULL) {
+         naev_versionParse( e->save.version, version, strlen(version) );
+         free(version);
+      }
+   } while (xml_nextNode(node));
+
+   xmlFreeDoc(doc);
+}
+
+
+/**
+ * @brief Writes the save metadata index.
+ *
+ *    @return 0 on success.
+ */
+static int load_indexWrite (void)
+{
+   char path[PATH_MAX];
+   int i;
+   xmlDocPtr doc;
+   xmlTextWriterPtr writer;
+   const LoadIndex *e;
+
+   writer = xmlNewTextWriterDoc(&doc, 0);
+   if (writer == NULL) {
+      WARN("Unable to create the save index writer.");
+      return -1;
+   }
+   xmlw_setParams( writer );
+   xmlw_start(writer);
+   xmlw_startElem(writer,"saves");
+   for (i=0; i<array_size(load_index); i++) {
+      e = &load_index[i];
+      if (e->mtime < 0)
+         continue;
+      xmlw_startElem(writer,"save");
+      xmlw_attr(writer,"file","%s",e->file);
+      xmlw_attr(writer,"mtime","%ld",e->mtime);
+      xmlw_attr(writer,"size","%ld",e->size);
+      if (e->save.name != NULL)
+         xmlw_elem(writer,"name","%s",e->save.name);
+      xmlw_elem(writer,"version","%d.%d.%d",
+            e->save.version[0], e->save.version[1], e->save.version[2]);
+      if (e->save.data != NULL)
+         xmlw_elem(writer,"data","%s",e->save.data);
+      if (e->save.planet != NULL)
+         xmlw_elem(writer,"planet","%s",e->save.planet);
+      xmlw_elem(writer,"date","%"PRIi64,e->save.date);
+      xmlw_elem(writer,"credits","%"CREDITS_PRI,e->save.credits);
+      if (e->save.shipname != NULL)
+         xmlw_elem(writer,"shipname","%s",e->save.shipname);
+      if (e->save.shipmodel != NULL)
+         xmlw_elem(writer,"shipmodel","%s",e->save.shipmodel);
+      xmlw_endElem(writer); /* "save" */
+   }
+   xmlw_endElem(writer); /* "saves" */
+   xmlw_done(writer);
+   xmlFreeTextWriter(writer);
+
+   nsnprintf( path, sizeof(path), "%ssaves/"LOAD_INDEX, nfile_dataPath() );
+   if (xmlSaveFileEnc( path, doc, "UTF-8" ) < 0)
+      WARN("Failed to write the save index '%s'.", path);
+   xmlFreeDoc(doc);
+   load_indexDirty = 0;
+   return 0;
+}
+
+
+/**
+ * @brief Records the metadata of a save that was just written.
+ *
+ * Saves the full file from having to be parsed to list it.
+ *
+ *    @param path Path of the save file.
+ *    @param save Metadata of the save, its path is ignored.
+ */
+void load_indexSet( const char *path, const nsave_t *save )
+{
+   LoadIndex *e;
+   const char *file;
+
+   file = strrchr( path, '/' );
+   file = (file != NULL) ? file+1 : path;
+
+   e = load_indexGet( file, 1 );
+   load_saveFree( &e->save );
+   if (load_stat( path, &e->mtime, &e->size )) {
+      e->mtime = -1;
+      return;
+   }
+   load_saveCopy( &e->save, save );
+   free( e->save.path );
+   e->save.path = NULL;
+   load_indexWrite();
+}
+
+
+/**
+ * @brief Gets the metadata of a save, from the index if it's still valid.
+ *
+ *    @param[out] save Metadata of the save.
+ *    @param file Name of the save file.
+ *    @param path Path of the save file.
+ *    @return 0 on success.
+ */
+static int load_loadIndexed( nsave_t *save, const char *file, const char *path )
+{
+   LoadIndex *e;
+   long mtime, size;
+
+   if (load_stat( path, &mtime, &size ))
+      return load_load( save, path );
+
+   /* Still good. */
+   e = load_indexGet( file, 1 );
+   e->seen = 1;
+   if ((e->mtime == mtime) && (e->size == size)) {
+      load_saveCopy( save, &e->save );
+      save->path = strdup( path );
+      return 0;
+   }
+
+   /* Parse the whole file. */
+   load_saveFree( &e->save );
+   e->mtime = -1;
+   load_indexDirty = 1;
+   if (load_load( save, path ))
+      return -1;
+   load_saveCopy( &e->save, save );
+   free( e->save.path );
+   e->save.path = NULL;
+   e->mtime = mtime;
+   e->size  = size;
+   return 0;
+}
+
+
 /**
  * @brief Loads or refreshes saved games.
  */
@@ -185,6 +487,7 @@ int load_refresh (void)
    load_saves = array_create( nsave_t );
 
    /* load the saves */
+   save_sync();
    files = nfile_readDir( &nfiles, "%ssaves", nfile_dataPath() );
    for (i=0; i<nfiles; i++) {
       len = strlen(files[i]);
@@ -221,20 +524,36 @@ int load_refresh (void)
       files[i+1]  = tmp;
    }
 
-   /* Allocate and parse. */
+   /* Allocate and parse, only what the index is missing. */
    ok = 0;
    ns = NULL;
+   if (load_index == NULL)
+      load_indexRead();
+   for (i=0; i<array_size(load_index); i++)
+      load_index[i].seen = 0;
    for (i=0; i<nfiles; i++) {
       if (!ok)
          ns = &array_grow( &load_saves );
       nsnprintf( buf, sizeof(buf), "%ssaves/%s", nfile_dataPath(), files[i] );
-      ok = load_load( ns, buf );
+      ok = load_loadIndexed( ns, files[i], buf );
    }
 
    /* If the save was invalid, array is 1 member too large. */
    if (ok)
       array_resize( &load_saves, array_size(load_saves)-1 );
 
+   /* Forget about files that are gone. */
+   for (i=array_size(load_index)-1; i>=0; i--) {
+      if (load_index[i].seen)
+         continue;
+      free( load_index[i].file );
+      load_saveFree( &load_index[i].save );
+      array_erase( &load_index, &load_index[i], &load_index[i+1] );
+      load_indexDirty = 1;
+   }
+   if (load_indexDirty)
+      load_indexWrite();
+
    /* Clean up memory. */
    for (i=0; i<nfiles; i++)
       free(files[i]);
@@ -255,20 +574,7 @@ void load_free (void)
    if (load_saves != NULL) {
       for (i=0; i<array_size(load_saves); i++) {
          ns = &load_saves[i];
-         free(ns->path);
-         if (ns->name != NULL)
-            free(ns->name);
-
-         if (ns->data != NULL)
-            free(ns->data);
-
-         if (ns->planet != NULL)
-            free(ns->planet);
-
-         if (ns->shipname != NULL)
-            free(ns->shipname);
-         if (ns->shipmodel != NULL)
-            free(ns->shipmodel);
+         load_saveFree( ns );
       }
       array_free( load_saves );
    }
@@ -481,6 +787,7 @@ static void load_menu_delete( unsigned int wdw, char *str )
    pos = toolkit_getListPos( wid, "lstSaves" );
    ns  = load_getList( &n );
    remove( ns[pos].path ); /* remove is portable and will call unlink on linux. */
+   save_snapshotFree(); /* Don't reload what was just deleted. */
 
    /* need to reload the menu */
    load_menu_close(wdw, NULL);
@@ -533,28 +840,53 @@ static void load_compatSlots (void)
 /**
  * @brief Actually loads a new game based on file.
  *
+ * The parsed savegame is kept as the snapshot to reload from.
+ *
  *    @param file File that contains the new game.
  *    @return 0 on success.
  */
 int load_game( const char* file, int version_diff )
 {
-   xmlNodePtr node;
    xmlDocPtr doc;
-   Planet *pnt;
 
    /* Make sure it exists. */
+   save_sync();
    if (!nfile_fileExists(file)) {
       dialogue_alert("Savegame file seems to have been deleted.");
       return -1;
    }
 
    /* Load the XML. */
-   doc   = xmlParseFile(file);
-   if (doc == NULL)
-      goto err;
+   doc   = savebin_parseFile(file);
+   if ((doc == NULL) || load_gameDoc( doc, version_diff )) {
+      if (doc != NULL)
+         xmlFreeDoc(doc);
+      WARN("Savegame '%s' invalid!", file);
+      return -1;
+   }
+
+   save_snapshotKeep( file, doc );
+   return 0;
+}
+
+
+/**
+ * @brief Loads a new game from a parsed savegame.
+ *
+ * The savegame is only read, so the same document can be loaded again.
+ *
+ *    @param doc Parsed savegame.
+ *    @param version_diff Version difference with the savegame.
+ *    @return 0 on success.
+ */
+int load_gameDoc( xmlDocPtr doc, int version_diff )
+{
+   xmlNodePtr node;
+   Planet *pnt;
+
    node  = doc->xmlChildrenNode; /* base node */
    if (node == NULL)
-      goto err_doc;
+      return -1;
 
    /* Clean up possible stuff that should be cleaned. */
    player_cleanup();
@@ -607,18 +939,10 @@ int load_game( const char* file, int version_diff )
    gui_setCargo();
    gui_setShip();
 
-   xmlFreeDoc(doc);
-
    /* Set loaded. */
    save_loaded = 1;
 
    return 0;
-
-err_doc:
-   xmlFreeDoc(doc);
-err:
-   WARN("Savegame '%s' invalid!", file);
-   return -1;
 }
 
 
@@ -10,6 +10,7 @@
 #include <stdint.h>
 
 #include "ntime.h"
+#include "nxml.h"
 
 
 /**
@@ -36,9 +37,11 @@ typedef struct nsave_s {
 
 void load_loadGameMenu (void);
 int load_game( const char* file, int version_diff );
+int load_gameDoc( xmlDocPtr doc, int version_diff );
 
 int load_refresh (void);
 void load_free (void);
+void load_indexSet( const char *path, const nsave_t *save );
 nsave_t *load_getList( int *n );
 
 
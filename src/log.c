@@ -6,6 +6,11 @@
  * @file log.c
  *
  * @brief Home of logprintf.
+ *
+ * Once log_init() is called messages are queued in a ring buffer and written
+ *  by a background thread, so slow terminals don't stall the caller. The
+ *  same message logged too often is only shown a few times per second, but
+ *  all of them are counted, see log_getCounts().
  */
 
 #include "log.h"
@@ -13,6 +18,7 @@
 #include "naev.h"
 #include "nfile.h"
 #include "nstring.h"
+#include "nhash.h"
 
 #include <stdio.h>
 #include <stdarg.h>
@@ -24,9 +30,59 @@
 #include <unistd.h> /* isatty */
 #endif
 
+#include "SDL.h"
+#include "SDL_thread.h"
+#include "SDL_mutex.h"
+
 #include "console.h"
 
 
+#define LOG_MSG_LEN     2048 /**< Maximum length of a message. */
+#define LOG_RING        256 /**< Messages that can be waiting to be written. */
+#define LOG_RATE_MAX    10 /**< Times a message is shown per rate window at most. */
+#define LOG_RATE_WINDOW 1000 /**< Length of a rate window in ms. */
+#define LOG_COUNTERS    1024 /**< Different messages counted at most. */
+
+
+/**
+ * @brief Message waiting to be written.
+ */
+typedef struct LogMsg_ {
+   FILE *stream; /**< Stream to write to. */
+   char msg[LOG_MSG_LEN]; /**< Message to write. */
+} LogMsg;
+
+
+/**
+ * @brief Counter of a message, keyed by its text.
+ */
+typedef struct LogCounter_ {
+   char *msg; /**< Text of the message. */
+   LogCount c; /**< Public counts. */
+   unsigned int window; /**< Start of the current rate window. */
+   unsigned int shown; /**< Times shown in the current rate window. */
+   unsigned int hidden; /**< Times hidden in the current rate window. */
+} LogCounter;
+
+
+/*
+ * Background writing, everything is protected by log_lock except for writing
+ *  to the streams which is protected by log_ioLock to keep the order.
+ */
+static SDL_mutex *log_lock    = NULL; /**< Lock for the ring and counters. */
+static SDL_mutex *log_ioLock  = NULL; /**< Lock for writing to the streams. */
+static SDL_cond *log_cond     = NULL; /**< Signals new messages or stopping. */
+static SDL_Thread *log_thread = NULL; /**< Writing thread. */
+static int log_running        = 0; /**< Whether the writing thread should run. */
+static LogMsg *log_ring       = NULL; /**< Messages waiting to be written. */
+static int log_head           = 0; /**< Next message to write. */
+static int log_nring          = 0; /**< Number of messages waiting. */
+static unsigned int log_dropped = 0; /**< Messages dropped for the ring being full. */
+static LogCounter *log_counters = NULL; /**< Message counters, the pointer never changes. */
+static int log_ncounters      = 0; /**< Number of counters. */
+static NameHash log_counterHash; /**< Maps message text to counters. */
+
+
 /**< Temporary storage buffers. */
 static char *outcopy = NULL;
 static char *errcopy = NULL;
@@ -51,6 +107,10 @@ int copying = 0;
  * Prototypes
  */
 static void log_append( FILE *stream, char *str );
+static int log_rate( const char *msg, FILE *stream );
+static void log_push( FILE *stream, const char *msg );
+static int log_writeRing( int max );
+static int log_threadFunc( void *data );
 
 /**
  * @brief Like fprintf but also prints to the naev console.
@@ -58,7 +118,7 @@ static void log_append( FILE *stream, char *str );
 int logprintf( FILE *stream, const char *fmt, ... )
 {
    va_list ap;
-   char buf[2048];
+   char buf[LOG_MSG_LEN];
 
    if (fmt == NULL)
       return 0;
@@ -68,6 +128,10 @@ int logprintf( FILE *stream, const char *fmt, ... )
       va_end( ap );
    }
 
+   /* Spammed messages are only counted. */
+   if (!log_rate( &buf[2], stream ))
+      return 0;
+
 #ifndef NOLOGPRINTFCONSOLE
    /* Add to console. */
    if (stream == stderr) {
@@ -83,11 +147,292 @@ int logprintf( FILE *stream, const char *fmt, ... )
    if (copying)
       log_append(stream, &buf[2]);
 
-   /* Also print to the stream. */
+   /* Also print to the stream, in the background if possible. */
+   if (log_running) {
+      log_push( stream, &buf[2] );
+      return strlen( &buf[2] );
+   }
    return fprintf( stream, "%s", &buf[2] );
 }
 
 
+/**
+ * @brief Counts a message and checks to see if it should be shown.
+ *
+ *    @param msg The formatted message.
+ *    @param stream Stream the message goes to.
+ *    @return 1 if the message should be shown.
+ */
+static int log_rate( const char *msg, FILE *stream )
+{
+   LogCounter *c;
+   unsigned int t, hidden;
+   char buf[128];
+   int i;
+
+   /* Not set up yet, can't be spam. */
+   if (log_lock == NULL)
+      return 1;
+
+   t = SDL_GetTicks();
+   hidden = 0;
+   SDL_mutexP( log_lock );
+   i = nhash_get( &log_counterHash, msg );
+   if (i < 0) {
+      /* Too many different messages, just show them. */
+      if (log_ncounters >= LOG_COUNTERS) {
+         SDL_mutexV( log_lock );
+         return 1;
+      }
+      i = log_ncounters++;
+      c = &log_counters[i];
+      memset( c, 0, sizeof(LogCounter) );
+      c->msg    = strdup( msg );
+      c->window = t;
+      strncpy( c->c.sample, msg, sizeof(c->c.sample)-1 );
+      c->c.sample[ strcspn( c->c.sample, "\n" ) ] = '\0';
+      nhash_set( &log_counterHash, c->msg, i );
+   }
+   c = &log_counters[i];
+   c->c.count++;
+
+   /* New window, report what was hidden in the last one. */
+   if (t - c->window >= LOG_RATE_WINDOW) {
+      hidden    = c->hidden;
+      c->window = t;
+      c->shown  = 0;
+      c->hidden = 0;
+   }
+   if (c->shown >= LOG_RATE_MAX) {
+      c->hidden++;
+      c->c.suppressed++;
+      SDL_mutexV( log_lock );
+      return 0;
+   }
+   c->shown++;
+   SDL_mutexV( log_lock );
+
+   if (hidden > 0) {
+      nsnprintf( buf, sizeof(buf), "   (%u similar messages not shown)\n", hidden );
+      if (log_running)
+         log_push( stream, buf );
+      else
+         fprintf( stream, "%s", buf );
+   }
+   return 1;
+}
+
+
+/**
+ * @brief Queues a message to be written by the background thread.
+ */
+static void log_push( FILE *stream, const char *msg )
+{
+   LogMsg *m;
+
+   SDL_mutexP( log_lock );
+   if (log_nring >= LOG_RING)
+      log_dropped++;
+   else {
+      m = &log_ring[ (log_head + log_nring) % LOG_RING ];
+      m->stream = stream;
+      strncpy( m->msg, msg, sizeof(m->msg)-1 );
+      m->msg[ sizeof(m->msg)-1 ] = '\0';
+      log_nring++;
+   }
+   SDL_CondSignal( log_cond );
+   SDL_mutexV( log_lock );
+}
+
+
+/**
+ * @brief Writes queued messages, the caller holds log_ioLock.
+ *
+ *    @param max Maximum number of messages to write.
+ *    @return Number of messages written.
+ */
+static int log_writeRing( int max )
+{
+   LogMsg m;
+   unsigned int dropped;
+   int n;
+
+   for (n=0; n<max; n++) {
+      SDL_mutexP( log_lock );
+      dropped     = log_dropped;
+      log_dropped = 0;
+      if (log_nring <= 0) {
+         SDL_mutexV( log_lock );
+         if (dropped > 0)
+            fprintf( stderr, "   (%u log messages dropped)\n", dropped );
+         break;
+      }
+      m         = log_ring[ log_head ];
+      log_head  = (log_head + 1) % LOG_RING;
+      log_nring--;
+      SDL_mutexV( log_lock );
+
+      if (dropped > 0)
+         fprintf( stderr, "   (%u log messages dropped)\n", dropped );
+      fprintf( m.stream, "%s", m.msg );
+   }
+   fflush( stdout );
+   return n;
+}
+
+
+/**
+ * @brief Writes messages as they are queued.
+ */
+static int log_threadFunc( void *data )
+{
+   (void) data;
+
+   for (;;) {
+      SDL_mutexP( log_lock );
+      while (log_running && (log_nring <= 0))
+         SDL_CondWait( log_cond, log_lock );
+      if (!log_running && (log_nring <= 0)) {
+         SDL_mutexV( log_lock );
+         break;
+      }
+      SDL_mutexV( log_lock );
+
+      SDL_mutexP( log_ioLock );
+      log_writeRing( LOG_RING );
+      SDL_mutexV( log_ioLock );
+   }
+   return 0;
+}
+
+
+/**
+ * @brief Starts writing messages in the background.
+ *
+ * Must be called after SDL_Init().
+ */
+void log_init (void)
+{
+   log_lock   = SDL_CreateMutex();
+   log_ioLock = SDL_CreateMutex();
+   log_cond   = SDL_CreateCond();
+   log_ring   = malloc( sizeof(LogMsg) * LOG_RING );
+   log_counters = malloc( sizeof(LogCounter) * LOG_COUNTERS );
+   nhash_init( &log_counterHash );
+
+   log_running = 1;
+   log_thread  = SDL_CreateThread( log_threadFunc,
+#if SDL_VERSION_ATLEAST(1,3,0)
+         "log_thread",
+#endif /* SDL_VERSION_ATLEAST(1,3,0) */
+         NULL );
+   if (log_thread == NULL) {
+      log_running = 0;
+      WARN("Unable to create log thread, logging synchronously.");
+   }
+}
+
+
+/**
+ * @brief Writes all the queued messages.
+ *
+ * Called before aborting so nothing is lost.
+ */
+void log_flush (void)
+{
+   if (log_ioLock == NULL)
+      return;
+
+   SDL_mutexP( log_ioLock );
+   log_writeRing( LOG_RING );
+   fflush( stderr );
+   SDL_mutexV( log_ioLock );
+}
+
+
+/**
+ * @brief Stops writing in the background, writing what is left.
+ */
+void log_exit (void)
+{
+   int i;
+
+   if (log_lock == NULL)
+      return;
+
+   /* Stop the thread, it writes what is left. */
+   if (log_thread != NULL) {
+      SDL_mutexP( log_lock );
+      log_running = 0;
+      SDL_CondSignal( log_cond );
+      SDL_mutexV( log_lock );
+      SDL_WaitThread( log_thread, NULL );
+      log_thread = NULL;
+   }
+   log_running = 0;
+   log_flush();
+
+   SDL_DestroyCond( log_cond );
+   SDL_DestroyMutex( log_ioLock );
+   SDL_DestroyMutex( log_lock );
+   log_cond   = NULL;
+   log_ioLock = NULL;
+   log_lock   = NULL;
+   free( log_ring );
+   log_ring   = NULL;
+   nhash_free( &log_counterHash );
+   for (i=0; i<log_ncounters; i++)
+      free( log_counters[i].msg );
+   free( log_counters );
+   log_counters  = NULL;
+   log_ncounters = 0;
+}
+
+
+/**
+ * @brief Compares counters by how often they were logged.
+ */
+static int log_countCompare( const void *p1, const void *p2 )
+{
+   const LogCount *c1, *c2;
+   c1 = (const LogCount*) p1;
+   c2 = (const LogCount*) p2;
+   if (c1->count != c2->count)
+      return (c1->count < c2->count) ? 1 : -1;
+   return strcmp( c1->sample, c2->sample );
+}
+
+
+/**
+ * @brief Gets the most logged messages.
+ *
+ *    @param[out] counts Counts of the messages, most logged first.
+ *    @param max Maximum number of counts to get.
+ *    @return Number of counts gotten.
+ */
+int log_getCounts( LogCount *counts, int max )
+{
+   LogCount *all;
+   int i, n;
+
+   if (log_lock == NULL)
+      return 0;
+
+   SDL_mutexP( log_lock );
+   n   = log_ncounters;
+   all = malloc( sizeof(LogCount) * MAX(n,1) );
+   for (i=0; i<n; i++)
+      all[i] = log_counters[i].c;
+   SDL_mutexV( log_lock );
+
+   qsort( all, n, sizeof(LogCount), log_countCompare );
+   n = MIN( n, max );
+   memcpy( counts, all, sizeof(LogCount) * n );
+   free( all );
+   return n;
+}
+
+
 /**
  * @brief Redirects stdout and stderr to files.
  *
@@ -115,12 +460,20 @@ void log_redirect (void)
    outfiledouble = malloc(PATH_MAX);
    errfiledouble = malloc(PATH_MAX);
 
+   /* Don't swap the streams under the writing thread. */
+   log_flush();
+   if (log_ioLock != NULL)
+      SDL_mutexP( log_ioLock );
+
    nsnprintf( outfile, PATH_MAX, "%slogs/stdout.txt", nfile_dataPath() );
    freopen( outfile, "w", stdout );
 
    nsnprintf( errfile, PATH_MAX, "%slogs/stderr.txt", nfile_dataPath() );
    freopen( errfile, "w", stderr );
 
+   if (log_ioLock != NULL)
+      SDL_mutexV( log_ioLock );
+
    nsnprintf( outfiledouble, PATH_MAX, "%slogs/%s_stdout.txt", nfile_dataPath(), timestr );
    nsnprintf( errfiledouble, PATH_MAX, "%slogs/%s_stderr.txt", nfile_dataPath(), timestr );
 
@@ -195,11 +548,17 @@ void log_copy( int enable )
       return;
    }
 
+   /* Queued messages were already copied. */
+   log_flush();
+   if (log_ioLock != NULL)
+      SDL_mutexP( log_ioLock );
    if (noutcopy)
       fprintf( stdout, "%s", outcopy );
 
    if (nerrcopy)
       fprintf( stderr, "%s", errcopy );
+   if (log_ioLock != NULL)
+      SDL_mutexV( log_ioLock );
 
    log_purge();
 }
@@ -15,11 +15,11 @@
 
 #define LOG(str, args...)  (logprintf(stdout,str"\n", ## args))
 #ifdef DEBUG_PARANOID /* Will cause WARNs to blow up */
-#define WARN(str, args...) (logprintf(stderr,"Warning: [%s] "str"\n", __func__, ## args), abort())
+#define WARN(str, args...) (logprintf(stderr,"Warning: [%s] "str"\n", __func__, ## args), log_flush(), abort())
 #else /* DEBUG_PARANOID */
 #define WARN(str, args...) (logprintf(stderr,"Warning: [%s] "str"\n", __func__, ## args))
 #endif /* DEBUG_PARANOID */
-#define ERR(str, args...)  (logprintf(stderr,"ERROR %s:%d [%s]: "str"\n", __FILE__, __LINE__, __func__, ## args), abort())
+#define ERR(str, args...)  (logprintf(stderr,"ERROR %s:%d [%s]: "str"\n", __FILE__, __LINE__, __func__, ## args), log_flush(), abort())
 #ifdef DEBUG
 #  undef DEBUG
 #  define DEBUG(str, args...) LOG(str, ## args)
@@ -31,7 +31,24 @@
 #endif /* DEBUG */
 
 
+#define LOG_SAMPLE_LEN  64 /**< Characters of a message kept for its counter. */
+
+
+/**
+ * @brief How often a message was logged.
+ */
+typedef struct LogCount_ {
+   char sample[LOG_SAMPLE_LEN]; /**< Start of the message as first logged. */
+   unsigned int count; /**< Times it was logged. */
+   unsigned int suppressed; /**< Times it was not shown for being repeated too often. */
+} LogCount;
+
+
 int logprintf( FILE *stream, const char *fmt, ... );
+void log_init (void);
+void log_exit (void);
+void log_flush (void);
+int log_getCounts( LogCount *counts, int max );
 void log_redirect (void);
 int log_isTerminal (void);
 void log_copy( int enable );
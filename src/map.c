@@ -11,6 +11,9 @@
 #include <stdio.h>
 #include <math.h>
 #include <float.h>
+#include <limits.h>
+#include <string.h>
+#include <stdint.h>
 
 #include "log.h"
 #include "toolkit.h"
@@ -34,9 +37,13 @@
 #define BUTTON_WIDTH    80 /**< Map button width. */
 #define BUTTON_HEIGHT   30 /**< Map button height. */
 
+#define MAP_TRADE_JUMPS 6 /**< Jumps the trade button plans routes over. */
+
+#define MAP_RING_POINTS 32 /**< Vertices of a cached system ring. */
+#define MAP_NAME_ZOOM   0.5 /**< Zoom at or below which names are hidden. */
+#define MAP_NAME_DENSE  1. /**< Zoom below which overlapping names are dropped. */
+
 
-#define MAP_LOOP_PROT   1000 /**< Number of iterations max in pathfinding before
-                                 aborting. */
 
 
 static double map_zoom        = 1.; /**< Zoom of the map. */
@@ -53,6 +60,38 @@ glTexture *gl_map_circle      = NULL; /**< Texture of the circle used for system
 static gl_vbo *map_vbo = NULL; /**< Map VBO. */
 
 
+/**
+ * @brief Layers of static map geometry that get cached.
+ */
+typedef enum MapLayer_ {
+   MAP_LAYER_DISKS, /**< Faction disks. */
+   MAP_LAYER_JUMPS, /**< Jump routes. */
+   MAP_LAYER_RINGS, /**< System rings. */
+   MAP_LAYER_FILLS, /**< System fills. */
+   MAP_LAYERS /**< Number of layers. */
+} MapLayer;
+
+
+/**
+ * @brief Cached geometry of a layer, in zoomed map coordinates.
+ */
+typedef struct MapGeom_ {
+   gl_vbo *vbo; /**< Uploaded geometry. */
+   GLenum mode; /**< Primitive to draw. */
+   int textured; /**< Whether it has texture coordinates. */
+   int n; /**< Vertices in the layer. */
+   int m; /**< Vertices allocated. */
+   GLfloat *vertex; /**< Vertices being built. */
+   GLfloat *tex; /**< Texture coordinates being built. */
+   GLfloat *col; /**< Colours being built. */
+} MapGeom;
+static MapGeom map_geom[MAP_LAYERS]; /**< Cached layers. */
+static int map_geomValid      = 0; /**< Whether the cached layers are up to date. */
+static double map_geomZoom    = 0.; /**< Zoom the layers were built at. */
+static char *map_nameGrid     = NULL; /**< Cells covered by names when decimating. */
+static int map_nameGridSize   = 0; /**< Cells allocated in map_nameGrid. */
+
+
 /*
  * extern
  */
@@ -80,7 +119,17 @@ static int map_mouse( unsigned int wid, SDL_Event* event, double mx, double my,
 static glTexture *gl_genFactionDisk( int radius );
 static int map_keyHandler( unsigned int wid, SDLKey key, SDLMod mod );
 static void map_buttonZoom( unsigned int wid, char* str );
+static void map_buttonTrade( unsigned int wid, char* str );
 static void map_selectCur (void);
+/* Cached geometry. */
+static void map_geomVertex( MapGeom *g, double x, double y,
+      double tx, double ty, const glColour *c, double a );
+static void map_geomQuad( MapGeom *g, double x, double y, double w, double h,
+      const glTexture *tex, const glColour *c );
+static void map_geomBuild( double r );
+static void map_geomUpdate( double r );
+static void map_geomRender( MapLayer layer, double x, double y, const glTexture *tex );
+static void map_geomFree (void);
 
 
 /**
@@ -114,6 +163,12 @@ void map_exit (void)
 
    if (gl_map_circle != NULL)
       gl_freeTexture( gl_map_circle );
+
+   map_graphInvalidate();
+   map_geomFree();
+   free( map_nameGrid );
+   map_nameGrid     = NULL;
+   map_nameGridSize = 0;
 }
 
 
@@ -160,6 +215,9 @@ void map_open (void)
    /* mark systems as needed */
    mission_sysMark();
 
+   /* Standings may have changed the system colours. */
+   map_geomInvalidate();
+
    /* Attempt to select current map if none is selected */
    if (map_selected == -1)
       map_selectCur();
@@ -255,6 +313,9 @@ void map_open (void)
    /* Autonav button */
    window_addButton( wid, -20 - 2*(BUTTON_WIDTH+20), 20, BUTTON_WIDTH, BUTTON_HEIGHT,
             "btnAutonav", "Autonav", player_autonavStartWindow );
+   /* Trade route button */
+   window_addButton( wid, -20 - 3*(BUTTON_WIDTH+20), 20, BUTTON_WIDTH, BUTTON_HEIGHT,
+            "btnTrade", "Trade", map_buttonTrade );
 
    /*
     * Bottom stuff
@@ -688,6 +749,275 @@ static glTexture *gl_genFactionDisk( int radius )
    return gl_loadImage( sur, OPENGL_TEX_MIPMAPS );
 }
 
+/**
+ * @brief Marks the cached map geometry as out of date.
+ *
+ * Must be called when what is shown of the systems changes, such as when
+ *  they become known, get marked or have their faction or presence changed.
+ */
+void map_geomInvalidate (void)
+{
+   map_geomValid = 0;
+}
+
+
+/**
+ * @brief Adds a vertex to a cached layer.
+ */
+static void map_geomVertex( MapGeom *g, double x, double y,
+      double tx, double ty, const glColour *c, double a )
+{
+   if (g->n >= g->m) {
+      g->m    = MAX( 2*g->m, 256 );
+      g->vertex = realloc( g->vertex, sizeof(GLfloat) * 2 * g->m );
+      g->col  = realloc( g->col, sizeof(GLfloat) * 4 * g->m );
+      if (g->textured)
+         g->tex = realloc( g->tex, sizeof(GLfloat) * 2 * g->m );
+   }
+
+   g->vertex[2*g->n+0] = x;
+   g->vertex[2*g->n+1] = y;
+   if (g->textured) {
+      g->tex[2*g->n+0] = tx;
+      g->tex[2*g->n+1] = ty;
+   }
+   g->col[4*g->n+0] = c->r;
+   g->col[4*g->n+1] = c->g;
+   g->col[4*g->n+2] = c->b;
+   g->col[4*g->n+3] = a;
+   g->n++;
+}
+
+
+/**
+ * @brief Adds a textured quad covering the whole texture to a cached layer.
+ */
+static void map_geomQuad( MapGeom *g, double x, double y, double w, double h,
+      const glTexture *tex, const glColour *c )
+{
+   double tx, ty, tw, th;
+
+   tx = tex->ox;
+   ty = tex->oy;
+   tw = tex->srw;
+   th = tex->srh;
+   map_geomVertex( g, x,   y,   tx,    ty,    c, c->a );
+   map_geomVertex( g, x+w, y,   tx+tw, ty,    c, c->a );
+   map_geomVertex( g, x+w, y+h, tx+tw, ty+th, c, c->a );
+   map_geomVertex( g, x,   y+h, tx,    ty+th, c, c->a );
+}
+
+
+/**
+ * @brief Builds the cached geometry of the map at the current zoom.
+ *
+ * Mirrors what map_renderFactionDisks(), map_renderJumps() and
+ *  map_renderSystems() draw outside of the editor.
+ *
+ *    @param r Radius of the systems.
+ */
+static void map_geomBuild( double r )
+{
+   int i, j, k;
+   const glColour *col, *cole;
+   glColour c;
+   StarSystem *sys, *jsys;
+   MapGeom *g;
+   double tx, ty, mx, my, presence, sw, a;
+   double cosi, sini, xc, yc, nxc;
+
+   for (i=0; i<MAP_LAYERS; i++)
+      map_geom[i].n = 0;
+   map_geom[MAP_LAYER_DISKS].mode     = GL_QUADS;
+   map_geom[MAP_LAYER_DISKS].textured = 1;
+   map_geom[MAP_LAYER_JUMPS].mode     = GL_LINES;
+   map_geom[MAP_LAYER_RINGS].mode     = GL_LINES;
+   map_geom[MAP_LAYER_FILLS].mode     = GL_QUADS;
+   map_geom[MAP_LAYER_FILLS].textured = 1;
+
+   cosi = cos( 2. * M_PI / MAP_RING_POINTS );
+   sini = sin( 2. * M_PI / MAP_RING_POINTS );
+
+   for (i=0; i<systems_nstack; i++) {
+      sys = system_getIndex( i );
+      tx  = sys->pos.x * map_zoom;
+      ty  = sys->pos.y * map_zoom;
+
+      /* Faction disk. */
+      if ((sys->faction != -1) && sys_isKnown(sys)) {
+         presence = sqrt(sys->ownerpresence);
+         sw  = (int)((60 + presence * 3) * map_zoom);
+         col = faction_colour(sys->faction);
+         c.r = col->r;
+         c.g = col->g;
+         c.b = col->b;
+         c.a = CLAMP( .6, .75, 20 / presence );
+         map_geomQuad( &map_geom[MAP_LAYER_DISKS], tx - (int)sw/2, ty - (int)sw/2,
+               sw, sw, gl_faction_disk, &c );
+      }
+
+      /* Jump routes, split at the middle like the line strips. */
+      if (sys_isKnown(sys)) {
+         g = &map_geom[MAP_LAYER_JUMPS];
+         for (j=0; j<sys->njumps; j++) {
+            jsys = sys->jumps[j].target;
+            if (!space_sysReachableFromSys(jsys,sys))
+               continue;
+
+            cole = &cBlue;
+            for (k=0; k<jsys->njumps; k++) {
+               if (jsys->jumps[k].target == sys) {
+                  if (jp_isFlag(&jsys->jumps[k], JP_EXITONLY))
+                     cole = &cWhite;
+                  else if (jp_isFlag(&jsys->jumps[k], JP_HIDDEN))
+                     cole = &cRed;
+                  break;
+               }
+            }
+            if (jp_isFlag(&sys->jumps[j], JP_EXITONLY))
+               col = &cWhite;
+            else if (jp_isFlag(&sys->jumps[j], JP_HIDDEN))
+               col = &cRed;
+            else
+               col = &cBlue;
+
+            mx  = tx + (jsys->pos.x - sys->pos.x)/2. * map_zoom;
+            my  = ty + (jsys->pos.y - sys->pos.y)/2. * map_zoom;
+            c.r = (col->r + cole->r)/2.;
+            c.g = (col->g + cole->g)/2.;
+            c.b = (col->b + cole->b)/2.;
+            map_geomVertex( g, tx, ty, 0., 0., col, 0.2 );
+            map_geomVertex( g, mx, my, 0., 0., &c, 0.8 );
+            map_geomVertex( g, mx, my, 0., 0., &c, 0.8 );
+            map_geomVertex( g, jsys->pos.x * map_zoom, jsys->pos.y * map_zoom,
+                  0., 0., cole, 0.2 );
+         }
+      }
+
+      /* System has to be known, reachable or marked. */
+      if (!sys_isKnown(sys) && !sys_isFlag(sys, SYSTEM_MARKED | SYSTEM_CMARKED)
+            && !space_sysReachable(sys))
+         continue;
+
+      /* Outer ring. */
+      g  = &map_geom[MAP_LAYER_RINGS];
+      xc = 1.;
+      yc = 0.;
+      for (j=0; j<MAP_RING_POINTS; j++) {
+         map_geomVertex( g, tx + xc*r, ty + yc*r, 0., 0., &cInert, cInert.a );
+         nxc = cosi * xc - sini * yc;
+         yc  = sini * xc + cosi * yc;
+         xc  = nxc;
+         map_geomVertex( g, tx + xc*r, ty + yc*r, 0., 0., &cInert, cInert.a );
+      }
+
+      /* Known systems with planets get filled. */
+      if (sys_isKnown(sys) && system_hasPlanet(sys)) {
+         col = (sys->faction < 0) ? &cInert : faction_getColour( sys->faction );
+         a   = r * .65;
+         map_geomQuad( &map_geom[MAP_LAYER_FILLS], tx - a, ty - a, 2.*a, 2.*a,
+               gl_map_circle, col );
+      }
+   }
+
+   /* Upload. */
+   for (i=0; i<MAP_LAYERS; i++) {
+      g = &map_geom[i];
+      if (g->n == 0)
+         continue;
+      k = sizeof(GLfloat) * 2 * g->n;
+      if (g->vbo == NULL)
+         g->vbo = gl_vboCreateStatic( 0, NULL );
+      gl_vboData( g->vbo, g->textured ? 4*k : 3*k, NULL );
+      gl_vboSubData( g->vbo, 0, k, g->vertex );
+      if (g->textured) {
+         gl_vboSubData( g->vbo, k, k, g->tex );
+         gl_vboSubData( g->vbo, 2*k, 2*k, g->col );
+      }
+      else
+         gl_vboSubData( g->vbo, k, 2*k, g->col );
+   }
+   gl_checkErr();
+}
+
+
+/**
+ * @brief Rebuilds the cached geometry of the map if needed.
+ *
+ *    @param r Radius of the systems.
+ */
+static void map_geomUpdate( double r )
+{
+   if (map_geomValid && (map_geomZoom == map_zoom))
+      return;
+
+   map_geomBuild( r );
+   map_geomZoom  = map_zoom;
+   map_geomValid = 1;
+}
+
+
+/**
+ * @brief Renders a cached layer of the map.
+ *
+ *    @param layer Layer to render.
+ *    @param x X position of the map origin.
+ *    @param y Y position of the map origin.
+ *    @param tex Texture of the layer if textured.
+ */
+static void map_geomRender( MapLayer layer, double x, double y, const glTexture *tex )
+{
+   const MapGeom *g;
+   GLuint k;
+
+   g = &map_geom[layer];
+   if (g->n == 0)
+      return;
+
+   gl_matrixPush();
+      gl_matrixTranslate( x, y );
+
+   k = sizeof(GLfloat) * 2 * g->n;
+   gl_vboActivateOffset( g->vbo, GL_VERTEX_ARRAY, 0, 2, GL_FLOAT, 0 );
+   if (g->textured) {
+      glEnable( GL_TEXTURE_2D );
+      glBindTexture( GL_TEXTURE_2D, tex->texture );
+      gl_vboActivateOffset( g->vbo, GL_TEXTURE_COORD_ARRAY, k, 2, GL_FLOAT, 0 );
+      gl_vboActivateOffset( g->vbo, GL_COLOR_ARRAY, 2*k, 4, GL_FLOAT, 0 );
+   }
+   else
+      gl_vboActivateOffset( g->vbo, GL_COLOR_ARRAY, k, 4, GL_FLOAT, 0 );
+   glDrawArrays( g->mode, 0, g->n );
+   gl_vboDeactivate();
+   if (g->textured)
+      glDisable( GL_TEXTURE_2D );
+
+   gl_matrixPop();
+   gl_checkErr();
+}
+
+
+/**
+ * @brief Frees the cached geometry of the map.
+ */
+static void map_geomFree (void)
+{
+   int i;
+   MapGeom *g;
+
+   for (i=0; i<MAP_LAYERS; i++) {
+      g = &map_geom[i];
+      if (g->vbo != NULL)
+         gl_vboDestroy( g->vbo );
+      free( g->vertex );
+      free( g->tex );
+      free( g->col );
+      memset( g, 0, sizeof(MapGeom) );
+   }
+   map_geomValid = 0;
+}
+
+
 /**
  * @brief Renders the custom map widget.
  *
@@ -709,6 +1039,9 @@ static void map_render( double bx, double by, double w, double h, void *data )
    if (gl_map_circle == NULL)
       gl_map_circle = gl_genCircle( r );
 
+   /* Static geometry only changes with knowledge, markers and zoom. */
+   map_geomUpdate( r );
+
    /* background */
    gl_renderRect( bx, by, w, h, &cBlack );
 
@@ -789,6 +1122,11 @@ void map_renderFactionDisks( double x, double y, int editor)
    int sw, sh;
    double tx, ty, presence;
 
+   if (!editor && map_geomValid) {
+      map_geomRender( MAP_LAYER_DISKS, x, y, gl_faction_disk );
+      return;
+   }
+
    for (i=0; i<systems_nstack; i++) {
       sys = system_getIndex( i );
 
@@ -835,6 +1173,14 @@ void map_renderJumps( double x, double y, int editor)
    glEnable( GL_LINE_SMOOTH );
    glLineWidth( CLAMP(1., 4., 2. * map_zoom) );
 
+   if (!editor && map_geomValid) {
+      map_geomRender( MAP_LAYER_JUMPS, x, y, NULL );
+      glShadeModel( GL_FLAT );
+      glDisable( GL_LINE_SMOOTH );
+      glLineWidth( 1. );
+      return;
+   }
+
    for (i=0; i<systems_nstack; i++) {
       sys = system_getIndex( i );
 
@@ -917,6 +1263,15 @@ void map_renderSystems( double bx, double by, double x, double y,
       glEnable(GL_LINE_SMOOTH);
    glEnable(GL_POINT_SMOOTH);
 
+   if (!editor && map_geomValid) {
+      map_geomRender( MAP_LAYER_RINGS, x, y, NULL );
+      map_geomRender( MAP_LAYER_FILLS, x, y, gl_map_circle );
+      if (!gl_vendorIsIntel())
+         glDisable( GL_LINE_SMOOTH );
+      glDisable(GL_POINT_SMOOTH);
+      return;
+   }
+
    for (i=0; i<systems_nstack; i++) {
       sys = system_getIndex( i );
 
@@ -1037,27 +1392,62 @@ static void map_renderPath( double x, double y, double a )
 void map_renderNames( double bx, double by, double x, double y,
       double w, double h, int editor )
 {
-   double tx,ty, vx,vy, d,n;
+   double tx,ty, vx,vy, d,n, cw,ch;
    int textw;
    StarSystem *sys, *jsys;
-   int i, j;
+   int i, j, k, gw,gh, cx,cy,cx2, decimate;
    char buf[32];
 
+   if (map_zoom <= MAP_NAME_ZOOM)
+      return;
+
+   /* Zoomed out names are decimated so only one is shown in each cell. */
+   decimate = !editor && (map_zoom < MAP_NAME_DENSE);
+   cw = 4. * gl_smallFont.h;
+   ch = gl_smallFont.h;
+   gw = (int)(w / cw) + 1;
+   gh = (int)(h / ch) + 1;
+   if (decimate) {
+      if (gw*gh > map_nameGridSize) {
+         map_nameGridSize = gw*gh;
+         map_nameGrid     = realloc( map_nameGrid, map_nameGridSize );
+      }
+      memset( map_nameGrid, 0, gw*gh );
+   }
+
    for (i=0; i<systems_nstack; i++) {
       sys = system_getIndex( i );
 
       /* Skip system. */
-      if ((!editor && !sys_isKnown(sys)) || (map_zoom <= 0.5 ))
+      if (!editor && !sys_isKnown(sys))
          continue;
 
-      textw = gl_printWidthRaw( &gl_smallFont, sys->name );
       tx = x + (sys->pos.x+11.) * map_zoom;
       ty = y + (sys->pos.y-5.) * map_zoom;
 
+      /* Cheap bounds check before measuring the text. */
+      if ((tx > bx+w) || (ty > by+h) || (ty+gl_smallFont.h < by))
+         continue;
+
+      textw = gl_printWidthRaw( &gl_smallFont, sys->name );
+
       /* Skip if out of bounds. */
       if (!rectOverlap(tx, ty, textw, gl_smallFont.h, bx, by, w, h))
          continue;
 
+      if (decimate) {
+         cx  = CLAMP( 0, gw-1, (int)((tx - bx) / cw) );
+         cx2 = CLAMP( 0, gw-1, (int)((tx + textw - bx) / cw) );
+         cy  = CLAMP( 0, gh-1, (int)((ty - by) / ch) );
+         for (k=cx; k<=cx2; k++)
+            if (map_nameGrid[ cy*gw + k ])
+               break;
+         if (k <= cx2)
+            continue;
+         for (k=cx; k<=cx2; k++)
+            map_nameGrid[ cy*gw + k ] = 1;
+      }
+
       gl_print( &gl_smallFont,
             tx, ty,
             &cWhite, sys->name );
@@ -1240,6 +1630,60 @@ static int map_mouse( unsigned int wid, SDL_Event* event, double mx, double my,
 
    return 0;
 }
+/**
+ * @brief Plots the most profitable trade route from the current system.
+ *
+ *    @param wid Unused.
+ *    @param str Unused.
+ */
+static void map_buttonTrade( unsigned int wid, char* str )
+{
+   (void) wid;
+   (void) str;
+   MapTradeStop *route;
+   credits_t profit;
+   char buf[1024], cred[ECON_CRED_STRLEN];
+   int i, l, jumps, capacity, plotted;
+   StarSystem *last;
+
+   capacity = pilot_cargoFree( player.p );
+   for (i=0; i<player.p->ncommodities; i++)
+      capacity += player.p->commodities[i].quantity;
+   jumps = map_tradeRoute( cur_system, MAP_TRADE_JUMPS, capacity, 0,
+         &route, &profit );
+   if (jumps == 0) {
+      dialogue_msg( "Trade Route", "No profitable trade route found within %d jumps.",
+            MAP_TRADE_JUMPS );
+      return;
+   }
+
+   /* List and plot the stops that trade. */
+   credits2str( cred, profit, 2 );
+   l    = nsnprintf( buf, sizeof(buf), "%s credits over %d jumps with %d tonnes:",
+         cred, jumps, capacity );
+   last    = cur_system;
+   plotted = 0;
+   for (i=0; i<=jumps; i++) {
+      if ((route[i].sell == NULL) && (route[i].buy == NULL))
+         continue;
+      if (l < (int)sizeof(buf))
+         l += nsnprintf( &buf[l], sizeof(buf)-l, "\n%s:%s%s%s%s",
+               route[i].sys->name,
+               (route[i].sell != NULL) ? " sell " : "",
+               (route[i].sell != NULL) ? route[i].sell->name : "",
+               (route[i].buy != NULL) ? " buy " : "",
+               (route[i].buy != NULL) ? route[i].buy->name : "" );
+      if (route[i].sys != last) {
+         map_select( route[i].sys, plotted );
+         last    = route[i].sys;
+         plotted = 1;
+      }
+   }
+   free( route );
+   dialogue_msgRaw( "Trade Route", buf );
+}
+
+
 /**
  * @brief Handles the button zoom clicks.
  *
@@ -1463,151 +1907,385 @@ void map_select( StarSystem *sys, char shifted )
    gui_setNav();
 }
 
+/** @brief Sets map_zoom to zoom and recreates the faction disk texture. */
+void map_setZoom(double zoom)
+{
+   map_zoom = zoom;
+
+   if (gl_map_circle != NULL) {
+      gl_freeTexture(gl_map_circle);
+      gl_map_circle = NULL;
+   }
+}
+
 /*
- * A* algorithm for shortest path finding
+ * Shortest path finding.
  *
- * Note since that we can't actually get an admissible heurestic for A* this is
- * in reality just Djikstras. I've removed the heurestic bit to make sure I
- * don't try to implement an admissible heuristic when I'm pretty sure there is
- * none.
+ * Since every jump costs the same there is no admissible heuristic better
+ *  than none, so this is Dijkstra's algorithm. The systems are kept as a
+ *  compact adjacency graph rebuilt whenever the jumps change, and the
+ *  searches use an indexed binary heap over arrays that are reused between
+ *  searches.
  */
+static int *map_gStart        = NULL; /**< First edge of each system, one more than systems. */
+static int *map_gTarget       = NULL; /**< Target system of each edge. */
+static int *map_gJump         = NULL; /**< Jump point index of each edge in its system. */
+static int map_gSystems       = 0; /**< Systems in the graph. */
+/* Search arena. */
+static int *A_g               = NULL; /**< Jumps to reach each system. */
+static int *A_parent          = NULL; /**< System each system was reached from. */
+static int *A_stamp           = NULL; /**< Search that last touched each system. */
+static int *A_heap            = NULL; /**< Binary heap of open systems. */
+static int *A_pos             = NULL; /**< Position of each system in the heap, -1 if closed. */
+static int A_nheap            = 0; /**< Systems in the heap. */
+static int A_search           = 0; /**< Current search. */
+/* Topology caches. */
 /**
- * @brief Node structure for A* pathfinding.
+ * @brief Cached jump distances and components over the jumps usable for a
+ *        kind of search.
  */
-typedef struct SysNode_ {
-   struct SysNode_ *next; /**< Next node */
-   struct SysNode_ *gnext; /**< Next node in the garbage collector. */
-
-   struct SysNode_ *parent; /**< Parent node. */
-   StarSystem* sys; /**< System in node. */
-   int g; /**< step */
-} SysNode; /**< System Node for use in A* pathfinding. */
-static SysNode *A_gc;
+typedef struct MapTopology_ {
+   int16_t *dist; /**< Jumps between any two systems, -1 if unreachable. */
+   char *row; /**< Whether each row of dist has been computed. */
+   int *comp; /**< Connected component of each system. */
+} MapTopology;
+#define MAP_TOPO_FULL      0 /**< Knowledge ignored, hidden jumps used. */
+#define MAP_TOPO_VISIBLE   1 /**< Knowledge ignored, unknown hidden jumps skipped. */
+#define MAP_TOPO_KNOWN     2 /**< Only known jumps. */
+#define MAP_TOPOLOGIES     3 /**< Number of topologies. */
+static MapTopology map_topo[MAP_TOPOLOGIES]; /**< Topology caches. */
 /* prototypes */
-static SysNode* A_newNode( StarSystem* sys );
-static int A_g( SysNode* n );
-static SysNode* A_add( SysNode *first, SysNode *cur );
-static SysNode* A_rm( SysNode *first, StarSystem *cur );
-static SysNode* A_in( SysNode *first, StarSystem *cur );
-static SysNode* A_lowest( SysNode *first );
-static void A_freeList( SysNode *first );
-/** @brief Creates a new node link to star system. */
-static SysNode* A_newNode( StarSystem* sys )
+static void map_graphBuild (void);
+static void A_reset( int start );
+static void A_swap( int i, int j );
+static void A_up( int i );
+static void A_down( int i );
+static void A_push( int sys, int g, int parent );
+static int A_pop (void);
+static int A_canJump( const JumpPoint *jp, int ignore_known, int show_hidden );
+static int map_topology( int ignore_known, int show_hidden );
+static void map_topoFree( MapTopology *t );
+static int map_compFind( int *comp, int i );
+static void map_compCompute( int topo );
+static void map_distCompute( int topo, int start );
+static int map_tradeMarket( const StarSystem *sys, int ignore_known );
+/** @brief Builds the adjacency graph and search arena from the systems. */
+static void map_graphBuild (void)
 {
-   SysNode* n;
-
-   n        = malloc(sizeof(SysNode));
+   int i, j, n;
+   StarSystem *sys;
 
-   n->next  = NULL;
-   n->sys   = sys;
+   map_graphInvalidate();
 
-   n->gnext = A_gc;
-   A_gc     = n;
+   map_gSystems = systems_nstack;
+   map_gStart   = malloc( sizeof(int) * (map_gSystems+1) );
+   n = 0;
+   for (i=0; i<map_gSystems; i++)
+      n += systems_stack[i].njumps;
+   map_gTarget  = malloc( sizeof(int) * MAX(n,1) );
+   map_gJump    = malloc( sizeof(int) * MAX(n,1) );
 
-   return n;
+   n = 0;
+   for (i=0; i<map_gSystems; i++) {
+      sys = &systems_stack[i];
+      map_gStart[i] = n;
+      for (j=0; j<sys->njumps; j++) {
+         map_gTarget[n] = sys->jumps[j].target->id;
+         map_gJump[n]   = j;
+         n++;
+      }
+   }
+   map_gStart[map_gSystems] = n;
+
+   A_g      = malloc( sizeof(int) * MAX(map_gSystems,1) );
+   A_parent = malloc( sizeof(int) * MAX(map_gSystems,1) );
+   A_stamp  = calloc( MAX(map_gSystems,1), sizeof(int) );
+   A_heap   = malloc( sizeof(int) * MAX(map_gSystems,1) );
+   A_pos    = malloc( sizeof(int) * MAX(map_gSystems,1) );
+   A_search = 0;
 }
-/** @brief Gets the g from a node. */
-static int A_g( SysNode* n )
+/**
+ * @brief Invalidates the jump graph, must be called when jumps change.
+ */
+void map_graphInvalidate (void)
 {
-   return n->g;
+   free( map_gStart );
+   free( map_gTarget );
+   free( map_gJump );
+   free( A_g );
+   free( A_parent );
+   free( A_stamp );
+   free( A_heap );
+   free( A_pos );
+   map_gStart  = NULL;
+   map_gTarget = NULL;
+   map_gJump   = NULL;
+   A_g         = NULL;
+   A_parent    = NULL;
+   A_stamp     = NULL;
+   A_heap      = NULL;
+   A_pos       = NULL;
+   map_gSystems = 0;
+
+   map_topoFree( &map_topo[MAP_TOPO_FULL] );
+   map_knownInvalidate();
 }
-/** @brief Adds a node to the linked list. */
-static SysNode* A_add( SysNode *first, SysNode *cur )
+/**
+ * @brief Invalidates the cached distances that depend on player knowledge,
+ *        must be called when systems or jumps become known or unknown.
+ */
+void map_knownInvalidate (void)
 {
-   SysNode *n;
-
-   if (first == NULL)
-      return cur;
-
-   n = first;
-   while (n->next != NULL)
-      n = n->next;
-   n->next = cur;
-
-   return first;
+   map_topoFree( &map_topo[MAP_TOPO_VISIBLE] );
+   map_topoFree( &map_topo[MAP_TOPO_KNOWN] );   map_geomInvalidate();
+}
+/** @brief Frees a topology cache. */
+static void map_topoFree( MapTopology *t )
+{
+   free( t->dist );
+   free( t->row );
+   free( t->comp );
+   t->dist = NULL;
+   t->row  = NULL;
+   t->comp = NULL;
 }
-/* @brief Removes a node from a linked list. */
-static SysNode* A_rm( SysNode *first, StarSystem *cur )
+/**
+ * @brief Gets the topology of a search.
+ *
+ * When knowledge isn't ignored hidden jumps must be known anyway, so
+ *  show_hidden doesn't matter.
+ */
+static int map_topology( int ignore_known, int show_hidden )
+{
+   if (!ignore_known)
+      return MAP_TOPO_KNOWN;
+   return show_hidden ? MAP_TOPO_FULL : MAP_TOPO_VISIBLE;
+}
+/** @brief Starts a new search from a system. */
+static void A_reset( int start )
 {
-   SysNode *n, *p;
+   if ((map_gStart == NULL) || (map_gSystems != systems_nstack))
+      map_graphBuild();
+
+   /* Stamps let us skip clearing the arrays. */
+   A_search++;
+   if (A_search == INT_MAX) {
+      memset( A_stamp, 0, sizeof(int) * map_gSystems );
+      A_search = 1;
+   }
+   A_nheap = 0;
+   A_push( start, 0, -1 );
+}
+/** @brief Swaps two heap elements. */
+static void A_swap( int i, int j )
+{
+   int t;
 
-   if (first->sys == cur) {
-      n = first->next;
-      first->next = NULL;
-      return n;
+   t           = A_heap[i];
+   A_heap[i]   = A_heap[j];
+   A_heap[j]   = t;
+   A_pos[ A_heap[i] ] = i;
+   A_pos[ A_heap[j] ] = j;
+}
+/** @brief Moves a heap element up to its place. */
+static void A_up( int i )
+{
+   while ((i > 0) && (A_g[ A_heap[(i-1)/2] ] > A_g[ A_heap[i] ])) {
+      A_swap( i, (i-1)/2 );
+      i = (i-1)/2;
    }
+}
+/** @brief Moves a heap element down to its place. */
+static void A_down( int i )
+{
+   int c;
 
-   p = first;
-   n = p->next;
-   do {
-      if (n->sys == cur) {
-         n->next = NULL;
-         p->next = n->next;
+   while ((c = 2*i+1) < A_nheap) {
+      if ((c+1 < A_nheap) && (A_g[ A_heap[c+1] ] < A_g[ A_heap[c] ]))
+         c++;
+      if (A_g[ A_heap[i] ] <= A_g[ A_heap[c] ])
          break;
-      }
-      p = n;
-   } while ((n=n->next) != NULL);
+      A_swap( i, c );
+      i = c;
+   }
+}
+/** @brief Opens a system or lowers its cost if already open. */
+static void A_push( int sys, int g, int parent )
+{
+   /* First time reached this search. */
+   if (A_stamp[sys] != A_search) {
+      A_stamp[sys]  = A_search;
+      A_g[sys]      = g;
+      A_parent[sys] = parent;
+      A_pos[sys]    = A_nheap;
+      A_heap[A_nheap++] = sys;
+      A_up( A_pos[sys] );
+      return;
+   }
+
+   /* Closed or not better. */
+   if ((A_pos[sys] < 0) || (g >= A_g[sys]))
+      return;
 
-   return first;
+   A_g[sys]      = g;
+   A_parent[sys] = parent;
+   A_up( A_pos[sys] );
 }
-/** @brief Checks to see if node is in linked list. */
-static SysNode* A_in( SysNode *first, StarSystem *cur )
+/** @brief Closes and returns the open system with the lowest cost, -1 if none. */
+static int A_pop (void)
 {
-   SysNode *n;
+   int sys;
 
-   if (first == NULL)
-      return NULL;
+   if (A_nheap == 0)
+      return -1;
 
-   n = first;
-   do {
-      if (n->sys == cur)
-         return n;
-   } while ((n=n->next) != NULL);
-   return NULL;
+   sys = A_heap[0];
+   A_nheap--;
+   if (A_nheap > 0) {
+      A_heap[0] = A_heap[A_nheap];
+      A_pos[ A_heap[0] ] = 0;
+      A_down( 0 );
+   }
+   A_pos[sys] = -1;
+   return sys;
 }
-/** @brief Returns the lowest ranking node from a linked list of nodes. */
-static SysNode* A_lowest( SysNode *first )
+/** @brief Checks to see if a jump can be used for a path. */
+static int A_canJump( const JumpPoint *jp, int ignore_known, int show_hidden )
 {
-   SysNode *lowest, *n;
+   /* Make sure it's reachable */
+   if (!ignore_known) {
+      if (!jp_isKnown(jp))
+         return 0;
+      if (!sys_isKnown(jp->target) && !space_sysReachable(jp->target))
+         return 0;
+   }
+   if (jp_isFlag( jp, JP_EXITONLY ))
+      return 0;
 
-   if (first == NULL)
-      return NULL;
+   /* Skip hidden jumps if they're unknown and not specifically requested */
+   if (!show_hidden && jp_isFlag( jp, JP_HIDDEN ) && !jp_isKnown(jp))
+      return 0;
 
-   n = first;
-   lowest = n;
-   do {
-      if (n->g < lowest->g)
-         lowest = n;
-   } while ((n=n->next) != NULL);
-   return lowest;
+   return 1;
+}
+/** @brief Finds the root of a component, halving the path on the way. */
+static int map_compFind( int *comp, int i )
+{
+   while (comp[i] != i) {
+      comp[i] = comp[ comp[i] ];
+      i       = comp[i];
+   }
+   return i;
+}
+/**
+ * @brief Computes the connected components of a topology.
+ *
+ * Jumps are treated as going both ways, so systems in different components
+ *  can never reach each other while ones in the same component usually can.
+ */
+static void map_compCompute( int topo )
+{
+   int i, e, a, b, ik, sh;
+   int *comp;
+
+   ik   = (topo != MAP_TOPO_KNOWN);
+   sh   = (topo == MAP_TOPO_FULL);
+   comp = malloc( sizeof(int) * MAX(map_gSystems,1) );
+   for (i=0; i<map_gSystems; i++)
+      comp[i] = i;
+   for (i=0; i<map_gSystems; i++) {
+      for (e=map_gStart[i]; e<map_gStart[i+1]; e++) {
+         if (!A_canJump( &systems_stack[i].jumps[ map_gJump[e] ], ik, sh ))
+            continue;
+         a = map_compFind( comp, i );
+         b = map_compFind( comp, map_gTarget[e] );
+         if (a != b)
+            comp[ MAX(a,b) ] = MIN(a,b);
+      }
+   }
+   for (i=0; i<map_gSystems; i++)
+      comp[i] = map_compFind( comp, i );
+   map_topo[topo].comp = comp;
 }
-/** @brief Frees a linked list. */
-static void A_freeList( SysNode *first )
+/** @brief Computes the distances from a system to all the others. */
+static void map_distCompute( int topo, int start )
 {
-   SysNode *p, *n;
+   int i, e, cur, ik, sh;
+   int16_t *row;
+   MapTopology *t;
+
+   t  = &map_topo[topo];
+   ik = (topo != MAP_TOPO_KNOWN);
+   sh = (topo == MAP_TOPO_FULL);
+   A_reset( start );
+   if (t->dist == NULL) {
+      t->dist = malloc( sizeof(int16_t) * map_gSystems * map_gSystems );
+      t->row  = calloc( map_gSystems, sizeof(char) );
+   }
 
-   if (first == NULL)
-      return;
+   row = &t->dist[ start * map_gSystems ];
+   for (i=0; i<map_gSystems; i++)
+      row[i] = -1;
 
-   p = NULL;
-   n = first;
-   do {
-      if (p != NULL)
-         free(p);
-      p = n;
-   } while ((n=n->gnext) != NULL);
-   free(p);
+   while ((cur = A_pop()) >= 0) {
+      row[cur] = A_g[cur];
+      for (e=map_gStart[cur]; e<map_gStart[cur+1]; e++)
+         if (A_canJump( &systems_stack[cur].jumps[ map_gJump[e] ], ik, sh ))
+            A_push( map_gTarget[e], A_g[cur]+1, cur );
+   }
+   t->row[start] = 1;
 }
 
-/** @brief Sets map_zoom to zoom and recreates the faction disk texture. */
-void map_setZoom(double zoom)
+/**
+ * @brief Checks to see if two systems may be connected by jumps.
+ *
+ * This is cheaper than map_jumpDist() but it can give false positives with
+ *  one-way jumps.
+ *
+ *    @param a System to start from.
+ *    @param b System to end at.
+ *    @param ignore_known Whether or not to ignore if systems are known.
+ *    @param show_hidden Whether or not to use unknown hidden jumps.
+ *    @return 0 if b can't be reached from a.
+ */
+int map_jumpConnected( const StarSystem *a, const StarSystem *b,
+      int ignore_known, int show_hidden )
 {
-   map_zoom = zoom;
+   int topo;
+
+   if ((map_gStart == NULL) || (map_gSystems != systems_nstack))
+      map_graphBuild();
+   topo = map_topology( ignore_known, show_hidden );
+   if (map_topo[topo].comp == NULL)
+      map_compCompute( topo );
+   return (map_topo[topo].comp[a->id] == map_topo[topo].comp[b->id]);
+}
 
-   if (gl_map_circle != NULL) {
-      gl_freeTexture(gl_map_circle);
-      gl_map_circle = NULL;
-   }
+/**
+ * @brief Gets the number of jumps between two systems.
+ *
+ * Distances are cached per starting system until the jumps change or, when
+ *  they depend on it, until the player's knowledge changes.
+ *
+ *    @param a System to start from.
+ *    @param b System to end at.
+ *    @param ignore_known Whether or not to ignore if systems are known.
+ *    @param show_hidden Whether or not to use unknown hidden jumps.
+ *    @return Number of jumps, or -1 if b can't be reached.
+ */
+int map_jumpDist( const StarSystem *a, const StarSystem *b,
+      int ignore_known, int show_hidden )
+{
+   int topo;
+   MapTopology *t;
+
+   if (!map_jumpConnected( a, b, ignore_known, show_hidden ))
+      return -1;
+   topo = map_topology( ignore_known, show_hidden );
+   t    = &map_topo[topo];
+   if ((t->row == NULL) || !t->row[a->id])
+      map_distCompute( topo, a->id );
+   return t->dist[ a->id * map_gSystems + b->id ];
 }
 
 /**
@@ -1624,16 +2302,8 @@ StarSystem** map_getJumpPath( int* njumps, const char* sysstart,
     const char* sysend, int ignore_known, int show_hidden,
     StarSystem** old_data )
 {
-   int i, j, cost, ojumps;
-
-   StarSystem *sys, *ssys, *esys, **res;
-   JumpPoint *jp;
-
-   SysNode *cur,   *neighbour;
-   SysNode *open,  *closed;
-   SysNode *ocost, *ccost;
-
-   A_gc = NULL;
+   int i, e, cur, ojumps;
+   StarSystem *ssys, *esys, **res;
 
    /* initial and target systems */
    ssys = system_get(sysstart); /* start */
@@ -1663,77 +2333,29 @@ StarSystem** map_getJumpPath( int* njumps, const char* sysstart,
       return NULL;
    }
 
-   /* start the linked lists */
-   open     = closed = NULL;
-   cur      = A_newNode( ssys );
-   cur->parent = NULL;
-   cur->g   = 0;
-   open     = A_add( open, cur ); /* Initial open node is the start system */
-
-   j = 0;
-   while ((cur = A_lowest(open))) {
-      /* End condition. */
-      if (cur->sys == esys)
-         break;
+   /* Different components, don't bother searching. */
+   if (!map_jumpConnected( ssys, esys, ignore_known, show_hidden )) {
+      (*njumps) = 0;
+      if (old_data != NULL)
+         free( old_data );
+      return NULL;
+   }
 
-      /* Break if infinite loop. */
-      j++;
-      if (j > MAP_LOOP_PROT)
+   /* Search until the goal is closed. */
+   A_reset( ssys->id );
+   while ((cur = A_pop()) >= 0) {
+      if (cur == esys->id)
          break;
 
-      /* Get best from open and toss to closed */
-      open   = A_rm( open, cur->sys );
-      closed = A_add( closed, cur );
-      cost   = A_g(cur) + 1; /* Base unit is jump and always increases by 1. */
-
-      for (i=0; i<cur->sys->njumps; i++) {
-         jp  = &cur->sys->jumps[i];
-         sys = jp->target;
-
-         /* Make sure it's reachable */
-         if (!ignore_known) {
-            if (!jp_isKnown(jp))
-               continue;
-            if (!sys_isKnown(sys) && !space_sysReachable(sys))
-               continue;
-         }
-         if (jp_isFlag( jp, JP_EXITONLY ))
-            continue;
-
-         /* Skip hidden jumps if they're unknown and not specifically requested */
-         if (!show_hidden && jp_isFlag( jp, JP_HIDDEN ) && !jp_isKnown(jp))
-            continue;
-
-         /* Check to see if it's already in the closed set. */
-         ccost = A_in(closed, sys);
-         if ((ccost != NULL) && (cost >= A_g(ccost)))
-            continue;
-            //closed = A_rm( closed, sys );
-
-         /* Remove if it exists and current is better. */
-         ocost = A_in(open, sys);
-         if (ocost != NULL) {
-            if (cost < A_g(ocost))
-               open = A_rm( open, sys ); /* New path is better */
-            else
-               continue; /* This node is worse, so ignore it. */
-         }
-
-         /* Create the node. */
-         neighbour         = A_newNode( sys );
-         neighbour->parent = cur;
-         neighbour->g      = cost;
-         open              = A_add( open, neighbour );
-      }
-
-      /* Sanity check in case not linked. */
-      if (open == NULL)
-         break;
+      for (e=map_gStart[cur]; e<map_gStart[cur+1]; e++)
+         if (A_canJump( &systems_stack[cur].jumps[ map_gJump[e] ],
+                  ignore_known, show_hidden ))
+            A_push( map_gTarget[e], A_g[cur]+1, cur );
    }
 
-   /* Build path backwards if not broken from loop. */
-   if (esys == cur->sys) {
-      (*njumps) = A_g(cur);
+   /* Build path backwards if found. */
+   if (cur == esys->id) {
+      (*njumps) = A_g[cur];
       if (old_data == NULL)
          res      = malloc( sizeof(StarSystem*) * (*njumps) );
       else {
@@ -1742,8 +2364,8 @@ StarSystem** map_getJumpPath( int* njumps, const char* sysstart,
       }
       /* Build path. */
       for (i=0; i<((*njumps)-ojumps); i++) {
-         res[(*njumps)-i-1] = cur->sys;
-         cur                = cur->parent;
+         res[(*njumps)-i-1] = &systems_stack[cur];
+         cur                = A_parent[cur];
       }
    }
    else {
@@ -1753,10 +2375,173 @@ StarSystem** map_getJumpPath( int* njumps, const char* sysstart,
          free( old_data );
    }
 
-   /* free the linked lists */
-   A_freeList(A_gc);
    return res;
 }
+/** @brief Checks to see if commodities can be traded in a system. */
+static int map_tradeMarket( const StarSystem *sys, int ignore_known )
+{
+   int i;
+   const Planet *pnt;
+
+   if (system_commodityPrices( sys ) == NULL)
+      return 0;
+   for (i=0; i<sys->nplanets; i++) {
+      pnt = sys->planets[i];
+      if ((pnt->real == ASSET_REAL) &&
+            planet_hasService( pnt, PLANET_SERVICE_COMMODITY ) &&
+            (ignore_known || planet_isKnown( pnt )))
+         return 1;
+   }
+   return 0;
+}
+/**
+ * @brief Finds the trade route with the most profit per jump.
+ *
+ * The route makes one jump per stop and carries a full hold of a single
+ *  commodity at a time, selling and buying at markets along the way. The
+ *  best value of every system and cargo is kept for each number of jumps,
+ *  which bounds the search to jumps times the number of jump points and
+ *  commodities. Prices are the cached ones, credits on hand are not taken
+ *  into account.
+ *
+ *    @param start System to start from.
+ *    @param maxjumps Most jumps to make, up to MAP_TRADE_MAXJUMPS.
+ *    @param capacity Tonnes of cargo that can be carried.
+ *    @param ignore_known Whether or not to ignore if systems and planets are known.
+ *    @param[out] route Stops of the route, jumps+1 of them starting with start,
+ *                      to be freed by the caller.
+ *    @param[out] profit Profit of the whole route.
+ *    @return Number of jumps of the route, 0 if there is no profitable route.
+ */
+int map_tradeRoute( const StarSystem *start, int maxjumps, int capacity,
+      int ignore_known, MapTradeStop **route, credits_t *profit )
+{
+   int i, h, s, t, e, k, kk, nc, nk, ns, best_h, best_s, sk;
+   double *A, *D, *a, *d, v, sv, best;
+   int *Afrom, *Dfrom;
+   const credits_t *pr;
+   Commodity *comm;
+   char *market;
+   size_t n;
+
+   *route  = NULL;
+   *profit = 0;
+   maxjumps = MIN( maxjumps, MAP_TRADE_MAXJUMPS );
+   if ((maxjumps <= 0) || (capacity <= 0))
+      return 0;
+   if ((map_gStart == NULL) || (map_gSystems != systems_nstack))
+      map_graphBuild();
+
+   /* Values of each system and cargo, the last slot is an empty hold. */
+   comm  = commodity_getAll( &nc );
+   nk    = nc+1;
+   ns    = map_gSystems;
+   n     = (size_t)(maxjumps+1) * ns * nk;
+   A     = malloc( sizeof(double) * n );
+   D     = malloc( sizeof(double) * n );
+   Afrom = malloc( sizeof(int) * n );
+   Dfrom = malloc( sizeof(int) * n );
+   market = malloc( MAX(ns,1) );
+   for (s=0; s<ns; s++)
+      market[s] = map_tradeMarket( &systems_stack[s], ignore_known );
+   for (i=0; i<(int)n; i++)
+      A[i] = -HUGE_VAL;
+   A[ start->id*nk + nc ] = 0.;
+
+   best   = 0.;
+   best_h = 0;
+   best_s = -1;
+   for (h=0; h<=maxjumps; h++) {
+      /* Arrive from the systems left on the previous jump. */
+      if (h > 0) {
+         for (s=0; s<ns; s++) {
+            d = &D[ ((h-1)*ns + s) * nk ];
+            if (d[nc] == -HUGE_VAL) {
+               for (k=0; k<nc; k++)
+                  if (d[k] > -HUGE_VAL)
+                     break;
+               if (k >= nc)
+                  continue;
+            }
+            for (e=map_gStart[s]; e<map_gStart[s+1]; e++) {
+               if (!A_canJump( &systems_stack[s].jumps[ map_gJump[e] ],
+                        ignore_known, 0 ))
+                  continue;
+               t = map_gTarget[e];
+               a = &A[ (h*ns + t) * nk ];
+               for (k=0; k<nk; k++) {
+                  if (d[k] > a[k]) {
+                     a[k] = d[k];
+                     Afrom[ (h*ns + t) * nk + k ] = s;
+                  }
+               }
+            }
+         }
+      }
+
+      /* Sell and buy at markets. */
+      for (s=0; s<ns; s++) {
+         a  = &A[ (h*ns + s) * nk ];
+         d  = &D[ (h*ns + s) * nk ];
+         pr = market[s] ? system_commodityPrices( &systems_stack[s] ) : NULL;
+         sv = a[nc];
+         sk = nc;
+         if (pr != NULL) {
+            for (k=0; k<nc; k++) {
+               if ((pr[k] <= 0) || (a[k] == -HUGE_VAL))
+                  continue;
+               v = a[k] + (double)capacity * pr[k];
+               if (v > sv) {
+                  sv = v;
+                  sk = k;
+               }
+            }
+         }
+         for (k=0; k<nk; k++) {
+            d[k] = a[k];
+            Dfrom[ (h*ns + s) * nk + k ] = k;
+            if ((k == nc) || ((pr != NULL) && (pr[k] > 0))) {
+               v = (k == nc) ? sv : sv - (double)capacity * pr[k];
+               if ((sv > -HUGE_VAL) && (v > d[k])) {
+                  d[k] = v;
+                  Dfrom[ (h*ns + s) * nk + k ] = sk;
+               }
+            }
+         }
+
+         /* Best so far with everything sold. */
+         if ((h > 0) && (d[nc] / h > best)) {
+            best   = d[nc] / h;
+            best_h = h;
+            best_s = s;
+         }
+      }
+   }
+
+   /* Walk back from the best end. */
+   if (best_s >= 0) {
+      *route  = malloc( sizeof(MapTradeStop) * (best_h+1) );
+      *profit = (credits_t) D[ (best_h*ns + best_s) * nk + nc ];
+      s = best_s;
+      k = nc;
+      for (h=best_h; h>=0; h--) {
+         kk = Dfrom[ (h*ns + s) * nk + k ];
+         (*route)[h].sys  = &systems_stack[s];
+         (*route)[h].sell = ((kk != k) && (kk != nc)) ? &comm[kk] : NULL;
+         (*route)[h].buy  = ((kk != k) && (k != nc)) ? &comm[k] : NULL;
+         if (h > 0)
+            s = Afrom[ (h*ns + s) * nk + kk ];
+         k = kk;
+      }
+   }
+
+   free( A );
+   free( D );
+   free( Afrom );
+   free( Dfrom );
+   free( market );
+   return best_h;
+}
 
 
 /**
@@ -1779,6 +2564,7 @@ int map_map( const Outfit *map )
    for (i=0; i<array_size(map->u.map->jumps);i++)
       jp_setFlag(map->u.map->jumps[i], JP_KNOWN);
 
+   map_knownInvalidate();
    return 1;
 }
 
@@ -1832,6 +2618,7 @@ int localmap_map( const Outfit *lmap )
       if (mod*jp->hide <= detect)
          jp_setFlag( jp, JP_KNOWN );
    }
+   map_knownInvalidate();
 
    detect = lmap->u.lmap.asset_detect;
    for (i=0; i<cur_system->nplanets; i++) {
@@ -1897,6 +2684,9 @@ void map_show( int wid, int x, int y, int w, int h, double zoom )
    /* mark systems as needed */
    mission_sysMark();
 
+   /* Standings may have changed the system colours. */
+   map_geomInvalidate();
+
    /* Set position to focus on current system. */
    map_xpos = cur_system->pos.x * zoom;
    map_ypos = cur_system->pos.y * zoom;
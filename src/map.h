@@ -11,6 +11,19 @@
 #include "space.h"
 
 
+#define MAP_TRADE_MAXJUMPS 16 /**< Most jumps a trade route can have. */
+
+
+/**
+ * @brief System along a trade route.
+ */
+typedef struct MapTradeStop_ {
+   StarSystem *sys; /**< System of the stop. */
+   Commodity *sell; /**< Commodity sold there, NULL if none. */
+   Commodity *buy; /**< Commodity bought there, NULL if none. */
+} MapTradeStop;
+
+
 /* init/exit */
 int map_init (void);
 void map_exit (void);
@@ -32,6 +45,15 @@ void map_jump (void);
 StarSystem** map_getJumpPath( int* njumps, const char* sysstart,
      const char* sysend, int ignore_known, int show_hidden,
      StarSystem** old_data );
+int map_jumpConnected( const StarSystem *a, const StarSystem *b,
+      int ignore_known, int show_hidden );
+int map_jumpDist( const StarSystem *a, const StarSystem *b,
+      int ignore_known, int show_hidden );
+int map_tradeRoute( const StarSystem *start, int maxjumps, int capacity,
+      int ignore_known, MapTradeStop **route, credits_t *profit );
+void map_graphInvalidate (void);
+void map_knownInvalidate (void);
+void map_geomInvalidate (void);
 int map_map( const Outfit *map );
 int map_isMapped( const Outfit* map );
 
@@ -307,6 +307,10 @@ static int map_findDistance( StarSystem *sys, Planet *pnt, int *jumps, double *d
       return 0;
    }
 
+   /* Not even reachable through unknown jumps. */
+   if (map_jumpDist( cur_system, sys, 0, 1 ) < 0)
+      return -1;
+
    /* Calculate jump path. */
    slist = map_getJumpPath( jumps, cur_system->name, sys->name, 0, 1, NULL );
    if (slist==NULL)
@@ -707,7 +711,7 @@ static void map_showOutfitDetail(unsigned int wid, char* wgtname, int x, int y,
 
    outfit = outfit_get( toolkit_getList(wid, wgtname) );
    window_modifyText( wid, "txtOutfitName", outfit->name );
-   window_modifyImage( wid, "imgOutfit", outfit->gfx_store, 0, 0 );
+   window_modifyImageDefer( wid, "imgOutfit", outfit_gfxStoreDefer(outfit), 0, 0 );
 
    window_modifyText( wid, "txtDescription", outfit->description );
    credits2str( buf2, outfit->price, 2 );
@@ -43,9 +43,33 @@ static int ovr_open = 0; /**< Is the overlay open? */
 static double ovr_res = 10.; /**< Resolution. */
 
 
+/*
+ * Cache of the static layer with the planets, jumps and their labels.
+ */
+#define OVR_CACHE_TTL   1. /**< Seconds before the layer picks up colour changes. */
+static glFbo *ovr_fbo         = NULL; /**< Cached static layer. */
+static int ovr_cacheValid     = 0; /**< Whether the cache can be drawn as is. */
+static StarSystem *ovr_cacheSys = NULL; /**< System the cache was rendered in. */
+static double ovr_cacheRes    = 0.; /**< Resolution the cache was rendered at. */
+static int ovr_cachePlanet    = -1; /**< Target planet left out of the cache. */
+static int ovr_cacheJump      = -1; /**< Target jump left out of the cache. */
+static double ovr_cacheTimer  = 0.; /**< Time left before rendering it again. */
+
+
+/*
+ * Marker geometry, all the crosses go out in a single draw.
+ */
+static GLfloat *ovr_mrkVertex = NULL; /**< Marker vertices and colours. */
+static int ovr_mrkVertexN     = 0; /**< Number of markers the buffer fits. */
+
+
 /*
  * Prototypes
  */
+/* Static layer. */
+static void ovr_renderStatic( double w, double h, double res );
+static int ovr_cacheBegin( double dt );
+static void ovr_cacheCheck( double dt );
 /* Markers. */
 static void ovr_mrkRenderAll( double res );
 static void ovr_mrkCleanup(  ovr_marker_t *mrk );
@@ -109,6 +133,9 @@ void ovr_refresh (void)
    double max_x, max_y;
    int i;
 
+   /* Layout may have changed. */
+   ovr_cacheValid = 0;
+
    /* Must be open. */
    if (!ovr_isOpen())
       return;
@@ -184,7 +211,6 @@ void ovr_key( int type )
  */
 void ovr_render( double dt )
 {
-   (void) dt;
    int i, j;
    Pilot **pstk;
    AsteroidAnchor *ast;
@@ -209,21 +235,26 @@ void ovr_render( double dt )
    /* First render the background overlay. */
    gl_renderRect( 0., 0., w, h, &c );
 
-   /* Render planets. */
-   for (i=0; i<cur_system->nplanets; i++)
-      if ((cur_system->planets[ i ]->real == ASSET_REAL) && (i != player.p->nav_planet))
-         gui_renderPlanet( i, RADAR_RECT, w, h, res, 1 );
+   /* Render the planets and jump points that aren't targeted, cached. */
+   ovr_cacheCheck( dt );
+   if (ovr_cacheValid)
+      gl_fboRender( ovr_fbo, 0., 0. );
+   else if (ovr_cacheBegin( dt )) {
+      ovr_renderStatic( w, h, res );
+      gl_fboEnd();
+      gl_fboRender( ovr_fbo, 0., 0. );
+   }
+   else
+      ovr_renderStatic( w, h, res );
+
+   /* Targets blink so they are always rendered. */
    if (player.p->nav_planet > -1)
       gui_renderPlanet( player.p->nav_planet, RADAR_RECT, w, h, res, 1 );
-
-   /* Render jump points. */
-   for (i=0; i<cur_system->njumps; i++)
-      if ((i != player.p->nav_hyperspace) && !jp_isFlag(&cur_system->jumps[i], JP_EXITONLY))
-         gui_renderJumpPoint( i, RADAR_RECT, w, h, res, 1 );
    if (player.p->nav_hyperspace > -1)
       gui_renderJumpPoint( player.p->nav_hyperspace, RADAR_RECT, w, h, res, 1 );
 
    /* Render pilots. */
+   gui_radarBatchBegin();
    pstk  = pilot_getAll( &n );
    j     = 0;
    for (i=0; i<n; i++) {
@@ -237,6 +268,7 @@ void ovr_render( double dt )
    /* Render the targeted pilot */
    if (j!=0)
       gui_renderPilot( pstk[j], RADAR_RECT, w, h, res, 1 );
+   gui_radarBatchEnd();
 
    /* Check if player has goto target. */
    if (player_isFlag(PLAYER_AUTONAV) && (player.autonav == AUTONAV_POS_APPROACH)) {
@@ -247,11 +279,13 @@ void ovr_render( double dt )
    }
 
    /* render the asteroids */
+   gui_radarBatchBegin();
    for (i=0; i<cur_system->nasteroids; i++) {
       ast = &cur_system->asteroids[i];
       for (j=0; j<ast->nb; j++)
          gui_renderAsteroid( &ast->asteroids[j], w, h, res, 1 );
    }
+   gui_radarBatchEnd();
 
    /* Render the player. */
    gui_renderPlayer( res, 1 );
@@ -261,29 +295,154 @@ void ovr_render( double dt )
 }
 
 
+/**
+ * @brief Renders the planets and jump points that aren't targeted.
+ *
+ *    @param w Width of the overlay.
+ *    @param h Height of the overlay.
+ *    @param res Resolution to render at.
+ */
+static void ovr_renderStatic( double w, double h, double res )
+{
+   int i;
+
+   for (i=0; i<cur_system->nplanets; i++)
+      if ((cur_system->planets[ i ]->real == ASSET_REAL) && (i != player.p->nav_planet))
+         gui_renderPlanet( i, RADAR_RECT, w, h, res, 1 );
+
+   for (i=0; i<cur_system->njumps; i++)
+      if ((i != player.p->nav_hyperspace) && !jp_isFlag(&cur_system->jumps[i], JP_EXITONLY))
+         gui_renderJumpPoint( i, RADAR_RECT, w, h, res, 1 );
+}
+
+
+/**
+ * @brief Checks the static layer cache and starts rendering to it if stale.
+ *
+ * The layer is kept until the system, the resolution or the targets change,
+ *  and is rendered again every so often to pick up colour changes from
+ *  standings or landing permissions.
+ *
+ *    @param dt Current delta tick.
+ *    @return 1 if rendering to the cache, 0 if it must be rendered directly.
+ */
+static int ovr_cacheBegin( double dt )
+{
+   if (!gl_hasFbo())
+      return 0;
+
+   /* Recreate on resolution changes. */
+   if ((ovr_fbo != NULL) && ((ovr_fbo->w != SCREEN_W) || (ovr_fbo->h != SCREEN_H))) {
+      gl_fboFree( ovr_fbo );
+      ovr_fbo = NULL;
+   }
+   if (ovr_fbo == NULL)
+      ovr_fbo = gl_fboCreate( SCREEN_W, SCREEN_H );
+   if (ovr_fbo == NULL)
+      return 0;
+
+   if (gl_fboBegin( ovr_fbo, 0., 0., 0, 0, SCREEN_W, SCREEN_H ))
+      return 0;
+
+   ovr_cacheSys    = cur_system;
+   ovr_cacheRes    = ovr_res;
+   ovr_cachePlanet = player.p->nav_planet;
+   ovr_cacheJump   = player.p->nav_hyperspace;
+   ovr_cacheTimer  = OVR_CACHE_TTL + dt;
+   ovr_cacheValid  = 1;
+   return 1;
+}
+
+
+/**
+ * @brief Checks to see if the static layer cache is still good.
+ *
+ *    @param dt Current delta tick.
+ */
+static void ovr_cacheCheck( double dt )
+{
+   if (!ovr_cacheValid)
+      return;
+
+   ovr_cacheTimer -= dt;
+   if ((ovr_cacheTimer < 0.) || (ovr_fbo == NULL) ||
+         (ovr_fbo->w != SCREEN_W) || (ovr_fbo->h != SCREEN_H) ||
+         (ovr_cacheSys != cur_system) || (ovr_cacheRes != ovr_res) ||
+         (ovr_cachePlanet != player.p->nav_planet) ||
+         (ovr_cacheJump != player.p->nav_hyperspace))
+      ovr_cacheValid = 0;
+}
+
+
 /**
  * @brief Renders all the markers.
  *
+ * The crosses are drawn in a single batch and the labels on top.
+ *
  *    @param res Resolution to render at.
  */
 static void ovr_mrkRenderAll( double res )
 {
-   int i;
+   int i, j, n;
    ovr_marker_t *mrk;
    double x, y;
+   GLfloat *vertex, *colours;
+   gl_vbo *vbo;
+   GLuint voff, coff;
 
    if (ovr_markers == NULL)
       return;
+   n = array_size(ovr_markers);
+   if (n == 0)
+      return;
 
-   for (i=0; i<array_size(ovr_markers); i++) {
+   /* Make sure the buffer fits, 4 vertices with 2 coordinates and 4 colours. */
+   if (ovr_mrkVertexN < n) {
+      ovr_mrkVertexN = MAX( 2*ovr_mrkVertexN, n );
+      ovr_mrkVertex  = realloc( ovr_mrkVertex,
+            sizeof(GLfloat) * ovr_mrkVertexN * 4*(2+4) );
+   }
+   vertex  = ovr_mrkVertex;
+   colours = &ovr_mrkVertex[ n*4*2 ];
+
+   for (i=0; i<n; i++) {
       mrk = &ovr_markers[i];
 
       x = mrk->u.pt.x / res + SCREEN_W / 2.;
       y = mrk->u.pt.y / res + SCREEN_H / 2.;
-      gl_renderCross( x, y, 5., &cRadar_hilight );
+      vertex[8*i + 0] = x;
+      vertex[8*i + 1] = y - 5.;
+      vertex[8*i + 2] = x;
+      vertex[8*i + 3] = y + 5.;
+      vertex[8*i + 4] = x - 5.;
+      vertex[8*i + 5] = y;
+      vertex[8*i + 6] = x + 5.;
+      vertex[8*i + 7] = y;
+      for (j=0; j<4; j++) {
+         colours[16*i + 4*j + 0] = cRadar_hilight.r;
+         colours[16*i + 4*j + 1] = cRadar_hilight.g;
+         colours[16*i + 4*j + 2] = cRadar_hilight.b;
+         colours[16*i + 4*j + 3] = cRadar_hilight.a;
+      }
+   }
+
+   /* Draw all the crosses. */
+   vbo  = gl_vboStreamReserve( sizeof(GLfloat) * n*4*(2+4) );
+   voff = gl_vboStreamPush( vertex, sizeof(GLfloat) * n*4*2 );
+   coff = gl_vboStreamPush( colours, sizeof(GLfloat) * n*4*4 );
+   gl_vboActivateOffset( vbo, GL_VERTEX_ARRAY, voff, 2, GL_FLOAT, 0 );
+   gl_vboActivateOffset( vbo, GL_COLOR_ARRAY, coff, 4, GL_FLOAT, 0 );
+   glDrawArrays( GL_LINES, 0, n*4 );
+   gl_vboDeactivate();
 
-      if (mrk->text != NULL)
-         gl_printRaw( &gl_smallFont, x+10., y-gl_smallFont.h/2., &cRadar_hilight, mrk->text );
+   /* Labels. */
+   for (i=0; i<n; i++) {
+      mrk = &ovr_markers[i];
+      if (mrk->text == NULL)
+         continue;
+      x = mrk->u.pt.x / res + SCREEN_W / 2.;
+      y = mrk->u.pt.y / res + SCREEN_H / 2.;
+      gl_printRaw( &gl_smallFont, x+10., y-gl_smallFont.h/2., &cRadar_hilight, mrk->text );
    }
 }
 
@@ -300,6 +459,14 @@ void ovr_mrkFree (void)
    if (ovr_markers != NULL)
       array_free( ovr_markers );
    ovr_markers = NULL;
+
+   /* Free rendering data. */
+   free( ovr_mrkVertex );
+   ovr_mrkVertex  = NULL;
+   ovr_mrkVertexN = 0;
+   gl_fboFree( ovr_fbo );
+   ovr_fbo        = NULL;
+   ovr_cacheValid = 0;
 }
 
 
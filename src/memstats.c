@@ -0,0 +1,141 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file memstats.c
+ *
+ * @brief Reports the memory used by each subsystem.
+ *
+ * Figures are worked out when asked for from what each subsystem keeps, so
+ *  they are estimates of the main allocations and not of the heap as a whole.
+ *  They can also be logged periodically to watch for leaks over a session.
+ */
+
+
+#include "memstats.h"
+
+#include "naev.h"
+
+#include "log.h"
+#include "opengl.h"
+#include "sound.h"
+#include "nlua.h"
+#include "pilot.h"
+#include "weapon.h"
+#include "space.h"
+
+
+static double memstats_interval  = 0.; /**< Seconds between logs, 0 to disable. */
+static double memstats_timer     = 0.; /**< Seconds left until the next log. */
+
+
+/**
+ * @brief Gets the memory used by each subsystem.
+ *
+ *    @param[out] stats Filled with the usage of each subsystem.
+ *    @return Number of subsystems filled in.
+ */
+int memstats_get( MemStat stats[MEMSTATS_MAX] )
+{
+   int n, nused, ncached;
+   size_t used, cached;
+
+   n = 0;
+
+   gl_texUsage( &nused, &used, &ncached, &cached );
+   stats[n].name  = "Textures";
+   stats[n].n     = nused;
+   stats[n].bytes = used;
+   n++;
+   stats[n].name  = "Textures cached";
+   stats[n].n     = ncached;
+   stats[n].bytes = cached;
+   n++;
+
+   stats[n].name  = "Sounds";
+   stats[n].bytes = sound_memUsage( &stats[n].n );
+   n++;
+
+   stats[n].name  = "Lua";
+   stats[n].n     = 1;
+   stats[n].bytes = nlua_memUsage();
+   n++;
+
+   stats[n].name  = "Pilots";
+   stats[n].bytes = pilot_memUsage( &stats[n].n );
+   n++;
+
+   stats[n].name  = "Weapons";
+   stats[n].bytes = weapon_memUsage( &stats[n].n );
+   n++;
+
+   stats[n].name  = "Universe";
+   stats[n].bytes = space_memUsage( &stats[n].n );
+   n++;
+
+   return n;
+}
+
+
+/**
+ * @brief Logs the memory used by each subsystem.
+ */
+void memstats_log (void)
+{
+   MemStat stats[MEMSTATS_MAX];
+   int i, n;
+   size_t total;
+
+   n     = memstats_get( stats );
+   total = 0;
+   LOG("Memory usage:");
+   for (i=0; i<n; i++) {
+      LOG("   %-16s %6d %9.1f KiB", stats[i].name, stats[i].n,
+            (double)stats[i].bytes / 1024.);
+      total += stats[i].bytes;
+   }
+   LOG("   %-16s %6s %9.1f KiB", "Total", "", (double)total / 1024.);
+}
+
+
+/**
+ * @brief Sets how often the memory usage gets logged.
+ *
+ *    @param interval Seconds between logs, 0 to disable.
+ */
+void memstats_setInterval( double interval )
+{
+   memstats_interval = MAX( 0., interval );
+   memstats_timer    = memstats_interval;
+}
+
+
+/**
+ * @brief Gets how often the memory usage gets logged.
+ *
+ *    @return Seconds between logs, 0 if disabled.
+ */
+double memstats_getInterval (void)
+{
+   return memstats_interval;
+}
+
+
+/**
+ * @brief Logs the memory usage when the interval runs out.
+ *
+ *    @param dt Real time elapsed in seconds.
+ */
+void memstats_update( double dt )
+{
+   if (memstats_interval <= 0.)
+      return;
+
+   memstats_timer -= dt;
+   if (memstats_timer > 0.)
+      return;
+
+   memstats_timer = memstats_interval;
+   memstats_log();
+}
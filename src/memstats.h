@@ -0,0 +1,40 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef MEMSTATS_H
+#  define MEMSTATS_H
+
+
+#include <stddef.h>
+
+
+#define MEMSTATS_MAX    8 /**< Maximum subsystems reported. */
+
+
+/**
+ * @brief Memory used by a subsystem.
+ */
+typedef struct MemStat_ {
+   const char *name; /**< Name of the subsystem. */
+   int n; /**< Number of objects. */
+   size_t bytes; /**< Bytes used. */
+} MemStat;
+
+
+/*
+ * Querying.
+ */
+int memstats_get( MemStat stats[MEMSTATS_MAX] );
+void memstats_log (void);
+
+/*
+ * Periodic logging.
+ */
+void memstats_setInterval( double interval );
+double memstats_getInterval (void);
+void memstats_update( double dt );
+
+
+#endif /* MEMSTATS_H */
@@ -280,8 +280,10 @@ void menu_main_resize (void)
       /* RIP abstractions. X must be set manually because window_moveWidget
        * transforms negative coordinates. */
       wgt = window_getwgt( bg_id, "txtBG" );
-      if (wgt)
+      if (wgt) {
          wgt->x = (SCREEN_W - tw) / 2;
+         window_dirty( window_wget( bg_id ) );
+      }
    }
    else
       window_moveWidget( bg_id, "txtBG", (SCREEN_W - tw)/2, 10. );
@@ -0,0 +1,570 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file metrics.c
+ *
+ * @brief Registry of engine metrics exported periodically.
+ *
+ * Subsystems register counters, gauges and histograms by name and feed them
+ *  as they run. Every interval they get exported, either as a line of JSON
+ *  appended to a file or as statsd packets sent to a local UDP socket when
+ *  the target looks like "udp://host:port". Histograms only keep the samples
+ *  of the current interval and are reported as percentiles.
+ *
+ * Nothing gets registered while disabled, so feeding a metric then only costs
+ *  checking that its id is valid.
+ */
+
+
+#include "metrics.h"
+
+#include "naev.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "nstring.h"
+#if HAS_POSIX
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#endif /* HAS_POSIX */
+
+#include "SDL.h"
+
+#include "log.h"
+#include "array.h"
+#include "nfile.h"
+#include "memstats.h"
+
+
+#define METRICS_SAMPLES    65536 /**< Most histogram samples kept per interval. */
+#define METRICS_PACKET     1400 /**< Largest statsd packet sent. */
+#define METRICS_PREFIX     "naev." /**< Prefix of the statsd names. */
+#define METRICS_UDP        "udp://" /**< Prefix of UDP targets. */
+
+
+/**
+ * @brief A registered metric.
+ */
+typedef struct Metric_ {
+   char *name; /**< Name of the metric. */
+   MetricType type; /**< Kind of metric. */
+   double value; /**< Count since the last export or last gauge value. */
+   int set; /**< Whether the gauge was ever set. */
+   double *samples; /**< Histogram samples of this interval. */
+   int n; /**< Histogram samples seen this interval, may exceed those kept. */
+   double max; /**< Largest histogram sample this interval. */
+} Metric;
+
+
+static int metrics_on         = 0; /**< Whether metrics are being collected. */
+static Metric *metrics_stack  = NULL; /**< Registered metrics. */
+static double metrics_interval = 10.; /**< Seconds between exports. */
+static double metrics_timer   = 0.; /**< Seconds left until the next export. */
+static double metrics_time    = 0.; /**< Seconds since metrics got enabled. */
+static FILE *metrics_file     = NULL; /**< File exported to. */
+#if HAS_POSIX
+static int metrics_sock       = -1; /**< Socket exported to. */
+static struct sockaddr_storage metrics_addr; /**< Address of the statsd server. */
+static socklen_t metrics_addrlen = 0; /**< Size of metrics_addr. */
+#endif /* HAS_POSIX */
+
+/* Built in metrics. */
+static int metrics_frames     = -1; /**< Frames rendered. */
+static int metrics_frameMs    = -1; /**< Frame time in milliseconds. */
+static int metrics_memReady   = 0; /**< Whether the memory gauges are registered. */
+static int metrics_mem[MEMSTATS_MAX]; /**< Bytes used per subsystem. */
+static int metrics_memN[MEMSTATS_MAX]; /**< Objects per subsystem. */
+
+
+/*
+ * Prototypes.
+ */
+static int metrics_openUDP( const char *target );
+static int metrics_cmp( const void *p1, const void *p2 );
+static double metrics_percentile( const Metric *m, double p );
+static void metrics_sample (void);
+static void metrics_exportJSON (void);
+static void metrics_exportStatsd (void);
+static void metrics_reset (void);
+static void metrics_write (void);
+
+
+/**
+ * @brief Opens the socket to a statsd server.
+ *
+ *    @param target Target of the form "udp://host:port".
+ *    @return 0 on success.
+ */
+static int metrics_openUDP( const char *target )
+{
+#if HAS_POSIX
+   char host[256];
+   const char *port;
+   struct addrinfo hints, *res;
+   int ret;
+
+   target += strlen(METRICS_UDP);
+   port    = strrchr( target, ':' );
+   if ((port == NULL) || (port == target) || (port-target >= (int)sizeof(host))) {
+      WARN("Metrics target '%s' is not of the form 'udp://host:port'.", target);
+      return -1;
+   }
+   strncpy( host, target, port-target );
+   host[ port-target ] = '\0';
+   port++;
+
+   memset( &hints, 0, sizeof(hints) );
+   hints.ai_family   = AF_UNSPEC;
+   hints.ai_socktype = SOCK_DGRAM;
+   ret = getaddrinfo( host, port, &hints, &res );
+   if (ret != 0) {
+      WARN("Unable to resolve metrics host '%s': %s", host, gai_strerror(ret));
+      return -1;
+   }
+
+   metrics_sock = socket( res->ai_family, res->ai_socktype, res->ai_protocol );
+   if (metrics_sock < 0) {
+      WARN("Unable to create metrics socket.");
+      freeaddrinfo( res );
+      return -1;
+   }
+   memcpy( &metrics_addr, res->ai_addr, res->ai_addrlen );
+   metrics_addrlen = res->ai_addrlen;
+   freeaddrinfo( res );
+   return 0;
+#else /* HAS_POSIX */
+   WARN("Exporting metrics to '%s' is not supported on this platform.", target);
+   return -1;
+#endif /* HAS_POSIX */
+}
+
+
+/**
+ * @brief Starts collecting metrics.
+ *
+ *    @param target File to append JSON lines to, relative to the data
+ *           directory, or "udp://host:port" of a statsd server. NULL
+ *           leaves metrics disabled.
+ *    @param interval Seconds between exports.
+ *    @return 0 on success.
+ */
+int metrics_init( const char *target, double interval )
+{
+   char file[PATH_MAX];
+
+   if ((target == NULL) || (target[0] == '\0'))
+      return 0;
+
+   if (strncmp( target, METRICS_UDP, strlen(METRICS_UDP) ) == 0) {
+      if (metrics_openUDP( target ))
+         return -1;
+   }
+   else {
+      if (target[0] == '/')
+         strncpy( file, target, sizeof(file)-1 );
+      else
+         nsnprintf( file, sizeof(file), "%s%s", nfile_dataPath(), target );
+      file[ sizeof(file)-1 ] = '\0';
+      metrics_file = fopen( file, "a" );
+      if (metrics_file == NULL) {
+         WARN("Unable to open '%s' to write the metrics.", file);
+         return -1;
+      }
+   }
+
+   metrics_on       = 1;
+   metrics_interval = MAX( interval, 0.1 );
+   metrics_timer    = metrics_interval;
+   metrics_time     = 0.;
+   metrics_stack    = array_create( Metric );
+
+   /* Built in metrics. */
+   metrics_frames  = metrics_register( "frames", METRIC_COUNTER );
+   metrics_frameMs = metrics_register( "frame_ms", METRIC_HISTOGRAM );
+   metrics_memReady = 0;
+
+   DEBUG("Exporting metrics to '%s' every %.1f seconds.", target, metrics_interval);
+   return 0;
+}
+
+
+/**
+ * @brief Checks to see if metrics are being collected.
+ */
+int metrics_enabled (void)
+{
+   return metrics_on;
+}
+
+
+/**
+ * @brief Registers a metric.
+ *
+ * Spaces and characters that would need escaping in JSON or statsd are
+ *  turned into underscores.
+ *
+ *    @param name Name of the metric.
+ *    @param type Kind of metric.
+ *    @return Id of the metric, the existing one if already registered, or -1
+ *            if metrics are disabled.
+ */
+int metrics_register( const char *name, MetricType type )
+{
+   int i;
+   Metric *m;
+   char buf[256], *c;
+
+   if (!metrics_on)
+      return -1;
+
+   /* Keep the names safe for JSON and statsd. */
+   strncpy( buf, name, sizeof(buf)-1 );
+   buf[ sizeof(buf)-1 ] = '\0';
+   for (c=buf; *c!='\0'; c++)
+      if ((*c == ' ') || (*c == '"') || (*c == '\\') || (*c == ':') || (*c == '|'))
+         *c = '_';
+
+   for (i=0; i<array_size(metrics_stack); i++)
+      if (strcmp( metrics_stack[i].name, buf ) == 0)
+         break;
+
+   if (i >= array_size(metrics_stack)) {
+      m = &array_grow( &metrics_stack );
+      memset( m, 0, sizeof(Metric) );
+      m->name = strdup( buf );
+      m->type = type;
+      if (type == METRIC_HISTOGRAM)
+         m->samples = array_create( double );
+      i = array_size(metrics_stack)-1;
+   }
+   else if (metrics_stack[i].type != type)
+      WARN("Metric '%s' registered again with a different type.", name);
+
+   return i;
+}
+
+
+/**
+ * @brief Adds to a counter.
+ *
+ *    @param id Id of the counter.
+ *    @param n Amount to add.
+ */
+void metrics_count( int id, double n )
+{
+   if (id < 0)
+      return;
+   metrics_stack[id].value += n;
+}
+
+
+/**
+ * @brief Sets a gauge.
+ *
+ *    @param id Id of the gauge.
+ *    @param value Value to set.
+ */
+void metrics_set( int id, double value )
+{
+   if (id < 0)
+      return;
+   metrics_stack[id].value = value;
+   metrics_stack[id].set   = 1;
+}
+
+
+/**
+ * @brief Adds a sample to a histogram.
+ *
+ *    @param id Id of the histogram.
+ *    @param value Sample to add.
+ */
+void metrics_observe( int id, double value )
+{
+   Metric *m;
+
+   if (id < 0)
+      return;
+
+   m = &metrics_stack[id];
+   if ((m->n == 0) || (value > m->max))
+      m->max = value;
+   m->n++;
+   if (array_size(m->samples) < METRICS_SAMPLES)
+      array_push_back( &m->samples, value );
+}
+
+
+/**
+ * @brief Compares two samples for qsort.
+ */
+static int metrics_cmp( const void *p1, const void *p2 )
+{
+   double a, b;
+   a = *(const double*) p1;
+   b = *(const double*) p2;
+   if (a < b)
+      return -1;
+   else if (a > b)
+      return 1;
+   return 0;
+}
+
+
+/**
+ * @brief Gets a percentile of a histogram, samples must be sorted.
+ *
+ *    @param m Histogram to get percentile of.
+ *    @param p Percentile from 0 to 1.
+ *    @return The sample at the percentile.
+ */
+static double metrics_percentile( const Metric *m, double p )
+{
+   int n, i;
+
+   n = array_size(m->samples);
+   if (n == 0)
+      return 0.;
+   i = MIN( (int)(p * n), n-1 );
+   return m->samples[i];
+}
+
+
+/**
+ * @brief Samples the gauges of the subsystems reporting memory usage.
+ *
+ * They are registered the first time, once all the subsystems are up.
+ */
+static void metrics_sample (void)
+{
+   MemStat stats[MEMSTATS_MAX];
+   char name[128];
+   int i, n;
+
+   n = memstats_get( stats );
+   if (!metrics_memReady) {
+      for (i=0; i<n; i++) {
+         nsnprintf( name, sizeof(name), "mem.%s", stats[i].name );
+         metrics_mem[i]  = metrics_register( name, METRIC_GAUGE );
+         nsnprintf( name, sizeof(name), "count.%s", stats[i].name );
+         metrics_memN[i] = metrics_register( name, METRIC_GAUGE );
+      }
+      metrics_memReady = 1;
+   }
+   for (i=0; i<n; i++) {
+      metrics_set( metrics_mem[i],  stats[i].bytes );
+      metrics_set( metrics_memN[i], stats[i].n );
+   }
+}
+
+
+/**
+ * @brief Exports the metrics as a line of JSON.
+ */
+static void metrics_exportJSON (void)
+{
+   int i, first;
+   MetricType t;
+   Metric *m;
+   const char *sections[] = { "counters", "gauges", "histograms" };
+
+   fprintf( metrics_file, "{\"time\":%.3f", metrics_time );
+   for (t=METRIC_COUNTER; t<=METRIC_HISTOGRAM; t++) {
+      fprintf( metrics_file, ",\"%s\":{", sections[t] );
+      first = 1;
+      for (i=0; i<array_size(metrics_stack); i++) {
+         m = &metrics_stack[i];
+         if ((m->type != t) || ((t == METRIC_GAUGE) && !m->set))
+            continue;
+         fprintf( metrics_file, "%s\"%s\":", first ? "" : ",", m->name );
+         first = 0;
+         if (t != METRIC_HISTOGRAM) {
+            fprintf( metrics_file, "%.17g", m->value );
+            continue;
+         }
+         fprintf( metrics_file, "{\"n\":%d,\"p50\":%g,\"p90\":%g,\"p99\":%g,\"max\":%g}",
+               m->n, metrics_percentile( m, 0.5 ), metrics_percentile( m, 0.9 ),
+               metrics_percentile( m, 0.99 ), m->max );
+      }
+      fprintf( metrics_file, "}" );
+   }
+   fprintf( metrics_file, "}\n" );
+   fflush( metrics_file );
+}
+
+
+/**
+ * @brief Exports the metrics as statsd packets.
+ *
+ * Histograms were already summarized so they get sent as gauges.
+ */
+static void metrics_exportStatsd (void)
+{
+#if HAS_POSIX
+   char buf[METRICS_PACKET], line[256];
+   int i, j, len, pos;
+   Metric *m;
+   const char *pname[] = { "p50", "p90", "p99", "max" };
+   double pval[4];
+
+   pos = 0;
+   for (i=0; i<array_size(metrics_stack); i++) {
+      m = &metrics_stack[i];
+      for (j=0; j<4; j++) {
+         if (m->type == METRIC_COUNTER)
+            len = nsnprintf( line, sizeof(line), METRICS_PREFIX"%s:%g|c\n",
+                  m->name, m->value );
+         else if (m->type == METRIC_GAUGE) {
+            if (!m->set)
+               break;
+            len = nsnprintf( line, sizeof(line), METRICS_PREFIX"%s:%g|g\n",
+                  m->name, m->value );
+         }
+         else {
+            if (j == 0) {
+               pval[0] = metrics_percentile( m, 0.5 );
+               pval[1] = metrics_percentile( m, 0.9 );
+               pval[2] = metrics_percentile( m, 0.99 );
+               pval[3] = m->max;
+            }
+            len = nsnprintf( line, sizeof(line), METRICS_PREFIX"%s.%s:%g|g\n",
+                  m->name, pname[j], pval[j] );
+         }
+         len = MIN( len, (int)sizeof(line)-1 );
+
+         /* Send what is there when full. */
+         if (pos + len > METRICS_PACKET) {
+            sendto( metrics_sock, buf, pos, 0,
+                  (struct sockaddr*)&metrics_addr, metrics_addrlen );
+            pos = 0;
+         }
+         memcpy( &buf[pos], line, len );
+         pos += len;
+
+         if (m->type != METRIC_HISTOGRAM)
+            break;
+      }
+   }
+   if (pos > 0)
+      sendto( metrics_sock, buf, pos, 0,
+            (struct sockaddr*)&metrics_addr, metrics_addrlen );
+#endif /* HAS_POSIX */
+}
+
+
+/**
+ * @brief Clears what only lasts an interval.
+ */
+static void metrics_reset (void)
+{
+   int i;
+   Metric *m;
+
+   for (i=0; i<array_size(metrics_stack); i++) {
+      m = &metrics_stack[i];
+      if (m->type == METRIC_COUNTER)
+         m->value = 0.;
+      else if (m->type == METRIC_HISTOGRAM) {
+         array_erase( &m->samples, array_begin(m->samples), array_end(m->samples) );
+         m->n   = 0;
+         m->max = 0.;
+      }
+   }
+}
+
+
+/**
+ * @brief Writes the metrics out and starts a new interval.
+ */
+static void metrics_write (void)
+{
+   int i;
+   Metric *m;
+
+   for (i=0; i<array_size(metrics_stack); i++) {
+      m = &metrics_stack[i];
+      if (m->type == METRIC_HISTOGRAM)
+         qsort( m->samples, array_size(m->samples), sizeof(double), metrics_cmp );
+   }
+
+   if (metrics_file != NULL)
+      metrics_exportJSON();
+   else
+      metrics_exportStatsd();
+
+   metrics_reset();
+}
+
+
+/**
+ * @brief Exports the metrics right away.
+ */
+void metrics_export (void)
+{
+   if (!metrics_on)
+      return;
+
+   metrics_sample();
+   metrics_write();
+}
+
+
+/**
+ * @brief Accounts a frame and exports when the interval runs out.
+ *
+ *    @param dt Real time of the frame in seconds.
+ */
+void metrics_update( double dt )
+{
+   if (!metrics_on)
+      return;
+
+   metrics_count( metrics_frames, 1. );
+   metrics_observe( metrics_frameMs, dt * 1000. );
+
+   metrics_time  += dt;
+   metrics_timer -= dt;
+   if (metrics_timer > 0.)
+      return;
+
+   metrics_timer = metrics_interval;
+   metrics_export();
+}
+
+
+/**
+ * @brief Exports what is left and stops collecting metrics.
+ */
+void metrics_exit (void)
+{
+   int i;
+
+   if (!metrics_on)
+      return;
+
+   /* Subsystems may be gone already, gauges keep their last values. */
+   metrics_write();
+
+   for (i=0; i<array_size(metrics_stack); i++) {
+      free( metrics_stack[i].name );
+      if (metrics_stack[i].samples != NULL)
+         array_free( metrics_stack[i].samples );
+   }
+   array_free( metrics_stack );
+   metrics_stack = NULL;
+
+   if (metrics_file != NULL)
+      fclose( metrics_file );
+   metrics_file = NULL;
+#if HAS_POSIX
+   if (metrics_sock >= 0)
+      close( metrics_sock );
+   metrics_sock = -1;
+#endif /* HAS_POSIX */
+
+   metrics_on = 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef METRICS_H
+#  define METRICS_H
+
+
+/**
+ * @brief Kinds of metrics.
+ */
+typedef enum MetricType_ {
+   METRIC_COUNTER,   /**< Adds up, reported as the amount since the last export. */
+   METRIC_GAUGE,     /**< Keeps the last value set. */
+   METRIC_HISTOGRAM  /**< Samples summarized as percentiles at each export. */
+} MetricType;
+
+
+/*
+ * Set up.
+ */
+int metrics_init( const char *target, double interval );
+int metrics_enabled (void);
+void metrics_exit (void);
+
+/*
+ * Feeding.
+ */
+int metrics_register( const char *name, MetricType type );
+void metrics_count( int id, double n );
+void metrics_set( int id, double value );
+void metrics_observe( int id, double value );
+
+/*
+ * Exporting.
+ */
+void metrics_update( double dt );
+void metrics_export (void);
+
+
+#endif /* METRICS_H */
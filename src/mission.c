@@ -36,12 +36,15 @@
 #include "npc.h"
 #include "array.h"
 #include "land.h"
+#include "nhash.h"
+#include "conf.h"
 
 
 #define XML_MISSION_ID        "Missions" /**< XML document identifier */
 #define XML_MISSION_TAG       "mission" /**< XML mission tag. */
 
 #define MISSION_CHUNK         32 /**< Chunk allocation. */
+#define MISSION_NLOC          (MIS_AVAIL_SPACE+1) /**< Number of availability locations. */
 
 
 /*
@@ -56,6 +59,29 @@ Mission *player_missions[MISSION_MAX]; /**< Player's active missions. */
  */
 static MissionData *mission_stack = NULL; /**< Unmutable after creation */
 static int mission_nstack = 0; /**< Missions in stack. */
+static NameHash mission_hash; /**< Mission name to stack index. */
+
+
+/**
+ * @brief Missions that can appear at a location and aren't tied to a planet
+ *  or system, split by faction.
+ */
+typedef struct MissionLocIndex_ {
+   int *all; /**< All of them, for when there's no faction. */
+   int *any; /**< Those available to any faction. */
+   int **faction; /**< Those available to each faction, NULL if none. */
+   int nfaction; /**< Number of factions in faction. */
+} MissionLocIndex;
+
+
+/*
+ * mission index, built once the stack is loaded
+ */
+static MissionLocIndex mission_locIndex[MISSION_NLOC]; /**< Generic missions per location. */
+static NameHash mission_planetHash; /**< Planet name to bucket in mission_planetList. */
+static NameHash mission_systemHash; /**< System name to bucket in mission_systemList. */
+static int **mission_planetList = NULL; /**< Missions tied to each planet. */
+static int **mission_systemList = NULL; /**< Missions tied to each system (and no planet). */
 
 
 /*
@@ -68,6 +94,14 @@ static int mission_init( Mission* mission, MissionData* misn, int genid, int cre
 static void mission_freeData( MissionData* mission );
 /* Matching. */
 static int mission_compare( const void* arg1, const void* arg2 );
+static int mission_compareID( const void* arg1, const void* arg2 );
+static void mission_indexAdd( int **list, int id );
+static void mission_indexBucket( NameHash *hash, int ***lists, const char *name, int id );
+static void mission_indexBuild (void);
+static void mission_indexFreeLists( int **lists );
+static void mission_indexFree (void);
+static int* mission_getCandidates( int loc, int faction,
+      const char* planet, const char* sysname );
 static int mission_meetReq( int mission, int faction,
       const char* planet, const char* sysname );
 static int mission_matchFaction( MissionData* misn, int faction );
@@ -108,9 +142,9 @@ int mission_getID( const char* name )
 {
    int i;
 
-   for (i=0; i<mission_nstack; i++)
-      if (strcmp(name,mission_stack[i].name)==0)
-         return i;
+   i = nhash_get( &mission_hash, name );
+   if (i >= 0)
+      return i;
 
    DEBUG("Mission '%s' not found in stack", name);
    return -1;
@@ -176,24 +210,49 @@ static int mission_init( Mission* mission, MissionData* misn, int genid, int cre
 
    /* init Lua */
    mission->env = nlua_newEnv(1);
+   nlua_setMemLimit( mission->env, (size_t)MAX( 0, conf.misn_mem ) * 1024 * 1024 );
 
    misn_loadLibs( mission->env ); /* load our custom libraries */
 
-   /* load the file */
-   buf = ndata_read( misn->lua, &bufsize );
-   if (buf == NULL) {
-      WARN("Mission '%s' Lua script not found.", misn->lua );
-      return -1;
+   /* Load the file once, instances only run the loaded chunk. */
+   if (misn->chunk == LUA_NOREF) {
+      buf = ndata_read( misn->lua, &bufsize );
+      if (buf == NULL) {
+         WARN("Mission '%s' Lua script not found.", misn->lua );
+         return -1;
+      }
+      if (nlua_loadbuffer( naevL, buf, bufsize, misn->lua ) != 0) {
+         WARN("Error loading mission file: %s\n"
+             "%s\n"
+             "Most likely Lua file has improper syntax, please check",
+               misn->lua, lua_tostring(naevL, -1));
+         lua_pop(naevL, 1);
+         free(buf);
+         return -1;
+      }
+      free(buf);
+      misn->chunk = luaL_ref( naevL, LUA_REGISTRYINDEX );
    }
-   if (nlua_dobufenv(mission->env, buf, bufsize, misn->lua) != 0) {
-      WARN("Error loading mission file: %s\n"
-          "%s\n"
-          "Most likely Lua file has improper syntax, please check",
+
+   /* Run it in the mission environment, the functions it defines inherit it. */
+   lua_rawgeti( naevL, LUA_REGISTRYINDEX, misn->chunk );
+   nlua_pushenv( mission->env );
+   lua_setfenv( naevL, -2 );
+   ret = nlua_pcall( mission->env, 0, 0 );
+
+   /* Don't keep the environment alive through the chunk. */
+   lua_rawgeti( naevL, LUA_REGISTRYINDEX, misn->chunk );
+   lua_pushvalue( naevL, LUA_GLOBALSINDEX );
+   lua_setfenv( naevL, -2 );
+   lua_pop( naevL, 1 );
+
+   if (ret != 0) {
+      WARN("Error running mission file: %s\n"
+          "%s\n",
             misn->lua, lua_tostring(naevL, -1));
-      free(buf);
+      lua_pop(naevL, 1);
       return -1;
    }
-   free(buf);
 
    /* run create function */
    if (create) {
@@ -279,7 +338,7 @@ static int mission_meetReq( int mission, int faction,
 
    /* Must meet Lua condition. */
    if (misn->avail.cond != NULL) {
-      c = cond_check(misn->avail.cond);
+      c = cond_checkRef(misn->avail.cond_ref);
       if (c < 0) {
          WARN("Conditional for mission '%s' failed to run", misn->name);
          return 0;
@@ -309,13 +368,14 @@ void missions_run( int loc, int faction, const char* planet, const char* sysname
 {
    MissionData* misn;
    Mission mission;
-   int i;
+   int i, j;
+   int *cand;
    double chance;
 
-   for (i=0; i<mission_nstack; i++) {
+   cand = mission_getCandidates( loc, faction, planet, sysname );
+   for (j=0; j<array_size(cand); j++) {
+      i    = cand[j];
       misn = &mission_stack[i];
-      if (misn->avail.loc != loc)
-         continue;
 
       if (!mission_meetReq(i, faction, planet, sysname))
          continue;
@@ -329,6 +389,203 @@ void missions_run( int loc, int faction, const char* planet, const char* sysname
          mission_cleanup(&mission); /* it better clean up for itself or we do it */
       }
    }
+   array_free( cand );
+}
+
+
+/**
+ * @brief Compares mission IDs for qsort.
+ */
+static int mission_compareID( const void* arg1, const void* arg2 )
+{
+   return *(const int*)arg1 - *(const int*)arg2;
+}
+
+
+/**
+ * @brief Adds a mission to an index list, creating it if needed.
+ */
+static void mission_indexAdd( int **list, int id )
+{
+   if (*list == NULL)
+      *list = array_create( int );
+   array_push_back( list, id );
+}
+
+
+/**
+ * @brief Adds a mission to the bucket of a planet or system name.
+ */
+static void mission_indexBucket( NameHash *hash, int ***lists, const char *name, int id )
+{
+   int b;
+
+   b = nhash_get( hash, name );
+   if (b < 0) {
+      if (*lists == NULL)
+         *lists = array_create( int* );
+      b = array_size( *lists );
+      array_push_back( lists, NULL );
+      nhash_set( hash, name, b );
+   }
+   mission_indexAdd( &(*lists)[b], id );
+}
+
+
+/**
+ * @brief Buckets the missions by where they can appear.
+ *
+ * Missions tied to a planet or system go into that name's bucket, the rest
+ *  go by location and faction so a landing only looks at missions that can
+ *  actually show up there.
+ */
+static void mission_indexBuild (void)
+{
+   int i, j, f;
+   MissionData *misn;
+   MissionLocIndex *idx;
+
+   mission_indexFree();
+
+   for (i=0; i<mission_nstack; i++) {
+      misn = &mission_stack[i];
+      if ((misn->avail.loc < 0) || (misn->avail.loc >= MISSION_NLOC) ||
+            (misn->avail.loc == MIS_AVAIL_NONE))
+         continue;
+
+      /* Tied to a place. */
+      if (misn->avail.planet != NULL) {
+         mission_indexBucket( &mission_planetHash, &mission_planetList,
+               misn->avail.planet, i );
+         continue;
+      }
+      if (misn->avail.system != NULL) {
+         mission_indexBucket( &mission_systemHash, &mission_systemList,
+               misn->avail.system, i );
+         continue;
+      }
+
+      /* Generic. */
+      idx = &mission_locIndex[ misn->avail.loc ];
+      mission_indexAdd( &idx->all, i );
+      if (misn->avail.nfactions <= 0) {
+         mission_indexAdd( &idx->any, i );
+         continue;
+      }
+      for (j=0; j<misn->avail.nfactions; j++) {
+         f = misn->avail.factions[j];
+         if (f < 0)
+            continue;
+         if (f >= idx->nfaction) {
+            idx->faction = realloc( idx->faction, sizeof(int*) * (f+1) );
+            memset( &idx->faction[idx->nfaction], 0,
+                  sizeof(int*) * (f+1 - idx->nfaction) );
+            idx->nfaction = f+1;
+         }
+         /* Don't list twice if the faction is repeated. */
+         if ((idx->faction[f] != NULL) &&
+               (idx->faction[f][ array_size(idx->faction[f])-1 ] == i))
+            continue;
+         mission_indexAdd( &idx->faction[f], i );
+      }
+   }
+}
+
+
+/**
+ * @brief Frees an index list array.
+ */
+static void mission_indexFreeLists( int **lists )
+{
+   int i;
+   if (lists == NULL)
+      return;
+   for (i=0; i<array_size(lists); i++)
+      if (lists[i] != NULL)
+         array_free( lists[i] );
+   array_free( lists );
+}
+
+
+/**
+ * @brief Frees the mission index.
+ */
+static void mission_indexFree (void)
+{
+   int i, j;
+   MissionLocIndex *idx;
+
+   for (i=0; i<MISSION_NLOC; i++) {
+      idx = &mission_locIndex[i];
+      if (idx->all != NULL)
+         array_free( idx->all );
+      if (idx->any != NULL)
+         array_free( idx->any );
+      for (j=0; j<idx->nfaction; j++)
+         if (idx->faction[j] != NULL)
+            array_free( idx->faction[j] );
+      free( idx->faction );
+      memset( idx, 0, sizeof(MissionLocIndex) );
+   }
+   mission_indexFreeLists( mission_planetList );
+   mission_indexFreeLists( mission_systemList );
+   mission_planetList = NULL;
+   mission_systemList = NULL;
+   nhash_free( &mission_planetHash );
+   nhash_free( &mission_systemHash );
+}
+
+
+/**
+ * @brief Gathers the missions that may appear at a location.
+ *
+ * A new array is returned since running missions may land on another
+ *  planet and look for missions again.
+ *
+ *    @return Array of mission IDs in stack order, free with array_free().
+ */
+static int* mission_getCandidates( int loc, int faction,
+      const char* planet, const char* sysname )
+{
+   int i, b;
+   int *l, *c;
+   MissionLocIndex *idx;
+
+   c = array_create( int );
+   if ((loc < 0) || (loc >= MISSION_NLOC))
+      return c;
+
+   /* Generic ones. */
+   idx = &mission_locIndex[loc];
+   l   = (faction < 0) ? idx->all : idx->any;
+   if (l != NULL)
+      for (i=0; i<array_size(l); i++)
+         array_push_back( &c, l[i] );
+   if ((faction >= 0) && (faction < idx->nfaction) && (idx->faction[faction] != NULL)) {
+      l = idx->faction[faction];
+      for (i=0; i<array_size(l); i++)
+         array_push_back( &c, l[i] );
+   }
+
+   /* Place specific ones, of any location. */
+   b = (planet != NULL) ? nhash_get( &mission_planetHash, planet ) : -1;
+   if (b >= 0) {
+      l = mission_planetList[b];
+      for (i=0; i<array_size(l); i++)
+         if (mission_stack[ l[i] ].avail.loc == loc)
+            array_push_back( &c, l[i] );
+   }
+   b = (sysname != NULL) ? nhash_get( &mission_systemHash, sysname ) : -1;
+   if (b >= 0) {
+      l = mission_systemList[b];
+      for (i=0; i<array_size(l); i++)
+         if (mission_stack[ l[i] ].avail.loc == loc)
+            array_push_back( &c, l[i] );
+   }
+
+   /* Keep the stack order the missions used to be run in. */
+   qsort( c, array_size(c), sizeof(int), mission_compareID );
+   return c;
 }
 
 
@@ -595,14 +852,18 @@ static void mission_freeData( MissionData* mission )
       free(mission->name);
    if (mission->lua)
       free(mission->lua);
+   if ((mission->chunk != LUA_NOREF) && (naevL != NULL))
+      luaL_unref( naevL, LUA_REGISTRYINDEX, mission->chunk );
    if (mission->avail.planet)
       free(mission->avail.planet);
    if (mission->avail.system)
       free(mission->avail.system);
    if (mission->avail.factions)
       free(mission->avail.factions);
-   if (mission->avail.cond)
+   if (mission->avail.cond) {
       free(mission->avail.cond);
+      cond_free(mission->avail.cond_ref);
+   }
    if (mission->avail.done)
       free(mission->avail.done);
 
@@ -694,7 +955,8 @@ static int mission_compare( const void* arg1, const void* arg2 )
 Mission* missions_genList( int *n, int faction,
       const char* planet, const char* sysname, int loc )
 {
-   int i,j, m, alloced;
+   int i,j,k, m, alloced;
+   int *cand;
    double chance;
    int rep;
    Mission* tmp;
@@ -710,7 +972,9 @@ Mission* missions_genList( int *n, int faction,
    tmp      = NULL;
    m        = 0;
    alloced  = 0;
-   for (i=0; i<mission_nstack; i++) {
+   cand = mission_getCandidates( loc, faction, planet, sysname );
+   for (k=0; k<array_size(cand); k++) {
+      i    = cand[k];
       misn = &mission_stack[i];
       if (misn->avail.loc == loc) {
 
@@ -741,6 +1005,7 @@ Mission* missions_genList( int *n, int faction,
             }
       }
    }
+   array_free( cand );
 
    /* Sort. */
    if (tmp != NULL) {
@@ -794,6 +1059,7 @@ static int mission_parse( MissionData* temp, const xmlNodePtr parent )
 
    /* Clear memory. */
    memset( temp, 0, sizeof(MissionData) );
+   temp->chunk = LUA_NOREF;
 
    /* Defaults. */
    temp->avail.priority = 5;
@@ -880,6 +1146,10 @@ static int mission_parse( MissionData* temp, const xmlNodePtr parent )
    MELEMENT((temp->avail.loc!=MIS_AVAIL_NONE) && (temp->avail.chance==0),"chance");
 #undef MELEMENT
 
+   /* Compile the condition once. */
+   if (temp->avail.cond != NULL)
+      temp->avail.cond_ref = cond_compile( temp->avail.cond );
+
    return 0;
 }
 
@@ -934,6 +1204,14 @@ int missions_load (void)
    /* Shrink to minimum. */
    mission_stack = realloc(mission_stack, sizeof(MissionData)*mission_nstack);
 
+   /* Index by name. */
+   nhash_init( &mission_hash );
+   for (i=0; i<mission_nstack; i++)
+      nhash_set( &mission_hash, mission_stack[i].name, i );
+
+   /* Bucket them by where they appear. */
+   mission_indexBuild();
+
    /* Clean up. */
    xmlFreeDoc(doc);
    free(buf);
@@ -955,11 +1233,13 @@ void missions_free (void)
    missions_cleanup();
 
    /* Free the mission data. */
+   mission_indexFree();
    for (i=0; i<mission_nstack; i++)
       mission_freeData( &mission_stack[i] );
    free( mission_stack );
    mission_stack = NULL;
    mission_nstack = 0;
+   nhash_free( &mission_hash );
 
    /* Free the player mission stack. */
    for (i=0; i<MISSION_MAX; i++)
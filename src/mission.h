@@ -60,6 +60,7 @@ typedef struct MissionAvail_s {
    int nfactions; /**< Number of factions in factions. */
 
    char* cond; /**< Condition that must be met (Lua). */
+   int cond_ref; /**< Compiled condition, see cond_compile(). */
    char* done; /**< Previous mission that must have been done. */
 
    int priority; /**< Mission priority: 0 = main plot, 5 = default, 10 = insignificant. */
@@ -78,6 +79,7 @@ typedef struct MissionData_ {
 
    unsigned int flags; /**< Flags to store binary properties */
    char* lua; /**< Lua file to use. */
+   int chunk; /**< Loaded script, registry reference or LUA_NOREF, see mission_init(). */
 } MissionData;
 
 
@@ -27,6 +27,9 @@
  */
 #define RG_PREAMP_DB       0.0
 
+#define MUSIC_BUFFERS      4 /**< Number of buffers queued while streaming. */
+#define MUSIC_FADE_STEP    10 /**< Milliseconds between volume updates when fading. */
+
 
 /* Lock for OpenAL operations. */
 #define soundLock()        SDL_mutexP(sound_lock)
@@ -83,6 +86,7 @@ static char *music_buf              = NULL; /**< Music playing buffer. */
 extern SDL_mutex *sound_lock; /**< Global sound lock, used for all OpenAL calls. */
 static SDL_mutex *music_vorbis_lock = NULL; /**< Lock for vorbisfile operations. */
 static SDL_cond  *music_state_cond  = NULL; /**< Cond for thread to signal status updates. */
+static SDL_cond  *music_cmd_cond    = NULL; /**< Cond for thread to wait for commands. */
 static SDL_mutex *music_state_lock  = NULL; /**< Lock for music state. */
 static music_cmd_t   music_command  = MUSIC_CMD_NONE; /**< Target music state. */
 static music_state_t music_state    = MUSIC_STATE_DEAD; /**< Current music state. */
@@ -108,7 +112,7 @@ typedef struct alMusic_ {
  * song currently playing
  */
 static alMusic music_vorbis; /**< Current music. */
-static ALuint music_buffer[2]; /**< Front and back buffer. */
+static ALuint music_buffer[MUSIC_BUFFERS]; /**< Streaming buffers. */
 ALuint music_source                    = 0; /**< Source associated to music. */
 
 
@@ -127,7 +131,11 @@ static void rg_filter( float **pcm, long channels, long samples, void *filter_pa
 #endif /* HAVE_OV_READ_FILTER */
 static void music_kill (void);
 static int music_thread( void* unused );
+static void music_command_set( music_cmd_t cmd );
+static int music_wait_delay( music_state_t state, int buf_ms );
 static int stream_loadBuffer( ALuint buffer );
+static int stream_bufferTime (void);
+static int stream_refill (void);
 
 
 /**
@@ -139,10 +147,11 @@ static int music_thread( void* unused )
 {
    (void)unused;
 
-   int ret;
-   int active = 0; /* active buffer */
+   int i, ret, delay;
+   int eof = 0; /* no more data to queue */
+   int buf_ms = 0; /* duration of a buffer */
    ALint state;
-   ALuint removed[2];
+   ALuint removed[MUSIC_BUFFERS];
    ALenum value;
    music_state_t cur_state;
    ALfloat gain;
@@ -166,8 +175,11 @@ static int music_thread( void* unused )
 
          case MUSIC_CMD_STOP:
             /* Notify of stopped. */
-            if (music_state == MUSIC_STATE_IDLE)
+            if (music_state == MUSIC_STATE_IDLE) {
                SDL_CondBroadcast( music_state_cond );
+               /* Clear command so the thread can go to sleep. */
+               music_command = MUSIC_CMD_NONE;
+            }
             else
                music_state = MUSIC_STATE_STOPPING;
             break;
@@ -308,11 +320,11 @@ static int music_thread( void* unused )
 
          /* Load the song. */
          case MUSIC_STATE_LOADING:
-            /* Load buffer and start playing. */
-            active = 0; /* load first buffer */
-            ret = stream_loadBuffer( music_buffer[active] );
+            /* Load first buffer and start playing. */
+            buf_ms = stream_bufferTime();
+            ret = stream_loadBuffer( music_buffer[0] );
             soundLock();
-            alSourceQueueBuffers( music_source, 1, &music_buffer[active] );
+            alSourceQueueBuffers( music_source, 1, &music_buffer[0] );
 
             /* Special case NULL file or error. */
             if (ret < 0) {
@@ -336,32 +348,21 @@ static int music_thread( void* unused )
             al_checkErr();
 
             soundUnlock();
-            /* Special case of a very short song. */
-            if (ret > 1) {
-               active = -1;
-
-               musicLock();
-               if (fadein_start)
-                  music_state = MUSIC_STATE_FADEIN;
-               else
-                  music_state = MUSIC_STATE_PLAYING;
-               SDL_CondBroadcast( music_state_cond );
-               musicUnlock();
-               break;
-            }
 
-            /* Load second buffer. */
-            active = 1;
-            ret = stream_loadBuffer( music_buffer[active] );
-            if (ret < 0)
-               active = -1;
-            else {
+            /* Fill the rest of the queue, short songs may not need it. */
+            eof = (ret > 0);
+            for (i=1; (i<MUSIC_BUFFERS) && !eof; i++) {
+               ret = stream_loadBuffer( music_buffer[i] );
+               if (ret < 0) {
+                  eof = 1;
+                  break;
+               }
                soundLock();
-               alSourceQueueBuffers( music_source, 1, &music_buffer[active] );
+               alSourceQueueBuffers( music_source, 1, &music_buffer[i] );
                /* Check for errors. */
                al_checkErr();
                soundUnlock();
-               active = 1 - active;
+               eof = (ret > 0);
             }
 
             musicLock();
@@ -425,7 +426,7 @@ static int music_thread( void* unused )
          /* Play the song if needed. */
          case MUSIC_STATE_PLAYING:
             /* Special case where file has ended. */
-            if (active < 0) {
+            if (eof) {
                soundLock();
                alGetSourcei( music_source, AL_SOURCE_STATE, &state );
 
@@ -448,34 +449,109 @@ static int music_thread( void* unused )
                break;
             }
 
-            soundLock();
+            /* Refill all the buffers that were played. */
+            eof = stream_refill();
+      }
 
-            /* See if needs another buffer set. */
-            alGetSourcei( music_source, AL_BUFFERS_PROCESSED, &state );
-            if (state > 0) {
-               /* refill active buffer */
-               alSourceUnqueueBuffers( music_source, 1, removed );
-               ret = stream_loadBuffer( music_buffer[active] );
-               if (ret < 0)
-                  active = -1;
-               else {
-                  alSourceQueueBuffers( music_source, 1, &music_buffer[active] );
-                  active = 1 - active;
-               }
-            }
+      /* Sleep until a command arrives or there is work to do. */
+      musicLock();
+      if (music_command == MUSIC_CMD_NONE) {
+         delay = music_wait_delay( music_state, buf_ms );
+         if (delay < 0)
+            SDL_CondWait( music_cmd_cond, music_state_lock );
+         else if (delay > 0)
+            SDL_CondWaitTimeout( music_cmd_cond, music_state_lock, delay );
+      }
+      musicUnlock();
+   }
 
-            /* Check for errors. */
-            al_checkErr();
+   return 0;
+}
 
-            soundUnlock();
-      }
 
-      /* Global thread delay. */
-      SDL_Delay(0);
+/**
+ * @brief Gives the music thread a command and wakes it up.
+ *
+ * Must be called with the music state lock held.
+ *
+ *    @param cmd Command to give.
+ */
+static void music_command_set( music_cmd_t cmd )
+{
+   music_command = cmd;
+   SDL_CondSignal( music_cmd_cond );
+}
+
+
+/**
+ * @brief Gets how long the music thread can sleep in a state.
+ *
+ * While streaming the thread wakes up about once per buffer played, the rest
+ *  of the queue covers for the time it takes to get scheduled again.
+ *
+ *    @param state State the thread is in.
+ *    @param buf_ms Duration of a buffer in milliseconds.
+ *    @return Milliseconds to sleep, 0 for none and -1 until a command arrives.
+ */
+static int music_wait_delay( music_state_t state, int buf_ms )
+{
+   switch (state) {
+      case MUSIC_STATE_IDLE:
+      case MUSIC_STATE_PAUSED:
+         return -1;
+
+      case MUSIC_STATE_FADEIN:
+      case MUSIC_STATE_FADEOUT:
+         return MUSIC_FADE_STEP;
+
+      case MUSIC_STATE_PLAYING:
+         return MAX( buf_ms, MUSIC_FADE_STEP );
 
+      default:
+         return 0;
    }
+}
 
-   return 0;
+
+/**
+ * @brief Refills the buffers that finished playing and queues them again.
+ *
+ *    @return 1 if the stream has no more data, 0 otherwise.
+ */
+static int stream_refill (void)
+{
+   int ret, eof;
+   ALint processed, state, queued;
+   ALuint buffer;
+
+   soundLock();
+
+   eof = 0;
+   alGetSourcei( music_source, AL_BUFFERS_PROCESSED, &processed );
+   while ((processed > 0) && !eof) {
+      alSourceUnqueueBuffers( music_source, 1, &buffer );
+      processed--;
+      ret = stream_loadBuffer( buffer );
+      if (ret < 0)
+         eof = 1;
+      else {
+         alSourceQueueBuffers( music_source, 1, &buffer );
+         eof = (ret > 0);
+      }
+   }
+
+   /* The queue ran dry before we woke up, get it going again. */
+   alGetSourcei( music_source, AL_SOURCE_STATE, &state );
+   alGetSourcei( music_source, AL_BUFFERS_QUEUED, &queued );
+   if ((state == AL_STOPPED) && (queued > 0))
+      alSourcePlay( music_source );
+
+   /* Check for errors. */
+   al_checkErr();
+
+   soundUnlock();
+
+   return eof;
 }
 
 
@@ -601,6 +677,30 @@ static int stream_loadBuffer( ALuint buffer )
 }
 
 
+/**
+ * @brief Gets the duration of a full buffer of the current song.
+ *
+ *    @return Duration in milliseconds.
+ */
+static int stream_bufferTime (void)
+{
+   int ms;
+
+   musicVorbisLock();
+
+   if ((music_vorbis.rw == NULL) || (music_vorbis.info == NULL) ||
+         (music_vorbis.info->rate <= 0))
+      ms = 0;
+   else
+      ms = (int)(1000. * music_bufSize /
+            (2. * music_vorbis.info->channels * music_vorbis.info->rate));
+
+   musicVorbisUnlock();
+
+   return ms;
+}
+
+
 /**
  * @brief Initializes the OpenAL music subsystem.
  */
@@ -610,6 +710,7 @@ int music_al_init (void)
 
    /* Create threading mechanisms. */
    music_state_cond  = SDL_CreateCond();
+   music_cmd_cond    = SDL_CreateCond();
    music_state_lock  = SDL_CreateMutex();
    music_vorbis_lock = SDL_CreateMutex();
    music_vorbis.rw   = NULL; /* indication it's not loaded */
@@ -623,7 +724,7 @@ int music_al_init (void)
    /* music_source created in sound_al_init. */
 
    /* Generate buffers and sources. */
-   alGenBuffers( 2, music_buffer );
+   alGenBuffers( MUSIC_BUFFERS, music_buffer );
 
    /* Set up OpenAL properties. */
    alSourcef(  music_source, AL_GAIN, music_vol );
@@ -666,7 +767,7 @@ void music_al_exit (void)
    soundLock();
 
    /* Free the music. */
-   alDeleteBuffers( 2, music_buffer );
+   alDeleteBuffers( MUSIC_BUFFERS, music_buffer );
    alDeleteSources( 1, &music_source );
 
    /* Check for errors. */
@@ -683,6 +784,7 @@ void music_al_exit (void)
    SDL_DestroyMutex( music_vorbis_lock );
    SDL_DestroyMutex( music_state_lock );
    SDL_DestroyCond( music_state_cond );
+   SDL_DestroyCond( music_cmd_cond );
 }
 
 
@@ -749,7 +851,7 @@ void music_al_free (void)
    /* Stop music if needed. */
    musicLock();
    if (music_state != MUSIC_STATE_IDLE) {
-      music_command = MUSIC_CMD_STOP;
+      music_command_set( MUSIC_CMD_STOP );
       music_forced  = 1;
       while (1) {
          SDL_CondWait( music_state_cond, music_state_lock );
@@ -825,7 +927,7 @@ void music_al_play (void)
 {
    musicLock();
 
-   music_command = MUSIC_CMD_FADEIN;
+   music_command_set( MUSIC_CMD_FADEIN );
    while (1) {
       SDL_CondWait( music_state_cond, music_state_lock );
       if (music_isPlaying())
@@ -843,7 +945,7 @@ void music_al_stop (void)
 {
    musicLock();
 
-   music_command = MUSIC_CMD_FADEOUT;
+   music_command_set( MUSIC_CMD_FADEOUT );
    while (1) {
       SDL_CondWait( music_state_cond, music_state_lock );
       if ((music_state == MUSIC_STATE_IDLE) ||
@@ -862,7 +964,7 @@ void music_al_pause (void)
 {
    musicLock();
 
-   music_command = MUSIC_CMD_PAUSE;
+   music_command_set( MUSIC_CMD_PAUSE );
    while (1) {
       SDL_CondWait( music_state_cond, music_state_lock );
       if ((music_state == MUSIC_STATE_IDLE) ||
@@ -881,7 +983,7 @@ void music_al_resume (void)
 {
    musicLock();
 
-   music_command = MUSIC_CMD_PLAY;
+   music_command_set( MUSIC_CMD_PLAY );
    while (1) {
       SDL_CondWait( music_state_cond, music_state_lock );
       if (music_isPlaying())
@@ -945,7 +1047,7 @@ static void music_kill (void)
    int ret;
    musicLock();
 
-   music_command = MUSIC_CMD_KILL;
+   music_command_set( MUSIC_CMD_KILL );
    music_forced  = 1;
    while (1) {
       ret = SDL_CondWaitTimeout( music_state_cond, music_state_lock, 3000 );
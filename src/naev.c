@@ -59,6 +59,7 @@
 #include "ai.h"
 #include "outfit.h"
 #include "weapon.h"
+#include "explosion.h"
 #include "faction.h"
 #include "nxml.h"
 #include "toolkit.h"
@@ -94,9 +95,19 @@
 #include "start.h"
 #include "threadpool.h"
 #include "load.h"
+#include "save.h"
 #include "options.h"
 #include "dialogue.h"
 #include "slots.h"
+#include "perf.h"
+#include "memstats.h"
+#include "metrics.h"
+#include "startup.h"
+#include "bench.h"
+#include "replay.h"
+#include "scratch.h"
+#include "spacesim.h"
+#include "nhash.h"
 
 
 #define CONF_FILE       "conf.lua" /**< Configuration file by default. */
@@ -122,8 +133,18 @@ static double fps_dt    = 1.; /**< Display fps accumulator. */
 static double game_dt   = 0.; /**< Current game deltatick (uses dt_mod). */
 static double real_dt   = 0.; /**< Real deltatick. */
 const double fps_min    = 1./30.; /**< Minimum fps to run at. */
+static const double fps_min_ff = 1./10.; /**< Minimum fps while autonav fast-forwards. */
+static const double fps_sim = 1./60.; /**< Rate of the fixed simulation tick in real time. */
+static double sim_accum = 0.; /**< Game time not simulated yet. */
+static double sim_alpha = 1.; /**< How far rendering is into the next tick. */
 static double fps_x     =  15.; /**< FPS X position. */
+static const double pace_margin = 0.001; /**< Seconds woken early in low latency mode. */
+static const double pace_decay = 0.1; /**< How fast the predicted frame time follows shorter frames. */
+static double pace_work = 0.; /**< Predicted seconds from waking up to the frame being done. */
+static double pace_wake = -1.; /**< When the running frame woke up, -1 if unknown. */
 static double fps_y     = -15.; /**< FPS Y position. */
+static glFbo *scene_fbo = NULL; /**< Scene kept while the game is frozen. */
+static int scene_valid  = 0; /**< Whether scene_fbo holds the current scene. */
 
 #if HAS_LINUX && HAS_BFD && defined(DEBUGGING)
 static bfd *abfd      = NULL;
@@ -146,9 +167,16 @@ static void debug_sigClose (void);
 /* update */
 static void fps_init (void);
 static double fps_elapsed (void);
+static double fps_now (void);
+static void fps_sleep( double delay );
 static void fps_control (void);
+static double pace_target (void);
+static void pace_done (void);
+static void pace_wait (void);
 static void update_all (void);
-static void render_all (void);
+static void render_all( int frozen );
+static void render_scene( double dt );
+static int render_sceneCached( double dt );
 /* Misc. */
 void loadscreen_render( double done, const char *msg ); /* nebula.c */
 void main_loop( int update ); /* dialogue.c */
@@ -199,6 +227,9 @@ int main( int argc, char** argv )
    /* Initializes SDL for possible warnings. */
    SDL_Init(0);
 
+   /* Write logs in the background from now on. */
+   log_init();
+
    /* Initialize the threadpool */
    threadpool_init();
 
@@ -284,6 +315,12 @@ int main( int argc, char** argv )
       log_purge();
 
 
+   /* Start the Lua profiler if wanted. */
+   nlua_profEnable( conf.lua_profile );
+
+   /* Profile the rest of the startup if wanted. */
+   startup_init( conf.startup_profile );
+
    /* Enable FPU exceptions. */
 #if defined(HAVE_FEENABLEEXCEPT) && defined(DEBUGGING)
    if (conf.fpu_except)
@@ -291,6 +328,7 @@ int main( int argc, char** argv )
 #endif /* defined(HAVE_FEENABLEEXCEPT) && defined(DEBUGGING) */
 
    /* Open data. */
+   startup_begin( "ndata" );
    if (ndata_open() != 0)
       ERR("Failed to open ndata.");
 
@@ -308,16 +346,27 @@ int main( int argc, char** argv )
 
    /* random numbers */
    rng_init();
+   if (replay_init())
+      WARN("Unable to record or replay the session.");
+   if (metrics_init( conf.metrics, conf.metrics_interval ))
+      WARN("Unable to export metrics.");
 
    /*
     * OpenGL
     */
+   startup_begin( "opengl" );
    if (gl_init()) { /* initializes video output */
       ERR("Initializing video output failed, exiting...");
       SDL_Quit();
       exit(EXIT_FAILURE);
    }
    window_caption();
+#if SDL_VERSION_ATLEAST(2,0,0)
+   /* Benchmarks and the economy simulation don't show anything. */
+   if ((conf.bench != NULL) || (conf.econsim > 0))
+      SDL_HideWindow( gl_screen.window );
+#endif /* SDL_VERSION_ATLEAST(2,0,0) */
+   startup_begin( "fonts" );
    gl_fontInit( NULL, NULL, conf.font_size_def ); /* initializes default font to size */
    gl_fontInit( &gl_smallFont, NULL, conf.font_size_small ); /* small font */
    gl_fontInit( &gl_defFontMono, "dat/mono.ttf", conf.font_size_def );
@@ -328,6 +377,7 @@ int main( int argc, char** argv )
 #endif /* SDL_VERSION_ATLEAST(2,0,0) */
 
    /* Display the load screen. */
+   startup_begin( "loadscreen" );
    loadscreen_load();
    loadscreen_render( 0., "Initializing subsystems..." );
    time_ms = SDL_GetTicks();
@@ -336,6 +386,7 @@ int main( int argc, char** argv )
    /*
     * Input
     */
+   startup_begin( "input" );
    if ((conf.joystick_ind >= 0) || (conf.joystick_nam != NULL)) {
       if (joystick_init()) WARN("Error initializing joystick input");
       if (conf.joystick_nam != NULL) { /* use the joystick name to find a joystick */
@@ -355,6 +406,7 @@ int main( int argc, char** argv )
    /*
     * OpenAL - Sound
     */
+   startup_begin( "sound" );
    if (conf.nosound) {
       LOG("Sound is disabled!");
       sound_disabled = 1;
@@ -367,11 +419,13 @@ int main( int argc, char** argv )
    fps_setPos( 15., (double)(gl_screen.h-15-gl_defFont.h) );
 
    /* Misc graphics init */
+   startup_begin( "nebula" );
    if (nebu_init() != 0) { /* Initializes the nebula */
       /* An error has happened */
       ERR("Unable to initialize the Nebula subsystem!");
       /* Weirdness will occur... */
    }
+   startup_begin( "gui" );
    gui_init(); /* initializes the GUI graphics */
    toolkit_init(); /* initializes the toolkit */
    map_init(); /* initializes the map. */
@@ -380,6 +434,7 @@ int main( int argc, char** argv )
 
    /* Data loading */
    load_all();
+   startup_begin( "menu" );
 
 #if SDL_VERSION_ATLEAST(2,0,0)
    /* Detect size changes that occurred during load. */
@@ -393,8 +448,24 @@ int main( int argc, char** argv )
    /* Unload load screen. */
    loadscreen_unload();
 
+   /* Run the benchmark instead of the game. */
+   if (conf.bench != NULL) {
+      if (bench_run( conf.bench ))
+         WARN("Benchmark '%s' failed to run.", conf.bench);
+      quit = 1;
+   }
+   /* Tune the economy instead of the game. */
+   else if (conf.econsim > 0) {
+      if (economy_sim( conf.econsim, "econsim.csv" ))
+         WARN("Economy simulation failed to run.");
+      quit = 1;
+   }
    /* Start menu. */
-   menu_main();
+   else
+      menu_main();
+
+   /* Everything up to here is the time to menu. */
+   startup_done();
 
    /* Force a minimum delay with loading screen */
    if ((SDL_GetTicks() - time_ms) < NAEV_INIT_DELAY)
@@ -404,7 +475,7 @@ int main( int argc, char** argv )
 #if HAS_UNIX
    /* Tell the player to migrate their configuration files out of ~/.naev */
    /* TODO get rid of this cruft ASAP. */
-   if ((oldconfig) && (!conf.datapath)) {
+   if ((oldconfig) && (!conf.datapath) && (!quit)) {
       char path[PATH_MAX], *script, *home;
       uint32_t scriptsize;
       int ret;
@@ -474,7 +545,7 @@ int main( int argc, char** argv )
    while (SDL_PollEvent(&event));
    /* primary loop */
    while (!quit) {
-      while (SDL_PollEvent(&event)) { /* event loop */
+      while (replay_pollEvent(&event)) { /* event loop */
          if (event.type == SDL_QUIT) {
             if (menu_askQuit()) {
                quit = 1; /* quit is handled here */
@@ -494,10 +565,20 @@ int main( int argc, char** argv )
       main_loop( 1 );
    }
 
+   /* Finish the recording or report the replay. */
+   replay_exit();
+
 
    /* Save configuration. */
    conf_saveConfig(buf);
 
+   /* Finish writing any savegame. */
+   save_sync();
+   save_snapshotFree();
+
+   /* Finish the background simulation. */
+   spacesim_exit();
+
    /* data unloading */
    unload_all();
 
@@ -519,13 +600,22 @@ int main( int argc, char** argv )
    ovr_mrkFree(); /* Clear markers. */
    toolkit_exit(); /* Kills the toolkit */
    ai_exit(); /* Stops the Lua AI magic */
+   perf_exit(); /* Writes any trace being recorded. */
+   metrics_exit(); /* Exports the last metrics. */
+   startup_exit(); /* Frees the startup profile. */
    joystick_exit(); /* Releases joystick */
    input_exit(); /* Cleans up keybindings */
    nebu_exit(); /* Destroys the nebula */
    lua_exit(); /* Closes Lua state. */
+   gl_fboFree( scene_fbo ); /* Frozen scene. */
+   scene_fbo = NULL;
    gl_exit(); /* Kills video output */
    sound_exit(); /* Kills the sound */
    news_exit(); /* Destroys the news. */
+   threadpool_exit(); /* Stops the worker threads. */
+   scratch_exit(); /* Frees the scratch memory. */
+   nhash_internFree(); /* Frees the interned strings. */
+   log_exit(); /* Writes what is left of the logs. */
 
    /* Free the icon. */
    if (naev_icon)
@@ -600,6 +690,9 @@ void loadscreen_render( double done, const char *msg )
    double x,y, w,h, rh;
    SDL_Event event;
 
+   /* Drawing is timed apart from what is being loaded. */
+   startup_begin( "loadscreen" );
+
    /* Clear background. */
    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -681,34 +774,48 @@ static void loadscreen_unload (void)
 void load_all (void)
 {
    /* We can do fast stuff here. */
+   startup_begin( "slots" );
    sp_load();
 
    /* order is very important as they're interdependent */
    loadscreen_render( 1./LOADING_STAGES, "Loading Commodities..." );
+   startup_begin( "commodities" );
    commodity_load(); /* dep for space */
    loadscreen_render( 2./LOADING_STAGES, "Loading Factions..." );
+   startup_begin( "factions" );
    factions_load(); /* dep for fleet, space, missions, AI */
    loadscreen_render( 3./LOADING_STAGES, "Loading AI..." );
+   startup_begin( "ai" );
    ai_load(); /* dep for fleets */
    loadscreen_render( 4./LOADING_STAGES, "Loading Missions..." );
+   startup_begin( "missions" );
    missions_load(); /* no dep */
    loadscreen_render( 5./LOADING_STAGES, "Loading Events..." );
+   startup_begin( "events" );
    events_load(); /* no dep */
    loadscreen_render( 6./LOADING_STAGES, "Loading Special Effects..." );
+   startup_begin( "spfx" );
    spfx_load(); /* no dep */
    loadscreen_render( 6./LOADING_STAGES, "Loading Damage Types..." );
+   startup_begin( "damagetypes" );
    dtype_load(); /* no dep */
    loadscreen_render( 7./LOADING_STAGES, "Loading Outfits..." );
+   startup_begin( "outfits" );
    outfit_load(); /* dep for ships */
    loadscreen_render( 8./LOADING_STAGES, "Loading Ships..." );
+   startup_begin( "ships" );
    ships_load(); /* dep for fleet */
    loadscreen_render( 9./LOADING_STAGES, "Loading Fleets..." );
+   startup_begin( "fleets" );
    fleet_load(); /* dep for space */
    loadscreen_render( 10./LOADING_STAGES, "Loading Techs..." );
+   startup_begin( "techs" );
    tech_load(); /* dep for space */
    loadscreen_render( 11./LOADING_STAGES, "Loading the Universe..." );
+   startup_begin( "universe" );
    space_load();
    loadscreen_render( 12./LOADING_STAGES, "Populating Maps..." );
+   startup_begin( "maps" );
    outfit_mapParse();
    background_init();
    player_init(); /* Initialize player stuff. */
@@ -721,9 +828,12 @@ void unload_all (void)
 {
    /* cleanup some stuff */
    player_cleanup(); /* cleans up the player stuff */
+   diff_free(); /* frees the parsed universe diffs, after they're cleared */
    gui_free(); /* cleans up the player's GUI */
    weapon_exit(); /* destroys all active weapons */
    pilots_free(); /* frees the pilots, they were locked up :( */
+   expl_free(); /* frees the explosion queue */
+   solid_exit(); /* frees the solid storage, must be after pilots and weapons */
    cond_exit(); /* destroy conditional subsystem. */
    land_exit(); /* Destroys landing vbo and friends. */
    npc_clear(); /* In case exiting while landed. */
@@ -755,36 +865,62 @@ void main_loop( int update )
     * Control FPS.
     */
    fps_control(); /* everyone loves fps control */
+   perf_frameStart( conf.perf_show );
+   memstats_update( real_dt );
+   metrics_update( real_dt );
 
    /*
-    * Handle update.
+    * Handle input.
     */
    input_update( real_dt ); /* handle key repeats. */
    sound_update( real_dt ); /* Update sounds. */
    if (toolkit_isOpen())
       toolkit_update(); /* to simulate key repetition */
-   if (!paused && update) {
-      /* Important that we pass real_dt here otherwise we get a dt feedback loop which isn't pretty. */
-      player_updateAutonav( real_dt );
-      update_all(); /* update game */
-   }
 
    /*
     * Handle render.
+    *
+    * The state of the last update is drawn first and the commands flushed, so
+    *  the driver and GPU work through them while the next update runs. The
+    *  frame is only swapped in afterwards.
     */
    /* Clear buffer. */
    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-   render_all();
+   render_all( paused || landed || !update );
    /* Toolkit is rendered on top. */
    if (toolkit_isOpen())
       toolkit_render();
    gl_checkErr(); /* check error every loop */
+   if (conf.low_latency)
+      gl_frameFence();
+   glFlush();
+
+   /*
+    * Handle update.
+    */
+   if (!paused && update) {
+      /* Important that we pass real_dt here otherwise we get a dt feedback loop which isn't pretty. */
+      player_updateAutonav( real_dt );
+      update_all(); /* update game */
+   }
+   nlua_gcStep(); /* Spread Lua garbage collection over frames. */
+   economy_sync(); /* Put in the prices solved in the background. */
+   space_gfxUpdate(); /* Upload the pre-warmed planet graphics. */
+   nebu_update(); /* Upload the nebula generated in the background. */
+   gl_screenshotUpdate(); /* Capture the frame before it's swapped. */
+   if (conf.low_latency)
+      pace_done();
+
    /* Draw buffer. */
 #if SDL_VERSION_ATLEAST(2,0,0)
    SDL_GL_SwapWindow( gl_screen.window );
 #else /* SDL_VERSION_ATLEAST(2,0,0) */
    SDL_GL_SwapBuffers();
 #endif /* SDL_VERSION_ATLEAST(2,0,0) */
+
+   /* Sleep now so input gets polled right before the next frame. */
+   if (conf.low_latency)
+      pace_wait();
 }
 
 
@@ -816,6 +952,7 @@ void naev_resize( int w, int h )
 
    /* Reload the GUI (may regenerate land window) */
    gui_reload();
+   naev_sceneDirty();
 
    /* Resets the overlay dimensions. */
    ovr_refresh();
@@ -933,6 +1070,42 @@ static double fps_elapsed (void)
 }
 
 
+/**
+ * @brief Gets a monotonic timestamp.
+ *
+ *    @return The time in seconds.
+ */
+static double fps_now (void)
+{
+#if HAS_POSIX && defined(CLOCK_MONOTONIC)
+   struct timespec ts;
+
+   if (use_posix_time && (clock_gettime(CLOCK_MONOTONIC, &ts)==0))
+      return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+#endif /* HAS_POSIX && defined(CLOCK_MONOTONIC) */
+   return (double)SDL_GetTicks() / 1000.;
+}
+
+
+/**
+ * @brief Sleeps.
+ *
+ *    @param delay Seconds to sleep.
+ */
+static void fps_sleep( double delay )
+{
+#if HAS_POSIX
+   struct timespec ts;
+
+   ts.tv_sec  = floor( delay );
+   ts.tv_nsec = fmod( delay, 1. ) * 1e9;
+   nanosleep( &ts, NULL );
+#else /* HAS_POSIX */
+   SDL_Delay( (unsigned int)(delay * 1000) );
+#endif /* HAS_POSIX */
+}
+
+
 /**
  * @brief Controls the FPS.
  */
@@ -940,72 +1113,143 @@ static void fps_control (void)
 {
    double delay;
    double fps_max;
-#if HAS_POSIX
-   struct timespec ts;
-#endif /* HAS_POSIX */
 
    /* dt in s */
-   real_dt  = fps_elapsed();
+   real_dt  = replay_frame( fps_elapsed() );
    game_dt  = real_dt * dt_mod; /* Apply the modifier. */
 
-   /* if fps is limited */
-   if (!conf.vsync && conf.fps_max != 0) {
+   /* if fps is limited, replays keep their own pace, low latency mode
+    * sleeps in pace_wait() instead */
+   if (!conf.vsync && conf.fps_max != 0 && !replay_isPlaying() &&
+         !conf.low_latency) {
       fps_max = 1./(double)conf.fps_max;
       if (real_dt < fps_max) {
          delay    = fps_max - real_dt;
-#if HAS_POSIX
-         ts.tv_sec  = floor( delay );
-         ts.tv_nsec = fmod( delay, 1. ) * 1e9;
-         nanosleep( &ts, NULL );
-#else /* HAS_POSIX */
-         SDL_Delay( (unsigned int)(delay * 1000) );
-#endif /* HAS_POSIX */
+         fps_sleep( delay );
          fps_dt  += delay; /* makes sure it displays the proper fps */
       }
    }
 }
 
 
+/**
+ * @brief Gets how long a frame should last in low latency mode.
+ *
+ *    @return Seconds per frame or 0. if frames aren't paced.
+ */
+static double pace_target (void)
+{
+#if SDL_VERSION_ATLEAST(2,0,0)
+   SDL_DisplayMode mode;
+#endif /* SDL_VERSION_ATLEAST(2,0,0) */
+
+   if (replay_isPlaying())
+      return 0.;
+
+   /* Vsync swaps once per refresh, whatever the limit. */
+   if (conf.vsync) {
+#if SDL_VERSION_ATLEAST(2,0,0)
+      if ((SDL_GetWindowDisplayMode( gl_screen.window, &mode ) == 0) &&
+            (mode.refresh_rate > 0))
+         return 1. / (double)mode.refresh_rate;
+#endif /* SDL_VERSION_ATLEAST(2,0,0) */
+      return 1. / 60.;
+   }
+   if (conf.fps_max != 0)
+      return 1. / (double)conf.fps_max;
+   return 0.;
+}
+
+
+/**
+ * @brief Waits for the GPU to finish the frame and learns how long it took.
+ *
+ * This is the sync point of low latency mode: the frame is done before it's
+ *  swapped, so the driver never has frames queued up. The time from waking up
+ *  to here is the cost of a frame, which is predicted to be the last one or
+ *  slowly moves down to shorter ones, so spikes don't cause missed frames
+ *  right after.
+ */
+static void pace_done (void)
+{
+   double work;
+
+   gl_frameWait();
+   if (pace_wake < 0.)
+      return;
+
+   work = fps_now() - pace_wake;
+   if (work > pace_work)
+      pace_work = work;
+   else
+      pace_work += (work - pace_work) * pace_decay;
+}
+
+
+/**
+ * @brief Sleeps after the swap until the next frame has to start.
+ *
+ * The next frame gets woken up so it is done, as predicted, just as its swap
+ *  is due. Input is polled after this, so it is only as old as the frame.
+ */
+static void pace_wait (void)
+{
+   double target, delay;
+
+   target = pace_target();
+   if (target > 0.) {
+      delay = MIN( target - pace_work - pace_margin, target );
+      if (delay > 0.)
+         fps_sleep( delay );
+   }
+   pace_wake = fps_now();
+}
+
+
 /**
  * @brief Updates the game itself (player flying around and friends).
  *
+ * The simulation runs in fixed ticks, independently of the frame rate, and
+ *  rendering interpolates between the last two. Ticks are fps_sim of real
+ *  time, so time compression makes them longer in game time up to fps_min,
+ *  past which more ticks are run instead.
+ *
  *    @brief Mainly uses game dt.
  */
 static void update_all (void)
 {
-   int i, n;
-   double nf, microdt, accumdt;
+   int n, nmax;
+   double tick, step, mod;
 
    if ((real_dt > 0.25) && (fps_skipped==0)) { /* slow timers down and rerun calculations */
       fps_skipped = 1;
       return;
    }
-   else if (game_dt > fps_min) { /* we'll force a minimum FPS for physics to work alright. */
-
-      /* Number of frames. */
-      nf = ceil( game_dt / fps_min );
-      microdt = game_dt / nf;
-      n  = (int) nf;
-
-      /* Update as much as needed, evenly. */
-      accumdt = 0.;
-      for (i=0; i<n; i++) {
-         update_routine( microdt, 0 );
-         /* Ok, so we need a bit of hackish logic here in case we are chopping up a
-          * very large dt and it turns out time compression changes so we're now
-          * updating in "normal time compression" zone. This amounts to many updates
-          * being run when time compression has changed and thus can cause, say, the
-          * player to exceed their target position or get mauled by an enemy ship.
-          */
-         accumdt += microdt;
-         if (accumdt > dt_mod*real_dt)
-            break;
-      }
 
-      /* Note we don't touch game_dt so that fps_display works well */
+   /* Empty space under autonav doesn't need fine steps. */
+   step = player_autonavFastForward() ? fps_min_ff : fps_min;
+   tick = MIN( fps_sim * dt_mod, step );
+   if (tick <= 0.)
+      return;
+
+   /* Don't try to catch up more than this frame needs or it snowballs. */
+   sim_accum += game_dt;
+   nmax = (int) ceil( game_dt / tick ) + 1;
+   for (n=0; (n < nmax) && (sim_accum >= tick); n++) {
+      mod = dt_mod;
+      update_routine( tick, 0 );
+      sim_accum -= tick;
+
+      /* Time compression may change during the tick, for example when
+       * autonav spots an enemy. The rest of the frame must then run at the new
+       * rate, otherwise the player would overshoot or get mauled. */
+      if (dt_mod != mod) {
+         sim_accum *= dt_mod / mod;
+         tick       = MIN( fps_sim * dt_mod, step );
+      }
    }
-   else /* Standard, just update with the last dt */
-      update_routine( game_dt, 0 );
+   sim_accum = MIN( sim_accum, tick );
+   sim_alpha = sim_accum / tick;
 
    fps_skipped = 0;
 }
@@ -1018,6 +1262,10 @@ static void update_all (void)
  */
 void update_routine( double dt, int enter_sys )
 {
+   /* Render interpolates from here. */
+   solid_snapshot();
+   cam_snapshot();
+
    if (!enter_sys) {
       hook_exclusionStart();
 
@@ -1026,22 +1274,125 @@ void update_routine( double dt, int enter_sys )
    }
 
    /* Update engine stuff. */
+   perf_begin( PERF_SPACE_UPDATE );
    space_update(dt);
+   perf_end( PERF_SPACE_UPDATE );
+   perf_begin( PERF_WEAPONS_UPDATE );
+   pilot_gridUpdate(); /* Broadphase must match the pilots weapons see. */
    weapons_update(dt);
+   perf_end( PERF_WEAPONS_UPDATE );
+   perf_begin( PERF_SPFX_UPDATE );
    spfx_update(dt);
+   perf_end( PERF_SPFX_UPDATE );
+   perf_begin( PERF_PILOTS_UPDATE );
    pilots_update(dt);
+   expl_update(dt); /* Damage and effects of the explosions of this step. */
+   perf_end( PERF_PILOTS_UPDATE );
+
+   /* Standing changes from combat this step. */
+   faction_updatePlayer();
 
    /* Update camera. */
+   perf_begin( PERF_CAM_UPDATE );
    cam_update( dt );
+   perf_end( PERF_CAM_UPDATE );
 
-   if (!enter_sys)
+   if (!enter_sys) {
+      perf_begin( PERF_HOOKS );
       hook_exclusionEnd( dt );
+      perf_end( PERF_HOOKS );
+
+      /* Entering a system runs within whatever jumped, which may still be
+       * using scratch memory. */
+      scratch_reset();
+   }
 }
 
 
 /**
  * @brief Renders the game itself (player flying around and friends).
  *
+ * While the game is frozen behind a dialogue, the land window or the pause
+ *  the scene is rendered once to a framebuffer and that gets drawn instead.
+ *
+ *    @param frozen Whether nothing in the scene is changing.
+ */
+static void render_all( int frozen )
+{
+   double dt;
+
+   dt = (paused) ? 0. : game_dt;
+
+   /* Render between the last two ticks. */
+   solid_interpolate( sim_alpha );
+   cam_interpolate( sim_alpha );
+
+   if (!frozen)
+      scene_valid = 0;
+   if (!frozen || !render_sceneCached( dt ))
+      render_scene( dt );
+
+   /* Things that keep changing. */
+   ovr_render(dt);
+   perf_render();
+   display_fps( real_dt ); /* Exception. */
+
+   cam_interpolateEnd();
+   solid_interpolateEnd();
+   scratch_reset();
+}
+
+
+/**
+ * @brief Draws the frozen scene, rendering it first if needed.
+ *
+ *    @param dt Current delta tick.
+ *    @return 1 if the scene was drawn, 0 if it must be rendered directly.
+ */
+static int render_sceneCached( double dt )
+{
+   if (!gl_hasFbo())
+      return 0;
+
+   /* Recreate on resolution changes. */
+   if ((scene_fbo != NULL) && ((scene_fbo->w != SCREEN_W) || (scene_fbo->h != SCREEN_H))) {
+      gl_fboFree( scene_fbo );
+      scene_fbo = NULL;
+   }
+   if (scene_fbo == NULL) {
+      scene_fbo   = gl_fboCreate( SCREEN_W, SCREEN_H );
+      scene_valid = 0;
+   }
+   if (scene_fbo == NULL)
+      return 0;
+
+   if (!scene_valid) {
+      if (gl_fboBegin( scene_fbo, 0., 0., 0, 0, SCREEN_W, SCREEN_H ))
+         return 0;
+      render_scene( dt );
+      gl_fboEnd();
+      scene_valid = 1;
+   }
+
+   gl_fboRender( scene_fbo, 0., 0. );
+   return 1;
+}
+
+
+/**
+ * @brief Marks the frozen scene as changed so it gets rendered again.
+ *
+ * Needed when the player acts while the game is paused, like targeting.
+ */
+void naev_sceneDirty (void)
+{
+   scene_valid = 0;
+}
+
+
+/**
+ * @brief Renders the scene.
+ *
  * Blitting order (layers):
  *   - BG
  *     - stars and planets
@@ -1056,33 +1407,43 @@ void update_routine( double dt, int enter_sys )
  *     - player
  *     - foreground particles
  *     - text and GUI
+ *
+ *    @param dt Current delta tick.
  */
-static void render_all (void)
+static void render_scene( double dt )
 {
-   double dt;
-
-   dt = (paused) ? 0. : game_dt;
-
    /* setup */
    spfx_begin(dt, real_dt);
    /* BG */
+   perf_begin( PERF_SPACE_RENDER );
    space_render(dt);
+   perf_end( PERF_SPACE_RENDER );
+   perf_begin( PERF_PLANETS_RENDER );
    planets_render();
+   perf_end( PERF_PLANETS_RENDER );
+   perf_begin( PERF_WEAPONS_RENDER );
    weapons_render(WEAPON_LAYER_BG, dt);
+   perf_end( PERF_WEAPONS_RENDER );
    /* N */
+   perf_begin( PERF_PILOTS_RENDER );
    pilots_render(dt);
+   perf_end( PERF_PILOTS_RENDER );
+   perf_begin( PERF_WEAPONS_RENDER );
    weapons_render(WEAPON_LAYER_FG, dt);
+   perf_end( PERF_WEAPONS_RENDER );
    spfx_render(SPFX_LAYER_BACK);
    /* FG */
    player_render(dt);
    spfx_render(SPFX_LAYER_FRONT);
+   perf_begin( PERF_OVERLAY_RENDER );
    space_renderOverlay(dt);
+   perf_end( PERF_OVERLAY_RENDER );
    gui_renderReticles(dt);
    pilots_renderOverlay(dt);
    spfx_end();
+   perf_begin( PERF_GUI_RENDER );
    gui_render(dt);
-   ovr_render(dt);
-   display_fps( real_dt ); /* Exception. */
+   perf_end( PERF_GUI_RENDER );
 }
 
 
@@ -1434,7 +1795,8 @@ static void debug_sigHandler( int sig, siginfo_t *info, void *unused )
    }
    DEBUG("Report this to project maintainer with the backtrace.");
 
-   /* Always exit. */
+   /* Always exit, the backtrace mustn't be left queued. */
+   log_flush();
    exit(1);
 }
 #endif /* HAS_LINUX && HAS_BFD && defined(DEBUGGING) */
@@ -97,6 +97,7 @@ void fps_setPos( double x, double y );
 void naev_resize( int w, int h );
 void naev_toggleFullscreen (void);
 #endif /* SDL_VERSION_ATLEAST(2,0,0) */
+void naev_sceneDirty (void);
 void update_routine( double dt, int enter_sys );
 int naev_versionString( char *str, size_t slen, int major, int minor, int rev );
 char *naev_version( int long_version );
@@ -21,6 +21,10 @@
  *  5) Makefile version
  *  6) ./ndata*
  *  7) dirname(argv[0])/ndata* (binary path)
+ *
+ * Overlay directories from the "overlays" option are searched before any of
+ *  these, so mods only have to ship the files they change. Derived caches
+ *  should be keyed with ndata_digest() so they only go stale per file.
  */
 
 #include "ndata.h"
@@ -29,6 +33,10 @@
 
 #if HAS_POSIX
 #include <libgen.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif /* HAS_POSIX */
 #if HAS_WIN32
 #include <windows.h>
@@ -46,9 +54,15 @@
 #include "npng.h"
 #include "nstring.h"
 #include "start.h"
+#include "nhash.h"
+#include "array.h"
+#include "threadpool.h"
+#include "md5.h"
+#include "startup.h"
 
 
 #define NDATA_FILENAME  "ndata" /**< Generic ndata file name. */
+#define NDATA_MAP_GRAIN 4 /**< Files mapped per job at least. */
 #ifndef NDATA_DEF
 #define NDATA_DEF       NDATA_FILENAME /**< Default ndata to use. */
 #endif /* NDATA_DEF */
@@ -66,16 +80,48 @@
 static char* ndata_filename         = NULL; /**< ndata archive name. */
 static char* ndata_dirname          = NULL; /**< Directory name. */
 static struct zip* ndata_archive    = NULL; /**< ndata file on disk */
+static struct zip** ndata_arcPool   = NULL; /**< Idle handles of the archive, one per concurrent read (array.h). */
+static SDL_mutex *ndata_arcLock     = NULL; /**< Lock for ndata_arcPool. */
 static char* ndata_arcName          = NULL; /**< Name of the ndata module. */
 static SDL_mutex *ndata_lock        = NULL; /**< Lock for ndata creation. */
 static int ndata_loadedfile         = 0; /**< Already loaded a file? */
 static int ndata_source             = 0;
 
 /*
- * File list.
+ * Overlays.
+ */
+static char **ndata_overlays  = NULL; /**< Overlay directories, slash terminated, searched in order (array.h). */
+
+/**
+ * @brief Content digest of a file.
+ */
+typedef struct NdataDigest_ {
+   char *path; /**< Path of the file in the ndata. */
+   char digest[33]; /**< Hex MD5 of the contents. */
+} NdataDigest;
+static NdataDigest *ndata_digests = NULL; /**< Digests computed so far (array.h). */
+static NameHash ndata_digestHash; /**< Maps paths to ndata_digests. */
+static SDL_mutex *ndata_digestLock = NULL; /**< Lock for the digests. */
+
+
+/**
+ * @brief Directory in the archive index.
+ */
+typedef struct NdataDir_ {
+   char *path; /**< Path with a trailing slash, empty for the root. */
+   int *files; /**< Positions in ndata_fileList of the direct children (array.h). */
+} NdataDir;
+
+
+/*
+ * Archive index, built once when the archive is opened.
  */
-static char **ndata_fileList  = NULL; /**< List of files in the archive. */
+static char **ndata_fileList  = NULL; /**< Sorted list of files in the archive. */
 static uint32_t ndata_fileNList     = 0; /**< Number of files in ndata_fileList. */
+static int *ndata_fileIndex   = NULL; /**< Archive index of each file in ndata_fileList. */
+static NameHash ndata_fileHash; /**< Maps paths to positions in ndata_fileList. */
+static NdataDir *ndata_dirs   = NULL; /**< Directories in the archive (array.h). */
+static NameHash ndata_dirHash; /**< Maps directory paths to ndata_dirs. */
 
 
 /*
@@ -90,6 +136,28 @@ static int ndata_prompt( void *data );
 #endif /* SDL_VERSION_ATLEAST(2,0,0) */
 static int ndata_notfound (void);
 static char** ndata_listBackend( const char* path, uint32_t* nfiles, int dirs );
+static void* ndata_readBackend( const char* filename, uint32_t *filesize );
+static int ndata_mapBackend( NdataView *view, const char *filename );
+static SDL_RWops *ndata_rwopsBackend( const char* filename );
+static int ndata_findFile( const char *filename, char *path, size_t len );
+static int ndata_mapFile( NdataView *view, const char *path );
+static SDL_RWops *ndata_rwopsFile( const char *path );
+#if HAS_POSIX
+static int ndata_rwopsUnmap( SDL_RWops *rw );
+#endif /* HAS_POSIX */
+static void ndata_buildIndex( struct zip *arc );
+static void ndata_freeIndex (void);
+static int ndata_archiveIndex( const char *filename );
+static struct zip* ndata_arcAcquire (void);
+static void ndata_arcRelease( struct zip *arc );
+static void* ndata_readArchive( int index, uint32_t *size );
+static void ndata_mapRange( int start, int end, void *data );
+static char** ndata_listIndex( const char* path, uint32_t* nfiles, int recursive );
+static int ndata_indexCompare( const void *p1, const void *p2 );
+static void ndata_overlayInit( const char *overlays );
+static int ndata_overlayFind( const char *filename, char *path, size_t len );
+static char** ndata_overlayList( char **files, uint32_t *nfiles,
+      const char *path, int recursive );
 static char **stripPath( const char **list, int nlist, const char *path );
 static char** filterList( const char** list, int nlist,
       const char* path, uint32_t* nfiles, int recursive );
@@ -390,6 +458,7 @@ static int ndata_openFile (void)
 {
    char path[PATH_MAX], *buf;
    char pathname[PATH_MAX];
+   struct zip *arc;
 
    /* Must be thread safe. */
    SDL_mutexP(ndata_lock);
@@ -464,9 +533,15 @@ static int ndata_openFile (void)
       else
          return -1;
    }
-   ndata_archive = nzip_open( ndata_filename );
-   if (ndata_archive == NULL)
+   arc = nzip_open( ndata_filename );
+   if (arc == NULL)
       WARN("Unable to open ndata from '%s'.", ndata_filename );
+   else
+      ndata_buildIndex( arc );
+   /* Only visible once indexed as other threads check without locking. */
+   if (arc != NULL)
+      ndata_arcRelease( arc );
+   ndata_archive = arc;
 
    /* Close lock. */
    SDL_mutexV(ndata_lock);
@@ -520,11 +595,14 @@ static void ndata_testVersion (void)
  */
 int ndata_open (void)
 {
-   /* Create the lock. */
-   ndata_lock = SDL_CreateMutex();
+   /* Create the locks. */
+   ndata_lock       = SDL_CreateMutex();
+   ndata_arcLock    = SDL_CreateMutex();
+   ndata_digestLock = SDL_CreateMutex();
 
    /* Set path to configuration. */
    ndata_setPath(conf.ndata);
+   ndata_overlayInit(conf.overlays);
 
    /* If user enforces ndata filename, we'll respect that. */
    if (ndata_isndata(ndata_filename))
@@ -542,7 +620,7 @@ int ndata_open (void)
  */
 void ndata_close (void)
 {
-   unsigned int i;
+   int i;
 
    /* Destroy the name. */
    if (ndata_arcName != NULL) {
@@ -550,27 +628,46 @@ void ndata_close (void)
       ndata_arcName = NULL;
    }
 
-   /* Destroy the list. */
-   if (ndata_fileList != NULL) {
-      for (i=0; i<ndata_fileNList; i++)
-         free(ndata_fileList[i]);
+   /* Destroy the index. */
+   ndata_freeIndex();
 
-      free(ndata_fileList);
-      ndata_fileList  = NULL;
-      ndata_fileNList = 0;
+   /* Destroy the overlays and digests. */
+   if (ndata_overlays != NULL) {
+      for (i=0; i<array_size(ndata_overlays); i++)
+         free( ndata_overlays[i] );
+      array_free( ndata_overlays );
+      ndata_overlays = NULL;
    }
-
-   /* Close the archive. */
-   if (ndata_archive) {
-      nzip_close(ndata_archive);
-      ndata_archive = NULL;
+   if (ndata_digests != NULL) {
+      for (i=0; i<array_size(ndata_digests); i++)
+         free( ndata_digests[i].path );
+      array_free( ndata_digests );
+      ndata_digests = NULL;
    }
+   nhash_free( &ndata_digestHash );
+
+   /* Close the archive, the first handle is in the pool too. */
+   if (ndata_arcPool != NULL) {
+      for (i=0; i<array_size(ndata_arcPool); i++)
+         nzip_close( ndata_arcPool[i] );
+      array_free( ndata_arcPool );
+      ndata_arcPool = NULL;
+   }
+   ndata_archive = NULL;
 
-   /* Destroy the lock. */
+   /* Destroy the locks. */
    if (ndata_lock != NULL) {
       SDL_DestroyMutex(ndata_lock);
       ndata_lock = NULL;
    }
+   if (ndata_arcLock != NULL) {
+      SDL_DestroyMutex(ndata_arcLock);
+      ndata_arcLock = NULL;
+   }
+   if (ndata_digestLock != NULL) {
+      SDL_DestroyMutex(ndata_digestLock);
+      ndata_digestLock = NULL;
+   }
 }
 
 
@@ -622,6 +719,10 @@ int ndata_exists( const char* filename )
 {
    char *buf, path[PATH_MAX];
 
+   /* Overlays take precedence. */
+   if (ndata_overlayFind( filename, path, sizeof(path) ) == 0)
+      return 1;
+
    /* See if needs to load ndata archive. */
    if (ndata_archive == NULL) {
 
@@ -659,7 +760,7 @@ int ndata_exists( const char* filename )
    }
 
    /* Try to get it from the archive. */
-   return nzip_hasFile( ndata_archive, filename );
+   return (nhash_get( &ndata_fileHash, filename ) >= 0);
 }
 
 
@@ -671,9 +772,32 @@ int ndata_exists( const char* filename )
  *    @return The file data or NULL on error.
  */
 void* ndata_read( const char* filename, uint32_t *filesize )
+{
+   void *buf;
+
+   buf = ndata_readBackend( filename, filesize );
+   if (buf != NULL)
+      startup_countBytes( *filesize );
+   return buf;
+}
+
+
+/**
+ * @brief Reads a file from the ndata, see ndata_read().
+ */
+static void* ndata_readBackend( const char* filename, uint32_t *filesize )
 {
    char *buf, path[PATH_MAX];
-   int nbuf;
+   int nbuf, index;
+
+   /* Overlays take precedence. */
+   if (ndata_overlayFind( filename, path, sizeof(path) ) == 0) {
+      buf = nfile_readFile( &nbuf, path );
+      if (buf != NULL) {
+         *filesize = nbuf;
+         return buf;
+      }
+   }
 
    /* See if needs to load ndata archive. */
    if (ndata_archive == NULL) {
@@ -750,7 +874,306 @@ void* ndata_read( const char* filename, uint32_t *filesize )
    ndata_loadedfile = 1;
 
    /* Get data from ndata archive. */
-   return nzip_readFile( ndata_archive, filename, filesize );
+   index = ndata_archiveIndex( filename );
+   if (index < 0) {
+      WARN("Unable to open file '%s': not found.", filename);
+      *filesize = 0;
+      return NULL;
+   }
+   return ndata_readArchive( index, filesize );
+}
+
+
+/**
+ * @brief Finds a file laid out on disk, with the same lookups as ndata_read().
+ *
+ *    @param filename Name of the file in the ndata.
+ *    @param[out] path Path of the file on disk.
+ *    @param len Size of path.
+ *    @return 0 if the file is on disk, -1 if it must come from the archive.
+ */
+static int ndata_findFile( const char *filename, char *path, size_t len )
+{
+   char *tmp;
+
+   /* Overlays take precedence. */
+   if (ndata_overlayFind( filename, path, len ) == 0)
+      return 0;
+
+   if (ndata_archive != NULL)
+      return -1;
+
+   /* Try the file locally. */
+   if ((ndata_source <= NDATA_SRC_LAIDOUT) && nfile_fileExists( filename )) {
+      nsnprintf( path, len, "%s", filename );
+      return 0;
+   }
+
+   /* Try the dirname path. */
+   if ((ndata_filename == NULL) && (ndata_dirname != NULL) &&
+         (ndata_source <= NDATA_SRC_DIRNAME)) {
+      nsnprintf( path, len, "%s/%s", ndata_dirname, filename );
+      if (nfile_fileExists( path )) {
+         ndata_source = NDATA_SRC_DIRNAME;
+         return 0;
+      }
+   }
+
+   /* Try the default location. */
+   if (ndata_source <= NDATA_SRC_NDATADEF) {
+      tmp = strdup( NDATA_DEF );
+      nsnprintf( path, len, "%s/%s", nfile_dirname(tmp), filename );
+      free(tmp);
+      if (nfile_fileExists( path )) {
+         ndata_source = NDATA_SRC_NDATADEF;
+         return 0;
+      }
+   }
+
+   /* Try the binary location. */
+   if (ndata_source <= NDATA_SRC_BINARY) {
+      tmp = strdup( naev_binary() );
+      nsnprintf( path, len, "%s/%s", nfile_dirname(tmp), filename );
+      free(tmp);
+      if (nfile_fileExists( path )) {
+         ndata_source = NDATA_SRC_BINARY;
+         return 0;
+      }
+   }
+
+   /* Load the ndata archive. */
+   ndata_openFile();
+   return -1;
+}
+
+
+/**
+ * @brief Maps a file on disk read-only.
+ *
+ *    @return 0 on success.
+ */
+static int ndata_mapFile( NdataView *view, const char *path )
+{
+#if HAS_POSIX
+   int fd;
+   struct stat st;
+   void *map;
+
+   fd = open( path, O_RDONLY );
+   if (fd < 0)
+      return -1;
+   if ((fstat( fd, &st ) != 0) || (st.st_size <= 0)) {
+      close( fd );
+      return -1;
+   }
+   map = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+   close( fd );
+   if (map == MAP_FAILED)
+      return -1;
+
+   view->data   = map;
+   view->size   = st.st_size;
+   view->maplen = st.st_size;
+   return 0;
+#else /* HAS_POSIX */
+   (void) view;
+   (void) path;
+   return -1;
+#endif /* HAS_POSIX */
+}
+
+
+/**
+ * @brief Gets a read-only view of a file in the ndata.
+ *
+ * Files laid out on disk are memory mapped, anything else is read into a
+ *  buffer owned by the view. Either way the view must be released with
+ *  ndata_unmap().
+ *
+ *    @param[out] view View of the file.
+ *    @param filename Name of the file.
+ *    @return 0 on success.
+ */
+int ndata_map( NdataView *view, const char *filename )
+{
+   int ret;
+
+   ret = ndata_mapBackend( view, filename );
+   if (ret == 0)
+      startup_countBytes( view->size );
+   return ret;
+}
+
+
+/**
+ * @brief Gets a view of a file in the ndata, see ndata_map().
+ */
+static int ndata_mapBackend( NdataView *view, const char *filename )
+{
+   char path[PATH_MAX];
+   int nbuf, index;
+   uint32_t size;
+
+   memset( view, 0, sizeof(NdataView) );
+
+   if (ndata_findFile( filename, path, sizeof(path) ) == 0) {
+      ndata_loadedfile = 1;
+      if (ndata_mapFile( view, path ) == 0)
+         return 0;
+      view->buf  = nfile_readFile( &nbuf, path );
+      view->data = view->buf;
+      view->size = (view->buf != NULL) ? nbuf : 0;
+      return (view->buf != NULL) ? 0 : -1;
+   }
+
+   /* Wasn't able to open the file. */
+   if (ndata_archive == NULL) {
+      WARN("Unable to open file '%s': not found.", filename);
+      return -1;
+   }
+
+   /* Entries in the archive have to be decompressed anyway. */
+   ndata_loadedfile = 1;
+   index = ndata_archiveIndex( filename );
+   if (index < 0) {
+      WARN("Unable to open file '%s': not found.", filename);
+      return -1;
+   }
+   view->buf  = ndata_readArchive( index, &size );
+   view->data = view->buf;
+   view->size = (view->buf != NULL) ? size : 0;
+   return (view->buf != NULL) ? 0 : -1;
+}
+
+
+/**
+ * @brief Files being mapped by ndata_mapFiles().
+ */
+typedef struct NdataMapJob_ {
+   NdataView *views; /**< Views to fill. */
+   const char *prefix; /**< Prefix of the paths. */
+   char **files; /**< Paths of the files. */
+   int failed; /**< Whether any file failed. */
+} NdataMapJob;
+
+
+/**
+ * @brief Maps a range of files, run from the threadpool.
+ */
+static void ndata_mapRange( int start, int end, void *data )
+{
+   char file[PATH_MAX];
+   NdataMapJob *job;
+   int i;
+
+   job = (NdataMapJob*) data;
+   for (i=start; i<end; i++) {
+      nsnprintf( file, sizeof(file), "%s%s", job->prefix, job->files[i] );
+      if (ndata_map( &job->views[i], file ) != 0)
+         job->failed = 1;
+   }
+}
+
+
+/**
+ * @brief Gets read-only views of many files at once.
+ *
+ * Files are read and inflated on the threadpool, each archive read having
+ *  its own handle so they don't wait on each other.
+ *
+ *    @param[out] views The n views, release each with ndata_unmap().
+ *    @param prefix Prefix of the file paths, can be NULL.
+ *    @param files Files to map.
+ *    @param n Number of files.
+ *    @return 0 if all the files were mapped, empty views are left otherwise.
+ */
+int ndata_mapFiles( NdataView *views, const char *prefix, char **files, int n )
+{
+   NdataMapJob job;
+
+   memset( views, 0, sizeof(NdataView) * n );
+   job.views  = views;
+   job.prefix = (prefix != NULL) ? prefix : "";
+   job.files  = files;
+   job.failed = 0;
+   threadpool_parallelFor( n, NDATA_MAP_GRAIN, ndata_mapRange, &job );
+   return job.failed ? -1 : 0;
+}
+
+
+/**
+ * @brief Gets a read-only view of a file on disk outside of the ndata.
+ *
+ *    @param[out] view View of the file, to release with ndata_unmap().
+ *    @param path Path of the file.
+ *    @return 0 on success.
+ */
+int ndata_mapPath( NdataView *view, const char *path )
+{
+   int nbuf;
+
+   memset( view, 0, sizeof(NdataView) );
+   if (ndata_mapFile( view, path ) == 0)
+      return 0;
+   if (!nfile_fileExists( path ))
+      return -1;
+   view->buf  = nfile_readFile( &nbuf, path );
+   view->data = view->buf;
+   view->size = (view->buf != NULL) ? nbuf : 0;
+   return (view->buf != NULL) ? 0 : -1;
+}
+
+
+/**
+ * @brief Releases a view gotten with ndata_map() or ndata_mapPath().
+ */
+void ndata_unmap( NdataView *view )
+{
+#if HAS_POSIX
+   if (view->maplen > 0)
+      munmap( (void*)view->data, view->maplen );
+#endif /* HAS_POSIX */
+   free( view->buf );
+   memset( view, 0, sizeof(NdataView) );
+}
+
+
+#if HAS_POSIX
+/**
+ * @brief Closes an rwops over a mapped file.
+ */
+static int ndata_rwopsUnmap( SDL_RWops *rw )
+{
+   munmap( rw->hidden.mem.base, rw->hidden.mem.stop - rw->hidden.mem.base );
+   SDL_FreeRW( rw );
+   return 0;
+}
+#endif /* HAS_POSIX */
+
+
+/**
+ * @brief Creates an rwops over a file on disk, mapping it when possible.
+ */
+static SDL_RWops *ndata_rwopsFile( const char *path )
+{
+   NdataView view;
+   SDL_RWops *rw;
+
+   if (ndata_mapFile( &view, path ) != 0)
+      return SDL_RWFromFile( path, "rb" );
+
+#if HAS_POSIX
+   /* The mapping is the whole of the memory, so close can find it. */
+   rw = SDL_RWFromConstMem( view.data, view.size );
+   if (rw == NULL) {
+      munmap( (void*)view.data, view.maplen );
+      return SDL_RWFromFile( path, "rb" );
+   }
+   rw->close = ndata_rwopsUnmap;
+#else /* HAS_POSIX */
+   rw = NULL;
+#endif /* HAS_POSIX */
+   return rw;
 }
 
 
@@ -762,72 +1185,489 @@ void* ndata_read( const char* filename, uint32_t *filesize )
  */
 SDL_RWops *ndata_rwops( const char* filename )
 {
-   char path[PATH_MAX], *tmp;
    SDL_RWops *rw;
+   int pos, size;
+
+   rw = ndata_rwopsBackend( filename );
+
+   /* Count the whole file as read, it usually is. */
+   if ((rw != NULL) && startup_enabled()) {
+      pos  = SDL_RWtell( rw );
+      size = SDL_RWseek( rw, 0, RW_SEEK_END );
+      SDL_RWseek( rw, pos, RW_SEEK_SET );
+      if (size > 0)
+         startup_countBytes( size );
+   }
+   return rw;
+}
+
+
+/**
+ * @brief Creates an rwops from a file in the ndata, see ndata_rwops().
+ */
+static SDL_RWops *ndata_rwopsBackend( const char* filename )
+{
+   char path[PATH_MAX];
+   SDL_RWops *rw;
+   struct zip *arc;
+   int index;
+
+   /* Files on disk are mapped instead of read. */
+   if (ndata_findFile( filename, path, sizeof(path) ) == 0) {
+      rw = ndata_rwopsFile( path );
+      if (rw != NULL) {
+         ndata_loadedfile = 1;
+         return rw;
+      }
+   }
 
+   /* Wasn't able to open the file. */
    if (ndata_archive == NULL) {
+      WARN("Unable to open file '%s': not found.", filename);
+      return NULL;
+   }
 
-      /* Try to open from file. */
-      if (ndata_source <= NDATA_SRC_LAIDOUT) {
-         rw = SDL_RWFromFile( filename, "rb" );
-         if (rw != NULL) {
-            ndata_loadedfile = 1;
-            return rw;
-         }
+   /* Mark that we loaded a file. */
+   ndata_loadedfile = 1;
+
+   index = ndata_archiveIndex( filename );
+   if (index < 0) {
+      WARN("Unable to open file '%s': not found.", filename);
+      return NULL;
+   }
+   arc = ndata_arcAcquire();
+   if (arc == NULL)
+      return NULL;
+   rw = nzip_rwopsIndex( arc, index );
+   ndata_arcRelease( arc );
+   return rw;
+}
+
+
+/**
+ * @brief Sets up the overlay directories.
+ *
+ *    @param overlays Directories separated by ';', can be NULL.
+ */
+static void ndata_overlayInit( const char *overlays )
+{
+   char *buf, *dir, *next;
+   char path[PATH_MAX];
+   int len;
+
+   if (overlays == NULL)
+      return;
+
+   buf = strdup( overlays );
+   for (dir = buf; dir != NULL; dir = next) {
+      next = strchr( dir, ';' );
+      if (next != NULL)
+         *next++ = '\0';
+      if (dir[0] == '\0')
+         continue;
+      if (!nfile_dirExists( "%s", dir )) {
+         WARN("Overlay directory '%s' does not exist, ignoring it.", dir);
+         continue;
       }
+      len = strlen( dir );
+      nsnprintf( path, sizeof(path), "%s%s", dir,
+            ((len > 0) && (dir[len-1] == '/')) ? "" : "/" );
+      if (ndata_overlays == NULL)
+         ndata_overlays = array_create( char* );
+      array_push_back( &ndata_overlays, strdup(path) );
+      DEBUG("Using overlay '%s'.", path);
+   }
+   free( buf );
+}
 
-      /* Try to open from dirname. */
-      if ((ndata_filename == NULL) && (ndata_dirname != NULL) &&
-            (ndata_source <= NDATA_SRC_DIRNAME)) {
-         nsnprintf( path, sizeof(path), "%s/%s", ndata_dirname, filename );
-         rw = SDL_RWFromFile( path, "rb" );
-         if (rw != NULL) {
-            ndata_source = NDATA_SRC_DIRNAME;
-            ndata_loadedfile = 1;
-            return rw;
-         }
+
+/**
+ * @brief Finds a file in the overlays.
+ *
+ *    @param filename Name of the file in the ndata.
+ *    @param[out] path Path of the file on disk.
+ *    @param len Size of path.
+ *    @return 0 if found in an overlay.
+ */
+static int ndata_overlayFind( const char *filename, char *path, size_t len )
+{
+   int i;
+
+   if (ndata_overlays == NULL)
+      return -1;
+
+   for (i=0; i<array_size(ndata_overlays); i++) {
+      nsnprintf( path, len, "%s%s", ndata_overlays[i], filename );
+      if (nfile_fileExists( path ))
+         return 0;
+   }
+   return -1;
+}
+
+
+/**
+ * @brief Adds the files of the overlays to a listing.
+ *
+ *    @param files Listing of the ndata, freed.
+ *    @param[in,out] nfiles Number of files in the listing.
+ *    @param path Path that was listed.
+ *    @param recursive Whether the listing is recursive.
+ *    @return The new listing.
+ */
+static char** ndata_overlayList( char **files, uint32_t *nfiles,
+      const char *path, int recursive )
+{
+   NameHash seen;
+   char **ofiles, **tfiles, **out;
+   int i, j, n, nout, mout;
+
+   if (ndata_overlays == NULL)
+      return files;
+
+   if (files == NULL)
+      *nfiles = 0;
+   mout = MAX( *nfiles, 16 );
+   out  = malloc( sizeof(char*) * mout );
+   nhash_init( &seen );
+   nout = 0;
+
+   /* Ndata files first, overlays only add what's missing. */
+   for (i=0; i<(int)*nfiles; i++) {
+      out[nout] = files[i];
+      nhash_set( &seen, out[nout], nout );
+      nout++;
+   }
+   free( files );
+
+   for (i=0; i<array_size(ndata_overlays); i++) {
+      if (recursive) {
+         tfiles = nfile_readDirRecursive( &n, "%s%s", ndata_overlays[i], path );
+         ofiles = stripPath( (const char**)tfiles, n, ndata_overlays[i] );
+         for (j=0; j<n; j++)
+            free( tfiles[j] );
+         free( tfiles );
       }
+      else
+         ofiles = nfile_readDir( &n, "%s%s", ndata_overlays[i], path );
+      if (ofiles == NULL)
+         continue;
 
-      /* Try to open from def. */
-      if (ndata_source <= NDATA_SRC_NDATADEF) {
-         tmp = strdup( NDATA_DEF );
-         nsnprintf( path, sizeof(path), "%s/%s", nfile_dirname(tmp), filename );
-         free(tmp);
-         rw = SDL_RWFromFile( path, "rb" );
-         if (rw != NULL) {
-            ndata_source = NDATA_SRC_NDATADEF;
-            ndata_loadedfile = 1;
-            return rw;
+      for (j=0; j<n; j++) {
+         if (nhash_get( &seen, ofiles[j] ) >= 0) {
+            free( ofiles[j] );
+            continue;
+         }
+         if (nout >= mout) {
+            mout *= 2;
+            out   = realloc( out, sizeof(char*) * mout );
          }
+         out[nout] = ofiles[j];
+         nhash_set( &seen, out[nout], nout );
+         nout++;
       }
+      free( ofiles );
+   }
 
-      /* Try to open from binary. */
-      if (ndata_source <= NDATA_SRC_BINARY) {
-         tmp = strdup( naev_binary() );
-         nsnprintf( path, sizeof(path), "%s/%s", nfile_dirname(tmp), filename );
-         free(tmp);
-         rw = SDL_RWFromFile( path, "rb" );
-         if (rw != NULL) {
-            ndata_source = NDATA_SRC_BINARY;
-            ndata_loadedfile = 1;
-            return rw;
-         }
+   nhash_free( &seen );
+   *nfiles = nout;
+   return out;
+}
+
+
+/**
+ * @brief Gets the digest of the contents of a file in the ndata.
+ *
+ * The file is looked up like ndata_read() does, so overlays are taken into
+ *  account. Digests are only computed once per file.
+ *
+ *    @param filename Name of the file.
+ *    @param[out] digest Hex MD5 of the contents of the file.
+ *    @return 0 on success.
+ */
+int ndata_digest( const char *filename, char digest[33] )
+{
+   NdataView view;
+   NdataDigest *d;
+   md5_state_t md5;
+   md5_byte_t md5val[16];
+   int i, ret;
+
+   SDL_mutexP( ndata_digestLock );
+   i = nhash_get( &ndata_digestHash, filename );
+   if (i >= 0)
+      memcpy( digest, ndata_digests[i].digest, 33 );
+   SDL_mutexV( ndata_digestLock );
+   if (i >= 0)
+      return 0;
+
+   /* Compute without the lock, reads may take a while. */
+   ret = ndata_map( &view, filename );
+   if (ret != 0)
+      return -1;
+   md5_init( &md5 );
+   md5_append( &md5, (const md5_byte_t*)view.data, view.size );
+   md5_finish( &md5, md5val );
+   ndata_unmap( &view );
+   for (i=0; i<16; i++)
+      nsnprintf( &digest[i * 2], 3, "%02x", md5val[i] );
+
+   SDL_mutexP( ndata_digestLock );
+   if (nhash_get( &ndata_digestHash, filename ) < 0) {
+      if (ndata_digests == NULL)
+         ndata_digests = array_create( NdataDigest );
+      d       = &array_grow( &ndata_digests );
+      d->path = strdup( filename );
+      memcpy( d->digest, digest, 33 );
+      nhash_set( &ndata_digestHash, d->path, array_size(ndata_digests)-1 );
+   }
+   SDL_mutexV( ndata_digestLock );
+   return 0;
+}
+
+
+/**
+ * @brief Archive file used when building the index.
+ */
+typedef struct NdataIndexEntry_ {
+   char *name; /**< Path of the file. */
+   int index; /**< Archive index of the file. */
+} NdataIndexEntry;
+
+
+/**
+ * @brief Compares index entries by path.
+ */
+static int ndata_indexCompare( const void *p1, const void *p2 )
+{
+   const NdataIndexEntry *e1, *e2;
+   e1 = (const NdataIndexEntry*) p1;
+   e2 = (const NdataIndexEntry*) p2;
+   return strcmp( e1->name, e2->name );
+}
+
+
+/**
+ * @brief Indexes the files of the archive by path and directory.
+ *
+ * The file list is sorted so all the files below a path are contiguous.
+ *
+ *    @param arc Archive to index.
+ */
+static void ndata_buildIndex( struct zip *arc )
+{
+   NdataIndexEntry *entries;
+   NdataDir *d;
+   char **names, buf[PATH_MAX];
+   const char *slash;
+   int *indices;
+   uint32_t i, n;
+   int id;
+
+   names = nzip_listFiles( arc, &n, &indices );
+   if (names == NULL)
+      return;
+
+   /* Sort by path. */
+   entries = malloc( sizeof(NdataIndexEntry) * MAX(n,1) );
+   for (i=0; i<n; i++) {
+      entries[i].name  = names[i];
+      entries[i].index = indices[i];
+   }
+   qsort( entries, n, sizeof(NdataIndexEntry), ndata_indexCompare );
+
+   ndata_fileNList = n;
+   ndata_fileList  = names;
+   ndata_fileIndex = indices;
+   ndata_dirs      = array_create( NdataDir );
+   for (i=0; i<n; i++) {
+      ndata_fileList[i]  = entries[i].name;
+      ndata_fileIndex[i] = entries[i].index;
+      nhash_set( &ndata_fileHash, ndata_fileList[i], i );
+
+      /* Add to its directory. */
+      slash = strrchr( ndata_fileList[i], '/' );
+      nsnprintf( buf, sizeof(buf), "%.*s",
+            (slash == NULL) ? 0 : (int)(slash - ndata_fileList[i] + 1),
+            ndata_fileList[i] );
+      id = nhash_get( &ndata_dirHash, buf );
+      if (id < 0) {
+         id       = array_size( ndata_dirs );
+         d        = &array_grow( &ndata_dirs );
+         d->path  = strdup( buf );
+         d->files = array_create( int );
+         nhash_set( &ndata_dirHash, d->path, id );
       }
+      array_push_back( &ndata_dirs[id].files, (int)i );
+   }
+   free( entries );
+}
 
-      /* Load the ndata archive. */
-      ndata_openFile();
+
+/**
+ * @brief Frees the archive index.
+ */
+static void ndata_freeIndex (void)
+{
+   uint32_t i;
+   int j;
+
+   nhash_free( &ndata_fileHash );
+   nhash_free( &ndata_dirHash );
+   if (ndata_dirs != NULL) {
+      for (j=0; j<array_size(ndata_dirs); j++) {
+         free( ndata_dirs[j].path );
+         array_free( ndata_dirs[j].files );
+      }
+      array_free( ndata_dirs );
+      ndata_dirs = NULL;
    }
+   if (ndata_fileList != NULL) {
+      for (i=0; i<ndata_fileNList; i++)
+         free(ndata_fileList[i]);
+      free(ndata_fileList);
+   }
+   free( ndata_fileIndex );
+   ndata_fileList  = NULL;
+   ndata_fileIndex = NULL;
+   ndata_fileNList = 0;
+}
 
-   /* Wasn't able to open the file. */
-   if (ndata_archive == NULL) {
-      WARN("Unable to open file '%s': not found.", filename);
+
+/**
+ * @brief Gets the archive index of a file.
+ *
+ *    @param filename Path of the file in the archive.
+ *    @return Archive index of the file or -1 if not found.
+ */
+static int ndata_archiveIndex( const char *filename )
+{
+   int i = nhash_get( &ndata_fileHash, filename );
+   if (i < 0)
+      return -1;
+   return ndata_fileIndex[i];
+}
+
+
+/**
+ * @brief Gets a handle of the archive no other thread is using.
+ *
+ * libzip handles are not reentrant, so concurrent reads each get their own
+ *  handle to inflate with. Handles are kept around for reuse.
+ *
+ *    @return Handle to release with ndata_arcRelease() or NULL on error.
+ */
+static struct zip* ndata_arcAcquire (void)
+{
+   struct zip *arc;
+   int n;
+
+   arc = NULL;
+   SDL_mutexP( ndata_arcLock );
+   n = (ndata_arcPool != NULL) ? array_size(ndata_arcPool) : 0;
+   if (n > 0) {
+      arc = ndata_arcPool[n-1];
+      array_erase( &ndata_arcPool, &ndata_arcPool[n-1], &ndata_arcPool[n] );
+   }
+   SDL_mutexV( ndata_arcLock );
+
+   /* All in use, open another. */
+   if (arc == NULL)
+      arc = nzip_open( ndata_filename );
+   return arc;
+}
+
+
+/**
+ * @brief Gives back a handle gotten with ndata_arcAcquire().
+ */
+static void ndata_arcRelease( struct zip *arc )
+{
+   SDL_mutexP( ndata_arcLock );
+   if (ndata_arcPool == NULL)
+      ndata_arcPool = array_create( struct zip* );
+   array_push_back( &ndata_arcPool, arc );
+   SDL_mutexV( ndata_arcLock );
+}
+
+
+/**
+ * @brief Reads a file from the archive, can run concurrently.
+ *
+ *    @param index Archive index of the file.
+ *    @param[out] size Size of the file.
+ *    @return The file data or NULL on error.
+ */
+static void* ndata_readArchive( int index, uint32_t *size )
+{
+   struct zip *arc;
+   void *data;
+
+   arc = ndata_arcAcquire();
+   if (arc == NULL) {
+      *size = 0;
       return NULL;
    }
+   data = nzip_readIndex( arc, index, size );
+   ndata_arcRelease( arc );
+   return data;
+}
 
-   /* Mark that we loaded a file. */
-   ndata_loadedfile = 1;
 
-   return nzip_rwops( ndata_archive, filename );
+/**
+ * @brief Lists files of the archive using the index.
+ *
+ *    @param path Path to list, directories must be slash terminated.
+ *    @param[out] nfiles Files that match.
+ *    @param recursive Whether all children at any depth should be listed.
+ *    @return The files that match, with the path stripped if not recursive.
+ */
+static char** ndata_listIndex( const char* path, uint32_t* nfiles, int recursive )
+{
+   char **files;
+   const NdataDir *d;
+   int id, lo, hi, mid, i, j, len;
+
+   len = strlen( path );
+
+   /* Files below a path are contiguous in the sorted list. */
+   if (recursive) {
+      lo = 0;
+      hi = ndata_fileNList;
+      while (lo < hi) {
+         mid = (lo + hi) / 2;
+         if (strcmp( ndata_fileList[mid], path ) < 0)
+            lo = mid+1;
+         else
+            hi = mid;
+      }
+      for (hi=lo; hi<(int)ndata_fileNList; hi++)
+         if (strncmp( ndata_fileList[hi], path, len ) != 0)
+            break;
+
+      files = malloc( sizeof(char*) * MAX(hi-lo,1) );
+      for (i=lo; i<hi; i++)
+         files[i-lo] = strdup( ndata_fileList[i] );
+      *nfiles = hi-lo;
+      return files;
+   }
+
+   /* Partial names are matched the slow way. */
+   if ((len > 0) && (path[len-1] != '/'))
+      return filterList( (const char**) ndata_fileList, ndata_fileNList,
+            path, nfiles, recursive );
+
+   id = nhash_get( &ndata_dirHash, path );
+   if (id < 0) {
+      *nfiles = 0;
+      return malloc( sizeof(char*) );
+   }
+
+   d     = &ndata_dirs[id];
+   files = malloc( sizeof(char*) * MAX(array_size(d->files),1) );
+   for (j=0; j<array_size(d->files); j++)
+      files[j] = strdup( &ndata_fileList[ d->files[j] ][len] );
+   *nfiles = array_size(d->files);
+   return files;
 }
 
 
@@ -936,9 +1776,9 @@ static char** ndata_listBackend( const char* path, uint32_t* nfiles, int recursi
    else
       nfile_readFunc = nfile_readDir;
 
-   /* Already loaded the list. */
-   if (ndata_fileList != NULL)
-      return filterList( (const char**) ndata_fileList, ndata_fileNList, path, nfiles, recursive );
+   /* Archive is already indexed. */
+   if (ndata_archive != NULL)
+      return ndata_listIndex( path, nfiles, recursive );
 
    /* See if can load from local directory. */
    if (ndata_archive == NULL) {
@@ -1003,10 +1843,7 @@ static char** ndata_listBackend( const char* path, uint32_t* nfiles, int recursi
       return NULL;
    }
 
-   /* Load list. */
-   ndata_fileList = nzip_listFiles( ndata_archive, &ndata_fileNList );
-
-   return filterList( (const char**) ndata_fileList, ndata_fileNList, path, nfiles, recursive );
+   return ndata_listIndex( path, nfiles, recursive );
 }
 
 /**
@@ -1016,7 +1853,8 @@ static char** ndata_listBackend( const char* path, uint32_t* nfiles, int recursi
  */
 char** ndata_list( const char* path, uint32_t* nfiles )
 {
-   return ndata_listBackend( path, nfiles, 0 );
+   char **files = ndata_listBackend( path, nfiles, 0 );
+   return ndata_overlayList( files, nfiles, path, 0 );
 }
 
 
@@ -1027,7 +1865,8 @@ char** ndata_list( const char* path, uint32_t* nfiles )
  */
 char** ndata_listRecursive( const char* path, uint32_t* nfiles )
 {
-   return ndata_listBackend( path, nfiles, 1 );
+   char **files = ndata_listBackend( path, nfiles, 1 );
+   return ndata_overlayList( files, nfiles, path, 1 );
 }
 
 
@@ -54,6 +54,7 @@
 #define MUSIC_LUA_PATH           "dat/snd/music.lua" /**< Lua music control file. */
 
 #define START_DATA_PATH          "dat/start.xml" /**< Path to module start file. */
+#define BENCH_DATA_PATH          "dat/bench/" /**< Path to benchmark scenarios. */
 
 #define FONT_DEFAULT_PATH        "dat/font.ttf" /**< Default font path. */
 #define OMSG_FONT_DEFAULT_PATH   "dat/mono.ttf" /**< Default font path. */
@@ -84,6 +85,25 @@ void* ndata_read( const char* filename, uint32_t *filesize );
 char** ndata_list( const char *path, uint32_t* nfiles );
 char** ndata_listRecursive( const char *path, uint32_t* nfiles );
 void ndata_sortName( char **files, uint32_t nfiles );
+int ndata_digest( const char *filename, char digest[33] );
+
+
+/*
+ * Read-only views.
+ */
+/**
+ * @brief Read-only view of a file in the ndata.
+ */
+typedef struct NdataView_ {
+   const char *data; /**< Data of the file. */
+   size_t size; /**< Size of the data. */
+   void *buf; /**< Buffer owned by the view when not mapped. */
+   size_t maplen; /**< Length of the mapping, 0 when not mapped. */
+} NdataView;
+int ndata_map( NdataView *view, const char* filename );
+int ndata_mapFiles( NdataView *views, const char *prefix, char **files, int n );
+int ndata_mapPath( NdataView *view, const char* path );
+void ndata_unmap( NdataView *view );
 
 
 /*
@@ -16,6 +16,7 @@
 
 #include "log.h"
 #include "opengl.h"
+#include "opengl_fbo.h"
 #include "nfile.h"
 #include "perlin.h"
 #include "rng.h"
@@ -29,11 +30,19 @@
 #include "camera.h"
 #include "nstring.h"
 #include "ndata.h"
+#include "threadpool.h"
+
+#include "SDL_mutex.h"
 
 
 #define NEBULA_Z             16 /**< Z plane */
 #define NEBULA_PUFFS         32 /**< Amount of puffs to generate */
-#define NEBULA_PATH_BG       "nebu_bg_%dx%d_%02d.png" /**< Nebula path format. */
+#define NEBULA_PATH_BG       "nebu_bg_%d_%02d.png" /**< Nebula path format, by size and layer. */
+#define NEBULA_RUGOSITY      5. /**< Lattice cells across a layer, must be whole so it tiles. */
+#define NEBULA_TILE          1024. /**< Size of a layer on screen, it repeats past that. */
+#define NEBULA_SIZE_LOW      128 /**< Size of the first pass shown while generating. */
+#define NEBULA_SIZE_SMALL    512 /**< Size of the layers on small screens. */
+#define NEBULA_SIZE          1024 /**< Size of the layers. */
 
 #define NEBULA_PUFF_BUFFER   300 /**< Nebula buffer */
 
@@ -44,10 +53,24 @@ extern void loadscreen_render( double done, const char *msg ); /**< from naev.c
 
 /* The nebula textures */
 static GLuint nebu_textures[NEBULA_Z]; /**< BG Nebula textures. */
-static int nebu_w    = 0; /**< BG Nebula width. */
-static int nebu_h    = 0; /**< BG Nebula height. */
-static int nebu_pw   = 0; /**< BG Padded Nebula width. */
-static int nebu_ph   = 0; /**< BG Padded Nebula height. */
+static int nebu_force = 0; /**< Whether to regenerate instead of using the cache. */
+
+
+/**
+ * @brief Full size nebula being generated in the background.
+ *
+ * The generating job posts done once the layers are ready, they are then
+ *  uploaded and the same job is sent back to save them to the cache, posting
+ *  done again when finished.
+ */
+typedef struct NebulaJob_ {
+   perlin_data_t *noise; /**< Noise the first pass was made from. */
+   int size; /**< Size of the layers. */
+   uint8_t *alpha; /**< Alpha of all the layers, NULL on failure. */
+   int saving; /**< Whether it is saving instead of generating. */
+   SDL_sem *done; /**< Posted when the current step is done. */
+} NebulaJob;
+static NebulaJob *nebu_job = NULL; /**< Background generation. */
 
 /* Information on rendering */
 static int cur_nebu[2]           = { 0, 1 }; /**< Nebulae currently rendering. */
@@ -67,36 +90,56 @@ static int nebu_loaded = 0; /**< Whether the nebula has been loaded. */
 static gl_vbo *nebu_vboOverlay   = NULL; /**< Overlay VBO. */
 static gl_vbo *nebu_vboBG        = NULL; /**< BG VBO. */
 
+/* Reduced resolution overlay. */
+static glFbo *nebu_fbo = NULL; /**< Framebuffer the overlay and puffs are rendered to. */
+
 /**
  * @struct NebulaPuff
  *
  * @brief Represents a nebula puff.
  */
 typedef struct NebulaPuff_ {
-   double x; /**< X position. */
-   double y; /**< Y position */
+   double x; /**< X position when the camera hasn't moved. */
+   double y; /**< Y position when the camera hasn't moved. */
    double height; /**< height vs player */
    int tex; /**< Texture */
 } NebulaPuff;
 static NebulaPuff *nebu_puffs = NULL; /**< Stack of puffs. */
 static int nebu_npuffs        = 0; /**< Number of puffs. */
-static double puff_x          = 0.;
-static double puff_y          = 0.;
+static double puff_x          = 0.; /**< Camera movement since the puffs were placed. */
+static double puff_y          = 0.; /**< Camera movement since the puffs were placed. */
+
+/**
+ * @brief Puff textures being generated by nebu_generatePuffs().
+ */
+typedef struct NebulaPuffGen_ {
+   perlin_data_t *noise[NEBULA_PUFFS]; /**< Noise of each puff. */
+   int size[NEBULA_PUFFS]; /**< Size of each puff. */
+   SDL_Surface *sur[NEBULA_PUFFS]; /**< Generated surface of each puff. */
+} NebulaPuffGen;
 
 
 /*
  * prototypes
  */
-static int nebu_init_recursive( int iter );
+static int nebu_loadCache( int size );
 static int nebu_checkCompat( const char* file );
 static int nebu_loadTexture( SDL_Surface *sur, int w, int h, GLuint tex );
-static int nebu_generate (void);
-static int saveNebula( float *map, const uint32_t w, const uint32_t h, const char* file );
+static void nebu_uploadLayer( GLuint tex, int size, GLenum format, const void *pixels );
+static int nebu_generate( int size );
+static int nebu_generateJob( void *data );
+static void nebu_finishJob( int upload );
+static int saveNebula( const uint8_t *alpha, const uint32_t w, const uint32_t h, const char* file );
 static SDL_Surface* loadNebula( const char* file );
+static uint8_t* nebu_alphaFromNebulaMap( const float* map, const int n );
 static SDL_Surface* nebu_surfaceFromNebulaMap( float* map, const int w, const int h );
 /* Puffs. */
 static void nebu_generatePuffs (void);
+static void nebu_generatePuffRange( int start, int end, void *data );
+static double nebu_puffWrap( double x, double max );
 static void nebu_renderPuffs( int below_player );
+static int nebu_lowresBegin (void);
+static void nebu_lowresEnd (void);
 /* Nebula render methods. */
 static void nebu_renderMultitexture( const double dt );
 
@@ -104,91 +147,72 @@ static void nebu_renderMultitexture( const double dt );
 /**
  * @brief Initializes the nebula.
  *
+ * The layers are tileable squares of a fixed size scaled to the screen, so
+ *  the cache holds whatever the resolution.  If there is none, a low
+ *  resolution pass is shown at once while the full layers are generated in
+ *  the background.
+ *
  *    @return 0 on success.
  */
 int nebu_init (void)
 {
-   return nebu_init_recursive( 0 );
+   int size;
+
+   /* Fewer texels are enough for small screens. */
+   if (SCREEN_W*SCREEN_H < 1024*768)
+      size = NEBULA_SIZE_SMALL;
+   else
+      size = NEBULA_SIZE;
+
+   glGenTextures( NEBULA_Z, nebu_textures );
+   if (nebu_force || nebu_loadCache( size )) {
+      LOG("No nebula found, generating in the background.");
+      if (nebu_generate( size ) != 0)
+         return -1;
+   }
+   else
+      DEBUG("Loaded %d Nebula Layers", NEBULA_Z);
+   nebu_force = 0;
+
+   /* Generate puffs. */
+   nebu_generatePuffs();
+
+   nebu_vbo_init();
+   nebu_loaded = 1;
+
+   return 0;
 }
 
 
 /**
- * @brief Small wrapper that handles recursivity limits.
+ * @brief Loads the nebula layers from the cache.
  *
- *    @param iter Iteration of recursivity.
+ *    @param size Size of the layers.
  *    @return 0 on success.
  */
-static int nebu_init_recursive( int iter )
+static int nebu_loadCache( int size )
 {
    int i;
    char nebu_file[PATH_MAX];
    SDL_Surface* nebu_sur;
-   int ret;
-
-   /* Avoid too much recursivity. */
-   if (iter > 3) {
-      WARN("Unable to generate nebula after 3 attempts, something has really gone wrong!");
-      return -1;
-   }
-
-   /* Special code to regenerate the nebula */
-   if ((nebu_w == -9) && (nebu_h == -9))
-      nebu_generate();
 
-   /* Set expected sizes */
-   nebu_w  = SCREEN_W;
-   nebu_h  = SCREEN_H;
-   if (gl_needPOT()) {
-      nebu_pw = gl_pot(nebu_w);
-      nebu_ph = gl_pot(nebu_h);
-   }
-   else {
-      nebu_pw = nebu_w;
-      nebu_ph = nebu_h;
-   }
-
-   /* Load each, checking for compatibility and padding */
-   glGenTextures( NEBULA_Z, nebu_textures );
    for (i=0; i<NEBULA_Z; i++) {
-      nsnprintf( nebu_file, PATH_MAX, NEBULA_PATH_BG, nebu_w, nebu_h, i );
+      nsnprintf( nebu_file, PATH_MAX, NEBULA_PATH_BG, size, i );
 
       /* Check compatibility. */
       if (nebu_checkCompat( nebu_file ))
-         goto no_nebula;
+         return -1;
 
       /* Try to load. */
       nebu_sur = loadNebula( nebu_file );
       if (nebu_sur == NULL)
-         goto no_nebula;
-      if ((nebu_sur->w != nebu_w) || (nebu_sur->h != nebu_h))
-         WARN("Nebula raw size doesn't match expected! (%dx%d instead of %dx%d)",
-               nebu_sur->w, nebu_sur->h, nebu_w, nebu_h );
+         return -1;
 
       /* Load the texture */
-      ret = nebu_loadTexture( nebu_sur, nebu_pw, nebu_ph, nebu_textures[i] );
-      if (ret)
-         goto no_nebula;
+      if (nebu_loadTexture( nebu_sur, size, size, nebu_textures[i] ))
+         return -1;
    }
-
-   /* Generate puffs after the recursivity stuff. */
-   nebu_generatePuffs();
-
-   /* Display loaded nebulas. */
-   DEBUG("Loaded %d Nebula Layers", NEBULA_Z);
-
-   nebu_vbo_init();
-   nebu_loaded = 1;
-
    return 0;
-no_nebula:
-   LOG("No nebula found, generating (this may take a while).");
-
-   /* So we generate and reload */
-   ret = nebu_generate();
-   if (ret != 0) /* An error has happened - break recursivity*/
-      return ret;
-
-   return nebu_init_recursive( iter+1 );
 }
 
 
@@ -215,9 +239,9 @@ void nebu_vbo_init (void)
    vertex[5] = 0;
    vertex[6] = SCREEN_W;
    vertex[7] = SCREEN_H;
-   /* Texture 0. */
-   tw = (double)nebu_w / (double)nebu_pw;
-   th = (double)nebu_h / (double)nebu_ph;
+   /* Texture 0, the layers repeat every NEBULA_TILE pixels. */
+   tw = SCREEN_W / NEBULA_TILE;
+   th = SCREEN_H / NEBULA_TILE;
    vertex[8]  = 0.;
    vertex[9]  = 0.;
    vertex[10] = tw;
@@ -273,27 +297,42 @@ static int nebu_loadTexture( SDL_Surface *sur, int w, int h, GLuint tex )
    if ((w!=0) && (h!=0) &&
          ((nebu_sur->w != w) || (nebu_sur->h != h))) {
       WARN("Nebula size doesn't match expected! (%dx%d instead of %dx%d)",
-            nebu_sur->w, nebu_sur->h, nebu_pw, nebu_ph );
+            nebu_sur->w, nebu_sur->h, w, h );
+      SDL_FreeSurface(nebu_sur);
       return -1;
    }
 
-   /* Load the texture */
-   glBindTexture( GL_TEXTURE_2D, tex );
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
    /* Store into opengl saving only alpha channel in video memory */
    SDL_LockSurface( nebu_sur );
-   glTexImage2D( GL_TEXTURE_2D, 0, GL_ALPHA, nebu_sur->w, nebu_sur->h,
-         0, GL_RGBA, GL_UNSIGNED_BYTE, nebu_sur->pixels );
+   nebu_uploadLayer( tex, nebu_sur->w, GL_RGBA, nebu_sur->pixels );
    SDL_UnlockSurface( nebu_sur );
 
    SDL_FreeSurface(nebu_sur);
-   gl_checkErr();
    return 0;
 }
 
 
+/**
+ * @brief Uploads a layer into a nebula texture, keeping only the alpha.
+ *
+ *    @param tex Already generated texture to load into.
+ *    @param size Size of the layer.
+ *    @param format Format of the pixels, GL_RGBA or GL_ALPHA.
+ *    @param pixels Pixels to upload.
+ */
+static void nebu_uploadLayer( GLuint tex, int size, GLenum format, const void *pixels )
+{
+   glBindTexture( GL_TEXTURE_2D, tex );
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+   glTexImage2D( GL_TEXTURE_2D, 0, GL_ALPHA, size, size,
+         0, format, GL_UNSIGNED_BYTE, pixels );
+   gl_checkErr();
+}
+
+
 /**
  * @brief Cleans up the nebu subsystem.
  */
@@ -301,12 +340,19 @@ void nebu_exit (void)
 {
    int i;
 
+   /* Wait for the background generation. */
+   if (nebu_job != NULL)
+      nebu_finishJob( 0 );
+
    /* Free the Nebula BG. */
    glDeleteTextures( NEBULA_Z, nebu_textures );
 
    /* Free the puffs. */
-   for (i=0; i<NEBULA_PUFFS; i++)
-      gl_freeTexture( nebu_pufftexs[i] );
+   for (i=0; i<NEBULA_PUFFS; i++) {
+      if (nebu_pufftexs[i] != NULL)
+         gl_freeTexture( nebu_pufftexs[i] );
+      nebu_pufftexs[i] = NULL;
+   }
 
    /* Free the VBO. */
    if (nebu_vboBG != NULL) {
@@ -317,6 +363,10 @@ void nebu_exit (void)
       gl_vboDestroy( nebu_vboOverlay );
       nebu_vboOverlay= NULL;
    }
+
+   /* Free the framebuffer. */
+   gl_fboFree( nebu_fbo );
+   nebu_fbo = NULL;
 }
 
 
@@ -336,7 +386,50 @@ void nebu_render( const double dt )
       nebu_renderMultitexture(dt);
 
    /* Now render the puffs, they are generic. */
-   nebu_renderPuffs( 1 );
+   if (nebu_lowresBegin()) {
+      nebu_renderPuffs( 1 );
+      nebu_lowresEnd();
+   }
+   else
+      nebu_renderPuffs( 1 );
+}
+
+
+/**
+ * @brief Starts rendering to the reduced resolution framebuffer.
+ *
+ *    @return 1 if rendering to it, 0 if it must be rendered directly.
+ */
+static int nebu_lowresBegin (void)
+{
+   if (conf.nebu_scale <= 1) {
+      gl_fboFree( nebu_fbo );
+      nebu_fbo = NULL;
+      return 0;
+   }
+
+   /* Recreate on resolution or option changes. */
+   if ((nebu_fbo != NULL) && ((nebu_fbo->w != SCREEN_W) ||
+            (nebu_fbo->h != SCREEN_H) || (nebu_fbo->scale != conf.nebu_scale))) {
+      gl_fboFree( nebu_fbo );
+      nebu_fbo = NULL;
+   }
+   if (nebu_fbo == NULL)
+      nebu_fbo = gl_fboCreateScaled( SCREEN_W, SCREEN_H, conf.nebu_scale );
+   if (nebu_fbo == NULL)
+      return 0;
+
+   return (gl_fboBegin( nebu_fbo, 0., 0., 0, 0, SCREEN_W, SCREEN_H ) == 0);
+}
+
+
+/**
+ * @brief Stops rendering to the reduced resolution framebuffer and upsamples it.
+ */
+static void nebu_lowresEnd (void)
+{
+   gl_fboEnd();
+   gl_fboRender( nebu_fbo, 0., 0. );
 }
 
 
@@ -348,7 +441,7 @@ void nebu_render( const double dt )
 static void nebu_renderMultitexture( const double dt )
 {
    GLfloat col[4];
-   int temp;
+   int temp, shader;
    double sx, sy;
 
    /* calculate frame to draw */
@@ -377,42 +470,52 @@ static void nebu_renderMultitexture( const double dt )
    col[2] = cBlue.b;
    col[3] = (nebu_dt - nebu_timer) / nebu_dt;
 
-   /* Set up the targets */
-   /* Texture 0 */
-   nglActiveTexture( GL_TEXTURE0 );
-   glEnable(GL_TEXTURE_2D);
-   glBindTexture( GL_TEXTURE_2D, nebu_textures[cur_nebu[1]]);
-   glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE );
-   /* Texture 1 */
-   nglActiveTexture( GL_TEXTURE1 );
-   glEnable(GL_TEXTURE_2D);
-   glBindTexture( GL_TEXTURE_2D, nebu_textures[cur_nebu[0]]);
-
-   /* Prepare it */
-   glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE );
-   glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_RGB,      GL_REPLACE );
-   glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_ALPHA,    GL_INTERPOLATE );
-   /* Colour */
-   glTexEnvfv( GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, col );
-
-   /* Arguments */
-   /* Arg0 */
-   glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE0_RGB,    GL_CONSTANT );
-   glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_RGB,   GL_SRC_COLOR );
-   glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE0_ALPHA,  GL_TEXTURE );
-   glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_ALPHA, GL_SRC_ALPHA );
-   /* Arg1 */
-   glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE1_ALPHA,  GL_PREVIOUS );
-   glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND1_ALPHA, GL_SRC_ALPHA );
-   /* Arg2 */
-   glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE2_ALPHA,  GL_CONSTANT );
-   glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND2_ALPHA, GL_SRC_ALPHA );
-
    /* Compensate possible rumble */
    spfx_getShake( &sx, &sy );
    gl_matrixPush();
       gl_matrixTranslate( -sx, -sy );
 
+   /* Same combination done by a program. */
+   shader = (gl_programUse( GL_PROG_NEBULA, col ) == 0);
+   if (shader) {
+      nglActiveTexture( GL_TEXTURE1 );
+      glBindTexture( GL_TEXTURE_2D, nebu_textures[cur_nebu[0]]);
+      nglActiveTexture( GL_TEXTURE0 );
+      glBindTexture( GL_TEXTURE_2D, nebu_textures[cur_nebu[1]]);
+   }
+   else {
+      /* Set up the targets */
+      /* Texture 0 */
+      nglActiveTexture( GL_TEXTURE0 );
+      glEnable(GL_TEXTURE_2D);
+      glBindTexture( GL_TEXTURE_2D, nebu_textures[cur_nebu[1]]);
+      glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE );
+      /* Texture 1 */
+      nglActiveTexture( GL_TEXTURE1 );
+      glEnable(GL_TEXTURE_2D);
+      glBindTexture( GL_TEXTURE_2D, nebu_textures[cur_nebu[0]]);
+
+      /* Prepare it */
+      glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE );
+      glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_RGB,      GL_REPLACE );
+      glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_ALPHA,    GL_INTERPOLATE );
+      /* Colour */
+      glTexEnvfv( GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, col );
+
+      /* Arguments */
+      /* Arg0 */
+      glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE0_RGB,    GL_CONSTANT );
+      glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_RGB,   GL_SRC_COLOR );
+      glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE0_ALPHA,  GL_TEXTURE );
+      glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_ALPHA, GL_SRC_ALPHA );
+      /* Arg1 */
+      glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE1_ALPHA,  GL_PREVIOUS );
+      glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND1_ALPHA, GL_SRC_ALPHA );
+      /* Arg2 */
+      glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE2_ALPHA,  GL_CONSTANT );
+      glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND2_ALPHA, GL_SRC_ALPHA );
+   }
+
    /* Now render! */
    gl_vboActivateOffset( nebu_vboBG, GL_VERTEX_ARRAY,
          sizeof(GL_FLOAT) * 0*2*4, 2, GL_FLOAT, 0 );
@@ -426,11 +529,15 @@ static void nebu_renderMultitexture( const double dt )
    gl_matrixPop();
 
    /* Set values to defaults */
-   glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
-   glDisable(GL_TEXTURE_2D);
-   nglActiveTexture( GL_TEXTURE0 );
-   glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
-   glDisable(GL_TEXTURE_2D);
+   if (shader)
+      gl_programUnuse();
+   else {
+      glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
+      glDisable(GL_TEXTURE_2D);
+      nglActiveTexture( GL_TEXTURE0 );
+      glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
+      glDisable(GL_TEXTURE_2D);
+   }
 
    /* Anything failed? */
    gl_checkErr();
@@ -582,6 +689,7 @@ void nebu_renderOverlay( const double dt )
    double ox, oy;
    double z;
    double sx, sy;
+   int lowres;
 
    /* Get GUI offsets. */
    gui_getOffset( &gx, &gy );
@@ -589,6 +697,9 @@ void nebu_renderOverlay( const double dt )
    /* Get zoom. */
    z = cam_getZoom();
 
+   /* Haze and puffs are smooth, they can be rendered at a lower resolution. */
+   lowres = nebu_lowresBegin();
+
    /*
     * Renders the puffs
     */
@@ -641,9 +752,8 @@ void nebu_renderOverlay( const double dt )
    gl_vboDeactivate();
    gl_matrixPop();
 
-   /* Reset puff movement. */
-   puff_x = 0.;
-   puff_y = 0.;
+   if (lowres)
+      nebu_lowresEnd();
 
    gl_checkErr();
 }
@@ -658,35 +768,51 @@ void nebu_renderOverlay( const double dt )
 static void nebu_renderPuffs( int below_player )
 {
    int i;
+   double x, y;
+   NebulaPuff *puff;
 
    /* Main menu shouldn't have puffs */
    if (menu_isOpen(MENU_MAIN)) return;
 
+   /* Puffs sharing a texture get drawn together. */
+   gl_batchBegin();
    for (i=0; i<nebu_npuffs; i++) {
+      puff = &nebu_puffs[i];
 
       /* Separate by layers */
-      if ((below_player && (nebu_puffs[i].height < 1.)) ||
-            (!below_player && (nebu_puffs[i].height > 1.))) {
-
-         /* calculate new position */
-         nebu_puffs[i].x += puff_x * nebu_puffs[i].height;
-         nebu_puffs[i].y += puff_y * nebu_puffs[i].height;
-
-         /* Check boundaries */
-         if (nebu_puffs[i].x > SCREEN_W + NEBULA_PUFF_BUFFER)
-            nebu_puffs[i].x -= SCREEN_W + 2*NEBULA_PUFF_BUFFER;
-         else if (nebu_puffs[i].y > SCREEN_H + NEBULA_PUFF_BUFFER)
-            nebu_puffs[i].y -= SCREEN_H + 2*NEBULA_PUFF_BUFFER;
-         else if (nebu_puffs[i].x < -NEBULA_PUFF_BUFFER)
-            nebu_puffs[i].x += SCREEN_W + 2*NEBULA_PUFF_BUFFER;
-         else if (nebu_puffs[i].y < -NEBULA_PUFF_BUFFER)
-            nebu_puffs[i].y += SCREEN_H + 2*NEBULA_PUFF_BUFFER;
+      if ((below_player && (puff->height < 1.)) ||
+            (!below_player && (puff->height > 1.))) {
+         if (nebu_pufftexs[puff->tex] == NULL)
+            continue;
+
+         /* Position only depends on how much the camera moved. */
+         x = nebu_puffWrap( puff->x + puff_x * puff->height, SCREEN_W );
+         y = nebu_puffWrap( puff->y + puff_y * puff->height, SCREEN_H );
 
          /* Render */
-         gl_blitStatic( nebu_pufftexs[nebu_puffs[i].tex],
-               nebu_puffs[i].x, nebu_puffs[i].y, &cLightBlue );
+         gl_blitStatic( nebu_pufftexs[puff->tex], x, y, &cLightBlue );
       }
    }
+   gl_batchEnd();
+}
+
+
+/**
+ * @brief Wraps a puff coordinate around the screen and its buffer.
+ *
+ *    @param x Coordinate to wrap.
+ *    @param max Size of the screen on that axis.
+ *    @return The coordinate in [-NEBULA_PUFF_BUFFER, max+NEBULA_PUFF_BUFFER).
+ */
+static double nebu_puffWrap( double x, double max )
+{
+   double span;
+
+   span = max + 2*NEBULA_PUFF_BUFFER;
+   x    = fmod( x + NEBULA_PUFF_BUFFER, span );
+   if (x < 0.)
+      x += span;
+   return x - NEBULA_PUFF_BUFFER;
 }
 
 
@@ -717,6 +843,8 @@ void nebu_prep( double density, double volatility )
 
    nebu_npuffs = density/4.;
    nebu_puffs = realloc(nebu_puffs, sizeof(NebulaPuff)*nebu_npuffs);
+   puff_x = 0.;
+   puff_y = 0.;
    for (i=0; i<nebu_npuffs; i++) {
       /* Position */
       nebu_puffs[i].x = (double)RNG(-NEBULA_PUFF_BUFFER,
@@ -739,80 +867,206 @@ void nebu_prep( double density, double volatility )
  */
 void nebu_forceGenerate (void)
 {
-   nebu_w = nebu_h = -9; /* \o/ magic numbers */
+   nebu_force = 1;
+}
+
+
+/**
+ * @brief Uploads the full nebula once generated in the background and
+ *        cleans up after it has been saved.
+ */
+void nebu_update (void)
+{
+   if ((nebu_job == NULL) || (SDL_SemTryWait( nebu_job->done ) != 0))
+      return;
+
+   /* Post it back, we've already taken it. */
+   SDL_SemPost( nebu_job->done );
+   nebu_finishJob( 1 );
 }
 
 
 /**
  * @brief Generates the nebula.
  *
+ * A low resolution pass of the same noise is shown while the full size is
+ *  generated in the background, see nebu_update().
+ *
+ *    @param size Size of the layers.
  *    @return 0 on success.
  */
-static int nebu_generate (void)
+static int nebu_generate( int size )
 {
-   int i;
+   int i, n;
+   perlin_data_t *noise;
    float *nebu;
+   uint8_t *alpha;
    const char *cache;
-   char nebu_file[PATH_MAX];
-   int w,h;
-   int ret;
+   NebulaJob *job;
 
    /* Warn user of what is happening. */
-   loadscreen_render( 0.05, "Generating Nebula (slow, run once)..." );
-
-   /* Get resolution to create at. */
-   w = SCREEN_W;
-   h = SCREEN_H;
+   loadscreen_render( 0.05, "Generating Nebula..." );
 
    /* Try to make the dir first if it fails. */
    cache = nfile_cachePath();
    nfile_dirMakeExist( "%s", cache );
    nfile_dirMakeExist( "%s"NEBULA_PATH, cache );
 
-   /* Generate all the nebula backgrounds */
-   nebu = noise_genNebulaMap( w, h, NEBULA_Z, 5. );
+   /* Noise is made here, the RNG isn't for other threads. */
+   noise = noise_new( 3, NOISE_DEFAULT_HURST, NOISE_DEFAULT_LACUNARITY );
 
-   /* Start saving - compression can take a bit. */
-   loadscreen_render( 0.05, "Compressing Nebula layers..." );
+   /* First pass. */
+   n    = NEBULA_SIZE_LOW*NEBULA_SIZE_LOW;
+   nebu = noise_genNebulaMap( noise, NEBULA_SIZE_LOW, NEBULA_SIZE_LOW,
+         NEBULA_Z, NEBULA_RUGOSITY );
+   if (nebu == NULL) {
+      noise_delete( noise );
+      return -1;
+   }
+   alpha = nebu_alphaFromNebulaMap( nebu, n*NEBULA_Z );
+   free(nebu);
+   for (i=0; i<NEBULA_Z; i++)
+      nebu_uploadLayer( nebu_textures[i], NEBULA_SIZE_LOW, GL_ALPHA, &alpha[ i*n ] );
+   free(alpha);
+
+   /* Full size in the background. */
+   job         = calloc( 1, sizeof(NebulaJob) );
+   job->noise  = noise;
+   job->size   = size;
+   job->done   = SDL_CreateSemaphore( 0 );
+   nebu_job    = job;
+   if ((job->done == NULL) || (threadpool_newJob( nebu_generateJob, job ) != 0)) {
+      nebu_generateJob( job );
+      nebu_finishJob( 1 );
+   }
+   return 0;
+}
 
-   /* Save each nebula as an image */
-   for (i=0; i<NEBULA_Z; i++) {
-      nsnprintf( nebu_file, PATH_MAX, NEBULA_PATH_BG, w, h, i );
-      ret = saveNebula( &nebu[ i*w*h ], w, h, nebu_file );
-      if (ret != 0)
-         break; /* An error has happened */
+
+/**
+ * @brief Generates the full nebula or saves it, in the background.
+ *
+ *    @param data Job to run.
+ *    @return 0 on success.
+ */
+static int nebu_generateJob( void *data )
+{
+   NebulaJob *job = (NebulaJob*) data;
+   char nebu_file[PATH_MAX];
+   float *nebu;
+   int i, n;
+
+   n = job->size * job->size;
+   if (job->saving) {
+      /* Compression can take a bit. */
+      for (i=0; i<NEBULA_Z; i++) {
+         nsnprintf( nebu_file, PATH_MAX, NEBULA_PATH_BG, job->size, i );
+         if (saveNebula( &job->alpha[ i*n ], job->size, job->size, nebu_file ) != 0)
+            break; /* An error has happened */
+      }
+   }
+   else {
+      nebu = noise_genNebulaMap( job->noise, job->size, job->size,
+            NEBULA_Z, NEBULA_RUGOSITY );
+      if (nebu != NULL) {
+         job->alpha = nebu_alphaFromNebulaMap( nebu, n*NEBULA_Z );
+         free(nebu);
+      }
    }
 
-   /* Cleanup */
-   free(nebu);
-   return ret;
+   if (job->done != NULL)
+      SDL_SemPost( job->done );
+   return 0;
+}
+
+
+/**
+ * @brief Waits for the background job, then uploads and saves the layers it
+ *        generated or frees it once saved.
+ *
+ *    @param upload Whether to upload and save generated layers.
+ */
+static void nebu_finishJob( int upload )
+{
+   NebulaJob *job = nebu_job;
+   int i, n;
+
+   if (job->done != NULL)
+      SDL_SemWait( job->done );
+
+   if (upload && !job->saving && (job->alpha != NULL)) {
+      n = job->size * job->size;
+      for (i=0; i<NEBULA_Z; i++)
+         nebu_uploadLayer( nebu_textures[i], job->size, GL_ALPHA, &job->alpha[ i*n ] );
+      DEBUG("Generated %d Nebula Layers", NEBULA_Z);
+
+      /* Save in the background too. */
+      job->saving = 1;
+      if ((job->done != NULL) && (threadpool_newJob( nebu_generateJob, job ) == 0))
+         return;
+      nebu_generateJob( job );
+      if (job->done != NULL)
+         SDL_SemWait( job->done );
+   }
+
+   if (job->done != NULL)
+      SDL_DestroySemaphore( job->done );
+   noise_delete( job->noise );
+   free( job->alpha );
+   free( job );
+   nebu_job = NULL;
 }
 
 
 /**
  * @brief Generates nebula puffs.
+ *
+ * The puffs are shared by all the nebulae, so they are only made once. The
+ *  noise is rolled here as the RNG isn't for other threads, the puffs are
+ *  then generated over the threadpool and uploaded.
  */
 static void nebu_generatePuffs (void)
 {
    int i;
-   int w,h;
-   SDL_Surface *sur;
-   float *nebu;
+   NebulaPuffGen *gen;
 
    /* Warn user of what is happening. */
    loadscreen_render( 0.05, "Generating Nebula Puffs..." );
 
+   gen = calloc( 1, sizeof(NebulaPuffGen) );
+   for (i=0; i<NEBULA_PUFFS; i++) {
+      gen->size[i]  = RNG(20,64);
+      gen->noise[i] = noise_new( 2, NOISE_DEFAULT_HURST, NOISE_DEFAULT_LACUNARITY );
+   }
+
    /* Generate the nebula puffs */
+   threadpool_parallelFor( NEBULA_PUFFS, 1, nebu_generatePuffRange, gen );
+
+   /* Load the textures */
    for (i=0; i<NEBULA_PUFFS; i++) {
+      nebu_pufftexs[i] = (gen->sur[i] != NULL) ? gl_loadImage( gen->sur[i], 0 ) : NULL;
+      noise_delete( gen->noise[i] );
+   }
+   free( gen );
+}
 
-      /* Generate the nebula */
-      w = h = RNG(20,64);
-      nebu = noise_genNebulaPuffMap( w, h, 1. );
-      sur = nebu_surfaceFromNebulaMap( nebu, w, h );
-      free(nebu);
 
-      /* Load the texture */
-      nebu_pufftexs[i] =  gl_loadImage( sur, 0 );
+/**
+ * @brief Generates a range of nebula puffs, run from the threadpool.
+ */
+static void nebu_generatePuffRange( int start, int end, void *data )
+{
+   NebulaPuffGen *gen = (NebulaPuffGen*) data;
+   float *nebu;
+   int i, size;
+
+   for (i=start; i<end; i++) {
+      size = gen->size[i];
+      nebu = noise_genNebulaPuffMap( gen->noise[i], size, size, 1. );
+      if (nebu == NULL)
+         continue;
+      gen->sur[i] = nebu_surfaceFromNebulaMap( nebu, size, size );
+      free(nebu);
    }
 }
 
@@ -835,20 +1089,29 @@ static int nebu_checkCompat( const char* file )
 /**
  * @brief Saves a nebula.
  *
- *    @param map Nebula map to save.
- *    @param w Width of nebula map.
- *    @param h Height of nebula map.
+ *    @param alpha Alpha of the nebula layer to save.
+ *    @param w Width of nebula layer.
+ *    @param h Height of nebula layer.
  *    @param file Path to save into.
  *    @return 0 on success.
  */
-static int saveNebula( float *map, const uint32_t w, const uint32_t h, const char* file )
+static int saveNebula( const uint8_t *alpha, const uint32_t w, const uint32_t h, const char* file )
 {
    char file_path[PATH_MAX];
    SDL_Surface* sur;
+   uint32_t *pix;
+   uint32_t i;
    int ret;
 
    /* fix surface */
-   sur = nebu_surfaceFromNebulaMap( map, w, h );
+   sur = SDL_CreateRGBSurface( SDL_SWSURFACE, w, h, 32, RGBAMASK );
+   if (sur == NULL)
+      return -1;
+   SDL_LockSurface( sur );
+   pix = sur->pixels;
+   for (i=0; i<h*w; i++)
+      pix[i] = RMASK + BMASK + GMASK + (uint32_t)alpha[i] * (AMASK / 0xFF);
+   SDL_UnlockSurface( sur );
 
    /* save */
    nsnprintf(file_path, PATH_MAX, "%s"NEBULA_PATH"%s", nfile_cachePath(), file );
@@ -900,6 +1163,25 @@ static SDL_Surface* loadNebula( const char* file )
 
 
 
+/**
+ * @brief Converts a nebula map to alpha values.
+ *
+ *    @param map Nebula map to use.
+ *    @param n Number of values in the map.
+ *    @return The alpha values, to be freed.
+ */
+static uint8_t* nebu_alphaFromNebulaMap( const float* map, const int n )
+{
+   int i;
+   uint8_t *alpha;
+
+   alpha = malloc( n );
+   for (i=0; i<n; i++)
+      alpha[i] = (uint8_t)(255. * CLAMP( 0., 1., map[i] ));
+   return alpha;
+}
+
+
 /**
  * @brief Generates a SDL_Surface from a 2d nebula map
  *
@@ -12,6 +12,7 @@
  */
 int nebu_init (void);
 void nebu_vbo_init (void);
+void nebu_update (void);
 void nebu_exit (void);
 
 /*
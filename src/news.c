@@ -31,6 +31,8 @@
 #include "nxml.h"
 #include "nxml_lua.h"
 #include "space.h"
+#include "nhash.h"
+#include "array.h"
 
 
 #define NEWS_MAX_LENGTH       8192
@@ -49,6 +51,16 @@ static char buf[NEWS_MAX_LENGTH];
 
 static int len;
 
+/*
+ * Generated news cache, buf is only rebuilt when these change.
+ */
+static unsigned int news_serial = 1; /**< Changes whenever an article is added or removed. */
+static unsigned int news_genSerial = 0; /**< news_serial when buf was generated. */
+static const char *news_genFaction = NULL; /**< Faction buf was generated for, interned. */
+static ntime_t news_genExpire = 0; /**< First removal date among the articles in the list. */
+static unsigned int news_lineSerial = 0; /**< news_genSerial of the wrapped lines. */
+static int news_lineWidth     = 0; /**< Width the lines were wrapped to. */
+
 static unsigned int news_tick = 0; /**< Last news tick. */
 static int news_drag          = 0; /**< Is dragging news? */
 static double news_pos        = 0.; /**< Position of the news feed. */
@@ -73,7 +85,7 @@ static int news_mouse( unsigned int wid, SDL_Event *event, double mx, double my,
 static int news_parseArticle( xmlNodePtr parent );
 int news_saveArticles( xmlTextWriterPtr writer ); /* externed in save.c */
 int news_loadArticles( xmlNodePtr parent ); /* externed in load.c */
-static char* make_clean( char* unclean );
+static char* make_clean( const char* unclean );
 static char* get_fromclean( char *clean );
 static void clear_newslines (void);
 
@@ -96,13 +108,11 @@ news_t* new_article(char* title, char* content, char* faction, ntime_t date,
 
    n_article->id = next_id++;
 
-   /* allocate it */
-   if ( !( (n_article->title = strdup(title)) &&
-         (n_article->desc = strdup(content)) &&
-         (n_article->faction = strdup(faction)))) {
-      ERR("Out of Memory.");
-      return NULL;
-   }
+   /* Strings are shared with previous articles. */
+   n_article->title   = nhash_intern( title );
+   n_article->desc    = nhash_intern( content );
+   n_article->faction = nhash_intern( faction );
+   news_serial++;
 
    n_article->date = date;
    n_article->date_to_rm = date_to_rm;
@@ -162,16 +172,16 @@ int free_article(int id)
       article_ptr->next = article_to_rm->next;
    }
 
-   free(article_to_rm->title);
-   free(article_to_rm->desc);
-   free(article_to_rm->faction);
    free(article_to_rm->tag);
    free(article_to_rm);
+   news_serial++;
 
    return 0;
 }
 
 
+
+
 /**
  * @brief Initiate news linked list with a stack
  */
@@ -204,9 +214,6 @@ void news_exit (void)
       temp = article_ptr;
       article_ptr = article_ptr->next;
 
-      free(temp->faction);
-      free(temp->title);
-      free(temp->desc);
       free(temp->tag);
 
       free(temp);
@@ -227,6 +234,10 @@ void news_exit (void)
    textlength  = 0;
 
    news_list = NULL;
+   news_genSerial  = 0;
+   news_genFaction = NULL;
+   news_lineSerial = 0;
+   news_serial++;
 
 }
 
@@ -261,9 +272,19 @@ int *generate_news( char* faction )
 {
    news_t *temp, *article_ptr;
    int p;
+   char *date;
+   ntime_t now;
+
+   /* Same articles as last time. */
+   now     = ntime_get();
+   faction = (char*)nhash_intern( faction );
+   if ((news_genSerial == news_serial) && (news_genFaction == faction) &&
+         (now < news_genExpire))
+      return 0;
 
    p = 0;
    article_ptr = news_list;
+   news_genExpire = INT64_MAX;
 
    /* Put all acceptable news into buf */
    do {
@@ -272,20 +293,23 @@ int *generate_news( char* faction )
          break;
 
       /* if the article is due for removal */
-      if (article_ptr->date_to_rm <= ntime_get()) {
+      if (article_ptr->date_to_rm <= now) {
          temp = article_ptr->next;
          free_article(article_ptr->id);
          article_ptr = temp;
          continue;
       }
+      news_genExpire = MIN( news_genExpire, article_ptr->date_to_rm );
 
-      /* if article is okay */
-      if (!strcmp(article_ptr->faction, "Generic") || !strcmp(article_ptr->faction, faction)) {
+      /* if article is okay, interned so same strings share pointers */
+      if ((strcmp(article_ptr->faction, "Generic") == 0) || (article_ptr->faction == faction)) {
          if (article_ptr->date && article_ptr->date<40000000000000) {
+            date = ntime_pretty(article_ptr->date, 1);
             p += nsnprintf( buf+p, NEWS_MAX_LENGTH-p,
                " %s \n"
                "%s: %s\e0\n\n"
-               , article_ptr->title, ntime_pretty(article_ptr->date, 1), article_ptr->desc );
+               , article_ptr->title, date, article_ptr->desc );
+            free(date);
          }
          else {
             p += nsnprintf( buf+p, NEWS_MAX_LENGTH-p,
@@ -303,6 +327,8 @@ int *generate_news( char* faction )
       nsnprintf(buf, NEWS_MAX_LENGTH, "\n\nSorry, no news today\n\n\n");
 
    len = p;
+   news_genSerial  = news_serial;
+   news_genFaction = faction;
 
    return 0;
 }
@@ -325,8 +351,17 @@ void news_widget( unsigned int wid, int x, int y, int w, int h )
    news_pos    = h/3;
    news_tick   = SDL_GetTicks();
 
+   /* Lines are still wrapped from last time. */
+   if ((news_nlines > 0) && (news_lineSerial == news_genSerial) &&
+         (news_lineWidth == w)) {
+      window_addCust( wid, x, y, w, h, "cstNews", 1, news_render, news_mouse, NULL );
+      return;
+   }
+
    if (news_nlines>0)
       clear_newslines();
+   news_lineSerial = news_genSerial;
+   news_lineWidth  = w;
 
 
    /* Now load up the text. */
@@ -503,7 +538,7 @@ static void news_render( double bx, double by, double w, double h, void *data )
 /*
  * @brief replace ascii character 27 with the string "\027"
  */
-static char* make_clean( char* unclean )
+static char* make_clean( const char* unclean )
 {
    int i, j;
    char *new;
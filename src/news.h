@@ -17,9 +17,9 @@ typedef struct news_s {
 
    int id;
 
-   char *title; /**< Title of the news article. */
-   char *desc; /**< Content of the news article. */
-   char *faction; /**< Faction of the news article */
+   const char *title; /**< Title of the news article, interned. */
+   const char *desc; /**< Content of the news article, interned. */
+   const char *faction; /**< Faction of the news article, interned. */
    char *tag; /**< tag to identify article, added after creation */
 
    ntime_t date; /**< Date added ascribed to the article, NULL if none */
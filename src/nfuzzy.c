@@ -0,0 +1,242 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file nfuzzy.c
+ *
+ * @brief Trigram index for case insensitive substring searches over names.
+ *
+ * Every name is split into its case-folded trigrams. A search only checks the
+ *  names containing the rarest trigram of the needle, instead of running
+ *  nstrcasestr() over every name. Needles shorter than a trigram fall back to
+ *  the linear scan. Results keep the order names were added in, so they
+ *  match what the scan returned.
+ */
+
+
+#include "nfuzzy.h"
+
+#include "naev.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nstring.h"
+
+
+#define NFUZZY_MIN      64 /**< Minimum amount of slots. */
+#define NFUZZY_CHUNK    128 /**< Names to grow by. */
+
+
+/*
+ * Prototypes.
+ */
+static uint32_t nfuzzy_trigram( const char *s );
+static int nfuzzy_slot( const NameIndex *idx, uint32_t key );
+static void nfuzzy_build( NameIndex *idx );
+
+
+/**
+ * @brief Gets the case-folded trigram at the start of a string.
+ *
+ *    @param s String with at least three characters.
+ *    @return The trigram, never 0.
+ */
+static uint32_t nfuzzy_trigram( const char *s )
+{
+   return ((uint32_t)tolower((unsigned char)s[0]) << 16) |
+         ((uint32_t)tolower((unsigned char)s[1]) << 8) |
+         (uint32_t)tolower((unsigned char)s[2]);
+}
+
+
+/**
+ * @brief Gets the slot of a trigram.
+ *
+ *    @return Slot holding the trigram or the empty slot where it would go.
+ */
+static int nfuzzy_slot( const NameIndex *idx, uint32_t key )
+{
+   unsigned int i, mask;
+
+   mask = idx->size - 1;
+   for (i = (key * 2654435761U) & mask;
+         (idx->keys[i] != 0) && (idx->keys[i] != key);
+         i = (i+1) & mask);
+   return i;
+}
+
+
+/**
+ * @brief Initializes an empty index.
+ *
+ *    @param idx Index to initialize.
+ */
+void nfuzzy_init( NameIndex *idx )
+{
+   memset( idx, 0, sizeof(NameIndex) );
+}
+
+
+/**
+ * @brief Frees an index.
+ *
+ *    @param idx Index to free.
+ */
+void nfuzzy_free( NameIndex *idx )
+{
+   free( idx->names );
+   free( idx->keys );
+   free( idx->start );
+   free( idx->count );
+   free( idx->postings );
+   nfuzzy_init( idx );
+}
+
+
+/**
+ * @brief Removes all the names from an index, keeping the memory.
+ *
+ *    @param idx Index to clear.
+ */
+void nfuzzy_clear( NameIndex *idx )
+{
+   idx->n     = 0;
+   idx->valid = 0;
+}
+
+
+/**
+ * @brief Adds a name to an index.
+ *
+ *    @param idx Index to add to.
+ *    @param name Name to add, must outlive its entry. NULL is never found.
+ */
+void nfuzzy_add( NameIndex *idx, const char *name )
+{
+   if (idx->n >= idx->m) {
+      idx->m    += NFUZZY_CHUNK;
+      idx->names = realloc( idx->names, idx->m * sizeof(char*) );
+   }
+   idx->names[ idx->n++ ] = name;
+   idx->valid = 0;
+}
+
+
+/**
+ * @brief Builds the trigram table of an index.
+ */
+static void nfuzzy_build( NameIndex *idx )
+{
+   int i, j, s, len, total, *last, *fill;
+
+   /* Keep load under 1/2 so probes stay short. */
+   total = 0;
+   for (i=0; i<idx->n; i++)
+      if (idx->names[i] != NULL)
+         total += MAX( 0, (int)strlen(idx->names[i]) - 2 );
+   for (s=NFUZZY_MIN; s < 2*total; s *= 2);
+
+   free( idx->keys );
+   free( idx->start );
+   free( idx->count );
+   free( idx->postings );
+   idx->size  = s;
+   idx->keys  = calloc( s, sizeof(uint32_t) );
+   idx->start = malloc( s * sizeof(int) );
+   idx->count = calloc( s, sizeof(int) );
+   last       = malloc( s * sizeof(int) );
+   for (i=0; i<s; i++)
+      last[i] = -1;
+
+   /* Count the names containing each trigram, once per name. */
+   for (i=0; i<idx->n; i++) {
+      if (idx->names[i] == NULL)
+         continue;
+      len = strlen( idx->names[i] );
+      for (j=0; j+3<=len; j++) {
+         s = nfuzzy_slot( idx, nfuzzy_trigram( &idx->names[i][j] ) );
+         idx->keys[s] = nfuzzy_trigram( &idx->names[i][j] );
+         if (last[s] != i) {
+            last[s] = i;
+            idx->count[s]++;
+         }
+      }
+   }
+
+   /* Lay out the postings. */
+   total = 0;
+   for (s=0; s<idx->size; s++) {
+      idx->start[s] = total;
+      total        += idx->count[s];
+      last[s]       = -1;
+   }
+   idx->postings = malloc( MAX( 1, total ) * sizeof(int) );
+   fill          = calloc( idx->size, sizeof(int) );
+   for (i=0; i<idx->n; i++) {
+      if (idx->names[i] == NULL)
+         continue;
+      len = strlen( idx->names[i] );
+      for (j=0; j+3<=len; j++) {
+         s = nfuzzy_slot( idx, nfuzzy_trigram( &idx->names[i][j] ) );
+         if (last[s] != i) {
+            last[s] = i;
+            idx->postings[ idx->start[s] + fill[s]++ ] = i;
+         }
+      }
+   }
+
+   free( fill );
+   free( last );
+   idx->valid = 1;
+}
+
+
+/**
+ * @brief Finds the names containing a string, ignoring case.
+ *
+ *    @param idx Index to search, built on first use after a change.
+ *    @param needle String to find.
+ *    @param[out] out Indices of the matching names in the order they were
+ *           added, must hold as many elements as names in the index.
+ *    @return Number of matching names.
+ */
+int nfuzzy_search( NameIndex *idx, const char *needle, int *out )
+{
+   int i, j, k, s, best, len, n;
+
+   n   = 0;
+   len = strlen( needle );
+
+   /* Too short to have a trigram. */
+   if (len < 3) {
+      for (i=0; i<idx->n; i++)
+         if ((idx->names[i] != NULL) &&
+               (nstrcasestr( idx->names[i], needle ) != NULL))
+            out[n++] = i;
+      return n;
+   }
+
+   if (!idx->valid)
+      nfuzzy_build( idx );
+
+   /* Pick the rarest trigram, a missing one means no match. */
+   best = -1;
+   for (j=0; j+3<=len; j++) {
+      s = nfuzzy_slot( idx, nfuzzy_trigram( &needle[j] ) );
+      if (idx->keys[s] == 0)
+         return 0;
+      if ((best < 0) || (idx->count[s] < idx->count[best]))
+         best = s;
+   }
+
+   /* Only the names with it can match. */
+   for (k=idx->start[best]; k<idx->start[best]+idx->count[best]; k++) {
+      i = idx->postings[k];
+      if (nstrcasestr( idx->names[i], needle ) != NULL)
+         out[n++] = i;
+   }
+   return n;
+}
@@ -0,0 +1,38 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef NFUZZY_H
+#  define NFUZZY_H
+
+
+#include <stdint.h>
+
+
+/**
+ * @brief Case insensitive substring index over a list of names.
+ *
+ * Names are not copied, they must stay valid as long as they are in the index.
+ */
+typedef struct NameIndex_ {
+   const char **names; /**< Names in the order they were added, may be NULL. */
+   int n; /**< Number of names. */
+   int m; /**< Memory allocated for names. */
+   int valid; /**< Whether the trigram table is up to date. */
+   uint32_t *keys; /**< Trigram of each slot, 0 if empty. */
+   int *start; /**< First posting of each slot. */
+   int *count; /**< Number of postings of each slot. */
+   int *postings; /**< Names containing each trigram, in ascending order. */
+   int size; /**< Number of slots, power of two. */
+} NameIndex;
+
+
+void nfuzzy_init( NameIndex *idx );
+void nfuzzy_free( NameIndex *idx );
+void nfuzzy_clear( NameIndex *idx );
+void nfuzzy_add( NameIndex *idx, const char *name );
+int nfuzzy_search( NameIndex *idx, const char *needle, int *out );
+
+
+#endif /* NFUZZY_H */
@@ -0,0 +1,278 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file nhash.c
+ *
+ * @brief Open addressing hash table from names to stack indices or pointers.
+ *
+ * Used to avoid linear strcmp scans when looking up data by name.  Stacks
+ *  that can change at runtime simply clear and refill their table.
+ *
+ * Also keeps a global table of interned strings, so equal strings are only
+ *  stored once and can be compared by pointer.
+ */
+
+
+#include "nhash.h"
+
+#include "naev.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "array.h"
+
+
+#define NHASH_MIN       64 /**< Minimum amount of slots. */
+
+
+/*
+ * Interned strings, they live until nhash_internFree().
+ */
+static char **nhash_strings = NULL; /**< Interned strings. */
+static NameHash nhash_stringHash; /**< Maps strings to nhash_strings. */
+
+
+/*
+ * Prototypes.
+ */
+static unsigned int nhash_hash( const char *key );
+static void nhash_grow( NameHash *h );
+static void nhash_insert( NameHash *h, const char *key, NameHashValue value );
+static const NameHashValue* nhash_find( const NameHash *h, const char *key );
+
+
+/**
+ * @brief FNV-1a hash of a string.
+ */
+static unsigned int nhash_hash( const char *key )
+{
+   unsigned int hash;
+
+   hash = 2166136261U;
+   for ( ; *key != '\0'; key++) {
+      hash ^= (unsigned char)*key;
+      hash *= 16777619U;
+   }
+   return hash;
+}
+
+
+/**
+ * @brief Initializes an empty table.
+ *
+ *    @param h Table to initialize.
+ */
+void nhash_init( NameHash *h )
+{
+   memset( h, 0, sizeof(NameHash) );
+}
+
+
+/**
+ * @brief Frees a table.
+ *
+ *    @param h Table to free.
+ */
+void nhash_free( NameHash *h )
+{
+   free( h->keys );
+   free( h->values );
+   nhash_init( h );
+}
+
+
+/**
+ * @brief Removes all the keys from a table, keeping the memory.
+ *
+ *    @param h Table to clear.
+ */
+void nhash_clear( NameHash *h )
+{
+   if (h->keys != NULL)
+      memset( h->keys, 0, sizeof(char*) * h->size );
+   h->n = 0;
+}
+
+
+/**
+ * @brief Doubles the size of a table.
+ */
+static void nhash_grow( NameHash *h )
+{
+   const char **keys;
+   NameHashValue *values;
+   int i, size;
+
+   keys   = h->keys;
+   values = h->values;
+   size   = h->size;
+
+   h->size   = (size == 0) ? NHASH_MIN : 2*size;
+   h->keys   = calloc( h->size, sizeof(char*) );
+   h->values = malloc( h->size * sizeof(NameHashValue) );
+   h->n      = 0;
+
+   for (i=0; i<size; i++)
+      if (keys[i] != NULL)
+         nhash_insert( h, keys[i], values[i] );
+
+   free( keys );
+   free( values );
+}
+
+
+/**
+ * @brief Sets the value of a key, replacing it if it already exists.
+ *
+ *    @param h Table to modify.
+ *    @param key Key to set, must outlive its entry.
+ *    @param value Value to set.
+ */
+void nhash_set( NameHash *h, const char *key, int value )
+{
+   NameHashValue v;
+   v.i = value;
+   nhash_insert( h, key, v );
+}
+
+
+/**
+ * @brief Sets the pointer of a key, replacing it if it already exists.
+ *
+ *    @param h Table to modify.
+ *    @param key Key to set, must outlive its entry.
+ *    @param ptr Pointer to set.
+ */
+void nhash_setPtr( NameHash *h, const char *key, void *ptr )
+{
+   NameHashValue v;
+   v.p = ptr;
+   nhash_insert( h, key, v );
+}
+
+
+/**
+ * @brief Inserts a key, replacing it if it already exists.
+ */
+static void nhash_insert( NameHash *h, const char *key, NameHashValue value )
+{
+   unsigned int i, mask;
+
+   if (key == NULL)
+      return;
+
+   /* Keep load under 1/2 so probes stay short. */
+   if (2*(h->n+1) > h->size)
+      nhash_grow( h );
+
+   mask = h->size - 1;
+   for (i = nhash_hash(key) & mask; h->keys[i] != NULL; i = (i+1) & mask) {
+      if (strcmp( h->keys[i], key ) == 0) {
+         h->keys[i]   = key;
+         h->values[i] = value;
+         return;
+      }
+   }
+
+   h->keys[i]   = key;
+   h->values[i] = value;
+   h->n++;
+}
+
+
+/**
+ * @brief Gets the value of a key.
+ *
+ *    @param h Table to look in.
+ *    @param key Key to look for.
+ *    @return The value of the key or -1 if not found.
+ */
+int nhash_get( const NameHash *h, const char *key )
+{
+   const NameHashValue *v = nhash_find( h, key );
+   return (v == NULL) ? -1 : v->i;
+}
+
+
+/**
+ * @brief Gets the pointer of a key.
+ *
+ *    @param h Table to look in.
+ *    @param key Key to look for.
+ *    @return The pointer of the key or NULL if not found.
+ */
+void* nhash_getPtr( const NameHash *h, const char *key )
+{
+   const NameHashValue *v = nhash_find( h, key );
+   return (v == NULL) ? NULL : v->p;
+}
+
+
+/**
+ * @brief Finds the value of a key.
+ */
+static const NameHashValue* nhash_find( const NameHash *h, const char *key )
+{
+   unsigned int i, mask;
+
+   if ((h->n == 0) || (key == NULL))
+      return NULL;
+
+   mask = h->size - 1;
+   for (i = nhash_hash(key) & mask; h->keys[i] != NULL; i = (i+1) & mask)
+      if (strcmp( h->keys[i], key ) == 0)
+         return &h->values[i];
+
+   return NULL;
+}
+
+
+/**
+ * @brief Gets the interned copy of a string.
+ *
+ * Only for use on the main thread.
+ *
+ *    @param str String to intern.
+ *    @return The interned string, valid until nhash_internFree().
+ */
+const char* nhash_intern( const char *str )
+{
+   int i;
+
+   if (str == NULL)
+      return NULL;
+
+   i = nhash_get( &nhash_stringHash, str );
+   if (i >= 0)
+      return nhash_strings[i];
+
+   if (nhash_strings == NULL) {
+      nhash_strings = array_create( char* );
+      nhash_init( &nhash_stringHash );
+   }
+   i = array_size( nhash_strings );
+   array_push_back( &nhash_strings, strdup( str ) );
+   nhash_set( &nhash_stringHash, nhash_strings[i], i );
+   return nhash_strings[i];
+}
+
+
+/**
+ * @brief Frees all the interned strings.
+ */
+void nhash_internFree (void)
+{
+   int i;
+
+   if (nhash_strings == NULL)
+      return;
+
+   nhash_free( &nhash_stringHash );
+   for (i=0; i<array_size(nhash_strings); i++)
+      free( nhash_strings[i] );
+   array_free( nhash_strings );
+   nhash_strings = NULL;
+}
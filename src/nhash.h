@@ -0,0 +1,45 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef NHASH_H
+#  define NHASH_H
+
+
+/**
+ * @brief Value of a key, either a stack index or a pointer.
+ */
+typedef union NameHashValue_ {
+   int i; /**< Stack index, see nhash_get(). */
+   void *p; /**< Pointer, see nhash_getPtr(). */
+} NameHashValue;
+
+
+/**
+ * @brief Maps names to stack indices or pointers.
+ *
+ * Keys are not copied, they must stay valid as long as they are in the table.
+ */
+typedef struct NameHash_ {
+   const char **keys; /**< Keys, NULL if the slot is empty. */
+   NameHashValue *values; /**< Values of the keys. */
+   int size; /**< Number of slots, power of two. */
+   int n; /**< Number of keys. */
+} NameHash;
+
+
+void nhash_init( NameHash *h );
+void nhash_free( NameHash *h );
+void nhash_clear( NameHash *h );
+void nhash_set( NameHash *h, const char *key, int value );
+int nhash_get( const NameHash *h, const char *key );
+void nhash_setPtr( NameHash *h, const char *key, void *ptr );
+void* nhash_getPtr( const NameHash *h, const char *key );
+
+/* String interning. */
+const char* nhash_intern( const char *str );
+void nhash_internFree (void);
+
+
+#endif /* NHASH_H */
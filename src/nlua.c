@@ -12,9 +12,20 @@
 
 #include "naev.h"
 
+#include "SDL.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
+
 #include "nluadef.h"
 #include "log.h"
 #include "ndata.h"
+#include "nfile.h"
+#include "nhash.h"
+#include "array.h"
 #include "nlua_rnd.h"
 #include "nlua_faction.h"
 #include "nlua_var.h"
@@ -34,14 +45,102 @@
 #include "nstring.h"
 
 
+#define NLUA_CACHE_PATH    "luac/" /**< Bytecode cache path, relative to the cache directory. */
+#define NLUA_CACHE_KEY     32 /**< Size of a bytecode cache key. */
+#define NLUA_INCLUDE_PURE  "-- @pure" /**< First line of libraries whose globals can be shared. */
+
+#define NLUA_GC_BUDGET     0.001 /**< Seconds of garbage collection per frame. */
+#define NLUA_GC_GROWTH     1.5 /**< Memory growth over the last collection that starts a new one. */
+#define NLUA_GC_PAUSE      400 /**< Pause of the automatic collector, only a backstop. */
+
+#define NLUA_PROF_NAME     128 /**< Maximum length of a profiled function name. */
+
+#define NLUA_POOL_GRAIN    16 /**< Size step between pool size classes. */
+#define NLUA_POOL_CLASSES  16 /**< Number of pool size classes, larger blocks use malloc. */
+#define NLUA_POOL_CHUNK    (64*1024) /**< Bytes allocated at once for a pool. */
+
+
 lua_State *naevL = NULL;
 nlua_env __NLUA_CURENV = LUA_NOREF;
 
 
+/**
+ * @brief Compiled chunk kept in memory.
+ */
+typedef struct LuaChunk_ {
+   char *key; /**< Hash of the chunk name and source. */
+   char *data; /**< Bytecode. */
+   size_t len; /**< Length of the bytecode. */
+} LuaChunk;
+static LuaChunk *nlua_chunks = NULL; /**< Chunks compiled or loaded this run. */
+static NameHash nlua_chunkHash; /**< Maps keys to nlua_chunks. */
+
+/**
+ * @brief Library loaded with include(), shared by all the environments.
+ */
+typedef struct LuaInclude_ {
+   char *path; /**< Name passed to include(). */
+   int chunk; /**< Compiled chunk in nlua_chunks. */
+   int pure; /**< Whether it is marked with NLUA_INCLUDE_PURE. */
+   nlua_env env; /**< Environment a pure library was run in, or LUA_NOREF. */
+   int ret; /**< Reference to what a pure library returned, or LUA_NOREF. */
+} LuaInclude;
+static LuaInclude *nlua_includes = NULL; /**< Libraries included this run. */
+static NameHash nlua_includeHash; /**< Maps paths to nlua_includes. */
+static int nlua_cacheDir = 0; /**< Whether the cache directory was created. */
+static int nlua_gcActive = 0; /**< Whether a collection cycle is being stepped. */
+static int nlua_gcBase = 0; /**< Lua memory in KB after the last collection. */
+static int nlua_profOn = 0; /**< Whether the profiler is recording. */
+static NLuaProfEntry *nlua_prof = NULL; /**< Profiled functions. */
+static NameHash nlua_profHash; /**< Maps names to nlua_prof. */
+
+
+/**
+ * @brief Header in front of every block given to Lua.
+ */
+typedef union NLuaBlock_ {
+   int env; /**< Slot of the environment the block is charged to. */
+   union NLuaBlock_ *next; /**< Next free block when in a pool. */
+   double align; /**< Keeps the data aligned. */
+} NLuaBlock;
+
+/**
+ * @brief Memory charged to an environment.
+ */
+typedef struct NLuaMemEnv_ {
+   size_t bytes; /**< Bytes allocated while it was running. */
+   size_t limit; /**< Maximum bytes, 0 for no limit. */
+   int warned; /**< Whether going over the limit was reported. */
+} NLuaMemEnv;
+static NLuaBlock *nlua_pools[NLUA_POOL_CLASSES]; /**< Free blocks of each size class. */
+static void **nlua_poolChunks = NULL; /**< Chunks the pools are carved from. */
+static NLuaMemEnv *nlua_memEnvs = NULL; /**< Charges indexed by slot, slot 0 is shared. */
+static int nlua_nmemEnvs = 0; /**< Number of slots in nlua_memEnvs. */
+static int nlua_memOn = 0; /**< Whether the state uses nlua_alloc(). */
+
+
 /*
  * prototypes
  */
 static int nlua_packfileLoader( lua_State* L );
+static void nlua_chunkKey( char *key, const char *buff, size_t sz, const char *name );
+static int nlua_chunkWriter( lua_State *L, const void *p, size_t sz, void *ud );
+static void nlua_chunkAdd( const char *key, char *data, size_t len );
+static void nlua_chunkFree (void);
+static int nlua_chunkLoad( lua_State *L, const char *buff, size_t sz,
+      const char *name, int *chunk );
+static int nlua_includeFind( const char *filename );
+static int nlua_includeGet( lua_State *L, const char *filename );
+static int nlua_includeRun( lua_State *L, int inc, int envtab );
+static void nlua_includeShare( lua_State *L, int inc, int envtab );
+static double nlua_clock (void);
+static int nlua_profCmp( const void *p1, const void *p2 );
+static void nlua_profDump (void);
+static void* nlua_alloc( void *ud, void *ptr, size_t osize, size_t nsize );
+static NLuaBlock* nlua_poolAlloc( int cls );
+static void nlua_poolExit (void);
+static int nlua_memSlot( nlua_env env, int create );
+static int nlua_panic( lua_State *L );
 lua_State *nlua_newState (void); /* creates a new state */
 int nlua_loadBasic( lua_State* L );
 int nlua_errTrace( lua_State *L );
@@ -53,6 +152,12 @@ int nlua_errTrace( lua_State *L );
 void lua_init(void) {
    naevL = nlua_newState();
    nlua_loadBasic(naevL);
+
+   /* Collection is stepped every frame, the automatic one only kicks in
+    * if that falls behind. */
+   lua_gc(naevL, LUA_GCSETPAUSE, NLUA_GC_PAUSE);
+   nlua_gcActive  = 0;
+   nlua_gcBase    = lua_gc(naevL, LUA_GCCOUNT, 0);
 }
 
 
@@ -62,6 +167,644 @@ void lua_init(void) {
 void lua_exit(void) {
    lua_close(naevL);
    naevL = NULL;
+   nlua_poolExit();
+   nlua_chunkFree();
+   nlua_profDump();
+   nlua_profClear();
+}
+
+
+/*
+ * @brief Turns the Lua profiler on or off.
+ *
+ *    @param enable Whether to record calls.
+ */
+void nlua_profEnable( int enable )
+{
+   nlua_profOn = enable;
+}
+
+
+/*
+ * @brief Checks whether the Lua profiler is recording.
+ */
+int nlua_profEnabled (void)
+{
+   return nlua_profOn;
+}
+
+
+/*
+ * @brief Starts timing a profiled call.
+ *
+ *    @return Start time or a negative value if the profiler is off.
+ */
+double nlua_profStart (void)
+{
+   if (!nlua_profOn)
+      return -1.;
+   return nlua_clock();
+}
+
+
+/*
+ * @brief Stops timing a profiled call and records it.
+ *
+ * Times are inclusive, nested profiled calls count towards every caller.
+ *
+ *    @param t0 Value returned by nlua_profStart().
+ *    @param fmt Printf-like name of the call.
+ */
+void nlua_profStop( double t0, const char *fmt, ... )
+{
+   char name[NLUA_PROF_NAME];
+   NLuaProfEntry *e;
+   va_list ap;
+   double dt;
+   int i;
+
+   if (t0 < 0.)
+      return;
+   dt = nlua_clock() - t0;
+
+   va_start(ap, fmt);
+   vsnprintf(name, sizeof(name), fmt, ap);
+   va_end(ap);
+
+   if (nlua_prof == NULL) {
+      nlua_prof = array_create( NLuaProfEntry );
+      nhash_init( &nlua_profHash );
+   }
+
+   i = nhash_get( &nlua_profHash, name );
+   if (i < 0) {
+      e        = &array_grow( &nlua_prof );
+      e->name  = strdup( name );
+      e->calls = 0;
+      e->time  = 0.;
+      e->max   = 0.;
+      i        = array_size( nlua_prof ) - 1;
+      nhash_set( &nlua_profHash, e->name, i );
+   }
+   e = &nlua_prof[i];
+   e->calls++;
+   e->time += dt;
+   if (dt > e->max)
+      e->max = dt;
+}
+
+
+/*
+ * @brief Compares profiled functions by total time, largest first.
+ */
+static int nlua_profCmp( const void *p1, const void *p2 )
+{
+   const NLuaProfEntry *e1, *e2;
+   e1 = (const NLuaProfEntry*) p1;
+   e2 = (const NLuaProfEntry*) p2;
+   if (e1->time > e2->time)
+      return -1;
+   if (e1->time < e2->time)
+      return +1;
+   return strcmp( e1->name, e2->name );
+}
+
+
+/*
+ * @brief Gets the profiled functions sorted by total time.
+ *
+ *    @param[out] entries Profiled functions, owned by the profiler.
+ *    @return Number of profiled functions.
+ */
+int nlua_profGet( const NLuaProfEntry **entries )
+{
+   int i, n;
+
+   *entries = nlua_prof;
+   if (nlua_prof == NULL)
+      return 0;
+
+   /* Sorting moves the entries around so the hash must be rebuilt. */
+   n = array_size( nlua_prof );
+   qsort( nlua_prof, n, sizeof(NLuaProfEntry), nlua_profCmp );
+   nhash_clear( &nlua_profHash );
+   for (i=0; i<n; i++)
+      nhash_set( &nlua_profHash, nlua_prof[i].name, i );
+   return n;
+}
+
+
+/*
+ * @brief Clears the recorded profile.
+ */
+void nlua_profClear (void)
+{
+   int i;
+
+   if (nlua_prof == NULL)
+      return;
+
+   for (i=0; i<array_size(nlua_prof); i++)
+      free( nlua_prof[i].name );
+   array_free( nlua_prof );
+   nlua_prof = NULL;
+   nhash_free( &nlua_profHash );
+}
+
+
+/*
+ * @brief Dumps the recorded profile as CSV into the data directory.
+ */
+static void nlua_profDump (void)
+{
+   const NLuaProfEntry *e;
+   char file[PATH_MAX];
+   FILE *f;
+   int i, n;
+
+   n = nlua_profGet( &e );
+   if (n == 0)
+      return;
+
+   nsnprintf( file, sizeof(file), "%s"NLUA_PROF_CSV, nfile_dataPath() );
+   f = fopen( file, "w" );
+   if (f == NULL) {
+      WARN("Unable to open '%s' to write the Lua profile.", file);
+      return;
+   }
+   fprintf( f, "name,calls,total_ms,mean_ms,max_ms\n" );
+   for (i=0; i<n; i++)
+      fprintf( f, "\"%s\",%lu,%.3f,%.4f,%.4f\n", e[i].name, e[i].calls,
+            e[i].time*1000., e[i].time*1000./(double)e[i].calls,
+            e[i].max*1000. );
+   fclose( f );
+   DEBUG("Lua profile written to '%s'.", file);
+}
+
+
+/*
+ * @brief Gets a high resolution clock in seconds.
+ */
+static double nlua_clock (void)
+{
+#if SDL_VERSION_ATLEAST(2,0,0)
+   return (double)SDL_GetPerformanceCounter() /
+         (double)SDL_GetPerformanceFrequency();
+#else /* SDL_VERSION_ATLEAST(2,0,0) */
+   return (double)SDL_GetTicks() / 1000.;
+#endif /* SDL_VERSION_ATLEAST(2,0,0) */
+}
+
+
+/*
+ * @brief Runs incremental garbage collection for at most a frame's budget.
+ *
+ * A cycle starts once memory has grown enough since the last one and is then
+ *  spread over as many frames as needed.
+ */
+void nlua_gcStep (void)
+{
+   double t0;
+
+   if (!nlua_gcActive) {
+      if (lua_gc(naevL, LUA_GCCOUNT, 0) < NLUA_GC_GROWTH * nlua_gcBase)
+         return;
+      nlua_gcActive = 1;
+   }
+
+   t0 = nlua_clock();
+   do {
+      /* Finished the cycle. */
+      if (lua_gc(naevL, LUA_GCSTEP, 0)) {
+         nlua_gcActive  = 0;
+         nlua_gcBase    = lua_gc(naevL, LUA_GCCOUNT, 0);
+         break;
+      }
+   } while (nlua_clock() - t0 < NLUA_GC_BUDGET);
+}
+
+
+/*
+ * @brief Gets the slot of an environment in nlua_memEnvs.
+ *
+ *    @param env Environment, anything not created by nlua_newEnv() is shared.
+ *    @param create Whether to grow nlua_memEnvs to fit it.
+ *    @return The slot or -1 if not there and not created.
+ */
+static int nlua_memSlot( nlua_env env, int create )
+{
+   NLuaMemEnv *p;
+   int n;
+
+   if (env <= 0)
+      env = 0;
+   if (env < nlua_nmemEnvs)
+      return env;
+   if (!create)
+      return -1;
+
+   n = MAX( 2*nlua_nmemEnvs, env+1 );
+   p = realloc( nlua_memEnvs, n * sizeof(NLuaMemEnv) );
+   if (p == NULL)
+      return 0;
+   memset( &p[nlua_nmemEnvs], 0, (n-nlua_nmemEnvs) * sizeof(NLuaMemEnv) );
+   nlua_memEnvs   = p;
+   nlua_nmemEnvs  = n;
+   return env;
+}
+
+
+/*
+ * @brief Takes a block from a pool, carving a new chunk if it is empty.
+ *
+ *    @param cls Size class of the block.
+ *    @return The block or NULL if out of memory.
+ */
+static NLuaBlock* nlua_poolAlloc( int cls )
+{
+   NLuaBlock *b;
+   char *chunk;
+   size_t size;
+   int i, n;
+
+   b = nlua_pools[cls];
+   if (b == NULL) {
+      chunk = malloc( NLUA_POOL_CHUNK );
+      if (chunk == NULL)
+         return NULL;
+      if (nlua_poolChunks == NULL)
+         nlua_poolChunks = array_create( void* );
+      array_push_back( &nlua_poolChunks, (void*)chunk );
+
+      size  = (cls+1) * NLUA_POOL_GRAIN;
+      n     = NLUA_POOL_CHUNK / size;
+      for (i=0; i<n; i++) {
+         b        = (NLuaBlock*)&chunk[i*size];
+         b->next  = nlua_pools[cls];
+         nlua_pools[cls] = b;
+      }
+      b = nlua_pools[cls];
+   }
+   nlua_pools[cls] = b->next;
+   return b;
+}
+
+
+/*
+ * @brief Frees the pools once the state that used them is closed.
+ */
+static void nlua_poolExit (void)
+{
+   int i;
+
+   if (nlua_poolChunks != NULL) {
+      for (i=0; i<array_size(nlua_poolChunks); i++)
+         free( nlua_poolChunks[i] );
+      array_free( nlua_poolChunks );
+      nlua_poolChunks = NULL;
+   }
+   memset( nlua_pools, 0, sizeof(nlua_pools) );
+   free( nlua_memEnvs );
+   nlua_memEnvs   = NULL;
+   nlua_nmemEnvs  = 0;
+   nlua_memOn     = 0;
+}
+
+
+/*
+ * @brief Allocator used by the Lua state.
+ *
+ * Small blocks come from pools of fixed size classes so the many short-lived
+ *  strings and tables don't each go through malloc. Every block is charged to
+ *  the environment running when it was allocated, which can have a limit:
+ *  going over it raises a memory error in the offending script.
+ */
+static void* nlua_alloc( void *ud, void *ptr, size_t osize, size_t nsize )
+{
+   NLuaBlock *b, *nb;
+   NLuaMemEnv *m;
+   int ocls, ncls, slot;
+   (void) ud;
+
+   /* The old size is only meaningful for existing blocks. */
+   b     = (ptr != NULL) ? (NLuaBlock*)ptr - 1 : NULL;
+   osize = (b != NULL) ? osize : 0;
+   ocls  = (b != NULL) ? (int)((osize + sizeof(NLuaBlock) - 1) / NLUA_POOL_GRAIN) : -1;
+   ncls  = (nsize > 0) ? (int)((nsize + sizeof(NLuaBlock) - 1) / NLUA_POOL_GRAIN) : -1;
+
+   /* Free. */
+   if (nsize == 0) {
+      if (b == NULL)
+         return NULL;
+      m = &nlua_memEnvs[ b->env ];
+      m->bytes -= MIN( m->bytes, osize );
+      if (ocls < NLUA_POOL_CLASSES) {
+         b->next = nlua_pools[ocls];
+         nlua_pools[ocls] = b;
+      }
+      else
+         free( b );
+      return NULL;
+   }
+
+   /* Shrinking is not allowed to fail so only growth is limited. */
+   slot  = (b != NULL) ? b->env : nlua_memSlot( __NLUA_CURENV, 1 );
+   m     = &nlua_memEnvs[ slot ];
+   if ((nsize > osize) && (m->limit > 0) && (m->bytes + nsize - osize > m->limit)) {
+      if (!m->warned)
+         WARN("Lua environment went over its memory limit of %lu KiB.",
+               (unsigned long)(m->limit / 1024));
+      m->warned = 1;
+      return NULL;
+   }
+
+   /* Stays in the same block. */
+   if ((b != NULL) && (ocls == ncls) && (ncls < NLUA_POOL_CLASSES))
+      nb = b;
+   else if ((b != NULL) && (ocls >= NLUA_POOL_CLASSES) && (ncls >= NLUA_POOL_CLASSES)) {
+      nb = realloc( b, nsize + sizeof(NLuaBlock) );
+      if (nb == NULL)
+         return NULL;
+   }
+   else {
+      nb = (ncls < NLUA_POOL_CLASSES) ? nlua_poolAlloc( ncls ) :
+            malloc( nsize + sizeof(NLuaBlock) );
+      if (nb == NULL)
+         return NULL;
+      if (b != NULL) {
+         memcpy( nb+1, ptr, MIN( osize, nsize ) );
+         if (ocls < NLUA_POOL_CLASSES) {
+            b->next = nlua_pools[ocls];
+            nlua_pools[ocls] = b;
+         }
+         else
+            free( b );
+      }
+   }
+
+   nb->env   = slot;
+   m->bytes += nsize;
+   m->bytes -= MIN( m->bytes, osize );
+   return nb+1;
+}
+
+
+/*
+ * @brief Reports an error outside of any protected call before Lua aborts.
+ */
+static int nlua_panic( lua_State *L )
+{
+   WARN("Unprotected error in Lua: %s", lua_tostring(L, -1));
+   return 0;
+}
+
+
+/*
+ * @brief Gets the memory charged to an environment.
+ *
+ *    @param env Environment to check.
+ *    @return Bytes allocated while it ran that are not yet collected.
+ */
+size_t nlua_envMemUsage( nlua_env env )
+{
+   int slot;
+
+   if (!nlua_memOn || (env <= 0))
+      return 0;
+   slot = nlua_memSlot( env, 0 );
+   return (slot < 0) ? 0 : nlua_memEnvs[slot].bytes;
+}
+
+
+/*
+ * @brief Limits the memory an environment can have allocated.
+ *
+ * Garbage counts until collected, so the limit is best kept well above what
+ *  the scripts actually need. It has no effect if the Lua implementation
+ *  doesn't allow custom allocators.
+ *
+ *    @param env Environment to limit.
+ *    @param limit Maximum bytes, 0 for no limit.
+ */
+void nlua_setMemLimit( nlua_env env, size_t limit )
+{
+   int slot;
+
+   if (!nlua_memOn || (env <= 0))
+      return;
+   slot = nlua_memSlot( env, 1 );
+   if (slot == 0)
+      return;
+   nlua_memEnvs[slot].limit   = limit;
+   nlua_memEnvs[slot].warned  = 0;
+}
+
+
+/*
+ * @brief Gets the memory used by the Lua state.
+ *
+ *    @return Bytes allocated by Lua, garbage included.
+ */
+size_t nlua_memUsage (void)
+{
+   if (naevL == NULL)
+      return 0;
+   return (size_t)lua_gc(naevL, LUA_GCCOUNT, 0) * 1024 +
+         (size_t)lua_gc(naevL, LUA_GCCOUNTB, 0);
+}
+
+
+/*
+ * @brief Gets the cache key of a chunk.
+ *
+ * The key covers the Lua implementation so bytecode from another build is
+ *  never picked up.
+ *
+ *    @param[out] key Key of size NLUA_CACHE_KEY.
+ *    @param buff Source of the chunk.
+ *    @param sz Size of the source.
+ *    @param name Name of the chunk.
+ */
+static void nlua_chunkKey( char *key, const char *buff, size_t sz, const char *name )
+{
+   const char *tag;
+   uint64_t h;
+   size_t i;
+
+#ifdef HAVE_LUAJIT
+   tag = LUA_RELEASE" jit";
+#else /* HAVE_LUAJIT */
+   tag = LUA_RELEASE;
+#endif /* HAVE_LUAJIT */
+
+   /* FNV-1a. */
+   h = UINT64_C(14695981039346656037);
+   for (i=0; tag[i] != '\0'; i++)
+      h = (h ^ (unsigned char)tag[i]) * UINT64_C(1099511628211);
+   for (i=0; name[i] != '\0'; i++)
+      h = (h ^ (unsigned char)name[i]) * UINT64_C(1099511628211);
+   for (i=0; i<sz; i++)
+      h = (h ^ (unsigned char)buff[i]) * UINT64_C(1099511628211);
+
+   nsnprintf( key, NLUA_CACHE_KEY, "%016"PRIx64"%08x", h, (unsigned int)sz );
+}
+
+
+/*
+ * @brief Appends dumped bytecode to a chunk.
+ */
+static int nlua_chunkWriter( lua_State *L, const void *p, size_t sz, void *ud )
+{
+   LuaChunk *c;
+   (void) L;
+
+   c        = (LuaChunk*) ud;
+   c->data  = realloc( c->data, c->len + sz );
+   memcpy( &c->data[ c->len ], p, sz );
+   c->len  += sz;
+   return 0;
+}
+
+
+/*
+ * @brief Keeps a compiled chunk in memory, taking ownership of data.
+ */
+static void nlua_chunkAdd( const char *key, char *data, size_t len )
+{
+   LuaChunk *c;
+
+   if (nlua_chunks == NULL) {
+      nlua_chunks = array_create( LuaChunk );
+      nhash_init( &nlua_chunkHash );
+   }
+
+   /* Keys are owned by the chunks so they survive the array moving. */
+   c        = &array_grow( &nlua_chunks );
+   c->key   = strdup( key );
+   c->data  = data;
+   c->len   = len;
+   nhash_set( &nlua_chunkHash, c->key, array_size(nlua_chunks)-1 );
+}
+
+
+/*
+ * @brief Frees the chunks kept in memory.
+ */
+static void nlua_chunkFree (void)
+{
+   int i;
+
+   if (nlua_chunks == NULL)
+      return;
+
+   for (i=0; i<array_size(nlua_chunks); i++) {
+      free( nlua_chunks[i].key );
+      free( nlua_chunks[i].data );
+   }
+   array_free( nlua_chunks );
+   nlua_chunks = NULL;
+   nhash_free( &nlua_chunkHash );
+
+   /* Includes point into the chunks, their references die with the state. */
+   if (nlua_includes == NULL)
+      return;
+   for (i=0; i<array_size(nlua_includes); i++)
+      free( nlua_includes[i].path );
+   array_free( nlua_includes );
+   nlua_includes = NULL;
+   nhash_free( &nlua_includeHash );
+}
+
+
+/*
+ * @brief Loads a chunk, reusing bytecode compiled from the same source.
+ *
+ * Bytecode is looked up first in memory and then in the cache directory,
+ *  falling back to compiling the source and storing the result in both.
+ *
+ *    @param L Lua state.
+ *    @param buff Pointer to source buffer.
+ *    @param sz Size of buffer.
+ *    @param name Name to use in error messages.
+ *    @return 0 on success like luaL_loadbuffer.
+ */
+int nlua_loadbuffer( lua_State *L, const char *buff, size_t sz, const char *name )
+{
+   return nlua_chunkLoad( L, buff, sz, name, NULL );
+}
+
+
+/*
+ * @brief Loads a chunk like nlua_loadbuffer() and says where it is kept.
+ *
+ *    @param[out] chunk Set to the chunk in nlua_chunks or -1 if it couldn't
+ *                be kept, may be NULL.
+ */
+static int nlua_chunkLoad( lua_State *L, const char *buff, size_t sz,
+      const char *name, int *chunk )
+{
+   char key[NLUA_CACHE_KEY];
+   LuaChunk c;
+   char *data;
+   int i, len, ret;
+
+   if (chunk != NULL)
+      *chunk = -1;
+   nlua_chunkKey( key, buff, sz, name );
+
+   /* Already compiled this run. */
+   if (nlua_chunks != NULL) {
+      i = nhash_get( &nlua_chunkHash, key );
+      if (i >= 0) {
+         if (luaL_loadbuffer( L, nlua_chunks[i].data,
+                  nlua_chunks[i].len, name ) == 0) {
+            if (chunk != NULL)
+               *chunk = i;
+            return 0;
+         }
+         lua_pop( L, 1 );
+      }
+   }
+
+   /* Compiled by a previous run. */
+   data = nfile_readFile( &len, "%s"NLUA_CACHE_PATH"%s.luac",
+         nfile_cachePath(), key );
+   if (data != NULL) {
+      if (luaL_loadbuffer( L, data, len, name ) == 0) {
+         nlua_chunkAdd( key, data, len );
+         if (chunk != NULL)
+            *chunk = array_size(nlua_chunks)-1;
+         return 0;
+      }
+      /* Stale or broken, recompile. */
+      lua_pop( L, 1 );
+      free( data );
+   }
+
+   /* Compile from source, errors are left for the caller. */
+   ret = luaL_loadbuffer( L, buff, sz, name );
+   if (ret != 0)
+      return ret;
+
+   c.data   = NULL;
+   c.len    = 0;
+   if ((lua_dump( L, nlua_chunkWriter, &c ) != 0) || (c.data == NULL)) {
+      free( c.data );
+      return 0;
+   }
+
+   if (!nlua_cacheDir) {
+      nfile_dirMakeExist( "%s", nfile_cachePath() );
+      nfile_dirMakeExist( "%s"NLUA_CACHE_PATH, nfile_cachePath() );
+      nlua_cacheDir = 1;
+   }
+   if (nfile_writeFile( c.data, c.len, "%s"NLUA_CACHE_PATH"%s.luac",
+            nfile_cachePath(), key ))
+      WARN("Unable to write Lua bytecode cache for '%s'.", name);
+   nlua_chunkAdd( key, c.data, c.len );
+   if (chunk != NULL)
+      *chunk = array_size(nlua_chunks)-1;
+   return 0;
 }
 
 
@@ -77,7 +820,7 @@ int nlua_dobufenv(nlua_env env,
                   const char *buff,
                   size_t sz,
                   const char *name) {
-   if (luaL_loadbuffer(naevL, buff, sz, name) != 0)
+   if (nlua_loadbuffer(naevL, buff, sz, name) != 0)
       return -1;
    nlua_pushenv(env);
    lua_setfenv(naevL, -2);
@@ -146,8 +889,17 @@ nlua_env nlua_newEnv(int rw) {
  *    @param env Enviornment to free.
  */
 void nlua_freeEnv(nlua_env env) {
-   if (naevL != NULL)
-      luaL_unref(naevL, LUA_REGISTRYINDEX, env);
+   int slot;
+
+   if (naevL == NULL)
+      return;
+
+   /* The reference gets reused so charges start over. Blocks still around
+    * get collected against the new owner, which is bounded at 0. */
+   slot = nlua_memOn ? nlua_memSlot( env, 0 ) : -1;
+   if (slot > 0)
+      memset( &nlua_memEnvs[slot], 0, sizeof(NLuaMemEnv) );
+   luaL_unref(naevL, LUA_REGISTRYINDEX, env);
 }
 
 
@@ -217,7 +969,10 @@ void nlua_register(nlua_env env, const char *libname,
 
 
 /**
- * @brief Wrapper around luaL_newstate.
+ * @brief Creates a new Lua state using nlua_alloc().
+ *
+ * 64 bit LuaJIT without GC64 doesn't allow custom allocators, in which case
+ *  its own is used and environments are not accounted for.
  *
  *    @return A newly created lua_State.
  */
@@ -226,7 +981,16 @@ lua_State *nlua_newState (void)
    lua_State *L;
 
    /* try to create the new state */
-   L = luaL_newstate();
+   nlua_memSlot( LUA_NOREF, 1 );
+   L = lua_newstate( nlua_alloc, NULL );
+   if (L != NULL) {
+      lua_atpanic( L, nlua_panic );
+      nlua_memOn = 1;
+   }
+   else {
+      nlua_poolExit();
+      L = luaL_newstate();
+   }
    if (L == NULL) {
       WARN("Failed to create new Lua state.");
       return NULL;
@@ -278,44 +1042,46 @@ int nlua_loadBasic( lua_State* L )
 }
 
 
-/**
- * @brief include( string module )
+/*
+ * @brief Finds a library included this run.
  *
- * Loads a module into the current Lua state from inside the data file.
+ *    @param filename Name passed to include().
+ *    @return Index in nlua_includes or -1 if not found.
+ */
+static int nlua_includeFind( const char *filename )
+{
+   if (nlua_includes == NULL)
+      return -1;
+   return nhash_get( &nlua_includeHash, filename );
+}
+
+
+/*
+ * @brief Finds an included library, reading and compiling it the first time.
  *
- *    @param module Name of the module to load.
- *    @return The return value of the chunk, or true.
+ * Leaves the compiled chunk on the stack.
+ *
+ *    @param L Lua state.
+ *    @param filename Name passed to include().
+ *    @return Index in nlua_includes or -1 if it couldn't be kept, the chunk
+ *            is still pushed unless there was an error.
  */
-static int nlua_packfileLoader( lua_State* L )
+static int nlua_includeGet( lua_State *L, const char *filename )
 {
-   const char *filename;
+   LuaInclude *inc;
    char *path_filename;
    char *buf;
-   int len;
+   int i, len, chunk, pure;
    uint32_t bufsize;
-   int envtab;
-
-   /* Environment table to load module into */
-   envtab = lua_upvalueindex(1);
-
-   /* Get parameters. */
-   filename = luaL_checkstring(L,1);
 
-   /* Check to see if already included. */
-   lua_getfield( L, envtab, "_include" ); /* t */
-   if (!lua_isnil(L,-1)) {
-      lua_getfield(L,-1,filename); /* t, f */
-      /* Already included. */
-      if (!lua_isnil(L,-1)) {
-         lua_remove(L, -2); /* val */
-         return 1;
-      }
-      lua_pop(L,2); /* */
-   }
-   /* Must create new _include table. */
-   else {
-      lua_newtable(L);              /* t */
-      lua_setfield(L, envtab, "_include"); /* */
+   /* Read and compiled by another environment. */
+   i = nlua_includeFind( filename );
+   if (i >= 0) {
+      inc = &nlua_includes[i];
+      if (luaL_loadbuffer( L, nlua_chunks[inc->chunk].data,
+               nlua_chunks[inc->chunk].len, filename ) != 0)
+         lua_error(L);
+      return i;
    }
 
    /* Try to locate the data directly */
@@ -337,22 +1103,165 @@ static int nlua_packfileLoader( lua_State* L )
    if (buf == NULL) {
       DEBUG("include(): %s not found in ndata.", filename);
       luaL_error(L, "include(): %s not found in ndata.", filename);
-      return 1;
+      return -1;
    }
 
-   if (luaL_loadbuffer(L, buf, bufsize, filename) != 0) {
+   pure = (bufsize >= strlen(NLUA_INCLUDE_PURE)) &&
+         (strncmp( buf, NLUA_INCLUDE_PURE, strlen(NLUA_INCLUDE_PURE) ) == 0);
+   if (nlua_chunkLoad(L, buf, bufsize, filename, &chunk) != 0) {
+      free(buf);
       lua_error(L);
-      return 1;
+      return -1;
    }
+   free(buf);
+   if (chunk < 0)
+      return -1;
 
-   lua_pushvalue(L, envtab);
+   if (nlua_includes == NULL) {
+      nlua_includes = array_create( LuaInclude );
+      nhash_init( &nlua_includeHash );
+   }
+   inc         = &array_grow( &nlua_includes );
+   inc->path   = strdup( filename );
+   inc->chunk  = chunk;
+   inc->pure   = pure;
+   inc->env    = LUA_NOREF;
+   inc->ret    = LUA_NOREF;
+   nhash_set( &nlua_includeHash, inc->path, array_size(nlua_includes)-1 );
+   return array_size(nlua_includes)-1;
+}
+
+
+/*
+ * @brief Runs the chunk of an included library on the stack.
+ *
+ * Pure libraries are run once in an environment of their own, what they
+ *  return is kept to hand out to every environment including them and
+ *  nothing is left on the stack.
+ *
+ * nlua_includes may move while the library runs, since it can include others.
+ *
+ *    @param L Lua state.
+ *    @param inc Library being included or -1 if it isn't kept.
+ *    @param envtab Index of the environment including it.
+ *    @return 1 if it was run in the environment including it, 0 if it was run
+ *            in its own.
+ */
+static int nlua_includeRun( lua_State *L, int inc, int envtab )
+{
+   nlua_env env;
+   int own;
+
+   own = (inc >= 0) && nlua_includes[inc].pure;
+   env = LUA_NOREF;
+   if (own) {
+      env = nlua_newEnv(0);
+      nlua_pushenv( env );
+   }
+   else
+      lua_pushvalue(L, envtab);
    lua_setfenv(L, -2);
 
    /* run the buffer */
    if (lua_pcall(L, 0, 1, 0) != 0) {
       /* will push the current error from the dobuffer */
+      if (own)
+         nlua_freeEnv( env );
       lua_error(L);
-      return 1;
+   }
+
+   if (own) {
+      if (lua_isnil(L,-1)) {
+         lua_pop(L, 1);
+         lua_pushboolean(L, 1);
+      }
+      nlua_includes[inc].env = env;
+      nlua_includes[inc].ret = luaL_ref(L, LUA_REGISTRYINDEX);
+   }
+   return !own;
+}
+
+
+/*
+ * @brief Gives an environment the globals defined by a pure library.
+ *
+ *    @param L Lua state.
+ *    @param inc Pure library that was already run.
+ *    @param envtab Index of the environment including it.
+ */
+static void nlua_includeShare( lua_State *L, int inc, int envtab )
+{
+   const char *k;
+
+   nlua_pushenv( nlua_includes[inc].env ); /* env */
+   lua_pushnil(L); /* env, nil */
+   while (lua_next(L, -2) != 0) { /* env, k, v */
+      /* Skip what every environment has of its own. */
+      k = (lua_type(L, -2) == LUA_TSTRING) ? lua_tostring(L, -2) : NULL;
+      if ((k != NULL) && ((strcmp(k, "include") == 0) || (strcmp(k, "_G") == 0) ||
+               (strcmp(k, "__RW") == 0) || (strcmp(k, "_include") == 0))) {
+         lua_pop(L, 1); /* env, k */
+         continue;
+      }
+      lua_pushvalue(L, -2); /* env, k, v, k */
+      lua_insert(L, -2); /* env, k, k, v */
+      lua_rawset(L, envtab); /* env, k */
+   }
+   lua_pop(L, 1); /* */
+
+   lua_rawgeti(L, LUA_REGISTRYINDEX, nlua_includes[inc].ret); /* val */
+}
+
+
+/**
+ * @brief include( string module )
+ *
+ * Loads a module into the current Lua state from inside the data file.
+ *
+ * Libraries are read and compiled once per run. Those whose first line is
+ *  "-- @pure" are also only run once, the globals they define and what they
+ *  return are then shared by all the environments including them. They must
+ *  not keep any state or use the globals of whoever includes them.
+ *
+ *    @param module Name of the module to load.
+ *    @return The return value of the chunk, or true.
+ */
+static int nlua_packfileLoader( lua_State* L )
+{
+   const char *filename;
+   int inc, envtab;
+
+   /* Environment table to load module into */
+   envtab = lua_upvalueindex(1);
+
+   /* Get parameters. */
+   filename = luaL_checkstring(L,1);
+
+   /* Check to see if already included. */
+   lua_getfield( L, envtab, "_include" ); /* t */
+   if (!lua_isnil(L,-1)) {
+      lua_getfield(L,-1,filename); /* t, f */
+      /* Already included. */
+      if (!lua_isnil(L,-1)) {
+         lua_remove(L, -2); /* val */
+         return 1;
+      }
+      lua_pop(L,2); /* */
+   }
+   /* Must create new _include table. */
+   else {
+      lua_newtable(L);              /* t */
+      lua_setfield(L, envtab, "_include"); /* */
+   }
+
+   /* Pure libraries already run by another environment. */
+   inc = nlua_includeFind( filename );
+   if ((inc >= 0) && (nlua_includes[inc].ret != LUA_NOREF))
+      nlua_includeShare( L, inc, envtab ); /* val */
+   else {
+      inc = nlua_includeGet( L, filename ); /* f */
+      if (!nlua_includeRun( L, inc, envtab )) /* val or nothing */
+         nlua_includeShare( L, inc, envtab ); /* val */
    }
 
    /* Mark as loaded. */
@@ -367,7 +1276,6 @@ static int nlua_packfileLoader( lua_State* L )
    lua_pop(L, 1); /* val */
 
    /* cleanup, success */
-   free(buf);
    return 1;
 }
 
@@ -465,6 +1373,15 @@ int nlua_errTrace( lua_State *L )
  */
 int nlua_pcall( nlua_env env, int nargs, int nresults ) {
    int errf, ret, top, prev_env;
+   lua_Debug ar;
+   double t0;
+
+   /* Identify the function before it gets consumed. */
+   t0 = nlua_profStart();
+   if (t0 >= 0.) {
+      lua_pushvalue(naevL, -1-nargs);
+      lua_getinfo(naevL, ">S", &ar);
+   }
 
 #if DEBUGGING
    top = lua_gettop(naevL);
@@ -482,6 +1399,9 @@ int nlua_pcall( nlua_env env, int nargs, int nresults ) {
 
    __NLUA_CURENV = prev_env;
 
+   if (t0 >= 0.)
+      nlua_profStop( t0, "lua:%s:%d", ar.short_src, ar.linedefined );
+
 #if DEBUGGING
    lua_remove(naevL, top-nargs);
 #endif /* DEBUGGING */
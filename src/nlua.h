@@ -12,8 +12,19 @@
 
 
 #define NLUA_DONE       "__done__"
+#define NLUA_PROF_CSV   "lua_profile.csv" /**< Profile dump, relative to the data directory. */
 
 typedef int nlua_env;
+
+/**
+ * @brief Profiled Lua function.
+ */
+typedef struct NLuaProfEntry_ {
+   char *name; /**< Name of the function. */
+   unsigned long calls; /**< Number of calls. */
+   double time; /**< Cumulative time in seconds. */
+   double max; /**< Longest call in seconds. */
+} NLuaProfEntry;
 extern lua_State *naevL;
 extern nlua_env __NLUA_CURENV;
 
@@ -22,6 +33,10 @@ extern nlua_env __NLUA_CURENV;
  */
 void lua_init(void);
 void lua_exit(void);
+void nlua_gcStep (void);
+size_t nlua_memUsage (void);
+size_t nlua_envMemUsage( nlua_env env );
+void nlua_setMemLimit( nlua_env env, size_t limit );
 nlua_env nlua_newEnv(int rw);
 void nlua_freeEnv(nlua_env env);
 void nlua_pushenv(nlua_env env);
@@ -29,6 +44,7 @@ void nlua_setenv(nlua_env env, const char *name);
 void nlua_getenv(nlua_env env, const char *name);
 void nlua_register(nlua_env env, const char *libname,
                    const luaL_Reg *l, int metatable);
+int nlua_loadbuffer( lua_State *L, const char *buff, size_t sz, const char *name );
 int nlua_dobufenv(nlua_env env,
                   const char *buff,
                   size_t sz,
@@ -37,4 +53,14 @@ int nlua_dofileenv(nlua_env env, const char *filename);
 int nlua_loadStandard( nlua_env env );
 int nlua_pcall( nlua_env env, int nargs, int nresults );
 
+/*
+ * profiling
+ */
+void nlua_profEnable( int enable );
+int nlua_profEnabled (void);
+double nlua_profStart (void);
+void nlua_profStop( double t0, const char *fmt, ... );
+int nlua_profGet( const NLuaProfEntry **entries );
+void nlua_profClear (void);
+
 #endif /* NLUA_H */
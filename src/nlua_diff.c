@@ -30,10 +30,14 @@
 static int diff_applyL( lua_State *L );
 static int diff_removeL( lua_State *L );
 static int diff_isappliedL( lua_State *L );
+static int diff_batchBeginL( lua_State *L );
+static int diff_batchEndL( lua_State *L );
 static const luaL_reg diff_methods[] = {
    { "apply", diff_applyL },
    { "remove", diff_removeL },
    { "isApplied", diff_isappliedL },
+   { "batchBegin", diff_batchBeginL },
+   { "batchEnd", diff_batchEndL },
    {0,0}
 }; /**< Unidiff Lua methods. */
 
@@ -61,6 +65,15 @@ int nlua_loadDiff( nlua_env env )
  * diff.apply( "collective_dead" )
  * @endcode
  *
+ * When applying several diffs at once, wrap them in a batch so the universe is
+ *  only rebuilt once:
+ * @code
+ * diff.batchBegin()
+ * diff.apply( "collective_dead" )
+ * diff.apply( "collective_dead_2" )
+ * diff.batchEnd()
+ * @endcode
+ *
  * @luamod diff
  */
 /**
@@ -113,3 +126,27 @@ static int diff_isappliedL( lua_State *L )
    lua_pushboolean(L,diff_isApplied(name));
    return 1;
 }
+/**
+ * @brief Starts a batch of diffs, the universe is only rebuilt on batchEnd.
+ *
+ * Every batchBegin must be matched by a batchEnd.
+ *
+ * @luafunc batchBegin()
+ */
+static int diff_batchBeginL( lua_State *L )
+{
+   NLUA_CHECKRW(L);
+   diff_batchBegin();
+   return 0;
+}
+/**
+ * @brief Ends a batch of diffs, rebuilding the universe.
+ *
+ * @luafunc batchEnd()
+ */
+static int diff_batchEndL( lua_State *L )
+{
+   NLUA_CHECKRW(L);
+   diff_batchEnd();
+   return 0;
+}
@@ -19,7 +19,9 @@
 #include "gui.h"
 #include "gui_osd.h"
 #include "gui_omsg.h"
+#include "gui_elem.h"
 #include "nlua_tex.h"
+#include "nlua_col.h"
 #include "menu.h"
 #include "info.h"
 
@@ -38,6 +40,15 @@ static int guiL_mouseClickEnable( lua_State *L );
 static int guiL_mouseMoveEnable( lua_State *L );
 static int guiL_menuInfo( lua_State *L );
 static int guiL_menuSmall( lua_State *L );
+static int guiL_elemBar( lua_State *L );
+static int guiL_elemText( lua_State *L );
+static int guiL_elemTextBlock( lua_State *L );
+static int guiL_elemTex( lua_State *L );
+static int guiL_elemRadar( lua_State *L );
+static int guiL_elemSetText( lua_State *L );
+static int guiL_elemSetValue( lua_State *L );
+static int guiL_elemSetColour( lua_State *L );
+static int guiL_elemSetVisible( lua_State *L );
 static const luaL_reg guiL_methods[] = {
    { "viewport", guiL_viewport },
    { "fpsPos", guiL_fpsPos },
@@ -52,6 +63,15 @@ static const luaL_reg guiL_methods[] = {
    { "mouseMoveEnable", guiL_mouseMoveEnable },
    { "menuInfo", guiL_menuInfo },
    { "menuSmall", guiL_menuSmall },
+   { "elemBar", guiL_elemBar },
+   { "elemText", guiL_elemText },
+   { "elemTextBlock", guiL_elemTextBlock },
+   { "elemTex", guiL_elemTex },
+   { "elemRadar", guiL_elemRadar },
+   { "elemSetText", guiL_elemSetText },
+   { "elemSetValue", guiL_elemSetValue },
+   { "elemSetColour", guiL_elemSetColour },
+   { "elemSetVisible", guiL_elemSetVisible },
    {0,0}
 }; /**< GUI methods. */
 
@@ -424,3 +444,239 @@ static int guiL_menuSmall( lua_State *L )
 }
 
 
+
+
+/**
+ * @brief Gets a binding parameter.
+ */
+static GuiBind guiL_checkbind( lua_State *L, int ind )
+{
+   const char *name;
+   int bind;
+
+   name = lua_isstring(L,ind) ? lua_tostring(L,ind) : NULL;
+   bind = guie_bind( name );
+   if (bind < 0)
+      NLUA_ERROR(L,"Invalid GUI binding '%s'.", name);
+   return bind;
+}
+
+
+/**
+ * @brief Adds a bar drawn every frame.
+ *
+ * Bound bars follow the player's values by themselves, others are changed
+ *  with elemSetValue. Bindings are "shield", "armour", "energy" and "fuel".
+ *
+ * @usage gui.elemBar( x, y, 128, 7, col, "shield" ) -- Rectangle following the shield.
+ * @usage gui.elemBar( x, y, 0, 0, col, "energy", tex ) -- Texture cut to the energy.
+ *
+ *    @luatparam number x X position.
+ *    @luatparam number y Y position.
+ *    @luatparam number w Width when full, 0 for that of the texture.
+ *    @luatparam number h Height, 0 for that of the texture.
+ *    @luatparam Colour col Colour of the bar.
+ *    @luatparam[opt] string bind Player value to follow.
+ *    @luatparam[opt] Tex tex Texture to draw instead of a rectangle.
+ *    @luatreturn number ID of the element.
+ * @luafunc elemBar( x, y, w, h, col, bind, tex )
+ */
+static int guiL_elemBar( lua_State *L )
+{
+   double x, y, w, h;
+   glColour *col;
+   glTexture *tex;
+   GuiBind bind;
+
+   NLUA_CHECKRW(L);
+   x     = luaL_checknumber(L,1);
+   y     = luaL_checknumber(L,2);
+   w     = luaL_checknumber(L,3);
+   h     = luaL_checknumber(L,4);
+   col   = luaL_checkcolour(L,5);
+   bind  = guiL_checkbind(L,6);
+   tex   = lua_istex(L,7) ? luaL_checktex(L,7) : NULL;
+   if ((bind == GUI_BIND_CREDITS) || (bind == GUI_BIND_CARGOFREE))
+      NLUA_ERROR(L,"GUI binding '%s' is only for text.", lua_tostring(L,6));
+
+   lua_pushnumber( L, guie_addBar( x, y, w, h, col, tex, bind ) );
+   return 1;
+}
+
+
+/**
+ * @brief Adds a line of text drawn every frame.
+ *
+ * Bound text shows the value after the string, the bindings are those of
+ *  elemBar as percentages, "credits" and "cargo_free".
+ *
+ * @usage gui.elemText( true, "Creds: ", x, y, col, 128, "right", "credits" )
+ *
+ *    @luatparam boolean small Whether or not to use a small font.
+ *    @luatparam string str Text, in front of the value if bound.
+ *    @luatparam number x X position.
+ *    @luatparam number y Y position.
+ *    @luatparam Colour col Colour of the text.
+ *    @luatparam[opt=0] number max Maximum width to render up to.
+ *    @luatparam[opt="left"] string align "left", "center" or "right" in the maximum width.
+ *    @luatparam[opt] string bind Player value to follow.
+ *    @luatreturn number ID of the element.
+ * @luafunc elemText( small, str, x, y, col, max, align, bind )
+ */
+static int guiL_elemText( lua_State *L )
+{
+   const char *str;
+   double x, y;
+   glColour *col;
+   int small, max, align;
+   GuiBind bind;
+
+   NLUA_CHECKRW(L);
+   small = lua_toboolean(L,1);
+   str   = luaL_checkstring(L,2);
+   x     = luaL_checknumber(L,3);
+   y     = luaL_checknumber(L,4);
+   col   = luaL_checkcolour(L,5);
+   max   = luaL_optinteger(L,6,0);
+   align = guie_align( lua_isstring(L,7) ? lua_tostring(L,7) : NULL );
+   if (align < 0)
+      NLUA_ERROR(L,"Invalid GUI alignment '%s'.", lua_tostring(L,7));
+   bind  = guiL_checkbind(L,8);
+
+   lua_pushnumber( L, guie_addText( small, str, x, y, col, max, align, bind ) );
+   return 1;
+}
+
+
+/**
+ * @brief Adds a block of wrapped text drawn every frame.
+ *
+ *    @luatparam boolean small Whether or not to use a small font.
+ *    @luatparam string str Text.
+ *    @luatparam number x X position.
+ *    @luatparam number y Y position.
+ *    @luatparam number w Width of the block of text.
+ *    @luatparam number h Height of the block of text.
+ *    @luatparam Colour col Colour of the text.
+ *    @luatreturn number ID of the element.
+ * @luafunc elemTextBlock( small, str, x, y, w, h, col )
+ */
+static int guiL_elemTextBlock( lua_State *L )
+{
+   NLUA_CHECKRW(L);
+   lua_pushnumber( L, guie_addTextBlock( lua_toboolean(L,1),
+            luaL_checkstring(L,2), luaL_checknumber(L,3), luaL_checknumber(L,4),
+            luaL_checkinteger(L,5), luaL_checkinteger(L,6),
+            luaL_checkcolour(L,7) ) );
+   return 1;
+}
+
+
+/**
+ * @brief Adds a texture drawn every frame.
+ *
+ *    @luatparam Tex tex Texture to draw.
+ *    @luatparam number x X position.
+ *    @luatparam number y Y position.
+ *    @luatparam[opt] Colour col Colour to tint it with.
+ *    @luatreturn number ID of the element.
+ * @luafunc elemTex( tex, x, y, col )
+ */
+static int guiL_elemTex( lua_State *L )
+{
+   glTexture *tex;
+   glColour *col;
+
+   NLUA_CHECKRW(L);
+   tex   = luaL_checktex(L,1);
+   col   = lua_iscolour(L,4) ? luaL_checkcolour(L,4) : NULL;
+   lua_pushnumber( L, guie_addTex( tex, luaL_checknumber(L,2),
+            luaL_checknumber(L,3), col ) );
+   return 1;
+}
+
+
+/**
+ * @brief Adds the radar drawn every frame, instead of calling radarRender.
+ *
+ *    @luatparam number x X position.
+ *    @luatparam number y Y position.
+ *    @luatreturn number ID of the element.
+ * @luafunc elemRadar( x, y )
+ */
+static int guiL_elemRadar( lua_State *L )
+{
+   NLUA_CHECKRW(L);
+   lua_pushnumber( L, guie_addRadar( luaL_checknumber(L,1),
+            luaL_checknumber(L,2) ) );
+   return 1;
+}
+
+
+/**
+ * @brief Changes the text of a text element.
+ *
+ * @usage gui.elemSetText( cargo_txt, cargo_str ) -- From update_cargo.
+ *
+ *    @luatparam number id ID of the element.
+ *    @luatparam string str New text.
+ * @luafunc elemSetText( id, str )
+ */
+static int guiL_elemSetText( lua_State *L )
+{
+   NLUA_CHECKRW(L);
+   if (guie_setText( luaL_checkinteger(L,1), luaL_checkstring(L,2) ))
+      NLUA_ERROR(L,"GUI element %d is not text.", luaL_checkinteger(L,1));
+   return 0;
+}
+
+
+/**
+ * @brief Changes how much a bar that isn't bound is filled.
+ *
+ *    @luatparam number id ID of the element.
+ *    @luatparam number value Fraction filled, from 0 to 1.
+ * @luafunc elemSetValue( id, value )
+ */
+static int guiL_elemSetValue( lua_State *L )
+{
+   NLUA_CHECKRW(L);
+   if (guie_setValue( luaL_checkinteger(L,1), luaL_checknumber(L,2) ))
+      NLUA_ERROR(L,"GUI element %d is not a bar.", luaL_checkinteger(L,1));
+   return 0;
+}
+
+
+/**
+ * @brief Changes the colour of an element.
+ *
+ *    @luatparam number id ID of the element.
+ *    @luatparam[opt] Colour col New colour, textures are drawn as is if nil.
+ * @luafunc elemSetColour( id, col )
+ */
+static int guiL_elemSetColour( lua_State *L )
+{
+   glColour *col;
+
+   NLUA_CHECKRW(L);
+   col = lua_iscolour(L,2) ? luaL_checkcolour(L,2) : NULL;
+   if (guie_setColour( luaL_checkinteger(L,1), col ))
+      NLUA_ERROR(L,"GUI element %d does not exist.", luaL_checkinteger(L,1));
+   return 0;
+}
+
+
+/**
+ * @brief Shows or hides an element.
+ *
+ *    @luatparam number id ID of the element.
+ *    @luatparam boolean visible Whether it should be drawn.
+ * @luafunc elemSetVisible( id, visible )
+ */
+static int guiL_elemSetVisible( lua_State *L )
+{
+   NLUA_CHECKRW(L);
+   if (guie_setVisible( luaL_checkinteger(L,1), lua_toboolean(L,2) ))
+      NLUA_ERROR(L,"GUI element %d does not exist.", luaL_checkinteger(L,1));
+   return 0;
+}
@@ -19,6 +19,7 @@
 #include "nlua_system.h"
 #include "land_outfits.h"
 #include "log.h"
+#include "map.h"
 
 
 static JumpPoint* luaL_validjumpSystem( lua_State *L, int ind, int *offset, StarSystem **sys );
@@ -450,8 +451,10 @@ static int jumpL_setKnown( lua_State *L )
       jp_rmFlag( jp, JP_KNOWN );
 
    /* Update outfits image array. */
-   if (changed)
+   if (changed) {
+      map_knownInvalidate();
       outfits_updateEquipmentOutfits();
+   }
 
    return 0;
 }
@@ -29,6 +29,8 @@
 #include "rng.h"
 #include "pilot.h"
 #include "pilot_heat.h"
+#include "pilot_grid.h"
+#include "pilot_ew.h"
 #include "player.h"
 #include "space.h"
 #include "ai.h"
@@ -40,6 +42,7 @@
 #include "land_outfits.h"
 #include "array.h"
 #include "escort.h"
+#include "scratch.h"
 
 
 /*
@@ -69,6 +72,9 @@ static int pilotL_remove( lua_State *L );
 static int pilotL_clear( lua_State *L );
 static int pilotL_toggleSpawn( lua_State *L );
 static int pilotL_getPilots( lua_State *L );
+static int pilotL_getInrange( lua_State *L );
+static int pilotL_getHostiles( lua_State *L );
+static int pilotL_getVisible( lua_State *L );
 static int pilotL_eq( lua_State *L );
 static int pilotL_name( lua_State *L );
 static int pilotL_id( lua_State *L );
@@ -83,6 +89,8 @@ static int pilotL_outfits( lua_State *L );
 static int pilotL_rename( lua_State *L );
 static int pilotL_position( lua_State *L );
 static int pilotL_velocity( lua_State *L );
+static int pilotL_positionXY( lua_State *L );
+static int pilotL_velocityXY( lua_State *L );
 static int pilotL_dir( lua_State *L );
 static int pilotL_ew( lua_State *L );
 static int pilotL_temp( lua_State *L );
@@ -156,6 +164,9 @@ static const luaL_reg pilotL_methods[] = {
    { "add", pilotL_addFleet },
    { "rm", pilotL_remove },
    { "get", pilotL_getPilots },
+   { "getInrange", pilotL_getInrange },
+   { "getHostiles", pilotL_getHostiles },
+   { "getVisible", pilotL_getVisible },
    { "__eq", pilotL_eq },
    /* Info. */
    { "name", pilotL_name },
@@ -171,6 +182,8 @@ static const luaL_reg pilotL_methods[] = {
    { "rename", pilotL_rename },
    { "pos", pilotL_position },
    { "vel", pilotL_velocity },
+   { "posxy", pilotL_positionXY },
+   { "velxy", pilotL_velocityXY },
    { "dir", pilotL_dir },
    { "ew", pilotL_ew },
    { "temp", pilotL_temp },
@@ -377,11 +390,10 @@ static int pilotL_addFleetFrom( lua_State *L, int from_ship )
    Fleet *flt;
    Ship *ship;
    const char *fltname, *fltai, *faction;
-   int i, first;
-   unsigned int p;
+   int i;
+   unsigned int p, *ids;
    double a, r;
-   Vector2d vv,vp, vn;
-   FleetPilot *plt;
+   Vector2d vv,vp, vn, *vps;
    LuaFaction lf;
    StarSystem *ss;
    Planet *planet;
@@ -392,6 +404,7 @@ static int pilotL_addFleetFrom( lua_State *L, int from_ship )
    int *ind, nind;
    double chance;
    int ignore_rules;
+   ScratchMark mark;
 
    /* Default values. */
    pilot_clearFlagsRaw( flags );
@@ -476,10 +489,11 @@ static int pilotL_addFleetFrom( lua_State *L, int from_ship )
          ignore_rules = 1;
 
       /* Build landable planet table. */
+      mark  = scratch_mark();
       ind   = NULL;
       nind  = 0;
       if (cur_system->nplanets > 0) {
-         ind = malloc( sizeof(int) * cur_system->nplanets );
+         ind = scratch_alloc( sizeof(int) * cur_system->nplanets );
          for (i=0; i<cur_system->nplanets; i++)
             if (planet_hasService(cur_system->planets[i],PLANET_SERVICE_INHABITED) &&
                   !areEnemies(lf,cur_system->planets[i]->faction))
@@ -490,7 +504,7 @@ static int pilotL_addFleetFrom( lua_State *L, int from_ship )
       jumpind  = NULL;
       njumpind = 0;
       if (cur_system->njumps > 0) {
-         jumpind = malloc( sizeof(int) * cur_system->njumps );
+         jumpind = scratch_alloc( sizeof(int) * cur_system->njumps );
          for (i=0; i<cur_system->njumps; i++) {
             /* The jump into the system must not be exit-only, and unless
              * ignore_rules is set, must also be non-hidden and have faction
@@ -507,7 +521,6 @@ static int pilotL_addFleetFrom( lua_State *L, int from_ship )
       /* Crazy case no landable nor presence, we'll just jump in randomly. */
       if ((nind == 0) && (njumpind==0)) {
          if (cur_system->njumps > 0) {
-            jumpind = malloc( sizeof(int) * cur_system->njumps );
             for (i=0; i<cur_system->njumps; i++)
                jumpind[ njumpind++ ] = i;
          }
@@ -542,8 +555,7 @@ static int pilotL_addFleetFrom( lua_State *L, int from_ship )
       }
 
       /* Free memory allocated. */
-      free( ind );
-      free( jumpind );
+      scratch_release( mark );
    }
 
    /* Set up velocities and such. */
@@ -563,26 +575,28 @@ static int pilotL_addFleetFrom( lua_State *L, int from_ship )
       lua_pushpilot(L,p);
    }
    else {
-      /* now we start adding pilots and toss ids into the table we return */
-      lua_newtable(L);
-      first = 1;
+      /* Fleet displacement - first ship is exact. */
+      mark = scratch_mark();
+      vps  = scratch_alloc( MAX(flt->npilots,1) * sizeof(Vector2d) );
+      ids  = scratch_alloc( MAX(flt->npilots,1) * sizeof(unsigned int) );
       for (i=0; i<flt->npilots; i++) {
-         plt = &flt->pilots[i];
-
-         /* Fleet displacement - first ship is exact. */
-         if (!first)
+         if (i > 0)
             vect_cadd(&vp, RNG(75,150) * (RNG(0,1) ? 1 : -1),
                   RNG(75,150) * (RNG(0,1) ? 1 : -1));
-         first = 0;
+         vps[i] = vp;
+      }
 
-         /* Create the pilot. */
-         p = fleet_createPilot( flt, plt, a, &vp, &vv, fltai, flags );
+      /* Create the pilots. */
+      fleet_createPilots( flt, a, vps, &vv, fltai, flags, ids );
 
-         /* we push each pilot created into a table and return it */
+      /* now we toss ids into the table we return */
+      lua_newtable(L);
+      for (i=0; i<flt->npilots; i++) {
          lua_pushnumber(L,i+1); /* index, starts with 1 */
-         lua_pushpilot(L,p); /* value = LuaPilot */
+         lua_pushpilot(L,ids[i]); /* value = LuaPilot */
          lua_rawset(L,-3); /* store the value in the table */
       }
+      scratch_release( mark );
    }
    return 1;
 }
@@ -760,21 +774,23 @@ static int pilotL_getPilots( lua_State *L )
    int i, j, k, d;
    int *factions;
    int nfactions;
+   ScratchMark mark;
 
    /* Whether or not to get disabled. */
    d = lua_toboolean(L,2);
 
    /* Check for belonging to faction. */
    if (lua_istable(L,1) || lua_isfaction(L,1)) {
+      mark = scratch_mark();
       if (lua_isfaction(L,1)) {
          nfactions = 1;
-         factions = malloc( sizeof(int) );
+         factions = scratch_alloc( sizeof(int) );
          factions[0] = lua_tofaction(L,1);
       }
       else {
          /* Get table length and preallocate. */
          nfactions = (int) lua_objlen(L,1);
-         factions = malloc( sizeof(int) * nfactions );
+         factions = scratch_alloc( sizeof(int) * MAX(nfactions,1) );
          /* Load up the table. */
          lua_pushnil(L);
          i = 0;
@@ -802,7 +818,7 @@ static int pilotL_getPilots( lua_State *L )
       }
 
       /* clean up. */
-      free(factions);
+      scratch_release( mark );
    }
    else if ((lua_isnil(L,1)) || (lua_gettop(L) == 0)) {
       /* Now put all the matching pilots in a table. */
@@ -824,6 +840,178 @@ static int pilotL_getPilots( lua_State *L )
    return 1;
 }
 
+
+/**
+ * @brief Starts a table of pilots for the queries.
+ *
+ * Reuses the table at index out if there is one, otherwise creates one.
+ *
+ *    @param L Lua state.
+ *    @param out Stack index of the optional output table.
+ */
+static void pilotL_tableStart( lua_State *L, int out )
+{
+   if (lua_istable(L,out))
+      lua_pushvalue(L,out);
+   else
+      lua_newtable(L);
+}
+
+/**
+ * @brief Clears what was left of a reused table after the last pilot.
+ *
+ *    @param L Lua state.
+ *    @param k Index of the first unused entry.
+ */
+static void pilotL_tableEnd( lua_State *L, int k )
+{
+   for (;; k++) {
+      lua_rawgeti(L, -1, k);
+      if (lua_isnil(L,-1)) {
+         lua_pop(L,1);
+         break;
+      }
+      lua_pop(L,1);
+      lua_pushnil(L);
+      lua_rawseti(L, -2, k);
+   }
+}
+
+/**
+ * @brief Checks to see if a pilot should be returned by the queries.
+ */
+static int pilotL_queryValid( const Pilot *p, int disabled )
+{
+   return (disabled || !pilot_isDisabled(p)) &&
+         !pilot_isFlag(p, PILOT_DELETE);
+}
+
+/**
+ * @brief Gets the pilots within a radius of a position.
+ *
+ * Uses the pilot grid so only pilots near the position are looked at. If a
+ *  table is passed it is filled instead of creating a new one.
+ *
+ * @usage p = pilot.getInrange( player.pos(), 3000 ) -- Pilots near the player
+ * @usage pilot.getInrange( pos, 1000, false, mem.near ) -- Reuses mem.near
+ *
+ *    @luatparam Vec2 pos Position to search around.
+ *    @luatparam number radius Radius to search in.
+ *    @luatparam[opt=false] boolean disabled Whether or not to get disabled pilots.
+ *    @luatparam[opt] table out Table to store the pilots in.
+ *    @luatreturn {Pilot,...} A table containing the pilots, in stack order.
+ * @luafunc getInrange( pos, radius, disabled, out )
+ */
+static int pilotL_getInrange( lua_State *L )
+{
+   Vector2d *pos;
+   double r;
+   int i, k, n, d;
+   Pilot **list;
+
+   pos = luaL_checkvector(L,1);
+   r   = luaL_checknumber(L,2);
+   d   = lua_toboolean(L,3);
+
+   n = pilot_gridQueryRadius( pos->x, pos->y, r, -1, &list );
+
+   pilotL_tableStart( L, 4 );
+   k = 1;
+   for (i=0; i<n; i++) {
+      if (!pilotL_queryValid( list[i], d ))
+         continue;
+      lua_pushpilot(L, list[i]->id);
+      lua_rawseti(L, -2, k++);
+   }
+   pilotL_tableEnd( L, k );
+   return 1;
+}
+
+/**
+ * @brief Gets the pilots hostile to a pilot.
+ *
+ * Pilots are hostile if their factions are enemies, or if either of them is
+ *  the player and the other is hostile to the player. The radius limits the search with
+ *  the pilot grid instead of looking at all the pilots.
+ *
+ * @usage h = pilot.getHostiles( p ) -- All pilots hostile to p
+ * @usage h = pilot.getHostiles( p, 5000 ) -- Only those within 5000
+ *
+ *    @luatparam Pilot p Pilot to get the hostiles of.
+ *    @luatparam[opt] number radius Maximum distance to p, nil for no limit.
+ *    @luatparam[opt=false] boolean disabled Whether or not to get disabled pilots.
+ *    @luatparam[opt] table out Table to store the pilots in.
+ *    @luatreturn {Pilot,...} A table containing the hostile pilots.
+ * @luafunc getHostiles( p, radius, disabled, out )
+ */
+static int pilotL_getHostiles( lua_State *L )
+{
+   Pilot *p, *t, **list;
+   int i, k, n, d;
+
+   p = luaL_validpilot(L,1);
+   d = lua_toboolean(L,3);
+
+   if (lua_isnoneornil(L,2)) {
+      list = pilot_stack;
+      n    = pilot_nstack;
+   }
+   else
+      n = pilot_gridQueryRadius( p->solid->pos.x, p->solid->pos.y,
+            luaL_checknumber(L,2), -1, &list );
+
+   pilotL_tableStart( L, 4 );
+   k = 1;
+   for (i=0; i<n; i++) {
+      t = list[i];
+      if ((t == p) || !pilotL_queryValid( t, d ))
+         continue;
+      if (!(areEnemies( p->faction, t->faction ) ||
+            ((t->id == PLAYER_ID) && pilot_isHostile(p)) ||
+            ((p->id == PLAYER_ID) && pilot_isHostile(t))))
+         continue;
+      lua_pushpilot(L, t->id);
+      lua_rawseti(L, -2, k++);
+   }
+   pilotL_tableEnd( L, k );
+   return 1;
+}
+
+/**
+ * @brief Gets the pilots in sensor range of a pilot.
+ *
+ * @usage v = pilot.getVisible( p )
+ *
+ *    @luatparam Pilot p Pilot whose sensors to use.
+ *    @luatparam[opt=false] boolean disabled Whether or not to get disabled pilots.
+ *    @luatparam[opt] table out Table to store the pilots in.
+ *    @luatreturn {Pilot,...} A table containing the pilots p can see.
+ * @luafunc getVisible( p, disabled, out )
+ */
+static int pilotL_getVisible( lua_State *L )
+{
+   Pilot *p, *t;
+   int i, k, d;
+
+   p = luaL_validpilot(L,1);
+   d = lua_toboolean(L,2);
+
+   pilotL_tableStart( L, 3 );
+   k = 1;
+   for (i=0; i<pilot_nstack; i++) {
+      t = pilot_stack[i];
+      if ((t == p) || !pilotL_queryValid( t, d ) ||
+            pilot_isFlag( t, PILOT_INVISIBLE ))
+         continue;
+      if (pilot_inRangePilot( p, t ) != 1)
+         continue;
+      lua_pushpilot(L, t->id);
+      lua_rawseti(L, -2, k++);
+   }
+   pilotL_tableEnd( L, k );
+   return 1;
+}
+
 /**
  * @brief Checks to see if pilot and p are the same.
  *
@@ -1628,14 +1816,39 @@ static int pilotL_rename( lua_State *L )
    return 0;
 }
 
+/**
+ * @brief Pushes a vector, reusing the one at index out if it's a vector.
+ *
+ *    @param L Lua state.
+ *    @param out Stack index of the optional output vector.
+ *    @param vec Vector to push.
+ */
+static void pilotL_pushvectorOut( lua_State *L, int out, const Vector2d *vec )
+{
+   Vector2d *v;
+
+   if (lua_isvector(L,out)) {
+      v = lua_tovector(L,out);
+      vect_cset( v, vec->x, vec->y );
+      lua_pushvalue(L,out);
+   }
+   else
+      lua_pushvector(L, *vec);
+}
+
 /**
  * @brief Gets the pilot's position.
  *
+ * If a vector is passed it is set and returned instead of making a new one,
+ *  which avoids creating garbage in scripts that run every frame.
+ *
  * @usage v = p:pos()
+ * @usage p:pos( v ) -- Stores the position in v
  *
  *    @luatparam Pilot p Pilot to get the position of.
+ *    @luatparam[opt] Vec2 v Vector to store the position in.
  *    @luatreturn Vec2 The pilot's current position.
- * @luafunc pos( p )
+ * @luafunc pos( p, v )
  */
 static int pilotL_position( lua_State *L )
 {
@@ -1645,18 +1858,22 @@ static int pilotL_position( lua_State *L )
    p     = luaL_validpilot(L,1);
 
    /* Push position. */
-   lua_pushvector(L, p->solid->pos);
+   pilotL_pushvectorOut( L, 2, &p->solid->pos );
    return 1;
 }
 
 /**
  * @brief Gets the pilot's velocity.
  *
+ * If a vector is passed it is set and returned instead of making a new one.
+ *
  * @usage vel = p:vel()
+ * @usage p:vel( v ) -- Stores the velocity in v
  *
  *    @luatparam Pilot p Pilot to get the velocity of.
+ *    @luatparam[opt] Vec2 v Vector to store the velocity in.
  *    @luatreturn Vec2 The pilot's current velocity.
- * @luafunc vel( p )
+ * @luafunc vel( p, v )
  */
 static int pilotL_velocity( lua_State *L )
 {
@@ -1666,10 +1883,54 @@ static int pilotL_velocity( lua_State *L )
    p     = luaL_validpilot(L,1);
 
    /* Push velocity. */
-   lua_pushvector(L, p->solid->vel);
+   pilotL_pushvectorOut( L, 2, &p->solid->vel );
    return 1;
 }
 
+/**
+ * @brief Gets the pilot's position as coordinates.
+ *
+ * Unlike pilot.pos this does not create a vector.
+ *
+ * @usage x, y = p:posxy()
+ *
+ *    @luatparam Pilot p Pilot to get the position of.
+ *    @luatreturn number X coordinate of the pilot.
+ *    @luatreturn number Y coordinate of the pilot.
+ * @luafunc posxy( p )
+ */
+static int pilotL_positionXY( lua_State *L )
+{
+   Pilot *p;
+
+   p = luaL_validpilot(L,1);
+   lua_pushnumber(L, p->solid->pos.x);
+   lua_pushnumber(L, p->solid->pos.y);
+   return 2;
+}
+
+/**
+ * @brief Gets the pilot's velocity as coordinates.
+ *
+ * Unlike pilot.vel this does not create a vector.
+ *
+ * @usage vx, vy = p:velxy()
+ *
+ *    @luatparam Pilot p Pilot to get the velocity of.
+ *    @luatreturn number X component of the velocity.
+ *    @luatreturn number Y component of the velocity.
+ * @luafunc velxy( p )
+ */
+static int pilotL_velocityXY( lua_State *L )
+{
+   Pilot *p;
+
+   p = luaL_validpilot(L,1);
+   lua_pushnumber(L, p->solid->vel.x);
+   lua_pushnumber(L, p->solid->vel.y);
+   return 2;
+}
+
 /**
  * @brief Gets the pilot's evasion.
  *
@@ -2578,7 +2839,7 @@ static int pilotL_addOutfit( lua_State *L )
 
       /* Add outfit - already tested. */
       ret = pilot_addOutfitRaw( p, o, p->outfits[i] );
-      pilot_calcStats( p );
+      pilot_calcStatsOutfit( p, p->outfits[i], o, 1 );
 
       /* Add ammo if needed. */
       if ((ret==0) && (outfit_ammo(o) != NULL))
@@ -30,6 +30,7 @@
 #include "map.h"
 #include "nmath.h"
 #include "nstring.h"
+#include "scratch.h"
 
 
 /* Planet metatable methods */
@@ -238,6 +239,7 @@ static int planetL_getBackend( lua_State *L, int landable )
    int nfactions;
    char **planets;
    int nplanets;
+   ScratchMark mark;
    const char *rndplanet;
    LuaSystem luasys;
    LuaFaction f;
@@ -248,6 +250,7 @@ static int planetL_getBackend( lua_State *L, int landable )
    rndplanet = NULL;
    planets   = NULL;
    nplanets  = 0;
+   mark      = scratch_mark();
 
    /* If boolean return random. */
    if (lua_isboolean(L,1)) {
@@ -286,7 +289,7 @@ static int planetL_getBackend( lua_State *L, int landable )
    else if (lua_istable(L,1)) {
       /* Get table length and preallocate. */
       nfactions = (int) lua_objlen(L,1);
-      factions = malloc( sizeof(int) * nfactions );
+      factions = scratch_alloc( sizeof(int) * MAX(nfactions,1) );
       /* Load up the table. */
       lua_pushnil(L);
       i = 0;
@@ -298,14 +301,15 @@ static int planetL_getBackend( lua_State *L, int landable )
 
       /* get the planets */
       planets = space_getFactionPlanet( &nplanets, factions, nfactions, landable );
-      free(factions);
    }
    else
       NLUA_INVALID_PARAMETER(L); /* Bad Parameter */
 
    /* No suitable planet found */
-   if ((rndplanet == NULL) && ((planets == NULL) || nplanets == 0))
+   if ((rndplanet == NULL) && ((planets == NULL) || nplanets == 0)) {
+      scratch_release( mark );
       return 0;
+   }
    /* Pick random planet */
    else if (rndplanet == NULL) {
       planets = (char**) arrayShuffle( (void**)planets, nplanets );
@@ -325,7 +329,7 @@ static int planetL_getBackend( lua_State *L, int landable )
          rndplanet = planets[i];
          break;
       }
-      free(planets);
+      scratch_release( mark );
    }
 
    /* Push the planet */
@@ -690,7 +694,7 @@ static int planetL_gfxSpace( lua_State *L )
    Planet *p;
    glTexture *tex;
    p        = luaL_validplanet(L,1);
-   if (p->gfx_space == NULL) /* Not loaded. */
+   if ((p->gfx_space == NULL) || (p->gfx_space == p->gfx_lod)) /* Not loaded. */
       tex = gl_newImage( p->gfx_spaceName, OPENGL_TEX_MIPMAPS );
    else
       tex = gl_dupTexture( p->gfx_space );
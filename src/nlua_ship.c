@@ -448,6 +448,7 @@ static int shipL_gfxTarget( lua_State *L )
    s  = luaL_validship(L,1);
 
    /* Push graphic. */
+   ship_gfxLoad( s );
    tex = gl_dupTexture( s->gfx_target );
    if (tex == NULL) {
       WARN("Unable to get ship target graphic for '%s'.", s->name);
@@ -478,6 +479,7 @@ static int shipL_gfx( lua_State *L )
    s  = luaL_validship(L,1);
 
    /* Push graphic. */
+   ship_gfxLoad( s );
    tex = gl_dupTexture( s->gfx_space );
    if (tex == NULL) {
       WARN("Unable to get ship graphic for '%s'.", s->name);
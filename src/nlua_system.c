@@ -19,6 +19,7 @@
 #include "nlua_vec2.h"
 #include "nlua_planet.h"
 #include "nlua_jump.h"
+#include "nlua_commodity.h"
 #include "log.h"
 #include "rng.h"
 #include "land.h"
@@ -38,6 +39,7 @@ static int systemL_faction( lua_State *L );
 static int systemL_nebula( lua_State *L );
 static int systemL_jumpdistance( lua_State *L );
 static int systemL_jumpPath( lua_State *L );
+static int systemL_tradeRoute( lua_State *L );
 static int systemL_adjacent( lua_State *L );
 static int systemL_jumps( lua_State *L );
 static int systemL_presences( lua_State *L );
@@ -60,6 +62,7 @@ static const luaL_reg system_methods[] = {
    { "nebula", systemL_nebula },
    { "jumpDist", systemL_jumpdistance },
    { "jumpPath", systemL_jumpPath },
+   { "tradeRoute", systemL_tradeRoute },
    { "adjacentSystems", systemL_adjacent },
    { "jumps", systemL_jumps },
    { "presences", systemL_presences },
@@ -404,8 +407,15 @@ static int systemL_jumpdistance( lua_State *L )
    else
       goal = cur_system->name;
 
-   s = map_getJumpPath( &jumps, start, goal, 1, h, NULL );
-   free(s);
+   /* Distances are cached. */
+   if ((system_get(start) != NULL) && (system_get(goal) != NULL)) {
+      jumps = map_jumpDist( system_get(start), system_get(goal), 1, h );
+      jumps = MAX( jumps, 0 );
+   }
+   else {
+      s = map_getJumpPath( &jumps, start, goal, 1, h, NULL );
+      free(s);
+   }
 
    lua_pushnumber(L,jumps);
    return 1;
@@ -492,6 +502,61 @@ static int systemL_jumpPath( lua_State *L )
 }
 
 
+/**
+ * @brief Finds the trade route with the most profit per jump from a system.
+ *
+ * The route makes one jump per stop carrying a full hold of a single
+ *  commodity, each stop says what to sell and buy there. Credits on hand are
+ *  not taken into account.
+ *
+ * @usage profit, route = sys:tradeRoute( 5, 100 ) -- Best route of up to 5 jumps with 100 tonnes.
+ * @usage for _,s in ipairs(route) do print( s.system, s.sell, s.buy ) end
+ *
+ *    @luatparam System s System to start from.
+ *    @luatparam number jumps Most jumps to make, at most 16.
+ *    @luatparam number capacity Tonnes of cargo that can be carried.
+ *    @luatparam[opt=false] boolean ignore_known Whether or not to use systems and planets the player doesn't know.
+ *    @luatreturn number|nil Profit of the whole route, nil if there is none.
+ *    @luatreturn {table,...} Stops of the route starting with s, each with a
+ *               system field and optional sell and buy commodity fields.
+ * @luafunc tradeRoute( s, jumps, capacity, ignore_known )
+ */
+static int systemL_tradeRoute( lua_State *L )
+{
+   StarSystem *sys;
+   MapTradeStop *route;
+   credits_t profit;
+   int i, jumps;
+
+   sys   = luaL_validsystem(L,1);
+   jumps = map_tradeRoute( sys, luaL_checkint(L,2), luaL_checkint(L,3),
+         lua_toboolean(L,4), &route, &profit );
+   if (jumps == 0)
+      return 0;
+
+   lua_pushnumber(L, profit);
+   lua_newtable(L);
+   for (i=0; i<=jumps; i++) {
+      lua_pushnumber(L, i+1); /* key. */
+      lua_newtable(L);        /* value. */
+      lua_pushsystem(L, system_index( route[i].sys ));
+      lua_setfield(L, -2, "system");
+      if (route[i].sell != NULL) {
+         lua_pushcommodity(L, route[i].sell);
+         lua_setfield(L, -2, "sell");
+      }
+      if (route[i].buy != NULL) {
+         lua_pushcommodity(L, route[i].buy);
+         lua_setfield(L, -2, "buy");
+      }
+      lua_rawset(L, -3);
+   }
+   free(route);
+
+   return 2;
+}
+
+
 /**
  * @brief Gets all the adjacent systems to a system.
  *
@@ -795,6 +860,7 @@ static int systemL_setknown( lua_State *L )
             jp_rmFlag( &sys->jumps[i], JP_KNOWN );
      }
    }
+   map_knownInvalidate();
 
    /* Update outfits image array. */
    outfits_updateEquipmentOutfits();
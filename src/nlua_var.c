@@ -24,6 +24,7 @@
 #include "nluadef.h"
 #include "log.h"
 #include "nxml.h"
+#include "nhash.h"
 
 
 
@@ -54,6 +55,7 @@ typedef struct misn_var_ {
 static misn_var* var_stack = NULL; /**< Stack of mission variables. */
 static int var_nstack      = 0; /**< Number of mission variables. */
 static int var_mstack      = 0; /**< Memory size of the mission variable stack. */
+static NameHash var_hash; /**< Maps names to their index in var_stack. */
 
 
 /*
@@ -61,6 +63,8 @@ static int var_mstack      = 0; /**< Memory size of the mission variable stack.
  */
 /* static */
 static int var_add( misn_var *var );
+static misn_var* var_find( const char *name );
+static void var_rehash (void);
 static void var_free( misn_var* var );
 /* externed */
 int var_save( xmlTextWriterPtr writer );
@@ -198,6 +202,7 @@ int var_load( xmlNodePtr parent )
 static int var_add( misn_var *new_var )
 {
    int i;
+   misn_var old;
 
    if (var_nstack+1 > var_mstack) { /* more memory */
       var_mstack += 64; /* overkill ftw */
@@ -205,20 +210,54 @@ static int var_add( misn_var *new_var )
    }
 
    /* check if already exists */
-   for (i=0; i<var_nstack; i++)
-      if (strcmp(new_var->name,var_stack[i].name)==0) { /* overwrite */
-         var_free( &var_stack[i] );
-         var_stack[i] = *new_var;
-         return 0;
-      }
+   i = nhash_get( &var_hash, new_var->name );
+   if (i >= 0) { /* overwrite */
+      /* Key must point to the new name before the old one is freed. */
+      old = var_stack[i];
+      var_stack[i] = *new_var;
+      nhash_set( &var_hash, var_stack[i].name, i );
+      var_free( &old );
+      return 0;
+   }
 
    var_stack[var_nstack] = *new_var;
+   nhash_set( &var_hash, var_stack[var_nstack].name, var_nstack );
    var_nstack++;
 
    return 0;
 }
 
 
+/**
+ * @brief Finds a var by name.
+ *
+ *    @param name Name of the var to find.
+ *    @return The var or NULL if it doesn't exist.
+ */
+static misn_var* var_find( const char *name )
+{
+   int i;
+
+   i = nhash_get( &var_hash, name );
+   if (i < 0)
+      return NULL;
+   return &var_stack[i];
+}
+
+
+/**
+ * @brief Rebuilds the name index after the stack got shifted.
+ */
+static void var_rehash (void)
+{
+   int i;
+
+   nhash_clear( &var_hash );
+   for (i=0; i<var_nstack; i++)
+      nhash_set( &var_hash, var_stack[i].name, i );
+}
+
+
 /**
  * @brief Mission variable Lua bindings.
  *
@@ -246,12 +285,7 @@ static int var_add( misn_var *new_var )
  */
 int var_checkflag( char* str )
 {
-   int i;
-
-   for (i=0; i<var_nstack; i++)
-      if (strcmp(var_stack[i].name,str)==0)
-         return 1;
-   return 0;
+   return (var_find( str ) != NULL);
 }
 /**
  * @brief Gets the mission variable value of a certain name.
@@ -263,32 +297,31 @@ int var_checkflag( char* str )
  */
 static int var_peek( lua_State *L )
 {
-   int i;
    const char *str;
+   misn_var *var;
 
    /* Get the parameter. */
    str = luaL_checkstring(L,1);
 
-   for (i=0; i<var_nstack; i++)
-      if (strcmp(str,var_stack[i].name)==0) {
-         switch (var_stack[i].type) {
-            case MISN_VAR_NIL:
-               lua_pushnil(L);
-               break;
-            case MISN_VAR_NUM:
-               lua_pushnumber(L,var_stack[i].d.num);
-               break;
-            case MISN_VAR_BOOL:
-               lua_pushboolean(L,var_stack[i].d.b);
-               break;
-            case MISN_VAR_STR:
-               lua_pushstring(L,var_stack[i].d.str);
-               break;
-         }
-         return 1;
-      }
+   var = var_find( str );
+   if (var == NULL)
+      return 0;
 
-   return 0;
+   switch (var->type) {
+      case MISN_VAR_NIL:
+         lua_pushnil(L);
+         break;
+      case MISN_VAR_NUM:
+         lua_pushnumber(L,var->d.num);
+         break;
+      case MISN_VAR_BOOL:
+         lua_pushboolean(L,var->d.b);
+         break;
+      case MISN_VAR_STR:
+         lua_pushstring(L,var->d.str);
+         break;
+   }
+   return 1;
 }
 /**
  * @brief Pops a mission variable off the stack, destroying it.
@@ -307,13 +340,15 @@ static int var_pop( lua_State *L )
 
    str = luaL_checkstring(L,1);
 
-   for (i=0; i<var_nstack; i++)
-      if (strcmp(str,var_stack[i].name)==0) {
-         var_free( &var_stack[i] );
-         memmove( &var_stack[i], &var_stack[i+1], sizeof(misn_var)*(var_nstack-i-1) );
-         var_nstack--;
-         return 0;
-      }
+   i = nhash_get( &var_hash, str );
+   if (i >= 0) {
+      var_free( &var_stack[i] );
+      memmove( &var_stack[i], &var_stack[i+1], sizeof(misn_var)*(var_nstack-i-1) );
+      var_nstack--;
+      /* Keep the save order, indices after i shifted. */
+      var_rehash();
+      return 0;
+   }
 
    /*NLUA_DEBUG("Var '%s' not found in stack", str);*/
    return 0;
@@ -402,5 +437,6 @@ void var_cleanup (void)
    var_stack   = NULL;
    var_nstack  = 0;
    var_mstack  = 0;
+   nhash_free( &var_hash );
 }
 
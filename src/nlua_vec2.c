@@ -223,7 +223,8 @@ static int vectorL_newP( lua_State *L )
  * @brief Adds two vectors or a vector and some cartesian coordinates.
  *
  * If x is a vector it adds both vectors, otherwise it adds cartesian coordinates
- * to the vector.
+ * to the vector. The method form modifies v in place and returns it, so it
+ * doesn't create a new vector like the operator does.
  *
  * @usage my_vec = my_vec + your_vec
  * @usage my_vec:add( your_vec )
@@ -291,7 +292,7 @@ static int vectorL_add__( lua_State *L )
 
    /* Actually add it */
    vect_cset( v1, v1->x + x, v1->y + y );
-   lua_pushvector( L, *v1 );
+   lua_pushvalue( L, 1 ); /* Modified in place, no new userdata. */
 
    return 1;
 }
@@ -300,7 +301,7 @@ static int vectorL_add__( lua_State *L )
  * @brief Subtracts two vectors or a vector and some cartesian coordinates.
  *
  * If x is a vector it subtracts both vectors, otherwise it subtracts cartesian
- * coordinates to the vector.
+ * coordinates to the vector. Like add, the method form works in place.
  *
  * @usage my_vec = my_vec - your_vec
  * @usage my_vec:sub( your_vec )
@@ -367,7 +368,7 @@ static int vectorL_sub__( lua_State *L )
 
    /* Actually add it */
    vect_cset( v1, v1->x - x, v1->y - y );
-   lua_pushvector( L, *v1 );
+   lua_pushvalue( L, 1 ); /* Modified in place, no new userdata. */
    return 1;
 }
 
@@ -407,7 +408,7 @@ static int vectorL_mul__( lua_State *L )
 
    /* Actually add it */
    vect_cset( v1, v1->x * mod, v1->y * mod );
-   lua_pushvector( L, *v1 );
+   lua_pushvalue( L, 1 ); /* Modified in place, no new userdata. */
    return 1;
 }
 
@@ -447,7 +448,7 @@ static int vectorL_div__( lua_State *L )
 
    /* Actually add it */
    vect_cset( v1, v1->x / mod, v1->y / mod );
-   lua_pushvector( L, *v1 );
+   lua_pushvalue( L, 1 ); /* Modified in place, no new userdata. */
    return 1;
 }
 
@@ -16,6 +16,7 @@
 
 #include "log.h"
 #include "opengl_tex.h"
+#include "startup.h"
 
 
 /**
@@ -376,6 +377,7 @@ SDL_Surface *npng_readSurface( npng_t *npng, int pad_pot, int vflip )
 
    /* Free rows. */
    free( row_pointers );
+   startup_countTexture();
    return surface;
 }
 
@@ -13,7 +13,163 @@
 
 #include "naev.h"
 
+#include <stdlib.h>
+
 #include "nstring.h"
+#include "log.h"
+#include "ndata.h"
+#include "nfile.h"
+#include "threadpool.h"
+
+
+#define XML_PARSE_GRAIN    4 /**< Files parsed per job at least. */
+#define XML_PARSE_BATCH    64 /**< Files parsed at once by the xml_forEach functions at least. */
+
+
+/**
+ * @brief Files being parsed by xml_parseBuffers().
+ */
+typedef struct XmlParseJob_ {
+   const char **bufs; /**< File contents, NULL if not read. */
+   const uint32_t *sizes; /**< Size of the files. */
+   xmlDocPtr *docs; /**< Parsed documents. */
+} XmlParseJob;
+
+
+/*
+ * Prototypes.
+ */
+static void xml_parseRange( int start, int end, void *data );
+static int xml_batchSize (void);
+
+
+/**
+ * @brief Parses a range of files, run from the threadpool.
+ */
+static void xml_parseRange( int start, int end, void *data )
+{
+   int i;
+   XmlParseJob *job;
+
+   job = (XmlParseJob*) data;
+   for (i=start; i<end; i++)
+      if (job->bufs[i] != NULL)
+         job->docs[i] = xmlParseMemory( job->bufs[i], job->sizes[i] );
+}
+
+
+/**
+ * @brief Parses a set of XML buffers on the threadpool.
+ *
+ *    @param bufs Buffers to parse, NULL ones are skipped.
+ *    @param sizes Size of each buffer.
+ *    @param n Number of buffers.
+ *    @return The n parsed documents, NULL for invalid buffers.
+ */
+xmlDocPtr* xml_parseBuffers( const char **bufs, const uint32_t *sizes, int n )
+{
+   XmlParseJob job;
+
+   job.bufs  = bufs;
+   job.sizes = sizes;
+   job.docs  = calloc( MAX(n,1), sizeof(xmlDocPtr) );
+   threadpool_parallelFor( n, XML_PARSE_GRAIN, xml_parseRange, &job );
+   return job.docs;
+}
+
+
+/**
+ * @brief Gets how many files to have parsed at once.
+ *
+ * Enough to keep the threadpool busy, few enough that the documents of the
+ *  whole data set are never in memory at once.
+ */
+static int xml_batchSize (void)
+{
+   return MAX( XML_PARSE_BATCH, 4 * XML_PARSE_GRAIN * threadpool_nthreads() );
+}
+
+
+/**
+ * @brief Parses a set of XML buffers on the threadpool a batch at a time.
+ *
+ * Each document is handed to func in order as soon as its batch is parsed,
+ *  func must free it. Anything touching the game state belongs in func.
+ *
+ *    @param bufs Buffers to parse, NULL ones are skipped.
+ *    @param sizes Size of each buffer.
+ *    @param n Number of buffers.
+ *    @param func Function to run on each document, which is NULL if invalid.
+ *    @param data Data to pass to func.
+ */
+void xml_forEachBuffer( const char **bufs, const uint32_t *sizes, int n,
+      void (*func)( xmlDocPtr doc, int i, void *data ), void *data )
+{
+   xmlDocPtr *docs;
+   int i, start, m, batch;
+
+   batch = xml_batchSize();
+   for (start=0; start<n; start+=batch) {
+      m    = MIN( batch, n-start );
+      docs = xml_parseBuffers( &bufs[start], &sizes[start], m );
+      for (i=0; i<m; i++)
+         func( docs[i], start+i, data );
+      free( docs );
+   }
+}
+
+
+/**
+ * @brief Reads and parses a set of XML files a batch at a time.
+ *
+ * Files are read and parsed on the threadpool. Each document is handed to
+ *  func in order as soon as its batch is parsed, func must free it.
+ *
+ *    @param prefix Prefix of the file paths, can be NULL.
+ *    @param files Files to parse.
+ *    @param n Number of files.
+ *    @param func Function to run on each document, which is NULL and warned
+ *           about if invalid.
+ *    @param data Data to pass to func.
+ */
+void xml_forEachFile( const char *prefix, char **files, int n,
+      void (*func)( xmlDocPtr doc, int i, void *data ), void *data )
+{
+   const char **bufs;
+   uint32_t *sizes;
+   int i, start, m, batch;
+   NdataView *views;
+   xmlDocPtr *docs;
+
+   batch = MIN( xml_batchSize(), MAX(n,1) );
+   views = malloc( sizeof(NdataView) * batch );
+   bufs  = malloc( sizeof(char*) * batch );
+   sizes = malloc( sizeof(uint32_t) * batch );
+   for (start=0; start<n; start+=batch) {
+      m = MIN( batch, n-start );
+      ndata_mapFiles( views, prefix, &files[start], m );
+      for (i=0; i<m; i++) {
+         bufs[i]  = views[i].data;
+         sizes[i] = views[i].size;
+      }
+
+      docs = xml_parseBuffers( bufs, sizes, m );
+
+      /* Buffers aren't needed once parsed. */
+      for (i=0; i<m; i++) {
+         if (docs[i] == NULL)
+            WARN("%s%s file is invalid xml!", (prefix != NULL) ? prefix : "",
+                  files[start+i]);
+         ndata_unmap( &views[i] );
+      }
+      for (i=0; i<m; i++)
+         func( docs[i], start+i, data );
+      free( docs );
+   }
+   free( views );
+   free( bufs );
+   free( sizes );
+}
 
 
 /**
@@ -84,3 +240,42 @@ void xmlw_setParams( xmlTextWriterPtr writer )
 }
 
 
+/**
+ * @brief Saves a document unless the file already has the same contents.
+ *
+ * Keeps saving everything cheap when only a few documents changed.
+ *
+ *    @param doc Document to save.
+ *    @param file File to save to.
+ *    @return 1 if written, 0 if the file was up to date, -1 on error.
+ */
+int xmlw_saveIfChanged( xmlDocPtr doc, const char *file )
+{
+   xmlChar *mem;
+   char *old;
+   int size, oldsize, ret;
+
+   xmlDocDumpMemoryEnc( doc, &mem, &size, "UTF-8" );
+   if (mem == NULL) {
+      WARN("Unable to write '%s'.", file);
+      return -1;
+   }
+
+   /* Compare with what is there. */
+   if (nfile_fileExists( file )) {
+      old = nfile_readFile( &oldsize, file );
+      ret = (old != NULL) && (oldsize == size) &&
+            (memcmp( old, mem, size ) == 0);
+      free( old );
+      if (ret) {
+         xmlFree( mem );
+         return 0;
+      }
+   }
+
+   ret = nfile_writeFile( (const char*)mem, size, file );
+   xmlFree( mem );
+   return (ret == 0) ? 1 : -1;
+}
+
+
@@ -124,12 +124,18 @@ do {if (xmlTextWriterEndDocument(w) < 0) { \
 glTexture* xml_parseTexture( xmlNodePtr node,
       const char *path, int defsx, int defsy,
       const unsigned int flags );
+xmlDocPtr* xml_parseBuffers( const char **bufs, const uint32_t *sizes, int n );
+void xml_forEachBuffer( const char **bufs, const uint32_t *sizes, int n,
+      void (*func)( xmlDocPtr doc, int i, void *data ), void *data );
+void xml_forEachFile( const char *prefix, char **files, int n,
+      void (*func)( xmlDocPtr doc, int i, void *data ), void *data );
 
 
 /*
  * Functions for generic complex writing.
  */
 void xmlw_setParams( xmlTextWriterPtr writer );
+int xmlw_saveIfChanged( xmlDocPtr doc, const char *file );
 
 
 #endif /* XML_H */
@@ -92,9 +92,34 @@ int nzip_hasFile ( struct zip* arc, const char* filename )
  *    @return A pointer to the file contents in memory
  */
 void* nzip_readFile ( struct zip* arc, const char* filename, uint32_t* size )
+{
+   int index;
+   int flags = 0;
+
+   index = zip_name_locate ( arc, filename, flags );
+
+   if ( index < 0 ) {
+      WARN ( "Error reading %s from archive", filename );
+      WARN ( "%s", zip_strerror ( arc ) );
+      return NULL;
+   }
+
+   return nzip_readIndex ( arc, index, size );
+}
+
+/**
+ * @brief Read the contents of a file from an archive by its index
+ *
+ *    @param arc Archive to look in
+ *    @param index Index of the file in the archive, see nzip_listFiles
+ *    @param[out] size Size of returned buffer
+ *    @return A pointer to the file contents in memory
+ */
+void* nzip_readIndex ( struct zip* arc, int index, uint32_t* size )
 {
    struct zip_file* file;
    struct zip_stat stats;
+   const char* filename;
    void* data;
    int err;
    uint32_t read;
@@ -102,16 +127,17 @@ void* nzip_readFile ( struct zip* arc, const char* filename, uint32_t* size )
 
    // Get info about file
    zip_stat_init ( &stats );
-   err = zip_stat ( arc, filename, flags, &stats );
+   err = zip_stat_index ( arc, index, flags, &stats );
 
    if ( err ) {
-      WARN ( "Error reading %s from archive", filename );
+      WARN ( "Error reading file %d from archive", index );
       WARN ( "%s", zip_strerror ( arc ) );
       return NULL;
    }
+   filename = stats.name;
 
    // Open the file
-   file = zip_fopen_index ( arc, stats.index, flags );
+   file = zip_fopen_index ( arc, index, flags );
 
    if ( file == NULL ) {
       WARN ( "Error reading %s from archive", filename );
@@ -147,12 +173,14 @@ void* nzip_readFile ( struct zip* arc, const char* filename, uint32_t* size )
  *
  *    @param arc Archive to look through
  *    @param[out] nfiles Number of files found
+ *    @param[out] indices Archive index of each file, may be NULL
  *    @return List of file names found
  */
-char** nzip_listFiles ( struct zip* arc, uint32_t* nfiles )
+char** nzip_listFiles ( struct zip* arc, uint32_t* nfiles, int** indices )
 {
    struct zip_stat stats;
    char **filelist, **shrunk;
+   int *index;
    uint32_t i, j;
    int err;
    int flags = 0;
@@ -161,6 +189,7 @@ char** nzip_listFiles ( struct zip* arc, uint32_t* nfiles )
    *nfiles = zip_get_num_entries ( arc, flags );
 
    filelist = malloc ( sizeof ( char* ) * ( *nfiles ) );
+   index = ( indices != NULL ) ? malloc ( sizeof ( int ) * ( *nfiles ) ) : NULL;
 
    // Get stats for each file, and store the name
    for ( i = 0, j = 0; i < *nfiles; i++ ) {
@@ -170,17 +199,25 @@ char** nzip_listFiles ( struct zip* arc, uint32_t* nfiles )
       if ( err ) {
          WARN ( "Error getting file list from archive" );
          WARN ( "%s", zip_strerror ( arc ) );
+         while ( j > 0 )
+            free ( filelist[--j] );
          free ( filelist );
+         free ( index );
          return NULL;
       }
 
       // If the name ends with a forward slash, it's a directory
-      if (stats.name[strlen(stats.name) - 1] != '/')
+      if (stats.name[strlen(stats.name) - 1] != '/') {
+         if ( index != NULL )
+            index[j] = i;
          filelist[j++] = strdup(stats.name);
+      }
    }
 
    // Number of files excluding directories
    *nfiles = j;
+   if ( indices != NULL )
+      *indices = index;
 
    // Shrink file list to needed size
    shrunk = realloc( filelist, sizeof(char*) * j );
@@ -229,12 +266,37 @@ int nzip_rwopsClose ( struct SDL_RWops* context )
  *    @return RWops for filename
  */
 SDL_RWops* nzip_rwops ( struct zip* arc, const char* filename )
+{
+   int index;
+   int flags = 0;
+
+   index = zip_name_locate ( arc, filename, flags );
+
+   if ( index < 0 ) {
+      WARN ( "Error reading %s from archive", filename );
+      WARN ( "%s", zip_strerror ( arc ) );
+      return NULL;
+   }
+
+   return nzip_rwopsIndex ( arc, index );
+}
+
+/**
+ * @brief Return SDL_RWops for a file in an archive by its index. This version works on a copy of the file in memory.
+ *
+ *    @param arc Archive to look in
+ *    @param index Index of the file in the archive, see nzip_listFiles
+ *    @return RWops for the file
+ */
+SDL_RWops* nzip_rwopsIndex ( struct zip* arc, int index )
 {
    void* data;
    uint32_t size;
    SDL_RWops* rwops;
 
-   data = nzip_readFile ( arc, filename, &size );
+   data = nzip_readIndex ( arc, index, &size );
+   if ( data == NULL )
+      return NULL;
    rwops = SDL_RWFromMem ( data,size);
    rwops->close = nzip_rwopsClose;
    rwops->hidden.unknown.data1 = data;
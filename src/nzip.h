@@ -16,9 +16,11 @@ void nzip_close ( struct zip* arc );
 
 int nzip_hasFile ( struct zip* arc, const char* filename );
 void* nzip_readFile ( struct zip* arc, const char* filename, uint32_t* size );
-char** nzip_listFiles ( struct zip* arc, uint32_t* nfiles );
+void* nzip_readIndex ( struct zip* arc, int index, uint32_t* size );
+char** nzip_listFiles ( struct zip* arc, uint32_t* nfiles, int** indices );
 
 SDL_RWops* nzip_rwops ( struct zip* arc, const char* filename );
+SDL_RWops* nzip_rwopsIndex ( struct zip* arc, int index );
 
 #else
 
@@ -27,8 +29,10 @@ SDL_RWops* nzip_rwops ( struct zip* arc, const char* filename );
 #define nzip_close(a)
 #define nzip_hasFile(a, b) 0
 #define nzip_readFile(a, b, c) NULL
-#define nzip_listFiles(a, b) NULL
+#define nzip_readIndex(a, b, c) NULL
+#define nzip_listFiles(a, b, c) NULL
 #define nzip_rwops(a, b) NULL
+#define nzip_rwopsIndex(a, b) NULL
 
 #endif /* USE_LIBZIP */
 
@@ -50,6 +50,8 @@
 #include "ndata.h"
 #include "gui.h"
 #include "conf.h"
+#include "array.h"
+#include "threadpool.h"
 
 
 /*
@@ -75,6 +77,66 @@ static int gl_view_h = 0; /* Viewport height. */
 static int intel_vendor = 0;
 
 
+/*
+ * Screenshots
+ */
+#define SHOT_INFLIGHT   8 /**< Screenshots being read back or encoded at once, bounds memory. */
+#define SHOT_FRAMES     2 /**< Frames to wait before mapping a readback without fences. */
+
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER           0x88EB /**< Same as GL_PIXEL_PACK_BUFFER_ARB. */
+#endif /* GL_PIXEL_PACK_BUFFER */
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ                 0x88E1 /**< Same as GL_STREAM_READ_ARB. */
+#endif /* GL_STREAM_READ */
+#ifndef GL_READ_ONLY
+#define GL_READ_ONLY                   0x88B8 /**< Same as GL_READ_ONLY_ARB. */
+#endif /* GL_READ_ONLY */
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE  0x9117 /**< From GL_ARB_sync. */
+#endif /* GL_SYNC_GPU_COMMANDS_COMPLETE */
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED            0x911A /**< From GL_ARB_sync. */
+#endif /* GL_ALREADY_SIGNALED */
+#ifndef GL_CONDITION_SATISFIED
+#define GL_CONDITION_SATISFIED         0x911C /**< From GL_ARB_sync. */
+#endif /* GL_CONDITION_SATISFIED */
+#ifndef GL_WAIT_FAILED
+#define GL_WAIT_FAILED                 0x911D /**< From GL_ARB_sync. */
+#endif /* GL_WAIT_FAILED */
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT     0x00000001 /**< From GL_ARB_sync. */
+#endif /* GL_SYNC_FLUSH_COMMANDS_BIT */
+#define GL_FRAME_WAIT_NS               100000000 /**< Nanoseconds to wait for the frame fence at a time. */
+
+/**
+ * @brief Screenshot being read back or encoded.
+ */
+typedef struct glShot_ {
+   char *file; /**< File to save as. */
+   GLuint pbo; /**< Buffer object being read into or 0. */
+   void *fence; /**< Signalled once the readback is done or NULL. */
+   int frames; /**< Frames since the readback started. */
+   int w; /**< Width. */
+   int h; /**< Height. */
+   GLubyte *pixels; /**< Pixels once mapped. */
+} glShot;
+static char **shot_queued     = NULL; /**< Files to capture the next frame as. */
+static glShot *shot_pending   = NULL; /**< Readbacks the GPU may not have done yet. */
+static char *shot_burst       = NULL; /**< Prefix of the files of a burst. */
+static int shot_burstFrame    = 0; /**< Frames of the burst so far. */
+static int shot_burstLeft     = 0; /**< Frames of the burst left. */
+static int shot_burstDropped  = 0; /**< Frames of the burst skipped to bound memory. */
+static int shot_encoding      = 0; /**< Screenshots on the threadpool. */
+static SDL_mutex *shot_lock   = NULL; /**< Protects shot_encoding. */
+static SDL_cond *shot_done    = NULL; /**< Signalled when a screenshot is written. */
+
+/*
+ * Frame sync point.
+ */
+static void *gl_frameSync     = NULL; /**< Fence after the commands of the frame or NULL. */
+
+
 /*
  * prototypes
  */
@@ -89,6 +151,13 @@ static int gl_hint (void);
 /* png */
 static int write_png( const char *file_name, png_bytep *rows,
       int w, int h, int colourtype, int bitdepth );
+/* screenshots */
+static int gl_shotHasPBO (void);
+static int gl_shotEncode( void *data );
+static void gl_shotEncodeStart( const glShot *s );
+static int gl_shotRead( const char *file );
+static void gl_shotMap( glShot *shot );
+static void gl_screenshotExit (void);
 
 
 /*
@@ -99,37 +168,314 @@ static int write_png( const char *file_name, png_bytep *rows,
 /**
  * @brief Takes a screenshot.
  *
+ * The frame is captured once it's rendered by gl_screenshotUpdate() and
+ *  encoded in the background, so the file only shows up a few frames later.
+ *
  *    @param filename Name of the file to save screenshot as.
  */
 void gl_screenshot( const char *filename )
 {
-   GLubyte *screenbuf;
+   if (shot_queued == NULL)
+      shot_queued = array_create( char* );
+   array_push_back( &shot_queued, strdup(filename) );
+}
+
+
+/**
+ * @brief Captures a screenshot of every frame.
+ *
+ *    @param prefix Files are named prefix followed by the frame number, NULL
+ *           or frames below 1 stop the burst.
+ *    @param frames Number of frames to capture.
+ */
+void gl_screenshotBurst( const char *prefix, int frames )
+{
+   if (shot_burst != NULL) {
+      DEBUG("Captured %d frames to '%s', %d dropped.",
+            shot_burstFrame - shot_burstDropped, shot_burst, shot_burstDropped);
+      free( shot_burst );
+      shot_burst = NULL;
+   }
+   if ((prefix == NULL) || (frames <= 0))
+      return;
+
+   shot_burst        = strdup( prefix );
+   shot_burstFrame   = 0;
+   shot_burstLeft    = frames;
+   shot_burstDropped = 0;
+}
+
+
+/**
+ * @brief Checks to see if a burst of screenshots is being captured.
+ */
+int gl_screenshotBursting (void)
+{
+   return (shot_burst != NULL);
+}
+
+
+/**
+ * @brief Checks to see if the framebuffer can be read into a buffer object.
+ */
+static int gl_shotHasPBO (void)
+{
+   return (nglGenBuffers != NULL) && (nglMapBuffer != NULL) &&
+         (gl_hasVersion( 2, 1 ) || gl_hasExt("GL_ARB_pixel_buffer_object"));
+}
+
+
+/**
+ * @brief Encodes a screenshot, run from the threadpool.
+ */
+static int gl_shotEncode( void *data )
+{
+   glShot *shot;
    png_bytep *rows;
-   int i, w, h;
+   int i;
+
+   shot = (glShot*) data;
+
+   /* Rows are bottom to top. */
+   rows = malloc( sizeof(png_bytep) * shot->h );
+   for (i=0; i<shot->h; i++)
+      rows[i] = &shot->pixels[ (shot->h - i - 1) * (3*shot->w) ];
+   write_png( shot->file, rows, shot->w, shot->h, PNG_COLOR_TYPE_RGB, 8 );
+
+   free( rows );
+   free( shot->pixels );
+   free( shot->file );
+   free( shot );
+
+   SDL_mutexP( shot_lock );
+   shot_encoding--;
+   SDL_CondSignal( shot_done );
+   SDL_mutexV( shot_lock );
+   return 0;
+}
+
 
-   /* Allocate data. */
-   w           = gl_screen.rw;
-   h           = gl_screen.rh;
-   screenbuf   = malloc( sizeof(GLubyte) * 3 * w*h );
-   rows        = malloc( sizeof(png_bytep) * h );
+/**
+ * @brief Hands a screenshot over to the threadpool.
+ */
+static void gl_shotEncodeStart( const glShot *s )
+{
+   glShot *shot;
+
+   shot  = malloc( sizeof(glShot) );
+   *shot = *s;
+
+   SDL_mutexP( shot_lock );
+   shot_encoding++;
+   SDL_mutexV( shot_lock );
+   if (threadpool_newJob( gl_shotEncode, shot ))
+      gl_shotEncode( shot ); /* No threadpool, encode right away. */
+}
+
+
+/**
+ * @brief Starts reading back the rendered frame.
+ *
+ *    @param file File to save as.
+ *    @return 0 on success, -1 if too many screenshots are in flight.
+ */
+static int gl_shotRead( const char *file )
+{
+   glShot shot;
+   int n;
+
+   SDL_mutexP( shot_lock );
+   n = shot_encoding;
+   SDL_mutexV( shot_lock );
+   if (shot_pending != NULL)
+      n += array_size( shot_pending );
+   if (n >= SHOT_INFLIGHT)
+      return -1;
+
+   memset( &shot, 0, sizeof(glShot) );
+   shot.file   = strdup( file );
+   shot.w      = gl_screen.rw;
+   shot.h      = gl_screen.rh;
 
-   /* Read pixels from buffer -- SLOW. */
    glPixelStorei(GL_PACK_ALIGNMENT, 1); /* Force them to pack the bytes. */
-   glReadPixels( 0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, screenbuf );
 
-   /* Convert data. */
-   for (i = 0; i < h; i++)
-      rows[i] = &screenbuf[ (h - i - 1) * (3*w) ];
+   /* No buffer objects, read pixels from buffer -- SLOW. */
+   if (!gl_shotHasPBO()) {
+      shot.pixels = malloc( sizeof(GLubyte) * 3 * shot.w*shot.h );
+      glReadPixels( 0, 0, shot.w, shot.h, GL_RGB, GL_UNSIGNED_BYTE, shot.pixels );
+      gl_checkErr();
+      gl_shotEncodeStart( &shot );
+      return 0;
+   }
+
+   /* Copy into a buffer object, only mapping it waits for the GPU. */
+   nglGenBuffers( 1, &shot.pbo );
+   nglBindBuffer( GL_PIXEL_PACK_BUFFER, shot.pbo );
+   nglBufferData( GL_PIXEL_PACK_BUFFER, 3 * shot.w*shot.h, NULL, GL_STREAM_READ );
+   glReadPixels( 0, 0, shot.w, shot.h, GL_RGB, GL_UNSIGNED_BYTE, NULL );
+   nglBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+   if (nglFenceSync != NULL)
+      shot.fence = nglFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+   gl_checkErr();
+
+   if (shot_pending == NULL)
+      shot_pending = array_create( glShot );
+   array_push_back( &shot_pending, shot );
+   return 0;
+}
 
-   /* Save PNG. */
-   write_png( filename, rows, w, h, PNG_COLOR_TYPE_RGB, 8);
 
-   /* Check to see if an error occurred. */
+/**
+ * @brief Copies a screenshot out of its buffer object and starts encoding it.
+ */
+static void gl_shotMap( glShot *shot )
+{
+   void *data;
+
+   nglBindBuffer( GL_PIXEL_PACK_BUFFER, shot->pbo );
+   data = nglMapBuffer( GL_PIXEL_PACK_BUFFER, GL_READ_ONLY );
+   if (data != NULL) {
+      shot->pixels = malloc( sizeof(GLubyte) * 3 * shot->w*shot->h );
+      memcpy( shot->pixels, data, 3 * shot->w*shot->h );
+      nglUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+   }
+   else
+      WARN("Unable to map the buffer of screenshot '%s'.", shot->file);
+   nglBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+   nglDeleteBuffers( 1, &shot->pbo );
+   if (shot->fence != NULL)
+      nglDeleteSync( shot->fence );
    gl_checkErr();
 
-   /* Free memory. */
-   free( screenbuf );
-   free( rows );
+   if (shot->pixels != NULL)
+      gl_shotEncodeStart( shot );
+   else
+      free( shot->file );
+}
+
+
+/**
+ * @brief Captures requested screenshots and collects finished readbacks.
+ *
+ * To be called once the frame is rendered but before it's swapped.
+ */
+void gl_screenshotUpdate (void)
+{
+   char file[PATH_MAX];
+   glShot *shot;
+   GLenum ret;
+   int i, ready;
+
+   /* Capture this frame. */
+   if (shot_queued != NULL) {
+      for (i=0; i<array_size(shot_queued); i++) {
+         if (gl_shotRead( shot_queued[i] ))
+            WARN("Too many screenshots being saved, skipping '%s'.", shot_queued[i]);
+         free( shot_queued[i] );
+      }
+      array_erase( &shot_queued, array_begin(shot_queued), array_end(shot_queued) );
+   }
+   if (shot_burst != NULL) {
+      nsnprintf( file, sizeof(file), "%s%04d.png", shot_burst, shot_burstFrame );
+      if (gl_shotRead( file ))
+         shot_burstDropped++;
+      shot_burstFrame++;
+      shot_burstLeft--;
+      if (shot_burstLeft <= 0)
+         gl_screenshotBurst( NULL, 0 );
+   }
+
+   /* Encode the frames the GPU is done with. */
+   if (shot_pending == NULL)
+      return;
+   for (i=array_size(shot_pending)-1; i>=0; i--) {
+      shot = &shot_pending[i];
+      shot->frames++;
+      if (shot->fence != NULL) {
+         ret   = nglClientWaitSync( shot->fence, 0, 0 );
+         ready = (ret == GL_ALREADY_SIGNALED) || (ret == GL_CONDITION_SATISFIED);
+      }
+      else
+         ready = (shot->frames >= SHOT_FRAMES);
+      if (!ready)
+         continue;
+
+      gl_shotMap( shot );
+      array_erase( &shot_pending, shot, shot+1 );
+   }
+}
+
+
+/**
+ * @brief Finishes saving all the screenshots, blocking.
+ */
+static void gl_screenshotExit (void)
+{
+   int i;
+
+   gl_screenshotBurst( NULL, 0 );
+   if (shot_queued != NULL) {
+      for (i=0; i<array_size(shot_queued); i++)
+         free( shot_queued[i] );
+      array_free( shot_queued );
+      shot_queued = NULL;
+   }
+   if (shot_pending != NULL) {
+      for (i=0; i<array_size(shot_pending); i++)
+         gl_shotMap( &shot_pending[i] );
+      array_free( shot_pending );
+      shot_pending = NULL;
+   }
+
+   /* Wait for the files to be written. */
+   SDL_mutexP( shot_lock );
+   while (shot_encoding > 0)
+      SDL_CondWait( shot_done, shot_lock );
+   SDL_mutexV( shot_lock );
+   SDL_DestroyCond( shot_done );
+   shot_done = NULL;
+   SDL_DestroyMutex( shot_lock );
+   shot_lock = NULL;
+}
+
+
+/**
+ * @brief Marks the end of the commands of the frame for gl_frameWait().
+ */
+void gl_frameFence (void)
+{
+   if (nglFenceSync == NULL)
+      return;
+   if (gl_frameSync != NULL)
+      nglDeleteSync( gl_frameSync );
+   gl_frameSync = nglFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
+
+
+/**
+ * @brief Waits for the GPU to finish the commands up to gl_frameFence().
+ *
+ * Used as a sync point so the driver can't queue frames ahead of the GPU.
+ *  Without fences the whole pipeline is finished instead.
+ */
+void gl_frameWait (void)
+{
+   GLenum ret;
+
+   if (nglFenceSync == NULL) {
+      glFinish();
+      return;
+   }
+   if (gl_frameSync == NULL)
+      return;
+
+   do {
+      ret = nglClientWaitSync( gl_frameSync, GL_SYNC_FLUSH_COMMANDS_BIT,
+            GL_FRAME_WAIT_NS );
+   } while ((ret != GL_ALREADY_SIGNALED) && (ret != GL_CONDITION_SATISFIED) &&
+         (ret != GL_WAIT_FAILED));
+   nglDeleteSync( gl_frameSync );
+   gl_frameSync = NULL;
 }
 
 
@@ -776,6 +1122,9 @@ int gl_init (void)
    /* Set up possible scaling. */
    gl_setupScaling();
 
+   /* Matrices are mirrored from the start so the viewport gets tracked. */
+   gl_initMatrix();
+
    /* Handle setting the default viewport. */
    gl_setDefViewport( 0, 0, gl_screen.rw, gl_screen.rh );
    gl_defViewport();
@@ -791,10 +1140,11 @@ int gl_init (void)
    gl_hint();
 
    /* Initialize subsystems.*/
-   gl_initMatrix();
    gl_initTextures();
    gl_initVBO();
    gl_initRender();
+   shot_lock = SDL_CreateMutex();
+   shot_done = SDL_CreateCond();
 
    /* Get info about the OpenGL window */
    gl_getGLInfo();
@@ -911,6 +1261,13 @@ void gl_windowToScreenPos( int *sx, int *sy, int wx, int wy )
  */
 void gl_exit (void)
 {
+   /* Finish the screenshots while the context is alive. */
+   gl_screenshotExit();
+   if (gl_frameSync != NULL) {
+      nglDeleteSync( gl_frameSync );
+      gl_frameSync = NULL;
+   }
+
    /* Exit the OpenGL subsystems. */
    gl_exitRender();
    gl_exitVBO();
@@ -24,6 +24,8 @@
 #include "opengl_matrix.h"
 #include "opengl_vbo.h"
 #include "opengl_render.h"
+#include "opengl_shader.h"
+#include "opengl_fbo.h"
 
 
 /* Recommended for compatibility and such */
@@ -128,7 +130,12 @@ void gl_setDefViewport( int x, int y, int w, int h );
  */
 double gl_setScale( double scalefactor );
 void gl_screenshot( const char *filename );
+void gl_screenshotBurst( const char *prefix, int frames );
+int gl_screenshotBursting (void);
+void gl_screenshotUpdate (void);
 int SDL_SavePNG( SDL_Surface *surface, const char *file );
+void gl_frameFence (void);
+void gl_frameWait (void);
 #ifdef DEBUGGING
 #define gl_checkErr()   gl_checkHandleError( __func__, __LINE__ )
 void gl_checkHandleError( const char *func, int line );
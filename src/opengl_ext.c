@@ -29,6 +29,11 @@ static int gl_extVBO (void);
 static int gl_extMultitexture (void);
 static int gl_extMipmaps (void);
 static int gl_extCompression (void);
+static int gl_extShaders (void);
+static int gl_extFramebuffers (void);
+static int gl_extSync (void);
+static int gl_extMapRange (void);
+static int gl_extTimer (void);
 
 
 /**
@@ -165,16 +170,21 @@ static int gl_extCompression (void)
    int i, found;
    GLint num, *ext;
 
+   nglGetCompressedTexImage = NULL;
    if (!conf.compress) {
       nglCompressedTexImage2D = NULL;
       return 0;
    }
 
    /* Find the extension. */
-   if (gl_hasVersion( 1, 3 ))
-      nglCompressedTexImage2D = gl_extGetProc("glCompressedTexImage2D");
-   else if (gl_hasExt("GL_ARB_texture_compression"))
-      nglCompressedTexImage2D = gl_extGetProc("glCompressedTexImage2DARB");
+   if (gl_hasVersion( 1, 3 )) {
+      nglCompressedTexImage2D  = gl_extGetProc("glCompressedTexImage2D");
+      nglGetCompressedTexImage = gl_extGetProc("glGetCompressedTexImage");
+   }
+   else if (gl_hasExt("GL_ARB_texture_compression")) {
+      nglCompressedTexImage2D  = gl_extGetProc("glCompressedTexImage2DARB");
+      nglGetCompressedTexImage = gl_extGetProc("glGetCompressedTexImageARB");
+   }
    else {
       nglCompressedTexImage2D = NULL;
       WARN("GL_ARB_texture_compression not found.");
@@ -198,10 +208,173 @@ static int gl_extCompression (void)
 
    /* Not supported. */
    if (found == 0) {
-      nglCompressedTexImage2D = NULL;
+      nglCompressedTexImage2D  = NULL;
+      nglGetCompressedTexImage = NULL;
+      return -1;
+   }
+
+   return 0;
+}
+
+
+/**
+ * @brief Loads the OpenGL 2.0 shader functions.
+ */
+static int gl_extShaders (void)
+{
+   if (!conf.shaders || !gl_hasVersion( 2, 0 )) {
+      nglCreateShader   = NULL;
+      nglUseProgram     = NULL;
+      return -1;
+   }
+
+   nglCreateShader         = gl_extGetProc("glCreateShader");
+   nglShaderSource         = gl_extGetProc("glShaderSource");
+   nglCompileShader        = gl_extGetProc("glCompileShader");
+   nglGetShaderiv          = gl_extGetProc("glGetShaderiv");
+   nglGetShaderInfoLog     = gl_extGetProc("glGetShaderInfoLog");
+   nglDeleteShader         = gl_extGetProc("glDeleteShader");
+   nglCreateProgram        = gl_extGetProc("glCreateProgram");
+   nglAttachShader         = gl_extGetProc("glAttachShader");
+   nglLinkProgram          = gl_extGetProc("glLinkProgram");
+   nglGetProgramiv         = gl_extGetProc("glGetProgramiv");
+   nglGetProgramInfoLog    = gl_extGetProc("glGetProgramInfoLog");
+   nglUseProgram           = gl_extGetProc("glUseProgram");
+   nglDeleteProgram        = gl_extGetProc("glDeleteProgram");
+   nglGetUniformLocation   = gl_extGetProc("glGetUniformLocation");
+   nglUniform1i            = gl_extGetProc("glUniform1i");
+   nglUniform2f            = gl_extGetProc("glUniform2f");
+   nglUniform4f            = gl_extGetProc("glUniform4f");
+   nglUniformMatrix4fv     = gl_extGetProc("glUniformMatrix4fv");
+
+   /* All or nothing. */
+   if ((nglCreateShader == NULL) || (nglShaderSource == NULL) ||
+         (nglCompileShader == NULL) || (nglGetShaderiv == NULL) ||
+         (nglGetShaderInfoLog == NULL) || (nglDeleteShader == NULL) ||
+         (nglCreateProgram == NULL) || (nglAttachShader == NULL) ||
+         (nglLinkProgram == NULL) || (nglGetProgramiv == NULL) ||
+         (nglGetProgramInfoLog == NULL) || (nglUseProgram == NULL) ||
+         (nglDeleteProgram == NULL) || (nglGetUniformLocation == NULL) ||
+         (nglUniform1i == NULL) || (nglUniform2f == NULL) ||
+         (nglUniform4f == NULL) || (nglUniformMatrix4fv == NULL)) {
+      nglCreateShader   = NULL;
+      nglUseProgram     = NULL;
+      return -1;
+   }
+   return 0;
+}
+
+
+/**
+ * @brief Loads the framebuffer object functions.
+ *
+ * Core names are used with OpenGL 3.0 or GL_ARB_framebuffer_object, else the
+ *  GL_EXT_framebuffer_object ones which take the same enumerations.
+ */
+static int gl_extFramebuffers (void)
+{
+   nglGenFramebuffers     = NULL;
+   nglBlendFuncSeparate   = NULL;
+   if (!conf.fbo)
+      return -1;
+
+   if (gl_hasVersion( 3, 0 ) || gl_hasExt("GL_ARB_framebuffer_object")) {
+      nglGenFramebuffers         = gl_extGetProc("glGenFramebuffers");
+      nglBindFramebuffer         = gl_extGetProc("glBindFramebuffer");
+      nglFramebufferTexture2D    = gl_extGetProc("glFramebufferTexture2D");
+      nglCheckFramebufferStatus  = gl_extGetProc("glCheckFramebufferStatus");
+      nglDeleteFramebuffers      = gl_extGetProc("glDeleteFramebuffers");
+   }
+   else if (gl_hasExt("GL_EXT_framebuffer_object")) {
+      nglGenFramebuffers         = gl_extGetProc("glGenFramebuffersEXT");
+      nglBindFramebuffer         = gl_extGetProc("glBindFramebufferEXT");
+      nglFramebufferTexture2D    = gl_extGetProc("glFramebufferTexture2DEXT");
+      nglCheckFramebufferStatus  = gl_extGetProc("glCheckFramebufferStatusEXT");
+      nglDeleteFramebuffers      = gl_extGetProc("glDeleteFramebuffersEXT");
+   }
+   else
+      return -1;
+
+   /* All or nothing. */
+   if ((nglGenFramebuffers == NULL) || (nglBindFramebuffer == NULL) ||
+         (nglFramebufferTexture2D == NULL) ||
+         (nglCheckFramebufferStatus == NULL) ||
+         (nglDeleteFramebuffers == NULL)) {
+      nglGenFramebuffers = NULL;
       return -1;
    }
 
+   /* Keeps the alpha of cached renders right, optional otherwise. */
+   if (gl_hasVersion( 1, 4 ))
+      nglBlendFuncSeparate = gl_extGetProc("glBlendFuncSeparate");
+   else if (gl_hasExt("GL_EXT_blend_func_separate"))
+      nglBlendFuncSeparate = gl_extGetProc("glBlendFuncSeparateEXT");
+   return 0;
+}
+
+
+/**
+ * @brief Loads the fence functions.
+ */
+static int gl_extSync (void)
+{
+   nglFenceSync      = NULL;
+   if (!gl_hasVersion( 3, 2 ) && !gl_hasExt("GL_ARB_sync"))
+      return -1;
+
+   nglFenceSync      = gl_extGetProc("glFenceSync");
+   nglClientWaitSync = gl_extGetProc("glClientWaitSync");
+   nglDeleteSync     = gl_extGetProc("glDeleteSync");
+
+   /* All or nothing. */
+   if ((nglFenceSync == NULL) || (nglClientWaitSync == NULL) ||
+         (nglDeleteSync == NULL)) {
+      nglFenceSync = NULL;
+      return -1;
+   }
+   return 0;
+}
+
+
+/**
+ * @brief Loads the buffer range mapping function.
+ */
+static int gl_extMapRange (void)
+{
+   nglMapBufferRange = NULL;
+   if (nglBindBuffer == NULL)
+      return -1;
+   if (!gl_hasVersion( 3, 0 ) && !gl_hasExt("GL_ARB_map_buffer_range"))
+      return -1;
+
+   nglMapBufferRange = gl_extGetProc("glMapBufferRange");
+   return (nglMapBufferRange == NULL) ? -1 : 0;
+}
+
+
+/**
+ * @brief Loads the timer query functions.
+ */
+static int gl_extTimer (void)
+{
+   nglGenQueries = NULL;
+   if (!gl_hasVersion( 3, 3 ) && !gl_hasExt("GL_ARB_timer_query"))
+      return -1;
+
+   nglGenQueries           = gl_extGetProc("glGenQueries");
+   nglDeleteQueries        = gl_extGetProc("glDeleteQueries");
+   nglBeginQuery           = gl_extGetProc("glBeginQuery");
+   nglEndQuery             = gl_extGetProc("glEndQuery");
+   nglGetQueryObjectiv     = gl_extGetProc("glGetQueryObjectiv");
+   nglGetQueryObjectui64v  = gl_extGetProc("glGetQueryObjectui64v");
+
+   /* All or nothing. */
+   if ((nglGenQueries == NULL) || (nglDeleteQueries == NULL) ||
+         (nglBeginQuery == NULL) || (nglEndQuery == NULL) ||
+         (nglGetQueryObjectiv == NULL) || (nglGetQueryObjectui64v == NULL)) {
+      nglGenQueries = NULL;
+      return -1;
+   }
    return 0;
 }
 
@@ -217,6 +390,11 @@ int gl_initExtensions (void)
    gl_extVBO();
    gl_extMipmaps();
    gl_extCompression();
+   gl_extShaders();
+   gl_extFramebuffers();
+   gl_extSync();
+   gl_extMapRange();
+   gl_extTimer();
 
    return 0;
 }
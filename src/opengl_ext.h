@@ -7,6 +7,8 @@
 #  define OPENGL_EXT_H
 
 
+#include <stdint.h>
+
 #include "SDL_opengl.h"
 
 /* GL_SGIS_generate_mipmap */
@@ -26,8 +28,55 @@ void* (APIENTRY *nglMapBuffer)(GLenum target, GLenum access);
 void (APIENTRY *nglUnmapBuffer)(GLenum target);
 void (APIENTRY *nglDeleteBuffers)(GLsizei n, const GLuint* ids);
 
+/* GL_ARB_map_buffer_range */
+void* (APIENTRY *nglMapBufferRange)(GLenum target, intptr_t offset, intptr_t length, GLbitfield access);
+
 /* GL_ARB_texture_compression */
 void (APIENTRY *nglCompressedTexImage2D)(GLenum, GLint, GLenum, GLsizei, GLsizei, GLint, GLsizei, const GLvoid *);
+void (APIENTRY *nglGetCompressedTexImage)(GLenum, GLint, GLvoid *);
+
+/* OpenGL 2.0 shaders */
+GLuint (APIENTRY *nglCreateShader)(GLenum type);
+void (APIENTRY *nglShaderSource)(GLuint shader, GLsizei count, const GLchar **string, const GLint *length);
+void (APIENTRY *nglCompileShader)(GLuint shader);
+void (APIENTRY *nglGetShaderiv)(GLuint shader, GLenum pname, GLint *params);
+void (APIENTRY *nglGetShaderInfoLog)(GLuint shader, GLsizei bufsize, GLsizei *length, GLchar *log);
+void (APIENTRY *nglDeleteShader)(GLuint shader);
+GLuint (APIENTRY *nglCreateProgram)(void);
+void (APIENTRY *nglAttachShader)(GLuint program, GLuint shader);
+void (APIENTRY *nglLinkProgram)(GLuint program);
+void (APIENTRY *nglGetProgramiv)(GLuint program, GLenum pname, GLint *params);
+void (APIENTRY *nglGetProgramInfoLog)(GLuint program, GLsizei bufsize, GLsizei *length, GLchar *log);
+void (APIENTRY *nglUseProgram)(GLuint program);
+void (APIENTRY *nglDeleteProgram)(GLuint program);
+GLint (APIENTRY *nglGetUniformLocation)(GLuint program, const GLchar *name);
+void (APIENTRY *nglUniform1i)(GLint location, GLint v0);
+void (APIENTRY *nglUniform2f)(GLint location, GLfloat v0, GLfloat v1);
+void (APIENTRY *nglUniform4f)(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3);
+void (APIENTRY *nglUniformMatrix4fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
+
+/* GL_ARB_framebuffer_object / GL_EXT_framebuffer_object */
+void (APIENTRY *nglGenFramebuffers)(GLsizei n, GLuint *ids);
+void (APIENTRY *nglBindFramebuffer)(GLenum target, GLuint id);
+void (APIENTRY *nglFramebufferTexture2D)(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
+GLenum (APIENTRY *nglCheckFramebufferStatus)(GLenum target);
+void (APIENTRY *nglDeleteFramebuffers)(GLsizei n, const GLuint *ids);
+
+/* GL_ARB_sync, fences are passed around as opaque pointers. */
+void* (APIENTRY *nglFenceSync)(GLenum condition, GLbitfield flags);
+GLenum (APIENTRY *nglClientWaitSync)(void *sync, GLbitfield flags, uint64_t timeout);
+void (APIENTRY *nglDeleteSync)(void *sync);
+
+/* GL_ARB_timer_query */
+void (APIENTRY *nglGenQueries)(GLsizei n, GLuint *ids);
+void (APIENTRY *nglDeleteQueries)(GLsizei n, const GLuint *ids);
+void (APIENTRY *nglBeginQuery)(GLenum target, GLuint id);
+void (APIENTRY *nglEndQuery)(GLenum target);
+void (APIENTRY *nglGetQueryObjectiv)(GLuint id, GLenum pname, GLint *params);
+void (APIENTRY *nglGetQueryObjectui64v)(GLuint id, GLenum pname, uint64_t *params);
+
+/* GL_EXT_blend_func_separate */
+void (APIENTRY *nglBlendFuncSeparate)(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha);
 
 
 /*
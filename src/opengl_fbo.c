@@ -0,0 +1,296 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file opengl_fbo.c
+ *
+ * @brief Handles rendering to textures with framebuffer objects.
+ *
+ * Framebuffers are optional, anything using them must keep a direct rendering
+ *  path for when gl_hasFbo() is false or creation fails.
+ *
+ * Framebuffers can be created at a fraction of the screen resolution for
+ *  fill-rate bound effects, they are then filtered when drawn back.
+ *
+ * Renders into a framebuffer keep screen coordinates, only the area starting
+ *  at the position passed to gl_fboBegin() is kept and only the region passed
+ *  is touched, the rest keeps what was rendered before. The texture ends up
+ *  with premultiplied alpha so it composites like the original rendering would.
+ */
+
+
+#include "opengl_fbo.h"
+
+#include "naev.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "log.h"
+
+
+static glFbo *fbo_active   = NULL; /**< Framebuffer being rendered to. */
+static double fbo_x        = 0.; /**< X position of the active framebuffer. */
+static double fbo_y        = 0.; /**< Y position of the active framebuffer. */
+static int fbo_region[4]; /**< Region being rendered to in screen coordinates. */
+static GLint fbo_view[4]; /**< Viewport to restore. */
+static GLfloat fbo_clear[4]; /**< Clear colour to restore. */
+
+
+/**
+ * @brief Checks to see if framebuffer objects are supported.
+ *
+ *    @return 1 if framebuffers can be created.
+ */
+int gl_hasFbo (void)
+{
+   return (nglGenFramebuffers != NULL) && (nglBlendFuncSeparate != NULL);
+}
+
+
+/**
+ * @brief Creates a framebuffer object.
+ *
+ *    @param w Width in screen coordinates.
+ *    @param h Height in screen coordinates.
+ *    @return The framebuffer or NULL on error.
+ */
+glFbo* gl_fboCreate( int w, int h )
+{
+   return gl_fboCreateScaled( w, h, 1 );
+}
+
+
+/**
+ * @brief Creates a framebuffer object at a reduced resolution.
+ *
+ *    @param w Width in screen coordinates.
+ *    @param h Height in screen coordinates.
+ *    @param scale Screen pixels per texel, bilinear filtered if more than 1.
+ *    @return The framebuffer or NULL on error.
+ */
+glFbo* gl_fboCreateScaled( int w, int h, int scale )
+{
+   glFbo *fbo;
+   GLenum status;
+   GLint filter;
+   int pw, ph;
+
+   if (!gl_hasFbo() || (w <= 0) || (h <= 0) || (scale < 1))
+      return NULL;
+
+   /* Real pixel size. */
+   pw = (int)ceil( (double)w / (gl_screen.mxscale * scale) );
+   ph = (int)ceil( (double)h / (gl_screen.myscale * scale) );
+   if (gl_needPOT()) {
+      pw = gl_pot( pw );
+      ph = gl_pot( ph );
+   }
+   if ((pw > gl_screen.tex_max) || (ph > gl_screen.tex_max))
+      return NULL;
+
+   fbo = calloc( 1, sizeof(glFbo) );
+   fbo->w  = w;
+   fbo->h  = h;
+   fbo->pw = pw;
+   fbo->ph = ph;
+   fbo->scale = scale;
+
+   /* Texture. */
+   filter = (scale > 1) ? GL_LINEAR : GL_NEAREST;
+   glGenTextures( 1, &fbo->tex.texture );
+   glBindTexture( GL_TEXTURE_2D, fbo->tex.texture );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+   glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, pw, ph, 0,
+         GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+   glBindTexture( GL_TEXTURE_2D, 0 );
+
+   /* Texture covers the whole padded area. */
+   fbo->tex.rw  = pw * gl_screen.mxscale * scale;
+   fbo->tex.rh  = ph * gl_screen.myscale * scale;
+   fbo->tex.w   = fbo->tex.rw;
+   fbo->tex.h   = fbo->tex.rh;
+   fbo->tex.sx  = 1.;
+   fbo->tex.sy  = 1.;
+   fbo->tex.sw  = fbo->tex.w;
+   fbo->tex.sh  = fbo->tex.h;
+   fbo->tex.srw = 1.;
+   fbo->tex.srh = 1.;
+
+   /* Framebuffer. */
+   nglGenFramebuffers( 1, &fbo->fbo );
+   nglBindFramebuffer( GL_FRAMEBUFFER, fbo->fbo );
+   nglFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+         GL_TEXTURE_2D, fbo->tex.texture, 0 );
+   status = nglCheckFramebufferStatus( GL_FRAMEBUFFER );
+   nglBindFramebuffer( GL_FRAMEBUFFER, 0 );
+   if (status != GL_FRAMEBUFFER_COMPLETE) {
+      WARN("Framebuffer of %dx%d incomplete (0x%04x).", pw, ph, status);
+      gl_fboFree( fbo );
+      return NULL;
+   }
+
+   gl_checkErr();
+   return fbo;
+}
+
+
+/**
+ * @brief Frees a framebuffer object.
+ *
+ *    @param fbo Framebuffer to free.
+ */
+void gl_fboFree( glFbo *fbo )
+{
+   if (fbo == NULL)
+      return;
+   if (fbo == fbo_active)
+      gl_fboEnd();
+   if (fbo->fbo != 0)
+      nglDeleteFramebuffers( 1, &fbo->fbo );
+   if (fbo->tex.texture != 0)
+      glDeleteTextures( 1, &fbo->tex.texture );
+   free( fbo );
+}
+
+
+/**
+ * @brief Starts rendering to a framebuffer object.
+ *
+ * Framebuffers do not nest, the caller must render directly if this fails.
+ *
+ *    @param fbo Framebuffer to render to.
+ *    @param x X position in screen coordinates mapped to its left edge.
+ *    @param y Y position in screen coordinates mapped to its bottom edge.
+ *    @param rx X position of the region to clear and render to.
+ *    @param ry Y position of the region to clear and render to.
+ *    @param rw Width of the region to clear and render to.
+ *    @param rh Height of the region to clear and render to.
+ *    @return 0 on success.
+ */
+int gl_fboBegin( glFbo *fbo, double x, double y,
+      int rx, int ry, int rw, int rh )
+{
+   if (fbo_active != NULL)
+      return -1;
+
+   fbo_active     = fbo;
+   fbo_x          = x;
+   fbo_y          = y;
+   fbo_region[0]  = rx;
+   fbo_region[1]  = ry;
+   fbo_region[2]  = rw;
+   fbo_region[3]  = rh;
+
+   /* Save state. */
+   glGetIntegerv( GL_VIEWPORT, fbo_view );
+   glGetFloatv( GL_COLOR_CLEAR_VALUE, fbo_clear );
+
+   nglBindFramebuffer( GL_FRAMEBUFFER, fbo->fbo );
+   glViewport( 0, 0, fbo->pw, fbo->ph );
+
+   /* Same units as the screen. */
+   gl_matrixPush();
+      gl_matrixIdentity();
+      gl_matrixOrtho( x, x + fbo->tex.rw, y, y + fbo->tex.rh, -1., 1. );
+
+   /* Only clear the region. */
+   gl_fboUnclip();
+   glClearColor( 0., 0., 0., 0. );
+   glClear( GL_COLOR_BUFFER_BIT );
+
+   /* Accumulate alpha so the result is premultiplied. */
+   nglBlendFuncSeparate( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+         GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
+
+   gl_checkErr();
+   return 0;
+}
+
+
+/**
+ * @brief Stops rendering to the active framebuffer object.
+ */
+void gl_fboEnd (void)
+{
+   if (fbo_active == NULL)
+      return;
+
+   glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+   gl_matrixPop();
+   nglBindFramebuffer( GL_FRAMEBUFFER, 0 );
+   glViewport( fbo_view[0], fbo_view[1], fbo_view[2], fbo_view[3] );
+   glClearColor( fbo_clear[0], fbo_clear[1], fbo_clear[2], fbo_clear[3] );
+
+   fbo_active = NULL;
+   gl_unclipRect();
+   gl_checkErr();
+}
+
+
+/**
+ * @brief Checks to see if rendering to a framebuffer object.
+ *
+ *    @return 1 if between gl_fboBegin() and gl_fboEnd().
+ */
+int gl_fboActive (void)
+{
+   return (fbo_active != NULL);
+}
+
+
+/**
+ * @brief Clips rendering to the active framebuffer object.
+ *
+ * The rectangle is further limited to the region being rendered.
+ *
+ *    @param x X position of the rectangle in screen coordinates.
+ *    @param y Y position of the rectangle in screen coordinates.
+ *    @param w Width of the rectangle.
+ *    @param h Height of the rectangle.
+ */
+void gl_fboClip( int x, int y, int w, int h )
+{
+   double x1, y1, x2, y2;
+
+   x1 = MAX( x, fbo_region[0] );
+   y1 = MAX( y, fbo_region[1] );
+   x2 = MIN( x + w, fbo_region[0] + fbo_region[2] );
+   y2 = MIN( y + h, fbo_region[1] + fbo_region[3] );
+   x1 = floor( (x1 - fbo_x) / (gl_screen.mxscale * fbo_active->scale) );
+   y1 = floor( (y1 - fbo_y) / (gl_screen.myscale * fbo_active->scale) );
+   x2 = ceil( (x2 - fbo_x) / (gl_screen.mxscale * fbo_active->scale) );
+   y2 = ceil( (y2 - fbo_y) / (gl_screen.myscale * fbo_active->scale) );
+
+   glScissor( x1, y1, MAX( 0., x2-x1 ), MAX( 0., y2-y1 ) );
+   glEnable( GL_SCISSOR_TEST );
+}
+
+
+/**
+ * @brief Clips rendering to the region of the active framebuffer object.
+ */
+void gl_fboUnclip (void)
+{
+   gl_fboClip( fbo_region[0], fbo_region[1], fbo_region[2], fbo_region[3] );
+}
+
+
+/**
+ * @brief Draws what was rendered to a framebuffer object.
+ *
+ *    @param fbo Framebuffer to draw.
+ *    @param x X position of its left edge in screen coordinates.
+ *    @param y Y position of its bottom edge in screen coordinates.
+ */
+void gl_fboRender( const glFbo *fbo, double x, double y )
+{
+   glBlendFunc( GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
+   gl_blitTexture( &fbo->tex, x, y, fbo->tex.rw, fbo->tex.rh,
+         0., 0., 1., 1., NULL );
+   glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+}
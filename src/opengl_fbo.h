@@ -0,0 +1,58 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef OPENGL_FBO_H
+#  define OPENGL_FBO_H
+
+
+#include "opengl.h"
+
+
+#ifndef GL_FRAMEBUFFER
+#define GL_FRAMEBUFFER           0x8D40 /**< Same as GL_FRAMEBUFFER_EXT. */
+#endif /* GL_FRAMEBUFFER */
+#ifndef GL_COLOR_ATTACHMENT0
+#define GL_COLOR_ATTACHMENT0     0x8CE0 /**< Same as GL_COLOR_ATTACHMENT0_EXT. */
+#endif /* GL_COLOR_ATTACHMENT0 */
+#ifndef GL_FRAMEBUFFER_COMPLETE
+#define GL_FRAMEBUFFER_COMPLETE  0x8CD5 /**< Same as GL_FRAMEBUFFER_COMPLETE_EXT. */
+#endif /* GL_FRAMEBUFFER_COMPLETE */
+
+
+/**
+ * @brief Framebuffer object rendering to a texture.
+ */
+typedef struct glFbo_ {
+   GLuint fbo; /**< OpenGL framebuffer object. */
+   glTexture tex; /**< Texture rendered to, not to be freed with gl_freeTexture. */
+   int w; /**< Width in screen coordinates. */
+   int h; /**< Height in screen coordinates. */
+   int pw; /**< Width of the texture in pixels. */
+   int ph; /**< Height of the texture in pixels. */
+   int scale; /**< Screen pixels per texel. */
+} glFbo;
+
+
+/*
+ * Creation.
+ */
+int gl_hasFbo (void);
+glFbo* gl_fboCreate( int w, int h );
+glFbo* gl_fboCreateScaled( int w, int h, int scale );
+void gl_fboFree( glFbo *fbo );
+
+/*
+ * Rendering.
+ */
+int gl_fboBegin( glFbo *fbo, double x, double y,
+      int rx, int ry, int rw, int rh );
+void gl_fboEnd (void);
+int gl_fboActive (void);
+void gl_fboClip( int x, int y, int w, int h );
+void gl_fboUnclip (void);
+void gl_fboRender( const glFbo *fbo, double x, double y );
+
+
+#endif /* OPENGL_FBO_H */
@@ -6,6 +6,10 @@
  * @file opengl_matrix.c
  *
  * @brief Handles OpenGL matrix stuff.
+ *
+ * The projection and modelview stacks are mirrored on the CPU so shader
+ *  programs can get the transform as a uniform instead of relying on the
+ *  fixed function matrices.
  */
 
 
@@ -13,12 +17,78 @@
 
 #include "naev.h"
 
+#include <string.h>
+
 #include "log.h"
 
 
+#define MATRIX_DEPTH    32 /**< Depth of each matrix stack. */
+
+
+/**
+ * @brief Column-major 4x4 matrix.
+ */
+typedef struct glMatrix_ {
+   double m[16]; /**< Elements, column-major like OpenGL. */
+} glMatrix;
+
+
 static int has_glsl = 0; /**< Whether or not using GLSL for matrix stuff. */
+static glMatrix matrix_stack[2][MATRIX_DEPTH]; /**< Projection and modelview stacks. */
+static int matrix_top[2] = { 0, 0 }; /**< Top of each stack. */
+static int matrix_mode   = 0; /**< Current stack, 0 for projection and 1 for modelview. */
 
 
+/*
+ * Prototypes.
+ */
+static void gl_matrixSetIdentity( glMatrix *m );
+static void gl_matrixMult( glMatrix *m, const glMatrix *b );
+static glMatrix* gl_matrixCur (void);
+
+
+/**
+ * @brief Sets a matrix to identity.
+ */
+static void gl_matrixSetIdentity( glMatrix *m )
+{
+   memset( m->m, 0, sizeof(m->m) );
+   m->m[0]  = 1.;
+   m->m[5]  = 1.;
+   m->m[10] = 1.;
+   m->m[15] = 1.;
+}
+
+
+/**
+ * @brief Multiplies a matrix on the right like OpenGL does, m = m*b.
+ */
+static void gl_matrixMult( glMatrix *m, const glMatrix *b )
+{
+   glMatrix r;
+   int i, j, k;
+   double s;
+
+   for (j=0; j<4; j++) {
+      for (i=0; i<4; i++) {
+         s = 0.;
+         for (k=0; k<4; k++)
+            s += m->m[k*4+i] * b->m[j*4+k];
+         r.m[j*4+i] = s;
+      }
+   }
+   *m = r;
+}
+
+
+/**
+ * @brief Gets the matrix on top of the current stack.
+ */
+static glMatrix* gl_matrixCur (void)
+{
+   return &matrix_stack[ matrix_mode ][ matrix_top[ matrix_mode ] ];
+}
+
 
 /**
  * @brief Initializes the OpenGL matrix subsystem.
@@ -27,6 +97,11 @@ static int has_glsl = 0; /**< Whether or not using GLSL for matrix stuff. */
  */
 int gl_initMatrix (void)
 {
+   matrix_mode   = 0;
+   matrix_top[0] = 0;
+   matrix_top[1] = 0;
+   gl_matrixSetIdentity( &matrix_stack[0][0] );
+   gl_matrixSetIdentity( &matrix_stack[1][0] );
    return 0;
 }
 
@@ -45,11 +120,9 @@ void gl_exitMatrix (void)
  */
 void gl_matrixMode( GLenum mode )
 {
-   if (has_glsl) {
-   }
-   else {
+   matrix_mode = (mode == GL_MODELVIEW) ? 1 : 0;
+   if (!has_glsl)
       glMatrixMode( mode );
-   }
 }
 
 
@@ -58,11 +131,18 @@ void gl_matrixMode( GLenum mode )
  */
 void gl_matrixPush (void)
 {
-   if (has_glsl) {
-   }
+   glMatrix *m;
+
+   if (matrix_top[ matrix_mode ] >= MATRIX_DEPTH-1)
+      WARN("Matrix stack overflow!");
    else {
-      glPushMatrix();
+      m = gl_matrixCur();
+      matrix_top[ matrix_mode ]++;
+      *gl_matrixCur() = *m;
    }
+
+   if (!has_glsl)
+      glPushMatrix();
 }
 
 
@@ -71,11 +151,9 @@ void gl_matrixPush (void)
  */
 void gl_matrixIdentity (void)
 {
-   if (has_glsl) {
-   }
-   else {
+   gl_matrixSetIdentity( gl_matrixCur() );
+   if (!has_glsl)
       glLoadIdentity();
-   }
 }
 
 
@@ -85,11 +163,19 @@ void gl_matrixIdentity (void)
 void gl_matrixOrtho( double left, double right,
       double bottom, double top, double nearVal, double farVal )
 {
-   if (has_glsl) {
-   }
-   else {
+   glMatrix o;
+
+   gl_matrixSetIdentity( &o );
+   o.m[0]  = 2. / (right - left);
+   o.m[5]  = 2. / (top - bottom);
+   o.m[10] = -2. / (farVal - nearVal);
+   o.m[12] = -(right + left) / (right - left);
+   o.m[13] = -(top + bottom) / (top - bottom);
+   o.m[14] = -(farVal + nearVal) / (farVal - nearVal);
+   gl_matrixMult( gl_matrixCur(), &o );
+
+   if (!has_glsl)
       glOrtho( left, right, bottom, top, nearVal, farVal );
-   }
 }
 
 
@@ -101,11 +187,17 @@ void gl_matrixOrtho( double left, double right,
  */
 void gl_matrixTranslate( double x, double y )
 {
-   if (has_glsl) {
-   }
-   else {
+   glMatrix *m;
+
+   /* Only the last column changes. */
+   m = gl_matrixCur();
+   m->m[12] += m->m[0]*x + m->m[4]*y;
+   m->m[13] += m->m[1]*x + m->m[5]*y;
+   m->m[14] += m->m[2]*x + m->m[6]*y;
+   m->m[15] += m->m[3]*x + m->m[7]*y;
+
+   if (!has_glsl)
       glTranslated( x, y, 0. );
-   }
 }
 
 
@@ -117,11 +209,17 @@ void gl_matrixTranslate( double x, double y )
  */
 void gl_matrixScale( double x, double y )
 {
-   if (has_glsl) {
+   glMatrix *m;
+   int i;
+
+   m = gl_matrixCur();
+   for (i=0; i<4; i++) {
+      m->m[i]   *= x;
+      m->m[4+i] *= y;
    }
-   else {
+
+   if (!has_glsl)
       glScaled( x, y, 1. );
-   }
 }
 
 
@@ -132,11 +230,20 @@ void gl_matrixScale( double x, double y )
  */
 void gl_matrixRotate( double a )
 {
-   if (has_glsl) {
-   }
-   else {
+   glMatrix r;
+   double c, s;
+
+   c = cos(a);
+   s = sin(a);
+   gl_matrixSetIdentity( &r );
+   r.m[0] = c;
+   r.m[1] = s;
+   r.m[4] = -s;
+   r.m[5] = c;
+   gl_matrixMult( gl_matrixCur(), &r );
+
+   if (!has_glsl)
       glRotated( 180./M_PI*a, 0., 0., 1. );
-   }
 }
 
 
@@ -145,9 +252,30 @@ void gl_matrixRotate( double a )
  */
 void gl_matrixPop (void)
 {
-   if (has_glsl) {
-   }
-   else {
+   if (matrix_top[ matrix_mode ] <= 0)
+      WARN("Matrix stack underflow!");
+   else
+      matrix_top[ matrix_mode ]--;
+
+   if (!has_glsl)
       glPopMatrix();
-   }
+}
+
+
+/**
+ * @brief Gets the projection times the modelview matrix.
+ *
+ * This is what gl_ModelViewProjectionMatrix would be for shaders.
+ *
+ *    @param[out] mvp Column-major matrix to set.
+ */
+void gl_matrixGetMVP( GLfloat mvp[16] )
+{
+   glMatrix m;
+   int i;
+
+   m = matrix_stack[0][ matrix_top[0] ];
+   gl_matrixMult( &m, &matrix_stack[1][ matrix_top[1] ] );
+   for (i=0; i<16; i++)
+      mvp[i] = (GLfloat) m.m[i];
 }
@@ -41,5 +41,11 @@ void gl_matrixScale( double x, double y );
 void gl_matrixRotate( double a );
 
 
+/*
+ * Shader access.
+ */
+void gl_matrixGetMVP( GLfloat mvp[16] );
+
+
 #endif /* OPENGL_MATRIX_H */
 
@@ -38,12 +38,51 @@
 #include "nstring.h"
 
 
-#define OPENGL_RENDER_VBO_SIZE      256 /**< Size of VBO. */
+#define OPENGL_RENDER_VBO_SIZE      256 /**< Maximum vertices of a primitive. */
+#define OPENGL_BATCH_CHUNK          256 /**< Amount of quads to grow the batch by. */
+#define OPENGL_BATCH_LOOKBACK       32 /**< Texture runs a quad may move back over. */
 
 
-static gl_vbo *gl_renderVBO = 0; /**< VBO for rendering stuff. */
-static int gl_renderVBOtexOffset = 0; /**< VBO texture offset. */
-static int gl_renderVBOcolOffset = 0; /**< VBO colour offset. */
+/**
+ * @brief A textured quad queued in the sprite batch.
+ */
+typedef struct glBatchQuad_ {
+   GLuint texture; /**< Texture to draw with. */
+   GLuint texture2; /**< Texture to interpolate with or 0. */
+   GLfloat inter; /**< Amount of texture to mix with texture2. */
+   int run; /**< Run it is drawn in. */
+   GLfloat vertex[4*2]; /**< Vertex positions. */
+   GLfloat tex[4*2]; /**< Texture coordinates. */
+   GLfloat col[4*4]; /**< Colour of each vertex. */
+} glBatchQuad;
+
+
+/**
+ * @brief Quads of the sprite batch drawn together with the same textures.
+ */
+typedef struct glBatchRun_ {
+   GLuint texture; /**< Texture to draw with. */
+   GLuint texture2; /**< Texture to interpolate with or 0. */
+   GLfloat x0; /**< Left of the bounding box of the quads. */
+   GLfloat y0; /**< Bottom of the bounding box of the quads. */
+   GLfloat x1; /**< Right of the bounding box of the quads. */
+   GLfloat y1; /**< Top of the bounding box of the quads. */
+   int start; /**< First quad of the run in the uploaded data. */
+   int n; /**< Number of quads. */
+} glBatchRun;
+
+
+/*
+ * Sprite batching.
+ */
+static int gl_batchDepth         = 0; /**< Nesting depth of gl_batchBegin. */
+static glBatchQuad *gl_batchQuads = NULL; /**< Queued quads. */
+static int gl_batchNQuads        = 0; /**< Number of queued quads. */
+static int gl_batchMQuads        = 0; /**< Memory allocated for quads. */
+static GLfloat *gl_batchData     = NULL; /**< Scratch data uploaded to the VBO. */
+static int gl_batchMData         = 0; /**< Memory allocated for the scratch data (quads). */
+static glBatchRun *gl_batchRuns   = NULL; /**< Runs of the batch being drawn. */
+static int gl_batchMRuns         = 0; /**< Memory allocated for runs. */
 
 
 /*
@@ -57,6 +96,13 @@ static glTexture *gl_circle      = NULL; /**< Circle mipmap. */
  */
 static void gl_drawCircleEmpty( const double cx, const double cy,
       const double r, const glColour *c );
+static int gl_batchRunsBuild( int n );
+static glBatchQuad* gl_batchNew( GLuint texture );
+static void gl_batchAdd( const glTexture* texture,
+      const double x, const double y,
+      const double w, const double h,
+      const double tx, const double ty,
+      const double tw, const double th, const glColour *c );
 static void gl_blitTextureInterpolate(  const glTexture* ta,
       const glTexture* tb, const double inter,
       const double x, const double y,
@@ -76,7 +122,10 @@ static void gl_blitTextureInterpolate(  const glTexture* ta,
  */
 void gl_renderRect( double x, double y, double w, double h, const glColour *c )
 {
+   gl_vbo *vbo;
+   GLuint voff, coff;
    GLfloat vertex[4*2], col[4*4];
+   int shader;
 
    /* Set the vertex. */
    /*   1--2
@@ -91,8 +140,9 @@ void gl_renderRect( double x, double y, double w, double h, const glColour *c )
    vertex[3] = vertex[1];
    vertex[5] = vertex[1] + (GLfloat)h;
    vertex[7] = vertex[5];
-   gl_vboSubData( gl_renderVBO, 0, 4*2*sizeof(GLfloat), vertex );
-   gl_vboActivateOffset( gl_renderVBO, GL_VERTEX_ARRAY, 0, 2, GL_FLOAT, 0 );
+   vbo  = gl_vboStreamReserve( sizeof(vertex) + sizeof(col) );
+   voff = gl_vboStreamPush( vertex, 4*2*sizeof(GLfloat) );
+   gl_vboActivateOffset( vbo, GL_VERTEX_ARRAY, voff, 2, GL_FLOAT, 0 );
 
    /* Set the colour. */
    col[0] = c->r;
@@ -111,14 +161,16 @@ void gl_renderRect( double x, double y, double w, double h, const glColour *c )
    col[13] = col[1];
    col[14] = col[2];
    col[15] = col[3];
-   gl_vboSubData( gl_renderVBO, gl_renderVBOcolOffset, 4*4*sizeof(GLfloat), col );
-   gl_vboActivateOffset( gl_renderVBO, GL_COLOR_ARRAY,
-         gl_renderVBOcolOffset, 4, GL_FLOAT, 0 );
+   coff = gl_vboStreamPush( col, 4*4*sizeof(GLfloat) );
+   gl_vboActivateOffset( vbo, GL_COLOR_ARRAY, coff, 4, GL_FLOAT, 0 );
 
    /* Draw. */
+   shader = (gl_programUse( GL_PROG_COLOUR, NULL ) == 0);
    glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
 
    /* Clear state. */
+   if (shader)
+      gl_programUnuse();
    gl_vboDeactivate();
 
    /* Check errors. */
@@ -137,6 +189,8 @@ void gl_renderRect( double x, double y, double w, double h, const glColour *c )
  */
 void gl_renderRectEmpty( double x, double y, double w, double h, const glColour *c )
 {
+   gl_vbo *vbo;
+   GLuint voff, coff;
    GLfloat vx, vy, vxw, vyh;
    GLfloat vertex[5*2], col[5*4];
 
@@ -157,8 +211,9 @@ void gl_renderRectEmpty( double x, double y, double w, double h, const glColour
    vertex[7] = vyh;
    vertex[8] = vx;
    vertex[9] = vy;
-   gl_vboSubData( gl_renderVBO, 0, sizeof(vertex), vertex );
-   gl_vboActivateOffset( gl_renderVBO, GL_VERTEX_ARRAY, 0, 2, GL_FLOAT, 0 );
+   vbo  = gl_vboStreamReserve( sizeof(vertex) + sizeof(col) );
+   voff = gl_vboStreamPush( vertex, sizeof(vertex) );
+   gl_vboActivateOffset( vbo, GL_VERTEX_ARRAY, voff, 2, GL_FLOAT, 0 );
 
    /* Set the colour. */
    col[0] = c->r;
@@ -181,9 +236,8 @@ void gl_renderRectEmpty( double x, double y, double w, double h, const glColour
    col[17] = col[1];
    col[18] = col[2];
    col[19] = col[3];
-   gl_vboSubData( gl_renderVBO, gl_renderVBOcolOffset, sizeof(col), col );
-   gl_vboActivateOffset( gl_renderVBO, GL_COLOR_ARRAY,
-         gl_renderVBOcolOffset, 4, GL_FLOAT, 0 );
+   coff = gl_vboStreamPush( col, sizeof(col) );
+   gl_vboActivateOffset( vbo, GL_COLOR_ARRAY, coff, 4, GL_FLOAT, 0 );
 
    /* Draw. */
    glDrawArrays( GL_LINE_STRIP, 0, 5 );
@@ -206,6 +260,8 @@ void gl_renderRectEmpty( double x, double y, double w, double h, const glColour
  */
 void gl_renderCross( double x, double y, double r, const glColour *c )
 {
+   gl_vbo *vbo;
+   GLuint voff, coff;
    int i;
    GLfloat vertex[2*4], colours[4*4];
    GLfloat vx,vy, vr;
@@ -222,8 +278,8 @@ void gl_renderCross( double x, double y, double r, const glColour *c )
       colours[4*i + 2] = c->b;
       colours[4*i + 3] = c->a;
    }
-   gl_vboSubData( gl_renderVBO, gl_renderVBOcolOffset,
-         sizeof(GLfloat) * 4*4, colours );
+   vbo  = gl_vboStreamReserve( sizeof(vertex) + sizeof(colours) );
+   coff = gl_vboStreamPush( colours, sizeof(GLfloat) * 4*4 );
    /* Set up vertex. */
    vertex[0] = vx+0.;
    vertex[1] = vy-vr;
@@ -233,16 +289,340 @@ void gl_renderCross( double x, double y, double r, const glColour *c )
    vertex[5] = vy+0.;
    vertex[6] = vx+vr;
    vertex[7] = vy+0.;
-   gl_vboSubData( gl_renderVBO, 0, sizeof(GLfloat) * 4*2, vertex );
+   voff = gl_vboStreamPush( vertex, sizeof(GLfloat) * 4*2 );
    /* Draw tho VBO. */
-   gl_vboActivateOffset( gl_renderVBO, GL_VERTEX_ARRAY, 0, 2, GL_FLOAT, 0 );
-   gl_vboActivateOffset( gl_renderVBO, GL_COLOR_ARRAY,
-         gl_renderVBOcolOffset, 4, GL_FLOAT, 0 );
+   gl_vboActivateOffset( vbo, GL_VERTEX_ARRAY, voff, 2, GL_FLOAT, 0 );
+   gl_vboActivateOffset( vbo, GL_COLOR_ARRAY, coff, 4, GL_FLOAT, 0 );
    glDrawArrays( GL_LINES, 0, 4 );
    gl_vboDeactivate();
 }
 
 
+/**
+ * @brief Starts batching sprites.
+ *
+ * While batching, gl_blitTexture only queues quads.  They are drawn when the
+ *  outermost gl_batchEnd is called, grouped by texture.  A quad only joins an
+ *  earlier run of its texture if it doesn't overlap anything queued after
+ *  that run, so what overlaps is still drawn in the order it was queued.
+ *  Interpolated quads are batched by their pair of textures when the program
+ *  that mixes them per vertex is available.  Anything else that is not a
+ *  plain textured quad is drawn immediately.
+ */
+void gl_batchBegin (void)
+{
+   gl_batchDepth++;
+}
+
+
+/**
+ * @brief Stops batching sprites and draws everything queued.
+ */
+void gl_batchEnd (void)
+{
+   if (gl_batchDepth <= 0) {
+      WARN("gl_batchEnd called without gl_batchBegin!");
+      return;
+   }
+
+   gl_batchDepth--;
+   if (gl_batchDepth == 0)
+      gl_batchFlush();
+}
+
+
+/**
+ * @brief Splits the queued quads in runs of the same textures.
+ *
+ * Each quad goes back over the last runs looking for one of its textures,
+ *  stopping at the first it overlaps, and starts a new run if none is found.
+ *
+ *    @param n Number of queued quads.
+ *    @return Number of runs.
+ */
+static int gl_batchRunsBuild( int n )
+{
+   int i, j, k, stop, nruns;
+   GLfloat x0, y0, x1, y1;
+   glBatchQuad *q;
+   glBatchRun *r;
+
+   nruns = 0;
+   for (i=0; i<n; i++) {
+      q  = &gl_batchQuads[i];
+      x0 = x1 = q->vertex[0];
+      y0 = y1 = q->vertex[1];
+      for (k=1; k<4; k++) {
+         x0 = MIN( x0, q->vertex[2*k+0] );
+         x1 = MAX( x1, q->vertex[2*k+0] );
+         y0 = MIN( y0, q->vertex[2*k+1] );
+         y1 = MAX( y1, q->vertex[2*k+1] );
+      }
+
+      /* Look for a run to join. */
+      stop = MAX( 0, nruns-OPENGL_BATCH_LOOKBACK );
+      for (j=nruns-1; j>=stop; j--) {
+         r = &gl_batchRuns[j];
+         if ((r->texture == q->texture) && (r->texture2 == q->texture2))
+            break;
+         if ((x0 <= r->x1) && (x1 >= r->x0) && (y0 <= r->y1) && (y1 >= r->y0)) {
+            j = -1;
+            break;
+         }
+      }
+
+      /* New run. */
+      if (j < stop) {
+         if (nruns >= gl_batchMRuns) {
+            gl_batchMRuns += OPENGL_BATCH_CHUNK;
+            gl_batchRuns   = realloc( gl_batchRuns, gl_batchMRuns * sizeof(glBatchRun) );
+         }
+         j = nruns++;
+         r = &gl_batchRuns[j];
+         r->texture  = q->texture;
+         r->texture2 = q->texture2;
+         r->x0 = x0;
+         r->y0 = y0;
+         r->x1 = x1;
+         r->y1 = y1;
+         r->n  = 0;
+      }
+      else {
+         r->x0 = MIN( r->x0, x0 );
+         r->y0 = MIN( r->y0, y0 );
+         r->x1 = MAX( r->x1, x1 );
+         r->y1 = MAX( r->y1, y1 );
+      }
+      r->n++;
+      q->run = j;
+   }
+
+   /* Place the runs one after the other. */
+   k = 0;
+   for (j=0; j<nruns; j++) {
+      gl_batchRuns[j].start = k;
+      k += gl_batchRuns[j].n;
+      gl_batchRuns[j].n = 0;
+   }
+   return nruns;
+}
+
+
+/**
+ * @brief Gets a new quad at the end of the sprite batch.
+ *
+ *    @param texture Texture the quad is drawn with.
+ *    @return The new quad, only its texture is set.
+ */
+static glBatchQuad* gl_batchNew( GLuint texture )
+{
+   glBatchQuad *q;
+
+   /* Grow memory if needed. */
+   if (gl_batchNQuads >= gl_batchMQuads) {
+      gl_batchMQuads += OPENGL_BATCH_CHUNK;
+      gl_batchQuads   = realloc( gl_batchQuads, gl_batchMQuads * sizeof(glBatchQuad) );
+   }
+   q = &gl_batchQuads[ gl_batchNQuads ];
+   q->texture  = texture;
+   q->texture2 = 0;
+   q->inter    = 1.;
+   gl_batchNQuads++;
+   return q;
+}
+
+
+/**
+ * @brief Queues a quad in the sprite batch.
+ *
+ * Parameters are the same as gl_blitTexture.
+ */
+static void gl_batchAdd( const glTexture* texture,
+      const double x, const double y,
+      const double w, const double h,
+      const double tx, const double ty,
+      const double tw, const double th, const glColour *c )
+{
+   glBatchQuad *q;
+   int i;
+
+   /* Must have colour for now. */
+   if (c == NULL)
+      c = &cWhite;
+
+   q = gl_batchNew( texture->texture );
+
+   /* Set the vertex, in GL_QUADS order. */
+   q->vertex[0] = (GLfloat)x;
+   q->vertex[1] = (GLfloat)y;
+   q->vertex[2] = (GLfloat)(x + w);
+   q->vertex[3] = q->vertex[1];
+   q->vertex[4] = q->vertex[2];
+   q->vertex[5] = (GLfloat)(y + h);
+   q->vertex[6] = q->vertex[0];
+   q->vertex[7] = q->vertex[5];
+
+   /* Set the texture. */
+   q->tex[0] = (GLfloat)(texture->ox + tx);
+   q->tex[1] = (GLfloat)(texture->oy + ty);
+   q->tex[2] = (GLfloat)(texture->ox + tx + tw);
+   q->tex[3] = q->tex[1];
+   q->tex[4] = q->tex[2];
+   q->tex[5] = (GLfloat)(texture->oy + ty + th);
+   q->tex[6] = q->tex[0];
+   q->tex[7] = q->tex[5];
+
+   /* Set the colour. */
+   for (i=0; i<4; i++) {
+      q->col[4*i+0] = c->r;
+      q->col[4*i+1] = c->g;
+      q->col[4*i+2] = c->b;
+      q->col[4*i+3] = c->a;
+   }
+}
+
+
+/**
+ * @brief Blits an arbitrary textured quad.
+ *
+ * Used for things that aren't axis aligned sprites, like beams, so they can
+ *  still be drawn together with everything else of the same texture when
+ *  batching.  Texture coordinates are used as they are, so the texture
+ *  shouldn't be packed in an atlas.
+ *
+ *    @param texture Texture to blit.
+ *    @param vertex Screen position of the four corners, in GL_QUADS order.
+ *    @param tex Texture coordinates of the four corners.
+ *    @param col Colour of the four corners.
+ */
+void gl_blitQuad( const glTexture* texture, const GLfloat vertex[4*2],
+      const GLfloat tex[4*2], const GLfloat col[4*4] )
+{
+   glBatchQuad *q;
+
+   gl_batchBegin();
+   q = gl_batchNew( texture->texture );
+   memcpy( q->vertex, vertex, sizeof(q->vertex) );
+   memcpy( q->tex, tex, sizeof(q->tex) );
+   memcpy( q->col, col, sizeof(q->col) );
+   gl_batchEnd();
+}
+
+
+/**
+ * @brief Draws all the queued quads.
+ *
+ * Uploads everything with a single VBO update and does one draw call per
+ *  run of quads with the same texture.
+ */
+void gl_batchFlush (void)
+{
+   int i, j, k, n, nruns, mixed;
+   GLfloat *vertex, *tex, *col, *inter;
+   glBatchQuad *q;
+   glBatchRun *r;
+   GLuint off;
+   gl_vbo *vbo;
+   int shader, interpolate;
+
+   n = gl_batchNQuads;
+   if (n == 0)
+      return;
+   gl_batchNQuads = 0;
+
+   /* Group by texture where it doesn't change what is on top. */
+   nruns = gl_batchRunsBuild( n );
+
+   /* Grow scratch memory if needed. */
+   if (n > gl_batchMData) {
+      gl_batchMData = gl_batchMQuads;
+      gl_batchData  = realloc( gl_batchData,
+            gl_batchMData * 4*(2+2+4+1) * sizeof(GLfloat) );
+   }
+   vertex = gl_batchData;
+   tex    = &gl_batchData[ n*4*2 ];
+   col    = &gl_batchData[ n*4*(2+2) ];
+   inter  = &gl_batchData[ n*4*(2+2+4) ];
+
+   /* Fill the data, run by run. */
+   mixed = 0;
+   for (i=0; i<n; i++) {
+      q = &gl_batchQuads[i];
+      r = &gl_batchRuns[ q->run ];
+      k = r->start + r->n++;
+      memcpy( &vertex[ k*4*2 ], q->vertex, sizeof(q->vertex) );
+      memcpy( &tex[ k*4*2 ], q->tex, sizeof(q->tex) );
+      memcpy( &col[ k*4*4 ], q->col, sizeof(q->col) );
+      for (j=0; j<4; j++)
+         inter[ k*4+j ] = q->inter;
+      if (q->texture2 != 0)
+         mixed = 1;
+   }
+
+   /* Upload all at once. */
+   vbo = gl_vboStreamReserve( n * 4*(2+2+4+1) * sizeof(GLfloat) );
+   off = gl_vboStreamPush( gl_batchData, n * 4*(2+2+4+1) * sizeof(GLfloat) );
+   gl_vboActivateOffset( vbo, GL_VERTEX_ARRAY, off, 2, GL_FLOAT, 0 );
+   gl_vboActivateOffset( vbo, GL_TEXTURE_COORD_ARRAY,
+         off + n*4*2 * sizeof(GLfloat), 2, GL_FLOAT, 0 );
+   gl_vboActivateOffset( vbo, GL_COLOR_ARRAY,
+         off + n*4*(2+2) * sizeof(GLfloat), 4, GL_FLOAT, 0 );
+   if (mixed) {
+      gl_vboActivateOffset( vbo, GL_TEXTURE1,
+            off + n*4*(2+2+4) * sizeof(GLfloat), 1, GL_FLOAT, 0 );
+      nglClientActiveTexture( GL_TEXTURE0 );
+   }
+
+   /* Draw each texture run. */
+   shader = (gl_programUse( GL_PROG_TEXTURE, NULL ) == 0);
+   if (!shader)
+      glEnable(GL_TEXTURE_2D);
+   glShadeModel(GL_SMOOTH); /* Quads may fade across. */
+   interpolate = 0;
+   for (j=0; j<nruns; j++) {
+      r = &gl_batchRuns[j];
+
+      /* Switch programs between plain and interpolated runs. */
+      if ((r->texture2 != 0) != interpolate) {
+         if (!interpolate) {
+            if (!shader)
+               glDisable(GL_TEXTURE_2D);
+            shader = (gl_programUse( GL_PROG_INTERPOLATE_BATCH, NULL ) == 0);
+         }
+         else {
+            shader = (gl_programUse( GL_PROG_TEXTURE, NULL ) == 0);
+            if (!shader) {
+               gl_programUnuse();
+               glEnable(GL_TEXTURE_2D);
+            }
+         }
+         interpolate = !interpolate;
+      }
+      if (interpolate && !shader)
+         continue;
+      if (interpolate) {
+         nglActiveTexture( GL_TEXTURE1 );
+         glBindTexture( GL_TEXTURE_2D, r->texture2 );
+         nglActiveTexture( GL_TEXTURE0 );
+      }
+
+      glBindTexture( GL_TEXTURE_2D, r->texture );
+      glDrawArrays( GL_QUADS, r->start*4, r->n*4 );
+   }
+
+   /* Clear state. */
+   glShadeModel(GL_FLAT);
+   gl_vboDeactivate();
+   if (shader)
+      gl_programUnuse();
+   else if (!interpolate)
+      glDisable(GL_TEXTURE_2D);
+
+   /* anything failed? */
+   gl_checkErr();
+}
+
+
 /**
  * @brief Texture blitting backend.
  *
@@ -263,10 +643,21 @@ void gl_blitTexture(  const glTexture* texture,
       const double tx, const double ty,
       const double tw, const double th, const glColour *c )
 {
+   gl_vbo *vbo;
+   GLuint voff, toff, coff;
    GLfloat vertex[4*2], tex[4*2], col[4*4];
+   int shader;
+
+   /* Queue it up if batching. */
+   if (gl_batchDepth > 0) {
+      gl_batchAdd( texture, x, y, w, h, tx, ty, tw, th, c );
+      return;
+   }
 
    /* Bind the texture. */
-   glEnable(GL_TEXTURE_2D);
+   shader = (gl_programUse( GL_PROG_TEXTURE, NULL ) == 0);
+   if (!shader)
+      glEnable(GL_TEXTURE_2D);
    glBindTexture( GL_TEXTURE_2D, texture->texture);
 
    /* Must have colour for now. */
@@ -282,21 +673,21 @@ void gl_blitTexture(  const glTexture* texture,
    vertex[3] = vertex[1];
    vertex[5] = vertex[1] + (GLfloat)h;
    vertex[7] = vertex[5];
-   gl_vboSubData( gl_renderVBO, 0, 4*2*sizeof(GLfloat), vertex );
-   gl_vboActivateOffset( gl_renderVBO, GL_VERTEX_ARRAY, 0, 2, GL_FLOAT, 0 );
+   vbo  = gl_vboStreamReserve( sizeof(vertex) + sizeof(tex) + sizeof(col) );
+   voff = gl_vboStreamPush( vertex, 4*2*sizeof(GLfloat) );
+   gl_vboActivateOffset( vbo, GL_VERTEX_ARRAY, voff, 2, GL_FLOAT, 0 );
 
    /* Set the texture. */
-   tex[0] = (GLfloat)tx;
+   tex[0] = (GLfloat)(texture->ox + tx);
    tex[4] = tex[0];
    tex[2] = tex[0] + (GLfloat)tw;
    tex[6] = tex[2];
-   tex[1] = (GLfloat)ty;
+   tex[1] = (GLfloat)(texture->oy + ty);
    tex[3] = tex[1];
    tex[5] = tex[1] + (GLfloat)th;
    tex[7] = tex[5];
-   gl_vboSubData( gl_renderVBO, gl_renderVBOtexOffset, 4*2*sizeof(GLfloat), tex );
-   gl_vboActivateOffset( gl_renderVBO, GL_TEXTURE_COORD_ARRAY,
-         gl_renderVBOtexOffset, 2, GL_FLOAT, 0 );
+   toff = gl_vboStreamPush( tex, 4*2*sizeof(GLfloat) );
+   gl_vboActivateOffset( vbo, GL_TEXTURE_COORD_ARRAY, toff, 2, GL_FLOAT, 0 );
 
    /* Set the colour. */
    col[0] = c->r;
@@ -315,16 +706,18 @@ void gl_blitTexture(  const glTexture* texture,
    col[13] = col[1];
    col[14] = col[2];
    col[15] = col[3];
-   gl_vboSubData( gl_renderVBO, gl_renderVBOcolOffset, 4*4*sizeof(GLfloat), col );
-   gl_vboActivateOffset( gl_renderVBO, GL_COLOR_ARRAY,
-         gl_renderVBOcolOffset, 4, GL_FLOAT, 0 );
+   coff = gl_vboStreamPush( col, 4*4*sizeof(GLfloat) );
+   gl_vboActivateOffset( vbo, GL_COLOR_ARRAY, coff, 4, GL_FLOAT, 0 );
 
    /* Draw. */
    glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
 
    /* Clear state. */
    gl_vboDeactivate();
-   glDisable(GL_TEXTURE_2D);
+   if (shader)
+      gl_programUnuse();
+   else
+      glDisable(GL_TEXTURE_2D);
 
    /* anything failed? */
    gl_checkErr();
@@ -354,8 +747,12 @@ static void gl_blitTextureInterpolate(  const glTexture* ta,
       const double tx, const double ty,
       const double tw, const double th, const glColour *c )
 {
+   gl_vbo *vbo;
+   GLuint voff, toff, coff;
    GLfloat vertex[4*2], tex[4*2], col[4*4];
    GLfloat mcol[4] = { 0., 0., 0. };
+   glBatchQuad *q;
+   int shader;
 
    /* No interpolation. */
    if (!conf.interpolate || (tb == NULL)) {
@@ -373,8 +770,8 @@ static void gl_blitTextureInterpolate(  const glTexture* ta,
       return;
    }
 
-   /* No multitexture. */
-   if (nglActiveTexture == NULL) {
+   /* No multitexture, or the textures don't share coordinates. */
+   if ((nglActiveTexture == NULL) || (ta->atlas != NULL) || (tb->atlas != NULL)) {
       if (inter > 0.5)
          gl_blitTexture( ta, x, y, w, h, tx, ty, tw, th, c );
       else
@@ -382,65 +779,86 @@ static void gl_blitTextureInterpolate(  const glTexture* ta,
       return;
    }
 
+   /* Queue it up if batching and the amount can be done per vertex. */
+   if ((gl_batchDepth > 0) && gl_programAvailable( GL_PROG_INTERPOLATE_BATCH )) {
+      gl_batchAdd( ta, x, y, w, h, tx, ty, tw, th, c );
+      q = &gl_batchQuads[ gl_batchNQuads-1 ];
+      q->texture2 = tb->texture;
+      q->inter    = (GLfloat)inter;
+      return;
+   }
+
    /* Set default colour. */
    if (c == NULL)
       c = &cWhite;
 
-   /* Bind the textures. */
-   /* Texture 0. */
-   nglActiveTexture( GL_TEXTURE0 );
-   glEnable(GL_TEXTURE_2D);
-   glBindTexture( GL_TEXTURE_2D, ta->texture);
-
-   /* Set the mode. */
-   glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE );
-
-   /* Interpolate texture and alpha. */
-   glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_RGB,      GL_INTERPOLATE );
-   glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_ALPHA,    GL_INTERPOLATE );
-   mcol[3] = inter;
-   glTexEnvfv( GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, mcol );
-
-   /* Arguments. */
-   /* Arg0. */
-   glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE0_RGB,    GL_TEXTURE0 );
-   glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_RGB,   GL_SRC_COLOR );
-   glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE0_ALPHA,  GL_TEXTURE0 );
-   glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_ALPHA, GL_SRC_ALPHA );
-   /* Arg1. */
-   glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE1_RGB,    GL_TEXTURE1 );
-   glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND1_RGB,   GL_SRC_COLOR );
-   glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE1_ALPHA,  GL_TEXTURE1 );
-   glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND1_ALPHA, GL_SRC_ALPHA );
-   /* Arg2. */
-   glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE2_RGB,    GL_CONSTANT );
-   glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND2_RGB,   GL_SRC_ALPHA );
-   glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE2_ALPHA,  GL_CONSTANT );
-   glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND2_ALPHA, GL_SRC_ALPHA );
-
-   /* Texture 1. */
-   nglActiveTexture( GL_TEXTURE1 );
-   glEnable(GL_TEXTURE_2D);
-   glBindTexture( GL_TEXTURE_2D, tb->texture);
-
-   /* Set the mode. */
-   glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE );
-
-   /* Interpolate texture and alpha. */
-   glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_RGB,      GL_MODULATE );
-   glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_ALPHA,    GL_MODULATE );
-
-   /* Arguments. */
-   /* Arg0. */
-   glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE0_RGB,    GL_PREVIOUS );
-   glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_RGB,   GL_SRC_COLOR );
-   glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE0_ALPHA,  GL_PREVIOUS );
-   glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_ALPHA, GL_SRC_ALPHA );
-   /* Arg1. */
-   glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE1_RGB,    GL_PRIMARY_COLOR );
-   glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND1_RGB,   GL_SRC_COLOR );
-   glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE1_ALPHA,  GL_PRIMARY_COLOR );
-   glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND1_ALPHA, GL_SRC_ALPHA );
+   /* Same combination done by a program. */
+   mcol[0] = inter;
+   shader  = (gl_programUse( GL_PROG_INTERPOLATE, mcol ) == 0);
+   if (shader) {
+      nglActiveTexture( GL_TEXTURE1 );
+      glBindTexture( GL_TEXTURE_2D, tb->texture );
+      nglActiveTexture( GL_TEXTURE0 );
+      glBindTexture( GL_TEXTURE_2D, ta->texture );
+   }
+   else {
+      mcol[0] = 0.;
+      /* Bind the textures. */
+      /* Texture 0. */
+      nglActiveTexture( GL_TEXTURE0 );
+      glEnable(GL_TEXTURE_2D);
+      glBindTexture( GL_TEXTURE_2D, ta->texture);
+
+      /* Set the mode. */
+      glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE );
+
+      /* Interpolate texture and alpha. */
+      glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_RGB,      GL_INTERPOLATE );
+      glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_ALPHA,    GL_INTERPOLATE );
+      mcol[3] = inter;
+      glTexEnvfv( GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, mcol );
+
+      /* Arguments. */
+      /* Arg0. */
+      glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE0_RGB,    GL_TEXTURE0 );
+      glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_RGB,   GL_SRC_COLOR );
+      glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE0_ALPHA,  GL_TEXTURE0 );
+      glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_ALPHA, GL_SRC_ALPHA );
+      /* Arg1. */
+      glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE1_RGB,    GL_TEXTURE1 );
+      glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND1_RGB,   GL_SRC_COLOR );
+      glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE1_ALPHA,  GL_TEXTURE1 );
+      glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND1_ALPHA, GL_SRC_ALPHA );
+      /* Arg2. */
+      glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE2_RGB,    GL_CONSTANT );
+      glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND2_RGB,   GL_SRC_ALPHA );
+      glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE2_ALPHA,  GL_CONSTANT );
+      glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND2_ALPHA, GL_SRC_ALPHA );
+
+      /* Texture 1. */
+      nglActiveTexture( GL_TEXTURE1 );
+      glEnable(GL_TEXTURE_2D);
+      glBindTexture( GL_TEXTURE_2D, tb->texture);
+
+      /* Set the mode. */
+      glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE );
+
+      /* Interpolate texture and alpha. */
+      glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_RGB,      GL_MODULATE );
+      glTexEnvi( GL_TEXTURE_ENV, GL_COMBINE_ALPHA,    GL_MODULATE );
+
+      /* Arguments. */
+      /* Arg0. */
+      glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE0_RGB,    GL_PREVIOUS );
+      glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_RGB,   GL_SRC_COLOR );
+      glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE0_ALPHA,  GL_PREVIOUS );
+      glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND0_ALPHA, GL_SRC_ALPHA );
+      /* Arg1. */
+      glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE1_RGB,    GL_PRIMARY_COLOR );
+      glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND1_RGB,   GL_SRC_COLOR );
+      glTexEnvi( GL_TEXTURE_ENV, GL_SOURCE1_ALPHA,  GL_PRIMARY_COLOR );
+      glTexEnvi( GL_TEXTURE_ENV, GL_OPERAND1_ALPHA, GL_SRC_ALPHA );
+   }
 
    /* Set the colour. */
    col[0] = c->r;
@@ -459,9 +877,9 @@ static void gl_blitTextureInterpolate(  const glTexture* ta,
    col[13] = col[1];
    col[14] = col[2];
    col[15] = col[3];
-   gl_vboSubData( gl_renderVBO, gl_renderVBOcolOffset, 4*4*sizeof(GLfloat), col );
-   gl_vboActivateOffset( gl_renderVBO, GL_COLOR_ARRAY,
-         gl_renderVBOcolOffset, 4, GL_FLOAT, 0 );
+   vbo  = gl_vboStreamReserve( sizeof(vertex) + sizeof(tex) + sizeof(col) );
+   coff = gl_vboStreamPush( col, 4*4*sizeof(GLfloat) );
+   gl_vboActivateOffset( vbo, GL_COLOR_ARRAY, coff, 4, GL_FLOAT, 0 );
 
    /* Set the vertex. */
    vertex[0] = (GLfloat)x;
@@ -472,8 +890,8 @@ static void gl_blitTextureInterpolate(  const glTexture* ta,
    vertex[3] = vertex[1];
    vertex[5] = vertex[1] + (GLfloat)h;
    vertex[7] = vertex[5];
-   gl_vboSubData( gl_renderVBO, 0, 4*2*sizeof(GLfloat), vertex );
-   gl_vboActivateOffset( gl_renderVBO, GL_VERTEX_ARRAY, 0, 2, GL_FLOAT, 0 );
+   voff = gl_vboStreamPush( vertex, 4*2*sizeof(GLfloat) );
+   gl_vboActivateOffset( vbo, GL_VERTEX_ARRAY, voff, 2, GL_FLOAT, 0 );
 
    /* Set the texture. */
    tex[0] = (GLfloat)tx;
@@ -484,22 +902,24 @@ static void gl_blitTextureInterpolate(  const glTexture* ta,
    tex[3] = tex[1];
    tex[5] = tex[1] + (GLfloat)th;
    tex[7] = tex[5];
-   gl_vboSubData( gl_renderVBO, gl_renderVBOtexOffset, 4*2*sizeof(GLfloat), tex );
-   gl_vboActivateOffset( gl_renderVBO, GL_TEXTURE0,
-         gl_renderVBOtexOffset, 2, GL_FLOAT, 0 );
-   gl_vboActivateOffset( gl_renderVBO, GL_TEXTURE1,
-         gl_renderVBOtexOffset, 2, GL_FLOAT, 0 );
+   toff = gl_vboStreamPush( tex, 4*2*sizeof(GLfloat) );
+   gl_vboActivateOffset( vbo, GL_TEXTURE0, toff, 2, GL_FLOAT, 0 );
+   gl_vboActivateOffset( vbo, GL_TEXTURE1, toff, 2, GL_FLOAT, 0 );
 
    /* Draw. */
    glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
 
    /* Clear state. */
    gl_vboDeactivate();
-   glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
-   glDisable(GL_TEXTURE_2D);
-   nglActiveTexture( GL_TEXTURE0 );
-   glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
-   glDisable(GL_TEXTURE_2D);
+   if (shader)
+      gl_programUnuse();
+   else {
+      glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
+      glDisable(GL_TEXTURE_2D);
+      nglActiveTexture( GL_TEXTURE0 );
+      glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
+      glDisable(GL_TEXTURE_2D);
+   }
 
    /* anything failed? */
    gl_checkErr();
@@ -529,6 +949,27 @@ void gl_gameToScreenCoords( double *nx, double *ny, double bx, double by )
 }
 
 
+/**
+ * @brief Checks to see if something in game coordinates may be on screen.
+ *
+ * Meant to reject objects before doing any work to render them.
+ *
+ *    @param bx Game X coord of the centre.
+ *    @param by Game Y coord of the centre.
+ *    @param r Radius of the object in game units.
+ *    @return 1 if the object overlaps the screen.
+ */
+int gl_isVisible( double bx, double by, double r )
+{
+   double x, y, sr;
+
+   gl_gameToScreenCoords( &x, &y, bx, by );
+   sr = r * cam_getZoom();
+   return (x + sr >= 0.) && (x - sr <= SCREEN_W) &&
+         (y + sr >= 0.) && (y - sr <= SCREEN_H);
+}
+
+
 /**
  * @brief Converts screen coordinates to ingame coordinates.
  *
@@ -778,6 +1219,8 @@ void gl_blitStatic( const glTexture* texture,
 void gl_drawCircleLoop( const double cx, const double cy,
       const double r, const glColour *c )
 {
+   gl_vbo *vbo;
+   GLuint voff, coff;
    int i, points;
    double angi, cosi, sini;
    double nxc, xc, yc;
@@ -806,8 +1249,9 @@ void gl_drawCircleLoop( const double cx, const double cy,
       vertex[i*2+1] = cy + yc * r;
    }
 
-   gl_vboSubData( gl_renderVBO, 0, points*2*sizeof(GLfloat), vertex );
-   gl_vboActivateOffset( gl_renderVBO, GL_VERTEX_ARRAY, 0, 2, GL_FLOAT, 0 );
+   vbo  = gl_vboStreamReserve( points*(2+4)*sizeof(GLfloat) );
+   voff = gl_vboStreamPush( vertex, points*2*sizeof(GLfloat) );
+   gl_vboActivateOffset( vbo, GL_VERTEX_ARRAY, voff, 2, GL_FLOAT, 0 );
 
    /* Set up the colour. */
    for (i=0; i<points; i++) {
@@ -817,9 +1261,8 @@ void gl_drawCircleLoop( const double cx, const double cy,
       col[4*i+3] = c->a;
    }
 
-   gl_vboSubData( gl_renderVBO, gl_renderVBOcolOffset, points*4*sizeof(GLfloat), col );
-   gl_vboActivateOffset( gl_renderVBO, GL_COLOR_ARRAY,
-         gl_renderVBOcolOffset, 4, GL_FLOAT, 0 );
+   coff = gl_vboStreamPush( col, points*4*sizeof(GLfloat) );
+   gl_vboActivateOffset( vbo, GL_COLOR_ARRAY, coff, 4, GL_FLOAT, 0 );
 
    /* Draw. */
    glDrawArrays( GL_LINE_LOOP, 0, points );
@@ -846,6 +1289,8 @@ if (i<OPENGL_RENDER_VBO_SIZE) { \
 static void gl_drawCircleEmpty( const double cx, const double cy,
       const double r, const glColour *c )
 {
+   gl_vbo *vbo;
+   GLuint voff, coff;
    int i, j;
    double x,y,p;
    GLfloat vertex[2*OPENGL_RENDER_VBO_SIZE], col[4*OPENGL_RENDER_VBO_SIZE];
@@ -891,8 +1336,9 @@ static void gl_drawCircleEmpty( const double cx, const double cy,
                PIXEL( cx-y, cy-x );
             }
    }
-   gl_vboSubData( gl_renderVBO, 0, i*2*sizeof(GLfloat), vertex );
-   gl_vboActivateOffset( gl_renderVBO, GL_VERTEX_ARRAY, 0, 2, GL_FLOAT, 0 );
+   vbo  = gl_vboStreamReserve( i*(2+4)*sizeof(GLfloat) );
+   voff = gl_vboStreamPush( vertex, i*2*sizeof(GLfloat) );
+   gl_vboActivateOffset( vbo, GL_VERTEX_ARRAY, voff, 2, GL_FLOAT, 0 );
 
    /* Set up the colour. */
    for (j=0; j<i; j++) {
@@ -901,9 +1347,8 @@ static void gl_drawCircleEmpty( const double cx, const double cy,
       col[4*j+2] = c->b;
       col[4*j+3] = c->a;
    }
-   gl_vboSubData( gl_renderVBO, gl_renderVBOcolOffset, j*4*sizeof(GLfloat), col );
-   gl_vboActivateOffset( gl_renderVBO, GL_COLOR_ARRAY,
-         gl_renderVBOcolOffset, 4, GL_FLOAT, 0 );
+   coff = gl_vboStreamPush( col, j*4*sizeof(GLfloat) );
+   gl_vboActivateOffset( vbo, GL_COLOR_ARRAY, coff, 4, GL_FLOAT, 0 );
 
    /* Draw. */
    glDrawArrays( GL_POINTS, 0, i );
@@ -947,6 +1392,13 @@ void gl_drawCircle( const double cx, const double cy,
 void gl_clipRect( int x, int y, int w, int h )
 {
    double rx, ry, rw, rh;
+
+   /* Framebuffers have their own origin and region. */
+   if (gl_fboActive()) {
+      gl_fboClip( x, y, w, h );
+      return;
+   }
+
    rx = (x + gl_screen.x) / gl_screen.mxscale;
    ry = (y + gl_screen.y) / gl_screen.myscale;
    rw = w / gl_screen.mxscale;
@@ -961,6 +1413,11 @@ void gl_clipRect( int x, int y, int w, int h )
  */
 void gl_unclipRect (void)
 {
+   if (gl_fboActive()) {
+      gl_fboUnclip();
+      return;
+   }
+
    glDisable( GL_SCISSOR_TEST );
    glScissor( 0, 0, gl_screen.rw, gl_screen.rh );
 }
@@ -991,6 +1448,8 @@ void gl_drawCircleInRect( const double cx, const double cy, const double r,
       const double rx, const double ry, const double rw, const double rh,
       const glColour *c, int filled )
 {
+   gl_vbo *vbo;
+   GLuint voff, coff;
    int i, j;
    double rxw,ryh, x,y,p, w,h, tx,ty, tw,th, r2;
    GLfloat vertex[2*OPENGL_RENDER_VBO_SIZE], col[4*OPENGL_RENDER_VBO_SIZE];
@@ -1070,8 +1529,9 @@ void gl_drawCircleInRect( const double cx, const double cy, const double r,
                PIXEL( cx-y, cy-x );
             }
    }
-   gl_vboSubData( gl_renderVBO, 0, i*2*sizeof(GLfloat), vertex );
-   gl_vboActivateOffset( gl_renderVBO, GL_VERTEX_ARRAY, 0, 2, GL_FLOAT, 0 );
+   vbo  = gl_vboStreamReserve( i*(2+4)*sizeof(GLfloat) );
+   voff = gl_vboStreamPush( vertex, i*2*sizeof(GLfloat) );
+   gl_vboActivateOffset( vbo, GL_VERTEX_ARRAY, voff, 2, GL_FLOAT, 0 );
 
    /* Set up the colour. */
    for (j=0; j<i; j++) {
@@ -1080,9 +1540,8 @@ void gl_drawCircleInRect( const double cx, const double cy, const double r,
       col[4*j+2] = c->b;
       col[4*j+3] = c->a;
    }
-   gl_vboSubData( gl_renderVBO, gl_renderVBOcolOffset, i*4*sizeof(GLfloat), col );
-   gl_vboActivateOffset( gl_renderVBO, GL_COLOR_ARRAY,
-         gl_renderVBOcolOffset, 4, GL_FLOAT, 0 );
+   coff = gl_vboStreamPush( col, i*4*sizeof(GLfloat) );
+   gl_vboActivateOffset( vbo, GL_COLOR_ARRAY, coff, 4, GL_FLOAT, 0 );
 
    /* Draw. */
    glDrawArrays( GL_POINTS, 0, i );
@@ -1154,15 +1613,12 @@ glTexture *gl_genCircle( int radius )
  */
 int gl_initRender (void)
 {
-   /* Initialize the VBO. */
-   gl_renderVBO = gl_vboCreateStream( sizeof(GLfloat) *
-         OPENGL_RENDER_VBO_SIZE*(2 + 2 + 4), NULL );
-   gl_renderVBOtexOffset = sizeof(GLfloat) * OPENGL_RENDER_VBO_SIZE*2;
-   gl_renderVBOcolOffset = sizeof(GLfloat) * OPENGL_RENDER_VBO_SIZE*(2+2);
-
    /* Initialize the circles. */
    gl_circle      = gl_genCircle( 128 );
 
+   /* Programs for the paths above. */
+   gl_initPrograms();
+
    return 0;
 }
 
@@ -1172,9 +1628,20 @@ int gl_initRender (void)
  */
 void gl_exitRender (void)
 {
-   /* Destroy the VBO. */
-   gl_vboDestroy( gl_renderVBO );
-   gl_renderVBO = NULL;
+   /* Destroy the programs. */
+   gl_exitPrograms();
+
+   /* Destroy the sprite batch. */
+   free( gl_batchQuads );
+   gl_batchQuads  = NULL;
+   gl_batchNQuads = 0;
+   gl_batchMQuads = 0;
+   free( gl_batchData );
+   gl_batchData   = NULL;
+   gl_batchMData  = 0;
+   free( gl_batchRuns );
+   gl_batchRuns   = NULL;
+   gl_batchMRuns  = 0;
 
    /* Destroy the circles. */
    gl_freeTexture(gl_circle);
@@ -22,17 +22,25 @@ void gl_exitRender (void);
  */
 void gl_gameToScreenCoords( double *nx, double *ny, double bx, double by );
 void gl_screenToGameCoords( double *nx, double *ny, int bx, int by );
+int gl_isVisible( double bx, double by, double r );
 
 
 /*
  * Rendering.
  */
+/* Sprite batching. */
+void gl_batchBegin (void);
+void gl_batchEnd (void);
+void gl_batchFlush (void);
 /* blits texture */
 void gl_blitTexture(  const glTexture* texture,
       const double x, const double y,
       const double w, const double h,
       const double tx, const double ty,
       const double tw, const double th, const glColour *c );
+/* blits an arbitrary quad */
+void gl_blitQuad( const glTexture* texture, const GLfloat vertex[4*2],
+      const GLfloat tex[4*2], const GLfloat col[4*4] );
 /* blits a sprite, relative pos */
 void gl_blitSprite( const glTexture* sprite,
       const double bx, const double by,
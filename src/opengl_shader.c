@@ -0,0 +1,354 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file opengl_shader.c
+ *
+ * @brief Handles OpenGL 2.0 shader programs.
+ *
+ * Shaders are optional, anything using them must keep a fixed function path
+ *  for when gl_hasShaders() is false or the program fails to build.
+ *
+ * The built-in programs replace the texture environment setups of the hot
+ *  rendering paths. They take the transform from the matrix mirror in
+ *  opengl_matrix.c instead of the fixed function matrices, and only use
+ *  generic vertex, texture coordinate and colour arrays.
+ */
+
+
+#include "opengl_shader.h"
+
+#include "naev.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+
+/**
+ * @brief Built-in program.
+ */
+typedef struct glProgram_ {
+   GLuint program; /**< Program, 0 if unavailable. */
+   GLint u_mvp; /**< Location of the transform. */
+   GLint u_param; /**< Location of the parameter or -1. */
+} glProgram;
+
+
+/* Vertex shaders. */
+static const char gl_vertSrc[] =
+   "#version 120\n"
+   "uniform mat4 mvp;\n"
+   "void main() {\n"
+   "   gl_Position    = mvp * gl_Vertex;\n"
+   "   gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+   "   gl_FrontColor  = gl_Color;\n"
+   "}\n"; /**< Single texture vertex shader. */
+static const char gl_vertMultiSrc[] =
+   "#version 120\n"
+   "uniform mat4 mvp;\n"
+   "void main() {\n"
+   "   gl_Position    = mvp * gl_Vertex;\n"
+   "   gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+   "   gl_TexCoord[1] = gl_MultiTexCoord1;\n"
+   "   gl_FrontColor  = gl_Color;\n"
+   "}\n"; /**< Two texture vertex shader. */
+
+/* Fragment shaders. */
+static const char gl_fragTextureSrc[] =
+   "#version 120\n"
+   "uniform sampler2D tex0;\n"
+   "void main() {\n"
+   "   gl_FragColor = gl_Color * texture2D( tex0, gl_TexCoord[0].st );\n"
+   "}\n"; /**< Same as GL_MODULATE. */
+static const char gl_fragColourSrc[] =
+   "#version 120\n"
+   "void main() {\n"
+   "   gl_FragColor = gl_Color;\n"
+   "}\n"; /**< Untextured. */
+static const char gl_fragInterpolateSrc[] =
+   "#version 120\n"
+   "uniform sampler2D tex0;\n"
+   "uniform sampler2D tex1;\n"
+   "uniform vec4 param;\n"
+   "void main() {\n"
+   "   vec4 a = texture2D( tex0, gl_TexCoord[0].st );\n"
+   "   vec4 b = texture2D( tex1, gl_TexCoord[0].st );\n"
+   "   gl_FragColor = gl_Color * mix( b, a, param.x );\n"
+   "}\n"; /**< Same as the GL_INTERPOLATE combiner of gl_blitTextureInterpolate(). */
+static const char gl_fragInterpolateBatchSrc[] =
+   "#version 120\n"
+   "uniform sampler2D tex0;\n"
+   "uniform sampler2D tex1;\n"
+   "void main() {\n"
+   "   vec4 a = texture2D( tex0, gl_TexCoord[0].st );\n"
+   "   vec4 b = texture2D( tex1, gl_TexCoord[0].st );\n"
+   "   gl_FragColor = gl_Color * mix( b, a, gl_TexCoord[1].s );\n"
+   "}\n"; /**< Interpolation with the amount per vertex, so quads can be batched. */
+static const char gl_fragNebulaSrc[] =
+   "#version 120\n"
+   "uniform sampler2D tex0;\n"
+   "uniform sampler2D tex1;\n"
+   "uniform vec4 param;\n"
+   "void main() {\n"
+   "   float a0 = texture2D( tex0, gl_TexCoord[0].st ).a;\n"
+   "   float a1 = texture2D( tex1, gl_TexCoord[1].st ).a;\n"
+   "   gl_FragColor = vec4( param.rgb, mix( a0, a1, param.a ) );\n"
+   "}\n"; /**< Same as the combiner of the nebula. */
+static const char gl_fragInterferenceSrc[] =
+   "#version 120\n"
+   "uniform vec4 param;\n"
+   "float hash( vec3 p ) {\n"
+   "   p  = fract( p * vec3( 0.1031, 0.1030, 0.0973 ) );\n"
+   "   p += dot( p, p.yzx + 33.33 );\n"
+   "   return fract( (p.x + p.y) * p.z );\n"
+   "}\n"
+   "void main() {\n"
+   "   vec2 px = floor( gl_TexCoord[0].st );\n"
+   "   if ((param.z > 0.) && (length( gl_TexCoord[0].st - vec2( param.z ) ) > param.z))\n"
+   "      discard;\n"
+   "   float f = floor( param.x );\n"
+   "   float v = mix( hash( vec3( px, f ) ), hash( vec3( px, f+1. ) ), param.x - f );\n"
+   "   float band = 0.5 + 0.5 * sin( px.y * 0.15 - param.x * 0.3 );\n"
+   "   v = mix( v, v * band, param.y );\n"
+   "   gl_FragColor = gl_Color * vec4( v, v, v, 1. );\n"
+   "}\n"; /**< Per pixel static faded between steps, volatile nebulae roll bands over it. */
+
+
+static glProgram gl_programs[GL_PROG_MAX]; /**< Built-in programs. */
+static int gl_programsLoaded = 0; /**< Whether the built-in programs were built. */
+
+
+/*
+ * Prototypes.
+ */
+static GLuint gl_shaderCompile( const char *name, GLenum type, const char *src );
+static void gl_programLoad( glProgramID id, const char *name,
+      const char *vert, const char *frag );
+
+
+/**
+ * @brief Checks to see if shaders are supported.
+ *
+ *    @return 1 if shader programs can be created.
+ */
+int gl_hasShaders (void)
+{
+   return (nglCreateShader != NULL);
+}
+
+
+/**
+ * @brief Compiles a shader.
+ *
+ *    @return The shader or 0 on error.
+ */
+static GLuint gl_shaderCompile( const char *name, GLenum type, const char *src )
+{
+   GLuint shader;
+   GLint status, len;
+   GLchar *log;
+
+   shader = nglCreateShader( type );
+   nglShaderSource( shader, 1, (const GLchar**) &src, NULL );
+   nglCompileShader( shader );
+
+   nglGetShaderiv( shader, GL_COMPILE_STATUS, &status );
+   if (status == GL_FALSE) {
+      nglGetShaderiv( shader, GL_INFO_LOG_LENGTH, &len );
+      log = malloc( MAX(len,1) );
+      log[0] = '\0';
+      nglGetShaderInfoLog( shader, MAX(len,1), NULL, log );
+      WARN("Unable to compile %s shader of '%s':\n%s",
+            (type == GL_VERTEX_SHADER) ? "vertex" : "fragment", name, log );
+      free( log );
+      nglDeleteShader( shader );
+      return 0;
+   }
+   return shader;
+}
+
+
+/**
+ * @brief Builds a shader program.
+ *
+ *    @param name Name of the program for error messages.
+ *    @param vert Vertex shader source or NULL to use the fixed function one.
+ *    @param frag Fragment shader source or NULL to use the fixed function one.
+ *    @return The program or 0 on error.
+ */
+GLuint gl_programCreate( const char *name, const char *vert, const char *frag )
+{
+   GLuint program, vs, fs;
+   GLint status, len;
+   GLchar *log;
+
+   if (!gl_hasShaders())
+      return 0;
+
+   vs = fs = 0;
+   if ((vert != NULL) && ((vs = gl_shaderCompile( name, GL_VERTEX_SHADER, vert )) == 0))
+      return 0;
+   if ((frag != NULL) && ((fs = gl_shaderCompile( name, GL_FRAGMENT_SHADER, frag )) == 0)) {
+      if (vs != 0)
+         nglDeleteShader( vs );
+      return 0;
+   }
+
+   program = nglCreateProgram();
+   if (vs != 0)
+      nglAttachShader( program, vs );
+   if (fs != 0)
+      nglAttachShader( program, fs );
+   nglLinkProgram( program );
+
+   /* The program keeps them alive while attached. */
+   if (vs != 0)
+      nglDeleteShader( vs );
+   if (fs != 0)
+      nglDeleteShader( fs );
+
+   nglGetProgramiv( program, GL_LINK_STATUS, &status );
+   if (status == GL_FALSE) {
+      nglGetProgramiv( program, GL_INFO_LOG_LENGTH, &len );
+      log = malloc( MAX(len,1) );
+      log[0] = '\0';
+      nglGetProgramInfoLog( program, MAX(len,1), NULL, log );
+      WARN("Unable to link shader program '%s':\n%s", name, log );
+      free( log );
+      nglDeleteProgram( program );
+      return 0;
+   }
+
+   gl_checkErr();
+   return program;
+}
+
+
+/**
+ * @brief Frees a shader program.
+ */
+void gl_programFree( GLuint program )
+{
+   if ((program != 0) && gl_hasShaders())
+      nglDeleteProgram( program );
+}
+
+
+
+/**
+ * @brief Builds a built-in program and looks up its uniforms.
+ */
+static void gl_programLoad( glProgramID id, const char *name,
+      const char *vert, const char *frag )
+{
+   glProgram *p;
+   GLint loc;
+
+   p = &gl_programs[id];
+   p->program = gl_programCreate( name, vert, frag );
+   if (p->program == 0)
+      return;
+   p->u_mvp   = nglGetUniformLocation( p->program, "mvp" );
+   p->u_param = nglGetUniformLocation( p->program, "param" );
+
+   /* Samplers never change. */
+   nglUseProgram( p->program );
+   loc = nglGetUniformLocation( p->program, "tex0" );
+   if (loc >= 0)
+      nglUniform1i( loc, 0 );
+   loc = nglGetUniformLocation( p->program, "tex1" );
+   if (loc >= 0)
+      nglUniform1i( loc, 1 );
+   nglUseProgram( 0 );
+}
+
+
+/**
+ * @brief Builds the built-in programs.
+ *
+ * Programs that fail to build are left unavailable so their users fall back
+ *  to fixed function.
+ */
+void gl_initPrograms (void)
+{
+   memset( gl_programs, 0, sizeof(gl_programs) );
+   gl_programsLoaded = 1;
+   if (!gl_hasShaders())
+      return;
+
+   gl_programLoad( GL_PROG_TEXTURE, "texture", gl_vertSrc, gl_fragTextureSrc );
+   gl_programLoad( GL_PROG_COLOUR, "colour", gl_vertSrc, gl_fragColourSrc );
+   gl_programLoad( GL_PROG_INTERPOLATE, "interpolate", gl_vertSrc, gl_fragInterpolateSrc );
+   gl_programLoad( GL_PROG_NEBULA, "nebula", gl_vertMultiSrc, gl_fragNebulaSrc );
+   gl_programLoad( GL_PROG_INTERPOLATE_BATCH, "interpolate_batch",
+         gl_vertMultiSrc, gl_fragInterpolateBatchSrc );
+   gl_programLoad( GL_PROG_INTERFERENCE, "interference", gl_vertSrc, gl_fragInterferenceSrc );
+   gl_checkErr();
+}
+
+
+/**
+ * @brief Frees the built-in programs.
+ */
+void gl_exitPrograms (void)
+{
+   int i;
+
+   for (i=0; i<GL_PROG_MAX; i++)
+      gl_programFree( gl_programs[i].program );
+   memset( gl_programs, 0, sizeof(gl_programs) );
+   gl_programsLoaded = 0;
+}
+
+
+/**
+ * @brief Checks to see if a built-in program can be used.
+ *
+ *    @param id Program to check.
+ *    @return 1 if gl_programUse() will succeed.
+ */
+int gl_programAvailable( glProgramID id )
+{
+   return gl_programsLoaded && (gl_programs[id].program != 0);
+}
+
+
+/**
+ * @brief Starts using a built-in program with the current transform.
+ *
+ * Must be paired with gl_programUnuse() when it succeeds.
+ *
+ *    @param id Program to use.
+ *    @param param Four parameters to pass to the program or NULL.
+ *    @return 0 on success, nonzero if fixed function must be used instead.
+ */
+int gl_programUse( glProgramID id, const GLfloat *param )
+{
+   glProgram *p;
+   GLfloat mvp[16];
+
+   if (!gl_programsLoaded)
+      return -1;
+   p = &gl_programs[id];
+   if (p->program == 0)
+      return -1;
+
+   gl_matrixGetMVP( mvp );
+   nglUseProgram( p->program );
+   nglUniformMatrix4fv( p->u_mvp, 1, GL_FALSE, mvp );
+   if ((param != NULL) && (p->u_param >= 0))
+      nglUniform4f( p->u_param, param[0], param[1], param[2], param[3] );
+   return 0;
+}
+
+
+/**
+ * @brief Stops using the built-in program, going back to fixed function.
+ */
+void gl_programUnuse (void)
+{
+   nglUseProgram( 0 );
+}
@@ -0,0 +1,45 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef OPENGL_SHADER_H
+#  define OPENGL_SHADER_H
+
+
+#include "opengl.h"
+
+
+/**
+ * @brief Built-in programs replacing the fixed function paths.
+ */
+typedef enum glProgramID_ {
+   GL_PROG_TEXTURE,     /**< Texture modulated by the vertex colour. */
+   GL_PROG_COLOUR,      /**< Vertex colour only. */
+   GL_PROG_INTERPOLATE, /**< Two textures mixed by param.x, modulated by the vertex colour. */
+   GL_PROG_NEBULA,      /**< Colour param.rgb with the alpha of two textures mixed by param.a. */
+   GL_PROG_INTERPOLATE_BATCH, /**< Like GL_PROG_INTERPOLATE but mixed by the second texture coordinate. */
+   GL_PROG_INTERFERENCE, /**< Radar static, texture coordinates in pixels, param is time, volatility and radius. */
+   GL_PROG_MAX          /**< Number of built-in programs. */
+} glProgramID;
+
+
+/*
+ * Programs.
+ */
+int gl_hasShaders (void);
+GLuint gl_programCreate( const char *name, const char *vert, const char *frag );
+void gl_programFree( GLuint program );
+
+/*
+ * Built-in programs.
+ */
+void gl_initPrograms (void);
+void gl_exitPrograms (void);
+int gl_programAvailable( glProgramID id );
+int gl_programUse( glProgramID id, const GLfloat *param );
+void gl_programUnuse (void);
+
+
+#endif /* OPENGL_SHADER_H */
+
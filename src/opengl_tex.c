@@ -6,6 +6,16 @@
  * @file opengl_tex.c
  *
  * @brief This file handles the opengl texture wrapper routines.
+ *
+ * Textures flagged with OPENGL_TEX_CACHE keep the blocks the driver
+ *  compressed them to in the cache directory, keyed by the MD5 of the image
+ *  file like the collision maps. Later loads upload the blocks directly, which
+ *  skips decoding the PNG when nothing else needs the pixels.
+ *
+ * Transparency maps are kept in a single pack in the cache directory that is
+ *  memory mapped at start up, so textures point straight into it and running
+ *  instances share the pages. Maps computed during the session are added to
+ *  the pack when the texture subsystem exits.
  */
 
 
@@ -16,6 +26,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
 #include "nstring.h"
 
 #include "log.h"
@@ -25,6 +36,10 @@
 #include "conf.h"
 #include "npng.h"
 #include "md5.h"
+#include "threadpool.h"
+#include "array.h"
+
+#include "SDL_mutex.h"
 
 
 /*
@@ -37,8 +52,102 @@ typedef struct glTexList_ {
    struct glTexList_ *next; /**< Next in linked list */
    glTexture *tex; /**< associated texture */
    int used; /**< counts how many times texture is being used */
+   size_t bytes; /**< Estimated video memory used. */
+   unsigned int stamp; /**< When it stopped being used, for eviction. */
 } glTexList;
 static glTexList* texture_list = NULL; /**< Texture list. */
+static size_t texture_bytes   = 0; /**< Estimated video memory of the list. */
+static size_t texture_cached  = 0; /**< Bytes of unused textures kept in the list. */
+static unsigned int texture_stamp = 0; /**< Last unused stamp given. */
+
+
+/*
+ * Transparency maps.
+ */
+#if defined(__GNUC__)
+#define TRANS_LANES  4 /**< Pixels tested at once, SSE2 or NEON width. */
+typedef uint32_t trans_v4 __attribute__ ((vector_size (4*sizeof(uint32_t)))); /**< Vector of TRANS_LANES pixels. */
+#endif /* defined(__GNUC__) */
+
+/*
+ * Atlases.
+ */
+#define OPENGL_ATLAS_SIZE  1024 /**< Width and height of an atlas. */
+#define OPENGL_ATLAS_MAX   256 /**< Largest image side packed in an atlas. */
+#define OPENGL_ATLAS_PAD   2 /**< Transparent gap between packed images. */
+/**
+ * @brief Shared texture small images are packed into, in shelves.
+ */
+typedef struct glAtlas_ {
+   struct glAtlas_ *next; /**< Next atlas. */
+   GLuint texture; /**< OpenGL texture. */
+   int x; /**< Free X position on the current shelf. */
+   int y; /**< Y position of the current shelf. */
+   int shelf; /**< Height of the current shelf. */
+   int users; /**< Textures packed in it. */
+} glAtlas;
+static glAtlas *gl_atlases = NULL; /**< Atlases in use. */
+
+
+/**
+ * @brief Image being decoded in the background.
+ */
+struct glTexAsync_ {
+   char *path; /**< Path of the image. */
+   unsigned int flags; /**< Flags to load the texture with. */
+   NdataView view; /**< File being decoded. */
+   SDL_sem *done; /**< Posted by the worker when decoded. */
+   int ready; /**< Whether done has already been taken. */
+   SDL_Surface *surface; /**< Decoded surface, NULL on failure. */
+   png_uint_32 w; /**< Non-padded width. */
+   png_uint_32 h; /**< Non-padded height. */
+   int sx; /**< X sprites. */
+   int sy; /**< Y sprites. */
+   int fsx; /**< X sprites forced by gl_newSpriteAsync(), 0 to use the metadata. */
+   int fsy; /**< Y sprites forced by gl_newSpriteAsync(), 0 to use the metadata. */
+   int cached; /**< Whether to use the compressed texture cache. */
+   int stale; /**< Whether the compressed texture cache turned out unusable. */
+   char digest[33]; /**< Digest of the file, empty if not needed. */
+   char *cache; /**< Compressed texture cache file read, NULL if missing. */
+   int cachesize; /**< Size of cache. */
+   glTexture mask; /**< Transparency map and collision masks built by the worker. */
+};
+
+
+/*
+ * Transparency map pack.
+ */
+#define OPENGL_TRANSPACK_FILE    "collisions.pack" /**< Pack file, relative to the cache directory. */
+#define OPENGL_TRANSPACK_MAGIC   0x3150544e /**< "NTP1", first word of the pack. */
+/**
+ * @brief Entry of the transparency map pack index, which is sorted by digest.
+ */
+typedef struct glTransEntry_ {
+   uint8_t digest[16]; /**< MD5 of the image file. */
+   uint32_t offset; /**< Offset of the map from the start of the pack. */
+   uint32_t size; /**< Size of the map. */
+   uint32_t hash; /**< FNV-1a hash of the map. */
+} glTransEntry;
+/**
+ * @brief Transparency map computed this session, not yet in the pack.
+ */
+typedef struct glTransNew_ {
+   glTransEntry e; /**< Entry, offset unset. */
+   uint8_t *data; /**< Copy of the map. */
+} glTransNew;
+static NdataView trans_pack; /**< Mapped pack. */
+static const glTransEntry *trans_index = NULL; /**< Index of the pack. */
+static uint32_t trans_nindex  = 0; /**< Entries in trans_index. */
+static glTransNew *trans_new  = NULL; /**< Maps to add to the pack. */
+static SDL_mutex *trans_lock  = NULL; /**< Protects trans_new, maps are built on the threadpool. */
+
+
+/*
+ * Compressed texture cache.
+ */
+#define OPENGL_TEXCACHE_MAGIC    0x3143544e /**< "NTC1", first word of a cache file. */
+#define OPENGL_TEXCACHE_HEADER   8 /**< Words in the header: magic, POT, format, levels, w, h, sx, sy. */
+#define OPENGL_TEXCACHE_LEVELS   10 /**< Maximum mipmap levels, same as GL_TEXTURE_MAX_LEVEL used. */
 
 
 /*
@@ -54,13 +163,58 @@ static int gl_tex_ext_npot = 0; /**< Support for GL_ARB_texture_non_power_of_two
 /*static int SDL_VFlipSurface( SDL_Surface* surface );*/
 static int SDL_IsTrans( SDL_Surface* s, int x, int y );
 static uint8_t* SDL_MapTrans( SDL_Surface* s, int w, int h );
+static void SDL_MapTransRow( const Uint32 *p, Uint32 amask, Uint32 thr,
+      uint8_t *t, int bit, int w );
 static size_t gl_transSize( const int w, const int h );
+static void gl_texMask( glTexture *t );
+static uint8_t* gl_texTrans( SDL_Surface *surface, const char *digest, int w, int h );
+/* Transparency map pack. */
+static uint32_t gl_transHash( const uint8_t *data, size_t len );
+static void gl_transDigest( const char *digest, uint8_t raw[16] );
+static int gl_transCompare( const void *p1, const void *p2 );
+static void gl_transPackOpen (void);
+static void gl_transPackSave (void);
+static const uint8_t* gl_transPackFind( const char *digest, size_t size );
+static uint8_t* gl_transPackFindNew( const char *digest, size_t size );
+static void gl_transPackAdd( const char *digest, const uint8_t *trans, size_t size );
+static int gl_transMapped( const uint8_t *trans );
+static int gl_outlineCompare( const void *p1, const void *p2 );
+static GLfloat gl_outlineCross( const GLfloat *o, const GLfloat *a, const GLfloat *b );
+static int gl_outlineHull( GLfloat *pts, int n );
 /* glTexture */
+static void gl_texParams( unsigned int flags );
+static void gl_texMipmaps( unsigned int flags );
 static GLuint gl_loadSurface( SDL_Surface* surface, int *rw, int *rh, unsigned int flags, int freesur );
+static glTexture* gl_loadImagePadCache( const char *name, SDL_Surface* surface,
+      const char *digest, unsigned int flags, int w, int h, int sx, int sy, int freesur );
 static glTexture* gl_loadNewImage( const char* path, unsigned int flags );
+static SDL_Surface* gl_rotateCPU( SDL_Surface *base, int bw, int bh,
+      int sx, int sy, int pw, int ph );
+static GLuint gl_rotateGPU( SDL_Surface *base, int bw, int bh,
+      int sx, int sy, int pw, int ph, unsigned int flags, SDL_Surface **sheet );
+static int gl_asyncDecode( void *data );
+static void gl_asyncWait( glTexAsync *a );
+static void gl_asyncFree( glTexAsync *a );
+/* Compressed cache. */
+static void gl_texDigest( const void *data, size_t len, char digest[33] );
+static void gl_texDigestRW( SDL_RWops *rw, char digest[33] );
+static int gl_texCacheEnabled( unsigned int flags );
+static char* gl_texCacheRead( const char *digest, int *size );
+static glTexture* gl_texCacheCreate( const char *name, const char *cache,
+      int size, unsigned int flags );
+static void gl_texCacheWrite( const char *digest, GLuint texture,
+      int w, int h, int sx, int sy );
 /* List. */
 static glTexture* gl_texExists( const char* path );
-static int gl_texAdd( glTexture *tex );
+static int gl_texAdd( glTexture *tex, unsigned int flags );
+static void gl_texRevive( glTexList *cur );
+static void gl_texDelete( glTexture *texture );
+static void gl_texRemove( glTexList *node );
+/* Atlas. */
+static int gl_atlasFit( glAtlas *a, int w, int h, int *x, int *y );
+static glAtlas* gl_atlasNew (void);
+static glTexture* gl_loadAtlas( const char* name, SDL_Surface* surface,
+      int w, int h, int sx, int sy, int freesur );
 
 
 /**
@@ -159,6 +313,55 @@ static int SDL_IsTrans( SDL_Surface* s, int x, int y )
 }
 
 
+/**
+ * @brief Maps the transparency of a row of 32 bit pixels.
+ *
+ * Pixels that start a byte of the map are tested 8 at a time, the alpha of
+ *  each lane compared against the threshold and the results weighted by
+ *  their bit to build the byte.
+ *
+ *    @param p Pixels of the row.
+ *    @param amask Alpha mask of the pixels.
+ *    @param thr Alpha below which pixels are transparent.
+ *    @param t Transparency map.
+ *    @param bit Bit of the map of the first pixel of the row.
+ *    @param w Width of the row.
+ */
+static void SDL_MapTransRow( const Uint32 *p, Uint32 amask, Uint32 thr,
+      uint8_t *t, int bit, int w )
+{
+   int j;
+#if defined(TRANS_LANES)
+   trans_v4 a, b, vmask, vthr, lo, hi;
+   uint32_t r;
+
+   vmask = (trans_v4){ amask, amask, amask, amask };
+   vthr  = (trans_v4){ thr, thr, thr, thr };
+   lo    = (trans_v4){ 1, 2, 4, 8 };
+   hi    = (trans_v4){ 16, 32, 64, 128 };
+#endif /* defined(TRANS_LANES) */
+
+   for (j=0; j<w; j++) {
+#if defined(TRANS_LANES)
+      /* Whole bytes of the map. */
+      if (((bit+j)%8 == 0) && (j+2*TRANS_LANES <= w)) {
+         memcpy( &a, &p[j], sizeof(trans_v4) );
+         memcpy( &b, &p[j+TRANS_LANES], sizeof(trans_v4) );
+         a = (trans_v4)((a & vmask) >= vthr) & lo;
+         b = (trans_v4)((b & vmask) >= vthr) & hi;
+         a |= b;
+         r  = a[0] | a[1] | a[2] | a[3];
+         t[(bit+j)/8] = r;
+         j += 2*TRANS_LANES - 1;
+         continue;
+      }
+#endif /* defined(TRANS_LANES) */
+      if ((p[j] & amask) >= thr)
+         t[(bit+j)/8] |= 1<<((bit+j)%8);
+   }
+}
+
+
 /**
  * @brief Maps the surface transparency.
  *
@@ -175,6 +378,7 @@ static uint8_t* SDL_MapTrans( SDL_Surface* s, int w, int h )
    int i,j;
    size_t size;
    uint8_t *t;
+   Uint32 thr;
 
    /* Get limit.s */
    if (w < 0)
@@ -191,6 +395,15 @@ static uint8_t* SDL_MapTrans( SDL_Surface* s, int w, int h )
    }
    memset(t, 0, size); /* important, must be set to zero */
 
+   /* 32 bit surfaces, which is what gets decoded, are mapped a row at a time. */
+   if (s->format->BytesPerPixel == 4) {
+      thr = (Uint32)(0.1*(double)s->format->Amask);
+      for (i=0; i<h; i++)
+         SDL_MapTransRow( (const Uint32*)((const Uint8*)s->pixels + i*s->pitch),
+               s->format->Amask, thr, t, i*w, w );
+      return t;
+   }
+
    /* Check each pixel individually. */
    for (i=0; i<h; i++)
       for (j=0; j<w; j++) /* sets each bit to be 1 if not transparent or 0 if is */
@@ -214,6 +427,173 @@ static size_t gl_transSize( const int w, const int h )
 }
 
 
+/**
+ * @brief Builds the collision masks of a texture from its transparency map.
+ *
+ * Each sprite gets its rows packed into 64 bit words so collisions can be
+ *  checked a word at a time, along with the bounding box and the convex hull
+ *  of its opaque pixels.
+ *
+ *    @param t Texture with a transparency map.
+ */
+static void gl_texMask( glTexture *t )
+{
+   int sx, sy, sw, sh, nsx, nsy;
+   int f, r, c, i, tx, ty, n, c1, c2;
+   int *hull;
+   uint64_t *row;
+   GLfloat *pts;
+
+   nsx = (int)t->sx;
+   nsy = (int)t->sy;
+   sw  = (int)t->sw;
+   sh  = (int)t->sh;
+
+   t->mask_stride = (sw + 63) / 64;
+   t->mask        = calloc( nsx*nsy * sh * t->mask_stride, sizeof(uint64_t) );
+   t->mask_hull   = malloc( nsx*nsy * 4 * sizeof(int) );
+   t->outline_start = malloc( (nsx*nsy+1) * sizeof(int) );
+   pts            = malloc( 8*sh * sizeof(GLfloat) );
+   if ((t->mask == NULL) || (t->mask_hull == NULL) ||
+         (t->outline_start == NULL) || (pts == NULL)) {
+      WARN("Out of Memory");
+      free( t->mask );
+      free( t->mask_hull );
+      free( t->outline_start );
+      free( pts );
+      t->mask      = NULL;
+      t->mask_hull = NULL;
+      t->outline_start = NULL;
+      return;
+   }
+   t->outline_start[0] = 0;
+
+   for (sy=0; sy<nsy; sy++) {
+      for (sx=0; sx<nsx; sx++) {
+         f    = sy*nsx + sx;
+         hull = &t->mask_hull[ 4*f ];
+         hull[0] = sw;
+         hull[1] = sh;
+         hull[2] = -1;
+         hull[3] = -1;
+
+         /* Sprites are stored flipped vertically in the sheet. */
+         tx = sx * sw;
+         ty = (nsy - sy - 1) * sh;
+         n = 0;
+         for (r=0; r<sh; r++) {
+            row = &t->mask[ (f*sh + r) * t->mask_stride ];
+            c1  = sw;
+            c2  = -1;
+            for (c=0; c<sw; c++) {
+               i = (ty+r)*(int)t->w + tx + c;
+               if (!(t->trans[ i/8 ] & (1 << (i%8))))
+                  continue;
+               row[ c/64 ] |= (uint64_t)1 << (c%64);
+               c1 = MIN( c1, c );
+               c2 = c;
+            }
+            if (c2 < 0)
+               continue;
+            hull[0] = MIN( hull[0], c1 );
+            hull[1] = MIN( hull[1], r );
+            hull[2] = MAX( hull[2], c2 );
+            hull[3] = r;
+
+            /* Corners of the outermost pixels of the row. */
+            pts[n++] = c1;    pts[n++] = r;
+            pts[n++] = c1;    pts[n++] = r+1;
+            pts[n++] = c2+1;  pts[n++] = r;
+            pts[n++] = c2+1;  pts[n++] = r+1;
+         }
+
+         /* Keep only the convex hull of the row corners. */
+         n = gl_outlineHull( pts, n/2 );
+         if (n > 0) {
+            t->outline = realloc( t->outline,
+                  (t->outline_start[f] + n) * 2 * sizeof(GLfloat) );
+            memcpy( &t->outline[ 2*t->outline_start[f] ], pts, n * 2 * sizeof(GLfloat) );
+         }
+         t->outline_start[f+1] = t->outline_start[f] + n;
+      }
+   }
+
+   free( pts );
+}
+
+
+/**
+ * @brief Orders outline points by x and then y.
+ */
+static int gl_outlineCompare( const void *p1, const void *p2 )
+{
+   const GLfloat *a, *b;
+
+   a = (const GLfloat*) p1;
+   b = (const GLfloat*) p2;
+   if (a[0] != b[0])
+      return (a[0] < b[0]) ? -1 : 1;
+   if (a[1] != b[1])
+      return (a[1] < b[1]) ? -1 : 1;
+   return 0;
+}
+
+
+/**
+ * @brief Gets the cross product of OA and OB, positive if counter-clockwise.
+ */
+static GLfloat gl_outlineCross( const GLfloat *o, const GLfloat *a, const GLfloat *b )
+{
+   return (a[0]-o[0]) * (b[1]-o[1]) - (a[1]-o[1]) * (b[0]-o[0]);
+}
+
+
+/**
+ * @brief Replaces a set of points with their convex hull.
+ *
+ * Uses the monotone chain algorithm, the hull is counter-clockwise.
+ *
+ *    @param[in,out] pts Points as x, y pairs, overwritten by the hull.
+ *    @param n Number of points.
+ *    @return Number of points in the hull.
+ */
+static int gl_outlineHull( GLfloat *pts, int n )
+{
+   int i, k, lower;
+   GLfloat *h;
+
+   if (n < 3)
+      return 0;
+
+   qsort( pts, n, 2*sizeof(GLfloat), gl_outlineCompare );
+
+   h = malloc( 2 * 2*n * sizeof(GLfloat) );
+   k = 0;
+   /* Lower hull. */
+   for (i=0; i<n; i++) {
+      while ((k >= 2) && (gl_outlineCross( &h[2*(k-2)], &h[2*(k-1)], &pts[2*i] ) <= 0.))
+         k--;
+      h[2*k]   = pts[2*i];
+      h[2*k+1] = pts[2*i+1];
+      k++;
+   }
+   /* Upper hull. */
+   lower = k+1;
+   for (i=n-2; i>=0; i--) {
+      while ((k >= lower) && (gl_outlineCross( &h[2*(k-2)], &h[2*(k-1)], &pts[2*i] ) <= 0.))
+         k--;
+      h[2*k]   = pts[2*i];
+      h[2*k+1] = pts[2*i+1];
+      k++;
+   }
+   k--; /* Last point is the first one. */
+
+   memcpy( pts, h, 2*k * sizeof(GLfloat) );
+   free( h );
+   return k;
+}
+
+
 /**
  * @brief Prepares the surface to be loaded as a texture.
  *
@@ -303,6 +683,53 @@ int gl_texHasCompress (void)
    return (nglCompressedTexImage2D != NULL);
 }
 
+/**
+ * @brief Sets the filtering and wrapping of the bound texture.
+ *
+ *    @param flags Flags the texture is loaded with.
+ */
+static void gl_texParams( unsigned int flags )
+{
+   /* Filtering, LINEAR is better for scaling, nearest looks nicer, LINEAR
+    * also seems to create a bit of artifacts around the edges */
+   if ((gl_screen.scale != 1.) || (flags & OPENGL_TEX_MIPMAPS)) {
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+   }
+   else {
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+   }
+
+   /* Always wrap just in case. */
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+/**
+ * @brief Generates the mipmaps of the bound texture if requested.
+ *
+ *    @param flags Flags the texture is loaded with.
+ */
+static void gl_texMipmaps( unsigned int flags )
+{
+   GLfloat param;
+
+   if (!(flags & OPENGL_TEX_MIPMAPS) || !gl_texHasMipmaps())
+      return;
+
+   /* Do fancy stuff. */
+   if (gl_hasExt("GL_EXT_texture_filter_anisotropic")) {
+      glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &param);
+      glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, param);
+   }
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 9);
+
+   /* Now generate the mipmaps. */
+   nglGenerateMipmap(GL_TEXTURE_2D);
+}
+
 /**
  * @brief Loads a surface into an opengl texture.
  *
@@ -315,7 +742,6 @@ int gl_texHasCompress (void)
 static GLuint gl_loadSurface( SDL_Surface* surface, int *rw, int *rh, unsigned int flags, int freesur )
 {
    GLuint texture;
-   GLfloat param;
 
    /* Prepare the surface. */
    surface = gl_prepareSurface( surface );
@@ -327,21 +753,7 @@ static GLuint gl_loadSurface( SDL_Surface* surface, int *rw, int *rh, unsigned i
    /* opengl texture binding */
    glGenTextures( 1, &texture ); /* Creates the texture */
    glBindTexture( GL_TEXTURE_2D, texture ); /* Loads the texture */
-
-   /* Filtering, LINEAR is better for scaling, nearest looks nicer, LINEAR
-    * also seems to create a bit of artifacts around the edges */
-   if ((gl_screen.scale != 1.) || (flags & OPENGL_TEX_MIPMAPS)) {
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-   }
-   else {
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-   }
-
-   /* Always wrap just in case. */
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+   gl_texParams( flags );
 
    /* now lead the texture data up */
    SDL_LockSurface( surface );
@@ -357,18 +769,7 @@ static GLuint gl_loadSurface( SDL_Surface* surface, int *rw, int *rh, unsigned i
    SDL_UnlockSurface( surface );
 
    /* Create mipmaps. */
-   if ((flags & OPENGL_TEX_MIPMAPS) && gl_texHasMipmaps()) {
-      /* Do fancy stuff. */
-      if (gl_hasExt("GL_EXT_texture_filter_anisotropic")) {
-         glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &param);
-         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, param);
-      }
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 9);
-
-      /* Now generate the mipmaps. */
-      nglGenerateMipmap(GL_TEXTURE_2D);
-   }
+   gl_texMipmaps( flags );
 
    /* cleanup */
    if (freesur)
@@ -380,339 +781,1656 @@ static GLuint gl_loadSurface( SDL_Surface* surface, int *rw, int *rh, unsigned i
 
 
 /**
- * @brief Wrapper for gl_loadImagePad that includes transparency mapping.
- *
- *    @param name Name to load with.
- *    @param surface Surface to load.
- *    @param rw RWops containing data to hash.
- *    @param flags Flags to use.
- *    @param w Non-padded width.
- *    @param h Non-padded height.
- *    @param sx X sprites.
- *    @param sy Y sprites.
- *    @param freesur Whether or not to free the surface.
- *    @return The glTexture for surface.
+ * @brief Gets the FNV-1a hash of a transparency map.
  */
-glTexture* gl_loadImagePadTrans( const char *name, SDL_Surface* surface, SDL_RWops *rw,
-      unsigned int flags, int w, int h, int sx, int sy, int freesur )
+static uint32_t gl_transHash( const uint8_t *data, size_t len )
 {
-   glTexture *texture;
-   int i, filesize;
-   size_t cachesize, pngsize;
-   uint8_t *trans;
-   char *cachefile, *data;
-   char digest[33];
-   md5_state_t md5;
-   md5_byte_t *md5val;
+   uint32_t h;
+   size_t i;
 
-   if (name != NULL) {
-      texture = gl_texExists( name );
-      if (texture != NULL)
-         return texture;
+   h = 2166136261u;
+   for (i=0; i<len; i++) {
+      h ^= data[i];
+      h *= 16777619u;
    }
+   return h;
+}
 
-   if (flags & OPENGL_TEX_MAPTRANS)
-      flags ^= OPENGL_TEX_MAPTRANS;
 
-   /* Appropriate size for the transparency map, see SDL_MapTrans */
-   cachesize = gl_transSize(w, h);
+/**
+ * @brief Converts a hex digest to its raw bytes.
+ */
+static void gl_transDigest( const char *digest, uint8_t raw[16] )
+{
+   unsigned int v;
+   int i;
 
-   cachefile = NULL;
-   trans     = NULL;
+   for (i=0; i<16; i++) {
+      sscanf( &digest[2*i], "%2x", &v );
+      raw[i] = v;
+   }
+}
 
-   if (rw != NULL) {
-      md5val = malloc(16);
-      md5_init(&md5);
-
-      pngsize = SDL_RWseek( rw, 0, SEEK_END );
-      SDL_RWseek( rw, 0, SEEK_SET );
-
-      data = malloc(pngsize);
-      if (data == NULL)
-         WARN("Out of memory!");
-      else {
-         SDL_RWread( rw, data, pngsize, 1 );
-         md5_append( &md5, (md5_byte_t*)data, pngsize );
-         free(data);
-      }
-      md5_finish( &md5, md5val );
 
-      for (i=0; i<16; i++)
-         nsnprintf( &digest[i * 2], 3, "%02x", md5val[i] );
-      free(md5val);
+/**
+ * @brief Compares transparency map pack entries by digest.
+ */
+static int gl_transCompare( const void *p1, const void *p2 )
+{
+   return memcmp( ((const glTransEntry*)p1)->digest,
+         ((const glTransEntry*)p2)->digest, 16 );
+}
 
-      cachefile = malloc( PATH_MAX );
-      nsnprintf( cachefile, PATH_MAX, "%scollisions/%s",
-         nfile_cachePath(), digest );
 
-      /* Attempt to find a cached transparency map. */
-      if (nfile_fileExists(cachefile)) {
-         trans = (uint8_t*)nfile_readFile( &filesize, cachefile );
+/**
+ * @brief Maps the transparency map pack.
+ */
+static void gl_transPackOpen (void)
+{
+   char file[PATH_MAX];
+   uint32_t header[2];
 
-         /* Consider cached data invalid if the length doesn't match. */
-         if (trans != NULL && cachesize != (unsigned int)filesize) {
-            free(trans);
-            trans = NULL;
-         }
-         /* Cached data matches, no need to overwrite. */
-         else {
-            free(cachefile);
-            cachefile = NULL;
-         }
-      }
-   }
-   else {
-      /* We could hash raw pixel data here, but that's slower than just
-       * generating the map from scratch.
-       */
-      WARN("Texture '%s' has no RWops", name);
-   }
+   trans_lock = SDL_CreateMutex();
 
-   if (trans == NULL) {
-      SDL_LockSurface(surface);
-      trans = SDL_MapTrans( surface, w, h );
-      SDL_UnlockSurface(surface);
+   nsnprintf( file, sizeof(file), "%s"OPENGL_TRANSPACK_FILE, nfile_cachePath() );
+   if (ndata_mapPath( &trans_pack, file ) != 0)
+      return;
 
-      if (cachefile != NULL) {
-         /* Cache newly-generated transparency map. */
-         nfile_dirMakeExist( "%s/collisions/", nfile_cachePath() );
-         nfile_writeFile( (char*)trans, cachesize, cachefile );
-         free(cachefile);
-      }
+   /* Check the header and that the index fits. */
+   if (trans_pack.size >= sizeof(header))
+      memcpy( header, trans_pack.data, sizeof(header) );
+   if ((trans_pack.size < sizeof(header)) ||
+         (header[0] != OPENGL_TRANSPACK_MAGIC) ||
+         ((trans_pack.size - sizeof(header)) / sizeof(glTransEntry) < header[1])) {
+      WARN("Transparency map pack '%s' is corrupt, ignoring it.", file);
+      ndata_unmap( &trans_pack );
+      return;
    }
-
-   texture = gl_loadImagePad( name, surface, flags, w, h, sx, sy, freesur );
-   texture->trans = trans;
-   return texture;
+   trans_index  = (const glTransEntry*) &trans_pack.data[ sizeof(header) ];
+   trans_nindex = header[1];
 }
 
 
 /**
- * @brief Loads the already padded SDL_Surface to a glTexture.
+ * @brief Finds a transparency map in the pack.
  *
- *    @param name Name to load with.
- *    @param surface Surface to load.
- *    @param flags Flags to use.
- *    @param w Non-padded width.
- *    @param h Non-padded height.
- *    @param sx X sprites.
- *    @param sy Y sprites.
- *    @param freesur Whether or not to free the surface.
- *    @return The glTexture for surface.
+ *    @param digest Digest of the image file.
+ *    @param size Expected size of the map.
+ *    @return The map in the pack or NULL if missing or invalid.
  */
-glTexture* gl_loadImagePad( const char *name, SDL_Surface* surface,
-      unsigned int flags, int w, int h, int sx, int sy, int freesur )
+static const uint8_t* gl_transPackFind( const char *digest, size_t size )
 {
-   glTexture *texture;
-   int rw, rh;
+   glTransEntry key;
+   const glTransEntry *e;
+   const uint8_t *data;
 
-   /* Make sure doesn't already exist. */
-   if (name != NULL) {
-      texture = gl_texExists( name );
-      if (texture != NULL)
-         return texture;
-   }
+   if (trans_nindex == 0)
+      return NULL;
 
-   if (flags & OPENGL_TEX_MAPTRANS)
-      return gl_loadImagePadTrans( name, surface, NULL, flags, w, h,
-            sx, sy, freesur );
+   gl_transDigest( digest, key.digest );
+   e = bsearch( &key, trans_index, trans_nindex, sizeof(glTransEntry),
+         gl_transCompare );
+   if ((e == NULL) || (e->size != size) || (e->offset > trans_pack.size) ||
+         (trans_pack.size - e->offset < e->size))
+      return NULL;
 
-   /* set up the texture defaults */
-   texture = calloc( 1, sizeof(glTexture) );
+   data = (const uint8_t*) &trans_pack.data[ e->offset ];
+   if (gl_transHash( data, e->size ) != e->hash)
+      return NULL;
+   return data;
+}
 
-   texture->w     = (double) w;
-   texture->h     = (double) h;
-   texture->sx    = (double) sx;
-   texture->sy    = (double) sy;
 
-   texture->texture = gl_loadSurface( surface, &rw, &rh, flags, freesur );
+/**
+ * @brief Finds a transparency map computed this session.
+ *
+ *    @return A copy of the map or NULL if missing.
+ */
+static uint8_t* gl_transPackFindNew( const char *digest, size_t size )
+{
+   uint8_t raw[16];
+   uint8_t *trans;
+   int i;
 
-   texture->rw    = (double) rw;
-   texture->rh    = (double) rh;
-   texture->sw    = texture->w / texture->sx;
-   texture->sh    = texture->h / texture->sy;
-   texture->srw   = texture->sw / texture->rw;
-   texture->srh   = texture->sh / texture->rh;
+   if (trans_new == NULL)
+      return NULL;
 
-   if (name != NULL) {
-      texture->name = strdup(name);
-      gl_texAdd( texture );
+   gl_transDigest( digest, raw );
+   trans = NULL;
+   SDL_mutexP( trans_lock );
+   for (i=0; i<array_size(trans_new); i++) {
+      if ((memcmp( trans_new[i].e.digest, raw, 16 ) != 0) ||
+            (trans_new[i].e.size != size))
+         continue;
+      trans = malloc( size );
+      memcpy( trans, trans_new[i].data, size );
+      break;
    }
-   else
-      texture->name = NULL;
-
-   return texture;
+   SDL_mutexV( trans_lock );
+   return trans;
 }
 
 
 /**
- * @brief Loads the SDL_Surface to a glTexture.
- *
- *    @param surface Surface to load.
+ * @brief Queues a transparency map to be added to the pack.
+ */
+static void gl_transPackAdd( const char *digest, const uint8_t *trans, size_t size )
+{
+   glTransNew *n;
+
+   SDL_mutexP( trans_lock );
+   if (trans_new == NULL)
+      trans_new = array_create( glTransNew );
+   n         = &array_grow( &trans_new );
+   gl_transDigest( digest, n->e.digest );
+   n->e.offset = 0;
+   n->e.size = size;
+   n->e.hash = gl_transHash( trans, size );
+   n->data   = malloc( size );
+   memcpy( n->data, trans, size );
+   SDL_mutexV( trans_lock );
+}
+
+
+/**
+ * @brief Checks whether a transparency map points into the pack.
+ */
+static int gl_transMapped( const uint8_t *trans )
+{
+   return (trans_pack.data != NULL) &&
+         ((const char*)trans >= trans_pack.data) &&
+         ((const char*)trans < trans_pack.data + trans_pack.size);
+}
+
+
+/**
+ * @brief Rewrites the pack with the maps computed this session.
+ *
+ * The new pack is written next to the old one and renamed over it, so other
+ *  instances keep their mapping of the old one.
+ */
+static void gl_transPackSave (void)
+{
+   char file[PATH_MAX], tmp[PATH_MAX];
+   glTransEntry *index;
+   const uint8_t **data;
+   uint32_t header[2], n, i, j, k;
+   size_t total;
+   char *buf;
+
+   if ((trans_new == NULL) || (array_size(trans_new) == 0))
+      return;
+
+   /* Merge the entries, new ones first to replace invalid old ones. */
+   n     = trans_nindex + array_size(trans_new);
+   index = malloc( n * sizeof(glTransEntry) );
+   data  = malloc( n * sizeof(uint8_t*) );
+   k     = 0;
+   for (i=0; i<(uint32_t)array_size(trans_new); i++) {
+      index[k] = trans_new[i].e;
+      k++;
+   }
+   for (i=0; i<trans_nindex; i++) {
+      if ((trans_index[i].offset > trans_pack.size) ||
+            (trans_pack.size - trans_index[i].offset < trans_index[i].size) ||
+            (gl_transHash( (const uint8_t*) &trans_pack.data[ trans_index[i].offset ],
+               trans_index[i].size ) != trans_index[i].hash))
+         continue;
+      index[k] = trans_index[i];
+      k++;
+   }
+
+   /* Sort, the stable order of qsort isn't guaranteed so look up data after. */
+   for (i=0; i<k; i++)
+      index[i].hash = (i < (uint32_t)array_size(trans_new)) ? i : (uint32_t)-1 - i;
+   qsort( index, k, sizeof(glTransEntry), gl_transCompare );
+   n     = 0;
+   total = sizeof(header);
+   for (i=0; i<k; i++) {
+      if ((n > 0) && (memcmp( index[n-1].digest, index[i].digest, 16 ) == 0)) {
+         /* Prefer the new one. */
+         if (index[i].hash < (uint32_t)array_size(trans_new))
+            index[n-1] = index[i];
+         continue;
+      }
+      index[n++] = index[i];
+   }
+   for (i=0; i<n; i++) {
+      j = index[i].hash;
+      if (j < (uint32_t)array_size(trans_new))
+         data[i] = trans_new[j].data;
+      else
+         data[i] = (const uint8_t*) &trans_pack.data[ index[i].offset ];
+      index[i].hash = gl_transHash( data[i], index[i].size );
+   }
+   total += n * sizeof(glTransEntry);
+   for (i=0; i<n; i++) {
+      index[i].offset = total;
+      total += index[i].size;
+   }
+
+   /* Write it all out. */
+   buf = malloc( total );
+   if (buf == NULL) {
+      WARN("Out of memory!");
+      free( index );
+      free( data );
+      return;
+   }
+   header[0] = OPENGL_TRANSPACK_MAGIC;
+   header[1] = n;
+   memcpy( buf, header, sizeof(header) );
+   memcpy( &buf[ sizeof(header) ], index, n * sizeof(glTransEntry) );
+   for (i=0; i<n; i++)
+      memcpy( &buf[ index[i].offset ], data[i], index[i].size );
+
+   nsnprintf( file, sizeof(file), "%s"OPENGL_TRANSPACK_FILE, nfile_cachePath() );
+   nsnprintf( tmp, sizeof(tmp), "%s.tmp", file );
+   nfile_dirMakeExist( "%s", nfile_cachePath() );
+   if (nfile_writeFile( buf, total, tmp ) == 0) {
+      /* Not every platform replaces on rename. */
+      if (rename( tmp, file ) != 0) {
+         remove( file );
+         if (rename( tmp, file ) != 0)
+            WARN("Unable to replace transparency map pack '%s'.", file);
+      }
+   }
+
+   free( buf );
+   free( index );
+   free( data );
+}
+
+
+/**
+ * @brief Gets the transparency map of a surface, using the pack.
+ *
+ * Doesn't touch OpenGL so it can be run from the threadpool. Maps found in
+ *  the pack point into it and mustn't be freed, see gl_transMapped().
+ *
+ *    @param surface Surface to map.
+ *    @param digest Digest of the image file or NULL to not cache.
+ *    @param w Non-padded width.
+ *    @param h Non-padded height.
+ *    @return The transparency map.
+ */
+static uint8_t* gl_texTrans( SDL_Surface *surface, const char *digest, int w, int h )
+{
+   size_t cachesize;
+   uint8_t *trans;
+
+   /* Appropriate size for the transparency map, see SDL_MapTrans */
+   cachesize = gl_transSize(w, h);
+
+   if (digest != NULL) {
+      trans = (uint8_t*) gl_transPackFind( digest, cachesize );
+      if (trans == NULL)
+         trans = gl_transPackFindNew( digest, cachesize );
+      if (trans != NULL)
+         return trans;
+   }
+
+   SDL_LockSurface(surface);
+   trans = SDL_MapTrans( surface, w, h );
+   SDL_UnlockSurface(surface);
+
+   if ((digest != NULL) && (trans != NULL))
+      gl_transPackAdd( digest, trans, cachesize );
+
+   return trans;
+}
+
+
+/**
+ * @brief Wrapper for gl_loadImagePad that includes transparency mapping.
+ *
+ *    @param name Name to load with.
+ *    @param surface Surface to load.
+ *    @param rw RWops containing data to hash.
+ *    @param flags Flags to use.
+ *    @param w Non-padded width.
+ *    @param h Non-padded height.
+ *    @param sx X sprites.
+ *    @param sy Y sprites.
+ *    @param freesur Whether or not to free the surface.
+ *    @return The glTexture for surface.
+ */
+glTexture* gl_loadImagePadTrans( const char *name, SDL_Surface* surface, SDL_RWops *rw,
+      unsigned int flags, int w, int h, int sx, int sy, int freesur )
+{
+   glTexture *texture;
+   int texcachesize;
+   uint8_t *trans;
+   char *texcache;
+   char digest[33];
+
+   if (name != NULL) {
+      texture = gl_texExists( name );
+      if (texture != NULL)
+         return texture;
+   }
+
+   if (flags & OPENGL_TEX_MAPTRANS)
+      flags ^= OPENGL_TEX_MAPTRANS;
+
+   if (rw != NULL)
+      gl_texDigestRW( rw, digest );
+   else {
+      /* We could hash raw pixel data here, but that's slower than just
+       * generating the map from scratch.
+       */
+      WARN("Texture '%s' has no RWops", name);
+   }
+   trans = gl_texTrans( surface, (rw != NULL) ? digest : NULL, w, h );
+
+   /* Same digest for the compressed blocks. */
+   texture = NULL;
+   if ((rw != NULL) && gl_texCacheEnabled( flags )) {
+      texcache = gl_texCacheRead( digest, &texcachesize );
+      if (texcache != NULL) {
+         texture = gl_texCacheCreate( name, texcache, texcachesize, flags );
+         free( texcache );
+      }
+      if ((texture != NULL) && freesur)
+         SDL_FreeSurface( surface );
+   }
+   if (texture == NULL)
+      texture = gl_loadImagePadCache( name, surface,
+            ((rw != NULL) && gl_texCacheEnabled( flags )) ? digest : NULL,
+            flags, w, h, sx, sy, freesur );
+   texture->trans = trans;
+   if (trans != NULL)
+      gl_texMask( texture );
+   return texture;
+}
+
+
+/**
+ * @brief Loads the already padded SDL_Surface to a glTexture.
+ *
+ *    @param name Name to load with.
+ *    @param surface Surface to load.
  *    @param flags Flags to use.
+ *    @param w Non-padded width.
+ *    @param h Non-padded height.
+ *    @param sx X sprites.
+ *    @param sy Y sprites.
+ *    @param freesur Whether or not to free the surface.
+ *    @return The glTexture for surface.
+ */
+glTexture* gl_loadImagePad( const char *name, SDL_Surface* surface,
+      unsigned int flags, int w, int h, int sx, int sy, int freesur )
+{
+   return gl_loadImagePadCache( name, surface, NULL, flags,
+         w, h, sx, sy, freesur );
+}
+
+
+/**
+ * @brief Loads the already padded SDL_Surface to a glTexture, writing the
+ *        compressed texture cache.
+ *
+ *    @param digest Digest of the image file to cache as or NULL.
  *    @return The glTexture for surface.
+ *    @sa gl_loadImagePad
+ */
+static glTexture* gl_loadImagePadCache( const char *name, SDL_Surface* surface,
+      const char *digest, unsigned int flags, int w, int h, int sx, int sy, int freesur )
+{
+   glTexture *texture;
+   int rw, rh;
+
+   /* Make sure doesn't already exist. */
+   if (name != NULL) {
+      texture = gl_texExists( name );
+      if (texture != NULL)
+         return texture;
+   }
+
+   if (flags & OPENGL_TEX_MAPTRANS)
+      return gl_loadImagePadTrans( name, surface, NULL, flags, w, h,
+            sx, sy, freesur );
+
+   /* Small images can share a texture. */
+   if ((flags & OPENGL_TEX_ATLAS) && (name != NULL)) {
+      texture = gl_loadAtlas( name, surface, w, h, sx, sy, freesur );
+      if (texture != NULL)
+         return texture;
+   }
+
+   /* set up the texture defaults */
+   texture = calloc( 1, sizeof(glTexture) );
+
+   texture->w     = (double) w;
+   texture->h     = (double) h;
+   texture->sx    = (double) sx;
+   texture->sy    = (double) sy;
+
+   texture->texture = gl_loadSurface( surface, &rw, &rh, flags, freesur );
+   if (digest != NULL)
+      gl_texCacheWrite( digest, texture->texture, w, h, sx, sy );
+
+   texture->rw    = (double) rw;
+   texture->rh    = (double) rh;
+   texture->sw    = texture->w / texture->sx;
+   texture->sh    = texture->h / texture->sy;
+   texture->srw   = texture->sw / texture->rw;
+   texture->srh   = texture->sh / texture->rh;
+
+   if (name != NULL) {
+      texture->name = strdup(name);
+      gl_texAdd( texture, flags );
+   }
+   else
+      texture->name = NULL;
+
+   return texture;
+}
+
+
+/**
+ * @brief Finds room for an image on the shelves of an atlas.
+ *
+ *    @return 0 if it fits, with the position in x and y.
+ */
+static int gl_atlasFit( glAtlas *a, int w, int h, int *x, int *y )
+{
+   /* Next shelf. */
+   if (a->x + w > OPENGL_ATLAS_SIZE) {
+      if (a->y + a->shelf + h > OPENGL_ATLAS_SIZE)
+         return -1;
+      a->y    += a->shelf;
+      a->x     = 0;
+      a->shelf = 0;
+   }
+   else if (a->y + h > OPENGL_ATLAS_SIZE)
+      return -1;
+
+   *x        = a->x;
+   *y        = a->y;
+   a->x     += w + OPENGL_ATLAS_PAD;
+   a->shelf  = MAX( a->shelf, h + OPENGL_ATLAS_PAD );
+   return 0;
+}
+
+
+/**
+ * @brief Creates a new empty atlas.
+ */
+static glAtlas* gl_atlasNew (void)
+{
+   glAtlas *a;
+   GLint max;
+
+   glGetIntegerv( GL_MAX_TEXTURE_SIZE, &max );
+   if (max < OPENGL_ATLAS_SIZE)
+      return NULL;
+
+   a = calloc( 1, sizeof(glAtlas) );
+   glGenTextures( 1, &a->texture );
+   glBindTexture( GL_TEXTURE_2D, a->texture );
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+   glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, OPENGL_ATLAS_SIZE,
+         OPENGL_ATLAS_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+
+   a->next    = gl_atlases;
+   gl_atlases = a;
+   gl_checkErr();
+   return a;
+}
+
+
+/**
+ * @brief Packs an image into an atlas.
+ *
+ * Atlas textures can be batched together by gl_batchBegin(), which is what
+ *  lets store and icon lists be drawn in a few draw calls.
+ *
+ *    @return The texture or NULL if it couldn't be packed, in which case the
+ *            surface isn't freed.
+ */
+static glTexture* gl_loadAtlas( const char* name, SDL_Surface* surface,
+      int w, int h, int sx, int sy, int freesur )
+{
+   glTexture *texture;
+   glAtlas *a;
+   int x, y;
+
+   if ((w > OPENGL_ATLAS_MAX) || (h > OPENGL_ATLAS_MAX) ||
+         (surface->format->BytesPerPixel != 4))
+      return NULL;
+
+   for (a=gl_atlases; a!=NULL; a=a->next)
+      if (gl_atlasFit( a, w, h, &x, &y ) == 0)
+         break;
+   if (a == NULL) {
+      a = gl_atlasNew();
+      if ((a == NULL) || (gl_atlasFit( a, w, h, &x, &y ) != 0))
+         return NULL;
+   }
+
+   /* Upload the non-padded part of the surface. */
+   glBindTexture( GL_TEXTURE_2D, a->texture );
+   SDL_LockSurface( surface );
+   glPixelStorei( GL_UNPACK_ROW_LENGTH, surface->pitch / 4 );
+   glTexSubImage2D( GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA,
+         GL_UNSIGNED_BYTE, surface->pixels );
+   glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+   SDL_UnlockSurface( surface );
+   if (freesur)
+      SDL_FreeSurface( surface );
+   gl_checkErr();
+
+   texture        = calloc( 1, sizeof(glTexture) );
+   texture->name  = strdup( name );
+   texture->atlas = a;
+   texture->texture = a->texture;
+   texture->w     = (double) w;
+   texture->h     = (double) h;
+   texture->sx    = (double) sx;
+   texture->sy    = (double) sy;
+   texture->rw    = (double) OPENGL_ATLAS_SIZE;
+   texture->rh    = (double) OPENGL_ATLAS_SIZE;
+   texture->sw    = texture->w / texture->sx;
+   texture->sh    = texture->h / texture->sy;
+   texture->srw   = texture->sw / texture->rw;
+   texture->srh   = texture->sh / texture->rh;
+   texture->ox    = (double) x / texture->rw;
+   texture->oy    = (double) y / texture->rh;
+   a->users++;
+
+   gl_texAdd( texture, 0 );
+   return texture;
+}
+
+
+/**
+ * @brief Gets the hex MD5 digest of some data.
+ */
+static void gl_texDigest( const void *data, size_t len, char digest[33] )
+{
+   md5_state_t md5;
+   md5_byte_t md5val[16];
+   int i;
+
+   md5_init( &md5 );
+   if (data != NULL)
+      md5_append( &md5, (const md5_byte_t*)data, len );
+   md5_finish( &md5, md5val );
+
+   for (i=0; i<16; i++)
+      nsnprintf( &digest[i * 2], 3, "%02x", md5val[i] );
+}
+
+
+/**
+ * @brief Gets the hex MD5 digest of a whole file, rewinding it after.
+ */
+static void gl_texDigestRW( SDL_RWops *rw, char digest[33] )
+{
+   size_t pngsize;
+   char *data;
+
+   pngsize = SDL_RWseek( rw, 0, SEEK_END );
+   SDL_RWseek( rw, 0, SEEK_SET );
+
+   data = malloc(pngsize);
+   if (data == NULL)
+      WARN("Out of memory!");
+   else
+      SDL_RWread( rw, data, pngsize, 1 );
+   gl_texDigest( data, pngsize, digest );
+   free(data);
+   SDL_RWseek( rw, 0, SEEK_SET );
+}
+
+
+/**
+ * @brief Checks to see if a texture can use the compressed texture cache.
+ *
+ * Blocks can only be read back with glGetCompressedTexImage, and atlas
+ *  textures are uploaded as part of a larger one.
+ */
+static int gl_texCacheEnabled( unsigned int flags )
+{
+   return (flags & OPENGL_TEX_CACHE) && !(flags & OPENGL_TEX_ATLAS) &&
+         gl_texHasCompress() && (nglGetCompressedTexImage != NULL);
+}
+
+
+/**
+ * @brief Reads a compressed texture cache file.
+ *
+ * Doesn't touch OpenGL so it can be run from the threadpool.
+ *
+ *    @param digest Digest of the image file.
+ *    @param[out] size Size of the file read.
+ *    @return The contents or NULL if not cached.
+ */
+static char* gl_texCacheRead( const char *digest, int *size )
+{
+   char file[PATH_MAX];
+
+   nsnprintf( file, sizeof(file), "%stextures/%s", nfile_cachePath(), digest );
+   if (!nfile_fileExists(file))
+      return NULL;
+   return nfile_readFile( size, file );
+}
+
+
+/**
+ * @brief Creates a texture from a compressed texture cache file.
+ *
+ *    @param name Name to load with.
+ *    @param cache Contents of the cache file.
+ *    @param size Size of cache.
+ *    @param flags Flags to use.
+ *    @return The texture or NULL if the cache can't be used.
+ */
+static glTexture* gl_texCacheCreate( const char *name, const char *cache,
+      int size, unsigned int flags )
+{
+   glTexture *texture;
+   uint32_t header[OPENGL_TEXCACHE_HEADER], level[3];
+   uint32_t i, levels;
+   int pos, rw, rh;
+   GLuint tex;
+   GLfloat param;
+
+   if ((cache == NULL) || (size < (int)sizeof(header)))
+      return NULL;
+   memcpy( header, cache, sizeof(header) );
+   levels = header[3];
+   if ((header[0] != OPENGL_TEXCACHE_MAGIC) ||
+         (header[1] != (uint32_t)gl_needPOT()) ||
+         (levels < 1) || (levels > OPENGL_TEXCACHE_LEVELS) ||
+         (header[4] == 0) || (header[5] == 0))
+      return NULL;
+
+   glGenTextures( 1, &tex );
+   glBindTexture( GL_TEXTURE_2D, tex );
+   gl_texParams( flags );
+
+   /* Upload the blocks of each level as they were read back. */
+   pos = sizeof(header);
+   rw  = rh = 0;
+   for (i=0; i<levels; i++) {
+      if (pos + (int)sizeof(level) > size)
+         break;
+      memcpy( level, &cache[pos], sizeof(level) );
+      pos += sizeof(level);
+      if ((level[2] == 0) || (level[2] > (uint32_t)(size - pos)))
+         break;
+      if (i == 0) {
+         rw = level[0];
+         rh = level[1];
+      }
+      nglCompressedTexImage2D( GL_TEXTURE_2D, i, header[2],
+            level[0], level[1], 0, level[2], &cache[pos] );
+      pos += level[2];
+   }
+
+   /* Truncated or from a driver that uses another format. */
+   if ((i < levels) || (glGetError() != GL_NO_ERROR)) {
+      glDeleteTextures( 1, &tex );
+      return NULL;
+   }
+
+   if (levels > 1) {
+      if (gl_hasExt("GL_EXT_texture_filter_anisotropic")) {
+         glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &param);
+         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, param);
+      }
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels-1);
+   }
+   else
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+   texture          = calloc( 1, sizeof(glTexture) );
+   texture->texture = tex;
+   texture->w       = (double) header[4];
+   texture->h       = (double) header[5];
+   texture->sx      = (double) MAX( 1, (int)header[6] );
+   texture->sy      = (double) MAX( 1, (int)header[7] );
+   texture->rw      = (double) rw;
+   texture->rh      = (double) rh;
+   texture->sw      = texture->w / texture->sx;
+   texture->sh      = texture->h / texture->sy;
+   texture->srw     = texture->sw / texture->rw;
+   texture->srh     = texture->sh / texture->rh;
+   if (name != NULL) {
+      texture->name = strdup(name);
+      gl_texAdd( texture, flags );
+   }
+
+   gl_checkErr();
+   return texture;
+}
+
+
+/**
+ * @brief Writes the compressed blocks of a texture to the cache.
+ *
+ *    @param digest Digest of the image file.
+ *    @param texture Texture just uploaded.
+ *    @param w Non-padded width.
+ *    @param h Non-padded height.
+ *    @param sx X sprites.
+ *    @param sy Y sprites.
+ */
+static void gl_texCacheWrite( const char *digest, GLuint texture,
+      int w, int h, int sx, int sy )
+{
+   uint32_t header[OPENGL_TEXCACHE_HEADER], level[3];
+   GLint compressed, format, lw, lh, lsize;
+   size_t total, pos;
+   int i, levels;
+   char *buf;
+
+   glBindTexture( GL_TEXTURE_2D, texture );
+   glGetTexLevelParameteriv( GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed );
+   if (!compressed)
+      return;
+   glGetTexLevelParameteriv( GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format );
+
+   /* Size up the levels. */
+   total = sizeof(header);
+   for (levels=0; levels<OPENGL_TEXCACHE_LEVELS; levels++) {
+      glGetTexLevelParameteriv( GL_TEXTURE_2D, levels, GL_TEXTURE_WIDTH, &lw );
+      if (lw <= 0)
+         break;
+      glGetTexLevelParameteriv( GL_TEXTURE_2D, levels,
+            GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &lsize );
+      total += sizeof(level) + lsize;
+   }
+   if (levels == 0)
+      return;
+
+   buf = malloc( total );
+   if (buf == NULL) {
+      WARN("Out of memory!");
+      return;
+   }
+   header[0] = OPENGL_TEXCACHE_MAGIC;
+   header[1] = gl_needPOT();
+   header[2] = format;
+   header[3] = levels;
+   header[4] = w;
+   header[5] = h;
+   header[6] = sx;
+   header[7] = sy;
+   memcpy( buf, header, sizeof(header) );
+   pos = sizeof(header);
+   for (i=0; i<levels; i++) {
+      glGetTexLevelParameteriv( GL_TEXTURE_2D, i, GL_TEXTURE_WIDTH, &lw );
+      glGetTexLevelParameteriv( GL_TEXTURE_2D, i, GL_TEXTURE_HEIGHT, &lh );
+      glGetTexLevelParameteriv( GL_TEXTURE_2D, i,
+            GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &lsize );
+      level[0] = lw;
+      level[1] = lh;
+      level[2] = lsize;
+      memcpy( &buf[pos], level, sizeof(level) );
+      pos += sizeof(level);
+      nglGetCompressedTexImage( GL_TEXTURE_2D, i, &buf[pos] );
+      pos += lsize;
+   }
+
+   nfile_dirMakeExist( "%s/textures/", nfile_cachePath() );
+   nfile_writeFile( buf, total, "%stextures/%s", nfile_cachePath(), digest );
+   free( buf );
+   gl_checkErr();
+}
+
+
+/**
+ * @brief Loads the SDL_Surface to a glTexture.
+ *
+ *    @param surface Surface to load.
+ *    @param flags Flags to use.
+ *    @return The glTexture for surface.
+ */
+glTexture* gl_loadImage( SDL_Surface* surface, unsigned int flags )
+{
+   return gl_loadImagePad( NULL, surface, flags, surface->w, surface->h, 1, 1, 1 );
+}
+
+
+/**
+ * @brief Check to see if a texture matching a path already exists.
+ *
+ *    @param path Path to the texture.
+ *    @return The texture, or NULL if none was found.
+ */
+static glTexture* gl_texExists( const char* path )
+{
+   glTexList *cur;
+
+   /* check to see if it already exists */
+   if (texture_list != NULL) {
+      for (cur=texture_list; cur!=NULL; cur=cur->next) {
+         if (strcmp(path,cur->tex->name)==0) {
+            gl_texRevive( cur );
+            return cur->tex;
+         }
+      }
+   }
+
+   return NULL;
+}
+
+
+/**
+ * @brief Marks a texture of the list as used again.
+ */
+static void gl_texRevive( glTexList *cur )
+{
+   if (cur->used <= 0) {
+      cur->used       = 0;
+      texture_cached -= cur->bytes;
+   }
+   cur->used += 1;
+}
+
+
+/**
+ * @brief Adds a texture to the list under the name of path.
+ */
+static int gl_texAdd( glTexture *tex, unsigned int flags )
+{
+   glTexList *new, *cur, *last;
+
+   /* Create the new node */
+   new = malloc( sizeof(glTexList) );
+   new->next  = NULL;
+   new->used  = 1;
+   new->tex   = tex;
+   new->stamp = 0;
+   new->bytes = (size_t)tex->rw * (size_t)tex->rh * 4;
+   if (tex->atlas != NULL)
+      new->bytes = (size_t)(tex->w + OPENGL_ATLAS_PAD) *
+            (size_t)(tex->h + OPENGL_ATLAS_PAD) * 4;
+   else if ((flags & OPENGL_TEX_MIPMAPS) && gl_texHasMipmaps())
+      new->bytes += new->bytes / 3;
+   texture_bytes += new->bytes;
+
+   if (texture_list == NULL) /* special condition - creating new list */
+      texture_list = new;
+   else {
+      for (cur=texture_list; cur!=NULL; cur=cur->next)
+         last = cur;
+
+      last->next = new;
+   }
+
+   return 0;
+}
+
+
+/**
+ * @brief Loads an image as a texture.
+ *
+ * May not necessarily load the image but use one if it's already open.
+ *
+ *    @param path Image to load.
+ *    @param flags Flags to control image parameters.
+ *    @return Texture loaded from image.
+ */
+glTexture* gl_newImage( const char* path, const unsigned int flags )
+{
+   glTexture *t;
+
+   /* Check if it already exists. */
+   t = gl_texExists( path );
+   if (t != NULL)
+      return t;
+
+   /* Load the image */
+   return gl_loadNewImage( path, flags );
+}
+
+
+/**
+ * @brief Only loads the image, does not add to stack unlike gl_newImage.
+ *
+ *    @param path Image to load.
+ *    @param flags Flags to control image parameters.
+ *    @return Texture loaded from image.
+ */
+static glTexture* gl_loadNewImage( const char* path, const unsigned int flags )
+{
+   glTexture *texture;
+   SDL_Surface *surface;
+   SDL_RWops *rw;
+   npng_t *npng;
+   png_uint_32 w, h;
+   int sx, sy;
+   char *str, *cache;
+   char digest[33];
+   int len, size, cached;
+
+   /* load from packfile */
+   rw = ndata_rwops( path );
+   if (rw == NULL) {
+      WARN("Failed to load surface '%s' from ndata.", path);
+      return NULL;
+   }
+
+   /* Cached blocks don't need decoding, transparency maps still do. */
+   cached = gl_texCacheEnabled( flags ) && !(flags & OPENGL_TEX_MAPTRANS);
+   if (cached) {
+      if (ndata_digest( path, digest ) != 0)
+         gl_texDigestRW( rw, digest );
+      size    = 0;
+      cache   = gl_texCacheRead( digest, &size );
+      texture = gl_texCacheCreate( path, cache, size, flags );
+      free( cache );
+      if (texture != NULL) {
+         SDL_RWclose( rw );
+         return texture;
+      }
+   }
+
+   npng     = npng_open( rw );
+   if (npng == NULL) {
+      WARN("File '%s' is not a png.", path );
+      return NULL;
+   }
+   npng_dim( npng, &w, &h );
+
+   /* Process metadata. */
+   len = npng_metadata( npng, "sx", &str );
+   sx  = (len > 0) ? atoi(str) : 1;
+   len = npng_metadata( npng, "sy", &str );
+   sy  = (len > 0) ? atoi(str) : 1;
+
+   /* Load surface. */
+   surface  = npng_readSurface( npng, gl_needPOT(), 1 );
+   npng_close( npng );
+
+   if (surface == NULL) {
+      WARN("'%s' could not be opened", path );
+      SDL_RWclose( rw );
+      return NULL;
+   }
+
+   if (flags & OPENGL_TEX_MAPTRANS)
+      texture = gl_loadImagePadTrans( path, surface, rw, flags, w, h, sx, sy, 1 );
+   else
+      texture = gl_loadImagePadCache( path, surface, cached ? digest : NULL,
+            flags, w, h, sx, sy, 1 );
+
+   SDL_RWclose( rw );
+   return texture;
+}
+
+
+/**
+ * @brief Decodes an image, run from the threadpool.
+ *
+ * Also builds the transparency map and collision masks so only the upload is
+ *  left for the main thread.
+ */
+static int gl_asyncDecode( void *data )
+{
+   glTexAsync *a;
+   SDL_RWops *rw;
+   npng_t *npng;
+   char *str;
+   int len;
+
+   a  = (glTexAsync*) data;
+
+   /* Both caches are keyed by the file. */
+   if ((a->cached || (a->flags & OPENGL_TEX_MAPTRANS)) && (a->view.data != NULL))
+      gl_texDigest( a->view.data, a->view.size, a->digest );
+
+   /* Cached blocks don't need decoding, transparency maps still do. */
+   if (a->cached && !a->stale && (a->view.data != NULL)) {
+      a->cache = gl_texCacheRead( a->digest, &a->cachesize );
+      if ((a->cache != NULL) && !(a->flags & OPENGL_TEX_MAPTRANS)) {
+         SDL_SemPost( a->done );
+         return 0;
+      }
+   }
+
+   rw = (a->view.data != NULL) ?
+         SDL_RWFromConstMem( a->view.data, a->view.size ) : NULL;
+   if (rw != NULL) {
+      npng = npng_open( rw );
+      if (npng != NULL) {
+         npng_dim( npng, &a->w, &a->h );
+         len   = npng_metadata( npng, "sx", &str );
+         a->sx = (len > 0) ? atoi(str) : 1;
+         len   = npng_metadata( npng, "sy", &str );
+         a->sy = (len > 0) ? atoi(str) : 1;
+         a->surface = npng_readSurface( npng, gl_needPOT(), 1 );
+         npng_close( npng );
+      }
+      SDL_FreeRW( rw );
+   }
+   if (a->fsx > 0) {
+      a->sx = a->fsx;
+      a->sy = a->fsy;
+   }
+
+   /* Collision data. */
+   if ((a->surface != NULL) && (a->flags & OPENGL_TEX_MAPTRANS)) {
+      a->mask.w     = (double) a->w;
+      a->mask.h     = (double) a->h;
+      a->mask.sx    = (double) a->sx;
+      a->mask.sy    = (double) a->sy;
+      a->mask.sw    = a->mask.w / a->mask.sx;
+      a->mask.sh    = a->mask.h / a->mask.sy;
+      a->mask.trans = gl_texTrans( a->surface, a->digest, a->w, a->h );
+      if (a->mask.trans != NULL)
+         gl_texMask( &a->mask );
+   }
+
+   SDL_SemPost( a->done );
+   return 0;
+}
+
+
+/**
+ * @brief Starts decoding an image in the background.
+ *
+ * The file is read on the calling thread, since ndata isn't reentrant, and
+ *  decoded on the threadpool. The texture must then be created on the main
+ *  thread with gl_asyncFinish().
+ *
+ *    @param path Image to load.
+ *    @param flags Flags to control image parameters.
+ *    @return The request.
+ */
+glTexAsync* gl_newImageAsync( const char* path, const unsigned int flags )
+{
+   return gl_newSpriteAsync( path, 0, 0, flags );
+}
+
+
+/**
+ * @brief Starts decoding a sprite sheet in the background.
+ *
+ *    @param path Image to load.
+ *    @param sx Number of X sprites in image, 0 to use the image metadata.
+ *    @param sy Number of Y sprites in image, 0 to use the image metadata.
+ *    @param flags Flags to control image parameters.
+ *    @return The request.
+ *    @sa gl_newImageAsync
+ */
+glTexAsync* gl_newSpriteAsync( const char* path, const int sx, const int sy,
+      const unsigned int flags )
+{
+   glTexAsync *a;
+
+   a        = calloc( 1, sizeof(glTexAsync) );
+   a->path  = strdup( path );
+   a->flags = flags;
+   a->sx    = 1;
+   a->sy    = 1;
+   if ((sx > 0) && (sy > 0)) {
+      a->fsx = sx;
+      a->fsy = sy;
+   }
+   a->cached = gl_texCacheEnabled( flags );
+   a->done  = SDL_CreateSemaphore( 0 );
+   ndata_map( &a->view, path );
+
+   if ((a->done == NULL) || (threadpool_newJob( gl_asyncDecode, a ) != 0)) {
+      if (a->done == NULL)
+         a->ready = 1;
+      gl_asyncDecode( a );
+   }
+   return a;
+}
+
+
+/**
+ * @brief Checks whether an image has been decoded, without blocking.
+ */
+int gl_asyncReady( glTexAsync *a )
+{
+   if (!a->ready && (SDL_SemTryWait( a->done ) == 0))
+      a->ready = 1;
+   return a->ready;
+}
+
+
+/**
+ * @brief Waits for an image to be decoded.
+ */
+static void gl_asyncWait( glTexAsync *a )
+{
+   if (!a->ready) {
+      SDL_SemWait( a->done );
+      a->ready = 1;
+   }
+}
+
+
+/**
+ * @brief Gets the decoded pixels of a request, blocking if it's still being
+ *        decoded.
+ *
+ * The surface is owned by the request and freed by gl_asyncFinish(). Images
+ *  loaded from the compressed texture cache aren't decoded unless they map
+ *  transparency.
+ *
+ *    @param a Request to get the pixels of.
+ *    @return The padded surface or NULL if not decoded.
+ */
+SDL_Surface* gl_asyncSurface( glTexAsync *a )
+{
+   gl_asyncWait( a );
+   return a->surface;
+}
+
+
+/**
+ * @brief Frees a request once decoded.
+ */
+static void gl_asyncFree( glTexAsync *a )
+{
+   ndata_unmap( &a->view );
+   if (a->surface != NULL)
+      SDL_FreeSurface( a->surface );
+   free( a->cache );
+   if (!gl_transMapped( a->mask.trans ))
+      free( a->mask.trans );
+   free( a->mask.mask );
+   free( a->mask.mask_hull );
+   free( a->mask.outline );
+   free( a->mask.outline_start );
+   if (a->done != NULL)
+      SDL_DestroySemaphore( a->done );
+   free( a->path );
+   free( a );
+}
+
+
+/**
+ * @brief Creates the texture of a request and frees it, blocking if it's
+ *        still being decoded.
+ *
+ *    @param a Request to finish.
+ *    @return The texture, as gl_newImage() or gl_newSprite() would return it.
+ */
+glTexture* gl_asyncFinish( glTexAsync *a )
+{
+   glTexture *t;
+   unsigned int flags;
+
+   gl_asyncWait( a );
+
+   /* Loaded in the meantime. */
+   t = gl_texExists( a->path );
+   if (t == NULL) {
+      /* Collision data was already built. */
+      flags = a->flags & ~OPENGL_TEX_MAPTRANS;
+
+      if (a->cache != NULL) {
+         t = gl_texCacheCreate( a->path, a->cache, a->cachesize, flags );
+
+         /* Stale cache, decode after all. */
+         if ((t == NULL) && (a->surface == NULL)) {
+            free( a->cache );
+            a->cache = NULL;
+            a->stale = 1;
+            gl_asyncDecode( a );
+            SDL_SemWait( a->done );
+         }
+      }
+      if (t == NULL) {
+         if (a->surface == NULL)
+            WARN("'%s' could not be opened", a->path );
+         else {
+            t = gl_loadImagePadCache( a->path, a->surface,
+                  a->cached ? a->digest : NULL, flags,
+                  a->w, a->h, a->sx, a->sy, 1 );
+            a->surface = NULL;
+         }
+      }
+
+      /* Hand over the collision data. */
+      if ((t != NULL) && (t->trans == NULL) && (a->mask.trans != NULL)) {
+         t->trans         = a->mask.trans;
+         t->mask          = a->mask.mask;
+         t->mask_stride   = a->mask.mask_stride;
+         t->mask_hull     = a->mask.mask_hull;
+         t->outline       = a->mask.outline;
+         t->outline_start = a->mask.outline_start;
+         memset( &a->mask, 0, sizeof(glTexture) );
+      }
+   }
+
+   /* Same as gl_newSprite(). */
+   if ((t != NULL) && (a->fsx > 0)) {
+      t->sx    = (double) a->fsx;
+      t->sy    = (double) a->fsy;
+      t->sw    = t->w / t->sx;
+      t->sh    = t->h / t->sy;
+      t->srw   = t->sw / t->rw;
+      t->srh   = t->sh / t->rh;
+   }
+
+   gl_asyncFree( a );
+   return t;
+}
+
+
+/**
+ * @brief Discards a request, blocking if it's still being decoded.
+ */
+void gl_asyncCancel( glTexAsync *a )
+{
+   gl_asyncWait( a );
+   gl_asyncFree( a );
+}
+
+
+/**
+ * @brief Starts loading an image that is only shown once decoded.
+ *
+ * Unlike gl_newImageAsync() the texture gets created whenever it's polled
+ *  with gl_deferGet() after decoding finished, so widgets can draw a
+ *  placeholder meanwhile.
+ *
+ *    @param path Image to load.
+ *    @param flags Flags to control image parameters.
+ *    @return The deferred image, free with gl_freeDefer().
+ */
+glTexDefer* gl_newImageDefer( const char* path, const unsigned int flags )
+{
+   glTexDefer *d;
+
+   d = calloc( 1, sizeof(glTexDefer) );
+
+   /* Already loaded, nothing to wait for. */
+   d->tex = gl_texExists( path );
+   if (d->tex == NULL)
+      d->async = gl_newImageAsync( path, flags );
+   return d;
+}
+
+
+/**
+ * @brief Gets the texture of a deferred image without blocking.
+ *
+ *    @param d Deferred image to get the texture of.
+ *    @return The texture or NULL if still decoding or failed.
+ */
+glTexture* gl_deferGet( glTexDefer *d )
+{
+   if (d == NULL)
+      return NULL;
+   if ((d->async != NULL) && gl_asyncReady( d->async ))
+      return gl_deferWait( d );
+   return d->tex;
+}
+
+
+/**
+ * @brief Gets the texture of a deferred image, blocking until it's decoded.
+ *
+ *    @param d Deferred image to get the texture of.
+ *    @return The texture or NULL if it failed to load.
+ */
+glTexture* gl_deferWait( glTexDefer *d )
+{
+   if (d == NULL)
+      return NULL;
+   if (d->async != NULL) {
+      d->tex   = gl_asyncFinish( d->async );
+      d->async = NULL;
+   }
+   return d->tex;
+}
+
+
+/**
+ * @brief Checks whether a deferred image still has no texture created.
+ */
+int gl_deferPending( const glTexDefer *d )
+{
+   return (d != NULL) && (d->async != NULL);
+}
+
+
+/**
+ * @brief Frees a deferred image and its texture.
+ *
+ *    @param d Deferred image to free.
  */
-glTexture* gl_loadImage( SDL_Surface* surface, unsigned int flags )
+void gl_freeDefer( glTexDefer *d )
 {
-   return gl_loadImagePad( NULL, surface, flags, surface->w, surface->h, 1, 1, 1 );
+   if (d == NULL)
+      return;
+   if (d->async != NULL)
+      gl_asyncCancel( d->async );
+   if (d->tex != NULL)
+      gl_freeTexture( d->tex );
+   free( d );
 }
 
 
 /**
- * @brief Check to see if a texture matching a path already exists.
+ * @brief Loads the texture immediately, but also sets it as a sprite.
  *
- *    @param path Path to the texture.
- *    @return The texture, or NULL if none was found.
+ *    @param path Image to load.
+ *    @param sx Number of X sprites in image.
+ *    @param sy Number of Y sprites in image.
+ *    @param flags Flags to control image parameters.
+ *    @return Texture loaded.
  */
-static glTexture* gl_texExists( const char* path )
+glTexture* gl_newSprite( const char* path, const int sx, const int sy,
+      const unsigned int flags )
 {
-   glTexList *cur;
-
-   /* check to see if it already exists */
-   if (texture_list != NULL) {
-      for (cur=texture_list; cur!=NULL; cur=cur->next) {
-         if (strcmp(path,cur->tex->name)==0) {
-            cur->used += 1;
-            return cur->tex;
-         }
-      }
-   }
+   glTexture* texture;
+   texture = gl_newImage( path, flags );
+   if (texture == NULL)
+      return NULL;
 
-   return NULL;
+   /* will possibly overwrite an existing textur properties
+    * so we have to load same texture always the same sprites */
+   texture->sx    = (double) sx;
+   texture->sy    = (double) sy;
+   texture->sw    = texture->w / texture->sx;
+   texture->sh    = texture->h / texture->sy;
+   texture->srw   = texture->sw / texture->rw;
+   texture->srh   = texture->sh / texture->rh;
+   return texture;
 }
 
 
 /**
- * @brief Adds a texture to the list under the name of path.
+ * @brief Renders the rotations of an image into a sprite sheet on the CPU.
+ *
+ * Nearest neighbour, only used when framebuffers are not available.
+ *
+ *    @param base Image facing the direction 0, flipped like it's uploaded.
+ *    @param bw Width of the image.
+ *    @param bh Height of the image.
+ *    @param sx X sprites.
+ *    @param sy Y sprites.
+ *    @param pw Width of the padded sheet.
+ *    @param ph Height of the padded sheet.
+ *    @return The sheet or NULL on error.
  */
-static int gl_texAdd( glTexture *tex )
+static SDL_Surface* gl_rotateCPU( SDL_Surface *base, int bw, int bh,
+      int sx, int sy, int pw, int ph )
 {
-   glTexList *new, *cur, *last;
-
-   /* Create the new node */
-   new = malloc( sizeof(glTexList) );
-   new->next = NULL;
-   new->used = 1;
-   new->tex  = tex;
-
-   if (texture_list == NULL) /* special condition - creating new list */
-      texture_list = new;
-   else {
-      for (cur=texture_list; cur!=NULL; cur=cur->next)
-         last = cur;
+   SDL_Surface *sheet;
+   int s, fx, fy, x, y, u, v;
+   double a, c, sn, dx, dy;
+   uint32_t *dst;
+   const uint32_t *src;
+
+   if (base->format->BytesPerPixel != 4) {
+      WARN("Unable to rotate a %d bpp surface.", base->format->BitsPerPixel);
+      return NULL;
+   }
+   sheet = SDL_CreateRGBSurface( SDL_SWSURFACE, pw, ph, 32, RGBAMASK );
+   if (sheet == NULL) {
+      WARN("Unable to create a %dx%d surface.", pw, ph);
+      return NULL;
+   }
 
-      last->next = new;
+   SDL_LockSurface( base );
+   SDL_LockSurface( sheet );
+   memset( sheet->pixels, 0, sheet->pitch * sheet->h );
+   for (s=0; s<sx*sy; s++) {
+      /* Same layout as gl_getSpriteFromDir(), rows are flipped. */
+      fx = s % sx;
+      fy = sy - s / sx - 1;
+      a  = 2. * M_PI * s / (double)(sx*sy);
+      c  = cos( a );
+      sn = sin( a );
+      for (y=0; y<bh; y++) {
+         dst = (uint32_t*)((uint8_t*)sheet->pixels +
+               (fy*bh + y) * sheet->pitch) + fx*bw;
+         dy  = y + .5 - bh/2.;
+         for (x=0; x<bw; x++) {
+            /* Sample the image rotated back. */
+            dx = x + .5 - bw/2.;
+            u  = (int)floor( c*dx + sn*dy + bw/2. );
+            v  = (int)floor( -sn*dx + c*dy + bh/2. );
+            if ((u < 0) || (u >= bw) || (v < 0) || (v >= bh))
+               continue;
+            src    = (const uint32_t*)((const uint8_t*)base->pixels +
+                  v * base->pitch) + u;
+            dst[x] = *src;
+         }
+      }
    }
+   SDL_UnlockSurface( sheet );
+   SDL_UnlockSurface( base );
 
-   return 0;
+   return sheet;
 }
 
 
 /**
- * @brief Loads an image as a texture.
- *
- * May not necessarily load the image but use one if it's already open.
+ * @brief Renders the rotations of an image into a sprite sheet texture.
  *
- *    @param path Image to load.
- *    @param flags Flags to control image parameters.
- *    @return Texture loaded from image.
+ *    @param base Image facing the direction 0, flipped like it's uploaded.
+ *    @param bw Width of the image.
+ *    @param bh Height of the image.
+ *    @param sx X sprites.
+ *    @param sy Y sprites.
+ *    @param pw Width of the padded sheet.
+ *    @param ph Height of the padded sheet.
+ *    @param flags Flags of the sheet.
+ *    @param[out] sheet Pixels read back from the sheet.
+ *    @return The sheet texture or 0 on error.
  */
-glTexture* gl_newImage( const char* path, const unsigned int flags )
+static GLuint gl_rotateGPU( SDL_Surface *base, int bw, int bh,
+      int sx, int sy, int pw, int ph, unsigned int flags, SDL_Surface **sheet )
 {
-   glTexture *t;
+   glTexture *tex;
+   GLuint texture, fbo;
+   GLenum status;
+   GLint view[4];
+   GLfloat clear[4];
+   int s, fx, fy;
+
+   *sheet = SDL_CreateRGBSurface( SDL_SWSURFACE, pw, ph, 32, RGBAMASK );
+   if (*sheet == NULL) {
+      WARN("Unable to create a %dx%d surface.", pw, ph);
+      return 0;
+   }
 
-   /* Check if it already exists. */
-   t = gl_texExists( path );
-   if (t != NULL)
-      return t;
+   /* Filtered so the rotations are smooth. */
+   tex = gl_loadImagePad( NULL, base, OPENGL_TEX_MIPMAPS,
+         bw, bh, 1, 1, 0 );
+
+   glGenTextures( 1, &texture );
+   glBindTexture( GL_TEXTURE_2D, texture );
+   gl_texParams( flags );
+   glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, pw, ph, 0,
+         GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+   glBindTexture( GL_TEXTURE_2D, 0 );
+
+   nglGenFramebuffers( 1, &fbo );
+   nglBindFramebuffer( GL_FRAMEBUFFER, fbo );
+   nglFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+         GL_TEXTURE_2D, texture, 0 );
+   status = nglCheckFramebufferStatus( GL_FRAMEBUFFER );
+   if (status != GL_FRAMEBUFFER_COMPLETE) {
+      WARN("Framebuffer of %dx%d incomplete (0x%04x).", pw, ph, status);
+      nglBindFramebuffer( GL_FRAMEBUFFER, 0 );
+      nglDeleteFramebuffers( 1, &fbo );
+      glDeleteTextures( 1, &texture );
+      gl_freeTexture( tex );
+      SDL_FreeSurface( *sheet );
+      *sheet = NULL;
+      return 0;
+   }
 
-   /* Load the image */
-   return gl_loadNewImage( path, flags );
+   /* Pixel units. */
+   glGetIntegerv( GL_VIEWPORT, view );
+   glGetFloatv( GL_COLOR_CLEAR_VALUE, clear );
+   glViewport( 0, 0, pw, ph );
+   gl_matrixPush();
+      gl_matrixIdentity();
+      gl_matrixOrtho( 0., pw, 0., ph, -1., 1. );
+   glDisable( GL_SCISSOR_TEST );
+   glClearColor( 0., 0., 0., 0. );
+   glClear( GL_COLOR_BUFFER_BIT );
+
+   /* Each frame replaces its cell, clipped so corners don't bleed. */
+   glDisable( GL_BLEND );
+   glEnable( GL_SCISSOR_TEST );
+   for (s=0; s<sx*sy; s++) {
+      fx = s % sx;
+      fy = sy - s / sx - 1;
+      glScissor( fx*bw, fy*bh, bw, bh );
+      gl_matrixPush();
+         gl_matrixTranslate( fx*bw + bw/2., fy*bh + bh/2. );
+         gl_matrixRotate( 2. * M_PI * s / (double)(sx*sy) );
+         gl_blitTexture( tex, -bw/2., -bh/2., bw, bh,
+               0., 0., tex->srw, tex->srh, NULL );
+      gl_matrixPop();
+   }
+   glDisable( GL_SCISSOR_TEST );
+   glEnable( GL_BLEND );
+
+   /* Collision data and the target graphic need the pixels. */
+   SDL_LockSurface( *sheet );
+   glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+   glReadPixels( 0, 0, pw, ph, GL_RGBA, GL_UNSIGNED_BYTE, (*sheet)->pixels );
+   SDL_UnlockSurface( *sheet );
+
+   /* Restore state. */
+   gl_matrixPop();
+   nglBindFramebuffer( GL_FRAMEBUFFER, 0 );
+   nglDeleteFramebuffers( 1, &fbo );
+   glViewport( view[0], view[1], view[2], view[3] );
+   glClearColor( clear[0], clear[1], clear[2], clear[3] );
+   gl_unclipRect();
+   gl_freeTexture( tex );
+
+   glBindTexture( GL_TEXTURE_2D, texture );
+   gl_texMipmaps( flags );
+   glBindTexture( GL_TEXTURE_2D, 0 );
+
+   gl_checkErr();
+   return texture;
 }
 
 
 /**
- * @brief Only loads the image, does not add to stack unlike gl_newImage.
+ * @brief Loads a sprite sheet generated from a single image.
+ *
+ * The image faces the direction 0 and frame s of the sheet is the image
+ *  rotated by s*2*M_PI/(sx*sy), which is what gl_getSpriteFromDir() expects.
+ *  Frames are rendered with a framebuffer when available and read back for
+ *  the collision data, otherwise they are rotated on the CPU.
  *
  *    @param path Image to load.
+ *    @param sx Number of X sprites to generate.
+ *    @param sy Number of Y sprites to generate.
  *    @param flags Flags to control image parameters.
- *    @return Texture loaded from image.
+ *    @param[out] sheet If not NULL gets the pixels of the sheet like
+ *                gl_asyncSurface() would, to be freed by the caller.
+ *    @return Texture loaded.
  */
-static glTexture* gl_loadNewImage( const char* path, const unsigned int flags )
+glTexture* gl_newRotatedSprite( const char* path, const int sx, const int sy,
+      const unsigned int flags, SDL_Surface **sheet )
 {
    glTexture *texture;
-   SDL_Surface *surface;
+   SDL_Surface *base, *surface;
    SDL_RWops *rw;
    npng_t *npng;
-   png_uint_32 w, h;
-   int sx, sy;
-   char *str;
-   int len;
+   png_uint_32 bw, bh;
+   int w, h, pw, ph;
+   char digest[33], buf[64];
+
+   if (sheet != NULL)
+      *sheet = NULL;
+
+   texture = gl_texExists( path );
+   if (texture != NULL)
+      return texture;
 
-   /* load from packfile */
    rw = ndata_rwops( path );
    if (rw == NULL) {
       WARN("Failed to load surface '%s' from ndata.", path);
       return NULL;
    }
-   npng     = npng_open( rw );
+   npng = npng_open( rw );
    if (npng == NULL) {
       WARN("File '%s' is not a png.", path );
+      SDL_RWclose( rw );
       return NULL;
    }
-   npng_dim( npng, &w, &h );
-
-   /* Process metadata. */
-   len = npng_metadata( npng, "sx", &str );
-   sx  = (len > 0) ? atoi(str) : 1;
-   len = npng_metadata( npng, "sy", &str );
-   sy  = (len > 0) ? atoi(str) : 1;
-
-   /* Load surface. */
-   surface  = npng_readSurface( npng, gl_needPOT(), 1 );
+   npng_dim( npng, &bw, &bh );
+   base = npng_readSurface( npng, gl_needPOT(), 1 );
    npng_close( npng );
-
-   if (surface == NULL) {
+   if (base == NULL) {
       WARN("'%s' could not be opened", path );
       SDL_RWclose( rw );
       return NULL;
    }
 
-   if (flags & OPENGL_TEX_MAPTRANS)
-      texture = gl_loadImagePadTrans( path, surface, rw, flags, w, h, sx, sy, 1 );
-   else
-      texture = gl_loadImagePad( path, surface, flags, w, h, sx, sy, 1 );
-
+   /* Collision maps are cached per layout as well as per file. */
+   if (ndata_digest( path, digest ) != 0)
+      gl_texDigestRW( rw, digest );
    SDL_RWclose( rw );
-   return texture;
-}
-
+   nsnprintf( buf, sizeof(buf), "%s:%dx%d", digest, sx, sy );
+   gl_texDigest( buf, strlen(buf), digest );
+
+   w  = sx * bw;
+   h  = sy * bh;
+   pw = gl_needPOT() ? gl_pot( w ) : w;
+   ph = gl_needPOT() ? gl_pot( h ) : h;
+   if ((pw > gl_screen.tex_max) || (ph > gl_screen.tex_max)) {
+      WARN("Rotations of '%s' need a %dx%d texture.", path, pw, ph);
+      SDL_FreeSurface( base );
+      return NULL;
+   }
 
-/**
- * @brief Loads the texture immediately, but also sets it as a sprite.
- *
- *    @param path Image to load.
- *    @param sx Number of X sprites in image.
- *    @param sy Number of Y sprites in image.
- *    @param flags Flags to control image parameters.
- *    @return Texture loaded.
- */
-glTexture* gl_newSprite( const char* path, const int sx, const int sy,
-      const unsigned int flags )
-{
-   glTexture* texture;
-   texture = gl_newImage( path, flags );
-   if (texture == NULL)
+   texture = calloc( 1, sizeof(glTexture) );
+   surface = NULL;
+   if (gl_hasFbo())
+      texture->texture = gl_rotateGPU( base, bw, bh, sx, sy, pw, ph,
+            flags, &surface );
+   if (texture->texture == 0) {
+      surface = gl_rotateCPU( base, bw, bh, sx, sy, pw, ph );
+      if (surface != NULL)
+         texture->texture = gl_loadSurface( surface, NULL, NULL, flags, 0 );
+   }
+   SDL_FreeSurface( base );
+   if (surface == NULL) {
+      free( texture );
       return NULL;
+   }
 
-   /* will possibly overwrite an existing textur properties
-    * so we have to load same texture always the same sprites */
+   texture->name  = strdup( path );
+   texture->w     = (double) w;
+   texture->h     = (double) h;
+   texture->rw    = (double) pw;
+   texture->rh    = (double) ph;
    texture->sx    = (double) sx;
    texture->sy    = (double) sy;
    texture->sw    = texture->w / texture->sx;
    texture->sh    = texture->h / texture->sy;
    texture->srw   = texture->sw / texture->rw;
    texture->srh   = texture->sh / texture->rh;
+   if (flags & OPENGL_TEX_MAPTRANS) {
+      texture->trans = gl_texTrans( surface, digest, w, h );
+      if (texture->trans != NULL)
+         gl_texMask( texture );
+   }
+   gl_texAdd( texture, flags );
+
+   if (sheet != NULL)
+      *sheet = surface;
+   else
+      SDL_FreeSurface( surface );
    return texture;
 }
 
@@ -724,7 +2442,7 @@ glTexture* gl_newSprite( const char* path, const int sx, const int sy,
  */
 void gl_freeTexture( glTexture* texture )
 {
-   glTexList *cur, *last;
+   glTexList *cur;
 
    /* Shouldn't be NULL (won't segfault though) */
    if (texture == NULL) {
@@ -733,33 +2451,21 @@ void gl_freeTexture( glTexture* texture )
    }
 
    /* see if we can find it in stack */
-   last = NULL;
    for (cur=texture_list; cur!=NULL; cur=cur->next) {
       if (cur->tex == texture) { /* found it */
+         if (cur->used <= 0) {
+            WARN("Attempting to free unused texture '%s'!", texture->name);
+            return;
+         }
          cur->used--;
          if (cur->used <= 0) { /* not used anymore */
-            /* free the texture */
-            glDeleteTextures( 1, &texture->texture );
-            if (texture->trans != NULL)
-               free(texture->trans);
-            if (texture->name != NULL)
-               free(texture->name);
-            free(texture);
-
-            /* free the list node */
-            if (last == NULL) { /* case there's no texture before it */
-               if (cur->next != NULL)
-                  texture_list = cur->next;
-               else /* case it's the last texture */
-                  texture_list = NULL;
-            }
-            else
-               last->next = cur->next;
-            free(cur);
+            /* Keep it around in case it gets loaded again. */
+            cur->stamp      = ++texture_stamp;
+            texture_cached += cur->bytes;
+            gl_texEvict();
          }
          return; /* we already found it so we can exit */
       }
-      last = cur;
    }
 
    /* Not found */
@@ -767,9 +2473,42 @@ void gl_freeTexture( glTexture* texture )
       WARN("Attempting to free texture '%s' not found in stack!", texture->name);
 
    /* Free anyways */
-   glDeleteTextures( 1, &texture->texture );
-   if (texture->trans != NULL)
+   gl_texDelete( texture );
+}
+
+
+/**
+ * @brief Frees the memory and video memory of a texture.
+ */
+static void gl_texDelete( glTexture *texture )
+{
+   glAtlas *a, *last;
+
+   if (texture->atlas == NULL)
+      glDeleteTextures( 1, &texture->texture );
+   else if (--texture->atlas->users <= 0) {
+      /* Space isn't reused, so only free the atlas when it's empty. */
+      last = NULL;
+      for (a=gl_atlases; a!=NULL; a=a->next) {
+         if (a == texture->atlas)
+            break;
+         last = a;
+      }
+      if (a != NULL) {
+         if (last == NULL)
+            gl_atlases = a->next;
+         else
+            last->next = a->next;
+      }
+      glDeleteTextures( 1, &texture->atlas->texture );
+      free( texture->atlas );
+   }
+   if ((texture->trans != NULL) && !gl_transMapped(texture->trans))
       free(texture->trans);
+   free(texture->mask);
+   free(texture->mask_hull);
+   free(texture->outline);
+   free(texture->outline_start);
    if (texture->name != NULL)
       free(texture->name);
    free(texture);
@@ -778,6 +2517,81 @@ void gl_freeTexture( glTexture* texture )
 }
 
 
+/**
+ * @brief Removes an unused texture from the list and frees it.
+ */
+static void gl_texRemove( glTexList *node )
+{
+   glTexList *cur, *last;
+
+   last = NULL;
+   for (cur=texture_list; cur!=NULL; cur=cur->next) {
+      if (cur == node)
+         break;
+      last = cur;
+   }
+   if (cur == NULL)
+      return;
+
+   if (last == NULL)
+      texture_list = cur->next;
+   else
+      last->next = cur->next;
+
+   texture_bytes  -= cur->bytes;
+   texture_cached -= cur->bytes;
+   gl_texDelete( cur->tex );
+   free(cur);
+}
+
+
+/**
+ * @brief Frees the least recently used unused textures until the cache fits
+ *        in conf.tex_cache megabytes.
+ */
+void gl_texEvict (void)
+{
+   glTexList *cur, *oldest;
+   size_t budget;
+
+   budget = (size_t)MAX( conf.tex_cache, 0 ) * 1024 * 1024;
+   while (texture_cached > budget) {
+      oldest = NULL;
+      for (cur=texture_list; cur!=NULL; cur=cur->next)
+         if ((cur->used <= 0) && ((oldest == NULL) || (cur->stamp < oldest->stamp)))
+            oldest = cur;
+      if (oldest == NULL)
+         break;
+      gl_texRemove( oldest );
+   }
+}
+
+
+/**
+ * @brief Gets the estimated video memory used by the textures.
+ *
+ *    @param[out] nused Number of textures in use.
+ *    @param[out] used Bytes of the textures in use.
+ *    @param[out] ncached Number of unused textures kept loaded.
+ *    @param[out] cached Bytes of the unused textures kept loaded.
+ */
+void gl_texUsage( int *nused, size_t *used, int *ncached, size_t *cached )
+{
+   glTexList *cur;
+
+   *nused   = 0;
+   *ncached = 0;
+   for (cur=texture_list; cur!=NULL; cur=cur->next) {
+      if (cur->used > 0)
+         (*nused)++;
+      else
+         (*ncached)++;
+   }
+   *used   = texture_bytes - texture_cached;
+   *cached = texture_cached;
+}
+
+
 /**
  * @brief Duplicates a texture.
  *
@@ -796,7 +2610,7 @@ glTexture* gl_dupTexture( glTexture *texture )
    if (texture_list != NULL) {
       for (cur=texture_list; cur!=NULL; cur=cur->next) {
          if (texture == cur->tex) {
-            cur->used += 1;
+            gl_texRevive( cur );
             return cur->tex;
          }
       }
@@ -808,6 +2622,71 @@ glTexture* gl_dupTexture( glTexture *texture )
 }
 
 
+/**
+ * @brief Creates a low detail copy of a texture from one of its mipmaps.
+ *
+ * The copy renders at the same size as the original so it can stand in for
+ *  it, it just has fewer pixels. It has no name, so it isn't shared and
+ *  can't be duplicated.
+ *
+ *    @param texture Texture to copy, must not be in an atlas.
+ *    @param size Largest side of the copy in pixels.
+ *    @return The copy or NULL if the texture has no small enough mipmap.
+ */
+glTexture* gl_newLOD( const glTexture *texture, int size )
+{
+   glTexture *lod;
+   SDL_Surface *surface;
+   GLint w, h;
+   int level;
+
+   if ((texture == NULL) || (texture->atlas != NULL) || !gl_texHasMipmaps())
+      return NULL;
+
+   /* Find the first mipmap that fits. */
+   glBindTexture( GL_TEXTURE_2D, texture->texture );
+   for (level=0; level<16; level++) {
+      glGetTexLevelParameteriv( GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &w );
+      glGetTexLevelParameteriv( GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &h );
+      if ((w <= 0) || (h <= 0))
+         return NULL;
+      if (MAX( w, h ) <= size)
+         break;
+   }
+   if (level >= 16)
+      return NULL;
+
+   /* Read it back, it keeps the padding of the original. */
+   surface = SDL_CreateRGBSurface( SDL_SWSURFACE, w, h, 32, RGBAMASK );
+   if (surface == NULL) {
+      WARN("Unable to create surface for low detail '%s'.", texture->name);
+      return NULL;
+   }
+   SDL_LockSurface( surface );
+   glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+   glGetTexImage( GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, surface->pixels );
+   SDL_UnlockSurface( surface );
+   gl_checkErr();
+
+   lod = gl_loadImage( surface, OPENGL_TEX_MIPMAPS );
+   if (lod == NULL)
+      return NULL;
+
+   /* Render like the original. */
+   lod->w   = texture->w;
+   lod->h   = texture->h;
+   lod->rw  = texture->rw;
+   lod->rh  = texture->rh;
+   lod->sx  = texture->sx;
+   lod->sy  = texture->sy;
+   lod->sw  = texture->sw;
+   lod->sh  = texture->sh;
+   lod->srw = texture->srw;
+   lod->srh = texture->srh;
+   return lod;
+}
+
+
 /**
  * @brief Checks to see if a pixel is transparent in a texture.
  *
@@ -827,6 +2706,53 @@ int gl_isTrans( const glTexture* t, const int x, const int y )
 }
 
 
+/**
+ * @brief Gets the collision mask of a sprite.
+ *
+ *    @param t Texture to get the mask of.
+ *    @param sx X position of the sprite.
+ *    @param sy Y position of the sprite.
+ *    @param[out] hull Bounding box of the opaque pixels as x1, y1, x2, y2.
+ *    @return The sprite's rows of t->mask_stride words, or NULL if there is none.
+ */
+const uint64_t* gl_getMask( const glTexture* t, const int sx, const int sy,
+      const int **hull )
+{
+   int f;
+
+   if (t->mask == NULL)
+      return NULL;
+
+   f     = sy*(int)t->sx + sx;
+   *hull = &t->mask_hull[ 4*f ];
+   return &t->mask[ f * (int)t->sh * t->mask_stride ];
+}
+
+
+/**
+ * @brief Gets the outline of a sprite.
+ *
+ *    @param t Texture to get the outline of.
+ *    @param sx X position of the sprite.
+ *    @param sy Y position of the sprite.
+ *    @param[out] pts Counter-clockwise convex hull of the opaque pixels as
+ *                    x, y pairs relative to the bottom left of the sprite.
+ *    @return Number of points, -1 if the texture has no outlines.
+ */
+int gl_getOutline( const glTexture* t, const int sx, const int sy,
+      const GLfloat **pts )
+{
+   int f;
+
+   if (t->outline_start == NULL)
+      return -1;
+
+   f    = sy*(int)t->sx + sx;
+   *pts = &t->outline[ 2*t->outline_start[f] ];
+   return t->outline_start[f+1] - t->outline_start[f];
+}
+
+
 /**
  * @brief Sets x and y to be the appropriate sprite for glTexture using dir.
  *
@@ -894,6 +2820,8 @@ int gl_initTextures (void)
    if (gl_hasVersion(2,0) || gl_hasExt("GL_ARB_texture_non_power_of_two"))
       gl_tex_ext_npot = 1;
 
+   gl_transPackOpen();
+
    return 0;
 }
 
@@ -903,7 +2831,15 @@ int gl_initTextures (void)
  */
 void gl_exitTextures (void)
 {
-   glTexList *tex;
+   glTexList *tex, *next;
+   int i;
+
+   /* Free the unused textures kept around. */
+   for (tex=texture_list; tex!=NULL; tex=next) {
+      next = tex->next;
+      if (tex->used <= 0)
+         gl_texRemove( tex );
+   }
 
    /* Make sure there's no texture leak */
    if (texture_list != NULL) {
@@ -911,5 +2847,21 @@ void gl_exitTextures (void)
       for (tex=texture_list; tex!=NULL; tex=tex->next)
          DEBUG("   '%s' opened %d times", tex->tex->name, tex->used );
    }
+
+   /* Update the transparency map pack. */
+   gl_transPackSave();
+   if (trans_new != NULL) {
+      for (i=0; i<array_size(trans_new); i++)
+         free( trans_new[i].data );
+      array_free( trans_new );
+      trans_new = NULL;
+   }
+   if (texture_list == NULL)
+      ndata_unmap( &trans_pack );
+   trans_index  = NULL;
+   trans_nindex = 0;
+   if (trans_lock != NULL)
+      SDL_DestroyMutex( trans_lock );
+   trans_lock = NULL;
 }
 
@@ -38,6 +38,8 @@
  */
 #define OPENGL_TEX_MAPTRANS   (1<<0) /**< Create a transparency map. */
 #define OPENGL_TEX_MIPMAPS    (1<<1) /**< Creates mipmaps. */
+#define OPENGL_TEX_ATLAS      (1<<2) /**< Packs into a shared atlas if small enough, ignoring mipmaps. */
+#define OPENGL_TEX_CACHE      (1<<3) /**< Uses the compressed texture cache when compression is enabled. */
 
 /**
  * @brief Abstraction for rendering sprite sheets.
@@ -64,6 +66,16 @@ typedef struct glTexture_ {
    /* data */
    GLuint texture; /**< the opengl texture itself */
    uint8_t* trans; /**< maps the transparency */
+   uint64_t* mask; /**< Opaque pixels of each sprite, one bit per pixel in rows of mask_stride words. */
+   int mask_stride; /**< 64 bit words per sprite row in mask. */
+   int* mask_hull; /**< Bounding box of the opaque pixels of each sprite as x1, y1, x2, y2. */
+   GLfloat* outline; /**< Convex hulls of the opaque pixels of the sprites as x, y pairs. */
+   int* outline_start; /**< First point of each sprite's hull in outline, one more than sprites. */
+
+   /* atlas */
+   struct glAtlas_ *atlas; /**< Atlas the texture is packed in, or NULL. */
+   double ox; /**< X offset in the GL texture. [0:1] */
+   double oy; /**< Y offset in the GL texture. [0:1] */
 
    /* properties */
    uint8_t flags; /**< flags used for texture properties */
@@ -94,7 +106,38 @@ glTexture* gl_loadImage( SDL_Surface* surface, const unsigned int flags ); /* Fr
 glTexture* gl_newImage( const char* path, const unsigned int flags );
 glTexture* gl_newSprite( const char* path, const int sx, const int sy,
       const unsigned int flags );
+glTexture* gl_newRotatedSprite( const char* path, const int sx, const int sy,
+      const unsigned int flags, SDL_Surface **sheet );
 glTexture* gl_dupTexture( glTexture *texture );
+glTexture* gl_newLOD( const glTexture *texture, int size );
+void gl_texEvict (void);
+void gl_texUsage( int *nused, size_t *used, int *ncached, size_t *cached );
+
+/*
+ * Background decoding.
+ */
+struct glTexAsync_;
+typedef struct glTexAsync_ glTexAsync; /**< Image being decoded in the background. */
+glTexAsync* gl_newImageAsync( const char* path, const unsigned int flags );
+glTexAsync* gl_newSpriteAsync( const char* path, const int sx, const int sy,
+      const unsigned int flags );
+SDL_Surface* gl_asyncSurface( glTexAsync *a );
+int gl_asyncReady( glTexAsync *a );
+glTexture* gl_asyncFinish( glTexAsync *a );
+void gl_asyncCancel( glTexAsync *a );
+
+/*
+ * Images created once decoded, for widgets that can wait.
+ */
+typedef struct glTexDefer_ {
+   glTexAsync *async; /**< Request still decoding, NULL once finished. */
+   glTexture *tex; /**< Texture once finished, NULL on failure. */
+} glTexDefer;
+glTexDefer* gl_newImageDefer( const char* path, const unsigned int flags );
+glTexture* gl_deferGet( glTexDefer *d );
+glTexture* gl_deferWait( glTexDefer *d );
+int gl_deferPending( const glTexDefer *d );
+void gl_freeDefer( glTexDefer *d );
 
 /*
  * Clean up.
@@ -111,6 +154,10 @@ int gl_texHasCompress (void);
  * Misc.
  */
 int gl_isTrans( const glTexture* t, const int x, const int y );
+const uint64_t* gl_getMask( const glTexture* t, const int sx, const int sy,
+      const int **hull );
+int gl_getOutline( const glTexture* t, const int sx, const int sy,
+      const GLfloat **pts );
 void gl_getSpriteFromDir( int* x, int* y, const glTexture* t, const double dir );
 int gl_needPOT (void);
 
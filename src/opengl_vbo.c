@@ -6,6 +6,12 @@
  * @file opengl_vbo.c
  *
  * @brief Handles OpenGL vbos.
+ *
+ * Per draw data goes to a shared stream VBO used as a ring buffer. Draws get
+ *  their own range of it so the GPU never waits on data still in use, when it
+ *  wraps around the buffer is orphaned and the driver hands out new storage.
+ *  A draw reserves everything it pushes first so it is never split across a
+ *  wrap.
  */
 
 
@@ -18,6 +24,18 @@
 
 #define BUFFER_OFFSET(i) ((char *)NULL + (i)) /**< Taken from OpengL spec. */
 
+#define OPENGL_VBO_STREAM_SIZE   (1<<20) /**< Starting size of the stream VBO in bytes. */
+
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT               0x0002 /**< Mapping is written to. */
+#endif /* GL_MAP_WRITE_BIT */
+#ifndef GL_MAP_INVALIDATE_RANGE_BIT
+#define GL_MAP_INVALIDATE_RANGE_BIT    0x0004 /**< Previous contents of the range are discarded. */
+#endif /* GL_MAP_INVALIDATE_RANGE_BIT */
+#ifndef GL_MAP_UNSYNCHRONIZED_BIT
+#define GL_MAP_UNSYNCHRONIZED_BIT      0x0020 /**< Don't wait for pending draws. */
+#endif /* GL_MAP_UNSYNCHRONIZED_BIT */
+
 
 /**
  * @brief VBO types.
@@ -42,11 +60,16 @@ struct gl_vbo_s {
 
 static int has_vbo = 0; /**< Whether or not has VBO. */
 
+static gl_vbo *vbo_stream     = NULL; /**< Shared stream VBO. */
+static GLsizei vbo_streamPos  = 0; /**< Next free byte of the stream VBO. */
+static GLsizei vbo_streamEnd  = 0; /**< End of the last reservation. */
+
 
 /**
  * Prototypes.
  */
 static gl_vbo* gl_vboCreate( GLenum target, GLsizei size, void* data, GLenum usage );
+static void gl_vboStreamUpload( GLint offset, GLsizei size, const void *data );
 
 
 /**
@@ -68,6 +91,11 @@ int gl_initVBO (void)
  */
 void gl_exitVBO (void)
 {
+   if (vbo_stream != NULL)
+      gl_vboDestroy( vbo_stream );
+   vbo_stream    = NULL;
+   vbo_streamPos = 0;
+   vbo_streamEnd = 0;
    has_vbo = 0;
 }
 
@@ -166,7 +194,9 @@ void gl_vboData( gl_vbo *vbo, GLsizei size, void* data )
  */
 void gl_vboSubData( gl_vbo *vbo, GLint offset, GLsizei size, void* data )
 {
-   if (has_vbo) {
+   if (has_vbo && (vbo == vbo_stream))
+      gl_vboStreamUpload( offset, size, data );
+   else if (has_vbo) {
       nglBindBuffer( GL_ARRAY_BUFFER, vbo->id );
       nglBufferSubData( GL_ARRAY_BUFFER, offset, size, data );
    }
@@ -178,6 +208,98 @@ void gl_vboSubData( gl_vbo *vbo, GLint offset, GLsizei size, void* data )
 }
 
 
+/**
+ * @brief Writes to a range of the stream VBO without waiting for the GPU.
+ *
+ * The range must not be used by any draw issued since the last wrap.
+ */
+static void gl_vboStreamUpload( GLint offset, GLsizei size, const void *data )
+{
+   void *p;
+
+   nglBindBuffer( GL_ARRAY_BUFFER, vbo_stream->id );
+   p = NULL;
+   if (nglMapBufferRange != NULL)
+      p = nglMapBufferRange( GL_ARRAY_BUFFER, offset, size, GL_MAP_WRITE_BIT |
+            GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+   if (p != NULL) {
+      memcpy( p, data, size );
+      nglUnmapBuffer( GL_ARRAY_BUFFER );
+   }
+   else
+      nglBufferSubData( GL_ARRAY_BUFFER, offset, size, (void*)data );
+}
+
+
+/**
+ * @brief Reserves room in the stream VBO for a draw.
+ *
+ * Everything pushed until the reserved size is used up ends up contiguous
+ *  in the same storage, so it can be drawn together.
+ *
+ *    @param size Total bytes that will be pushed, multiple of 4.
+ *    @return The stream VBO to activate.
+ */
+gl_vbo* gl_vboStreamReserve( GLsizei size )
+{
+   GLsizei m;
+
+   if (vbo_stream == NULL) {
+      m = OPENGL_VBO_STREAM_SIZE;
+      while (m < size)
+         m *= 2;
+      vbo_stream = gl_vboCreateStream( m, NULL );
+      vbo_streamPos = 0;
+   }
+
+   /* Wrap around, orphaning the storage the GPU may still be reading. */
+   else if (vbo_streamPos + size > vbo_stream->size) {
+      m = vbo_stream->size;
+      while (m < size)
+         m *= 2;
+      if (has_vbo)
+         gl_vboData( vbo_stream, m, NULL );
+      else if (m != vbo_stream->size) {
+         vbo_stream->data = realloc( vbo_stream->data, m );
+         vbo_stream->size = m;
+      }
+      vbo_streamPos = 0;
+   }
+
+   vbo_streamEnd = vbo_streamPos + size;
+   return vbo_stream;
+}
+
+
+/**
+ * @brief Pushes data to the stream VBO.
+ *
+ *    @param data Data to push.
+ *    @param size Size of the data in bytes, multiple of 4.
+ *    @return Offset of the data in the stream VBO.
+ */
+GLuint gl_vboStreamPush( const void *data, GLsizei size )
+{
+   GLuint offset;
+
+   /* Not reserved, it's a draw of its own. */
+   if ((vbo_stream == NULL) || (vbo_streamPos + size > vbo_streamEnd))
+      gl_vboStreamReserve( size );
+
+   offset = vbo_streamPos;
+   if (has_vbo)
+      gl_vboStreamUpload( offset, size, data );
+   else
+      memcpy( &vbo_stream->data[offset], data, size );
+   vbo_streamPos += size;
+
+   /* Check for errors. */
+   gl_checkErr();
+
+   return offset;
+}
+
+
 /**
  * @brief Creates a stream vbo.
  *
@@ -41,6 +41,13 @@ void gl_vboActivateOffset( gl_vbo *vbo, GLuint class, GLuint offset,
 void gl_vboDeactivate (void);
 
 
+/*
+ * Streaming.
+ */
+gl_vbo* gl_vboStreamReserve( GLsizei size );
+GLuint gl_vboStreamPush( const void *data, GLsizei size );
+
+
 /*
  * Destroy.
  */
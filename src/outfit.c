@@ -36,6 +36,8 @@
 #include "damagetype.h"
 #include "slots.h"
 #include "mapData.h"
+#include "nhash.h"
+#include "nfuzzy.h"
 
 
 #define outfit_setProp(o,p)      ((o)->properties |= p) /**< Checks outfit property. */
@@ -49,6 +51,9 @@
  * the stack
  */
 static Outfit* outfit_stack = NULL; /**< Stack of outfits. */
+static OutfitWeapon* outfit_weapons = NULL; /**< Projectile data of the weapon outfits. */
+static NameHash outfit_hash; /**< Outfit name to stack index. */
+static NameIndex outfit_fuzzy; /**< Outfit names for fuzzy searches. */
 
 
 /*
@@ -60,9 +65,11 @@ static int outfit_setDefaultSize( Outfit *o );
 static void outfit_launcherDesc( Outfit* o );
 static int outfit_compareNames( const void *name1, const void *name2 );
 /* parsing */
+static void outfit_loadDoc( xmlDocPtr doc, int i, void *data );
 static int outfit_loadDir( char *dir );
+static void outfit_buildWeapons (void);
 static int outfit_parseDamage( Damage *dmg, xmlNodePtr node );
-static int outfit_parse( Outfit* temp, const char* file );
+static int outfit_parse( Outfit* temp, xmlDocPtr doc );
 static void outfit_parseSBolt( Outfit* temp, const xmlNodePtr parent );
 static void outfit_parseSBeam( Outfit* temp, const xmlNodePtr parent );
 static void outfit_parseSLauncher( Outfit* temp, const xmlNodePtr parent );
@@ -88,9 +95,9 @@ Outfit* outfit_get( const char* name )
 {
    int i;
 
-   for (i=0; i<array_size(outfit_stack); i++)
-      if (strcmp(name,outfit_stack[i].name)==0)
-         return &outfit_stack[i];
+   i = nhash_get( &outfit_hash, name );
+   if (i >= 0)
+      return &outfit_stack[i];
 
    WARN("Outfit '%s' not found in stack.", name);
    return NULL;
@@ -106,9 +113,9 @@ Outfit* outfit_get( const char* name )
 Outfit* outfit_getW( const char* name )
 {
    int i;
-   for (i=0; i<array_size(outfit_stack); i++)
-      if (strcmp(name,outfit_stack[i].name)==0)
-         return &outfit_stack[i];
+   i = nhash_get( &outfit_hash, name );
+   if (i >= 0)
+      return &outfit_stack[i];
    return NULL;
 }
 
@@ -141,21 +148,19 @@ const char *outfit_existsCase( const char* name )
  */
 char **outfit_searchFuzzyCase( const char* name, int *n )
 {
-   int i, len, nstack;
+   int i, len, nstack, *found;
    char **names;
 
    /* Overallocate to maximum. */
    nstack = array_size(outfit_stack);
+   found = malloc( sizeof(int) * MAX( 1, nstack ) );
    names = malloc( sizeof(char*) * nstack );
 
    /* Do fuzzy search. */
-   len = 0;
-   for (i=0; i<nstack; i++) {
-      if (nstrcasestr( outfit_stack[i].name, name ) != NULL) {
-         names[len] = outfit_stack[i].name;
-         len++;
-      }
-   }
+   len = nfuzzy_search( &outfit_fuzzy, name, found );
+   for (i=0; i<len; i++)
+      names[i] = outfit_stack[ found[i] ].name;
+   free(found);
 
    /* Free if empty. */
    if (len == 0) {
@@ -739,6 +744,55 @@ int outfit_soundHit( const Outfit* o )
    else if (outfit_isAmmo(o)) return o->u.amm.sound_hit;
    return -1.;
 }
+/**
+ * @brief Gets the store graphic of an outfit, starting to decode it if needed.
+ *    @param o Outfit to get the store graphic of.
+ *    @return The deferred store graphic or NULL if it has none.
+ */
+glTexDefer* outfit_gfxStoreDefer( Outfit* o )
+{
+   if ((o->gfx_store == NULL) && (o->gfx_store_path != NULL))
+      o->gfx_store = gl_newImageDefer( o->gfx_store_path,
+            OPENGL_TEX_MIPMAPS | OPENGL_TEX_ATLAS );
+   return o->gfx_store;
+}
+/**
+ * @brief Gets the store graphic of an outfit, blocking until it's loaded.
+ *    @param o Outfit to get the store graphic of.
+ *    @return The store graphic or NULL if it has none.
+ */
+glTexture* outfit_gfxStore( Outfit* o )
+{
+   return gl_deferWait( outfit_gfxStoreDefer(o) );
+}
+/**
+ * @brief Starts decoding the sounds an outfit plays so they are ready when used.
+ *    @param o Outfit to prefetch the sounds of.
+ */
+void outfit_prefetchSounds( const Outfit* o )
+{
+   const Outfit *amm;
+
+   if (outfit_isBolt(o) || outfit_isAmmo(o)) {
+      sound_prefetch( outfit_sound(o) );
+      sound_prefetch( outfit_soundHit(o) );
+   }
+   else if (outfit_isBeam(o)) {
+      sound_prefetch( o->u.bem.sound_warmup );
+      sound_prefetch( o->u.bem.sound );
+      sound_prefetch( o->u.bem.sound_off );
+   }
+   else if (outfit_isAfterburner(o)) {
+      sound_prefetch( o->u.afb.sound_on );
+      sound_prefetch( o->u.afb.sound );
+      sound_prefetch( o->u.afb.sound_off );
+   }
+   else if (outfit_isLauncher(o)) {
+      amm = outfit_ammo(o);
+      if (amm != NULL)
+         outfit_prefetchSounds( amm );
+   }
+}
 /**
  * @brief Gets the outfit's duration.
  *    @param o Outfit to get the duration of.
@@ -2058,23 +2112,21 @@ if (o) WARN("Outfit '%s' missing/invalid '"s"' element", temp->name) /**< Define
  * @brief Parses and returns Outfit from parent node.
 
  *    @param temp Outfit to load into.
- *    @param parent Parent node to parse outfit from.
+ *    @param doc Document to parse outfit from, gets freed.
  *    @return 0 on success.
  */
-static int outfit_parse( Outfit* temp, const char* file )
+static int outfit_parse( Outfit* temp, xmlDocPtr doc )
 {
    xmlNodePtr cur, node, parent;
    char *prop;
    const char *cprop;
+   char buf[PATH_MAX];
    int group;
-   uint32_t bufsize;
-   char *buf = ndata_read( file, &bufsize );
-
-   xmlDocPtr doc = xmlParseMemory( buf, bufsize );
 
    parent = doc->xmlChildrenNode; /* first system node */
    if (parent == NULL) {
       ERR("Malformed '"OUTFIT_DATA_PATH"' file: does not contain elements");
+      xmlFreeDoc(doc);
       return -1;
    }
 
@@ -2105,8 +2157,11 @@ static int outfit_parse( Outfit* temp, const char* file )
             xmlr_strd(cur,"typename",temp->typename);
             xmlr_int(cur,"priority",temp->priority);
             if (xml_isNode(cur,"gfx_store")) {
-               temp->gfx_store = xml_parseTexture( cur,
-                     OUTFIT_GFX_PATH"store/%s.png", 1, 1, OPENGL_TEX_MIPMAPS );
+               /* Only loaded once shown. */
+               if (xml_get(cur) != NULL) {
+                  nsnprintf( buf, sizeof(buf), OUTFIT_GFX_PATH"store/%s.png", xml_get(cur) );
+                  temp->gfx_store_path = strdup( buf );
+               }
                continue;
             }
             else if (xml_isNode(cur,"slot")) {
@@ -2210,7 +2265,7 @@ if (o) WARN("Outfit '%s' missing/invalid '"s"' element", temp->name) /**< Define
    MELEMENT(temp->name==NULL,"name");
    MELEMENT(temp->slot.type==OUTFIT_SLOT_NULL,"slot");
    MELEMENT((temp->slot.type!=OUTFIT_SLOT_NA) && (temp->slot.size==OUTFIT_SLOT_SIZE_NA),"size");
-   MELEMENT(temp->gfx_store==NULL,"gfx_store");
+   MELEMENT(temp->gfx_store_path==NULL,"gfx_store");
    /*MELEMENT(temp->mass==0,"mass"); Not really needed */
    MELEMENT(temp->type==0,"type");
    /*MELEMENT(temp->price==0,"price");*/
@@ -2218,12 +2273,23 @@ if (o) WARN("Outfit '%s' missing/invalid '"s"' element", temp->name) /**< Define
 #undef MELEMENT
 
    xmlFreeDoc(doc);
-   free(buf);
 
    return 0;
 }
 
 
+/**
+ * @brief Loads an outfit from a parsed file.
+ */
+static void outfit_loadDoc( xmlDocPtr doc, int i, void *data )
+{
+   (void) i;
+   (void) data;
+   if (doc != NULL)
+      outfit_parse( &array_grow(&outfit_stack), doc );
+}
+
+
 /**
  * @brief Loads all the files in a directory.
  *
@@ -2236,11 +2302,11 @@ static int outfit_loadDir( char *dir )
    char **outfit_files;
    int i;
 
+   /* Parse the XML in parallel. */
    outfit_files = ndata_listRecursive( dir, &nfiles );
-   for (i=0; i<(int)nfiles; i++) {
-      outfit_parse( &array_grow(&outfit_stack), outfit_files[i] );
+   xml_forEachFile( NULL, outfit_files, nfiles, outfit_loadDoc, NULL );
+   for (i=0; i<(int)nfiles; i++)
       free( outfit_files[i] );
-   }
    free( outfit_files );
 
    /* Reduce size. */
@@ -2249,6 +2315,56 @@ static int outfit_loadDir( char *dir )
    return 0;
 }
 
+/**
+ * @brief Packs the projectile data of the weapon outfits.
+ */
+static void outfit_buildWeapons (void)
+{
+   int i, n;
+   Outfit *o;
+   OutfitWeapon *wp;
+
+   n = 0;
+   for (i=0; i<array_size(outfit_stack); i++)
+      if (outfit_isBolt(&outfit_stack[i]) || outfit_isBeam(&outfit_stack[i]) ||
+            outfit_isAmmo(&outfit_stack[i]))
+         n++;
+
+   /* Sized up front, the outfits point into it. */
+   outfit_weapons = array_create( OutfitWeapon );
+   array_resize( &outfit_weapons, n );
+   n = 0;
+   for (i=0; i<array_size(outfit_stack); i++) {
+      o = &outfit_stack[i];
+      if (!outfit_isBolt(o) && !outfit_isBeam(o) && !outfit_isAmmo(o))
+         continue;
+
+      wp = &outfit_weapons[ n++ ];
+      memset( wp, 0, sizeof(OutfitWeapon) );
+      wp->type       = o->type;
+      wp->properties = o->properties;
+      wp->gfx        = outfit_gfx(o);
+      wp->spin       = outfit_spin(o);
+      if (outfit_isBolt(o))
+         wp->gfx_end = o->u.blt.gfx_end;
+      else if (outfit_isBeam(o)) {
+         wp->turn    = o->u.bem.turn;
+         wp->range   = o->u.bem.range;
+         wp->energy  = o->u.bem.energy;
+         wp->min_duration = o->u.bem.min_duration;
+      }
+      else {
+         wp->ai      = o->u.amm.ai;
+         wp->speed   = o->u.amm.speed;
+         wp->thrust  = o->u.amm.thrust;
+         wp->turn    = o->u.amm.turn;
+         wp->resist  = o->u.amm.resist;
+      }
+      o->weapon = wp;
+   }
+}
+
+
 /**
  * @brief Loads all the outfits.
  *
@@ -2265,6 +2381,14 @@ int outfit_load (void)
    array_shrink(&outfit_stack);
    noutfits = array_size(outfit_stack);
 
+   /* Index by name, backwards so the first of duplicates wins. */
+   nhash_init( &outfit_hash );
+   for (i=noutfits-1; i>=0; i--)
+      nhash_set( &outfit_hash, outfit_stack[i].name, i );
+   nfuzzy_init( &outfit_fuzzy );
+   for (i=0; i<noutfits; i++)
+      nfuzzy_add( &outfit_fuzzy, outfit_stack[i].name );
+
    /* Second pass, sets up ammunition relationships. */
    for (i=0; i<noutfits; i++) {
       o = &outfit_stack[i];
@@ -2286,6 +2410,9 @@ int outfit_load (void)
          o->u.bay.ammo = outfit_get( o->u.bay.ammo_name );
    }
 
+   /* Third pass, packs what projectiles use. */
+   outfit_buildWeapons();
+
 #ifdef DEBUGGING
    char **outfit_names = malloc( noutfits * sizeof(char*) );
    int start;
@@ -2482,10 +2609,14 @@ void outfit_free (void)
       free(o->desc_short);
       free(o->license);
       free(o->name);
-      if (o->gfx_store)
-         gl_freeTexture(o->gfx_store);
+      free(o->gfx_store_path);
+      gl_freeDefer(o->gfx_store);
    }
 
    array_free(outfit_stack);
+   array_free(outfit_weapons);
+   outfit_weapons = NULL;
+   nhash_free( &outfit_hash );
+   nfuzzy_free( &outfit_fuzzy );
 }
 
@@ -317,6 +317,30 @@ typedef struct OutfitGUIData_ {
    char *gui;        /**< Name of the GUI file. */
 } OutfitGUIData;
 
+/**
+ * @brief What the projectiles of a weapon outfit read every frame.
+ *
+ * Copied out of the outfits once they are all loaded and packed together, so
+ *  the weapon update, collision and render loops don't wander through the
+ *  whole outfit.
+ */
+typedef struct OutfitWeapon_ {
+   OutfitType type;  /**< Type of the outfit. */
+   unsigned int properties; /**< Properties of the outfit. */
+   OutfitAmmoAI ai;  /**< Smartness of ammo. */
+   glTexture *gfx;   /**< Graphic of the projectile or beam. */
+   glTexture *gfx_end; /**< End graphic of bolts, NULL if none. */
+   double spin;      /**< Graphic spin rate of bolts and ammo. */
+   double speed;     /**< Maximum speed of ammo. */
+   double thrust;    /**< Acceleration of ammo. */
+   double turn;      /**< Turn rate of ammo and beams. */
+   double resist;    /**< Jamming resistance of ammo. */
+   double range;     /**< Range of beams. */
+   double energy;    /**< Energy usage per second of beams. */
+   double min_duration; /**< Minimum duration beams are fired for. */
+} OutfitWeapon;
+
+
 /**
  * @brief A ship outfit, depends radically on the type.
  */
@@ -337,7 +361,8 @@ typedef struct Outfit_ {
    char *desc_short; /**< Short outfit description. */
    int priority;     /**< Sort priority, highest first. */
 
-   glTexture* gfx_store; /**< Store graphic. */
+   char* gfx_store_path; /**< Store graphic to load when first shown. */
+   glTexDefer* gfx_store; /**< Store graphic, see outfit_gfxStore(). */
 
    unsigned int properties; /**< Properties stored bitwise. */
 
@@ -359,6 +384,7 @@ typedef struct Outfit_ {
       OutfitLocalMapData lmap;    /**< LOCALMAP */
       OutfitGUIData gui;          /**< GUI */
    } u; /**< Holds the type-based outfit data. */
+   const OutfitWeapon *weapon; /**< What bolt, beam and ammo projectiles read every frame, NULL for the rest. */
 } Outfit;
 
 
@@ -421,6 +447,9 @@ double outfit_speed( const Outfit* o );
 double outfit_spin( const Outfit* o );
 int outfit_sound( const Outfit* o );
 int outfit_soundHit( const Outfit* o );
+void outfit_prefetchSounds( const Outfit* o );
+glTexDefer* outfit_gfxStoreDefer( Outfit* o );
+glTexture* outfit_gfxStore( Outfit* o );
 /* Active outfits. */
 double outfit_duration( const Outfit* o );
 double outfit_cooldown( const Outfit* o );
@@ -0,0 +1,530 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file perf.c
+ *
+ * @brief Times the phases of each frame.
+ *
+ * Phase times are kept for the last PERF_HISTORY frames and drawn as a
+ *  stacked bar graph, and can be recorded as a Chrome trace-event file to be
+ *  opened with chrome://tracing.
+ *
+ * When timer queries are supported the render phases are also timed on the
+ *  GPU. The queries are read back PERF_GPU_FRAMES frames later so the driver
+ *  never has to stall, and only results that are in by then are used.
+ */
+
+
+#include "perf.h"
+
+#include "naev.h"
+
+#include "SDL.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "log.h"
+#include "nstring.h"
+#include "nfile.h"
+#include "array.h"
+#include "opengl.h"
+#include "colour.h"
+#include "font.h"
+#include "metrics.h"
+
+
+#define PERF_HISTORY    120 /**< Frames kept for the overlay. */
+#define PERF_BAR_W      2. /**< Width of a frame's bar. */
+#define PERF_BAR_SCALE  6. /**< Pixels per millisecond. */
+#define PERF_X          15. /**< X position of the overlay. */
+#define PERF_Y          100. /**< Y position of the overlay. */
+#define PERF_TRACE_MAX  (1<<20) /**< Maximum trace events recorded. */
+#define PERF_TRACE_FILE "naev_trace.json" /**< Trace file, relative to the data directory. */
+#define PERF_FRAME      (-1) /**< Trace event for a whole frame. */
+#define PERF_GPU_FRAMES 4 /**< Frames in flight before GPU timings are read. */
+#define PERF_GPU_QUERIES 16 /**< Most GPU timings per frame. */
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED          0x88BF /**< From GL_ARB_timer_query. */
+#endif /* GL_TIME_ELAPSED */
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT          0x8866 /**< From OpenGL 1.5. */
+#endif /* GL_QUERY_RESULT */
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867 /**< From OpenGL 1.5. */
+#endif /* GL_QUERY_RESULT_AVAILABLE */
+
+
+/**
+ * @brief Recorded trace event.
+ */
+typedef struct PerfEvent_ {
+   int phase; /**< Phase or PERF_FRAME. */
+   double ts; /**< Start in microseconds. */
+   double dur; /**< Duration in microseconds. */
+   int gpu; /**< Whether dur is GPU time, ts is then when the CPU issued it. */
+} PerfEvent;
+
+
+/**
+ * @brief GPU timings issued during a frame.
+ */
+typedef struct PerfGPUFrame_ {
+   GLuint queries[PERF_GPU_QUERIES]; /**< Timer queries. */
+   int phase[PERF_GPU_QUERIES]; /**< Phase each query times. */
+   double ts[PERF_GPU_QUERIES]; /**< CPU start of each query, for the trace. */
+   int n; /**< Queries issued. */
+   int hist; /**< Frame in perf_gpuHist they go to. */
+} PerfGPUFrame;
+
+
+/* Phase names, also used in the trace. */
+static const char *perf_names[PERF_PHASES] = {
+   "space_update",
+   "weapons_update",
+   "spfx_update",
+   "pilots_update",
+   "cam_update",
+   "hooks",
+   "space_render",
+   "planets_render",
+   "weapons_render",
+   "pilots_render",
+   "overlay_render",
+   "gui_render"
+}; /**< Names of the phases. */
+static const glColour *perf_colours[PERF_PHASES] = {
+   &cBlue,
+   &cRed,
+   &cPurple,
+   &cGreen,
+   &cGrey70,
+   &cOrange,
+   &cLightBlue,
+   &cAqua,
+   &cPrimeRed,
+   &cPrimeGreen,
+   &cDarkPurple,
+   &cYellow
+}; /**< Colours of the phases. */
+
+static int perf_show       = 0; /**< Whether the overlay is shown. */
+static int perf_trace      = 0; /**< Whether a trace is being recorded. */
+static double perf_epoch   = -1.; /**< Origin of the timestamps. */
+static double perf_frameT0 = -1.; /**< Start of the current frame. */
+static double perf_t0[PERF_PHASES]; /**< Start of the running phases. */
+static double perf_hist[PERF_HISTORY][PERF_PHASES]; /**< Milliseconds per phase per frame. */
+static int perf_cur        = 0; /**< Current frame in perf_hist. */
+static PerfEvent *perf_events = NULL; /**< Recorded trace events. */
+static int perf_gpu        = 0; /**< 1 if GPU timing is set up, -1 if unsupported. */
+static PerfGPUFrame perf_gpuFrames[PERF_GPU_FRAMES]; /**< Frames in flight. */
+static int perf_gpuCur     = 0; /**< Current frame in perf_gpuFrames. */
+static int perf_gpuActive  = -1; /**< Query running in the current frame, -1 if none. */
+static int perf_gpuLast    = 0; /**< Frame in perf_gpuHist that was last read back. */
+static double perf_gpuHist[PERF_HISTORY][PERF_PHASES]; /**< GPU milliseconds per phase per frame. */
+static int perf_metrics[PERF_PHASES]; /**< Metrics the phase times are fed to. */
+static int perf_metricsReady = 0; /**< Whether the metrics are registered. */
+
+
+/*
+ * Prototypes.
+ */
+static double perf_clock (void);
+static void perf_record( int phase, double t0, double t1, int gpu );
+static int perf_isRender( int phase );
+static void perf_gpuInit (void);
+static void perf_gpuRead( PerfGPUFrame *fr );
+static void perf_metricsFeed (void);
+
+
+/**
+ * @brief Gets the time in microseconds.
+ */
+static double perf_clock (void)
+{
+   double t;
+#if SDL_VERSION_ATLEAST(2,0,0)
+   t = (double)SDL_GetPerformanceCounter() * 1e6 /
+         (double)SDL_GetPerformanceFrequency();
+#else /* SDL_VERSION_ATLEAST(2,0,0) */
+   t = (double)SDL_GetTicks() * 1000.;
+#endif /* SDL_VERSION_ATLEAST(2,0,0) */
+   if (perf_epoch < 0.)
+      perf_epoch = t;
+   return t - perf_epoch;
+}
+
+
+/**
+ * @brief Adds an event to the trace.
+ */
+static void perf_record( int phase, double t0, double t1, int gpu )
+{
+   PerfEvent *e;
+
+   if (perf_events == NULL)
+      perf_events = array_create( PerfEvent );
+   if (array_size(perf_events) >= PERF_TRACE_MAX) {
+      WARN("Trace has reached %d events, stopping.", PERF_TRACE_MAX);
+      perf_traceStop();
+      return;
+   }
+
+   e        = &array_grow( &perf_events );
+   e->phase = phase;
+   e->ts    = t0;
+   e->dur   = t1 - t0;
+   e->gpu   = gpu;
+}
+
+
+/**
+ * @brief Checks whether a phase renders, so can be timed on the GPU.
+ */
+static int perf_isRender( int phase )
+{
+   return (phase >= PERF_SPACE_RENDER) && (phase < PERF_PHASES);
+}
+
+
+/**
+ * @brief Creates the timer queries, if supported.
+ */
+static void perf_gpuInit (void)
+{
+   int i;
+
+   if (nglGenQueries == NULL) {
+      perf_gpu = -1;
+      return;
+   }
+   for (i=0; i<PERF_GPU_FRAMES; i++) {
+      nglGenQueries( PERF_GPU_QUERIES, perf_gpuFrames[i].queries );
+      perf_gpuFrames[i].n    = 0;
+      perf_gpuFrames[i].hist = 0;
+   }
+   perf_gpu = 1;
+}
+
+
+/**
+ * @brief Reads back the GPU timings of a frame in flight.
+ *
+ * Results that are not in yet are dropped instead of waited for.
+ *
+ *    @param fr Frame to read.
+ */
+static void perf_gpuRead( PerfGPUFrame *fr )
+{
+   int i;
+   GLint available;
+   uint64_t ns;
+   double ms;
+
+   for (i=0; i<fr->n; i++) {
+      available = 0;
+      nglGetQueryObjectiv( fr->queries[i], GL_QUERY_RESULT_AVAILABLE, &available );
+      if (!available)
+         continue;
+      nglGetQueryObjectui64v( fr->queries[i], GL_QUERY_RESULT, &ns );
+      ms = (double)ns / 1e6;
+      perf_gpuHist[fr->hist][ fr->phase[i] ] += ms;
+      if (perf_trace)
+         perf_record( fr->phase[i], fr->ts[i], fr->ts[i] + ms*1000., 1 );
+   }
+   fr->n = 0;
+}
+
+
+/**
+ * @brief Feeds the phase times of the frame that ended to the metrics.
+ */
+static void perf_metricsFeed (void)
+{
+   char name[64];
+   int i;
+
+   if (!perf_metricsReady) {
+      for (i=0; i<PERF_PHASES; i++) {
+         nsnprintf( name, sizeof(name), "phase.%s", perf_names[i] );
+         perf_metrics[i] = metrics_register( name, METRIC_HISTOGRAM );
+      }
+      perf_metricsReady = 1;
+   }
+
+   for (i=0; i<PERF_PHASES; i++)
+      metrics_observe( perf_metrics[i], perf_hist[perf_cur][i] );
+}
+
+
+/**
+ * @brief Starts a new frame.
+ *
+ * Phases are also timed while metrics are being collected.
+ *
+ *    @param show Whether the overlay is to be shown.
+ */
+void perf_frameStart( int show )
+{
+   double t;
+   int i;
+
+   perf_show = show;
+   if (!perf_show && !perf_trace && !metrics_enabled()) {
+      perf_frameT0 = -1.;
+      return;
+   }
+
+   t = perf_clock();
+   if (perf_trace && (perf_frameT0 >= 0.))
+      perf_record( PERF_FRAME, perf_frameT0, t, 0 );
+   if (metrics_enabled() && (perf_frameT0 >= 0.))
+      perf_metricsFeed();
+   perf_frameT0 = t;
+
+   perf_cur = (perf_cur+1) % PERF_HISTORY;
+   for (i=0; i<PERF_PHASES; i++) {
+      perf_hist[perf_cur][i]    = 0.;
+      perf_gpuHist[perf_cur][i] = 0.;
+   }
+
+   /* The oldest frame in flight gets read and reused. */
+   if (perf_gpu == 0)
+      perf_gpuInit();
+   if (perf_gpu > 0) {
+      perf_gpuCur = (perf_gpuCur+1) % PERF_GPU_FRAMES;
+      perf_gpuRead( &perf_gpuFrames[perf_gpuCur] );
+      perf_gpuLast = perf_gpuFrames[perf_gpuCur].hist;
+      perf_gpuFrames[perf_gpuCur].hist = perf_cur;
+      perf_gpuActive = -1;
+   }
+}
+
+
+/**
+ * @brief Starts timing a phase.
+ *
+ *    @param phase Phase starting.
+ */
+void perf_begin( PerfPhase phase )
+{
+   PerfGPUFrame *fr;
+
+   if (perf_frameT0 < 0.)
+      return;
+   perf_t0[phase] = perf_clock();
+
+   /* Only one timer query can run at a time. */
+   if ((perf_gpu > 0) && perf_isRender( phase ) && (perf_gpuActive < 0)) {
+      fr = &perf_gpuFrames[perf_gpuCur];
+      if (fr->n >= PERF_GPU_QUERIES)
+         return;
+      fr->phase[fr->n] = phase;
+      fr->ts[fr->n]    = perf_t0[phase];
+      nglBeginQuery( GL_TIME_ELAPSED, fr->queries[fr->n] );
+      perf_gpuActive   = fr->n++;
+   }
+}
+
+
+/**
+ * @brief Stops timing a phase.
+ *
+ *    @param phase Phase ending, must have been started with perf_begin().
+ */
+void perf_end( PerfPhase phase )
+{
+   double t;
+
+   if (perf_frameT0 < 0.)
+      return;
+
+   if ((perf_gpuActive >= 0) &&
+         (perf_gpuFrames[perf_gpuCur].phase[perf_gpuActive] == (int)phase)) {
+      nglEndQuery( GL_TIME_ELAPSED );
+      perf_gpuActive = -1;
+   }
+
+   t = perf_clock();
+   perf_hist[perf_cur][phase] += (t - perf_t0[phase]) / 1000.;
+   if (perf_trace)
+      perf_record( phase, perf_t0[phase], t, 0 );
+}
+
+
+/**
+ * @brief Gets the time spent in a phase during the current frame.
+ *
+ *    @param phase Phase to get.
+ *    @return Milliseconds spent in the phase.
+ */
+double perf_get( PerfPhase phase )
+{
+   return perf_hist[perf_cur][phase];
+}
+
+
+/**
+ * @brief Gets the GPU time of a phase of the latest frame read back.
+ *
+ *    @param phase Phase to get.
+ *    @return GPU milliseconds spent in the phase, 0 if not timed.
+ */
+double perf_getGPU( PerfPhase phase )
+{
+   return perf_gpuHist[perf_gpuLast][phase];
+}
+
+
+/**
+ * @brief Gets the name of a phase.
+ *
+ *    @param phase Phase to get the name of.
+ *    @return Name of the phase.
+ */
+const char* perf_name( PerfPhase phase )
+{
+   return perf_names[phase];
+}
+
+
+/**
+ * @brief Renders the rolling phase bar graph.
+ */
+void perf_render (void)
+{
+   int i, j, f;
+   double x, y, h, total, gpu;
+
+   if (!perf_show)
+      return;
+
+   /* Background and 60 FPS budget line. */
+   gl_renderRect( PERF_X, PERF_Y, PERF_HISTORY*PERF_BAR_W,
+         1000./60. * PERF_BAR_SCALE, &cBlackHilight );
+   gl_renderRect( PERF_X, PERF_Y + 1000./60. * PERF_BAR_SCALE,
+         PERF_HISTORY*PERF_BAR_W, 1., &cGrey50 );
+
+   /* Oldest frame first. */
+   for (i=0; i<PERF_HISTORY; i++) {
+      f = (perf_cur + 1 + i) % PERF_HISTORY;
+      x = PERF_X + i*PERF_BAR_W;
+      y = PERF_Y;
+      for (j=0; j<PERF_PHASES; j++) {
+         h = perf_hist[f][j] * PERF_BAR_SCALE;
+         if (h <= 0.)
+            continue;
+         gl_renderRect( x, y, PERF_BAR_W, h, perf_colours[j] );
+         y += h;
+      }
+   }
+
+   /* Legend with the last frame's times, GPU times lag a few frames. */
+   x     = PERF_X + PERF_HISTORY*PERF_BAR_W + 10.;
+   y     = PERF_Y;
+   total = 0.;
+   gpu   = 0.;
+   for (j=0; j<PERF_PHASES; j++) {
+      if ((perf_gpu > 0) && perf_isRender( j ))
+         gl_print( &gl_smallFont, x, y, perf_colours[j], "%5.2f %5.2f %s",
+               perf_hist[perf_cur][j], perf_getGPU(j), perf_names[j] );
+      else
+         gl_print( &gl_smallFont, x, y, perf_colours[j], "%5.2f %s",
+               perf_hist[perf_cur][j], perf_names[j] );
+      y    += gl_smallFont.h + 2.;
+      total += perf_hist[perf_cur][j];
+      gpu   += perf_getGPU(j);
+   }
+   if (perf_gpu > 0)
+      gl_print( &gl_smallFont, x, y, &cWhite, "%5.2f %5.2f total", total, gpu );
+   else
+      gl_print( &gl_smallFont, x, y, &cWhite, "%5.2f total", total );
+}
+
+
+/**
+ * @brief Starts recording a trace.
+ *
+ *    @return 0 on success.
+ */
+int perf_traceStart (void)
+{
+   if (perf_trace)
+      return -1;
+   if (perf_events != NULL)
+      array_erase( &perf_events, array_begin(perf_events), array_end(perf_events) );
+   perf_trace = 1;
+   return 0;
+}
+
+
+/**
+ * @brief Stops recording a trace and writes it as trace-event JSON.
+ *
+ *    @return 0 on success.
+ */
+int perf_traceStop (void)
+{
+   char file[PATH_MAX];
+   FILE *f;
+   int i, n;
+   const char *name;
+
+   if (!perf_trace)
+      return -1;
+   perf_trace = 0;
+
+   nsnprintf( file, sizeof(file), "%s"PERF_TRACE_FILE, nfile_dataPath() );
+   f = fopen( file, "w" );
+   if (f == NULL) {
+      WARN("Unable to open '%s' to write the trace.", file);
+      return -1;
+   }
+
+   n = (perf_events != NULL) ? array_size(perf_events) : 0;
+   fprintf( f, "{\"traceEvents\":[\n" );
+   for (i=0; i<n; i++) {
+      name = (perf_events[i].phase == PERF_FRAME) ? "frame" :
+            perf_names[ perf_events[i].phase ];
+      fprintf( f, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+            "\"ts\":%.1f,\"dur\":%.1f}%s\n", name,
+            (perf_events[i].phase == PERF_FRAME) ? 1 : (perf_events[i].gpu ? 3 : 2),
+            perf_events[i].ts, perf_events[i].dur, (i<n-1) ? "," : "" );
+   }
+   fprintf( f, "],\"displayTimeUnit\":\"ms\"}\n" );
+   fclose( f );
+
+   DEBUG("Trace with %d events written to '%s'.", n, file);
+   return 0;
+}
+
+
+/**
+ * @brief Checks whether a trace is being recorded.
+ */
+int perf_tracing (void)
+{
+   return perf_trace;
+}
+
+
+/**
+ * @brief Writes any trace being recorded and frees the profiler.
+ */
+void perf_exit (void)
+{
+   int i;
+
+   if (perf_trace)
+      perf_traceStop();
+   if (perf_gpu > 0)
+      for (i=0; i<PERF_GPU_FRAMES; i++)
+         nglDeleteQueries( PERF_GPU_QUERIES, perf_gpuFrames[i].queries );
+   perf_gpu = 0;
+   if (perf_events != NULL)
+      array_free( perf_events );
+   perf_events = NULL;
+}
@@ -0,0 +1,50 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef PERF_H
+#  define PERF_H
+
+
+/**
+ * @brief Phases of a frame that get timed.
+ */
+typedef enum PerfPhase_ {
+   PERF_SPACE_UPDATE,   /**< space_update() */
+   PERF_WEAPONS_UPDATE, /**< weapons_update() */
+   PERF_SPFX_UPDATE,    /**< spfx_update() */
+   PERF_PILOTS_UPDATE,  /**< pilots_update() */
+   PERF_CAM_UPDATE,     /**< cam_update() */
+   PERF_HOOKS,          /**< Queued hooks run by hook_exclusionEnd(). */
+   PERF_SPACE_RENDER,   /**< space_render() */
+   PERF_PLANETS_RENDER, /**< planets_render() */
+   PERF_WEAPONS_RENDER, /**< weapons_render() */
+   PERF_PILOTS_RENDER,  /**< pilots_render() */
+   PERF_OVERLAY_RENDER, /**< space_renderOverlay() */
+   PERF_GUI_RENDER,     /**< gui_render() */
+   PERF_PHASES          /**< Number of phases. */
+} PerfPhase;
+
+
+/*
+ * Timing.
+ */
+void perf_frameStart( int show );
+void perf_begin( PerfPhase phase );
+void perf_end( PerfPhase phase );
+double perf_get( PerfPhase phase );
+double perf_getGPU( PerfPhase phase );
+const char* perf_name( PerfPhase phase );
+
+/*
+ * Output.
+ */
+void perf_render (void);
+int perf_traceStart (void);
+int perf_traceStop (void);
+int perf_tracing (void);
+void perf_exit (void);
+
+
+#endif /* PERF_H */
@@ -38,6 +38,10 @@
  * @note Tried to optimize a while back with SSE and the works, but because
  *       of the nature of how it's implemented in non-linear fashion it just
  *       wound up complicating the code without actually making it faster.
+ *       The nebula map is now generated a row at a time instead: since only
+ *       x changes along a row, the lattice lookups of a cell are done once
+ *       for all the pixels in it and the remaining interpolation is done
+ *       NOISE_LANES pixels at a time.
  */
 
 
@@ -60,6 +64,13 @@
 
 #define SIMPLEX_SCALE 0.5f
 
+#define NOISE_ROWS   8 /**< Minimum rows of the nebula map per job. */
+
+#if defined(__GNUC__)
+#define NOISE_LANES  4 /**< Pixels evaluated at once, SSE2 or NEON width. */
+typedef float noise_v4 __attribute__ ((vector_size (4*sizeof(float)))); /**< Vector of NOISE_LANES floats. */
+#endif /* defined(__GNUC__) */
+
 
 /**
  * @brief Linearly Interpolates x between a and b.
@@ -67,6 +78,18 @@
 #define LERP(a, b, x)      ( a + x * (b - a) )
 
 
+/**
+ * @brief Lattice cell seen from a row of constant y and z.
+ *
+ * Corner k is at +1 in x, y and z for bits 0, 1 and 2 respectively.
+ */
+typedef struct noise_cell_ {
+   float gx[8]; /**< X gradients of the corners. */
+   float py[8]; /**< Y terms of the lattice values of the corners. */
+   float pz[8]; /**< Z terms of the lattice values of the corners. */
+} noise_cell;
+
+
 /**
  * @brief Structure used for generating noise.
  */
@@ -85,14 +108,14 @@ struct perlin_data_s {
  * @brief Threading stuff.
  */
 typedef struct thread_args_ {
-   int z; /**< Z level working on. */
    float zoom; /**< Zoom level of detail. */
    int n; /**< Number of layers to generate. */
    int h; /**< Height. */
    int w; /**< Width. */
    perlin_data_t *noise; /**< Parent noise. */
    int octaves; /**< Octave parameters. */
-   float *max; /**< Maximum value. */
+   int period; /**< Period in lattice cells of the first octave. */
+   float *max; /**< Maximum value of each row. */
    float *nebula; /**< Nebula loading into. */
 } thread_args;
 
@@ -108,8 +131,14 @@ static float lattice3( perlin_data_t *pdata, int ix, float fx,
       int iy, float fy, int iz, float fz );
 static float lattice2( perlin_data_t *pdata, int ix, float fx, int iy, float fy );
 static float lattice1( perlin_data_t *pdata, int ix, float fx );
+/* Rows. */
+static void noise_cellRow( perlin_data_t *pdata, noise_cell *c,
+      int ix, int iy, float fy, int iz, float fz, int p );
+static float noise_cellGet( const noise_cell *c, float r0, float w1, float w2 );
+static void noise_turbulence3row( perlin_data_t* pdata, float *tx, float *out,
+      int w, float fy, float fz, int octaves, int period );
 /*Threading */
-static int noise_genNebulaMap_thread( void *data );
+static void noise_genNebulaMap_rows( int start, int end, void *data );
 
 
 /**
@@ -585,81 +614,210 @@ float* noise_genRadarInt( const int w, const int h, float rug )
 
 
 /**
- * @brief Thread worker for generating nebula stuff.
+ * @brief Does the lattice3 lookups of a cell for a row.
  *
- *    @param data Data to pass.
+ * With a period p the lattice repeats every p cells in x and y, p must not
+ *  be over 256.  A period of 0 leaves the lattice as is.
  */
-static int noise_genNebulaMap_thread( void *data )
+static void noise_cellRow( perlin_data_t *pdata, noise_cell *c,
+      int ix, int iy, float fy, int iz, float fz, int p )
 {
-   thread_args *args = (thread_args*) data;
-   float f[3];
-   float value;
-   int y, x;
-   float max;
+   int k, dx, dy, dz, nx, ny, nIndex;
+
+   for (k=0; k<8; k++) {
+      dx = k & 1;
+      dy = (k>>1) & 1;
+      dz = (k>>2) & 1;
+      nx = (p > 0) ? (ix + dx) % p : ix + dx;
+      ny = (p > 0) ? (iy + dy) % p : iy + dy;
+      nIndex = pdata->map[nx & 0xFF];
+      nIndex = pdata->map[(nIndex + ny) & 0xFF];
+      nIndex = pdata->map[(nIndex + iz + dz) & 0xFF];
+      c->gx[k] = pdata->buffer[nIndex][0];
+      c->py[k] = pdata->buffer[nIndex][1] * (dy ? fy-1 : fy);
+      c->pz[k] = pdata->buffer[nIndex][2] * (dz ? fz-1 : fz);
+   }
+}
 
-   /* Generate the layer. */
-   max = 0;
-   f[2] = args->zoom * (float)args->z / (float)args->n;
 
-   for (y=0; y<args->h; y++) {
-      f[1] = args->zoom * (float)y / (float)args->h;
+/**
+ * @brief Does what noise_get3 does once the lattice lookups of the cell are
+ *        done, without clamping.
+ */
+static float noise_cellGet( const noise_cell *c, float r0, float w1, float w2 )
+{
+   float v[8], w0, r0m;
+   int k;
+
+   r0m = r0 - 1;
+   w0  = CUBIC(r0);
+   for (k=0; k<8; k++)
+      v[k] = c->gx[k] * ((k & 1) ? r0m : r0) + c->py[k] + c->pz[k];
+   return LERP(
+         LERP( LERP(v[0], v[1], w0), LERP(v[2], v[3], w0), w1 ),
+         LERP( LERP(v[4], v[5], w0), LERP(v[6], v[7], w0), w1 ),
+         w2 );
+}
 
-      for (x=0; x<args->w; x++) {
-         f[0] = args->zoom * (float)x / (float)args->w;
 
-         value = noise_turbulence3( args->noise, f, args->octaves );
-         if (max < value)
-            max = value;
+/**
+ * @brief Gets the 3d turbulence of a row of points of constant y and z.
+ *
+ * Gives the same results as calling noise_turbulence3 on each point.
+ *
+ *    @param pdata Perlin data to generate noise from.
+ *    @param[in,out] tx X positions, they get scaled in the process.
+ *    @param[out] out Noise of each point.
+ *    @param w Number of points.
+ *    @param fy Y position.
+ *    @param fz Z position.
+ *    @param octaves Octaves to use.
+ *    @param period Period of the first octave in cells, 0 to not wrap.
+ */
+static void noise_turbulence3row( perlin_data_t* pdata, float *tx, float *out,
+      int w, float fy, float fz, int octaves, int period )
+{
+   int i, x, n0, n1, n2, cell, j;
+   float r1, r2, w1, w2, value, e;
+   noise_cell c;
+#if defined(NOISE_LANES)
+   noise_v4 vx, r0, r0m, w0, v[8], a, b, vv;
+   float lanes[NOISE_LANES];
+   int k;
+#endif /* defined(NOISE_LANES) */
+
+   for (x=0; x<w; x++)
+      out[x] = 0.;
+
+   for (i=0; i<octaves; i++) {
+      n1   = (int)fy;
+      n2   = (int)fz;
+      r1   = fy - n1;
+      r2   = fz - n2;
+      w1   = CUBIC(r1);
+      w2   = CUBIC(r2);
+      e    = pdata->exponent[i];
+      cell = (int)tx[0] - 1;
+
+      x = 0;
+      while (x < w) {
+         n0 = (int)tx[x];
+         if (n0 != cell) {
+            noise_cellRow( pdata, &c, n0, n1, r1, n2, r2, period );
+            cell = n0;
+         }
+
+#if defined(NOISE_LANES)
+         /* Whole vector in the cell, since x only grows. */
+         if ((x+NOISE_LANES <= w) && ((int)tx[x+NOISE_LANES-1] == cell)) {
+            memcpy( &vx, &tx[x], sizeof(vx) );
+            r0  = vx - (float)cell;
+            r0m = r0 - 1.f;
+            w0  = r0 * r0 * (3.f - 2.f*r0);
+            for (k=0; k<8; k++)
+               v[k] = c.gx[k] * ((k & 1) ? r0m : r0) + c.py[k] + c.pz[k];
+            a  = LERP( LERP(v[0], v[1], w0), LERP(v[2], v[3], w0), w1 );
+            b  = LERP( LERP(v[4], v[5], w0), LERP(v[6], v[7], w0), w1 );
+            vv = LERP( a, b, w2 );
+            memcpy( lanes, &vv, sizeof(lanes) );
+            for (j=0; j<NOISE_LANES; j++) {
+               value     = CLAMP(-0.99999f, 0.99999f, lanes[j]);
+               out[x+j] += ABS(value) * e;
+            }
+            x += NOISE_LANES;
+            continue;
+         }
+#endif /* defined(NOISE_LANES) */
+
+         value   = noise_cellGet( &c, tx[x] - n0, w1, w2 );
+         value   = CLAMP(-0.99999f, 0.99999f, value);
+         out[x] += ABS(value) * e;
+         x++;
+      }
 
-         args->nebula[args->z * args->w * args->h + y * args->w + x] = value;
-       }
+      for (j=0; j<w; j++)
+         tx[j] *= pdata->lacunarity;
+      fy *= pdata->lacunarity;
+      fz *= pdata->lacunarity;
+      period = (int)(period * pdata->lacunarity + 0.5);
    }
 
-   /* Set up output. */
-   *args->max = max;
+   for (x=0; x<w; x++)
+      out[x] = CLAMP(-0.99999f, 0.99999f, out[x]);
+}
+
 
-   /* Clean up. */
-   free( args );
-   return 0;
+/**
+ * @brief Thread worker for generating rows of the nebula.
+ *
+ *    @param start First row, counting across the layers.
+ *    @param end Row after the last.
+ *    @param data Data to pass.
+ */
+static void noise_genNebulaMap_rows( int start, int end, void *data )
+{
+   thread_args *args = (thread_args*) data;
+   float *row, *tx;
+   float fy, fz, max;
+   int r, x, y, z;
+
+   tx = malloc( sizeof(float) * args->w );
+   for (r=start; r<end; r++) {
+      z    = r / args->h;
+      y    = r % args->h;
+      row  = &args->nebula[ r * args->w ];
+      fz   = args->zoom * (float)z / (float)args->n;
+      fy   = args->zoom * (float)y / (float)args->h;
+      for (x=0; x<args->w; x++)
+         tx[x] = args->zoom * (float)x / (float)args->w;
+
+      noise_turbulence3row( args->noise, tx, row, args->w, fy, fz,
+            args->octaves, args->period );
+
+      max = 0.;
+      for (x=0; x<args->w; x++)
+         if (max < row[x])
+            max = row[x];
+      args->max[r] = max;
+   }
+   free( tx );
 }
 
 
 /**
  * @brief Generates a 3d nebula map.
  *
+ * Rows of all the layers are split over the threadpool.  The map spans rug
+ *  lattice cells whatever its size, so maps of different sizes made from the
+ *  same noise look the same, and it tiles when rug is a whole number.
+ *
+ *    @param noise 3d noise to generate from.
  *    @param w Width of the map.
  *    @param h Height of the map.
  *    @param n Number of slices of the map (2d planes).
  *    @param rug Rugosity of the map.
  *    @return The map generated.
  */
-float* noise_genNebulaMap( const int w, const int h, const int n, float rug )
+float* noise_genNebulaMap( perlin_data_t *noise, const int w, const int h,
+      const int n, float rug )
 {
-   int x, y, z, i;
+   int i;
    int octaves;
-   float hurst;
-   float lacunarity;
-   perlin_data_t* noise;
    float *nebula;
    float value;
    float zoom;
    float *_max;
    float max;
    unsigned int s;
-   thread_args *args;
-   ThreadQueue *vpool;
+   thread_args args;
 
    /* pretty default values */
    octaves     = 3;
-   hurst       = NOISE_DEFAULT_HURST;
-   lacunarity  = NOISE_DEFAULT_LACUNARITY;
-   zoom        = rug * ((float)h/768.)*((float)w/1024.);
+   zoom        = rug;
 
-   /* create noise and data */
-   noise      = noise_new( 3, hurst, lacunarity );
+   /* create data */
    nebula     = malloc(sizeof(float)*w*h*n);
    if (nebula == NULL) {
-      noise_delete( noise );
       WARN("Out of memory!");
       return NULL;
    }
@@ -669,46 +827,33 @@ float* noise_genNebulaMap( const int w, const int h, const int n, float rug )
    DEBUG("Generating Nebula of size %dx%dx%d", w, h, n);
 
    /* Prepare for generation. */
-   _max        = malloc( sizeof(float) * n );
-
-   /* Initialize vpool */
-   vpool = vpool_create();
-
-   /* Start to create the nebula */
-   for (z=0; z<n; z++) {
-      /* Make ze arguments! */
-      args     = malloc( sizeof(thread_args) );
-      args->z  = z;
-      args->zoom = zoom;
-      args->n  = n;
-      args->h  = h;
-      args->w  = w;
-      args->noise = noise;
-      args->octaves = octaves;
-      args->max = &_max[z];
-      args->nebula = nebula;
-
-      /* Launch ze thread. */
-      vpool_enqueue( vpool, noise_genNebulaMap_thread, args );
-   }
-
-   /* Wait for threads to signal completion. */
-   vpool_wait( vpool );
+   _max        = malloc( sizeof(float) * n * h );
+
+   /* Make ze arguments! */
+   args.zoom    = zoom;
+   args.n       = n;
+   args.h       = h;
+   args.w       = w;
+   args.noise   = noise;
+   args.octaves = octaves;
+   args.period  = (zoom == floorf(zoom)) ? (int)zoom : 0;
+   args.max     = _max;
+   args.nebula  = nebula;
+
+   /* Create the nebula. */
+   threadpool_parallelFor( n * h, NOISE_ROWS, noise_genNebulaMap_rows, &args );
    max = 0.;
-   for (i=0; i<n; i++) {
+   for (i=0; i<n*h; i++) {
       if (_max[i]>max)
          max = _max[i];
    }
 
    /* Post filtering */
    value = 1. - max;
-   for (z=0; z<n; z++)
-      for (y=0; y<h; y++)
-         for (x=0; x<w; x++)
-            nebula[z*w*h + y*w + x] += value;
+   for (i=0; i<n*w*h; i++)
+      nebula[i] += value;
 
    /* Clean up */
-   noise_delete( noise );
    free(_max);
 
    /* Results */
@@ -720,20 +865,21 @@ float* noise_genNebulaMap( const int w, const int h, const int n, float rug )
 /**
  * @brief Generates tiny nebula puffs
  *
+ * Doesn't use the RNG, so it can run on any thread.
+ *
+ *    @param noise Two dimensional noise to generate from.
  *    @param w Width of the puff to generate.
  *    @param h Height of the puff to generate.
  *    @param rug Rugosity of the puff.
  *    @return The puff generated.
  */
-float* noise_genNebulaPuffMap( const int w, const int h, float rug )
+float* noise_genNebulaPuffMap( perlin_data_t *noise, const int w, const int h,
+      float rug )
 {
    int x,y, hw,hh;
    float d;
    float f[2];
    int octaves;
-   float hurst;
-   float lacunarity;
-   perlin_data_t* noise;
    float *nebula;
    float value;
    float zoom;
@@ -741,15 +887,11 @@ float* noise_genNebulaPuffMap( const int w, const int h, float rug )
 
    /* pretty default values */
    octaves     = 3;
-   hurst       = NOISE_DEFAULT_HURST;
-   lacunarity  = NOISE_DEFAULT_LACUNARITY;
    zoom        = rug;
 
-   /* create noise and data */
-   noise       = noise_new( 2, hurst, lacunarity );
+   /* create data */
    nebula      = malloc(sizeof(float)*w*h);
    if (nebula == NULL) {
-      noise_delete( noise );
       WARN("Out of memory!");
       return NULL;
    }
@@ -783,9 +925,6 @@ float* noise_genNebulaPuffMap( const int w, const int h, float rug )
       }
    }
 
-   /* Clean up */
-   noise_delete( noise );
-
    /* Results */
    return nebula;
 }
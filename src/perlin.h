@@ -29,8 +29,10 @@ float noise_simplex1( perlin_data_t* noise, float f[1] );
 
 /* High level. */
 float* noise_genRadarInt( const int w, const int h, float rug );
-float* noise_genNebulaMap( const int w, const int h, const int n, float rug );
-float* noise_genNebulaPuffMap( const int w, const int h, float rug );
+float* noise_genNebulaMap( perlin_data_t *noise, const int w, const int h,
+      const int n, float rug );
+float* noise_genNebulaPuffMap( perlin_data_t *noise, const int w, const int h,
+      float rug );
 
 
 #endif
@@ -15,6 +15,22 @@
 #include "log.h"
 
 
+#define SOLID_PAGE      256 /**< Solids per storage page. */
+#define SOLID_LERP_MAX  1000. /**< Moves longer than this in a tick are teleports. */
+
+
+/*
+ * Solid storage.
+ */
+static Solid **solid_pages    = NULL; /**< Storage pages, never move once allocated. */
+static int solid_npages       = 0; /**< Number of storage pages. */
+static Solid **solid_unused   = NULL; /**< Stack of unused solids. */
+static int solid_nunused      = 0; /**< Number of unused solids. */
+static int solid_munused      = 0; /**< Memory allocated for the unused stack. */
+static Vector2d *solid_saved  = NULL; /**< Simulated positions while rendering interpolated. */
+static int solid_nsaved       = 0; /**< Number of saved positions. */
+
+
 /*
  * M I S C
  */
@@ -66,15 +82,16 @@ double angle_diff( const double ref, double a )
  */
 void vect_cset( Vector2d* v, const double x, const double y )
 {
-   v->x     = x;
-   v->y     = y;
-   v->mod   = MOD(x,y);
-   v->angle = ANGLE(x,y);
+   v->x = x;
+   v->y = y;
 }
 
 
 /**
- * @brief Creates a minimal vector only valid for blitting and not other operations.
+ * @brief Creates a minimal vector.
+ *
+ * Was only valid for blitting when vectors stored their polar form, it is the
+ *  same as vect_cset() now.
  *
  *    @param v Vector to set.
  *    @param x X value for vector.
@@ -96,10 +113,8 @@ void vect_csetmin( Vector2d* v, const double x, const double y )
  */
 void vect_pset( Vector2d* v, const double mod, const double angle )
 {
-   v->mod   = mod;
-   v->angle = angle;
-   v->x     = v->mod*cos(v->angle);
-   v->y     = v->mod*sin(v->angle);
+   v->x = mod*cos(angle);
+   v->y = mod*sin(angle);
 }
 
 
@@ -110,10 +125,8 @@ void vect_pset( Vector2d* v, const double mod, const double angle )
  */
 void vectnull( Vector2d* v )
 {
-   v->x     = 0.;
-   v->y     = 0.;
-   v->mod   = 0.;
-   v->angle = 0.;
+   v->x = 0.;
+   v->y = 0.;
 }
 
 
@@ -144,10 +157,8 @@ double vect_angle( const Vector2d* ref, const Vector2d* v )
  */
 void vect_cadd( Vector2d* v, const double x, const double y )
 {
-   v->x    += x;
-   v->y    += y;
-   v->mod   = MOD(v->x,v->y);
-   v->angle = ANGLE(v->x,v->y);
+   v->x += x;
+   v->y += y;
 }
 
 
@@ -160,10 +171,8 @@ void vect_cadd( Vector2d* v, const double x, const double y )
  */
 void vect_padd( Vector2d* v, const double m, const double a )
 {
-   v->x    += m*cos(a);
-   v->y    += m*sin(a);
-   v->mod   = MOD(v->x,v->y);
-   v->angle = ANGLE(v->x,v->y);
+   v->x += m*cos(a);
+   v->y += m*sin(a);
 }
 
 
@@ -181,8 +190,6 @@ void vect_reflect( Vector2d* r, Vector2d* v, Vector2d* n )
    dot      = vect_dot( v, n );
    r->x     = v->x - ((2. * dot) * n->x);
    r->y     = v->y - ((2. * dot) * n->y);
-   r->mod   = MOD(r->x,r->y);
-   r->angle = MOD(r->x,r->y);
 }
 
 
@@ -226,8 +233,11 @@ void vect_uv( double* u, double* v, Vector2d* source, Vector2d* reference_vector
  */
 void vect_uv_decomp( Vector2d* u, Vector2d* v, Vector2d* reference_vector )
 {
-   vect_pset(u, 1, VANGLE(*reference_vector));
-   vect_pset(v, 1, VANGLE(*reference_vector)+M_PI_2);
+   double a;
+
+   a = VANGLE(*reference_vector);
+   vect_pset(u, 1, a);
+   vect_pset(v, 1, a+M_PI_2);
 }
 
 
@@ -445,6 +455,7 @@ void solid_init( Solid* dest, const double mass, const double dir,
       vectnull( &dest->pos );
    else
       dest->pos = *pos;
+   dest->pos_prev = dest->pos;
 
    /* Misc. */
    dest->speed_max = -1.; /* Negative is invalid. */
@@ -479,9 +490,28 @@ void solid_init( Solid* dest, const double mass, const double dir,
 Solid* solid_create( const double mass, const double dir,
       const Vector2d* pos, const Vector2d* vel, int update )
 {
-   Solid* dyn = malloc(sizeof(Solid));
-   if (dyn==NULL)
-      ERR("Out of Memory");
+   int i;
+   Solid *page, *dyn;
+
+   /* Out of solids, add a new page. */
+   if (solid_nunused == 0) {
+      page = calloc( SOLID_PAGE, sizeof(Solid) ); /* Unused solids have no update. */
+      if (page==NULL)
+         ERR("Out of Memory");
+      solid_npages++;
+      solid_pages = realloc( solid_pages, solid_npages * sizeof(Solid*) );
+      solid_pages[ solid_npages-1 ] = page;
+
+      if (solid_munused < SOLID_PAGE * solid_npages) {
+         solid_munused = SOLID_PAGE * solid_npages;
+         solid_unused  = realloc( solid_unused, solid_munused * sizeof(Solid*) );
+      }
+      /* Pushed in reverse so they get handed out in memory order. */
+      for (i=SOLID_PAGE-1; i>=0; i--)
+         solid_unused[ solid_nunused++ ] = &page[i];
+   }
+
+   dyn = solid_unused[ --solid_nunused ];
    solid_init( dyn, mass, dir, pos, vel, update );
    return dyn;
 }
@@ -490,10 +520,119 @@ Solid* solid_create( const double mass, const double dir,
 /**
  * @brief Frees an existing solid.
  *
+ * The solid goes back to the storage so it can be reused. Solids that weren't
+ *  created by solid_create are refused.
+ *
  *    @param src Solid to free.
  */
 void solid_free( Solid* src )
 {
-   free(src);
+   int i;
+
+   if (src == NULL)
+      return;
+
+   /* Must be from one of the pages. */
+   for (i=0; i<solid_npages; i++)
+      if ((src >= solid_pages[i]) && (src < solid_pages[i] + SOLID_PAGE))
+         break;
+   if ((i >= solid_npages) || (solid_nunused >= SOLID_PAGE * solid_npages)) {
+      WARN("Trying to free a solid that wasn't created by solid_create.");
+      return;
+   }
+
+   src->update = NULL;
+   solid_unused[ solid_nunused++ ] = src;
+}
+
+
+/**
+ * @brief Releases the solid storage.
+ *
+ * All solids created with solid_create must have been freed already.
+ */
+void solid_exit (void)
+{
+   int i;
+
+   if (solid_nunused != SOLID_PAGE * solid_npages)
+      WARN("Releasing solid storage with %d solids still in use.",
+            SOLID_PAGE * solid_npages - solid_nunused);
+
+   for (i=0; i<solid_npages; i++)
+      free( solid_pages[i] );
+   free( solid_pages );
+   free( solid_unused );
+   free( solid_saved );
+   solid_saved    = NULL;
+   solid_nsaved   = 0;
+   solid_pages    = NULL;
+   solid_npages   = 0;
+   solid_unused   = NULL;
+   solid_nunused  = 0;
+   solid_munused  = 0;
 }
 
+
+/**
+ * @brief Remembers where all the solids are at the start of a tick.
+ */
+void solid_snapshot (void)
+{
+   int i, j;
+   Solid *page;
+
+   for (i=0; i<solid_npages; i++) {
+      page = solid_pages[i];
+      for (j=0; j<SOLID_PAGE; j++)
+         if (page[j].update != NULL)
+            page[j].pos_prev = page[j].pos;
+   }
+}
+
+
+/**
+ * @brief Moves all the solids between their last two ticks for rendering.
+ *
+ * Must be followed by solid_interpolateEnd() before the next update.
+ *
+ *    @param alpha How far into the current tick to render, from 0 to 1.
+ */
+void solid_interpolate( double alpha )
+{
+   int i, j, n;
+   Solid *s;
+
+   n = SOLID_PAGE * solid_npages;
+   if (solid_nsaved < n) {
+      solid_saved  = realloc( solid_saved, n * sizeof(Vector2d) );
+      solid_nsaved = n;
+   }
+
+   alpha = CLAMP( 0., 1., alpha );
+   for (i=0; i<solid_npages; i++) {
+      for (j=0; j<SOLID_PAGE; j++) {
+         s = &solid_pages[i][j];
+         solid_saved[ i*SOLID_PAGE + j ] = s->pos;
+         if ((s->update == NULL) ||
+               (vect_dist2( &s->pos, &s->pos_prev ) > pow2(SOLID_LERP_MAX)))
+            continue;
+         s->pos.x = s->pos_prev.x + alpha * (s->pos.x - s->pos_prev.x);
+         s->pos.y = s->pos_prev.y + alpha * (s->pos.y - s->pos_prev.y);
+      }
+   }
+}
+
+
+/**
+ * @brief Puts the solids back where the simulation has them.
+ */
+void solid_interpolateEnd (void)
+{
+   int i, j, n;
+
+   n = MIN( solid_npages, solid_nsaved / SOLID_PAGE );
+   for (i=0; i<n; i++)
+      for (j=0; j<SOLID_PAGE; j++)
+         solid_pages[i][j].pos = solid_saved[ i*SOLID_PAGE + j ];
+}
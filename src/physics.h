@@ -13,8 +13,8 @@
 
 #define VX(v)     ((v).x) /**< Gets the X component of a vector. */
 #define VY(v)     ((v).y) /**< Gets the Y component of a vector. */
-#define VMOD(v)   ((v).mod) /**< Gets the modulus of a vector. */
-#define VANGLE(v) ((v).angle) /**< Gets the angle of a vector. */
+#define VMOD(v)   (vect_mod(&(v))) /**< Gets the modulus of a vector. */
+#define VANGLE(v) (vect_ang(&(v))) /**< Gets the angle of a vector. */
 
 #define MOD(x,y)  (sqrt((x)*(x)+(y)*(y))) /**< Gets the modulus of a vector by cartesian coordinates. */
 #define ANGLE(x,y) (atan2(y,x)) /**< Gets the angle of two cartesian coordinates. */
@@ -33,15 +33,36 @@
 
 /**
  * @brief Represents a 2d vector.
+ *
+ * Only the cartesian coordinates are stored, the modulus and angle are
+ *  computed when read with VMOD() and VANGLE(). Most vectors are written
+ *  far more often than their polar form is read, so the integrators and
+ *  everything setting them don't pay for a sqrt and an atan2 each time.
  */
 typedef struct Vector2d_ {
    double x; /**< X cartesian position of the vector. */
    double y; /**< Y cartesian position of the vector. */
-   double mod; /**< Modulus of the vector. */
-   double angle; /**< Angle of the vector. */
 } Vector2d; /**< 2 dimensional vector. */
 
 
+/**
+ * @brief Gets the modulus of a vector, use VMOD().
+ */
+__inline__ static double vect_mod( const Vector2d *v )
+{
+   return MOD( v->x, v->y );
+}
+
+
+/**
+ * @brief Gets the angle of a vector, use VANGLE().
+ */
+__inline__ static double vect_ang( const Vector2d *v )
+{
+   return ANGLE( v->x, v->y );
+}
+
+
 /*
  * misc
  */
@@ -52,7 +73,7 @@ double angle_diff( const double ref, double a );
  * vector manipulation
  */
 void vect_cset( Vector2d* v, const double x, const double y );
-void vect_csetmin( Vector2d* v, const double x, const double y ); /* does not set mod nor angle */
+void vect_csetmin( Vector2d* v, const double x, const double y ); /* same as vect_cset */
 void vect_pset( Vector2d* v, const double mod, const double angle );
 void vectnull( Vector2d* v );
 double vect_angle( const Vector2d* ref, const Vector2d* v );
@@ -73,6 +94,7 @@ typedef struct Solid_ {
    double dir_vel; /**< Velocity at which solid is rotating in rad/s. */
    Vector2d vel; /**< Velocity of the solid. */
    Vector2d pos; /**< Position of the solid. */
+   Vector2d pos_prev; /**< Position at the start of the last tick. */
    double thrust; /**< Relative X force, basically simplified for our thrust model. */
    double speed_max; /**< Maximum speed. */
    void (*update)( struct Solid_*, const double ); /**< Update method. */
@@ -88,6 +110,14 @@ void solid_init( Solid* dest, const double mass, const double dir,
 Solid* solid_create( const double mass, const double dir,
       const Vector2d* pos, const Vector2d* vel, int update );
 void solid_free( Solid* src );
+void solid_exit (void);
+
+/*
+ * Interpolated rendering.
+ */
+void solid_snapshot (void);
+void solid_interpolate( double alpha );
+void solid_interpolateEnd (void);
 
 
 #endif /* PHYSICS_H */
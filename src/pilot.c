@@ -44,14 +44,41 @@
 #include "camera.h"
 #include "damagetype.h"
 #include "pause.h"
+#include "threadpool.h"
+#include "array.h"
 
 
 #define PILOT_CHUNK_MIN 128 /**< Minimum chunks to increment pilot_stack by */
 #define PILOT_CHUNK_MAX 2048 /**< Maximum chunks to increment pilot_stack by */
 #define CHUNK_SIZE      32 /**< Size to allocate memory by. */
 
-/* ID Generators. */
-static unsigned int pilot_id = PLAYER_ID; /**< Stack of pilot ids to assure uniqueness */
+/*
+ * Pilot IDs are handles into a slot table, the low bits are the slot and the
+ *  high bits its generation. Freeing a pilot bumps the generation of its slot
+ *  so IDs still around resolve to NULL, and slots are reused oldest first to
+ *  make a generation wrap around take as long as possible. The player keeps
+ *  PLAYER_ID and pilots outside of the stack get IDs of generation 0, neither
+ *  has a slot.
+ */
+#define PILOT_SLOT_BITS    14 /**< Bits of a pilot ID that are its slot. */
+#define PILOT_SLOT_MAX     (1<<PILOT_SLOT_BITS) /**< Maximum pilots in the stack. */
+#define PILOT_SLOT_MASK    (PILOT_SLOT_MAX-1) /**< Slot of a pilot ID. */
+#define PILOT_GEN_MASK     ((1U<<(32-PILOT_SLOT_BITS))-1) /**< Generations before wrapping around. */
+#define PILOT_ID(s,g)      (((unsigned int)(g)<<PILOT_SLOT_BITS) | (unsigned int)(s)) /**< Makes a pilot ID. */
+
+/**
+ * @brief Slot of the pilot handle table.
+ */
+typedef struct PilotSlot_ {
+   Pilot *p; /**< Pilot in the slot, NULL if free. */
+   unsigned int gen; /**< Current generation, never 0. */
+   int pos; /**< Position of the pilot in pilot_stack. */
+   int next; /**< Next free slot, -1 if last. */
+} PilotSlot;
+static PilotSlot *pilot_slots = NULL; /**< Pilot handle table. */
+static int pilot_slotHead     = -1; /**< Oldest free slot. */
+static int pilot_slotTail     = -1; /**< Newest free slot. */
+static unsigned int pilot_id  = PLAYER_ID; /**< Counter for the IDs of pilots outside of the stack. */
 
 
 /* stack of pilot_nstack */
@@ -60,6 +87,46 @@ int pilot_nstack = 0; /**< same */
 static int pilot_mstack = 0; /**< Memory allocated for pilot_stack. */
 
 
+/* freed pilots kept around for reuse, so spawning doesn't fragment the heap */
+#define PILOT_POOL_MAX  128 /**< Maximum freed pilots kept for reuse. */
+static Pilot* pilot_pool[PILOT_POOL_MAX]; /**< Freed pilots. */
+static int pilot_npool = 0; /**< Number of freed pilots kept. */
+
+
+/* deferred integration */
+#define PILOT_INTEGRATE_GRAIN 16 /**< Minimum pilots integrated per job. */
+static int pilot_deferIntegrate = 0; /**< Whether pilot_update defers solid integration. */
+static Pilot** pilot_integrate = NULL; /**< Pilots waiting for integration. */
+static int pilot_nintegrate = 0; /**< Number of pilots waiting for integration. */
+static int pilot_mintegrate = 0; /**< Memory allocated for pilot_integrate. */
+static double pilot_integrateDt = 0.; /**< Delta tick of the pending integration. */
+
+
+/* rendering */
+#define PILOT_LOD_PIXELS   12. /**< Below this on screen size engine glow isn't drawn. */
+
+
+/* ship templates */
+/**
+ * @brief Outfit slots of a ship with its default outfits, shared by new pilots.
+ */
+typedef struct PilotSlotTemplate_ {
+   PilotOutfitSlot *slots; /**< Slots in global order, NULL if not built. */
+   int ncannons;     /**< Number of cannons in the default outfits. */
+   int nturrets;     /**< Number of turrets in the default outfits. */
+   int nbeams;       /**< Number of beams in the default outfits. */
+   int njammers;     /**< Number of jammers in the default outfits. */
+   int nafterburners; /**< Number of afterburners in the default outfits. */
+} PilotSlotTemplate;
+static PilotSlotTemplate *pilot_templates = NULL; /**< Templates indexed by ship. */
+static int pilot_ntemplates = 0; /**< Number of ships pilot_templates covers. */
+
+
+/* distress */
+#define PILOT_DISTRESS_COALESCE  1. /**< Window in which repeated distress calls aren't propagated. */
+static unsigned int *pilot_distressIds = NULL; /**< Pilots reached by the current distress call. */
+
+
 /* misc */
 static double pilot_commTimeout  = 15.; /**< Time for text above pilot to time out. */
 static double pilot_commFade     = 5.; /**< Time for text above pilot to fade out. */
@@ -72,13 +139,27 @@ static double pilot_commFade     = 5.; /**< Time for text above pilot to fade ou
 /* Update. */
 static void pilot_hyperspace( Pilot* pilot, double dt );
 static void pilot_refuel( Pilot *p, double dt );
+static void pilot_integrateRange( int start, int end, void *data );
+/* Creation. */
+static void pilot_fillSlots( Pilot *p, Ship *ship );
+static const PilotSlotTemplate* pilot_slotTemplate( Ship *ship );
 /* Clean up. */
 static void pilot_dead( Pilot* p, unsigned int killer );
 /* Targetting. */
 static int pilot_validEnemy( const Pilot* p, const Pilot* target );
+static double pilot_costEnemy( const Pilot *t, double d2, void *data );
+static double pilot_costEnemySize( const Pilot *t, double d2, void *data );
+static double pilot_costEnemyHeuristic( const Pilot *t, double d2, void *data );
+static double pilot_costNearest( const Pilot *t, double d2, void *data );
 /* Misc. */
 static void pilot_setCommMsg( Pilot *p, const char *s );
 static int pilot_getStackPos( const unsigned int id );
+static int pilot_getSlot( const unsigned int id );
+static unsigned int pilot_slotAdd( Pilot *p, int pos );
+static void pilot_slotRelease( Pilot *p );
+static Pilot* pilot_alloc (void);
+static void pilot_release( Pilot *p );
+static void pilot_allocOutfits( Pilot *p, int nstructure, int nutility, int nweapon );
 
 
 /**
@@ -92,10 +173,160 @@ Pilot** pilot_getAll( int *n )
 
 
 /**
- * @brief Compare id (for use with bsearch)
+ * @brief Gets the memory used by the pilots.
+ *
+ * Counts the pilots with their solids, slots and cargo, plus the freed pilots
+ *  kept for reuse, but not the data they share such as ships and outfits.
+ *
+ *    @param[out] n Number of pilots.
+ *    @return Bytes used.
+ */
+size_t pilot_memUsage( int *n )
+{
+   int i;
+   size_t size;
+   const Pilot *p;
+
+   size = (pilot_mstack + pilot_npool) * sizeof(Pilot*) +
+         pilot_npool * sizeof(Pilot);
+   for (i=0; i<pilot_nstack; i++) {
+      p     = pilot_stack[i];
+      size += sizeof(Pilot) + sizeof(Solid) +
+            p->noutfits * (sizeof(PilotOutfitSlot) + sizeof(PilotOutfitSlot*)) +
+            p->ncommodities * sizeof(PilotCommodity);
+   }
+   *n = pilot_nstack;
+   return size;
+}
+
+
+/**
+ * @brief Gets the slot of a pilot ID.
+ *
+ *    @param id ID of the pilot to get.
+ *    @return Slot of the pilot or -1 if stale or not in the stack.
  */
-static int compid(const void *id, const void *p) {
-    return *((const unsigned int*)id) - (*((Pilot**)p))->id;
+static int pilot_getSlot( const unsigned int id )
+{
+   int s;
+
+   s = id & PILOT_SLOT_MASK;
+   if ((pilot_slots == NULL) || (s >= array_size(pilot_slots)))
+      return -1;
+   if ((pilot_slots[s].p == NULL) ||
+         (pilot_slots[s].gen != (id >> PILOT_SLOT_BITS)))
+      return -1;
+   return s;
+}
+
+
+/**
+ * @brief Gets a slot for a pilot that was just put in the stack.
+ *
+ *    @param p Pilot to get a slot for.
+ *    @param pos Position of the pilot in pilot_stack.
+ *    @return ID of the pilot, 0 if out of slots.
+ */
+static unsigned int pilot_slotAdd( Pilot *p, int pos )
+{
+   int s;
+   PilotSlot *slot;
+
+   if (pilot_slots == NULL)
+      pilot_slots = array_create( PilotSlot );
+
+   /* Reuse the oldest free slot, slot 0 is never used. */
+   if (pilot_slotHead >= 0) {
+      s = pilot_slotHead;
+      pilot_slotHead = pilot_slots[s].next;
+      if (pilot_slotHead < 0)
+         pilot_slotTail = -1;
+   }
+   else {
+      if (array_size(pilot_slots) == 0) {
+         slot = &array_grow( &pilot_slots );
+         memset( slot, 0, sizeof(PilotSlot) );
+      }
+      if (array_size(pilot_slots) >= PILOT_SLOT_MAX) {
+         WARN("Pilot stack is full with %d pilots.", pilot_nstack);
+         return 0;
+      }
+      s = array_size(pilot_slots);
+      slot = &array_grow( &pilot_slots );
+      slot->gen = 1;
+   }
+
+   slot       = &pilot_slots[s];
+   slot->p    = p;
+   slot->pos  = pos;
+   slot->next = -1;
+   pilot_ewInvalidate();
+   return PILOT_ID( s, slot->gen );
+}
+
+
+/**
+ * @brief Frees the slot of a pilot so its ID goes stale.
+ *
+ *    @param p Pilot to free the slot of, nothing happens if it has none.
+ */
+static void pilot_slotRelease( Pilot *p )
+{
+   int s;
+   PilotSlot *slot;
+
+   s = pilot_getSlot( p->id );
+   if ((s < 0) || (pilot_slots[s].p != p))
+      return;
+
+   slot       = &pilot_slots[s];
+   slot->p    = NULL;
+   slot->gen  = (slot->gen + 1) & PILOT_GEN_MASK;
+   if (slot->gen == 0)
+      slot->gen = 1;
+   slot->next = -1;
+   if (pilot_slotTail >= 0)
+      pilot_slots[ pilot_slotTail ].next = s;
+   else
+      pilot_slotHead = s;
+   pilot_slotTail = s;
+   pilot_ewInvalidate();
+}
+
+
+/**
+ * @brief Gets a small index of a pilot for tables of pilot pairs.
+ *
+ * Indices are the slots, the player is always 0. They only stay the same
+ *  until pilots are added or removed.
+ *
+ *    @param p Pilot to get the index of.
+ *    @return Index below pilot_indexMax() or -1 if it has none.
+ */
+int pilot_index( const Pilot *p )
+{
+   int s;
+
+   if (p->id == PLAYER_ID)
+      return (p == player.p) ? 0 : -1;
+
+   s = pilot_getSlot( p->id );
+   if ((s < 0) || (pilot_slots[s].p != p))
+      return -1;
+   return s;
+}
+
+
+/**
+ * @brief Gets the bound of the pilot indices.
+ *
+ *    @return Every pilot_index() is below this.
+ */
+int pilot_indexMax (void)
+{
+   if (pilot_slots == NULL)
+      return 1;
+   return MAX( 1, array_size(pilot_slots) );
 }
 
 
@@ -107,12 +338,18 @@ static int compid(const void *id, const void *p) {
  */
 static int pilot_getStackPos( const unsigned int id )
 {
-   /* binary search */
-   Pilot **pp = bsearch(&id, pilot_stack, pilot_nstack, sizeof(Pilot*), compid);
-   if (pp == NULL)
+   int i, s;
+
+   /* Player has no slot, but is normally first. */
+   if (id == PLAYER_ID) {
+      for (i=0; i<pilot_nstack; i++)
+         if (pilot_stack[i]->id == PLAYER_ID)
+            return i;
       return -1;
-   else
-      return pp - pilot_stack;
+   }
+
+   s = pilot_getSlot( id );
+   return (s < 0) ? -1 : pilot_slots[s].pos;
 }
 
 
@@ -231,13 +468,8 @@ unsigned int pilot_getPrevID( const unsigned int id, int mode )
  */
 int pilot_validTarget( const Pilot* p, const Pilot* target )
 {
-   /* Must not be dead. */
-   if (pilot_isFlag( target, PILOT_DELETE ) ||
-         pilot_isFlag( target, PILOT_DEAD))
-      return 0;
-
-   /* Must not be invisible. */
-   if (pilot_isFlag( target, PILOT_INVISIBLE ))
+   /* Must not be dead nor invisible. */
+   if (pilot_isFlagAny( target, PILOT_FLAGS_NOTARGET ))
       return 0;
 
    /* Must be in range. */
@@ -289,25 +521,68 @@ static int pilot_validEnemy( const Pilot* p, const Pilot* target )
  */
 unsigned int pilot_getNearestEnemy( const Pilot* p )
 {
-   unsigned int tp;
-   int i;
-   double d, td;
+   Pilot *t;
 
-   tp = 0;
-   d  = 0.;
-   for (i=0; i<pilot_nstack; i++) {
+   t = pilot_gridNearest( p->solid->pos.x, p->solid->pos.y, 1.,
+         pilot_costEnemy, (void*)p, NULL );
+   return (t != NULL) ? t->id : 0;
+}
 
-      if (!pilot_validEnemy( p, pilot_stack[i] ))
-         continue;
 
-      /* Check distance. */
-      td = vect_dist2(&pilot_stack[i]->solid->pos, &p->solid->pos);
-      if (!tp || (td < d)) {
-         d  = td;
-         tp = pilot_stack[i]->id;
-      }
-   }
-   return tp;
+/**
+ * @brief Parameters of the nearest enemy searches.
+ */
+typedef struct PilotEnemySearch_ {
+   const Pilot *p; /**< Pilot searching. */
+   double mass_LB; /**< Lower bound for target mass. */
+   double mass_UB; /**< Upper bound for target mass. */
+   double mass_factor; /**< Heuristic parameter for target mass. */
+   double health_factor; /**< Heuristic parameter for target health. */
+   double damage_factor; /**< Heuristic parameter for target dps. */
+   double range_factor; /**< Heuristic weighting for range. */
+   int disabled; /**< Whether to accept disabled pilots. */
+} PilotEnemySearch;
+
+
+/**
+ * @brief Cost of a target for pilot_getNearestEnemy.
+ */
+static double pilot_costEnemy( const Pilot *t, double d2, void *data )
+{
+   if (!pilot_validEnemy( (const Pilot*) data, t ))
+      return -1.;
+   return d2;
+}
+
+
+/**
+ * @brief Cost of a target for pilot_getNearestEnemy_size.
+ */
+static double pilot_costEnemySize( const Pilot *t, double d2, void *data )
+{
+   PilotEnemySearch *s = (PilotEnemySearch*) data;
+
+   if (!pilot_validEnemy( s->p, t ))
+      return -1.;
+   if ((t->solid->mass < s->mass_LB) || (t->solid->mass > s->mass_UB))
+      return -1.;
+   return d2;
+}
+
+
+/**
+ * @brief Cost of a target for pilot_getNearestEnemy_heuristic.
+ */
+static double pilot_costEnemyHeuristic( const Pilot *t, double d2, void *data )
+{
+   PilotEnemySearch *s = (PilotEnemySearch*) data;
+
+   if (!pilot_validEnemy( s->p, t ))
+      return -1.;
+   return s->range_factor * d2
+         + fabs( pilot_relsize( s->p, t ) - s->mass_factor)
+         + fabs( pilot_relhp(   s->p, t ) - s->health_factor)
+         + fabs( pilot_reldps(  s->p, t ) - s->damage_factor);
 }
 
 /**
@@ -320,29 +595,15 @@ unsigned int pilot_getNearestEnemy( const Pilot* p )
  */
 unsigned int pilot_getNearestEnemy_size( const Pilot* p, double target_mass_LB, double target_mass_UB)
 {
-   unsigned int tp;
-   int i;
-   double d, td;
-
-   tp = 0;
-   d  = 0.;
-   for (i=0; i<pilot_nstack; i++) {
-
-      if (!pilot_validEnemy( p, pilot_stack[i] ))
-         continue;
-
-      if (pilot_stack[i]->solid->mass < target_mass_LB || pilot_stack[i]->solid->mass > target_mass_UB)
-         continue;
-
-      /* Check distance. */
-      td = vect_dist2(&pilot_stack[i]->solid->pos, &p->solid->pos);
-      if (!tp || (td < d)) {
-         d = td;
-         tp = pilot_stack[i]->id;
-      }
-   }
+   PilotEnemySearch s;
+   Pilot *t;
 
-   return tp;
+   s.p       = p;
+   s.mass_LB = target_mass_LB;
+   s.mass_UB = target_mass_UB;
+   t = pilot_gridNearest( p->solid->pos.x, p->solid->pos.y, 1.,
+         pilot_costEnemySize, &s, NULL );
+   return (t != NULL) ? t->id : 0;
 }
 
 /**
@@ -359,34 +620,18 @@ unsigned int pilot_getNearestEnemy_heuristic( const Pilot* p,
       double mass_factor, double health_factor,
       double damage_factor, double range_factor )
 {
-   unsigned int tp;
-   int i;
-   double temp, current_heuristic_value;
-   Pilot *target;
-
-   current_heuristic_value = 10000.;
-
-   tp = 0;
-   for (i=0; i<pilot_nstack; i++) {
-      target = pilot_stack[i];
-
-      if (!pilot_validEnemy( p, target ))
-         continue;
-
-      /* Check distance. */
-      temp = range_factor *
-               vect_dist2( &target->solid->pos, &p->solid->pos )
-            + fabs( pilot_relsize( p, target ) - mass_factor)
-            + fabs( pilot_relhp(   p, target ) - health_factor)
-            + fabs( pilot_reldps(  p, target ) - damage_factor);
-
-      if ((tp == 0) || (temp < current_heuristic_value)) {
-         current_heuristic_value = temp;
-         tp = target->id;
-      }
-   }
+   PilotEnemySearch s;
+   Pilot *t;
 
-   return tp;
+   s.p             = p;
+   s.mass_factor   = mass_factor;
+   s.health_factor = health_factor;
+   s.damage_factor = damage_factor;
+   s.range_factor  = range_factor;
+   /* The other terms are never negative, so range bounds the cost. */
+   t = pilot_gridNearest( p->solid->pos.x, p->solid->pos.y,
+         MAX( 0., range_factor ), pilot_costEnemyHeuristic, &s, NULL );
+   return (t != NULL) ? t->id : 0;
 }
 
 /**
@@ -482,38 +727,49 @@ unsigned int pilot_getBoss( const Pilot* p )
  */
 double pilot_getNearestPos( const Pilot *p, unsigned int *tp, double x, double y, int disabled )
 {
-   int i;
-   double d, td;
+   PilotEnemySearch s;
+   Pilot *t;
+   double d;
 
-   *tp = PLAYER_ID;
-   d  = 0;
-   for (i=0; i<pilot_nstack; i++) {
+   s.p        = p;
+   s.disabled = disabled;
+   t = pilot_gridNearest( x, y, 1., pilot_costNearest, &s, &d );
+   if (t == NULL) {
+      *tp = PLAYER_ID;
+      return 0.;
+   }
+   *tp = t->id;
+   return d;
+}
 
-      /* Must not be self. */
-      if (pilot_stack[i] == p)
-         continue;
 
-      /* Player doesn't select escorts (unless disabled is active). */
-      if (!disabled && (p->faction == FACTION_PLAYER) &&
-            (pilot_stack[i]->faction == FACTION_PLAYER))
-         continue;
+/**
+ * @brief Cost of a target for pilot_getNearestPos.
+ */
+static double pilot_costNearest( const Pilot *t, double d2, void *data )
+{
+   PilotEnemySearch *s = (PilotEnemySearch*) data;
+   const Pilot *p      = s->p;
+   int disabled        = s->disabled;
 
-      /* Shouldn't be disabled. */
-      if (!disabled && pilot_isDisabled(pilot_stack[i]))
-         continue;
+   /* Must not be self. */
+   if (t == p)
+      return -1.;
 
-      /* Must be a valid target. */
-      if (!pilot_validTarget( p, pilot_stack[i] ))
-         continue;
+   /* Player doesn't select escorts (unless disabled is active). */
+   if (!disabled && (p->faction == FACTION_PLAYER) &&
+         (t->faction == FACTION_PLAYER))
+      return -1.;
 
-      /* Minimum distance. */
-      td = pow2(x-pilot_stack[i]->solid->pos.x) + pow2(y-pilot_stack[i]->solid->pos.y);
-      if (((*tp==PLAYER_ID) || (td < d))) {
-         d = td;
-         *tp = pilot_stack[i]->id;
-      }
-   }
-   return d;
+   /* Shouldn't be disabled. */
+   if (!disabled && pilot_isDisabled(t))
+      return -1.;
+
+   /* Must be a valid target. */
+   if (!pilot_validTarget( p, t ))
+      return -1.;
+
+   return d2;
 }
 
 
@@ -575,26 +831,25 @@ double pilot_getNearestAng( const Pilot *p, unsigned int *tp, double ang, int di
 /**
  * @brief Pulls a pilot out of the pilot_stack based on ID.
  *
- * It's a binary search ( O(logn) ) therefore it's pretty fast and can be
- *  abused all the time.  Maximum iterations is 32 on a platform with 32 bit
- *  unsigned ints.
+ * It's a lookup in the slot table so it can be abused all the time, IDs of
+ *  pilots that are gone are NULL even if their slot got reused.
  *
  *    @param id ID of the pilot to get.
  *    @return The actual pilot who has matching ID or NULL if not found.
  */
 Pilot* pilot_get( const unsigned int id )
 {
-   int m;
+   int s;
 
    if (id==PLAYER_ID)
       return player.p; /* special case player.p */
 
-   m = pilot_getStackPos(id);
+   s = pilot_getSlot(id);
 
-   if ((m==-1) || (pilot_isFlag(pilot_stack[m], PILOT_DELETE)))
+   if ((s==-1) || (pilot_isFlag(pilot_slots[s].p, PILOT_DELETE)))
       return NULL;
    else
-      return pilot_stack[m];
+      return pilot_slots[s].p;
 }
 
 
@@ -1059,8 +1314,9 @@ void pilot_broadcast( Pilot *p, const char *msg, int ignore_int )
  */
 void pilot_distress( Pilot *p, Pilot *attacker, const char *msg, int ignore_int )
 {
-   int i, r;
-   double d;
+   int i, n, r;
+   double d, reach, hide;
+   Pilot **list, *t;
 
    /* Broadcast the message. */
    if (msg[0] != '\0')
@@ -1088,33 +1344,76 @@ void pilot_distress( Pilot *p, Pilot *attacker, const char *msg, int ignore_int
       }
    }
 
+   /*
+    * Repeated calls about the same attacker don't need to reach everyone
+    * again, they already reacted to the first one.
+    */
+   if (ignore_int || ((p->distress_timer > 0.) &&
+            (p->distress_attacker == ((attacker != NULL) ? attacker->id : 0))))
+      n = 0;
+   else {
+      p->distress_timer    = PILOT_DISTRESS_COALESCE;
+      p->distress_attacker = (attacker != NULL) ? attacker->id : 0;
+
+      /*
+       * Pilots can only hear it within sensor range or when they would detect
+       * the victim, the least hidden pilot bounds how far that can be.
+       */
+      reach = pilot_sensorRange();
+      hide  = pilot_gridMinHide();
+      if (hide > 0.)
+         reach = MAX( reach, pilot_sensorRange() * p->ew_detect / hide );
+      else
+         reach = HUGE_VAL;
+      if (reach < HUGE_VAL)
+         n = pilot_gridQueryRadius( p->solid->pos.x, p->solid->pos.y,
+               sqrt(reach), -1, &list );
+      else {
+         list = pilot_stack;
+         n    = pilot_nstack;
+      }
+
+      /* AI can query the grid, so keep the ids. */
+      if (pilot_distressIds == NULL)
+         pilot_distressIds = array_create( unsigned int );
+      array_resize( &pilot_distressIds, 0 );
+      for (i=0; i<n; i++)
+         array_push_back( &pilot_distressIds, list[i]->id );
+      /* Escorts always know what their leader is up to. */
+      for (i=0; i<p->nescorts; i++) {
+         t = pilot_get( p->escorts[i].id );
+         if ((t != NULL) && (vect_dist2( &p->solid->pos, &t->solid->pos ) > reach))
+            array_push_back( &pilot_distressIds, t->id );
+      }
+      n = array_size( pilot_distressIds );
+   }
+
    /* Now we must check to see if a pilot is in range. */
-   for (i=0; i<pilot_nstack; i++) {
+   for (i=0; i<n; i++) {
+      t = pilot_get( pilot_distressIds[i] );
+
       /* Skip if unsuitable. */
-      if ((pilot_stack[i]->ai == NULL) || (pilot_stack[i]->id == p->id) ||
-            (pilot_isFlag(pilot_stack[i], PILOT_DEAD)) ||
-            (pilot_isFlag(pilot_stack[i], PILOT_DELETE)))
+      if ((t == NULL) || (t->ai == NULL) || (t->id == p->id) ||
+            pilot_isFlagAny(t, PILOT_FLAGS_GONE))
          continue;
 
-      if (!ignore_int) {
-         if (!pilot_inRangePilot(p, pilot_stack[i])) {
-            /*
-             * If the pilots are within sensor range of each other, send the
-             * distress signal, regardless of electronic warfare hide values.
-             */
-            d = vect_dist2( &p->solid->pos, &pilot_stack[i]->solid->pos );
-            if (d > pilot_sensorRange())
-               continue;
-         }
+      if (!pilot_inRangePilot(p, t)) {
+         /*
+          * If the pilots are within sensor range of each other, send the
+          * distress signal, regardless of electronic warfare hide values.
+          */
+         d = vect_dist2( &p->solid->pos, &t->solid->pos );
+         if (d > pilot_sensorRange())
+            continue;
+      }
 
-         /* Send AI the distress signal. */
-         ai_getDistress( pilot_stack[i], p, attacker );
+      /* Send AI the distress signal. */
+      ai_getDistress( t, p, attacker );
 
-         /* Check if should take faction hit. */
-         if ((attacker == player.p) && !pilot_isFlag(p, PILOT_DISTRESSED) &&
-               !areEnemies(p->faction, pilot_stack[i]->faction))
-            r = 1;
-      }
+      /* Check if should take faction hit. */
+      if ((attacker == player.p) && !pilot_isFlag(p, PILOT_DISTRESSED) &&
+            !areEnemies(p->faction, t->faction))
+         r = 1;
    }
 
    /* Player only gets one faction hit per pilot. */
@@ -1122,7 +1421,7 @@ void pilot_distress( Pilot *p, Pilot *attacker, const char *msg, int ignore_int
 
       /* Modify faction, about 1 for a llama, 4.2 for a hawking */
       if ((attacker != NULL) && (attacker->faction == FACTION_PLAYER) && r)
-         faction_modPlayer( p->faction, -(pow(p->base_mass, 0.2) - 1.), "distress" );
+         faction_modPlayerQueue( p->faction, -(pow(p->base_mass, 0.2) - 1.), "distress" );
 
       /* Set flag to avoid a second faction hit. */
       pilot_setFlag(p, PILOT_DISTRESSED);
@@ -1254,7 +1553,7 @@ double pilot_hit( Pilot* p, const Solid* w, const unsigned int shooter,
    /* Calculate the damage. */
    absorb         = 1. - CLAMP( 0., 1., p->dmg_absorb - dmg->penetration );
    disable        = dmg->disable;
-   dtype_calcDamage( &damage_shield, &damage_armour, absorb, &knockback, dmg, &p->stats );
+   dtype_calcDamageMod( &damage_shield, &damage_armour, absorb, &knockback, dmg, p->dmods );
 
    /*
     * Delay undisable if necessary. Amount varies with damage, as e.g. a
@@ -1363,7 +1662,7 @@ double pilot_hit( Pilot* p, const Solid* w, const unsigned int shooter,
             mod = 2 * (pow(p->base_mass, 0.4) - 1.);
 
             /* Modify faction for him and friends. */
-            faction_modPlayer( p->faction, -mod, "kill" );
+            faction_modPlayerQueue( p->faction, -mod, "kill" );
          }
       }
    }
@@ -1526,55 +1825,53 @@ static void pilot_dead( Pilot* p, unsigned int killer )
 
 
 /**
- * @brief Makes the pilot explosion.
- *    @param x X position of the pilot.
- *    @param y Y position of the pilot.
+ * @brief Applies an explosion to a pilot.
+ *    @param p Pilot that may be hit.
+ *    @param x X position of the explosion.
+ *    @param y Y position of the explosion.
  *    @param radius Radius of the explosion.
  *    @param dmg Damage of the explosion.
- *    @param parent The exploding pilot.
+ *    @param parent ID of the exploding pilot, 0 is none.
+ *    @return 1 if the pilot was hit.
  */
-void pilot_explode( double x, double y, double radius, const Damage *dmg, const Pilot *parent )
+int pilot_explodeHit( Pilot *p, double x, double y, double radius,
+      const Damage *dmg, unsigned int parent )
 {
-   int i;
    double rx, ry;
    double dist, rad2;
-   Pilot *p;
    Solid s; /* Only need to manipulate mass and vel. */
    Damage ddmg;
 
    rad2 = radius*radius;
-   ddmg = *dmg;
 
-   for (i=0; i<pilot_nstack; i++) {
-      p = pilot_stack[i];
+   /* Calculate a bit. */
+   rx = p->solid->pos.x - x;
+   ry = p->solid->pos.y - y;
+   dist = pow2(rx) + pow2(ry);
+   /* Take into account ship size. */
+   dist -= pow2(p->ship->gfx_space->sw);
+   dist = MAX(0,dist);
 
-      /* Calculate a bit. */
-      rx = p->solid->pos.x - x;
-      ry = p->solid->pos.y - y;
-      dist = pow2(rx) + pow2(ry);
-      /* Take into account ship size. */
-      dist -= pow2(p->ship->gfx_space->sw);
-      dist = MAX(0,dist);
-
-      /* Pilot is hit. */
-      if (dist < rad2) {
+   /* Pilot isn't hit. */
+   if (dist >= rad2)
+      return 0;
 
-         /* Adjust damage based on distance. */
-         ddmg.damage = dmg->damage * (1. - sqrt(dist / rad2));
+   /* Adjust damage based on distance. */
+   ddmg = *dmg;
+   ddmg.damage = dmg->damage * (1. - sqrt(dist / rad2));
 
-         /* Impact settings. */
-         s.mass =  pow2(dmg->damage) / 30.;
-         s.vel.x = rx;
-         s.vel.y = ry;
+   /* Impact settings. */
+   s.mass =  pow2(dmg->damage) / 30.;
+   s.vel.x = rx;
+   s.vel.y = ry;
 
-         /* Actual damage calculations. */
-         pilot_hit( p, &s, (parent!=NULL) ? parent->id : 0, &ddmg, 1 );
+   /* Actual damage calculations. */
+   pilot_hit( p, &s, parent, &ddmg, 1 );
 
-         /* Shock wave from the explosion. */
-         if (p->id == PILOT_PLAYER)
-            spfx_shake( pow2(ddmg.damage) / pow2(100.) * SHAKE_MAX );
-      }
-   }
+   /* Shock wave from the explosion. */
+   if (p->id == PILOT_PLAYER)
+      spfx_shake( pow2(ddmg.damage) / pow2(100.) * SHAKE_MAX );
+   return 1;
 }
 
 
@@ -1588,6 +1885,7 @@ void pilot_render( Pilot* p, const double dt )
 {
    (void) dt;
    double scalew, scaleh;
+   glTexture *glow;
 
    /* Check if needs scaling. */
    if (pilot_isFlag( p, PILOT_LANDING )) {
@@ -1603,8 +1901,15 @@ void pilot_render( Pilot* p, const double dt )
       scaleh = 1.;
    }
 
+   /* Too small to see the engines, plain sprite batches better. */
+   if (MAX( p->ship->gfx_space->sw, p->ship->gfx_space->sh ) * cam_getZoom() <
+         PILOT_LOD_PIXELS)
+      glow = NULL;
+   else
+      glow = p->ship->gfx_engine;
+
    /* Base ship. */
-   gl_blitSpriteInterpolateScale( p->ship->gfx_space, p->ship->gfx_engine,
+   gl_blitSpriteInterpolateScale( p->ship->gfx_space, glow,
          1.-p->engine_glow, p->solid->pos.x, p->solid->pos.y,
          scalew, scaleh,
          p->tsx, p->tsy, NULL );
@@ -1696,7 +2001,6 @@ void pilot_update( Pilot* pilot, const double dt )
    double a, px,py, vx,vy;
    char buf[16];
    PilotOutfitSlot *o;
-   double Q;
    Damage dmg;
    double stress_falloff;
    double efficiency, thrust;
@@ -1717,6 +2021,8 @@ void pilot_update( Pilot* pilot, const double dt )
     */
    pilot->ptimer   -= dt;
    pilot->tcontrol -= dt;
+   if (pilot->distress_timer > 0.)
+      pilot->distress_timer -= dt;
    if (cooling) {
       pilot->ctimer   -= dt;
       if (pilot->ctimer < 0.) {
@@ -1730,9 +2036,8 @@ void pilot_update( Pilot* pilot, const double dt )
    for (i=0; i<MAX_AI_TIMERS; i++)
       if (pilot->timer[i] > 0.)
          pilot->timer[i] -= dt;
-   /* Update heat. */
+   /* Update outfits. */
    a = -1.;
-   Q = 0.;
    nchg = 0; /* Number of outfits that change state, processed at the end. */
    for (i=0; i<pilot->noutfits; i++) {
       o = pilot->outfits[i];
@@ -1762,17 +2067,13 @@ void pilot_update( Pilot* pilot, const double dt )
          }
       }
 
-      /* Handle heat. */
-      if (!cooling)
-         Q  += pilot_heatUpdateSlot( pilot, o, dt );
-
       /* Handle lockons. */
       pilot_lockUpdateSlot( pilot, o, target, &a, dt );
    }
 
    /* Global heat. */
    if (!cooling)
-      pilot_heatUpdateShip( pilot, Q, dt );
+      pilot_heatUpdateShip( pilot, pilot_heatUpdateSlots( pilot, dt ), dt );
    else
       pilot_heatUpdateCooldown( pilot );
 
@@ -2042,12 +2343,43 @@ void pilot_update( Pilot* pilot, const double dt )
          pilot->engine_glow = 0.;
    }
 
+   /* Integration only touches the pilot itself, so pilots_update batches it. */
+   if (pilot_deferIntegrate) {
+      if (pilot_nintegrate >= pilot_mintegrate) {
+         pilot_mintegrate += CHUNK_SIZE;
+         pilot_integrate = realloc( pilot_integrate,
+               pilot_mintegrate * sizeof(Pilot*) );
+      }
+      pilot_integrate[ pilot_nintegrate++ ] = pilot;
+      return;
+   }
+
    /* Update the solid, must be run after limit_speed. */
    pilot->solid->update( pilot->solid, dt );
    gl_getSpriteFromDir( &pilot->tsx, &pilot->tsy,
          pilot->ship->gfx_space, pilot->solid->dir );
 }
 
+
+/**
+ * @brief Integrates a range of the pending pilots.
+ *
+ * Runs on the worker threads, must not touch anything but the pilots.
+ */
+static void pilot_integrateRange( int start, int end, void *data )
+{
+   int i;
+   Pilot *p;
+   (void) data;
+
+   for (i=start; i<end; i++) {
+      p = pilot_integrate[i];
+      p->solid->update( p->solid, pilot_integrateDt );
+      gl_getSpriteFromDir( &p->tsx, &p->tsy,
+            p->ship->gfx_space, p->solid->dir );
+   }
+}
+
 /**
  * @brief Deletes a pilot.
  *
@@ -2364,6 +2696,141 @@ credits_t pilot_modCredits( Pilot *p, credits_t amount )
 }
 
 
+/**
+ * @brief Gets memory for a pilot, reusing a freed one if possible.
+ *
+ *    @return Uninitialized pilot or NULL on error.
+ */
+static Pilot* pilot_alloc (void)
+{
+   if (pilot_npool > 0)
+      return pilot_pool[ --pilot_npool ];
+   return malloc(sizeof(Pilot));
+}
+
+
+/**
+ * @brief Gives back the memory of a freed pilot.
+ *
+ *    @param p Pilot already cleaned up by pilot_free().
+ */
+static void pilot_release( Pilot *p )
+{
+   if (pilot_npool < PILOT_POOL_MAX)
+      pilot_pool[ pilot_npool++ ] = p;
+   else
+      free(p);
+}
+
+
+/**
+ * @brief Allocates the outfit slots of a pilot.
+ *
+ * All the slot types live in a single block starting at outfit_structure,
+ *  followed by the outfits pointer list.
+ *
+ *    @param p Pilot to allocate slots of.
+ *    @param nstructure Number of structure slots.
+ *    @param nutility Number of utility slots.
+ *    @param nweapon Number of weapon slots.
+ */
+static void pilot_allocOutfits( Pilot *p, int nstructure, int nutility, int nweapon )
+{
+   p->noutfits          = nstructure + nutility + nweapon;
+   p->outfit_nstructure = nstructure;
+   p->outfit_nutility   = nutility;
+   p->outfit_nweapon    = nweapon;
+   p->outfit_structure  = calloc( MAX( 1, p->noutfits ),
+         sizeof(PilotOutfitSlot) + sizeof(PilotOutfitSlot*) );
+   p->outfit_utility    = &p->outfit_structure[ nstructure ];
+   p->outfit_weapon     = &p->outfit_utility[ nutility ];
+   p->outfits           = (PilotOutfitSlot**) &p->outfit_structure[ MAX( 1, p->noutfits ) ];
+}
+
+
+/**
+ * @brief Sets up the slots of a pilot with the default outfits of its ship.
+ *
+ *    @param p Pilot with allocated slots.
+ *    @param ship Ship the pilot is flying.
+ */
+static void pilot_fillSlots( Pilot *p, Ship *ship )
+{
+   int i, k;
+
+   k = 0;
+   for (i=0; i<p->outfit_nstructure; i++) {
+      p->outfits[k] = &p->outfit_structure[i];
+      p->outfits[k]->sslot = &ship->outfit_structure[i];
+      if (ship->outfit_structure[i].data != NULL)
+         pilot_addOutfitRaw( p, ship->outfit_structure[i].data, p->outfits[k] );
+      k++;
+   }
+   for (i=0; i<p->outfit_nutility; i++) {
+      p->outfits[k] = &p->outfit_utility[i];
+      p->outfits[k]->sslot = &ship->outfit_utility[i];
+      if (ship->outfit_utility[i].data != NULL)
+         pilot_addOutfitRaw( p, ship->outfit_utility[i].data, p->outfits[k] );
+      k++;
+   }
+   for (i=0; i<p->outfit_nweapon; i++) {
+      p->outfits[k] = &p->outfit_weapon[i];
+      p->outfits[k]->sslot = &ship->outfit_weapon[i];
+      if (ship->outfit_weapon[i].data != NULL)
+         pilot_addOutfitRaw( p, ship->outfit_weapon[i].data, p->outfits[k] );
+      k++;
+   }
+   /* Second pass set ID. */
+   for (i=0; i<p->noutfits; i++)
+      p->outfits[i]->id = i;
+}
+
+
+/**
+ * @brief Gets the slot template of a ship, building it the first time.
+ *
+ * Ships don't change once loaded so the template is never rebuilt, pilots
+ *  get their own copy of it and are free to change it.
+ *
+ *    @param ship Ship to get template of.
+ *    @return The template or NULL if the ship is not in the ship stack.
+ */
+static const PilotSlotTemplate* pilot_slotTemplate( Ship *ship )
+{
+   int i, n;
+   Ship *ships;
+   Pilot *p;
+   PilotSlotTemplate *t;
+
+   ships = ship_getAll( &n );
+   i     = ship - ships;
+   if ((ships == NULL) || (i < 0) || (i >= n))
+      return NULL;
+
+   if (pilot_templates == NULL) {
+      pilot_templates  = calloc( n, sizeof(PilotSlotTemplate) );
+      pilot_ntemplates = n;
+   }
+   t = &pilot_templates[i];
+   if (t->slots != NULL)
+      return t;
+
+   /* Build it on a scratch pilot. */
+   p = calloc( 1, sizeof(Pilot) );
+   pilot_allocOutfits( p, ship->outfit_nstructure,
+         ship->outfit_nutility, ship->outfit_nweapon );
+   pilot_fillSlots( p, ship );
+   t->slots          = p->outfit_structure;
+   t->ncannons       = p->ncannons;
+   t->nturrets       = p->nturrets;
+   t->nbeams         = p->nbeams;
+   t->njammers       = p->njammers;
+   t->nafterburners  = p->nafterburners;
+   free( p );
+   return t;
+}
+
+
 /**
  * @brief Initialize pilot.
  *
@@ -2381,15 +2848,20 @@ void pilot_init( Pilot* pilot, Ship* ship, const char* name, int faction, const
       const double dir, const Vector2d* pos, const Vector2d* vel,
       const PilotFlags flags )
 {
-   int i, p;
+   int i;
+   const PilotSlotTemplate *tmpl;
 
    /* Clear memory. */
    memset(pilot, 0, sizeof(Pilot));
 
    if (pilot_isFlagRaw(flags, PILOT_PLAYER)) /* Set player ID, should probably be fixed to something sane someday. */
       pilot->id = PLAYER_ID;
-   else
-      pilot->id = ++pilot_id; /* new unique pilot id based on pilot_id, can't be 0 */
+   else if (pilot_isFlagRaw(flags, PILOT_EMPTY)) { /* Not in the stack, generation 0 never resolves. */
+      pilot_id = MAX( PLAYER_ID+1, (pilot_id+1) & PILOT_SLOT_MASK );
+      pilot->id = pilot_id;
+   }
+   else /* Was just put at the end of the stack by pilot_create(). */
+      pilot->id = pilot_slotAdd( pilot, pilot_nstack-1 );
 
    /* Defaults. */
    pilot->autoweap = 1;
@@ -2397,6 +2869,7 @@ void pilot_init( Pilot* pilot, Ship* ship, const char* name, int faction, const
    /* Basic information. */
    pilot->ship = ship;
    pilot->name = strdup( (name==NULL) ? ship->name : name );
+   ship_gfxUse( ship );
 
    /* faction */
    pilot->faction = faction;
@@ -2412,43 +2885,23 @@ void pilot_init( Pilot* pilot, Ship* ship, const char* name, int faction, const
    pilot_calcStats(pilot);
    pilot->stress = 0.; /* No stress. */
 
-   /* Allocate outfit memory. */
-   /* Slot types. */
-   pilot->outfit_nstructure = ship->outfit_nstructure;
-   pilot->outfit_structure = calloc( ship->outfit_nstructure, sizeof(PilotOutfitSlot) );
-   pilot->outfit_nutility  = ship->outfit_nutility;
-   pilot->outfit_utility   = calloc( ship->outfit_nutility, sizeof(PilotOutfitSlot) );
-   pilot->outfit_nweapon   = ship->outfit_nweapon;
-   pilot->outfit_weapon    = calloc( ship->outfit_nweapon, sizeof(PilotOutfitSlot) );
-   /* Global. */
-   pilot->noutfits = pilot->outfit_nstructure + pilot->outfit_nutility + pilot->outfit_nweapon;
-   pilot->outfits  = calloc( pilot->noutfits, sizeof(PilotOutfitSlot*) );
-   /* First pass copy data. */
-   p = 0;
-   for (i=0; i<pilot->outfit_nstructure; i++) {
-      pilot->outfits[p] = &pilot->outfit_structure[i];
-      pilot->outfits[p]->sslot = &ship->outfit_structure[i];
-      if (ship->outfit_structure[i].data != NULL)
-         pilot_addOutfitRaw( pilot, ship->outfit_structure[i].data, pilot->outfits[p] );
-      p++;
-   }
-   for (i=0; i<pilot->outfit_nutility; i++) {
-      pilot->outfits[p] = &pilot->outfit_utility[i];
-      pilot->outfits[p]->sslot = &ship->outfit_utility[i];
-      if (ship->outfit_utility[i].data != NULL)
-         pilot_addOutfitRaw( pilot, ship->outfit_utility[i].data, pilot->outfits[p] );
-      p++;
-   }
-   for (i=0; i<pilot->outfit_nweapon; i++) {
-      pilot->outfits[p] = &pilot->outfit_weapon[i];
-      pilot->outfits[p]->sslot = &ship->outfit_weapon[i];
-      if (ship->outfit_weapon[i].data != NULL)
-         pilot_addOutfitRaw( pilot, ship->outfit_weapon[i].data, pilot->outfits[p] );
-      p++;
+   /* Allocate outfit memory and copy the default outfits over. */
+   pilot_allocOutfits( pilot, ship->outfit_nstructure,
+         ship->outfit_nutility, ship->outfit_nweapon );
+   tmpl = pilot_slotTemplate( ship );
+   if (tmpl != NULL) {
+      memcpy( pilot->outfit_structure, tmpl->slots,
+            pilot->noutfits * sizeof(PilotOutfitSlot) );
+      for (i=0; i<pilot->noutfits; i++)
+         pilot->outfits[i] = &pilot->outfit_structure[i];
+      pilot->ncannons      = tmpl->ncannons;
+      pilot->nturrets      = tmpl->nturrets;
+      pilot->nbeams        = tmpl->nbeams;
+      pilot->njammers      = tmpl->njammers;
+      pilot->nafterburners = tmpl->nafterburners;
    }
-   /* Second pass set ID. */
-   for (i=0; i<pilot->noutfits; i++)
-      pilot->outfits[i]->id = i;
+   else
+      pilot_fillSlots( pilot, ship );
 
    /* cargo - must be set before calcStats */
    pilot->cargo_free = pilot->ship->cap_cargo; /* should get redone with calcCargo */
@@ -2534,7 +2987,7 @@ unsigned int pilot_create( Ship* ship, const char* name, int faction, const char
    Pilot *dyn;
 
    /* Allocate pilot memory. */
-   dyn = malloc(sizeof(Pilot));
+   dyn = pilot_alloc();
    if (dyn == NULL) {
       WARN("Unable to allocate memory");
       return 0;
@@ -2552,6 +3005,7 @@ unsigned int pilot_create( Ship* ship, const char* name, int faction, const char
    /* Set the pilot in the stack -- must be there before initializing */
    pilot_stack[pilot_nstack] = dyn;
    pilot_nstack++; /* there's a new pilot */
+   pilot_gridInvalidate();
 
    /* Initialize the pilot. */
    pilot_init( dyn, ship, name, faction, ai, dir, pos, vel, flags );
@@ -2560,6 +3014,73 @@ unsigned int pilot_create( Ship* ship, const char* name, int faction, const char
 }
 
 
+/**
+ * @brief Creates a group of pilots flying the same ship with the same AI.
+ *
+ * The stack only grows once and the AI profile is set up once, the AI of
+ *  the pilots is only created after all of them are in the stack.
+ *
+ *    @param ship Ship the pilots will be flying.
+ *    @param name Pilots' name, if NULL ship's name will be used.
+ *    @param faction Faction of the pilots.
+ *    @param ai Name of the AI profile to use for the pilots.
+ *    @param n Number of pilots to create.
+ *    @param dir Initial direction of each pilot.
+ *    @param pos Initial position of each pilot.
+ *    @param vel Initial velocity of each pilot.
+ *    @param flags Used for tweaking the pilots.
+ *    @param[out] ids Ids of the n pilots created, 0 for failures.
+ *    @return Number of pilots created.
+ *
+ * @sa pilot_create
+ */
+int pilot_createBatch( Ship* ship, const char* name, int faction, const char *ai,
+      int n, const double *dir, const Vector2d* pos, const Vector2d* vel,
+      const PilotFlags flags, unsigned int *ids )
+{
+   int i, m;
+   Pilot **list;
+
+   if (n <= 0)
+      return 0;
+
+   /* Grow the stack once. */
+   if (pilot_nstack+n > pilot_mstack) {
+      if (pilot_mstack == 0)
+         pilot_mstack = PILOT_CHUNK_MIN;
+      while (pilot_nstack+n > pilot_mstack)
+         pilot_mstack += MIN( pilot_mstack, PILOT_CHUNK_MAX );
+      pilot_stack = realloc( pilot_stack, pilot_mstack*sizeof(Pilot*) );
+   }
+   pilot_gridInvalidate();
+
+   /* Set up everything but the AI. */
+   list = malloc( n * sizeof(Pilot*) );
+   m    = 0;
+   for (i=0; i<n; i++) {
+      ids[i] = 0;
+      list[m] = pilot_alloc();
+      if (list[m] == NULL) {
+         WARN("Unable to allocate memory");
+         continue;
+      }
+      pilot_stack[pilot_nstack] = list[m];
+      pilot_nstack++;
+      pilot_init( list[m], ship, name, faction, NULL,
+            dir[i], &pos[i], &vel[i], flags );
+      ids[i] = list[m]->id;
+      m++;
+   }
+
+   /* AI for all at once. */
+   if (ai != NULL)
+      ai_pinitBatch( list, m, ai );
+
+   free( list );
+   return m;
+}
+
+
 /**
  * @brief Creates a pilot without adding it to the stack.
  *
@@ -2574,7 +3095,7 @@ Pilot* pilot_createEmpty( Ship* ship, const char* name,
       int faction, const char *ai, PilotFlags flags )
 {
    Pilot* dyn;
-   dyn = malloc(sizeof(Pilot));
+   dyn = pilot_alloc();
    if (dyn == NULL) {
       WARN("Unable to allocate memory");
       return 0;
@@ -2594,10 +3115,11 @@ Pilot* pilot_createEmpty( Ship* ship, const char* name,
 Pilot* pilot_copy( Pilot* src )
 {
    int i, p;
-   Pilot *dest = malloc(sizeof(Pilot));
+   Pilot *dest = pilot_alloc();
 
    /* Copy data over, we'll have to reset all the pointers though. */
    *dest = *src;
+   ship_gfxUse( dest->ship );
 
    /* Copy names. */
    if (src->name)
@@ -2606,22 +3128,17 @@ Pilot* pilot_copy( Pilot* src )
       dest->title = strdup(src->title);
 
    /* Copy solid. */
-   dest->solid = malloc(sizeof(Solid));
+   dest->solid = solid_create( src->solid->mass, src->solid->dir,
+         &src->solid->pos, &src->solid->vel, SOLID_UPDATE_RK4 );
    *dest->solid = *src->solid;
 
    /* Copy outfits. */
-   dest->noutfits = src->noutfits;
-   dest->outfits  = malloc( sizeof(PilotOutfitSlot*) * dest->noutfits );
-   dest->outfit_nstructure = src->outfit_nstructure;
-   dest->outfit_structure  = malloc( sizeof(PilotOutfitSlot) * dest->outfit_nstructure );
+   pilot_allocOutfits( dest, src->outfit_nstructure,
+         src->outfit_nutility, src->outfit_nweapon );
    memcpy( dest->outfit_structure, src->outfit_structure,
          sizeof(PilotOutfitSlot) * dest->outfit_nstructure );
-   dest->outfit_nutility = src->outfit_nutility;
-   dest->outfit_utility  = malloc( sizeof(PilotOutfitSlot) * dest->outfit_nutility );
    memcpy( dest->outfit_utility, src->outfit_utility,
          sizeof(PilotOutfitSlot) * dest->outfit_nutility );
-   dest->outfit_nweapon = src->outfit_nweapon;
-   dest->outfit_weapon  = malloc( sizeof(PilotOutfitSlot) * dest->outfit_nweapon );
    memcpy( dest->outfit_weapon, src->outfit_weapon,
          sizeof(PilotOutfitSlot) * dest->outfit_nweapon );
    p = 0;
@@ -2636,6 +3153,7 @@ Pilot* pilot_copy( Pilot* src )
    /* Hooks get cleared. */
    dest->hooks          = NULL;
    dest->nhooks         = 0;
+   dest->hook_mask      = 0;
 
    /* Copy has no escorts. */
    dest->escorts        = NULL;
@@ -2669,6 +3187,13 @@ void pilot_free( Pilot* p )
 {
    int i;
 
+   /* Its ID is stale from now on. */
+   pilot_slotRelease(p);
+
+   /* Graphics may be freed once no pilot uses them. */
+   if (p->ship != NULL)
+      ship_gfxRelease( p->ship );
+
    /* Clear up pilot hooks. */
    pilot_clearHooks(p);
 
@@ -2678,15 +3203,9 @@ void pilot_free( Pilot* p )
    /* Free weapon sets. */
    pilot_weapSetFree(p);
 
-   /* Free outfits. */
-   if (p->outfits != NULL)
-      free(p->outfits);
+   /* Free outfits, the slot types and pointers share one block. */
    if (p->outfit_structure != NULL)
       free(p->outfit_structure);
-   if (p->outfit_utility != NULL)
-      free(p->outfit_utility);
-   if (p->outfit_weapon != NULL)
-      free(p->outfit_weapon);
 
    /* Remove commodities. */
    while (p->commodities != NULL)
@@ -2726,7 +3245,7 @@ void pilot_free( Pilot* p )
    memset( p, 0, sizeof(Pilot) );
 #endif /* DEBUGGING */
 
-   free(p);
+   pilot_release(p);
 }
 
 
@@ -2737,12 +3256,15 @@ void pilot_free( Pilot* p )
  */
 void pilot_destroy(Pilot* p)
 {
-   int i;
+   int i, s;
 
    /* find the pilot */
-   for (i=0; i < pilot_nstack; i++)
-      if (pilot_stack[i]==p)
-         break;
+   i = pilot_getStackPos( p->id );
+   if ((i < 0) || (pilot_stack[i] != p)) {
+      for (i=0; i < pilot_nstack; i++)
+         if (pilot_stack[i]==p)
+            break;
+   }
 
    /* Remove faction if necessary. */
    if (p->presence > 0) {
@@ -2754,8 +3276,14 @@ void pilot_destroy(Pilot* p)
    pilot_free(p);
    pilot_nstack--;
 
-   /* copy other pilots down */
-   memmove(&pilot_stack[i], &pilot_stack[i+1], (pilot_nstack-i)*sizeof(Pilot*));
+   /* last pilot takes its place */
+   if (i < pilot_nstack) {
+      pilot_stack[i] = pilot_stack[pilot_nstack];
+      s = pilot_getSlot( pilot_stack[i]->id );
+      if (s >= 0)
+         pilot_slots[s].pos = i;
+   }
+   pilot_gridInvalidate();
 }
 
 
@@ -2775,6 +3303,28 @@ void pilots_free (void)
    pilot_stack = NULL;
    player.p = NULL;
    pilot_nstack = 0;
+   if (pilot_slots != NULL)
+      array_free( pilot_slots );
+   pilot_slots    = NULL;
+   pilot_slotHead = -1;
+   pilot_slotTail = -1;
+   pilot_ewFree();
+   pilot_weapAimFree();
+   pilot_gridFree();
+   for (i=0; i<pilot_npool; i++)
+      free(pilot_pool[i]);
+   pilot_npool = 0;
+   free(pilot_integrate);
+   pilot_integrate  = NULL;
+   pilot_mintegrate = 0;
+   if (pilot_distressIds != NULL)
+      array_free( pilot_distressIds );
+   pilot_distressIds = NULL;
+   for (i=0; i<pilot_ntemplates; i++)
+      free(pilot_templates[i].slots);
+   free(pilot_templates);
+   pilot_templates  = NULL;
+   pilot_ntemplates = 0;
 }
 
 
@@ -2800,6 +3350,7 @@ void pilots_clean (void)
    }
    else
       pilot_nstack = 0;
+   pilot_gridInvalidate();
 
    /* Clear global hooks. */
    pilots_clearGlobalHooks();
@@ -2829,6 +3380,7 @@ void pilots_cleanAll (void)
       player.p = NULL;
    }
    pilot_nstack = 0;
+   pilot_gridInvalidate();
 }
 
 
@@ -2842,7 +3394,11 @@ void pilots_update( double dt )
    int i;
    Pilot *p;
 
-   /* Now update all the pilots. */
+   /* Now update all the pilots, integrating them afterwards in parallel. */
+   pilot_deferIntegrate = 1;
+   pilot_nintegrate     = 0;
+   pilot_integrateDt    = dt;
+   ai_frameStart();
    for (i=0; i<pilot_nstack; i++) {
       p = pilot_stack[i];
 
@@ -2853,17 +3409,13 @@ void pilots_update( double dt )
          continue;
       }
 
-      /* Invisible, not doing anything. */
-      if (pilot_isFlag(p, PILOT_INVISIBLE))
+      /* Invisible, disabled or dead, not thinking. */
+      if (pilot_isFlagAny(p, PILOT_FLAGS_NOTHINK))
          continue;
 
       /* See if should think. */
       if ((p->think==NULL) || (p->ai==NULL))
          continue;
-      if (pilot_isDisabled(p))
-         continue;
-      if (pilot_isFlag(p,PILOT_DEAD))
-         continue;
 
       /* Hyperspace gets special treatment */
       if (pilot_isFlag(p, PILOT_HYP_PREP))
@@ -2873,31 +3425,34 @@ void pilots_update( double dt )
          if (VMOD(p->solid->vel) < 2*solid_maxspeed( p->solid, p->speed, p->thrust) )
             pilot_rmFlag(p, PILOT_HYP_END);
       }
-      /* Must not be boarding to think. */
-      else if (!pilot_isFlag(p, PILOT_BOARDING) &&
-            !pilot_isFlag(p, PILOT_REFUELBOARDING) &&
-            /* Must not be landing nor taking off. */
-            !pilot_isFlag(p, PILOT_LANDING) &&
-            !pilot_isFlag(p, PILOT_TAKEOFF))
+      /* Must not be boarding, landing nor taking off to think. */
+      else if (!pilot_isFlagAny(p, PILOT_FLAGS_BUSY))
          p->think(p, dt);
    }
+   ai_frameEnd();
 
    /* Now update all the pilots. */
    for (i=0; i<pilot_nstack; i++) {
       p = pilot_stack[i];
 
-      /* Ignore. */
-      if (pilot_isFlag(p, PILOT_DELETE))
-         continue;
-
-      /* Invisible, not doing anything. */
-      if (pilot_isFlag(p, PILOT_INVISIBLE))
+      /* Ignore deleted and invisible pilots. */
+      if (pilot_isFlagAny(p, PILOT_FLAG(PILOT_DELETE) | PILOT_FLAG(PILOT_INVISIBLE)))
          continue;
 
       /* Just update the pilot. */
       if (p->update) /* update */
          p->update( p, dt );
    }
+   pilot_deferIntegrate = 0;
+
+   threadpool_parallelFor( pilot_nintegrate, PILOT_INTEGRATE_GRAIN,
+         pilot_integrateRange, NULL );
+   pilot_nintegrate = 0;
+
+   /* Pilots moved, searches until the next step must rebin them. */
+   pilot_gridInvalidate();
+   pilot_ewInvalidate();
+   pilot_weapAimInvalidate();
 }
 
 
@@ -2909,15 +3464,26 @@ void pilots_update( double dt )
 void pilots_render( double dt )
 {
    int i;
+   Pilot *p;
+   glTexture *gfx;
+
+   gl_batchBegin();
    for (i=0; i<pilot_nstack; i++) {
+      p = pilot_stack[i];
 
       /* Invisible, not doing anything. */
-      if (pilot_isFlag(pilot_stack[i], PILOT_INVISIBLE))
+      if (pilot_isFlag(p, PILOT_INVISIBLE) || (p->render == NULL))
+         continue;
+
+      /* Off screen, skip before any setup. */
+      gfx = p->ship->gfx_space;
+      if ((gfx != NULL) && !gl_isVisible( p->solid->pos.x, p->solid->pos.y,
+               MAX( gfx->sw, gfx->sh ) / 2. ))
          continue;
 
-      if (pilot_stack[i]->render != NULL) /* render */
-         pilot_stack[i]->render(pilot_stack[i], dt);
+      p->render(p, dt);
    }
+   gl_batchEnd();
 }
 
 
@@ -2953,6 +3519,7 @@ void pilot_clearTimers( Pilot *pilot )
 
    pilot->ptimer     = 0.; /* Pilot timer. */
    pilot->tcontrol   = 0.; /* AI control timer. */
+   pilot->tlod       = 0.; /* AI level of detail timer. */
    pilot->stimer     = 0.; /* Shield timer. */
    pilot->dtimer     = 0.; /* Disable timer. */
    for (i=0; i<MAX_AI_TIMERS; i++)
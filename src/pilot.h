@@ -15,6 +15,7 @@
 #include "sound.h"
 #include "economy.h"
 #include "ntime.h"
+#include "damagetype.h"
 
 
 #define PLAYER_ID       1 /**< Player pilot ID. */
@@ -69,13 +70,16 @@ enum {
 
 
 /* flags */
-#define pilot_clearFlagsRaw(a) memset((a), 0, PILOT_FLAGS_MAX) /**< Clears the pilot flags. */
-#define pilot_copyFlagsRaw(d,s) memcpy((d), (s), PILOT_FLAGS_MAX) /**< Copies the pilot flags from s to d. */
-#define pilot_isFlagRaw(a,f)  ((a)[f]) /**< Checks to see if a pilot flag is set. */
-#define pilot_setFlagRaw(a,f) ((a)[f] = 1) /**< Sets flags rawly. */
-#define pilot_isFlag(p,f)     ((p)->flags[f]) /**< Checks if flag f is set on pilot p. */
-#define pilot_setFlag(p,f)    ((p)->flags[f] = 1) /**< Sets flag f on pilot p. */
-#define pilot_rmFlag(p,f)     ((p)->flags[f] = 0) /**< Removes flag f on pilot p. */
+#define PILOT_FLAG(f)         ((PilotFlags)1 << (f)) /**< Mask of flag f, can be or'd together. */
+#define pilot_clearFlagsRaw(a) ((a) = 0) /**< Clears the pilot flags. */
+#define pilot_copyFlagsRaw(d,s) ((d) = (s)) /**< Copies the pilot flags from s to d. */
+#define pilot_isFlagRaw(a,f)  (((a) & PILOT_FLAG(f)) != 0) /**< Checks to see if a pilot flag is set. */
+#define pilot_setFlagRaw(a,f) ((a) |= PILOT_FLAG(f)) /**< Sets flags rawly. */
+#define pilot_isFlag(p,f)     (((p)->flags & PILOT_FLAG(f)) != 0) /**< Checks if flag f is set on pilot p. */
+#define pilot_setFlag(p,f)    ((p)->flags |= PILOT_FLAG(f)) /**< Sets flag f on pilot p. */
+#define pilot_rmFlag(p,f)     ((p)->flags &= ~PILOT_FLAG(f)) /**< Removes flag f on pilot p. */
+#define pilot_isFlagAny(p,m)  (((p)->flags & (m)) != 0) /**< Checks if any flag in mask m is set on pilot p. */
+#define pilot_isFlagAll(p,m)  (((p)->flags & (m)) == (m)) /**< Checks if all flags in mask m are set on pilot p. */
 enum {
    /* creation */
    PILOT_PLAYER,       /**< Pilot is a player. */
@@ -125,9 +129,20 @@ enum {
    PILOT_COOLDOWN_BRAKE, /**< Pilot is braking to enter active cooldown mode. */
    PILOT_BRAKING,      /**< Pilot is braking. */
    PILOT_HASSPEEDLIMIT, /**< Speed limiting is activated for Pilot.*/
-   PILOT_FLAGS_MAX     /**< Maximum number of flags. */
+   PILOT_FLAGS_MAX     /**< Maximum number of flags, must fit in PilotFlags. */
 };
-typedef char PilotFlags[ PILOT_FLAGS_MAX ];
+typedef uint64_t PilotFlags; /**< Bitmask of pilot flags, see PILOT_FLAG(). */
+
+/* flag masks tested together in the hot loops */
+#define PILOT_FLAGS_GONE      (PILOT_FLAG(PILOT_DEAD) | PILOT_FLAG(PILOT_DELETE)) /**< Pilot is dying or about to be removed. */
+#define PILOT_FLAGS_NOTARGET  (PILOT_FLAGS_GONE | PILOT_FLAG(PILOT_INVISIBLE)) /**< Pilot can't be targeted. */
+#define PILOT_FLAGS_NOTHINK   (PILOT_FLAG(PILOT_INVISIBLE) | PILOT_FLAG(PILOT_DISABLED) | \
+      PILOT_FLAG(PILOT_DEAD)) /**< Pilot's AI doesn't run. */
+#define PILOT_FLAGS_BUSY      (PILOT_FLAG(PILOT_BOARDING) | PILOT_FLAG(PILOT_REFUELBOARDING) | \
+      PILOT_FLAG(PILOT_LANDING) | PILOT_FLAG(PILOT_TAKEOFF)) /**< Pilot is busy and can't think. */
+#define PILOT_FLAGS_NOHIT     (PILOT_FLAG(PILOT_INVINCIBLE) | PILOT_FLAG(PILOT_INVISIBLE) | \
+      PILOT_FLAG(PILOT_LANDING) | PILOT_FLAG(PILOT_TAKEOFF) | \
+      PILOT_FLAG(PILOT_DEAD)) /**< Weapons go through the pilot. */
 
 /* makes life easier */
 #define pilot_isPlayer(p)   pilot_isFlag(p,PILOT_PLAYER) /**< Checks if pilot is a player. */
@@ -216,6 +231,8 @@ typedef struct PilotWeaponSet_ {
    int inrange;   /**< Whether or not to fire only if the target is inrange. */
    double range[PILOT_WEAPSET_MAX_LEVELS]; /**< Range of the levels in the outfit slot. */
    double speed[PILOT_WEAPSET_MAX_LEVELS]; /**< Speed of the levels in the outfit slot. */
+   double range_all; /**< Sum of the range of all the levels. */
+   double speed_all; /**< Sum of the speed of all the levels. */
 } PilotWeaponSet;
 
 
@@ -261,6 +278,36 @@ typedef struct Escort_s {
 } Escort_t;
 
 
+/**
+ * @brief Outfit totals pilot_calcStats() builds the pilot's stats from.
+ *
+ * Kept so a single outfit can be added or removed without going over all
+ *  the slots again.
+ */
+typedef struct PilotStatsSum_ {
+   int valid;           /**< Whether the sum matches the outfits. */
+   double cpu;          /**< CPU used by outfits. */
+   double mass_outfit;  /**< Mass of outfits, without ammo. */
+   double base_mass;    /**< Ship mass plus core outfit mass. */
+   double thrust;       /**< Thrust before modifiers. */
+   double turn;         /**< Turn before modifiers. */
+   double speed;        /**< Speed before modifiers. */
+   double absorb;       /**< Damage absorption. */
+   double armour;       /**< Armour before modifiers. */
+   double armour_regen; /**< Armour regeneration before modifiers. */
+   double shield;       /**< Shield before modifiers. */
+   double shield_regen; /**< Shield regeneration before modifiers. */
+   double energy;       /**< Energy before modifiers. */
+   double energy_regen; /**< Energy regeneration before modifiers. */
+   double energy_loss;  /**< Energy lost per second. */
+   double fuel;         /**< Fuel capacity. */
+   double cargo;        /**< Cargo capacity before modifiers. */
+   double crew;         /**< Crew before modifiers. */
+   ShipStats stats;     /**< Unclamped sum of the ship and outfit stats. */
+   ShipStats amount;    /**< Number of positive modifiers of each stat. */
+} PilotStatsSum;
+
+
 /**
  * @brief The representation of an in-game pilot.
  */
@@ -326,6 +373,8 @@ typedef struct Pilot_ {
    double ew_hide;   /**< Static hide factor. */
    double ew_movement; /**< Movement factor. */
    double ew_evasion; /**< Dynamic evasion factor. */
+   double ew_T;      /**< Temperature ew_heat was computed at. */
+   double ew_vmod;   /**< Speed ew_movement was computed at. */
    double ew_detect; /**< Static detection factor. */
    double ew_jump_detect; /** Static jump detection factor */
 
@@ -341,6 +390,8 @@ typedef struct Pilot_ {
 
    /* Ship statistics. */
    ShipStats stats;  /**< Pilot's copy of ship statistics. */
+   PilotStatsSum stats_sum; /**< Outfit totals the stats come from. */
+   DTypeMod dmods[DTYPE_MAX]; /**< Damage multipliers from the stats, see dtype_calcMods(). */
 
    /* Associated functions */
    void (*think)(struct Pilot_*, const double); /**< AI thinking for the pilot */
@@ -388,6 +439,7 @@ typedef struct Pilot_ {
    /* Hook attached to the pilot */
    PilotHook *hooks; /**< Pilot hooks. */
    int nhooks;       /**< Number of pilot hooks. */
+   unsigned int hook_mask; /**< Bit per hook type in hooks, see pilot_hasHook(). */
 
    /* Escort stuff. */
    unsigned int parent; /**< Pilot's parent. */
@@ -402,6 +454,8 @@ typedef struct Pilot_ {
    /* AI */
    AI_Profile* ai;   /**< AI personality profile */
    double tcontrol;  /**< timer for control tick */
+   double tlod;      /**< timer for level of detail AI tick */
+   int lod_flags;    /**< AI firing flags held between level of detail ticks */
    double timer[MAX_AI_TIMERS]; /**< timers for AI */
    Task* task;       /**< current action */
 
@@ -417,6 +471,8 @@ typedef struct Pilot_ {
    double sbonus;    /**< Shield regeneration bonus. */
    double dtimer;    /**< Disable timer. */
    double dtimer_accum; /**< Accumulated disable timer. */
+   double distress_timer; /**< Time left during which repeated distress calls are coalesced. */
+   unsigned int distress_attacker; /**< Attacker of the last propagated distress call. */
    int hail_pos;     /**< Hail animation position. */
    int lockons;      /**< Stores how many seeking weapons are targeting pilot */
    int *mounted;     /**< Number of mounted outfits on the mount. */
@@ -433,13 +489,17 @@ typedef struct Pilot_ {
 #include "pilot_outfit.h"
 #include "pilot_weapon.h"
 #include "pilot_ew.h"
+#include "pilot_grid.h"
 
 
 /*
  * getting pilot stuff
  */
 Pilot** pilot_getAll( int *n );
+size_t pilot_memUsage( int *n );
 Pilot* pilot_get( const unsigned int id );
+int pilot_index( const Pilot *p );
+int pilot_indexMax (void);
 unsigned int pilot_getNextID( const unsigned int id, int mode );
 unsigned int pilot_getPrevID( const unsigned int id, int mode );
 unsigned int pilot_getNearestEnemy( const Pilot* p );
@@ -466,7 +526,8 @@ void pilot_setTarget( Pilot* p, unsigned int id );
 double pilot_hit( Pilot* p, const Solid* w, const unsigned int shooter,
       const Damage *dmg, int reset );
 void pilot_updateDisable( Pilot* p, const unsigned int shooter );
-void pilot_explode( double x, double y, double radius, const Damage *dmg, const Pilot *parent );
+int pilot_explodeHit( Pilot *p, double x, double y, double radius,
+      const Damage *dmg, unsigned int parent );
 double pilot_face( Pilot* p, const double dir );
 int pilot_brake( Pilot* p );
 double pilot_brakeDist( Pilot *p, Vector2d *pos );
@@ -495,6 +556,9 @@ void pilot_init( Pilot* dest, Ship* ship, const char* name, int faction, const c
 unsigned int pilot_create( Ship* ship, const char* name, int faction, const char *ai,
       const double dir, const Vector2d* pos, const Vector2d* vel,
       const PilotFlags flags );
+int pilot_createBatch( Ship* ship, const char* name, int faction, const char *ai,
+      int n, const double *dir, const Vector2d* pos, const Vector2d* vel,
+      const PilotFlags flags, unsigned int *ids );
 Pilot* pilot_createEmpty( Ship* ship, const char* name,
       int faction, const char *ai, PilotFlags flags );
 Pilot* pilot_copy( Pilot* src );
@@ -15,6 +15,9 @@
 #include "naev.h"
 
 #include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "log.h"
 #include "space.h"
@@ -25,6 +28,23 @@ static double sensor_curRange    = 0.; /**< Current base sensor range, used to c
 
 #define EVASION_SCALE        1.3225 /**< 1.15 squared. Ensures that ships have higher evasion than hide. */
 #define SENSOR_DEFAULT_RANGE 7500   /**< The default sensor range for all ships. */
+#define SENSOR_VIS_CHUNK     64     /**< Pilots to grow the visibility cache by. */
+#define EW_HEAT_STEP         0.5    /**< Temperature change in K before ew_heat follows. */
+#define EW_SPEED_STEP        1.     /**< Speed change before ew_movement follows. */
+
+
+/*
+ * Visibility of pilot pairs is cached for the frame, two bits per ordered
+ *  pair indexed by pilot_index(). 0 is not known yet, otherwise it is the
+ *  distance result of pilot_inRangePilot() plus 2. The cache is dropped when
+ *  pilots move, come or go, or the sensor range changes.
+ */
+static uint32_t *sensor_vis   = NULL; /**< Cached visibility of pilot pairs. */
+static int sensor_nvis        = 0; /**< Pilots the cache is sized for. */
+static int sensor_visDirty    = 1; /**< Whether the cache must be cleared before use. */
+
+
+static int pilot_inRangePilotDist( const Pilot *p, const Pilot *target );
 
 /**
  * @brief Updates the pilot's static electronic warfare properties.
@@ -38,7 +58,10 @@ void pilot_ewUpdateStatic( Pilot *p )
     * equivalent to: ew_base_hide * ew_mass * sqrt(ew_heat)
     */
    p->ew_mass     = pow2( pilot_ewMass( p->solid->mass ) );
+   p->ew_T        = p->heat_T;
    p->ew_heat     = pilot_ewHeat( p->heat_T );
+   p->ew_vmod     = VMOD( p->solid->vel );
+   p->ew_movement = pilot_ewMovement( p->ew_vmod );
    p->ew_asteroid = pilot_ewAsteroid( p );
    p->ew_hide     = p->ew_base_hide * p->ew_mass * p->ew_heat * p->ew_asteroid;
    p->ew_evasion  = p->ew_hide * EVASION_SCALE;
@@ -48,18 +71,46 @@ void pilot_ewUpdateStatic( Pilot *p )
 /**
  * @brief Updates the pilot's dynamic electronic warfare properties.
  *
+ * Heat and movement only follow once the temperature or speed moved by more
+ *  than EW_HEAT_STEP or EW_SPEED_STEP, so pilots cruising or cooling slowly
+ *  keep their values. The speed is compared squared to skip the sqrt().
+ *
  *    @param p Pilot to update.
  */
 void pilot_ewUpdateDynamic( Pilot *p )
 {
-   /* Update hide. */
-   p->ew_heat     = pilot_ewHeat( p->heat_T );
-   p->ew_asteroid = pilot_ewAsteroid( p );
-   p->ew_hide     = p->ew_base_hide * p->ew_mass * p->ew_heat * p->ew_asteroid;
-
-   /* Update evasion. */
-   p->ew_movement = pilot_ewMovement( VMOD(p->solid->vel) );
-   p->ew_evasion  = p->ew_hide * EVASION_SCALE;
+   double v2, asteroid;
+   int changed;
+
+   changed = 0;
+
+   /* Update heat. */
+   if (fabs( p->heat_T - p->ew_T ) > EW_HEAT_STEP) {
+      p->ew_T     = p->heat_T;
+      p->ew_heat  = pilot_ewHeat( p->heat_T );
+      changed     = 1;
+   }
+
+   /* Update movement, |v^2 - u^2| = |v - u| (v + u). */
+   v2 = pow2( p->solid->vel.x ) + pow2( p->solid->vel.y );
+   if (fabs( v2 - pow2( p->ew_vmod ) ) >
+         EW_SPEED_STEP * (2.*p->ew_vmod + EW_SPEED_STEP)) {
+      p->ew_vmod     = sqrt( v2 );
+      p->ew_movement = pilot_ewMovement( p->ew_vmod );
+   }
+
+   /* Fields have sharp edges, so they are always checked. */
+   asteroid = pilot_ewAsteroid( p );
+   if (asteroid != p->ew_asteroid) {
+      p->ew_asteroid = asteroid;
+      changed        = 1;
+   }
+
+   /* Update hide and evasion. */
+   if (changed) {
+      p->ew_hide    = p->ew_base_hide * p->ew_mass * p->ew_heat * p->ew_asteroid;
+      p->ew_evasion = p->ew_hide * EVASION_SCALE;
+   }
 }
 
 
@@ -129,6 +180,30 @@ void pilot_updateSensorRange (void)
    /* Speeds up calculations as we compare it against vectors later on
     * and we want to avoid actually calculating the sqrt(). */
    sensor_curRange = pow2(sensor_curRange);
+   pilot_ewInvalidate();
+}
+
+
+/**
+ * @brief Drops the pilot visibility cache.
+ *
+ * Must be called whenever pilots move or their electronic warfare changes.
+ */
+void pilot_ewInvalidate (void)
+{
+   sensor_visDirty = 1;
+}
+
+
+/**
+ * @brief Frees the pilot visibility cache.
+ */
+void pilot_ewFree (void)
+{
+   free( sensor_vis );
+   sensor_vis      = NULL;
+   sensor_nvis     = 0;
+   sensor_visDirty = 1;
 }
 
 
@@ -175,7 +250,7 @@ int pilot_inRange( const Pilot *p, double x, double y )
  */
 int pilot_inRangePilot( const Pilot *p, const Pilot *target )
 {
-   double d, sense;
+   int i, j, k, n, v, shift;
 
    /* Special case player or omni-visible. */
    if ((pilot_isPlayer(p) && pilot_isFlag(target, PILOT_VISPLAYER)) ||
@@ -183,6 +258,44 @@ int pilot_inRangePilot( const Pilot *p, const Pilot *target )
          target->parent == p->id)
       return 1;
 
+   /* Pilots outside of the stack don't get cached. */
+   i = pilot_index( p );
+   j = pilot_index( target );
+   if ((i < 0) || (j < 0))
+      return pilot_inRangePilotDist( p, target );
+
+   /* Clear or grow the cache. */
+   n = pilot_indexMax();
+   if (n > sensor_nvis) {
+      sensor_nvis = n + SENSOR_VIS_CHUNK;
+      free( sensor_vis );
+      sensor_vis  = malloc( (sensor_nvis*sensor_nvis + 15) / 16 * sizeof(uint32_t) );
+      sensor_visDirty = 1;
+   }
+   if (sensor_visDirty) {
+      memset( sensor_vis, 0, (sensor_nvis*sensor_nvis + 15) / 16 * sizeof(uint32_t) );
+      sensor_visDirty = 0;
+   }
+
+   /* Look it up. */
+   k     = i*sensor_nvis + j;
+   shift = (k & 15) * 2;
+   v     = (sensor_vis[ k >> 4 ] >> shift) & 3;
+   if (v == 0) {
+      v = pilot_inRangePilotDist( p, target ) + 2;
+      sensor_vis[ k >> 4 ] |= (uint32_t)v << shift;
+   }
+   return v - 2;
+}
+
+
+/**
+ * @brief Distance part of pilot_inRangePilot().
+ */
+static int pilot_inRangePilotDist( const Pilot *p, const Pilot *target )
+{
+   double d, sense;
+
    /* Get distance. */
    d = vect_dist2( &p->solid->pos, &target->solid->pos );
 
@@ -15,6 +15,8 @@
  * Sensors and range.
  */
 void pilot_updateSensorRange (void);
+void pilot_ewInvalidate (void);
+void pilot_ewFree (void);
 double pilot_sensorRange( void );
 int pilot_inRange( const Pilot *p, double x, double y );
 int pilot_inRangePilot( const Pilot *p, const Pilot *target );
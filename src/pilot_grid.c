@@ -0,0 +1,772 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+/**
+ * @file pilot_grid.c
+ *
+ * @brief Uniform grid broadphase over the pilots in the current system.
+ *
+ * Pilots are binned by their sprite bounding box into fixed size cells.  Since
+ *  systems are not bounded, cells are hashed into a fixed amount of buckets,
+ *  so unrelated cells may share a bucket.  This only produces extra
+ *  candidates which are discarded by the narrowphase.
+ *
+ * The grid is rebuilt once per update step, and lazily if the pilot stack
+ *  changes or pilots move in between.  Collision candidates are always
+ *  returned in pilot stack order.
+ *
+ * Proximity searches walk rings of cells outwards from the query point and
+ *  stop once no unvisited pilot can beat the best found so far.  They use
+ *  their own output buffer, so they may be run while a collision candidate
+ *  list is still in use.
+ *
+ * Collision queries can also be given their own PilotGridQuery, which lets
+ *  several threads query an up to date grid at once.
+ */
+
+
+#include "pilot_grid.h"
+
+#include "naev.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "log.h"
+
+
+#define GRID_BUCKETS       1024 /**< Amount of hash buckets, must be power of two. */
+#define GRID_CHUNK         128 /**< Size to grow the arrays by. */
+#define GRID_LINEAR        32 /**< Below this many pilots searches just scan them all. */
+
+#define GRID_CELL(x)       ((int)floor((x) / PILOT_GRID_CELL)) /**< Cell of a coordinate. */
+#define GRID_HASH(cx,cy)   ((((unsigned int)(cx)*73856093U) ^ \
+      ((unsigned int)(cy)*19349663U)) & (GRID_BUCKETS-1)) /**< Bucket of a cell. */
+
+
+/*
+ * pilot stuff
+ */
+extern Pilot** pilot_stack;
+extern int pilot_nstack;
+
+
+static int grid_valid         = 0; /**< Whether or not the grid matches the pilot stack. */
+static Pilot **grid_pilots    = NULL; /**< Pilots indexed by grid id (stack order). */
+static int grid_npilots       = 0; /**< Number of pilots in the grid. */
+static int grid_mpilots       = 0; /**< Memory allocated for pilots. */
+static unsigned int grid_gen  = 0; /**< Build generation, grid ids change with each. */
+static int grid_start[GRID_BUCKETS+1]; /**< Start of each bucket in grid_ents. */
+static int grid_fill[GRID_BUCKETS]; /**< Fill cursor used while building. */
+static int *grid_ents         = NULL; /**< Grid ids, sorted by bucket. */
+static int grid_nents         = 0; /**< Number of entries. */
+static int grid_ments         = 0; /**< Memory allocated for entries. */
+static PilotGridQuery grid_q; /**< Scratch space of the main thread queries. */
+static int *grid_nearid       = NULL; /**< Grid ids of the last proximity search. */
+static double *grid_neard     = NULL; /**< Distances of the last k-nearest search. */
+static Pilot **grid_near      = NULL; /**< Pilots of the last proximity search. */
+static int grid_nnear         = 0; /**< Number of pilots of the last proximity search. */
+static double grid_maxw       = 0.; /**< Widest sprite in the grid. */
+static double grid_minhide    = 0.; /**< Lowest electronic warfare hide in the grid. */
+
+
+/*
+ * Prototypes.
+ */
+static void grid_cellRange( const Pilot *p, int *cx1, int *cy1, int *cx2, int *cy2 );
+static void grid_stampNext( PilotGridQuery *q );
+static void grid_addBucket( PilotGridQuery *q, unsigned int b );
+static void grid_addBucketTo( PilotGridQuery *q, unsigned int b, int *out, int *nout );
+static int grid_ringNext( int r, int *nseen );
+static int grid_cmp( const void *a, const void *b );
+static int grid_finish( PilotGridQuery *q, Pilot ***list );
+static int grid_all( Pilot ***list );
+
+
+/**
+ * @brief Gets the cells covered by a pilot.
+ */
+static void grid_cellRange( const Pilot *p, int *cx1, int *cy1, int *cx2, int *cy2 )
+{
+   double hw, hh;
+
+   if ((p->ship != NULL) && (p->ship->gfx_space != NULL)) {
+      hw = p->ship->gfx_space->sw / 2.;
+      hh = p->ship->gfx_space->sh / 2.;
+   }
+   else {
+      hw = 0.;
+      hh = 0.;
+   }
+
+   *cx1 = GRID_CELL( p->solid->pos.x - hw );
+   *cy1 = GRID_CELL( p->solid->pos.y - hh );
+   *cx2 = GRID_CELL( p->solid->pos.x + hw );
+   *cy2 = GRID_CELL( p->solid->pos.y + hh );
+}
+
+
+/**
+ * @brief Rebuilds the grid from the current pilot stack.
+ *
+ * Should be called once per update step before weapons are updated.
+ */
+void pilot_gridUpdate (void)
+{
+   int i, cx, cy, cx1, cy1, cx2, cy2;
+   unsigned int b;
+
+   /* Make sure we have memory for the pilots. */
+   if (pilot_nstack > grid_mpilots) {
+      grid_mpilots = pilot_nstack + GRID_CHUNK;
+      grid_pilots  = realloc( grid_pilots, grid_mpilots * sizeof(Pilot*) );
+      grid_nearid  = realloc( grid_nearid, grid_mpilots * sizeof(int) );
+      grid_neard   = realloc( grid_neard, grid_mpilots * sizeof(double) );
+      grid_near    = realloc( grid_near, grid_mpilots * sizeof(Pilot*) );
+   }
+   grid_npilots = pilot_nstack;
+   if (grid_npilots > 0)
+      memcpy( grid_pilots, pilot_stack, grid_npilots * sizeof(Pilot*) );
+   grid_gen++;
+
+   /* Count entries per bucket. */
+   memset( grid_start, 0, sizeof(grid_start) );
+   grid_nents = 0;
+   grid_maxw  = 0.;
+   grid_minhide = HUGE_VAL;
+   for (i=0; i<grid_npilots; i++) {
+      if ((grid_pilots[i]->ship != NULL) && (grid_pilots[i]->ship->gfx_space != NULL))
+         grid_maxw = MAX( grid_maxw, grid_pilots[i]->ship->gfx_space->sw );
+      grid_minhide = MIN( grid_minhide,
+            MIN( grid_pilots[i]->ew_hide, grid_pilots[i]->ew_evasion ) );
+      grid_cellRange( grid_pilots[i], &cx1, &cy1, &cx2, &cy2 );
+      for (cy=cy1; cy<=cy2; cy++) {
+         for (cx=cx1; cx<=cx2; cx++) {
+            grid_start[ GRID_HASH(cx,cy)+1 ]++;
+            grid_nents++;
+         }
+      }
+   }
+
+   /* Prefix sum. */
+   for (i=0; i<GRID_BUCKETS; i++) {
+      grid_start[i+1] += grid_start[i];
+      grid_fill[i]     = grid_start[i];
+   }
+
+   /* Make sure we have memory for the entries. */
+   if (grid_nents > grid_ments) {
+      grid_ments = grid_nents + GRID_CHUNK;
+      grid_ents  = realloc( grid_ents, grid_ments * sizeof(int) );
+   }
+
+   /* Fill buckets, pilots are added in stack order. */
+   for (i=0; i<grid_npilots; i++) {
+      grid_cellRange( grid_pilots[i], &cx1, &cy1, &cx2, &cy2 );
+      for (cy=cy1; cy<=cy2; cy++) {
+         for (cx=cx1; cx<=cx2; cx++) {
+            b = GRID_HASH(cx,cy);
+            grid_ents[ grid_fill[b]++ ] = i;
+         }
+      }
+   }
+
+   grid_valid = 1;
+}
+
+
+/**
+ * @brief Marks the grid as out of date.
+ *
+ * Must be called whenever a pilot is added to or removed from the stack, or
+ *  after pilots have moved.
+ */
+void pilot_gridInvalidate (void)
+{
+   grid_valid = 0;
+}
+
+
+/**
+ * @brief Rebuilds the grid if it is out of date.
+ *
+ * Must be called before querying with a PilotGridQuery from other threads,
+ *  as those queries can't rebuild it.
+ */
+void pilot_gridEnsure (void)
+{
+   if (!grid_valid)
+      pilot_gridUpdate();
+}
+
+
+/**
+ * @brief Frees the grid.
+ */
+void pilot_gridFree (void)
+{
+   free(grid_pilots);
+   free(grid_ents);
+   free(grid_nearid);
+   free(grid_neard);
+   free(grid_near);
+   grid_pilots    = NULL;
+   grid_ents      = NULL;
+   grid_nearid    = NULL;
+   grid_neard     = NULL;
+   grid_near      = NULL;
+   grid_nnear     = 0;
+   grid_npilots   = 0;
+   grid_mpilots   = 0;
+   grid_nents     = 0;
+   grid_ments     = 0;
+   grid_valid     = 0;
+   pilot_gridQueryFree( &grid_q );
+}
+
+
+/**
+ * @brief Sets up the scratch space of a collision query.
+ *
+ *    @param q Query to set up.
+ */
+void pilot_gridQueryInit( PilotGridQuery *q )
+{
+   memset( q, 0, sizeof(PilotGridQuery) );
+}
+
+
+/**
+ * @brief Frees the scratch space of a collision query.
+ *
+ *    @param q Query to free.
+ */
+void pilot_gridQueryFree( PilotGridQuery *q )
+{
+   free(q->stamp);
+   free(q->cand);
+   free(q->out);
+   pilot_gridQueryInit( q );
+}
+
+
+/**
+ * @brief Starts a new query.
+ */
+static void grid_stampNext( PilotGridQuery *q )
+{
+   if (!grid_valid)
+      pilot_gridUpdate();
+
+   /* Make sure we have memory for the pilots. */
+   if (q->m < grid_npilots) {
+      q->m     = grid_mpilots;
+      q->stamp = realloc( q->stamp, q->m * sizeof(unsigned int) );
+      q->cand  = realloc( q->cand, q->m * sizeof(int) );
+      q->out   = realloc( q->out, q->m * sizeof(Pilot*) );
+      q->gen   = grid_gen - 1;
+   }
+
+   q->ncand = 0;
+   q->curstamp++;
+
+   /* Grid was rebuilt or wrapped around, clear stamps. */
+   if ((q->gen != grid_gen) || (q->curstamp == 0)) {
+      if (grid_npilots > 0)
+         memset( q->stamp, 0, grid_npilots * sizeof(unsigned int) );
+      q->gen      = grid_gen;
+      q->curstamp = 1;
+   }
+}
+
+
+/**
+ * @brief Adds all the pilots in a bucket to the candidates.
+ */
+static void grid_addBucket( PilotGridQuery *q, unsigned int b )
+{
+   grid_addBucketTo( q, b, q->cand, &q->ncand );
+}
+
+
+/**
+ * @brief Adds all the unseen pilots in a bucket to a list of grid ids.
+ */
+static void grid_addBucketTo( PilotGridQuery *q, unsigned int b, int *out, int *nout )
+{
+   int i, id;
+
+   for (i=grid_start[b]; i<grid_start[b+1]; i++) {
+      id = grid_ents[i];
+      if (q->stamp[id] == q->curstamp)
+         continue;
+      q->stamp[id] = q->curstamp;
+      out[ (*nout)++ ] = id;
+   }
+}
+
+
+/**
+ * @brief Compares two grid ids.
+ */
+static int grid_cmp( const void *a, const void *b )
+{
+   return *(const int*)a - *(const int*)b;
+}
+
+
+/**
+ * @brief Sorts the candidates into stack order and outputs them.
+ */
+static int grid_finish( PilotGridQuery *q, Pilot ***list )
+{
+   int i, j, id;
+
+   /* Insertion sort is much faster for the usual handful of candidates. */
+   if (q->ncand > 32)
+      qsort( q->cand, q->ncand, sizeof(int), grid_cmp );
+   else {
+      for (i=1; i<q->ncand; i++) {
+         id = q->cand[i];
+         for (j=i; (j>0) && (q->cand[j-1] > id); j--)
+            q->cand[j] = q->cand[j-1];
+         q->cand[j] = id;
+      }
+   }
+
+   for (i=0; i<q->ncand; i++)
+      q->out[i] = grid_pilots[ q->cand[i] ];
+
+   *list = q->out;
+   return q->ncand;
+}
+
+
+/**
+ * @brief Outputs all the pilots in the grid.
+ */
+static int grid_all( Pilot ***list )
+{
+   *list = grid_pilots;
+   return grid_npilots;
+}
+
+
+/**
+ * @brief Gets the pilots that may overlap a rectangle.
+ *
+ * The list is owned by the grid and is only valid until the next query.
+ *
+ *    @param x1 Left side of the rectangle.
+ *    @param y1 Bottom side of the rectangle.
+ *    @param x2 Right side of the rectangle.
+ *    @param y2 Top side of the rectangle.
+ *    @param[out] list Candidate pilots in stack order.
+ *    @return Number of candidate pilots.
+ */
+int pilot_gridQueryRect( double x1, double y1, double x2, double y2,
+      Pilot ***list )
+{
+   return pilot_gridQueryRectWith( &grid_q, x1, y1, x2, y2, list );
+}
+
+
+/**
+ * @brief Gets the pilots that may overlap a rectangle using a given query.
+ *
+ * The list is owned by the query and is only valid until its next use. Safe
+ *  to call from other threads with their own query, as long as the grid is
+ *  up to date and the pilots don't change meanwhile.
+ *
+ *    @param q Query scratch space.
+ *    @param x1 Left side of the rectangle.
+ *    @param y1 Bottom side of the rectangle.
+ *    @param x2 Right side of the rectangle.
+ *    @param y2 Top side of the rectangle.
+ *    @param[out] list Candidate pilots in stack order.
+ *    @return Number of candidate pilots.
+ */
+int pilot_gridQueryRectWith( PilotGridQuery *q,
+      double x1, double y1, double x2, double y2, Pilot ***list )
+{
+   int cx, cy, cx1, cy1, cx2, cy2;
+
+   grid_stampNext( q );
+
+   cx1 = GRID_CELL( x1 );
+   cy1 = GRID_CELL( y1 );
+   cx2 = GRID_CELL( x2 );
+   cy2 = GRID_CELL( y2 );
+
+   /* Huge rectangles will touch every bucket anyway. */
+   if ((double)(cx2-cx1+1) * (double)(cy2-cy1+1) >= GRID_BUCKETS)
+      return grid_all( list );
+
+   for (cy=cy1; cy<=cy2; cy++)
+      for (cx=cx1; cx<=cx2; cx++)
+         grid_addBucket( q, GRID_HASH(cx,cy) );
+
+   return grid_finish( q, list );
+}
+
+
+/**
+ * @brief Gets the width of the widest pilot sprite in the grid.
+ *
+ * Lets queries that depend on the size of the pilots widen their rectangle
+ *  just enough.
+ */
+double pilot_gridMaxWidth (void)
+{
+   if (!grid_valid)
+      pilot_gridUpdate();
+   return grid_maxw;
+}
+
+
+/**
+ * @brief Gets the lowest electronic warfare hide or evasion of the pilots in the grid.
+ *
+ * Bounds how far away a pilot can be detected, values are as of the last
+ *  grid build.
+ *
+ *    @return The lowest hide or HUGE_VAL if there are no pilots.
+ */
+double pilot_gridMinHide (void)
+{
+   if (!grid_valid)
+      pilot_gridUpdate();
+   return grid_minhide;
+}
+
+
+/**
+ * @brief Gets the pilots that may overlap a line segment.
+ *
+ * Walks the cells crossed by the segment.  The list is owned by the grid and
+ *  is only valid until the next query.
+ *
+ *    @param pos Origin of the segment.
+ *    @param dir Direction of the segment.
+ *    @param len Length of the segment.
+ *    @param[out] list Candidate pilots in stack order.
+ *    @return Number of candidate pilots.
+ */
+int pilot_gridQueryLine( const Vector2d *pos, double dir, double len,
+      Pilot ***list )
+{
+   return pilot_gridQueryLineWith( &grid_q, pos, dir, len, list );
+}
+
+
+/**
+ * @brief Gets the pilots that may overlap a line segment using a given query.
+ *
+ * Same as pilot_gridQueryRectWith() as to threads.
+ *
+ *    @param q Query scratch space.
+ *    @param pos Origin of the segment.
+ *    @param dir Direction of the segment.
+ *    @param len Length of the segment.
+ *    @param[out] list Candidate pilots in stack order.
+ *    @return Number of candidate pilots.
+ */
+int pilot_gridQueryLineWith( PilotGridQuery *q, const Vector2d *pos,
+      double dir, double len, Pilot ***list )
+{
+   int i, n, cx, cy, ex, ey, sx, sy;
+   double dx, dy, tx, ty, tdx, tdy;
+
+   grid_stampNext( q );
+
+   dx = len * cos(dir);
+   dy = len * sin(dir);
+
+   cx = GRID_CELL( pos->x );
+   cy = GRID_CELL( pos->y );
+   ex = GRID_CELL( pos->x + dx );
+   ey = GRID_CELL( pos->y + dy );
+   n  = ABS(ex-cx) + ABS(ey-cy) + 1;
+   if (n >= GRID_BUCKETS)
+      return grid_all( list );
+
+   /* Set up the traversal, t goes from 0 to 1 along the segment. */
+   sx = (dx > 0.) ? 1 : -1;
+   sy = (dy > 0.) ? 1 : -1;
+   if (dx != 0.) {
+      tx  = ((cx + (sx > 0)) * PILOT_GRID_CELL - pos->x) / dx;
+      tdx = PILOT_GRID_CELL / FABS(dx);
+   }
+   else {
+      tx  = HUGE_VAL;
+      tdx = HUGE_VAL;
+   }
+   if (dy != 0.) {
+      ty  = ((cy + (sy > 0)) * PILOT_GRID_CELL - pos->y) / dy;
+      tdy = PILOT_GRID_CELL / FABS(dy);
+   }
+   else {
+      ty  = HUGE_VAL;
+      tdy = HUGE_VAL;
+   }
+
+   for (i=0; i<n; i++) {
+      grid_addBucket( q, GRID_HASH(cx,cy) );
+      if ((cx == ex) && (cy == ey))
+         break;
+      if (tx < ty) {
+         cx += sx;
+         tx += tdx;
+      }
+      else {
+         cy += sy;
+         ty += tdy;
+      }
+   }
+   /* Make sure rounding didn't make us miss the end. */
+   grid_addBucket( q, GRID_HASH(ex,ey) );
+
+   return grid_finish( q, list );
+}
+
+
+/*
+ * Ring walk state, only used by the proximity searches.
+ */
+static int ring_cx = 0; /**< Cell of the query point. */
+static int ring_cy = 0; /**< Cell of the query point. */
+
+
+/**
+ * @brief Collects the unseen pilots of a ring of cells into grid_nearid.
+ *
+ * Ring r is the border of the (2r+1)x(2r+1) square of cells centered on the
+ *  query cell.  Once the square would touch every bucket, all the unseen
+ *  pilots are collected at once.
+ *
+ *    @param r Ring to collect.
+ *    @param[in,out] nseen Amount of pilots seen so far.
+ *    @return Number of pilots collected or -1 if the whole grid is done.
+ */
+static int grid_ringNext( int r, int *nseen )
+{
+   int i, n;
+
+   if (*nseen >= grid_npilots)
+      return -1;
+
+   n = 0;
+   if ((double)(2*r+1) * (double)(2*r+1) >= GRID_BUCKETS) {
+      for (i=0; i<grid_npilots; i++) {
+         if (grid_q.stamp[i] == grid_q.curstamp)
+            continue;
+         grid_q.stamp[i] = grid_q.curstamp;
+         grid_nearid[ n++ ] = i;
+      }
+   }
+   else if (r == 0)
+      grid_addBucketTo( &grid_q, GRID_HASH(ring_cx,ring_cy), grid_nearid, &n );
+   else {
+      for (i=-r; i<=r; i++) {
+         grid_addBucketTo( &grid_q, GRID_HASH(ring_cx+i,ring_cy-r), grid_nearid, &n );
+         grid_addBucketTo( &grid_q, GRID_HASH(ring_cx+i,ring_cy+r), grid_nearid, &n );
+      }
+      for (i=-r+1; i<=r-1; i++) {
+         grid_addBucketTo( &grid_q, GRID_HASH(ring_cx-r,ring_cy+i), grid_nearid, &n );
+         grid_addBucketTo( &grid_q, GRID_HASH(ring_cx+r,ring_cy+i), grid_nearid, &n );
+      }
+   }
+
+   *nseen += n;
+   return n;
+}
+
+
+/**
+ * @brief Gets the pilot with the lowest cost around a point.
+ *
+ * The cost function gets the squared distance to the point and returns a
+ *  negative value to reject the pilot.  It must never return less than
+ *  scale times the squared distance, since that is what lets the search stop
+ *  early.  A scale of 0 forces every pilot to be checked.  Ties go to the
+ *  pilot earliest in the stack, like a linear scan.
+ *
+ *    @param x X position of the point.
+ *    @param y Y position of the point.
+ *    @param scale Lower bound of the cost per squared distance.
+ *    @param cost Cost function.
+ *    @param data Data passed to the cost function.
+ *    @param[out] best Cost of the pilot found, may be NULL.
+ *    @return The pilot with the lowest cost or NULL if none was accepted.
+ */
+Pilot* pilot_gridNearest( double x, double y, double scale,
+      PilotGridCost cost, void *data, double *best )
+{
+   int i, r, n, nseen, id, bid;
+   double c, bc, d, d2;
+   Pilot *t;
+
+   grid_stampNext( &grid_q );
+
+   bid   = -1;
+   bc    = 0.;
+   nseen = 0;
+   ring_cx = GRID_CELL( x );
+   ring_cy = GRID_CELL( y );
+   /* Small stacks don't pay for the ring walk. */
+   r = (grid_npilots < GRID_LINEAR) ? GRID_BUCKETS : 0;
+   for ( ; (n = grid_ringNext( r, &nseen )) >= 0; r++) {
+      for (i=0; i<n; i++) {
+         id = grid_nearid[i];
+         t  = grid_pilots[id];
+         d2 = pow2(t->solid->pos.x - x) + pow2(t->solid->pos.y - y);
+         c  = cost( t, d2, data );
+         if (c < 0.)
+            continue;
+         if ((bid < 0) || (c < bc) || ((c == bc) && (id < bid))) {
+            bc  = c;
+            bid = id;
+         }
+      }
+
+      /* Nothing outside the square can be cheaper. */
+      d = r * PILOT_GRID_CELL;
+      if ((bid >= 0) && (scale > 0.) && (bc < scale * d*d))
+         break;
+   }
+
+   if (best != NULL)
+      *best = bc;
+   return (bid >= 0) ? grid_pilots[ bid ] : NULL;
+}
+
+
+/**
+ * @brief Gets the k pilots nearest to a point.
+ *
+ * The list is owned by the grid and is only valid until the next proximity
+ *  search.
+ *
+ *    @param x X position of the point.
+ *    @param y Y position of the point.
+ *    @param k Maximum amount of pilots to get.
+ *    @param faction Only get pilots of this faction, -1 for any faction.
+ *    @param[out] list Pilots sorted by distance, nearest first.
+ *    @return Number of pilots found.
+ */
+int pilot_gridNearestK( double x, double y, int k, int faction, Pilot ***list )
+{
+   int i, j, r, n, nseen, id, m;
+   double d, d2;
+   Pilot *t;
+   int *kid;
+
+   grid_stampNext( &grid_q );
+
+   grid_nnear = 0;
+   if (k > grid_npilots)
+      k = grid_npilots;
+   if (k <= 0) {
+      *list = grid_near;
+      return 0;
+   }
+
+   /* Best ids are kept in the candidates, which collision queries don't need now. */
+   kid   = grid_q.cand;
+   m     = 0;
+   nseen = 0;
+   ring_cx = GRID_CELL( x );
+   ring_cy = GRID_CELL( y );
+   r = (grid_npilots < GRID_LINEAR) ? GRID_BUCKETS : 0;
+   for ( ; (n = grid_ringNext( r, &nseen )) >= 0; r++) {
+      for (i=0; i<n; i++) {
+         id = grid_nearid[i];
+         t  = grid_pilots[id];
+         if ((faction >= 0) && (t->faction != faction))
+            continue;
+         d2 = pow2(t->solid->pos.x - x) + pow2(t->solid->pos.y - y);
+         if ((m == k) && (d2 >= grid_neard[m-1]))
+            continue;
+
+         /* Insert sorted, dropping the farthest if full. */
+         if (m < k)
+            m++;
+         for (j=m-1; (j>0) && ((grid_neard[j-1] > d2) ||
+                  ((grid_neard[j-1] == d2) && (kid[j-1] > id))); j--) {
+            grid_neard[j] = grid_neard[j-1];
+            kid[j]        = kid[j-1];
+         }
+         grid_neard[j] = d2;
+         kid[j]        = id;
+      }
+
+      d = r * PILOT_GRID_CELL;
+      if ((m == k) && (grid_neard[m-1] < d*d))
+         break;
+   }
+
+   for (i=0; i<m; i++)
+      grid_near[i] = grid_pilots[ kid[i] ];
+   grid_q.ncand = 0;
+   grid_nnear = m;
+   *list = grid_near;
+   return m;
+}
+
+
+/**
+ * @brief Gets the pilots within a radius of a point.
+ *
+ * The list is owned by the grid and is only valid until the next proximity
+ *  search.
+ *
+ *    @param x X position of the point.
+ *    @param y Y position of the point.
+ *    @param r Radius to search.
+ *    @param faction Only get pilots of this faction, -1 for any faction.
+ *    @param[out] list Pilots in stack order.
+ *    @return Number of pilots found.
+ */
+int pilot_gridQueryRadius( double x, double y, double r, int faction,
+      Pilot ***list )
+{
+   int i, n, m, cx, cy, cx1, cy1, cx2, cy2;
+   Pilot *t;
+
+   grid_stampNext( &grid_q );
+
+   n   = 0;
+   cx1 = GRID_CELL( x - r );
+   cy1 = GRID_CELL( y - r );
+   cx2 = GRID_CELL( x + r );
+   cy2 = GRID_CELL( y + r );
+   if ((grid_npilots < GRID_LINEAR) ||
+         ((double)(cx2-cx1+1) * (double)(cy2-cy1+1) >= GRID_BUCKETS)) {
+      for (i=0; i<grid_npilots; i++)
+         grid_nearid[ n++ ] = i;
+   }
+   else {
+      for (cy=cy1; cy<=cy2; cy++)
+         for (cx=cx1; cx<=cx2; cx++)
+            grid_addBucketTo( &grid_q, GRID_HASH(cx,cy), grid_nearid, &n );
+      qsort( grid_nearid, n, sizeof(int), grid_cmp );
+   }
+
+   /* Narrowphase. */
+   m = 0;
+   for (i=0; i<n; i++) {
+      t = grid_pilots[ grid_nearid[i] ];
+      if ((faction >= 0) && (t->faction != faction))
+         continue;
+      if (pow2(t->solid->pos.x - x) + pow2(t->solid->pos.y - y) > r*r)
+         continue;
+      grid_near[ m++ ] = t;
+   }
+
+   grid_nnear = m;
+   *list = grid_near;
+   return m;
+}
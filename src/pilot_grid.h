@@ -0,0 +1,72 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef PILOT_GRID_H
+#  define PILOT_GRID_H
+
+
+#include "pilot.h"
+
+
+#define PILOT_GRID_CELL       256. /**< Size of a grid cell in world units. */
+
+
+/**
+ * @brief Cost of a pilot for pilot_gridNearest, negative rejects it.
+ */
+typedef double (*PilotGridCost)( const Pilot *t, double d2, void *data );
+
+
+/**
+ * @brief Scratch space of collision queries.
+ *
+ * Each thread querying the grid at once needs its own.
+ */
+typedef struct PilotGridQuery_ {
+   unsigned int *stamp; /**< Query stamp per grid id to avoid duplicates. */
+   unsigned int curstamp; /**< Current query stamp. */
+   unsigned int gen; /**< Grid build the stamps belong to. */
+   int *cand; /**< Candidate grid ids of the last query. */
+   Pilot **out; /**< Candidate pilots of the last query. */
+   int ncand; /**< Number of candidates of the last query. */
+   int m; /**< Pilots the scratch space can hold. */
+} PilotGridQuery;
+
+
+/*
+ * Building.
+ */
+void pilot_gridUpdate (void);
+void pilot_gridInvalidate (void);
+void pilot_gridEnsure (void);
+void pilot_gridFree (void);
+
+/*
+ * Queries.
+ */
+int pilot_gridQueryRect( double x1, double y1, double x2, double y2,
+      Pilot ***list );
+int pilot_gridQueryLine( const Vector2d *pos, double dir, double len,
+      Pilot ***list );
+void pilot_gridQueryInit( PilotGridQuery *q );
+void pilot_gridQueryFree( PilotGridQuery *q );
+int pilot_gridQueryRectWith( PilotGridQuery *q,
+      double x1, double y1, double x2, double y2, Pilot ***list );
+int pilot_gridQueryLineWith( PilotGridQuery *q, const Vector2d *pos,
+      double dir, double len, Pilot ***list );
+double pilot_gridMaxWidth (void);
+double pilot_gridMinHide (void);
+
+/*
+ * Proximity searches.
+ */
+Pilot* pilot_gridNearest( double x, double y, double scale,
+      PilotGridCost cost, void *data, double *best );
+int pilot_gridNearestK( double x, double y, int k, int faction, Pilot ***list );
+int pilot_gridQueryRadius( double x, double y, double r, int faction,
+      Pilot ***list );
+
+
+#endif /* PILOT_GRID_H */
@@ -186,6 +186,38 @@ double pilot_heatUpdateSlot( Pilot *p, PilotOutfitSlot *o, double dt )
 }
 
 
+/**
+ * @brief Heats all the active slots of a pilot.
+ *
+ * Same as calling pilot_heatUpdateSlot() on each active slot, but the
+ *  chassis state is loaded once instead of per slot.
+ *
+ *    @param p Pilot to update.
+ *    @param dt Delta tick.
+ *    @return The energy transferred.
+ */
+double pilot_heatUpdateSlots( Pilot *p, double dt )
+{
+   double Q, Qs, T, k;
+   int i;
+   PilotOutfitSlot *o;
+
+   T = p->heat_T;
+   k = -p->heat_cond;
+   Q = 0.;
+   for (i=0; i<p->noutfits; i++) {
+      o = p->outfits[i];
+      if ((o->outfit == NULL) || !o->active)
+         continue;
+
+      Qs         = k * (o->heat_T - T) * o->heat_area * dt;
+      o->heat_T += Qs / o->heat_C;
+      Q         += Qs;
+   }
+   return Q;
+}
+
+
 /**
  * @brief Heats the pilot's ship.
  *
@@ -209,11 +241,12 @@ double pilot_heatUpdateSlot( Pilot *p, PilotOutfitSlot *o, double dt )
  */
 void pilot_heatUpdateShip( Pilot *p, double Q_cond, double dt )
 {
-   double Q, Q_rad;
+   double Q, Q_rad, T2;
 
    /* Calculate radiation. */
+   T2          = p->heat_T * p->heat_T;
    Q_rad       = CONST_STEFAN_BOLTZMANN * p->heat_area * p->heat_emis *
-         (CONST_SPACE_STAR_TEMP_4 - pow(p->heat_T,4.)) * dt;
+         (CONST_SPACE_STAR_TEMP_4 - T2*T2) * dt;
 
    /* Total heat movement. */
    Q           = Q_rad - Q_cond;
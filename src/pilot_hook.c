@@ -25,8 +25,59 @@
 #include "array.h"
 
 
+#define PILOT_HOOK_BIT(t)  (1U << (t)) /**< Bit of a hook type in the masks. */
+
+
 static PilotHook *pilot_globalHooks = NULL; /**< Global hooks that affect all pilots. */
+static unsigned int pilot_globalMask = 0; /**< Hook types in pilot_globalHooks. */
 static int pilot_hookCleanup = 0; /**< Are hooks being removed from a pilot? */
+static int pilot_nattached = 0; /**< Hooks attached to individual pilots. */
+
+
+static void pilot_hookMask( Pilot *p );
+static void pilots_globalMask (void);
+
+
+/**
+ * @brief Checks to see if anything listens to a pilot hook type.
+ *
+ * Both the pilot's own hooks and the global pilot hooks are seen by looking
+ *  at masks, so events nobody hooked cost nothing.
+ *
+ *    @param p Pilot to check.
+ *    @param hook_type Type of hook.
+ *    @return 1 if running the hook type on the pilot could run hooks.
+ */
+int pilot_hasHook( const Pilot *p, int hook_type )
+{
+   return ((p->hook_mask | pilot_globalMask) & PILOT_HOOK_BIT(hook_type)) != 0;
+}
+
+
+/**
+ * @brief Recomputes the hook mask of a pilot.
+ */
+static void pilot_hookMask( Pilot *p )
+{
+   int i;
+   p->hook_mask = 0;
+   for (i=0; i<p->nhooks; i++)
+      p->hook_mask |= PILOT_HOOK_BIT( p->hooks[i].type );
+}
+
+
+/**
+ * @brief Recomputes the mask of the global pilot hooks.
+ */
+static void pilots_globalMask (void)
+{
+   int i;
+   pilot_globalMask = 0;
+   if (pilot_globalHooks == NULL)
+      return;
+   for (i=0; i<array_size(pilot_globalHooks); i++)
+      pilot_globalMask |= PILOT_HOOK_BIT( pilot_globalHooks[i].type );
+}
 
 
 /**
@@ -41,6 +92,10 @@ int pilot_runHookParam( Pilot* p, int hook_type, HookParam* param, int nparam )
    int n, i, run, ret;
    HookParam hstaparam[5], *hdynparam, *hparam;
 
+   /* Nobody is listening. */
+   if (!pilot_hasHook( p, hook_type ))
+      return 0;
+
    /* Set up hook parameters. */
    if (nparam <= 3) {
       hstaparam[0].type       = HOOK_PARAM_PILOT;
@@ -92,9 +147,6 @@ int pilot_runHookParam( Pilot* p, int hook_type, HookParam* param, int nparam )
    if (hdynparam != NULL)
       free( hdynparam );
 
-   if (run > 0)
-      claim_activateAll(); /* Reset claims. */
-
    return run;
 }
 
@@ -125,6 +177,8 @@ void pilot_addHook( Pilot *pilot, int type, unsigned int hook )
    pilot->hooks = realloc( pilot->hooks, sizeof(PilotHook) * pilot->nhooks );
    pilot->hooks[pilot->nhooks-1].type  = type;
    pilot->hooks[pilot->nhooks-1].id    = hook;
+   pilot->hook_mask |= PILOT_HOOK_BIT( type );
+   pilot_nattached++;
 }
 
 
@@ -143,6 +197,7 @@ void pilots_addGlobalHook( int type, unsigned int hook )
    phook       = &array_grow( &pilot_globalHooks );
    phook->type = type;
    phook->id   = hook;
+   pilot_globalMask |= PILOT_HOOK_BIT( type );
 }
 
 
@@ -160,6 +215,7 @@ void pilots_rmGlobalHook( unsigned int hook )
    for (i=0; i<array_size(pilot_globalHooks); i++) {
       if (pilot_globalHooks[i].id == hook) {
          array_erase( &pilot_globalHooks, &pilot_globalHooks[i], &pilot_globalHooks[i+1] );
+         pilots_globalMask();
          return;
       }
    }
@@ -176,6 +232,7 @@ void pilots_clearGlobalHooks (void)
       return;
 
    array_erase( &pilot_globalHooks, pilot_globalHooks, &pilot_globalHooks[ array_size(pilot_globalHooks) ] );
+   pilot_globalMask = 0;
 }
 
 
@@ -197,6 +254,10 @@ void pilots_rmHook( unsigned int hook )
    /* Remove global hook first. */
    pilots_rmGlobalHook( hook );
 
+   /* No pilot has hooks, which is the usual case for hooks being freed. */
+   if (pilot_nattached <= 0)
+      return;
+
    plist = pilot_getAll( &n );
    for (i=0; i<n; i++) {
       p = plist[i];
@@ -212,8 +273,10 @@ void pilots_rmHook( unsigned int hook )
             continue;
 
          p->nhooks--;
+         pilot_nattached--;
          memmove( &p->hooks[j], &p->hooks[j+1], sizeof(PilotHook) * (p->nhooks-j) );
          j--; /* Dun like it but we have to keep iterator sane. */
+         pilot_hookMask( p );
       }
    }
 }
@@ -239,9 +302,11 @@ void pilot_clearHooks( Pilot *p )
    pilot_hookCleanup = 0;
 
    /* Clear the hooks. */
+   pilot_nattached -= p->nhooks;
    free(p->hooks);
    p->hooks  = NULL;
    p->nhooks = 0;
+   p->hook_mask = 0;
 }
 
 
@@ -256,6 +321,7 @@ void pilot_freeGlobalHooks (void)
       array_free( pilot_globalHooks );
       pilot_globalHooks = NULL;
    }
+   pilot_globalMask = 0;
 }
 
 
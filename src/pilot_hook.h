@@ -15,6 +15,7 @@
  */
 void pilot_addHook( Pilot *pilot, int type, unsigned int hook );
 int pilot_runHook( Pilot* p, int hook_type );
+int pilot_hasHook( const Pilot *p, int hook_type );
 void pilots_rmHook( unsigned int hook );
 void pilot_clearHooks( Pilot *p );
 
@@ -28,6 +28,9 @@
  * Prototypes.
  */
 static int pilot_hasOutfitLimit( Pilot *p, const char *limit );
+static void pilot_calcStatsSlot( Pilot *pilot, const PilotOutfitSlot *slot,
+      const Outfit *o, int sign );
+static void pilot_calcStatsFinish( Pilot *pilot );
 
 
 /**
@@ -42,7 +45,7 @@ static int pilot_hasOutfitLimit( Pilot *p, const char *limit );
 void pilot_lockUpdateSlot( Pilot *p, PilotOutfitSlot *o, Pilot *t, double *a, double dt )
 {
    double max, old;
-   double x,y, ang, arc;
+   double arc;
    int locked;
 
    /* No target. */
@@ -58,12 +61,8 @@ void pilot_lockUpdateSlot( Pilot *p, PilotOutfitSlot *o, Pilot *t, double *a, do
    if (arc > 0.) {
 
       /* We use an external variable to set and update the angle if necessary. */
-      if (*a < 0.) {
-         x     = t->solid->pos.x - p->solid->pos.x;
-         y     = t->solid->pos.y - p->solid->pos.y;
-         ang   = ANGLE( x, y );
-         *a    = fabs( angle_diff( ang, p->solid->dir ) );
-      }
+      if (*a < 0.)
+         *a    = fabs( angle_diff( VANGLE( pilot_weapAim( p, t )->rel ), p->solid->dir ) );
 
       /* Decay if not in arc. */
       if (*a > arc) {
@@ -306,6 +305,9 @@ int pilot_addOutfitRaw( Pilot* pilot, Outfit* outfit, PilotOutfitSlot *s )
    /* Set some default parameters. */
    s->timer    = 0.;
 
+   /* Get its sounds ready before it's used. */
+   outfit_prefetchSounds( outfit );
+
    /* Some per-case scenarios. */
    if (outfit_isFighterBay(outfit)) {
       s->u.ammo.outfit   = NULL;
@@ -401,7 +403,7 @@ int pilot_addOutfit( Pilot* pilot, Outfit* outfit, PilotOutfitSlot *s )
    ret = pilot_addOutfitRaw( pilot, outfit, s );
 
    /* Recalculate the stats */
-   pilot_calcStats(pilot);
+   pilot_calcStatsOutfit( pilot, s, outfit, 1 );
 
    return ret;
 }
@@ -452,6 +454,7 @@ int pilot_rmOutfitRaw( Pilot* pilot, PilotOutfitSlot *s )
 int pilot_rmOutfit( Pilot* pilot, PilotOutfitSlot *s )
 {
    const char *str;
+   Outfit *o;
    int ret;
 
    str = pilot_canEquip( pilot, s, NULL );
@@ -461,10 +464,12 @@ int pilot_rmOutfit( Pilot* pilot, PilotOutfitSlot *s )
       return -1;
    }
 
+   o   = s->outfit;
    ret = pilot_rmOutfitRaw( pilot, s );
 
    /* recalculate the stats */
-   pilot_calcStats(pilot);
+   if (o != NULL)
+      pilot_calcStatsOutfit( pilot, s, o, 0 );
 
    return ret;
 }
@@ -859,126 +864,111 @@ char* pilot_getOutfits( const Pilot* pilot )
 
 
 /**
- * @brief Recalculates the pilot's stats based on his outfits.
+ * @brief Adds or removes the part of an outfit that adds up linearly.
  *
- *    @param pilot Pilot to recalculate his stats.
+ *    @param pilot Pilot to update the outfit totals of.
+ *    @param slot Slot the outfit is in.
+ *    @param o Outfit to add or remove.
+ *    @param sign 1 to add the outfit, -1 to remove it.
  */
-void pilot_calcStats( Pilot* pilot )
+static void pilot_calcStatsSlot( Pilot *pilot, const PilotOutfitSlot *slot,
+      const Outfit *o, int sign )
+{
+   PilotStatsSum *sum;
+
+   sum = &pilot->stats_sum;
+
+   /* Modify CPU. */
+   sum->cpu          += sign * outfit_cpu(o);
+
+   /* Add mass. */
+   sum->mass_outfit  += sign * o->mass;
+
+   /* Keep a separate counter for required (core) outfits. */
+   if (sp_required( o->slot.spid ))
+      sum->base_mass += sign * o->mass;
+
+   /* Active outfits must be on to affect stuff. */
+   if (slot->active && !(slot->state==PILOT_OUTFIT_ON))
+      return;
+
+   if (outfit_isMod(o)) { /* Modification */
+      /* Movement. */
+      sum->thrust       += sign * o->u.mod.thrust;
+      sum->turn         += sign * o->u.mod.turn;
+      sum->speed        += sign * o->u.mod.speed;
+      /* Health. */
+      sum->absorb       += sign * o->u.mod.absorb;
+      sum->armour       += sign * o->u.mod.armour;
+      sum->armour_regen += sign * o->u.mod.armour_regen;
+      sum->shield       += sign * o->u.mod.shield;
+      sum->shield_regen += sign * o->u.mod.shield_regen;
+      sum->energy       += sign * o->u.mod.energy;
+      sum->energy_regen += sign * o->u.mod.energy_regen;
+      sum->energy_loss  += sign * o->u.mod.energy_loss;
+      /* Fuel. */
+      sum->fuel         += sign * o->u.mod.fuel;
+      /* Misc. */
+      sum->cargo        += sign * o->u.mod.cargo;
+      sum->mass_outfit  += sign * o->u.mod.mass_rel * pilot->ship->mass;
+      sum->crew         += sign * o->u.mod.crew_rel * pilot->ship->crew;
+      /*
+       * Stats.
+       */
+      ss_statsModSum( &sum->stats, o->u.mod.stats, &sum->amount, sign );
+   }
+}
+
+
+/**
+ * @brief Derives the pilot's stats from his outfit totals.
+ *
+ *    @param pilot Pilot to finish calculating the stats of.
+ */
+static void pilot_calcStatsFinish( Pilot *pilot )
 {
    int i;
-   Outfit* o;
    PilotOutfitSlot *slot;
    double ac, sc, ec, fc; /* temporary health coefficients to set */
-   ShipStats amount, *s, *default_s;
+   ShipStats *s, *default_s, *amount;
+   const PilotStatsSum *sum;
+
+   sum = &pilot->stats_sum;
 
-   /*
-    * set up the basic stuff
-    */
-   /* mass */
-   pilot->solid->mass   = pilot->ship->mass;
-   pilot->base_mass     = pilot->solid->mass;
-   /* cpu */
-   pilot->cpu           = 0.;
-   /* movement */
-   pilot->thrust_base   = pilot->ship->thrust;
-   pilot->turn_base     = pilot->ship->turn;
-   pilot->speed_base    = pilot->ship->speed;
-   /* crew */
-   pilot->crew          = pilot->ship->crew;
-   /* cargo */
-   pilot->cap_cargo     = pilot->ship->cap_cargo;
-   /* fuel_consumption. */
-   pilot->fuel_consumption = pilot->ship->fuel_consumption;
    /* health */
    ac = (pilot->armour_max > 0.) ? pilot->armour / pilot->armour_max : 0.;
    sc = (pilot->shield_max > 0.) ? pilot->shield / pilot->shield_max : 0.;
    ec = (pilot->energy_max > 0.) ? pilot->energy / pilot->energy_max : 0.;
    fc = (pilot->fuel_max   > 0.) ? pilot->fuel   / pilot->fuel_max   : 0.;
-   pilot->armour_max    = pilot->ship->armour;
-   pilot->shield_max    = pilot->ship->shield;
-   pilot->fuel_max      = pilot->ship->fuel;
-   pilot->armour_regen  = pilot->ship->armour_regen;
-   pilot->shield_regen  = pilot->ship->shield_regen;
-   /* Absorption. */
-   pilot->dmg_absorb    = pilot->ship->dmg_absorb;
-   /* Energy. */
-   pilot->energy_max    = pilot->ship->energy;
-   pilot->energy_regen  = pilot->ship->energy_regen;
-   pilot->energy_loss   = 0.; /* Initially no net loss. */
-   /* Stats. */
-   s = &pilot->stats;
-   *s = pilot->ship->stats_array;
-   memset( &amount, 0, sizeof(ShipStats) );
 
-   /*
-    * Now add outfit changes
-    */
-   pilot->mass_outfit   = 0.;
-   pilot->jamming       = 0;
+   /* Totals. */
+   pilot->cpu           = sum->cpu;
+   pilot->mass_outfit   = sum->mass_outfit;
+   pilot->base_mass     = sum->base_mass;
+   pilot->thrust_base   = sum->thrust;
+   pilot->turn_base     = sum->turn;
+   pilot->speed_base    = sum->speed;
+   pilot->dmg_absorb    = sum->absorb;
+   pilot->armour_max    = sum->armour;
+   pilot->armour_regen  = sum->armour_regen;
+   pilot->shield_max    = sum->shield;
+   pilot->shield_regen  = sum->shield_regen;
+   pilot->energy_max    = sum->energy;
+   pilot->energy_regen  = sum->energy_regen;
+   pilot->energy_loss   = sum->energy_loss;
+   pilot->fuel_max      = sum->fuel;
+   pilot->cap_cargo     = sum->cargo;
+   pilot->crew          = sum->crew;
+   pilot->stats         = sum->stats;
+   ss_statsClamp( &pilot->stats );
+   dtype_calcMods( pilot->dmods, &pilot->stats );
+
+   /* Ammo changes all the time so it's not part of the totals. */
    for (i=0; i<pilot->noutfits; i++) {
       slot = pilot->outfits[i];
-      o    = slot->outfit;
-
-      /* Outfit must exist. */
-      if (o==NULL)
-         continue;
-
-      /* Modify CPU. */
-      pilot->cpu           += outfit_cpu(o);
-
-      /* Add mass. */
-      pilot->mass_outfit   += o->mass;
-
-      /* Keep a separate counter for required (core) outfits. */
-      if (sp_required( o->slot.spid ))
-         pilot->base_mass += o->mass;
-
-      /* Add ammo mass. */
-      if (outfit_ammo(o) != NULL)
-         if (slot->u.ammo.outfit != NULL)
-            pilot->mass_outfit += slot->u.ammo.quantity * slot->u.ammo.outfit->mass;
-
-      if (outfit_isAfterburner(o)) /* Afterburner */
-         pilot->afterburner = pilot->outfits[i]; /* Set afterburner */
-
-      /* Active outfits must be on to affect stuff. */
-      if (slot->active && !(slot->state==PILOT_OUTFIT_ON))
-         continue;
-
-      if (outfit_isMod(o)) { /* Modification */
-         /* Movement. */
-         pilot->thrust_base   += o->u.mod.thrust;
-         pilot->turn_base     += o->u.mod.turn;
-         pilot->speed_base    += o->u.mod.speed;
-         /* Health. */
-         pilot->dmg_absorb    += o->u.mod.absorb;
-         pilot->armour_max    += o->u.mod.armour;
-         pilot->armour_regen  += o->u.mod.armour_regen;
-         pilot->shield_max    += o->u.mod.shield;
-         pilot->shield_regen  += o->u.mod.shield_regen;
-         pilot->energy_max    += o->u.mod.energy;
-         pilot->energy_regen  += o->u.mod.energy_regen;
-         pilot->energy_loss   += o->u.mod.energy_loss;
-         /* Fuel. */
-         pilot->fuel_max      += o->u.mod.fuel;
-         /* Misc. */
-         pilot->cap_cargo     += o->u.mod.cargo;
-         pilot->mass_outfit   += o->u.mod.mass_rel * pilot->ship->mass;
-         pilot->crew          += o->u.mod.crew_rel * pilot->ship->crew;
-         /*
-          * Stats.
-          */
-         ss_statsModFromList( s, o->u.mod.stats, &amount );
-
-      }
-      else if (outfit_isAfterburner(o)) { /* Afterburner */
-         pilot_setFlag( pilot, PILOT_AFTERBURNER ); /* We use old school flags for this still... */
-         pilot->energy_loss += pilot->afterburner->outfit->u.afb.energy; /* energy loss */
-      }
-      else if (outfit_isJammer(o)) { /* Jammer */
-         pilot->jamming        = 1;
-         pilot->energy_loss   += o->u.jam.energy;
-      }
+      if ((slot->outfit != NULL) && (outfit_ammo(slot->outfit) != NULL) &&
+            (slot->u.ammo.outfit != NULL))
+         pilot->mass_outfit += slot->u.ammo.quantity * slot->u.ammo.outfit->mass;
    }
 
    if (!pilot_isFlag( pilot, PILOT_AFTERBURNER ))
@@ -987,6 +977,7 @@ void pilot_calcStats( Pilot* pilot )
    /* Slot voodoo. */
    s = &pilot->stats;
    default_s = &pilot->ship->stats_array;
+   amount = &pilot->stats_sum.amount;
 
    /* Fire rate:
     *  amount = p * exp( -0.15 * (n-1) )
@@ -995,19 +986,19 @@ void pilot_calcStats( Pilot* pilot )
     *  3x 15% -> 33.33%
     *  6x 15% -> 42.51%
     */
-   if (amount.fwd_firerate > 0) {
-      s->fwd_firerate = default_s->fwd_firerate + (s->fwd_firerate-default_s->fwd_firerate) * exp( -0.15 * (double)(MAX(amount.fwd_firerate-1.,0)) );
+   if (amount->fwd_firerate > 0) {
+      s->fwd_firerate = default_s->fwd_firerate + (s->fwd_firerate-default_s->fwd_firerate) * exp( -0.15 * (double)(MAX(amount->fwd_firerate-1.,0)) );
    }
    /* Cruiser. */
-   if (amount.tur_firerate > 0) {
-      s->tur_firerate = default_s->tur_firerate + (s->tur_firerate-default_s->tur_firerate) * exp( -0.15 * (double)(MAX(amount.tur_firerate-1.,0)) );
+   if (amount->tur_firerate > 0) {
+      s->tur_firerate = default_s->tur_firerate + (s->tur_firerate-default_s->tur_firerate) * exp( -0.15 * (double)(MAX(amount->tur_firerate-1.,0)) );
    }
    /*
     * Electronic warfare setting base parameters.
     */
-   s->ew_hide           = default_s->ew_hide + (s->ew_hide-default_s->ew_hide)                      * exp( -0.2 * (double)(MAX(amount.ew_hide-1.,0)) );
-   s->ew_detect         = default_s->ew_detect + (s->ew_detect-default_s->ew_detect)                * exp( -0.2 * (double)(MAX(amount.ew_detect-1.,0)) );
-   s->ew_jump_detect    = default_s->ew_jump_detect + (s->ew_jump_detect-default_s->ew_jump_detect) * exp( -0.2 * (double)(MAX(amount.ew_jump_detect-1.,0)) );
+   s->ew_hide           = default_s->ew_hide + (s->ew_hide-default_s->ew_hide)                      * exp( -0.2 * (double)(MAX(amount->ew_hide-1.,0)) );
+   s->ew_detect         = default_s->ew_detect + (s->ew_detect-default_s->ew_detect)                * exp( -0.2 * (double)(MAX(amount->ew_detect-1.,0)) );
+   s->ew_jump_detect    = default_s->ew_jump_detect + (s->ew_jump_detect-default_s->ew_jump_detect) * exp( -0.2 * (double)(MAX(amount->ew_jump_detect-1.,0)) );
 
    /* Square the internal values to speed up comparisons. */
    pilot->ew_base_hide   = pow2( s->ew_hide );
@@ -1070,6 +1061,112 @@ void pilot_calcStats( Pilot* pilot )
 }
 
 
+/**
+ * @brief Recalculates the pilot's stats based on his outfits.
+ *
+ *    @param pilot Pilot to recalculate his stats.
+ */
+void pilot_calcStats( Pilot* pilot )
+{
+   int i;
+   Outfit* o;
+   PilotOutfitSlot *slot;
+   PilotStatsSum *sum;
+
+   /*
+    * set up the basic stuff
+    */
+   sum = &pilot->stats_sum;
+   memset( sum, 0, sizeof(PilotStatsSum) );
+   /* mass */
+   pilot->solid->mass   = pilot->ship->mass;
+   sum->base_mass       = pilot->ship->mass;
+   /* movement */
+   sum->thrust          = pilot->ship->thrust;
+   sum->turn            = pilot->ship->turn;
+   sum->speed           = pilot->ship->speed;
+   /* crew */
+   sum->crew            = pilot->ship->crew;
+   /* cargo */
+   sum->cargo           = pilot->ship->cap_cargo;
+   /* fuel_consumption. */
+   pilot->fuel_consumption = pilot->ship->fuel_consumption;
+   /* health */
+   sum->armour          = pilot->ship->armour;
+   sum->shield          = pilot->ship->shield;
+   sum->fuel            = pilot->ship->fuel;
+   sum->armour_regen    = pilot->ship->armour_regen;
+   sum->shield_regen    = pilot->ship->shield_regen;
+   /* Absorption. */
+   sum->absorb          = pilot->ship->dmg_absorb;
+   /* Energy. */
+   sum->energy          = pilot->ship->energy;
+   sum->energy_regen    = pilot->ship->energy_regen;
+   /* Stats. */
+   sum->stats           = pilot->ship->stats_array;
+
+   /*
+    * Now add outfit changes
+    */
+   pilot->jamming       = 0;
+   for (i=0; i<pilot->noutfits; i++) {
+      slot = pilot->outfits[i];
+      o    = slot->outfit;
+
+      /* Outfit must exist. */
+      if (o==NULL)
+         continue;
+
+      pilot_calcStatsSlot( pilot, slot, o, 1 );
+
+      if (outfit_isAfterburner(o)) /* Afterburner */
+         pilot->afterburner = pilot->outfits[i]; /* Set afterburner */
+
+      /* Active outfits must be on to affect stuff. */
+      if (slot->active && !(slot->state==PILOT_OUTFIT_ON))
+         continue;
+
+      if (outfit_isAfterburner(o)) { /* Afterburner */
+         pilot_setFlag( pilot, PILOT_AFTERBURNER ); /* We use old school flags for this still... */
+         sum->energy_loss += pilot->afterburner->outfit->u.afb.energy; /* energy loss */
+      }
+      else if (outfit_isJammer(o)) { /* Jammer */
+         pilot->jamming     = 1;
+         sum->energy_loss  += o->u.jam.energy;
+      }
+   }
+   sum->valid = 1;
+
+   pilot_calcStatsFinish( pilot );
+}
+
+
+/**
+ * @brief Updates the pilot's stats for a single outfit added or removed.
+ *
+ * Only the outfit's own contribution is applied, afterburners and jammers or
+ *  totals gone stale through other raw changes fall back to pilot_calcStats().
+ *  Call it right after pilot_addOutfitRaw() or pilot_rmOutfitRaw().
+ *
+ *    @param pilot Pilot to update the stats of.
+ *    @param s Slot that changed.
+ *    @param o Outfit added to or removed from the slot.
+ *    @param add 1 if the outfit was added, 0 if it was removed.
+ */
+void pilot_calcStatsOutfit( Pilot *pilot, const PilotOutfitSlot *s,
+      const Outfit *o, int add )
+{
+   /* Doesn't just add up. */
+   if (!pilot->stats_sum.valid || outfit_isAfterburner(o) || outfit_isJammer(o)) {
+      pilot_calcStats( pilot );
+      return;
+   }
+
+   pilot_calcStatsSlot( pilot, s, o, add ? 1 : -1 );
+   pilot_calcStatsFinish( pilot );
+}
+
+
 /**
  * @brief Cures the pilot as if he was landed.
  */
@@ -1118,5 +1215,3 @@ void pilot_updateMass( Pilot *pilot )
    /* Need to recalculate electronic warfare mass change. */
    pilot_ewUpdateStatic( pilot );
 }
-
-
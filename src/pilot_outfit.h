@@ -39,6 +39,8 @@ void pilot_lockClear( Pilot *p );
 /* Other. */
 char* pilot_getOutfits( const Pilot *pilot );
 void pilot_calcStats( Pilot *pilot );
+void pilot_calcStatsOutfit( Pilot *pilot, const PilotOutfitSlot *s,
+      const Outfit *o, int add );
 void pilot_updateMass( Pilot *pilot );
 void pilot_healLanded( Pilot *pilot );
 
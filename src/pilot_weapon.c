@@ -51,6 +51,15 @@ static int pilot_weapSetFire( Pilot *p, PilotWeaponSet *ws, int level );
 static int pilot_shootWeaponSetOutfit( Pilot* p, PilotWeaponSet *ws, Outfit *o, int level, double time );
 static int pilot_shootWeapon( Pilot* p, PilotOutfitSlot* w, double time );
 static void pilot_weapSetUpdateRange( PilotWeaponSet *ws );
+static PilotAim* pilot_weapAimGet( const Pilot *p, const Pilot *t );
+static double pilot_weapIntercept( const Pilot *parent, const Pilot *target,
+      Vector2d *rel, double speed, int absolute );
+
+
+static PilotAim *weap_aim     = NULL; /**< Target solutions indexed by pilot_index(). */
+static int weap_naim          = 0; /**< Number of target solutions allocated. */
+static unsigned int weap_aimGen = 1; /**< Current step of the target solutions. */
+static PilotAim weap_aimTmp; /**< Target solution of pilots without an index. */
 
 
 /**
@@ -568,6 +577,8 @@ static void pilot_weapSetUpdateRange( PilotWeaponSet *ws )
          ws->range[i] = 0.;
          ws->speed[i] = 0.;
       }
+      ws->range_all = 0.;
+      ws->speed_all = 0.;
       return;
    }
 
@@ -609,6 +620,8 @@ static void pilot_weapSetUpdateRange( PilotWeaponSet *ws )
    }
 
    /* Postprocess. */
+   ws->range_all = 0.;
+   ws->speed_all = 0.;
    for (i=0; i<PILOT_WEAPSET_MAX_LEVELS; i++) {
       /* Postprocess range. */
       if (range_num[i] == 0)
@@ -621,6 +634,10 @@ static void pilot_weapSetUpdateRange( PilotWeaponSet *ws )
          ws->speed[i] = 0;
       else
          ws->speed[i] = speed_accum[i] / (double) speed_num[i];
+
+      /* Queried every tick by the AI, so keep the totals around. */
+      ws->range_all += ws->range[i];
+      ws->speed_all += ws->speed[i];
    }
 }
 
@@ -635,19 +652,11 @@ static void pilot_weapSetUpdateRange( PilotWeaponSet *ws )
 double pilot_weapSetRange( Pilot* p, int id, int level )
 {
    PilotWeaponSet *ws;
-   int i;
-   double range;
 
    ws = pilot_weapSet(p,id);
-   if (level < 0) {
-      range = 0;
-      for (i=0; i<PILOT_WEAPSET_MAX_LEVELS; i++)
-         range += ws->range[i];
-   }
-   else
-      range = ws->range[ level ];
-
-   return range;
+   if (level < 0)
+      return ws->range_all;
+   return ws->range[ level ];
 }
 
 
@@ -661,19 +670,11 @@ double pilot_weapSetRange( Pilot* p, int id, int level )
 double pilot_weapSetSpeed( Pilot* p, int id, int level )
 {
    PilotWeaponSet *ws;
-   int i;
-   double speed;
 
    ws = pilot_weapSet(p,id);
-   if (level < 0) {
-      speed = 0;
-      for (i=0; i<PILOT_WEAPSET_MAX_LEVELS; i++)
-         speed += ws->speed[i];
-   }
-   else
-      speed = ws->speed[ level ];
-
-   return speed;
+   if (level < 0)
+      return ws->speed_all;
+   return ws->speed[ level ];
 }
 
 
@@ -862,53 +863,116 @@ void pilot_stopBeam( Pilot *p, PilotOutfitSlot *w )
 
 
 /**
- * @brief Computes an estimation of ammo flying time
+ * @brief Gets the target solution of a pilot, solving it if needed.
  *
- *    @param w the weapon that shoot
- *    @param parent Parent of the weapon
- *    @param target Target of the weapon
+ * Solutions get reused until pilot_weapAimInvalidate() is called, so every
+ *  mount and launcher of a pilot shares the same solution during a step.
+ *
+ *    @param p Pilot aiming.
+ *    @param t Target of the pilot.
+ *    @return The target solution.
  */
-double pilot_weapFlyTime( Outfit *o, Pilot *parent, Pilot *target)
+static PilotAim* pilot_weapAimGet( const Pilot *p, const Pilot *t )
+{
+   PilotAim *a;
+   int i, n;
+
+   i = pilot_index( p );
+   if (i < 0) {
+      /* Can't be looked up again, always solve. */
+      a      = &weap_aimTmp;
+      a->gen = 0;
+   }
+   else {
+      if (i >= weap_naim) {
+         n        = pilot_indexMax();
+         weap_aim = realloc( weap_aim, n * sizeof(PilotAim) );
+         memset( &weap_aim[weap_naim], 0, (n-weap_naim) * sizeof(PilotAim) );
+         weap_naim = n;
+      }
+      a = &weap_aim[i];
+      if ((a->gen == weap_aimGen) && (a->pilot == p->id) &&
+            (a->target == t->id))
+         return a;
+      a->gen = weap_aimGen;
+   }
+
+   a->pilot  = p->id;
+   a->target = t->id;
+   vect_cset( &a->rel, t->solid->pos.x - p->solid->pos.x,
+         t->solid->pos.y - p->solid->pos.y );
+   a->nspeed = 0;
+   return a;
+}
+
+
+/**
+ * @brief Gets the target solution of a pilot.
+ *
+ *    @param p Pilot aiming.
+ *    @param t Target of the pilot.
+ *    @return The target solution, valid until the pilots move.
+ */
+const PilotAim* pilot_weapAim( const Pilot *p, const Pilot *t )
 {
-   Vector2d approach_vector, relative_location, orthoradial_vector;
-   double speed, radial_speed, orthoradial_speed, dist, t;
+   return pilot_weapAimGet( p, t );
+}
 
-   dist = vect_dist( &parent->solid->pos, &target->solid->pos );
 
-   /* Beam weapons */
-   if (outfit_isBeam(o))
-      {
-      if (dist > o->u.bem.range)
-         return INFINITY;
-      return 0.;
-      }
+/**
+ * @brief Invalidates all the target solutions, must be called when pilots move.
+ */
+void pilot_weapAimInvalidate (void)
+{
+   weap_aimGen++;
+   if (weap_aimGen == 0)
+      weap_aimGen = 1;
+}
 
-   /* A bay doesn't have range issues */
-   if (outfit_isFighterBay(o))
-      return 0.;
 
-   /* Rockets use absolute velocity while bolt use relative vel */
-   if (outfit_isLauncher(o))
+/**
+ * @brief Frees the target solutions.
+ */
+void pilot_weapAimFree (void)
+{
+   free( weap_aim );
+   weap_aim  = NULL;
+   weap_naim = 0;
+}
+
+
+/**
+ * @brief Solves the time for a projectile to intercept a target.
+ *
+ *    @param parent Shooter.
+ *    @param target Target of the projectile.
+ *    @param rel Vector from the shooter to the target.
+ *    @param speed Speed of the projectile.
+ *    @param absolute Whether the projectile doesn't inherit the shooter velocity.
+ *    @return Time to intercept or INFINITY if it can't.
+ */
+static double pilot_weapIntercept( const Pilot *parent, const Pilot *target,
+      Vector2d *rel, double speed, int absolute )
+{
+   Vector2d approach_vector, orthoradial_vector;
+   double radial_speed, orthoradial_speed, dist, t;
+
+   dist = VMOD(*rel);
+
+   if (absolute)
          vect_cset( &approach_vector, - VX(target->solid->vel), - VY(target->solid->vel) );
    else
          vect_cset( &approach_vector, VX(parent->solid->vel) - VX(target->solid->vel),
                VY(parent->solid->vel) - VY(target->solid->vel) );
 
-   speed = outfit_speed(o);
-
-   /* Get the vector : shooter -> target*/
-   vect_cset( &relative_location, VX(target->solid->pos) - VX(parent->solid->pos),
-         VY(target->solid->pos) - VY(parent->solid->pos) );
-
    /* Get the orthogonal vector*/
-   vect_cset(&orthoradial_vector, VY(parent->solid->pos) - VY(target->solid->pos),
-         VX(target->solid->pos) -  VX(parent->solid->pos) );
+   vect_cset(&orthoradial_vector, -VY(*rel), VX(*rel) );
 
-   radial_speed = vect_dot( &approach_vector, &relative_location );
-   radial_speed = radial_speed / VMOD(relative_location);
+   radial_speed = vect_dot( &approach_vector, rel );
+   radial_speed = radial_speed / dist;
 
    orthoradial_speed = vect_dot(&approach_vector, &orthoradial_vector);
-   orthoradial_speed = orthoradial_speed / VMOD(relative_location);
+   orthoradial_speed = orthoradial_speed / dist;
 
    if( ((speed*speed - VMOD(approach_vector)*VMOD(approach_vector)) != 0) && (speed*speed - orthoradial_speed*orthoradial_speed) > 0)
       t = dist * (sqrt( speed*speed - orthoradial_speed*orthoradial_speed ) - radial_speed) /
@@ -929,6 +993,54 @@ double pilot_weapFlyTime( Outfit *o, Pilot *parent, Pilot *target)
 }
 
 
+/**
+ * @brief Computes an estimation of ammo flying time
+ *
+ * Intercept times are remembered in the target solution of the parent, so
+ *  launchers and turrets sharing a projectile speed only solve once a step.
+ *
+ *    @param w the weapon that shoot
+ *    @param parent Parent of the weapon
+ *    @param target Target of the weapon
+ */
+double pilot_weapFlyTime( Outfit *o, Pilot *parent, Pilot *target)
+{
+   PilotAim *a;
+   double speed, t;
+   int i, absolute;
+
+   a = pilot_weapAimGet( parent, target );
+
+   /* Beam weapons */
+   if (outfit_isBeam(o))
+      {
+      if (VMOD(a->rel) > o->u.bem.range)
+         return INFINITY;
+      return 0.;
+      }
+
+   /* A bay doesn't have range issues */
+   if (outfit_isFighterBay(o))
+      return 0.;
+
+   /* Rockets use absolute velocity while bolt use relative vel */
+   speed    = outfit_speed(o);
+   absolute = outfit_isLauncher(o);
+   for (i=0; i<a->nspeed; i++)
+      if ((a->speed[i] == speed) && (a->absolute[i] == absolute))
+         return a->time[i];
+
+   t = pilot_weapIntercept( parent, target, &a->rel, speed, absolute );
+   if (a->nspeed < PILOT_AIM_SPEEDS) {
+      a->speed[ a->nspeed ]    = speed;
+      a->absolute[ a->nspeed ] = absolute;
+      a->time[ a->nspeed ]     = t;
+      a->nspeed++;
+   }
+   return t;
+}
+
+
 /**
  * @brief Calculates and shoots the appropriate weapons in a weapon set matching an outfit.
  */
@@ -16,6 +16,23 @@
 #define WEAPSET_TYPE_WEAPON   1  /**< Activates weapons (while held down). */
 #define WEAPSET_TYPE_ACTIVE   2  /**< Toggles outfits (if on it deactivates). */
 
+#define PILOT_AIM_SPEEDS      4  /**< Projectile speeds a target solution remembers. */
+
+
+/**
+ * @brief Solution to a pilot's target, shared by all its mounts during a step.
+ */
+typedef struct PilotAim_ {
+   unsigned int gen; /**< Step the solution was made in. */
+   unsigned int pilot; /**< Pilot the solution belongs to. */
+   unsigned int target; /**< Target the solution is for. */
+   Vector2d rel; /**< Vector from the pilot to the target. */
+   int nspeed; /**< Number of intercept times solved. */
+   double speed[PILOT_AIM_SPEEDS]; /**< Projectile speeds solved for. */
+   int absolute[PILOT_AIM_SPEEDS]; /**< Whether the projectile ignores the pilot velocity. */
+   double time[PILOT_AIM_SPEEDS]; /**< Intercept time for each speed. */
+} PilotAim;
+
 
 /* Freedom. */
 void pilot_weapSetFree( Pilot* p );
@@ -29,6 +46,12 @@ void pilot_getRateMod( double *rate_mod, double* energy_mod,
 double pilot_weapFlyTime( Outfit *o, Pilot *parent, Pilot *target);
 
 
+/* Aiming. */
+const PilotAim* pilot_weapAim( const Pilot *p, const Pilot *t );
+void pilot_weapAimInvalidate (void);
+void pilot_weapAimFree (void);
+
+
 /* Updating. */
 void pilot_weapSetAIClear( Pilot* p );
 void pilot_weapSetPress( Pilot* p, int id, int type );
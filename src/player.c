@@ -60,6 +60,7 @@
 #include "input.h"
 #include "news.h"
 #include "nstring.h"
+#include "spacesim.h"
 
 
 /*
@@ -128,17 +129,15 @@ static double player_timer = 0.; /**< For death and such. */
 /*
  * unique mission stack.
  */
-static int* missions_done  = NULL; /**< Saves position of completed missions. */
-static int missions_mdone  = 0; /**< Memory size of completed missions. */
-static int missions_ndone  = 0; /**< Number of completed missions. */
+static uint32_t* missions_done = NULL; /**< Bitset of completed missions by ID. */
+static int missions_ndone  = 0; /**< Number of words in missions_done. */
 
 
 /*
  * unique event stack.
  */
-static int* events_done  = NULL; /**< Saves position of completed events. */
-static int events_mdone  = 0; /**< Memory size of completed events. */
-static int events_ndone  = 0; /**< Number of completed events. */
+static uint32_t* events_done = NULL; /**< Bitset of completed events by ID. */
+static int events_ndone  = 0; /**< Number of words in events_done. */
 
 
 /*
@@ -180,6 +179,9 @@ static void player_parseShipSlot( xmlNodePtr node, Pilot *ship, PilotOutfitSlot
 static int player_parseShip( xmlNodePtr parent, int is_player, char *planet );
 static int player_parseEscorts( xmlNodePtr parent );
 static void player_addOutfitToPilot( Pilot* pilot, Outfit* outfit, PilotOutfitSlot *s );
+/* Done missions and events. */
+static void player_doneSet( uint32_t **set, int *n, int id );
+static int player_doneGet( const uint32_t *set, int n, int id );
 /* Misc. */
 static int player_filterSuitablePlanet( Planet *p );
 static void player_planetOutOfRangeMsg (void);
@@ -491,7 +493,8 @@ Pilot* player_newShip( Ship* ship, const char *def_name,
    /* Update ship list if landed. */
    if (landed) {
       w = land_getWid( LAND_WINDOW_EQUIPMENT );
-      equipment_regenLists( w, 0, 1 );
+      if (w > 0)
+         equipment_regenLists( w, 0, 1 );
    }
 
    return new_ship;
@@ -604,6 +607,7 @@ void player_swapShip( char* shipname )
             pilot_stack[j] = ship;
             break;
          }
+      pilot_ewInvalidate();
 
       /* Copy position back. */
       player.p->solid->pos = v;
@@ -687,7 +691,8 @@ void player_rmShip( char* shipname )
    /* Update ship list if landed. */
    if (landed) {
       w = land_getWid( LAND_WINDOW_EQUIPMENT );
-      equipment_regenLists( w, 0, 1 );
+      if (w > 0)
+         equipment_regenLists( w, 0, 1 );
    }
 }
 
@@ -708,6 +713,7 @@ void player_cleanup (void)
    missions_cleanup();
    events_cleanup();
    space_clearKnown();
+   spacesim_clear();
    land_cleanup();
    map_cleanup();
 
@@ -763,14 +769,12 @@ void player_cleanup (void)
       free(missions_done);
    missions_done = NULL;
    missions_ndone = 0;
-   missions_mdone = 0;
 
    /* Clean up events. */
    if (events_done != NULL)
       free(events_done);
    events_done = NULL;
    events_ndone = 0;
-   events_mdone = 0;
 
    /* Clean up licenses. */
    if (player_nlicenses > 0) {
@@ -1680,6 +1684,8 @@ int player_jump (void)
       player_message("\erYou do not have enough fuel to hyperspace jump.");
    else {
       player_message("\epPreparing for hyperspace.");
+      /* Decode the destination while jumping. */
+      space_gfxPrefetch( cur_system->jumps[player.p->nav_hyperspace].target );
       /* Stop acceleration noise. */
       player_accelOver();
       /* Stop possible shooting. */
@@ -1741,6 +1747,10 @@ void player_brokeHyperspace (void)
    /* Update the map */
    map_jump();
 
+   /* Pre-warm the next system of the route. */
+   if (player.p->nav_hyperspace != -1)
+      space_gfxPrefetch( cur_system->jumps[player.p->nav_hyperspace].target );
+
    /* Add the escorts. */
    player_addEscorts();
 
@@ -1996,9 +2006,49 @@ void player_screenshot (void)
       return;
    }
 
-   /* now proceed to take the screenshot */
+   /* now proceed to take the screenshot, it's written in the background */
    DEBUG( "Taking screenshot [%03d]...", screenshot_cur );
    gl_screenshot(filename);
+   screenshot_cur++;
+}
+
+
+#define PLAYER_BURST_FRAMES   1800 /**< Frames captured by a screenshot burst, 30 seconds at 60 FPS. */
+static int screenshot_burst = 0; /**< Current screenshot burst at. */
+/**
+ * @brief Starts or stops capturing a screenshot of every frame.
+ */
+void player_screenshotBurst (void)
+{
+   char prefix[PATH_MAX], filename[PATH_MAX];
+
+   if (gl_screenshotBursting()) {
+      gl_screenshotBurst( NULL, 0 );
+      return;
+   }
+
+   if (nfile_dirMakeExist("%s", nfile_dataPath()) < 0 || nfile_dirMakeExist("%sscreenshots", nfile_dataPath()) < 0) {
+      WARN("Aborting screenshot burst");
+      return;
+   }
+
+   /* Try to find current bursts. */
+   for ( ; screenshot_burst < 1000; screenshot_burst++) {
+      nsnprintf( prefix, PATH_MAX, "%sscreenshots/burst%03d_",
+            nfile_dataPath(), screenshot_burst );
+      nsnprintf( filename, PATH_MAX, "%s0000.png", prefix );
+      if (!nfile_fileExists( filename ))
+         break;
+   }
+
+   if (screenshot_burst >= 999) {
+      WARN("You have reached the maximum amount of screenshot bursts [999]");
+      return;
+   }
+
+   DEBUG( "Capturing screenshot burst [%03d]...", screenshot_burst );
+   gl_screenshotBurst( prefix, PLAYER_BURST_FRAMES );
+   screenshot_burst++;
 }
 
 
@@ -2603,23 +2653,53 @@ int player_rmOutfit( const Outfit *o, int quantity )
 
 
 /**
- * @brief Marks a mission as completed.
+ * @brief Sets a bit in a done bitset, growing it as needed.
  *
- *    @param id ID of the mission to mark as completed.
+ *    @param set Bitset to modify.
+ *    @param n Number of words in the bitset.
+ *    @param id ID to mark.
  */
-void player_missionFinished( int id )
+static void player_doneSet( uint32_t **set, int *n, int id )
 {
-   /* Make sure not already marked. */
-   if (player_missionAlreadyDone(id))
+   int w;
+
+   if (id < 0)
       return;
 
-   /* Mark as done. */
-   missions_ndone++;
-   if (missions_ndone > missions_mdone) { /* need to grow */
-      missions_mdone += 25;
-      missions_done = realloc( missions_done, sizeof(int) * missions_mdone);
+   w = id / 32;
+   if (w >= *n) {
+      *set = realloc( *set, sizeof(uint32_t) * (w+1) );
+      memset( &(*set)[*n], 0, sizeof(uint32_t) * (w+1 - *n) );
+      *n   = w+1;
    }
-   missions_done[ missions_ndone-1 ] = id;
+   (*set)[w] |= 1U << (id % 32);
+}
+
+
+/**
+ * @brief Checks a bit in a done bitset.
+ *
+ *    @param set Bitset to check.
+ *    @param n Number of words in the bitset.
+ *    @param id ID to check.
+ *    @return 1 if the bit is set.
+ */
+static int player_doneGet( const uint32_t *set, int n, int id )
+{
+   if ((id < 0) || (id / 32 >= n))
+      return 0;
+   return (set[id / 32] >> (id % 32)) & 1;
+}
+
+
+/**
+ * @brief Marks a mission as completed.
+ *
+ *    @param id ID of the mission to mark as completed.
+ */
+void player_missionFinished( int id )
+{
+   player_doneSet( &missions_done, &missions_ndone, id );
 }
 
 
@@ -2631,11 +2711,7 @@ void player_missionFinished( int id )
  */
 int player_missionAlreadyDone( int id )
 {
-   int i;
-   for (i=0; i<missions_ndone; i++)
-      if (missions_done[i] == id)
-         return 1;
-   return 0;
+   return player_doneGet( missions_done, missions_ndone, id );
 }
 
 
@@ -2646,17 +2722,7 @@ int player_missionAlreadyDone( int id )
  */
 void player_eventFinished( int id )
 {
-   /* Make sure not already done. */
-   if (player_eventAlreadyDone(id))
-      return;
-
-   /* Add to done. */
-   events_ndone++;
-   if (events_ndone > events_mdone) { /* need to grow */
-      events_mdone += 25;
-      events_done = realloc( events_done, sizeof(int) * events_mdone);
-   }
-   events_done[ events_ndone-1 ] = id;
+   player_doneSet( &events_done, &events_ndone, id );
 }
 
 
@@ -2668,11 +2734,7 @@ void player_eventFinished( int id )
  */
 int player_eventAlreadyDone( int id )
 {
-   int i;
-   for (i=0; i<events_ndone; i++)
-      if (events_done[i] == id)
-         return 1;
-   return 0;
+   return player_doneGet( events_done, events_ndone, id );
 }
 
 
@@ -2927,8 +2989,10 @@ int player_save( xmlTextWriterPtr writer )
 
    /* Mission the player has done. */
    xmlw_startElem(writer,"missions_done");
-   for (i=0; i<missions_ndone; i++) {
-      m = mission_get(missions_done[i]);
+   for (i=0; i<missions_ndone*32; i++) {
+      if (!player_doneGet( missions_done, missions_ndone, i ))
+         continue;
+      m = mission_get(i);
       if (m != NULL) /* In case mission name changes between versions */
          xmlw_elem(writer,"done","%s",m->name);
    }
@@ -2936,8 +3000,10 @@ int player_save( xmlTextWriterPtr writer )
 
    /* Events the player has done. */
    xmlw_startElem(writer,"events_done");
-   for (i=0; i<events_ndone; i++) {
-      ev = event_dataName(events_done[i]);
+   for (i=0; i<events_ndone*32; i++) {
+      if (!player_doneGet( events_done, events_ndone, i ))
+         continue;
+      ev = event_dataName(i);
       if (ev != NULL) /* In case mission name changes between versions */
          xmlw_elem(writer,"done","%s",ev);
    }
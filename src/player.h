@@ -267,6 +267,7 @@ void player_weapSetPress( int id, int type, int repeat );
 void player_land (void);
 int player_jump (void);
 void player_screenshot (void);
+void player_screenshotBurst (void);
 void player_accel( double acc );
 void player_accelOver (void);
 void player_hail (void);
@@ -30,6 +30,7 @@ static double tc_mod    = 1.; /**< Time compression modifier. */
 static double tc_base   = 1.; /**< Base compression modifier. */
 static double tc_down   = 0.; /**< Rate of decrement. */
 static int tc_rampdown  = 0; /**< Ramping down time compression? */
+static int tc_clear     = 0; /**< No hostiles in sensor range at the last check? */
 static double lasts;
 static double lasta;
 
@@ -125,6 +126,7 @@ static int player_autonavSetup (void)
    /* Sane values. */
    tc_rampdown  = 0;
    tc_down      = 0.;
+   tc_clear     = 0;
    lasts        = player.p->shield / player.p->shield_max;
    lasta        = player.p->armour / player.p->armour_max;
 
@@ -486,6 +488,7 @@ int player_autonavShouldResetSpeed (void)
 
    lasts = shield;
    lasta = armour;
+   tc_clear = !hostiles;
 
    if (will_reset || (player.autonav_timer > 0)) {
       player_autonavResetSpeed();
@@ -495,6 +498,26 @@ int player_autonavShouldResetSpeed (void)
 }
 
 
+/**
+ * @brief Checks whether the simulation can be fast-forwarded.
+ *
+ * This is the case while autonav is compressing time with no hostiles in
+ *  sensor range and isn't about to arrive, so nothing needs fine steps.
+ *
+ *    @return 1 if coarse update steps may be used.
+ */
+int player_autonavFastForward (void)
+{
+   if ((player.p == NULL) || !player_isFlag(PLAYER_AUTONAV))
+      return 0;
+   if (pilot_isFlag(player.p, PILOT_DISABLED) ||
+         pilot_isFlag(player.p, PILOT_DEAD))
+      return 0;
+   return tc_clear && !tc_rampdown && (player.autonav_timer <= 0.) &&
+         (tc_mod > tc_base);
+}
+
+
 /**
  * @brief Handles autonav thinking.
  *
@@ -27,6 +27,7 @@ void player_autonavEnd (void);
 void player_autonavAbortJump( const char *reason );
 void player_autonavAbort( const char *reason );
 int player_autonavShouldResetSpeed (void);
+int player_autonavFastForward (void);
 void player_autonavStartWindow( unsigned int wid, char *str);
 void player_autonavPos( double x, double y );
 void player_autonavPnt( char *name );
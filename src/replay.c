@@ -0,0 +1,290 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file replay.c
+ *
+ * @brief Records sessions and replays them to compare builds.
+ *
+ * A recording holds the random seed, then for every frame the input events
+ *  polled by the main loop followed by the delta tick the frame ran with.
+ *  Replaying seeds the generators the same way and feeds the events and
+ *  delta ticks back instead of the real ones, so the same session is
+ *  simulated again, and logs the time spent per phase once it ends.
+ *
+ * Replays are only exact with the same data, configuration and saves as the
+ *  recording, so games are not saved while replaying. Events are stored as
+ *  they are in memory, a recording is only meant for the platform it was
+ *  made on.
+ */
+
+
+#include "replay.h"
+
+#include "naev.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "log.h"
+#include "conf.h"
+#include "rng.h"
+#include "perf.h"
+
+
+#define REPLAY_MAGIC    "NRPL" /**< Identifies replay files. */
+#define REPLAY_VERSION  1 /**< Version of the replay format. */
+
+#define REPLAY_EVENT    'E' /**< Input event record, followed by an SDL_Event. */
+#define REPLAY_FRAME    'F' /**< End of frame record, followed by a double dt. */
+
+
+/**
+ * @brief Header of a replay file.
+ */
+typedef struct ReplayHeader_ {
+   char magic[4]; /**< REPLAY_MAGIC. */
+   uint32_t version; /**< REPLAY_VERSION. */
+   uint32_t event_size; /**< sizeof(SDL_Event) of the recording build. */
+   uint32_t seed; /**< Random seed. */
+} ReplayHeader;
+
+
+static FILE *replay_file   = NULL; /**< File being recorded or replayed. */
+static int replay_playing  = 0; /**< Whether replaying instead of recording. */
+static int replay_next     = EOF; /**< Type of the next record when replaying. */
+static int replay_frames   = 0; /**< Frames recorded or replayed. */
+static int replay_events   = 0; /**< Events recorded or replayed. */
+static double replay_wall  = 0.; /**< Real time spent replaying. */
+static double replay_total[PERF_PHASES]; /**< Total milliseconds per phase. */
+static double replay_max[PERF_PHASES]; /**< Worst milliseconds per phase. */
+
+
+/*
+ * Prototypes.
+ */
+static int replay_read( void *ptr, size_t size );
+static void replay_report (void);
+
+
+/**
+ * @brief Starts recording or replaying, depending on the configuration.
+ *
+ * Must be called once the random subsystem is initialized, as it is seeded
+ *  again here.
+ *
+ *    @return 0 on success.
+ */
+int replay_init (void)
+{
+   ReplayHeader h;
+   int i;
+
+   if (conf.replay != NULL) {
+      replay_file = fopen( conf.replay, "rb" );
+      if (replay_file == NULL) {
+         WARN("Unable to open replay '%s'.", conf.replay);
+         return -1;
+      }
+      if ((fread( &h, sizeof(h), 1, replay_file ) != 1) ||
+            (memcmp( h.magic, REPLAY_MAGIC, 4 ) != 0) ||
+            (h.version != REPLAY_VERSION) ||
+            (h.event_size != sizeof(SDL_Event))) {
+         WARN("'%s' is not a replay made on this platform.", conf.replay);
+         fclose( replay_file );
+         replay_file = NULL;
+         return -1;
+      }
+      replay_playing = 1;
+      replay_next    = fgetc( replay_file );
+      for (i=0; i<PERF_PHASES; i++) {
+         replay_total[i] = 0.;
+         replay_max[i]   = 0.;
+      }
+      LOG("Replaying '%s' with seed %u%s.", conf.replay, h.seed,
+            conf.replay_fast ? " as fast as possible" : "");
+   }
+   else if (conf.record != NULL) {
+      replay_file = fopen( conf.record, "wb" );
+      if (replay_file == NULL) {
+         WARN("Unable to open '%s' to record to.", conf.record);
+         return -1;
+      }
+      memset( &h, 0, sizeof(h) );
+      memcpy( h.magic, REPLAY_MAGIC, 4 );
+      h.version    = REPLAY_VERSION;
+      h.event_size = sizeof(SDL_Event);
+      h.seed       = randint();
+      fwrite( &h, sizeof(h), 1, replay_file );
+      LOG("Recording to '%s' with seed %u.", conf.record, h.seed);
+   }
+   else
+      return 0;
+
+   rng_seed( h.seed );
+   return 0;
+}
+
+
+/**
+ * @brief Stops recording or replaying.
+ */
+void replay_exit (void)
+{
+   if (replay_file == NULL)
+      return;
+
+   if (replay_playing)
+      replay_report();
+   else
+      DEBUG("Recorded %d frames and %d events to '%s'.",
+            replay_frames, replay_events, conf.record);
+
+   fclose( replay_file );
+   replay_file    = NULL;
+   replay_playing = 0;
+}
+
+
+/**
+ * @brief Reads from the replay, stopping the replay at the end of the file.
+ *
+ *    @return 0 on success.
+ */
+static int replay_read( void *ptr, size_t size )
+{
+   if (fread( ptr, size, 1, replay_file ) == 1)
+      return 0;
+
+   WARN("Replay '%s' is truncated.", conf.replay);
+   replay_next = EOF;
+   return -1;
+}
+
+
+/**
+ * @brief Logs the time spent per phase while replaying.
+ */
+static void replay_report (void)
+{
+   int i, n;
+   double sum;
+
+   n = MAX( replay_frames-1, 1 ); /* The first frame has no timings yet. */
+   LOG("Replay '%s': %d frames, %d events in %.2f s", conf.replay,
+         replay_frames, replay_events, replay_wall);
+   LOG("   %-16s %10s %10s %10s", "phase", "total ms", "mean ms", "max ms");
+   sum = 0.;
+   for (i=0; i<PERF_PHASES; i++) {
+      if (replay_total[i] <= 0.)
+         continue;
+      LOG("   %-16s %10.2f %10.4f %10.4f", perf_name(i),
+            replay_total[i], replay_total[i] / n, replay_max[i]);
+      sum += replay_total[i];
+   }
+   LOG("   %-16s %10.2f %10.4f", "total", sum, sum / n);
+}
+
+
+/**
+ * @brief Polls for an input event, recording or replaying it.
+ *
+ * Replaces SDL_PollEvent() wherever the events go to the game. While
+ *  replaying the real events are thrown away.
+ *
+ *    @param[out] event Event polled.
+ *    @return 1 if there was an event.
+ */
+int replay_pollEvent( SDL_Event *event )
+{
+   SDL_Event real;
+
+   if (!replay_playing) {
+      if (!SDL_PollEvent( event ))
+         return 0;
+#if SDL_VERSION_ATLEAST(2,0,0)
+      if (event->type == SDL_DROPFILE)
+         return 1; /* Holds a pointer, can't be replayed. */
+#endif /* SDL_VERSION_ATLEAST(2,0,0) */
+      if (replay_file != NULL) {
+         fputc( REPLAY_EVENT, replay_file );
+         fwrite( event, sizeof(SDL_Event), 1, replay_file );
+         replay_events++;
+      }
+      return 1;
+   }
+
+   while (SDL_PollEvent( &real ));
+   if (replay_next != REPLAY_EVENT)
+      return 0;
+   if (replay_read( event, sizeof(SDL_Event) ))
+      return 0;
+   replay_next = fgetc( replay_file );
+   replay_events++;
+   return 1;
+}
+
+
+/**
+ * @brief Ends a frame, recording or replaying its delta tick.
+ *
+ * When the replay runs out the game quits.
+ *
+ *    @param dt Real delta tick of the frame.
+ *    @return Delta tick to run the frame with.
+ */
+double replay_frame( double dt )
+{
+   double rdt;
+   int i;
+
+   if (replay_file == NULL)
+      return dt;
+
+   if (!replay_playing) {
+      fputc( REPLAY_FRAME, replay_file );
+      fwrite( &dt, sizeof(dt), 1, replay_file );
+      replay_frames++;
+      return dt;
+   }
+
+   /* Timings of the frame that just ended. */
+   replay_wall += dt;
+   if (replay_frames > 0) {
+      for (i=0; i<PERF_PHASES; i++) {
+         replay_total[i] += perf_get(i);
+         replay_max[i]    = MAX( replay_max[i], perf_get(i) );
+      }
+   }
+
+   /* Events no loop got to are dropped, like they were when recording. */
+   while (replay_next == REPLAY_EVENT) {
+      if (fseek( replay_file, sizeof(SDL_Event), SEEK_CUR ) != 0)
+         replay_next = EOF;
+      else
+         replay_next = fgetc( replay_file );
+   }
+   if ((replay_next != REPLAY_FRAME) || replay_read( &rdt, sizeof(rdt) )) {
+      replay_exit();
+      naev_quit();
+      return dt;
+   }
+   replay_next = fgetc( replay_file );
+   replay_frames++;
+
+   /* Keep the recorded pace. */
+   if (!conf.replay_fast && (dt < rdt))
+      SDL_Delay( (unsigned int)((rdt - dt) * 1000.) );
+   return rdt;
+}
+
+
+/**
+ * @brief Checks whether a replay is running.
+ */
+int replay_isPlaying (void)
+{
+   return replay_playing;
+}
@@ -0,0 +1,24 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef REPLAY_H
+#  define REPLAY_H
+
+
+#include "SDL.h"
+
+
+int replay_init (void);
+void replay_exit (void);
+
+/* Main loop. */
+int replay_pollEvent( SDL_Event *event );
+double replay_frame( double dt );
+
+/* State. */
+int replay_isPlaying (void);
+
+
+#endif /* REPLAY_H */
@@ -16,6 +16,7 @@
 #include "naev.h"
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <math.h>
 #include <unistd.h>
 #include <time.h>
@@ -42,6 +43,12 @@ static uint32_t mt_y; /**< Internal mersenne twister variable. */
 static int mt_pos = 0; /**< Current number being used. */
 
 
+/*
+ * Streams.
+ */
+static uint64_t rng_master = 0; /**< Seed streams are split from. */
+
+
 /*
  * prototypes
  */
@@ -50,6 +57,8 @@ static uint32_t rng_timeEntropy (void);
 static void mt_initArray( uint32_t seed );
 static void mt_genArray (void);
 static uint32_t mt_getInt (void);
+/* streams */
+static uint64_t rng_splitmix( uint64_t *x );
 
 
 /**
@@ -84,6 +93,27 @@ void rng_init (void)
       mt_initArray( i );
    for (i=0; i<10; i++) /* generate numbers to get away from poor initial values */
       mt_genArray();
+   rng_master = ((uint64_t)mt_getInt() << 32) | mt_getInt();
+}
+
+
+/**
+ * @fn void rng_seed( uint32_t seed )
+ *
+ * @brief Seeds the random subsystem so the same sequence is generated every
+ *  run.
+ *
+ *    @param seed Seed to use.
+ */
+void rng_seed( uint32_t seed )
+{
+   int i;
+
+   mt_initArray( seed );
+   for (i=0; i<10; i++) /* generate numbers to get away from poor initial values */
+      mt_genArray();
+   srand( seed ); /* Lua's math.random uses the C generator. */
+   rng_master = seed;
 }
 
 
@@ -197,6 +227,90 @@ double randfp (void)
 }
 
 
+/**
+ * @brief SplitMix64, used to expand seeds into stream states.
+ */
+static uint64_t rng_splitmix( uint64_t *x )
+{
+   uint64_t z;
+
+   z = (*x += 0x9E3779B97F4A7C15ULL);
+   z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+   z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+   return z ^ (z >> 31);
+}
+
+
+/**
+ * @brief Splits a stream off the master seed.
+ *
+ * The same key gives the same stream until the generator is seeded again.
+ *
+ *    @param r Stream to initialize.
+ *    @param key What the stream is for, like the index of a work item.
+ */
+void rng_streamInit( RandStream *r, uint32_t key )
+{
+   uint64_t x;
+
+   x = rng_master;
+   rng_splitmix( &x );
+   rng_streamSeed( r, x ^ ((uint64_t)key * 0xD1B54A32D192ED03ULL) );
+}
+
+
+/**
+ * @brief Seeds a stream directly.
+ *
+ *    @param r Stream to seed.
+ *    @param seed Seed to use.
+ */
+void rng_streamSeed( RandStream *r, uint64_t seed )
+{
+   int i;
+
+   for (i=0; i<4; i++)
+      r->s[i] = rng_splitmix( &seed );
+}
+
+
+/**
+ * @brief Gets a random integer from a stream.
+ *
+ *    @param r Stream to use.
+ *    @return A random integer.
+ */
+uint32_t rng_streamInt( RandStream *r )
+{
+   uint64_t *s, result, t;
+
+   /* xoshiro256** */
+   s      = r->s;
+   result = s[1] * 5;
+   result = ((result << 7) | (result >> 57)) * 9;
+   t      = s[1] << 17;
+   s[2]  ^= s[0];
+   s[3]  ^= s[1];
+   s[1]  ^= s[2];
+   s[0]  ^= s[3];
+   s[2]  ^= t;
+   s[3]   = (s[3] << 45) | (s[3] >> 19);
+   return (uint32_t)(result >> 32);
+}
+
+
+/**
+ * @brief Gets a random float between 0 and 1 (exclusive) from a stream.
+ *
+ *    @param r Stream to use.
+ *    @return A random float in [0:1).
+ */
+double rng_streamFloat( RandStream *r )
+{
+   return (double)rng_streamInt( r ) / 4294967296.;
+}
+
+
 /**
  * @fn double Normal( double x )
  *
@@ -8,6 +8,9 @@
 #  define RNG_H
 
 
+#include <stdint.h>
+
+
 /**
  * @brief Gets a random number between L and H (L <= RNG <= H).
  *
@@ -44,13 +47,49 @@
 #define RNG_3SIGMA()       NormalInverse(0.0013498985 + RNGF()*(1.-0.0013498985*2.))
 
 
+/**
+ * @brief Gets a random number between L and H from a stream (L <= RNGS <= H).
+ *
+ * If L is bigger then H it inverts the roles.
+ */
+#define RNGS(R,L,H)  (((L)>(H)) ? RNGS_SANE((R),(H),(L)) : RNGS_SANE((R),(L),(H)))
+/**
+ * @brief Gets a number between L and H from a stream (L <= RNGS <= H).
+ */
+#define RNGS_SANE(R,L,H) ((int)L + (int)((double)(H-L+1) * rng_streamFloat(R)))
+/**
+ * @brief Gets a random float between 0 and 1 from a stream (0. <= RNGSF < 1.).
+ */
+#define RNGSF(R)     (rng_streamFloat(R))
+
+
+/**
+ * @brief Independent random stream.
+ *
+ * The global generator isn't thread safe, work running on other threads
+ *  draws from its own stream instead. Streams made with rng_streamInit()
+ *  only depend on the master seed and their key, so keying them by what is
+ *  being worked on keeps the results the same whatever thread does it.
+ */
+typedef struct RandStream_ {
+   uint64_t s[4]; /**< xoshiro256** state. */
+} RandStream;
+
+
 /* Init */
 void rng_init (void);
+void rng_seed( uint32_t seed );
 
 /* Random functions */
 unsigned int randint (void);
 double randfp (void);
 
+/* Streams */
+void rng_streamInit( RandStream *r, uint32_t key );
+void rng_streamSeed( RandStream *r, uint64_t seed );
+uint32_t rng_streamInt( RandStream *r );
+double rng_streamFloat( RandStream *r );
+
 /* Probability functions */
 double Normal( double x );
 double NormalInverse( double p );
@@ -6,6 +6,14 @@
  * @file save.c
  *
  * @brief Handles saving/loading games.
+ *
+ * Saving serializes the game into memory on the main thread, which is cheap
+ *  compared to building a document, while compressing and writing it to disk
+ *  is done by a worker.  The save is written to a temporary file that then
+ *  replaces the old one so a crash can never leave a half written savegame.
+ *
+ * With the save_binary option the game is serialized into a document instead,
+ *  which the worker writes in the binary format of savebin.c.
  */
 
 #include "save.h"
@@ -13,6 +21,10 @@
 #include "naev.h"
 
 #include <errno.h> /* errno */
+#include <stdio.h> /* rename */
+
+#include "SDL.h"
+#include "SDL_thread.h"
 
 #include "log.h"
 #include "nxml.h"
@@ -31,11 +43,36 @@
 #include "land.h"
 #include "gui.h"
 #include "load.h"
+#include "threadpool.h"
+#include "replay.h"
+#include "savebin.h"
 
 
 int save_loaded   = 0; /**< Just loaded the savegame. */
 
 
+/**
+ * @brief Serialized savegame being written to disk.
+ */
+typedef struct SaveJob_ {
+   char file[PATH_MAX]; /**< Savegame to write. */
+   xmlBufferPtr buf; /**< Serialized savegame, NULL if writing doc in binary. */
+   int backup; /**< Whether to back up the old savegame first. */
+   int compress; /**< Compression level. */
+   int ret; /**< 0 if the savegame was written. */
+   int snapshot; /**< Whether to keep doc as snapshot once written. */
+   xmlDocPtr doc; /**< Savegame document, parsed from buf if it is set. */
+   nsave_t meta; /**< Metadata for the save index. */
+} SaveJob;
+
+static SaveJob save_job; /**< Savegame being written. */
+static SDL_sem *save_done   = NULL; /**< Posted when the savegame finished writing. */
+static int save_busy        = 0; /**< Whether a savegame is being written. */
+
+static xmlDocPtr save_snapshot = NULL; /**< Last savegame written or loaded. */
+static char save_snapshotFile[PATH_MAX]; /**< File save_snapshot matches. */
+
+
 /*
  * prototypes
  */
@@ -60,6 +97,9 @@ extern int space_sysSave( xmlTextWriterPtr writer ); /**< Saves the space stuff.
 extern int diff_save( xmlTextWriterPtr writer ); /**< Saves the universe diffs. */
 /* static */
 static int save_data( xmlTextWriterPtr writer );
+static int save_writeJob( void *data );
+static void save_meta( nsave_t *ns );
+static void save_metaFree( nsave_t *ns );
 
 
 /**
@@ -85,14 +125,151 @@ static int save_data( xmlTextWriterPtr writer )
 }
 
 
+/**
+ * @brief Gets the metadata shown in the load menu, same as load_load() reads.
+ */
+static void save_meta( nsave_t *ns )
+{
+   int scu, stp, stu;
+   double rem;
+
+   memset( ns, 0, sizeof(nsave_t) );
+   ns->name       = strdup( player.name );
+   ns->version[0] = VMAJOR;
+   ns->version[1] = VMINOR;
+   ns->version[2] = VREV;
+   ns->data       = strdup( ndata_name() );
+   ns->planet     = strdup( land_planet->name );
+   ntime_getR( &scu, &stp, &stu, &rem );
+   ns->date       = ntime_create( scu, stp, stu );
+   ns->credits    = player.p->credits;
+   ns->shipname   = strdup( player.p->name );
+   ns->shipmodel  = strdup( player.p->ship->name );
+}
+
+
+/**
+ * @brief Frees metadata from save_meta().
+ */
+static void save_metaFree( nsave_t *ns )
+{
+   free( ns->name );
+   free( ns->data );
+   free( ns->planet );
+   free( ns->shipname );
+   free( ns->shipmodel );
+   memset( ns, 0, sizeof(nsave_t) );
+}
+
+
+/**
+ * @brief Writes a serialized savegame to disk.
+ *
+ * Runs in a worker thread so it must not touch any game state.
+ */
+static int save_writeJob( void *data )
+{
+   SaveJob *job;
+   char tmp[PATH_MAX];
+   xmlOutputBufferPtr out;
+   int ret;
+
+   job = (SaveJob*) data;
+   job->ret = -1;
+   nsnprintf( tmp, PATH_MAX, "%s.tmp", job->file );
+
+   /* Back up old savegame. */
+   if (job->backup && (nfile_backupIfExists(job->file) < 0)) {
+      WARN("Aborting save...");
+      goto done;
+   }
+
+   /* Write to a temporary file first. */
+   if (job->buf == NULL) {
+      if (savebin_write( tmp, job->doc ) != 0) {
+         WARN("Failed to write savegame, the old savegame was kept.");
+         remove( tmp );
+         goto done;
+      }
+   }
+   else {
+      out = xmlOutputBufferCreateFilename( tmp, NULL, job->compress );
+      if (out == NULL) {
+         WARN("Unable to open '%s' to write the savegame.", tmp);
+         goto done;
+      }
+      ret = xmlOutputBufferWrite( out, xmlBufferLength(job->buf),
+            (const char*)xmlBufferContent(job->buf) );
+      if ((xmlOutputBufferClose(out) < 0) || (ret < 0)) {
+         WARN("Failed to write savegame, the old savegame was kept.");
+         remove( tmp );
+         goto done;
+      }
+   }
+
+   /* Replace the old savegame. */
+#if HAS_WIN32
+   remove( job->file ); /* Windows will not rename over files. */
+#endif /* HAS_WIN32 */
+   if (rename( tmp, job->file ) != 0)
+      WARN("Failed to replace savegame '%s': %s", job->file, strerror(errno));
+   else
+      job->ret = 0;
+
+   /* Parse it here so reloading doesn't have to. */
+   if ((job->ret == 0) && job->snapshot && (job->buf != NULL))
+      job->doc = xmlReadMemory( (const char*)xmlBufferContent(job->buf),
+            xmlBufferLength(job->buf), job->file, NULL, 0 );
+
+done:
+   SDL_SemPost( save_done );
+   return 0;
+}
+
+
+/**
+ * @brief Blocks until the savegame being written is on disk.
+ *
+ * Must be called before reading savegames.
+ */
+void save_sync (void)
+{
+   if (!save_busy)
+      return;
+
+   while (SDL_SemWait( save_done ) == -1)
+      WARN("SDL_SemWait failed! Error: %s", SDL_GetError());
+
+   /* Listing saves won't have to parse it. */
+   if (save_job.ret == 0)
+      load_indexSet( save_job.file, &save_job.meta );
+   save_metaFree( &save_job.meta );
+
+   /* Reloading won't have to either. */
+   if ((save_job.doc != NULL) && (save_job.ret == 0) && save_job.snapshot)
+      save_snapshotKeep( save_job.file, save_job.doc );
+   else if (save_job.doc != NULL)
+      xmlFreeDoc( save_job.doc );
+   save_job.doc = NULL;
+
+   if (save_job.buf != NULL)
+      xmlBufferFree( save_job.buf );
+   save_job.buf = NULL;
+   save_busy    = 0;
+}
+
+
 /**
  * @brief Saves the current game.
  *
+ * The savegame is serialized right away and written to disk in the
+ *  background, use save_sync() to wait for it.
+ *
  *    @return 0 on success.
  */
 int save_all (void)
 {
-   char file[PATH_MAX];
+   xmlBufferPtr buf;
    xmlDocPtr doc;
    xmlTextWriterPtr writer;
 
@@ -100,15 +277,36 @@ int save_all (void)
    if (player_isTut() || player_isFlag(PLAYER_NOSAVE))
       return 0;
 
-   /* Create the writer. */
-   writer = xmlNewTextWriterDoc(&doc, conf.save_compress);
+   /* Replays must keep starting from the same saves. */
+   if (replay_isPlaying())
+      return 0;
+
+   /* Only one savegame is written at a time. */
+   save_sync();
+
+   /* Create the writer, binary savegames are encoded from the tree. */
+   buf = NULL;
+   doc = NULL;
+   if (conf.save_binary)
+      writer = xmlNewTextWriterDoc(&doc, 0);
+   else {
+      buf = xmlBufferCreate();
+      if (buf == NULL) {
+         ERR("Out of Memory");
+         return -1;
+      }
+      writer = xmlNewTextWriterMemory(buf, 0);
+   }
    if (writer == NULL) {
       ERR("testXmlwriterDoc: Error creating the xml writer");
+      if (buf != NULL)
+         xmlBufferFree(buf);
       return -1;
    }
 
-   /* Set the writer parameters. */
-   xmlw_setParams( writer );
+   /* Set the writer parameters, indenting would only add text nodes to the tree. */
+   if (buf != NULL)
+      xmlw_setParams( writer );
 
    /* Start element. */
    xmlw_start(writer);
@@ -123,59 +321,101 @@ int save_all (void)
    /* Save the data. */
    if (save_data(writer) < 0) {
       ERR("Trying to save game data");
-      goto err_writer;
+      goto err;
    }
 
    /* Finish element. */
    xmlw_endElem(writer); /* "naev_save" */
    xmlw_done(writer);
+   xmlFreeTextWriter(writer); /* Flushes into the buffer. */
+   writer = NULL;
 
-   /* Write to file. */
+   /* Make sure the save directory exists. */
    if ((nfile_dirMakeExist("%s", nfile_dataPath()) < 0) ||
          (nfile_dirMakeExist("%ssaves", nfile_dataPath()) < 0)) {
       WARN("Failed to create save directory '%ssaves'.", nfile_dataPath());
-      goto err_writer;
-   }
-   nsnprintf(file, PATH_MAX, "%ssaves/%s.ns", nfile_dataPath(), player.name);
-
-   /* Back up old savegame. */
-   if (!save_loaded) {
-      if (nfile_backupIfExists(file) < 0) {
-         WARN("Aborting save...");
-         goto err_writer;
-      }
-   }
-   save_loaded = 0;
-
-   /* Critical section, if crashes here player's game gets corrupted.
-    * Luckily we have a copy just in case... */
-   xmlFreeTextWriter(writer);
-   if (xmlSaveFileEnc(file, doc, "UTF-8") < 0) {
-      WARN("Failed to write savegame!  You'll most likely have to restore it by copying your backup savegame over your current savegame.");
       goto err;
    }
-   xmlFreeDoc(doc);
+
+   /* Hand it over to be written. */
+   nsnprintf(save_job.file, PATH_MAX, "%ssaves/%s.ns", nfile_dataPath(), player.name);
+   save_job.buf      = buf;
+   save_job.backup   = !save_loaded;
+   save_job.compress = conf.save_compress;
+   save_job.snapshot = conf.save_snapshot;
+   save_job.doc      = doc;
+   save_loaded       = 0;
+   save_meta( &save_job.meta );
+
+   if (save_done == NULL)
+      save_done = SDL_CreateSemaphore( 0 );
+   save_busy = 1;
+   if (threadpool_newJob( save_writeJob, &save_job ))
+      save_writeJob( &save_job ); /* No threadpool, write right away. */
 
    return 0;
 
-err_writer:
-   xmlFreeTextWriter(writer);
 err:
-   xmlFreeDoc(doc);
+   if (writer != NULL)
+      xmlFreeTextWriter(writer);
+   if (buf != NULL)
+      xmlBufferFree(buf);
+   if (doc != NULL)
+      xmlFreeDoc(doc);
    return -1;
 }
 
 /**
  * @brief Reload the current savegame.
+ *
+ * Uses the snapshot if it matches the savegame, skipping reading and
+ *  parsing it.
  */
 void save_reload (void)
 {
    char path[PATH_MAX];
+   save_sync();
    nsnprintf(path, PATH_MAX, "%ssaves/%s.ns", nfile_dataPath(), player.name);
+   if ((save_snapshot != NULL) && (strcmp( save_snapshotFile, path ) == 0) &&
+         (load_gameDoc( save_snapshot, 0 ) == 0))
+      return;
    load_game( path, 0 );
 }
 
 
+/**
+ * @brief Keeps a parsed savegame to reload from.
+ *
+ * Does nothing but free it if snapshots are disabled.
+ *
+ *    @param file File the savegame is in.
+ *    @param doc Parsed savegame, owned by the snapshot afterwards.
+ */
+void save_snapshotKeep( const char *file, xmlDocPtr doc )
+{
+   save_snapshotFree();
+   if (!conf.save_snapshot) {
+      xmlFreeDoc( doc );
+      return;
+   }
+   save_snapshot = doc;
+   strncpy( save_snapshotFile, file, PATH_MAX-1 );
+   save_snapshotFile[PATH_MAX-1] = '\0';
+}
+
+
+/**
+ * @brief Frees the savegame snapshot.
+ */
+void save_snapshotFree (void)
+{
+   if (save_snapshot != NULL)
+      xmlFreeDoc( save_snapshot );
+   save_snapshot = NULL;
+   save_snapshotFile[0] = '\0';
+}
+
+
 /**
  * @brief Checks to see if there's a savegame available.
  *
@@ -188,6 +428,7 @@ int save_hasSave (void)
    int has_save;
 
    /* Look for saved games. */
+   save_sync();
    files = nfile_readDir( &nfiles, "%ssaves", nfile_dataPath() );
    has_save = 0;
    for (i=0; i<nfiles; i++) {
@@ -7,9 +7,17 @@
 #  define SAVE_H
 
 
+#include "nxml.h"
+
+
 int save_all (void);
+void save_sync (void);
 void save_reload (void);
 int save_hasSave (void);
 
+/* Snapshot. */
+void save_snapshotKeep( const char *file, xmlDocPtr doc );
+void save_snapshotFree (void);
+
 
 #endif /* SAVE_H */
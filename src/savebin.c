@@ -0,0 +1,583 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file savebin.c
+ *
+ * @brief Compact binary savegames.
+ *
+ * A binary savegame is the same document as an XML one, stored as a stream
+ *  of tokens instead of text so it is smaller and rebuilding the tree skips
+ *  the XML parser.  Every element and attribute name is only written the
+ *  first time it is seen, later it is an index.  The stream is then deflated
+ *  at the fastest level.
+ *
+ * The file starts with a header:
+ *  - SAVEBIN_MAGIC
+ *  - uint32 SAVEBIN_VERSION, little endian
+ *  - uint32 size of the stream once inflated, little endian
+ *
+ * Nodes in the stream are a token followed by their data, numbers are
+ *  encoded 7 bits at a time with the high bit set if more follow:
+ *  - SAVEBIN_ELEM name nattr (name value)*nattr children SAVEBIN_END
+ *  - SAVEBIN_TEXT value
+ *
+ * A name is 0 followed by a value the first time, afterwards its index + 1.
+ *  A value is its length followed by that many bytes and a terminating 0.
+ *  The stream ends with a SAVEBIN_END at the top level.
+ *
+ * Savegames are loaded and listed whatever their format, so the save_binary
+ *  option can be changed at any time.
+ */
+
+
+#include "savebin.h"
+
+#include "naev.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "log.h"
+#include "nfile.h"
+#include "nhash.h"
+#include "array.h"
+
+
+#define SAVEBIN_MAGIC      "NSVB" /**< Identifies binary savegames. */
+#define SAVEBIN_VERSION    1 /**< Version of the binary savegame format. */
+#define SAVEBIN_HEADER     12 /**< Size of the header. */
+#define SAVEBIN_MAX        (256*1024*1024) /**< Largest stream accepted. */
+
+#define SAVEBIN_END        0 /**< Ends the children of an element. */
+#define SAVEBIN_ELEM       1 /**< Element token. */
+#define SAVEBIN_TEXT       2 /**< Text token. */
+
+
+/**
+ * @brief Growing buffer a stream is encoded to.
+ */
+typedef struct SaveBinOut_ {
+   unsigned char *data; /**< Encoded data. */
+   size_t len; /**< Bytes used. */
+   size_t size; /**< Bytes allocated. */
+   NameHash names; /**< Name to index of the names written so far. */
+   int nnames; /**< Number of names written so far. */
+} SaveBinOut;
+
+
+/**
+ * @brief Stream being decoded.
+ */
+typedef struct SaveBinIn_ {
+   const unsigned char *p; /**< Current position. */
+   const unsigned char *end; /**< End of the stream. */
+   const char **names; /**< Names read so far, point into the stream. */
+   xmlDocPtr doc; /**< Document being built. */
+   int err; /**< Set when the stream is broken. */
+} SaveBinIn;
+
+
+/*
+ * Prototypes.
+ */
+/* Encoding. */
+static void savebin_put( SaveBinOut *o, const void *p, size_t n );
+static void savebin_putNum( SaveBinOut *o, size_t v );
+static void savebin_putValue( SaveBinOut *o, const char *s );
+static void savebin_putName( SaveBinOut *o, const char *name );
+static void savebin_putNode( SaveBinOut *o, xmlNodePtr node );
+static void savebin_putU32( unsigned char *p, uint32_t v );
+/* Decoding. */
+static size_t savebin_getNum( SaveBinIn *in );
+static const char* savebin_getValue( SaveBinIn *in, size_t *len );
+static const char* savebin_getName( SaveBinIn *in );
+static xmlNodePtr savebin_getElem( SaveBinIn *in, int depth );
+static uint32_t savebin_getU32( const unsigned char *p );
+static xmlDocPtr savebin_decode( const char *buf, size_t len, const char *file );
+
+
+/**
+ * @brief Appends bytes to the stream.
+ */
+static void savebin_put( SaveBinOut *o, const void *p, size_t n )
+{
+   if (o->len + n > o->size) {
+      o->size = MAX( 2*o->size, o->len + n + 4096 );
+      o->data = realloc( o->data, o->size );
+   }
+   memcpy( &o->data[o->len], p, n );
+   o->len += n;
+}
+
+
+/**
+ * @brief Appends a number to the stream.
+ */
+static void savebin_putNum( SaveBinOut *o, size_t v )
+{
+   unsigned char b[10];
+   int n;
+
+   n = 0;
+   do {
+      b[n] = v & 0x7F;
+      v  >>= 7;
+      if (v != 0)
+         b[n] |= 0x80;
+      n++;
+   } while (v != 0);
+   savebin_put( o, b, n );
+}
+
+
+/**
+ * @brief Appends a value to the stream.
+ */
+static void savebin_putValue( SaveBinOut *o, const char *s )
+{
+   size_t len;
+
+   if (s == NULL)
+      s = "";
+   len = strlen(s);
+   savebin_putNum( o, len );
+   savebin_put( o, s, len+1 );
+}
+
+
+/**
+ * @brief Appends a name to the stream, as an index if it was seen before.
+ */
+static void savebin_putName( SaveBinOut *o, const char *name )
+{
+   int i;
+
+   i = nhash_get( &o->names, name );
+   if (i >= 0) {
+      savebin_putNum( o, i+1 );
+      return;
+   }
+   nhash_set( &o->names, name, o->nnames++ );
+   savebin_putNum( o, 0 );
+   savebin_putValue( o, name );
+}
+
+
+/**
+ * @brief Appends a node and its children to the stream.
+ */
+static void savebin_putNode( SaveBinOut *o, xmlNodePtr node )
+{
+   unsigned char t;
+   xmlAttrPtr attr;
+   xmlNodePtr cur;
+   size_t nattr;
+
+   switch (node->type) {
+      case XML_TEXT_NODE:
+      case XML_CDATA_SECTION_NODE:
+         t = SAVEBIN_TEXT;
+         savebin_put( o, &t, 1 );
+         savebin_putValue( o, (const char*)node->content );
+         return;
+
+      case XML_ELEMENT_NODE:
+         break;
+
+      default:
+         return; /* Comments and such aren't loaded anyway. */
+   }
+
+   t = SAVEBIN_ELEM;
+   savebin_put( o, &t, 1 );
+   savebin_putName( o, (const char*)node->name );
+
+   nattr = 0;
+   for (attr=node->properties; attr!=NULL; attr=attr->next)
+      nattr++;
+   savebin_putNum( o, nattr );
+   for (attr=node->properties; attr!=NULL; attr=attr->next) {
+      savebin_putName( o, (const char*)attr->name );
+      savebin_putValue( o, (attr->children != NULL) ?
+            (const char*)attr->children->content : NULL );
+   }
+
+   for (cur=node->children; cur!=NULL; cur=cur->next)
+      savebin_putNode( o, cur );
+
+   t = SAVEBIN_END;
+   savebin_put( o, &t, 1 );
+}
+
+
+/**
+ * @brief Writes a little endian 32 bit number.
+ */
+static void savebin_putU32( unsigned char *p, uint32_t v )
+{
+   p[0] = v & 0xFF;
+   p[1] = (v >> 8) & 0xFF;
+   p[2] = (v >> 16) & 0xFF;
+   p[3] = (v >> 24) & 0xFF;
+}
+
+
+/**
+ * @brief Writes a document as a binary savegame.
+ *
+ * Doesn't touch any game state, so it can run in a worker thread.
+ *
+ *    @param file File to write to.
+ *    @param doc Document to write.
+ *    @return 0 on success.
+ */
+int savebin_write( const char *file, xmlDocPtr doc )
+{
+   SaveBinOut o;
+   xmlNodePtr cur;
+   unsigned char t, *z;
+   uLongf zlen;
+   FILE *fp;
+   int ret;
+
+   /* Encode. */
+   memset( &o, 0, sizeof(o) );
+   nhash_init( &o.names );
+   for (cur=doc->children; cur!=NULL; cur=cur->next)
+      savebin_putNode( &o, cur );
+   t = SAVEBIN_END;
+   savebin_put( &o, &t, 1 );
+   nhash_free( &o.names );
+
+   /* Compress behind the header. */
+   zlen  = compressBound( o.len );
+   z     = malloc( SAVEBIN_HEADER + zlen );
+   memcpy( z, SAVEBIN_MAGIC, 4 );
+   savebin_putU32( &z[4], SAVEBIN_VERSION );
+   savebin_putU32( &z[8], o.len );
+   ret   = compress2( &z[SAVEBIN_HEADER], &zlen, o.data, o.len, Z_BEST_SPEED );
+   free( o.data );
+   if (ret != Z_OK) {
+      WARN("Unable to compress savegame '%s'.", file);
+      free( z );
+      return -1;
+   }
+
+   /* Write. */
+   fp = fopen( file, "wb" );
+   if (fp == NULL) {
+      WARN("Unable to open '%s' to write the savegame.", file);
+      free( z );
+      return -1;
+   }
+   ret = (fwrite( z, SAVEBIN_HEADER + zlen, 1, fp ) != 1);
+   ret = (fclose( fp ) != 0) || ret;
+   free( z );
+   if (ret) {
+      WARN("Failed to write savegame '%s'.", file);
+      return -1;
+   }
+   return 0;
+}
+
+
+/**
+ * @brief Reads a number from the stream.
+ */
+static size_t savebin_getNum( SaveBinIn *in )
+{
+   size_t v;
+   int shift;
+
+   v     = 0;
+   shift = 0;
+   while (in->p < in->end) {
+      v |= (size_t)(*in->p & 0x7F) << shift;
+      if (!(*in->p++ & 0x80))
+         return v;
+      shift += 7;
+      if (shift > 8*(int)sizeof(size_t)-7)
+         break;
+   }
+   in->err = 1;
+   return 0;
+}
+
+
+/**
+ * @brief Reads a value from the stream.
+ *
+ *    @return The value, it points into the stream.
+ */
+static const char* savebin_getValue( SaveBinIn *in, size_t *len )
+{
+   const char *s;
+   size_t n;
+
+   n = savebin_getNum( in );
+   if (in->err || (n >= (size_t)(in->end - in->p)) || (in->p[n] != '\0')) {
+      in->err = 1;
+      return NULL;
+   }
+   s      = (const char*)in->p;
+   in->p += n+1;
+   if (len != NULL)
+      *len = n;
+   return s;
+}
+
+
+/**
+ * @brief Reads a name from the stream.
+ */
+static const char* savebin_getName( SaveBinIn *in )
+{
+   const char *s;
+   size_t i;
+
+   i = savebin_getNum( in );
+   if (in->err)
+      return NULL;
+   if (i > 0) {
+      if (i > (size_t)array_size(in->names)) {
+         in->err = 1;
+         return NULL;
+      }
+      return in->names[i-1];
+   }
+
+   s = savebin_getValue( in, NULL );
+   if (s != NULL)
+      array_push_back( &in->names, s );
+   return s;
+}
+
+
+/**
+ * @brief Reads an element and its children from the stream, the token is
+ *  already read.
+ */
+static xmlNodePtr savebin_getElem( SaveBinIn *in, int depth )
+{
+   xmlNodePtr node, child;
+   const char *name, *value;
+   size_t i, nattr, len;
+   int t;
+
+   if (depth > 256) {
+      in->err = 1;
+      return NULL;
+   }
+
+   name = savebin_getName( in );
+   if (name == NULL)
+      return NULL;
+   node = xmlNewDocNode( in->doc, NULL, (const xmlChar*)name, NULL );
+
+   nattr = savebin_getNum( in );
+   for (i=0; (i<nattr) && !in->err; i++) {
+      name  = savebin_getName( in );
+      value = savebin_getValue( in, NULL );
+      if (!in->err)
+         xmlNewProp( node, (const xmlChar*)name, (const xmlChar*)value );
+   }
+
+   while (!in->err) {
+      if (in->p >= in->end) {
+         in->err = 1;
+         break;
+      }
+      t = *in->p++;
+      if (t == SAVEBIN_END)
+         return node;
+      else if (t == SAVEBIN_TEXT) {
+         value = savebin_getValue( in, &len );
+         if (value != NULL)
+            xmlAddChild( node, xmlNewDocTextLen( in->doc,
+                     (const xmlChar*)value, len ) );
+      }
+      else if (t == SAVEBIN_ELEM) {
+         child = savebin_getElem( in, depth+1 );
+         if (child != NULL)
+            xmlAddChild( node, child );
+      }
+      else
+         in->err = 1;
+   }
+
+   xmlFreeNode( node );
+   return NULL;
+}
+
+
+/**
+ * @brief Reads a little endian 32 bit number.
+ */
+static uint32_t savebin_getU32( const unsigned char *p )
+{
+   return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+         ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+/**
+ * @brief Rebuilds a document from a binary savegame.
+ */
+static xmlDocPtr savebin_decode( const char *buf, size_t len, const char *file )
+{
+   const unsigned char *h;
+   unsigned char *raw;
+   uLongf rawlen;
+   SaveBinIn in;
+   xmlNodePtr node;
+   int t;
+
+   h = (const unsigned char*) buf;
+   if ((len < SAVEBIN_HEADER) || (memcmp( h, SAVEBIN_MAGIC, 4 ) != 0)) {
+      WARN("'%s' is not a binary savegame.", file);
+      return NULL;
+   }
+   if (savebin_getU32( &h[4] ) != SAVEBIN_VERSION) {
+      WARN("Binary savegame '%s' has unknown version %u.", file,
+            savebin_getU32( &h[4] ));
+      return NULL;
+   }
+   rawlen = savebin_getU32( &h[8] );
+   if ((rawlen == 0) || (rawlen > SAVEBIN_MAX)) {
+      WARN("Binary savegame '%s' is corrupt.", file);
+      return NULL;
+   }
+
+   /* Inflate. */
+   raw = malloc( rawlen );
+   if ((uncompress( raw, &rawlen, &h[SAVEBIN_HEADER], len - SAVEBIN_HEADER ) != Z_OK) ||
+         (rawlen != savebin_getU32( &h[8] ))) {
+      WARN("Binary savegame '%s' is corrupt.", file);
+      free( raw );
+      return NULL;
+   }
+
+   /* Rebuild the tree. */
+   memset( &in, 0, sizeof(in) );
+   in.p     = raw;
+   in.end   = raw + rawlen;
+   in.names = array_create( const char* );
+   in.doc   = xmlNewDoc( (const xmlChar*)"1.0" );
+   while (!in.err) {
+      if (in.p >= in.end) {
+         in.err = 1;
+         break;
+      }
+      t = *in.p++;
+      if (t == SAVEBIN_END)
+         break;
+      if (t != SAVEBIN_ELEM) {
+         in.err = 1;
+         break;
+      }
+      node = savebin_getElem( &in, 0 );
+      if (node == NULL)
+         break;
+      if (xmlDocGetRootElement( in.doc ) == NULL)
+         xmlDocSetRootElement( in.doc, node );
+      else
+         xmlAddChild( (xmlNodePtr)in.doc, node );
+   }
+   array_free( in.names );
+   free( raw );
+
+   if (in.err || (xmlDocGetRootElement( in.doc ) == NULL)) {
+      WARN("Binary savegame '%s' is corrupt.", file);
+      xmlFreeDoc( in.doc );
+      return NULL;
+   }
+   return in.doc;
+}
+
+
+/**
+ * @brief Checks whether a savegame is in the binary format.
+ *
+ *    @param file Savegame to check.
+ *    @return 1 if it is binary.
+ */
+int savebin_isBinary( const char *file )
+{
+   FILE *fp;
+   char magic[4];
+   int ret;
+
+   fp = fopen( file, "rb" );
+   if (fp == NULL)
+      return 0;
+   ret = (fread( magic, 4, 1, fp ) == 1) &&
+         (memcmp( magic, SAVEBIN_MAGIC, 4 ) == 0);
+   fclose( fp );
+   return ret;
+}
+
+
+/**
+ * @brief Parses a savegame, whatever its format.
+ *
+ *    @param file Savegame to parse.
+ *    @return The document or NULL on error.
+ */
+xmlDocPtr savebin_parseFile( const char *file )
+{
+   xmlDocPtr doc;
+   char *buf;
+   int len;
+
+   if (!savebin_isBinary( file ))
+      return xmlParseFile( file );
+
+   buf = nfile_readFile( &len, "%s", file );
+   if (buf == NULL)
+      return NULL;
+   doc = savebin_decode( buf, len, file );
+   free( buf );
+   return doc;
+}
+
+
+/**
+ * @brief Rewrites a savegame in the binary or XML format.
+ *
+ * The old savegame is backed up first.
+ *
+ *    @param file Savegame to convert.
+ *    @param binary Whether to convert to binary, XML otherwise.
+ *    @return 0 on success.
+ */
+int savebin_convert( const char *file, int binary )
+{
+   xmlDocPtr doc;
+   int ret;
+
+   doc = savebin_parseFile( file );
+   if (doc == NULL) {
+      WARN("Unable to read savegame '%s'.", file);
+      return -1;
+   }
+   if (nfile_backupIfExists( "%s", file ) < 0) {
+      xmlFreeDoc( doc );
+      return -1;
+   }
+
+   if (binary)
+      ret = savebin_write( file, doc );
+   else
+      ret = (xmlSaveFormatFileEnc( file, doc, "UTF-8", 1 ) < 0) ? -1 : 0;
+   xmlFreeDoc( doc );
+
+   if (ret == 0)
+      LOG("Converted '%s' to %s.", file, binary ? "binary" : "XML");
+   else
+      WARN("Unable to convert '%s'.", file);
+   return ret;
+}
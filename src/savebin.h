@@ -0,0 +1,22 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef SAVEBIN_H
+#  define SAVEBIN_H
+
+
+#include "nxml.h"
+
+
+/* Reading and writing. */
+int savebin_isBinary( const char *file );
+xmlDocPtr savebin_parseFile( const char *file );
+int savebin_write( const char *file, xmlDocPtr doc );
+
+/* Conversion. */
+int savebin_convert( const char *file, int binary );
+
+
+#endif /* SAVEBIN_H */
@@ -0,0 +1,184 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file scratch.c
+ *
+ * @brief Frame scoped memory for temporaries.
+ *
+ * Allocations just bump a pointer in a block and are never freed one by one.
+ *  Everything allocated is dropped when the frame ends, and code that wants
+ *  its memory back sooner can release to a mark it took beforehand, which
+ *  drops everything allocated since in one go.
+ *
+ * When a block runs out another one is chained so earlier allocations don't
+ *  move. At the end of the frame the chain is merged into a single block big
+ *  enough for all of it, so the next frames don't need to chain.
+ *
+ * Only meant for the main thread.
+ */
+
+
+#include "scratch.h"
+
+#include "naev.h"
+
+#include <stdlib.h>
+
+#include "log.h"
+
+
+#define SCRATCH_ALIGN   16 /**< Alignment of the allocations. */
+#define SCRATCH_BLOCK   (64*1024) /**< Minimum size of a block. */
+
+
+/**
+ * @brief Block of scratch memory, the data follows it.
+ */
+typedef struct ScratchBlock_ {
+   struct ScratchBlock_ *prev; /**< Block chained before this one. */
+   size_t size; /**< Bytes of data in the block. */
+   size_t used; /**< Bytes of data in use. */
+} ScratchBlock;
+
+
+#define SCRATCH_HEADER  ((sizeof(ScratchBlock) + SCRATCH_ALIGN-1) & ~(size_t)(SCRATCH_ALIGN-1)) /**< Header size keeping the data aligned. */
+
+
+static ScratchBlock *scratch_cur = NULL; /**< Block being allocated from. */
+static size_t scratch_total      = 0; /**< Bytes in all the blocks. */
+
+
+/*
+ * Prototypes.
+ */
+static ScratchBlock* scratch_newBlock( size_t size );
+
+
+/**
+ * @brief Chains a new block.
+ *
+ *    @param size Minimum bytes the block must hold.
+ *    @return The new block or NULL on error.
+ */
+static ScratchBlock* scratch_newBlock( size_t size )
+{
+   ScratchBlock *b;
+
+   size = MAX( size, SCRATCH_BLOCK );
+   b    = malloc( SCRATCH_HEADER + size );
+   if (b == NULL) {
+      WARN("Out of Memory");
+      return NULL;
+   }
+   b->prev        = scratch_cur;
+   b->size        = size;
+   b->used        = 0;
+   scratch_cur    = b;
+   scratch_total += size;
+   return b;
+}
+
+
+/**
+ * @brief Allocates scratch memory.
+ *
+ * The memory is valid until the end of the frame or until released to an
+ *  earlier mark, whatever comes first.
+ *
+ *    @param size Bytes to allocate.
+ *    @return The memory allocated or NULL on error.
+ */
+void* scratch_alloc( size_t size )
+{
+   ScratchBlock *b;
+   void *ptr;
+
+   size = (size + SCRATCH_ALIGN-1) & ~(size_t)(SCRATCH_ALIGN-1);
+   b    = scratch_cur;
+   if ((b == NULL) || (b->size - b->used < size)) {
+      b = scratch_newBlock( MAX( size, scratch_total ) );
+      if (b == NULL)
+         return NULL;
+   }
+   ptr      = (char*)b + SCRATCH_HEADER + b->used;
+   b->used += size;
+   return ptr;
+}
+
+
+/**
+ * @brief Marks the current position of the scratch memory.
+ *
+ *    @return Mark to release to with scratch_release().
+ */
+ScratchMark scratch_mark (void)
+{
+   ScratchMark m;
+
+   m.block = scratch_cur;
+   m.used  = (scratch_cur != NULL) ? scratch_cur->used : 0;
+   return m;
+}
+
+
+/**
+ * @brief Releases all the scratch memory allocated since a mark.
+ *
+ * Marks must be released in the opposite order they were taken, it's fine
+ *  to never release one as the frame ending will.
+ *
+ *    @param mark Mark to release to.
+ */
+void scratch_release( ScratchMark mark )
+{
+   ScratchBlock *b;
+
+   /* Blocks chained since are kept until the frame ends. */
+   for (b=scratch_cur; b!=NULL; b=b->prev) {
+      if (b == mark.block) {
+         b->used = mark.used;
+         return;
+      }
+      b->used = 0;
+   }
+}
+
+
+/**
+ * @brief Drops all the scratch memory, done at the end of each frame.
+ */
+void scratch_reset (void)
+{
+   size_t total;
+
+   if (scratch_cur == NULL)
+      return;
+
+   /* Merge the chain into one block. */
+   if (scratch_cur->prev != NULL) {
+      total = scratch_total;
+      scratch_exit();
+      scratch_newBlock( total );
+      return;
+   }
+
+   scratch_cur->used = 0;
+}
+
+
+/**
+ * @brief Frees all the scratch memory.
+ */
+void scratch_exit (void)
+{
+   ScratchBlock *b;
+
+   while (scratch_cur != NULL) {
+      b           = scratch_cur;
+      scratch_cur = b->prev;
+      free( b );
+   }
+   scratch_total = 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef SCRATCH_H
+#  define SCRATCH_H
+
+
+#include <stddef.h>
+
+
+/**
+ * @brief Position in the scratch memory to release back to.
+ */
+typedef struct ScratchMark_ {
+   void *block; /**< Block allocations were being made from. */
+   size_t used; /**< Bytes of the block in use. */
+} ScratchMark;
+
+
+/*
+ * Allocation.
+ */
+void* scratch_alloc( size_t size );
+ScratchMark scratch_mark (void);
+void scratch_release( ScratchMark mark );
+
+/*
+ * Frame.
+ */
+void scratch_reset (void);
+void scratch_exit (void);
+
+
+#endif /* SCRATCH_H */
@@ -28,6 +28,7 @@
 #include "shipstats.h"
 #include "slots.h"
 #include "nfile.h"
+#include "nhash.h"
 
 
 #define XML_SHIP  "ship" /**< XML individual ship identifier. */
@@ -45,15 +46,23 @@
 
 #define STATS_DESC_MAX 256 /**< Maximum length for statistics description. */
 
+#define SHIP_GFX_BUDGET (64*1024*1024) /**< Bytes of unused ship graphics to keep around. */
+
 
 static Ship* ship_stack = NULL; /**< Stack of ships available in the game. */
+static NameHash ship_hash; /**< Ship name to stack index. */
+static unsigned int ship_gfxTick = 0; /**< Use counter to find the least recently used graphics. */
 
 
 /*
  * Prototypes
  */
-static int ship_loadGFX( Ship *temp, char *buf, int sx, int sy, int engine );
+static int ship_loadGFX( Ship *temp, char *buf, int sx, int sy, int engine, int rotate );
+static void ship_finishGFX( Ship *temp, glTexAsync *space, glTexAsync *engine );
+static void ship_freeGFX( Ship *temp );
+static size_t ship_gfxSize( const Ship *temp );
 static int ship_parse( Ship *temp, xmlNodePtr parent );
+static void ship_loadDoc( xmlDocPtr doc, int i, void *data );
 
 
 /**
@@ -64,13 +73,11 @@ static int ship_parse( Ship *temp, xmlNodePtr parent );
  */
 Ship* ship_get( const char* name )
 {
-   Ship *temp;
    int i;
 
-   temp = ship_stack;
-   for (i=0; i < array_size(ship_stack); i++)
-      if (strcmp(temp[i].name, name)==0)
-         return &temp[i];
+   i = nhash_get( &ship_hash, name );
+   if (i >= 0)
+      return &ship_stack[i];
 
    WARN("Ship %s does not exist", name);
    return NULL;
@@ -85,13 +92,11 @@ Ship* ship_get( const char* name )
  */
 Ship* ship_getW( const char* name )
 {
-   Ship *temp;
    int i;
 
-   temp = ship_stack;
-   for (i=0; i < array_size(ship_stack); i++)
-      if (strcmp(temp[i].name, name)==0)
-         return &temp[i];
+   i = nhash_get( &ship_hash, name );
+   if (i >= 0)
+      return &ship_stack[i];
 
    return NULL;
 }
@@ -422,7 +427,8 @@ static int ship_genTargetGFX( Ship *temp, SDL_Surface *surface, int sx, int sy )
 
    /* Load the store surface. */
    nsnprintf( buf, sizeof(buf), "%s_gfx_store.png", temp->name );
-   temp->gfx_store = gl_loadImagePad( buf, gfx_store, 0, SHIP_TARGET_W, SHIP_TARGET_H, 1, 1, 1 );
+   temp->gfx_store = gl_loadImagePad( buf, gfx_store, OPENGL_TEX_ATLAS,
+         SHIP_TARGET_W, SHIP_TARGET_H, 1, 1, 1 );
 
 #if 0 /* Disabled for now due to issues with larger sprites. */
    /* Some filtering. */
@@ -464,19 +470,15 @@ static int ship_genTargetGFX( Ship *temp, SDL_Surface *surface, int sx, int sy )
 
 
 /**
- * @brief Loads the graphics for a ship.
+ * @brief Sets up the graphics of a ship to be loaded when first needed.
  *
  *    @param temp Ship to load into.
  *    @param buf Name of the texture to work with.
  */
-static int ship_loadGFX( Ship *temp, char *buf, int sx, int sy, int engine )
+static int ship_loadGFX( Ship *temp, char *buf, int sx, int sy, int engine, int rotate )
 {
    char base[PATH_MAX], str[PATH_MAX];
    int i;
-   png_uint_32 w, h;
-   SDL_RWops *rw;
-   npng_t *npng;
-   SDL_Surface *surface;
 
    /* Get base path. */
    for (i=0; i<PATH_MAX; i++) {
@@ -491,46 +493,232 @@ static int ship_loadGFX( Ship *temp, char *buf, int sx, int sy, int engine )
       return -1;
    }
 
-   /* Load the space sprite. */
-   nsnprintf( str, PATH_MAX, SHIP_GFX_PATH"%s/%s"SHIP_EXT, base, buf );
-   rw    = ndata_rwops( str );
-   npng  = npng_open( rw );
-   npng_dim( npng, &w, &h );
-   surface = npng_readSurface( npng, gl_needPOT(), 1 );
-
-   /* Load the texture. */
-   temp->gfx_space = gl_loadImagePadTrans( str, surface, rw,
-         OPENGL_TEX_MAPTRANS | OPENGL_TEX_MIPMAPS,
-         w, h, sx, sy, 0 );
-
-   /* Create the target graphic. */
-   ship_genTargetGFX( temp, surface, sx, sy );
-
-   /* Free stuff. */
-   npng_close( npng );
-   SDL_RWclose( rw );
-   SDL_FreeSurface( surface );
-
-   /* Load the engine sprite .*/
-   if (engine && conf.engineglow && conf.interpolate) {
-      nsnprintf( str, PATH_MAX, SHIP_GFX_PATH"%s/%s"SHIP_ENGINE SHIP_EXT, base, buf );
-      temp->gfx_engine = gl_newSprite( str, sx, sy, OPENGL_TEX_MIPMAPS );
-      if (temp->gfx_engine == NULL)
-         WARN("Ship '%s' does not have an engine sprite (%s).", temp->name, str );
-   }
-
-   /* Calculate mount angle. */
-   temp->mangle  = 2.*M_PI;
-   temp->mangle /= temp->gfx_space->sx * temp->gfx_space->sy;
-
    /* Get the comm graphic for future loading. */
    nsnprintf( str, PATH_MAX, SHIP_GFX_PATH"%s/%s"SHIP_COMM SHIP_EXT, base, buf );
    temp->gfx_comm = strdup(str);
 
+   /* Remember how to load the sprites. */
+   nsnprintf( str, PATH_MAX, SHIP_GFX_PATH"%s/%s", base, buf );
+   temp->gfx_path   = strdup(str);
+   temp->gfx_sx     = sx;
+   temp->gfx_sy     = sy;
+   temp->gfx_engine_on = engine;
+   temp->gfx_rotate = rotate;
+
+   /* Calculate mount angle. */
+   temp->mangle  = 2.*M_PI;
+   temp->mangle /= sx * sy;
+
    return 0;
 }
 
 
+/**
+ * @brief Loads the space graphics of a ship if they aren't loaded yet.
+ *
+ * The sprites are decoded on the threadpool while the engine glow is
+ *  decoded, with rotate the files hold a single image facing the direction 0
+ *  and the sprite sheets are generated from it.
+ *
+ *    @param s Ship to load the graphics of.
+ *    @return 0 on success.
+ */
+int ship_gfxLoad( Ship *s )
+{
+   char str[PATH_MAX];
+   int engine;
+   SDL_Surface *surface;
+   glTexAsync *space, *glow;
+
+   s->gfx_used = ++ship_gfxTick;
+   if (s->gfx_space != NULL)
+      return 0;
+   if (s->gfx_path == NULL)
+      return -1;
+
+   engine = s->gfx_engine_on && conf.engineglow && conf.interpolate;
+
+   /* Sheets rendered from a single image. */
+   if (s->gfx_rotate) {
+      nsnprintf( str, PATH_MAX, "%s"SHIP_EXT, s->gfx_path );
+      s->gfx_space = gl_newRotatedSprite( str, s->gfx_sx, s->gfx_sy,
+            OPENGL_TEX_MAPTRANS | OPENGL_TEX_MIPMAPS, &surface );
+      if (s->gfx_space == NULL) {
+         WARN("Ship '%s' missing 'GFX' element", s->name);
+         return -1;
+      }
+      if (surface != NULL) {
+         ship_genTargetGFX( s, surface, s->gfx_sx, s->gfx_sy );
+         SDL_FreeSurface( surface );
+      }
+      if (engine) {
+         nsnprintf( str, PATH_MAX, "%s"SHIP_ENGINE SHIP_EXT, s->gfx_path );
+         s->gfx_engine = gl_newRotatedSprite( str, s->gfx_sx, s->gfx_sy,
+               OPENGL_TEX_MIPMAPS, NULL );
+         if (s->gfx_engine == NULL)
+            WARN("Ship '%s' does not have an engine sprite.", s->name );
+      }
+      return 0;
+   }
+
+   /* Start decoding the space sprite. */
+   nsnprintf( str, PATH_MAX, "%s"SHIP_EXT, s->gfx_path );
+   space = gl_newSpriteAsync( str, s->gfx_sx, s->gfx_sy,
+         OPENGL_TEX_MAPTRANS | OPENGL_TEX_MIPMAPS | OPENGL_TEX_CACHE );
+
+   /* Start decoding the engine sprite .*/
+   glow = NULL;
+   if (engine) {
+      nsnprintf( str, PATH_MAX, "%s"SHIP_ENGINE SHIP_EXT, s->gfx_path );
+      glow = gl_newSpriteAsync( str, s->gfx_sx, s->gfx_sy,
+            OPENGL_TEX_MIPMAPS | OPENGL_TEX_CACHE );
+   }
+
+   ship_finishGFX( s, space, glow );
+   return (s->gfx_space == NULL) ? -1 : 0;
+}
+
+
+/**
+ * @brief Finishes loading the graphics of a ship.
+ *
+ *    @param temp Ship to load into.
+ *    @param space Space sprite being decoded.
+ *    @param engine Engine sprite being decoded or NULL.
+ */
+static void ship_finishGFX( Ship *temp, glTexAsync *space, glTexAsync *engine )
+{
+   SDL_Surface *surface;
+
+   /* Keep the decoded pixels for the target graphic, the upload frees them. */
+   surface = (space != NULL) ? gl_asyncSurface( space ) : NULL;
+   if (surface != NULL)
+      surface->refcount++;
+
+   /* Upload the sprites. */
+   temp->gfx_space = (space != NULL) ? gl_asyncFinish( space ) : NULL;
+   if (surface != NULL) {
+      if (temp->gfx_space != NULL)
+         ship_genTargetGFX( temp, surface, temp->gfx_sx, temp->gfx_sy );
+      SDL_FreeSurface( surface );
+   }
+   if (engine != NULL) {
+      temp->gfx_engine = gl_asyncFinish( engine );
+      if (temp->gfx_engine == NULL)
+         WARN("Ship '%s' does not have an engine sprite.", temp->name );
+   }
+   if (temp->gfx_space == NULL)
+      WARN("Ship '%s' missing 'GFX' element", temp->name);
+}
+
+
+/**
+ * @brief Frees the space graphics of a ship, they get loaded again when needed.
+ *
+ *    @param temp Ship to free the graphics of.
+ */
+static void ship_freeGFX( Ship *temp )
+{
+   if (temp->gfx_space != NULL)
+      gl_freeTexture(temp->gfx_space);
+   if (temp->gfx_engine != NULL)
+      gl_freeTexture(temp->gfx_engine);
+   if (temp->gfx_target != NULL)
+      gl_freeTexture(temp->gfx_target);
+   if (temp->gfx_store != NULL)
+      gl_freeTexture(temp->gfx_store);
+   temp->gfx_space   = NULL;
+   temp->gfx_engine  = NULL;
+   temp->gfx_target  = NULL;
+   temp->gfx_store   = NULL;
+}
+
+
+/**
+ * @brief Estimates the texture memory used by the graphics of a ship.
+ */
+static size_t ship_gfxSize( const Ship *temp )
+{
+   size_t size;
+
+   size = 0;
+   if (temp->gfx_space != NULL)
+      size += (size_t)(temp->gfx_space->rw * temp->gfx_space->rh * 4.);
+   if (temp->gfx_engine != NULL)
+      size += (size_t)(temp->gfx_engine->rw * temp->gfx_engine->rh * 4.);
+   if (temp->gfx_target != NULL)
+      size += (size_t)(temp->gfx_target->rw * temp->gfx_target->rh * 4.);
+   if (temp->gfx_store != NULL)
+      size += (size_t)(temp->gfx_store->rw * temp->gfx_store->rh * 4.);
+   return size;
+}
+
+
+/**
+ * @brief Marks the graphics of a ship as used, loading them if needed.
+ *
+ * Used graphics are never freed by ships_gfxGC(), every call must be matched
+ *  by a ship_gfxRelease().
+ *
+ *    @param s Ship being used.
+ */
+void ship_gfxUse( Ship *s )
+{
+   s->gfx_refs++;
+   ship_gfxLoad( s );
+}
+
+
+/**
+ * @brief Stops using the graphics of a ship.
+ *
+ *    @param s Ship no longer used.
+ */
+void ship_gfxRelease( Ship *s )
+{
+   if (s->gfx_refs <= 0) {
+      WARN("Ship '%s' graphics released more times than used.", s->name);
+      return;
+   }
+   s->gfx_refs--;
+   s->gfx_used = ++ship_gfxTick;
+}
+
+
+/**
+ * @brief Frees the least recently used graphics of ships that are not in use
+ *        until they fit in the budget.
+ *
+ * Graphics shown without being used, like in the shipyard, may be freed so this
+ *  must not run while they are displayed.
+ */
+void ships_gfxGC (void)
+{
+   int i, lru;
+   size_t total;
+
+   /* Only unused graphics count. */
+   total = 0;
+   for (i=0; i<array_size(ship_stack); i++)
+      if (ship_stack[i].gfx_refs <= 0)
+         total += ship_gfxSize( &ship_stack[i] );
+
+   while (total > SHIP_GFX_BUDGET) {
+      lru = -1;
+      for (i=0; i<array_size(ship_stack); i++) {
+         if ((ship_stack[i].gfx_refs > 0) || (ship_stack[i].gfx_space == NULL))
+            continue;
+         if ((lru < 0) || (ship_stack[i].gfx_used < ship_stack[lru].gfx_used))
+            lru = i;
+      }
+      if (lru < 0)
+         break;
+      total -= MIN( total, ship_gfxSize( &ship_stack[lru] ) );
+      ship_freeGFX( &ship_stack[lru] );
+   }
+}
+
+
 /**
  * @brief Parses a slot for a ship.
  *
@@ -662,7 +850,7 @@ static int ship_parse( Ship *temp, xmlNodePtr parent )
    xmlNodePtr cur, node;
    int sx, sy;
    char *stmp, *buf;
-   int l, m, h, engine;
+   int l, m, h, engine, rotate;
    ShipStatList *ll;
 
    /* Clear memory. */
@@ -726,8 +914,16 @@ static int ship_parse( Ship *temp, xmlNodePtr parent )
          else
             engine = 1;
 
+         xmlr_attr(node, "rotate", stmp );
+         if (stmp != NULL) {
+            rotate = atoi(stmp);
+            free(stmp);
+         }
+         else
+            rotate = 0;
+
          /* Load the graphics. */
-         ship_loadGFX( temp, buf, sx, sy, engine );
+         ship_loadGFX( temp, buf, sx, sy, engine, rotate );
 
          continue;
       }
@@ -875,7 +1071,7 @@ static int ship_parse( Ship *temp, xmlNodePtr parent )
 #define MELEMENT(o,s)      if (o) WARN("Ship '%s' missing '"s"' element", temp->name)
    MELEMENT(temp->name==NULL,"name");
    MELEMENT(temp->base_type==NULL,"base_type");
-   MELEMENT(temp->gfx_space==NULL,"GFX");
+   MELEMENT(temp->gfx_comm==NULL,"GFX");
    MELEMENT(temp->gui==NULL,"GUI");
    MELEMENT(temp->class==SHIP_CLASS_NULL,"class");
    MELEMENT(temp->price==0,"price");
@@ -901,6 +1097,35 @@ static int ship_parse( Ship *temp, xmlNodePtr parent )
 }
 
 
+/**
+ * @brief Loads a ship from a parsed file.
+ */
+static void ship_loadDoc( xmlDocPtr doc, int i, void *data )
+{
+   char **ship_files;
+   xmlNodePtr node;
+
+   if (doc == NULL)
+      return;
+
+   ship_files = data;
+   node = doc->xmlChildrenNode; /* First ship node */
+   if (node == NULL) {
+      xmlFreeDoc(doc);
+      WARN("Malformed %s%s file: does not contain elements",
+            SHIP_DATA_PATH, ship_files[i]);
+      return;
+   }
+
+   if (xml_isNode(node, XML_SHIP))
+      /* Load the ship. */
+      ship_parse( &array_grow(&ship_stack), node );
+
+   /* Clean up. */
+   xmlFreeDoc(doc);
+}
+
+
 /**
  * @brief Loads all the ships in the data files.
  *
@@ -908,11 +1133,9 @@ static int ship_parse( Ship *temp, xmlNodePtr parent )
  */
 int ships_load (void)
 {
-   uint32_t bufsize, nfiles;
-   char *buf, **ship_files, *file;
-   int i, sl;
-   xmlNodePtr node;
-   xmlDocPtr doc;
+   uint32_t nfiles;
+   char **ship_files;
+   int i;
 
    /* Sanity. */
    ss_check();
@@ -922,47 +1145,18 @@ int ships_load (void)
       ship_stack = array_create(Ship);
    }
 
+   /* Parse the XML in parallel. */
    ship_files = ndata_list( SHIP_DATA_PATH, &nfiles );
-   for (i=0; i<(int)nfiles; i++) {
-
-      /* Get the file name .*/
-      sl   = strlen(SHIP_DATA_PATH)+strlen(ship_files[i])+1;
-      file = malloc( sl );
-      nsnprintf( file, sl, "%s%s", SHIP_DATA_PATH, ship_files[i] );
-
-      /* Load the XML. */
-      buf  = ndata_read( file, &bufsize );
-      doc  = xmlParseMemory( buf, bufsize );
-
-      if (doc == NULL) {
-         free(buf);
-         WARN("%s file is invalid xml!", file);
-         free(file);
-         continue;
-      }
-
-      node = doc->xmlChildrenNode; /* First ship node */
-      if (node == NULL) {
-         xmlFreeDoc(doc);
-         free(buf);
-         WARN("Malformed %s file: does not contain elements", file);
-         free(file);
-         continue;
-      }
-
-      free(file);
-
-      if (xml_isNode(node, XML_SHIP))
-         /* Load the ship. */
-         ship_parse( &array_grow(&ship_stack), node );
-
-      /* Clean up. */
-      xmlFreeDoc(doc);
-      free(buf);
-   }
+   xml_forEachFile( SHIP_DATA_PATH, ship_files, nfiles, ship_loadDoc, ship_files );
 
    /* Shrink stack. */
    array_shrink(&ship_stack);
+
+   /* Index by name, backwards so the first of duplicates wins. */
+   nhash_init( &ship_hash );
+   for (i=array_size(ship_stack)-1; i>=0; i--)
+      nhash_set( &ship_hash, ship_stack[i].name, i );
+
    DEBUG("Loaded %d Ship%s", array_size(ship_stack), (array_size(ship_stack)==1) ? "" : "s" );
 
    /* Clean up. */
@@ -1012,16 +1206,12 @@ void ships_free (void)
          ss_free( s->stats );
 
       /* Free graphics. */
-      gl_freeTexture(s->gfx_space);
-      if (s->gfx_engine != NULL)
-         gl_freeTexture(s->gfx_engine);
-      if (s->gfx_target != NULL)
-         gl_freeTexture(s->gfx_target);
-      if (s->gfx_store != NULL)
-         gl_freeTexture(s->gfx_store);
+      ship_freeGFX( s );
+      free(s->gfx_path);
       free(s->gfx_comm);
    }
 
    array_free(ship_stack);
    ship_stack = NULL;
+   nhash_free( &ship_hash );
 }
@@ -115,11 +115,18 @@ typedef struct Ship_ {
    double dmg_absorb; /**< Damage absorption in per one [0:1] with 1 being 100% absorption. */
 
    /* graphics */
-   glTexture *gfx_space; /**< Space sprite sheet. */
+   glTexture *gfx_space; /**< Space sprite sheet, NULL until ship_gfxLoad(). */
    glTexture *gfx_engine; /**< Space engine glow sprite sheet. */
    glTexture *gfx_target; /**< Targeting window graphic. */
    glTexture *gfx_store; /**< Store graphic. */
    char* gfx_comm;   /**< Name of graphic for communication. */
+   char* gfx_path;   /**< Path of the sprites without extension. */
+   int gfx_sx;       /**< X sprites. */
+   int gfx_sy;       /**< Y sprites. */
+   int gfx_engine_on; /**< Whether the ship has an engine glow sprite. */
+   int gfx_rotate;   /**< Sprites are generated from a single image. */
+   int gfx_refs;     /**< Users of the graphics, see ship_gfxUse(). */
+   unsigned int gfx_used; /**< When the graphics were last used. */
 
    /* GUI interface */
    char* gui;        /**< Name of the GUI the ship uses by default. */
@@ -165,6 +172,15 @@ credits_t ship_buyPrice( const Ship* s );
 glTexture* ship_loadCommGFX( Ship* s );
 
 
+/*
+ * graphics
+ */
+int ship_gfxLoad( Ship *s );
+void ship_gfxUse( Ship *s );
+void ship_gfxRelease( Ship *s );
+void ships_gfxGC (void);
+
+
 /*
  * misc.
  */
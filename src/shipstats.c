@@ -335,6 +335,105 @@ int ss_statsModFromList( ShipStats *stats, const ShipStatList* list, const ShipS
 }
 
 
+/**
+ * @brief Adds or removes a stat list from a running sum.
+ *
+ * Unlike ss_statsModFromList() nothing is clamped and booleans are counted,
+ *  so removing a list undoes adding it. ss_statsClamp() turns the sum into
+ *  usable stats.
+ *
+ *    @param stats Sum to update.
+ *    @param list List to add or remove.
+ *    @param amount Number of positive modifiers of each stat to update.
+ *    @param sign 1 to add the list, -1 to remove it.
+ *    @return 0 on success.
+ */
+int ss_statsModSum( ShipStats *stats, const ShipStatList* list, ShipStats *amount, int sign )
+{
+   char *ptr, *aptr;
+   double *dbl;
+   int *i;
+   const ShipStatList *ll;
+   const ShipStatsLookup *sl;
+
+   ptr  = (char*) stats;
+   aptr = (char*) amount;
+   for (ll = list; ll != NULL; ll = ll->next) {
+      sl = &ss_lookup[ ll->type ];
+      switch (sl->data) {
+         case SS_DATA_TYPE_DOUBLE:
+         case SS_DATA_TYPE_DOUBLE_ABSOLUTE:
+            dbl   = (double*) &ptr[ sl->offset ];
+            *dbl += sign * ll->d.d;
+            if ((sl->inverted && (ll->d.d < 0.)) ||
+                  (!sl->inverted && (ll->d.d > 0.))) {
+               dbl   = (double*) &aptr[ sl->offset ];
+               *dbl += sign;
+            }
+            break;
+
+         case SS_DATA_TYPE_INTEGER:
+            i     = (int*) &ptr[ sl->offset ];
+            *i   += sign * ll->d.i;
+            if ((sl->inverted && (ll->d.i < 0)) ||
+                  (!sl->inverted && (ll->d.i > 0))) {
+               i     = (int*) &aptr[ sl->offset ];
+               *i   += sign;
+            }
+            break;
+
+         case SS_DATA_TYPE_BOOLEAN:
+            i     = (int*) &ptr[ sl->offset ];
+            *i   += sign;
+            break;
+      }
+   }
+
+   return 0;
+}
+
+
+/**
+ * @brief Turns a sum built with ss_statsModSum() into usable stats.
+ *
+ *    @param stats Stats to clamp.
+ *    @return 0 on success.
+ */
+int ss_statsClamp( ShipStats *stats )
+{
+   int j;
+   char *ptr;
+   double *dbl;
+   int *i;
+   const ShipStatsLookup *sl;
+
+   ptr = (char*) stats;
+   for (j=0; j<SS_TYPE_SENTINEL; j++) {
+      sl = &ss_lookup[ j ];
+      if (sl->name == NULL)
+         continue;
+
+      switch (sl->data) {
+         case SS_DATA_TYPE_DOUBLE:
+            dbl   = (double*) &ptr[ sl->offset ];
+            *dbl  = MAX( 0., *dbl );
+            break;
+
+         case SS_DATA_TYPE_BOOLEAN:
+            i     = (int*) &ptr[ sl->offset ];
+            *i    = (*i > 0);
+            break;
+
+         case SS_DATA_TYPE_DOUBLE_ABSOLUTE:
+         case SS_DATA_TYPE_INTEGER:
+            break;
+      }
+   }
+
+   return 0;
+}
+
+
 /**
  * @brief Gets the name from type.
  *
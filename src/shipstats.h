@@ -231,6 +231,8 @@ void ss_free( ShipStatList *ll );
 int ss_statsInit( ShipStats *stats );
 int ss_statsModSingle( ShipStats *stats, const ShipStatList* list, const ShipStats *amount );
 int ss_statsModFromList( ShipStats *stats, const ShipStatList* list, const ShipStats *amount );
+int ss_statsModSum( ShipStats *stats, const ShipStatList* list, ShipStats *amount, int sign );
+int ss_statsClamp( ShipStats *stats );
 
 /*
  * Lookup.
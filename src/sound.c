@@ -30,6 +30,9 @@
 #include "conf.h"
 #include "player.h"
 #include "camera.h"
+#include "threadpool.h"
+#include "nhash.h"
+#include "startup.h"
 
 
 #define SOUND_SUFFIX_WAV   ".wav" /**< Suffix of sounds. */
@@ -39,6 +42,18 @@
 #define voiceLock()        SDL_LockMutex(voice_mutex)
 #define voiceUnlock()      SDL_UnlockMutex(voice_mutex)
 
+#define soundLoadLock()    SDL_LockMutex(sound_load_mutex)
+#define soundLoadUnlock()  SDL_UnlockMutex(sound_load_mutex)
+
+
+/*
+ * Sound decoding states.
+ */
+#define SOUND_UNLOADED     0 /**< Only registered, decoded on first use. */
+#define SOUND_LOADING      1 /**< Being decoded. */
+#define SOUND_LOADED       2 /**< Ready to play. */
+#define SOUND_FAILED       3 /**< Failed to decode, never plays. */
+
 
 /*
  * Global sound properties.
@@ -52,6 +67,10 @@ static int sound_initialized  = 0; /**< Whether or not sound is initialized. */
  */
 static alSound *sound_list    = NULL; /**< List of available sounds. */
 static int sound_nlist        = 0; /**< Number of available sounds. */
+static NameHash sound_hash;         /**< Sound name to list index. */
+static SDL_mutex *sound_load_mutex = NULL; /**< Lock for the decoding state of sounds. */
+static SDL_cond *sound_load_cond = NULL; /**< Signalled when a sound finishes decoding. */
+static int sound_npending     = 0; /**< Sounds being decoded in the background. */
 
 
 /*
@@ -120,6 +139,8 @@ int  (*sound_sys_env) ( SoundEnv_t env, double param ) = NULL;
 /* General. */
 static int sound_makeList (void);
 static int sound_load( alSound *snd, const char *filename );
+static alSound* sound_require( int sound );
+static int sound_loadJob( void *data );
 static void sound_free( alSound *snd );
 /* Voices. */
 
@@ -254,6 +275,10 @@ int sound_init (void)
    if (voice_mutex == NULL)
       WARN("Unable to create voice mutex.");
 
+   /* Create the decoding lock. */
+   sound_load_mutex = SDL_CreateMutex();
+   sound_load_cond  = SDL_CreateCond();
+
    /* Load available sounds. */
    ret = sound_makeList();
    if (ret != 0)
@@ -321,12 +346,24 @@ void sound_exit (void)
       voice_mutex = NULL;
    }
 
+   /* Wait for the sounds still decoding. */
+   soundLoadLock();
+   while (sound_npending > 0)
+      SDL_CondWait( sound_load_cond, sound_load_mutex );
+   soundLoadUnlock();
+
    /* free the sounds */
    for (i=0; i<sound_nlist; i++)
       sound_free( &sound_list[i] );
    free( sound_list );
    sound_list = NULL;
    sound_nlist = 0;
+   nhash_free( &sound_hash );
+
+   SDL_DestroyCond( sound_load_cond );
+   SDL_DestroyMutex( sound_load_mutex );
+   sound_load_cond  = NULL;
+   sound_load_mutex = NULL;
 
    /* Exit sound subsystem. */
    sound_sys_exit();
@@ -349,15 +386,131 @@ int sound_get( char* name )
    if (sound_disabled)
       return 0;
 
-   for (i=0; i<sound_nlist; i++)
-      if (strcmp(name, sound_list[i].name)==0)
-         return i;
+   i = nhash_get( &sound_hash, name );
+   if (i >= 0)
+      return i;
 
    WARN("Sound '%s' not found in sound list", name);
    return -1;
 }
 
 
+/**
+ * @brief Gets a sound ready to play, decoding it if it wasn't used before.
+ *
+ *    @param sound Sound to get.
+ *    @return The sound or NULL if it can't be played.
+ */
+static alSound* sound_require( int sound )
+{
+   alSound *s;
+   int ret, state;
+
+   s = &sound_list[sound];
+
+   soundLoadLock();
+
+   /* Already being decoded in the background. */
+   while (s->state == SOUND_LOADING)
+      SDL_CondWait( sound_load_cond, sound_load_mutex );
+
+   /* First use. */
+   if (s->state == SOUND_UNLOADED) {
+      s->state = SOUND_LOADING;
+      soundLoadUnlock();
+      ret = sound_load( s, s->path );
+      soundLoadLock();
+      s->state = (ret == 0) ? SOUND_LOADED : SOUND_FAILED;
+      SDL_CondBroadcast( sound_load_cond );
+   }
+   state = s->state;
+
+   soundLoadUnlock();
+
+   return (state == SOUND_LOADED) ? s : NULL;
+}
+
+
+/**
+ * @brief Decodes a sound on the threadpool.
+ *
+ *    @param data Sound to decode.
+ */
+static int sound_loadJob( void *data )
+{
+   alSound *s;
+   int ret;
+
+   s = (alSound*) data;
+   ret = sound_load( s, s->path );
+
+   soundLoadLock();
+   s->state = (ret == 0) ? SOUND_LOADED : SOUND_FAILED;
+   sound_npending--;
+   SDL_CondBroadcast( sound_load_cond );
+   soundLoadUnlock();
+
+   return 0;
+}
+
+
+/**
+ * @brief Hints that a sound will be played soon.
+ *
+ * The sound gets decoded in the background so playing it does not stall.
+ *
+ *    @param sound Sound to decode.
+ */
+void sound_prefetch( int sound )
+{
+   alSound *s;
+
+   if (sound_disabled)
+      return;
+
+   if ((sound < 0) || (sound >= sound_nlist))
+      return;
+
+   s = &sound_list[sound];
+
+   soundLoadLock();
+   if (s->state != SOUND_UNLOADED) {
+      soundLoadUnlock();
+      return;
+   }
+   s->state = SOUND_LOADING;
+   sound_npending++;
+   soundLoadUnlock();
+
+   threadpool_newJob( sound_loadJob, s );
+}
+
+
+/**
+ * @brief Gets the memory used by loaded sounds.
+ *
+ *    @param[out] n Number of decoded sounds.
+ *    @return Bytes of decoded audio, streamed sounds only keep their file.
+ */
+size_t sound_memUsage( int *n )
+{
+   int i;
+   size_t size;
+
+   size = 0;
+   *n   = 0;
+   soundLoadLock();
+   for (i=0; i<sound_nlist; i++) {
+      if (sound_list[i].state != SOUND_LOADED)
+         continue;
+      size += sound_list[i].size;
+      (*n)++;
+   }
+   soundLoadUnlock();
+   return size;
+}
+
+
 /**
  * @brief Gets the length of the sound buffer.
  *
@@ -366,10 +519,16 @@ int sound_get( char* name )
  */
 double sound_length( int sound )
 {
+   alSound *s;
+
    if (sound_disabled)
       return 0.;
 
-   return sound_list[sound].length;
+   if ((sound < 0) || (sound >= sound_nlist))
+      return 0.;
+
+   s = sound_require( sound );
+   return (s != NULL) ? s->length : 0.;
 }
 
 
@@ -390,12 +549,14 @@ int sound_play( int sound )
    if ((sound < 0) || (sound >= sound_nlist))
       return -1;
 
+   /* Get the sound. */
+   s = sound_require( sound );
+   if (s == NULL)
+      return -1;
+
    /* Gets a new voice. */
    v = voice_new();
 
-   /* Get the sound. */
-   s = &sound_list[sound];
-
    /* Try to play the sound. */
    if (sound_sys_play( v, s ))
       return -1;
@@ -449,12 +610,14 @@ int sound_playPos( int sound, double px, double py, double vx, double vy )
          return 0;
    }
 
+   /* Get the sound. */
+   s = sound_require( sound );
+   if (s == NULL)
+      return -1;
+
    /* Gets a new voice. */
    v = voice_new();
 
-   /* Get the sound. */
-   s = &sound_list[sound];
-
    /* Try to play the sound. */
    if (sound_sys_playPos( v, s, px, py, vx, vy ))
       return -1;
@@ -474,6 +637,7 @@ int sound_playPos( int sound, double px, double py, double vx, double vy )
  *    @param voice Identifier of the voice to update.
  *    @param x New x position to update to.
  *    @param y New y position to update to.
+ *    @return 0 on success, -1 if the voice isn't playing anymore.
  */
 int sound_updatePos( int voice, double px, double py, double vx, double vy )
 {
@@ -482,13 +646,17 @@ int sound_updatePos( int voice, double px, double py, double vx, double vy )
    if (sound_disabled)
       return 0;
 
+   /* Voice was never played. */
+   if (voice <= 0)
+      return -1;
+
    v = voice_get(voice);
-   if (v != NULL) {
+   if (v == NULL)
+      return -1;
 
-      /* Update the voice. */
-      if (sound_sys_updatePos( v, px, py, vx, vy))
-         return -1;
-   }
+   /* Update the voice, it's sent to the backend on the next sound_update(). */
+   if (sound_sys_updatePos( v, px, py, vx, vy))
+      return -1;
 
    return 0;
 }
@@ -696,6 +864,9 @@ void sound_setSpeed( double s )
 
 /**
  * @brief Makes the list of available sounds.
+ *
+ * Sounds are only registered here, they get decoded when first played or
+ *  prefetched.
  */
 static int sound_makeList (void)
 {
@@ -743,11 +914,12 @@ static int sound_makeList (void)
       strncpy( tmp, files[i], len );
       tmp[len] = '\0';
 
-      /* Load the sound. */
-      sound_list[sound_nlist-1].name = strdup(tmp);
+      /* Register the sound. */
+      memset( &sound_list[sound_nlist-1], 0, sizeof(alSound) );
+      sound_list[sound_nlist-1].name  = strdup(tmp);
       nsnprintf( path, PATH_MAX, SOUND_PATH"%s", files[i] );
-      if (sound_load( &sound_list[sound_nlist-1], path ))
-         sound_nlist--; /* Song not actually added. */
+      sound_list[sound_nlist-1].path  = strdup(path);
+      sound_list[sound_nlist-1].state = SOUND_UNLOADED;
 
       /* Clean up. */
       free(files[i]);
@@ -755,7 +927,12 @@ static int sound_makeList (void)
    /* shrink to minimum ram usage */
    sound_list = realloc( sound_list, sound_nlist*sizeof(alSound));
 
-   DEBUG("Loaded %d sound%s", sound_nlist, (sound_nlist==1)?"":"s");
+   /* Index by name. */
+   nhash_init( &sound_hash );
+   for (i=0; i<sound_nlist; i++)
+      nhash_set( &sound_hash, sound_list[i].name, i );
+
+   DEBUG("Registered %d sound%s", sound_nlist, (sound_nlist==1)?"":"s");
 
    /* More clean up. */
    free(files);
@@ -818,10 +995,15 @@ double sound_getVolumeLog(void)
  */
 static int sound_load( alSound *snd, const char *filename )
 {
+   int ret;
+
    if (sound_disabled)
       return -1;
 
-   return sound_sys_load( snd, filename );
+   ret = sound_sys_load( snd, filename );
+   if (ret == 0)
+      startup_countSound();
+   return ret;
 }
 
 
@@ -837,9 +1019,13 @@ static void sound_free( alSound *snd )
       free(snd->name);
       snd->name = NULL;
    }
+   free(snd->path);
+   snd->path = NULL;
 
-   /* Free internals. */
-   sound_sys_free(snd);
+   /* Free internals, only decoded sounds have any. */
+   if (snd->state == SOUND_LOADED)
+      sound_sys_free(snd);
+   snd->state = SOUND_UNLOADED;
 }
 
 
@@ -869,13 +1055,19 @@ int sound_createGroup( int size )
  */
 int sound_playGroup( int group, int sound, int once )
 {
+   alSound *s;
+
    if (sound_disabled)
       return 0;
 
    if ((sound < 0) || (sound >= sound_nlist))
       return -1;
 
-   return sound_sys_playGroup( group, &sound_list[sound], once );
+   s = sound_require( sound );
+   if (s == NULL)
+      return -1;
+
+   return sound_sys_playGroup( group, s, once );
 }
 
 
@@ -8,6 +8,9 @@
 #  define SOUND_H
 
 
+#include <stddef.h>
+
+
 #define SOUND_SPEED_PLAY_LIMIT      2.0 /**< Speed modifier at which sounds do not play. */
 
 
@@ -37,7 +40,9 @@ void sound_resume (void);
  * sound manipulation functions
  */
 int sound_get( char* name );
+void sound_prefetch( int sound );
 double sound_length( int sound );
+size_t sound_memUsage( int *n );
 int sound_volume( const double vol );
 double sound_getVolume (void);
 double sound_getVolumeLog (void);
@@ -42,8 +42,15 @@
  * 3) Now we allow the user to dynamically create voices, these voices will
  * always try to grab a source from the source pool.  If they can't they
  * will pretend to play the buffer.
- * 4) Every so often we'll check to see if the important voices are being
- * played and take away the sources from the lesser ones.
+ * 4) Positional voices too far away to be heard never get a source. When
+ * the pool runs out the quietest voice, the one furthest from the listener,
+ * has its source taken away if the new voice would be louder.
+ * 5) Source properties of all the voices are updated once per frame under a
+ * single lock.
+ * 6) Ogg files larger than SOUND_STREAM_SIZE aren't decoded at load time,
+ * each voice playing them decodes its own stream into a few queued buffers
+ * refilled by the per frame update. Groups need a whole buffer to loop, so
+ * they decode the sound the first time they play it.
  *
  *
  * EFX
@@ -56,6 +63,11 @@
 
 
 #define SOUND_FADEOUT         100
+#define SOUND_REFERENCE_DIST  500. /**< Distance under which sounds don't get louder. */
+#define SOUND_MAX_DIST        25000. /**< Distance over which sounds don't get quieter. */
+#define SOUND_CULL_GAIN       0.05 /**< Positional voices quieter than this don't get a source. */
+#define SOUND_STREAM_SIZE     (256*1024) /**< Encoded size over which sounds are streamed. */
+#define SOUND_STREAM_BUFSIZE  (64*1024) /**< Size of each streamed buffer. */
 
 
 #define soundLock()     SDL_mutexP(sound_lock)
@@ -104,6 +116,8 @@ static ALuint efx_echo        = 0; /**< Echo effect. */
  * Sound speed.
  */
 static double sound_speed     = 1.; /**< Sound speed. */
+static ALfloat al_listener[2] = { 0., 0. }; /**< Position of the listener. */
+static char al_streamBuf[SOUND_STREAM_BUFSIZE]; /**< Decoding buffer for streamed voices. */
 
 
 /**
@@ -138,10 +152,20 @@ static int al_enableEFX (void);
  * General.
  */
 static ALuint sound_al_getSource (void);
+static ALfloat al_voiceGain( ALfloat px, ALfloat py, ALint relative );
+static ALuint sound_al_stealSource( ALfloat gain );
+static void sound_al_updateVoices (void);
 static int al_playVoice( alVoice *v, alSound *s,
       ALfloat px, ALfloat py, ALfloat vx, ALfloat vy, ALint relative );
 static int sound_al_loadWav( alSound *snd, SDL_RWops *rw );
 static int sound_al_loadOgg( alSound *snd, OggVorbis_File *vf );
+static int sound_al_loadOggStream( alSound *snd, OggVorbis_File *vf,
+      const char *filename );
+static int sound_al_decode( alSound *snd );
+static int al_streamOpen( alVoice *v, const alSound *s );
+static int al_streamLoad( alVoice *v, ALuint buffer );
+static void al_streamUpdate( alVoice *v );
+static void al_streamClose( alVoice *v );
 /*
  * Pausing.
  */
@@ -316,8 +340,8 @@ int sound_al_init (void)
        *  inverse    2        500      1.000   0.333   0.052   0.026
        *  exponent   2        500      1.000   0.250   0.010   0.003
        */
-      alSourcef( s, AL_REFERENCE_DISTANCE, 500. ); /* Close distance to clamp at (doesn't get louder). */
-      alSourcef( s, AL_MAX_DISTANCE,       25000. ); /* Max distance to clamp at (doesn't get quieter). */
+      alSourcef( s, AL_REFERENCE_DISTANCE, SOUND_REFERENCE_DIST ); /* Close distance to clamp at (doesn't get louder). */
+      alSourcef( s, AL_MAX_DISTANCE,       SOUND_MAX_DIST ); /* Max distance to clamp at (doesn't get quieter). */
       alSourcef( s, AL_ROLLOFF_FACTOR,     1. ); /* Determines how it drops off. */
 
       /* Set the filter. */
@@ -667,6 +691,71 @@ static int sound_al_loadOgg( alSound *snd, OggVorbis_File *vf )
 }
 
 
+/**
+ * @brief Sets up an ogg file to be streamed instead of decoded.
+ *
+ *    @param snd Sound to load ogg into.
+ *    @param vf Vorbisfile containing the sound.
+ *    @param filename Name of the file to stream from.
+ */
+static int sound_al_loadOggStream( alSound *snd, OggVorbis_File *vf,
+      const char *filename )
+{
+   int ret;
+
+   /* Finish opening the file. */
+   ret = ov_test_open(vf);
+   if (ret) {
+      WARN("Failed to finish loading Ogg file: %s", vorbis_getErr(ret) );
+      return -1;
+   }
+
+   snd->length    = ov_time_total( vf, -1 );
+   snd->u.al.buf  = 0;
+   snd->u.al.file = strdup( filename );
+   ov_clear(vf);
+
+   return 0;
+}
+
+
+/**
+ * @brief Decodes a streamed sound into a buffer.
+ *
+ *    @param snd Sound to decode.
+ *    @return 0 on success.
+ */
+static int sound_al_decode( alSound *snd )
+{
+   int ret;
+   SDL_RWops *rw;
+   OggVorbis_File vf;
+
+   if (snd->u.al.buf != 0)
+      return 0;
+
+   rw = ndata_rwops( snd->u.al.file );
+   if (rw == NULL)
+      return -1;
+   ret = ov_test_callbacks( rw, &vf, NULL, 0, sound_al_ovcall_noclose );
+   if (ret == 0)
+      ret = sound_al_loadOgg( snd, &vf );
+   else
+      ov_clear(&vf);
+   SDL_RWclose(rw);
+
+   if (ret != 0) {
+      WARN("Failed to decode sound file '%s'.", snd->u.al.file);
+      return -1;
+   }
+
+   /* Voices use the buffer too from now on. */
+   free( snd->u.al.file );
+   snd->u.al.file = NULL;
+   return 0;
+}
+
+
 /**
  * @brief Loads the sound.
  *
@@ -679,13 +768,24 @@ int sound_al_load( alSound *snd, const char *filename )
    SDL_RWops *rw;
    OggVorbis_File vf;
    ALint freq, bits, channels, size;
+   int fsize;
 
    /* get the file data buffer from packfile */
    rw = ndata_rwops( filename );
+   snd->u.al.buf  = 0;
+   snd->u.al.file = NULL;
 
-   /* Check to see if it's an Ogg. */
-   if (ov_test_callbacks( rw, &vf, NULL, 0, sound_al_ovcall_noclose )==0)
-      ret = sound_al_loadOgg( snd, &vf );
+   /* Get the encoded size. */
+   fsize = SDL_RWseek( rw, 0, SEEK_END );
+   SDL_RWseek( rw, 0, SEEK_SET );
+
+   /* Check to see if it's an Ogg, large ones get streamed. */
+   if (ov_test_callbacks( rw, &vf, NULL, 0, sound_al_ovcall_noclose )==0) {
+      if (fsize > SOUND_STREAM_SIZE)
+         ret = sound_al_loadOggStream( snd, &vf, filename );
+      else
+         ret = sound_al_loadOgg( snd, &vf );
+   }
 
    /* Otherwise try WAV. */
    else {
@@ -705,6 +805,10 @@ int sound_al_load( alSound *snd, const char *filename )
       return ret;
    }
 
+   /* Streamed sounds already know their length. */
+   if (snd->u.al.buf == 0)
+      return 0;
+
    soundLock();
 
    /* Get the length of the sound. */
@@ -718,6 +822,7 @@ int sound_al_load( alSound *snd, const char *filename )
    }
    else
       snd->length = (double)size / (double)(freq * (bits/8) * channels);
+   snd->size = size;
 
    /* Check for errors. */
    al_checkErr();
@@ -736,9 +841,13 @@ void sound_al_free( alSound *snd )
    soundLock();
 
    /* free the stuff */
-   alDeleteBuffers( 1, &snd->u.al.buf );
+   if (snd->u.al.buf != 0)
+      alDeleteBuffers( 1, &snd->u.al.buf );
 
    soundUnlock();
+
+   free( snd->u.al.file );
+   snd->u.al.file = NULL;
 }
 
 
@@ -824,26 +933,234 @@ static ALuint sound_al_getSource (void)
 }
 
 
+/**
+ * @brief Starts streaming a sound into a voice's source.
+ *
+ * Called with the sound lock held.
+ *
+ *    @param v Voice with a source to stream into.
+ *    @param s Streamed sound to play.
+ *    @return 0 on success.
+ */
+static int al_streamOpen( alVoice *v, const alSound *s )
+{
+   int i;
+   SDL_RWops *rw;
+
+   rw = ndata_rwops( s->u.al.file );
+   if (rw == NULL)
+      return -1;
+
+   v->u.al.stream = malloc( sizeof(OggVorbis_File) );
+   if (ov_open_callbacks( rw, v->u.al.stream, NULL, 0, sound_al_ovcall ) != 0) {
+      WARN("Sound '%s' does not appear to be a vorbis bitstream.", s->name);
+      SDL_RWclose( rw );
+      free( v->u.al.stream );
+      v->u.al.stream = NULL;
+      return -1;
+   }
+
+   /* Queue up the first buffers. */
+   alSourcei( v->u.al.source, AL_BUFFER, AL_NONE );
+   alGenBuffers( SOUND_STREAM_BUFFERS, v->u.al.sbuf );
+   for (i=0; i<SOUND_STREAM_BUFFERS; i++) {
+      if (al_streamLoad( v, v->u.al.sbuf[i] ))
+         break;
+      alSourceQueueBuffers( v->u.al.source, 1, &v->u.al.sbuf[i] );
+   }
+
+   return 0;
+}
+
+
+/**
+ * @brief Decodes the next part of a voice's stream into a buffer.
+ *
+ *    @param v Streaming voice.
+ *    @param buffer Buffer to load.
+ *    @return 0 on success, 1 if the stream is over.
+ */
+static int al_streamLoad( alVoice *v, ALuint buffer )
+{
+   int size, section;
+   long result;
+   vorbis_info *info;
+
+   size = 0;
+   while (size < SOUND_STREAM_BUFSIZE) {
+      result = ov_read( v->u.al.stream, &al_streamBuf[size],
+            SOUND_STREAM_BUFSIZE - size, VORBIS_ENDIAN, 2, 1, &section );
+      if (result == OV_HOLE) /* Skip over holes. */
+         continue;
+      if (result <= 0) /* End of file or broken stream. */
+         break;
+      size += result;
+   }
+   if (size == 0)
+      return 1;
+
+   info = ov_info( v->u.al.stream, -1 );
+   alBufferData( buffer,
+         (info->channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16,
+         al_streamBuf, size, info->rate );
+   return 0;
+}
+
+
+/**
+ * @brief Refills the processed buffers of a streaming voice.
+ *
+ * Called with the sound lock held.
+ *
+ *    @param v Streaming voice to update.
+ */
+static void al_streamUpdate( alVoice *v )
+{
+   ALint processed, queued, state;
+   ALuint buffer;
+
+   alGetSourcei( v->u.al.source, AL_BUFFERS_PROCESSED, &processed );
+   while (processed > 0) {
+      alSourceUnqueueBuffers( v->u.al.source, 1, &buffer );
+      if (al_streamLoad( v, buffer ) == 0)
+         alSourceQueueBuffers( v->u.al.source, 1, &buffer );
+      processed--;
+   }
+
+   /* Restart if it ran dry before the stream ended. */
+   alGetSourcei( v->u.al.source, AL_SOURCE_STATE, &state );
+   alGetSourcei( v->u.al.source, AL_BUFFERS_QUEUED, &queued );
+   if ((state == AL_STOPPED) && (queued > 0))
+      alSourcePlay( v->u.al.source );
+}
+
+
+/**
+ * @brief Stops a voice's stream and frees it.
+ *
+ * Called with the sound lock held.
+ *
+ *    @param v Voice to stop streaming.
+ */
+static void al_streamClose( alVoice *v )
+{
+   if (v->u.al.stream == NULL)
+      return;
+
+   if (v->u.al.source != 0) {
+      alSourceStop( v->u.al.source );
+      alSourcei( v->u.al.source, AL_BUFFER, AL_NONE );
+   }
+   alDeleteBuffers( SOUND_STREAM_BUFFERS, v->u.al.sbuf );
+   ov_clear( v->u.al.stream );
+   free( v->u.al.stream );
+   v->u.al.stream = NULL;
+}
+
+
+/**
+ * @brief Estimates how loud a voice is from its distance to the listener.
+ *
+ * Uses the same clamped inverse distance model OpenAL is set up with.
+ */
+static ALfloat al_voiceGain( ALfloat px, ALfloat py, ALint relative )
+{
+   ALfloat d;
+
+   if (relative)
+      d = sqrt( px*px + py*py );
+   else
+      d = sqrt( pow2(px - al_listener[0]) + pow2(py - al_listener[1]) );
+   d = CLAMP( SOUND_REFERENCE_DIST, SOUND_MAX_DIST, d );
+   return SOUND_REFERENCE_DIST / d;
+}
+
+
+/**
+ * @brief Takes the source away from the quietest playing voice.
+ *
+ *    @param gain Estimated gain of the voice wanting a source.
+ *    @return The source or 0 if all voices are louder.
+ */
+static ALuint sound_al_stealSource( ALfloat gain )
+{
+   alVoice *v, *victim;
+   ALfloat g, min;
+   ALuint source;
+
+   voice_lock();
+   victim = NULL;
+   min    = gain;
+   for (v=voice_active; v!=NULL; v=v->next) {
+      if ((v->u.al.source == 0) || (v->state != VOICE_PLAYING))
+         continue;
+      g = al_voiceGain( v->u.al.pos[0], v->u.al.pos[1], v->u.al.relative );
+      if (g < min) {
+         min    = g;
+         victim = v;
+      }
+   }
+
+   if (victim == NULL) {
+      voice_unlock();
+      return 0;
+   }
+
+   /* Stop it, it gets erased next update. */
+   source = victim->u.al.source;
+   soundLock();
+   al_streamClose( victim );
+   alSourceStop( source );
+   alSourcei( source, AL_BUFFER, AL_NONE );
+   al_checkErr();
+   soundUnlock();
+   victim->u.al.source = 0;
+   victim->state = VOICE_STOPPED;
+   voice_unlock();
+
+   return source;
+}
+
+
 /**
  * @brief Plays a voice.
  */
 static int al_playVoice( alVoice *v, alSound *s,
       ALfloat px, ALfloat py, ALfloat vx, ALfloat vy, ALint relative )
 {
+   ALfloat gain;
+
    /* Must be below the limit. */
    if (sound_speed > SOUND_SPEED_PLAY_LIMIT)
       return 0;
 
+   /* Not worth a source if it can't be heard. */
+   gain = al_voiceGain( px, py, relative );
+   if (gain * svolume_lin < SOUND_CULL_GAIN)
+      return -1;
+
    /* Set up the source and buffer. */
    v->u.al.source = sound_al_getSource();
+   if (v->u.al.source == 0)
+      v->u.al.source = sound_al_stealSource( gain );
    if (v->u.al.source == 0)
       return -1;
    v->u.al.buffer = s->u.al.buf;
+   v->u.al.relative = relative;
+   v->u.al.stream = NULL;
 
    soundLock();
 
-   /* Attach buffer. */
-   alSourcei( v->u.al.source, AL_BUFFER, v->u.al.buffer );
+   /* Attach buffer or start streaming. */
+   if (v->u.al.buffer != 0)
+      alSourcei( v->u.al.source, AL_BUFFER, v->u.al.buffer );
+   else if (al_streamOpen( v, s )) {
+      source_stack[source_nstack] = v->u.al.source;
+      source_nstack++;
+      v->u.al.source = 0;
+      soundUnlock();
+      return -1;
+   }
 
    /* Enable positional sound. */
    alSourcei( v->u.al.source, AL_SOURCE_RELATIVE, relative );
@@ -925,51 +1242,16 @@ int sound_al_updatePos( alVoice *v,
 /**
  * @brief Updates the voice.
  *
+ * Sources are handled by sound_al_update(), this only marks voices that lost
+ *  theirs.
+ *
  *    @param v Voice to update.
  */
 void sound_al_updateVoice( alVoice *v )
 {
-   ALint state;
-
    /* Invalid source, mark to delete. */
-   if (v->u.al.source == 0) {
+   if ((v->u.al.source == 0) && (v->state == VOICE_PLAYING))
       v->state = VOICE_DESTROY;
-      return;
-   }
-
-   soundLock();
-
-   /* Get status. */
-   alGetSourcei( v->u.al.source, AL_SOURCE_STATE, &state );
-   if (state == AL_STOPPED) {
-
-      /* Remove buffer so it doesn't start up again if resume is called. */
-      alSourcei( v->u.al.source, AL_BUFFER, AL_NONE );
-
-      /* Check for errors. */
-      al_checkErr();
-
-      soundUnlock();
-
-      /* Put source back on the list. */
-      source_stack[source_nstack] = v->u.al.source;
-      source_nstack++;
-      v->u.al.source = 0;
-
-      /* Mark as stopped - erased next iteration. */
-      v->state = VOICE_STOPPED;
-      return;
-   }
-
-   /* Set up properties. */
-   alSourcef(  v->u.al.source, AL_GAIN, svolume*svolume_speed );
-   alSourcefv( v->u.al.source, AL_POSITION, v->u.al.pos );
-   alSourcefv( v->u.al.source, AL_VELOCITY, v->u.al.vel );
-
-   /* Check for errors. */
-   al_checkErr();
-
-   soundUnlock();
 }
 
 
@@ -1078,6 +1360,8 @@ int sound_al_updateListener( double dir, double px, double py,
    pos[1] = py;
    pos[2] = 0.;
    alListenerfv( AL_POSITION, pos );
+   al_listener[0] = px;
+   al_listener[1] = py;
    vel[0] = vx;
    vel[1] = vy;
    vel[2] = 0.;
@@ -1249,6 +1533,10 @@ int sound_al_playGroup( int group, alSound *s, int once )
    ALint state;
    double v;
 
+   /* Groups loop whole buffers. */
+   if (sound_al_decode( s ))
+      return -1;
+
    for (i=0; i<al_ngroups; i++) {
 
       /* Find group. */
@@ -1417,7 +1705,60 @@ static void al_resumev( ALint n, ALuint *s )
 
 
 /**
- * @brief Updates the group sounds.
+ * @brief Updates the sources of all the voices at once.
+ */
+static void sound_al_updateVoices (void)
+{
+   alVoice *v;
+   ALint state;
+
+   if (voice_active == NULL)
+      return;
+
+   voice_lock();
+   soundLock();
+   for (v=voice_active; v!=NULL; v=v->next) {
+      if (v->u.al.source == 0)
+         continue;
+
+      /* Keep streams fed. */
+      if ((v->u.al.stream != NULL) && (v->state == VOICE_PLAYING))
+         al_streamUpdate( v );
+
+      /* Get status, stopped voices give their source back too. */
+      alGetSourcei( v->u.al.source, AL_SOURCE_STATE, &state );
+      if ((state == AL_STOPPED) || (v->state != VOICE_PLAYING)) {
+         /* Remove buffer so it doesn't start up again if resume is called. */
+         al_streamClose( v );
+         alSourceStop( v->u.al.source );
+         alSourcei( v->u.al.source, AL_BUFFER, AL_NONE );
+
+         /* Put source back on the list. */
+         source_stack[source_nstack] = v->u.al.source;
+         source_nstack++;
+         v->u.al.source = 0;
+
+         /* Mark as stopped - erased next iteration. */
+         v->state = VOICE_STOPPED;
+         continue;
+      }
+
+      /* Set up properties. */
+      alSourcef(  v->u.al.source, AL_GAIN, svolume*svolume_speed );
+      alSourcefv( v->u.al.source, AL_POSITION, v->u.al.pos );
+      alSourcefv( v->u.al.source, AL_VELOCITY, v->u.al.vel );
+   }
+
+   /* Check for errors. */
+   al_checkErr();
+
+   soundUnlock();
+   voice_unlock();
+}
+
+
+/**
+ * @brief Updates the group sounds and voices.
  */
 void sound_al_update (void)
 {
@@ -1426,6 +1767,8 @@ void sound_al_update (void)
    ALfloat d, v;
    unsigned int t, f;
 
+   sound_al_updateVoices();
+
    t = SDL_GetTicks();
 
    for (i=0; i<al_ngroups; i++) {
@@ -27,6 +27,9 @@
 #define VOICE_STATIC       (1<<11) /* voice isn't relative */
 
 
+#define SOUND_STREAM_BUFFERS  3 /**< Buffers queued by a streamed voice. */
+
+
 #define MUSIC_FADEOUT_DELAY   1000 /**< Time it takes to fade out. */
 #define MUSIC_FADEIN_DELAY    2000 /**< Time it takes to fade in. */
 
@@ -38,7 +41,10 @@
  */
 typedef struct alSound_ {
    char *name; /**< Buffer's name. */
+   char *path; /**< File the sound is decoded from on first use. */
+   int state; /**< Whether it's decoded, see sound.c. */
    double length; /**< Length of the buffer. */
+   size_t size; /**< Bytes of decoded audio kept in memory. */
 
    /*
     * Backend specific.
@@ -46,7 +52,8 @@ typedef struct alSound_ {
    union {
 #if USE_OPENAL
       struct {
-         ALuint buf; /**< Buffer data. */
+         ALuint buf; /**< Buffer data, 0 if the sound is streamed. */
+         char *file; /**< File to stream from, NULL if decoded. */
       } al; /**< For OpenAL backend. */
 #endif /* USE_OPENAL */
 #if USE_SDLMIX
@@ -97,6 +104,9 @@ typedef struct alVoice_ {
          ALfloat vel[3]; /**< Velocity of the voice. */
          ALuint source; /**< Source current in use. */
          ALuint buffer; /**< Buffer attached to the voice. */
+         ALint relative; /**< Whether the position is relative to the listener. */
+         struct OggVorbis_File *stream; /**< Stream being played, NULL if not streaming. */
+         ALuint sbuf[SOUND_STREAM_BUFFERS]; /**< Buffers queued while streaming. */
       } al; /**< For OpenAL backend. */
 #endif /* USE_OPENAL */
 #if USE_SDLMIX
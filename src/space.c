@@ -49,9 +49,15 @@
 #include "nstring.h"
 #include "nmath.h"
 #include "map.h"
+#include "camera.h"
 #include "damagetype.h"
 #include "hook.h"
 #include "dev_uniedit.h"
+#include "nhash.h"
+#include "nfuzzy.h"
+#include "array.h"
+#include "scratch.h"
+#include "spacesim.h"
 
 
 #define XML_PLANET_TAG        "asset" /**< Individual planet xml tag. */
@@ -61,6 +67,7 @@
 #define PLANET_GFX_EXTERIOR_PATH_H 400 /**< Planet exterior graphic height. */
 
 #define CHUNK_SIZE            32 /**< Size to allocate by. */
+#define SPAWN_BUDGET          0.002 /**< Seconds of spawning per frame after which expired spawns wait. */
 #define CHUNK_SIZE_SMALL       8 /**< Smaller size to allocate chunks by. */
 
 /* used to overcome warnings due to 0 values */
@@ -71,6 +78,37 @@
 #define FLAG_FACTIONSET       (1<<5) /**< Set the faction value. */
 
 #define DEBRIS_BUFFER         1000 /**< Buffer to smooth appearance of debris */
+#define ASTEROID_ACTIVE_RANGE 5000. /**< Distance from a field at which its asteroids are simulated. */
+#define ASTEROID_GRID_CELLS   32 /**< Maximum cells of an asteroid grid per axis. */
+#define ASTEROID_GRID_MIN     500. /**< Minimum size of an asteroid grid cell. */
+
+#define SPACE_CACHE_FILE      "universe.bin" /**< Universe snapshot, in the cache directory. */
+#define SPACE_CACHE_VERSION   1 /**< Version of the snapshot format, change when it does. */
+#define SPACE_CACHE_MAGIC     0x31494e555645414eULL /**< "NAEVUNI1" read as little endian. */
+#define SPACE_CACHE_FNV       14695981039346656037ULL /**< FNV-1a offset basis. */
+
+
+/**
+ * @brief Data files read into memory.
+ */
+typedef struct SpaceFiles_ {
+   char **files; /**< Names of the files. */
+   NdataView *views; /**< Views of the files. */
+   const char **bufs; /**< Contents of the files, NULL if unreadable. */
+   uint32_t *sizes; /**< Sizes of the files. */
+   int n; /**< Number of files. */
+} SpaceFiles;
+
+
+/**
+ * @brief Universe snapshot being written or read.
+ */
+typedef struct SpaceCacheBuf_ {
+   char *data; /**< Snapshot data. */
+   size_t len; /**< Bytes written or read. */
+   size_t size; /**< Bytes allocated or available. */
+   int err; /**< Set when reading past the end. */
+} SpaceCacheBuf;
 
 /*
  * planet <-> system name stack
@@ -95,6 +133,14 @@ static Planet *planet_stack = NULL; /**< Planet stack. */
 static int planet_nstack = 0; /**< Planet stack size. */
 static int planet_mstack = 0; /**< Memory size of planet stack. */
 
+/* Name lookup, rebuilt lazily when invalid. */
+static NameHash planet_hash; /**< Planet name to planet stack index. */
+static NameHash system_hash; /**< System name to system stack index. */
+static NameHash spacename_hash; /**< Planet name to planet<->system stack index. */
+static int space_hashValid = 0; /**< Whether the name lookup tables are current. */
+static NameIndex planet_fuzzy; /**< Planet names for fuzzy searches. */
+static NameIndex system_fuzzy; /**< System names for fuzzy searches. */
+
 /*
  * Asteroid types stack.
  */
@@ -105,14 +151,43 @@ static int asteroid_ntypes = 0; /**< Asteroid types stack size. */
  * Misc.
  */
 static int systems_loading = 1; /**< Systems are loading. */
+static int space_deferred  = 0; /**< Universe rebuilds are deferred, see space_deferStart(). */
+static int space_deferJumps = 0; /**< Jumps need to be reconstructed. */
+static int space_deferPresences = 0; /**< Presences need to be reconstructed. */
+static int space_deferGfx  = 0; /**< Current system graphics need to be reloaded. */
 StarSystem *cur_system = NULL; /**< Current star system. */
 glTexture *jumppoint_gfx = NULL; /**< Jump point graphics. */
 static glTexture *jumpbuoy_gfx = NULL; /**< Jump buoy graphics. */
 static nlua_env landing_env = LUA_NOREF; /**< Landing lua env. */
 static int space_fchg = 0; /**< Faction change counter, to avoid unnecessary calls. */
 static int space_simulating = 0; /**< Are we simulating space? */
+static int space_spawnNext = 0; /**< Presence the scheduler starts with next, see SPAWN_BUDGET. */
 glTexture **asteroid_gfx = NULL;
 uint32_t nasterogfx = 0; /**< Nb of asteroid gfx. */
+static double asteroid_radius = 0.; /**< Largest half size of the asteroid graphics, for culling. */
+static SystemView space_view; /**< View of the current system, see space_getView(). */
+static int space_viewMem = 0; /**< Planets and jumps space_view has memory for. */
+static int space_viewDirty = 1; /**< Whether space_view needs to be rebuilt. */
+
+
+/*
+ * Background planet graphics.
+ */
+#define SPACE_GFX_BUDGET   2 /**< Milliseconds of texture uploads per frame. */
+#define SPACE_LOD_SIZE     128 /**< Largest side of the low detail planet graphics. */
+#define SPACE_LOD_PIXELS   128. /**< On screen size above which planets need their full graphic. */
+#define SPACE_LOD_MARGIN   512. /**< Pixels around the screen planets need their full graphic in. */
+/**
+ * @brief Planet graphic being decoded in the background.
+ */
+typedef struct SpaceGfxJob_ {
+   Planet *pnt; /**< Planet the graphic is for. */
+   glTexAsync *tex; /**< Texture request. */
+} SpaceGfxJob;
+static SpaceGfxJob *space_gfxJobs = NULL; /**< Pending planet graphics. */
+static int space_gfxNjobs = 0; /**< Number of pending planet graphics. */
+static int space_gfxMjobs = 0; /**< Memory size of space_gfxJobs. */
+static StarSystem *space_gfxNext = NULL; /**< System being pre-warmed. */
 
 
 /*
@@ -140,24 +215,75 @@ static int space_parseAssets( xmlNodePtr parent, StarSystem* sys );
 /* system load */
 static void system_init( StarSystem *sys );
 static void asteroid_init( Asteroid *ast, AsteroidAnchor *field );
+static void asteroid_initField( AsteroidAnchor *field );
+static int asteroid_inField( const AsteroidAnchor *field, const Vector2d *p );
+static int asteroid_inSubset( const AsteroidSubset *sub, const Vector2d *p );
+static AsteroidGrid* asteroid_buildGrid( const StarSystem *sys );
+static void asteroid_freeGrid( AsteroidGrid *grid );
+static int asteroid_fieldActive( const AsteroidAnchor *field, const Pilot *p );
+static void asteroid_updateField( AsteroidAnchor *field, double dt );
+static void asteroid_catchUp( AsteroidAnchor *field );
 static void debris_init( Debris *deb );
-static int systems_load (void);
+static void planets_loadDoc( xmlDocPtr doc, int i, void *data );
+static int planets_load( const SpaceFiles *sf );
+static int systems_load( const SpaceFiles *sf );
 static int asteroidTypes_load (void);
 static StarSystem* system_parse( StarSystem *system, const xmlNodePtr parent );
 static int system_parseJumpPoint( const xmlNodePtr node, StarSystem *sys );
 static int system_parseAsteroidField( const xmlNodePtr node, StarSystem *sys );
+static AsteroidAnchor* system_newAsteroidField( StarSystem *sys );
+static void system_setupAsteroidField( StarSystem *sys, AsteroidAnchor *a );
 static int system_parseJumpPointDiff( const xmlNodePtr node, StarSystem *sys );
 static void system_parseJumps( const xmlNodePtr parent );
+/* Universe snapshot. */
+static void space_readFiles( SpaceFiles *sf, const char *dir );
+static void space_freeFiles( SpaceFiles *sf );
+static uint64_t space_cacheHash( uint64_t h, const void *data, size_t len );
+static uint64_t space_cacheKey( const SpaceFiles *planets, const SpaceFiles *systems );
+static void scw_raw( SpaceCacheBuf *b, const void *data, size_t len );
+static void scw_int( SpaceCacheBuf *b, int i );
+static void scw_u64( SpaceCacheBuf *b, uint64_t u );
+static void scw_double( SpaceCacheBuf *b, double d );
+static void scw_str( SpaceCacheBuf *b, const char *str );
+static void scr_raw( SpaceCacheBuf *b, void *data, size_t len );
+static int scr_int( SpaceCacheBuf *b );
+static uint64_t scr_u64( SpaceCacheBuf *b );
+static double scr_double( SpaceCacheBuf *b );
+static char* scr_str( SpaceCacheBuf *b );
+static void space_cacheSave( uint64_t key );
+static int space_cacheLoad( uint64_t key );
+static void planet_free( Planet *pnt );
+static void system_free( StarSystem *sys );
+/* Name lookup. */
+static void space_hashBuild (void);
+static int planet_lookup( const char *planetname );
+static int system_lookup( const char *sysname );
 static void system_parseAsteroids( const xmlNodePtr parent, StarSystem *sys );
 /* misc */
 static int getPresenceIndex( StarSystem *sys, int faction );
 static void presenceCleanup( StarSystem *sys );
+static void presencePrune( StarSystem *sys );
+static void presenceRefresh( PresenceSpill *spill );
+static void system_spillPresence( StarSystem *sys, int faction, double amount,
+      int range, PresenceSpill **spill );
+static double space_clock (void);
 static void system_scheduler( double dt, int init );
 /* Render. */
 static void space_renderJumpPoint( JumpPoint *jp, int i );
 static void space_renderPlanet( Planet *p );
+static void space_renderAsteroids (void);
 static void space_renderAsteroid( Asteroid *a );
 static void space_renderDebris( Debris *d, double x, double y );
+/* Graphics. */
+static int space_gfxFind( const Planet *pnt );
+static void space_gfxFinish( int i );
+static void space_gfxCancel( StarSystem *sys );
+static void space_gfxQueue( Planet *planet );
+static void space_gfxResidency (void);
+static void planet_gfxLOD( Planet *planet );
+/* System view. */
+static void space_viewBuild (void);
+static void space_viewFree (void);
 /*
  * Externed prototypes.
  */
@@ -225,6 +351,22 @@ credits_t planet_commodityPrice( const Planet *p, const Commodity *c )
 }
 
 
+/**
+ * @brief Gets the prices of all the commodities in a system.
+ *
+ * The prices are only recomputed when the economy is, so they can be read
+ *  repeatedly across systems.
+ *
+ *    @param sys System to get prices in.
+ *    @return Prices indexed like commodity_getAll(), 0 for those not traded,
+ *            or NULL if the economy hasn't run yet.
+ */
+const credits_t* system_commodityPrices( const StarSystem *sys )
+{
+   return sys->comm_prices;
+}
+
+
 /**
  * @brief Changes the planets faction.
  *
@@ -234,7 +376,21 @@ credits_t planet_commodityPrice( const Planet *p, const Commodity *c )
  */
 int planet_setFaction( Planet *p, int faction )
 {
+   StarSystem *sys;
+
+   space_viewDirty = 1;
+
+   /* Presence not added yet, will be added with the new faction. */
+   if (p->presence_sys < 0) {
+      p->faction = faction;
+      return 0;
+   }
+
+   /* Only move the presence of this planet. */
+   sys = &systems_stack[ p->presence_sys ];
+   planet_rmPresence( p );
    p->faction = faction;
+   planet_addPresence( p, sys );
    return 0;
 }
 
@@ -359,7 +515,8 @@ int space_calcJumpInPos( StarSystem *in, StarSystem *out, Vector2d *pos, Vector2
  *    @param[out] nplanets Number of planets found.
  *    @param factions Factions to check against.
  *    @param nfactions Number of factions in factions.
- *    @return An array of faction names.  Individual names are not allocated.
+ *    @return An array of faction names in scratch memory.  Individual names
+ *            are not allocated.
  */
 char** space_getFactionPlanet( int *nplanets, int *factions, int nfactions, int landable )
 {
@@ -367,11 +524,14 @@ char** space_getFactionPlanet( int *nplanets, int *factions, int nfactions, int
    Planet* planet;
    char **tmp;
    int ntmp;
-   int mtmp;
 
+   /* At most one planet per system. */
    ntmp = 0;
-   mtmp = CHUNK_SIZE;
-   tmp = malloc(sizeof(char*) * mtmp);
+   tmp  = scratch_alloc( sizeof(char*) * MAX(systems_nstack,1) );
+   if (tmp == NULL) {
+      (*nplanets) = 0;
+      return NULL;
+   }
 
    for (i=0; i<systems_nstack; i++) {
       for (j=0; j<systems_stack[i].nplanets; j++) {
@@ -403,12 +563,7 @@ char** space_getFactionPlanet( int *nplanets, int *factions, int nfactions, int
          if (!space_sysReallyReachable( systems_stack[i].name ))
             continue;
 
-         ntmp++;
-         if (ntmp > mtmp) { /* need more space */
-            mtmp *= 2;
-            tmp = realloc(tmp, sizeof(char*) * mtmp);
-         }
-         tmp[ntmp-1] = planet->name;
+         tmp[ntmp++] = planet->name;
          break; /* no need to check all factions */
       }
    }
@@ -501,12 +656,36 @@ double system_getClosest( const StarSystem *sys, int *pnt, int *jp, double x, do
    double d, td;
    Planet *p;
    JumpPoint *j;
+   const SystemView *v;
 
    /* Default output. */
    *pnt = -1;
    *jp  = -1;
    d    = INFINITY;
 
+   /* The current system has its positions packed together. */
+   if (sys == cur_system) {
+      v = space_getView();
+      for (i=0; i<v->nplanets; i++) {
+         if (!(v->pflags[i] & SYSVIEW_REAL))
+            continue;
+         td = pow2(x-v->px[i]) + pow2(y-v->py[i]);
+         if (td < d) {
+            *pnt  = i;
+            d     = td;
+         }
+      }
+      for (i=0; i<v->njumps; i++) {
+         td = pow2(x-v->jx[i]) + pow2(y-v->jy[i]);
+         if (td < d) {
+            *pnt  = -1; /* We must clear planet target as jump point is closer. */
+            *jp   = i;
+            d     = td;
+         }
+      }
+      return d;
+   }
+
    /* Planets. */
    for (i=0; i<sys->nplanets; i++) {
       p  = sys->planets[i];
@@ -611,17 +790,14 @@ int space_sysReachable( StarSystem *sys )
  */
 int space_sysReallyReachable( char* sysname )
 {
-   int njumps;
-   StarSystem** path;
+   StarSystem *sys;
 
    if (strcmp(sysname,cur_system->name)==0)
       return 1;
-   path = map_getJumpPath( &njumps, cur_system->name, sysname, 1, 1, NULL );
-   if (path != NULL) {
-      free(path);
-      return 1;
-   }
-   return 0;
+   sys = system_get( sysname );
+   if (sys == NULL)
+      return 0;
+   return (map_jumpDist( cur_system, sys, 1, 1 ) > 0);
 }
 
 /**
@@ -655,6 +831,35 @@ StarSystem* system_getAll( int *nsys )
 }
 
 
+/**
+ * @brief Gets the memory used by the universe.
+ *
+ * Counts the systems and planets with their jumps, presences and asteroid
+ *  fields, but not their strings or graphics.
+ *
+ *    @param[out] n Number of systems and planets.
+ *    @return Bytes used.
+ */
+size_t space_memUsage( int *n )
+{
+   int i;
+   size_t size;
+   const StarSystem *sys;
+
+   size = systems_mstack * sizeof(StarSystem) + planet_mstack * sizeof(Planet) +
+         spacename_mstack * 2 * sizeof(char*);
+   for (i=0; i<systems_nstack; i++) {
+      sys   = &systems_stack[i];
+      size += sys->nplanets * (sizeof(Planet*) + sizeof(int)) +
+            sys->njumps * sizeof(JumpPoint) +
+            sys->npresence * sizeof(SystemPresence) +
+            sys->nasteroids * sizeof(AsteroidAnchor);
+   }
+   *n = systems_nstack + planet_nstack;
+   return size;
+}
+
+
 /**
  * @brief Checks to see if a system exists.
  *
@@ -692,20 +897,21 @@ const char *system_existsCase( const char* sysname )
  */
 char **system_searchFuzzyCase( const char* sysname, int *n )
 {
-   int i, len;
+   int i, len, *found;
    char **names;
 
+   if (!space_hashValid)
+      space_hashBuild();
+
    /* Overallocate to maximum. */
+   found = malloc( sizeof(int) * MAX( 1, systems_nstack ) );
    names = malloc( sizeof(char*) * systems_nstack );
 
    /* Do fuzzy search. */
-   len = 0;
-   for (i=0; i<systems_nstack; i++) {
-      if (nstrcasestr( systems_stack[i].name, sysname ) != NULL) {
-         names[len] = systems_stack[i].name;
-         len++;
-      }
-   }
+   len = nfuzzy_search( &system_fuzzy, sysname, found );
+   for (i=0; i<len; i++)
+      names[i] = systems_stack[ found[i] ].name;
+   free(found);
 
    /* Free if empty. */
    if (len == 0) {
@@ -730,9 +936,9 @@ StarSystem* system_get( const char* sysname )
 {
    int i;
 
-   for (i=0; i<systems_nstack; i++)
-      if (strcmp(sysname, systems_stack[i].name)==0)
-         return &systems_stack[i];
+   i = system_lookup( sysname );
+   if (i >= 0)
+      return &systems_stack[i];
 
    WARN("System '%s' not found in stack", sysname);
    return NULL;
@@ -773,9 +979,19 @@ char* planet_getSystem( const char* planetname )
 {
    int i;
 
+   if (!space_hashValid)
+      space_hashBuild();
+   i = nhash_get( &spacename_hash, planetname );
+   if ((i >= 0) && (i < spacename_nstack) &&
+         (strcmp(planetname_stack[i],planetname)==0))
+      return systemname_stack[i];
+
+   /* Table may have missed unnamed entries, scan to be sure. */
    for (i=0; i<spacename_nstack; i++)
-      if (strcmp(planetname_stack[i],planetname)==0)
+      if (strcmp(planetname_stack[i],planetname)==0) {
+         space_hashValid = 0;
          return systemname_stack[i];
+      }
 
    DEBUG("Planet '%s' not found in planetname stack", planetname);
    return NULL;
@@ -797,15 +1013,116 @@ Planet* planet_get( const char* planetname )
       return NULL;
    }
 
-   for (i=0; i<planet_nstack; i++)
-      if (strcmp(planet_stack[i].name,planetname)==0)
-         return &planet_stack[i];
+   i = planet_lookup( planetname );
+   if (i >= 0)
+      return &planet_stack[i];
 
    WARN("Planet '%s' not found in the universe", planetname);
    return NULL;
 }
 
 
+/**
+ * @brief Rebuilds the name lookup tables.
+ *
+ * Tables are built backwards so the first of duplicate names wins, like the
+ *  linear scans they replace.
+ */
+static void space_hashBuild (void)
+{
+   int i;
+
+   nhash_clear( &planet_hash );
+   for (i=planet_nstack-1; i>=0; i--)
+      nhash_set( &planet_hash, planet_stack[i].name, i );
+
+   nhash_clear( &system_hash );
+   for (i=systems_nstack-1; i>=0; i--)
+      nhash_set( &system_hash, systems_stack[i].name, i );
+
+   nhash_clear( &spacename_hash );
+   for (i=spacename_nstack-1; i>=0; i--)
+      nhash_set( &spacename_hash, planetname_stack[i], i );
+
+   /* Fuzzy indices are built on their first search. */
+   nfuzzy_clear( &planet_fuzzy );
+   for (i=0; i<planet_nstack; i++)
+      nfuzzy_add( &planet_fuzzy, planet_stack[i].name );
+
+   nfuzzy_clear( &system_fuzzy );
+   for (i=0; i<systems_nstack; i++)
+      nfuzzy_add( &system_fuzzy, systems_stack[i].name );
+
+   space_hashValid = 1;
+}
+
+
+/**
+ * @brief Marks the name lookup tables as out of date.
+ *
+ * Must be called whenever a planet or system is renamed, since the tables
+ *  point at the names.
+ */
+void space_namesChanged (void)
+{
+   space_hashValid = 0;
+}
+
+
+/**
+ * @brief Gets the stack index of a planet by name.
+ *
+ *    @param planetname Name of the planet.
+ *    @return Index of the planet or -1 if not found.
+ */
+static int planet_lookup( const char *planetname )
+{
+   int i;
+
+   if (!space_hashValid)
+      space_hashBuild();
+   i = nhash_get( &planet_hash, planetname );
+   if (i >= 0)
+      return i;
+
+   /* Planets still unnamed when the table was built aren't in it. */
+   for (i=0; i<planet_nstack; i++)
+      if ((planet_stack[i].name != NULL) &&
+            (strcmp(planet_stack[i].name,planetname)==0)) {
+         space_hashValid = 0;
+         return i;
+      }
+   return -1;
+}
+
+
+/**
+ * @brief Gets the stack index of a system by name.
+ *
+ *    @param sysname Name of the system.
+ *    @return Index of the system or -1 if not found.
+ */
+static int system_lookup( const char *sysname )
+{
+   int i;
+
+   if (!space_hashValid)
+      space_hashBuild();
+   i = nhash_get( &system_hash, sysname );
+   if (i >= 0)
+      return i;
+
+   /* Systems still unnamed when the table was built aren't in it. */
+   for (i=0; i<systems_nstack; i++)
+      if ((systems_stack[i].name != NULL) &&
+            (strcmp(sysname, systems_stack[i].name)==0)) {
+         space_hashValid = 0;
+         return i;
+      }
+   return -1;
+}
+
+
 /**
  * @brief Gets planet by index.
  *
@@ -877,11 +1194,7 @@ void planet_setBlackMarket( Planet *p )
  */
 int planet_exists( const char* planetname )
 {
-   int i;
-   for (i=0; i<planet_nstack; i++)
-      if (strcmp(planet_stack[i].name,planetname)==0)
-         return 1;
-   return 0;
+   return (planet_lookup( planetname ) >= 0);
 }
 
 
@@ -906,20 +1219,21 @@ const char* planet_existsCase( const char* planetname )
  */
 char **planet_searchFuzzyCase( const char* planetname, int *n )
 {
-   int i, len;
+   int i, len, *found;
    char **names;
 
+   if (!space_hashValid)
+      space_hashBuild();
+
    /* Overallocate to maximum. */
+   found = malloc( sizeof(int) * MAX( 1, planet_nstack ) );
    names = malloc( sizeof(char*) * planet_nstack );
 
    /* Do fuzzy search. */
-   len = 0;
-   for (i=0; i<planet_nstack; i++) {
-      if (nstrcasestr( planet_stack[i].name, planetname ) != NULL) {
-         names[len] = planet_stack[i].name;
-         len++;
-      }
-   }
+   len = nfuzzy_search( &planet_fuzzy, planetname, found );
+   for (i=0; i<len; i++)
+      names[i] = planet_stack[ found[i] ].name;
+   free(found);
 
    /* Free if empty. */
    if (len == 0) {
@@ -980,21 +1294,56 @@ JumpPoint* jump_getTarget( StarSystem* target, const StarSystem* sys )
 }
 
 
+/**
+ * @brief Gets the time in seconds for the spawn budget.
+ */
+static double space_clock (void)
+{
+#if SDL_VERSION_ATLEAST(2,0,0)
+   return (double)SDL_GetPerformanceCounter() /
+         (double)SDL_GetPerformanceFrequency();
+#else /* SDL_VERSION_ATLEAST(2,0,0) */
+   return (double)SDL_GetTicks() / 1000.;
+#endif /* SDL_VERSION_ATLEAST(2,0,0) */
+}
+
+
 /**
  * @brief Controls fleet spawning.
  *
+ * Spawns are limited to SPAWN_BUDGET per frame, factions whose timer ran out
+ *  once it's used up spawn on the next frames, the timer keeps counting so
+ *  none of the spawns are lost.
+ *
  *    @param dt Current delta tick.
  *    @param init Should be 1 to initialize the scheduler.
  */
 static void system_scheduler( double dt, int init )
 {
-   int i, n;
+   int i, k, n, start;
+   double t0;
    nlua_env env;
    SystemPresence *p;
    Pilot *pilot;
 
    /* Go through all the factions and reduce the timer. */
-   for (i=0; i < cur_system->npresence; i++) {
+   if (!init) {
+      for (i=0; i < cur_system->npresence; i++) {
+         p = &cur_system->presence[i];
+         if ((faction_getScheduler( p->faction ) != LUA_NOREF) && !p->disabled)
+            p->timer -= dt;
+      }
+   }
+
+   /* Carry on from where the budget ran out. */
+   start = 0;
+   if (!init && (cur_system->npresence > 0))
+      start = space_spawnNext % cur_system->npresence;
+   space_spawnNext = 0;
+   t0 = space_clock();
+
+   for (k=0; k < cur_system->npresence; k++) {
+      i = (start + k) % cur_system->npresence;
       p = &cur_system->presence[i];
       env = faction_getScheduler( p->faction );
 
@@ -1018,11 +1367,16 @@ static void system_scheduler( double dt, int init )
          n = 0;
       }
       else {
-         /* Decrement dt, only continue  */
-         p->timer -= dt;
+         /* Only continue if the timer ran out. */
          if (p->timer >= 0.)
             continue;
 
+         /* Out of budget, the rest spawn next frame. */
+         if (space_clock() - t0 > SPAWN_BUDGET) {
+            space_spawnNext = i;
+            break;
+         }
+
          nlua_getenv( env, "spawn" ); /* f */
          if (lua_isnil(naevL,-1)) {
             WARN("Lua Spawn script for faction '%s' missing obligatory entry point 'spawn'.",
@@ -1033,7 +1387,8 @@ static void system_scheduler( double dt, int init )
          lua_pushnumber( naevL, p->curUsed ); /* f, presence */
          n = 1;
       }
-      lua_pushnumber( naevL, p->value ); /* f, [arg,], max */
+      /* Entering seeds from what the background simulation left. */
+      lua_pushnumber( naevL, init ? spacesim_presence(p) : p->value ); /* f, [arg,], max */
 
       /* Actually run the function. */
       if (nlua_pcall(env, n+1, 2)) { /* error has occurred */
@@ -1115,7 +1470,6 @@ void space_update( const double dt )
    Damage dmg;
    HookParam hparam[3];
    AsteroidAnchor *ast;
-   Asteroid *a;
    Debris *d;
    Pilot *pplayer;
    Solid *psolid;
@@ -1128,6 +1482,9 @@ void space_update( const double dt )
    if (space_spawn)
       system_scheduler( dt, 0 );
 
+   /* Advance the systems around. */
+   spacesim_update( dt );
+
    /*
     * Volatile systems.
     */
@@ -1220,6 +1577,7 @@ void space_update( const double dt )
       for (i=0; i<cur_system->njumps; i++)
          if (( !jp_isKnown( &cur_system->jumps[i] )) && ( pilot_inRangeJump( player.p, i ))) {
             jp_setFlag( &cur_system->jumps[i], JP_KNOWN );
+            map_knownInvalidate();
             player_message( "You discovered a Jump Point." );
             hparam[0].type  = HOOK_PARAM_STRING;
             hparam[0].u.str = "jump";
@@ -1232,43 +1590,21 @@ void space_update( const double dt )
    }
 
    /* Asteroids/Debris update */
+   pplayer = pilot_get( PLAYER_ID );
    for (i=0; i<cur_system->nasteroids; i++) {
       ast = &cur_system->asteroids[i];
 
-      for (j=0; j<ast->nb; j++) {
-         a = &ast->asteroids[j];
-
-         a->pos.x += a->vel.x * dt;
-         a->pos.y += a->vel.y * dt;
-
-         /* Grow and shrink */
-         if (a->appearing == 1) {
-            a->timer += dt;
-            if (a->timer >= 2.) {
-               a->timer = 0.;
-               a->appearing = 0;
-            }
-         }
-
-         if (a->appearing == 2) {
-            a->timer += dt;
-            if (a->timer >= 2.) {
-               /* reinit any disappeared asteroid */
-               asteroid_init( a, ast );
-            }
-         }
-
-         /* Manage the asteroid getting outside the field */
-         if ( space_isInField(&a->pos)<0 && a->appearing==0 ) {
-            /* Make it shrink */
-            a->timer = 0.;
-            a->appearing = 2;
-         }
+      /* Fields out of reach are caught up once the player gets close. */
+      if (asteroid_fieldActive( ast, pplayer )) {
+         if (ast->lazy > 0.)
+            asteroid_catchUp( ast );
+         asteroid_updateField( ast, dt );
       }
+      else
+         ast->lazy += dt;
 
       x = 0;
       y = 0;
-      pplayer = pilot_get( PLAYER_ID );
       if (pplayer != NULL) {
          psolid  = pplayer->solid;
          x = psolid->vel.x;
@@ -1304,11 +1640,12 @@ void space_update( const double dt )
 void space_init( const char* sysname )
 {
    char* nt;
-   int i, j, n, s;
+   int i, n, s;
    Planet *pnt;
    AsteroidAnchor *ast;
-   Asteroid *a;
-   Debris *d;
+
+   /* Hand the system over to the background simulation before clearing it. */
+   spacesim_leave();
 
    /* cleanup some stuff */
    player_clear(); /* clears targets */
@@ -1365,22 +1702,12 @@ void space_init( const char* sysname )
       planet_updateLand( pnt );
    }
 
-   /* Set up asteroids. */
+   /* Set up asteroids, they may have been rolled while in hyperspace. */
    for (i=0; i<cur_system->nasteroids; i++) {
       ast = &cur_system->asteroids[i];
-
-      /* Add the asteroids to the anchor */
-      ast->asteroids = malloc( (ast->nb) * sizeof(Asteroid) );
-      for (j=0; j<ast->nb; j++) {
-         a = &ast->asteroids[j];
-         asteroid_init(a, ast);
-      }
-      /* Add the debris to the anchor */
-      ast->debris = malloc( (ast->ndebris) * sizeof(Debris) );
-      for (j=0; j<ast->ndebris; j++) {
-         d = &ast->debris[j];
-         debris_init(d);
-      }
+      if (!ast->warm)
+         asteroid_initField( ast );
+      ast->warm = 0;
    }
 
    /* Clear interference if you leave system with interference. */
@@ -1408,10 +1735,14 @@ void space_init( const char* sysname )
    space_gfxLoad( cur_system );
 
    /* Call the scheduler. */
+   spacesim_enter( cur_system );
    system_scheduler( 0., 1 );
 
    /* we now know this system */
-   sys_setFlag(cur_system,SYSTEM_KNOWN);
+   if (!sys_isKnown(cur_system)) {
+      sys_setFlag(cur_system,SYSTEM_KNOWN);
+      map_knownInvalidate();
+   }
 
    /* Simulate system. */
    space_simulating = 1;
@@ -1437,6 +1768,9 @@ void space_init( const char* sysname )
    /* Update gui. */
    gui_setSystem();
 
+   /* Drop ship graphics nobody in the new system needs. */
+   ships_gfxGC();
+
    /* Start background. */
    background_load( cur_system->background );
 }
@@ -1495,6 +1829,145 @@ void asteroid_init( Asteroid *ast, AsteroidAnchor *field )
 }
 
 
+/**
+ * @brief Rolls all the asteroids and debris of a field.
+ *
+ * The memory is kept between visits, the field is only rerolled.
+ *
+ *    @param field Field to initialize.
+ */
+static void asteroid_initField( AsteroidAnchor *field )
+{
+   int i;
+
+   if (field->asteroids == NULL)
+      field->asteroids = malloc( MAX(field->nb,1) * sizeof(Asteroid) );
+   for (i=0; i<field->nb; i++)
+      asteroid_init( &field->asteroids[i], field );
+
+   if (field->debris == NULL)
+      field->debris = malloc( MAX(field->ndebris,1) * sizeof(Debris) );
+   for (i=0; i<field->ndebris; i++)
+      debris_init( &field->debris[i] );
+
+   field->lazy = 0.;
+   field->warm = 1;
+}
+
+
+/**
+ * @brief Checks to see if a field is close enough to the player to be simulated.
+ *
+ *    @param field Field to check.
+ *    @param p Player pilot, may be NULL.
+ *    @return 1 if the field has to be simulated.
+ */
+static int asteroid_fieldActive( const AsteroidAnchor *field, const Pilot *p )
+{
+   double dx, dy, r;
+
+   if (p == NULL)
+      return 0;
+
+   /* Distance to the bounding box, the view has to stay covered when zoomed out. */
+   dx = MAX( 0., MAX( field->bmin.x - p->solid->pos.x, p->solid->pos.x - field->bmax.x ) );
+   dy = MAX( 0., MAX( field->bmin.y - p->solid->pos.y, p->solid->pos.y - field->bmax.y ) );
+   r  = ASTEROID_ACTIVE_RANGE + MAX( SCREEN_W, SCREEN_H ) / cam_getZoom();
+   return (pow2(dx) + pow2(dy) <= pow2(r));
+}
+
+
+/**
+ * @brief Updates the asteroids of a field near the player.
+ *
+ *    @param field Field to update.
+ *    @param dt Current delta tick.
+ */
+static void asteroid_updateField( AsteroidAnchor *field, double dt )
+{
+   int j;
+   Asteroid *a;
+
+   /* Move them all first, the loop is kept simple so it can be vectorized. */
+   for (j=0; j<field->nb; j++) {
+      a = &field->asteroids[j];
+      a->pos.x += a->vel.x * dt;
+      a->pos.y += a->vel.y * dt;
+   }
+
+   for (j=0; j<field->nb; j++) {
+      a = &field->asteroids[j];
+
+      /* Grow and shrink */
+      if (a->appearing == 1) {
+         a->timer += dt;
+         if (a->timer >= 2.) {
+            a->timer = 0.;
+            a->appearing = 0;
+         }
+      }
+
+      if (a->appearing == 2) {
+         a->timer += dt;
+         if (a->timer >= 2.) {
+            /* reinit any disappeared asteroid */
+            asteroid_init( a, field );
+         }
+      }
+
+      /* Manage the asteroid getting outside the field, its own field is the
+       * usual case so it is tested first. */
+      if ((a->appearing==0) && !asteroid_inField( field, &a->pos ) &&
+            (space_isInField(&a->pos) < 0)) {
+         /* Make it shrink */
+         a->timer = 0.;
+         a->appearing = 2;
+      }
+   }
+}
+
+
+/**
+ * @brief Advances a field that was not simulated to where it would be now.
+ *
+ * Asteroids move in straight lines, so they are moved by the time that was
+ *  skipped at once and those that drifted out are respawned, as they would
+ *  have shrunk and reappeared while the player was away.
+ *
+ *    @param field Field to catch up.
+ */
+static void asteroid_catchUp( AsteroidAnchor *field )
+{
+   int j;
+   double t;
+   Asteroid *a;
+
+   t = field->lazy;
+   field->lazy = 0.;
+
+   for (j=0; j<field->nb; j++) {
+      a = &field->asteroids[j];
+      a->pos.x += a->vel.x * t;
+      a->pos.y += a->vel.y * t;
+
+      if (a->appearing != 0) {
+         a->timer += t;
+         if (a->timer < 2.)
+            continue;
+         if (a->appearing == 2) {
+            asteroid_init( a, field );
+            continue;
+         }
+         a->timer = 0.;
+         a->appearing = 0;
+      }
+
+      if (!asteroid_inField( field, &a->pos ) && (space_isInField(&a->pos) < 0))
+         asteroid_init( a, field );
+   }
+}
+
+
 /**
  * @brief Initializes a debris.
  *    @param deb Debris to initialize.
@@ -1535,11 +2008,15 @@ Planet *planet_new (void)
       realloced      = 1;
    }
 
+   /* Name gets set by the caller. */
+   space_hashValid = 0;
+
    /* Clean up memory. */
    p           = &planet_stack[ planet_nstack-1 ];
    memset( p, 0, sizeof(Planet) );
    p->id       = planet_nstack-1;
    p->faction  = -1;
+   p->presence_sys = -1;
 
    /* Reconstruct the jumps. */
    if (!systems_loading && realloced)
@@ -1550,78 +2027,49 @@ Planet *planet_new (void)
 
 
 /**
- * @brief Loads all the planets in the game.
- *
- *    @return 0 on success.
+ * @brief Loads a planet from a parsed file.
  */
-static int planets_load ( void )
+static void planets_loadDoc( xmlDocPtr doc, int i, void *data )
 {
-   uint32_t bufsize;
-   char *buf, **planet_files, *file;
+   const SpaceFiles *sf;
    xmlNodePtr node;
-   xmlDocPtr doc;
    Planet *p;
-   uint32_t nfiles;
-   int i, len;
 
-   /* Load landing stuff. */
-   landing_env = nlua_newEnv(0);
-   nlua_loadStandard(landing_env);
-   buf         = ndata_read( LANDING_DATA_PATH, &bufsize );
-   if (nlua_dobufenv(landing_env, buf, bufsize, LANDING_DATA_PATH) != 0) {
-      WARN( "Failed to load landing file: %s\n"
-            "%s\n"
-            "Most likely Lua file has improper syntax, please check",
-            LANDING_DATA_PATH, lua_tostring(naevL,-1));
+   sf = data;
+   if (doc == NULL) {
+      WARN("%s%s file is invalid xml!", PLANET_DATA_PATH, sf->files[i]);
+      return;
    }
-   free(buf);
 
-   /* Initialize stack if needed. */
-   if (planet_stack == NULL) {
-      planet_mstack = CHUNK_SIZE;
-      planet_stack = malloc( sizeof(Planet) * planet_mstack );
-      planet_nstack = 0;
+   node = doc->xmlChildrenNode; /* first planet node */
+   if (node == NULL) {
+      WARN("Malformed %s%s file: does not contain elements",
+            PLANET_DATA_PATH, sf->files[i]);
+      xmlFreeDoc(doc);
+      return;
    }
 
-   /* Load XML stuff. */
-   planet_files = ndata_list( PLANET_DATA_PATH, &nfiles );
-   for (i=0; i<(int)nfiles; i++) {
-      len  = (strlen(PLANET_DATA_PATH)+strlen(planet_files[i])+2);
-      file = malloc( len );
-      nsnprintf( file, len,"%s%s",PLANET_DATA_PATH,planet_files[i]);
-      buf  = ndata_read( file, &bufsize );
-      doc  = xmlParseMemory( buf, bufsize );
-      if (doc == NULL) {
-         WARN("%s file is invalid xml!",file);
-         free(file);
-         free(buf);
-         continue;
-      }
-
-      node = doc->xmlChildrenNode; /* first planet node */
-      if (node == NULL) {
-         WARN("Malformed %s file: does not contain elements",file);
-         free(file);
-         xmlFreeDoc(doc);
-         free(buf);
-         continue;
-      }
-
-      if (xml_isNode(node,XML_PLANET_TAG)) {
-         p = planet_new();
-         planet_parse( p, node );
-      }
-
-      /* Clean up. */
-      free(file);
-      xmlFreeDoc(doc);
-      free(buf);
+   if (xml_isNode(node,XML_PLANET_TAG)) {
+      p = planet_new();
+      planet_parse( p, node );
    }
 
    /* Clean up. */
-   for (i=0; i<(int)nfiles; i++)
-      free( planet_files[i] );
-   free( planet_files );
+   xmlFreeDoc(doc);
+}
+
+
+/**
+ * @brief Loads all the planets in the game.
+ *
+ *    @param sf Asset files to load.
+ *    @return 0 on success.
+ */
+static int planets_load( const SpaceFiles *sf )
+{
+   /* Load XML stuff, parsing in parallel a batch at a time. */
+   xml_forEachBuffer( sf->bufs, sf->sizes, sf->n,
+         planets_loadDoc, (void*)sf );
 
    return 0;
 }
@@ -1750,16 +2198,257 @@ void planet_updateLand( Planet *p )
  */
 void space_gfxLoad( StarSystem *sys )
 {
-   int i;
+   int i, j;
    Planet *planet;
+
+   /* The view has the size of the graphics. */
+   if (sys == cur_system)
+      space_viewDirty = 1;
+
    for (i=0; i<sys->nplanets; i++) {
       planet = sys->planets[i];
 
       if (planet->real != ASSET_REAL)
          continue;
 
+      /* Finish what was started in the background. */
+      j = space_gfxFind( planet );
+      if (j >= 0)
+         space_gfxFinish( j );
+
       if (planet->gfx_space == NULL)
-         planet->gfx_space = gl_newImage( planet->gfx_spaceName, OPENGL_TEX_MIPMAPS );
+         planet->gfx_space = gl_newImage( planet->gfx_spaceName,
+               OPENGL_TEX_MIPMAPS | OPENGL_TEX_CACHE );
+      planet_gfxLOD( planet );
+   }
+}
+
+
+/**
+ * @brief Takes the low detail copy of a planet graphic if it has none.
+ *
+ * Needs the full graphic to be loaded, planets without a copy always keep
+ *  their full graphic.
+ */
+static void planet_gfxLOD( Planet *planet )
+{
+   if ((planet->gfx_lod != NULL) || (planet->gfx_space == NULL))
+      return;
+   planet->gfx_lod = gl_newLOD( planet->gfx_space, SPACE_LOD_SIZE );
+}
+
+
+/**
+ * @brief Frees the graphics in space of a planet.
+ *
+ *    @param planet Planet to free the graphics of.
+ */
+void planet_gfxFree( Planet *planet )
+{
+   if ((planet->gfx_space != NULL) && (planet->gfx_space != planet->gfx_lod))
+      gl_freeTexture( planet->gfx_space );
+   if (planet->gfx_lod != NULL)
+      gl_freeTexture( planet->gfx_lod );
+   planet->gfx_space = NULL;
+   planet->gfx_lod   = NULL;
+}
+
+
+/**
+ * @brief Gets the pending graphic of a planet.
+ *
+ *    @return Index in space_gfxJobs or -1.
+ */
+static int space_gfxFind( const Planet *pnt )
+{
+   int i;
+   for (i=0; i<space_gfxNjobs; i++)
+      if (space_gfxJobs[i].pnt == pnt)
+         return i;
+   return -1;
+}
+
+
+/**
+ * @brief Creates the texture of a pending graphic, blocking if needed.
+ *
+ *    @param i Index in space_gfxJobs.
+ */
+static void space_gfxFinish( int i )
+{
+   SpaceGfxJob job;
+   glTexture *tex;
+
+   job = space_gfxJobs[i];
+   space_gfxNjobs--;
+   memmove( &space_gfxJobs[i], &space_gfxJobs[i+1],
+         sizeof(SpaceGfxJob) * (space_gfxNjobs-i) );
+
+   tex = gl_asyncFinish( job.tex );
+   if ((tex != NULL) && ((job.pnt->gfx_space == NULL) ||
+            (job.pnt->gfx_space == job.pnt->gfx_lod))) {
+      job.pnt->gfx_space = tex;
+      planet_gfxLOD( job.pnt );
+   }
+   else if (tex != NULL)
+      gl_freeTexture( tex );
+}
+
+
+/**
+ * @brief Drops the pending graphics of a system.
+ *
+ *    @param sys System to cancel, NULL for all.
+ */
+static void space_gfxCancel( StarSystem *sys )
+{
+   int i, j, k;
+
+   for (i=j=0; i<space_gfxNjobs; i++) {
+      k = 0;
+      if (sys != NULL)
+         for (; k<sys->nplanets; k++)
+            if (sys->planets[k] == space_gfxJobs[i].pnt)
+               break;
+      if ((sys == NULL) || (k < sys->nplanets)) {
+         gl_asyncCancel( space_gfxJobs[i].tex );
+         continue;
+      }
+      space_gfxJobs[j++] = space_gfxJobs[i];
+   }
+   space_gfxNjobs = j;
+}
+
+
+/**
+ * @brief Starts decoding the graphics of a system in the background.
+ *
+ * Used to pre-warm the next system while in hyperspace, so that entering it
+ *  doesn't stall on loading the planets. Only one system is pre-warmed at a
+ *  time, the previous one is unloaded if it was not entered.
+ *
+ *    @param sys System to pre-warm.
+ */
+void space_gfxPrefetch( StarSystem *sys )
+{
+   int i;
+   Planet *planet;
+
+   if ((space_gfxNext != NULL) && (space_gfxNext != sys) &&
+         (space_gfxNext != cur_system))
+      space_gfxUnload( space_gfxNext );
+   space_gfxNext = sys;
+   if ((sys == NULL) || (sys == cur_system))
+      return;
+
+   for (i=0; i<sys->nplanets; i++) {
+      planet = sys->planets[i];
+
+      if (planet->real != ASSET_REAL)
+         continue;
+      if ((planet->gfx_space != NULL) || (space_gfxFind( planet ) >= 0))
+         continue;
+
+      space_gfxQueue( planet );
+   }
+}
+
+
+/**
+ * @brief Starts decoding the full graphic of a planet in the background.
+ */
+static void space_gfxQueue( Planet *planet )
+{
+   if (space_gfxNjobs >= space_gfxMjobs) {
+      space_gfxMjobs = MAX( 2*space_gfxMjobs, 8 );
+      space_gfxJobs  = realloc( space_gfxJobs,
+            sizeof(SpaceGfxJob) * space_gfxMjobs );
+   }
+   space_gfxJobs[ space_gfxNjobs ].pnt = planet;
+   space_gfxJobs[ space_gfxNjobs ].tex =
+         gl_newImageAsync( planet->gfx_spaceName,
+               OPENGL_TEX_MIPMAPS | OPENGL_TEX_CACHE );
+   space_gfxNjobs++;
+}
+
+
+/**
+ * @brief Keeps the full planet graphics only where they can be seen.
+ *
+ * Planets far off screen or only a few pixels across are drawn with their
+ *  low detail copy and the full graphic goes back to the texture cache. It
+ *  is decoded again in the background once the planet gets close, keeping
+ *  it uses a looser test than loading it so it doesn't flip at the edge.
+ */
+static void space_gfxResidency (void)
+{
+   int i, full, need;
+   double z, k, r;
+   Planet *planet;
+
+   if (cur_system == NULL)
+      return;
+
+   z = cam_getZoom();
+   for (i=0; i<cur_system->nplanets; i++) {
+      planet = cur_system->planets[i];
+      if ((planet->real != ASSET_REAL) || (planet->gfx_lod == NULL) ||
+            (planet->gfx_space == NULL))
+         continue;
+
+      full = (planet->gfx_space != planet->gfx_lod);
+      k    = full ? 2. : 1.;
+      r    = MAX( planet->gfx_space->sw, planet->gfx_space->sh ) / 2.;
+      need = (2.*r*z*k >= SPACE_LOD_PIXELS) &&
+            gl_isVisible( planet->pos.x, planet->pos.y, r + k*SPACE_LOD_MARGIN/z );
+
+      if (need && !full && (space_gfxFind( planet ) < 0))
+         space_gfxQueue( planet );
+      else if (!need && full) {
+         gl_freeTexture( planet->gfx_space );
+         planet->gfx_space = planet->gfx_lod;
+      }
+   }
+}
+
+
+/**
+ * @brief Uploads the pre-warmed graphics that are decoded.
+ *
+ * Uploads are spread over frames, stopping once SPACE_GFX_BUDGET is spent.
+ *  What is left of the budget goes to rolling the asteroid fields of the
+ *  pre-warmed system.
+ */
+void space_gfxUpdate (void)
+{
+   int i;
+   unsigned int t0;
+   AsteroidAnchor *ast;
+
+   space_gfxResidency();
+
+   t0 = SDL_GetTicks();
+   i  = 0;
+   while (i < space_gfxNjobs) {
+      if (!gl_asyncReady( space_gfxJobs[i].tex )) {
+         i++;
+         continue;
+      }
+      space_gfxFinish( i );
+      if (SDL_GetTicks() - t0 >= SPACE_GFX_BUDGET)
+         return;
+   }
+
+   /* Asteroids use the RNG so they are rolled here instead of in a job. */
+   if ((space_gfxNext == NULL) || (space_gfxNext == cur_system))
+      return;
+   for (i=0; i<space_gfxNext->nasteroids; i++) {
+      ast = &space_gfxNext->asteroids[i];
+      if (ast->warm)
+         continue;
+      asteroid_initField( ast );
+      if (SDL_GetTicks() - t0 >= SPACE_GFX_BUDGET)
+         return;
    }
 }
 
@@ -1773,12 +2462,12 @@ void space_gfxUnload( StarSystem *sys )
 {
    int i;
    Planet *planet;
+   space_gfxCancel( sys );
+   if (space_gfxNext == sys)
+      space_gfxNext = NULL;
    for (i=0; i<sys->nplanets; i++) {
       planet = sys->planets[i];
-      if (planet->gfx_space != NULL) {
-         gl_freeTexture( planet->gfx_space );
-         planet->gfx_space = NULL;
-      }
+      planet_gfxFree( planet );
    }
 }
 
@@ -2075,17 +2764,21 @@ int system_addPlanet( StarSystem *sys, const char *planetname )
    }
    planetname_stack[spacename_nstack-1] = planet->name;
    systemname_stack[spacename_nstack-1] = sys->name;
+   space_hashValid = 0;
 
    economy_addQueuedUpdate();
 
    /* Add the presence. */
    if (!systems_loading) {
-      system_addPresence( sys, planet->faction, planet->presenceAmount, planet->presenceRange );
+      planet_addPresence( planet, sys );
       system_setFaction(sys);
    }
 
    /* Reload graphics if necessary. */
-   if (cur_system != NULL)
+   space_viewDirty = 1;
+   if (space_deferred)
+      space_deferGfx = 1;
+   else if (cur_system != NULL)
       space_gfxLoad( cur_system );
 
    return 0;
@@ -2127,7 +2820,8 @@ int system_rmPlanet( StarSystem *sys, const char *planetname )
    memmove( &sys->planetsid[i], &sys->planetsid[i+1], sizeof(int) * (sys->nplanets-i) );
 
    /* Remove the presence. */
-   system_addPresence( sys, planet->faction, -(planet->presenceAmount), planet->presenceRange );
+   planet_rmPresence( planet );
+   space_viewDirty = 1;
 
    /* Remove from the name stack thingy. */
    found = 0;
@@ -2138,6 +2832,7 @@ int system_rmPlanet( StarSystem *sys, const char *planetname )
                sizeof(char*) * (spacename_nstack-i) );
          memmove( &systemname_stack[i], &systemname_stack[i+1],
                sizeof(char*) * (spacename_nstack-i) );
+         space_hashValid = 0;
          found = 1;
          break;
       }
@@ -2165,7 +2860,10 @@ int system_addJumpDiff( StarSystem *sys, xmlNodePtr node )
 {
    if (system_parseJumpPointDiff(node, sys) <= -1)
       return 0;
-   systems_reconstructJumps();
+   if (space_deferred)
+      space_deferJumps = 1;
+   else
+      systems_reconstructJumps();
    economy_addQueuedUpdate();
 
    return 1;
@@ -2225,6 +2923,7 @@ int system_rmJump( StarSystem *sys, const char *jumpname )
 
    /* Remove jump from system. */
    sys->njumps--;
+   space_viewDirty = 1;
 
    /* Refresh presence */
    system_setFaction(sys);
@@ -2330,9 +3029,10 @@ StarSystem *system_new (void)
    if (cur_system != NULL)
       cur_system = system_getIndex( id );
 
-   /* Initialize system and id. */
+   /* Initialize system and id, name gets set by the caller. */
    system_init( sys );
    sys->id = systems_nstack-1;
+   space_hashValid = 0;
 
    /* Reconstruct the jumps. */
    if (!systems_loading && realloced)
@@ -2384,11 +3084,16 @@ void systems_reconstructJumps (void)
    StarSystem *sys;
    int i;
 
+   space_viewDirty = 1;
+
    /* So we need to calculate the shortest jump. */
    for (i=0; i<systems_nstack; i++) {
       sys = &systems_stack[i];
       system_reconstructJumps(sys);
    }
+
+   /* Paths through the old jumps are no longer valid. */
+   map_graphInvalidate();
 }
 
 
@@ -2807,23 +3512,11 @@ static void system_parseJumps( const xmlNodePtr parent )
  */
 static int system_parseAsteroidField( const xmlNodePtr node, StarSystem *sys )
 {
-   int i, j, k, l, m, n, retry, getout;
    AsteroidAnchor *a;
-   AsteroidSubset *sub, *newsub;
    xmlNodePtr cur, pcur;
-   double x, y, pro, prob;
-
-   /* Allocate more space. */
-   sys->asteroids = realloc( sys->asteroids, (sys->nasteroids+1)*sizeof(AsteroidAnchor) );
-   a = &sys->asteroids[ sys->nasteroids ];
-   memset( a, 0, sizeof(AsteroidAnchor) );
+   double x, y;
 
-   /* Initialize stuff. */
-   a->density  = .2;
-   a->ncorners = 0;
-   a->corners  = NULL;
-   a->aera     = 0.;
-   vect_cset( &a->pos, 0., 0. );
+   a = system_newAsteroidField( sys );
 
    /* Parse data. */
    cur = node->xmlChildrenNode;
@@ -2851,6 +3544,53 @@ static int system_parseAsteroidField( const xmlNodePtr node, StarSystem *sys )
 
    } while (xml_nextNode(cur));
 
+   system_setupAsteroidField( sys, a );
+   return 0;
+}
+
+
+/**
+ * @brief Adds an asteroid field with no corners to a system.
+ *
+ *    @param sys System to add the field to.
+ *    @return The new asteroid field.
+ */
+static AsteroidAnchor* system_newAsteroidField( StarSystem *sys )
+{
+   AsteroidAnchor *a;
+
+   /* Allocate more space. */
+   sys->asteroids = realloc( sys->asteroids, (sys->nasteroids+1)*sizeof(AsteroidAnchor) );
+   a = &sys->asteroids[ sys->nasteroids ];
+   memset( a, 0, sizeof(AsteroidAnchor) );
+
+   /* Initialize stuff. */
+   a->density  = .2;
+   a->ncorners = 0;
+   a->corners  = NULL;
+   a->aera     = 0.;
+   vect_cset( &a->pos, 0., 0. );
+
+   /* The grid no longer covers all the fields. */
+   asteroid_freeGrid( sys->astgrid );
+   sys->astgrid = NULL;
+
+   return a;
+}
+
+
+/**
+ * @brief Computes the derived data of an asteroid field from its corners.
+ *
+ *    @param sys System the field belongs to.
+ *    @param a Field with its density and corners set.
+ */
+static void system_setupAsteroidField( StarSystem *sys, AsteroidAnchor *a )
+{
+   int i, j, k, l, m, n, retry, getout;
+   AsteroidSubset *sub, *newsub;
+   double x, y, pro, prob;
+
    if (a->ncorners < 3)
        WARN("asteroid field in %d has less than 3 corners.", sys->name);
 
@@ -2871,6 +3611,18 @@ static int system_parseAsteroidField( const xmlNodePtr node, StarSystem *sys )
    }
    a->aera /= 2;
 
+   /* Bounding box, to quickly reject positions. */
+   if (a->ncorners > 0) {
+      a->bmin = a->corners[0];
+      a->bmax = a->corners[0];
+   }
+   for (i=1; i<a->ncorners; i++) {
+      a->bmin.x = MIN( a->bmin.x, a->corners[i].x );
+      a->bmin.y = MIN( a->bmin.y, a->corners[i].y );
+      a->bmax.x = MAX( a->bmax.x, a->corners[i].x );
+      a->bmax.y = MAX( a->bmax.y, a->corners[i].y );
+   }
+
    /* Compute number of asteroids */
    a->nb      = floor( ABS(a->aera) / 500000 * a->density );
    a->ndebris = floor(100*a->density);
@@ -2881,7 +3633,8 @@ static int system_parseAsteroidField( const xmlNodePtr node, StarSystem *sys )
    /* Initialize the convex subsets. */
    a->subsets = malloc( sizeof(AsteroidSubset) );
    a->subsets[0].ncorners = a->ncorners;
-   a->subsets[0].corners = a->corners;
+   a->subsets[0].corners = malloc( sizeof(Vector2d) * MAX(a->ncorners,1) );
+   memcpy( a->subsets[0].corners, a->corners, sizeof(Vector2d) * a->ncorners );
    a->nsubsets = 1;
 
    /* Cut the subsets until they are all convex. */
@@ -2979,6 +3732,18 @@ static int system_parseAsteroidField( const xmlNodePtr node, StarSystem *sys )
       sub->pos.x /= sub->ncorners;
       sub->pos.y /= sub->ncorners;
 
+      /* Bounding box, to quickly reject positions. */
+      if (sub->ncorners > 0) {
+         sub->bmin = sub->corners[0];
+         sub->bmax = sub->corners[0];
+      }
+      for (j=1; j<sub->ncorners; j++) {
+         sub->bmin.x = MIN( sub->bmin.x, sub->corners[j].x );
+         sub->bmin.y = MIN( sub->bmin.y, sub->corners[j].y );
+         sub->bmax.x = MAX( sub->bmax.x, sub->corners[j].x );
+         sub->bmax.y = MAX( sub->bmax.y, sub->corners[j].y );
+      }
+
       /* Compute the aera as a sum of triangles */
       for (j=0; j<sub->ncorners-1; j++) {
          sub->aera += (sub->corners[j].x-sub->pos.x)*(sub->corners[j+1].y-sub->pos.y) 
@@ -2992,8 +3757,6 @@ static int system_parseAsteroidField( const xmlNodePtr node, StarSystem *sys )
       }
       sub->aera /= 2;
    }
-
-   return 0;
 }
 
 
@@ -3022,50 +3785,590 @@ static void system_parseAsteroids( const xmlNodePtr parent, StarSystem *sys )
 
 
 /**
- * @brief Loads the entire universe into ram - pretty big feat eh?
+ * @brief Reads all the files in a data directory.
  *
- *    @return 0 on success.
+ *    @param[out] sf Files read.
+ *    @param dir Directory to read.
  */
-int space_load (void)
+static void space_readFiles( SpaceFiles *sf, const char *dir )
 {
-   int i, j, len;
-   int ret;
-   StarSystem *sys;
-   char **asteroid_files, file[PATH_MAX];
+   char file[PATH_MAX];
+   uint32_t n;
+   int i;
 
-   /* Loading. */
-   systems_loading = 1;
+   sf->files = ndata_list( dir, &n );
+   sf->n     = n;
+   sf->views = malloc( sizeof(NdataView) * MAX(sf->n,1) );
+   sf->bufs  = malloc( sizeof(char*) * MAX(sf->n,1) );
+   sf->sizes = malloc( sizeof(uint32_t) * MAX(sf->n,1) );
+   for (i=0; i<sf->n; i++) {
+      nsnprintf( file, sizeof(file), "%s%s", dir, sf->files[i] );
+      ndata_map( &sf->views[i], file );
+      sf->bufs[i]  = sf->views[i].data;
+      sf->sizes[i] = sf->views[i].size;
+   }
+}
 
-   /* Load jump point graphic - must be before systems_load(). */
-   jumppoint_gfx = gl_newSprite(  PLANET_GFX_SPACE_PATH"jumppoint.png", 4, 4, OPENGL_TEX_MIPMAPS );
-   jumpbuoy_gfx = gl_newImage(  PLANET_GFX_SPACE_PATH"jumpbuoy.png", 0 );
 
-   /* Load planets. */
-   ret = planets_load();
-   if (ret < 0)
-      return ret;
+/**
+ * @brief Frees files read with space_readFiles().
+ */
+static void space_freeFiles( SpaceFiles *sf )
+{
+   int i;
 
-   /* Load systems. */
-   ret = systems_load();
-   if (ret < 0)
-      return ret;
+   for (i=0; i<sf->n; i++) {
+      free( sf->files[i] );
+      ndata_unmap( &sf->views[i] );
+   }
+   free( sf->files );
+   free( sf->views );
+   free( sf->bufs );
+   free( sf->sizes );
+}
 
-   /* Load asteroid graphics. */
-   asteroid_files = ndata_list( PLANET_GFX_SPACE_PATH"asteroid/", &nasterogfx );
-   asteroid_gfx = malloc( sizeof(StarSystem) * systems_mstack );
 
-   for (i=0; i<(int)nasterogfx; i++) {
-      len  = (strlen(PLANET_GFX_SPACE_PATH)+strlen(asteroid_files[i])+11);
-      nsnprintf( file, len,"%s%s",PLANET_GFX_SPACE_PATH"asteroid/",asteroid_files[i] );
-      asteroid_gfx[i] = gl_newImage( file, OPENGL_TEX_MIPMAPS );
+/**
+ * @brief Hashes data with FNV-1a.
+ */
+static uint64_t space_cacheHash( uint64_t h, const void *data, size_t len )
+{
+   const unsigned char *p;
+   size_t i;
+
+   p = data;
+   for (i=0; i<len; i++) {
+      h ^= p[i];
+      h *= 1099511628211ULL;
    }
+   return h;
+}
 
-   /* Load asteroid types. */
-   ret = asteroidTypes_load();
-   if (ret < 0)
-      return ret;
 
-   /* Done loading. */
+/**
+ * @brief Gets the key of the universe snapshot matching some data files.
+ */
+static uint64_t space_cacheKey( const SpaceFiles *planets, const SpaceFiles *systems )
+{
+   const SpaceFiles *sf[2];
+   const char *version;
+   uint32_t v;
+   uint64_t h;
+   int i, j;
+
+   h       = SPACE_CACHE_FNV;
+   v       = SPACE_CACHE_VERSION;
+   version = naev_version(1);
+   h       = space_cacheHash( h, &v, sizeof(v) );
+   h       = space_cacheHash( h, version, strlen(version) );
+
+   sf[0] = planets;
+   sf[1] = systems;
+   for (i=0; i<2; i++) {
+      for (j=0; j<sf[i]->n; j++) {
+         h = space_cacheHash( h, sf[i]->files[j], strlen(sf[i]->files[j])+1 );
+         h = space_cacheHash( h, &sf[i]->sizes[j], sizeof(uint32_t) );
+         if (sf[i]->bufs[j] != NULL)
+            h = space_cacheHash( h, sf[i]->bufs[j], sf[i]->sizes[j] );
+      }
+   }
+   return h;
+}
+
+
+/** @brief Appends raw data to a snapshot being written. */
+static void scw_raw( SpaceCacheBuf *b, const void *data, size_t len )
+{
+   if (b->len + len > b->size) {
+      b->size = MAX( 2*b->size, b->len + len + 4096 );
+      b->data = realloc( b->data, b->size );
+   }
+   memcpy( &b->data[b->len], data, len );
+   b->len += len;
+}
+/** @brief Appends an int to a snapshot being written. */
+static void scw_int( SpaceCacheBuf *b, int i )
+{
+   int32_t v = i;
+   scw_raw( b, &v, sizeof(v) );
+}
+/** @brief Appends an unsigned 64 bit int to a snapshot being written. */
+static void scw_u64( SpaceCacheBuf *b, uint64_t u )
+{
+   scw_raw( b, &u, sizeof(u) );
+}
+/** @brief Appends a double to a snapshot being written. */
+static void scw_double( SpaceCacheBuf *b, double d )
+{
+   scw_raw( b, &d, sizeof(d) );
+}
+/** @brief Appends a string, which may be NULL, to a snapshot being written. */
+static void scw_str( SpaceCacheBuf *b, const char *str )
+{
+   int len;
+
+   len = (str != NULL) ? (int)strlen(str) : -1;
+   scw_int( b, len );
+   if (len > 0)
+      scw_raw( b, str, len );
+}
+
+
+/** @brief Reads raw data from a snapshot, zeroing it past the end. */
+static void scr_raw( SpaceCacheBuf *b, void *data, size_t len )
+{
+   if (b->len + len > b->size) {
+      memset( data, 0, len );
+      b->len = b->size;
+      b->err = 1;
+      return;
+   }
+   memcpy( data, &b->data[b->len], len );
+   b->len += len;
+}
+/** @brief Reads an int from a snapshot. */
+static int scr_int( SpaceCacheBuf *b )
+{
+   int32_t v;
+   scr_raw( b, &v, sizeof(v) );
+   return v;
+}
+/** @brief Reads an unsigned 64 bit int from a snapshot. */
+static uint64_t scr_u64( SpaceCacheBuf *b )
+{
+   uint64_t u;
+   scr_raw( b, &u, sizeof(u) );
+   return u;
+}
+/** @brief Reads a double from a snapshot. */
+static double scr_double( SpaceCacheBuf *b )
+{
+   double d;
+   scr_raw( b, &d, sizeof(d) );
+   return d;
+}
+/** @brief Reads a newly allocated string, or NULL, from a snapshot. */
+static char* scr_str( SpaceCacheBuf *b )
+{
+   char *str;
+   int len;
+
+   len = scr_int( b );
+   if ((len < 0) || (b->len + len > b->size)) {
+      if (len >= 0)
+         b->err = 1;
+      return NULL;
+   }
+   str = malloc( len+1 );
+   memcpy( str, &b->data[b->len], len );
+   str[len] = '\0';
+   b->len  += len;
+   return str;
+}
+
+
+/**
+ * @brief Writes the loaded planets and systems as a universe snapshot.
+ *
+ * Only what comes from the data files is written, everything derived after
+ *  loading is computed again the same way for the snapshot.
+ *
+ *    @param key Key of the data files the universe was loaded from.
+ */
+static void space_cacheSave( uint64_t key )
+{
+   SpaceCacheBuf b;
+   Planet *p;
+   StarSystem *sys;
+   JumpPoint *jp;
+   AsteroidAnchor *a;
+   char **names;
+   int i, j, n;
+   uint64_t hdr[3];
+
+   memset( &b, 0, sizeof(b) );
+   memset( hdr, 0, sizeof(hdr) );
+   scw_raw( &b, hdr, sizeof(hdr) ); /* Filled in at the end. */
+
+   /* Assets. */
+   scw_int( &b, planet_nstack );
+   for (i=0; i<planet_nstack; i++) {
+      p = &planet_stack[i];
+      scw_str( &b, p->name );
+      scw_double( &b, p->pos.x );
+      scw_double( &b, p->pos.y );
+      scw_double( &b, p->radius );
+      scw_str( &b, p->class );
+      scw_str( &b, (p->faction >= 0) ? faction_name(p->faction) : NULL );
+      scw_u64( &b, p->population );
+      scw_double( &b, p->presenceAmount );
+      scw_int( &b, p->presenceRange );
+      scw_int( &b, p->real );
+      scw_double( &b, p->hide );
+      scw_str( &b, p->land_func );
+      scw_str( &b, p->description );
+      scw_str( &b, p->bar_description );
+      scw_int( &b, p->services );
+      scw_int( &b, p->ncommodities );
+      for (j=0; j<p->ncommodities; j++)
+         scw_str( &b, p->commodities[j]->name );
+      if (p->tech != NULL) {
+         names = tech_getItemNames( p->tech, &n );
+         scw_int( &b, n );
+         for (j=0; j<n; j++) {
+            scw_str( &b, names[j] );
+            free( names[j] );
+         }
+         free( names );
+      }
+      else
+         scw_int( &b, -1 );
+      scw_str( &b, p->gfx_spaceName );
+      scw_str( &b, p->gfx_spacePath );
+      scw_str( &b, p->gfx_exterior );
+      scw_str( &b, p->gfx_exteriorPath );
+      scw_int( &b, p->flags );
+   }
+
+   /* Systems. */
+   scw_int( &b, systems_nstack );
+   for (i=0; i<systems_nstack; i++) {
+      sys = &systems_stack[i];
+      scw_str( &b, sys->name );
+      scw_double( &b, sys->pos.x );
+      scw_double( &b, sys->pos.y );
+      scw_int( &b, sys->stars );
+      scw_double( &b, sys->interference );
+      scw_double( &b, sys->nebu_density );
+      scw_double( &b, sys->nebu_volatility );
+      scw_double( &b, sys->radius );
+      scw_str( &b, sys->background );
+      scw_int( &b, sys->nplanets );
+      for (j=0; j<sys->nplanets; j++)
+         scw_str( &b, sys->planets[j]->name );
+      scw_int( &b, sys->nasteroids );
+      for (j=0; j<sys->nasteroids; j++) {
+         a = &sys->asteroids[j];
+         scw_double( &b, a->density );
+         scw_int( &b, a->ncorners );
+         for (n=0; n<a->ncorners; n++) {
+            scw_double( &b, a->corners[n].x );
+            scw_double( &b, a->corners[n].y );
+         }
+      }
+   }
+
+   /* Jumps, after all the systems exist. */
+   for (i=0; i<systems_nstack; i++) {
+      sys = &systems_stack[i];
+      scw_int( &b, sys->njumps );
+      for (j=0; j<sys->njumps; j++) {
+         jp = &sys->jumps[j];
+         scw_int( &b, jp->target->id );
+         scw_double( &b, jp->pos.x );
+         scw_double( &b, jp->pos.y );
+         scw_double( &b, jp->radius );
+         scw_int( &b, jp->flags );
+         scw_double( &b, jp->hide );
+      }
+   }
+
+   /* Header. */
+   hdr[0] = SPACE_CACHE_MAGIC;
+   hdr[1] = key;
+   hdr[2] = space_cacheHash( SPACE_CACHE_FNV, &b.data[sizeof(hdr)],
+         b.len - sizeof(hdr) );
+   memcpy( b.data, hdr, sizeof(hdr) );
+
+   nfile_dirMakeExist( "%s", nfile_cachePath() );
+   if (nfile_writeFile( b.data, b.len, "%s"SPACE_CACHE_FILE, nfile_cachePath() ))
+      WARN("Unable to write universe snapshot.");
+   free( b.data );
+}
+
+
+/**
+ * @brief Loads the planets and systems from the universe snapshot.
+ *
+ * A snapshot that can't be decoded is deleted and whatever was loaded from it
+ *  is freed, so the universe can be loaded from XML instead.
+ *
+ *    @param key Key of the current data files.
+ *    @return 0 on success, -1 if there is no usable snapshot.
+ */
+static int space_cacheLoad( uint64_t key )
+{
+   SpaceCacheBuf b;
+   uint64_t hdr[3];
+   Planet *p;
+   StarSystem *sys;
+   JumpPoint *jp;
+   AsteroidAnchor *a;
+   char *str;
+   int len, i, j, k, n, ns, first, pfirst, nfirst;
+   double x, y;
+   char path[PATH_MAX];
+
+   if (!nfile_fileExists( "%s"SPACE_CACHE_FILE, nfile_cachePath() ))
+      return -1;
+   b.data = nfile_readFile( &len, "%s"SPACE_CACHE_FILE, nfile_cachePath() );
+   if (b.data == NULL)
+      return -1;
+   b.size = len;
+   b.len  = 0;
+   b.err  = 0;
+
+   /* Must be for the same data and not be damaged. */
+   scr_raw( &b, hdr, sizeof(hdr) );
+   if (b.err || (hdr[0] != SPACE_CACHE_MAGIC) || (hdr[1] != key) ||
+         (hdr[2] != space_cacheHash( SPACE_CACHE_FNV, &b.data[b.len],
+                                     b.size - b.len ))) {
+      DEBUG("Universe snapshot is out of date, loading from XML.");
+      free( b.data );
+      return -1;
+   }
+
+   /* Assets. */
+   pfirst = planet_nstack;
+   nfirst = spacename_nstack;
+   n = scr_int( &b );
+   for (i=0; (i<n) && !b.err; i++) {
+      p = planet_new();
+      p->name        = scr_str( &b );
+      p->pos.x       = scr_double( &b );
+      p->pos.y       = scr_double( &b );
+      p->radius      = scr_double( &b );
+      p->class       = scr_str( &b );
+      str            = scr_str( &b );
+      if (str != NULL) {
+         p->faction  = faction_get( str );
+         free( str );
+      }
+      p->population  = scr_u64( &b );
+      p->presenceAmount = scr_double( &b );
+      p->presenceRange = scr_int( &b );
+      p->real        = scr_int( &b );
+      p->hide        = scr_double( &b );
+      p->land_func   = scr_str( &b );
+      p->description = scr_str( &b );
+      p->bar_description = scr_str( &b );
+      p->services    = scr_int( &b );
+      k              = scr_int( &b );
+      if (k > 0) {
+         p->commodities = malloc( sizeof(Commodity*) * k );
+         for (j=0; j<k; j++) {
+            str = scr_str( &b );
+            p->commodities[j] = (str != NULL) ? commodity_get( str ) : NULL;
+            free( str );
+         }
+         p->ncommodities = k;
+      }
+      k              = scr_int( &b );
+      if (k >= 0) {
+         p->tech = tech_groupCreate();
+         for (j=0; j<k; j++) {
+            str = scr_str( &b );
+            if (str != NULL)
+               tech_addItemTech( p->tech, str );
+            free( str );
+         }
+      }
+      p->gfx_spaceName = scr_str( &b );
+      p->gfx_spacePath = scr_str( &b );
+      p->gfx_exterior = scr_str( &b );
+      p->gfx_exteriorPath = scr_str( &b );
+      p->flags       = scr_int( &b );
+   }
+
+   /* Systems. */
+   first = systems_nstack;
+   ns    = scr_int( &b );
+   for (i=0; (i<ns) && !b.err; i++) {
+      sys = system_new();
+      sys->name      = scr_str( &b );
+      sys->pos.x     = scr_double( &b );
+      sys->pos.y     = scr_double( &b );
+      sys->stars     = scr_int( &b );
+      sys->interference = scr_double( &b );
+      sys->nebu_density = scr_double( &b );
+      sys->nebu_volatility = scr_double( &b );
+      sys->radius    = scr_double( &b );
+      sys->background = scr_str( &b );
+      n = scr_int( &b );
+      for (j=0; (j<n) && !b.err; j++) {
+         str = scr_str( &b );
+         if (str != NULL)
+            system_addPlanet( sys, str );
+         free( str );
+      }
+      n = scr_int( &b );
+      for (j=0; (j<n) && !b.err; j++) {
+         a = system_newAsteroidField( sys );
+         a->density  = scr_double( &b );
+         k           = scr_int( &b );
+         if ((k < 0) || (b.len + k*2*sizeof(double) > b.size)) {
+            b.err = 1;
+            break;
+         }
+         a->corners  = malloc( sizeof(Vector2d) * MAX(k,1) );
+         a->ncorners = k;
+         for (k=0; k<a->ncorners; k++) {
+            x = scr_double( &b );
+            y = scr_double( &b );
+            vect_cset( &a->corners[k], x, y );
+            a->pos.x += x;
+            a->pos.y += y;
+         }
+         system_setupAsteroidField( sys, a );
+      }
+   }
+
+   /* Jumps. */
+   for (i=0; (i<ns) && !b.err; i++) {
+      sys = &systems_stack[ first+i ];
+      n   = scr_int( &b );
+      if ((n < 0) || (b.len + n*(2*sizeof(int32_t)+4*sizeof(double)) > b.size)) {
+         b.err = 1;
+         break;
+      }
+      sys->jumps  = (n > 0) ? calloc( n, sizeof(JumpPoint) ) : NULL;
+      sys->njumps = n;
+      for (j=0; j<n; j++) {
+         jp = &sys->jumps[j];
+         k  = scr_int( &b );
+         if ((k < 0) || (first+k >= systems_nstack)) {
+            b.err = 1;
+            break;
+         }
+         jp->target   = &systems_stack[ first+k ];
+         jp->targetid = jp->target->id;
+         jp->pos.x    = scr_double( &b );
+         jp->pos.y    = scr_double( &b );
+         jp->radius   = scr_double( &b );
+         jp->flags    = scr_int( &b );
+         jp->hide     = scr_double( &b );
+      }
+   }
+
+   free( b.data );
+
+   /* The checksum matched, so this can only be a format bug. */
+   if (b.err) {
+      WARN("Universe snapshot '%s"SPACE_CACHE_FILE"' is inconsistent, loading from XML.",
+            nfile_cachePath());
+      for (i=first; i<systems_nstack; i++)
+         system_free( &systems_stack[i] );
+      systems_nstack = first;
+      for (i=pfirst; i<planet_nstack; i++)
+         planet_free( &planet_stack[i] );
+      planet_nstack    = pfirst;
+      spacename_nstack = nfirst;
+      space_hashValid  = 0;
+      nsnprintf( path, sizeof(path), "%s"SPACE_CACHE_FILE, nfile_cachePath() );
+      nfile_delete( path );
+      return -1;
+   }
+
+   return 0;
+}
+
+
+/**
+ * @brief Loads the entire universe into ram - pretty big feat eh?
+ *
+ *    @return 0 on success.
+ */
+int space_load (void)
+{
+   int i, j, len;
+   int ret;
+   uint32_t bufsize;
+   uint64_t key;
+   StarSystem *sys;
+   SpaceFiles planets, systems;
+   char *buf, **asteroid_files, file[PATH_MAX];
+
+   /* Loading. */
+   systems_loading = 1;
+
+   /* Load jump point graphic - must be before systems_load(). */
+   jumppoint_gfx = gl_newSprite(  PLANET_GFX_SPACE_PATH"jumppoint.png", 4, 4, OPENGL_TEX_MIPMAPS );
+   jumpbuoy_gfx = gl_newImage(  PLANET_GFX_SPACE_PATH"jumpbuoy.png", 0 );
+
+   /* Load landing stuff. */
+   landing_env = nlua_newEnv(0);
+   nlua_loadStandard(landing_env);
+   buf         = ndata_read( LANDING_DATA_PATH, &bufsize );
+   if (nlua_dobufenv(landing_env, buf, bufsize, LANDING_DATA_PATH) != 0) {
+      WARN( "Failed to load landing file: %s\n"
+            "%s\n"
+            "Most likely Lua file has improper syntax, please check",
+            LANDING_DATA_PATH, lua_tostring(naevL,-1));
+   }
+   free(buf);
+
+   /* Initialize stacks if needed. */
+   if (planet_stack == NULL) {
+      planet_mstack = CHUNK_SIZE;
+      planet_stack = malloc( sizeof(Planet) * planet_mstack );
+      planet_nstack = 0;
+   }
+   if (systems_stack == NULL) {
+      systems_mstack = CHUNK_SIZE;
+      systems_stack = malloc( sizeof(StarSystem) * systems_mstack );
+      systems_nstack = 0;
+   }
+
+   /* Use the snapshot if it was made from the same files. */
+   space_readFiles( &planets, PLANET_DATA_PATH );
+   space_readFiles( &systems, SYSTEM_DATA_PATH );
+   key = space_cacheKey( &planets, &systems );
+   if (space_cacheLoad( key ) != 0) {
+      /* Load planets. */
+      ret = planets_load( &planets );
+      if (ret >= 0)
+         /* Load systems. */
+         ret = systems_load( &systems );
+      if (ret >= 0)
+         space_cacheSave( key );
+   }
+   else
+      ret = 0;
+   space_freeFiles( &planets );
+   space_freeFiles( &systems );
+   if (ret < 0)
+      return ret;
+
+   DEBUG("Loaded %d Star System%s with %d Planet%s",
+         systems_nstack, (systems_nstack==1) ? "" : "s",
+         planet_nstack, (planet_nstack==1) ? "" : "s" );
+
+   /* Load asteroid graphics. */
+   asteroid_files = ndata_list( PLANET_GFX_SPACE_PATH"asteroid/", &nasterogfx );
+   asteroid_gfx = malloc( sizeof(StarSystem) * systems_mstack );
+
+   for (i=0; i<(int)nasterogfx; i++) {
+      len  = (strlen(PLANET_GFX_SPACE_PATH)+strlen(asteroid_files[i])+11);
+      nsnprintf( file, len,"%s%s",PLANET_GFX_SPACE_PATH"asteroid/",asteroid_files[i] );
+      asteroid_gfx[i] = gl_newImage( file, OPENGL_TEX_MIPMAPS );
+   }
+
+   /* Load asteroid types. */
+   ret = asteroidTypes_load();
+   if (ret < 0)
+      return ret;
+
+   /* Fields are culled with the largest graphic, whatever they use. */
+   asteroid_radius = 0.;
+   for (i=0; i<(int)nasterogfx; i++)
+      asteroid_radius = MAX( asteroid_radius,
+            MAX( asteroid_gfx[i]->sw, asteroid_gfx[i]->sh ) / 2. );
+   for (i=0; i<asteroid_ntypes; i++)
+      for (j=0; j<asteroid_types[i].ngfx; j++)
+         asteroid_radius = MAX( asteroid_radius,
+               MAX( asteroid_types[i].gfxs[j]->sw, asteroid_types[i].gfxs[j]->sh ) / 2. );
+
+   /* Done loading. */
    systems_loading = 0;
 
    /* Apply all the presences. */
@@ -3188,101 +4491,56 @@ static int asteroidTypes_load (void)
  *  - First loads the star systems.
  *  - Next sets the jump routes.
  *
+ *    @param sf System files to load.
  *    @return 0 on success.
  */
-static int systems_load (void)
+static int systems_load( const SpaceFiles *sf )
 {
-   uint32_t bufsize;
-   char *buf, **system_files, *file;
    xmlNodePtr node;
-   xmlDocPtr doc;
+   xmlDocPtr *docs;
    StarSystem *sys;
-   int i, len;
-   uint32_t nfiles;
-
-   /* Allocate if needed. */
-   if (systems_stack == NULL) {
-      systems_mstack = CHUNK_SIZE;
-      systems_stack = malloc( sizeof(StarSystem) * systems_mstack );
-      systems_nstack = 0;
-   }
+   int i;
 
-   system_files = ndata_list( SYSTEM_DATA_PATH, &nfiles );
+   /* Parse the XML in parallel, the documents are kept for both passes. */
+   docs = xml_parseBuffers( sf->bufs, sf->sizes, sf->n );
 
    /*
     * First pass - loads all the star systems_stack.
     */
-   for (i=0; i<(int)nfiles; i++) {
-
-      len  = strlen(SYSTEM_DATA_PATH)+strlen(system_files[i])+2;
-      file = malloc( len );
-      nsnprintf( file, len, "%s%s", SYSTEM_DATA_PATH, system_files[i] );
-      /* Load the file. */
-      buf = ndata_read( file, &bufsize );
-      doc = xmlParseMemory( buf, bufsize );
-      if (doc == NULL) {
-         WARN("%s file is invalid xml!",file);
-         free(buf);
+   for (i=0; i<sf->n; i++) {
+      if (docs[i] == NULL) {
+         WARN("%s%s file is invalid xml!", SYSTEM_DATA_PATH, sf->files[i]);
          continue;
       }
 
-      node = doc->xmlChildrenNode; /* first planet node */
+      node = docs[i]->xmlChildrenNode; /* first planet node */
       if (node == NULL) {
-         WARN("Malformed %s file: does not contain elements",file);
-         xmlFreeDoc(doc);
-         free(buf);
+         WARN("Malformed %s%s file: does not contain elements",
+               SYSTEM_DATA_PATH, sf->files[i]);
+         xmlFreeDoc(docs[i]);
+         docs[i] = NULL;
          continue;
       }
 
       sys = system_new();
       system_parse( sys, node );
       system_parseAsteroids(node, sys); /* load the asteroids anchors */
-
-      /* Clean up. */
-      xmlFreeDoc(doc);
-      free(buf);
-      free( file );
    }
 
    /*
     * Second pass - loads all the jump routes.
     */
-   for (i=0; i<(int)nfiles; i++) {
-
-      len  = strlen(SYSTEM_DATA_PATH)+strlen(system_files[i])+2;
-      file = malloc( len );
-      nsnprintf( file, len, "%s%s", SYSTEM_DATA_PATH, system_files[i] );
-      /* Load the file. */
-      buf = ndata_read( file, &bufsize );
-      free( file );
-      doc = xmlParseMemory( buf, bufsize );
-      if (doc == NULL) {
-         free(buf);
+   for (i=0; i<sf->n; i++) {
+      if (docs[i] == NULL)
          continue;
-      }
-
-      node = doc->xmlChildrenNode; /* first planet node */
-      if (node == NULL) {
-         xmlFreeDoc(doc);
-         free(buf);
-         continue;
-      }
 
+      node = docs[i]->xmlChildrenNode; /* first planet node */
       system_parseJumps(node); /* will automatically load the jumps into the system */
 
       /* Clean up. */
-      xmlFreeDoc(doc);
-      free(buf);
+      xmlFreeDoc(docs[i]);
    }
-
-   DEBUG("Loaded %d Star System%s with %d Planet%s",
-         systems_nstack, (systems_nstack==1) ? "" : "s",
-         planet_nstack, (planet_nstack==1) ? "" : "s" );
-
-   /* Clean up. */
-   for (i=0; i<(int)nfiles; i++)
-      free( system_files[i] );
-   free( system_files );
+   free( docs );
 
    return 0;
 }
@@ -3326,44 +4584,159 @@ void space_renderOverlay( const double dt )
  */
 void planets_render (void)
 {
-   int i, j;
-   double x, y;
-   AsteroidAnchor *ast;
-   Pilot *pplayer;
-   Solid *psolid;
+   int i;
+   double r;
+   const SystemView *v;
 
    /* Must be a system. */
    if (cur_system==NULL)
       return;
+   v = space_getView();
 
-   /* Render the jumps. */
-   for (i=0; i < cur_system->njumps; i++)
-      space_renderJumpPoint( &cur_system->jumps[i], i );
+   /* Render the jumps, the buoys are 200 away. */
+   r = MAX( jumppoint_gfx->sw, jumppoint_gfx->sh ) / 2. + 200. +
+         MAX( jumpbuoy_gfx->sw, jumpbuoy_gfx->sh ) / 2.;
+   for (i=0; i < v->njumps; i++)
+      if (gl_isVisible( v->jx[i], v->jy[i], r ))
+         space_renderJumpPoint( &cur_system->jumps[i], i );
 
    /* Render the planets. */
-   for (i=0; i < cur_system->nplanets; i++)
-      if (cur_system->planets[i]->real == ASSET_REAL)
+   for (i=0; i < v->nplanets; i++)
+      if ((v->pflags[i] & SYSVIEW_REAL) && (v->pr[i] > 0.) &&
+            gl_isVisible( v->px[i], v->py[i], v->pr[i] ) &&
+            (cur_system->planets[i]->gfx_space != NULL))
          space_renderPlanet( cur_system->planets[i] );
 
+   /* Render the asteroids & debris. */
+   space_renderAsteroids();
+}
+
+
+/**
+ * @brief Gets the view of the current system, rebuilding it if needed.
+ *
+ *    @return The view, empty if there is no current system.
+ */
+const SystemView* space_getView (void)
+{
+   if (space_viewDirty || (space_view.sys != cur_system) ||
+         ((cur_system != NULL) &&
+            ((space_view.nplanets != cur_system->nplanets) ||
+               (space_view.njumps != cur_system->njumps))))
+      space_viewBuild();
+   return &space_view;
+}
+
+
+/**
+ * @brief Builds the view of the current system.
+ */
+static void space_viewBuild (void)
+{
+   int i, n;
+   Planet *p;
+   JumpPoint *jp;
+   SystemView *v;
+
+   v = &space_view;
+   v->sys      = cur_system;
+   v->nplanets = (cur_system != NULL) ? cur_system->nplanets : 0;
+   v->njumps   = (cur_system != NULL) ? cur_system->njumps : 0;
+   space_viewDirty = 0;
+
+   /* Grow the memory, it is kept for the next systems. */
+   n = MAX( v->nplanets, v->njumps );
+   if (n > space_viewMem) {
+      space_viewMem = MAX( n, 2*space_viewMem );
+      v->px        = realloc( v->px, sizeof(double) * space_viewMem );
+      v->py        = realloc( v->py, sizeof(double) * space_viewMem );
+      v->pr        = realloc( v->pr, sizeof(double) * space_viewMem );
+      v->pservices = realloc( v->pservices, sizeof(unsigned int) * space_viewMem );
+      v->pfaction  = realloc( v->pfaction, sizeof(int) * space_viewMem );
+      v->pflags    = realloc( v->pflags, sizeof(unsigned int) * space_viewMem );
+      v->jx        = realloc( v->jx, sizeof(double) * space_viewMem );
+      v->jy        = realloc( v->jy, sizeof(double) * space_viewMem );
+   }
+
+   for (i=0; i<v->nplanets; i++) {
+      p = cur_system->planets[i];
+      v->px[i]        = p->pos.x;
+      v->py[i]        = p->pos.y;
+      v->pr[i]        = (p->gfx_space != NULL) ?
+            MAX( p->gfx_space->sw, p->gfx_space->sh ) / 2. : 0.;
+      v->pservices[i] = p->services;
+      v->pfaction[i]  = p->faction;
+      v->pflags[i]    = (p->real == ASSET_REAL) ? SYSVIEW_REAL : 0;
+   }
+
+   for (i=0; i<v->njumps; i++) {
+      jp = &cur_system->jumps[i];
+      v->jx[i] = jp->pos.x;
+      v->jy[i] = jp->pos.y;
+   }
+}
+
+
+/**
+ * @brief Frees the view of the current system.
+ */
+static void space_viewFree (void)
+{
+   free( space_view.px );
+   free( space_view.py );
+   free( space_view.pr );
+   free( space_view.pservices );
+   free( space_view.pfaction );
+   free( space_view.pflags );
+   free( space_view.jx );
+   free( space_view.jy );
+   memset( &space_view, 0, sizeof(SystemView) );
+   space_viewMem   = 0;
+   space_viewDirty = 1;
+}
+
+
+/**
+ * @brief Renders the asteroids and debris of the current system.
+ *
+ * Everything is batched, so there is a single draw per asteroid graphic.
+ *  Fields that are off screen are skipped as a whole.
+ */
+static void space_renderAsteroids (void)
+{
+   int i, j;
+   double x, y, r;
+   AsteroidAnchor *ast;
+   Pilot *pplayer;
+   Solid *psolid;
+
+   if (cur_system->nasteroids <= 0)
+      return;
+
    /* Get the player in order to compute the offset for debris. */
    pplayer = pilot_get( PLAYER_ID );
-   if (pplayer != NULL)
-      psolid  = pplayer->solid;
+   psolid  = (pplayer != NULL) ? pplayer->solid : NULL;
 
-   /* Render the asteroids & debris. */
+   gl_batchBegin();
    for (i=0; i < cur_system->nasteroids; i++) {
       ast = &cur_system->asteroids[i];
-      for (j=0; j < ast->nb; j++)
-        space_renderAsteroid( &ast->asteroids[j] );
 
-      if (pplayer != NULL) {
+      /* Asteroids stay in the bounding box of their field. */
+      r = hypot( ast->bmax.x - ast->bmin.x, ast->bmax.y - ast->bmin.y ) / 2.;
+      if (gl_isVisible( (ast->bmin.x + ast->bmax.x) / 2.,
+               (ast->bmin.y + ast->bmax.y) / 2., r + asteroid_radius ))
+         for (j=0; j < ast->nb; j++)
+            space_renderAsteroid( &ast->asteroids[j] );
+
+      /* Debris follow the player instead. */
+      if (psolid != NULL) {
          x = psolid->pos.x - SCREEN_W/2;
          y = psolid->pos.y - SCREEN_H/2;
          for (j=0; j < ast->ndebris; j++)
-           space_renderDebris( &ast->debris[j], x, y );
+            space_renderDebris( &ast->debris[j], x, y );
       }
    }
-
+   gl_batchEnd();
 }
 
 
@@ -3411,6 +4784,14 @@ static void space_renderAsteroid( Asteroid *a )
 {
    double scale;
    AsteroidType *at;
+   glTexture *gfx;
+
+   at  = &asteroid_types[a->type];
+   gfx = at->gfxs[a->gfxID];
+
+   /* Off screen. */
+   if (!gl_isVisible( a->pos.x, a->pos.y, MAX( gfx->sw, gfx->sh ) / 2. ))
+      return;
 
    /* Check if needs scaling. */
    if (a->appearing == 1)
@@ -3420,9 +4801,7 @@ static void space_renderAsteroid( Asteroid *a )
    else
       scale = 1.;
 
-   at = &asteroid_types[a->type];
-
-   gl_blitSpriteInterpolateScale( at->gfxs[a->gfxID], at->gfxs[a->gfxID], 1,
+   gl_blitSpriteInterpolateScale( gfx, gfx, 1,
                                   a->pos.x, a->pos.y, scale, scale, 0, 0, NULL );
 }
 
@@ -3433,18 +4812,23 @@ static void space_renderAsteroid( Asteroid *a )
 static void space_renderDebris( Debris *d, double x, double y )
 {
    double scale;
-   Vector2d *testVect;
+   Vector2d testVect;
+   glTexture *gfx;
 
    scale = .5;
+   gfx   = asteroid_gfx[d->gfxID];
 
-   testVect = malloc(sizeof(Vector2d));
-   testVect->x = d->pos.x + x;
-   testVect->y = d->pos.y + y;
+   /* Off screen, don't bother checking the fields. */
+   if (!gl_isVisible( d->pos.x + x, d->pos.y + y,
+            scale * MAX( gfx->sw, gfx->sh ) / 2. ))
+      return;
 
-   if ( space_isInField( testVect ) == 0 )
-      gl_blitSpriteInterpolateScale( asteroid_gfx[d->gfxID], asteroid_gfx[d->gfxID], 1,
+   testVect.x = d->pos.x + x;
+   testVect.y = d->pos.y + y;
+
+   if ( space_isInField( &testVect ) == 0 )
+      gl_blitSpriteInterpolateScale( gfx, gfx, 1,
                                      d->pos.x + x, d->pos.y + y, scale, scale, 0, 0, NULL );
-   free(testVect);
 }
 
 
@@ -3454,11 +4838,10 @@ static void space_renderDebris( Debris *d, double x, double y )
 void space_exit (void)
 {
    int i, j;
-   Planet *pnt;
-   AsteroidAnchor *ast;
-   StarSystem *sys;
    AsteroidType *at;
 
+   space_viewFree();
+
    /* Free jump point graphic. */
    if (jumppoint_gfx != NULL)
       gl_freeTexture(jumppoint_gfx);
@@ -3478,76 +4861,31 @@ void space_exit (void)
    if (systemname_stack != NULL)
       free(systemname_stack);
    spacename_nstack = 0;
+   nhash_free( &planet_hash );
+   nhash_free( &system_hash );
+   nhash_free( &spacename_hash );
+   nfuzzy_free( &planet_fuzzy );
+   nfuzzy_free( &system_fuzzy );
+   space_hashValid = 0;
+
+   /* Drop the pre-warmed graphics. */
+   space_gfxCancel( NULL );
+   free( space_gfxJobs );
+   space_gfxJobs  = NULL;
+   space_gfxMjobs = 0;
+   space_gfxNext  = NULL;
 
    /* Free the planets. */
-   for (i=0; i < planet_nstack; i++) {
-      pnt = &planet_stack[i];
-
-      free(pnt->name);
-      free(pnt->class);
-      free(pnt->description);
-      free(pnt->bar_description);
-
-      /* graphics */
-      if (pnt->gfx_spaceName != NULL) {
-         if (pnt->gfx_space != NULL)
-            gl_freeTexture( pnt->gfx_space );
-         free(pnt->gfx_spaceName);
-         free(pnt->gfx_spacePath);
-      }
-      if (pnt->gfx_exterior != NULL) {
-         free(pnt->gfx_exterior);
-         free(pnt->gfx_exteriorPath);
-      }
-
-      /* Landing. */
-      free(pnt->land_func);
-      free(pnt->land_msg);
-      free(pnt->bribe_msg);
-      free(pnt->bribe_ack_msg);
-
-      /* tech */
-      if (pnt->tech != NULL)
-         tech_groupDestroy( pnt->tech );
-
-      /* commodities */
-      free(pnt->commodities);
-   }
+   for (i=0; i < planet_nstack; i++)
+      planet_free( &planet_stack[i] );
    free(planet_stack);
    planet_stack = NULL;
    planet_nstack = 0;
    planet_mstack = 0;
 
    /* Free the systems. */
-   for (i=0; i < systems_nstack; i++) {
-      free(systems_stack[i].name);
-      if (systems_stack[i].fleets)
-         free(systems_stack[i].fleets);
-      if (systems_stack[i].jumps)
-         free(systems_stack[i].jumps);
-      if (systems_stack[i].background)
-         free(systems_stack[i].background);
-
-      if(systems_stack[i].presence)
-         free(systems_stack[i].presence);
-
-      if (systems_stack[i].planets != NULL)
-         free(systems_stack[i].planets);
-      if (systems_stack[i].planetsid != NULL)
-         free(systems_stack[i].planetsid);
-
-      /* Free the asteroids. */
-      sys = &systems_stack[i];
-      
-      for (j=0; j < sys->nasteroids; j++) {
-         ast = &sys->asteroids[j];
-         free(ast->asteroids);
-         free(ast->debris);
-         free(ast->subsets);
-      }
-      free(sys->asteroids);
-
-   }
+   for (i=0; i < systems_nstack; i++)
+      system_free( &systems_stack[i] );
    free(systems_stack);
    systems_stack = NULL;
    systems_nstack = 0;
@@ -3572,6 +4910,89 @@ void space_exit (void)
 }
 
 
+/**
+ * @brief Frees what a planet owns.
+ *
+ *    @param pnt Planet to free.
+ */
+static void planet_free( Planet *pnt )
+{
+   free(pnt->name);
+   free(pnt->class);
+   free(pnt->description);
+   free(pnt->bar_description);
+
+   /* graphics */
+   if (pnt->gfx_spaceName != NULL) {
+      planet_gfxFree( pnt );
+      free(pnt->gfx_spaceName);
+      free(pnt->gfx_spacePath);
+   }
+   if (pnt->gfx_exterior != NULL) {
+      free(pnt->gfx_exterior);
+      free(pnt->gfx_exteriorPath);
+   }
+
+   /* Landing. */
+   free(pnt->land_func);
+   free(pnt->land_msg);
+   free(pnt->bribe_msg);
+   free(pnt->bribe_ack_msg);
+
+   /* tech */
+   if (pnt->tech != NULL)
+      tech_groupDestroy( pnt->tech );
+
+   /* presence */
+   if (pnt->presence_spill != NULL)
+      array_free( pnt->presence_spill );
+
+   /* commodities */
+   free(pnt->commodities);
+}
+
+
+/**
+ * @brief Frees what a star system owns.
+ *
+ *    @param sys System to free.
+ */
+static void system_free( StarSystem *sys )
+{
+   int j, k;
+   AsteroidAnchor *ast;
+
+   free(sys->name);
+   if (sys->fleets)
+      free(sys->fleets);
+   if (sys->jumps)
+      free(sys->jumps);
+   if (sys->background)
+      free(sys->background);
+
+   if(sys->presence)
+      free(sys->presence);
+
+   if (sys->planets != NULL)
+      free(sys->planets);
+   if (sys->planetsid != NULL)
+      free(sys->planetsid);
+
+   /* Free the asteroids. */
+   for (j=0; j < sys->nasteroids; j++) {
+      ast = &sys->asteroids[j];
+      free(ast->asteroids);
+      free(ast->debris);
+      for (k=0; k < ast->nsubsets; k++)
+         free(ast->subsets[k].corners);
+      free(ast->subsets);
+      free(ast->corners);
+   }
+   free(sys->asteroids);
+   asteroid_freeGrid( sys->astgrid );
+}
+
+
 /**
  * @brief Clears all system knowledge.
  */
@@ -3587,6 +5008,7 @@ void space_clearKnown (void)
    }
    for (j=0; j<planet_nstack; j++)
       planet_rmFlag(&planet_stack[j],PLANET_KNOWN);
+   map_knownInvalidate();
 }
 
 
@@ -3603,6 +5025,7 @@ void space_clearMarkers (void)
       systems_stack[i].markers_high  = 0;
       systems_stack[i].markers_low   = 0;
    }
+   map_geomInvalidate();
 }
 
 
@@ -3614,6 +5037,7 @@ void space_clearComputerMarkers (void)
    int i;
    for (i=0; i<systems_nstack; i++)
       sys_rmFlag(&systems_stack[i],SYSTEM_CMARKED);
+   map_geomInvalidate();
 }
 
 
@@ -3656,6 +5080,7 @@ int space_addMarker( int sys, SysMarker type )
    /* Decrement markers. */
    (*markers)++;
    sys_setFlag(ssys, SYSTEM_MARKED);
+   map_geomInvalidate();
 
    return 0;
 }
@@ -3702,6 +5127,7 @@ int space_rmMarker( int sys, SysMarker type )
    if (*markers <= 0) {
       sys_rmFlag(ssys, SYSTEM_MARKED);
       (*markers) = 0;
+      map_geomInvalidate();
    }
 
    return 0;
@@ -3788,6 +5214,7 @@ int space_sysLoad( xmlNodePtr parent )
       }
    } while (xml_nextNode(node));
 
+   map_knownInvalidate();
    return 0;
 }
 
@@ -3849,6 +5276,7 @@ static int getPresenceIndex( StarSystem *sys, int faction )
       sys->presence[0].value     = 0 ;
       sys->presence[0].curUsed   = 0 ;
       sys->presence[0].timer     = 0.;
+      sys->presence[0].depleted  = 0.;
       return 0;
    }
 
@@ -3863,6 +5291,7 @@ static int getPresenceIndex( StarSystem *sys, int faction )
    sys->presence = realloc(sys->presence, sizeof(SystemPresence) * sys->npresence);
    sys->presence[i].faction = faction;
    sys->presence[i].value = 0;
+   sys->presence[i].depleted = 0.;
 
    return i;
 }
@@ -3887,6 +5316,19 @@ static void presenceCleanup( StarSystem *sys )
       return;
    }
 
+   presencePrune( sys );
+}
+
+
+/**
+ * @brief Removes the 0 and negative-value presences of a system.
+ *
+ *    @param sys Pointer to the system to prune.
+ */
+static void presencePrune( StarSystem *sys )
+{
+   int i;
+
    /* Check the system for 0 and negative-value presences. */
    for (i=0; i < sys->npresence; i++) {
       if (sys->presence[i].value > 0.)
@@ -3923,10 +5365,27 @@ void system_presenceCleanupAll( void )
  *    @param range The range of spill of the presence.
  */
 void system_addPresence( StarSystem *sys, int faction, double amount, int range )
+{
+   system_spillPresence( sys, faction, amount, range, NULL );
+}
+
+
+/**
+ * @brief Adds some presence to a system and spills it to its neighbours.
+ *
+ *    @param sys Pointer to the system to add to or remove from.
+ *    @param faction The index of the faction to alter presence for.
+ *    @param amount The amount of presence to add (negative to subtract).
+ *    @param range The range of spill of the presence.
+ *    @param[out] spill If not NULL, gets what was added to each system.
+ */
+static void system_spillPresence( StarSystem *sys, int faction, double amount,
+      int range, PresenceSpill **spill )
 {
    int i, x, curSpill;
    Queue q, qn;
    StarSystem *cur;
+   PresenceSpill *ps;
 
    /* Check for NULL and display a warning. */
    if (sys == NULL) {
@@ -3945,6 +5404,11 @@ void system_addPresence( StarSystem *sys, int faction, double amount, int range
    /* Add the presence to the current system. */
    i = getPresenceIndex(sys, faction);
    sys->presence[i].value += amount;
+   if (spill != NULL) {
+      ps        = &array_grow( spill );
+      ps->sys   = sys->id;
+      ps->value = amount;
+   }
 
    /* If there's no range, we're done here. */
    if (range < 1)
@@ -3993,6 +5457,11 @@ void system_addPresence( StarSystem *sys, int faction, double amount, int range
       /* Spill some presence. */
       x = getPresenceIndex(cur, faction);
       cur->presence[x].value += amount / (2 + curSpill);
+      if (spill != NULL) {
+         ps        = &array_grow( spill );
+         ps->sys   = cur->id;
+         ps->value = amount / (2 + curSpill);
+      }
 
       /* Check to see if we've finished this range and grab the next queue. */
       if (q_isEmpty(q)) {
@@ -4062,7 +5531,83 @@ void system_addAllPlanetsPresence( StarSystem *sys )
    }
 
    for(i=0; i<sys->nplanets; i++)
-      system_addPresence(sys, sys->planets[i]->faction, sys->planets[i]->presenceAmount, sys->planets[i]->presenceRange);
+      planet_addPresence( sys->planets[i], sys );
+}
+
+
+/**
+ * @brief Refreshes the faction of the systems presence was added to.
+ */
+static void presenceRefresh( PresenceSpill *spill )
+{
+   int i;
+   StarSystem *sys;
+
+   for (i=0; i<array_size(spill); i++) {
+      sys = &systems_stack[ spill[i].sys ];
+      system_setFaction( sys );
+      sys->ownerpresence = system_getPresence( sys, sys->faction );
+   }
+
+   /* Faction disks may change. */
+   if (array_size(spill) > 0)
+      map_geomInvalidate();
+}
+
+
+/**
+ * @brief Adds the presence of a planet, remembering where it went.
+ *
+ * The presence can then be taken back with planet_rmPresence() without
+ *  touching the rest of the universe.
+ *
+ *    @param p Planet to add the presence of.
+ *    @param sys System the planet is in.
+ */
+void planet_addPresence( Planet *p, StarSystem *sys )
+{
+   if (p->presence_sys >= 0)
+      planet_rmPresence( p );
+
+   if (p->presence_spill == NULL)
+      p->presence_spill = array_create( PresenceSpill );
+   p->presence_sys     = sys->id;
+   p->presence_faction = p->faction;
+   system_spillPresence( sys, p->faction, p->presenceAmount,
+         p->presenceRange, &p->presence_spill );
+
+   if (!systems_loading)
+      presenceRefresh( p->presence_spill );
+}
+
+
+/**
+ * @brief Removes the presence added by planet_addPresence().
+ *
+ *    @param p Planet to remove the presence of.
+ */
+void planet_rmPresence( Planet *p )
+{
+   int i, x;
+   StarSystem *sys;
+
+   if (p->presence_sys < 0)
+      return;
+
+   for (i=0; i<array_size(p->presence_spill); i++) {
+      sys = &systems_stack[ p->presence_spill[i].sys ];
+      x   = getPresenceIndex( sys, p->presence_faction );
+      sys->presence[x].value -= p->presence_spill[i].value;
+      /* Don't leave rounding errors behind. */
+      if (fabs(sys->presence[x].value) < 1e-9)
+         sys->presence[x].value = 0.;
+      presencePrune( sys );
+   }
+   presenceRefresh( p->presence_spill );
+
+   array_erase( &p->presence_spill, array_begin(p->presence_spill),
+         array_end(p->presence_spill) );
+   p->presence_sys = -1;
 }
 
 
@@ -4073,6 +5618,20 @@ void space_reconstructPresences( void )
 {
    int i;
 
+   if (space_deferred) {
+      space_deferPresences = 1;
+      return;
+   }
+
+   /* Forget what the planets added. */
+   for (i=0; i<planet_nstack; i++) {
+      if (planet_stack[i].presence_spill != NULL)
+         array_erase( &planet_stack[i].presence_spill,
+               array_begin(planet_stack[i].presence_spill),
+               array_end(planet_stack[i].presence_spill) );
+      planet_stack[i].presence_sys = -1;
+   }
+
    /* Reset the presence in each system. */
    for (i=0; i<systems_nstack; i++) {
       if (systems_stack[i].presence)
@@ -4091,55 +5650,241 @@ void space_reconstructPresences( void )
       system_setFaction( &systems_stack[i] );
       systems_stack[i].ownerpresence = system_getPresence( &systems_stack[i], systems_stack[i].faction );
    }
+
+   /* Faction disks change. */
+   map_geomInvalidate();
+}
+
+
+/**
+ * @brief Defers rebuilding the universe when modifying it a lot.
+ *
+ * Jump and presence reconstruction and reloading the current system graphics
+ *  are done only once by space_deferEnd().
+ */
+void space_deferStart (void)
+{
+   space_deferred++;
+}
+
+
+/**
+ * @brief Does the universe rebuilds deferred since space_deferStart().
+ */
+void space_deferEnd (void)
+{
+   if (space_deferred <= 0) {
+      WARN("space_deferEnd called without space_deferStart.");
+      return;
+   }
+   space_deferred--;
+   if (space_deferred > 0)
+      return;
+
+   if (space_deferJumps)
+      systems_reconstructJumps();
+   if (space_deferPresences)
+      space_reconstructPresences();
+   if (space_deferGfx && (cur_system != NULL))
+      space_gfxLoad( cur_system );
+   space_deferJumps     = 0;
+   space_deferPresences = 0;
+   space_deferGfx       = 0;
+}
+
+
+/**
+ * @brief Builds the grid of the asteroid field subsets of a system.
+ *
+ *    @param sys System to build the grid of.
+ *    @return The grid or NULL if the system has no fields.
+ */
+static AsteroidGrid* asteroid_buildGrid( const StarSystem *sys )
+{
+   int i, k, x, y, n, pass, x0,y0, x1,y1;
+   Vector2d bmax;
+   const AsteroidSubset *sub;
+   AsteroidGrid *grid;
+
+   /* Bounds of all the subsets. */
+   n = 0;
+   grid = calloc( 1, sizeof(AsteroidGrid) );
+   for (i=0; i<sys->nasteroids; i++) {
+      for (k=0; k<sys->asteroids[i].nsubsets; k++) {
+         sub = &sys->asteroids[i].subsets[k];
+         if (sub->ncorners < 3)
+            continue;
+         if (n == 0) {
+            grid->bmin = sub->bmin;
+            bmax       = sub->bmax;
+         }
+         grid->bmin.x = MIN( grid->bmin.x, sub->bmin.x );
+         grid->bmin.y = MIN( grid->bmin.y, sub->bmin.y );
+         bmax.x       = MAX( bmax.x, sub->bmax.x );
+         bmax.y       = MAX( bmax.y, sub->bmax.y );
+         n++;
+      }
+   }
+   if (n == 0) {
+      free( grid );
+      return NULL;
+   }
+   grid->cell = MAX( ASTEROID_GRID_MIN, MAX( bmax.x - grid->bmin.x,
+            bmax.y - grid->bmin.y ) / ASTEROID_GRID_CELLS );
+   grid->nx   = (int)floor( (bmax.x - grid->bmin.x) / grid->cell ) + 1;
+   grid->ny   = (int)floor( (bmax.y - grid->bmin.y) / grid->cell ) + 1;
+   grid->start = calloc( grid->nx*grid->ny+1, sizeof(int) );
+
+   /* First count the candidates of each cell, then fill them in. */
+   for (pass=0; pass<2; pass++) {
+      if (pass == 1) {
+         for (i=0; i<grid->nx*grid->ny; i++)
+            grid->start[i+1] += grid->start[i];
+         grid->field  = malloc( sizeof(int) * MAX(grid->start[grid->nx*grid->ny],1) );
+         grid->subset = malloc( sizeof(int) * MAX(grid->start[grid->nx*grid->ny],1) );
+      }
+      for (i=0; i<sys->nasteroids; i++) {
+         for (k=0; k<sys->asteroids[i].nsubsets; k++) {
+            sub = &sys->asteroids[i].subsets[k];
+            if (sub->ncorners < 3)
+               continue;
+            x0 = (int)floor( (sub->bmin.x - grid->bmin.x) / grid->cell );
+            y0 = (int)floor( (sub->bmin.y - grid->bmin.y) / grid->cell );
+            x1 = (int)floor( (sub->bmax.x - grid->bmin.x) / grid->cell );
+            y1 = (int)floor( (sub->bmax.y - grid->bmin.y) / grid->cell );
+            for (y=y0; y<=y1; y++) {
+               for (x=x0; x<=x1; x++) {
+                  if (pass == 0) {
+                     grid->start[ y*grid->nx+x+1 ]++;
+                     continue;
+                  }
+                  /* start is used as the fill position, restored after. */
+                  n = grid->start[ y*grid->nx+x ]++;
+                  grid->field[n]  = i;
+                  grid->subset[n] = k;
+               }
+            }
+         }
+      }
+   }
+   for (i=grid->nx*grid->ny; i>0; i--)
+      grid->start[i] = grid->start[i-1];
+   grid->start[0] = 0;
+
+   return grid;
+}
+
+
+/**
+ * @brief Frees an asteroid grid.
+ */
+static void asteroid_freeGrid( AsteroidGrid *grid )
+{
+   if (grid == NULL)
+      return;
+   free( grid->start );
+   free( grid->field );
+   free( grid->subset );
+   free( grid );
 }
 
 
 /**
  * @brief See if the position is in an asteroid field.
  *
+ * Only the subsets listed in the cell of the position are tested.
+ *
  *    @param p pointer to the position.
  *    @return -1 If false; index of the field otherwise.
  */
 int space_isInField ( Vector2d *p )
 {
-   int i, j, k, isin, istotin;
-   AsteroidAnchor *a;
-   AsteroidSubset *sub;
-   double aera;
+   int i, x, y, c;
+   AsteroidGrid *grid;
+   const AsteroidSubset *sub;
 
-   istotin = -1;
-   for (i=0; i < cur_system->nasteroids; i++) {
-      a = &cur_system->asteroids[i];
-
-      for (k=0; k < a->nsubsets; k++) {
-         sub = &a->subsets[k];
-         isin = 1;
-         /* test every signed aera */
-         for (j=0; j < sub->ncorners-1; j++) {
-            aera = (sub->corners[j].x-p->x)*(sub->corners[j+1].y-p->y) 
-                 - (sub->corners[j+1].x-p->x)*(sub->corners[j].y-p->y);
-            if (sub->aera*aera <= 0) {
-               isin = 0;
-               break;
-            }
-         }
-         /* And the last one to loop */
-         if (sub->ncorners > 0) {
-            j = sub->ncorners-1;
-            aera = (sub->corners[j].x-p->x)*(sub->corners[0].y-p->y) 
-                 - (sub->corners[0].x-p->x)*(sub->corners[j].y-p->y);
-            if (sub->aera*aera <= 0)
-               isin = 0;
-         }
+   if (cur_system->nasteroids <= 0)
+      return -1;
+   if (cur_system->astgrid == NULL) {
+      cur_system->astgrid = asteroid_buildGrid( cur_system );
+      if (cur_system->astgrid == NULL)
+         return -1;
+   }
+   grid = cur_system->astgrid;
 
-         if (isin) {
-            istotin = i;
-            break;
-         }
-      }
+   x = (int)floor( (p->x - grid->bmin.x) / grid->cell );
+   y = (int)floor( (p->y - grid->bmin.y) / grid->cell );
+   if ((x < 0) || (x >= grid->nx) || (y < 0) || (y >= grid->ny))
+      return -1;
+
+   /* Candidates are sorted by field, the last field containing it wins. */
+   c = y*grid->nx + x;
+   for (i=grid->start[c+1]-1; i>=grid->start[c]; i--) {
+      sub = &cur_system->asteroids[ grid->field[i] ].subsets[ grid->subset[i] ];
+      if ((p->x < sub->bmin.x) || (p->x > sub->bmax.x) ||
+            (p->y < sub->bmin.y) || (p->y > sub->bmax.y))
+         continue;
+      if (asteroid_inSubset( sub, p ))
+         return grid->field[i];
    }
 
-   return istotin;
+   return -1;
+}
+
+
+/**
+ * @brief See if the position is in a convex subset of an asteroid field.
+ *
+ *    @param sub Subset to check.
+ *    @param p Position to check.
+ *    @return 1 if the position is in the subset.
+ */
+static int asteroid_inSubset( const AsteroidSubset *sub, const Vector2d *p )
+{
+   int j;
+   double aera;
+
+   /* test every signed aera */
+   for (j=0; j < sub->ncorners-1; j++) {
+      aera = (sub->corners[j].x-p->x)*(sub->corners[j+1].y-p->y) 
+           - (sub->corners[j+1].x-p->x)*(sub->corners[j].y-p->y);
+      if (sub->aera*aera <= 0)
+         return 0;
+   }
+   /* And the last one to loop */
+   if (sub->ncorners > 0) {
+      j = sub->ncorners-1;
+      aera = (sub->corners[j].x-p->x)*(sub->corners[0].y-p->y) 
+           - (sub->corners[0].x-p->x)*(sub->corners[j].y-p->y);
+      if (sub->aera*aera <= 0)
+         return 0;
+   }
+
+   return 1;
+}
+
+
+/**
+ * @brief See if the position is in a given asteroid field.
+ *
+ *    @param field Field to check.
+ *    @param p Position to check.
+ *    @return 1 if the position is in one of the convex subsets of the field.
+ */
+static int asteroid_inField( const AsteroidAnchor *field, const Vector2d *p )
+{
+   int k;
+
+   /* Quick rejection. */
+   if ((field->ncorners > 0) && ((p->x < field->bmin.x) || (p->x > field->bmax.x) ||
+         (p->y < field->bmin.y) || (p->y > field->bmax.y)))
+      return 0;
+
+   for (k=0; k < field->nsubsets; k++)
+      if (asteroid_inSubset( &field->subsets[k], p ))
+         return 1;
+
+   return 0;
 }
 
 
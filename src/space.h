@@ -52,6 +52,15 @@
 #define planet_isBlackMarket(p) planet_isFlag(p,PLANET_BLACKMARKET) /**< Checks if planet is a black market. */
 
 
+/**
+ * @brief Presence an asset added to a system.
+ */
+typedef struct PresenceSpill_ {
+   int sys; /**< ID of the system. */
+   double value; /**< Presence added to it. */
+} PresenceSpill;
+
+
 /**
  * @struct Planet
  *
@@ -71,6 +80,9 @@ typedef struct Planet_ {
    /* Asset details. */
    double presenceAmount; /**< The amount of presence this asset exerts. */
    int presenceRange; /**< The range of presence exertion of this asset. */
+   int presence_sys; /**< ID of the system its presence was added from, -1 if none. */
+   int presence_faction; /**< Faction its presence was added for. */
+   PresenceSpill *presence_spill; /**< Presence it added to each system (array.h). */
    int real; /**< If the asset is tangible or not. */
    double hide; /**< The ewarfare hide value for an asset. */
 
@@ -93,7 +105,8 @@ typedef struct Planet_ {
    tech_group_t *tech; /**< Planet tech. */
 
    /* Graphics. */
-   glTexture* gfx_space; /**< graphic in space */
+   glTexture* gfx_space; /**< graphic in space, may be gfx_lod while far away */
+   glTexture* gfx_lod; /**< Low detail copy of the graphic in space or NULL. */
    char *gfx_spaceName; /**< Name to load texture quickly with. */
    char *gfx_spacePath; /**< Name of the gfx_space for saving purposes. */
    char *gfx_exterior; /**< Don't actually load the texture */
@@ -133,6 +146,7 @@ typedef struct SystemPresence_ {
    double curUsed; /**< Presence currently used. */
    double timer; /**< Current faction timer. */
    int disabled; /**< Whether or not spawning is disabled for this presence. */
+   double depleted; /**< Fraction of value lost while off-screen, see spacesim.c. */
 } SystemPresence;
 
 
@@ -212,6 +226,8 @@ typedef struct AsteroidSubset_ {
    int ncorners; /**< Number of corners. */
    Vector2d pos; /**< Center. */
    double aera; /**< Subset's aera. */
+   Vector2d bmin; /**< Lower left corner of the bounding box. */
+   Vector2d bmax; /**< Upper right corner of the bounding box. */
 } AsteroidSubset;
 
 
@@ -230,9 +246,30 @@ typedef struct AsteroidAnchor_ {
    double aera; /**< Field's aera. */
    AsteroidSubset *subsets; /**< Convex subsets. */
    int nsubsets; /**< Number of convex subsets. */
+   Vector2d bmin; /**< Lower left corner of the bounding box. */
+   Vector2d bmax; /**< Upper right corner of the bounding box. */
+   double lazy; /**< Time not simulated while far from the player. */
+   int warm; /**< Asteroids were rolled ahead of entering the system and are unused. */
 } AsteroidAnchor;
 
 
+/**
+ * @brief Grid of the asteroid field subsets of a system.
+ *
+ * Each cell lists the subsets whose bounding box overlaps it, by field then
+ *  subset, so the fields a position is in are found in a single cell.
+ */
+typedef struct AsteroidGrid_ {
+   Vector2d bmin; /**< Lower left corner of the grid. */
+   double cell; /**< Size of a cell. */
+   int nx; /**< Number of cells on the x axis. */
+   int ny; /**< Number of cells on the y axis. */
+   int *start; /**< Start of the candidates of each cell, nx*ny+1 entries. */
+   int *field; /**< Field of each candidate. */
+   int *subset; /**< Subset of each candidate. */
+} AsteroidGrid;
+
+
 /**
  * @brief Represents a star system.
  *
@@ -264,6 +301,7 @@ struct StarSystem_ {
    /* Asteroids. */
    AsteroidAnchor *asteroids; /**< Asteroids fields in the system */
    int nasteroids; /**< number of asteroids fields */
+   AsteroidGrid *astgrid; /**< Grid of the field subsets, built when first needed. */
 
    /* Fleets. */
    Fleet** fleets; /**< fleets that can appear in the current system */
@@ -272,6 +310,7 @@ struct StarSystem_ {
 
    /* Calculated. */
    double *prices; /**< Handles the prices in the system. */
+   credits_t *comm_prices; /**< Price of each commodity, indexed like commodity_getAll(). */
 
    /* Presence. */
    SystemPresence *presence; /**< Pointer to an array of presences in this system. */
@@ -290,6 +329,39 @@ struct StarSystem_ {
 };
 
 
+/*
+ * System view flags.
+ */
+#define SYSVIEW_REAL       (1<<0) /**< Planet is real. */
+
+
+/**
+ * @brief Compact copy of the current system for the per frame loops.
+ *
+ * Built when the system loads and again when its planets, their factions or
+ *  its jumps change. It is indexed like the planets and jumps of the system.
+ *  What changes while in the system, like known flags or the graphics swapped
+ *  for their low detail copy, is still read from the planets and jumps.
+ */
+typedef struct SystemView_ {
+   const StarSystem *sys; /**< System the view is of. */
+
+   /* Planets. */
+   int nplanets; /**< Number of planets. */
+   double *px; /**< X position of each planet. */
+   double *py; /**< Y position of each planet. */
+   double *pr; /**< Half size of the graphic in space, 0 if there is none. */
+   unsigned int *pservices; /**< Services of each planet. */
+   int *pfaction; /**< Faction of each planet. */
+   unsigned int *pflags; /**< SYSVIEW_* flags of each planet. */
+
+   /* Jumps. */
+   int njumps; /**< Number of jump points. */
+   double *jx; /**< X position of each jump point. */
+   double *jy; /**< Y position of each jump point. */
+} SystemView;
+
+
 extern StarSystem *cur_system; /**< current star system */
 extern int space_spawn; /**< 1 if spawning is enabled. */
 
@@ -300,6 +372,7 @@ extern int space_spawn; /**< 1 if spawning is enabled. */
 void space_init( const char* sysname );
 int space_load (void);
 void space_exit (void);
+void space_namesChanged (void);
 
 /*
  * planet stuff
@@ -318,6 +391,7 @@ char **planet_searchFuzzyCase( const char* planetname, int *n );
 char* planet_getServiceName( int service );
 int planet_getService( char *name );
 credits_t planet_commodityPrice( const Planet *p, const Commodity *c );
+const credits_t* system_commodityPrices( const StarSystem *sys );
 /* Misc modification. */
 int planet_setFaction( Planet *p, int faction );
 /* Land related stuff. */
@@ -325,6 +399,7 @@ char planet_getColourChar( Planet *p );
 const glColour* planet_getColour( Planet *p );
 void planet_updateLand( Planet *p );
 int planet_setRadiusFromGFX(Planet* planet);
+void planet_gfxFree( Planet *planet );
 
 
 /*
@@ -362,7 +437,11 @@ void system_presenceCleanupAll( void );
 void system_addPresence( StarSystem *sys, int faction, double amount, int range );
 double system_getPresence( StarSystem *sys, int faction );
 void system_addAllPlanetsPresence( StarSystem *sys );
+void planet_addPresence( Planet *p, StarSystem *sys );
+void planet_rmPresence( Planet *p );
 void space_reconstructPresences( void );
+void space_deferStart (void);
+void space_deferEnd (void);
 void system_rmCurrentPresence( StarSystem *sys, int faction, double amount );
 
 /*
@@ -375,11 +454,14 @@ void space_update( const double dt );
  */
 void space_gfxLoad( StarSystem *sys );
 void space_gfxUnload( StarSystem *sys );
+void space_gfxPrefetch( StarSystem *sys );
+void space_gfxUpdate (void);
 
 /*
  * Getting stuff.
  */
 StarSystem* system_getAll( int *nsys );
+size_t space_memUsage( int *n );
 int system_exists( const char* sysname );
 const char *system_existsCase( const char* sysname );
 char **system_searchFuzzyCase( const char* sysname, int *n );
@@ -392,6 +474,7 @@ int space_sysReachableFromSys( StarSystem *target, StarSystem *sys );
 char** space_getFactionPlanet( int *nplanets, int *factions, int nfactions, int landable );
 char* space_getRndPlanet( int landable, unsigned int services,
       int (*filter)(Planet *p));
+const SystemView* space_getView (void);
 double system_getClosest( const StarSystem *sys, int *pnt, int *jp, double x, double y );
 double system_getClosestAng( const StarSystem *sys, int *pnt, int *jp, double x, double y, double ang );
 
@@ -0,0 +1,397 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file spacesim.c
+ *
+ * @brief Coarse simulation of the systems around the player.
+ *
+ * Only the player's system has real pilots. The systems a few jumps around
+ *  it instead track how depleted each faction presence is, which is advanced
+ *  in fixed ticks on a worker:
+ *
+ *  - Depletion recovers over time, as factions send in new ships.
+ *  - Presences fight the enemy presences of the same system, wearing each
+ *     other down in proportion to the strength of the other side.
+ *  - Traffic through the jumps evens out the depletion of the same faction
+ *     between neighbouring systems.
+ *
+ * Leaving a system records how much of its presence was still in use, and
+ *  entering one has the faction scripts create their pilots with only the
+ *  presence that is left, so fights the player walked away from or heard
+ *  of next door carry on being felt for a while.
+ */
+
+
+#include "spacesim.h"
+
+#include "naev.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "faction.h"
+#include "array.h"
+#include "threadpool.h"
+
+
+/* systems stack. */
+extern StarSystem *systems_stack; /**< Star system stack. */
+extern int systems_nstack; /**< Number of star systems. */
+
+
+#define SPACESIM_TICK         10. /**< Seconds between simulation ticks. */
+#define SPACESIM_MAXTICK      60. /**< Most seconds a single tick covers. */
+#define SPACESIM_RANGE        2 /**< Jumps from the player's system that are simulated. */
+#define SPACESIM_RECOVER      (1./600.) /**< Depletion recovered per second. */
+#define SPACESIM_ATTRITION    (1./300.) /**< Depletion per second against an overwhelming enemy. */
+#define SPACESIM_TRAFFIC      (1./120.) /**< Rate depletion evens out with neighbours. */
+#define SPACESIM_MAXDEPLETED  0.9 /**< Presence never drops below this. */
+
+
+/**
+ * @brief Presence as seen by the simulation.
+ */
+typedef struct SimPresence_ {
+   int sys; /**< Index of the system in systems_stack. */
+   int pres; /**< Index of the presence in the system. */
+   int faction; /**< Faction of the presence, to check it is still the same. */
+   int fixed; /**< Player's system, it is only read. */
+   double value; /**< Full value of the presence. */
+   double depleted; /**< Depletion at the start of the tick. */
+   double out; /**< Depletion at the end of the tick. */
+   int enemies; /**< First enemy in the links. */
+   int nenemies; /**< Number of enemies. */
+   int neighbours; /**< First neighbour in the links. */
+   int nneighbours; /**< Number of neighbours. */
+} SimPresence;
+
+
+/**
+ * @brief Tick handed over to the worker.
+ */
+typedef struct SimJob_ {
+   SimPresence *pres; /**< Presences being simulated (array.h). */
+   int *links; /**< Enemy and neighbour indices into pres (array.h). */
+   double dt; /**< Seconds the tick covers. */
+} SimJob;
+
+
+static SimJob spacesim_job; /**< Tick being simulated. */
+static SDL_mutex *spacesim_lock = NULL; /**< Protects spacesim_done. */
+static int spacesim_busy      = 0; /**< Whether the worker has a tick. */
+static int spacesim_done      = 0; /**< Whether the worker finished the tick. */
+static double spacesim_timer  = 0.; /**< Seconds since the last tick. */
+static StarSystem *spacesim_cur = NULL; /**< System the player is in. */
+static int *spacesim_first    = NULL; /**< First presence of each system, -1 if not simulated. */
+static int *spacesim_queue    = NULL; /**< Systems by distance, for the search. */
+
+
+/*
+ * Prototypes.
+ */
+static void spacesim_build( double dt );
+static int spacesim_tick( void *data );
+
+
+/**
+ * @brief Starts tracking the system the player is entering.
+ *
+ *    @param sys System being entered.
+ */
+void spacesim_enter( StarSystem *sys )
+{
+   spacesim_cur = sys;
+}
+
+
+/**
+ * @brief Records how depleted the system the player is leaving is.
+ *
+ * Must be called before its pilots are cleared.
+ */
+void spacesim_leave (void)
+{
+   int i;
+   SystemPresence *p;
+
+   if (spacesim_cur == NULL)
+      return;
+
+   spacesim_sync( 1 );
+   for (i=0; i<spacesim_cur->npresence; i++) {
+      p = &spacesim_cur->presence[i];
+      if (p->value <= 0.)
+         continue;
+      p->depleted = CLAMP( 0., SPACESIM_MAXDEPLETED, 1. - p->curUsed / p->value );
+   }
+   spacesim_cur = NULL;
+}
+
+
+/**
+ * @brief Gets the presence a faction has left in a system.
+ *
+ *    @param p Presence to get.
+ *    @return Presence value that wasn't depleted.
+ */
+double spacesim_presence( const SystemPresence *p )
+{
+   return p->value * (1. - p->depleted);
+}
+
+
+/**
+ * @brief Advances the simulation.
+ *
+ *    @param dt Current delta tick.
+ */
+void spacesim_update( double dt )
+{
+   spacesim_sync( 0 );
+
+   spacesim_timer += dt;
+   if ((spacesim_timer < SPACESIM_TICK) || spacesim_busy || (spacesim_cur == NULL))
+      return;
+
+   /* Long pauses don't make traffic overshoot. */
+   spacesim_build( MIN( spacesim_timer, SPACESIM_MAXTICK ) );
+   spacesim_timer = 0.;
+   if (array_size( spacesim_job.pres ) == 0)
+      return;
+
+   if (spacesim_lock == NULL)
+      spacesim_lock = SDL_CreateMutex();
+   spacesim_busy = 1;
+   spacesim_done = 0;
+   if (threadpool_newJob( spacesim_tick, &spacesim_job ))
+      spacesim_tick( &spacesim_job ); /* No threadpool, run right away. */
+}
+
+
+/**
+ * @brief Copies back the results of the last tick.
+ *
+ *    @param wait Whether to block until the tick is over.
+ */
+void spacesim_sync( int wait )
+{
+   int i, done;
+   SimPresence *sp;
+   StarSystem *sys;
+
+   while (spacesim_busy) {
+      SDL_LockMutex( spacesim_lock );
+      done = spacesim_done;
+      SDL_UnlockMutex( spacesim_lock );
+
+      if (!done) {
+         if (!wait)
+            return;
+         SDL_Delay( 1 );
+         continue;
+      }
+
+      for (i=0; i<array_size(spacesim_job.pres); i++) {
+         sp = &spacesim_job.pres[i];
+         if (sp->fixed)
+            continue;
+         /* Presences may have been changed by unidiffs in the meantime. */
+         sys = &systems_stack[ sp->sys ];
+         if ((sp->pres >= sys->npresence) ||
+               (sys->presence[ sp->pres ].faction != sp->faction))
+            continue;
+         sys->presence[ sp->pres ].depleted = sp->out;
+      }
+      spacesim_busy = 0;
+   }
+}
+
+
+/**
+ * @brief Restores all presences, for a new game.
+ */
+void spacesim_clear (void)
+{
+   int i, j;
+
+   spacesim_sync( 1 );
+   for (i=0; i<systems_nstack; i++)
+      for (j=0; j<systems_stack[i].npresence; j++)
+         systems_stack[i].presence[j].depleted = 0.;
+   spacesim_cur   = NULL;
+   spacesim_timer = 0.;
+}
+
+
+/**
+ * @brief Stops the simulation and frees its memory.
+ */
+void spacesim_exit (void)
+{
+   spacesim_sync( 1 );
+
+   if (spacesim_job.pres != NULL)
+      array_free( spacesim_job.pres );
+   spacesim_job.pres = NULL;
+   if (spacesim_job.links != NULL)
+      array_free( spacesim_job.links );
+   spacesim_job.links = NULL;
+   free( spacesim_first );
+   spacesim_first = NULL;
+   free( spacesim_queue );
+   spacesim_queue = NULL;
+   if (spacesim_lock != NULL)
+      SDL_DestroyMutex( spacesim_lock );
+   spacesim_lock = NULL;
+}
+
+
+/**
+ * @brief Takes a copy of the systems around the player for the worker.
+ *
+ *    @param dt Seconds the tick covers.
+ */
+static void spacesim_build( double dt )
+{
+   int i, j, k, l, n, d, head, end, first;
+   StarSystem *sys, *target;
+   SimPresence *sp;
+
+   if (spacesim_job.pres == NULL) {
+      spacesim_job.pres  = array_create( SimPresence );
+      spacesim_job.links = array_create( int );
+   }
+   /* The editor can add systems. */
+   spacesim_first = realloc( spacesim_first, systems_nstack * sizeof(int) );
+   spacesim_queue = realloc( spacesim_queue, systems_nstack * sizeof(int) );
+   array_resize( &spacesim_job.pres, 0 );
+   array_resize( &spacesim_job.links, 0 );
+   spacesim_job.dt = dt;
+
+   /* Systems in range, closest first. */
+   for (i=0; i<systems_nstack; i++)
+      spacesim_first[i] = -1;
+   n = 0;
+   spacesim_queue[n++] = spacesim_cur - systems_stack;
+   spacesim_first[ spacesim_queue[0] ] = 0;
+   head = 0;
+   for (d=0; d<SPACESIM_RANGE; d++) {
+      end = n;
+      for (; head<end; head++) {
+         sys = &systems_stack[ spacesim_queue[head] ];
+         for (j=0; j<sys->njumps; j++) {
+            target = sys->jumps[j].target;
+            if ((target == NULL) || (spacesim_first[ target - systems_stack ] >= 0))
+               continue;
+            spacesim_first[ target - systems_stack ] = 0;
+            spacesim_queue[n++] = target - systems_stack;
+         }
+      }
+   }
+
+   /* Copy the presences. */
+   for (i=0; i<n; i++) {
+      sys = &systems_stack[ spacesim_queue[i] ];
+      spacesim_first[ spacesim_queue[i] ] = array_size( spacesim_job.pres );
+      for (j=0; j<sys->npresence; j++) {
+         sp = &array_grow( &spacesim_job.pres );
+         memset( sp, 0, sizeof(SimPresence) );
+         sp->sys     = spacesim_queue[i];
+         sp->pres    = j;
+         sp->faction = sys->presence[j].faction;
+         sp->fixed   = (sys == spacesim_cur);
+         sp->value   = sys->presence[j].value;
+         if (sp->fixed && (sp->value > 0.))
+            sp->depleted = CLAMP( 0., SPACESIM_MAXDEPLETED,
+                  1. - sys->presence[j].curUsed / sp->value );
+         else
+            sp->depleted = sys->presence[j].depleted;
+         sp->out     = sp->depleted;
+      }
+   }
+
+   /* Link enemies and neighbours, faction standings stay on this thread. */
+   for (i=0; i<n; i++) {
+      sys   = &systems_stack[ spacesim_queue[i] ];
+      first = spacesim_first[ spacesim_queue[i] ];
+      for (j=0; j<sys->npresence; j++) {
+         sp = &spacesim_job.pres[ first+j ];
+
+         sp->enemies = array_size( spacesim_job.links );
+         for (k=0; k<sys->npresence; k++)
+            if ((k != j) && areEnemies( sp->faction, sys->presence[k].faction ))
+               array_push_back( &spacesim_job.links, first+k );
+         sp->nenemies = array_size( spacesim_job.links ) - sp->enemies;
+
+         sp->neighbours = array_size( spacesim_job.links );
+         for (k=0; k<sys->njumps; k++) {
+            target = sys->jumps[k].target;
+            if ((target == NULL) || (spacesim_first[ target - systems_stack ] < 0))
+               continue;
+            for (l=0; l<target->npresence; l++) {
+               if (target->presence[l].faction != sp->faction)
+                  continue;
+               array_push_back( &spacesim_job.links,
+                     spacesim_first[ target - systems_stack ] + l );
+               break;
+            }
+         }
+         sp->nneighbours = array_size( spacesim_job.links ) - sp->neighbours;
+      }
+   }
+}
+
+
+/**
+ * @brief Runs a tick of the simulation, on the worker.
+ *
+ *    @param data Tick to run.
+ *    @return 0 always.
+ */
+static int spacesim_tick( void *data )
+{
+   SimJob *job;
+   SimPresence *sp, *other;
+   int i, k;
+   double d, own, foe, mean;
+
+   job = (SimJob*) data;
+   for (i=0; i<array_size(job->pres); i++) {
+      sp = &job->pres[i];
+      if (sp->fixed || (sp->value <= 0.))
+         continue;
+      d = sp->depleted;
+
+      /* Recovery. */
+      d -= SPACESIM_RECOVER * job->dt;
+
+      /* Conflict. */
+      own = sp->value * (1. - sp->depleted);
+      foe = 0.;
+      for (k=0; k<sp->nenemies; k++) {
+         other = &job->pres[ job->links[ sp->enemies+k ] ];
+         foe  += other->value * (1. - other->depleted);
+      }
+      if (foe > 0.)
+         d += SPACESIM_ATTRITION * job->dt * foe / (own + foe);
+
+      /* Traffic. */
+      if (sp->nneighbours > 0) {
+         mean = 0.;
+         for (k=0; k<sp->nneighbours; k++)
+            mean += job->pres[ job->links[ sp->neighbours+k ] ].depleted;
+         mean /= sp->nneighbours;
+         d += SPACESIM_TRAFFIC * job->dt * (mean - sp->depleted);
+      }
+
+      sp->out = CLAMP( 0., SPACESIM_MAXDEPLETED, d );
+   }
+
+   SDL_LockMutex( spacesim_lock );
+   spacesim_done = 1;
+   SDL_UnlockMutex( spacesim_lock );
+   return 0;
+}
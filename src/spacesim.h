@@ -0,0 +1,25 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef SPACESIM_H
+#  define SPACESIM_H
+
+
+#include "space.h"
+
+
+/* Player's system. */
+void spacesim_enter( StarSystem *sys );
+void spacesim_leave (void);
+double spacesim_presence( const SystemPresence *p );
+
+/* Simulation. */
+void spacesim_update( double dt );
+void spacesim_sync( int wait );
+void spacesim_clear (void);
+void spacesim_exit (void);
+
+
+#endif /* SPACESIM_H */
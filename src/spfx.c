@@ -30,6 +30,9 @@
 #include "nxml.h"
 #include "debris.h"
 #include "perlin.h"
+#include "camera.h"
+#include "gui.h"
+#include "nhash.h"
 
 
 #define SPFX_XML_ID     "spfxs" /**< XML Document tag. */
@@ -86,31 +89,88 @@ typedef struct SPFX_Base_ {
 
 static SPFX_Base *spfx_effects = NULL; /**< Total special effects. */
 static int spfx_neffects = 0; /**< Total number of special effects. */
+static NameHash spfx_hash; /**< Special effect name to index. */
 
 
 /**
  * @struct SPFX
  *
  * @brief An actual in-game active special effect.
+ *
+ * Effects don't change once spawned, where they are and the frame they show
+ *  follows from the time they were spawned at.
  */
 typedef struct SPFX_ {
-   Vector2d pos; /**< Current position. */
-   Vector2d vel; /**< Current velocity. */
+   GLfloat px; /**< X position when spawned. */
+   GLfloat py; /**< Y position when spawned. */
+   GLfloat vx; /**< X velocity. */
+   GLfloat vy; /**< Y velocity. */
+   GLfloat t0; /**< Time it was spawned at. */
+   GLfloat life; /**< Time it lives for. */
+} SPFX;
 
-   int lastframe; /**< Needed when paused */
-   int effect; /**< The real effect */
 
-   double timer; /**< Time left */
-} SPFX;
+#define SPFX_VERTEX_SIZE   8 /**< Floats per vertex: position, velocity, corner, spawn time and life. */
+#define SPFX_QUAD_SIZE     (4*SPFX_VERTEX_SIZE) /**< Floats per effect. */
+
 
+/**
+ * @struct SPFX_Ring
+ *
+ * @brief Ring buffer with the effects of a type on a layer, oldest first.
+ *
+ * Effects are only added at the end and removed from the start once dead,
+ *  those dying before the oldest are skipped until it's their turn.
+ */
+typedef struct SPFX_Ring_ {
+   SPFX *spfx; /**< Effects. */
+   GLfloat *vertex; /**< Quads of the effects for the program. */
+   gl_vbo *vbo; /**< Uploaded quads. */
+   int head; /**< Position of the oldest effect. */
+   int n; /**< Effects in the ring, including dead ones. */
+   int m; /**< Memory allocated. */
+   int nupload; /**< Newest effects not uploaded yet. */
+   int vbom; /**< Effects the VBO has room for, 0 if it has to be reuploaded. */
+} SPFX_Ring;
 
-/* front stack is for effects on player, back is for the rest */
-static SPFX *spfx_stack_front = NULL; /**< Frontal special effect layer. */
-static int spfx_nstack_front = 0; /**< Number of special effects in front. */
-static int spfx_mstack_front = 0; /**< Memory allocated for frontal special effects. */
-static SPFX *spfx_stack_back = NULL; /**< Back special effect layer. */
-static int spfx_nstack_back = 0; /**< Number of special effects in back. */
-static int spfx_mstack_back = 0; /**< Memory allocated for special effects in back. */
+
+/* front layer is for effects on player, back is for the rest */
+static SPFX_Ring *spfx_layers[2] = { NULL, NULL }; /**< Rings of each effect per layer. */
+static double spfx_time = 0.; /**< Time the effects are animated with. */
+
+
+/*
+ * Program animating and moving the effects.
+ */
+static GLuint spfx_program       = 0; /**< Effect program, 0 if unavailable. */
+static int spfx_programTried     = 0; /**< Whether creating the program was attempted. */
+static GLint spfx_uTime          = -1; /**< Current time and animation length. */
+static GLint spfx_uSize          = -1; /**< Size of a sprite. */
+static GLint spfx_uSheet         = -1; /**< Sprites per row and column. */
+static GLint spfx_uFrame         = -1; /**< Size of a sprite in texture coordinates. */
+static GLint spfx_uOrigin        = -1; /**< Texture origin. */
+static const char spfx_vertSrc[] =
+   "uniform vec2 time;\n"
+   "uniform vec2 size;\n"
+   "uniform vec2 sheet;\n"
+   "uniform vec2 frame;\n"
+   "uniform vec2 origin;\n"
+   "void main(void) {\n"
+   "   float t     = time.x - gl_MultiTexCoord0.z;\n"
+   "   float timer = gl_MultiTexCoord0.w - t;\n"
+   "   if (timer < 0.) {\n"
+   "      gl_Position = vec4( 2., 2., 2., 1. );\n"
+   "      return;\n"
+   "   }\n"
+   "   float f  = floor( sheet.x * sheet.y * min( 1. - mod( timer, time.y ) / time.y, 1. ) );\n"
+   "   float fx = mod( f, sheet.x );\n"
+   "   float fy = floor( f / sheet.x );\n"
+   "   vec2 c   = gl_MultiTexCoord0.xy + 0.5;\n"
+   "   vec2 p   = gl_Vertex.xy + gl_Vertex.zw * t + gl_MultiTexCoord0.xy * size;\n"
+   "   gl_TexCoord[0] = vec4( origin + frame * vec2( fx + c.x, sheet.y - fy - 1. + c.y ), 0., 1. );\n"
+   "   gl_Position    = gl_ModelViewProjectionMatrix * vec4( p, 0., 1. );\n"
+   "   gl_FrontColor  = vec4( 1. );\n"
+   "}\n"; /**< Movement and sprite animation of the effects. */
 
 
 /*
@@ -119,8 +179,12 @@ static int spfx_mstack_back = 0; /**< Memory allocated for special effects in ba
 /* General. */
 static int spfx_base_parse( SPFX_Base *temp, const xmlNodePtr parent );
 static void spfx_base_free( SPFX_Base *effect );
-static void spfx_destroy( SPFX *layer, int *nlayer, int spfx );
-static void spfx_update_layer( SPFX *layer, int *nlayer, const double dt );
+static SPFX_Ring* spfx_getLayer( int layer );
+static void spfx_ringFree( SPFX_Ring *ring );
+static int spfx_ringPush( SPFX_Ring *ring );
+static void spfx_ringUpload( SPFX_Ring *ring );
+static void spfx_ringRender( SPFX_Ring *ring, const SPFX_Base *effect );
+static void spfx_initProgram (void);
 /* Haptic. */
 static int spfx_hapticInit (void);
 static void spfx_hapticRumble( double mod );
@@ -200,11 +264,7 @@ static void spfx_base_free( SPFX_Base *effect )
  */
 int spfx_get( char* name )
 {
-   int i;
-   for (i=0; i<spfx_neffects; i++)
-      if (strcmp(spfx_effects[i].name, name)==0)
-         return i;
-   return -1;
+   return nhash_get( &spfx_hash, name );
 }
 
 
@@ -217,7 +277,7 @@ int spfx_get( char* name )
  */
 int spfx_load (void)
 {
-   int mem;
+   int i, mem;
    uint32_t bufsize;
    char *buf;
    xmlNodePtr node;
@@ -263,6 +323,15 @@ int spfx_load (void)
    /* Shrink back to minimum - shouldn't change ever. */
    spfx_effects = realloc(spfx_effects, sizeof(SPFX_Base) * spfx_neffects);
 
+   /* Index by name. */
+   nhash_init( &spfx_hash );
+   for (i=0; i<spfx_neffects; i++)
+      nhash_set( &spfx_hash, spfx_effects[i].name, i );
+
+   /* One ring per effect and layer. */
+   spfx_layers[SPFX_LAYER_FRONT] = calloc( MAX(spfx_neffects,1), sizeof(SPFX_Ring) );
+   spfx_layers[SPFX_LAYER_BACK]  = calloc( MAX(spfx_neffects,1), sizeof(SPFX_Ring) );
+
    /* Clean up. */
    xmlFreeDoc(doc);
    free(buf);
@@ -283,19 +352,26 @@ int spfx_load (void)
  */
 void spfx_free (void)
 {
-   int i;
+   int i, j;
 
    /* Clean up the debris. */
    debris_cleanup();
 
-   /* get rid of all the particles and free the stacks */
+   /* get rid of all the particles and free the rings */
    spfx_clear();
-   if (spfx_stack_front) free(spfx_stack_front);
-   spfx_stack_front = NULL;
-   spfx_mstack_front = 0;
-   if (spfx_stack_back) free(spfx_stack_back);
-   spfx_stack_back = NULL;
-   spfx_mstack_back = 0;
+   for (i=0; i<2; i++) {
+      if (spfx_layers[i] == NULL)
+         continue;
+      for (j=0; j<spfx_neffects; j++)
+         spfx_ringFree( &spfx_layers[i][j] );
+      free( spfx_layers[i] );
+      spfx_layers[i] = NULL;
+   }
+
+   /* Free the program. */
+   gl_programFree( spfx_program );
+   spfx_program      = 0;
+   spfx_programTried = 0;
 
    /* now clear the effects */
    for (i=0; i<spfx_neffects; i++)
@@ -303,6 +379,7 @@ void spfx_free (void)
    free(spfx_effects);
    spfx_effects = NULL;
    spfx_neffects = 0;
+   nhash_free( &spfx_hash );
 
    /* Free the noise. */
    noise_delete( shake_noise );
@@ -324,10 +401,13 @@ void spfx_add( int effect,
       const double vx, const double vy,
       const int layer )
 {
+   SPFX_Ring *ring;
    SPFX *cur_spfx;
+   GLfloat *v;
    double ttl, anim;
+   int i;
 
-   if ((effect < 0) || (effect > spfx_neffects)) {
+   if ((effect < 0) || (effect >= spfx_neffects)) {
       WARN("Trying to add spfx with invalid effect!");
       return;
    }
@@ -335,119 +415,197 @@ void spfx_add( int effect,
    /*
     * Select the Layer
     */
-   if (layer == SPFX_LAYER_FRONT) { /* front layer */
-      if (spfx_mstack_front < spfx_nstack_front+1) { /* need more memory */
-         if (spfx_mstack_front == 0)
-            spfx_mstack_front = SPFX_CHUNK_MIN;
-         else
-            spfx_mstack_front += MIN( spfx_mstack_front, SPFX_CHUNK_MAX );
-         spfx_stack_front = realloc( spfx_stack_front, spfx_mstack_front*sizeof(SPFX) );
-      }
-      cur_spfx = &spfx_stack_front[spfx_nstack_front];
-      spfx_nstack_front++;
-   }
-   else if (layer == SPFX_LAYER_BACK) { /* back layer */
-      if (spfx_mstack_back < spfx_nstack_back+1) { /* need more memory */
-         if (spfx_mstack_back == 0)
-            spfx_mstack_back = SPFX_CHUNK_MIN;
-         else
-            spfx_mstack_back += MIN( spfx_mstack_back, SPFX_CHUNK_MAX );
-         spfx_stack_back = realloc( spfx_stack_back, spfx_mstack_back*sizeof(SPFX) );
-      }
-      cur_spfx = &spfx_stack_back[spfx_nstack_back];
-      spfx_nstack_back++;
-   }
-   else {
+   ring = spfx_getLayer( layer );
+   if (ring == NULL) {
       WARN("Invalid SPFX layer.");
       return;
    }
+   ring     = &ring[effect];
+   i        = spfx_ringPush( ring );
+   cur_spfx = &ring->spfx[i];
 
    /* The actual adding of the spfx */
-   cur_spfx->effect = effect;
-   vect_csetmin( &cur_spfx->pos, px, py );
-   vect_csetmin( &cur_spfx->vel, vx, vy );
+   cur_spfx->px = px;
+   cur_spfx->py = py;
+   cur_spfx->vx = vx;
+   cur_spfx->vy = vy;
+   cur_spfx->t0 = spfx_time;
    /* Timer magic if ttl != anim */
    ttl = spfx_effects[effect].ttl;
    anim = spfx_effects[effect].anim;
    if (ttl != anim)
-      cur_spfx->timer = ttl + RNGF()*anim;
+      cur_spfx->life = ttl + RNGF()*anim;
    else
-      cur_spfx->timer = ttl;
+      cur_spfx->life = ttl;
+
+   /* Quad for the program, corners are relative to the sprite size. */
+   v = &ring->vertex[ i*SPFX_QUAD_SIZE ];
+   for (i=0; i<4; i++) {
+      v[0] = cur_spfx->px;
+      v[1] = cur_spfx->py;
+      v[2] = cur_spfx->vx;
+      v[3] = cur_spfx->vy;
+      v[4] = ((i==1) || (i==2)) ? .5 : -.5;
+      v[5] = (i>=2) ? .5 : -.5;
+      v[6] = cur_spfx->t0;
+      v[7] = cur_spfx->life;
+      v   += SPFX_VERTEX_SIZE;
+   }
 }
 
 
 /**
- * @brief Clears all the currently running effects.
+ * @brief Gets how many of an effect are in a layer.
+ *
+ * Effects that died but weren't dropped from the ring yet are counted too.
+ *
+ *    @param effect Effect to count.
+ *    @param layer Layer to count in.
+ *    @return Amount of the effect in the layer.
  */
-void spfx_clear (void)
+int spfx_count( int effect, int layer )
 {
-   int i;
+   SPFX_Ring *ring;
 
-   /* Clear front layer */
-   for (i=spfx_nstack_front-1; i>=0; i--)
-      spfx_destroy( spfx_stack_front, &spfx_nstack_front, i );
+   if ((effect < 0) || (effect >= spfx_neffects))
+      return 0;
+   ring = spfx_getLayer( layer );
+   if (ring == NULL)
+      return 0;
+   return ring[effect].n;
+}
 
-   /* Clear back layer */
-   for (i=spfx_nstack_back-1; i>=0; i--)
-      spfx_destroy( spfx_stack_back, &spfx_nstack_back, i );
 
-   /* Clear rumble */
-   shake_set = 0;
-   shake_off = 1;
-   shake_force_mod = 0.;
-   vectnull( &shake_pos );
-   vectnull( &shake_vel );
+/**
+ * @brief Gets the rings of a layer.
+ *
+ *    @param layer Layer to get.
+ *    @return The rings of each effect on the layer or NULL if invalid.
+ */
+static SPFX_Ring* spfx_getLayer( int layer )
+{
+   if ((layer != SPFX_LAYER_FRONT) && (layer != SPFX_LAYER_BACK))
+      return NULL;
+   return spfx_layers[layer];
 }
 
+
 /**
- * @brief Destroys an active spfx.
- *
- *    @param layer Layer the spfx is on.
- *    @param nlayer Pointer to the number of elements in the layer.
- *    @param spfx Position of the spfx in the stack.
+ * @brief Frees the memory of a ring.
  */
-static void spfx_destroy( SPFX *layer, int *nlayer, int spfx )
+static void spfx_ringFree( SPFX_Ring *ring )
 {
-   (*nlayer)--;
-   memmove( &layer[spfx], &layer[spfx+1], (*nlayer-spfx)*sizeof(SPFX) );
+   free( ring->spfx );
+   free( ring->vertex );
+   if (ring->vbo != NULL)
+      gl_vboDestroy( ring->vbo );
+   memset( ring, 0, sizeof(SPFX_Ring) );
 }
 
 
 /**
- * @brief Updates all the spfx.
+ * @brief Makes room for a new effect at the end of a ring.
  *
- *    @param dt Current delta tick.
+ *    @param ring Ring to add to.
+ *    @return Position of the new effect.
  */
-void spfx_update( const double dt )
+static int spfx_ringPush( SPFX_Ring *ring )
 {
-   spfx_update_layer( spfx_stack_front, &spfx_nstack_front, dt );
-   spfx_update_layer( spfx_stack_back, &spfx_nstack_back, dt );
+   SPFX *spfx;
+   GLfloat *vertex;
+   int i, m, k;
+
+   /* Grow, unwrapping it. */
+   if (ring->n >= ring->m) {
+      if (ring->m == 0)
+         m = SPFX_CHUNK_MIN;
+      else
+         m = ring->m + MIN( ring->m, SPFX_CHUNK_MAX );
+      spfx   = malloc( m * sizeof(SPFX) );
+      vertex = malloc( m * SPFX_QUAD_SIZE * sizeof(GLfloat) );
+      for (i=0; i<ring->n; i++) {
+         k = (ring->head + i) % ring->m;
+         spfx[i] = ring->spfx[k];
+         memcpy( &vertex[ i*SPFX_QUAD_SIZE ], &ring->vertex[ k*SPFX_QUAD_SIZE ],
+               SPFX_QUAD_SIZE * sizeof(GLfloat) );
+      }
+      free( ring->spfx );
+      free( ring->vertex );
+      ring->spfx   = spfx;
+      ring->vertex = vertex;
+      ring->m      = m;
+      ring->head   = 0;
+      ring->vbom   = 0;
+   }
+
+   i = (ring->head + ring->n) % ring->m;
+   ring->n++;
+   ring->nupload = MIN( ring->nupload+1, ring->n );
+   return i;
 }
 
 
 /**
- * @brief Updates an individual spfx.
+ * @brief Clears all the currently running effects.
+ */
+void spfx_clear (void)
+{
+   int i, j;
+   SPFX_Ring *ring;
+
+   /* Clear the layers */
+   for (i=0; i<2; i++) {
+      if (spfx_layers[i] == NULL)
+         continue;
+      for (j=0; j<spfx_neffects; j++) {
+         ring = &spfx_layers[i][j];
+         ring->head    = 0;
+         ring->n       = 0;
+         ring->nupload = 0;
+      }
+   }
+   spfx_time = 0.;
+
+   /* Clear rumble */
+   shake_set = 0;
+   shake_off = 1;
+   shake_force_mod = 0.;
+   vectnull( &shake_pos );
+   vectnull( &shake_vel );
+}
+
+
+/**
+ * @brief Updates all the spfx.
+ *
+ * Effects move and animate on their own, only the dead ones get dropped.
  *
- *    @param layer Layer the spfx is on.
- *    @param nlayer Pointer to the associated nlayer.
  *    @param dt Current delta tick.
  */
-static void spfx_update_layer( SPFX *layer, int *nlayer, const double dt )
+void spfx_update( const double dt )
 {
-   int i;
+   int i, j;
+   SPFX_Ring *ring;
+   SPFX *s;
 
-   for (i=0; i<*nlayer; i++) {
-      layer[i].timer -= dt; /* less time to live */
+   spfx_time += dt;
 
-      /* time to die! */
-      if (layer[i].timer < 0.) {
-         spfx_destroy( layer, nlayer, i );
-         i--;
+   for (i=0; i<2; i++) {
+      if (spfx_layers[i] == NULL)
          continue;
+      for (j=0; j<spfx_neffects; j++) {
+         ring = &spfx_layers[i][j];
+
+         /* time to die! */
+         while (ring->n > 0) {
+            s = &ring->spfx[ ring->head ];
+            if (spfx_time - s->t0 <= s->life)
+               break;
+            ring->head = (ring->head + 1) % ring->m;
+            ring->n--;
+         }
+         ring->nupload = MIN( ring->nupload, ring->n );
       }
-
-      /* actually update it */
-      vect_cadd( &layer[i].pos, dt*VX(layer[i].vel), dt*VY(layer[i].vel) );
    }
 }
 
@@ -706,49 +864,155 @@ void spfx_cinematic (void)
  */
 void spfx_render( const int layer )
 {
-   SPFX *spfx_stack;
-   int i, spfx_nstack;
-   SPFX_Base *effect;
-   int sx, sy;
-   double time;
-
+   SPFX_Ring *rings;
+   double x, y, z, gx, gy;
+   int i;
 
    /* get the appropriate layer */
-   switch (layer) {
-      case SPFX_LAYER_FRONT:
-         spfx_stack = spfx_stack_front;
-         spfx_nstack = spfx_nstack_front;
-         break;
-
-      case SPFX_LAYER_BACK:
-         spfx_stack = spfx_stack_back;
-         spfx_nstack = spfx_nstack_back;
-         break;
-
-      default:
-         WARN("Rendering invalid SPFX layer.");
-         return;
+   rings = spfx_getLayer( layer );
+   if (rings == NULL) {
+      WARN("Rendering invalid SPFX layer.");
+      return;
    }
 
+   spfx_initProgram();
+
+   /* The program works in game coordinates. */
+   if (spfx_program != 0) {
+      cam_getPos( &x, &y );
+      z = cam_getZoom();
+      gui_getOffset( &gx, &gy );
+      gl_matrixPush();
+         gl_matrixTranslate( gx + SCREEN_W/2., gy + SCREEN_H/2. );
+         gl_matrixScale( z, z );
+         gl_matrixTranslate( -x, -y );
+      nglUseProgram( spfx_program );
+   }
+   else
+      gl_batchBegin();
+
    /* Now render the layer */
-   for (i=spfx_nstack-1; i>=0; i--) {
-      effect = &spfx_effects[ spfx_stack[i].effect ];
+   for (i=0; i<spfx_neffects; i++)
+      if (rings[i].n > 0)
+         spfx_ringRender( &rings[i], &spfx_effects[i] );
 
-      /* Simplifies */
-      sx = (int)effect->gfx->sx;
-      sy = (int)effect->gfx->sy;
+   if (spfx_program != 0) {
+      nglUseProgram( 0 );
+      gl_matrixPop();
+   }
+   else
+      gl_batchEnd();
+   gl_checkErr();
+}
 
-      if (!paused) { /* don't calculate frame if paused */
-         time = 1. - fmod(spfx_stack[i].timer,effect->anim) / effect->anim;
-         spfx_stack[i].lastframe = sx * sy * MIN(time, 1.);
-      }
 
-      /* Renders */
-      gl_blitSprite( effect->gfx,
-            VX(spfx_stack[i].pos), VY(spfx_stack[i].pos),
-            spfx_stack[i].lastframe % sx,
-            spfx_stack[i].lastframe / sx,
-            NULL );
+/**
+ * @brief Builds the effect program the first time it's needed.
+ */
+static void spfx_initProgram (void)
+{
+   if (spfx_programTried)
+      return;
+   spfx_programTried = 1;
+
+   spfx_program = gl_programCreate( "spfx", spfx_vertSrc, NULL );
+   if (spfx_program == 0)
+      return;
+   spfx_uTime   = nglGetUniformLocation( spfx_program, "time" );
+   spfx_uSize   = nglGetUniformLocation( spfx_program, "size" );
+   spfx_uSheet  = nglGetUniformLocation( spfx_program, "sheet" );
+   spfx_uFrame  = nglGetUniformLocation( spfx_program, "frame" );
+   spfx_uOrigin = nglGetUniformLocation( spfx_program, "origin" );
+}
+
+
+/**
+ * @brief Uploads the effects of a ring that the VBO doesn't have yet.
+ */
+static void spfx_ringUpload( SPFX_Ring *ring )
+{
+   int i, k, n;
+
+   /* Reupload everything if it grew. */
+   if (ring->vbom != ring->m) {
+      if (ring->vbo == NULL)
+         ring->vbo = gl_vboCreateStream( 0, NULL );
+      gl_vboData( ring->vbo, ring->m * SPFX_QUAD_SIZE * sizeof(GLfloat), NULL );
+      ring->vbom    = ring->m;
+      ring->nupload = ring->n;
+   }
+
+   /* New effects are at the end, in at most two pieces. */
+   while (ring->nupload > 0) {
+      i = (ring->head + ring->n - ring->nupload) % ring->m;
+      n = MIN( ring->nupload, ring->m - i );
+      k = i * SPFX_QUAD_SIZE * sizeof(GLfloat);
+      gl_vboSubData( ring->vbo, k, n * SPFX_QUAD_SIZE * sizeof(GLfloat),
+            &ring->vertex[ i*SPFX_QUAD_SIZE ] );
+      ring->nupload -= n;
    }
 }
 
+
+/**
+ * @brief Renders the effects of a ring.
+ *
+ *    @param ring Ring to render.
+ *    @param effect Type of the effects in the ring.
+ */
+static void spfx_ringRender( SPFX_Ring *ring, const SPFX_Base *effect )
+{
+   const glTexture *gfx;
+   const SPFX *s;
+   int i, k, n, sx, sy, frame;
+   double t, timer, time;
+
+   gfx = effect->gfx;
+   sx  = (int)gfx->sx;
+   sy  = (int)gfx->sy;
+
+   /* Without the program the effects are placed here, newest first. */
+   if (spfx_program == 0) {
+      for (i=ring->n-1; i>=0; i--) {
+         s     = &ring->spfx[ (ring->head + i) % ring->m ];
+         t     = spfx_time - s->t0;
+         timer = s->life - t;
+         if (timer < 0.)
+            continue;
+
+         time  = 1. - fmod(timer,effect->anim) / effect->anim;
+         frame = sx * sy * MIN(time, 1.);
+
+         /* Renders */
+         gl_blitSprite( gfx, s->px + s->vx*t, s->py + s->vy*t,
+               frame % sx, frame / sx, NULL );
+      }
+      return;
+   }
+
+   spfx_ringUpload( ring );
+
+   nglUniform2f( spfx_uTime, spfx_time, effect->anim );
+   nglUniform2f( spfx_uSize, gfx->sw, gfx->sh );
+   nglUniform2f( spfx_uSheet, sx, sy );
+   nglUniform2f( spfx_uFrame, gfx->srw, gfx->srh );
+   nglUniform2f( spfx_uOrigin, gfx->ox, gfx->oy );
+
+   glEnable( GL_TEXTURE_2D );
+   glBindTexture( GL_TEXTURE_2D, gfx->texture );
+   gl_vboActivateOffset( ring->vbo, GL_VERTEX_ARRAY, 0, 4, GL_FLOAT,
+         SPFX_VERTEX_SIZE * sizeof(GLfloat) );
+   gl_vboActivateOffset( ring->vbo, GL_TEXTURE_COORD_ARRAY, 4 * sizeof(GLfloat),
+         4, GL_FLOAT, SPFX_VERTEX_SIZE * sizeof(GLfloat) );
+
+   /* Live effects may wrap around the end. */
+   i = ring->head;
+   n = MIN( ring->n, ring->m - i );
+   glDrawArrays( GL_QUADS, 4*i, 4*n );
+   k = ring->n - n;
+   if (k > 0)
+      glDrawArrays( GL_QUADS, 0, 4*k );
+
+   gl_vboDeactivate();
+   glDisable( GL_TEXTURE_2D );
+}
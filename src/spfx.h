@@ -26,6 +26,7 @@ void spfx_add( const int effect,
       const double px, const double py,
       const double vx, const double vy,
       const int layer );
+int spfx_count( int effect, int layer );
 
 
 /*
@@ -0,0 +1,259 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+/**
+ * @file startup.c
+ *
+ * @brief Profiles the phases of the startup up to the main menu.
+ *
+ * Startup is split in named phases with startup_begin(), each phase running
+ *  until the next one begins. Every phase gets the wall time spent in it,
+ *  the bytes read from the ndata and the textures and sounds decoded while it
+ *  ran. Work done by the threadpool goes to the phase running when it
+ *  finishes. A phase that begins again keeps adding to its totals.
+ *
+ * The summary gets logged by startup_done() once the main menu is up.
+ */
+
+
+#include "startup.h"
+
+#include "naev.h"
+
+#include "SDL.h"
+#include "SDL_mutex.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "array.h"
+
+
+/**
+ * @brief A phase of the startup.
+ */
+typedef struct StartupPhase_ {
+   const char *name; /**< Name of the phase, not owned. */
+   double time; /**< Milliseconds spent in it. */
+   size_t bytes; /**< Bytes read from the ndata. */
+   int textures; /**< Textures decoded. */
+   int sounds; /**< Sounds decoded. */
+} StartupPhase;
+
+
+static int startup_on            = 0; /**< Whether startup is being profiled. */
+static SDL_mutex *startup_lock   = NULL; /**< Lock for the counts. */
+static StartupPhase *startup_phases = NULL; /**< Phases in the order they first began (array.h). */
+static int startup_cur           = -1; /**< Phase running, -1 if none. */
+static double startup_t0         = 0.; /**< Start of the profile. */
+static double startup_phaseT0    = 0.; /**< Start of the running phase. */
+static size_t startup_bytes      = 0; /**< Bytes read so far. */
+static int startup_textures      = 0; /**< Textures decoded so far. */
+static int startup_sounds        = 0; /**< Sounds decoded so far. */
+static size_t startup_bytes0     = 0; /**< Bytes read when the phase began. */
+static int startup_textures0     = 0; /**< Textures decoded when the phase began. */
+static int startup_sounds0       = 0; /**< Sounds decoded when the phase began. */
+
+
+/*
+ * Prototypes.
+ */
+static double startup_clock (void);
+static void startup_endPhase( double t );
+
+
+/**
+ * @brief Gets the time in milliseconds.
+ */
+static double startup_clock (void)
+{
+#if SDL_VERSION_ATLEAST(2,0,0)
+   return (double)SDL_GetPerformanceCounter() * 1000. /
+         (double)SDL_GetPerformanceFrequency();
+#else /* SDL_VERSION_ATLEAST(2,0,0) */
+   return (double)SDL_GetTicks();
+#endif /* SDL_VERSION_ATLEAST(2,0,0) */
+}
+
+
+/**
+ * @brief Starts profiling the startup.
+ *
+ *    @param enabled Whether to profile, nothing is recorded otherwise.
+ */
+void startup_init( int enabled )
+{
+   if (!enabled)
+      return;
+
+   startup_lock   = SDL_CreateMutex();
+   startup_phases = array_create( StartupPhase );
+   startup_cur    = -1;
+   startup_t0     = startup_clock();
+   startup_on     = 1;
+}
+
+
+/**
+ * @brief Checks whether the startup is being profiled.
+ */
+int startup_enabled (void)
+{
+   return startup_on;
+}
+
+
+/**
+ * @brief Adds what was done since the running phase began to it.
+ *
+ *    @param t Time the phase ends.
+ */
+static void startup_endPhase( double t )
+{
+   StartupPhase *p;
+
+   if (startup_cur < 0)
+      return;
+
+   p = &startup_phases[ startup_cur ];
+   SDL_mutexP( startup_lock );
+   p->time     += t - startup_phaseT0;
+   p->bytes    += startup_bytes - startup_bytes0;
+   p->textures += startup_textures - startup_textures0;
+   p->sounds   += startup_sounds - startup_sounds0;
+   startup_bytes0    = startup_bytes;
+   startup_textures0 = startup_textures;
+   startup_sounds0   = startup_sounds;
+   SDL_mutexV( startup_lock );
+   startup_cur = -1;
+}
+
+
+/**
+ * @brief Ends the running phase and begins another.
+ *
+ *    @param name Name of the phase, must stay valid until startup_done().
+ */
+void startup_begin( const char *name )
+{
+   StartupPhase *p;
+   double t;
+   int i;
+
+   if (!startup_on)
+      return;
+
+   t = startup_clock();
+   startup_endPhase( t );
+
+   for (i=0; i<array_size(startup_phases); i++)
+      if (strcmp( startup_phases[i].name, name ) == 0)
+         break;
+   if (i >= array_size(startup_phases)) {
+      p = &array_grow( &startup_phases );
+      memset( p, 0, sizeof(StartupPhase) );
+      p->name = name;
+   }
+   startup_cur     = i;
+   startup_phaseT0 = t;
+}
+
+
+/**
+ * @brief Ends the profile and logs the summary.
+ *
+ * Should be called once the main menu is up, the total is the time to menu.
+ */
+void startup_done (void)
+{
+   StartupPhase *p, total;
+   double t;
+   int i;
+
+   if (!startup_on)
+      return;
+
+   t = startup_clock();
+   startup_endPhase( t );
+   startup_on = 0;
+
+   memset( &total, 0, sizeof(StartupPhase) );
+   LOG("Startup profile:");
+   LOG("   %-20s %10s %10s %9s %7s", "phase", "ms", "KiB read", "textures", "sounds");
+   for (i=0; i<array_size(startup_phases); i++) {
+      p = &startup_phases[i];
+      LOG("   %-20s %10.1f %10.1f %9d %7d", p->name, p->time,
+            (double)p->bytes / 1024., p->textures, p->sounds );
+      total.time     += p->time;
+      total.bytes    += p->bytes;
+      total.textures += p->textures;
+      total.sounds   += p->sounds;
+   }
+   LOG("   %-20s %10.1f %10.1f %9d %7d", "total", total.time,
+         (double)total.bytes / 1024., total.textures, total.sounds );
+   LOG("   Time to menu: %.1f ms", t - startup_t0);
+
+   array_free( startup_phases );
+   startup_phases = NULL;
+}
+
+
+/**
+ * @brief Frees what is left of the profiler.
+ *
+ * The lock is kept until here as workers may still be counting after
+ *  startup_done().
+ */
+void startup_exit (void)
+{
+   startup_on = 0;
+   if (startup_phases != NULL) {
+      array_free( startup_phases );
+      startup_phases = NULL;
+   }
+   if (startup_lock != NULL) {
+      SDL_DestroyMutex( startup_lock );
+      startup_lock = NULL;
+   }
+}
+
+
+/**
+ * @brief Counts bytes read from the ndata.
+ */
+void startup_countBytes( size_t n )
+{
+   if (!startup_on)
+      return;
+   SDL_mutexP( startup_lock );
+   startup_bytes += n;
+   SDL_mutexV( startup_lock );
+}
+
+
+/**
+ * @brief Counts a texture being decoded.
+ */
+void startup_countTexture (void)
+{
+   if (!startup_on)
+      return;
+   SDL_mutexP( startup_lock );
+   startup_textures++;
+   SDL_mutexV( startup_lock );
+}
+
+
+/**
+ * @brief Counts a sound being decoded.
+ */
+void startup_countSound (void)
+{
+   if (!startup_on)
+      return;
+   SDL_mutexP( startup_lock );
+   startup_sounds++;
+   SDL_mutexV( startup_lock );
+}
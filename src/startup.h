@@ -0,0 +1,30 @@
+/*
+ * See Licensing and Copyright notice in naev.h
+ */
+
+
+#ifndef STARTUP_H
+#  define STARTUP_H
+
+
+#include <stddef.h>
+
+
+/*
+ * Phases.
+ */
+void startup_init( int enabled );
+int startup_enabled (void);
+void startup_begin( const char *name );
+void startup_done (void);
+void startup_exit (void);
+
+/*
+ * Counting, can be done from any thread.
+ */
+void startup_countBytes( size_t n );
+void startup_countTexture (void);
+void startup_countSound (void);
+
+
+#endif /* STARTUP_H */
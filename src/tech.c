@@ -7,6 +7,11 @@
  *
  * @brief Handles tech groups and metagroups for populating the planet outfitter,
  *        shipyard and commodity exchange.
+ *
+ * Each group caches the outfits, ships and commodities it contains through all
+ *  its nested groups as bitsets over their stacks. Any change to any group
+ *  bumps a generation counter that invalidates every cache, so the caches never
+ *  have to know which groups include each other.
  */
 
 
@@ -26,6 +31,9 @@
 #define XML_TECH_ID         "Techs"          /**< Tech xml document tag. */
 #define XML_TECH_TAG        "tech"           /**< Individual tech xml tag. */
 
+#define TECH_FLAT_TYPES     3                /**< Types that get flattened. */
+#define TECH_BITS           32               /**< Bits per bitset word. */
+
 
 /**
  * @brief Different tech types.
@@ -62,6 +70,8 @@ typedef struct tech_item_s {
 struct tech_group_s {
    char *name;          /**< Name of the tech group. */
    tech_item_t *items;  /**< Items in the tech group. */
+   uint32_t *flat;      /**< Bitsets of all the items of each flattened type. */
+   unsigned int flat_gen; /**< Value of tech_gen flat was built at. */
 };
 
 
@@ -69,6 +79,7 @@ struct tech_group_s {
  * Group list.
  */
 static tech_group_t *tech_groups = NULL;
+static unsigned int tech_gen = 1; /**< Bumped whenever any group changes. */
 
 
 /*
@@ -88,7 +99,10 @@ static int tech_getID( const char *name );
 static int tech_addItemGroupPointer( tech_group_t *grp, tech_group_t *ptr );
 static int tech_addItemGroup( tech_group_t *grp, const char* name );
 /* Getting by tech. */
-static void** tech_addGroupItem( void **items, tech_item_type_t type, tech_group_t *tech, int *n, int *m );
+static void tech_flatLayout( int *off );
+static int tech_flatIndex( const tech_item_t *item );
+static const uint32_t* tech_flatten( tech_group_t *grp );
+static void** tech_flatItems( tech_group_t *tech, tech_item_type_t type, int *n );
 
 
 /**
@@ -209,6 +223,7 @@ static void tech_freeGroup( tech_group_t *grp )
       free(grp->name);
    if (grp->items != NULL)
       array_free( grp->items );
+   free( grp->flat );
 }
 
 
@@ -408,6 +423,7 @@ static tech_item_t *tech_itemGrow( tech_group_t *grp )
 {
    if (grp->items == NULL)
       grp->items = array_create( tech_item_t );
+   tech_gen++;
    return &array_grow( &grp->items );
 }
 
@@ -549,6 +565,7 @@ int tech_rmItemTech( tech_group_t *tech, const char *value )
       buf = tech_getItemName( &tech->items[i] );
       if (strcmp(buf, value)==0) {
          array_erase( &tech->items, &tech->items[i], &tech->items[i+1] );
+         tech_gen++;
          return 0;
       }
    }
@@ -583,6 +600,7 @@ int tech_rmItem( const char *name, const char *value )
       buf = tech_getItemName( &tech->items[i] );
       if (strcmp(buf, value)==0) {
          array_erase( &tech->items, &tech->items[i], &tech->items[i+1] );
+         tech_gen++;
          return 0;
       }
    }
@@ -676,61 +694,143 @@ static void tech_createMetaGroup( tech_group_t *grp, tech_group_t **tech, int nu
 
 
 /**
- * @brief Recursive function for creating an array of commodities from a tech group.
+ * @brief Gets where the bitset of each flattened type starts.
+ *
+ *    @param[out] off Word offset of each type, followed by the total words.
  */
-static void** tech_addGroupItem( void **items, tech_item_type_t type, tech_group_t *tech, int *n, int *m )
+static void tech_flatLayout( int *off )
 {
-   int i, j, size, f;
-   tech_item_t *item;
+   int n[TECH_FLAT_TYPES], i;
 
-   /* Must have items. */
-   if (tech->items == NULL)
-      return items;
+   outfit_getAll( &n[TECH_TYPE_OUTFIT] );
+   ship_getAll( &n[TECH_TYPE_SHIP] );
+   commodity_getAll( &n[TECH_TYPE_COMMODITY] );
 
-   /* Comfort. */
-   size  = array_size( tech->items );
+   off[0] = 0;
+   for (i=0; i<TECH_FLAT_TYPES; i++)
+      off[i+1] = off[i] + (n[i] + TECH_BITS-1) / TECH_BITS;
+}
 
-   /* Load commodities first, then we handle groups. */
-   for (i=0; i<size; i++) {
-      item = &tech->items[i];
 
-      /* Only handle commodities for now. */
-      if (item->type != type)
-         continue;
+/**
+ * @brief Gets the stack index of an outfit, ship or commodity item.
+ */
+static int tech_flatIndex( const tech_item_t *item )
+{
+   int n;
 
-      /* Skip if already in list. */
-      f = 0;
-      for (j=0; j<*n; j++) {
-         if (items[j] == item->u.ptr) {
-            f = 1;
-            break;
-         }
-      }
-      if (f == 1)
-         continue;
+   switch (item->type) {
+      case TECH_TYPE_OUTFIT:
+         return item->u.outfit - outfit_getAll( &n );
+      case TECH_TYPE_SHIP:
+         return item->u.ship - ship_getAll( &n );
+      case TECH_TYPE_COMMODITY:
+         return item->u.comm - commodity_getAll( &n );
+      default:
+         return -1;
+   }
+}
 
-      /* Allocate memory if needed. */
-      (*n)++;
-      if ((*n) > (*m)) {
-         if ((*m) == 0)
-            (*m)  = 16;
-         (*m) *= 2;
-         items = realloc( items, sizeof(void*) * (*m) );
+
+/**
+ * @brief Gets the flattened items of a group, building them if out of date.
+ *
+ *    @param grp Group to flatten.
+ *    @return Bitsets laid out as given by tech_flatLayout().
+ */
+static const uint32_t* tech_flatten( tech_group_t *grp )
+{
+   int i, j, k, s, off[TECH_FLAT_TYPES+1];
+   const uint32_t *sub;
+   tech_item_t *item;
+
+   if ((grp->flat != NULL) && (grp->flat_gen == tech_gen))
+      return grp->flat;
+
+   tech_flatLayout( off );
+   free( grp->flat );
+   grp->flat     = calloc( MAX( 1, off[TECH_FLAT_TYPES] ), sizeof(uint32_t) );
+   grp->flat_gen = tech_gen;
+
+   s = (grp->items != NULL) ? array_size( grp->items ) : 0;
+   for (i=0; i<s; i++) {
+      item = &grp->items[i];
+      sub  = NULL;
+      switch (item->type) {
+         case TECH_TYPE_OUTFIT:
+         case TECH_TYPE_SHIP:
+         case TECH_TYPE_COMMODITY:
+            k = tech_flatIndex( item );
+            grp->flat[ off[item->type] + k/TECH_BITS ] |= 1U << (k % TECH_BITS);
+            break;
+         case TECH_TYPE_GROUP:
+            sub = tech_flatten( &tech_groups[ item->u.grp ] );
+            break;
+         case TECH_TYPE_GROUP_POINTER:
+            sub = tech_flatten( item->u.grpptr );
+            break;
       }
 
-      /* Add. */
-      items[ (*n)-1 ]  = item->u.ptr;
+      /* Nested groups are already flat. */
+      if (sub != NULL)
+         for (j=0; j<off[TECH_FLAT_TYPES]; j++)
+            grp->flat[j] |= sub[j];
    }
 
-   /* Now handle other groups. */
-   for (i=0; i<size; i++) {
-      item = &tech->items[i];
+   return grp->flat;
+}
+
 
-      /* Only handle commodities for now. */
-      if (item->type == TECH_TYPE_GROUP)
-         items  = tech_addGroupItem( items, type, &tech_groups[ item->u.grp ], n, m );
-      else if (item->type == TECH_TYPE_GROUP_POINTER)
-         items  = tech_addGroupItem( items, type, item->u.grpptr, n, m );
+/**
+ * @brief Creates an array of all the items of a type in a tech group.
+ *
+ *    @param tech Tech group to get items from.
+ *    @param type Type of the items, outfit, ship or commodity.
+ *    @param[out] n Number of items found.
+ *    @return Items in stack order, NULL if none are found.
+ */
+static void** tech_flatItems( tech_group_t *tech, tech_item_type_t type, int *n )
+{
+   int i, j, ns, off[TECH_FLAT_TYPES+1];
+   const uint32_t *flat;
+   uint32_t w;
+   void **items;
+   Outfit *outfits;
+   Ship *ships;
+   Commodity *comms;
+
+   flat = tech_flatten( tech );
+   tech_flatLayout( off );
+
+   /* Count. */
+   *n = 0;
+   for (i=off[type]; i<off[type+1]; i++)
+      for (w=flat[i]; w!=0; w&=w-1)
+         (*n)++;
+   if (*n == 0)
+      return NULL;
+
+   outfits = outfit_getAll( &ns );
+   ships   = ship_getAll( &ns );
+   comms   = commodity_getAll( &ns );
+
+   /* Fill. */
+   items = malloc( sizeof(void*) * (*n) );
+   j     = 0;
+   for (i=0; i<(off[type+1]-off[type])*TECH_BITS; i++) {
+      if (!(flat[ off[type] + i/TECH_BITS ] & (1U << (i % TECH_BITS))))
+         continue;
+      switch (type) {
+         case TECH_TYPE_OUTFIT:
+            items[j++] = &outfits[i];
+            break;
+         case TECH_TYPE_SHIP:
+            items[j++] = &ships[i];
+            break;
+         default:
+            items[j++] = &comms[i];
+            break;
+      }
    }
 
    return items;
@@ -825,7 +925,6 @@ char** tech_getAllItemNames( int *n )
  */
 Outfit** tech_getOutfit( tech_group_t *tech, int *n )
 {
-   int m;
    Outfit **o;
 
    if (tech==NULL) {
@@ -834,9 +933,7 @@ Outfit** tech_getOutfit( tech_group_t *tech, int *n )
    }
 
    /* Get the outfits. */
-   *n = 0;
-   m  = 0;
-   o  = (Outfit**)tech_addGroupItem( NULL, TECH_TYPE_OUTFIT, tech, n, &m );
+   o  = (Outfit**)tech_flatItems( tech, TECH_TYPE_OUTFIT, n );
 
    /* None found case. */
    if (o == NULL) {
@@ -889,7 +986,6 @@ Outfit** tech_getOutfitArray( tech_group_t **tech, int num, int *n )
  */
 Ship** tech_getShip( tech_group_t *tech, int *n )
 {
-   int m;
    Ship **s;
 
    if (tech==NULL) {
@@ -898,9 +994,7 @@ Ship** tech_getShip( tech_group_t *tech, int *n )
    }
 
    /* Get the outfits. */
-   *n = 0;
-   m  = 0;
-   s  = (Ship**) tech_addGroupItem( NULL, TECH_TYPE_SHIP, tech, n, &m );
+   s  = (Ship**) tech_flatItems( tech, TECH_TYPE_SHIP, n );
 
    /* None found case. */
    if (s == NULL) {
@@ -981,7 +1075,6 @@ Commodity** tech_getCommodityArray( tech_group_t **tech, int num, int *n )
  */
 Commodity** tech_getCommodity( tech_group_t *tech, int *n )
 {
-   int m;
    Commodity **c;
 
    if (tech==NULL) {
@@ -990,9 +1083,7 @@ Commodity** tech_getCommodity( tech_group_t *tech, int *n )
    }
 
    /* Get the commodities. */
-   *n = 0;
-   m  = 0;
-   c  = (Commodity**) tech_addGroupItem( NULL, TECH_TYPE_COMMODITY, tech, n, &m );
+   c  = (Commodity**) tech_flatItems( tech, TECH_TYPE_COMMODITY, n );
 
    /* None found case. */
    if (c == NULL) {
@@ -2,618 +2,676 @@
  * See Licensing and Copyright notice in threadpool.h
  */
 /*
- * @brief A simple threadpool implementation using a single queue.
+ * @brief A work-stealing threadpool.
  *
- * The queue is inspired by this paper (look for the queue with two locks):
+ * Every worker thread owns a deque of jobs.  A worker pushes and pops jobs at
+ *  the tail of its own deque (so recently spawned, cache-hot jobs run first)
+ *  and, when it runs out of work, steals from the head of the other deques.
+ *  Threads that are not workers push into an extra shared deque.  Each deque
+ *  has its own lock, so there is no single lock every job has to go through.
  *
- * Maged M. Michael and Michael L. Scott. 1998. Nonblocking algorithms and
- * preemption-safe locking on multiprogrammed shared memory multiprocessors. J.
- * Parallel Distrib. Comput. 51, 1 (May 1998), 1-26. DOI=10.1006/jpdc.1998.1446
- * http://dx.doi.org/10.1006/jpdc.1998.1446
+ * Idle workers sleep on a semaphore that holds one token per queued job.  A
+ *  thread must take a token before claiming a job, which guarantees that it
+ *  will find one in some deque.
  *
- * @ARTICLE{Michael98non-blockingalgorithms,
- *    author = {Maged M. Michael and Michael L. Scott},
- *    title = {Non-Blocking Algorithms and Preemption-Safe Locking on Multiprogrammed Shared Memory Multiprocessors},
- *    journal = {Journal of Parallel and Distributed Computing},
- *    year = {1998},
- *    volume = {51},
- *    pages = {1--26},
- * }
- *
- * @note The algorithm/strategy for killing idle workers should be moved into
- *       the threadhandler and it should also be improved (the current strategy
- *       is probably not very good).
+ * Threads waiting on a group (fork/join) run the queued jobs of that group
+ *  while they wait instead of blocking, so groups can be nested without
+ *  running out of workers. Other jobs are left to the workers, a frame
+ *  waiting on a parallel for must not end up running a long background job.
  */
 
 
 #include "threadpool.h"
 
+#include "naev.h"
+
 #include "SDL.h"
 #include "SDL_thread.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "log.h"
 
 
-#define THREADPOOL_TIMEOUT (5 * 100) /* The time a worker thread waits in ms. */
-#define THREADSIG_STOP     (1) /* The signal to stop a worker thread */
-#define THREADSIG_RUN      (0) /* The signal to indicate the worker thread is running */
+#define THREADPOOL_DEQUE_MIN  64 /* Initial size of a deque, must be power of two. */
+#define THREADPOOL_WAIT       1 /* Time in ms a joining thread sleeps before looking for work. */
+#define THREADPOOL_DEFAULT    3 /* Workers to use if we can't query the core count. */
+#define THREADPOOL_SPLIT      4 /* Ranges per thread in a parallel for. */
 
 
 /**
- * Threads to use.
+ * @brief A job to run.
  */
-static int MAXTHREADS = 8; /* Bit overkill, but oh well. */
-
+typedef struct ThreadJob_ {
+   int (*function)(void *); /* The function to be called */
+   void *data;              /* And its arguments */
+   ThreadGroup *group;      /* Group the job belongs to, or NULL */
+} ThreadJob;
 
 /**
- * @brief Node in the thread queue.
+ * @brief Double ended job queue.
+ *
+ * The owner works at the tail, thieves at the head.
  */
-typedef struct Node_ {
-   void *data;          /* The element in the list */
-   struct Node_ *next;  /* The next node in the list */
-} Node;
+typedef struct ThreadDeque_ {
+   SDL_mutex *lock;     /* Protects the deque. */
+   ThreadJob *jobs;     /* Ring buffer of jobs. */
+   int size;            /* Size of the ring buffer (power of two). */
+   int head;            /* Steal end. */
+   int tail;            /* Owner end. */
+} ThreadDeque;
 
 /**
- * @brief Threadqueue itself.
+ * @brief Fork/join group.
  */
-struct ThreadQueue_ {
-   Node *first;         /* The first node */
-   Node *last;          /* The second node */
-   /* A semaphore to ensure reads only happen when the queue is not empty */
-   SDL_sem *semaphore;
-   SDL_mutex *t_lock;   /* Tail lock. Lock when reading/updating tail */
-   SDL_mutex *h_lock;   /* Same as tail lock, except it's head lock */
+struct ThreadGroup_ {
+   SDL_mutex *lock;     /* Protects pending. */
+   SDL_cond *cond;      /* Signalled when pending reaches zero. */
+   int pending;         /* Jobs that haven't finished yet. */
 };
 
 /**
- * @brief Data for the threadqueue.
+ * @brief Virtual thread pool, just a group with the old interface.
  */
-typedef struct ThreadQueueData_ {
-   int (*function)(void *);  /* The function to be called */
-   void *data;               /* And its arguments */
-} ThreadQueueData;
+struct ThreadQueue_ {
+   ThreadGroup *group;  /* Group the jobs are spawned in. */
+};
 
 /**
- * @brief Thread data.
+ * @brief A range of a parallel for.
  */
-typedef struct ThreadData_ {
-   int (*function)(void *); /* The function to be called */
-   void *data;             /* Arguments to the above function */
-   int signal;             /* Signals to the thread */
-   SDL_sem *semaphore;     /* The semaphore to signal new jobs or new signal in the
-                              'signal' variable */
-   ThreadQueue *idle;      /* The queue with idle threads */
-   ThreadQueue *stopped;   /* The queue with stopped threads */
-} ThreadData;
+typedef struct ThreadRange_ {
+   void (*function)(int start, int end, void *data); /* Function to run. */
+   void *data;          /* Arguments to the function. */
+   int start;           /* First element. */
+   int end;             /* One past the last element. */
+} ThreadRange;
 
-/**
- * @brief Virtual thread pool data.
- */
-typedef struct vpoolThreadData_ {
-   SDL_cond *cond;         /* Condition variable for signalling all jobs in the vpool
-                              are done */
-   SDL_mutex *mutex;       /* The mutex to use with the above condition variable */
-   int *count;             /* Variable to count number of finished jobs in the vpool */
-   ThreadQueueData *node;  /* The job to be done */
-} vpoolThreadData;
 
-/* The global threadpool queue */
-static ThreadQueue *global_queue = NULL;
+/*
+ * The pool.
+ */
+static int pool_nworkers         = 0; /* Number of worker threads. */
+static ThreadDeque *pool_deques  = NULL; /* Deques, the last one is for non-workers. */
+static SDL_Thread **pool_threads = NULL; /* Worker threads. */
+static unsigned long *pool_ids   = NULL; /* Thread ID of each worker. */
+static int *pool_index           = NULL; /* Index passed to each worker. */
+static SDL_sem *pool_jobs        = NULL; /* One token per queued job. */
+static volatile int pool_stop    = 0; /* Workers should stop. */
 
 
 /*
  * Prototypes.
  */
-static ThreadQueue* tq_create (void);
-static void tq_enqueue( ThreadQueue *q, void *data );
-static void* tq_dequeue( ThreadQueue *q );
-static void tq_destroy( ThreadQueue *q );
+static int tp_self (void);
+static void tp_push( const ThreadJob *job );
+static int tp_popTail( ThreadDeque *d, ThreadJob *job );
+static int tp_popHead( ThreadDeque *d, ThreadJob *job );
+static int tp_popGroup( ThreadDeque *d, const ThreadGroup *group, ThreadJob *job );
+static void tp_claim( int self, ThreadJob *job );
+static int tp_claimGroup( int self, const ThreadGroup *group, ThreadJob *job );
+static void tp_run( ThreadJob *job );
 static int threadpool_worker( void *data );
-static int threadpool_handler( void *data );
-static int vpool_worker( void *data );
+static int threadpool_rangeWorker( void *data );
 
 
 /**
- * @brief Creates a concurrent queue.
- *
- * The basic concept is that we have a separate lock for both head and tail, so
- *  we can operate separately on either head or tail. This lets us enqueue at
- *  tail and dequeue at the head in true FIFO fashion.
+ * @brief Gets the index of the calling worker.
  *
- *    @return The ThreadQueue.
+ *    @return Index of the worker or -1 if not a worker thread.
  */
-static ThreadQueue* tq_create (void)
+static int tp_self (void)
 {
-   ThreadQueue *q;
-   Node *n;
+   int i;
+   unsigned long id;
+
+   id = (unsigned long) SDL_ThreadID();
+   for (i=0; i<pool_nworkers; i++)
+      if (pool_ids[i] == id)
+         return i;
+   return -1;
+}
 
-   /* Queue memory allocation. */
-   q        = calloc( 1, sizeof(ThreadQueue) );
 
-   /* Allocate and insert the dummy node */
-   n        = calloc( 1, sizeof(Node) );
-   n->next  = NULL;
-   q->first = n;
-   q->last  = n;
+/**
+ * @brief Queues a job on the calling thread's deque.
+ *
+ *    @param job Job to queue.
+ */
+static void tp_push( const ThreadJob *job )
+{
+   int i, n, self;
+   ThreadDeque *d;
+   ThreadJob *jobs;
+
+   self = tp_self();
+   d    = &pool_deques[ (self < 0) ? pool_nworkers : self ];
+
+   SDL_mutexP( d->lock );
+
+   /* Grow if full, unwrapping the ring buffer. */
+   n = d->tail - d->head;
+   if (n >= d->size) {
+      jobs = malloc( 2 * d->size * sizeof(ThreadJob) );
+      for (i=0; i<n; i++)
+         jobs[i] = d->jobs[ (d->head + i) & (d->size-1) ];
+      free( d->jobs );
+      d->jobs  = jobs;
+      d->size *= 2;
+      d->head  = 0;
+      d->tail  = n;
+   }
+
+   d->jobs[ d->tail & (d->size-1) ] = *job;
+   d->tail++;
 
-   /* Create locks. */
-   q->t_lock      = SDL_CreateMutex();
-   q->h_lock      = SDL_CreateMutex();
-   q->semaphore   = SDL_CreateSemaphore( 0 );
+   SDL_mutexV( d->lock );
 
-   return q;
+   /* Job must be in the deque before the token is available. */
+   SDL_SemPost( pool_jobs );
 }
 
+
 /**
- * @brief Enqueue data to the ThreadQueue q.
- *
- *    @param q The queue to be inserted into.
- *    @param data The element to be stored in the queue.
+ * @brief Pops the newest job of a deque.
  */
-static void tq_enqueue( ThreadQueue *q, void *data )
+static int tp_popTail( ThreadDeque *d, ThreadJob *job )
 {
-   Node *n;
-
-   /* Allocate new struct. */
-   n        = calloc( 1, sizeof(Node) );
-   n->data  = data;
-   n->next  = NULL;
+   int ret = 0;
 
-   /* Lock */
-   SDL_mutexP( q->t_lock );
-
-   /* Enqueue. */
-   q->last->next  = n;
-   q->last        = n;
+   SDL_mutexP( d->lock );
+   if (d->tail > d->head) {
+      d->tail--;
+      *job = d->jobs[ d->tail & (d->size-1) ];
+      ret  = 1;
+   }
+   SDL_mutexV( d->lock );
 
-   /* Signal and unlock. This wil break if someone tries to enqueue 2^32+1
-    * elements or something. */
-   SDL_SemPost( q->semaphore );
-   SDL_mutexV( q->t_lock );
+   return ret;
 }
 
+
 /**
- * @brief Dequeue from the ThreadQueue q.
- *
- * @attention The callee should ALWAYS have called SDL_SemWait() on the semaphore.
- *
- *    @param q The queue to dequeue from.
- *    @return A void pointer to the element from the queue.
+ * @brief Steals the oldest job of a deque.
  */
-static void* tq_dequeue( ThreadQueue *q )
+static int tp_popHead( ThreadDeque *d, ThreadJob *job )
 {
-   void *d;
-   Node *newhead, *node;
-
-   /* Lock the head. */
-   SDL_mutexP( q->h_lock );
-
-   /* Start running. */
-   node     = q->first;
-   newhead  = node->next;
-
-   /* Head not consistent. */
-   if (newhead == NULL) {
-      WARN("Tried to dequeue while the queue was empty!");
-      /* Ugly fix :/ */
-      /*
-      SDL_mutexV(q->h_lock);
-      return NULL;
-      */
-      /* We prefer to wait until the cache updates :/ */
-      do {
-         node     = q->first;
-         newhead  = node->next;
-      } while (newhead == NULL);
+   int ret = 0;
+
+   SDL_mutexP( d->lock );
+   if (d->tail > d->head) {
+      *job = d->jobs[ d->head & (d->size-1) ];
+      d->head++;
+      ret  = 1;
    }
+   SDL_mutexV( d->lock );
+
+   return ret;
+}
 
-   /* Remember the value and assign newhead as the new dummy element. */
-   d        = newhead->data;
-   q->first = newhead;
 
-   /* Unlock */
-   SDL_mutexV( q->h_lock );
+/**
+ * @brief Pops the newest job of a group from a deque.
+ */
+static int tp_popGroup( ThreadDeque *d, const ThreadGroup *group, ThreadJob *job )
+{
+   int i, ret = 0;
+
+   SDL_mutexP( d->lock );
+   for (i=d->tail-1; i>=d->head; i--) {
+      if (d->jobs[ i & (d->size-1) ].group != group)
+         continue;
+      *job = d->jobs[ i & (d->size-1) ];
+      /* Close the gap. */
+      for (; i<d->tail-1; i++)
+         d->jobs[ i & (d->size-1) ] = d->jobs[ (i+1) & (d->size-1) ];
+      d->tail--;
+      ret = 1;
+      break;
+   }
+   SDL_mutexV( d->lock );
 
-   free( node );
-   return d;
+   return ret;
 }
 
+
 /**
- * @brief Destroys and frees a ThreadQueue.
+ * @brief Claims a job.
  *
- * Frees all elements too.
+ * @attention The caller must have taken a token from pool_jobs.
  *
- *    @param q The ThreadQueue to free.
+ *    @param self Index of the calling worker or -1.
+ *    @param[out] job Job claimed.
  */
-static void tq_destroy( ThreadQueue *q )
+static void tp_claim( int self, ThreadJob *job )
 {
-   /* Iterate through the list and free the nodes */
-   while (q->first->next != NULL)
-      free( tq_dequeue(q) ); /* Locks q->t_lock, so we must destroy mutex after. */
+   int i, n, start;
 
-   /* Clean up threading structures. */
-   SDL_DestroySemaphore( q->semaphore );
-   SDL_DestroyMutex( q->h_lock );
-   SDL_DestroyMutex( q->t_lock );
+   n     = pool_nworkers + 1;
+   start = (self < 0) ? pool_nworkers : self;
 
-   free( q->first );
-   free( q );
+   /* The token guarantees there is a job somewhere, keep looking. */
+   while (1) {
+      /* Own work first. */
+      if ((self >= 0) && tp_popTail( &pool_deques[self], job ))
+         return;
+
+      /* Steal from everyone else, including the shared deque. */
+      for (i=0; i<n; i++)
+         if (tp_popHead( &pool_deques[ (start + i) % n ], job ))
+            return;
+   }
 }
 
 
 /**
- * @brief Enqueues a new job for the threadpool.
+ * @brief Claims a queued job of a group.
  *
- * @warning Do NOT enqueue a job that has to wait for another job to be done as
- *          this could lead to a deadlock.
+ * A token is taken for the job, it is given back if there is none so it stays
+ *  with the job it belongs to. Stop tokens, that have no job, are given back
+ *  too.
  *
- *    @param function The function (job) to be called (executed).
- *    @param data The arguments for the function.
- *    @return Returns 0 on success and -2 if there was no threadpool.
+ *    @param self Index of the calling worker or -1.
+ *    @param group Group to claim a job of.
+ *    @param[out] job Job claimed.
+ *    @return 1 if claimed, 0 if the group has no queued jobs and -1 if it
+ *            couldn't be checked as all the tokens are taken or stopping.
  */
-int threadpool_newJob( int (*function)(void *), void *data )
+static int tp_claimGroup( int self, const ThreadGroup *group, ThreadJob *job )
 {
-   ThreadQueueData *node;
+   int i, n, start;
 
-   if (global_queue == NULL) {
-      WARN("Threadpool has not been initialized yet!");
-      return -2;
-   }
+   if (pool_stop || (SDL_SemTryWait( pool_jobs ) != 0))
+      return -1;
 
-   /* Allocate and set parameters. */
-   node           = calloc( 1, sizeof(ThreadQueueData) );
-   node->data     = data;
-   node->function = function;
+   n     = pool_nworkers + 1;
+   start = (self < 0) ? pool_nworkers : self;
 
-   /* Actually enque. */
-   tq_enqueue( global_queue, node );
+   /* Our own deque first, it is where the jobs were spawned. */
+   for (i=0; i<n; i++)
+      if (tp_popGroup( &pool_deques[ (start + i) % n ], group, job ))
+         return 1;
 
+   SDL_SemPost( pool_jobs );
    return 0;
 }
 
+
+/**
+ * @brief Runs a job and signals its group.
+ */
+static void tp_run( ThreadJob *job )
+{
+   ThreadGroup *group;
+
+   job->function( job->data );
+
+   group = job->group;
+   if (group == NULL)
+      return;
+
+   SDL_mutexP( group->lock );
+   group->pending--;
+   if (group->pending <= 0)
+      SDL_CondBroadcast( group->cond );
+   SDL_mutexV( group->lock );
+}
+
+
 /**
  * @brief The worker function for the threadpool.
  *
- * It waits for a signal from the handler. If it receives THREADSIG_STOP it
- *  means the worker thread should stop. Else it dequeues a job from the
- *  global_queue and executes it.
+ * Sleeps until there is a job, then runs it.
  *
- *    @param data A pointer to the ThreadData struct used for a lot of stuff.
+ *    @param data Pointer to the index of the worker.
  */
 static int threadpool_worker( void *data )
 {
-   ThreadData *work;
+   int self;
+   ThreadJob job;
 
-   work = (ThreadData*) data;
+   self = *(int*) data;
+   pool_ids[self] = (unsigned long) SDL_ThreadID();
 
    /* Work loop */
    while (1) {
-      /* Wait for new signal */
-      while (SDL_SemWait( work->semaphore ) == -1) {
-          /* Putting this in a while-loop is probably a really bad idea, but I
-           * don't have any better ideas. */
+      while (SDL_SemWait( pool_jobs ) == -1)
           WARN("SDL_SemWait failed! Error: %s", SDL_GetError());
-      }
+
       /* Break if received signal to stop */
-      if (work->signal == THREADSIG_STOP)
+      if (pool_stop)
          break;
 
-      /* Do work :-) */
-      work->function( work->data );
-
-      /* Enqueue itself in the idle worker threads queue */
-      tq_enqueue( work->idle, work );
+      tp_claim( self, &job );
+      tp_run( &job );
    }
-   /* Enqueue itself in the stopped worker threads queue when stopped */
-   tq_enqueue( work->stopped, work );
 
    return 0;
 }
 
+
 /**
- * @brief Handles assigning jobs to the workers and killing them if necessary.
- *
- * @note Stopping the threeadpool_handler is not yet implemented.
- *
- * Process is:
- *
- * 1) Wait for job
- * 2) if Timed out -> kill idle, putting on stopped, go to 1)
- * 3) Have thread run job
- * 3.1) Grab a job from the queue
- * 3.2) If idle thread, grab idle thread
- *      else if stopped threads, reactivate stopped thread
- *      else wait for running thread
- * 4) Go to 1)
+ * @brief Initialize the global threadpool.
  *
- *    @param data Not used. SDL threading requires functions to take a void
- *                pointer as argument.
- *    @return Not really implemented yet.
+ *    @return Returns 0 on success and -1 if there's already a threadpool.
  */
-static int threadpool_handler( void *data )
+int threadpool_init (void)
 {
-   (void) data;
-   int i, nrunning, newthread;
-   ThreadData *threadargs, *threadarg;
-   /* Queues for idle workers and stopped workers */
-   ThreadQueue *idle, *stopped;
-   ThreadQueueData *node;
-
-   /* Initialize the idle and stopped queues. */
-   idle     = tq_create();
-   stopped  = tq_create();
-
-   /* Allocate threadargs to communicate with workers */
-   threadargs = calloc( MAXTHREADS, sizeof(ThreadData) );
-
-   /* Initialize threadargs */
-   for (i=0; i<MAXTHREADS; i++) {
-      threadargs[i].function  = NULL;
-      threadargs[i].data      = NULL;
-      threadargs[i].semaphore = SDL_CreateSemaphore( 0 ); /* Used to give orders. */
-      threadargs[i].idle      = idle;
-      threadargs[i].stopped   = stopped;
-      threadargs[i].signal    = THREADSIG_RUN;
-      /* 'Workers' that do not have a thread are considered stopped */
-      tq_enqueue( stopped, &threadargs[i] );
-   }
+   int i, n;
 
-   /* Set the number of running threads to 0 */
-   nrunning = 0;
-
-   /*
-    * Thread handler main loop.
-    */
-   while (1) {
-      /*
-       * We must now wait, this shall be done on each active thread. However they will
-       * be put to sleep as time passes. When we receive a command we'll proceed to process
-       * it.
-       */
-      if (nrunning > 0) {
-         /*
-          * Here we'll wait until thread gets work to do. If it doesn't it will
-          * just stop a worker thread and wait until it gets something to do.
-          */
-         if (SDL_SemWaitTimeout( global_queue->semaphore, THREADPOOL_TIMEOUT ) != 0) {
-            /* There weren't any new jobs so we'll start killing threads ;) */
-            if (SDL_SemTryWait( idle->semaphore ) == 0) {
-               threadarg         = tq_dequeue( idle );
-               /* Set signal to stop worker thread */
-               threadarg->signal = THREADSIG_STOP;
-               /* Signal thread and decrement running threads counter */
-               SDL_SemPost( threadarg->semaphore );
-               nrunning -= 1;
-            }
-
-            /* We just go back to waiting on a thread. */
-            continue;
-         }
-
-         /* We got work. Continue to handle work. */
-      }
-      else {
-         /*
-          * Here we wait for a new job. No threads are alive at this point and the
-          * threadpool is just patiently waiting for work to arrive.
-          */
-         if (SDL_SemWait( global_queue->semaphore ) == -1) {
-             WARN("SDL_SemWait failed! Error: %s", SDL_GetError());
-             continue;
-         }
-
-         /* We got work. Continue to handle work. */
-      }
-
-      /*
-       * Get a new job from the queue. This should be safe as we have received
-       * a permission from the global_queue->semaphore.
-       */
-      node        = tq_dequeue( global_queue );
-      newthread   = 0;
-
-      /*
-       * Choose where to get the thread. Either idle, revive stopped or block until
-       * another thread becomes idle.
-       */
-      /* Idle thread available */
-      if (SDL_SemTryWait(idle->semaphore) == 0)
-         threadarg         = tq_dequeue( idle );
-      /* Make a new thread */
-      else if (SDL_SemTryWait(stopped->semaphore) == 0) {
-         threadarg         = tq_dequeue( stopped );
-         threadarg->signal = THREADSIG_RUN;
-         newthread         = 1;
-      }
-      /* Wait for idle thread */
-      else {
-         while (SDL_SemWait(idle->semaphore) == -1) {
-             /* Bad idea */
-             WARN("SDL_SemWait failed! Error: %s", SDL_GetError());
-         }
-         threadarg         = tq_dequeue( idle );
-      }
-
-      /* Assign arguments for the thread */
-      threadarg->function  = node->function;
-      threadarg->data      = node->data;
-      /* Signal the thread that there's a new job */
-      SDL_SemPost( threadarg->semaphore );
+   /* There's already a pool. */
+   if (pool_deques != NULL) {
+      WARN("Threadpool has already been initialized!");
+      return -1;
+   }
 
-      /* Start a new thread and increment the thread counter */
-      if (newthread) {
-         SDL_CreateThread( threadpool_worker,
+   /* The thread that waits on jobs also runs them, so leave it a core. */
+#if SDL_VERSION_ATLEAST(1,3,0)
+   n = SDL_GetCPUCount() - 1;
+#else /* SDL_VERSION_ATLEAST(1,3,0) */
+   n = THREADPOOL_DEFAULT;
+#endif /* SDL_VERSION_ATLEAST(1,3,0) */
+   n = MAX( 1, n );
+
+   pool_stop   = 0;
+   pool_jobs   = SDL_CreateSemaphore( 0 );
+   pool_deques = calloc( n+1, sizeof(ThreadDeque) );
+   for (i=0; i<n+1; i++) {
+      pool_deques[i].lock = SDL_CreateMutex();
+      pool_deques[i].size = THREADPOOL_DEQUE_MIN;
+      pool_deques[i].jobs = malloc( THREADPOOL_DEQUE_MIN * sizeof(ThreadJob) );
+   }
+   pool_threads = calloc( n, sizeof(SDL_Thread*) );
+   pool_ids     = calloc( n, sizeof(unsigned long) );
+   pool_index   = calloc( n, sizeof(int) );
+
+   /* Deques must be set up before anyone can push. */
+   pool_nworkers = n;
+   for (i=0; i<n; i++) {
+      pool_index[i]   = i;
+      pool_threads[i] = SDL_CreateThread( threadpool_worker,
 #if SDL_VERSION_ATLEAST(1,3,0)
                "threadpool_worker",
 #endif /* SDL_VERSION_ATLEAST(1,3,0) */
-               threadarg );
-         nrunning += 1;
-      }
-
-      /* Free the now unused job from the global_queue */
-      free(node);
+               &pool_index[i] );
    }
-   /** @TODO A way to stop the threadpool. */
 
-   /* Clean up. */
-   tq_destroy( idle );
-   tq_destroy( stopped );
-   free( threadargs );
+   DEBUG("Threadpool started with %d workers", n);
 
    return 0;
 }
 
+
 /**
- * @brief Initialize the global threadpool.
+ * @brief Stops all the workers and frees the threadpool.
  *
- *    @return Returns 0 on success and -1 if there's already a threadpool.
+ * Queued jobs that haven't started are discarded with a warning.
  */
-int threadpool_init (void)
+void threadpool_exit (void)
 {
-#if SDL_VERSION_ATLEAST(1,3,0)
-   MAXTHREADS = SDL_GetCPUCount() + 1; /* SDL 1.3 is pretty cool. */
-#endif /* SDL_VERSION_ATLEAST(1,3,0) */
+   int i, n;
+
+   if (pool_deques == NULL)
+      return;
+
+   /* Wake everyone up so they see the signal. */
+   pool_stop = 1;
+   for (i=0; i<pool_nworkers; i++)
+      SDL_SemPost( pool_jobs );
+   for (i=0; i<pool_nworkers; i++)
+      if (pool_threads[i] != NULL)
+         SDL_WaitThread( pool_threads[i], NULL );
+
+   /* Nobody is left to run them. */
+   n = 0;
+   for (i=0; i<pool_nworkers+1; i++)
+      n += pool_deques[i].tail - pool_deques[i].head;
+   if (n > 0)
+      WARN("Threadpool exiting with %d queued jobs, discarding them", n);
 
-   /* There's already a queue */
-   if (global_queue != NULL) {
-      WARN("Threadpool has already been initialized!");
-      return -1;
+   /* Clean up. */
+   for (i=0; i<pool_nworkers+1; i++) {
+      SDL_DestroyMutex( pool_deques[i].lock );
+      free( pool_deques[i].jobs );
    }
+   free( pool_deques );
+   free( pool_threads );
+   free( pool_ids );
+   free( pool_index );
+   SDL_DestroySemaphore( pool_jobs );
+   pool_deques   = NULL;
+   pool_threads  = NULL;
+   pool_ids      = NULL;
+   pool_index    = NULL;
+   pool_jobs     = NULL;
+   pool_nworkers = 0;
+}
 
-   /* Create the global queue queue */
-   global_queue = tq_create();
 
-   /* Initialize the threadpool handler. */
-   SDL_CreateThread( threadpool_handler,
-#if SDL_VERSION_ATLEAST(1,3,0)
-               "threadpool_handler",
-#endif /* SDL_VERSION_ATLEAST(1,3,0) */
-               NULL );
+/**
+ * @brief Gets the number of threads that can run jobs at once.
+ *
+ * This includes the thread waiting on the jobs.
+ *
+ *    @return Number of threads.
+ */
+int threadpool_nthreads (void)
+{
+   return pool_nworkers + 1;
+}
+
+
+/**
+ * @brief Enqueues a new job for the threadpool.
+ *
+ *    @param function The function (job) to be called (executed).
+ *    @param data The arguments for the function.
+ *    @return Returns 0 on success and -2 if there was no threadpool.
+ */
+int threadpool_newJob( int (*function)(void *), void *data )
+{
+   ThreadJob job;
+
+   if (pool_deques == NULL) {
+      WARN("Threadpool has not been initialized yet!");
+      return -2;
+   }
+
+   job.function = function;
+   job.data     = data;
+   job.group    = NULL;
+   tp_push( &job );
 
    return 0;
 }
 
+
 /**
- * @brief Creates a new vpool queue.
- *
- * This is just an interface to make running a number of jobs and then wait for
- *  them to finish more pleasant. You should not nest vpools as of now as there
- *  are only a limit number of worker threads and we can't have them wait for a
- *  thread to finish that doesn't exist.
- *
- * If you really want to sort of nest vpools, you should start a new thread
- *  instead of using the threadpool. I might add a vpool_waitInANewThread
- *  function some day.
+ * @brief Creates a fork/join group.
  *
- *    @return Returns a ThreadQueue to be used.
+ *    @return The new group.
  */
-ThreadQueue* vpool_create (void)
+ThreadGroup* threadgroup_create (void)
 {
-   return tq_create();
+   ThreadGroup *group;
+
+   group          = calloc( 1, sizeof(ThreadGroup) );
+   group->lock    = SDL_CreateMutex();
+   group->cond    = SDL_CreateCond();
+   group->pending = 0;
+
+   return group;
 }
 
+
 /**
- * @brief Enqueue a job in the vpool queue.
+ * @brief Spawns a job in a group.
  *
- * @warning Do NOT enqueue jobs that wait for another job to be done, as this
- *          could lead to a deadlock.
+ * If the threadpool isn't running the job is run right away.
  *
- * @warning Do NOT enqueue jobs that wait for a vpool, as this could lead to a
- *          deadlock.
+ *    @param group Group to spawn in.
+ *    @param function The function (job) to be called (executed).
+ *    @param data The arguments for the function.
  */
-void vpool_enqueue( ThreadQueue *queue, int (*function)(void *), void *data )
+void threadgroup_spawn( ThreadGroup* group, int (*function)(void *), void *data )
 {
-   ThreadQueueData *node;
+   ThreadJob job;
 
-   /* Allocate and set up data. */
-   node           = calloc( 1, sizeof(ThreadQueueData) );
-   node->data     = data;
-   node->function = function;
+   if (pool_deques == NULL) {
+      function( data );
+      return;
+   }
+
+   SDL_mutexP( group->lock );
+   group->pending++;
+   SDL_mutexV( group->lock );
 
-   /* Add to vpool. */
-   tq_enqueue( queue, node );
+   job.function = function;
+   job.data     = data;
+   job.group    = group;
+   tp_push( &job );
 }
 
+
 /**
- * @brief A special vpool worker that signals the waiting thread when all jobs
- *        are done.
+ * @brief Waits until all the jobs in a group are done and frees the group.
  *
- * It uses a mutex+condition variable+counter.
+ * The calling thread runs the queued jobs of the group while it waits.
+ *
+ *    @param group Group to wait on.
  */
-static int vpool_worker( void *data )
+void threadgroup_wait( ThreadGroup* group )
 {
-   int cnt;
-   vpoolThreadData *work;
+   int done, self;
+   ThreadJob job;
+
+   self = tp_self();
 
-   work = (vpoolThreadData*) data;
+   while (1) {
+      SDL_mutexP( group->lock );
+      done = (group->pending <= 0);
+      SDL_mutexV( group->lock );
+      if (done)
+         break;
 
-   /* Do work */
-   work->node->function( work->node->data );
+      /* Help out with our own jobs. */
+      if ((pool_jobs != NULL) && (tp_claimGroup( self, group, &job ) > 0)) {
+         tp_run( &job );
+         continue;
+      }
 
-   /* Decrement the counter and signal vpool_wait if all threads are done */
-   SDL_mutexP( work->mutex );
-   cnt   = *(work->count) - 1;
-   if (cnt <= 0)                    /* All jobs done. */
-      SDL_CondSignal( work->cond );  /* Signal waiting thread */
-   *(work->count) = cnt;
-   SDL_mutexV( work->mutex );
+      /* Our jobs are running elsewhere, wait a bit for them to finish. */
+      SDL_mutexP( group->lock );
+      if (group->pending > 0)
+         SDL_CondWaitTimeout( group->cond, group->lock, THREADPOOL_WAIT );
+      SDL_mutexV( group->lock );
+   }
 
+   SDL_DestroyCond( group->cond );
+   SDL_DestroyMutex( group->lock );
+   free( group );
+}
+
+
+/**
+ * @brief Runs a range of a parallel for.
+ */
+static int threadpool_rangeWorker( void *data )
+{
+   ThreadRange *r = (ThreadRange*) data;
+   r->function( r->start, r->end, r->data );
    return 0;
 }
 
-/* @brief Run every job in the vpool queue and block until every job in the
- *        queue is done.
+
+/**
+ * @brief Runs a function over a range in parallel.
  *
- * @note It destroys the queue when it's done.
+ * The range [0,n) is split into chunks of at least grain elements.  The
+ *  function is called once per chunk, possibly from different threads, and
+ *  this blocks until all the chunks are done.
+ *
+ *    @param n Number of elements.
+ *    @param grain Minimum number of elements per chunk.
+ *    @param function Function to run on [start,end).
+ *    @param data Data to pass to the function.
  */
-void vpool_wait( ThreadQueue *queue )
+void threadpool_parallelFor( int n, int grain,
+      void (*function)(int start, int end, void *data), void *data )
 {
-   int i, cnt;
-   SDL_cond *cond;
-   SDL_mutex *mutex;
-   vpoolThreadData *arg;
-   ThreadQueueData *node;
-
-   /* Create temporary threading structures. */
-   cond  = SDL_CreateCond();
-   mutex = SDL_CreateMutex();
-   /* This might be a little ugly (and inefficient?) */
-   cnt   = SDL_SemValue( queue->semaphore );
-
-   /* Allocate all vpoolThreadData objects */
-   arg = calloc( cnt, sizeof(vpoolThreadData) );
-
-   SDL_mutexP( mutex );
-   /* Initialize the vpoolThreadData */
-   for (i=0; i<cnt; i++) {
-      /* This is needed to keep the invariants of the queue */
-      while (SDL_SemWait( queue->semaphore ) == -1) {
-          /* Again, a really bad idea */
-          WARN("SDL_SemWait failed! Error: %s", SDL_GetError());
-      }
-      node = tq_dequeue( queue );
-
-      /* Set up arguments. */
-      arg[i].node    = node;
-      arg[i].cond    = cond;
-      arg[i].mutex   = mutex;
-      arg[i].count   = &cnt;
+   int i, nranges, chunk;
+   ThreadRange *ranges;
+   ThreadGroup *group;
+
+   if (n <= 0)
+      return;
+   grain = MAX( 1, grain );
+
+   /* Not worth it. */
+   if ((pool_deques == NULL) || (n <= grain)) {
+      function( 0, n, data );
+      return;
+   }
 
-      /* Launch new job. */
-      threadpool_newJob( vpool_worker, &arg[i] );
+   /* Split the work up. */
+   chunk   = MAX( grain, (n + threadpool_nthreads()*THREADPOOL_SPLIT - 1) /
+         (threadpool_nthreads()*THREADPOOL_SPLIT) );
+   nranges = (n + chunk - 1) / chunk;
+   ranges  = malloc( nranges * sizeof(ThreadRange) );
+   for (i=0; i<nranges; i++) {
+      ranges[i].function = function;
+      ranges[i].data     = data;
+      ranges[i].start    = i*chunk;
+      ranges[i].end      = MIN( n, (i+1)*chunk );
    }
 
-   /* Wait for the threads to finish */
-   SDL_CondWait( cond, mutex );
-   SDL_mutexV( mutex );
+   /* Spawn all but the first, which we run ourselves. */
+   group = threadgroup_create();
+   for (i=1; i<nranges; i++)
+      threadgroup_spawn( group, threadpool_rangeWorker, &ranges[i] );
+   threadpool_rangeWorker( &ranges[0] );
+   threadgroup_wait( group );
 
-   /* Clean up */
-   SDL_DestroyMutex( mutex );
-   SDL_DestroyCond( cond );
-   tq_destroy( queue );
-   free( arg );
+   free( ranges );
 }
 
 
+/**
+ * @brief Creates a new vpool queue.
+ *
+ * This is just an interface to make running a number of jobs and then wait for
+ *  them to finish more pleasant.  Jobs may start as soon as they are enqueued.
+ *
+ *    @return Returns a ThreadQueue to be used.
+ */
+ThreadQueue* vpool_create (void)
+{
+   ThreadQueue *queue;
+
+   queue        = calloc( 1, sizeof(ThreadQueue) );
+   queue->group = threadgroup_create();
+
+   return queue;
+}
+
+
+/**
+ * @brief Enqueue a job in the vpool queue.
+ */
+void vpool_enqueue( ThreadQueue *queue, int (*function)(void *), void *data )
+{
+   threadgroup_spawn( queue->group, function, data );
+}
+
+
+/* @brief Run every job in the vpool queue and block until every job in the
+ *        queue is done.
+ *
+ * @note It destroys the queue when it's done.
+ */
+void vpool_wait( ThreadQueue *queue )
+{
+   threadgroup_wait( queue->group );
+   free( queue );
+}
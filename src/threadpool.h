@@ -21,18 +21,37 @@
 struct ThreadQueue_;
 typedef struct ThreadQueue_ ThreadQueue;
 
+struct ThreadGroup_;
+typedef struct ThreadGroup_ ThreadGroup;
+
 
 /* Initializes the threadpool */
 int threadpool_init( void );
 
+/* Stops the worker threads and cleans up */
+void threadpool_exit( void );
+
+/* Number of threads that can run jobs, including the caller */
+int threadpool_nthreads( void );
+
 /* Enqueues a new job */
 int threadpool_newJob( int (*function)(void *), void *data );
 
+/* Fork/join groups. The thread waiting on a group runs jobs while it waits,
+ * so groups may be nested safely. */
+ThreadGroup* threadgroup_create( void );
+void threadgroup_spawn( ThreadGroup* group, int (*function)(void *), void *data );
+void threadgroup_wait( ThreadGroup* group );
+
+/* Runs function over [0,n) split into ranges of at least grain elements and
+ * blocks until all ranges are done. */
+void threadpool_parallelFor( int n, int grain,
+      void (*function)(int start, int end, void *data), void *data );
+
 /* Creates a new vpool queue */
 ThreadQueue* vpool_create( void );
 
-/* Enqueue a job in the vpool queue. Do NOT enqueue a job that has to wait for
- * another job to be done as this could lead to a deadlock. */
+/* Enqueue a job in the vpool queue. */
 void vpool_enqueue( ThreadQueue* queue, int (*function)(void *), void *data );
 
 /* Run every job in the vpool queue and block untill every job in the queue is
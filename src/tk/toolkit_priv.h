@@ -10,6 +10,7 @@
 
 #include "naev.h"
 #include "log.h"
+#include "nhash.h"
 
 #include "tk/widget.h"
 
@@ -62,10 +63,15 @@ typedef enum WidgetStatus_ {
 #define WGT_FLAG_RAWINPUT     (1<<1)   /**< Widget should always get raw input. */
 #define WGT_FLAG_ALWAYSMMOVE  (1<<2)   /**< Widget should always get mouse motion events. */
 #define WGT_FLAG_FOCUSED      (1<<3)   /**< Widget is focused. */
+#define WGT_FLAG_DIRTY        (1<<4)   /**< Widget changed since the window was cached. */
+#define WGT_FLAG_UNCACHED     (1<<5)   /**< Widget is rendered every frame, outside of the window cache. */
+#define WGT_FLAG_LIVE         (1<<6)   /**< Widget is not in the window cache this frame. */
+#define WGT_FLAG_DEFERRED     (1<<7)   /**< Widget is waiting for deferred images, kept out of the cache meanwhile. */
 #define WGT_FLAG_KILL         (1<<9)   /**< Widget should die. */
 #define wgt_setFlag(w,f)      ((w)->flags |= (f)) /**< Sets a widget flag. */
 #define wgt_rmFlag(w,f)       ((w)->flags &= ~(f)) /**< Removes a widget flag. */
 #define wgt_isFlag(w,f)       ((w)->flags & (f)) /**< Checks if a widget has a fla.g */
+#define wgt_dirty(w)          wgt_setFlag(w,WGT_FLAG_DIRTY) /**< Marks a widget as needing to be rendered again. */
 
 
 /**
@@ -136,10 +142,13 @@ typedef struct Widget_ {
 #define WINDOW_NORENDER    (1<<2) /**< Window does not render even if it should. */
 #define WINDOW_NOBORDER    (1<<3) /**< Window does not need border. */
 #define WINDOW_FULLSCREEN  (1<<4) /**< Window is fullscreen. */
+#define WINDOW_DIRTY       (1<<5) /**< Window cache must be rendered again. */
+#define WINDOW_NOCACHE     (1<<6) /**< Window renders directly, not through a cache. */
 #define WINDOW_KILL        (1<<9) /**< Window should die. */
 #define window_isFlag(w,f) ((w)->flags & (f)) /**< Checks a window flag. */
 #define window_setFlag(w,f) ((w)->flags |= (f)) /**< Sets a window flag. */
 #define window_rmFlag(w,f) ((w)->flags &= ~(f)) /**< Removes a window flag. */
+#define window_dirty(w)    window_setFlag(w,WINDOW_DIRTY) /**< Marks a window as needing to be rendered again. */
 
 
 /**
@@ -174,7 +183,10 @@ typedef struct Window_ {
    int exposed; /**< Whether window is visible or hidden. */
    int focus; /**< Current focused widget. */
    Widget *widgets; /**< Widget storage. */
+   NameHash wgt_hash; /**< Maps widget names to widgets. */
    void *udata; /**< Custom data of the window. */
+
+   glFbo *fbo; /**< Cached render of the window, NULL if not cached. */
 } Window;
 
 
@@ -198,6 +210,7 @@ void toolkit_nextFocus( Window *wdw );
 void toolkit_prevFocus( Window *wdw );
 void toolkit_focusWidget( Window *wdw, Widget *wgt );
 void toolkit_defocusWidget( Window *wdw, Widget *wgt );
+void toolkit_setDeferred( Widget *wgt, int pending );
 
 
 /* Render stuff. */
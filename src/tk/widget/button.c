@@ -151,6 +151,7 @@ void window_disableButton( const unsigned int wid, char* name )
 
    /* Disable button. */
    wgt->dat.btn.disabled = 1;
+   wgt_dirty( wgt );
 
    /* Sanitize focus. */
    wdw = window_wget(wid);
@@ -196,6 +197,7 @@ void window_enableButton( const unsigned int wid, char *name )
    /* Enable button. */
    wgt->dat.btn.disabled = 0;
    wgt_setFlag(wgt, WGT_FLAG_CANFOCUS);
+   wgt_dirty( wgt );
 }
 
 
@@ -219,6 +221,7 @@ void window_buttonCaption( const unsigned int wid, char *name, char *display )
    if (wgt->dat.btn.display != NULL)
       free(wgt->dat.btn.display);
    wgt->dat.btn.display = strdup(display);
+   wgt_dirty( wgt );
 
    if (wgt->dat.btn.key != 0)
       btn_updateHotkey(wgt);
@@ -109,6 +109,7 @@ void window_checkboxCaption( const unsigned int wid, const char *name, char *dis
    if (wgt->dat.chk.display != NULL)
       free(wgt->dat.chk.display);
    wgt->dat.chk.display = strdup(display);
+   wgt_dirty( wgt );
 }
 
 
@@ -142,6 +143,7 @@ int window_checkboxSet( const unsigned int wid, const char *name, int state )
       return -1;
 
    wgt->dat.chk.state = state;
+   wgt_dirty( wgt );
    return wgt->dat.chk.state;
 }
 
@@ -56,6 +56,7 @@ void window_addCust( const unsigned int wid,
 
    /* generic */
    wgt->type   = WIDGET_CUST;
+   wgt_setFlag( wgt, WGT_FLAG_UNCACHED ); /* Can draw anything at any time. */
 
    /* specific */
    wgt->render          = cst_render;
@@ -258,6 +258,7 @@ static void fad_setValue( Widget *fad, double value )
    /* Sanity check. */
    fad->dat.fad.value = CLAMP( fad->dat.fad.min, fad->dat.fad.max,
          fad->dat.fad.value );
+   wgt_dirty( fad );
 
    /* Run function if needed. */
    if (fad->dat.fad.fptr != NULL)
@@ -13,6 +13,7 @@
 
 
 static void img_render( Widget* img, double bx, double by );
+static void img_setDefer( Widget* img, glTexDefer* defer, int w, int h );
 
 
 /**
@@ -44,6 +45,8 @@ void window_addImage( const unsigned int wid,
    /* specific */
    wgt->render          = img_render;
    wgt->dat.img.image   = image;
+   wgt->dat.img.defer   = NULL;
+   wgt->dat.img.fit     = 0;
    wgt->dat.img.border  = border;
    wgt->dat.img.colour  = cWhite; /* normal colour */
 
@@ -54,6 +57,79 @@ void window_addImage( const unsigned int wid,
 }
 
 
+/**
+ * @brief Adds an image widget showing an image once it's decoded.
+ *
+ * A placeholder is drawn until then, the deferred image is not freed.
+ *
+ *    @param wid ID of the window to add the widget to.
+ *    @param x X position within the window to use.
+ *    @param y Y position within the window to use.
+ *    @param w Width, 0 takes the width of the image once decoded.
+ *    @param h Height, 0 takes the height of the image once decoded.
+ *    @param name Name of the widget to use internally.
+ *    @param defer Deferred image to use.
+ *    @param border Whether to use a border.
+ */
+void window_addImageDefer( const unsigned int wid,
+                           const int x, const int y,
+                           const int w, const int h,
+                           char* name, glTexDefer* defer, int border )
+{
+   Widget *wgt;
+
+   window_addImage( wid, x, y, MAX(w,0), MAX(h,0), name, NULL, border );
+   wgt = window_getwgt( wid, name );
+   if ((wgt == NULL) || (wgt->type != WIDGET_IMAGE))
+      return;
+   img_setDefer( wgt, defer, w, h );
+}
+
+
+/**
+ * @brief Sets the deferred image of an image widget.
+ *
+ *    @param img Image widget to set.
+ *    @param defer Deferred image to set.
+ *    @param w New width, 0 uses image, -1 doesn't change and >0 sets directly.
+ *    @param h New height, 0 uses image, -1 doesn't change and >0 sets directly.
+ */
+static void img_setDefer( Widget* img, glTexDefer* defer, int w, int h )
+{
+   glTexture *tex;
+
+   img->dat.img.image = NULL;
+   img->dat.img.defer = defer;
+   img->dat.img.fit   = 0;
+
+   if (w > 0)
+      img->w = w;
+   if (h > 0)
+      img->h = h;
+
+   /* Size may have to wait for the image. */
+   tex = gl_deferGet( defer );
+   if ((w == 0) || (h == 0)) {
+      if (tex != NULL) {
+         if (w == 0)
+            img->w = tex->sw;
+         if (h == 0)
+            img->h = tex->sh;
+      }
+      else if (gl_deferPending( defer ))
+         img->dat.img.fit = 1;
+      else {
+         if (w == 0)
+            img->w = 0;
+         if (h == 0)
+            img->h = 0;
+      }
+   }
+
+   toolkit_setDeferred( img, gl_deferPending( defer ) );
+}
+
+
 /**
  * @brief Renders a image widget.
  *
@@ -65,6 +141,7 @@ static void img_render( Widget* img, double bx, double by )
 {
    double x,y;
    double w,h;
+   glTexture *tex;
 
    /* Values. */
    x = bx + img->x;
@@ -75,8 +152,26 @@ static void img_render( Widget* img, double bx, double by )
    /*
     * image
     */
-   if (img->dat.img.image != NULL) {
-      gl_blitScale( img->dat.img.image, x, y,
+   tex = img->dat.img.image;
+   if ((tex == NULL) && (img->dat.img.defer != NULL)) {
+      tex = gl_deferGet( img->dat.img.defer );
+
+      /* Placeholder until it's decoded. */
+      if (gl_deferPending( img->dat.img.defer ))
+         toolkit_drawRect( x, y, w, h, toolkit_colDark, NULL );
+      else {
+         if (img->dat.img.fit && (tex != NULL)) {
+            img->w = tex->sw;
+            img->h = tex->sh;
+            w = img->w;
+            h = img->h;
+         }
+         img->dat.img.fit = 0;
+         toolkit_setDeferred( img, 0 );
+      }
+   }
+   if (tex != NULL) {
+      gl_blitScale( tex, x, y,
             w, h, &img->dat.img.colour );
    }
 
@@ -130,6 +225,7 @@ void window_modifyImage( const unsigned int wid,
       char* name, glTexture* image, int w, int h )
 {
    Widget *wgt;
+   int ow, oh;
 
    /* Get the widget. */
    wgt = window_getwgt(wid,name);
@@ -144,12 +240,55 @@ void window_modifyImage( const unsigned int wid,
 
    /* Set the image. */
    wgt->dat.img.image = image;
+   wgt->dat.img.defer = NULL;
+   wgt->dat.img.fit   = 0;
+   toolkit_setDeferred( wgt, 0 );
 
    /* Adjust size. */
+   ow = wgt->w;
+   oh = wgt->h;
    if (w >= 0)
       wgt->w = (w > 0) ? w : ((image==NULL) ? 0 : wgt->dat.img.image->sw);
    if (h >= 0)
       wgt->h = (h > 0) ? h : ((image==NULL) ? 0 : wgt->dat.img.image->sh);
+
+   /* Old area must be cleared if it shrunk. */
+   if ((wgt->w != ow) || (wgt->h != oh))
+      window_dirty( window_wget(wid) );
+   else
+      wgt_dirty( wgt );
+}
+
+
+/**
+ * Modifies an existing image's image to one shown once decoded.
+ *
+ *    @param wid ID of the window to get widget from.
+ *    @param name Name of the widget to modify image of.
+ *    @param defer New deferred image to set, not freed.
+ *    @param w New width to set, 0 uses image, -1 doesn't change and >0 sets directly.
+ *    @param h New height to set, 0 uses image, -1 doesn't change and >0 sets directly.
+ */
+void window_modifyImageDefer( const unsigned int wid,
+      char* name, glTexDefer* defer, int w, int h )
+{
+   Widget *wgt;
+
+   /* Get the widget. */
+   wgt = window_getwgt(wid,name);
+   if (wgt == NULL)
+      return;
+
+   /* Check the type. */
+   if (wgt->type != WIDGET_IMAGE) {
+      WARN("Not modifying image on non-image widget '%s'.", name);
+      return;
+   }
+
+   img_setDefer( wgt, defer, w, h );
+
+   /* Size may have changed. */
+   window_dirty( window_wget(wid) );
 }
 
 
@@ -178,5 +317,6 @@ void window_imgColour( const unsigned int wid,
 
    /* Set the colour. */
    wgt->dat.img.colour = *colour;
+   wgt_dirty( wgt );
 }
 
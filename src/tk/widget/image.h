@@ -17,6 +17,8 @@
  */
 typedef struct WidgetImageData_{
    glTexture* image; /**< Image to display. */
+   glTexDefer* defer; /**< Image to display once decoded, used if image is NULL. */
+   int fit; /**< Whether to take the size of the deferred image once decoded. */
    glColour colour; /**< Colour to warp to. */
    int border; /**< 1 if widget should have border. */
 } WidgetImageData;
@@ -27,10 +29,16 @@ void window_addImage( const unsigned int wid,
       const int x, const int y, /* position */
       const int w, const int h, /* dimensions */
       char* name, glTexture* image, int border ); /* label and image itself */
+void window_addImageDefer( const unsigned int wid,
+      const int x, const int y, /* position */
+      const int w, const int h, /* dimensions */
+      char* name, glTexDefer* defer, int border );
 
 /* Misc functions. */
 void window_modifyImage( const unsigned int wid,
       char* name, glTexture* image, int w, int h );
+void window_modifyImageDefer( const unsigned int wid,
+      char* name, glTexDefer* defer, int w, int h );
 void window_imgColour( const unsigned int wid,
       char* name, const glColour* colour );
 glTexture* window_getImage( const unsigned int wid, char* name );
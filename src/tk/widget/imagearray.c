@@ -20,6 +20,10 @@
 /* Render. */
 static void iar_render( Widget* iar, double bx, double by );
 static void iar_renderOverlay( Widget* iar, double bx, double by );
+static void iar_renderBackground( Widget* iar, int pos, int is_selected,
+      double xcurs, double ycurs, double w, double h );
+static void iar_renderText( Widget* iar, int pos, int is_selected,
+      const glColour *fontcolour, double xcurs, double ycurs, double w, double h );
 /* Key. */
 static int iar_key( Widget* iar, SDLKey key, SDLMod mod );
 /* Mouse. */
@@ -39,6 +43,7 @@ static Widget *iar_getWidget( const unsigned int wid, const char *name );
 static char* toolkit_getNameById( Widget *wgt, int elem );
 /* Clean up. */
 static void iar_cleanup( Widget* iar );
+static void iar_pollDefers( Widget* iar );
 
 
 /**
@@ -94,6 +99,7 @@ void window_addImageArray( const unsigned int wid,
    wgt->mmoveevent         = iar_mmove;
    wgt_setFlag(wgt, WGT_FLAG_ALWAYSMMOVE);
    wgt->dat.iar.images     = tex;
+   wgt->dat.iar.defers     = NULL;
    wgt->dat.iar.captions   = caption;
    wgt->dat.iar.nelements  = nelem;
    wgt->dat.iar.selected   = 0;
@@ -135,15 +141,13 @@ static void iar_getDim( Widget* iar, double *w, double *h )
  */
 static void iar_render( Widget* iar, double bx, double by )
 {
-   int i,j, pos;
+   int i,j, pos, pass;
    double x,y, w,h, xcurs,ycurs;
    double scroll_pos;
-   int xelem, yelem;
+   int xelem, yelem, jmin, jmax;
    double xspace;
-   const glColour *c, *dc, *lc;
    glColour tc, fontcolour;
    int is_selected;
-   int tw;
    double d;
 
    /*
@@ -161,6 +165,10 @@ static void iar_render( Widget* iar, double bx, double by )
    yelem = iar->dat.iar.yelem;
    xspace = (double)(((int)iar->w - 10) % (int)w) / (double)(xelem + 1);
 
+   /* Pick up the images decoded meanwhile. */
+   if (iar->dat.iar.defers != NULL)
+      iar_pollDefers( iar );
+
    /* background */
    toolkit_drawRect( x, y, iar->w, iar->h, &cBlack, NULL );
 
@@ -174,129 +182,70 @@ static void iar_render( Widget* iar, double bx, double by )
       scroll_pos = iar->dat.iar.pos / d;
    toolkit_drawScrollbar( x + iar->w - 10., y, 10., iar->h, scroll_pos );
 
+   /* Only the rows around the viewport are walked. */
+   jmin = MAX( 0, (int)(iar->dat.iar.pos / h) - 1 );
+   jmax = MIN( yelem, (int)((iar->dat.iar.pos + iar->h) / h) + 1 );
+
    /*
     * Main drawing loop.
+    *
+    * Done in three passes so the images can be batched: backgrounds, then
+    *  images, then the captions and outlines on top.
     */
    gl_clipRect( x, y, iar->w, iar->h );
-   ycurs = y + iar->h - h + iar->dat.iar.pos;
-   for (j=0; j<yelem; j++) {
-      xcurs = x + xspace;
-
-      /*  Skip rows that are wholly outside of the viewport. */
-      if ((ycurs > y + iar->h) || (ycurs + h < y)) {
-         ycurs -= h;
-         continue;
-      }
-
-      for (i=0; i<xelem; i++) {
-
-         /* Get position. */
-         pos = j*xelem + i;
+   for (pass=0; pass<3; pass++) {
+      if (pass == 1)
+         gl_batchBegin();
+      ycurs = y + iar->h - h + iar->dat.iar.pos - jmin*h;
+      for (j=jmin; j<jmax; j++) {
+         xcurs = x + xspace;
+
+         /*  Skip rows that are wholly outside of the viewport. */
+         if ((ycurs > y + iar->h) || (ycurs + h < y)) {
+            ycurs -= h;
+            continue;
+         }
 
-         /* Out of elements. */
-         if ((pos) >= iar->dat.iar.nelements)
-            break;
+         for (i=0; i<xelem; i++) {
 
-         is_selected = (iar->dat.iar.selected == pos) ? 1 : 0;
+            /* Get position. */
+            pos = j*xelem + i;
 
-         fontcolour = cWhite;
-         /* Draw background. */
-         if (is_selected)
-            toolkit_drawRect( xcurs + 2.,
-                  ycurs + 2.,
-                  w - 5., h - 5., &cDConsole, NULL );
-         else if (iar->dat.iar.background != NULL) {
-            toolkit_drawRect( xcurs + 2.,
-                  ycurs + 2.,
-                  w - 5., h - 5., &iar->dat.iar.background[pos], NULL );
+            /* Out of elements. */
+            if ((pos) >= iar->dat.iar.nelements)
+               break;
 
-            tc = iar->dat.iar.background[pos];
-
-            if (((tc.r + tc.g + tc.b) / 3) > 0.5)
-               fontcolour = cBlack;
-         }
+            is_selected = (iar->dat.iar.selected == pos) ? 1 : 0;
 
-         /* image */
-         if (iar->dat.iar.images[pos] != NULL)
-            gl_blitScale( iar->dat.iar.images[pos],
-                  xcurs + 5., ycurs + gl_smallFont.h + 7.,
-                  iar->dat.iar.iw, iar->dat.iar.ih, NULL );
-
-         /* caption */
-         if (iar->dat.iar.captions[pos] != NULL)
-            gl_printMidRaw( &gl_smallFont, iar->dat.iar.iw, xcurs + 5., ycurs + 5.,
-                     (is_selected) ? &cBlack : &fontcolour,
-                     iar->dat.iar.captions[pos] );
-
-         /* quantity. */
-         if (iar->dat.iar.quantity != NULL) {
-            if (iar->dat.iar.quantity[pos] != NULL) {
-               /* Rectangle to highlight better. */
-               tw = gl_printWidthRaw( &gl_smallFont,
-                     iar->dat.iar.quantity[pos] );
-
-               if (is_selected)
-                  tc = cDConsole;
-               else if (iar->dat.iar.background != NULL)
-                  tc = iar->dat.iar.background[pos];
-               else
-                  tc = cBlack;
-
-               tc.a = 0.75;
-               toolkit_drawRect( xcurs + 2.,
-                     ycurs + 5. + iar->dat.iar.ih,
-                     tw + 4., gl_smallFont.h + 4., &tc, NULL );
-               /* Quantity number. */
-               gl_printMaxRaw( &gl_smallFont, iar->dat.iar.iw,
-                     xcurs + 5., ycurs + iar->dat.iar.ih + 7.,
-                     &fontcolour, iar->dat.iar.quantity[pos] );
+            fontcolour = cWhite;
+            if (!is_selected && (iar->dat.iar.background != NULL)) {
+               tc = iar->dat.iar.background[pos];
+               if (((tc.r + tc.g + tc.b) / 3) > 0.5)
+                  fontcolour = cBlack;
             }
-         }
 
-         /* Slot type. */
-         if (iar->dat.iar.slottype != NULL) {
-            if (iar->dat.iar.slottype[pos] != NULL) {
-               /* Rectangle to highlight better. Width is a hack due to lack of monospace font. */
-               tw = gl_printWidthRaw( &gl_smallFont, "M" );
-
-               if (is_selected)
-                  tc = cDConsole;
-               else if (iar->dat.iar.background != NULL)
-                  tc = iar->dat.iar.background[pos];
-               else
-                  tc = cBlack;
-
-               tc.a = 0.75;
-               toolkit_drawRect( xcurs + iar->dat.iar.iw - 6.,
-                     ycurs + 5. + iar->dat.iar.ih,
-                     tw + 2., gl_smallFont.h + 4., &tc, NULL );
-               /* Slot size letter. */
-               gl_printMaxRaw( &gl_smallFont, iar->dat.iar.iw,
-                     xcurs + iar->dat.iar.iw - 4., ycurs + iar->dat.iar.ih + 7.,
-                     &fontcolour, iar->dat.iar.slottype[pos] );
+            if (pass == 0)
+               iar_renderBackground( iar, pos, is_selected, xcurs, ycurs, w, h );
+            else if (pass == 1) {
+               /* image */
+               if (iar->dat.iar.images[pos] != NULL)
+                  gl_blitScale( iar->dat.iar.images[pos],
+                        xcurs + 5., ycurs + gl_smallFont.h + 7.,
+                        iar->dat.iar.iw, iar->dat.iar.ih, NULL );
+               else if ((iar->dat.iar.defers != NULL) &&
+                     gl_deferPending( iar->dat.iar.defers[pos] ))
+                  toolkit_drawRect( xcurs + 5., ycurs + gl_smallFont.h + 7.,
+                        iar->dat.iar.iw, iar->dat.iar.ih, toolkit_colDark, NULL );
             }
+            else
+               iar_renderText( iar, pos, is_selected, &fontcolour,
+                     xcurs, ycurs, w, h );
+            xcurs += w + xspace;
          }
-
-         /* outline */
-         if (is_selected) {
-            lc = &cWhite;
-            c = &cGrey80;
-            dc = &cGrey60;
-         }
-         else {
-            lc = toolkit_colLight;
-            c = toolkit_col;
-            dc = toolkit_colDark;
-         }
-         toolkit_drawOutline( xcurs + 2.,
-               ycurs + 2.,
-               w - 4., h - 4., 1., lc, c );
-         toolkit_drawOutline( xcurs + 2.,
-               ycurs + 2.,
-               w - 4., h - 4., 2., dc, NULL );
-         xcurs += w + xspace;
+         ycurs -= h;
       }
-      ycurs -= h;
+      if (pass == 1)
+         gl_batchEnd();
    }
    gl_unclipRect();
 
@@ -308,6 +257,132 @@ static void iar_render( Widget* iar, double bx, double by )
 }
 
 
+/**
+ * @brief Sets the images of an image array that finished decoding.
+ *
+ *    @param iar Image array widget to update.
+ */
+static void iar_pollDefers( Widget* iar )
+{
+   int i, pending;
+   glTexDefer *d;
+
+   pending = 0;
+   for (i=0; i<iar->dat.iar.nelements; i++) {
+      d = iar->dat.iar.defers[i];
+      if ((d == NULL) || (iar->dat.iar.images[i] != NULL))
+         continue;
+      iar->dat.iar.images[i] = gl_deferGet( d );
+      if (gl_deferPending( d ))
+         pending++;
+   }
+
+   toolkit_setDeferred( iar, pending > 0 );
+}
+
+
+/**
+ * @brief Renders the background of an image array element.
+ */
+static void iar_renderBackground( Widget* iar, int pos, int is_selected,
+      double xcurs, double ycurs, double w, double h )
+{
+   if (is_selected)
+      toolkit_drawRect( xcurs + 2.,
+            ycurs + 2.,
+            w - 5., h - 5., &cDConsole, NULL );
+   else if (iar->dat.iar.background != NULL)
+      toolkit_drawRect( xcurs + 2.,
+            ycurs + 2.,
+            w - 5., h - 5., &iar->dat.iar.background[pos], NULL );
+}
+
+
+/**
+ * @brief Renders the caption, labels and outline of an image array element.
+ */
+static void iar_renderText( Widget* iar, int pos, int is_selected,
+      const glColour *fontcolour, double xcurs, double ycurs, double w, double h )
+{
+   const glColour *c, *dc, *lc;
+   glColour tc;
+   int tw;
+
+   /* caption */
+   if (iar->dat.iar.captions[pos] != NULL)
+      gl_printMidRaw( &gl_smallFont, iar->dat.iar.iw, xcurs + 5., ycurs + 5.,
+               (is_selected) ? &cBlack : fontcolour,
+               iar->dat.iar.captions[pos] );
+
+   /* quantity. */
+   if (iar->dat.iar.quantity != NULL) {
+      if (iar->dat.iar.quantity[pos] != NULL) {
+         /* Rectangle to highlight better. */
+         tw = gl_printWidthRaw( &gl_smallFont,
+               iar->dat.iar.quantity[pos] );
+
+         if (is_selected)
+            tc = cDConsole;
+         else if (iar->dat.iar.background != NULL)
+            tc = iar->dat.iar.background[pos];
+         else
+            tc = cBlack;
+
+         tc.a = 0.75;
+         toolkit_drawRect( xcurs + 2.,
+               ycurs + 5. + iar->dat.iar.ih,
+               tw + 4., gl_smallFont.h + 4., &tc, NULL );
+         /* Quantity number. */
+         gl_printMaxRaw( &gl_smallFont, iar->dat.iar.iw,
+               xcurs + 5., ycurs + iar->dat.iar.ih + 7.,
+               fontcolour, iar->dat.iar.quantity[pos] );
+      }
+   }
+
+   /* Slot type. */
+   if (iar->dat.iar.slottype != NULL) {
+      if (iar->dat.iar.slottype[pos] != NULL) {
+         /* Rectangle to highlight better. Width is a hack due to lack of monospace font. */
+         tw = gl_printWidthRaw( &gl_smallFont, "M" );
+
+         if (is_selected)
+            tc = cDConsole;
+         else if (iar->dat.iar.background != NULL)
+            tc = iar->dat.iar.background[pos];
+         else
+            tc = cBlack;
+
+         tc.a = 0.75;
+         toolkit_drawRect( xcurs + iar->dat.iar.iw - 6.,
+               ycurs + 5. + iar->dat.iar.ih,
+               tw + 2., gl_smallFont.h + 4., &tc, NULL );
+         /* Slot size letter. */
+         gl_printMaxRaw( &gl_smallFont, iar->dat.iar.iw,
+               xcurs + iar->dat.iar.iw - 4., ycurs + iar->dat.iar.ih + 7.,
+               fontcolour, iar->dat.iar.slottype[pos] );
+      }
+   }
+
+   /* outline */
+   if (is_selected) {
+      lc = &cWhite;
+      c = &cGrey80;
+      dc = &cGrey60;
+   }
+   else {
+      lc = toolkit_colLight;
+      c = toolkit_col;
+      dc = toolkit_colDark;
+   }
+   toolkit_drawOutline( xcurs + 2.,
+         ycurs + 2.,
+         w - 4., h - 4., 1., lc, c );
+   toolkit_drawOutline( xcurs + 2.,
+         ycurs + 2.,
+         w - 4., h - 4., 2., dc, NULL );
+}
+
+
 /**
  * @brief Renders the overlay.
  */
@@ -552,6 +627,8 @@ static void iar_cleanup( Widget* iar )
       free(iar->dat.iar.quantity);
    if (iar->dat.iar.background != NULL)
       free(iar->dat.iar.background);
+   if (iar->dat.iar.defers != NULL)
+      free(iar->dat.iar.defers);
 }
 
 
@@ -760,6 +837,7 @@ int toolkit_setImageArray( const unsigned int wid, const char* name, char* elem
    Widget *wgt = iar_getWidget( wid, name );
    if (wgt == NULL)
       return -1;
+   wgt_dirty( wgt );
 
    /* Case NULL. */
    if (elem == NULL) {
@@ -821,6 +899,7 @@ int toolkit_setImageArrayOffset( const unsigned int wid, const char* name, doubl
    Widget *wgt = iar_getWidget( wid, name );
    if (wgt == NULL)
       return -1;
+   wgt_dirty( wgt );
 
    /* Get dimensions. */
    iar_getDim( wgt, NULL, &h );
@@ -854,6 +933,7 @@ int toolkit_setImageArrayPos( const unsigned int wid, const char* name, int pos
    Widget *wgt = iar_getWidget( wid, name );
    if (wgt == NULL)
       return -1;
+   wgt_dirty( wgt );
 
    /* Set position. */
    wgt->dat.iar.selected = CLAMP( 0, wgt->dat.iar.nelements-1, pos );
@@ -897,6 +977,32 @@ int toolkit_setImageArrayAlt( const unsigned int wid, const char* name, char **a
 }
 
 
+/**
+ * @brief Sets the alt text of a single image in the image array.
+ *
+ *    @param wid Window where image array is.
+ *    @param name Name of the image array.
+ *    @param pos Position of the image.
+ *    @param alt Alt text of the image (freed), NULL to remove it.
+ *    @return 0 on success.
+ */
+int toolkit_setImageArrayAltElem( const unsigned int wid, const char* name,
+      int pos, char *alt )
+{
+   Widget *wgt = iar_getWidget( wid, name );
+   if ((wgt == NULL) || (pos < 0) || (pos >= wgt->dat.iar.nelements)) {
+      free( alt );
+      return -1;
+   }
+
+   if (wgt->dat.iar.alts == NULL)
+      wgt->dat.iar.alts = calloc( wgt->dat.iar.nelements, sizeof(char*) );
+   free( wgt->dat.iar.alts[pos] );
+   wgt->dat.iar.alts[pos] = alt;
+   return 0;
+}
+
+
 /**
  * @brief Sets the quantity text for the images in the image array.
  *
@@ -912,6 +1018,7 @@ int toolkit_setImageArrayQuantity( const unsigned int wid, const char* name,
    Widget *wgt = iar_getWidget( wid, name );
    if (wgt == NULL)
       return -1;
+   wgt_dirty( wgt );
 
    /* Clean up. */
    if (wgt->dat.iar.quantity != NULL) {
@@ -927,6 +1034,35 @@ int toolkit_setImageArrayQuantity( const unsigned int wid, const char* name,
 }
 
 
+/**
+ * @brief Sets the quantity text of a single image in the image array.
+ *
+ * Avoids rebuilding the whole array when only one element changes.
+ *
+ *    @param wid Window where image array is.
+ *    @param name Name of the image array.
+ *    @param pos Position of the image.
+ *    @param quantity Quantity of the image (freed), NULL to remove it.
+ *    @return 0 on success.
+ */
+int toolkit_setImageArrayQuantityElem( const unsigned int wid, const char* name,
+      int pos, char *quantity )
+{
+   Widget *wgt = iar_getWidget( wid, name );
+   if ((wgt == NULL) || (pos < 0) || (pos >= wgt->dat.iar.nelements)) {
+      free( quantity );
+      return -1;
+   }
+   wgt_dirty( wgt );
+
+   if (wgt->dat.iar.quantity == NULL)
+      wgt->dat.iar.quantity = calloc( wgt->dat.iar.nelements, sizeof(char*) );
+   free( wgt->dat.iar.quantity[pos] );
+   wgt->dat.iar.quantity[pos] = quantity;
+   return 0;
+}
+
+
 /**
  * @brief Sets the slot type text for the images in the image array.
  *
@@ -942,6 +1078,7 @@ int toolkit_setImageArraySlotType( const unsigned int wid, const char* name,
    Widget *wgt = iar_getWidget( wid, name );
    if (wgt == NULL)
       return -1;
+   wgt_dirty( wgt );
 
    /* Clean up. */
    if (wgt->dat.iar.slottype != NULL) {
@@ -971,6 +1108,7 @@ int toolkit_setImageArrayBackground( const unsigned int wid, const char* name,
    Widget *wgt = iar_getWidget( wid, name );
    if (wgt == NULL)
       return -1;
+   wgt_dirty( wgt );
 
    /* Free if already exists. */
    if (wgt->dat.iar.background != NULL)
@@ -982,6 +1120,40 @@ int toolkit_setImageArrayBackground( const unsigned int wid, const char* name,
 }
 
 
+/**
+ * @brief Sets the images to show once decoded for elements without an image.
+ *
+ * Placeholders are drawn until the images are decoded.
+ *
+ *    @param wid Window where image array is.
+ *    @param name Name of the image array.
+ *    @param defer Array of deferred images (freed), the images are not freed.
+ *    @return 0 on success.
+ */
+int toolkit_setImageArrayDefer( const unsigned int wid, const char* name,
+      glTexDefer **defer )
+{
+   Widget *wgt = iar_getWidget( wid, name );
+   if (wgt == NULL) {
+      free( defer );
+      return -1;
+   }
+   wgt_dirty( wgt );
+
+   /* Free if already exists. */
+   if (wgt->dat.iar.defers != NULL)
+      free( wgt->dat.iar.defers );
+
+   /* Set. */
+   wgt->dat.iar.defers = defer;
+   if (defer != NULL)
+      iar_pollDefers( wgt );
+   else
+      toolkit_setDeferred( wgt, 0 );
+   return 0;
+}
+
+
 /**
  * @brief Stores several image array attributes.
  *
@@ -18,6 +18,7 @@
  */
 typedef struct WidgetImageArrayData_ {
    glTexture **images; /**< Image array. */
+   glTexDefer **defers; /**< Images shown once decoded where images are NULL, may be NULL. */
    char **captions; /**< Corresponding caption array. */
    char **alts; /**< Alt text when mouse over. */
    char **quantity; /**< Number in top-left corner. */
@@ -64,12 +65,18 @@ int toolkit_setImageArrayPos( const unsigned int wid, const char* name, int pos
 double toolkit_getImageArrayOffset( const unsigned int wid, const char* name );
 int toolkit_setImageArrayOffset( const unsigned int wid, const char* name, double off );
 int toolkit_setImageArrayAlt( const unsigned int wid, const char* name, char **alt );
+int toolkit_setImageArrayAltElem( const unsigned int wid, const char* name,
+      int pos, char *alt );
 int toolkit_setImageArrayQuantity( const unsigned int wid, const char* name,
       char **quantity );
+int toolkit_setImageArrayQuantityElem( const unsigned int wid, const char* name,
+      int pos, char *quantity );
 int toolkit_setImageArraySlotType( const unsigned int wid, const char* name,
       char **slottype );
 int toolkit_setImageArrayBackground( const unsigned int wid, const char* name,
       glColour *bg );
+int toolkit_setImageArrayDefer( const unsigned int wid, const char* name,
+      glTexDefer **defer );
 int toolkit_saveImageArrayData( const unsigned int wid, const char *name,
       iar_data_t *iar_data );
 
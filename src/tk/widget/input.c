@@ -654,6 +654,7 @@ char* window_setInput( const unsigned int wid, char* name, const char *msg )
    }
 
    /* Set the message. */
+   wgt_dirty( wgt );
    if (msg == NULL) {
       memset( wgt->dat.inp.input, 0, wgt->dat.inp.max );
       wgt->dat.inp.pos     = 0;
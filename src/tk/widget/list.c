@@ -25,6 +25,8 @@ static int lst_mmove( Widget* lst, int x, int y, int rx, int ry );
 static void lst_cleanup( Widget* lst );
 
 static Widget *lst_getWgt( const unsigned int wid, const char* name );
+static void lst_updateHeight( Widget* lst );
+static int lst_visible( Widget* lst );
 static int lst_focus( Widget* lst, double bx, double by );
 static void lst_scroll( Widget* lst, int direction );
 
@@ -83,10 +85,7 @@ void window_addList( const unsigned int wid,
    toolkit_setPos( wdw, wgt, x, y );
 
    /* check if needs scrollbar. */
-   if (2 + (nitems * (gl_defFont.h + 2)) > (int)wgt->h)
-      wgt->dat.lst.height = (2 + gl_defFont.h) * nitems + 2;
-   else
-      wgt->dat.lst.height = 0;
+   lst_updateHeight( wgt );
 
    if (wdw->focus == -1) /* initialize the focus */
       toolkit_nextFocus( wdw );
@@ -96,6 +95,32 @@ void window_addList( const unsigned int wid,
 }
 
 
+/**
+ * @brief Updates the scrolled height of a list, 0 if it needs no scrollbar.
+ *
+ *    @param lst List to update.
+ */
+static void lst_updateHeight( Widget* lst )
+{
+   if (2 + (lst->dat.lst.noptions * (gl_defFont.h + 2)) > (int)lst->h)
+      lst->dat.lst.height = (2 + gl_defFont.h) * lst->dat.lst.noptions + 2;
+   else
+      lst->dat.lst.height = 0;
+}
+
+
+/**
+ * @brief Gets the number of options that fit in the list.
+ *
+ *    @param lst List to check.
+ *    @return Number of options in view at once.
+ */
+static int lst_visible( Widget* lst )
+{
+   return MAX( 1, (int)((lst->h - 2.) / (gl_defFont.h + 2.)) );
+}
+
+
 /**
  * @brief Renders a list widget.
  *
@@ -105,8 +130,8 @@ void window_addList( const unsigned int wid,
  */
 static void lst_render( Widget* lst, double bx, double by )
 {
-   int i;
-   double x,y, tx,ty, miny;
+   int i, end;
+   double x,y, tx,ty;
    double w, scroll_pos;
 
    w = lst->w;
@@ -133,24 +158,23 @@ static void lst_render( Widget* lst, double bx, double by )
       toolkit_drawScrollbar( x + lst->w - 12. + 1, y -1, 12., lst->h + 2, scroll_pos );
    }
 
+   /* Only the options in view are drawn. */
+   end = MIN( lst->dat.lst.noptions, lst->dat.lst.pos + lst_visible( lst ) );
+
    /* draw selected */
-   toolkit_drawRect( x, y - 1. + lst->h -
-         (1 + lst->dat.lst.selected - lst->dat.lst.pos)*(gl_defFont.h+2.),
-         w-1, gl_defFont.h + 2., &cHilight, NULL );
+   if ((lst->dat.lst.selected >= lst->dat.lst.pos) && (lst->dat.lst.selected < end))
+      toolkit_drawRect( x, y - 1. + lst->h -
+            (1 + lst->dat.lst.selected - lst->dat.lst.pos)*(gl_defFont.h+2.),
+            w-1, gl_defFont.h + 2., &cHilight, NULL );
 
-   /* draw content */
+   /* draw content, the font caches the layout of each string. */
    tx = x + 2.;
    ty = y + lst->h - 2. - gl_defFont.h;
-   miny = ty - lst->h + 2 + gl_defFont.h;
    w -= 4;
-   for (i=lst->dat.lst.pos; i<lst->dat.lst.noptions; i++) {
+   for (i=lst->dat.lst.pos; i<end; i++) {
       gl_printMaxRaw( &gl_defFont, (int)w,
             tx, ty, &cBlack, lst->dat.lst.options[i] );
       ty -= 2 + gl_defFont.h;
-
-      /* Check if out of bounds. */
-      if (ty < miny)
-         break;
    }
 }
 
@@ -359,6 +383,7 @@ static void lst_scroll( Widget* lst, int direction )
    if (lst == NULL)
       return;
 
+   wgt_dirty( lst );
    lst->dat.lst.selected -= direction;
 
    /* boundary check. */
@@ -499,8 +524,106 @@ int toolkit_setListOffset( const unsigned int wid, const char* name, int off )
       return -1;
 
    wgt->dat.lst.pos = off;
+   wgt_dirty( wgt );
    return 0;
 }
 
 
 
+
+
+/**
+ * @brief Inserts an option into a list without having to recreate it.
+ *
+ * The selected option stays the same, so the callback is not run.
+ *
+ *    @param wid Window identifier where the list is.
+ *    @param name Name of the list.
+ *    @param pos Position to insert at, -1 to append.
+ *    @param item Option to insert (will be freed automatically).
+ *    @return The position it was inserted at or -1 on error.
+ */
+int toolkit_listInsert( const unsigned int wid, const char* name, int pos, char *item )
+{
+   WidgetListData *dat;
+   char **options;
+   Widget *wgt = lst_getWgt( wid, name );
+   if ((wgt == NULL) || (item == NULL))
+      return -1;
+   dat = &wgt->dat.lst;
+
+   options = realloc( dat->options, sizeof(char*) * (dat->noptions+1) );
+   if (options == NULL) {
+      WARN("Out of Memory!");
+      return -1;
+   }
+   dat->options = options;
+
+   if ((pos < 0) || (pos > dat->noptions))
+      pos = dat->noptions;
+   memmove( &dat->options[pos+1], &dat->options[pos],
+         sizeof(char*) * (dat->noptions - pos) );
+   dat->options[pos] = item;
+   dat->noptions++;
+
+   /* Keep the same option selected and in view. */
+   if ((dat->selected >= 0) && (pos <= dat->selected))
+      dat->selected++;
+   if (pos < dat->pos)
+      dat->pos++;
+
+   lst_updateHeight( wgt );
+   wgt_dirty( wgt );
+   return pos;
+}
+
+
+/**
+ * @brief Removes an option from a list without having to recreate it.
+ *
+ * If the selected option is removed, the next one gets selected and the
+ *  callback is run.
+ *
+ *    @param wid Window identifier where the list is.
+ *    @param name Name of the list.
+ *    @param pos Position of the option to remove.
+ *    @return The option removed, which must be freed, or NULL on error.
+ */
+char* toolkit_listRemove( const unsigned int wid, const char* name, int pos )
+{
+   WidgetListData *dat;
+   char *item;
+   int removed;
+   Widget *wgt = lst_getWgt( wid, name );
+   if (wgt == NULL)
+      return NULL;
+   dat = &wgt->dat.lst;
+
+   if ((pos < 0) || (pos >= dat->noptions)) {
+      WARN("List '%s' has no option %d", name, pos);
+      return NULL;
+   }
+
+   item = dat->options[pos];
+   memmove( &dat->options[pos], &dat->options[pos+1],
+         sizeof(char*) * (dat->noptions - pos - 1) );
+   dat->noptions--;
+
+   removed = (pos == dat->selected);
+   if (pos < dat->selected)
+      dat->selected--;
+   if (pos < dat->pos)
+      dat->pos--;
+   dat->pos = CLAMP( 0, MAX(0, dat->noptions - lst_visible( wgt )), dat->pos );
+
+   lst_updateHeight( wgt );
+   wgt_dirty( wgt );
+
+   /* Nothing left to select. */
+   if (dat->noptions == 0)
+      dat->selected = -1;
+   else if (removed)
+      lst_scroll( wgt, 0 ); /* checks boundaries and triggers callback */
+
+   return item;
+}
@@ -36,6 +36,10 @@ char* toolkit_setListPos( const unsigned int wid, const char* name, int pos );
 int toolkit_getListOffset( const unsigned int wid, const char* name );
 int toolkit_setListOffset( const unsigned int wid, const char* name, int off );
 
+/* Incremental changes. */
+int toolkit_listInsert( const unsigned int wid, const char* name, int pos, char *item );
+char* toolkit_listRemove( const unsigned int wid, const char* name, int pos );
+
 
 #endif /* WGT_LIST_H */
 
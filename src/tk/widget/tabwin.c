@@ -74,6 +74,7 @@ unsigned int* window_addTabbedWindow( const unsigned int wid,
 
    /* specific */
    wgt_setFlag( wgt, WGT_FLAG_RAWINPUT );
+   wgt_setFlag( wgt, WGT_FLAG_UNCACHED ); /* Children have their own cache. */
    wgt->exposeevent        = tab_expose;
    wgt->rawevent           = tab_raw;
    wgt->render             = tab_render;
@@ -125,9 +125,15 @@ void window_modifyText( const unsigned int wid,
       return;
    }
 
+   /* Often set every frame to the same thing. */
+   if ((wgt->dat.txt.text == newstring) || ((wgt->dat.txt.text != NULL) &&
+            (newstring != NULL) && (strcmp( wgt->dat.txt.text, newstring )==0)))
+      return;
+
    /* Set text. */
    if (wgt->dat.txt.text)
       free(wgt->dat.txt.text);
    wgt->dat.txt.text = (newstring) ?  strdup(newstring) : NULL;
+   wgt_dirty( wgt );
 }
 
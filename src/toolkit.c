@@ -29,6 +29,8 @@
 #define INPUT_DELAY      conf.repeat_delay /**< Delay before starting to repeat. */
 #define INPUT_FREQ       conf.repeat_freq /**< Interval between repetition. */
 
+#define CACHE_MARGIN     4 /**< Extra area rendered again around dirty widgets for outlines. */
+
 
 static unsigned int genwid = 0; /**< Generates unique window ids, > 0 */
 
@@ -42,6 +44,7 @@ static int toolkit_delayCounter = 0; /**< Horrible hack around secondary loop. *
  */
 #define MIN_WINDOWS  3 /**< Minimum windows to prealloc. */
 static Window *windows = NULL; /**< Window linked list, not to be confused with MS windows. */
+static NameHash window_hash; /**< Maps names to the first living window with them. */
 static int window_dead = 0; /**< There are dead windows lying around. */
 
 
@@ -87,6 +90,12 @@ static Widget* toolkit_getFocus( Window *wdw );
 static void toolkit_expose( Window *wdw, int expose );
 /* render */
 static void window_renderBorder( Window* w );
+static int toolkit_wgtOverlap( const Widget *a, const Widget *b );
+static void window_updateLive( Window *w );
+static int window_renderCache( Window *w );
+/* Lookup. */
+static void window_hashWindows (void);
+static void window_hashWidgets( Window *wdw );
 /* Death. */
 static void widget_kill( Widget *wgt );
 static void window_kill( Window *wdw );
@@ -113,6 +122,34 @@ void toolkit_delay (void)
 }
 
 
+/**
+ * @brief Sets whether a widget is waiting for deferred images.
+ *
+ * Waiting widgets are rendered every frame outside of the window cache so
+ *  they can poll their images, the cache is rebuilt once they are done.
+ *
+ *    @param wgt Widget to set.
+ *    @param pending Whether it still has images to wait for.
+ */
+void toolkit_setDeferred( Widget *wgt, int pending )
+{
+   Window *wdw;
+
+   if (!pending == !wgt_isFlag( wgt, WGT_FLAG_DEFERRED ))
+      return;
+
+   if (pending)
+      wgt_setFlag( wgt, WGT_FLAG_DEFERRED );
+   else
+      wgt_rmFlag( wgt, WGT_FLAG_DEFERRED );
+
+   /* Which widgets are live must be worked out again. */
+   wdw = window_wget( wgt->wdw );
+   if (wdw != NULL)
+      window_dirty( wdw );
+}
+
+
 /**
  * @brief Sets the internal widget position.
  *
@@ -123,6 +160,8 @@ void toolkit_delay (void)
  */
 void toolkit_setPos( Window *wdw, Widget *wgt, int x, int y )
 {
+   window_dirty( wdw );
+
    /* X position. */
    if (x < 0)
       wgt->x = wdw->w - wgt->w + x;
@@ -248,6 +287,7 @@ Widget* window_newWidget( Window* w, const char *name )
    else
       wgt->name   = strdup(name);
    wgt->id     = ++w->idgen;
+   nhash_setPtr( &w->wgt_hash, wgt->name, wgt );
 
    /* Set up. */
    wlast = NULL;
@@ -258,6 +298,7 @@ Widget* window_newWidget( Window* w, const char *name )
    else
       wlast->next = wgt;
 
+   window_dirty( w );
    return wgt;
 }
 
@@ -298,15 +339,49 @@ Widget* window_getwgt( const unsigned int wid, const char* name )
       return NULL;
 
    /* Find the widget. */
-   for (wgt=wdw->widgets; wgt!=NULL; wgt=wgt->next)
-      if (strcmp(wgt->name, name)==0)
-         return wgt;
+   wgt = nhash_getPtr( &wdw->wgt_hash, name );
+   if (wgt != NULL)
+      return wgt;
 
    WARN("Widget '%s' not found in window '%u'!", name, wid );
    return NULL;
 }
 
 
+/**
+ * @brief Rebuilds the window name table, must be called when windows die or
+ *  change order.
+ *
+ * Names map to the first living window with them like a list walk would.
+ */
+static void window_hashWindows (void)
+{
+   Window *w;
+
+   nhash_clear( &window_hash );
+   for (w = windows; w != NULL; w = w->next)
+      if (!window_isFlag(w, WINDOW_KILL) &&
+            (nhash_getPtr( &window_hash, w->name ) == NULL))
+         nhash_setPtr( &window_hash, w->name, w );
+}
+
+
+/**
+ * @brief Rebuilds the widget name table of a window, must be called when
+ *  widgets are freed.
+ *
+ *    @param wdw Window to rebuild widget table of.
+ */
+static void window_hashWidgets( Window *wdw )
+{
+   Widget *wgt;
+
+   nhash_clear( &wdw->wgt_hash );
+   for (wgt=wdw->widgets; wgt!=NULL; wgt=wgt->next)
+      nhash_setPtr( &wdw->wgt_hash, wgt->name, wgt );
+}
+
+
 /**
  * @brief Gets the dimensions of a window.
  *
@@ -459,10 +534,10 @@ unsigned int window_get( const char* wdwname )
    Window *w;
    if (windows == NULL)
       return 0;
-   for (w = windows; w != NULL; w = w->next)
-      if ((strcmp(w->name,wdwname)==0) && !window_isFlag(w, WINDOW_KILL))
-         return w->id;
-   return 0;
+   w = nhash_getPtr( &window_hash, wdwname );
+   if (w == NULL)
+      return 0;
+   return w->id;
 }
 
 
@@ -562,6 +637,10 @@ unsigned int window_createFlags( const char* name,
          wlast->next = wdw;
    }
 
+   /* Older windows with the same name take precedence. */
+   if (nhash_getPtr( &window_hash, wdw->name ) == NULL)
+      nhash_setPtr( &window_hash, wdw->name, wdw );
+
    return wid;
 }
 
@@ -740,6 +819,7 @@ void window_setBorder( unsigned int wid, int enable )
       window_rmFlag( wdw, WINDOW_NOBORDER );
    else
       window_setFlag( wdw, WINDOW_NOBORDER );
+   window_dirty( wdw );
 }
 
 
@@ -844,6 +924,7 @@ void window_destroy( const unsigned int wid )
       /* Mark for death. */
       window_setFlag( wdw, WINDOW_KILL );
       window_dead = 1;
+      window_hashWindows();
 
       /* Run the close function first. */
       if (wdw->close_fptr != NULL)
@@ -880,12 +961,14 @@ static void window_kill( Window *wdw )
    /* Destroy the window. */
    if (wdw->name)
       free(wdw->name);
+   nhash_free( &wdw->wgt_hash );
    wgt = wdw->widgets;
    while (wgt != NULL) {
       wgtkill = wgt;
       wgt = wgtkill->next;
       widget_kill(wgtkill);
    }
+   gl_fboFree( wdw->fbo );
    free(wdw);
 
    /* Clear key repeat, since toolkit could miss the keyup event. */
@@ -912,11 +995,10 @@ int widget_exists( const unsigned int wid, const char* wgtname )
    }
 
    /* Check for widget. */
-   for (wgt=w->widgets; wgt!=NULL; wgt=wgt->next)
-      if (strcmp(wgtname, wgt->name)==0)
-         return !wgt_isFlag(wgt, WGT_FLAG_KILL);
-
-   return 0;
+   wgt = nhash_getPtr( &w->wgt_hash, wgtname );
+   if (wgt == NULL)
+      return 0;
+   return !wgt_isFlag(wgt, WGT_FLAG_KILL);
 }
 
 
@@ -937,10 +1019,7 @@ void window_destroyWidget( unsigned int wid, const char* wgtname )
       return;
 
    /* Get the widget. */
-   for (wgt=wdw->widgets; wgt!=NULL; wgt=wgt->next)
-      if (strcmp(wgt->name, wgtname)==0)
-         break;
-
+   wgt = nhash_getPtr( &wdw->wgt_hash, wgtname );
    if (wgt == NULL) {
       WARN("Widget '%s' not found in window '%s'", wgtname, wdw->name );
       return;
@@ -954,6 +1033,7 @@ void window_destroyWidget( unsigned int wid, const char* wgtname )
    window_dead = 1;
    wgt_rmFlag( wgt, WGT_FLAG_FOCUSED );
    wgt_setFlag( wgt, WGT_FLAG_KILL );
+   window_dirty( wdw );
 }
 
 
@@ -1580,6 +1660,150 @@ static void window_renderBorder( Window* w )
 }
 
 
+/**
+ * @brief Checks to see if two widgets overlap.
+ */
+static int toolkit_wgtOverlap( const Widget *a, const Widget *b )
+{
+   return !((a->x >= b->x + b->w) || (b->x >= a->x + a->w) ||
+         (a->y >= b->y + b->h) || (b->y >= a->y + a->h));
+}
+
+
+/**
+ * @brief Picks the widgets of a window that are not cached.
+ *
+ * Widgets flagged as uncached and those sticking out of the window are live,
+ *  as is anything drawn over a live widget so the stacking order is kept.
+ *
+ *    @param w Window to update.
+ */
+static void window_updateLive( Window *w )
+{
+   Widget *wgt, *live;
+
+   for (wgt=w->widgets; wgt!=NULL; wgt=wgt->next) {
+      wgt_rmFlag( wgt, WGT_FLAG_LIVE );
+      if (wgt->render == NULL)
+         continue;
+
+      if (wgt_isFlag( wgt, WGT_FLAG_UNCACHED | WGT_FLAG_DEFERRED ) ||
+            (wgt->x < 0) || (wgt->y < 0) ||
+            (wgt->x + wgt->w > w->w) || (wgt->y + wgt->h > w->h)) {
+         wgt_setFlag( wgt, WGT_FLAG_LIVE );
+         continue;
+      }
+
+      for (live=w->widgets; live!=wgt; live=live->next) {
+         if (wgt_isFlag( live, WGT_FLAG_LIVE ) && toolkit_wgtOverlap( wgt, live )) {
+            wgt_setFlag( wgt, WGT_FLAG_LIVE );
+            break;
+         }
+      }
+   }
+}
+
+
+/**
+ * @brief Renders a window through its cache.
+ *
+ * The border and widgets that are not live are kept in a framebuffer which is
+ *  only rendered again over the widgets that were marked dirty, or completely
+ *  if the window is dirty. Live widgets are then rendered over it.
+ *
+ *    @param w Window to render.
+ *    @return 0 on success, the window must be rendered directly otherwise.
+ */
+static int window_renderCache( Window *w )
+{
+   Widget *wgt;
+   int full, x1, y1, x2, y2;
+
+   if (window_isFlag( w, WINDOW_NOCACHE ))
+      return -1;
+   if (!gl_hasFbo()) {
+      window_setFlag( w, WINDOW_NOCACHE );
+      return -1;
+   }
+
+   /* Create the cache, also when the window got resized. */
+   if ((w->fbo != NULL) && ((w->fbo->w != w->w) || (w->fbo->h != w->h))) {
+      gl_fboFree( w->fbo );
+      w->fbo = NULL;
+   }
+   if (w->fbo == NULL) {
+      w->fbo = gl_fboCreate( w->w, w->h );
+      if (w->fbo == NULL) {
+         window_setFlag( w, WINDOW_NOCACHE );
+         return -1;
+      }
+      window_dirty( w );
+   }
+
+   /* Area to render again. */
+   full = window_isFlag( w, WINDOW_DIRTY );
+   if (full) {
+      window_updateLive( w );
+      x1 = 0;
+      y1 = 0;
+      x2 = w->w;
+      y2 = w->h;
+   }
+   else {
+      x1 = w->w;
+      y1 = w->h;
+      x2 = 0;
+      y2 = 0;
+      for (wgt=w->widgets; wgt!=NULL; wgt=wgt->next) {
+         if (!wgt_isFlag( wgt, WGT_FLAG_DIRTY ) || wgt_isFlag( wgt, WGT_FLAG_LIVE ))
+            continue;
+         x1 = MIN( x1, wgt->x - CACHE_MARGIN );
+         y1 = MIN( y1, wgt->y - CACHE_MARGIN );
+         x2 = MAX( x2, wgt->x + wgt->w + CACHE_MARGIN );
+         y2 = MAX( y2, wgt->y + wgt->h + CACHE_MARGIN );
+      }
+      x1 = MAX( x1, 0 );
+      y1 = MAX( y1, 0 );
+      x2 = MIN( x2, w->w );
+      y2 = MIN( y2, w->h );
+   }
+
+   if ((x1 < x2) && (y1 < y2)) {
+      /* Framebuffers don't nest, parent is still rendering. */
+      if (gl_fboBegin( w->fbo, w->x, w->y, w->x + x1, w->y + y1, x2-x1, y2-y1 ))
+         return -1;
+
+      if (!window_isFlag( w, WINDOW_NOBORDER ))
+         window_renderBorder(w);
+
+      for (wgt=w->widgets; wgt!=NULL; wgt=wgt->next) {
+         if ((wgt->render == NULL) || wgt_isFlag( wgt, WGT_FLAG_LIVE ))
+            continue;
+         if (!full && ((wgt->x >= x2) || (wgt->x + wgt->w <= x1) ||
+                  (wgt->y >= y2) || (wgt->y + wgt->h <= y1)))
+            continue;
+         wgt->render( wgt, w->x, w->y );
+      }
+
+      gl_fboEnd();
+   }
+
+   /* Cache is up to date. */
+   window_rmFlag( w, WINDOW_DIRTY );
+   for (wgt=w->widgets; wgt!=NULL; wgt=wgt->next)
+      wgt_rmFlag( wgt, WGT_FLAG_DIRTY );
+
+   gl_fboRender( w->fbo, w->x, w->y );
+
+   /* Live widgets. */
+   for (wgt=w->widgets; wgt!=NULL; wgt=wgt->next)
+      if ((wgt->render != NULL) && wgt_isFlag( wgt, WGT_FLAG_LIVE ))
+         wgt->render( wgt, w->x, w->y );
+
+   return 0;
+}
+
+
 /**
  * @brief Renders a window.
  *
@@ -1598,16 +1822,18 @@ void window_render( Window *w )
    x = w->x;
    y = w->y;
 
-   /* See if needs border. */
-   if (!window_isFlag( w, WINDOW_NOBORDER ))
-      window_renderBorder(w);
-
-   /*
-    * widgets
-    */
-   for (wgt=w->widgets; wgt!=NULL; wgt=wgt->next)
-      if (wgt->render != NULL)
-         wgt->render( wgt, x, y );
+   if (window_renderCache( w )) {
+      /* See if needs border. */
+      if (!window_isFlag( w, WINDOW_NOBORDER ))
+         window_renderBorder(w);
+
+      /*
+       * widgets
+       */
+      for (wgt=w->widgets; wgt!=NULL; wgt=wgt->next)
+         if (wgt->render != NULL)
+            wgt->render( wgt, x, y );
+   }
 
    /*
     * focused widget
@@ -1729,8 +1955,10 @@ int toolkit_inputWindow( Window *wdw, SDL_Event *event, int purge )
       if (wgt_isFlag( wgt, WGT_FLAG_RAWINPUT )) {
          if (wgt->rawevent != NULL) {
             ret = wgt->rawevent( wgt, event );
-            if (ret != 0)
+            if (ret != 0) {
+               wgt_dirty( wgt );
                return ret;
+            }
          }
       }
    }
@@ -1871,8 +2099,9 @@ static int toolkit_mouseEvent( Window *w, SDL_Event* event )
 static int toolkit_mouseEventWidget( Window *w, Widget *wgt,
       SDL_Event *event, int x, int y, int rx, int ry )
 {
-   int ret, inbounds;
+   int ret, inbounds, called;
    Uint8 button;
+   WidgetStatus status;
 
    /* Widget translations. */
    x -= wgt->x;
@@ -1888,7 +2117,9 @@ static int toolkit_mouseEventWidget( Window *w, Widget *wgt,
    inbounds = !((x < 0) || (x >= wgt->w) || (y < 0) || (y >= wgt->h));
 
    /* Regular widgets. */
-   ret = 0;
+   ret    = 0;
+   called = 0;
+   status = wgt->status;
    switch (event->type) {
       case SDL_MOUSEMOTION:
          /* Change the status of the widget if mouse isn't down. */
@@ -1910,8 +2141,10 @@ static int toolkit_mouseEventWidget( Window *w, Widget *wgt,
             inbounds = 1;
 
          /* Try to give the event to the widget. */
-         if (inbounds && (wgt->mmoveevent != NULL))
+         if (inbounds && (wgt->mmoveevent != NULL)) {
             ret |= (*wgt->mmoveevent)( wgt, x, y, rx, ry );
+            called = 1;
+         }
 
          break;
 
@@ -1921,8 +2154,10 @@ static int toolkit_mouseEventWidget( Window *w, Widget *wgt,
             break;
 
          /* Try to give the event to the widget. */
-         if (wgt->mwheelevent != NULL)
+         if (wgt->mwheelevent != NULL) {
             ret |= (*wgt->mwheelevent)( wgt, event->wheel );
+            called = 1;
+         }
 
          break;
 #endif /* SDL_VERSION_ATLEAST(2,0,0) */
@@ -1941,8 +2176,10 @@ static int toolkit_mouseEventWidget( Window *w, Widget *wgt,
          }
 
          /* Try to give the event to the widget. */
-         if (wgt->mclickevent != NULL)
+         if (wgt->mclickevent != NULL) {
             ret |= (*wgt->mclickevent)( wgt, button, x, y );
+            called = 1;
+         }
          break;
 
       case SDL_MOUSEBUTTONUP:
@@ -1967,8 +2204,10 @@ static int toolkit_mouseEventWidget( Window *w, Widget *wgt,
          }
 
          /* Signal scroll done if necessary. */
-         if ((wgt->status == WIDGET_STATUS_SCROLLING) && (wgt->scrolldone != NULL))
+         if ((wgt->status == WIDGET_STATUS_SCROLLING) && (wgt->scrolldone != NULL)) {
             wgt->scrolldone( wgt );
+            called = 1;
+         }
 
          /* Always goes normal unless is below mouse. */
          if (inbounds)
@@ -1979,6 +2218,10 @@ static int toolkit_mouseEventWidget( Window *w, Widget *wgt,
          break;
    }
 
+   /* Widget may look different now. */
+   if (called || (wgt->status != status))
+      wgt_dirty( wgt );
+
    return ret;
 }
 
@@ -2106,6 +2349,7 @@ static int toolkit_keyEvent( Window *wdw, SDL_Event* event )
 
    /* Trigger event function if exists. */
    if (wgt != NULL) {
+      wgt_dirty( wgt );
       if (wgt->keyevent != NULL) {
          if (wgt->keyevent( wgt, input_key, input_mod ))
             return 1;
@@ -2124,8 +2368,10 @@ static int toolkit_keyEvent( Window *wdw, SDL_Event* event )
    /* Handle button hotkeys. */
    for (wgt=wdw->widgets; wgt!=NULL; wgt=wgt->next)
       if ((wgt->type == WIDGET_BUTTON) && (wgt->dat.btn.key != 0) &&
-            (wgt->dat.btn.key == input_key))
+            (wgt->dat.btn.key == input_key)) {
+         wgt_dirty( wgt );
          return (wgt->keyevent( wgt, SDLK_RETURN, input_mod ));
+      }
 
    /* Handle other cases where event might be used by the window. */
    switch (key) {
@@ -2176,6 +2422,7 @@ static int toolkit_textEvent( Window *wdw, SDL_Event* event )
 
    /* Trigger event function if exists. */
    if ((wgt != NULL) && (wgt->textevent != NULL)) {
+      wgt_dirty( wgt );
       if ((*wgt->textevent)( wgt, event->text.text ))
          return 1;
    }
@@ -2231,9 +2478,12 @@ static void toolkit_purgeDead (void)
                else
                   wgtlast->next = wgt->next;
                wgt = wgtlast;
+               /* Name is freed with it. */
+               window_hashWidgets( wdw );
                /* Kill target. */
                wgtkill->next = NULL;
                widget_kill( wgtkill );
+               window_dirty( wdw );
             }
             /* Save position. */
             wgtlast = wgt;
@@ -2316,14 +2566,18 @@ void toolkit_update (void)
             event.key.keysym.mod = input_mod;
             event.key.keysym.unicode = (uint8_t)input_text;
             ret = wgt->rawevent( wgt, &event );
-            if (ret != 0)
+            if (ret != 0) {
+               wgt_dirty( wgt );
                return;
+            }
          }
       }
    }
 
    /* Handle the focused widget. */
    wgt = toolkit_getFocus( wdw );
+   if (wgt != NULL)
+      wgt_dirty( wgt );
    if ((wgt != NULL) && (wgt->keyevent != NULL))
       wgt->keyevent( wgt, input_key, input_mod );
 
@@ -2350,6 +2604,7 @@ static void toolkit_expose( Window *wdw, int expose )
       return;
    else
       wdw->exposed = expose;
+   window_dirty( wdw );
 
    if (expose)
       toolkit_focusSanitize( wdw );
@@ -2500,6 +2755,7 @@ void toolkit_focusWidget( Window *wdw, Widget *wgt )
 
    wdw->focus = wgt->id;
    wgt_setFlag( wgt, WGT_FLAG_FOCUSED );
+   wgt_dirty( wgt );
    if (wgt->focusGain != NULL)
       wgt->focusGain( wgt );
 }
@@ -2514,6 +2770,7 @@ void toolkit_defocusWidget( Window *wdw, Widget *wgt )
       return;
 
    wgt_rmFlag( wgt, WGT_FLAG_FOCUSED );
+   wgt_dirty( wgt );
    if (wgt->focusLose != NULL)
       wgt->focusLose( wgt );
 }
@@ -2661,6 +2918,7 @@ void window_raise( unsigned int wid )
       wlast->next = wdw;       /* last links to wdw */
 
    wdw->next   = NULL;      /* wdw becomes new last window */
+   window_hashWindows();
 
    wtmp = toolkit_getActiveWindow();
 
@@ -2698,6 +2956,7 @@ void window_lower( unsigned int wid )
 
    wdw->next   = windows;   /* wdw links to first window */
    windows     = wdw;       /* wdw becomes new first window */
+   window_hashWindows();
 
    wtmp = toolkit_getActiveWindow();
 
@@ -2720,6 +2979,10 @@ void toolkit_reposition (void)
    int i, xorig, yorig, xdiff, ydiff;
 
    for (w = windows; w != NULL; w = w->next) {
+      /* Screen scale may have changed too. */
+      gl_fboFree( w->fbo );
+      w->fbo = NULL;
+
       /* Fullscreen windows must always be full size, though their widgets
        * don't auto-scale. */
       if (window_isFlag( w, WINDOW_FULLSCREEN )) {
@@ -2791,12 +3054,14 @@ void toolkit_exit (void)
    Window *wdw;
 
    /* Destroy the windows. */
+   nhash_clear( &window_hash );
    while (windows!=NULL) {
       wdw      = windows;
       windows  = windows->next;
       window_kill(wdw);
    }
    free(windows);
+   nhash_free( &window_hash );
 
    /* Free the VBO. */
    gl_vboDestroy( toolkit_vbo );
@@ -10,6 +10,10 @@
  * Diffs allow changing planets, fleets, factions, etc... in the universe.
  *  These are meant to be applied after the player triggers them, mostly
  *  through missions.
+ *
+ * The diff file is only parsed once, diffs keep pointing into it.  Diffs
+ *  applied or removed between diff_batchBegin() and diff_batchEnd() rebuild
+ *  the universe only once at the end, which is how savegames load them.
  */
 
 
@@ -26,6 +30,7 @@
 #include "ndata.h"
 #include "fleet.h"
 #include "map_overlay.h"
+#include "economy.h"
 
 
 #define CHUNK_SIZE      32 /**< Size of chunk to allocate. */
@@ -134,10 +139,22 @@ static int diff_nstack = 0; /**< Number of diffs in the stack. */
 static int diff_mstack = 0; /**< Currently allocated diffs. */
 
 
+/*
+ * Parsed diff file.
+ */
+static xmlDocPtr diff_doc = NULL; /**< Parsed DIFF_DATA_PATH. */
+static xmlNodePtr *diff_nodes = NULL; /**< Unidiff nodes in diff_doc. */
+static char **diff_names = NULL; /**< Names of the unidiff nodes. */
+static int diff_nnodes = 0; /**< Number of unidiff nodes. */
+static int diff_batch = 0; /**< Nesting of diff_batchBegin(). */
+
+
 /*
  * Prototypes.
  */
 static UniDiff_t* diff_get( const char *name );
+static int diff_parse (void);
+static xmlNodePtr diff_getNode( const char *name );
 static UniDiff_t *diff_newDiff (void);
 static int diff_removeDiff( UniDiff_t *diff );
 static int diff_patchSystem( UniDiff_t *diff, xmlNodePtr node );
@@ -184,65 +201,111 @@ static UniDiff_t* diff_get( const char *name )
 
 
 /**
- * @brief Applies a diff to the universe.
+ * @brief Parses the diff file and indexes its diffs by name.
  *
- *    @param name Diff to apply.
  *    @return 0 on success.
  */
-int diff_apply( const char *name )
+static int diff_parse (void)
 {
    xmlNodePtr node;
-   xmlDocPtr doc;
    uint32_t bufsize;
    char *buf;
-   char *diffname;
+   int n;
 
-   /* Check if already applied. */
-   if (diff_isApplied(name))
+   if (diff_doc != NULL)
       return 0;
 
    buf = ndata_read( DIFF_DATA_PATH, &bufsize );
-   doc = xmlParseMemory( buf, bufsize );
+   if (buf == NULL) {
+      WARN("Unable to read '"DIFF_DATA_PATH"'.");
+      return -1;
+   }
+   diff_doc = xmlParseMemory( buf, bufsize );
+   free(buf);
+   if (diff_doc == NULL) {
+      WARN("Unable to parse '"DIFF_DATA_PATH"'.");
+      return -1;
+   }
 
-   node = doc->xmlChildrenNode;
+   node = diff_doc->xmlChildrenNode;
    if (strcmp((char*)node->name,"unidiffs")) {
       ERR("Malformed unidiff file: missing root element 'unidiffs'");
-      return 0;
+      return -1;
    }
 
    node = node->xmlChildrenNode; /* first system node */
    if (node == NULL) {
       ERR("Malformed unidiff file: does not contain elements");
-      return 0;
+      return -1;
    }
 
+   n = 0;
    do {
-      if (xml_isNode(node,"unidiff")) {
-         /* Check to see if it's the diff we're looking for. */
-         xmlr_attr(node,"name",diffname);
-         if (strcmp(diffname,name)==0) {
-            /* Apply it. */
-            diff_patch( node );
+      if (!xml_isNode(node,"unidiff"))
+         continue;
+      if (diff_nnodes >= n) {
+         n = (n == 0) ? CHUNK_SIZE : 2*n;
+         diff_nodes = realloc( diff_nodes, sizeof(xmlNodePtr) * n );
+         diff_names = realloc( diff_names, sizeof(char*) * n );
+      }
+      diff_nodes[diff_nnodes] = node;
+      xmlr_attr(node,"name",diff_names[diff_nnodes]);
+      if (diff_names[diff_nnodes] == NULL) {
+         WARN("Unidiff in "DIFF_DATA_PATH" has no name.");
+         continue;
+      }
+      diff_nnodes++;
+   } while (xml_nextNode(node));
 
-            /* Clean up. */
-            free(diffname);
-            xmlFreeDoc(doc);
-            free(buf);
+   return 0;
+}
 
-            economy_execQueued();
 
-            return 0;
-         }
-         free(diffname);
-      }
-   } while (xml_nextNode(node));
+/**
+ * @brief Gets the node of a diff in the diff file.
+ *
+ *    @param name Name of the diff.
+ *    @return The unidiff node or NULL if not found.
+ */
+static xmlNodePtr diff_getNode( const char *name )
+{
+   int i;
 
-   /* More clean up. */
-   xmlFreeDoc(doc);
-   free(buf);
+   if (diff_parse())
+      return NULL;
 
-   WARN("UniDiff '%s' not found in "DIFF_DATA_PATH".", name);
-   return -1;
+   for (i=0; i<diff_nnodes; i++)
+      if (strcmp(diff_names[i],name)==0)
+         return diff_nodes[i];
+   return NULL;
+}
+
+
+/**
+ * @brief Applies a diff to the universe.
+ *
+ *    @param name Diff to apply.
+ *    @return 0 on success.
+ */
+int diff_apply( const char *name )
+{
+   xmlNodePtr node;
+
+   /* Check if already applied. */
+   if (diff_isApplied(name))
+      return 0;
+
+   node = diff_getNode( name );
+   if (node == NULL) {
+      WARN("UniDiff '%s' not found in "DIFF_DATA_PATH".", name);
+      return -1;
+   }
+
+   /* Apply it. */
+   diff_patch( node );
+   if (!diff_batch)
+      economy_execQueued();
+   return 0;
 }
 
 
@@ -598,10 +661,8 @@ static int diff_patch( xmlNodePtr parent )
       }
       else if (xml_isNode(node, "tech"))
          diff_patchTech( diff, node );
-      else if (xml_isNode(node, "asset")) {
-         univ_update = 1;
-         diff_patchAsset( diff, node );
-      }
+      else if (xml_isNode(node, "asset"))
+         diff_patchAsset( diff, node ); /* Only moves the asset's presence. */
       else if (xml_isNode(node, "faction")) {
          univ_update = 1;
          diff_patchFaction( diff, node );
@@ -687,7 +748,8 @@ static int diff_patch( xmlNodePtr parent )
       space_reconstructPresences();
 
    /* Update overlay map just in case. */
-   ovr_refresh();
+   if (!diff_batch)
+      ovr_refresh();
    return 0;
 }
 
@@ -882,7 +944,8 @@ void diff_remove( const char *name )
 
    diff_removeDiff(diff);
 
-   economy_execQueued();
+   if (!diff_batch)
+      economy_execQueued();
 }
 
 
@@ -894,7 +957,41 @@ void diff_clear (void)
    while (diff_nstack > 0)
       diff_removeDiff(&diff_stack[diff_nstack-1]);
 
+   if (!diff_batch)
+      economy_execQueued();
+}
+
+
+/**
+ * @brief Starts a batch of diffs.
+ *
+ * Rebuilding the universe is deferred until the matching diff_batchEnd(),
+ *  batches may be nested.
+ */
+void diff_batchBegin (void)
+{
+   if (diff_batch == 0)
+      space_deferStart();
+   diff_batch++;
+}
+
+
+/**
+ * @brief Ends a batch of diffs, rebuilding the universe if it's the outermost.
+ */
+void diff_batchEnd (void)
+{
+   if (diff_batch <= 0) {
+      WARN("diff_batchEnd called without diff_batchBegin.");
+      return;
+   }
+   diff_batch--;
+   if (diff_batch > 0)
+      return;
+
+   space_deferEnd();
    economy_execQueued();
+   ovr_refresh();
 }
 
 
@@ -1100,6 +1197,8 @@ int diff_load( xmlNodePtr parent )
 {
    xmlNodePtr node, cur;
 
+   /* Rebuild the universe only once for all the diffs. */
+   diff_batchBegin();
    diff_clear();
 
    node = parent->xmlChildrenNode;
@@ -1113,8 +1212,31 @@ int diff_load( xmlNodePtr parent )
       }
    } while (xml_nextNode(node));
 
+   diff_batchEnd();
+
    return 0;
 
 }
 
 
+/**
+ * @brief Frees the parsed diff file.
+ *
+ * The active diffs must have been cleared.
+ */
+void diff_free (void)
+{
+   int i;
+
+   for (i=0; i<diff_nnodes; i++)
+      free( diff_names[i] );
+   free( diff_names );
+   free( diff_nodes );
+   diff_names  = NULL;
+   diff_nodes  = NULL;
+   diff_nnodes = 0;
+
+   if (diff_doc != NULL)
+      xmlFreeDoc( diff_doc );
+   diff_doc = NULL;
+}
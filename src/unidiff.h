@@ -11,7 +11,10 @@
 int diff_apply( const char *name );
 void diff_remove( const char *name );
 void diff_clear (void);
+void diff_batchBegin (void);
+void diff_batchEnd (void);
 int diff_isApplied( const char *name );
+void diff_free (void);
 
 
 #endif /* UNIDIFF_H */
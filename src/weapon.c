@@ -9,6 +9,11 @@
  *
  * Weapons are what gets created when a pilot shoots.  They are based
  * on the outfit that created them.
+ *
+ * Weapons are updated in three passes per layer: the timers run first, then
+ *  bolts and ammo look for what they hit on the worker threads without
+ *  changing anything but themselves, and last the hits are applied along
+ *  with everything else in layer order on the main thread.
  */
 
 
@@ -31,12 +36,15 @@
 #include "gui.h"
 #include "camera.h"
 #include "ai.h"
+#include "threadpool.h"
 
 
 #define weapon_isSmart(w)     (w->think != NULL) /**< Checks if the weapon w is smart. */
 
 #define WEAPON_CHUNK_MAX      16384 /**< Maximum size to increase array with */
 #define WEAPON_CHUNK_MIN      256 /**< Minimum size to increase array with */
+#define WEAPON_PAGE           256 /**< Weapons per storage page. */
+#define WEAPON_DETECT_GRAIN   64 /**< Minimum weapons checked for hits per job. */
 
 /* Weapon status */
 #define WEAPON_STATUS_OK         0 /**< Weapon is fine */
@@ -59,11 +67,13 @@ extern int pilot_nstack;
 typedef struct Weapon_ {
    Solid *solid; /**< Actually has its own solid :) */
    unsigned int ID; /**< Only used for beam weapons. */
+   int lpos; /**< Position in the layer array. */
 
    int faction; /**< faction of pilot that shot it */
    unsigned int parent; /**< pilot that shot it */
    unsigned int target; /**< target to hit, only used by seeking things */
    const Outfit* outfit; /**< related outfit that fired it or whatnot */
+   const OutfitWeapon* wp; /**< What the outfit gives the updates, collisions and rendering. */
 
    double real_vel; /**< Keeps track of the real velocity. */
    double jam_power; /**< Power being jammed by. */
@@ -85,9 +95,23 @@ typedef struct Weapon_ {
    void (*think)(struct Weapon_*, const double); /**< for the smart missiles */
 
    char status; /**< Weapon status - to check for jamming */
+
+   int hit; /**< Whether a hit was found this tick. */
+   unsigned int hit_pilot; /**< Pilot the hit found is on. */
+   Vector2d hit_pos; /**< Position of the hit found. */
 } Weapon;
 
 
+/**
+ * @brief Jammer active this frame.
+ */
+typedef struct WeaponJammer_ {
+   const Vector2d *pos; /**< Position of the jamming pilot. */
+   double range2; /**< Range squared of the jammer. */
+   double power; /**< Power of the jammer. */
+} WeaponJammer;
+
+
 /* behind pilot_nstack layer */
 static Weapon** wbackLayer = NULL; /**< behind pilots */
 static int nwbackLayer = 0; /**< number of elements */
@@ -96,15 +120,28 @@ static int mwbacklayer = 0; /**< alloced memory size */
 static Weapon** wfrontLayer = NULL; /**< in front of pilots, behind player */
 static int nwfrontLayer = 0; /**< number of elements */
 static int mwfrontLayer = 0; /**< alloced memory size */
+static int weapon_defer = 0; /**< Destroyed weapons leave a NULL hole until weapons_compact(). */
+
+/* Weapon storage. */
+static Weapon **weapon_pages   = NULL; /**< Storage pages, never move once allocated. */
+static int weapon_npages       = 0; /**< Number of storage pages. */
+static Weapon **weapon_unused  = NULL; /**< Stack of unused weapons. */
+static int weapon_nunused      = 0; /**< Number of unused weapons. */
+static int weapon_munused      = 0; /**< Memory allocated for the unused stack. */
+
+/* Jamming. */
+static WeaponJammer *weapon_jammers = NULL; /**< Jammers active this frame. */
+static int weapon_njammers     = 0; /**< Number of active jammers. */
+static int weapon_mjammers     = 0; /**< Memory allocated for the jammers. */
 
 /* Graphics. */
-static gl_vbo  *weapon_vbo     = NULL; /**< Weapon VBO. */
-static GLfloat *weapon_vboData = NULL; /**< Data of weapon VBO. */
-static int weapon_vboSize      = 0; /**< Size of the VBO. */
+static GLfloat *weapon_vboData = NULL; /**< Minimap points pushed to the stream VBO. */
+static int weapon_vboSize      = 0; /**< Points weapon_vboData can hold. */
 
 
 /* Internal stuff. */
 static unsigned int beam_idgen = 0; /**< Beam identifier generator. */
+static double weapon_detectDt = 0.; /**< Delta tick of the hits being looked for. */
 
 
 /*
@@ -123,14 +160,24 @@ static Weapon* weapon_create( const Outfit* outfit, double T,
       const Pilot *parent, const unsigned int target, double time );
 /* Updating. */
 static void weapon_render( Weapon* w, const double dt );
+static void weapon_beamVertex( GLfloat *vertex, GLfloat *tex, GLfloat *col,
+      int i, double x, double y, double s, double t, double a );
+static void weapons_updateJammers (void);
 static void weapons_updateLayer( const double dt, const WeaponLayer layer );
 static void weapon_update( Weapon* w, const double dt, WeaponLayer layer );
+static void weapons_detectRange( int start, int end, void *data );
+static void weapon_detect( Weapon* w, PilotGridQuery *q, const double dt );
+static void weapon_detected( Weapon* w, const Pilot *p, const Vector2d *pos );
+static int weapon_sweepPilot( Weapon* w, Pilot *p, const double dt );
+static int weapon_sweep( Weapon* w, const glTexture *gfx, PilotGridQuery *q, const double dt );
 /* Destruction. */
 static void weapon_destroy( Weapon* w, WeaponLayer layer );
+static void weapons_compact( Weapon **wlayer, int *nlayer );
 static void weapon_free( Weapon* w );
+/* Storage. */
+static Weapon* weapon_alloc (void);
 static void weapon_explodeLayer( WeaponLayer layer,
-      double x, double y, double radius,
-      const Pilot *parent, int mode );
+      const ExplosionDamage *expl, int nexpl );
 /* Hitting. */
 static int weapon_checkCanHit( Weapon* w, Pilot *p );
 static void weapon_hit( Weapon* w, Pilot* p, WeaponLayer layer, Vector2d* pos );
@@ -164,6 +211,8 @@ void weapon_minimap( const double res, const double w,
    Weapon *wp;
    const glColour *c;
    GLsizei offset;
+   GLuint voff, coff;
+   gl_vbo *vbo;
    Pilot *par;
 
    /* Get offset. */
@@ -265,14 +314,13 @@ void weapon_minimap( const double res, const double w,
    /* Only render with something to draw. */
    if (p > 0) {
       /* Upload data changes. */
-      gl_vboSubData( weapon_vbo, 0, sizeof(GLfloat) * 2*p, weapon_vboData );
-      gl_vboSubData( weapon_vbo, offset * sizeof(GLfloat),
-            sizeof(GLfloat) * 4*p, &weapon_vboData[offset] );
+      vbo  = gl_vboStreamReserve( sizeof(GLfloat) * (2+4)*p );
+      voff = gl_vboStreamPush( weapon_vboData, sizeof(GLfloat) * 2*p );
+      coff = gl_vboStreamPush( &weapon_vboData[offset], sizeof(GLfloat) * 4*p );
 
       /* Activate VBO. */
-      gl_vboActivateOffset( weapon_vbo, GL_VERTEX_ARRAY, 0, 2, GL_FLOAT, 0 );
-      gl_vboActivateOffset( weapon_vbo, GL_COLOR_ARRAY, offset * sizeof(GLfloat),
-            4, GL_FLOAT, 0 );
+      gl_vboActivateOffset( vbo, GL_VERTEX_ARRAY, voff, 2, GL_FLOAT, 0 );
+      gl_vboActivateOffset( vbo, GL_COLOR_ARRAY, coff, 4, GL_FLOAT, 0 );
 
       /* Render VBO. */
       glDrawArrays( GL_POINTS, 0, p );
@@ -311,8 +359,7 @@ static void think_seeker( Weapon* w, const double dt )
 {
    double diff;
    Pilot *p;
-   Vector2d v;
-   double t, turn_max;
+   double x, y, t, turn_max;
 
    if (w->target == w->parent)
       return; /* no self shooting */
@@ -332,19 +379,19 @@ static void think_seeker( Weapon* w, const double dt )
       case WEAPON_STATUS_UNJAMMED: /* Work as expected */
 
          /* Smart seekers take into account ship velocity. */
-         if (w->outfit->u.amm.ai == AMMO_AI_SMART) {
+         if (w->wp->ai == AMMO_AI_SMART) {
 
             /* Calculate time to reach target. */
-            vect_cset( &v, p->solid->pos.x - w->solid->pos.x,
-                  p->solid->pos.y - w->solid->pos.y );
-            t = vect_odist( &v ) / w->outfit->u.amm.speed;
+            x = p->solid->pos.x - w->solid->pos.x;
+            y = p->solid->pos.y - w->solid->pos.y;
+            t = MOD( x, y ) / w->wp->speed;
 
             /* Calculate target's movement. */
-            vect_cset( &v, v.x + t*(p->solid->vel.x - w->solid->vel.x),
-                  v.y + t*(p->solid->vel.y - w->solid->vel.y) );
+            x += t*(p->solid->vel.x - w->solid->vel.x);
+            y += t*(p->solid->vel.y - w->solid->vel.y);
 
-            /* Get the angle now. */
-            diff = angle_diff(w->solid->dir, VANGLE(v) );
+            /* Get the angle now, only the one atan2 is needed. */
+            diff = angle_diff(w->solid->dir, ANGLE( x, y ) );
          }
          /* Other seekers are stupid. */
          else {
@@ -353,9 +400,9 @@ static void think_seeker( Weapon* w, const double dt )
          }
 
          /* Set turn. */
-         turn_max = w->outfit->u.amm.turn * (1. - w->jam_power);
+         turn_max = w->wp->turn * (1. - w->jam_power);
          weapon_setTurn( w, CLAMP( -turn_max, turn_max,
-                  10 * diff * w->outfit->u.amm.turn ));
+                  10 * diff * w->wp->turn ));
          break;
 
       case WEAPON_STATUS_JAMMED: /* Continue doing whatever */
@@ -368,11 +415,11 @@ static void think_seeker( Weapon* w, const double dt )
    }
 
    /* Limit speed here */
-   w->real_vel = MIN( w->outfit->u.amm.speed, w->real_vel + w->outfit->u.amm.thrust*dt );
+   w->real_vel = MIN( w->wp->speed, w->real_vel + w->wp->thrust*dt );
    vect_pset( &w->solid->vel, (1. - w->jam_power) * w->real_vel, w->solid->dir );
 
    /* Modulate max speed. */
-   //w->solid->speed_max = w->outfit->u.amm.speed * (1. - w->jam_power);
+   //w->solid->speed_max = w->wp->speed * (1. - w->jam_power);
 }
 
 
@@ -397,7 +444,7 @@ static void think_beam( Weapon* w, const double dt )
    }
 
    /* Check if pilot has enough energy left to keep beam active. */
-   p->energy -= dt*w->outfit->u.bem.energy;
+   p->energy -= dt*w->wp->energy;
    if (p->energy < 0.) {
       p->energy = 0.;
       w->timer = -1;
@@ -410,7 +457,7 @@ static void think_beam( Weapon* w, const double dt )
    w->solid->pos.y = p->solid->pos.y + v.y;
 
    /* Handle aiming. */
-   switch (w->outfit->type) {
+   switch (w->wp->type) {
       case OUTFIT_TYPE_BEAM:
          w->solid->dir = p->solid->dir;
          break;
@@ -428,8 +475,8 @@ static void think_beam( Weapon* w, const double dt )
          else
             diff = angle_diff(w->solid->dir, /* Get angle to target pos */
                   vect_angle(&w->solid->pos, &t->solid->pos));
-         weapon_setTurn( w, CLAMP( -w->outfit->u.bem.turn, w->outfit->u.bem.turn,
-                  10 * diff *  w->outfit->u.bem.turn ));
+         weapon_setTurn( w, CLAMP( -w->wp->turn, w->wp->turn,
+                  10 * diff *  w->wp->turn ));
          break;
 
       default:
@@ -445,8 +492,82 @@ static void think_beam( Weapon* w, const double dt )
  */
 void weapons_update( const double dt )
 {
+   weapons_updateJammers();
+
+   /* Weapons destroyed while updating are removed once both layers are done,
+    * so nothing moves under the loops and the layers keep their draw order. */
+   weapon_defer = 1;
    weapons_updateLayer(dt,WEAPON_LAYER_BG);
    weapons_updateLayer(dt,WEAPON_LAYER_FG);
+   weapon_defer = 0;
+   weapons_compact( wbackLayer, &nwbackLayer );
+   weapons_compact( wfrontLayer, &nwfrontLayer );
+}
+
+
+/**
+ * @brief Removes the holes left by the weapons destroyed in a layer.
+ *
+ *    @param wlayer Layer to compact.
+ *    @param nlayer Number of weapons in the layer.
+ */
+static void weapons_compact( Weapon **wlayer, int *nlayer )
+{
+   int i, j;
+
+   for (i=j=0; i<*nlayer; i++) {
+      if (wlayer[i] == NULL)
+         continue;
+      wlayer[j]       = wlayer[i];
+      wlayer[j]->lpos = j;
+      j++;
+   }
+   for (i=j; i<*nlayer; i++)
+      wlayer[i] = NULL;
+   *nlayer = j;
+}
+
+
+/**
+ * @brief Gathers the jammers that are on this frame.
+ *
+ * Only pilots flagged as jamming by pilot_calcStats() when their outfits
+ *  changed are looked at, so the seekers only have to go over this list.
+ */
+static void weapons_updateJammers (void)
+{
+   int i, j;
+   Pilot *p;
+   const Outfit *o;
+   WeaponJammer *jam;
+
+   weapon_njammers = 0;
+   for (i=0; i<pilot_nstack; i++) {
+      p = pilot_stack[i];
+
+      /* Must be jamming. */
+      if (!p->jamming)
+         continue;
+
+      for (j=0; j<p->noutfits; j++) {
+         o = p->outfits[j]->outfit;
+         if ((o == NULL) || !outfit_isJammer(o))
+            continue;
+         /* Must be on. */
+         if (p->outfits[j]->state != PILOT_OUTFIT_ON)
+            continue;
+
+         if (weapon_njammers >= weapon_mjammers) {
+            weapon_mjammers = MAX( 2*weapon_mjammers, 8 );
+            weapon_jammers  = realloc( weapon_jammers,
+                  sizeof(WeaponJammer) * weapon_mjammers );
+         }
+         jam         = &weapon_jammers[ weapon_njammers++ ];
+         jam->pos    = &p->solid->pos;
+         jam->range2 = o->u.jam.range2;
+         jam->power  = o->u.jam.power;
+      }
+   }
 }
 
 
@@ -465,7 +586,7 @@ static void weapons_updateLayer( const double dt, const WeaponLayer layer )
    int spfx;
    int s;
    Pilot *p;
-   Outfit *o;
+   const WeaponJammer *jam;
 
    /* Choose layer. */
    switch (layer) {
@@ -483,55 +604,27 @@ static void weapons_updateLayer( const double dt, const WeaponLayer layer )
          return;
    }
 
-   /** @TODO optimize me plz. */
-   /* Reset jam power. */
+   /* Apply the strongest jammer in range to each seeker. */
    for (k=0; k < *nlayer; k++) {
       w = wlayer[k];
-      if (!outfit_isSeeker( w->outfit ))
-         continue;
+      if ((w == NULL) || (w->wp->ai == AMMO_AI_DUMB))
+         continue; /* Only seekers get jammed. */
       w->jam_power = 0.;
-   }
-   /* Iterate over all pilots. */
-   for (i=0; i<pilot_nstack; i++) {
-      p = pilot_stack[i];
-
-      /* Must be jamming. */
-      if (!p->jamming)
-         continue;
-
-      /* Iterate over outfits to find jammers. */
-      for (j=0; j<p->noutfits; j++) {
-         o    = p->outfits[j]->outfit;
-         if (o==NULL)
+      for (j=0; j<weapon_njammers; j++) {
+         jam = &weapon_jammers[j];
+         if (jam->range2 < vect_dist2( &w->solid->pos, jam->pos ))
             continue;
-         /* Must be on. */
-         if (p->outfits[j]->state != PILOT_OUTFIT_ON)
-            continue;
-         /* Must be a jammer. */
-         if (!outfit_isJammer(o))
-            continue;
-    
-         /* Apply jamming. */
-         for (k=0; k < *nlayer; k++) {
-            w = wlayer[k];
-            if (!outfit_isSeeker( w->outfit ))
-               continue;
-
-            /* Must be in range. */
-            if (o->u.jam.range2 < vect_dist2( &w->solid->pos, &p->solid->pos ))
-               continue;
-
-            /* We only consider the strongest jammer. */
-            w->jam_power = CLAMP( 0., 1., MAX( w->jam_power, (o->u.jam.power - w->outfit->u.amm.resist) ) );
-         }
+         w->jam_power = MAX( w->jam_power, jam->power - w->wp->resist );
       }
+      w->jam_power = CLAMP( 0., 1., w->jam_power );
    }
 
-   i = 0;
-   while (i < *nlayer) {
+   for (i=0; i<*nlayer; i++) {
       w = wlayer[i];
+      if (w == NULL)
+         continue;
 
-      switch (w->outfit->type) {
+      switch (w->wp->type) {
 
          /* most missiles behave the same */
          case OUTFIT_TYPE_AMMO:
@@ -540,10 +633,10 @@ static void weapons_updateLayer( const double dt, const WeaponLayer layer )
             if (w->timer < 0.) {
                spfx = -1;
                /* See if we need armour death sprite. */
-               if (outfit_isProp(w->outfit, OUTFIT_PROP_WEAP_BLOWUP_ARMOUR))
+               if (outfit_isProp(w->wp, OUTFIT_PROP_WEAP_BLOWUP_ARMOUR))
                   spfx = outfit_spfxArmour(w->outfit);
                /* See if we need shield death sprite. */
-               else if (outfit_isProp(w->outfit, OUTFIT_PROP_WEAP_BLOWUP_SHIELD))
+               else if (outfit_isProp(w->wp, OUTFIT_PROP_WEAP_BLOWUP_SHIELD))
                   spfx = outfit_spfxShield(w->outfit);
                /* Add death sprite if needed. */
                if (spfx != -1) {
@@ -570,10 +663,10 @@ static void weapons_updateLayer( const double dt, const WeaponLayer layer )
             if (w->timer < 0.) {
                spfx = -1;
                /* See if we need armour death sprite. */
-               if (outfit_isProp(w->outfit, OUTFIT_PROP_WEAP_BLOWUP_ARMOUR))
+               if (outfit_isProp(w->wp, OUTFIT_PROP_WEAP_BLOWUP_ARMOUR))
                   spfx = outfit_spfxArmour(w->outfit);
                /* See if we need shield death sprite. */
-               else if (outfit_isProp(w->outfit, OUTFIT_PROP_WEAP_BLOWUP_SHIELD))
+               else if (outfit_isProp(w->wp, OUTFIT_PROP_WEAP_BLOWUP_SHIELD))
                   spfx = outfit_spfxShield(w->outfit);
                /* Add death sprite if needed. */
                if (spfx != -1) {
@@ -600,7 +693,7 @@ static void weapons_updateLayer( const double dt, const WeaponLayer layer )
          case OUTFIT_TYPE_BEAM:
          case OUTFIT_TYPE_TURRET_BEAM:
             w->timer -= dt;
-            if (w->timer < 0. || (w->outfit->u.bem.min_duration > 0. &&
+            if (w->timer < 0. || (w->wp->min_duration > 0. &&
                   w->mount->stimer < 0.)) {
                p = pilot_get(w->parent);
                if (p != NULL)
@@ -622,18 +715,40 @@ static void weapons_updateLayer( const double dt, const WeaponLayer layer )
                   w->outfit->name);
             break;
       }
+   }
 
-      /* Out of bounds, loop is over. */
-      if (i >= *nlayer)
-         break;
+   /* Look for hits, only the weapons themselves change meanwhile. */
+   pilot_gridEnsure();
+   weapon_detectDt = dt;
+   threadpool_parallelFor( *nlayer, WEAPON_DETECT_GRAIN,
+         weapons_detectRange, wlayer );
 
-      /* Only increment if weapon wasn't deleted. */
-      if (w == wlayer[i]) {
-         weapon_update(w,dt,layer);
-         if ((i < *nlayer) && (w == wlayer[i]))
-            i++;
-      }
-   }
+   /* Apply the hits and move on in layer order. */
+   for (i=0; i<*nlayer; i++)
+      if (wlayer[i] != NULL)
+         weapon_update( wlayer[i], dt, layer );
+}
+
+
+/**
+ * @brief Looks for the hits of a range of weapons in a layer.
+ *
+ *    @param start First weapon to check.
+ *    @param end Weapon after the last to check.
+ *    @param data Layer being checked.
+ */
+static void weapons_detectRange( int start, int end, void *data )
+{
+   Weapon **wlayer;
+   PilotGridQuery q;
+   int i;
+
+   wlayer = data;
+   pilot_gridQueryInit( &q );
+   for (i=start; i<end; i++)
+      if (wlayer[i] != NULL)
+         weapon_detect( wlayer[i], &q, weapon_detectDt );
+   pilot_gridQueryFree( &q );
 }
 
 
@@ -664,8 +779,37 @@ void weapons_render( const WeaponLayer layer, const double dt )
          return;
    }
 
+   gl_batchBegin();
    for (i=0; i<(*nlayer); i++)
       weapon_render( wlayer[i], dt );
+   gl_batchEnd();
+}
+
+
+/**
+ * @brief Sets a corner of a beam segment quad.
+ *
+ *    @param[out] vertex Vertex positions of the quad.
+ *    @param[out] tex Texture coordinates of the quad.
+ *    @param[out] col Colours of the quad.
+ *    @param i Corner to set.
+ *    @param x X screen position.
+ *    @param y Y screen position.
+ *    @param s Texture coordinate along the beam.
+ *    @param t Texture coordinate across the beam.
+ *    @param a Alpha of the corner.
+ */
+static void weapon_beamVertex( GLfloat *vertex, GLfloat *tex, GLfloat *col,
+      int i, double x, double y, double s, double t, double a )
+{
+   vertex[2*i+0] = (GLfloat)x;
+   vertex[2*i+1] = (GLfloat)y;
+   tex[2*i+0]    = (GLfloat)s;
+   tex[2*i+1]    = (GLfloat)t;
+   col[4*i+0]    = 1.;
+   col[4*i+1]    = 1.;
+   col[4*i+2]    = 1.;
+   col[4*i+3]    = (GLfloat)a;
 }
 
 
@@ -679,25 +823,28 @@ static void weapon_render( Weapon* w, const double dt )
 {
    double x,y, cx,cy, gx,gy;
    glTexture *gfx;
-   double z;
+   double z, dx,dy, lx[2];
+   double len[4], vx[8], vy[8], ts[4], ta[4];
+   GLfloat vertex[4*2], tex[4*2], col[4*4];
+   int i, j;
    glColour c = { .r=1., .g=1., .b=1. };
 
-   switch (w->outfit->type) {
+   switch (w->wp->type) {
       /* Weapons that use sprites. */
       case OUTFIT_TYPE_AMMO:
       case OUTFIT_TYPE_BOLT:
       case OUTFIT_TYPE_TURRET_BOLT:
-         gfx = outfit_gfx(w->outfit);
+         gfx = w->wp->gfx;
 
          /* Alpha based on strength. */
          c.a = w->strength;
 
          /* Outfit spins around. */
-         if (outfit_isProp(w->outfit, OUTFIT_PROP_WEAP_SPIN)) {
+         if (outfit_isProp(w->wp, OUTFIT_PROP_WEAP_SPIN)) {
             /* Check timer. */
             w->anim -= dt;
             if (w->anim < 0.) {
-               w->anim = outfit_spin(w->outfit);
+               w->anim = w->wp->spin;
 
                /* Increment sprite. */
                w->sprite++;
@@ -706,8 +853,8 @@ static void weapon_render( Weapon* w, const double dt )
             }
 
             /* Render. */
-            if (outfit_isBolt(w->outfit) && w->outfit->u.blt.gfx_end)
-               gl_blitSpriteInterpolate( gfx, w->outfit->u.blt.gfx_end,
+            if (w->wp->gfx_end != NULL)
+               gl_blitSpriteInterpolate( gfx, w->wp->gfx_end,
                      w->timer / w->life,
                      w->solid->pos.x, w->solid->pos.y,
                      w->sprite % (int)gfx->sx, w->sprite / (int)gfx->sx, &c );
@@ -717,8 +864,8 @@ static void weapon_render( Weapon* w, const double dt )
          }
          /* Outfit faces direction. */
          else {
-            if (outfit_isBolt(w->outfit) && w->outfit->u.blt.gfx_end)
-               gl_blitSpriteInterpolate( gfx, w->outfit->u.blt.gfx_end,
+            if (w->wp->gfx_end != NULL)
+               gl_blitSpriteInterpolate( gfx, w->wp->gfx_end,
                      w->timer / w->life,
                      w->solid->pos.x, w->solid->pos.y, w->sx, w->sy, &c );
             else
@@ -729,7 +876,7 @@ static void weapon_render( Weapon* w, const double dt )
       /* Beam weapons. */
       case OUTFIT_TYPE_BEAM:
       case OUTFIT_TYPE_TURRET_BEAM:
-         gfx = outfit_gfx(w->outfit);
+         gfx = w->wp->gfx;
 
          /* Zoom. */
          z = cam_getZoom();
@@ -740,63 +887,41 @@ static void weapon_render( Weapon* w, const double dt )
          x = (w->solid->pos.x - cx)*z + gx;
          y = (w->solid->pos.y - cy)*z + gy;
 
-         /* Set up the matrix. */
-         glPushMatrix();
-            glTranslated( SCREEN_W/2.+x, SCREEN_H/2.+y, 0. );
-            glRotated( 270. + w->solid->dir / M_PI * 180., 0., 0., 1. );
-
-         /* Preparatives. */
-         glEnable(GL_TEXTURE_2D);
-         glBindTexture( GL_TEXTURE_2D, gfx->texture);
-         glShadeModel(GL_SMOOTH);
-
-         /* Actual rendering. */
-         glBegin(GL_QUAD_STRIP);
-
-            /* Start faded. */
-            ACOLOUR(cWhite, 0.);
-
-            glTexCoord2d( w->anim, 0. );
-            glVertex2d( -gfx->sh/2.*z, 0. );
-
-            glTexCoord2d( w->anim, 1. );
-            glVertex2d( +gfx->sh/2.*z, 0. );
-
-            /* Full strength. */
-            COLOUR(cWhite);
-
-            glTexCoord2d( w->anim + 10. / gfx->sw, 0. );
-            glVertex2d( -gfx->sh/2.*z, 10.*z );
-
-            glTexCoord2d( w->anim + 10. / gfx->sw, 1. );
-            glVertex2d( +gfx->sh/2.*z, 10.*z );
-
-            glTexCoord2d( w->anim + 0.8*w->outfit->u.bem.range / gfx->sw, 0. );
-            glVertex2d( -gfx->sh/2.*z, 0.8*w->outfit->u.bem.range*z );
-
-            glTexCoord2d( w->anim + 0.8*w->outfit->u.bem.range / gfx->sw, 1. );
-            glVertex2d( +gfx->sh/2.*z, 0.8*w->outfit->u.bem.range*z );
-
-            /* Fades out. */
-            ACOLOUR(cWhite, 0.);
-
-            glTexCoord2d( w->anim + w->outfit->u.bem.range / gfx->sw, 0. );
-            glVertex2d( -gfx->sh/2.*z, w->outfit->u.bem.range*z );
+         /* Beam frame, rotated to point along the beam. */
+         x  += SCREEN_W/2.;
+         y  += SCREEN_H/2.;
+         dx  = cos( 3.*M_PI/2. + w->solid->dir ) * z;
+         dy  = sin( 3.*M_PI/2. + w->solid->dir ) * z;
+         lx[0] = -gfx->sh/2.; /* Left and right edge. */
+         lx[1] = +gfx->sh/2.;
+
+         /* Fades in, full strength and fades out along the length. */
+         len[0] = 0.;
+         len[1] = 10.;
+         len[2] = 0.8*w->wp->range;
+         len[3] = w->wp->range;
+         for (i=0; i<4; i++) {
+            for (j=0; j<2; j++) {
+               vx[2*i+j] = x + lx[j]*dx - len[i]*dy;
+               vy[2*i+j] = y + lx[j]*dy + len[i]*dx;
+            }
+            ts[i] = w->anim + len[i] / gfx->sw;
+            ta[i] = ((i==0) || (i==3)) ? 0. : 1.;
+         }
 
-            glTexCoord2d( w->anim + w->outfit->u.bem.range / gfx->sw, 1. );
-            glVertex2d( +gfx->sh/2.*z, w->outfit->u.bem.range*z );
-         glEnd(); /* GL_QUAD_STRIP */
+         /* Queue the three segments so beams of the same texture batch. */
+         for (i=0; i<3; i++) {
+            weapon_beamVertex( vertex, tex, col, 0, vx[2*i], vy[2*i], ts[i], 0., ta[i] );
+            weapon_beamVertex( vertex, tex, col, 1, vx[2*i+1], vy[2*i+1], ts[i], 1., ta[i] );
+            weapon_beamVertex( vertex, tex, col, 2, vx[2*i+3], vy[2*i+3], ts[i+1], 1., ta[i+1] );
+            weapon_beamVertex( vertex, tex, col, 3, vx[2*i+2], vy[2*i+2], ts[i+1], 0., ta[i+1] );
+            gl_blitQuad( gfx, vertex, tex, col );
+         }
 
          /* Do the beam movement. */
          w->anim -= 5. * dt;
          if (w->anim <= -gfx->sw)
             w->anim += gfx->sw;
-
-         /* Clean up. */
-         glDisable(GL_TEXTURE_2D);
-         glShadeModel(GL_FLAT);
-         glPopMatrix();
-         gl_checkErr();
          break;
 
       default:
@@ -818,27 +943,14 @@ static int weapon_checkCanHit( Weapon* w, Pilot *p )
 {
    Pilot *parent;
 
-   /* Can't hit invincible stuff. */
-   if (pilot_isFlag(p, PILOT_INVINCIBLE))
-      return 0;
-
-   /* Can't hit invisible stuff. */
-   if (pilot_isFlag(p, PILOT_INVISIBLE))
+   /* Can't hit invincible, invisible, landing, taking off nor dead stuff. */
+   if (pilot_isFlagAny(p, PILOT_FLAGS_NOHIT))
       return 0;
 
    /* Can never hit same faction. */
    if (p->faction == w->faction)
       return 0;
 
-   /* Must not be landing nor taking off. */
-   if (pilot_isFlag(p, PILOT_LANDING) ||
-         pilot_isFlag(p, PILOT_TAKEOFF))
-      return 0;
-
-   /* Go "through" dead pilots. */
-   if (pilot_isFlag(p, PILOT_DEAD))
-      return 0;
-
    /* Player can not hit special pilots. */
    if ((w->faction == FACTION_PLAYER) &&
          pilot_isFlag(p, PILOT_INVINC_PLAYER))
@@ -885,42 +997,212 @@ static int weapon_checkCanHit( Weapon* w, Pilot *p )
 
 
 /**
- * @brief Updates an individual weapon.
+ * @brief Checks the path a weapon covers in a tick against a pilot.
  *
- *    @param w Weapon to update.
+ * The path is taken relative to the pilot so both moving is accounted for.
+ *
+ *    @return 1 if the weapon hits the pilot.
+ */
+static int weapon_sweepPilot( Weapon* w, Pilot *p, const double dt )
+{
+   double dx, dy;
+   Vector2d crash[2];
+
+   dx = (w->solid->vel.x - p->solid->vel.x) * dt;
+   dy = (w->solid->vel.y - p->solid->vel.y) * dt;
+   if (!CollideLineSprite( &w->solid->pos, ANGLE(dx,dy), MOD(dx,dy),
+            p->ship->gfx_space, p->tsx, p->tsy, &p->solid->pos, crash ))
+      return 0;
+
+   weapon_detected( w, p, &crash[0] );
+   return 1;
+}
+
+
+/**
+ * @brief Checks the path a bolt or ammo covers in a tick for hits.
+ *
+ * Sprite checks only happen at the positions the weapon is at each tick, so
+ *  a weapon moving further than its size in a tick could fly through a ship
+ *  between two of them. Checking the path in between keeps long ticks from
+ *  missing hits.
+ *
+ *    @param w Weapon to check.
+ *    @param gfx Graphic of the weapon.
+ *    @param q Grid query scratch space to use.
  *    @param dt Current delta tick.
- *    @param layer Layer to which the weapon belongs.
+ *    @return 1 if the weapon hits something.
  */
-static void weapon_update( Weapon* w, const double dt, WeaponLayer layer )
+static int weapon_sweep( Weapon* w, const glTexture *gfx, PilotGridQuery *q, const double dt )
+{
+   int i, n;
+   double dx, dy;
+   Pilot *p, **plist;
+
+   /* Slow weapons overlap their previous tick so they can't tunnel. */
+   dx = w->solid->vel.x * dt;
+   dy = w->solid->vel.y * dt;
+   if (pow2(dx) + pow2(dy) < pow2( MIN( gfx->sw, gfx->sh ) / 2. ))
+      return 0;
+
+   /* Smart weapons only collide with their target. */
+   if (weapon_isSmart(w)) {
+      p = pilot_get( w->target );
+      if ((p == NULL) || (w->parent == p->id) ||
+            (w->status != WEAPON_STATUS_OK) || !weapon_checkCanHit(w,p))
+         return 0;
+      return weapon_sweepPilot( w, p, dt );
+   }
+
+   /* Only pilots around the path can be hit. */
+   n = pilot_gridQueryRectWith( q,
+         MIN( w->solid->pos.x, w->solid->pos.x+dx ) - gfx->sw/2.,
+         MIN( w->solid->pos.y, w->solid->pos.y+dy ) - gfx->sh/2.,
+         MAX( w->solid->pos.x, w->solid->pos.x+dx ) + gfx->sw/2.,
+         MAX( w->solid->pos.y, w->solid->pos.y+dy ) + gfx->sh/2., &plist );
+   for (i=0; i<n; i++) {
+      p = plist[i];
+      if (w->parent == p->id) continue; /* pilot is self */
+
+      if (weapon_checkCanHit(w,p) && weapon_sweepPilot( w, p, dt ))
+         return 1;
+   }
+   return 0;
+}
+
+
+/**
+ * @brief Looks for what a bolt or ammo hits this tick.
+ *
+ * Runs on the worker threads, so only the weapon itself may be changed.
+ *
+ *    @param w Weapon to check.
+ *    @param q Grid query scratch space to use.
+ *    @param dt Current delta tick.
+ */
+static void weapon_detect( Weapon* w, PilotGridQuery *q, const double dt )
 {
-   int i, b, psx,psy;
+   int i, n, psx,psy;
    glTexture *gfx;
    Vector2d crash[2];
-   Pilot *p;
+   Pilot *p, **plist;
+
+   w->hit = 0;
+
+   /* Beams keep hitting, they are checked when applying. */
+   if ((w->wp->type == OUTFIT_TYPE_BEAM) || (w->wp->type == OUTFIT_TYPE_TURRET_BEAM))
+      return;
 
    /* Get the sprite direction to speed up calculations. */
-   b     = outfit_isBeam(w->outfit);
-   if (!b) {
-      gfx = outfit_gfx(w->outfit);
-      gl_getSpriteFromDir( &w->sx, &w->sy, gfx, w->solid->dir );
+   gfx = w->wp->gfx;
+   gl_getSpriteFromDir( &w->sx, &w->sy, gfx, w->solid->dir );
+
+   /* smart weapons only collide with their target */
+   if (weapon_isSmart(w)) {
+      p = pilot_get( w->target );
+      if ((p != NULL) && (w->parent != p->id) &&
+            (w->status == WEAPON_STATUS_OK) &&
+            weapon_checkCanHit(w,p) &&
+            CollideSprite( gfx, w->sx, w->sy, &w->solid->pos,
+                  p->ship->gfx_space, p->tsx, p->tsy,
+                  &p->solid->pos,
+                  &crash[0] )) {
+         weapon_detected( w, p, &crash[0] );
+         return;
+      }
    }
-   else
-      gfx = NULL;
+   /* dumb weapons hit anything not of the same faction */
+   else {
+      /* Only pilots overlapping the weapon's sprite can be hit. */
+      n = pilot_gridQueryRectWith( q, w->solid->pos.x - gfx->sw/2.,
+            w->solid->pos.y - gfx->sh/2.,
+            w->solid->pos.x + gfx->sw/2.,
+            w->solid->pos.y + gfx->sh/2., &plist );
+      for (i=0; i<n; i++) {
+         p = plist[i];
+         if (w->parent == p->id) continue; /* pilot is self */
+
+         psx = p->tsx;
+         psy = p->tsy;
+
+         if (weapon_checkCanHit(w,p) &&
+               CollideSprite( gfx, w->sx, w->sy, &w->solid->pos,
+                     p->ship->gfx_space, psx, psy,
+                     &p->solid->pos,
+                     &crash[0] )) {
+            weapon_detected( w, p, &crash[0] );
+            return;
+         }
+      }
+   }
+
+   /* Nothing at its position, check the way to the next one. */
+   weapon_sweep( w, gfx, q, dt );
+}
 
-   for (i=0; i<pilot_nstack; i++) {
-      p = pilot_stack[i];
 
-      psx = pilot_stack[i]->tsx;
-      psy = pilot_stack[i]->tsy;
+/**
+ * @brief Records the hit a weapon will apply.
+ *
+ *    @param w Weapon that hits.
+ *    @param p Pilot hit.
+ *    @param pos Position of the hit.
+ */
+static void weapon_detected( Weapon* w, const Pilot *p, const Vector2d *pos )
+{
+   w->hit       = 1;
+   w->hit_pilot = p->id;
+   w->hit_pos   = *pos;
+}
 
-      if (w->parent == pilot_stack[i]->id) continue; /* pilot is self */
 
-      /* Beam weapons have special collisions. */
-      if (b) {
+/**
+ * @brief Updates an individual weapon.
+ *
+ * Applies the hit weapon_detect() found, unless an earlier hit made the
+ *  pilot unhittable, and checks beams.
+ *
+ *    @param w Weapon to update.
+ *    @param dt Current delta tick.
+ *    @param layer Layer to which the weapon belongs.
+ */
+static void weapon_update( Weapon* w, const double dt, WeaponLayer layer )
+{
+   int i, n, psx,psy;
+   Vector2d crash[2], pos;
+   Pilot *p, **plist;
+   double bx,by, dx,dy, d, r2;
+
+   /* Beam weapons have special collisions. */
+   if ((w->wp->type == OUTFIT_TYPE_BEAM) || (w->wp->type == OUTFIT_TYPE_TURRET_BEAM)) {
+      /* Only pilots along the beam can be hit. */
+      n = pilot_gridQueryLine( &w->solid->pos, w->solid->dir,
+            w->wp->range, &plist );
+      bx = cos( w->solid->dir );
+      by = sin( w->solid->dir );
+      for (i=0; i<n; i++) {
+         p = plist[i];
+         if (w->parent == p->id) continue; /* pilot is self */
+
+         /* Cells are coarse, skip pilots whose bounding circle misses the beam. */
+         dx = p->solid->pos.x - w->solid->pos.x;
+         dy = p->solid->pos.y - w->solid->pos.y;
+         r2 = (pow2(p->ship->gfx_space->sw) + pow2(p->ship->gfx_space->sh)) / 4.;
+         if (pow2( dx*by - dy*bx ) > r2)
+            continue;
+         d = dx*bx + dy*by;
+         if (((d < 0.) && (pow2(d) > r2)) ||
+               ((d > w->wp->range) &&
+                  (pow2(d - w->wp->range) > r2)))
+            continue;
+
+         psx = p->tsx;
+         psy = p->tsy;
+
          /* Check for collision. */
          if (weapon_checkCanHit(w,p) &&
                CollideLineSprite( &w->solid->pos, w->solid->dir,
-                     w->outfit->u.bem.range,
+                     w->wp->range,
                      p->ship->gfx_space, psx, psy,
                      &p->solid->pos,
                      crash)) {
@@ -929,30 +1211,15 @@ static void weapon_update( Weapon* w, const double dt, WeaponLayer layer )
              * destroyed like the other weapons.*/
          }
       }
-      /* smart weapons only collide with their target */
-      else if (weapon_isSmart(w)) {
-
-         if ((pilot_stack[i]->id == w->target) &&
-               (w->status == WEAPON_STATUS_OK) &&
-               weapon_checkCanHit(w,p) &&
-               CollideSprite( gfx, w->sx, w->sy, &w->solid->pos,
-                     p->ship->gfx_space, psx, psy,
-                     &p->solid->pos,
-                     &crash[0] )) {
-            weapon_hit( w, p, layer, &crash[0] );
-            return; /* Weapon is destroyed. */
-         }
-      }
-      /* dumb weapons hit anything not of the same faction */
-      else {
-         if (weapon_checkCanHit(w,p) &&
-               CollideSprite( gfx, w->sx, w->sy, &w->solid->pos,
-                     p->ship->gfx_space, psx, psy,
-                     &p->solid->pos,
-                     &crash[0] )) {
-            weapon_hit( w, p, layer, &crash[0] );
-            return; /* Weapon is destroyed. */
-         }
+   }
+   /* Hit found, the weapon is destroyed. */
+   else if (w->hit) {
+      w->hit = 0; /* Only good for the step it was found in. */
+      p = pilot_get( w->hit_pilot );
+      if ((p != NULL) && weapon_checkCanHit(w,p)) {
+         pos = w->hit_pos;
+         weapon_hit( w, p, layer, &pos );
+         return;
       }
    }
 
@@ -963,9 +1230,10 @@ static void weapon_update( Weapon* w, const double dt, WeaponLayer layer )
    /* Update the solid position. */
    (*w->solid->update)(w->solid, dt);
 
-   /* Update the sound. */
-   sound_updatePos(w->voice, w->solid->pos.x, w->solid->pos.y,
-         w->solid->vel.x, w->solid->vel.y);
+   /* Update the sound, forget it once it's done so it isn't looked up anymore. */
+   if ((w->voice > 0) && sound_updatePos(w->voice, w->solid->pos.x,
+            w->solid->pos.y, w->solid->vel.x, w->solid->vel.y))
+      w->voice = -1;
 }
 
 
@@ -1005,8 +1273,7 @@ static void weapon_hitAI( Pilot *p, Pilot *shooter, double dmg )
          for (i=0; i<pilot_nstack; i++) {
             /* Skip if unsuitable. */
             if ((pilot_stack[i]->ai == NULL) || (pilot_stack[i]->id == p->id) ||
-                  (pilot_isFlag(pilot_stack[i], PILOT_DEAD)) ||
-                  (pilot_isFlag(pilot_stack[i], PILOT_DELETE)))
+                  pilot_isFlagAny(pilot_stack[i], PILOT_FLAGS_GONE))
                continue;
 
             /*
@@ -1159,7 +1426,7 @@ static double weapon_aimTurret( const Outfit *outfit, const Pilot *parent,
       const Pilot *pilot_target, const Vector2d *pos, const Vector2d *vel, double dir,
       double swivel, double time )
 {
-   Vector2d relative_location;
+   const PilotAim *aim;
    double rdir, lead_angle;
    double x, y, t;
    double off;
@@ -1167,9 +1434,8 @@ static double weapon_aimTurret( const Outfit *outfit, const Pilot *parent,
    if (pilot_target == NULL)
       rdir        = dir;
    else {
-      /* Get the vector : shooter -> target*/
-      vect_cset( &relative_location, VX(pilot_target->solid->pos) - VX(parent->solid->pos),
-            VY(pilot_target->solid->pos) - VY(parent->solid->pos) );
+      /* Get the vector : shooter -> target, shared by all the mounts. */
+      aim = pilot_weapAim( parent, pilot_target );
 
          /* Try to predict where the enemy will be. */
       t = time;
@@ -1189,12 +1455,12 @@ static double weapon_aimTurret( const Outfit *outfit, const Pilot *parent,
       lead_angle = M_PI*pilot_ewWeaponTrack( parent, pilot_target, outfit->u.blt.track );
 
       /*only do this if the lead angle is implemented; save compute cycled on fixed weapons*/
-      if (lead_angle && fabs( angle_diff(ANGLE(x, y), VANGLE(relative_location)) ) > lead_angle) {
+      if (lead_angle && fabs( angle_diff(rdir, VANGLE(aim->rel)) ) > lead_angle) {
          /* the target is moving too fast for the turret to keep up */
-         if (ANGLE(x, y) < VANGLE(relative_location))
-            rdir = angle_diff(lead_angle, VANGLE(relative_location));
+         if (rdir < VANGLE(aim->rel))
+            rdir = angle_diff(lead_angle, VANGLE(aim->rel));
          else
-            rdir = angle_diff(-1*lead_angle, VANGLE(relative_location));
+            rdir = angle_diff(-1*lead_angle, VANGLE(aim->rel));
       }
 
       /* Calculate bounds. */
@@ -1270,7 +1536,7 @@ static void weapon_createBolt( Weapon *w, const Outfit* outfit, double T,
          w->solid->vel.y);
 
    /* Set facing direction. */
-   gfx = outfit_gfx( w->outfit );
+   gfx = w->wp->gfx;
    gl_getSpriteFromDir( &w->sx, &w->sy, gfx, w->solid->dir );
 }
 
@@ -1299,7 +1565,7 @@ static void weapon_createAmmo( Weapon *w, const Outfit* launcher, double T,
 
    pilot_target = NULL;
    ammo = launcher->u.lau.ammo;
-   if (w->outfit->type == OUTFIT_TYPE_AMMO &&
+   if (w->wp->type == OUTFIT_TYPE_AMMO &&
             launcher->type == OUTFIT_TYPE_TURRET_LAUNCHER) {
       pilot_target = pilot_get(w->target);
       rdir = weapon_aimTurret( ammo, parent, pilot_target, pos, vel, dir, M_PI, time );
@@ -1320,21 +1586,21 @@ static void weapon_createAmmo( Weapon *w, const Outfit* launcher, double T,
    /* If thrust is 0. we assume it starts out at speed. */
    v = *vel;
    if (ammo->u.amm.thrust == 0.)
-      vect_cadd( &v, cos(rdir) * w->outfit->u.amm.speed,
-            sin(rdir) * w->outfit->u.amm.speed );
+      vect_cadd( &v, cos(rdir) * w->wp->speed,
+            sin(rdir) * w->wp->speed );
    w->real_vel = VMOD(v);
 
    /* Set up ammo details. */
    mass        = w->outfit->mass;
    w->timer    = ammo->u.amm.duration;
    w->solid    = solid_create( mass, rdir, pos, &v, SOLID_UPDATE_RK4 );
-   if (w->outfit->u.amm.thrust != 0.) {
-      weapon_setThrust( w, w->outfit->u.amm.thrust * mass );
-      w->solid->speed_max = w->outfit->u.amm.speed; /* Limit speed, we only care if it has thrust. */
+   if (w->wp->thrust != 0.) {
+      weapon_setThrust( w, w->wp->thrust * mass );
+      w->solid->speed_max = w->wp->speed; /* Limit speed, we only care if it has thrust. */
    }
 
    /* Handle seekers. */
-   if (w->outfit->u.amm.ai != AMMO_AI_DUMB) {
+   if (w->wp->ai != AMMO_AI_DUMB) {
       w->think = think_seeker; /* AI is the same atm. */
 
       /* If they are seeking a pilot, increment lockon counter. */
@@ -1352,7 +1618,7 @@ static void weapon_createAmmo( Weapon *w, const Outfit* launcher, double T,
          w->solid->vel.y);
 
    /* Set facing direction. */
-   gfx = outfit_gfx( w->outfit );
+   gfx = w->wp->gfx;
    gl_getSpriteFromDir( &w->sx, &w->sy, gfx, w->solid->dir );
 }
 
@@ -1379,7 +1645,7 @@ static Weapon* weapon_create( const Outfit* outfit, double T,
    Weapon* w;
 
    /* Create basic features */
-   w           = calloc( 1, sizeof(Weapon) );
+   w           = weapon_alloc();
    w->dam_mod  = 1.; /* Default of 100% damage. */
    w->faction  = parent->faction; /* non-changeable */
    w->parent   = parent->id; /* non-changeable */
@@ -1388,6 +1654,7 @@ static Weapon* weapon_create( const Outfit* outfit, double T,
       w->outfit   = outfit->u.lau.ammo; /* non-changeable */
    else
       w->outfit   = outfit; /* non-changeable */
+   w->wp       = w->outfit->weapon;
    w->update   = weapon_update;
    w->status   = WEAPON_STATUS_OK;
    w->strength = 1.;
@@ -1494,6 +1761,7 @@ void weapon_add( const Outfit* outfit, const double T, const double dir,
          WARN("Unknown weapon layer!");
    }
 
+   w->lpos = *nLayer;
    if (*mLayer > *nLayer) /* more memory alloced than needed */
       curLayer[(*nLayer)++] = w;
    else { /* need to allocate more memory */
@@ -1516,9 +1784,6 @@ void weapon_add( const Outfit* outfit, const double T, const double dir,
       weapon_vboSize = mwfrontLayer + mwbacklayer;
       size = sizeof(GLfloat) * (2+4) * weapon_vboSize;
       weapon_vboData = realloc( weapon_vboData, size );
-      if (weapon_vbo == NULL)
-         weapon_vbo = gl_vboCreateStream( size, NULL );
-      gl_vboData( weapon_vbo, size, weapon_vboData );
    }
 }
 
@@ -1577,6 +1842,7 @@ unsigned int beam_start( const Outfit* outfit,
          return -1;
    }
 
+   w->lpos = *nLayer;
    if (*mLayer > *nLayer) /* more memory alloced than needed */
       curLayer[(*nLayer)++] = w;
    else { /* need to allocate more memory */
@@ -1599,9 +1865,6 @@ unsigned int beam_start( const Outfit* outfit,
       weapon_vboSize = mwfrontLayer + mwbacklayer;
       size = sizeof(GLfloat) * (2+4) * weapon_vboSize;
       weapon_vboData = realloc( weapon_vboData, size );
-      if (weapon_vbo == NULL)
-         weapon_vbo = gl_vboCreateStream( size, NULL );
-      gl_vboData( weapon_vbo, size, weapon_vboData );
    }
 
    return w->ID;
@@ -1642,7 +1905,7 @@ void beam_end( const unsigned int parent, unsigned int beam )
 
    /* Now try to destroy the beam. */
    for (i=0; i<*nLayer; i++) {
-      if (curLayer[i]->ID == beam) { /* Found it. */
+      if ((curLayer[i] != NULL) && (curLayer[i]->ID == beam)) { /* Found it. */
          weapon_destroy(curLayer[i], layer);
          break;
       }
@@ -1677,18 +1940,24 @@ static void weapon_destroy( Weapon* w, WeaponLayer layer )
          return;
    }
 
-   for (i=0; (wlayer[i] != w) && (i < *nlayer); i++); /* get to the current position */
-   if (i >= *nlayer) {
+   i = w->lpos;
+   if ((i < 0) || (i >= *nlayer) || (wlayer[i] != w)) {
       WARN("Trying to destroy weapon not found in stack!");
       return;
    }
 
-   weapon_free(wlayer[i]);
-   wlayer[i] = NULL;
-   (*nlayer)--;
+   weapon_free(w);
 
-   for ( ; i < (*nlayer); i++)
-      wlayer[i] = wlayer[i+1];
+   /* The layer is in draw order, so it must be kept. */
+   if (weapon_defer) {
+      wlayer[i] = NULL;
+      return;
+   }
+   (*nlayer)--;
+   memmove( &wlayer[i], &wlayer[i+1], sizeof(Weapon*) * (*nlayer-i) );
+   for (; i<*nlayer; i++)
+      wlayer[i]->lpos = i;
+   wlayer[*nlayer] = NULL;
 }
 
 
@@ -1725,9 +1994,63 @@ static void weapon_free( Weapon* w )
    memset(w, 0, sizeof(Weapon));
 #endif /* DEBUGGING */
 
-   free(w);
+   /* Give it back to the storage. */
+   weapon_unused[ weapon_nunused++ ] = w;
 }
 
+
+/**
+ * @brief Gets a cleared weapon from the storage.
+ *
+ *    @return A zeroed weapon.
+ */
+static Weapon* weapon_alloc (void)
+{
+   int i;
+   Weapon *page, *w;
+
+   /* Out of weapons, add a new page. */
+   if (weapon_nunused == 0) {
+      page = malloc( WEAPON_PAGE * sizeof(Weapon) );
+      if (page == NULL)
+         ERR("Out of Memory");
+      weapon_npages++;
+      weapon_pages = realloc( weapon_pages, weapon_npages * sizeof(Weapon*) );
+      weapon_pages[ weapon_npages-1 ] = page;
+
+      if (weapon_munused < WEAPON_PAGE * weapon_npages) {
+         weapon_munused = WEAPON_PAGE * weapon_npages;
+         weapon_unused  = realloc( weapon_unused, weapon_munused * sizeof(Weapon*) );
+      }
+      /* Pushed in reverse so they get handed out in memory order. */
+      for (i=WEAPON_PAGE-1; i>=0; i--)
+         weapon_unused[ weapon_nunused++ ] = &page[i];
+   }
+
+   w = weapon_unused[ --weapon_nunused ];
+   memset( w, 0, sizeof(Weapon) );
+   return w;
+}
+
+/**
+ * @brief Gets the memory used by the weapons.
+ *
+ * Storage pages are never given back, so this is the peak since the last
+ *  weapon_exit().
+ *
+ *    @param[out] n Number of weapons flying.
+ *    @return Bytes used.
+ */
+size_t weapon_memUsage( int *n )
+{
+   *n = nwbackLayer + nwfrontLayer;
+   return weapon_npages * (WEAPON_PAGE * sizeof(Weapon) + sizeof(Weapon*)) +
+         *n * sizeof(Solid) +
+         (mwbacklayer + mwfrontLayer + weapon_munused) * sizeof(Weapon*) +
+         weapon_mjammers * sizeof(WeaponJammer);
+}
+
+
 /**
  * @brief Clears all the weapons, does NOT free the layers.
  */
@@ -1752,6 +2075,8 @@ void weapon_clear (void)
  */
 void weapon_exit (void)
 {
+   int i;
+
    weapon_clear();
 
    /* Destroy front layer. */
@@ -1768,27 +2093,38 @@ void weapon_exit (void)
       mwfrontLayer = 0;
    }
 
-   /* Destroy VBO. */
-   if (weapon_vbo != NULL) {
-      free( weapon_vboData );
-      weapon_vboData = NULL;
-      gl_vboDestroy( weapon_vbo );
-      weapon_vbo = NULL;
-   }
+   /* Destroy storage. */
+   for (i=0; i<weapon_npages; i++)
+      free( weapon_pages[i] );
+   free( weapon_pages );
+   free( weapon_unused );
+   free( weapon_jammers );
+   weapon_jammers  = NULL;
+   weapon_njammers = 0;
+   weapon_mjammers = 0;
+   weapon_pages   = NULL;
+   weapon_npages  = 0;
+   weapon_unused  = NULL;
+   weapon_nunused = 0;
+   weapon_munused = 0;
+
+   /* Free the minimap points. */
+   free( weapon_vboData );
+   weapon_vboData = NULL;
+   weapon_vboSize = 0;
 }
 
 
 /**
- * @brief Clears possible exploded weapons.
+ * @brief Clears weapons caught in explosions.
+ *
+ *    @param expl Explosions to check.
+ *    @param nexpl Number of explosions.
  */
-void weapon_explode( double x, double y, double radius,
-      int dtype, double damage,
-      const Pilot *parent, int mode )
+void weapon_explode( const ExplosionDamage *expl, int nexpl )
 {
-   (void)dtype;
-   (void)damage;
-   weapon_explodeLayer( WEAPON_LAYER_FG, x, y, radius, parent, mode );
-   weapon_explodeLayer( WEAPON_LAYER_BG, x, y, radius, parent, mode );
+   weapon_explodeLayer( WEAPON_LAYER_FG, expl, nexpl );
+   weapon_explodeLayer( WEAPON_LAYER_BG, expl, nexpl );
 }
 
 
@@ -1796,14 +2132,13 @@ void weapon_explode( double x, double y, double radius,
  * @brief Explodes all the things on a layer.
  */
 static void weapon_explodeLayer( WeaponLayer layer,
-      double x, double y, double radius,
-      const Pilot *parent, int mode )
+      const ExplosionDamage *expl, int nexpl )
 {
-   (void)parent;
-   int i;
+   int i, j, mode;
    Weapon **curLayer;
    int *nLayer;
-   double dist, rad2;
+   double dist;
+   const ExplosionDamage *e;
 
    /* set the proper layer */
    switch (layer) {
@@ -1821,19 +2156,30 @@ static void weapon_explodeLayer( WeaponLayer layer,
          return;
    }
 
-   rad2 = radius*radius;
-
    /* Now try to destroy the weapons affected. */
    for (i=0; i<*nLayer; i++) {
-      if (((mode & EXPL_MODE_MISSILE) && outfit_isAmmo(curLayer[i]->outfit)) ||
-            ((mode & EXPL_MODE_BOLT) && outfit_isBolt(curLayer[i]->outfit))) {
+      if (curLayer[i] == NULL)
+         continue;
+      if (outfit_isAmmo(curLayer[i]->outfit))
+         mode = EXPL_MODE_MISSILE;
+      else if (outfit_isBolt(curLayer[i]->outfit))
+         mode = EXPL_MODE_BOLT;
+      else
+         continue;
 
-         dist = pow2(curLayer[i]->solid->pos.x - x) +
-               pow2(curLayer[i]->solid->pos.y - y);
+      for (j=0; j<nexpl; j++) {
+         e = &expl[j];
+         if (!(e->mode & mode))
+            continue;
+
+         dist = pow2(curLayer[i]->solid->pos.x - e->x) +
+               pow2(curLayer[i]->solid->pos.y - e->y);
 
-         if (dist < rad2) {
+         if (dist < pow2(e->radius)) {
             weapon_destroy(curLayer[i], layer);
-            i--;
+            if (!weapon_defer)
+               i--; /* The next weapon moved into its place. */
+            break;
          }
       }
    }
@@ -11,6 +11,7 @@
 #include "outfit.h"
 #include "physics.h"
 #include "pilot.h"
+#include "explosion.h"
 
 
 /**
@@ -42,9 +43,7 @@ void beam_end( const unsigned int parent, unsigned int beam );
 /*
  * Misc stuff.
  */
-void weapon_explode( double x, double y, double radius,
-      int dtype, double damage,
-      const Pilot *parent, int mode );
+void weapon_explode( const ExplosionDamage *expl, int nexpl );
 
 
 /*
@@ -54,6 +53,12 @@ void weapons_update( const double dt );
 void weapons_render( const WeaponLayer layer, const double dt );
 
 
+/*
+ * memory
+ */
+size_t weapon_memUsage( int *n );
+
+
 /*
  * clean
  */